@@ -16,10 +16,12 @@
 
  #define LOG_TAG "atrace"
 
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
 #include <inttypes.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdbool.h>
@@ -31,6 +33,11 @@
 #include <unistd.h>
 #include <zlib.h>
 
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <vector>
+
 #include <binder/IBinder.h>
 #include <binder/IServiceManager.h>
 #include <binder/Parcel.h>
@@ -183,9 +190,12 @@ static const char* g_categoriesFile = NULL;
 static const char* g_kernelTraceFuncs = NULL;
 static const char* g_debugAppCmdLine = "";
 static const char* g_outputFile = nullptr;
+static int g_ringBufferSizeKB = 0;
+static bool g_rawCapture = false;
 
 /* Global state */
 static bool g_traceAborted = false;
+static volatile sig_atomic_t g_snapshotRequested = 0;
 static bool g_categoryEnables[NELEM(k_categories)] = {};
 
 /* Sys file paths */
@@ -234,6 +244,9 @@ static const char* k_traceStreamPath =
 static const char* k_traceMarkerPath =
     "/sys/kernel/debug/tracing/trace_marker";
 
+static const char* k_tracingPath =
+    "/sys/kernel/debug/tracing";
+
 // Check whether a file exists.
 static bool fileExists(const char* filename) {
     return access(filename, F_OK) != -1;
@@ -486,8 +499,10 @@ static bool pokeBinderServices()
         sp<IBinder> obj = sm->checkService(services[i]);
         if (obj != NULL) {
             Parcel data;
+            // One way, so that a busy process can't hold up the others: all
+            // it does is to read the properties again.
             if (obj->transact(IBinder::SYSPROPS_TRANSACTION, data,
-                    NULL, 0) != OK) {
+                    NULL, IBinder::FLAG_ONEWAY) != OK) {
                 if (false) {
                     // XXX: For some reason this fails on tablets trying to
                     // poke the "phone" service.  It's not clear whether some
@@ -505,6 +520,40 @@ static bool pokeBinderServices()
 
 // Set the trace tags that userland tracing uses, and poke the running
 // processes to pick up the new value.
+// Get what processes look at when they're poked: the tags and the list of
+// apps to trace.
+static std::string getTraceProperties()
+{
+    char value[PROPERTY_VALUE_MAX];
+    char key[PROPERTY_KEY_MAX];
+    // Unset is the same as no tags.
+    property_get(k_traceTagsProperty, value, "0");
+    std::string properties(String8::format("%#" PRIx64,
+            (uint64_t) strtoull(value, NULL, 0)).string());
+
+    property_get(k_traceAppsNumberProperty, value, "");
+    int numApps = std::min(atoi(value), MAX_PACKAGES);
+    for (int i = 0; i < numApps; i++) {
+        snprintf(key, sizeof(key), k_traceAppsPropertyTemplate, i);
+        property_get(key, value, "");
+        if (value[0]) {
+            properties += ",";
+            properties += value;
+        }
+    }
+    return properties;
+}
+
+// Poke the binder services only if the properties they read changed since
+// they were last poked: tracing only kernel events then disturbs no one.
+static bool pokeBinderServicesIfChanged(const std::string& previousProperties)
+{
+    if (getTraceProperties() == previousProperties) {
+        return true;
+    }
+    return pokeBinderServices();
+}
+
 static bool setTagsProperty(uint64_t tags)
 {
     char buf[PROPERTY_VALUE_MAX];
@@ -729,6 +778,7 @@ static bool setUpTrace()
     ok &= setKernelTraceFuncs(g_kernelTraceFuncs);
 
     // Set up the tags property.
+    std::string previousProperties = getTraceProperties();
     uint64_t tags = 0;
     for (int i = 0; i < NELEM(k_categories); i++) {
         if (g_categoryEnables[i]) {
@@ -755,7 +805,7 @@ static bool setUpTrace()
         packageList += value;
     }
     ok &= setAppCmdlineProperty(packageList.data());
-    ok &= pokeBinderServices();
+    ok &= pokeBinderServicesIfChanged(previousProperties);
 
     // Disable all the sysfs enables.  This is done as a separate loop from
     // the enables to allow the same enable to exist in multiple categories.
@@ -790,9 +840,10 @@ static void cleanUpTrace()
     disableKernelTraceEvents();
 
     // Reset the system properties.
+    std::string previousProperties = getTraceProperties();
     setTagsProperty(0);
     clearAppProperties();
-    pokeBinderServices();
+    pokeBinderServicesIfChanged(previousProperties);
 
     // Set the options back to their defaults.
     setTraceOverwriteEnable(true);
@@ -840,6 +891,481 @@ static void streamTrace()
     }
 }
 
+// Size of the pieces of trace compressed at once in the ring buffer.
+static const size_t k_ringChunkSize = 256*1024;
+
+static bool writeFully(int fd, const uint8_t* data, size_t size)
+{
+    while (size > 0) {
+        ssize_t written = TEMP_FAILURE_RETRY(write(fd, data, size));
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+// Write data to outFd, deflating it into zs unless it's null. The stream
+// is ended when finish is set.
+static bool writeTraceData(int outFd, z_stream* zs, const uint8_t* data,
+        size_t size, bool finish)
+{
+    if (zs == NULL) {
+        return writeFully(outFd, data, size);
+    }
+
+    uint8_t out[64*1024];
+    zs->next_in = const_cast<uint8_t*>(data);
+    zs->avail_in = size;
+    int result;
+    do {
+        zs->next_out = out;
+        zs->avail_out = sizeof(out);
+        result = deflate(zs, finish ? Z_FINISH : Z_NO_FLUSH);
+        if (result == Z_STREAM_ERROR) {
+            fprintf(stderr, "error deflating trace: %s\n", zs->msg);
+            return false;
+        }
+        if (!writeFully(outFd, out, sizeof(out) - zs->avail_out)) {
+            fprintf(stderr, "error writing deflated trace: %s (%d)\n",
+                    strerror(errno), errno);
+            return false;
+        }
+    } while (zs->avail_out == 0 || (finish && result != Z_STREAM_END));
+    return true;
+}
+
+// Write the trace kept in the ring buffer, followed by what hasn't been
+// compressed yet, the same way dumpTrace() does.
+static void writeRingSnapshot(const std::deque<std::vector<uint8_t>>& ring,
+        const uint8_t* pending, size_t pendingSize)
+{
+    int outFd = STDOUT_FILENO;
+    if (g_outputFile) {
+        outFd = open(g_outputFile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (outFd == -1) {
+            fprintf(stderr, "error opening %s: %s (%d)\n", g_outputFile,
+                    strerror(errno), errno);
+            return;
+        }
+    }
+    ALOGI("Writing trace snapshot");
+    dprintf(outFd, "TRACE:\n");
+
+    z_stream out;
+    memset(&out, 0, sizeof(out));
+    if (g_compress && deflateInit(&out, Z_DEFAULT_COMPRESSION) != Z_OK) {
+        fprintf(stderr, "error initializing zlib\n");
+        g_compress = false;
+    }
+    z_stream* zs = g_compress ? &out : NULL;
+
+    std::vector<uint8_t> chunk(k_ringChunkSize);
+    bool ok = true;
+    for (const auto& compressed : ring) {
+        if (!ok) {
+            break;
+        }
+        uLongf size = chunk.size();
+        if (uncompress(chunk.data(), &size, compressed.data(),
+                compressed.size()) != Z_OK) {
+            fprintf(stderr, "error inflating trace chunk\n");
+            continue;
+        }
+        ok = writeTraceData(outFd, zs, chunk.data(), size, false);
+    }
+    if (ok) {
+        writeTraceData(outFd, zs, pending, pendingSize, true);
+    }
+
+    if (zs != NULL) {
+        deflateEnd(zs);
+    }
+    if (g_outputFile) {
+        close(outFd);
+    }
+}
+
+// Read data from the tracing pipe and keep the last g_ringBufferSizeKB of it,
+// compressed, until a snapshot is requested with SIGUSR1.
+static void ringTrace()
+{
+    int traceFD = open(k_traceStreamPath, O_RDWR);
+    if (traceFD == -1) {
+        fprintf(stderr, "error opening %s: %s (%d)\n", k_traceStreamPath,
+                strerror(errno), errno);
+        return;
+    }
+
+    // Each chunk is compressed on its own, so that the oldest one can be
+    // dropped when the ring is full. Favor speed, this runs all the time.
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit(&zs, Z_BEST_SPEED) != Z_OK) {
+        fprintf(stderr, "error initializing zlib\n");
+        close(traceFD);
+        return;
+    }
+
+    const size_t ringSize = (size_t) g_ringBufferSizeKB * 1024;
+    std::deque<std::vector<uint8_t>> ring;
+    size_t ringUsed = 0;
+    std::vector<uint8_t> pending(k_ringChunkSize);
+    size_t pendingSize = 0;
+
+    while (!g_traceAborted) {
+        if (g_snapshotRequested) {
+            g_snapshotRequested = 0;
+            writeRingSnapshot(ring, pending.data(), pendingSize);
+        }
+
+        ssize_t bytes_read = read(traceFD, pending.data() + pendingSize,
+                k_ringChunkSize - pendingSize);
+        if (bytes_read <= 0) {
+            if (bytes_read < 0 && errno == EINTR) {
+                continue;
+            }
+            if (!g_traceAborted) {
+                fprintf(stderr, "read returned %zd bytes err %d (%s)\n",
+                        bytes_read, errno, strerror(errno));
+            }
+            break;
+        }
+        pendingSize += bytes_read;
+        if (pendingSize < k_ringChunkSize) {
+            continue;
+        }
+
+        std::vector<uint8_t> compressed(deflateBound(&zs, pendingSize));
+        zs.next_in = pending.data();
+        zs.avail_in = pendingSize;
+        zs.next_out = compressed.data();
+        zs.avail_out = compressed.size();
+        int result = deflate(&zs, Z_FINISH);
+        if (result == Z_STREAM_END) {
+            compressed.resize(compressed.size() - zs.avail_out);
+            ringUsed += compressed.size();
+            ring.push_back(std::move(compressed));
+            while (ringUsed > ringSize && ring.size() > 1) {
+                ringUsed -= ring.front().size();
+                ring.pop_front();
+            }
+        } else {
+            fprintf(stderr, "error deflating trace: %s\n", zs.msg);
+        }
+        deflateReset(&zs);
+        pendingSize = 0;
+    }
+
+    deflateEnd(&zs);
+    close(traceFD);
+}
+
+// Binary capture: the per-CPU ring buffer pages are moved from
+// per_cpu/cpuN/trace_pipe_raw to files with splice() as they fill up, and
+// written out with the event formats in the trace-cmd "trace.dat" (version 6)
+// layout, which tools like trace-cmd and kernelshark decode offline. This
+// saves the kernel from formatting every event as text.
+struct RawCapture {
+    struct Cpu {
+        int traceFd;
+        int pipe[2];
+        int fileFd;
+        uint64_t size;
+    };
+    std::vector<Cpu> cpus;
+    size_t pageSize;
+};
+
+static void closeRawCapture(RawCapture* capture)
+{
+    for (auto& cpu : capture->cpus) {
+        if (cpu.traceFd != -1) close(cpu.traceFd);
+        if (cpu.pipe[0] != -1) close(cpu.pipe[0]);
+        if (cpu.pipe[1] != -1) close(cpu.pipe[1]);
+        if (cpu.fileFd != -1) close(cpu.fileFd);
+    }
+    capture->cpus.clear();
+}
+
+// Open the raw trace of every CPU, and an anonymous file next to the output
+// file to hold it until the capture ends.
+static bool openRawCapture(RawCapture* capture)
+{
+    capture->pageSize = sysconf(_SC_PAGESIZE);
+    long numCpus = sysconf(_SC_NPROCESSORS_CONF);
+    for (long i = 0; i < numCpus; i++) {
+        RawCapture::Cpu cpu = { -1, { -1, -1 }, -1, 0 };
+        String8 path = String8::format("%s/per_cpu/cpu%ld/trace_pipe_raw",
+                k_tracingPath, i);
+        cpu.traceFd = open(path.string(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (cpu.traceFd == -1) {
+            fprintf(stderr, "error opening %s: %s (%d)\n", path.string(),
+                    strerror(errno), errno);
+            closeRawCapture(capture);
+            return false;
+        }
+        capture->cpus.push_back(cpu);
+        RawCapture::Cpu& added = capture->cpus.back();
+
+        String8 tmpPath = String8::format("%s.cpu%ldXXXXXX", g_outputFile, i);
+        added.fileFd = mkstemp(tmpPath.lockBuffer(tmpPath.size()));
+        tmpPath.unlockBuffer();
+        if (added.fileFd == -1 || pipe2(added.pipe, O_CLOEXEC) == -1) {
+            fprintf(stderr, "error setting up capture of cpu %ld: %s (%d)\n",
+                    i, strerror(errno), errno);
+            if (added.fileFd != -1) unlink(tmpPath.string());
+            closeRawCapture(capture);
+            return false;
+        }
+        unlink(tmpPath.string());
+    }
+    return true;
+}
+
+// Move the full pages of a CPU's ring buffer to its file, without copying
+// them. Returns false once there is nothing left to read.
+static bool spliceRawPages(const RawCapture& capture, RawCapture::Cpu* cpu)
+{
+    ssize_t spliced = splice(cpu->traceFd, NULL, cpu->pipe[1], NULL,
+            16 * capture.pageSize, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (spliced <= 0) {
+        if (spliced == -1 && errno != EAGAIN) {
+            fprintf(stderr, "error splicing trace: %s (%d)\n", strerror(errno),
+                    errno);
+        }
+        return false;
+    }
+    while (spliced > 0) {
+        ssize_t written = splice(cpu->pipe[0], NULL, cpu->fileFd, NULL,
+                spliced, SPLICE_F_MOVE);
+        if (written <= 0) {
+            fprintf(stderr, "error splicing trace: %s (%d)\n", strerror(errno),
+                    errno);
+            return false;
+        }
+        spliced -= written;
+        cpu->size += written;
+    }
+    return true;
+}
+
+// Capture the trace until the deadline, or until tracing is aborted.
+static void captureRawTrace(RawCapture* capture, nsecs_t deadline)
+{
+    std::vector<struct pollfd> pfds;
+    for (const auto& cpu : capture->cpus) {
+        pfds.push_back({ cpu.traceFd, POLLIN, 0 });
+    }
+    while (!g_traceAborted) {
+        nsecs_t left = deadline - systemTime(CLOCK_MONOTONIC);
+        if (left <= 0) {
+            break;
+        }
+        // The raw trace only polls readable once pages are full, don't rely
+        // on it for long.
+        int timeoutMs = std::min<nsecs_t>(left / 1000000 + 1, 100);
+        poll(pfds.data(), pfds.size(), timeoutMs);
+        for (auto& cpu : capture->cpus) {
+            while (spliceRawPages(*capture, &cpu));
+        }
+    }
+}
+
+// Move everything left in the ring buffers to the files. splice() only moves
+// full pages, so the last, partially filled, page of each CPU is read.
+static void drainRawTrace(RawCapture* capture)
+{
+    std::vector<uint8_t> page(capture->pageSize);
+    for (auto& cpu : capture->cpus) {
+        while (spliceRawPages(*capture, &cpu));
+        ssize_t bytes;
+        while ((bytes = read(cpu.traceFd, page.data(), page.size())) > 0) {
+            // Keep the pages aligned, their header tells how much is used.
+            memset(page.data() + bytes, 0, page.size() - bytes);
+            if (!writeFully(cpu.fileFd, page.data(), page.size())) {
+                fprintf(stderr, "error writing trace: %s (%d)\n",
+                        strerror(errno), errno);
+                break;
+            }
+            cpu.size += page.size();
+        }
+    }
+}
+
+static bool readFileToString(const String8& path, std::string* content)
+{
+    content->clear();
+    int fd = open(path.string(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    char buf[4096];
+    ssize_t bytes;
+    while ((bytes = read(fd, buf, sizeof(buf))) > 0) {
+        content->append(buf, bytes);
+    }
+    close(fd);
+    return bytes == 0;
+}
+
+// Helpers writing trace.dat values in the byte order of this device.
+static void appendInt(std::string* out, const void* value, size_t size)
+{
+    out->append(static_cast<const char*>(value), size);
+}
+
+static void appendU32(std::string* out, uint32_t value)
+{
+    appendInt(out, &value, sizeof(value));
+}
+
+static void appendU64(std::string* out, uint64_t value)
+{
+    appendInt(out, &value, sizeof(value));
+}
+
+// Append the "format" files of every event of a system, preceded by their
+// count.
+static void appendEventFormats(std::string* out, const char* system)
+{
+    String8 systemPath = String8::format("%s/events/%s", k_tracingPath, system);
+    std::vector<std::string> formats;
+    DIR* dir = opendir(systemPath.string());
+    if (dir != NULL) {
+        struct dirent* entry;
+        std::string format;
+        while ((entry = readdir(dir)) != NULL) {
+            if (entry->d_name[0] == '.' || entry->d_type != DT_DIR) continue;
+            String8 path = String8::format("%s/%s/format", systemPath.string(),
+                    entry->d_name);
+            if (readFileToString(path, &format)) {
+                formats.push_back(format);
+            }
+        }
+        closedir(dir);
+    }
+    appendU32(out, formats.size());
+    for (const auto& format : formats) {
+        appendU64(out, format.size());
+        out->append(format);
+    }
+}
+
+// Append a tracing file preceded by its size, written on sizeBytes bytes.
+static void appendSizedFile(std::string* out, const String8& path,
+        size_t sizeBytes)
+{
+    std::string content;
+    readFileToString(path, &content);
+    if (sizeBytes == 4) {
+        appendU32(out, content.size());
+    } else {
+        appendU64(out, content.size());
+    }
+    out->append(content);
+}
+
+// Write the captured trace with everything needed to decode it.
+static bool writeRawTrace(const RawCapture& capture, int outFd)
+{
+    std::string header("\027\010\104tracing", 10);
+    header.append("6", 2);
+    uint16_t endianCheck = 1;
+    header.push_back(*reinterpret_cast<uint8_t*>(&endianCheck) == 1 ? 0 : 1);
+
+    // The size of the kernel's longs, which may not be ours, is the size of
+    // the commit field of the page header.
+    std::string headerPage;
+    readFileToString(String8::format("%s/events/header_page", k_tracingPath),
+            &headerPage);
+    int longSize = sizeof(long);
+    size_t commit = headerPage.find("commit;");
+    if (commit != std::string::npos) {
+        size_t size = headerPage.find("size:", commit);
+        if (size != std::string::npos) {
+            longSize = atoi(headerPage.c_str() + size + strlen("size:"));
+        }
+    }
+    header.push_back(longSize);
+    appendU32(&header, capture.pageSize);
+
+    header.append("header_page", sizeof("header_page"));
+    appendU64(&header, headerPage.size());
+    header.append(headerPage);
+    header.append("header_event", sizeof("header_event"));
+    appendSizedFile(&header, String8::format("%s/events/header_event",
+            k_tracingPath), 8);
+
+    appendEventFormats(&header, "ftrace");
+    std::vector<std::string> systems;
+    String8 eventsPath = String8::format("%s/events", k_tracingPath);
+    DIR* dir = opendir(eventsPath.string());
+    if (dir != NULL) {
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (entry->d_name[0] == '.' || entry->d_type != DT_DIR ||
+                    !strcmp(entry->d_name, "ftrace")) {
+                continue;
+            }
+            systems.push_back(entry->d_name);
+        }
+        closedir(dir);
+    }
+    appendU32(&header, systems.size());
+    for (const auto& system : systems) {
+        header.append(system.c_str(), system.size() + 1);
+        appendEventFormats(&header, system.c_str());
+    }
+
+    appendSizedFile(&header, String8("/proc/kallsyms"), 4);
+    appendSizedFile(&header, String8::format("%s/printk_formats", k_tracingPath), 4);
+    appendSizedFile(&header, String8::format("%s/saved_cmdlines", k_tracingPath), 8);
+
+    appendU32(&header, capture.cpus.size());
+    header.append("flyrecord", sizeof("flyrecord"));
+
+    // The data of each CPU follows, starting on a page boundary.
+    uint64_t offset = header.size() + 16 * capture.cpus.size();
+    std::vector<uint64_t> offsets;
+    for (const auto& cpu : capture.cpus) {
+        offset = (offset + capture.pageSize - 1) & ~(uint64_t) (capture.pageSize - 1);
+        offsets.push_back(offset);
+        appendU64(&header, offset);
+        appendU64(&header, cpu.size);
+        offset += cpu.size;
+    }
+
+    if (!writeFully(outFd, reinterpret_cast<const uint8_t*>(header.data()),
+            header.size())) {
+        fprintf(stderr, "error writing trace: %s (%d)\n", strerror(errno), errno);
+        return false;
+    }
+    uint64_t written = header.size();
+    std::vector<uint8_t> padding(capture.pageSize);
+    for (size_t i = 0; i < capture.cpus.size(); i++) {
+        if (!writeFully(outFd, padding.data(), offsets[i] - written)) {
+            fprintf(stderr, "error writing trace: %s (%d)\n", strerror(errno), errno);
+            return false;
+        }
+        off_t fileOffset = 0;
+        uint64_t left = capture.cpus[i].size;
+        while (left > 0) {
+            ssize_t sent = sendfile(outFd, capture.cpus[i].fileFd, &fileOffset, left);
+            if (sent <= 0) {
+                fprintf(stderr, "error writing trace: %s (%d)\n", strerror(errno),
+                        errno);
+                return false;
+            }
+            left -= sent;
+        }
+        written = offsets[i] + capture.cpus[i].size;
+    }
+    return true;
+}
+
 // Read the current kernel trace and write it to stdout.
 static void dumpTrace(int outFd)
 {
@@ -945,6 +1471,11 @@ static void handleSignal(int /*signo*/)
     }
 }
 
+static void handleSnapshotSignal(int /*signo*/)
+{
+    g_snapshotRequested = 1;
+}
+
 static void registerSigHandler()
 {
     struct sigaction sa;
@@ -955,6 +1486,10 @@ static void registerSigHandler()
     sigaction(SIGINT, &sa, NULL);
     sigaction(SIGQUIT, &sa, NULL);
     sigaction(SIGTERM, &sa, NULL);
+
+    // Not restarted, so that a blocked read of the trace pipe returns right away.
+    sa.sa_handler = handleSnapshotSignal;
+    sigaction(SIGUSR1, &sa, NULL);
 }
 
 static void listSupportedCategories()
@@ -991,6 +1526,12 @@ static void showHelp(const char *cmd)
                     "                    Note: this can take significant CPU time, and is best\n"
                     "                    used for measuring things that are not affected by\n"
                     "                    CPU performance, like pagecache usage.\n"
+                    "  --ring N        keep the last N KB of compressed trace in memory, and\n"
+                    "                    write them out (to stdout or the -o file) on SIGUSR1\n"
+                    "                    until tracing is stopped\n"
+                    "  --raw           capture the binary trace of each CPU to the -o file\n"
+                    "                    in the trace-cmd trace.dat format, which is cheaper\n"
+                    "                    for the kernel than a text trace\n"
                     "  --list_categories\n"
                     "                  list the available tracing categories\n"
                     " -o filename      write the trace to the specified file instead\n"
@@ -1020,6 +1561,8 @@ int main(int argc, char **argv)
             {"async_dump",      no_argument, 0,  0 },
             {"list_categories", no_argument, 0,  0 },
             {"stream",          no_argument, 0,  0 },
+            {"ring",      required_argument, 0,  0 },
+            {"raw",             no_argument, 0,  0 },
             {           0,                0, 0,  0 }
         };
 
@@ -1093,6 +1636,16 @@ int main(int argc, char **argv)
                 } else if (!strcmp(long_options[option_index].name, "stream")) {
                     traceStream = true;
                     traceDump = false;
+                } else if (!strcmp(long_options[option_index].name, "ring")) {
+                    g_ringBufferSizeKB = atoi(optarg);
+                    if (g_ringBufferSizeKB <= 0) {
+                        fprintf(stderr, "invalid ring buffer size: %s\n", optarg);
+                        exit(-1);
+                    }
+                    traceStream = true;
+                    traceDump = false;
+                } else if (!strcmp(long_options[option_index].name, "raw")) {
+                    g_rawCapture = true;
                 } else if (!strcmp(long_options[option_index].name, "list_categories")) {
                     listSupportedCategories();
                     exit(0);
@@ -1107,6 +1660,11 @@ int main(int argc, char **argv)
         }
     }
 
+    if (g_rawCapture && (!g_outputFile || g_compress || traceStream)) {
+        fprintf(stderr, "--raw needs -o, and can't be used with -z, --stream or --ring\n");
+        exit(-1);
+    }
+
     registerSigHandler();
 
     if (g_initialSleepSecs > 0) {
@@ -1117,6 +1675,8 @@ int main(int argc, char **argv)
     ok &= setUpTrace();
     ok &= startTrace();
 
+    RawCapture rawCapture;
+
     if (ok && traceStart) {
         if (!traceStream) {
             printf("capturing trace...");
@@ -1131,7 +1691,15 @@ int main(int argc, char **argv)
         ok = clearTrace();
 
         writeClockSyncMarker();
-        if (ok && !async && !traceStream) {
+        if (ok && !async && g_rawCapture) {
+            // Keep moving the pages out as they fill, so that the capture
+            // isn't limited by the size of the kernel buffer.
+            ok = openRawCapture(&rawCapture);
+            if (ok) {
+                captureRawTrace(&rawCapture, systemTime(CLOCK_MONOTONIC) +
+                        seconds_to_nanoseconds(g_traceDurationSeconds));
+            }
+        } else if (ok && !async && !traceStream) {
             // Sleep to allow the trace to be captured.
             struct timespec timeLeft;
             timeLeft.tv_sec = g_traceDurationSeconds;
@@ -1144,7 +1712,11 @@ int main(int argc, char **argv)
         }
 
         if (traceStream) {
-            streamTrace();
+            if (g_ringBufferSizeKB > 0) {
+                ringTrace();
+            } else {
+                streamTrace();
+            }
         }
     }
 
@@ -1158,10 +1730,18 @@ int main(int argc, char **argv)
             fflush(stdout);
             int outFd = STDOUT_FILENO;
             if (g_outputFile) {
-                outFd = open(g_outputFile, O_WRONLY | O_CREAT);
+                outFd = open(g_outputFile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
             }
             if (outFd == -1) {
                 printf("Failed to open '%s', err=%d", g_outputFile, errno);
+            } else if (g_rawCapture) {
+                // Dumps of an asynchronous trace read the kernel buffer now.
+                if (!rawCapture.cpus.empty() || openRawCapture(&rawCapture)) {
+                    drainRawTrace(&rawCapture);
+                    writeRawTrace(rawCapture, outFd);
+                    closeRawCapture(&rawCapture);
+                }
+                close(outFd);
             } else {
                 dprintf(outFd, "TRACE:\n");
                 dumpTrace(outFd);
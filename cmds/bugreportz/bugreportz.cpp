@@ -15,6 +15,8 @@
  */
 
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -29,6 +31,12 @@
 
 static constexpr char BEGIN_PREFIX[] = "BEGIN:";
 static constexpr char PROGRESS_PREFIX[] = "PROGRESS:";
+static constexpr char OK_PREFIX[] = "OK:";
+
+// How often the bugreport is checked for new data while dumpstate doesn't say anything.
+static constexpr int STREAM_POLL_MS = 250;
+// Same as the socket timeout set by main().
+static constexpr int STREAM_TIMEOUT_MS = 10 * 60 * 1000;
 
 static void write_line(const std::string& line, bool show_progress) {
     if (line.empty()) return;
@@ -76,3 +84,97 @@ int bugreportz(int s, bool show_progress) {
     }
     return EXIT_SUCCESS;
 }
+
+// Copies everything appended to the bugreport since the last call.
+static bool copy_new_data(int zip_fd, int out_fd) {
+    char buffer[65536];
+    while (1) {
+        ssize_t bytes_read = TEMP_FAILURE_RETRY(read(zip_fd, buffer, sizeof(buffer)));
+        if (bytes_read == 0) {
+            return true;
+        } else if (bytes_read == -1) {
+            fprintf(stderr, "FAIL:Cannot read bugreport: %s\n", strerror(errno));
+            return false;
+        }
+        if (!android::base::WriteFully(out_fd, buffer, bytes_read)) {
+            fprintf(stderr, "FAIL:Cannot write bugreport: %s\n", strerror(errno));
+            return false;
+        }
+    }
+}
+
+static int open_bugreport(const std::string& line, const char* prefix) {
+    std::string path = line.substr(strlen(prefix));
+    if (android::base::EndsWith(path, "\n")) path.pop_back();
+    int fd = TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd == -1) {
+        fprintf(stderr, "WARNING: cannot open %s: %s\n", path.c_str(), strerror(errno));
+    }
+    return fd;
+}
+
+int bugreportz_stream(int s, int out_fd) {
+    // dumpstate writes the .zip file sequentially, so whatever it already wrote can be sent while
+    // the next entries are still being generated. The file is opened as soon as its path is known,
+    // which also keeps it readable when dumpstate renames it at the end.
+    int zip_fd = -1;
+    bool done = false;
+    bool ok = false;
+    int idle_ms = 0;
+    std::string line;
+    while (!done) {
+        struct pollfd pfd = {s, POLLIN, 0};
+        int rc = TEMP_FAILURE_RETRY(poll(&pfd, 1, STREAM_POLL_MS));
+        if (rc == -1) {
+            fprintf(stderr, "FAIL:Bugreport read terminated abnormally (%s)\n", strerror(errno));
+            break;
+        } else if (rc == 0) {
+            idle_ms += STREAM_POLL_MS;
+            if (idle_ms >= STREAM_TIMEOUT_MS) {
+                fprintf(stderr, "FAIL:Bugreport read terminated abnormally (%s)\n",
+                        strerror(ETIMEDOUT));
+                break;
+            }
+        } else {
+            char buffer[4096];
+            ssize_t bytes_read = TEMP_FAILURE_RETRY(read(s, buffer, sizeof(buffer)));
+            if (bytes_read <= 0) {
+                fprintf(stderr, "FAIL:Bugreport read terminated abnormally (%s)\n",
+                        bytes_read == 0 ? "no result from dumpstate" : strerror(errno));
+                break;
+            }
+            idle_ms = 0;
+            for (int i = 0; i < bytes_read && !done; i++) {
+                char c = buffer[i];
+                line.append(1, c);
+                if (c != '\n') continue;
+
+                // stdout is the bugreport itself, so dumpstate's lines go to stderr.
+                android::base::WriteStringToFd(line, STDERR_FILENO);
+                if (android::base::StartsWith(line, BEGIN_PREFIX)) {
+                    if (zip_fd == -1) zip_fd = open_bugreport(line, BEGIN_PREFIX);
+                } else if (android::base::StartsWith(line, OK_PREFIX)) {
+                    if (zip_fd == -1) zip_fd = open_bugreport(line, OK_PREFIX);
+                    ok = zip_fd != -1;
+                    done = true;
+                } else if (!android::base::StartsWith(line, PROGRESS_PREFIX)) {
+                    // FAIL or anything unexpected.
+                    done = true;
+                }
+                line.clear();
+            }
+        }
+        if (zip_fd != -1 && !copy_new_data(zip_fd, out_fd)) {
+            ok = false;
+            break;
+        }
+    }
+
+    if (zip_fd != -1) {
+        close(zip_fd);
+    }
+    if (close(s) == -1) {
+        fprintf(stderr, "WARNING: error closing socket: %s\n", strerror(errno));
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
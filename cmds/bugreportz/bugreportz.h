@@ -18,4 +18,9 @@
 // Calls dumpstate using the given socket and output its result to stdout.
 int bugreportz(int s, bool show_progress);
 
+// Calls dumpstate using the given socket and streams the zipped bugreport to out_fd while it is
+// being generated; dumpstate's progress and result lines go to stderr. Returns EXIT_SUCCESS if
+// the whole bugreport was copied.
+int bugreportz_stream(int s, int out_fd);
+
 #endif  // BUGREPORTZ_H
@@ -17,16 +17,22 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #include <string>
 
+#include <android-base/file.h>
+
 #include "bugreportz.h"
 
 using ::testing::StrEq;
+using ::testing::internal::CaptureStderr;
 using ::testing::internal::CaptureStdout;
+using ::testing::internal::GetCapturedStderr;
 using ::testing::internal::GetCapturedStdout;
 
 class BugreportzTest : public ::testing::Test {
@@ -84,10 +90,38 @@ class BugreportzTest : public ::testing::Test {
         ASSERT_EQ(0, status) << "bugrepotz() call failed (stdout: " << stdout_ << ")";
     }
 
+    // Calls bugreportz_stream() using the internal pipe and returns what it streamed.
+    std::string BugreportzStream(int expected_status) {
+        close(write_fd_);
+        write_fd_ = -1;
+
+        FILE* out = tmpfile();
+        EXPECT_NE(nullptr, out);
+        if (out == nullptr) return "";
+
+        CaptureStderr();
+        int status = bugreportz_stream(read_fd_, fileno(out));
+        read_fd_ = -1;
+        stderr_ = GetCapturedStderr();
+        EXPECT_EQ(expected_status, status) << "wrong bugreportz_stream() result (stderr: "
+                                           << stderr_ << ")";
+
+        std::string data;
+        rewind(out);
+        EXPECT_TRUE(android::base::ReadFdToString(fileno(out), &data));
+        fclose(out);
+        return data;
+    }
+
+    void AssertStderrEquals(const std::string& expected) {
+        ASSERT_THAT(stderr_, StrEq(expected)) << "wrong stderr output";
+    }
+
   private:
     int read_fd_;
     int write_fd_;
     std::string stdout_;
+    std::string stderr_;
 };
 
 // Tests 'bugreportz', without any argument - it will ignore progress lines.
@@ -126,3 +160,37 @@ TEST_F(BugreportzTest, WithProgress) {
         "PROGRESS:IS NOT AUTOMATIC\n"
         "Newline is optional");
 }
+
+// Tests 'bugreportz -s' - it will copy the bugreport and echo dumpstate's output to stderr
+TEST_F(BugreportzTest, Stream) {
+    char path[] = "/data/local/tmp/bugreportz_test.XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    ASSERT_TRUE(android::base::WriteStringToFd("PK I AM A ZIP", fd));
+    close(fd);
+
+    WriteToSocket(std::string("BEGIN:") + path + "\n");
+    WriteToSocket("PROGRESS:42/100\n");
+    WriteToSocket(std::string("OK:") + path + "\n");
+
+    std::string data = BugreportzStream(EXIT_SUCCESS);
+    unlink(path);
+
+    ASSERT_THAT(data, StrEq("PK I AM A ZIP"));
+    AssertStderrEquals(std::string("BEGIN:") + path + "\n" + "PROGRESS:42/100\n" + "OK:" + path +
+                       "\n");
+}
+
+// Tests 'bugreportz -s' when dumpstate fails
+TEST_F(BugreportzTest, StreamFailure) {
+    WriteToSocket("BEGIN:/I/DO/NOT/EXIST.zip\n");
+    WriteToSocket("FAIL:EPIC\n");
+
+    std::string data = BugreportzStream(EXIT_FAILURE);
+
+    ASSERT_THAT(data, StrEq(""));
+    AssertStderrEquals(
+        "BEGIN:/I/DO/NOT/EXIST.zip\n"
+        "WARNING: cannot open /I/DO/NOT/EXIST.zip: No such file or directory\n"
+        "FAIL:EPIC\n");
+}
@@ -26,13 +26,14 @@
 
 #include "bugreportz.h"
 
-static constexpr char VERSION[] = "1.1";
+static constexpr char VERSION[] = "1.2";
 
 static void show_usage() {
     fprintf(stderr,
             "usage: bugreportz [-h | -v]\n"
             "  -h: to display this help message\n"
             "  -p: display progress\n"
+            "  -s: stream the zipped bugreport to stdout while it is generated\n"
             "  -v: to display the version\n"
             "  or no arguments to generate a zipped bugreport\n");
 }
@@ -43,10 +44,11 @@ static void show_version() {
 
 int main(int argc, char* argv[]) {
     bool show_progress = false;
+    bool stream_data = false;
     if (argc > 1) {
         /* parse arguments */
         int c;
-        while ((c = getopt(argc, argv, "hpv")) != -1) {
+        while ((c = getopt(argc, argv, "hpsv")) != -1) {
             switch (c) {
                 case 'h':
                     show_usage();
@@ -54,6 +56,9 @@ int main(int argc, char* argv[]) {
                 case 'p':
                     show_progress = true;
                     break;
+                case 's':
+                    stream_data = true;
+                    break;
                 case 'v':
                     show_version();
                     return EXIT_SUCCESS;
@@ -81,6 +86,10 @@ int main(int argc, char* argv[]) {
     }
 
     if (s == -1) {
+        if (stream_data) {
+            fprintf(stderr, "FAIL:Failed to connect to dumpstatez service: %s\n", strerror(errno));
+            return EXIT_FAILURE;
+        }
         printf("FAIL:Failed to connect to dumpstatez service: %s\n", strerror(errno));
         return EXIT_SUCCESS;
     }
@@ -95,5 +104,8 @@ int main(int argc, char* argv[]) {
         fprintf(stderr, "WARNING: Cannot set socket timeout: %s\n", strerror(errno));
     }
 
+    if (stream_data) {
+        return bugreportz_stream(s, STDOUT_FILENO);
+    }
     bugreportz(s, show_progress);
 }
@@ -14,12 +14,15 @@
  * limitations under the License.
  */
 
+#include <condition_variable>
+#include <deque>
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <libgen.h>
 #include <limits.h>
 #include <memory>
+#include <mutex>
 #include <regex>
 #include <set>
 #include <stdbool.h>
@@ -32,6 +35,7 @@
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/wait.h>
+#include <thread>
 #include <unistd.h>
 
 #include <android-base/file.h>
@@ -56,11 +60,59 @@ using android::base::StringPrintf;
 static char cmdline_buf[16384] = "(unknown)";
 static const char *dump_traces_path = NULL;
 
+/*
+ * Writes the zipped bugreport on a separate thread, so the data of an entry is deflated while
+ * dumpstate goes on collecting the next ones.
+ *
+ * Entries are written in the order they are queued; at most MAX_PENDING_BYTES of uncompressed
+ * data are queued at once, the calling thread waits when there is more to keep memory bounded.
+ * Errors are logged as they happen and reported by Finish().
+ */
+class ZipCompressor {
+  public:
+    /* takes ownership of file */
+    ZipCompressor(FILE* file);
+    ~ZipCompressor();
+
+    void StartEntry(const std::string& name, time_t time);
+    void WriteBytes(std::vector<uint8_t> data);
+    void FinishEntry();
+
+    /* writes the pending entries, finishes the archive and closes the file */
+    bool Finish();
+
+  private:
+    static const size_t MAX_PENDING_BYTES = 4 * 1024 * 1024;
+
+    struct Op {
+        enum { START_ENTRY, WRITE_BYTES, FINISH_ENTRY } type;
+        std::string name;
+        time_t time;
+        std::vector<uint8_t> data;
+    };
+
+    void Queue(Op op);
+    void Drain();
+    void Run();
+
+    FILE* file_;
+    ZipWriter writer_;
+    std::mutex mutex_;
+    std::condition_variable queued_;
+    std::condition_variable written_;
+    std::deque<Op> ops_;
+    size_t pending_ops_ = 0;
+    size_t pending_bytes_ = 0;
+    bool failed_ = false;
+    bool stopping_ = false;
+    std::thread thread_;
+};
+
 // TODO: variables below should be part of dumpstate object
 static unsigned long id;
 static char build_type[PROPERTY_VALUE_MAX];
 static time_t now;
-static std::unique_ptr<ZipWriter> zip_writer;
+static std::unique_ptr<ZipCompressor> zip_compressor;
 static std::set<std::string> mount_points;
 void add_mountinfo();
 int control_socket_fd = -1;
@@ -115,7 +167,7 @@ static void get_tombstone_fds(tombstone_data_t data[NUM_TOMBSTONES]) {
                                          O_RDONLY | O_CLOEXEC | O_NOFOLLOW | O_NONBLOCK));
         struct stat st;
         if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
-            (zip_writer || (time_t) st.st_mtime >= thirty_minutes_ago)) {
+            (is_zipping() || (time_t) st.st_mtime >= thirty_minutes_ago)) {
         data[i].fd = fd;
         } else {
         close(fd);
@@ -225,8 +277,8 @@ static bool dump_anrd_trace() {
     long long cur_size = 0;
     const char *trace_path = "/data/misc/anrd/";
 
-    if (!zip_writer) {
-        MYLOGE("Not dumping anrd trace because zip_writer is not set\n");
+    if (!is_zipping()) {
+        MYLOGE("Not dumping anrd trace because dumpstate is not zipping\n");
         return false;
     }
 
@@ -786,6 +838,113 @@ static const std::set<std::string> PROBLEMATIC_FILE_EXTENSIONS = {
       ".shb", ".sys", ".vb",  ".vbe", ".vbs", ".vxd", ".wsc", ".wsf", ".wsh"
 };
 
+ZipCompressor::ZipCompressor(FILE* file) : file_(file), writer_(file) {
+    thread_ = std::thread(&ZipCompressor::Run, this);
+}
+
+ZipCompressor::~ZipCompressor() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    queued_.notify_one();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    if (file_) {
+        fclose(file_);
+    }
+}
+
+void ZipCompressor::StartEntry(const std::string& name, time_t time) {
+    Queue(Op{Op::START_ENTRY, name, time, std::vector<uint8_t>()});
+}
+
+void ZipCompressor::WriteBytes(std::vector<uint8_t> data) {
+    Queue(Op{Op::WRITE_BYTES, std::string(), 0, std::move(data)});
+}
+
+void ZipCompressor::FinishEntry() {
+    Queue(Op{Op::FINISH_ENTRY, std::string(), 0, std::vector<uint8_t>()});
+}
+
+void ZipCompressor::Queue(Op op) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    written_.wait(lock, [this] { return pending_bytes_ < MAX_PENDING_BYTES; });
+    pending_ops_++;
+    pending_bytes_ += op.data.size();
+    ops_.push_back(std::move(op));
+    lock.unlock();
+    queued_.notify_one();
+}
+
+void ZipCompressor::Drain() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    written_.wait(lock, [this] { return pending_ops_ == 0; });
+}
+
+bool ZipCompressor::Finish() {
+    Drain();
+    if (!file_) {
+        return false;
+    }
+    int32_t err = writer_.Finish();
+    if (err) {
+        MYLOGE("zip_writer->Finish(): %s\n", ZipWriter::ErrorCodeString(err));
+        failed_ = true;
+    }
+    if (fclose(file_)) {
+        MYLOGE("fclose(): %s\n", strerror(errno));
+        failed_ = true;
+    }
+    file_ = nullptr;
+    return !failed_;
+}
+
+void ZipCompressor::Run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        queued_.wait(lock, [this] { return !ops_.empty() || stopping_; });
+        if (ops_.empty()) {
+            return;
+        }
+        Op op = std::move(ops_.front());
+        ops_.pop_front();
+        lock.unlock();
+
+        int32_t err = 0;
+        switch (op.type) {
+            case Op::START_ENTRY:
+                err = writer_.StartEntryWithTime(op.name.c_str(), ZipWriter::kCompress, op.time);
+                if (err) {
+                    MYLOGE("zip_writer->StartEntryWithTime(%s): %s\n", op.name.c_str(),
+                            ZipWriter::ErrorCodeString(err));
+                }
+                break;
+            case Op::WRITE_BYTES:
+                err = writer_.WriteBytes(op.data.data(), op.data.size());
+                if (err) {
+                    MYLOGE("zip_writer->WriteBytes(): %s\n", ZipWriter::ErrorCodeString(err));
+                }
+                break;
+            case Op::FINISH_ENTRY:
+                err = writer_.FinishEntry();
+                if (err) {
+                    MYLOGE("zip_writer->FinishEntry(): %s\n", ZipWriter::ErrorCodeString(err));
+                }
+                break;
+        }
+
+        lock.lock();
+        if (err) {
+            failed_ = true;
+        }
+        pending_ops_--;
+        pending_bytes_ -= op.data.size();
+        written_.notify_all();
+    }
+}
+
 bool add_zip_entry_from_fd(const std::string& entry_name, int fd) {
     if (!is_zipping()) {
         MYLOGD("Not adding entry %s from fd because dumpstate is not zipping\n",
@@ -807,37 +966,26 @@ bool add_zip_entry_from_fd(const std::string& entry_name, int fd) {
 
     // Logging statement  below is useful to time how long each entry takes, but it's too verbose.
     // MYLOGD("Adding zip entry %s\n", entry_name.c_str());
-    int32_t err = zip_writer->StartEntryWithTime(valid_name.c_str(),
-            ZipWriter::kCompress, get_mtime(fd, now));
-    if (err) {
-        MYLOGE("zip_writer->StartEntryWithTime(%s): %s\n", valid_name.c_str(),
-                ZipWriter::ErrorCodeString(err));
-        return false;
-    }
+    zip_compressor->StartEntry(valid_name, get_mtime(fd, now));
 
-    std::vector<uint8_t> buffer(65536);
+    bool ret = true;
     while (1) {
-        ssize_t bytes_read = TEMP_FAILURE_RETRY(read(fd, buffer.data(), sizeof(buffer)));
+        std::vector<uint8_t> buffer(65536);
+        ssize_t bytes_read = TEMP_FAILURE_RETRY(read(fd, buffer.data(), buffer.size()));
         if (bytes_read == 0) {
             break;
         } else if (bytes_read == -1) {
             MYLOGE("read(%s): %s\n", entry_name.c_str(), strerror(errno));
-            return false;
-        }
-        err = zip_writer->WriteBytes(buffer.data(), bytes_read);
-        if (err) {
-            MYLOGE("zip_writer->WriteBytes(): %s\n", ZipWriter::ErrorCodeString(err));
-            return false;
+            ret = false;
+            break;
         }
+        buffer.resize(bytes_read);
+        zip_compressor->WriteBytes(std::move(buffer));
     }
 
-    err = zip_writer->FinishEntry();
-    if (err) {
-        MYLOGE("zip_writer->FinishEntry(): %s\n", ZipWriter::ErrorCodeString(err));
-        return false;
-    }
-
-    return true;
+    // Finish the entry even when reading failed, so the next ones can still be added.
+    zip_compressor->FinishEntry();
+    return ret;
 }
 
 bool add_zip_entry(const std::string& entry_name, const std::string& entry_path) {
@@ -867,7 +1015,7 @@ void add_dir(const char *dir, bool recursive) {
 }
 
 bool is_zipping() {
-    return zip_writer != nullptr;
+    return zip_compressor != nullptr;
 }
 
 /* adds a text entry entry to the existing zip file. */
@@ -877,25 +1025,9 @@ static bool add_text_zip_entry(const std::string& entry_name, const std::string&
         return false;
     }
     MYLOGD("Adding zip text entry %s\n", entry_name.c_str());
-    int32_t err = zip_writer->StartEntryWithTime(entry_name.c_str(), ZipWriter::kCompress, now);
-    if (err) {
-        MYLOGE("zip_writer->StartEntryWithTime(%s): %s\n", entry_name.c_str(),
-                ZipWriter::ErrorCodeString(err));
-        return false;
-    }
-
-    err = zip_writer->WriteBytes(content.c_str(), content.length());
-    if (err) {
-        MYLOGE("zip_writer->WriteBytes(%s): %s\n", entry_name.c_str(),
-                ZipWriter::ErrorCodeString(err));
-        return false;
-    }
-
-    err = zip_writer->FinishEntry();
-    if (err) {
-        MYLOGE("zip_writer->FinishEntry(): %s\n", ZipWriter::ErrorCodeString(err));
-        return false;
-    }
+    zip_compressor->StartEntry(entry_name, now);
+    zip_compressor->WriteBytes(std::vector<uint8_t>(content.begin(), content.end()));
+    zip_compressor->FinishEntry();
 
     return true;
 }
@@ -975,32 +1107,39 @@ static void dumpstate(const std::string& screenshot_path, const std::string& ver
     dump_emmc_ecsd("/d/mmc0/mmc0:0001/ext_csd");
     dump_file("MEMORY INFO", "/proc/meminfo");
     run_command("CPU INFO", 10, "top", "-n", "1", "-d", "1", "-m", "30", "-H", NULL);
-    run_command("PROCRANK", 20, SU_PATH, "root", "procrank", NULL);
-    dump_file("VIRTUAL MEMORY STATS", "/proc/vmstat");
-    dump_file("VMALLOC INFO", "/proc/vmallocinfo");
-    dump_file("SLAB INFO", "/proc/slabinfo");
-    dump_file("ZONEINFO", "/proc/zoneinfo");
-    dump_file("PAGETYPEINFO", "/proc/pagetypeinfo");
-    dump_file("BUDDYINFO", "/proc/buddyinfo");
-    dump_file("FRAGMENTATION INFO", "/d/extfrag/unusable_index");
-
-    dump_file("KERNEL WAKE SOURCES", "/d/wakeup_sources");
-    dump_file("KERNEL CPUFREQ", "/sys/devices/system/cpu/cpu0/cpufreq/stats/time_in_state");
-    dump_file("KERNEL SYNC", "/d/sync");
-
-    run_command("PROCESSES AND THREADS", 10, "ps", "-Z", "-t", "-p", "-P", NULL);
-    run_command("LIBRANK", 10, SU_PATH, "root", "librank", NULL);
-
-    run_command("PRINTENV", 10, "printenv", NULL);
-    run_command("NETSTAT", 10, "netstat", "-n", NULL);
-    run_command("LSMOD", 10, "lsmod", NULL);
-
-    do_dmesg();
-
-    run_command("LIST OF OPEN FILES", 10, SU_PATH, "root", "lsof", NULL);
-    for_each_pid(do_showmap, "SMAPS OF ALL PROCESSES");
-    for_each_tid(show_wchan, "BLOCKED PROCESS WAIT-CHANNELS");
-    for_each_pid(show_showtime, "PROCESS TIMES (pid cmd user system iowait+percentage)");
+    /* Sections below don't depend on each other, run them at the same time. */
+    ParallelSections processes("PROCESSES");
+    processes.Add([] { run_command("PROCRANK", 20, SU_PATH, "root", "procrank", NULL); });
+    processes.Add([] {
+        dump_file("VIRTUAL MEMORY STATS", "/proc/vmstat");
+        dump_file("VMALLOC INFO", "/proc/vmallocinfo");
+        dump_file("SLAB INFO", "/proc/slabinfo");
+        dump_file("ZONEINFO", "/proc/zoneinfo");
+        dump_file("PAGETYPEINFO", "/proc/pagetypeinfo");
+        dump_file("BUDDYINFO", "/proc/buddyinfo");
+        dump_file("FRAGMENTATION INFO", "/d/extfrag/unusable_index");
+
+        dump_file("KERNEL WAKE SOURCES", "/d/wakeup_sources");
+        dump_file("KERNEL CPUFREQ", "/sys/devices/system/cpu/cpu0/cpufreq/stats/time_in_state");
+        dump_file("KERNEL SYNC", "/d/sync");
+    });
+
+    processes.Add([] {
+        run_command("PROCESSES AND THREADS", 10, "ps", "-Z", "-t", "-p", "-P", NULL);
+    });
+    processes.Add([] { run_command("LIBRANK", 10, SU_PATH, "root", "librank", NULL); });
+
+    processes.Add([] {
+        run_command("PRINTENV", 10, "printenv", NULL);
+        run_command("NETSTAT", 10, "netstat", "-n", NULL);
+        run_command("LSMOD", 10, "lsmod", NULL);
+    });
+
+    processes.Add(do_dmesg);
+
+    processes.Add([] { run_command("LIST OF OPEN FILES", 10, SU_PATH, "root", "lsof", NULL); });
+    processes.Add(dump_scanned_processes);
+    processes.Run();
 
     /* Dump Bluetooth HCI logs */
     add_dir("/data/misc/bluetooth/logs", true);
@@ -1058,7 +1197,7 @@ static void dumpstate(const std::string& screenshot_path, const std::string& ver
             const char *name = tombstone_data[i].name;
             int fd = tombstone_data[i].fd;
             dumped = 1;
-            if (zip_writer) {
+            if (is_zipping()) {
                 if (!add_zip_entry_from_fd(ZIP_ROOT_DIR + name, fd)) {
                     MYLOGE("Unable to add tombstone %s to zip file\n", name);
                 }
@@ -1073,30 +1212,42 @@ static void dumpstate(const std::string& screenshot_path, const std::string& ver
         printf("*** NO TOMBSTONES to dump in %s\n\n", TOMBSTONE_DIR);
     }
 
-    dump_file("NETWORK DEV INFO", "/proc/net/dev");
-    dump_file("QTAGUID NETWORK INTERFACES INFO", "/proc/net/xt_qtaguid/iface_stat_all");
-    dump_file("QTAGUID NETWORK INTERFACES INFO (xt)", "/proc/net/xt_qtaguid/iface_stat_fmt");
-    dump_file("QTAGUID CTRL INFO", "/proc/net/xt_qtaguid/ctrl");
-    dump_file("QTAGUID STATS INFO", "/proc/net/xt_qtaguid/stats");
+    ParallelSections network("NETWORK");
+    network.Add([] {
+        dump_file("NETWORK DEV INFO", "/proc/net/dev");
+        dump_file("QTAGUID NETWORK INTERFACES INFO", "/proc/net/xt_qtaguid/iface_stat_all");
+        dump_file("QTAGUID NETWORK INTERFACES INFO (xt)", "/proc/net/xt_qtaguid/iface_stat_fmt");
+        dump_file("QTAGUID CTRL INFO", "/proc/net/xt_qtaguid/ctrl");
+        dump_file("QTAGUID STATS INFO", "/proc/net/xt_qtaguid/stats");
+    });
 
-    do_kmsg();
+    network.Add(do_kmsg);
 
     /* The following have a tendency to get wedged when wifi drivers/fw goes belly-up. */
 
-    run_command("NETWORK INTERFACES", 10, "ip", "link", NULL);
+    network.Add([] {
+        run_command("NETWORK INTERFACES", 10, "ip", "link", NULL);
 
-    run_command("IPv4 ADDRESSES", 10, "ip", "-4", "addr", "show", NULL);
-    run_command("IPv6 ADDRESSES", 10, "ip", "-6", "addr", "show", NULL);
+        run_command("IPv4 ADDRESSES", 10, "ip", "-4", "addr", "show", NULL);
+        run_command("IPv6 ADDRESSES", 10, "ip", "-6", "addr", "show", NULL);
+    });
 
-    run_command("IP RULES", 10, "ip", "rule", "show", NULL);
-    run_command("IP RULES v6", 10, "ip", "-6", "rule", "show", NULL);
+    network.Add([] {
+        run_command("IP RULES", 10, "ip", "rule", "show", NULL);
+        run_command("IP RULES v6", 10, "ip", "-6", "rule", "show", NULL);
+    });
 
-    dump_route_tables();
+    network.Add(dump_route_tables);
 
-    run_command("ARP CACHE", 10, "ip", "-4", "neigh", "show", NULL);
-    run_command("IPv6 ND CACHE", 10, "ip", "-6", "neigh", "show", NULL);
-    run_command("MULTICAST ADDRESSES", 10, "ip", "maddr", NULL);
-    run_command("WIFI NETWORKS", 20, "wpa_cli", "IFNAME=wlan0", "list_networks", NULL);
+    network.Add([] {
+        run_command("ARP CACHE", 10, "ip", "-4", "neigh", "show", NULL);
+        run_command("IPv6 ND CACHE", 10, "ip", "-6", "neigh", "show", NULL);
+        run_command("MULTICAST ADDRESSES", 10, "ip", "maddr", NULL);
+    });
+    network.Add([] {
+        run_command("WIFI NETWORKS", 20, "wpa_cli", "IFNAME=wlan0", "list_networks", NULL);
+    });
+    network.Run();
 
 #ifdef FWDUMP_bcmdhd
     run_command("ND OFFLOAD TABLE", 5,
@@ -1181,18 +1332,33 @@ static void dumpstate(const std::string& screenshot_path, const std::string& ver
     printf("== Android Framework Services\n");
     printf("========================================================\n");
 
-    run_command("DUMPSYS", 60, "dumpsys", "-t", "60", "--skip", "meminfo", "cpuinfo", NULL);
+    run_command("DUMPSYS", 60, "dumpsys", "-t", "60", "-j", "4", "--skip", "meminfo", "cpuinfo",
+            NULL);
 
     printf("========================================================\n");
     printf("== Checkins\n");
     printf("========================================================\n");
 
-    run_command("CHECKIN BATTERYSTATS", 30, "dumpsys", "-t", "30", "batterystats", "-c", NULL);
-    run_command("CHECKIN MEMINFO", 30, "dumpsys", "-t", "30", "meminfo", "--checkin", NULL);
-    run_command("CHECKIN NETSTATS", 30, "dumpsys", "-t", "30", "netstats", "--checkin", NULL);
-    run_command("CHECKIN PROCSTATS", 30, "dumpsys", "-t", "30", "procstats", "-c", NULL);
-    run_command("CHECKIN USAGESTATS", 30, "dumpsys", "-t", "30", "usagestats", "-c", NULL);
-    run_command("CHECKIN PACKAGE", 30, "dumpsys", "-t", "30", "package", "--checkin", NULL);
+    ParallelSections checkins("CHECKINS");
+    checkins.Add([] {
+        run_command("CHECKIN BATTERYSTATS", 30, "dumpsys", "-t", "30", "batterystats", "-c", NULL);
+    });
+    checkins.Add([] {
+        run_command("CHECKIN MEMINFO", 30, "dumpsys", "-t", "30", "meminfo", "--checkin", NULL);
+    });
+    checkins.Add([] {
+        run_command("CHECKIN NETSTATS", 30, "dumpsys", "-t", "30", "netstats", "--checkin", NULL);
+    });
+    checkins.Add([] {
+        run_command("CHECKIN PROCSTATS", 30, "dumpsys", "-t", "30", "procstats", "-c", NULL);
+    });
+    checkins.Add([] {
+        run_command("CHECKIN USAGESTATS", 30, "dumpsys", "-t", "30", "usagestats", "-c", NULL);
+    });
+    checkins.Add([] {
+        run_command("CHECKIN PACKAGE", 30, "dumpsys", "-t", "30", "package", "--checkin", NULL);
+    });
+    checkins.Run();
 
     printf("========================================================\n");
     printf("== Running Application Activities\n");
@@ -1268,9 +1434,8 @@ static bool finish_zip_file(const std::string& bugreport_name, const std::string
         return false;
     }
 
-    int32_t err = zip_writer->Finish();
-    if (err) {
-        MYLOGE("zip_writer->Finish(): %s\n", ZipWriter::ErrorCodeString(err));
+    if (!zip_compressor->Finish()) {
+        MYLOGE("Failed to write .zip file\n");
         return false;
     }
 
@@ -1455,9 +1620,6 @@ int main(int argc, char *argv[]) {
     /* pointer to the actual path, be it zip or text */
     std::string path;
 
-    /* pointer to the zipped file */
-    std::unique_ptr<FILE, int(*)(FILE*)> zip_file(NULL, fclose);
-
     /* redirect output if needed */
     bool is_redirecting = !use_socket && use_outfile;
 
@@ -1500,12 +1662,12 @@ int main(int argc, char *argv[]) {
             path = bugreport_dir + "/" + base_name + "-" + suffix + ".zip";
             MYLOGD("Creating initial .zip file (%s)\n", path.c_str());
             create_parent_dirs(path.c_str());
-            zip_file.reset(fopen(path.c_str(), "wb"));
+            FILE* zip_file = fopen(path.c_str(), "wb");
             if (!zip_file) {
                 MYLOGE("fopen(%s, 'wb'): %s\n", path.c_str(), strerror(errno));
                 do_zip_file = 0;
             } else {
-                zip_writer.reset(new ZipWriter(zip_file.get()));
+                zip_compressor.reset(new ZipCompressor(zip_file));
             }
             add_text_zip_entry("version.txt", version);
         }
@@ -1625,6 +1787,8 @@ int main(int argc, char *argv[]) {
             add_dir(PROFILE_DATA_DIR_REF, true);
         }
         add_mountinfo();
+        // smaps used to be read through su, which user builds don't have.
+        scan_processes(!is_user_build());
         dump_iptables();
 
         // Capture any IPSec policies in play.  No keys are exposed here.
@@ -45,6 +45,8 @@
 #include <unistd.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <functional>
+#include <string>
 #include <vector>
 
 #define SU_PATH "/system/xbin/su"
@@ -68,7 +70,7 @@ typedef void (for_each_tid_func)(int, int, const char *);
  * example, jumping from 70% to 100%), while a value too low will cause the progress to get stuck
  * at an almost-finished value (like 99%) for a while.
  */
-static const int WEIGHT_TOTAL = 6500;
+static const int WEIGHT_TOTAL = 3000;
 
 /* Most simple commands have 10 as timeout, so 5 is a good estimate */
 static const int WEIGHT_FILE = 5;
@@ -178,6 +180,13 @@ void show_showtime(int pid, const char *name);
 /* Runs "showmap" for a process */
 void do_showmap(int pid, const char *name);
 
+/* Reads the memory totals (if with_smaps), times and threads' wait channels of every process in a
+ * single pass over /proc, without forking. Needs root to read the smaps of other processes. */
+void scan_processes(bool with_smaps);
+
+/* Prints the sections read by scan_processes() */
+void dump_scanned_processes();
+
 /* Gets the dmesg output for the kernel */
 void do_dmesg();
 
@@ -234,6 +243,36 @@ private:
     uint64_t started_;
 };
 
+/*
+ * Helper class used to run independent sections concurrently.
+ *
+ * Each section runs in a forked dumpstate whose output is held back, and is printed once all of
+ * them are done in the order they were added, so the bugreport reads as if they had run one after
+ * the other. Sections must only print to stdout: they can't add zip entries nor change the state
+ * of dumpstate, which is lost with the forked process.
+ *
+ * Typical usage:
+ *
+ *    ParallelSections sections("NETWORK");
+ *    sections.Add([] { run_command("IP RULES", 10, "ip", "rule", "show", NULL); });
+ *    sections.Add(dump_route_tables);
+ *    sections.Run();
+ *
+ */
+class ParallelSections {
+public:
+    ParallelSections(const char *title);
+
+    void Add(std::function<void()> section);
+
+    /* Runs the sections added so far and prints their output. */
+    void Run();
+
+private:
+    const char* title_;
+    std::vector<std::function<void()>> sections_;
+};
+
 #ifdef __cplusplus
 }
 #endif
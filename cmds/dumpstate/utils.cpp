@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -121,6 +122,37 @@ void for_each_userid(void (*func)(int), const char *header) {
     closedir(d);
 }
 
+/* gets the command line of a process from its /proc/PID directory or, for kernel threads which
+ * have none, its name between brackets */
+static void get_process_name(int pid_fd, char *cmdline, size_t size) {
+    int fd;
+
+    memset(cmdline, 0, size);
+
+    if ((fd = TEMP_FAILURE_RETRY(openat(pid_fd, "cmdline", O_RDONLY | O_CLOEXEC))) >= 0) {
+        TEMP_FAILURE_RETRY(read(fd, cmdline, size - 2));
+        close(fd);
+        if (cmdline[0]) {
+            return;
+        }
+    }
+
+    // if no cmdline, a kernel thread has comm
+    if ((fd = TEMP_FAILURE_RETRY(openat(pid_fd, "comm", O_RDONLY | O_CLOEXEC))) >= 0) {
+        TEMP_FAILURE_RETRY(read(fd, cmdline + 1, size - 4));
+        close(fd);
+        if (cmdline[1]) {
+            cmdline[0] = '[';
+            size_t len = strcspn(cmdline, "\f\b\r\n");
+            cmdline[len] = ']';
+            cmdline[len+1] = '\0';
+        }
+    }
+    if (!cmdline[0]) {
+        strcpy(cmdline, "N/A");
+    }
+}
+
 static void __for_each_pid(void (*helper)(int, const char *, void *), const char *header, void *arg) {
     DIR *d;
     struct dirent *de;
@@ -133,40 +165,20 @@ static void __for_each_pid(void (*helper)(int, const char *, void *), const char
     if (header) printf("\n------ %s ------\n", header);
     while ((de = readdir(d))) {
         int pid;
-        int fd;
-        char cmdpath[255];
         char cmdline[255];
 
         if (!(pid = atoi(de->d_name))) {
             continue;
         }
 
-        memset(cmdline, 0, sizeof(cmdline));
-
-        snprintf(cmdpath, sizeof(cmdpath), "/proc/%d/cmdline", pid);
-        if ((fd = TEMP_FAILURE_RETRY(open(cmdpath, O_RDONLY | O_CLOEXEC))) >= 0) {
-            TEMP_FAILURE_RETRY(read(fd, cmdline, sizeof(cmdline) - 2));
-            close(fd);
-            if (cmdline[0]) {
-                helper(pid, cmdline, arg);
-                continue;
-            }
-        }
-
-        // if no cmdline, a kernel thread has comm
-        snprintf(cmdpath, sizeof(cmdpath), "/proc/%d/comm", pid);
-        if ((fd = TEMP_FAILURE_RETRY(open(cmdpath, O_RDONLY | O_CLOEXEC))) >= 0) {
-            TEMP_FAILURE_RETRY(read(fd, cmdline + 1, sizeof(cmdline) - 4));
-            close(fd);
-            if (cmdline[1]) {
-                cmdline[0] = '[';
-                size_t len = strcspn(cmdline, "\f\b\r\n");
-                cmdline[len] = ']';
-                cmdline[len+1] = '\0';
-            }
-        }
-        if (!cmdline[0]) {
+        int pid_fd = TEMP_FAILURE_RETRY(openat(dirfd(d), de->d_name,
+                O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+        if (pid_fd < 0) {
+            // the process is gone
             strcpy(cmdline, "N/A");
+        } else {
+            get_process_name(pid_fd, cmdline, sizeof(cmdline));
+            close(pid_fd);
         }
         helper(pid, cmdline, arg);
     }
@@ -303,6 +315,48 @@ static void snprdec(char *buffer, size_t len, size_t spc, unsigned permille) {
              "%*s", (spc > offset) ? (int)(spc - offset) : 0, str);
 }
 
+/* formats the times of a process from the content of its /proc/PID/stat file, which may be the
+ * same memory as buffer; returns false if there is nothing to show */
+static bool format_showtime(int pid, const char *name, const char *stat, char *buffer,
+        size_t len) {
+    // field 14 is utime
+    // field 15 is stime
+    // field 42 is iotime
+    unsigned long long utime = 0, stime = 0, iotime = 0;
+    if (sscanf(stat,
+               "%*u %*s %*s %*d %*d %*d %*d %*d %*d %*d %*d "
+               "%*d %*d %llu %llu %*d %*d %*d %*d %*d %*d "
+               "%*d %*d %*d %*d %*d %*d %*d %*d %*d %*d "
+               "%*d %*d %*d %*d %*d %*d %*d %*d %*d %llu ",
+               &utime, &stime, &iotime) != 3) {
+        return false;
+    }
+
+    unsigned long long total = utime + stime;
+    if (!total) {
+        return false;
+    }
+
+    unsigned permille = (iotime * 1000 + (total / 2)) / total;
+    if (permille > 1000) {
+        permille = 1000;
+    }
+
+    // try to beautify and stabilize columns at <80 characters
+    snprintf(buffer, len, "%-6d%s", pid, name);
+    if ((name[0] != '[') || utime) {
+        snprcent(buffer, len, 57, utime);
+    }
+    snprcent(buffer, len, 65, stime);
+    if ((name[0] != '[') || iotime) {
+        snprcent(buffer, len, 73, iotime);
+    }
+    if (iotime) {
+        snprdec(buffer, len, 79, permille);
+    }
+    return true;
+}
+
 void show_showtime(int pid, const char *name) {
     ON_DRY_RUN_RETURN();
     char path[255];
@@ -326,44 +380,205 @@ void show_showtime(int pid, const char *name) {
         return;
     }
 
-    // field 14 is utime
-    // field 15 is stime
-    // field 42 is iotime
-    unsigned long long utime = 0, stime = 0, iotime = 0;
-    if (sscanf(buffer,
-               "%*u %*s %*s %*d %*d %*d %*d %*d %*d %*d %*d "
-               "%*d %*d %llu %llu %*d %*d %*d %*d %*d %*d "
-               "%*d %*d %*d %*d %*d %*d %*d %*d %*d %*d "
-               "%*d %*d %*d %*d %*d %*d %*d %*d %*d %llu ",
-               &utime, &stime, &iotime) != 3) {
+    if (format_showtime(pid, name, buffer, buffer, sizeof(buffer))) {
+        puts(buffer); // adds a trailing newline
+    }
+
+    return;
+}
+
+/* sections gathered by scan_processes() */
+static std::string smaps_section;
+static std::string wchan_section;
+static std::string times_section;
+
+/* reads a whole /proc file into buffer, which is kept between calls so that scanning all the
+ * processes doesn't allocate for each file; returns the length read, or -1 */
+static ssize_t read_proc_file(int dir_fd, const char *name, std::vector<char> *buffer) {
+    int fd = TEMP_FAILURE_RETRY(openat(dir_fd, name, O_RDONLY | O_CLOEXEC));
+    if (fd < 0) {
+        return -1;
+    }
+    if (buffer->size() < 4096) {
+        buffer->resize(4096);
+    }
+    size_t len = 0;
+    while (1) {
+        if (len + 1 >= buffer->size()) {
+            buffer->resize(buffer->size() * 2);
+        }
+        ssize_t bytes_read = TEMP_FAILURE_RETRY(read(fd, buffer->data() + len,
+                buffer->size() - len - 1));
+        if (bytes_read <= 0) {
+            close(fd);
+            if (bytes_read < 0) {
+                return -1;
+            }
+            (*buffer)[len] = '\0';
+            return len;
+        }
+        len += bytes_read;
+    }
+}
+
+/* adds a line with the memory totals of a process, read from smaps_rollup when the kernel has it
+ * or from smaps otherwise */
+static void scan_smaps(int pid_fd, int pid, const char *name, std::vector<char> *buffer) {
+    ssize_t len = read_proc_file(pid_fd, "smaps_rollup", buffer);
+    if (len < 0) {
+        len = read_proc_file(pid_fd, "smaps", buffer);
+    }
+    if (len <= 0) {
+        // kernel threads have no mappings
         return;
     }
 
-    unsigned long long total = utime + stime;
-    if (!total) {
+    static const char *const FIELDS[] = {
+        "Rss:", "Pss:", "Shared_Clean:", "Shared_Dirty:", "Private_Clean:", "Private_Dirty:",
+        "Swap:",
+    };
+    static const size_t NUM_FIELDS = sizeof(FIELDS) / sizeof(FIELDS[0]);
+    unsigned long long totals[NUM_FIELDS] = {};
+
+    for (char *line = buffer->data(); line && *line; ) {
+        char *next = strchr(line, '\n');
+        // mapping lines start with their address, only the lines after them are summed up
+        if (*line >= 'A' && *line <= 'Z') {
+            for (size_t i = 0; i < NUM_FIELDS; i++) {
+                size_t field_len = strlen(FIELDS[i]);
+                if (!strncmp(line, FIELDS[i], field_len)) {
+                    totals[i] += strtoull(line + field_len, NULL, 10);
+                    break;
+                }
+            }
+        }
+        line = next ? next + 1 : NULL;
+    }
+
+    char line[512];
+    snprintf(line, sizeof(line), "%7d %8llu %8llu %8llu %8llu %8llu %8llu %8llu  %s\n", pid,
+             totals[0], totals[1], totals[2], totals[3], totals[4], totals[5], totals[6], name);
+    smaps_section += line;
+}
+
+/* adds the wait channel of every thread of a process, the main thread first */
+static void scan_wchan(int pid_fd, int pid, const char *name, std::vector<char> *buffer) {
+    char line[512];
+    char path[255];
+
+    int task_fd = TEMP_FAILURE_RETRY(openat(pid_fd, "task", O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    DIR *d = task_fd < 0 ? NULL : fdopendir(task_fd);
+    if (!d) {
+        snprintf(line, sizeof(line), "Failed to open /proc/%d/task (%s)\n", pid,
+                 strerror(errno));
+        wchan_section += line;
+        if (task_fd >= 0) {
+            close(task_fd);
+        }
         return;
     }
 
-    unsigned permille = (iotime * 1000 + (total / 2)) / total;
-    if (permille > 1000) {
-        permille = 1000;
+    std::vector<int> tids(1, pid);
+    struct dirent *de;
+    while ((de = readdir(d))) {
+        int tid = atoi(de->d_name);
+        if (tid && tid != pid) {
+            tids.push_back(tid);
+        }
     }
 
-    // try to beautify and stabilize columns at <80 characters
-    snprintf(buffer, sizeof(buffer), "%-6d%s", pid, name);
-    if ((name[0] != '[') || utime) {
-        snprcent(buffer, sizeof(buffer), 57, utime);
+    for (int tid : tids) {
+        char comm[255];
+        if (tid == pid) {
+            snprintf(comm, sizeof(comm), "%s", name);
+        } else {
+            snprintf(path, sizeof(path), "%d/comm", tid);
+            ssize_t len = read_proc_file(task_fd, path, buffer);
+            snprintf(comm, sizeof(comm), "%s", len < 0 ? "N/A" : buffer->data());
+            char *c = strrchr(comm, '\n');
+            if (c) {
+                *c = '\0';
+            }
+        }
+
+        snprintf(path, sizeof(path), "%d/wchan", tid);
+        if (read_proc_file(task_fd, path, buffer) < 0) {
+            snprintf(line, sizeof(line), "Failed to read '/proc/%d/task/%s' (%s)\n", pid, path,
+                     strerror(errno));
+        } else {
+            char name_buffer[255];
+            snprintf(name_buffer, sizeof(name_buffer), "%*s%s", tid == pid ? 0 : 3, "", comm);
+            snprintf(line, sizeof(line), "%-7d %-32s %s\n", tid, name_buffer, buffer->data());
+        }
+        wchan_section += line;
     }
-    snprcent(buffer, sizeof(buffer), 65, stime);
-    if ((name[0] != '[') || iotime) {
-        snprcent(buffer, sizeof(buffer), 73, iotime);
+
+    closedir(d);
+}
+
+void scan_processes(bool with_smaps) {
+    ON_DRY_RUN_RETURN();
+    DurationReporter duration_reporter("SCAN PROCESSES", NULL);
+    DIR *d;
+    struct dirent *de;
+
+    smaps_section.clear();
+    wchan_section.clear();
+    times_section.clear();
+
+    if (!(d = opendir("/proc"))) {
+        MYLOGE("Failed to open /proc (%s)\n", strerror(errno));
+        return;
     }
-    if (iotime) {
-        snprdec(buffer, sizeof(buffer), 79, permille);
+
+    if (with_smaps) {
+        smaps_section =
+                "                            shared   shared  private  private\n"
+                "    PID      RSS      PSS    clean    dirty    clean    dirty     swap  name\n";
     }
-    puts(buffer); // adds a trailing newline
 
-    return;
+    std::vector<char> buffer;
+    while ((de = readdir(d))) {
+        int pid;
+        char name[255];
+
+        if (!(pid = atoi(de->d_name))) {
+            continue;
+        }
+        int pid_fd = TEMP_FAILURE_RETRY(openat(dirfd(d), de->d_name,
+                O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+        if (pid_fd < 0) {
+            // the process is gone
+            continue;
+        }
+        get_process_name(pid_fd, name, sizeof(name));
+
+        if (with_smaps) {
+            scan_smaps(pid_fd, pid, name, &buffer);
+        }
+        scan_wchan(pid_fd, pid, name, &buffer);
+
+        char line[1023];
+        if (read_proc_file(pid_fd, "stat", &buffer) > 0 &&
+                format_showtime(pid, name, buffer.data(), line, sizeof(line))) {
+            times_section += line;
+            times_section += '\n';
+        }
+
+        close(pid_fd);
+        update_progress(1);
+    }
+
+    closedir(d);
+}
+
+void dump_scanned_processes() {
+    if (!smaps_section.empty()) {
+        printf("\n------ %s ------\n%s", "SMAPS OF ALL PROCESSES", smaps_section.c_str());
+    }
+    printf("\n------ %s ------\n%s", "BLOCKED PROCESS WAIT-CHANNELS", wchan_section.c_str());
+    printf("\n------ %s ------\n%s", "PROCESS TIMES (pid cmd user system iowait+percentage)",
+           times_section.c_str());
 }
 
 void do_dmesg() {
@@ -1181,10 +1396,15 @@ int do_update_progress = 0; // Set by dumpstate.cpp
 int weight_total = WEIGHT_TOTAL;
 
 // TODO: make this function thread safe if sections are generated in parallel.
+/* set in the processes running parallel sections, which only report how much they progressed
+ * once they are done */
+static bool in_parallel_section = false;
+
 void update_progress(int delta) {
     if (!do_update_progress) return;
 
     progress += delta;
+    if (in_parallel_section) return;
 
     char key[PROPERTY_KEY_MAX];
     char value[PROPERTY_VALUE_MAX];
@@ -1393,3 +1613,110 @@ void format_args(const char* command, const char *args[], std::string *string) {
     // TODO: not really working: if NULL is missing, it will crash dumpstate.
     MYLOGE("internal error: missing NULL entry on %s", string->c_str());
 }
+
+/* sections running at the same time at most */
+static const size_t MAX_PARALLEL_SECTIONS = 4;
+
+ParallelSections::ParallelSections(const char *title) : title_(title) {}
+
+void ParallelSections::Add(std::function<void()> section) {
+    sections_.push_back(section);
+}
+
+void ParallelSections::Run() {
+    DurationReporter duration_reporter(title_, NULL);
+    std::vector<std::function<void()>> sections;
+    sections.swap(sections_);
+    ON_DRY_RUN({ for (auto& section : sections) section(); return; });
+
+    struct child_t {
+        pid_t pid;
+        int fd;
+        int status;
+        std::string output;
+    };
+    std::vector<child_t> children(sections.size(), child_t{-1, -1, 0, std::string()});
+    size_t next = 0;
+    size_t running = 0;
+
+    while (next < sections.size() || running > 0) {
+        while (next < sections.size() && running < MAX_PARALLEL_SECTIONS) {
+            child_t& child = children[next];
+            int fds[2];
+            // Don't let the child print what the parent buffered.
+            fflush(stdout);
+            if (pipe2(fds, O_CLOEXEC) != 0 || (child.pid = fork()) < 0) {
+                // Run it below, in order, once the others are printed.
+                MYLOGE("Could not fork a parallel section: %s\n", strerror(errno));
+                child.pid = -1;
+                next++;
+                continue;
+            }
+            if (child.pid == 0) {
+                prctl(PR_SET_PDEATHSIG, SIGKILL);
+                dup2(fds[1], STDOUT_FILENO);
+                close(fds[0]);
+                close(fds[1]);
+                in_parallel_section = true;
+                int started = progress;
+                sections[next]();
+                fflush(stdout);
+                // Must call _exit (instead of exit), otherwise it will corrupt the zip file.
+                _exit(std::min(std::max(progress - started, 0), 255));
+            }
+            close(fds[1]);
+            fcntl(fds[0], F_SETFL, O_NONBLOCK);
+            child.fd = fds[0];
+            running++;
+            next++;
+        }
+        if (running == 0) {
+            continue;
+        }
+
+        std::vector<struct pollfd> pfds;
+        std::vector<child_t*> polled;
+        for (auto& child : children) {
+            if (child.fd >= 0) {
+                pfds.push_back({child.fd, POLLIN, 0});
+                polled.push_back(&child);
+            }
+        }
+        // Wake up now and then, commands the sections ran may keep the pipes open after they
+        // are done.
+        TEMP_FAILURE_RETRY(poll(pfds.data(), pfds.size(), 1000));
+        for (size_t i = 0; i < polled.size(); i++) {
+            child_t& child = *polled[i];
+            char buffer[65536];
+            ssize_t bytes_read;
+            while ((bytes_read = TEMP_FAILURE_RETRY(read(child.fd, buffer, sizeof(buffer)))) > 0) {
+                child.output.append(buffer, bytes_read);
+            }
+            bool eof = bytes_read == 0 || (bytes_read == -1 && errno != EAGAIN);
+            if (waitpid(child.pid, &child.status, eof ? 0 : WNOHANG) == child.pid) {
+                // Whatever is left was written before the child exited.
+                while ((bytes_read = TEMP_FAILURE_RETRY(read(child.fd, buffer,
+                                sizeof(buffer)))) > 0) {
+                    child.output.append(buffer, bytes_read);
+                }
+                close(child.fd);
+                child.fd = -1;
+                running--;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < sections.size(); i++) {
+        child_t& child = children[i];
+        if (child.pid < 0) {
+            sections[i]();
+            continue;
+        }
+        fwrite(child.output.data(), child.output.size(), 1, stdout);
+        if (WIFSIGNALED(child.status)) {
+            printf("*** parallel section killed by signal %d\n\n", WTERMSIG(child.status));
+        } else if (WIFEXITED(child.status)) {
+            update_progress(WEXITSTATUS(child.status));
+        }
+    }
+}
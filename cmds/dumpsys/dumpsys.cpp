@@ -6,8 +6,14 @@
 #define LOG_TAG "dumpsys"
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
 #include <thread>
+#include <vector>
 
 #include <android-base/file.h>
 #include <android-base/stringprintf.h>
@@ -45,10 +51,12 @@ static void usage() {
         "usage: dumpsys\n"
             "         To dump all services.\n"
             "or:\n"
-            "       dumpsys [-t TIMEOUT] [--help | -l | --skip SERVICES | SERVICE [ARGS]]\n"
+            "       dumpsys [-t TIMEOUT] [-j JOBS] [--help | -l | --skip SERVICES | SERVICE [ARGS]]\n"
             "         --help: shows this help\n"
             "         -l: only list services, do not dump them\n"
             "         -t TIMEOUT: TIMEOUT to use in seconds instead of default 10 seconds\n"
+            "         -j JOBS: dumps up to JOBS services at the same time, their output is still\n"
+            "                  printed one service after the other\n"
             "         --skip SERVICES: dumps all services but SERVICES (comma-separated list)\n"
             "         SERVICE [ARGS]: dumps only service SERVICE, optionally passing ARGS to it\n");
 }
@@ -62,6 +70,125 @@ bool IsSkipped(const Vector<String16>& skipped, const String16& service) {
     return false;
 }
 
+typedef std::function<bool(const char*, size_t)> Writer;
+
+static bool WriteString(const Writer& write, const std::string& str) {
+    return write(str.data(), str.size());
+}
+
+// Dumps a service, passing what it prints to write. With headers, the output is surrounded by the
+// name of the service and how long it took.
+static void DumpService(const String16& service_name, const sp<IBinder>& service,
+                        const Vector<String16>& args, int timeoutArg, bool headers,
+                        const Writer& write) {
+    int sfd[2];
+
+    if (pipe(sfd) != 0) {
+        aerr << "Failed to create pipe to dump service info for " << service_name
+             << ": " << strerror(errno) << endl;
+        return;
+    }
+
+    unique_fd local_end(sfd[0]);
+    unique_fd remote_end(sfd[1]);
+    sfd[0] = sfd[1] = -1;
+
+    if (headers) {
+        WriteString(write, StringPrintf("------------------------------------------------------------"
+                                        "-------------------\n"
+                                        "DUMP OF SERVICE %s:\n",
+                                        String8(service_name).string()));
+    }
+
+    // dump blocks until completion, so spawn a thread..
+    std::thread dump_thread([=, remote_end { std::move(remote_end) }]() mutable {
+        int err = service->dump(remote_end.get(), args);
+
+        // It'd be nice to be able to close the remote end of the socketpair before the dump
+        // call returns, to terminate our reads if the other end closes their copy of the
+        // file descriptor, but then hangs for some reason. There doesn't seem to be a good
+        // way to do this, though.
+        remote_end.clear();
+
+        if (err != 0) {
+            aerr << "Error dumping service info: (" << strerror(err) << ") " << service_name
+                 << endl;
+        }
+    });
+
+    auto timeout = std::chrono::seconds(timeoutArg);
+    auto start = std::chrono::steady_clock::now();
+    auto end = start + timeout;
+
+    struct pollfd pfd = {
+        .fd = local_end.get(),
+        .events = POLLIN
+    };
+
+    bool timed_out = false;
+    bool error = false;
+    while (true) {
+        // Wrap this in a lambda so that TEMP_FAILURE_RETRY recalculates the timeout.
+        auto time_left_ms = [end]() {
+            auto now = std::chrono::steady_clock::now();
+            auto diff = std::chrono::duration_cast<std::chrono::milliseconds>(end - now);
+            return std::max(diff.count(), 0ll);
+        };
+
+        int rc = TEMP_FAILURE_RETRY(poll(&pfd, 1, time_left_ms()));
+        if (rc < 0) {
+            aerr << "Error in poll while dumping service " << service_name << " : "
+                 << strerror(errno) << endl;
+            error = true;
+            break;
+        } else if (rc == 0) {
+            timed_out = true;
+            break;
+        }
+
+        char buf[4096];
+        rc = TEMP_FAILURE_RETRY(read(local_end.get(), buf, sizeof(buf)));
+        if (rc < 0) {
+            aerr << "Failed to read while dumping service " << service_name << ": "
+                 << strerror(errno) << endl;
+            error = true;
+            break;
+        } else if (rc == 0) {
+            // EOF.
+            break;
+        }
+
+        if (!write(buf, rc)) {
+            aerr << "Failed to write while dumping service " << service_name << ": "
+                 << strerror(errno) << endl;
+            error = true;
+            break;
+        }
+    }
+
+    if (timed_out) {
+        WriteString(write, "\n*** SERVICE DUMP TIMEOUT EXPIRED ***\n\n");
+    }
+
+    if (timed_out || error) {
+        dump_thread.detach();
+    } else {
+        dump_thread.join();
+    }
+
+    if (headers) {
+        std::chrono::duration<double> elapsed_seconds = std::chrono::steady_clock::now() - start;
+        WriteString(write, StringPrintf("--------- %.3fs was the duration of dumpsys %s\n",
+                                        elapsed_seconds.count(), String8(service_name).string()));
+    }
+}
+
+// Output of a service dumped by a job, printed by the main thread once the service is done.
+struct ServiceOutput {
+    std::string output;
+    bool done = false;
+};
+
 int main(int argc, char* const argv[])
 {
     signal(SIGPIPE, SIG_IGN);
@@ -79,6 +206,7 @@ int main(int argc, char* const argv[])
     bool showListOnly = false;
     bool skipServices = false;
     int timeoutArg = 10;
+    int jobs = 1;
     static struct option longOptions[] = {
         {"skip", no_argument, 0,  0 },
         {"help", no_argument, 0,  0 },
@@ -89,7 +217,7 @@ int main(int argc, char* const argv[])
         int c;
         int optionIndex = 0;
 
-        c = getopt_long(argc, argv, "+t:l", longOptions, &optionIndex);
+        c = getopt_long(argc, argv, "+t:lj:", longOptions, &optionIndex);
 
         if (c == -1) {
             break;
@@ -120,6 +248,17 @@ int main(int argc, char* const argv[])
             showListOnly = true;
             break;
 
+        case 'j':
+            {
+                char *endptr;
+                jobs = strtol(optarg, &endptr, 10);
+                if (*endptr != '\0' || jobs <= 0) {
+                    fprintf(stderr, "Error: invalid number of jobs: '%s'\n", optarg);
+                    return -1;
+                }
+            }
+            break;
+
         default:
             fprintf(stderr, "\n");
             usage();
@@ -171,116 +310,77 @@ int main(int argc, char* const argv[])
         return 0;
     }
 
-    for (size_t i = 0; i < N; i++) {
-        String16 service_name = std::move(services[i]);
-        if (IsSkipped(skippedServices, service_name)) continue;
-
-        sp<IBinder> service = sm->checkService(service_name);
-        if (service != NULL) {
-            int sfd[2];
-
-            if (pipe(sfd) != 0) {
-                aerr << "Failed to create pipe to dump service info for " << service_name
-                     << ": " << strerror(errno) << endl;
-                continue;
-            }
+    const Writer write_stdout = [](const char* data, size_t size) {
+        return WriteFully(STDOUT_FILENO, data, size);
+    };
 
-            unique_fd local_end(sfd[0]);
-            unique_fd remote_end(sfd[1]);
-            sfd[0] = sfd[1] = -1;
+    if (jobs <= 1 || N <= 1) {
+        for (size_t i = 0; i < N; i++) {
+            String16 service_name = std::move(services[i]);
+            if (IsSkipped(skippedServices, service_name)) continue;
 
-            if (N > 1) {
-                aout << "------------------------------------------------------------"
-                        "-------------------" << endl;
-                aout << "DUMP OF SERVICE " << service_name << ":" << endl;
+            sp<IBinder> service = sm->checkService(service_name);
+            if (service != NULL) {
+                DumpService(service_name, service, args, timeoutArg, N > 1, write_stdout);
+            } else {
+                aerr << "Can't find service: " << service_name << endl;
             }
+        }
+        return 0;
+    }
 
-            // dump blocks until completion, so spawn a thread..
-            std::thread dump_thread([=, remote_end { std::move(remote_end) }]() mutable {
-                int err = service->dump(remote_end.get(), args);
-
-                // It'd be nice to be able to close the remote end of the socketpair before the dump
-                // call returns, to terminate our reads if the other end closes their copy of the
-                // file descriptor, but then hangs for some reason. There doesn't seem to be a good
-                // way to do this, though.
-                remote_end.clear();
-
-                if (err != 0) {
-                    aerr << "Error dumping service info: (" << strerror(err) << ") " << service_name
-                         << endl;
-                }
-            });
-
-            auto timeout = std::chrono::seconds(timeoutArg);
-            auto start = std::chrono::steady_clock::now();
-            auto end = start + timeout;
-
-            struct pollfd pfd = {
-                .fd = local_end.get(),
-                .events = POLLIN
-            };
-
-            bool timed_out = false;
-            bool error = false;
-            while (true) {
-                // Wrap this in a lambda so that TEMP_FAILURE_RETRY recalculates the timeout.
-                auto time_left_ms = [end]() {
-                    auto now = std::chrono::steady_clock::now();
-                    auto diff = std::chrono::duration_cast<std::chrono::milliseconds>(end - now);
-                    return std::max(diff.count(), 0ll);
-                };
-
-                int rc = TEMP_FAILURE_RETRY(poll(&pfd, 1, time_left_ms()));
-                if (rc < 0) {
-                    aerr << "Error in poll while dumping service " << service_name << " : "
-                         << strerror(errno) << endl;
-                    error = true;
-                    break;
-                } else if (rc == 0) {
-                    timed_out = true;
-                    break;
-                }
-
-                char buf[4096];
-                rc = TEMP_FAILURE_RETRY(read(local_end.get(), buf, sizeof(buf)));
-                if (rc < 0) {
-                    aerr << "Failed to read while dumping service " << service_name << ": "
-                         << strerror(errno) << endl;
-                    error = true;
-                    break;
-                } else if (rc == 0) {
-                    // EOF.
-                    break;
-                }
-
-                if (!WriteFully(STDOUT_FILENO, buf, rc)) {
-                    aerr << "Failed to write while dumping service " << service_name << ": "
-                         << strerror(errno) << endl;
-                    error = true;
-                    break;
+    // Services are dumped by the jobs as they pick them in order, each into its own buffer. The
+    // buffers are printed in the same order, each as soon as it's complete, so the output is the
+    // same as when dumping the services one after the other.
+    std::vector<ServiceOutput> outputs(N);
+    std::mutex lock;
+    std::condition_variable dumped;
+    std::atomic<size_t> next(0);
+
+    auto job = [&]() {
+        size_t i;
+        while ((i = next++) < N) {
+            std::string output;
+            if (!IsSkipped(skippedServices, services[i])) {
+                sp<IBinder> service = sm->checkService(services[i]);
+                if (service != NULL) {
+                    DumpService(services[i], service, args, timeoutArg, true,
+                                [&output](const char* data, size_t size) {
+                                    output.append(data, size);
+                                    return true;
+                                });
+                } else {
+                    aerr << "Can't find service: " << services[i] << endl;
                 }
             }
+            std::lock_guard<std::mutex> guard(lock);
+            outputs[i].output = std::move(output);
+            outputs[i].done = true;
+            dumped.notify_all();
+        }
+    };
 
-            if (timed_out) {
-                aout << endl << "*** SERVICE DUMP TIMEOUT EXPIRED ***" << endl << endl;
-            }
-
-            if (timed_out || error) {
-                dump_thread.detach();
-            } else {
-                dump_thread.join();
-            }
+    std::vector<std::thread> threads;
+    for (int j = 0; j < jobs && static_cast<size_t>(j) < N; j++) {
+        threads.emplace_back(job);
+    }
 
-            if (N > 1) {
-              std::chrono::duration<double> elapsed_seconds =
-                  std::chrono::steady_clock::now() - start;
-              aout << StringPrintf("--------- %.3fs ", elapsed_seconds.count()).c_str()
-                   << "was the duration of dumpsys " << service_name << endl;
-            }
-        } else {
-            aerr << "Can't find service: " << service_name << endl;
+    for (size_t i = 0; i < N; i++) {
+        std::string output;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            dumped.wait(guard, [&]() { return outputs[i].done; });
+            output = std::move(outputs[i].output);
+        }
+        if (!WriteString(write_stdout, output)) {
+            aerr << "Failed to write while dumping service " << services[i] << ": "
+                 << strerror(errno) << endl;
         }
     }
 
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
     return 0;
 }
@@ -0,0 +1,498 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define ATRACE_TAG ATRACE_TAG_ALWAYS
+
+#include <gui/BitTube.h>
+#include <gui/FrameTimestamps.h>
+#include <gui/ISurfaceComposerClient.h>
+#include <gui/Surface.h>
+#include <gui/SurfaceComposerClient.h>
+#include <gui/SurfaceControl.h>
+#include <ui/DisplayInfo.h>
+#include <utils/String8.h>
+#include <utils/Trace.h>
+
+#include <EGL/egl.h>
+#include <GLES2/gl2.h>
+
+#include <math.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "Flatland.h"
+#include "GLHelper.h"
+
+// The scenarios below are not composited by flatland itself: every window is
+// a real SurfaceFlinger layer, so they measure what SurfaceFlinger and the
+// HWC do with them on the device.  The timestamps of every frame come from
+// SurfaceFlinger's frame event channel of the topmost window.
+
+namespace android {
+
+enum WindowType {
+    WINDOW_OPAQUE,
+    WINDOW_TRANSLUCENT,
+    WINDOW_DIM,
+    WINDOW_BLUR,
+};
+
+struct WindowDesc {
+    WindowType type;
+
+    // The position and size of the window, in fractions of the display.
+    float x;
+    float y;
+    float width;
+    float height;
+
+    // The opacity of the window, or the strength of the dim or blur.
+    float alpha;
+
+    // The clockwise rotation about the top-left corner, in degrees.
+    float rotation;
+};
+
+struct CompositingDesc {
+    // The name of the test.
+    const char* name;
+
+    // The list of windows, from bottom to top.
+    WindowDesc windows[MAX_NUM_LAYERS];
+};
+
+#define STATUS_BAR  { WINDOW_OPAQUE, 0.0f, 0.0f,   1.0f, 0.03f, 1.0f, 0.0f }
+#define NAV_BAR     { WINDOW_OPAQUE, 0.0f, 0.94f,  1.0f, 0.06f, 1.0f, 0.0f }
+#define WALLPAPER   { WINDOW_OPAQUE, 0.0f, 0.0f,   1.0f, 1.0f,  1.0f, 0.0f }
+#define APP_WINDOW  { WINDOW_OPAQUE, 0.0f, 0.03f,  1.0f, 0.91f, 1.0f, 0.0f }
+
+static const CompositingDesc scenarios[] = {
+    { "Single Window",
+        {
+            APP_WINDOW,
+            STATUS_BAR,
+            NAV_BAR,
+        },
+    },
+
+    { "Launcher Over Wallpaper",
+        {
+            WALLPAPER,
+            { WINDOW_TRANSLUCENT, 0.0f, 0.03f, 1.0f, 0.91f, 1.0f, 0.0f },
+            STATUS_BAR,
+            NAV_BAR,
+        },
+    },
+
+    { "Translucent Windows",
+        {
+            WALLPAPER,
+            { WINDOW_TRANSLUCENT, 0.0f,  0.03f, 0.8f, 0.6f, 0.8f, 0.0f },
+            { WINDOW_TRANSLUCENT, 0.05f, 0.1f,  0.8f, 0.6f, 0.8f, 0.0f },
+            { WINDOW_TRANSLUCENT, 0.1f,  0.2f,  0.8f, 0.6f, 0.8f, 0.0f },
+            { WINDOW_TRANSLUCENT, 0.15f, 0.3f,  0.8f, 0.6f, 0.8f, 0.0f },
+            STATUS_BAR,
+            NAV_BAR,
+        },
+    },
+
+    { "Rotated Window",
+        {
+            WALLPAPER,
+            { WINDOW_OPAQUE, 0.3f, 0.1f, 0.6f, 0.6f, 1.0f, 15.0f },
+            STATUS_BAR,
+            NAV_BAR,
+        },
+    },
+
+    { "Dialog Over Dim",
+        {
+            APP_WINDOW,
+            { WINDOW_DIM,    0.0f, 0.0f, 1.0f, 1.0f, 0.6f, 0.0f },
+            { WINDOW_OPAQUE, 0.1f, 0.3f, 0.8f, 0.4f, 1.0f, 0.0f },
+            STATUS_BAR,
+            NAV_BAR,
+        },
+    },
+
+    { "Dialog Over Blur",
+        {
+            APP_WINDOW,
+            { WINDOW_BLUR,   0.0f, 0.0f, 1.0f, 1.0f, 0.5f, 0.0f },
+            { WINDOW_OPAQUE, 0.1f, 0.3f, 0.8f, 0.4f, 1.0f, 0.0f },
+            STATUS_BAR,
+            NAV_BAR,
+        },
+    },
+
+    { "Many Small Windows",
+        {
+            WALLPAPER,
+            { WINDOW_TRANSLUCENT, 0.0f,  0.05f, 0.3f, 0.2f, 0.9f, 0.0f },
+            { WINDOW_TRANSLUCENT, 0.35f, 0.05f, 0.3f, 0.2f, 0.9f, 0.0f },
+            { WINDOW_TRANSLUCENT, 0.7f,  0.05f, 0.3f, 0.2f, 0.9f, 0.0f },
+            { WINDOW_TRANSLUCENT, 0.0f,  0.3f,  0.3f, 0.2f, 0.9f, 0.0f },
+            { WINDOW_TRANSLUCENT, 0.35f, 0.3f,  0.3f, 0.2f, 0.9f, 0.0f },
+            { WINDOW_TRANSLUCENT, 0.7f,  0.3f,  0.3f, 0.2f, 0.9f, 0.0f },
+            { WINDOW_TRANSLUCENT, 0.0f,  0.55f, 0.3f, 0.2f, 0.9f, 0.0f },
+            { WINDOW_TRANSLUCENT, 0.35f, 0.55f, 0.3f, 0.2f, 0.9f, 0.0f },
+            { WINDOW_TRANSLUCENT, 0.7f,  0.55f, 0.3f, 0.2f, 0.9f, 0.0f },
+            STATUS_BAR,
+            NAV_BAR,
+        },
+    },
+};
+
+// The results of the frames of a scenario.
+struct CompositingResult {
+    // The number of frames SurfaceFlinger composited.
+    size_t frames;
+
+    // The number of frames that needed GLES composition.
+    size_t glesFrames;
+
+    // Median time from the start of the refresh to the end of GLES
+    // composition, for the frames composited with GLES.
+    nsecs_t glesCompositionTime;
+
+    // Median time from queueing a buffer to its display.
+    nsecs_t presentLatency;
+};
+
+static size_t countWindows(const CompositingDesc& desc) {
+    size_t i;
+    for (i = 0; i < MAX_NUM_LAYERS; i++) {
+        if (desc.windows[i].width == 0.0f) {
+            break;
+        }
+    }
+    return i;
+}
+
+static nsecs_t median(std::vector<nsecs_t>* values) {
+    if (values->empty()) {
+        return 0;
+    }
+    std::vector<nsecs_t>::iterator middle = values->begin() + values->size() / 2;
+    std::nth_element(values->begin(), middle, values->end());
+    return *middle;
+}
+
+class CompositingRunner {
+
+public:
+
+    CompositingRunner(const CompositingDesc& desc) :
+        mDesc(desc),
+        mNumWindows(countWindows(desc)),
+        mGLHelper(NULL),
+        mProbe(-1) {
+    }
+
+    bool setUp() {
+        ATRACE_CALL();
+
+        status_t err;
+
+        mGLHelper = new GLHelper();
+        if (!mGLHelper->setUp(NULL, 0)) {
+            return false;
+        }
+
+        mComposerClient = new SurfaceComposerClient;
+        err = mComposerClient->initCheck();
+        if (err != NO_ERROR) {
+            fprintf(stderr, "SurfaceComposerClient::initCheck error: %#x\n", err);
+            return false;
+        }
+
+        sp<IBinder> dpy = mComposerClient->getBuiltInDisplay(
+                ISurfaceComposer::eDisplayIdMain);
+        if (dpy == NULL) {
+            fprintf(stderr, "SurfaceComposer::getBuiltInDisplay failed.\n");
+            return false;
+        }
+        DisplayInfo info;
+        err = mComposerClient->getDisplayInfo(dpy, &info);
+        if (err != NO_ERROR) {
+            fprintf(stderr, "SurfaceComposer::getDisplayInfo failed: %#x\n", err);
+            return false;
+        }
+
+        mWindows.resize(mNumWindows);
+        for (size_t i = 0; i < mNumWindows; i++) {
+            if (!setUpWindow(i, mDesc.windows[i], info.w, info.h)) {
+                return false;
+            }
+            if (mWindows[i].eglSurface != EGL_NO_SURFACE) {
+                mProbe = i;
+            }
+        }
+        if (mProbe < 0) {
+            fprintf(stderr, "Scenario without any window content.\n");
+            return false;
+        }
+
+        err = mWindows[mProbe].control->getSurface()->createFrameEventChannel(
+                &mFrameEvents);
+        if (err != NO_ERROR) {
+            fprintf(stderr, "Surface::createFrameEventChannel error: %#x\n", err);
+            return false;
+        }
+
+        return true;
+    }
+
+    void tearDown() {
+        ATRACE_CALL();
+
+        mFrameEvents.clear();
+        for (size_t i = 0; i < mWindows.size(); i++) {
+            if (mWindows[i].eglSurface != EGL_NO_SURFACE) {
+                mGLHelper->destroySurface(&mWindows[i].eglSurface);
+            }
+            mWindows[i].control.clear();
+        }
+        mWindows.clear();
+
+        if (mComposerClient != NULL) {
+            mComposerClient->dispose();
+            mComposerClient.clear();
+        }
+
+        if (mGLHelper != NULL) {
+            mGLHelper->tearDown();
+            delete mGLHelper;
+            mGLHelper = NULL;
+        }
+    }
+
+    bool run(uint32_t warmUpFrames, uint32_t totalFrames,
+            CompositingResult* outResult) {
+        ATRACE_CALL();
+
+        std::vector<FrameTimestamps> events;
+        for (uint32_t i = 0; i < totalFrames; i++) {
+            if (!doFrame(i)) {
+                return false;
+            }
+            receiveFrameEvents(0, &events);
+        }
+
+        // The last frames are only sent once they have been displayed.
+        while (events.empty() || events.back().frameNumber < totalFrames) {
+            if (!receiveFrameEvents(500, &events)) {
+                break;
+            }
+        }
+
+        std::vector<nsecs_t> glesTimes;
+        std::vector<nsecs_t> latencies;
+        *outResult = CompositingResult();
+        uint64_t lastFrame = 0;
+        for (size_t i = 0; i < events.size(); i++) {
+            // A buffer which stays on screen shows up in every refresh, only
+            // the one where it was latched counts.
+            const FrameTimestamps& t = events[i];
+            if (t.frameNumber <= warmUpFrames || t.frameNumber == lastFrame ||
+                    t.refreshStartTime == 0) {
+                continue;
+            }
+            lastFrame = t.frameNumber;
+            outResult->frames++;
+            if (t.glCompositionDoneTime > 0) {
+                outResult->glesFrames++;
+                glesTimes.push_back(t.glCompositionDoneTime - t.refreshStartTime);
+            }
+            if (t.displayRetireTime > 0) {
+                latencies.push_back(t.displayRetireTime - t.postedTime);
+            }
+        }
+        outResult->glesCompositionTime = median(&glesTimes);
+        outResult->presentLatency = median(&latencies);
+
+        return true;
+    }
+
+private:
+
+    struct Window {
+        Window() : eglSurface(EGL_NO_SURFACE) {}
+
+        sp<SurfaceControl> control;
+        EGLSurface eglSurface;
+    };
+
+    bool setUpWindow(size_t index, const WindowDesc& desc, uint32_t dispW,
+            uint32_t dispH) {
+        status_t err;
+
+        uint32_t flags = 0;
+        switch (desc.type) {
+            case WINDOW_OPAQUE:
+                flags = ISurfaceComposerClient::eOpaque;
+                break;
+            case WINDOW_TRANSLUCENT:
+                break;
+            case WINDOW_DIM:
+                flags = ISurfaceComposerClient::eFXSurfaceDim;
+                break;
+            case WINDOW_BLUR:
+                flags = ISurfaceComposerClient::eFXSurfaceBlur;
+                break;
+        }
+
+        uint32_t w = uint32_t(desc.width * float(dispW));
+        uint32_t h = uint32_t(desc.height * float(dispH));
+        sp<SurfaceControl> sc = mComposerClient->createSurface(
+                String8::format("Flatland %zu", index), w, h,
+                PIXEL_FORMAT_RGBA_8888, flags);
+        if (sc == NULL || !sc->isValid()) {
+            fprintf(stderr, "Failed to create SurfaceControl.\n");
+            return false;
+        }
+
+        float angle = desc.rotation * float(M_PI) / 180.0f;
+        float c = cosf(angle);
+        float s = sinf(angle);
+
+        SurfaceComposerClient::openGlobalTransaction();
+        err = sc->setLayer(0x7FFFFF00 + index);
+        if (err == NO_ERROR) {
+            err = sc->setPosition(desc.x * float(dispW), desc.y * float(dispH));
+        }
+        if (err == NO_ERROR) {
+            err = sc->setMatrix(c, s, -s, c);
+        }
+        if (err == NO_ERROR) {
+            err = desc.type == WINDOW_BLUR ? sc->setBlur(desc.alpha)
+                                           : sc->setAlpha(desc.alpha);
+        }
+        if (err == NO_ERROR) {
+            err = sc->show();
+        }
+        SurfaceComposerClient::closeGlobalTransaction();
+        if (err != NO_ERROR) {
+            fprintf(stderr, "Failed to set up window %zu: %#x\n", index, err);
+            return false;
+        }
+
+        mWindows[index].control = sc;
+        if (desc.type == WINDOW_OPAQUE || desc.type == WINDOW_TRANSLUCENT) {
+            return mGLHelper->createEGLSurface(sc, &mWindows[index].eglSurface);
+        }
+        return true;
+    }
+
+    // Gives every window a new buffer.  Filling them is as cheap as it gets,
+    // so the GPU is mostly left to SurfaceFlinger.
+    bool doFrame(uint32_t frame) {
+        for (size_t i = 0; i < mWindows.size(); i++) {
+            EGLSurface surface = mWindows[i].eglSurface;
+            if (surface == EGL_NO_SURFACE) {
+                continue;
+            }
+            if (!mGLHelper->makeCurrent(surface)) {
+                return false;
+            }
+            float shade = float((frame + i) % 16) / 16.0f;
+            glClearColor(shade, 0.5f, 1.0f - shade, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+            if (!mGLHelper->swapBuffers(surface)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Appends the frame events received within timeoutMs to events.  Returns
+    // false if none arrived.
+    bool receiveFrameEvents(int timeoutMs, std::vector<FrameTimestamps>* events) {
+        bool received = false;
+        struct pollfd fd = { mFrameEvents->getFd(), POLLIN, 0 };
+        while (poll(&fd, 1, received ? 0 : timeoutMs) == 1) {
+            FrameTimestamps timestamps;
+            if (BitTube::recvObjects(mFrameEvents, &timestamps, 1) != 1) {
+                break;
+            }
+            events->push_back(timestamps);
+            received = true;
+        }
+        return received;
+    }
+
+    const CompositingDesc& mDesc;
+    const size_t mNumWindows;
+
+    GLHelper* mGLHelper;
+    sp<SurfaceComposerClient> mComposerClient;
+    std::vector<Window> mWindows;
+
+    // The window whose frame events are received.
+    ssize_t mProbe;
+    sp<BitTube> mFrameEvents;
+};
+
+bool runCompositingTests() {
+    const uint32_t warmUpFrames = 30;
+    const uint32_t totalFrames = 330;
+
+    size_t nameLen = 0;
+    for (size_t i = 0; i < NELEMS(scenarios); i++) {
+        nameLen = std::max(nameLen, strlen(scenarios[i].name));
+    }
+
+    const char* scenario = "Scenario";
+    size_t leftPad = (nameLen - strlen(scenario)) / 2;
+    size_t rightPad = nameLen - strlen(scenario) - leftPad;
+    printf(" %*s%s%*s | Windows | GLES frames | GLES time (ms) | Latency (ms)\n",
+            static_cast<int>(leftPad), "", scenario,
+            static_cast<int>(rightPad), "");
+
+    for (size_t i = 0; i < NELEMS(scenarios); i++) {
+        const CompositingDesc& desc = scenarios[i];
+        printf(" %-*s | %7zu | ", static_cast<int>(nameLen), desc.name,
+                countWindows(desc));
+        fflush(stdout);
+
+        CompositingRunner r(desc);
+        CompositingResult result;
+        bool success = r.setUp() && r.run(warmUpFrames, totalFrames, &result);
+        r.tearDown();
+        if (!success) {
+            printf("\n");
+            fprintf(stderr, "error running scenario.\n");
+            return false;
+        }
+
+        if (result.frames == 0) {
+            printf("  no frames\n");
+        } else {
+            printf("     %5.1f%% |         %6.3f |       %6.3f\n",
+                    100.0 * double(result.glesFrames) / double(result.frames),
+                    double(result.glesCompositionTime) / 1e6,
+                    double(result.presentLatency) / 1e6);
+        }
+        fflush(stdout);
+    }
+    return true;
+}
+
+} // namespace android
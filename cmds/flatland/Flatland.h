@@ -68,4 +68,7 @@ public:
 
 Renderer* staticGradient();
 
+// Runs the scenarios composited by SurfaceFlinger and prints their results.
+bool runCompositingTests();
+
 } // namespace android
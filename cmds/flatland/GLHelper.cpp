@@ -289,14 +289,24 @@ bool GLHelper::createWindowSurface(uint32_t w, uint32_t h,
     }
     SurfaceComposerClient::closeGlobalTransaction();
 
-    sp<ANativeWindow> anw = sc->getSurface();
+    result = createEGLSurface(sc, surface);
+    if (!result) {
+        return false;
+    }
+
+    *surfaceControl = sc;
+    return true;
+}
+
+bool GLHelper::createEGLSurface(const sp<SurfaceControl>& surfaceControl,
+        EGLSurface* surface) {
+    sp<ANativeWindow> anw = surfaceControl->getSurface();
     EGLSurface s = eglCreateWindowSurface(mDisplay, mConfig, anw.get(), NULL);
     if (s == EGL_NO_SURFACE) {
         fprintf(stderr, "eglCreateWindowSurface error: %#x\n", eglGetError());
         return false;
     }
 
-    *surfaceControl = sc;
     *surface = s;
     return true;
 }
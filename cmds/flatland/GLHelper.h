@@ -58,6 +58,9 @@ public:
     bool createWindowSurface(uint32_t w, uint32_t h,
             sp<SurfaceControl>* surfaceControl, EGLSurface* surface);
 
+    bool createEGLSurface(const sp<SurfaceControl>& surfaceControl,
+            EGLSurface* surface);
+
     void destroySurface(EGLSurface* surface);
 
     bool swapBuffers(EGLSurface surface);
@@ -37,6 +37,7 @@ using namespace ::android;
 
 static uint32_t g_SleepBetweenSamplesMs = 0;
 static bool     g_PresentToWindow       = false;
+static bool     g_Compositing           = false;
 static size_t   g_BenchmarkNameLen      = 0;
 
 struct BenchmarkDesc {
@@ -729,6 +730,7 @@ static void showHelp(const char *cmd) {
     fprintf(stderr, "options include:\n"
                     "  -s N            sleep for N ms between samples\n"
                     "  -d              display the test frame to a window\n"
+                    "  -c              run the scenarios composited by SurfaceFlinger\n"
                     "  --help          print this helpful message and exit\n"
             );
 }
@@ -747,7 +749,7 @@ int main(int argc, char** argv) {
             {     0,               0, 0,  0 }
         };
 
-        ret = getopt_long(argc, argv, "ds:",
+        ret = getopt_long(argc, argv, "cds:",
                           long_options, &option_index);
 
         if (ret < 0) {
@@ -755,6 +757,10 @@ int main(int argc, char** argv) {
         }
 
         switch(ret) {
+            case 'c':
+                g_Compositing = true;
+            break;
+
             case 'd':
                 g_PresentToWindow = true;
             break;
@@ -784,6 +790,14 @@ int main(int argc, char** argv) {
     }
     printf("\n");
 
+    if (g_Compositing) {
+        if (!runCompositingTests()) {
+            fprintf(stderr, "exiting due to error.\n");
+            return 1;
+        }
+        return 0;
+    }
+
     if (!runTests()) {
         fprintf(stderr, "exiting due to error.\n");
         return 1;
@@ -1,6 +1,6 @@
 LOCAL_PATH := $(call my-dir)
 
-common_src_files := commands.cpp globals.cpp utils.cpp
+common_src_files := commands.cpp dir_size_cache.cpp globals.cpp utils.cpp
 common_cflags := -Wall -Werror
 
 #
@@ -90,6 +90,7 @@ LOCAL_CFLAGS := $(common_cflags)
 LOCAL_SRC_FILES := otapreopt_chroot.cpp
 LOCAL_SHARED_LIBRARIES := \
     libbase \
+    libcutils \
     liblog \
 
 LOCAL_ADDITIONAL_DEPENDENCIES += $(LOCAL_PATH)/Android.mk
@@ -20,6 +20,7 @@
 #include <inttypes.h>
 #include <regex>
 #include <stdlib.h>
+#include <unordered_map>
 #include <sys/capability.h>
 #include <sys/file.h>
 #include <sys/resource.h>
@@ -37,11 +38,11 @@
 #include <cutils/log.h>               // TODO: Move everything to base/logging.
 #include <cutils/sched_policy.h>
 #include <diskusage/dirsize.h>
-#include <logwrap/logwrap.h>
 #include <private/android_filesystem_config.h>
 #include <selinux/android.h>
 #include <system/thread_defs.h>
 
+#include <dir_size_cache.h>
 #include <globals.h>
 #include <installd_deps.h>
 #include <otapreopt_utils.h>
@@ -57,7 +58,6 @@ using android::base::StringPrintf;
 namespace android {
 namespace installd {
 
-static constexpr const char* kCpPath = "/system/bin/cp";
 static constexpr const char* kXattrDefault = "user.default";
 
 static constexpr const char* PKG_LIB_POSTFIX = "/lib";
@@ -423,6 +423,13 @@ int destroy_app_data(const char *uuid, const char *pkgname, userid_t userid, int
     return res;
 }
 
+// Sizes of the trees below code and data directories, so that asking for the size of an app which
+// didn't change since last time doesn't walk all of its files again.
+static DirSizeCache& get_dir_size_cache() {
+    static DirSizeCache cache;
+    return cache;
+}
+
 int move_complete_app(const char *from_uuid, const char *to_uuid, const char *package_name,
         const char *data_app_name, appid_t appid, const char* seinfo, int target_sdk_version) {
     std::vector<userid_t> users = get_known_users(from_uuid);
@@ -431,25 +438,10 @@ int move_complete_app(const char *from_uuid, const char *to_uuid, const char *pa
     {
         auto from = create_data_app_package_path(from_uuid, data_app_name);
         auto to = create_data_app_package_path(to_uuid, data_app_name);
-        auto to_parent = create_data_app_path(to_uuid);
-
-        char *argv[] = {
-            (char*) kCpPath,
-            (char*) "-F", /* delete any existing destination file first (--remove-destination) */
-            (char*) "-p", /* preserve timestamps, ownership, and permissions */
-            (char*) "-R", /* recurse into subdirectories (DEST must be a directory) */
-            (char*) "-P", /* Do not follow symlinks [default] */
-            (char*) "-d", /* don't dereference symlinks */
-            (char*) from.c_str(),
-            (char*) to_parent.c_str()
-        };
 
         LOG(DEBUG) << "Copying " << from << " to " << to;
-        int rc = android_fork_execvp(ARRAY_SIZE(argv), argv, NULL, false, true);
-
-        if (rc != 0) {
-            LOG(ERROR) << "Failed copying " << from << " to " << to
-                    << ": status " << rc;
+        if (copy_directory_recursive(from, to, get_dir_size_cache().GetSize(from)) != 0) {
+            LOG(ERROR) << "Failed copying " << from << " to " << to;
             goto fail;
         }
 
@@ -475,40 +467,23 @@ int move_complete_app(const char *from_uuid, const char *to_uuid, const char *pa
             goto fail;
         }
 
-        char *argv[] = {
-            (char*) kCpPath,
-            (char*) "-F", /* delete any existing destination file first (--remove-destination) */
-            (char*) "-p", /* preserve timestamps, ownership, and permissions */
-            (char*) "-R", /* recurse into subdirectories (DEST must be a directory) */
-            (char*) "-P", /* Do not follow symlinks [default] */
-            (char*) "-d", /* don't dereference symlinks */
-            nullptr,
-            nullptr
-        };
-
         {
             auto from = create_data_user_de_package_path(from_uuid, user, package_name);
-            auto to = create_data_user_de_path(to_uuid, user);
-            argv[6] = (char*) from.c_str();
-            argv[7] = (char*) to.c_str();
+            auto to = create_data_user_de_package_path(to_uuid, user, package_name);
 
             LOG(DEBUG) << "Copying " << from << " to " << to;
-            int rc = android_fork_execvp(ARRAY_SIZE(argv), argv, NULL, false, true);
-            if (rc != 0) {
-                LOG(ERROR) << "Failed copying " << from << " to " << to << " with status " << rc;
+            if (copy_directory_recursive(from, to, get_dir_size_cache().GetSize(from)) != 0) {
+                LOG(ERROR) << "Failed copying " << from << " to " << to;
                 goto fail;
             }
         }
         {
             auto from = create_data_user_ce_package_path(from_uuid, user, package_name);
-            auto to = create_data_user_ce_path(to_uuid, user);
-            argv[6] = (char*) from.c_str();
-            argv[7] = (char*) to.c_str();
+            auto to = create_data_user_ce_package_path(to_uuid, user, package_name);
 
             LOG(DEBUG) << "Copying " << from << " to " << to;
-            int rc = android_fork_execvp(ARRAY_SIZE(argv), argv, NULL, false, true);
-            if (rc != 0) {
-                LOG(ERROR) << "Failed copying " << from << " to " << to << " with status " << rc;
+            if (copy_directory_recursive(from, to, get_dir_size_cache().GetSize(from)) != 0) {
+                LOG(ERROR) << "Failed copying " << from << " to " << to;
                 goto fail;
             }
         }
@@ -578,13 +553,13 @@ int destroy_user_data(const char *uuid, userid_t userid, int flags) {
 
 /* Try to ensure free_size bytes of storage are available.
  * Returns 0 on success.
- * This is rather simple-minded because doing a full LRU would
- * be potentially memory-intensive, and without atime it would
- * also require that apps constantly modify file metadata even
- * when just reading from the cache, which is pretty awful.
+ * Cache files are deleted from the least recently modified on,
+ * see clear_cache_dirs(). This is by modification time because
+ * without atime a real LRU would require that apps constantly
+ * modify file metadata even when just reading from the cache,
+ * which is pretty awful.
  */
 int free_cache(const char *uuid, int64_t free_size) {
-    cache_t* cache;
     int64_t avail;
 
     auto data_path = create_data_path(uuid);
@@ -595,18 +570,16 @@ int free_cache(const char *uuid, int64_t free_size) {
     ALOGI("free_cache(%" PRId64 ") avail %" PRId64 "\n", free_size, avail);
     if (avail >= free_size) return 0;
 
-    cache = start_cache_collection();
-
+    std::vector<std::string> dirs;
     auto users = get_known_users(uuid);
     for (auto user : users) {
-        add_cache_files(cache, create_data_user_ce_path(uuid, user));
-        add_cache_files(cache, create_data_user_de_path(uuid, user));
-        add_cache_files(cache,
+        add_cache_dirs(&dirs, create_data_user_ce_path(uuid, user));
+        add_cache_dirs(&dirs, create_data_user_de_path(uuid, user));
+        add_cache_dirs(&dirs,
                 StringPrintf("%s/Android/data", create_data_media_path(uuid, user).c_str()));
     }
 
-    clear_cache_files(data_path, cache, free_size);
-    finish_cache_collection(cache);
+    clear_cache_dirs(data_path, dirs, free_size);
 
     return data_disk_free(data_path) >= free_size ? 0 : -1;
 }
@@ -655,18 +628,13 @@ static void add_app_data_size(std::string& path, int64_t *codesize, int64_t *dat
         }
 
         if (de->d_type == DT_DIR) {
-            int subfd;
-            int64_t dirsize = 0;
+            int64_t dirsize;
             /* always skip "." and ".." */
             if (name[0] == '.') {
                 if (name[1] == 0) continue;
                 if ((name[1] == '.') && (name[2] == 0)) continue;
             }
-            subfd = openat(dfd, name, O_RDONLY | O_DIRECTORY);
-            if (subfd >= 0) {
-                dirsize = calculate_dir_size(subfd);
-                close(subfd);
-            }
+            dirsize = get_dir_size_cache().GetSize(path + "/" + name);
             // TODO: check xattrs!
             if (!strcmp(name, "cache") || !strcmp(name, "code_cache")) {
                 *datasize += statsize;
@@ -686,15 +654,7 @@ static void add_app_data_size(std::string& path, int64_t *codesize, int64_t *dat
 int get_app_size(const char *uuid, const char *pkgname, int userid, int flags, ino_t ce_data_inode,
         const char *code_path, int64_t *codesize, int64_t *datasize, int64_t *cachesize,
         int64_t* asecsize) {
-    DIR *d;
-    int dfd;
-
-    d = opendir(code_path);
-    if (d != nullptr) {
-        dfd = dirfd(d);
-        *codesize += calculate_dir_size(dfd);
-        closedir(d);
-    }
+    *codesize += get_dir_size_cache().GetSize(code_path);
 
     if (flags & FLAG_STORAGE_CE) {
         auto path = create_data_user_ce_package_path(uuid, userid, pkgname, ce_data_inode);
@@ -1237,6 +1197,44 @@ static void run_profman_merge(const std::vector<fd_t>& profiles_fd, fd_t referen
     exit(68);   /* only get here on exec failure */
 }
 
+// What a profile file looked like when it was given to profman.
+struct ProfileStamp {
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    struct timespec ctime;
+
+    bool operator==(const ProfileStamp& other) const {
+        return dev == other.dev && ino == other.ino && size == other.size
+                && mtime.tv_sec == other.mtime.tv_sec && mtime.tv_nsec == other.mtime.tv_nsec
+                && ctime.tv_sec == other.ctime.tv_sec && ctime.tv_nsec == other.ctime.tv_nsec;
+    }
+};
+
+// The profiles of the packages for which profman found nothing worth compiling, as they were when
+// it did. Background dexopt merges the profiles of every package, and most of them didn't change
+// since the previous run, so profman isn't forked again for those.
+static std::unordered_map<std::string, std::vector<ProfileStamp>>& get_unchanged_profiles() {
+    static std::unordered_map<std::string, std::vector<ProfileStamp>> unchanged_profiles;
+    return unchanged_profiles;
+}
+
+static bool stamp_profiles(const std::vector<fd_t>& profiles_fd, fd_t reference_profile_fd,
+        /*out*/ std::vector<ProfileStamp>* stamps) {
+    stamps->clear();
+    std::vector<fd_t> fds(profiles_fd);
+    fds.push_back(reference_profile_fd);
+    for (fd_t fd : fds) {
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            return false;
+        }
+        stamps->push_back({st.st_dev, st.st_ino, st.st_size, st.st_mtim, st.st_ctim});
+    }
+    return true;
+}
+
 // Decides if profile guided compilation is needed or not based on existing profiles.
 // Returns true if there is enough information in the current profiles that worth
 // a re-compilation of the package.
@@ -1256,6 +1254,21 @@ static bool analyse_profiles(uid_t uid, const char* pkgname) {
         return false;
     }
 
+    std::vector<ProfileStamp> stamps;
+    auto unchanged = get_unchanged_profiles().find(pkgname);
+    if (unchanged != get_unchanged_profiles().end()) {
+        if (stamp_profiles(profiles_fd, reference_profile_fd, &stamps)
+                && stamps == unchanged->second) {
+            ALOGV("PROFMAN (MERGE): profiles of '%s' didn't change\n", pkgname);
+            close_all_fds(profiles_fd, "profiles_fd");
+            if (close(reference_profile_fd) != 0) {
+                PLOG(WARNING) << "Failed to close fd for reference profile";
+            }
+            return false;
+        }
+        get_unchanged_profiles().erase(unchanged);
+    }
+
     ALOGV("PROFMAN (MERGE): --- BEGIN '%s' ---\n", pkgname);
 
     pid_t pid = fork();
@@ -1284,6 +1297,10 @@ static bool analyse_profiles(uid_t uid, const char* pkgname) {
                 need_to_compile = false;
                 should_clear_current_profiles = false;
                 should_clear_reference_profile = false;
+                // Nothing changes as long as the profiles don't.
+                if (stamp_profiles(profiles_fd, reference_profile_fd, &stamps)) {
+                    get_unchanged_profiles()[pkgname] = stamps;
+                }
                 break;
             case PROFMAN_BIN_RETURN_CODE_BAD_PROFILES:
                 LOG(WARNING) << "Bad profiles for package " << pkgname;
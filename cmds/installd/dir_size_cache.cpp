@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "dir_size_cache.h"
+
+#include <algorithm>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <android-base/logging.h>
+#include <diskusage/dirsize.h>
+
+namespace android {
+namespace installd {
+
+static constexpr uint32_t kWatchMask = IN_CREATE | IN_DELETE | IN_MODIFY | IN_MOVED_FROM
+        | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW;
+
+DirSizeCache::DirSizeCache() {
+    inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd_ < 0) {
+        PLOG(WARNING) << "inotify_init1 failed, app sizes won't be cached";
+    }
+}
+
+DirSizeCache::~DirSizeCache() {
+    if (inotify_fd_ >= 0) {
+        close(inotify_fd_);
+    }
+}
+
+int64_t DirSizeCache::GetSize(const std::string& path) {
+    int dfd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd < 0) {
+        return 0;
+    }
+    if (inotify_fd_ < 0) {
+        return calculate_dir_size_parallel(dfd, 0);
+    }
+
+    ProcessEvents();
+    auto it = trees_.find(path);
+    if (it != trees_.end()) {
+        close(dfd);
+        return it->second.size;
+    }
+
+    Tree tree;
+    bool complete = true;
+    tree.size = Walk(dfd, path, path, &tree, &complete);
+    if (complete) {
+        trees_.emplace(path, tree);
+    } else {
+        Unwatch(path, tree);
+    }
+    return tree.size;
+}
+
+void DirSizeCache::ProcessEvents() {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (true) {
+        ssize_t len = read(inotify_fd_, buf, sizeof(buf));
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN) {
+                PLOG(WARNING) << "Failed to read inotify events";
+                ForgetAll();
+            }
+            return;
+        }
+
+        for (char* p = buf; p < buf + len; ) {
+            const struct inotify_event* event = reinterpret_cast<struct inotify_event*>(p);
+            p += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                // Events were lost, nothing can be trusted anymore.
+                ForgetAll();
+                continue;
+            }
+            auto it = watch_roots_.find(event->wd);
+            if (it == watch_roots_.end()) {
+                continue;
+            }
+            // Forget() updates watch_roots_.
+            std::vector<std::string> roots(it->second);
+            for (const auto& root : roots) {
+                Forget(root);
+            }
+        }
+    }
+}
+
+void DirSizeCache::Forget(const std::string& root) {
+    auto it = trees_.find(root);
+    if (it != trees_.end()) {
+        Unwatch(root, it->second);
+        trees_.erase(it);
+    }
+}
+
+void DirSizeCache::ForgetAll() {
+    for (const auto& watch : watch_roots_) {
+        inotify_rm_watch(inotify_fd_, watch.first);
+    }
+    watch_roots_.clear();
+    trees_.clear();
+}
+
+bool DirSizeCache::Watch(const std::string& path, const std::string& root, Tree* tree) {
+    int wd = inotify_add_watch(inotify_fd_, path.c_str(), kWatchMask);
+    if (wd < 0) {
+        if (errno == ENOSPC) {
+            LOG(WARNING) << "Out of inotify watches, not caching the size of " << root;
+        }
+        return false;
+    }
+    std::vector<std::string>& roots = watch_roots_[wd];
+    if (std::find(roots.begin(), roots.end(), root) == roots.end()) {
+        roots.push_back(root);
+        tree->watches.push_back(wd);
+    }
+    return true;
+}
+
+void DirSizeCache::Unwatch(const std::string& root, const Tree& tree) {
+    for (int wd : tree.watches) {
+        auto it = watch_roots_.find(wd);
+        if (it == watch_roots_.end()) {
+            continue;
+        }
+        std::vector<std::string>& roots = it->second;
+        roots.erase(std::remove(roots.begin(), roots.end(), root), roots.end());
+        if (roots.empty()) {
+            // Fails harmlessly when the kernel already dropped the watch.
+            inotify_rm_watch(inotify_fd_, wd);
+            watch_roots_.erase(it);
+        }
+    }
+}
+
+// Same walk as calculate_dir_size(), which also watches every directory before reading it so that
+// no change can go unnoticed. Takes ownership of dfd.
+int64_t DirSizeCache::Walk(int dfd, const std::string& path, const std::string& root, Tree* tree,
+        bool* complete) {
+    if (*complete && !Watch(path, root, tree)) {
+        *complete = false;
+    }
+
+    DIR* d = fdopendir(dfd);
+    if (d == nullptr) {
+        close(dfd);
+        return 0;
+    }
+
+    int64_t size = 0;
+    struct stat s;
+    struct dirent* de;
+    while ((de = readdir(d))) {
+        const char* name = de->d_name;
+        if (de->d_type == DT_DIR) {
+            /* always skip "." and ".." */
+            if (name[0] == '.') {
+                if (name[1] == 0) continue;
+                if ((name[1] == '.') && (name[2] == 0)) continue;
+            }
+            if (fstatat(dfd, name, &s, AT_SYMLINK_NOFOLLOW) == 0) {
+                size += stat_size(&s);
+            }
+            int subfd = openat(dfd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (subfd >= 0) {
+                size += Walk(subfd, path + "/" + name, root, tree, complete);
+            }
+        } else if (fstatat(dfd, name, &s, AT_SYMLINK_NOFOLLOW) == 0) {
+            size += stat_size(&s);
+        }
+    }
+    closedir(d);
+    return size;
+}
+
+}  // namespace installd
+}  // namespace android
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DIR_SIZE_CACHE_H_
+#define DIR_SIZE_CACHE_H_
+
+#include <inttypes.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace android {
+namespace installd {
+
+// Remembers the size of directory trees so that asking for the size of an app again doesn't walk
+// all of its files again. Every directory of a cached tree is watched with inotify, and a tree is
+// forgotten as soon as anything in it is created, deleted, moved or written to. The pending
+// events are only read when a size is asked for, so no thread is needed.
+//
+// Trees that can't be watched completely, e.g. because the inotify watch limit was reached, are
+// walked every time, as is everything when inotify isn't available.
+class DirSizeCache {
+public:
+    DirSizeCache();
+    ~DirSizeCache();
+
+    // Returns the size of everything below path, like calculate_dir_size(), or 0 when path can't
+    // be opened.
+    int64_t GetSize(const std::string& path);
+
+private:
+    struct Tree {
+        int64_t size;
+        std::vector<int> watches;
+    };
+
+    DirSizeCache(const DirSizeCache&) = delete;
+    void operator=(const DirSizeCache&) = delete;
+
+    void ProcessEvents();
+    void Forget(const std::string& root);
+    void ForgetAll();
+    bool Watch(const std::string& path, const std::string& root, Tree* tree);
+    void Unwatch(const std::string& root, const Tree& tree);
+    int64_t Walk(int dfd, const std::string& path, const std::string& root, Tree* tree,
+            bool* complete);
+
+    int inotify_fd_;
+    std::unordered_map<std::string, Tree> trees_;
+    // Watches may be shared by trees containing each other.
+    std::unordered_map<int, std::vector<std::string>> watch_roots_;
+};
+
+}  // namespace installd
+}  // namespace android
+
+#endif  // DIR_SIZE_CACHE_H_
@@ -15,6 +15,7 @@
 */
 
 #include <fcntl.h>
+#include <inttypes.h>
 #include <selinux/android.h>
 #include <selinux/avc.h>
 #include <sys/capability.h>
@@ -22,7 +23,15 @@
 #include <sys/prctl.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
 
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
 #include <android-base/logging.h>
 #include <cutils/fs.h>
 #include <cutils/log.h>               // TODO: Move everything to base::logging.
@@ -263,6 +272,18 @@ static int do_regular_dexopt(const char* args[DEXOPT_PARAM_COUNT],
 using DexoptFn = int (*)(const char* args[DEXOPT_PARAM_COUNT],
                          char reply[REPLY_MAX]);
 
+static int run_dexopt(const char* args[DEXOPT_PARAM_COUNT], char reply[REPLY_MAX])
+{
+    int dexopt_flags = atoi(args[6]);
+    DexoptFn dexopt_fn;
+    if ((dexopt_flags & DEXOPT_OTA) != 0) {
+        dexopt_fn = do_ota_dexopt;
+    } else {
+        dexopt_fn = do_regular_dexopt;
+    }
+    return dexopt_fn(args, reply);
+}
+
 static int do_dexopt(char **arg, char reply[REPLY_MAX])
 {
     const char* args[DEXOPT_PARAM_COUNT];
@@ -270,15 +291,186 @@ static int do_dexopt(char **arg, char reply[REPLY_MAX])
         CHECK(arg[i] != nullptr);
         args[i] = arg[i];
     }
+    return run_dexopt(args, reply);
+}
 
-    int dexopt_flags = atoi(arg[6]);
-    DexoptFn dexopt_fn;
-    if ((dexopt_flags & DEXOPT_OTA) != 0) {
-        dexopt_fn = do_ota_dexopt;
-    } else {
-        dexopt_fn = do_regular_dexopt;
+// Batched dexopt. Jobs are queued with "queue_dexopt", which takes the dexopt parameters followed
+// by the time the package was last used, and "run_dexopt_queue" compiles them all, most recently
+// used packages first, with several dex2oat (or otapreopt) children running at the same time.
+//
+// Each job runs in a forked installd, so that the file descriptors and cleanups of every job stay
+// private to it and dexopt() doesn't need to know about the others. How many run at the same time
+// is bounded by "dalvik.vm.dexopt-batch-jobs" (half the CPUs when unset). A job is only started
+// beside the ones already running when at least "dalvik.vm.dexopt-batch-min-free-mb" of memory is
+// available and the CPUs aren't thermally capped.
+
+struct DexoptJob {
+    std::string params[DEXOPT_PARAM_COUNT];
+    int64_t last_used_ms;
+};
+
+static std::vector<DexoptJob> dexopt_queue;
+
+static constexpr long kDefaultDexoptBatchMinFreeMb = 256;
+
+static int64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+static long get_long_property(const char* key, long default_value) {
+    char buf[kPropertyValueMax];
+    if (get_property(key, buf, nullptr) <= 0) {
+        return default_value;
     }
-    return dexopt_fn(args, reply);
+    char* end;
+    long value = strtol(buf, &end, 10);
+    return (end != buf && *end == '\0') ? value : default_value;
+}
+
+static size_t get_dexopt_batch_jobs() {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    long jobs = get_long_property("dalvik.vm.dexopt-batch-jobs", cpus / 2);
+    return static_cast<size_t>(std::max(jobs, 1L));
+}
+
+// Returns the value of a "<key>: <value> kB" line of /proc/meminfo, or -1.
+static long read_meminfo_kb(const char* key) {
+    std::string meminfo;
+    if (!android::base::ReadFileToString("/proc/meminfo", &meminfo)) {
+        return -1;
+    }
+    std::string prefix = std::string(key) + ":";
+    size_t pos = meminfo.find(prefix);
+    if (pos == std::string::npos) {
+        return -1;
+    }
+    return strtol(meminfo.c_str() + pos + prefix.size(), nullptr, 10);
+}
+
+static long read_long_from_file(const char* path) {
+    std::string content;
+    if (!android::base::ReadFileToString(path, &content)) {
+        return -1;
+    }
+    return strtol(content.c_str(), nullptr, 10);
+}
+
+// The thermal framework caps the frequency of the CPUs when the device heats up.
+static bool is_cpu_throttled() {
+    long max_freq = read_long_from_file("/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq");
+    long cur_max = read_long_from_file("/sys/devices/system/cpu/cpu0/cpufreq/scaling_max_freq");
+    return max_freq > 0 && cur_max > 0 && cur_max < max_freq;
+}
+
+// Whether one more job can run beside the ones already running.
+static bool can_start_another_dexopt(long min_free_kb) {
+    if (is_cpu_throttled()) {
+        return false;
+    }
+    long available_kb = read_meminfo_kb("MemAvailable");
+    return available_kb < 0 || available_kb >= min_free_kb;
+}
+
+static int run_dexopt_job(const DexoptJob& job) {
+    const char* args[DEXOPT_PARAM_COUNT];
+    for (size_t i = 0; i < DEXOPT_PARAM_COUNT; ++i) {
+        args[i] = job.params[i].c_str();
+    }
+    char reply[REPLY_MAX];
+    reply[0] = 0;
+    return run_dexopt(args, reply);
+}
+
+static int do_queue_dexopt(char **arg, char reply[REPLY_MAX] ATTRIBUTE_UNUSED)
+{
+    /* dexopt parameters, int64_t last_used_ms */
+    DexoptJob job;
+    for (size_t i = 0; i < DEXOPT_PARAM_COUNT; ++i) {
+        CHECK(arg[i] != nullptr);
+        job.params[i] = arg[i];
+    }
+    job.last_used_ms = strtoll(arg[DEXOPT_PARAM_COUNT], nullptr, 10);
+    dexopt_queue.push_back(std::move(job));
+    return 0;
+}
+
+static int do_run_dexopt_queue(char **arg ATTRIBUTE_UNUSED, char reply[REPLY_MAX])
+{
+    std::vector<DexoptJob> jobs;
+    jobs.swap(dexopt_queue);
+    std::stable_sort(jobs.begin(), jobs.end(), [](const DexoptJob& a, const DexoptJob& b) {
+        return a.last_used_ms > b.last_used_ms;
+    });
+
+    const size_t max_jobs = get_dexopt_batch_jobs();
+    const long min_free_kb =
+            get_long_property("dalvik.vm.dexopt-batch-min-free-mb", kDefaultDexoptBatchMinFreeMb)
+            * 1024;
+
+    struct RunningJob {
+        size_t index;
+        int64_t start_ns;
+    };
+    std::map<pid_t, RunningJob> running;
+    size_t next = 0;
+    int failed = 0;
+    const int64_t batch_start_ns = monotonic_ns();
+
+    auto report = [&](size_t index, int64_t start_ns, int res) {
+        const char* pkgname = jobs[index].params[2].c_str();
+        int64_t duration_ms = (monotonic_ns() - start_ns) / 1000000;
+        if (res == 0) {
+            ALOGI("dexopt of %s took %" PRId64 " ms\n", pkgname, duration_ms);
+        } else {
+            ALOGE("dexopt of %s failed (0x%04x) after %" PRId64 " ms\n", pkgname, res,
+                  duration_ms);
+            failed++;
+        }
+    };
+
+    while (next < jobs.size() || !running.empty()) {
+        if (next < jobs.size() && (running.empty() ||
+                (running.size() < max_jobs && can_start_another_dexopt(min_free_kb)))) {
+            size_t index = next++;
+            int64_t start_ns = monotonic_ns();
+            pid_t pid = fork();
+            if (pid == 0) {
+                _exit(run_dexopt_job(jobs[index]) == 0 ? 0 : 1);
+            } else if (pid < 0) {
+                PLOG(WARNING) << "fork failed, running dexopt in installd";
+                report(index, start_ns, run_dexopt_job(jobs[index]));
+            } else {
+                running[pid] = RunningJob{index, start_ns};
+            }
+            continue;
+        }
+
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            PLOG(ERROR) << "waitpid failed with " << running.size() << " dexopt jobs running";
+            failed += running.size();
+            running.clear();
+            continue;
+        }
+        auto it = running.find(pid);
+        if (it == running.end()) {
+            continue;
+        }
+        int res = (WIFEXITED(status) && WEXITSTATUS(status) == 0) ? 0 : status;
+        report(it->second.index, it->second.start_ns, res);
+        running.erase(it);
+    }
+
+    ALOGI("dexopt of %zu packages took %" PRId64 " ms, %d failed\n", jobs.size(),
+          (monotonic_ns() - batch_start_ns) / 1000000, failed);
+    snprintf(reply, REPLY_MAX, "%d", failed);
+    return failed == 0 ? 0 : -1;
 }
 
 static int do_merge_profiles(char **arg, char reply[REPLY_MAX])
@@ -450,6 +642,8 @@ struct cmdinfo cmds[] = {
     { "destroy_user_data",    3, do_destroy_user_data },
 
     { "dexopt",              10, do_dexopt },
+    { "queue_dexopt",        11, do_queue_dexopt },
+    { "run_dexopt_queue",     0, do_run_dexopt_queue },
     { "markbootcomplete",     1, do_mark_boot_complete },
     { "rmdex",                2, do_rm_dex },
     { "freecache",            2, do_free_cache },
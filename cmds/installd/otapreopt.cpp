@@ -15,6 +15,7 @@
  */
 
 #include <algorithm>
+#include <fcntl.h>
 #include <inttypes.h>
 #include <random>
 #include <regex>
@@ -27,6 +28,7 @@
 #include <sys/stat.h>
 #include <sys/wait.h>
 
+#include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/macros.h>
 #include <android-base/stringprintf.h>
@@ -326,6 +328,9 @@ private:
             cleared = true;
         }
 
+        // Whatever was compiled against the previous boot image has to be compiled again.
+        ClearCheckpoints();
+
         // Reset umask in otapreopt, so that we control the the access for the files we create.
         umask(0);
 
@@ -565,13 +570,83 @@ private:
         return false;
     }
 
+    // Packages already compiled for this OTA are listed in a checkpoint file in the OTA data
+    // directory, so that preopting after a reboot or a cancellation goes on where it stopped
+    // instead of compiling everything again. Every line identifies one dexopt invocation: the
+    // build of the target slot, the dexopt parameters and the state of the apk.
+    std::string GetCheckpointFile() const {
+        return GetOTADataDirectory() + "/otapreopt.checkpoint";
+    }
+
+    std::string GetCheckpointKey() const {
+        constexpr size_t kApkPathIndex = 0;
+        const std::string* fingerprint = system_properties_.GetProperty("ro.build.fingerprint");
+        std::string key = fingerprint != nullptr ? *fingerprint : "";
+        for (size_t i = 0; i < DEXOPT_PARAM_COUNT; ++i) {
+            key += ' ';
+            key += package_parameters_[i] != nullptr ? package_parameters_[i] : "!";
+        }
+        struct stat st;
+        if (stat(package_parameters_[kApkPathIndex], &st) == 0) {
+            key += StringPrintf(" %" PRId64 " %" PRId64 ".%09ld", static_cast<int64_t>(st.st_size),
+                                static_cast<int64_t>(st.st_mtim.tv_sec), st.st_mtim.tv_nsec);
+        }
+        // The parameters don't contain newlines, but make sure a key is always a single line.
+        std::replace(key.begin(), key.end(), '\n', ' ');
+        return key;
+    }
+
+    bool IsCheckpointed(const std::string& key) const {
+        std::string checkpoints;
+        if (!android::base::ReadFileToString(GetCheckpointFile(), &checkpoints)) {
+            return false;
+        }
+        for (const std::string& line : Split(checkpoints, "\n")) {
+            if (line == key) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void AddCheckpoint(const std::string& key) const {
+        // Several packages may be compiled at once, a single O_APPEND write keeps lines whole.
+        int fd = TEMP_FAILURE_RETRY(open(GetCheckpointFile().c_str(),
+                                         O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600));
+        if (fd < 0) {
+            PLOG(WARNING) << "Could not open " << GetCheckpointFile();
+            return;
+        }
+        // The artifacts must be on disk before they are recorded as done, they are on /data too.
+        if (syncfs(fd) != 0) {
+            PLOG(WARNING) << "Could not sync " << GetCheckpointFile();
+        }
+        if (!android::base::WriteStringToFd(key + "\n", fd) || fsync(fd) != 0) {
+            PLOG(WARNING) << "Could not write " << GetCheckpointFile();
+        }
+        close(fd);
+    }
+
+    void ClearCheckpoints() const {
+        if (unlink(GetCheckpointFile().c_str()) != 0 && errno != ENOENT) {
+            PLOG(WARNING) << "Could not remove " << GetCheckpointFile();
+        }
+    }
+
     int RunPreopt() {
         if (ShouldSkipPreopt()) {
             return 0;
         }
 
+        std::string checkpoint_key = GetCheckpointKey();
+        if (IsCheckpointed(checkpoint_key)) {
+            LOG(INFO) << "Already preopted " << package_parameters_[0];
+            return 0;
+        }
+
         int dexopt_result = dexopt(package_parameters_);
         if (dexopt_result == 0) {
+            AddCheckpoint(checkpoint_key);
             return 0;
         }
 
@@ -585,7 +660,11 @@ private:
         }
 
         LOG(WARNING) << "Original dexopt failed, re-trying after boot image was regenerated.";
-        return dexopt(package_parameters_);
+        dexopt_result = dexopt(package_parameters_);
+        if (dexopt_result == 0) {
+            AddCheckpoint(checkpoint_key);
+        }
+        return dexopt_result;
     }
 
     ////////////////////////////////////
@@ -17,6 +17,8 @@
 #include <fcntl.h>
 #include <linux/unistd.h>
 #include <sys/mount.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
 
 #include <sstream>
@@ -24,6 +26,8 @@
 #include <android-base/logging.h>
 #include <android-base/macros.h>
 #include <android-base/stringprintf.h>
+#include <cutils/sched_policy.h>
+#include <system/thread_defs.h>
 
 #include <commands.h>
 #include <otapreopt_utils.h>
@@ -45,6 +49,26 @@ static void CloseDescriptor(int fd) {
     }
 }
 
+// From linux/ioprio.h, which isn't exported to userspace.
+static constexpr int kIoprioWhoProcess = 1;
+static constexpr int kIoprioClassIdle = 3;
+static constexpr int kIoprioClassShift = 13;
+
+// Preopting runs while the device is in use, so it and everything it starts (dex2oat, patchoat)
+// run in the background. The idle I/O class only gets the disk when no one else needs it and the
+// background cgroup only gets the CPUs the foreground leaves, so both back off under foreground
+// load by themselves and take everything when the device is idle. Errors are ignored, as for the
+// vendor mount below.
+static void LowerPriority() {
+    int result = syscall(__NR_ioprio_set, kIoprioWhoProcess, 0,
+                         kIoprioClassIdle << kIoprioClassShift);
+    UNUSED(result);
+    result = set_sched_policy(0, SP_BACKGROUND);
+    UNUSED(result);
+    result = setpriority(PRIO_PROCESS, 0, ANDROID_PRIORITY_BACKGROUND);
+    UNUSED(result);
+}
+
 static void CloseDescriptor(const char* descriptor_string) {
     int fd = -1;
     std::istringstream stream(descriptor_string);
@@ -68,6 +92,10 @@ static int otapreopt_chroot(const int argc, char **arg) {
     // 2) The status channel.
     CloseDescriptor(arg[1]);
 
+    // The cgroups are mounted below /dev, which isn't bind-mounted recursively, so this has to
+    // happen before the chroot.
+    LowerPriority();
+
     // We need to run the otapreopt tool from the postinstall partition. As such, set up a
     // mount namespace and change root.
 
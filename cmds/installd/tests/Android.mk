@@ -5,6 +5,7 @@ LOCAL_ADDITIONAL_DEPENDENCIES := $(LOCAL_PATH)/Android.mk
 
 # Build the unit tests.
 test_src_files := \
+    installd_dir_size_cache_test.cpp \
     installd_utils_test.cpp
 
 shared_libraries := \
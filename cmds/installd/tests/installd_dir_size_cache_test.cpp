@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <diskusage/dirsize.h>
+#include <dir_size_cache.h>
+
+#undef LOG_TAG
+#define LOG_TAG "dir_size_cache_test"
+
+#define TEST_TMP_DIR "/data/local/tmp/"
+
+namespace android {
+namespace installd {
+
+class DirSizeCacheTest : public testing::Test {
+protected:
+    virtual void SetUp() {
+        char dir[] = TEST_TMP_DIR "dir_size_cache_test.XXXXXX";
+        ASSERT_TRUE(mkdtemp(dir) != nullptr);
+        root = dir;
+        MakeDir("a");
+        MakeDir("a/b");
+        WriteFile("a/file", 8192);
+        WriteFile("a/b/file", 16384);
+    }
+
+    virtual void TearDown() {
+        std::string cmd = "rm -rf " + root;
+        system(cmd.c_str());
+    }
+
+    void MakeDir(const std::string& name) {
+        ASSERT_EQ(0, mkdir((root + "/" + name).c_str(), 0700));
+    }
+
+    void WriteFile(const std::string& name, size_t size) {
+        int fd = open((root + "/" + name).c_str(), O_WRONLY | O_CREAT | O_APPEND, 0600);
+        ASSERT_GE(fd, 0);
+        std::vector<char> data(size, 'x');
+        ASSERT_EQ(static_cast<ssize_t>(size), write(fd, data.data(), size));
+        // Make sure the blocks are allocated, st_blocks is what is measured.
+        fsync(fd);
+        close(fd);
+    }
+
+    int64_t WalkedSize() {
+        int dfd = open(root.c_str(), O_RDONLY | O_DIRECTORY);
+        return dfd >= 0 ? calculate_dir_size(dfd) : -1;
+    }
+
+    std::string root;
+    DirSizeCache cache;
+};
+
+TEST_F(DirSizeCacheTest, MatchesWalk) {
+    int64_t size = WalkedSize();
+    EXPECT_GT(size, 0);
+    EXPECT_EQ(size, cache.GetSize(root));
+    EXPECT_EQ(size, cache.GetSize(root));
+}
+
+TEST_F(DirSizeCacheTest, ParallelMatchesWalk) {
+    // More subdirectories than calculate_dir_size_parallel() queues, so that
+    // some are sized by the thread that found them.
+    for (int i = 0; i < 100; i++) {
+        std::string name = "a/b/" + std::to_string(i);
+        MakeDir(name);
+        MakeDir(name + "/c");
+        WriteFile(name + "/c/file", 4096);
+    }
+    int64_t size = WalkedSize();
+    for (int threads : {0, 1, 2, 4}) {
+        int dfd = open(root.c_str(), O_RDONLY | O_DIRECTORY);
+        ASSERT_GE(dfd, 0);
+        EXPECT_EQ(size, calculate_dir_size_parallel(dfd, threads));
+    }
+}
+
+TEST_F(DirSizeCacheTest, MissingDirectory) {
+    EXPECT_EQ(0, cache.GetSize(root + "/missing"));
+}
+
+TEST_F(DirSizeCacheTest, FileCreated) {
+    int64_t before = cache.GetSize(root);
+    WriteFile("a/b/new", 4096);
+    int64_t after = cache.GetSize(root);
+    EXPECT_GT(after, before);
+    EXPECT_EQ(WalkedSize(), after);
+}
+
+TEST_F(DirSizeCacheTest, FileGrown) {
+    int64_t before = cache.GetSize(root);
+    WriteFile("a/b/file", 65536);
+    int64_t after = cache.GetSize(root);
+    EXPECT_GT(after, before);
+    EXPECT_EQ(WalkedSize(), after);
+}
+
+TEST_F(DirSizeCacheTest, DirectoryRemoved) {
+    int64_t before = cache.GetSize(root);
+    ASSERT_EQ(0, unlink((root + "/a/b/file").c_str()));
+    ASSERT_EQ(0, rmdir((root + "/a/b").c_str()));
+    int64_t after = cache.GetSize(root);
+    EXPECT_LT(after, before);
+    EXPECT_EQ(WalkedSize(), after);
+}
+
+TEST_F(DirSizeCacheTest, NestedTrees) {
+    int64_t inner = cache.GetSize(root + "/a/b");
+    int64_t outer = cache.GetSize(root);
+    WriteFile("a/b/new", 4096);
+    EXPECT_GT(cache.GetSize(root + "/a/b"), inner);
+    EXPECT_GT(cache.GetSize(root), outer);
+    EXPECT_EQ(WalkedSize(), cache.GetSize(root));
+}
+
+}  // namespace installd
+}  // namespace android
@@ -19,9 +19,20 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <sys/xattr.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <thread>
 
 #if defined(__APPLE__)
 #include <sys/mount.h>
@@ -29,8 +40,10 @@
 #include <sys/statfs.h>
 #endif
 
+#include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/stringprintf.h>
+#include <android-base/unique_fd.h>
 #include <cutils/fs.h>
 #include <cutils/log.h>
 #include <private/android_filesystem_config.h>
@@ -41,7 +54,6 @@
 #define LOG_TAG "installd"
 #endif
 
-#define CACHE_NOISY(x) //x
 #define DEBUG_XATTRS 0
 
 using android::base::StringPrintf;
@@ -526,264 +538,351 @@ int copy_dir_files(const char *srcname,
     return res;
 }
 
-int64_t data_disk_free(const std::string& data_path)
-{
-    struct statfs sfs;
-    if (statfs(data_path.c_str(), &sfs) == 0) {
-        return sfs.f_bavail * sfs.f_bsize;
-    } else {
-        PLOG(ERROR) << "Couldn't statfs " << data_path;
+static constexpr size_t kMaxCopyThreads = 4;
+// Files queued at most, so that walking huge trees doesn't take memory without bound.
+static constexpr size_t kMaxQueuedCopies = 1024;
+static constexpr int64_t kCopyProgressIntervalNs = 5 * 1000000000LL;
+
+static constexpr const char* kXattrSelinux = "security.selinux";
+
+struct copy_job_t {
+    std::string from;
+    std::string to;
+    struct stat st;
+};
+
+struct copy_state_t {
+    std::mutex lock;
+    std::condition_variable cond;
+    std::deque<copy_job_t> jobs;
+    bool walked;
+    bool failed;
+    // Progress, guarded by lock.
+    int64_t expected_size;
+    int64_t copied_size;
+    size_t copied_files;
+    int64_t start_ns;
+    int64_t last_progress_ns;
+    // Directories are only given their attributes once all of their files were copied.
+    std::vector<copy_job_t> dirs;
+};
+
+static int64_t copy_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+// Copies the extended attributes of from to to, but their SELinux label, which the caller is
+// expected to restore, and the inodes remembered in kXattrInode*, which belong to the source.
+static int copy_xattrs(int fromfd, int tofd, const std::string& from) {
+    ssize_t len = flistxattr(fromfd, nullptr, 0);
+    if (len <= 0) {
+        return (len == 0 || errno == ENOTSUP) ? 0 : -1;
+    }
+    std::vector<char> names(len);
+    len = flistxattr(fromfd, names.data(), names.size());
+    if (len < 0) {
         return -1;
     }
+    std::vector<char> value;
+    for (const char* name = names.data(); name < names.data() + len; name += strlen(name) + 1) {
+        if (!strcmp(name, kXattrSelinux) || !strcmp(name, kXattrInodeCache)
+                || !strcmp(name, kXattrInodeCodeCache)) {
+            continue;
+        }
+        ssize_t size = fgetxattr(fromfd, name, nullptr, 0);
+        if (size < 0) {
+            PLOG(WARNING) << "Failed to read xattr " << name << " of " << from;
+            continue;
+        }
+        value.resize(size);
+        size = fgetxattr(fromfd, name, value.data(), value.size());
+        if (size < 0 || fsetxattr(tofd, name, value.data(), size, 0) != 0) {
+            PLOG(ERROR) << "Failed to copy xattr " << name << " of " << from;
+            return -1;
+        }
+    }
+    return 0;
 }
 
-cache_t* start_cache_collection()
-{
-    cache_t* cache = (cache_t*)calloc(1, sizeof(cache_t));
-    return cache;
+// Gives to the owner, permissions, extended attributes and timestamps of from.
+static int copy_attributes(int fromfd, int tofd, const std::string& from, const struct stat& st) {
+    // chown() clears the set-user-ID and set-group-ID bits, so it goes first.
+    if (fchown(tofd, st.st_uid, st.st_gid) != 0 || fchmod(tofd, st.st_mode & 07777) != 0) {
+        PLOG(ERROR) << "Failed to copy the owner and permissions of " << from;
+        return -1;
+    }
+    if (copy_xattrs(fromfd, tofd, from) != 0) {
+        return -1;
+    }
+    const struct timespec times[2] = { st.st_atim, st.st_mtim };
+    if (futimens(tofd, times) != 0) {
+        PLOG(ERROR) << "Failed to copy the timestamps of " << from;
+        return -1;
+    }
+    return 0;
 }
 
-#define CACHE_BLOCK_SIZE (512*1024)
-
-static void* _cache_malloc(cache_t* cache, size_t len)
-{
-    len = (len+3)&~3;
-    if (len > (CACHE_BLOCK_SIZE/2)) {
-        // It doesn't make sense to try to put this allocation into one
-        // of our blocks, because it is so big.  Instead, make a new dedicated
-        // block for it.
-        int8_t* res = (int8_t*)malloc(len+sizeof(void*));
-        if (res == NULL) {
-            return NULL;
+static int copy_file_contents(int fromfd, int tofd, const std::string& from, off_t size) {
+    // sendfile() copies within the kernel, even across filesystems.
+    off_t offset = 0;
+    while (offset < size) {
+        ssize_t n = sendfile(tofd, fromfd, &offset, std::min<off_t>(size - offset, 1 << 30));
+        if (n < 0 && errno == EINTR) {
+            continue;
         }
-        CACHE_NOISY(ALOGI("Allocated large cache mem block: %p size %zu", res, len));
-        // Link it into our list of blocks, not disrupting the current one.
-        if (cache->memBlocks == NULL) {
-            *(void**)res = NULL;
-            cache->memBlocks = res;
-        } else {
-            *(void**)res = *(void**)cache->memBlocks;
-            *(void**)cache->memBlocks = res;
+        if (n < 0 && offset == 0 && (errno == EINVAL || errno == ENOSYS)) {
+            break;
+        }
+        if (n < 0) {
+            PLOG(ERROR) << "Failed to copy " << from;
+            return -1;
         }
-        return res + sizeof(void*);
-    }
-    int8_t* res = cache->curMemBlockAvail;
-    int8_t* nextPos = res + len;
-    if (cache->memBlocks == NULL || nextPos > cache->curMemBlockEnd) {
-        int8_t* newBlock = (int8_t*) malloc(CACHE_BLOCK_SIZE);
-        if (newBlock == NULL) {
-            return NULL;
+        if (n == 0) {
+            // The file shrank since it was stat'ed.
+            return 0;
         }
-        CACHE_NOISY(ALOGI("Allocated new cache mem block: %p", newBlock));
-        *(void**)newBlock = cache->memBlocks;
-        cache->memBlocks = newBlock;
-        res = cache->curMemBlockAvail = newBlock + sizeof(void*);
-        cache->curMemBlockEnd = newBlock + CACHE_BLOCK_SIZE;
-        nextPos = res + len;
-    }
-    CACHE_NOISY(ALOGI("cache_malloc: ret %p size %zu, block=%p, nextPos=%p",
-            res, len, cache->memBlocks, nextPos));
-    cache->curMemBlockAvail = nextPos;
-    return res;
-}
+    }
+    if (offset >= size) {
+        return 0;
+    }
 
-static void* _cache_realloc(cache_t* cache, void* cur, size_t origLen, size_t len)
-{
-    // This isn't really a realloc, but it is good enough for our purposes here.
-    void* alloc = _cache_malloc(cache, len);
-    if (alloc != NULL && cur != NULL) {
-        memcpy(alloc, cur, origLen < len ? origLen : len);
+    char buf[64 * 1024];
+    ssize_t n;
+    while ((n = TEMP_FAILURE_RETRY(read(fromfd, buf, sizeof(buf)))) > 0) {
+        if (!android::base::WriteFully(tofd, buf, n)) {
+            break;
+        }
+    }
+    if (n != 0) {
+        PLOG(ERROR) << "Failed to copy " << from;
+        return -1;
     }
-    return alloc;
+    return 0;
 }
 
-static void _inc_num_cache_collected(cache_t* cache)
-{
-    cache->numCollected++;
-    if ((cache->numCollected%20000) == 0) {
-        ALOGI("Collected cache so far: %zd directories, %zd files",
-            cache->numDirs, cache->numFiles);
+static int copy_file(const copy_job_t& job) {
+    base::unique_fd fromfd(open(job.from.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC));
+    if (fromfd.get() < 0) {
+        PLOG(ERROR) << "Failed to open " << job.from;
+        return -1;
+    }
+    // Delete any existing destination file first, like cp -F.
+    if (unlink(job.to.c_str()) != 0 && errno != ENOENT) {
+        PLOG(ERROR) << "Failed to delete " << job.to;
+        return -1;
+    }
+    base::unique_fd tofd(open(job.to.c_str(),
+            O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600));
+    if (tofd.get() < 0) {
+        PLOG(ERROR) << "Failed to create " << job.to;
+        return -1;
+    }
+    if (copy_file_contents(fromfd.get(), tofd.get(), job.from, job.st.st_size) != 0) {
+        return -1;
     }
+    return copy_attributes(fromfd.get(), tofd.get(), job.from, job.st);
 }
 
-static cache_dir_t* _add_cache_dir_t(cache_t* cache, cache_dir_t* parent, const char *name)
-{
-    size_t nameLen = strlen(name);
-    cache_dir_t* dir = (cache_dir_t*)_cache_malloc(cache, sizeof(cache_dir_t)+nameLen+1);
-    if (dir != NULL) {
-        dir->parent = parent;
-        dir->childCount = 0;
-        dir->hiddenCount = 0;
-        dir->deleted = 0;
-        strcpy(dir->name, name);
-        if (cache->numDirs >= cache->availDirs) {
-            size_t newAvail = cache->availDirs < 1000 ? 1000 : cache->availDirs*2;
-            cache_dir_t** newDirs = (cache_dir_t**)_cache_realloc(cache, cache->dirs,
-                    cache->availDirs*sizeof(cache_dir_t*), newAvail*sizeof(cache_dir_t*));
-            if (newDirs == NULL) {
-                ALOGE("Failure growing cache dirs array for %s\n", name);
-                return NULL;
-            }
-            cache->availDirs = newAvail;
-            cache->dirs = newDirs;
+static void copy_files(copy_state_t* state) {
+    std::unique_lock<std::mutex> lock(state->lock);
+    while (true) {
+        state->cond.wait(lock, [state]() { return !state->jobs.empty() || state->walked; });
+        if (state->jobs.empty()) {
+            return;
         }
-        cache->dirs[cache->numDirs] = dir;
-        cache->numDirs++;
-        if (parent != NULL) {
-            parent->childCount++;
+        copy_job_t job = std::move(state->jobs.front());
+        state->jobs.pop_front();
+        // There is room for another file now.
+        state->cond.notify_all();
+        if (state->failed) {
+            // Don't bother copying what is left.
+            continue;
         }
-        _inc_num_cache_collected(cache);
-    } else {
-        ALOGE("Failure allocating cache_dir_t for %s\n", name);
-    }
-    return dir;
-}
 
-static cache_file_t* _add_cache_file_t(cache_t* cache, cache_dir_t* dir, time_t modTime,
-        const char *name)
-{
-    size_t nameLen = strlen(name);
-    cache_file_t* file = (cache_file_t*)_cache_malloc(cache, sizeof(cache_file_t)+nameLen+1);
-    if (file != NULL) {
-        file->dir = dir;
-        file->modTime = modTime;
-        strcpy(file->name, name);
-        if (cache->numFiles >= cache->availFiles) {
-            size_t newAvail = cache->availFiles < 1000 ? 1000 : cache->availFiles*2;
-            cache_file_t** newFiles = (cache_file_t**)_cache_realloc(cache, cache->files,
-                    cache->availFiles*sizeof(cache_file_t*), newAvail*sizeof(cache_file_t*));
-            if (newFiles == NULL) {
-                ALOGE("Failure growing cache file array for %s\n", name);
-                return NULL;
-            }
-            cache->availFiles = newAvail;
-            cache->files = newFiles;
+        lock.unlock();
+        int res = copy_file(job);
+        lock.lock();
+
+        if (res != 0) {
+            state->failed = true;
+            state->cond.notify_all();
+            continue;
+        }
+        state->copied_size += job.st.st_blocks * 512;
+        state->copied_files++;
+        int64_t now = copy_now_ns();
+        if (now - state->last_progress_ns >= kCopyProgressIntervalNs) {
+            state->last_progress_ns = now;
+            LOG(INFO) << "Copied " << state->copied_files << " files, "
+                    << (state->copied_size >> 20) << " of " << (state->expected_size >> 20)
+                    << " MB";
         }
-        CACHE_NOISY(ALOGI("Setting file %p at position %zd in array %p", file,
-                cache->numFiles, cache->files));
-        cache->files[cache->numFiles] = file;
-        cache->numFiles++;
-        dir->childCount++;
-        _inc_num_cache_collected(cache);
-    } else {
-        ALOGE("Failure allocating cache_file_t for %s\n", name);
     }
-    return file;
 }
 
-static int _add_cache_files(cache_t *cache, cache_dir_t *parentDir, const char *dirName,
-        DIR* dir, char *pathBase, char *pathPos, size_t pathAvailLen)
-{
-    struct dirent *de;
-    cache_dir_t* cacheDir = NULL;
-    int dfd;
+static void queue_copy(copy_state_t* state, copy_job_t job) {
+    std::unique_lock<std::mutex> lock(state->lock);
+    state->cond.wait(lock, [state]() {
+        return state->jobs.size() < kMaxQueuedCopies || state->failed;
+    });
+    state->jobs.push_back(std::move(job));
+    state->cond.notify_all();
+}
 
-    CACHE_NOISY(ALOGI("_add_cache_files: parent=%p dirName=%s dir=%p pathBase=%s",
-            parentDir, dirName, dir, pathBase));
+static bool copy_failed(copy_state_t* state) {
+    std::lock_guard<std::mutex> lock(state->lock);
+    return state->failed;
+}
 
-    dfd = dirfd(dir);
+static int copy_special(const std::string& from, const std::string& to, const struct stat& st) {
+    if (unlink(to.c_str()) != 0 && errno != ENOENT) {
+        PLOG(ERROR) << "Failed to delete " << to;
+        return -1;
+    }
+    if (S_ISLNK(st.st_mode)) {
+        char target[PATH_MAX];
+        ssize_t len = readlink(from.c_str(), target, sizeof(target) - 1);
+        if (len < 0) {
+            PLOG(ERROR) << "Failed to read symlink " << from;
+            return -1;
+        }
+        target[len] = 0;
+        if (symlink(target, to.c_str()) != 0) {
+            PLOG(ERROR) << "Failed to copy symlink " << from;
+            return -1;
+        }
+    } else if (mknod(to.c_str(), st.st_mode, st.st_rdev) != 0) {
+        PLOG(ERROR) << "Failed to copy " << from;
+        return -1;
+    } else if (chmod(to.c_str(), st.st_mode & 07777) != 0) {
+        PLOG(ERROR) << "Failed to copy the permissions of " << from;
+        return -1;
+    }
+    const struct timespec times[2] = { st.st_atim, st.st_mtim };
+    if (lchown(to.c_str(), st.st_uid, st.st_gid) != 0
+            || utimensat(AT_FDCWD, to.c_str(), times, AT_SYMLINK_NOFOLLOW) != 0) {
+        PLOG(ERROR) << "Failed to copy the owner and timestamps of " << from;
+        return -1;
+    }
+    return 0;
+}
 
-    if (dfd < 0) return 0;
+static int copy_dir(copy_state_t* state, const std::string& from, const std::string& to,
+        const struct stat& st) {
+    if (mkdir(to.c_str(), 0700) != 0) {
+        struct stat to_st;
+        if (errno != EEXIST || lstat(to.c_str(), &to_st) != 0 || !S_ISDIR(to_st.st_mode)) {
+            PLOG(ERROR) << "Failed to create " << to;
+            return -1;
+        }
+    }
+    state->dirs.push_back(copy_job_t{from, to, st});
 
-    // Sub-directories always get added to the data structure, so if they
-    // are empty we will know about them to delete them later.
-    cacheDir = _add_cache_dir_t(cache, parentDir, dirName);
+    DIR* d = opendir(from.c_str());
+    if (d == nullptr) {
+        PLOG(ERROR) << "Failed to open " << from;
+        return -1;
+    }
+    int res = 0;
+    struct dirent* de;
+    while (res == 0 && (de = readdir(d))) {
+        const char* name = de->d_name;
+        /* always skip "." and ".." */
+        if (name[0] == '.') {
+            if (name[1] == 0) continue;
+            if ((name[1] == '.') && (name[2] == 0)) continue;
+        }
 
-    while ((de = readdir(dir))) {
-        const char *name = de->d_name;
+        copy_job_t job{from + "/" + name, to + "/" + name, {}};
+        if (fstatat(dirfd(d), name, &job.st, AT_SYMLINK_NOFOLLOW) != 0) {
+            PLOG(ERROR) << "Failed to stat " << job.from;
+            res = -1;
+        } else if (S_ISDIR(job.st.st_mode)) {
+            res = copy_dir(state, job.from, job.to, job.st);
+        } else if (S_ISREG(job.st.st_mode)) {
+            queue_copy(state, std::move(job));
+        } else {
+            res = copy_special(job.from, job.to, job.st);
+        }
+        if (copy_failed(state)) {
+            res = -1;
+        }
+    }
+    closedir(d);
+    return res;
+}
 
-        if (de->d_type == DT_DIR) {
-            int subfd;
-            DIR *subdir;
+int copy_directory_recursive(const std::string& from, const std::string& to,
+        int64_t expected_size) {
+    struct stat st;
+    if (lstat(from.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+        PLOG(ERROR) << "Failed to stat directory " << from;
+        return -1;
+    }
 
-                /* always skip "." and ".." */
-            if (name[0] == '.') {
-                if (name[1] == 0) continue;
-                if ((name[1] == '.') && (name[2] == 0)) continue;
-            }
+    copy_state_t state;
+    state.walked = false;
+    state.failed = false;
+    state.expected_size = expected_size;
+    state.copied_size = 0;
+    state.copied_files = 0;
+    state.start_ns = state.last_progress_ns = copy_now_ns();
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t num_threads = std::min(kMaxCopyThreads, static_cast<size_t>(std::max(cpus, 1L)));
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < num_threads; i++) {
+        threads.emplace_back(copy_files, &state);
+    }
 
-            subfd = openat(dfd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
-            if (subfd < 0) {
-                ALOGE("Couldn't openat %s: %s\n", name, strerror(errno));
-                continue;
-            }
-            subdir = fdopendir(subfd);
-            if (subdir == NULL) {
-                ALOGE("Couldn't fdopendir %s: %s\n", name, strerror(errno));
-                close(subfd);
-                continue;
-            }
-            if (cacheDir == NULL) {
-                cacheDir = _add_cache_dir_t(cache, parentDir, dirName);
-            }
-            if (cacheDir != NULL) {
-                // Update pathBase for the new path...  this may change dirName
-                // if that is also pointing to the path, but we are done with it
-                // now.
-                size_t finallen = snprintf(pathPos, pathAvailLen, "/%s", name);
-                CACHE_NOISY(ALOGI("Collecting dir %s\n", pathBase));
-                if (finallen < pathAvailLen) {
-                    _add_cache_files(cache, cacheDir, name, subdir, pathBase,
-                            pathPos+finallen, pathAvailLen-finallen);
-                } else {
-                    // Whoops, the final path is too long!  We'll just delete
-                    // this directory.
-                    ALOGW("Cache dir %s truncated in path %s; deleting dir\n",
-                            name, pathBase);
-                    _delete_dir_contents(subdir, NULL);
-                    if (unlinkat(dfd, name, AT_REMOVEDIR) < 0) {
-                        ALOGE("Couldn't unlinkat %s: %s\n", name, strerror(errno));
-                    }
-                }
-            }
-            closedir(subdir);
-        } else if (de->d_type == DT_REG) {
-            // Skip files that start with '.'; they will be deleted if
-            // their entire directory is deleted.  This allows for metadata
-            // like ".nomedia" to remain in the directory until the entire
-            // directory is deleted.
-            if (cacheDir == NULL) {
-                cacheDir = _add_cache_dir_t(cache, parentDir, dirName);
-            }
-            if (name[0] == '.') {
-                cacheDir->hiddenCount++;
-                continue;
-            }
-            if (cacheDir != NULL) {
-                // Build final full path for file...  this may change dirName
-                // if that is also pointing to the path, but we are done with it
-                // now.
-                size_t finallen = snprintf(pathPos, pathAvailLen, "/%s", name);
-                CACHE_NOISY(ALOGI("Collecting file %s\n", pathBase));
-                if (finallen < pathAvailLen) {
-                    struct stat s;
-                    if (stat(pathBase, &s) >= 0) {
-                        _add_cache_file_t(cache, cacheDir, s.st_mtime, name);
-                    } else {
-                        ALOGW("Unable to stat cache file %s; deleting\n", pathBase);
-                        if (unlink(pathBase) < 0) {
-                            ALOGE("Couldn't unlink %s: %s\n", pathBase, strerror(errno));
-                        }
-                    }
-                } else {
-                    // Whoops, the final path is too long!  We'll just delete
-                    // this file.
-                    ALOGW("Cache file %s truncated in path %s; deleting\n",
-                            name, pathBase);
-                    if (unlinkat(dfd, name, 0) < 0) {
-                        *pathPos = 0;
-                        ALOGE("Couldn't unlinkat %s in %s: %s\n", name, pathBase,
-                                strerror(errno));
-                    }
-                }
-            }
-        } else {
-            cacheDir->hiddenCount++;
+    int res = copy_dir(&state, from, to, st);
+    {
+        std::lock_guard<std::mutex> lock(state.lock);
+        state.walked = true;
+        if (res != 0) {
+            state.failed = true;
         }
+        state.cond.notify_all();
     }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    if (state.failed) {
+        return -1;
+    }
+
+    // Deepest directories first, copying into a directory changes its timestamps.
+    for (auto dir = state.dirs.rbegin(); dir != state.dirs.rend(); ++dir) {
+        base::unique_fd fromfd(open(dir->from.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+        base::unique_fd tofd(open(dir->to.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+        if (fromfd.get() < 0 || tofd.get() < 0) {
+            PLOG(ERROR) << "Failed to open " << dir->from << " or " << dir->to;
+            return -1;
+        }
+        if (copy_attributes(fromfd.get(), tofd.get(), dir->from, dir->st) != 0) {
+            return -1;
+        }
+    }
+
+    LOG(INFO) << "Copied " << state.copied_files << " files, " << (state.copied_size >> 20)
+            << " MB from " << from << " in " << (copy_now_ns() - state.start_ns) / 1000000
+            << " ms";
     return 0;
 }
 
+int64_t data_disk_free(const std::string& data_path)
+{
+    struct statfs sfs;
+    if (statfs(data_path.c_str(), &sfs) == 0) {
+        return sfs.f_bavail * sfs.f_bsize;
+    } else {
+        PLOG(ERROR) << "Couldn't statfs " << data_path;
+        return -1;
+    }
+}
+
 int get_path_inode(const std::string& path, ino_t *inode) {
     struct stat buf;
     memset(&buf, 0, sizeof(buf));
@@ -877,22 +976,17 @@ std::string read_path_inode(const std::string& parent, const char* name, const c
     }
 }
 
-void add_cache_files(cache_t* cache, const std::string& data_path) {
+void add_cache_dirs(std::vector<std::string>* dirs, const std::string& data_path) {
     DIR *d;
     struct dirent *de;
-    char dirname[PATH_MAX];
-
-    const char* basepath = data_path.c_str();
-    CACHE_NOISY(ALOGI("add_cache_files: basepath=%s\n", basepath));
 
-    d = opendir(basepath);
+    d = opendir(data_path.c_str());
     if (d == NULL) {
         return;
     }
 
     while ((de = readdir(d))) {
         if (de->d_type == DT_DIR) {
-            DIR* subdir;
             const char *name = de->d_name;
 
                 /* always skip "." and ".." */
@@ -901,146 +995,242 @@ void add_cache_files(cache_t* cache, const std::string& data_path) {
                 if ((name[1] == '.') && (name[2] == 0)) continue;
             }
 
-            auto parent = StringPrintf("%s/%s", basepath, name);
-            auto resolved = read_path_inode(parent, "cache", kXattrInodeCache);
-            strcpy(dirname, resolved.c_str());
-            CACHE_NOISY(ALOGI("Adding cache files from dir: %s\n", dirname));
-
-            subdir = opendir(dirname);
-            if (subdir != NULL) {
-                size_t dirnameLen = strlen(dirname);
-                _add_cache_files(cache, NULL, dirname, subdir, dirname, dirname+dirnameLen,
-                        PATH_MAX - dirnameLen);
-                closedir(subdir);
-            }
+            auto parent = StringPrintf("%s/%s", data_path.c_str(), name);
+            dirs->push_back(read_path_inode(parent, "cache", kXattrInodeCache));
         }
     }
 
     closedir(d);
 }
 
-static char *create_dir_path(char path[PATH_MAX], cache_dir_t* dir)
-{
-    char *pos = path;
-    if (dir->parent != NULL) {
-        pos = create_dir_path(path, dir->parent);
-    }
-    // Note that we don't need to worry about going beyond the buffer,
-    // since when we were constructing the cache entries our maximum
-    // buffer size for full paths was PATH_MAX.
-    strcpy(pos, dir->name);
-    pos += strlen(pos);
-    *pos = '/';
-    pos++;
-    *pos = 0;
-    return pos;
+// Cache files are ordered by the hour they were last modified in, so that collecting them takes
+// a counter per hour rather than a record per file, however many files there are.
+static constexpr time_t kCacheAgeGranularity = 60 * 60;
+
+static constexpr size_t kMaxCacheThreads = 4;
+
+// Bytes taken by the cache files last modified in each hour.
+typedef std::map<time_t, int64_t> cache_ages_t;
+
+struct cache_trim_t {
+    std::string data_path;
+    int64_t free_size;
+    time_t cutoff;
+    std::atomic<bool> done;
+    std::atomic<int64_t> freed;
+    std::atomic<size_t> num_deleted;
+    // What freed needs to reach before the filesystem is asked again, only updated with lock.
+    std::atomic<int64_t> to_free;
+    std::mutex lock;
+};
+
+// Calls fn(dir, thread) for each of dirs, on up to num_threads threads numbered from 0.
+template <typename Fn>
+static void for_each_cache_dir(const std::vector<std::string>& dirs, size_t num_threads, Fn fn) {
+    std::atomic<size_t> next(0);
+    auto worker = [&](size_t thread) {
+        size_t i;
+        while ((i = next++) < dirs.size()) {
+            fn(dirs[i], thread);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t thread = 1; thread < num_threads; thread++) {
+        threads.emplace_back(worker, thread);
+    }
+    worker(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
 }
 
-static void delete_cache_dir(char path[PATH_MAX], cache_dir_t* dir)
-{
-    if (dir->parent != NULL) {
-        create_dir_path(path, dir);
-        ALOGI("DEL DIR %s\n", path);
-        if (dir->hiddenCount <= 0) {
-            if (rmdir(path)) {
-                ALOGE("Couldn't rmdir %s: %s\n", path, strerror(errno));
-                return;
+static void add_cache_ages(int dfd, cache_ages_t* ages) {
+    DIR *d;
+    struct dirent *de;
+    struct stat s;
+
+    d = fdopendir(dfd);
+    if (d == NULL) {
+        close(dfd);
+        return;
+    }
+
+    while ((de = readdir(d))) {
+        const char *name = de->d_name;
+        if (de->d_type == DT_DIR) {
+                /* always skip "." and ".." */
+            if (name[0] == '.') {
+                if (name[1] == 0) continue;
+                if ((name[1] == '.') && (name[2] == 0)) continue;
             }
-        } else {
-            // The directory contains hidden files so we need to delete
-            // them along with the directory itself.
-            if (delete_dir_contents(path, 1, NULL)) {
-                return;
+            int subfd = openat(dfd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            if (subfd >= 0) {
+                add_cache_ages(subfd, ages);
+            }
+        } else if (de->d_type == DT_REG && name[0] != '.') {
+            if (fstatat(dfd, name, &s, AT_SYMLINK_NOFOLLOW) == 0) {
+                (*ages)[s.st_mtime / kCacheAgeGranularity] += s.st_blocks * 512;
             }
         }
-        dir->parent->childCount--;
-        dir->deleted = 1;
-        if (dir->parent->childCount <= 0) {
-            delete_cache_dir(path, dir->parent);
-        }
-    } else if (dir->hiddenCount > 0) {
-        // This is a root directory, but it has hidden files.  Get rid of
-        // all of those files, but not the directory itself.
-        create_dir_path(path, dir);
-        ALOGI("DEL CONTENTS %s\n", path);
-        delete_dir_contents(path, 0, NULL);
     }
+    closedir(d);
 }
 
-static int cache_modtime_sort(const void *lhsP, const void *rhsP)
-{
-    const cache_file_t *lhs = *(const cache_file_t**)lhsP;
-    const cache_file_t *rhs = *(const cache_file_t**)rhsP;
-    return lhs->modTime < rhs->modTime ? -1 : (lhs->modTime > rhs->modTime ? 1 : 0);
-}
+static bool cache_trim_done(cache_trim_t* trim) {
+    if (trim->done) {
+        return true;
+    }
+    if (trim->freed < trim->to_free) {
+        return false;
+    }
 
-void clear_cache_files(const std::string& data_path, cache_t* cache, int64_t free_size)
-{
-    size_t i;
-    int skip = 0;
-    char path[PATH_MAX];
+    std::lock_guard<std::mutex> lock(trim->lock);
+    if (trim->done || trim->freed < trim->to_free) {
+        return trim->done;
+    }
+    // What was counted as freed may not be, e.g. for files still open, so ask the filesystem.
+    int64_t avail = data_disk_free(trim->data_path);
+    if (avail < 0 || avail >= trim->free_size) {
+        trim->done = true;
+    } else {
+        trim->to_free = trim->freed + (trim->free_size - avail);
+    }
+    return trim->done;
+}
 
-    ALOGI("Collected cache files: %zd directories, %zd files",
-        cache->numDirs, cache->numFiles);
+// Deletes the files of the directory modified before the cutoff, and the directories left without
+// any. Returns whether nothing but hidden files is left in the directory. Takes ownership of dfd.
+static bool trim_cache_dir(int dfd, cache_trim_t* trim) {
+    DIR *d;
+    struct dirent *de;
+    struct stat s;
+    bool empty = true;
 
-    CACHE_NOISY(ALOGI("Sorting files..."));
-    qsort(cache->files, cache->numFiles, sizeof(cache_file_t*),
-            cache_modtime_sort);
+    d = fdopendir(dfd);
+    if (d == NULL) {
+        close(dfd);
+        return false;
+    }
 
-    CACHE_NOISY(ALOGI("Cleaning empty directories..."));
-    for (i=cache->numDirs; i>0; i--) {
-        cache_dir_t* dir = cache->dirs[i-1];
-        if (dir->childCount <= 0 && !dir->deleted) {
-            delete_cache_dir(path, dir);
+    while ((de = readdir(d))) {
+        const char *name = de->d_name;
+        if (cache_trim_done(trim)) {
+            empty = false;
+            break;
         }
-    }
 
-    CACHE_NOISY(ALOGI("Trimming files..."));
-    for (i=0; i<cache->numFiles; i++) {
-        skip++;
-        if (skip > 10) {
-            if (data_disk_free(data_path) > free_size) {
-                return;
+        if (de->d_type == DT_DIR) {
+                /* always skip "." and ".." */
+            if (name[0] == '.') {
+                if (name[1] == 0) continue;
+                if ((name[1] == '.') && (name[2] == 0)) continue;
             }
-            skip = 0;
-        }
-        cache_file_t* file = cache->files[i];
-        strcpy(create_dir_path(path, file->dir), file->name);
-        ALOGI("DEL (mod %d) %s\n", (int)file->modTime, path);
-        if (unlink(path) < 0) {
-            ALOGE("Couldn't unlink %s: %s\n", path, strerror(errno));
-        }
-        file->dir->childCount--;
-        if (file->dir->childCount <= 0) {
-            delete_cache_dir(path, file->dir);
+            int subfd = openat(dfd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            if (subfd < 0) {
+                ALOGE("Couldn't openat %s: %s\n", name, strerror(errno));
+                empty = false;
+                continue;
+            }
+            if (!trim_cache_dir(subfd, trim)) {
+                empty = false;
+                continue;
+            }
+            // The directory contains hidden files at most, delete them along with it.
+            if (delete_dir_contents_fd(dfd, name) != 0 || unlinkat(dfd, name, AT_REMOVEDIR) < 0) {
+                ALOGE("Couldn't rmdir %s: %s\n", name, strerror(errno));
+                empty = false;
+            }
+        } else if (de->d_type == DT_REG) {
+            // Skip files that start with '.'; they will be deleted if
+            // their entire directory is deleted.  This allows for metadata
+            // like ".nomedia" to remain in the directory until the entire
+            // directory is deleted.
+            if (name[0] == '.') {
+                continue;
+            }
+            int64_t size = 0;
+            if (fstatat(dfd, name, &s, AT_SYMLINK_NOFOLLOW) == 0) {
+                if (s.st_mtime / kCacheAgeGranularity > trim->cutoff) {
+                    empty = false;
+                    continue;
+                }
+                size = s.st_blocks * 512;
+            }
+            // Files which can't be stat'ed are deleted as well.
+            if (unlinkat(dfd, name, 0) < 0) {
+                ALOGE("Couldn't unlinkat %s: %s\n", name, strerror(errno));
+                empty = false;
+                continue;
+            }
+            trim->freed += size;
+            trim->num_deleted++;
         }
     }
+    closedir(d);
+    return empty;
 }
 
-void finish_cache_collection(cache_t* cache)
+void clear_cache_dirs(const std::string& data_path, const std::vector<std::string>& dirs,
+        int64_t free_size)
 {
-    CACHE_NOISY(size_t i;)
-
-    CACHE_NOISY(ALOGI("clear_cache_files: %zu dirs, %zu files\n", cache->numDirs, cache->numFiles));
-    CACHE_NOISY(
-        for (i=0; i<cache->numDirs; i++) {
-            cache_dir_t* dir = cache->dirs[i];
-            ALOGI("dir #%zu: %p %s parent=%p\n", i, dir, dir->name, dir->parent);
-        })
-    CACHE_NOISY(
-        for (i=0; i<cache->numFiles; i++) {
-            cache_file_t* file = cache->files[i];
-            ALOGI("file #%zu: %p %s time=%d dir=%p\n", i, file, file->name,
-                    (int)file->modTime, file->dir);
-        })
-    void* block = cache->memBlocks;
-    while (block != NULL) {
-        void* nextBlock = *(void**)block;
-        CACHE_NOISY(ALOGI("Freeing cache mem block: %p", block));
-        free(block);
-        block = nextBlock;
-    }
-    free(cache);
+    int64_t avail = data_disk_free(data_path);
+    if (avail < 0 || avail >= free_size) {
+        return;
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t num_threads = std::min(std::min(dirs.size(), kMaxCacheThreads),
+            static_cast<size_t>(std::max(cpus, 1L)));
+
+    // First find out how old the files which need to go are...
+    std::vector<cache_ages_t> thread_ages(std::max(num_threads, static_cast<size_t>(1)));
+    for_each_cache_dir(dirs, num_threads, [&](const std::string& dir, size_t thread) {
+        int dfd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dfd >= 0) {
+            add_cache_ages(dfd, &thread_ages[thread]);
+        }
+    });
+    cache_ages_t& ages = thread_ages[0];
+    for (size_t thread = 1; thread < thread_ages.size(); thread++) {
+        for (const auto& age : thread_ages[thread]) {
+            ages[age.first] += age.second;
+        }
+    }
+
+    const int64_t needed = free_size - avail;
+    int64_t total = 0;
+    time_t cutoff = std::numeric_limits<time_t>::max();
+    for (const auto& age : ages) {
+        total += age.second;
+        if (total >= needed) {
+            cutoff = age.first;
+            break;
+        }
+    }
+    ALOGI("Collected cache of %zu packages, deleting up to %" PRId64 " bytes", dirs.size(), total);
+
+    // ...then delete them, until there is enough space.
+    cache_trim_t trim;
+    trim.data_path = data_path;
+    trim.free_size = free_size;
+    trim.cutoff = cutoff;
+    trim.done = false;
+    trim.freed = 0;
+    trim.num_deleted = 0;
+    trim.to_free = needed;
+    for_each_cache_dir(dirs, num_threads, [&](const std::string& dir, size_t) {
+        if (cache_trim_done(&trim)) {
+            return;
+        }
+        int dfd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dfd >= 0 && trim_cache_dir(dfd, &trim)) {
+            // This is a root directory, get rid of its hidden files but not of itself.
+            delete_dir_contents(dir.c_str(), 0, NULL);
+        }
+    });
+    ALOGI("Deleted %zu cache files, %" PRId64 " bytes", trim.num_deleted.load(),
+            trim.freed.load());
 }
 
 /**
@@ -35,33 +35,6 @@ namespace installd {
 
 struct dir_rec_t;
 
-typedef struct cache_dir_struct {
-    struct cache_dir_struct* parent;
-    int32_t childCount;
-    int32_t hiddenCount;
-    int32_t deleted;
-    char name[];
-} cache_dir_t;
-
-typedef struct {
-    cache_dir_t* dir;
-    time_t modTime;
-    char name[];
-} cache_file_t;
-
-typedef struct {
-    size_t numDirs;
-    size_t availDirs;
-    cache_dir_t** dirs;
-    size_t numFiles;
-    size_t availFiles;
-    cache_file_t** files;
-    size_t numCollected;
-    void* memBlocks;
-    int8_t* curMemBlockAvail;
-    int8_t* curMemBlockEnd;
-} cache_t;
-
 constexpr const char* kXattrInodeCache = "user.inode_cache";
 constexpr const char* kXattrInodeCodeCache = "user.inode_code_cache";
 
@@ -117,20 +90,26 @@ int delete_dir_contents_fd(int dfd, const char *name);
 
 int copy_dir_files(const char *srcname, const char *dstname, uid_t owner, gid_t group);
 
-int64_t data_disk_free(const std::string& data_path);
+// Copies from into to, which is created if needed, along with everything below it, preserving
+// owners, permissions, timestamps and extended attributes but SELinux labels, as cp -FpRPd would.
+// Files are copied on several threads, and progress is logged against expected_size bytes.
+int copy_directory_recursive(const std::string& from, const std::string& to,
+        int64_t expected_size);
 
-cache_t* start_cache_collection();
+int64_t data_disk_free(const std::string& data_path);
 
 int get_path_inode(const std::string& path, ino_t *inode);
 
 int write_path_inode(const std::string& parent, const char* name, const char* inode_xattr);
 std::string read_path_inode(const std::string& parent, const char* name, const char* inode_xattr);
 
-void add_cache_files(cache_t* cache, const std::string& data_path);
-
-void clear_cache_files(const std::string& data_path, cache_t* cache, int64_t free_size);
+// Adds the cache directory of every package below data_path to dirs.
+void add_cache_dirs(std::vector<std::string>* dirs, const std::string& data_path);
 
-void finish_cache_collection(cache_t* cache);
+// Deletes the least recently modified files of dirs until free_size bytes are available on the
+// filesystem of data_path.
+void clear_cache_dirs(const std::string& data_path, const std::vector<std::string>& dirs,
+        int64_t free_size);
 
 int validate_system_app_path(const char* path);
 
@@ -260,6 +260,9 @@ int binder_parse(struct binder_state *bs, struct binder_io *bio,
                 } else {
                     binder_send_reply(bs, &reply, txn->data.ptr.buffer, res);
                 }
+                if (reply.release_ref) {
+                    binder_release(bs, reply.release_ref);
+                }
             }
             ptr += sizeof(*txn);
             break;
@@ -287,10 +290,22 @@ int binder_parse(struct binder_state *bs, struct binder_io *bio,
             death->func(bs, death->ptr);
             break;
         }
-        case BR_FAILED_REPLY:
-            r = -1;
+        case BR_CLEAR_DEATH_NOTIFICATION_DONE: {
+            struct binder_death *death = (struct binder_death *)(uintptr_t) *(binder_uintptr_t *)ptr;
+            ptr += sizeof(binder_uintptr_t);
+            death->func(bs, death->ptr);
             break;
+        }
+        case BR_FAILED_REPLY:
         case BR_DEAD_REPLY:
+            if (func) {
+                /* Inside binder_loop() these can only answer a one-way
+                 * sent by binder_send_oneway(); the target is gone and
+                 * there is nothing to unwind. */
+                ALOGW("parse: one-way transaction failed (%s)\n",
+                      cmd == BR_DEAD_REPLY ? "dead" : "failed");
+                break;
+            }
             r = -1;
             break;
         default:
@@ -331,6 +346,46 @@ void binder_link_to_death(struct binder_state *bs, uint32_t target, struct binde
     binder_write(bs, &data, sizeof(data));
 }
 
+void binder_clear_death(struct binder_state *bs, uint32_t target, struct binder_death *death)
+{
+    struct {
+        uint32_t cmd;
+        struct binder_handle_cookie payload;
+    } __attribute__((packed)) data;
+
+    data.cmd = BC_CLEAR_DEATH_NOTIFICATION;
+    data.payload.handle = target;
+    data.payload.cookie = (uintptr_t) death;
+    binder_write(bs, &data, sizeof(data));
+}
+
+int binder_send_oneway(struct binder_state *bs, struct binder_io *msg,
+                       uint32_t target, uint32_t code)
+{
+    struct {
+        uint32_t cmd;
+        struct binder_transaction_data txn;
+    } __attribute__((packed)) writebuf;
+
+    if (msg->flags & BIO_F_OVERFLOW) {
+        fprintf(stderr,"binder: txn buffer overflow\n");
+        return -1;
+    }
+
+    writebuf.cmd = BC_TRANSACTION;
+    writebuf.txn.target.handle = target;
+    writebuf.txn.cookie = 0;
+    writebuf.txn.code = code;
+    writebuf.txn.flags = TF_ONE_WAY;
+    writebuf.txn.data_size = msg->data - msg->data0;
+    writebuf.txn.offsets_size = ((char*) msg->offs) - ((char*) msg->offs0);
+    writebuf.txn.data.ptr.buffer = (uintptr_t)msg->data0;
+    writebuf.txn.data.ptr.offsets = (uintptr_t)msg->offs0;
+
+    hexdump(msg->data0, msg->data - msg->data0);
+    return binder_write(bs, &writebuf, sizeof(writebuf)) < 0 ? -1 : 0;
+}
+
 int binder_call(struct binder_state *bs,
                 struct binder_io *msg, struct binder_io *reply,
                 uint32_t target, uint32_t code)
@@ -429,6 +484,7 @@ void bio_init_from_txn(struct binder_io *bio, struct binder_transaction_data *tx
     bio->data_avail = txn->data_size;
     bio->offs_avail = txn->offsets_size / sizeof(size_t);
     bio->flags = BIO_F_SHARED;
+    bio->release_ref = 0;
 }
 
 void bio_init(struct binder_io *bio, void *data,
@@ -436,6 +492,7 @@ void bio_init(struct binder_io *bio, void *data,
 {
     size_t n = maxoffs * sizeof(size_t);
 
+    bio->release_ref = 0;
     if (n > maxdata) {
         bio->flags = BIO_F_OVERFLOW;
         bio->data_avail = 0;
@@ -536,6 +593,12 @@ void bio_put_ref(struct binder_io *bio, uint32_t handle)
     obj->cookie = 0;
 }
 
+void bio_put_ref_owned(struct binder_io *bio, uint32_t handle)
+{
+    bio_put_ref(bio, handle);
+    bio->release_ref = handle;
+}
+
 void bio_put_string16(struct binder_io *bio, const uint16_t *str)
 {
     size_t len;
@@ -19,7 +19,7 @@ struct binder_io
     char *data0;           /* start of data buffer */
     binder_size_t *offs0;  /* start of offsets buffer */
     uint32_t flags;
-    uint32_t unused;
+    uint32_t release_ref;  /* handle to release once the reply is sent */
 };
 
 struct binder_death {
@@ -39,6 +39,13 @@ enum {
     SVC_MGR_CHECK_SERVICE,
     SVC_MGR_ADD_SERVICE,
     SVC_MGR_LIST_SERVICES,
+    SVC_MGR_WAIT_FOR_SERVICE,
+    SVC_MGR_STOP_WAITING_FOR_SERVICE,
+};
+
+enum {
+    /* Sent one-way to callbacks registered with SVC_MGR_WAIT_FOR_SERVICE */
+    SVC_MGR_NOTIFY_REGISTERED = 1,
 };
 
 typedef int (*binder_handler)(struct binder_state *bs,
@@ -69,6 +76,17 @@ void binder_acquire(struct binder_state *bs, uint32_t target);
 void binder_release(struct binder_state *bs, uint32_t target);
 
 void binder_link_to_death(struct binder_state *bs, uint32_t target, struct binder_death *death);
+/* cancel a death notification
+ * - death->func is still called exactly once more: either for the death
+ *   itself, if it raced with the cancel, or when the driver confirms it
+ */
+void binder_clear_death(struct binder_state *bs, uint32_t target, struct binder_death *death);
+
+/* queue a one-way transaction without waiting for it to complete
+ * - returns zero if the driver accepted the command
+ */
+int binder_send_oneway(struct binder_state *bs, struct binder_io *msg,
+                       uint32_t target, uint32_t code);
 
 void binder_loop(struct binder_state *bs, binder_handler func);
 
@@ -83,6 +101,10 @@ void bio_init(struct binder_io *bio, void *data,
 
 void bio_put_obj(struct binder_io *bio, void *ptr);
 void bio_put_ref(struct binder_io *bio, uint32_t handle);
+/* put a reference the caller acquired into a reply; binder_loop() releases
+ * it after sending the reply, once the driver has given the receiver its own
+ * reference */
+void bio_put_ref_owned(struct binder_io *bio, uint32_t handle);
 void bio_put_uint32(struct binder_io *bio, uint32_t n);
 void bio_put_string16(struct binder_io *bio, const uint16_t *str);
 void bio_put_string16_x(struct binder_io *bio, const char *_str);
@@ -4,11 +4,14 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <cutils/multiuser.h>
+#include <cutils/properties.h>
 
 #include <private/android_filesystem_config.h>
 
@@ -31,10 +34,12 @@ struct audit_data {
     const char *name;
 };
 
-const char *str8(const uint16_t *x, size_t x_len)
+/* Service names are at most 127 characters. */
+#define STR8_MAX 128
+
+const char *str8(const uint16_t *x, size_t x_len, char *buf)
 {
-    static char buf[128];
-    size_t max = 127;
+    size_t max = STR8_MAX - 1;
     char *p = buf;
 
     if (x_len < max) {
@@ -64,24 +69,69 @@ static int selinux_enabled;
 static char *service_manager_context;
 static struct selabel_handle* sehandle;
 
+/* Requests are served by SVC_MGR_THREADS binder loopers.
+ * - svc_lock guards the registry and the waiter list; lookups only read
+ *   them, so they share the lock and run in parallel.
+ * - mac_lock serializes calls into libselinux, whose AVC is not
+ *   thread-safe, and guards sehandle and the SELinux caches below.
+ * When both are needed, svc_lock is taken first. */
+#define SVC_MGR_THREADS 4
+static pthread_rwlock_t svc_lock = PTHREAD_RWLOCK_INITIALIZER;
+static pthread_mutex_t mac_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* Adds the time spent waiting for svc_lock to *wait_ns. */
+static void svc_rdlock(uint64_t *wait_ns)
+{
+    uint64_t start = now_ns();
+    pthread_rwlock_rdlock(&svc_lock);
+    *wait_ns += now_ns() - start;
+}
+
+static void svc_wrlock(uint64_t *wait_ns)
+{
+    uint64_t start = now_ns();
+    pthread_rwlock_wrlock(&svc_lock);
+    *wait_ns += now_ns() - start;
+}
+
+static void svc_unlock(void)
+{
+    pthread_rwlock_unlock(&svc_lock);
+}
+
+static bool check_mac_perms_ctx(const char *sctx, pid_t spid, uid_t uid, const char *tctx,
+                                const char *perm, const char *name)
+{
+    const char *class = "service_manager";
+    struct audit_data ad;
+
+    ad.pid = spid;
+    ad.uid = uid;
+    ad.name = name;
+
+    return selinux_check_access(sctx, tctx, class, perm, (void *) &ad) == 0;
+}
+
 static bool check_mac_perms(pid_t spid, uid_t uid, const char *tctx, const char *perm, const char *name)
 {
     char *sctx = NULL;
-    const char *class = "service_manager";
     bool allowed;
-    struct audit_data ad;
 
     if (getpidcon(spid, &sctx) < 0) {
         ALOGE("SELinux: getpidcon(pid=%d) failed to retrieve pid context.\n", spid);
         return false;
     }
 
-    ad.pid = spid;
-    ad.uid = uid;
-    ad.name = name;
-
-    int result = selinux_check_access(sctx, tctx, class, perm, (void *) &ad);
-    allowed = (result == 0);
+    pthread_mutex_lock(&mac_lock);
+    allowed = check_mac_perms_ctx(sctx, spid, uid, tctx, perm, name);
+    pthread_mutex_unlock(&mac_lock);
 
     freecon(sctx);
     return allowed;
@@ -110,10 +160,13 @@ static bool check_mac_perms_from_lookup(pid_t spid, uid_t uid, const char *perm,
         abort();
     }
 
+    pthread_mutex_lock(&mac_lock);
     if (selabel_lookup(sehandle, &tctx, name, 0) != 0) {
+        pthread_mutex_unlock(&mac_lock);
         ALOGE("SELinux: No match for %s in service_contexts.\n", name);
         return false;
     }
+    pthread_mutex_unlock(&mac_lock);
 
     allowed = check_mac_perms(spid, uid, tctx, perm, name);
     freecon(tctx);
@@ -123,12 +176,13 @@ static bool check_mac_perms_from_lookup(pid_t spid, uid_t uid, const char *perm,
 static int svc_can_register(const uint16_t *name, size_t name_len, pid_t spid, uid_t uid)
 {
     const char *perm = "add";
+    char name8[STR8_MAX];
 
     if (multiuser_get_app_id(uid) >= AID_APP) {
         return 0; /* Don't allow apps to register services */
     }
 
-    return check_mac_perms_from_lookup(spid, uid, perm, str8(name, name_len)) ? 1 : 0;
+    return check_mac_perms_from_lookup(spid, uid, perm, str8(name, name_len, name8)) ? 1 : 0;
 }
 
 static int svc_can_list(pid_t spid, uid_t uid)
@@ -137,30 +191,152 @@ static int svc_can_list(pid_t spid, uid_t uid)
     return check_mac_perms_from_getcon(spid, uid, perm) ? 1 : 0;
 }
 
-static int svc_can_find(const uint16_t *name, size_t name_len, pid_t spid, uid_t uid)
-{
-    const char *perm = "find";
-    return check_mac_perms_from_lookup(spid, uid, perm, str8(name, name_len)) ? 1 : 0;
-}
-
 struct svcinfo
 {
     struct svcinfo *next;
+    struct svcinfo *hash_next;
     uint32_t handle;
+    uint32_t hash;
     struct binder_death death;
     int allow_isolated;
+    char *tctx;             /* cached service_contexts label, or NULL */
     size_t len;
     uint16_t name[0];
 };
 
+/* svclist keeps registration order for SVC_MGR_LIST_SERVICES; lookups go
+ * through the hash buckets. */
 struct svcinfo *svclist = NULL;
 
-struct svcinfo *find_svc(const uint16_t *s16, size_t len)
+#define SVC_HASH_BUCKETS 256
+static struct svcinfo *svc_buckets[SVC_HASH_BUCKETS];
+
+/* Recent "find" grants, keyed by caller context and service. Only grants
+ * are cached so that every denial still reaches the AVC and gets audited.
+ * The whole cache is dropped when the policy or service_contexts reload. */
+struct find_grant
 {
     struct svcinfo *si;
+    char *sctx;
+};
+
+#define FIND_GRANT_CACHE_SIZE 64
+static struct find_grant find_grants[FIND_GRANT_CACHE_SIZE];
+
+static uint32_t svc_hash(const uint16_t *s16, size_t len)
+{
+    /* FNV-1a */
+    uint32_t hash = 2166136261u;
+    while (len--) {
+        hash ^= *s16++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t str_hash(const char *s)
+{
+    uint32_t hash = 2166136261u;
+    while (*s) {
+        hash ^= (unsigned char) *s++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* Picks up a new service_contexts after a policy reload and drops every
+ * cached decision. */
+static void reload_service_contexts(void)
+{
+    struct selabel_handle *tmp_sehandle = selinux_android_service_context_handle();
+    struct svcinfo *si;
+    size_t i;
+
+    if (!tmp_sehandle) {
+        return;
+    }
+
+    pthread_rwlock_wrlock(&svc_lock);
+    pthread_mutex_lock(&mac_lock);
+    selabel_close(sehandle);
+    sehandle = tmp_sehandle;
 
     for (si = svclist; si; si = si->next) {
-        if ((len == si->len) &&
+        if (si->tctx) {
+            freecon(si->tctx);
+            si->tctx = NULL;
+        }
+    }
+    for (i = 0; i < FIND_GRANT_CACHE_SIZE; i++) {
+        free(find_grants[i].sctx);
+        find_grants[i].sctx = NULL;
+        find_grants[i].si = NULL;
+    }
+    pthread_mutex_unlock(&mac_lock);
+    pthread_rwlock_unlock(&svc_lock);
+}
+
+/* Caller holds svc_lock for reading. */
+static int svc_can_find(struct svcinfo *si, pid_t spid, uid_t uid)
+{
+    const char *perm = "find";
+    char *sctx = NULL;
+    char name8[STR8_MAX];
+    struct find_grant *grant;
+    int allowed;
+
+    if (selinux_enabled <= 0) {
+        return 1;
+    }
+
+    if (!sehandle) {
+        ALOGE("SELinux: Failed to find sehandle. Aborting service_manager.\n");
+        abort();
+    }
+
+    if (getpidcon(spid, &sctx) < 0) {
+        ALOGE("SELinux: getpidcon(pid=%d) failed to retrieve pid context.\n", spid);
+        return 0;
+    }
+
+    str8(si->name, si->len, name8);
+    pthread_mutex_lock(&mac_lock);
+    if (!si->tctx && selabel_lookup(sehandle, &si->tctx, name8, 0) != 0) {
+        si->tctx = NULL;
+        pthread_mutex_unlock(&mac_lock);
+        ALOGE("SELinux: No match for %s in service_contexts.\n", name8);
+        freecon(sctx);
+        return 0;
+    }
+
+    grant = &find_grants[(str_hash(sctx) ^ si->hash) % FIND_GRANT_CACHE_SIZE];
+    if (grant->si == si && !strcmp(grant->sctx, sctx)) {
+        pthread_mutex_unlock(&mac_lock);
+        freecon(sctx);
+        return 1;
+    }
+
+    allowed = check_mac_perms_ctx(sctx, spid, uid, si->tctx, perm, name8) ? 1 : 0;
+    if (allowed) {
+        char *copy = strdup(sctx);
+        if (copy) {
+            free(grant->sctx);
+            grant->sctx = copy;
+            grant->si = si;
+        }
+    }
+    pthread_mutex_unlock(&mac_lock);
+    freecon(sctx);
+    return allowed;
+}
+
+struct svcinfo *find_svc(const uint16_t *s16, size_t len)
+{
+    struct svcinfo *si;
+    uint32_t hash = svc_hash(s16, len);
+
+    for (si = svc_buckets[hash % SVC_HASH_BUCKETS]; si; si = si->hash_next) {
+        if ((hash == si->hash) && (len == si->len) &&
             !memcmp(s16, si->name, len * sizeof(uint16_t))) {
             return si;
         }
@@ -168,24 +344,110 @@ struct svcinfo *find_svc(const uint16_t *s16, size_t len)
     return NULL;
 }
 
-void svcinfo_death(struct binder_state *bs, void *ptr)
+/* Caller holds svc_lock for writing. */
+static void svcinfo_death_locked(struct binder_state *bs, struct svcinfo *si)
 {
-    struct svcinfo *si = (struct svcinfo* ) ptr;
+    char name8[STR8_MAX];
 
-    ALOGI("service '%s' died\n", str8(si->name, si->len));
+    ALOGI("service '%s' died\n", str8(si->name, si->len, name8));
     if (si->handle) {
         binder_release(bs, si->handle);
         si->handle = 0;
     }
 }
 
+void svcinfo_death(struct binder_state *bs, void *ptr)
+{
+    pthread_rwlock_wrlock(&svc_lock);
+    svcinfo_death_locked(bs, (struct svcinfo *) ptr);
+    svc_unlock();
+}
+
+/* Clients blocked in IServiceManager::waitForService(), each told once,
+ * through its callback binder, when the service it wants is added. A
+ * client that stops waiting takes its callback back; one that doesn't,
+ * or has more than MAX_SVC_WAITERS_PER_UID, loses its oldest, and falls
+ * back to re-checking the service now and then. */
+struct svcwaiter
+{
+    struct svcwaiter *next;
+    uint32_t handle;
+    uid_t uid;
+    struct binder_death death;
+    size_t len;
+    uint16_t name[0];
+};
+
+#define MAX_SVC_WAITERS 256
+#define MAX_SVC_WAITERS_PER_UID 16
+static struct svcwaiter *waitlist = NULL;
+static unsigned waiter_count = 0;
+
+/* Caller holds svc_lock for writing. */
+static void svcwaiter_unlink(struct binder_state *bs, struct svcwaiter *sw)
+{
+    struct svcwaiter **p;
+
+    for (p = &waitlist; *p; p = &(*p)->next) {
+        if (*p == sw) {
+            *p = sw->next;
+            break;
+        }
+    }
+    binder_release(bs, sw->handle);
+    sw->handle = 0;
+}
+
+/* Called either when the waiting client dies, or, once its death
+ * notification has been cleared, when the driver confirms the clear. */
+void svcwaiter_death(struct binder_state *bs, void *ptr)
+{
+    struct svcwaiter *sw = (struct svcwaiter *) ptr;
+
+    pthread_rwlock_wrlock(&svc_lock);
+    if (sw->handle) {
+        svcwaiter_unlink(bs, sw);
+    }
+    waiter_count--;
+    svc_unlock();
+    free(sw);
+}
+
+/* Caller holds svc_lock for writing. */
+static void svcwaiter_remove(struct binder_state *bs, struct svcwaiter *sw)
+{
+    /* sw is freed by svcwaiter_death() once the driver is done with it */
+    binder_clear_death(bs, sw->handle, &sw->death);
+    svcwaiter_unlink(bs, sw);
+}
+
+/* Caller holds svc_lock for writing. */
+static void notify_waiters(struct binder_state *bs, const uint16_t *s, size_t len)
+{
+    struct svcwaiter *sw = waitlist;
+    struct svcwaiter *next;
+    unsigned iodata[512/4];
+    struct binder_io msg;
+
+    for (; sw; sw = next) {
+        next = sw->next;
+        if ((len != sw->len) || memcmp(s, sw->name, len * sizeof(uint16_t))) {
+            continue;
+        }
+        bio_init(&msg, iodata, sizeof(iodata), 4);
+        bio_put_string16(&msg, sw->name);
+        binder_send_oneway(bs, &msg, sw->handle, SVC_MGR_NOTIFY_REGISTERED);
+        svcwaiter_remove(bs, sw);
+    }
+}
+
 uint16_t svcmgr_id[] = {
     'a','n','d','r','o','i','d','.','o','s','.',
     'I','S','e','r','v','i','c','e','M','a','n','a','g','e','r'
 };
 
 
-uint32_t do_find_service(const uint16_t *s, size_t len, uid_t uid, pid_t spid)
+static uint32_t do_find_service_locked(const uint16_t *s, size_t len, uid_t uid, pid_t spid)
 {
     struct svcinfo *si = find_svc(s, len);
 
@@ -202,19 +464,37 @@ uint32_t do_find_service(const uint16_t *s, size_t len, uid_t uid, pid_t spid)
         }
     }
 
-    if (!svc_can_find(s, len, spid, uid)) {
+    if (!svc_can_find(si, spid, uid)) {
         return 0;
     }
 
     return si->handle;
 }
 
+/* Returns the handle with a reference acquired for the caller, which has to
+ * release it: once the lock is dropped the service can die or be replaced,
+ * and the handle released and reused by the driver before it is in a reply. */
+uint32_t do_find_service(struct binder_state *bs, const uint16_t *s, size_t len,
+                         uid_t uid, pid_t spid, uint64_t *wait_ns)
+{
+    uint32_t handle;
+
+    svc_rdlock(wait_ns);
+    handle = do_find_service_locked(s, len, uid, spid);
+    if (handle) {
+        binder_acquire(bs, handle);
+    }
+    svc_unlock();
+    return handle;
+}
+
 int do_add_service(struct binder_state *bs,
                    const uint16_t *s, size_t len,
                    uint32_t handle, uid_t uid, int allow_isolated,
-                   pid_t spid)
+                   pid_t spid, uint64_t *wait_ns)
 {
     struct svcinfo *si;
+    char name8[STR8_MAX];
 
     //ALOGI("add_service('%s',%x,%s) uid=%d\n", str8(s, len), handle,
     //        allow_isolated ? "allow_isolated" : "!allow_isolated", uid);
@@ -224,23 +504,25 @@ int do_add_service(struct binder_state *bs,
 
     if (!svc_can_register(s, len, spid, uid)) {
         ALOGE("add_service('%s',%x) uid=%d - PERMISSION DENIED\n",
-             str8(s, len), handle, uid);
+             str8(s, len, name8), handle, uid);
         return -1;
     }
 
+    svc_wrlock(wait_ns);
     si = find_svc(s, len);
     if (si) {
         if (si->handle) {
             ALOGE("add_service('%s',%x) uid=%d - ALREADY REGISTERED, OVERRIDE\n",
-                 str8(s, len), handle, uid);
-            svcinfo_death(bs, si);
+                 str8(s, len, name8), handle, uid);
+            svcinfo_death_locked(bs, si);
         }
         si->handle = handle;
     } else {
         si = malloc(sizeof(*si) + (len + 1) * sizeof(uint16_t));
         if (!si) {
+            svc_unlock();
             ALOGE("add_service('%s',%x) uid=%d - OUT OF MEMORY\n",
-                 str8(s, len), handle, uid);
+                 str8(s, len, name8), handle, uid);
             return -1;
         }
         si->handle = handle;
@@ -250,26 +532,179 @@ int do_add_service(struct binder_state *bs,
         si->death.func = (void*) svcinfo_death;
         si->death.ptr = si;
         si->allow_isolated = allow_isolated;
+        si->tctx = NULL;
+        si->hash = svc_hash(s, len);
         si->next = svclist;
         svclist = si;
+        si->hash_next = svc_buckets[si->hash % SVC_HASH_BUCKETS];
+        svc_buckets[si->hash % SVC_HASH_BUCKETS] = si;
     }
 
     binder_acquire(bs, handle);
     binder_link_to_death(bs, handle, &si->death);
+    notify_waiters(bs, s, len);
+    svc_unlock();
+    return 0;
+}
+
+int do_wait_for_service(struct binder_state *bs,
+                        const uint16_t *s, size_t len,
+                        uint32_t handle, uid_t uid, pid_t spid,
+                        uint64_t *wait_ns)
+{
+    struct svcinfo *si;
+    struct svcwaiter *sw;
+    struct svcwaiter *oldest = NULL;
+    unsigned uid_waiters = 0;
+    char name8[STR8_MAX];
+
+    if (!handle || (len == 0) || (len > 127))
+        return -1;
+
+    if (!check_mac_perms_from_lookup(spid, uid, "find", str8(s, len, name8))) {
+        return -1;
+    }
+
+    svc_wrlock(wait_ns);
+
+    /* The client checks again after registering, so there is nothing
+     * to wait for if the service is already here. */
+    si = find_svc(s, len);
+    if (si && si->handle) {
+        svc_unlock();
+        return 0;
+    }
+
+    /* newest first, so the last one of uid found is its oldest */
+    for (sw = waitlist; sw; sw = sw->next) {
+        if ((handle == sw->handle) && (len == sw->len) &&
+            !memcmp(s, sw->name, len * sizeof(uint16_t))) {
+            svc_unlock();
+            return 0;
+        }
+        if (sw->uid == uid) {
+            uid_waiters++;
+            oldest = sw;
+        }
+    }
+
+    if (uid_waiters >= MAX_SVC_WAITERS_PER_UID) {
+        ALOGE("wait_for_service('%s') uid=%d - TOO MANY WAITERS, DROPPING OLDEST\n",
+             name8, uid);
+        svcwaiter_remove(bs, oldest);
+    } else if (waiter_count >= MAX_SVC_WAITERS) {
+        svc_unlock();
+        ALOGE("wait_for_service('%s') uid=%d - TOO MANY WAITERS\n", name8, uid);
+        return -1;
+    }
+
+    sw = malloc(sizeof(*sw) + (len + 1) * sizeof(uint16_t));
+    if (!sw) {
+        svc_unlock();
+        return -1;
+    }
+    sw->handle = handle;
+    sw->uid = uid;
+    sw->len = len;
+    memcpy(sw->name, s, len * sizeof(uint16_t));
+    sw->name[len] = '\0';
+    sw->death.func = (void*) svcwaiter_death;
+    sw->death.ptr = sw;
+    sw->next = waitlist;
+    waitlist = sw;
+    waiter_count++;
+
+    binder_acquire(bs, handle);
+    binder_link_to_death(bs, handle, &sw->death);
+    svc_unlock();
     return 0;
 }
 
+int do_stop_waiting_for_service(struct binder_state *bs,
+                                const uint16_t *s, size_t len,
+                                uint32_t handle, uint64_t *wait_ns)
+{
+    struct svcwaiter *sw;
+
+    if (!handle || (len == 0) || (len > 127))
+        return -1;
+
+    svc_wrlock(wait_ns);
+    for (sw = waitlist; sw; sw = sw->next) {
+        if ((handle == sw->handle) && (len == sw->len) &&
+            !memcmp(s, sw->name, len * sizeof(uint16_t))) {
+            svcwaiter_remove(bs, sw);
+            break;
+        }
+    }
+    svc_unlock();
+    return 0;
+}
+
+/* Until boot completes, periodically log how long requests waited for
+ * svc_lock (the only place they queue inside servicemanager) and how long
+ * they took overall. */
+#define BOOT_STATS_INTERVAL 256
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct {
+    uint64_t count;
+    uint64_t wait_ns;
+    uint64_t wait_max_ns;
+    uint64_t total_ns;
+    uint64_t total_max_ns;
+    int boot_completed;
+} boot_stats;
+
+static void record_request(uint64_t wait_ns, uint64_t total_ns)
+{
+    char value[PROPERTY_VALUE_MAX];
+    uint64_t count;
+
+    pthread_mutex_lock(&stats_lock);
+    if (boot_stats.boot_completed) {
+        pthread_mutex_unlock(&stats_lock);
+        return;
+    }
+    count = ++boot_stats.count;
+    boot_stats.wait_ns += wait_ns;
+    boot_stats.total_ns += total_ns;
+    if (wait_ns > boot_stats.wait_max_ns)
+        boot_stats.wait_max_ns = wait_ns;
+    if (total_ns > boot_stats.total_max_ns)
+        boot_stats.total_max_ns = total_ns;
+
+    if (count % BOOT_STATS_INTERVAL == 0) {
+        property_get("sys.boot_completed", value, "0");
+        boot_stats.boot_completed = !strcmp(value, "1");
+        ALOGI("%s: %" PRIu64 " requests, lock wait avg %" PRIu64 "us max %" PRIu64
+              "us, total avg %" PRIu64 "us max %" PRIu64 "us\n",
+              boot_stats.boot_completed ? "boot completed" : "booting", count,
+              boot_stats.wait_ns / count / 1000, boot_stats.wait_max_ns / 1000,
+              boot_stats.total_ns / count / 1000, boot_stats.total_max_ns / 1000);
+    }
+    pthread_mutex_unlock(&stats_lock);
+}
+
+static int svcmgr_dispatch(struct binder_state *bs,
+                           struct binder_transaction_data *txn,
+                           struct binder_io *msg,
+                           struct binder_io *reply,
+                           uint64_t *wait_ns);
+
 int svcmgr_handler(struct binder_state *bs,
                    struct binder_transaction_data *txn,
                    struct binder_io *msg,
                    struct binder_io *reply)
 {
-    struct svcinfo *si;
     uint16_t *s;
     size_t len;
-    uint32_t handle;
     uint32_t strict_policy;
-    int allow_isolated;
+    int updated;
+    int res;
+    uint64_t start = now_ns();
+    uint64_t wait_ns = 0;
+    char name8[STR8_MAX];
 
     //ALOGI("target=%p code=%d pid=%d uid=%d\n",
     //      (void*) txn->target.ptr, txn->code, txn->sender_pid, txn->sender_euid);
@@ -292,18 +727,34 @@ int svcmgr_handler(struct binder_state *bs,
 
     if ((len != (sizeof(svcmgr_id) / 2)) ||
         memcmp(svcmgr_id, s, sizeof(svcmgr_id))) {
-        fprintf(stderr,"invalid id %s\n", str8(s, len));
+        fprintf(stderr,"invalid id %s\n", str8(s, len, name8));
         return -1;
     }
 
-    if (sehandle && selinux_status_updated() > 0) {
-        struct selabel_handle *tmp_sehandle = selinux_android_service_context_handle();
-        if (tmp_sehandle) {
-            selabel_close(sehandle);
-            sehandle = tmp_sehandle;
-        }
+    pthread_mutex_lock(&mac_lock);
+    updated = sehandle && selinux_status_updated() > 0;
+    pthread_mutex_unlock(&mac_lock);
+    if (updated) {
+        reload_service_contexts();
     }
 
+    res = svcmgr_dispatch(bs, txn, msg, reply, &wait_ns);
+    record_request(wait_ns, now_ns() - start);
+    return res;
+}
+
+static int svcmgr_dispatch(struct binder_state *bs,
+                           struct binder_transaction_data *txn,
+                           struct binder_io *msg,
+                           struct binder_io *reply,
+                           uint64_t *wait_ns)
+{
+    struct svcinfo *si;
+    uint16_t *s;
+    size_t len;
+    uint32_t handle;
+    int allow_isolated;
+
     switch(txn->code) {
     case SVC_MGR_GET_SERVICE:
     case SVC_MGR_CHECK_SERVICE:
@@ -311,10 +762,11 @@ int svcmgr_handler(struct binder_state *bs,
         if (s == NULL) {
             return -1;
         }
-        handle = do_find_service(s, len, txn->sender_euid, txn->sender_pid);
+        handle = do_find_service(bs, s, len, txn->sender_euid, txn->sender_pid,
+                                 wait_ns);
         if (!handle)
             break;
-        bio_put_ref(reply, handle);
+        bio_put_ref_owned(reply, handle);
         return 0;
 
     case SVC_MGR_ADD_SERVICE:
@@ -325,7 +777,28 @@ int svcmgr_handler(struct binder_state *bs,
         handle = bio_get_ref(msg);
         allow_isolated = bio_get_uint32(msg) ? 1 : 0;
         if (do_add_service(bs, s, len, handle, txn->sender_euid,
-            allow_isolated, txn->sender_pid))
+            allow_isolated, txn->sender_pid, wait_ns))
+            return -1;
+        break;
+
+    case SVC_MGR_WAIT_FOR_SERVICE:
+        s = bio_get_string16(msg, &len);
+        if (s == NULL) {
+            return -1;
+        }
+        handle = bio_get_ref(msg);
+        if (do_wait_for_service(bs, s, len, handle, txn->sender_euid, txn->sender_pid,
+                                wait_ns))
+            return -1;
+        break;
+
+    case SVC_MGR_STOP_WAITING_FOR_SERVICE:
+        s = bio_get_string16(msg, &len);
+        if (s == NULL) {
+            return -1;
+        }
+        handle = bio_get_ref(msg);
+        if (do_stop_waiting_for_service(bs, s, len, handle, wait_ns))
             return -1;
         break;
 
@@ -337,14 +810,15 @@ int svcmgr_handler(struct binder_state *bs,
                     txn->sender_euid);
             return -1;
         }
+        svc_rdlock(wait_ns);
         si = svclist;
         while ((n-- > 0) && si)
             si = si->next;
         if (si) {
             bio_put_string16(reply, si->name);
-            return 0;
         }
-        return -1;
+        svc_unlock();
+        return si ? 0 : -1;
     }
     default:
         ALOGE("unknown code %d\n", txn->code);
@@ -369,9 +843,18 @@ static int audit_callback(void *data, __unused security_class_t cls, char *buf,
     return 0;
 }
 
+static void *svcmgr_loop_thread(void *arg)
+{
+    binder_loop((struct binder_state *) arg, svcmgr_handler);
+    /* Same as the main thread falling out of its loop. */
+    exit(0);
+    return NULL;
+}
+
 int main()
 {
     struct binder_state *bs;
+    int i;
 
     bs = binder_open(128*1024);
     if (!bs) {
@@ -406,6 +889,15 @@ int main()
     cb.func_log = selinux_log_callback;
     selinux_set_callback(SELINUX_CB_LOG, cb);
 
+    for (i = 1; i < SVC_MGR_THREADS; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, svcmgr_loop_thread, bs)) {
+            ALOGE("failed to start binder thread %d (%s)\n", i, strerror(errno));
+            break;
+        }
+        pthread_detach(thread);
+    }
+
     binder_loop(bs, svcmgr_handler);
 
     return 0;
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_BATTERYPROPERTIESSNAPSHOT_H
+#define ANDROID_BATTERYPROPERTIESSNAPSHOT_H
+
+#include <stdint.h>
+
+#include <binder/IMemory.h>
+#include <batteryservice/BatteryService.h>
+#include <utils/RefBase.h>
+
+namespace android {
+
+class IBatteryPropertiesRegistrar;
+
+/*
+ * The latest BatteryProperties, in memory the registrar shares read-only
+ * with its clients so that they can look at the battery state without a
+ * binder call; listeners are still told when it changes.
+ *
+ * The registrar is the only writer. Updates are published with a sequence
+ * number that is odd while one is being written and that changes with
+ * every update, and readers retry until they copied a stable one.
+ */
+class BatteryPropertiesSnapshot : public RefBase {
+public:
+    // Registrar side: allocates the shared memory, with nothing published.
+    static sp<BatteryPropertiesSnapshot> create();
+
+    // Client side: maps the memory handed out by the registrar, or returns
+    // NULL when it doesn't hand out any.
+    static sp<BatteryPropertiesSnapshot> fromMemory(const sp<IMemory>& memory);
+    static sp<BatteryPropertiesSnapshot> fromRegistrar(
+            const sp<IBatteryPropertiesRegistrar>& registrar);
+
+    sp<IMemory> getMemory() const { return mMemory; }
+
+    void publish(const BatteryProperties& props);
+
+    // Copies the latest update into props and returns its sequence number,
+    // which tells whether anything changed since an earlier read, or
+    // returns 0 when nothing could be read, e.g. nothing was published yet;
+    // callers then fall back to asking the registrar.
+    uint32_t read(BatteryProperties* props) const;
+
+private:
+    struct Shared;
+
+    explicit BatteryPropertiesSnapshot(const sp<IMemory>& memory);
+
+    sp<IMemory> mMemory;
+    Shared* mShared;
+};
+
+}; // namespace android
+
+#endif // ANDROID_BATTERYPROPERTIESSNAPSHOT_H
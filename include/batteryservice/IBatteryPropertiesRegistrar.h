@@ -19,6 +19,7 @@
 #define ANDROID_IBATTERYPROPERTIESREGISTRAR_H
 
 #include <binder/IInterface.h>
+#include <binder/IMemory.h>
 #include <batteryservice/IBatteryPropertiesListener.h>
 
 namespace android {
@@ -29,6 +30,7 @@ enum {
     UNREGISTER_LISTENER,
     GET_PROPERTY,
     GET_DOCK_PROPERTY,
+    GET_PROPERTIES_MEMORY,
 };
 
 class IBatteryPropertiesRegistrar : public IInterface {
@@ -39,6 +41,9 @@ public:
     virtual void unregisterListener(const sp<IBatteryPropertiesListener>& listener) = 0;
     virtual status_t getProperty(int id, struct BatteryProperty *val) = 0;
     virtual status_t getDockProperty(int id, struct BatteryProperty *val) = 0;
+    // The BatteryPropertiesSnapshot memory, for registrars that keep one;
+    // NULL from the others.
+    virtual sp<IMemory> getPropertiesMemory() { return NULL; }
 };
 
 class BnBatteryPropertiesRegistrar : public BnInterface<IBatteryPropertiesRegistrar> {
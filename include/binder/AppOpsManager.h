@@ -108,9 +108,16 @@ public:
     };
 
     AppOpsManager();
+    // Uses service instead of looking up the app ops service, for tests.
+    explicit AppOpsManager(const sp<IAppOpsService>& service);
 
+    // The modes checkOp() and noteOp() get are cached for the whole
+    // process, and forgotten when the app ops service reports a change.
     int32_t checkOp(int32_t op, int32_t uid, const String16& callingPackage);
     int32_t noteOp(int32_t op, int32_t uid, const String16& callingPackage);
+    // Like noteOp(), but when the mode is cached it is returned right away,
+    // and the op is noted with others from a background thread shortly after.
+    int32_t noteOpAsync(int32_t op, int32_t uid, const String16& callingPackage);
     int32_t startOp(int32_t op, int32_t uid, const String16& callingPackage);
     void finishOp(int32_t op, int32_t uid, const String16& callingPackage);
     void startWatchingMode(int32_t op, const String16& packageName,
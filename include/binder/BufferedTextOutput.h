@@ -47,10 +47,12 @@ protected:
 private:
     struct BufferState;
     struct ThreadState;
+    class BufferLock;
     
     static  ThreadState*getThreadState();
     static  void        threadDestructor(void *st);
     
+            // The calling thread's state, or NULL to use mGlobalState.
             BufferState*getBuffer() const;
             
     uint32_t            mFlags;
@@ -63,6 +63,13 @@ public:
         FLAG_ONEWAY             = 0x00000001
     };
 
+    enum {
+        // linkToDeath() flag: deliver binderDied() on the process-wide
+        // obituary thread instead of the binder thread that received
+        // the death notification.
+        DEATH_FLAG_ASYNC        = 0x00000001
+    };
+
                           IBinder();
 
     /**
@@ -106,6 +113,10 @@ public:
      * The @a cookie is optional -- if non-NULL, it should be a
      * memory address that you own (that is, you know it is unique).
      *
+     * Pass DEATH_FLAG_ASYNC in @a flags for recipients whose cleanup is
+     * slow or takes locks contended elsewhere; they are then called in
+     * order on a single worker thread, batched per dead binder.
+     *
      * @note You will only receive death notifications for remote binders,
      * as local binders by definition can't die without you dying as well.
      * Trying to use this function on a local binder will result in an
@@ -20,6 +20,7 @@
 #include <utils/Errors.h>
 #include <binder/Parcel.h>
 #include <binder/ProcessState.h>
+#include <utils/Timers.h>
 #include <utils/Vector.h>
 
 #if defined(_WIN32)
@@ -29,6 +30,8 @@ typedef  int  uid_t;
 // ---------------------------------------------------------------------------
 namespace android {
 
+class TransactionStats;
+
 class IPCThreadState
 {
 public:
@@ -64,6 +67,35 @@ public:
                                          uint32_t code, const Parcel& data,
                                          Parcel* reply, uint32_t flags);
 
+            // Between these calls, TF_ONE_WAY transactions made from this
+            // thread are queued and handed to the driver together instead of
+            // one ioctl each.  Calls nest; the outermost endOneWayBatch()
+            // submits the queue and returns the first error any of the
+            // queued transactions hit.  A two-way transaction or reply made
+            // while batching submits the queue first, preserving ordering.
+            void                beginOneWayBatch();
+            status_t            endOneWayBatch();
+
+    // Process-wide count of BINDER_WRITE_READ ioctls issued and of
+    // transactions sent, for judging how well commands are being batched.
+    static  void                getDriverStats(uint64_t* outIoctls,
+                                               uint64_t* outTransactions);
+
+    // Per-interface, per-code latency histograms of the transactions this
+    // process makes and serves.  Off by default; recording costs two clock
+    // reads per transaction and no locks.  Services can append the dump to
+    // their dumpsys output, or sample it into atrace counters under 'tag'.
+    static  void                setTransactionStatsEnabled(bool enabled);
+    static  void                dumpTransactionStats(String8& result);
+    static  void                traceTransactionStats(uint64_t tag);
+
+    // Bytes of the driver's transaction buffer held by parcels this process
+    // received and hasn't released yet, and who holds them.  A warning is
+    // logged when the buffer is close to full; see
+    // Parcel::releaseTransactionBuffer() for giving space back early.
+    static  size_t              getOutstandingBufferBytes();
+    static  void                dumpOutstandingBuffers(String8& result);
+
             void                incStrongHandle(int32_t handle);
             void                decStrongHandle(int32_t handle);
             void                incWeakHandle(int32_t handle);
@@ -102,7 +134,17 @@ private:
                                                      uint32_t code,
                                                      const Parcel& data,
                                                      status_t* statusBuffer);
+            status_t            queueOneWayTransaction(int32_t handle,
+                                                       uint32_t code,
+                                                       const Parcel& data,
+                                                       uint32_t flags);
+            status_t            flushOneWayBatch();
             status_t            getAndExecuteCommand();
+            bool                idleTimedOut();
+            void                recordTransaction(bool incoming, uint32_t code,
+                                                  const Parcel& data,
+                                                  nsecs_t wallStart,
+                                                  nsecs_t cpuStart);
             status_t            executeCommand(int32_t command);
             void                processPendingDerefs();
 
@@ -125,6 +167,14 @@ private:
             uid_t               mCallingUid;
             int32_t             mStrictModePolicy;
             int32_t             mLastTransactionBinderFlags;
+            int32_t             mOneWayBatchDepth;
+            // Private copies of batched transaction data; the driver reads
+            // them when the batch is submitted.
+            Vector<Parcel*>     mOneWayBatch;
+            TransactionStats*   mTransactionStats;
+            // The transaction whose reply is being waited for.
+            int32_t             mReplyHandle;
+            uint32_t            mReplyCode;
 };
 
 }; // namespace android
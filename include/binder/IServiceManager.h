@@ -43,6 +43,13 @@ public:
      */
     virtual sp<IBinder>         checkService( const String16& name) const = 0;
 
+    /**
+     * Retrieve a service, blocking until it is registered.  Rather than
+     * polling, this asks the service manager to call back as soon as the
+     * service is added.
+     */
+    virtual sp<IBinder>         waitForService( const String16& name) const = 0;
+
     /**
      * Register a service.
      */
@@ -60,6 +67,8 @@ public:
         CHECK_SERVICE_TRANSACTION,
         ADD_SERVICE_TRANSACTION,
         LIST_SERVICES_TRANSACTION,
+        WAIT_FOR_SERVICE_TRANSACTION,
+        STOP_WAITING_FOR_SERVICE_TRANSACTION,
     };
 };
 
@@ -34,8 +34,19 @@ class SimpleBestFitAllocator;
 class MemoryDealer : public RefBase
 {
 public:
+    // How a free chunk is picked for an allocation.
+    enum Policy {
+        // the first chunk of the smallest size class that fits, in constant
+        // time
+        POLICY_GOOD_FIT = 0,
+        // the smallest chunk that fits, found by walking its size class; for
+        // clients mixing many sizes that fragment the heap otherwise
+        POLICY_BEST_FIT = 1,
+    };
+
     MemoryDealer(size_t size, const char* name = 0,
             uint32_t flags = 0 /* or bits such as MemoryHeapBase::READ_ONLY */ );
+    MemoryDealer(size_t size, const char* name, uint32_t flags, Policy policy);
 
     virtual sp<IMemory> allocate(size_t size);
     virtual void        deallocate(size_t offset);
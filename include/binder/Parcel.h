@@ -61,6 +61,12 @@ public:
     status_t            setDataSize(size_t size);
     void                setDataPosition(size_t pos) const;
     status_t            setDataCapacity(size_t size);
+
+    // Makes room for len more bytes at the current data position with at
+    // most one reallocation.  Writers that know their flattened size up
+    // front use this so that a large payload does not grow the buffer
+    // piecemeal.
+    status_t            reserveData(size_t len);
     
     status_t            setData(const uint8_t* buffer, size_t len);
 
@@ -89,6 +95,14 @@ public:
 
     void                freeData();
 
+    // A parcel received from the driver, as an incoming transaction or a
+    // reply, holds on to its space in the process's transaction buffer
+    // until destroyed.  This moves the contents, data position included,
+    // into a copy of the parcel's own and gives the space back right away,
+    // which is worth doing before keeping a large parcel around; the file
+    // descriptors in it are duplicated.  Does nothing to other parcels.
+    status_t            releaseTransactionBuffer();
+
 private:
     const binder_size_t* objects() const;
 
@@ -208,6 +222,13 @@ public:
     // as long as it keeps a dup of the blob file descriptor handy for later.
     status_t            writeDupImmutableBlobFileDescriptor(int fd);
 
+    // Writes a byte buffer whose size decides the transport: in place when
+    // small, otherwise an immutable ashmem blob, so large payloads cost one
+    // copy into shared memory and none on the reading side.  The format
+    // differs from writeByteVector(); read it with readByteVectorBlob().
+    status_t            writeByteVectorBlob(const uint8_t* data, size_t len);
+    status_t            writeByteVectorBlob(const std::vector<uint8_t>& val);
+
     status_t            writeObject(const flat_binder_object& val, bool nullMetaData);
 
     // Like Parcel.java's writeNoException().  Just writes a zero int32.
@@ -333,6 +354,12 @@ public:
     // The caller should call release() on the blob after reading its contents.
     status_t            readBlob(size_t len, ReadableBlob* outBlob) const;
 
+    // Reads a buffer written by writeByteVectorBlob().  The blob form views
+    // the data where it lies, in the parcel or the mapped region, until
+    // released; the vector form copies it out.
+    status_t            readByteVectorBlob(ReadableBlob* outBlob) const;
+    status_t            readByteVectorBlob(std::vector<uint8_t>* val) const;
+
     const flat_binder_object* readObject(bool nullMetaData) const;
 
     // Explicitly close all file descriptors in the parcel.
@@ -341,6 +368,8 @@ public:
     // Debugging: get metrics on current allocations.
     static size_t       getGlobalAllocSize();
     static size_t       getGlobalAllocCount();
+    // Bytes held in per-thread caches of idle Parcel buffers.
+    static size_t       getGlobalPooledSize();
 
 private:
     typedef void        (*release_func)(Parcel* parcel,
@@ -367,6 +396,9 @@ private:
     void                releaseObjects();
     void                acquireObjects();
     status_t            growData(size_t len);
+    // Makes room for count more entries in the object index with at most
+    // one reallocation.
+    status_t            growObjects(size_t count);
     status_t            restartWrite(size_t desired);
     status_t            continueWrite(size_t desired);
     status_t            writePointer(uintptr_t val);
@@ -649,7 +681,15 @@ status_t Parcel::unsafeWriteTypedVector(const std::vector<T>& val,
         return BAD_VALUE;
     }
 
-    status_t status = this->writeInt32(val.size());
+    // Every element occupies at least one word; reserve that much up
+    // front so long vectors don't reallocate once per growth step.
+    status_t status = this->reserveData((val.size() + 1) * sizeof(int32_t));
+
+    if (status != OK) {
+        return status;
+    }
+
+    status = this->writeInt32(val.size());
 
     if (status != OK) {
         return status;
@@ -20,9 +20,12 @@
 #include <stdint.h>
 #include <unistd.h>
 
+#include <unordered_map>
+
+#include <utils/Mutex.h>
 #include <utils/String16.h>
 #include <utils/Singleton.h>
-#include <utils/SortedVector.h>
+#include <utils/Timers.h>
 
 namespace android {
 // ---------------------------------------------------------------------------
@@ -30,31 +33,43 @@ namespace android {
 /*
  * PermissionCache caches permission checks for a given uid.
  *
- * Currently the cache is not updated when there is a permission change,
- * for instance when an application is uninstalled.
+ * The cache is not told about permission changes, for instance when an
+ * application is uninstalled: results expire after a while instead, and a
+ * service that learns about such a change can invalidate() them sooner.
  *
  * IMPORTANT: for the reason stated above, only system permissions are safe
  * to cache. This restriction may be lifted at a later time.
  *
+ * Entries are spread over shards by hash, each with its own lock, so that
+ * binder threads checking different callers don't wait for each other.
  */
 
 class PermissionCache : Singleton<PermissionCache> {
-    struct Entry {
+    struct Key {
         String16    name;
         uid_t       uid;
-        bool        granted;
-        inline bool operator < (const Entry& e) const {
-            return (uid == e.uid) ? (name < e.name) : (uid < e.uid);
+        inline bool operator == (const Key& k) const {
+            return (uid == k.uid) && (name == k.name);
         }
     };
-    mutable Mutex mLock;
-    // we pool all the permission names we see, as many permissions checks
-    // will have identical names
-    SortedVector< String16 > mPermissionNamesPool;
-    // this is our cache per say. it stores pooled names.
-    SortedVector< Entry > mCache;
-
-    // free the whole cache, but keep the permission name pool
+    struct KeyHash {
+        size_t operator () (const Key& k) const;
+    };
+    struct Entry {
+        bool        granted;
+        nsecs_t     expires;
+    };
+    struct Shard {
+        mutable Mutex lock;
+        std::unordered_map<Key, Entry, KeyHash> entries;
+    };
+    enum { NUM_SHARDS = 8 };
+    Shard mShards[NUM_SHARDS];
+
+    Shard& shardFor(const Key& key);
+    const Shard& shardFor(const Key& key) const;
+
+    // free the whole cache
     void purge();
 
     status_t check(bool* granted,
@@ -72,6 +87,12 @@ public:
 
     static bool checkPermission(const String16& permission,
             pid_t pid, uid_t uid);
+
+    // forget the cached results of uid, e.g. when its packages changed
+    static void invalidate(uid_t uid);
+
+    // forget all the cached results, e.g. when permissions changed
+    static void invalidate();
 };
 
 // ---------------------------------------------------------------------------
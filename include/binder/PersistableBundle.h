@@ -18,6 +18,7 @@
 #define ANDROID_PERSISTABLE_BUNDLE_H
 
 #include <map>
+#include <mutex>
 #include <vector>
 
 #include <binder/Parcelable.h>
@@ -31,12 +32,17 @@ namespace os {
 /*
  * C++ implementation of PersistableBundle, a mapping from String values to
  * various types that can be saved to persistent and later restored.
+ *
+ * Like the Java class, a bundle read from a parcel keeps its bytes and only
+ * decodes them when first accessed, so that a bundle that is just passed on
+ * is written back out with a single copy.
  */
 class PersistableBundle : public Parcelable {
 public:
     PersistableBundle() = default;
     virtual ~PersistableBundle() = default;
-    PersistableBundle(const PersistableBundle& bundle) = default;
+    PersistableBundle(const PersistableBundle& bundle);
+    PersistableBundle& operator=(const PersistableBundle& bundle);
 
     status_t writeToParcel(Parcel* parcel) const override;
     status_t readFromParcel(const Parcel* parcel) override;
@@ -80,6 +86,8 @@ public:
     bool getPersistableBundle(const String16& key, PersistableBundle* out) const;
 
     friend bool operator==(const PersistableBundle& lhs, const PersistableBundle& rhs) {
+        lhs.unparcel();
+        rhs.unparcel();
         return (lhs.mBoolMap == rhs.mBoolMap && lhs.mIntMap == rhs.mIntMap &&
                 lhs.mLongMap == rhs.mLongMap && lhs.mDoubleMap == rhs.mDoubleMap &&
                 lhs.mStringMap == rhs.mStringMap && lhs.mBoolVectorMap == rhs.mBoolVectorMap &&
@@ -96,19 +104,29 @@ public:
 
 private:
     status_t writeToParcelInner(Parcel* parcel) const;
-    status_t readFromParcelInner(const Parcel* parcel, size_t length);
-
-    std::map<String16, bool> mBoolMap;
-    std::map<String16, int32_t> mIntMap;
-    std::map<String16, int64_t> mLongMap;
-    std::map<String16, double> mDoubleMap;
-    std::map<String16, String16> mStringMap;
-    std::map<String16, std::vector<bool>> mBoolVectorMap;
-    std::map<String16, std::vector<int32_t>> mIntVectorMap;
-    std::map<String16, std::vector<int64_t>> mLongVectorMap;
-    std::map<String16, std::vector<double>> mDoubleVectorMap;
-    std::map<String16, std::vector<String16>> mStringVectorMap;
-    std::map<String16, PersistableBundle> mPersistableBundleMap;
+    status_t readFromParcelInner(const Parcel* parcel) const;
+
+    // Decodes mParcelledData into the maps, if readFromParcel() left any.
+    void unparcel() const;
+    void copyFrom(const PersistableBundle& bundle);
+
+    // Guards the decoding of mParcelledData, which const accessors do.
+    mutable std::mutex mParcelledDataLock;
+    // What follows the magic number of a bundle read from a parcel, until
+    // it is decoded; the maps are empty while it isn't.
+    mutable std::vector<uint8_t> mParcelledData;
+
+    mutable std::map<String16, bool> mBoolMap;
+    mutable std::map<String16, int32_t> mIntMap;
+    mutable std::map<String16, int64_t> mLongMap;
+    mutable std::map<String16, double> mDoubleMap;
+    mutable std::map<String16, String16> mStringMap;
+    mutable std::map<String16, std::vector<bool>> mBoolVectorMap;
+    mutable std::map<String16, std::vector<int32_t>> mIntVectorMap;
+    mutable std::map<String16, std::vector<int64_t>> mLongVectorMap;
+    mutable std::map<String16, std::vector<double>> mDoubleVectorMap;
+    mutable std::map<String16, std::vector<String16>> mStringVectorMap;
+    mutable std::map<String16, PersistableBundle> mPersistableBundleMap;
 };
 
 }  // namespace os
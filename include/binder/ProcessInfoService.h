@@ -21,6 +21,7 @@
 #include <utils/Errors.h>
 #include <utils/Singleton.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 namespace android {
 
@@ -29,15 +30,30 @@ namespace android {
 class ProcessInfoService : public Singleton<ProcessInfoService> {
 
     friend class Singleton<ProcessInfoService>;
+
+    // Drops the service as soon as it dies, so that the next call looks up
+    // its replacement instead of failing on the dead binder first.
+    class ServiceDeathRecipient : public IBinder::DeathRecipient {
+    public:
+        virtual void binderDied(const wp<IBinder>& who);
+    };
+
     sp<IProcessInfoService> mProcessInfoService;
+    sp<ServiceDeathRecipient> mDeathRecipient;
     Mutex mProcessInfoLock;
 
     ProcessInfoService();
 
-    status_t getProcessStatesImpl(size_t length, /*in*/ int32_t* pids, /*out*/ int32_t* states);
+    // scores may be NULL, when only the states are wanted
+    status_t getProcessStatesImpl(size_t length, /*in*/ int32_t* pids, /*out*/ int32_t* states,
+            /*out*/ int32_t* scores);
     void updateBinderLocked();
+    void dropBinder(const sp<IProcessInfoService>& pis);
 
     static const int BINDER_ATTEMPT_LIMIT = 5;
+    // How long to wait for the service to be registered again, at first;
+    // the wait doubles with every attempt that doesn't find it.
+    static const useconds_t BINDER_RETRY_DELAY_US = 50000;
 
 public:
 
@@ -52,7 +68,17 @@ public:
     static status_t getProcessStatesFromPids(size_t length, /*in*/ int32_t* pids,
             /*out*/ int32_t* states) {
         return ProcessInfoService::getInstance().getProcessStatesImpl(length, /*in*/ pids,
-                /*out*/ states);
+                /*out*/ states, /*out*/ NULL);
+    }
+
+    /**
+     * Same as getProcessStatesFromPids(), also writing the oom score of each process into
+     * the "scores" output array, with the same single call to the service.
+     */
+    static status_t getProcessStatesAndOomScoresFromPids(size_t length, /*in*/ int32_t* pids,
+            /*out*/ int32_t* states, /*out*/ int32_t* scores) {
+        return ProcessInfoService::getInstance().getProcessStatesImpl(length, /*in*/ pids,
+                /*out*/ states, /*out*/ scores);
     }
 
 };
@@ -64,6 +64,25 @@ public:
             status_t            setThreadPoolMaxThreadCount(size_t maxThreads);
             void                giveThreadPoolName();
 
+            // Lets the pool adapt to load.  Each time every pool thread has
+            // been busy for at least growAfterMs, the thread cap is raised
+            // by one, up to maxThreads.  Pool threads other than the main
+            // one exit after sitting idle for idleTimeoutMs; 0 keeps them.
+            status_t            setThreadPoolAdaptive(size_t maxThreads,
+                                                      int64_t growAfterMs,
+                                                      int64_t idleTimeoutMs);
+
+            struct ThreadPoolStats {
+                size_t          threads;            // pool threads running
+                size_t          executingThreads;   // of those, busy now
+                size_t          maxThreads;         // current cap
+                uint64_t        starvationCount;    // times all were busy
+                int64_t         totalStarvationMs;  // time incoming work
+                int64_t         maxStarvationMs;    //   had to queue
+                uint64_t        retiredThreads;     // exited while idle
+            };
+            void                getThreadPoolStats(ThreadPoolStats* outStats);
+
 private:
     friend class IPCThreadState;
     
@@ -79,7 +98,18 @@ private:
                 RefBase::weakref_type* refs;
             };
 
-            handle_entry*       lookupHandleLocked(int32_t handle);
+            // Handles are spread over shards, each with its own lock, so
+            // that threads resolving different handles don't serialize.
+            enum { HANDLE_SHARD_COUNT = 16 };
+
+            struct handle_shard {
+                Mutex lock;  // protects entries
+                Vector<handle_entry> entries;
+            };
+
+            handle_shard&       shardForHandle(int32_t handle);
+            handle_entry*       lookupHandleLocked(handle_shard& shard, int32_t handle);
+            status_t            updateDriverMaxThreadsLocked();
 
             int                 mDriverFD;
             void*               mVMStart;
@@ -93,11 +123,23 @@ private:
             size_t              mMaxThreads;
             // Time when thread pool was emptied
             int64_t             mStarvationStartTimeMs;
+            // Adaptive pool policy; mAdaptiveMaxThreads is 0 when disabled.
+            size_t              mAdaptiveMaxThreads;
+            int64_t             mGrowAfterMs;
+            int64_t             mIdleTimeoutMs;
+            // Pool threads currently in joinThreadPool().
+            size_t              mPoolThreadCount;
+            // The driver never forgets a registered looper, so every thread
+            // retired for idleness is added back onto the cap we give it.
+            size_t              mRetiredThreadCount;
+            uint64_t            mStarvationCount;
+            int64_t             mTotalStarvationMs;
+            int64_t             mMaxStarvationMs;
+
+            handle_shard        mHandleShards[HANDLE_SHARD_COUNT];
 
     mutable Mutex               mLock;  // protects everything below.
 
-            Vector<handle_entry>mHandleToObject;
-
             bool                mManagesContexts;
             context_check_func  mBinderContextCheckFunc;
             void*               mBinderContextUserData;
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_GUI_BUFFERITEMFIFO_H
+#define ANDROID_GUI_BUFFERITEMFIFO_H
+
+#include <gui/BufferItem.h>
+
+#include <stddef.h>
+
+namespace android {
+
+// The queue of BufferItems between a BufferQueue's producer and consumer.
+// Items live in a power-of-two ring and are assigned in place, so popping
+// the front never shifts the remaining items (as erasing from the front of
+// a Vector did) and the storage is reused from frame to frame. The ring
+// only grows if the queue gets deeper than it has ever been.
+class BufferItemFifo {
+public:
+    template <typename Fifo, typename Item>
+    class Iterator {
+    public:
+        Iterator(Fifo* fifo, size_t index) : mFifo(fifo), mIndex(index) {}
+        Item& operator*() const { return (*mFifo)[mIndex]; }
+        Item* operator->() const { return &(*mFifo)[mIndex]; }
+        Iterator& operator++() { ++mIndex; return *this; }
+        bool operator==(const Iterator& o) const { return mIndex == o.mIndex; }
+        bool operator!=(const Iterator& o) const { return mIndex != o.mIndex; }
+        size_t index() const { return mIndex; }
+    private:
+        Fifo* mFifo;
+        size_t mIndex;
+    };
+    typedef Iterator<BufferItemFifo, BufferItem> iterator;
+    typedef Iterator<const BufferItemFifo, const BufferItem> const_iterator;
+
+    BufferItemFifo();
+    ~BufferItemFifo();
+
+    bool empty() const { return mSize == 0; }
+    size_t size() const { return mSize; }
+
+    const BufferItem& operator[](size_t index) const { return mItems[wrap(index)]; }
+    BufferItem& operator[](size_t index) { return mItems[wrap(index)]; }
+    const BufferItem& itemAt(size_t index) const { return (*this)[index]; }
+    BufferItem& editItemAt(size_t index) { return (*this)[index]; }
+
+    void push_back(const BufferItem& item);
+    // Removes the front item, dropping its buffer and fence references.
+    void pop_front();
+    // Erasing the front is O(1); anywhere else shifts the items behind it.
+    iterator erase(iterator it);
+    void clear();
+
+    iterator begin() { return iterator(this, 0); }
+    iterator end() { return iterator(this, mSize); }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, mSize); }
+
+private:
+    BufferItemFifo(const BufferItemFifo&);
+    BufferItemFifo& operator=(const BufferItemFifo&);
+
+    size_t wrap(size_t index) const { return (mHead + index) & (mCapacity - 1); }
+    void grow();
+
+    BufferItem* mItems;
+    size_t mCapacity;
+    size_t mHead;
+    size_t mSize;
+};
+
+} // namespace android
+
+#endif
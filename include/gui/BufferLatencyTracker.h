@@ -0,0 +1,73 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_GUI_BUFFERLATENCYTRACKER_H
+#define ANDROID_GUI_BUFFERLATENCYTRACKER_H
+
+#include <utils/Timers.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace android {
+
+class String8;
+
+// Latency histograms for the stages a buffer goes through in one
+// BufferQueue. The owner serializes access (BufferQueueCore uses mMutex).
+class BufferLatencyTracker
+{
+public:
+    enum Stage {
+        // Time dequeueBuffer spent waiting for a buffer to become free
+        DEQUEUE_BLOCK,
+        // Time from queueBuffer until the consumer acquired the buffer
+        QUEUE_TO_ACQUIRE,
+        // Time the consumer held the buffer between acquire and release
+        ACQUIRE_TO_RELEASE,
+        NUM_STAGES,
+    };
+
+    BufferLatencyTracker();
+
+    void record(Stage stage, nsecs_t duration);
+    void clear();
+
+    // Writes a header and one tab-separated line per stage: name, count, and
+    // the p50, p90, p99 and maximum latency in microseconds. Percentiles are
+    // the upper bound of the power-of-two bucket they fall in.
+    void dump(String8& result, const char* prefix) const;
+
+private:
+    // Bucket i counts durations shorter than 2^i microseconds; the last one
+    // takes everything longer
+    static constexpr size_t NUM_BUCKETS = 24;
+
+    struct Histogram {
+        uint64_t count;
+        nsecs_t max;
+        uint64_t buckets[NUM_BUCKETS];
+    };
+
+    static nsecs_t percentile(const Histogram& histogram, uint32_t percent);
+
+    Histogram mHistograms[NUM_STAGES];
+
+}; // class BufferLatencyTracker
+
+} // namespace android
+
+#endif
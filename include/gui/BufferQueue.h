@@ -68,6 +68,8 @@ public:
         virtual void onSidebandStreamChanged() override;
         virtual bool getFrameTimestamps(uint64_t frameNumber,
                 FrameTimestamps* outTimestamps) const override;
+        virtual status_t createFrameEventChannel(
+                sp<BitTube>* outChannel) override;
     private:
         // mConsumerListener is a weak reference to the IConsumerListener.  This is
         // the raison d'etre of ProxyConsumerListener.
@@ -108,6 +108,10 @@ public:
     // fail if a producer is connected to the BufferQueue.
     virtual status_t setMaxAcquiredBufferCount(int maxAcquiredBuffers);
 
+    // See IGraphicBufferConsumer::setFrameDropPolicy
+    virtual status_t setFrameDropPolicy(int maxQueuedFrames,
+            nsecs_t expectedPresentOffset) override;
+
     // setConsumerName sets the name used in logging
     virtual void setConsumerName(const String8& name);
 
@@ -143,9 +147,15 @@ public:
     // See IGraphicBufferConsumer::discardFreeBuffers
     virtual status_t discardFreeBuffers() override;
 
+    // See IGraphicBufferConsumer::trimFreeBuffers
+    virtual status_t trimFreeBuffers(int maxAllocatedBuffers) override;
+
     // dump our state in a String
     virtual void dumpState(String8& result, const char* prefix) const;
 
+    // See IGraphicBufferConsumer::dumpLatency
+    virtual void dumpLatency(String8& result, const char* prefix) const;
+
     // Functions required for backwards compatibility.
     // These will be modified/renamed in IGraphicBufferConsumer and will be
     // removed from this class at that time. See b/13306289.
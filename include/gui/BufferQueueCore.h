@@ -18,8 +18,11 @@
 #define ANDROID_GUI_BUFFERQUEUECORE_H
 
 #include <gui/BufferItem.h>
+#include <gui/BufferItemFifo.h>
+#include <gui/BufferLatencyTracker.h>
 #include <gui/BufferQueueDefs.h>
 #include <gui/BufferSlot.h>
+#include <gui/BufferSlotSets.h>
 #include <gui/OccupancyTracker.h>
 
 #include <utils/Condition.h>
@@ -31,8 +34,6 @@
 #include <utils/Trace.h>
 #include <utils/Vector.h>
 
-#include <list>
-#include <set>
 
 #define BQ_LOGV(x, ...) ALOGV("[%s] " x, mConsumerName.string(), ##__VA_ARGS__)
 #define BQ_LOGD(x, ...) ALOGD("[%s] " x, mConsumerName.string(), ##__VA_ARGS__)
@@ -76,7 +77,7 @@ public:
         NO_CONNECTED_API        = 0,
     };
 
-    typedef Vector<BufferItem> Fifo;
+    typedef BufferItemFifo Fifo;
 
     // BufferQueueCore manages a pool of gralloc memory slots to be used by
     // producers and consumers. allocator is used to allocate all the needed
@@ -117,6 +118,13 @@ private:
     int getMaxBufferCountLocked(bool asyncMode,
             bool dequeueBufferCannotBlock, int maxBufferCount) const;
 
+    // getAsyncBufferCountLocked returns the number of extra buffers that let
+    // droppable frames wait in the queue without blocking dequeueBuffer: none
+    // unless asyncMode or dequeueBufferCannotBlock is set, and otherwise one for
+    // each frame allowed by mMaxQueuedDroppableFrames.
+    int getAsyncBufferCountLocked(bool asyncMode,
+            bool dequeueBufferCannotBlock) const;
+
     // clearBufferSlotLocked frees the GraphicBuffer and sync resources for the
     // given slot.
     void clearBufferSlotLocked(int slot);
@@ -130,6 +138,10 @@ private:
     // minimum possible without discarding data.
     void discardFreeBuffersLocked();
 
+    // trimFreeBuffersLocked releases free buffers, most recently released
+    // first, until at most maxAllocatedBuffers buffers remain allocated.
+    void trimFreeBuffersLocked(int maxAllocatedBuffers);
+
     // If delta is positive, makes more slots available. If negative, takes
     // away slots. Returns false if the request can't be met.
     bool adjustAvailableSlotsLocked(int delta);
@@ -205,18 +217,18 @@ private:
 
     // mFreeSlots contains all of the slots which are FREE and do not currently
     // have a buffer attached.
-    std::set<int> mFreeSlots;
+    SlotSet mFreeSlots;
 
     // mFreeBuffers contains all of the slots which are FREE and currently have
     // a buffer attached.
-    std::list<int> mFreeBuffers;
+    SlotList mFreeBuffers;
 
     // mUnusedSlots contains all slots that are currently unused. They should be
     // free and not have a buffer attached.
-    std::list<int> mUnusedSlots;
+    SlotList mUnusedSlots;
 
     // mActiveBuffers contains all slots which have a non-FREE buffer attached.
-    std::set<int> mActiveBuffers;
+    SlotSet mActiveBuffers;
 
     // mDequeueCondition is a condition variable used for dequeueBuffer in
     // synchronous mode.
@@ -260,6 +272,21 @@ private:
     // via setMaxDequeuedBufferCount.
     int mMaxDequeuedBufferCount;
 
+    // mMaxQueuedDroppableFrames is the number of droppable frames that may wait
+    // at the back of the queue. When another frame is queued, the oldest of
+    // them are dropped. It defaults to 1, in which case a droppable frame is
+    // replaced by the next one, and can be changed by the consumer via
+    // setFrameDropPolicy.
+    int mMaxQueuedDroppableFrames;
+
+    // mExpectedPresentOffset is how long after being queued the consumer
+    // expects to present a frame, or -1 if it has no such expectation. When
+    // a frame with an explicit timestamp is queued that is due by then, the
+    // droppable frames queued before it are dropped right away, as
+    // acquireBuffer would drop them anyway. It can be changed by the consumer
+    // via setFrameDropPolicy.
+    nsecs_t mExpectedPresentOffset;
+
     // mBufferHasBeenQueued is true once a buffer has been queued. It is reset
     // when something causes all buffers to be freed (e.g., changing the buffer
     // count).
@@ -336,6 +363,9 @@ private:
 
     OccupancyTracker mOccupancyTracker;
 
+    // Dequeue, queue-to-acquire and acquire-to-release latency histograms
+    BufferLatencyTracker mLatencyTracker;
+
     const uint64_t mUniqueId;
 
 }; // class BufferQueueCore
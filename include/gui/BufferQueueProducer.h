@@ -112,6 +112,13 @@ public:
     virtual status_t queueBuffer(int slot,
             const QueueBufferInput& input, QueueBufferOutput* output);
 
+    // See IGraphicBufferProducer::queueAndDequeueBuffer
+    virtual status_t queueAndDequeueBuffer(int slot,
+            const QueueBufferInput& input, QueueBufferOutput* output,
+            uint32_t width, uint32_t height, PixelFormat format,
+            uint32_t usage, int* outSlot, sp<Fence>* outFence,
+            sp<GraphicBuffer>* outBuffer, status_t* outDequeueResult) override;
+
     // cancelBuffer returns a dequeued buffer to the BufferQueue, but doesn't
     // queue it for use by the consumer.
     //
@@ -180,6 +187,9 @@ public:
     virtual bool getFrameTimestamps(uint64_t frameNumber,
             FrameTimestamps* outTimestamps) const override;
 
+    // See IGraphicBufferProducer::createFrameEventChannel
+    virtual status_t createFrameEventChannel(sp<BitTube>* outChannel) override;
+
     // See IGraphicBufferProducer::getUniqueId
     virtual status_t getUniqueId(uint64_t* outId) const override;
 
@@ -199,13 +209,31 @@ private:
     // block if there are no available slots and we are not in non-blocking
     // mode (producer and consumer controlled by the application). If it blocks,
     // it will release mCore->mMutex while blocked so that other operations on
-    // the BufferQueue may succeed.
+    // the BufferQueue may succeed. A Prefetch caller never blocks; it gets
+    // WOULD_BLOCK instead.
     enum class FreeSlotCaller {
         Dequeue,
         Attach,
+        Prefetch,
     };
     status_t waitForFreeSlotThenRelock(FreeSlotCaller caller, int* found) const;
 
+    // Returns the slot of a queued buffer that is being dropped to the free
+    // list, unless the buffer is stale or its slot is shared.
+    void freeDroppedBufferLocked(const BufferItem& dropped);
+
+    // Drops the droppable frames at the back of the queue that the consumer's
+    // frame drop policy no longer wants once incoming gets queued. Returns
+    // true if the last queued frame was dropped, in which case it is left in
+    // the queue for the caller to overwrite with incoming.
+    bool dropQueuedFramesLocked(const BufferItem& incoming);
+
+    // Implements dequeueBuffer, and the dequeue half of
+    // queueAndDequeueBuffer when caller is FreeSlotCaller::Prefetch.
+    status_t dequeueBufferInternal(FreeSlotCaller caller, int* outSlot,
+            sp<Fence>* outFence, uint32_t width, uint32_t height,
+            PixelFormat format, uint32_t usage);
+
     sp<BufferQueueCore> mCore;
 
     // This references mCore->mSlots. Lock mCore->mMutex while accessing.
@@ -24,6 +24,7 @@
 #include <EGL/eglext.h>
 
 #include <utils/StrongPointer.h>
+#include <utils/Timers.h>
 
 namespace android {
 
@@ -182,7 +183,9 @@ struct BufferSlot {
       mEglFence(EGL_NO_SYNC_KHR),
       mFence(Fence::NO_FENCE),
       mAcquireCalled(false),
-      mNeedsReallocation(false) {
+      mNeedsReallocation(false),
+      mQueueTime(0),
+      mAcquireTime(0) {
     }
 
     // mGraphicBuffer points to the buffer allocated for this slot or is NULL
@@ -230,6 +233,12 @@ struct BufferSlot {
     // producer. If so, it needs to set the BUFFER_NEEDS_REALLOCATION flag when
     // dequeued to prevent the producer from using a stale cached buffer.
     bool mNeedsReallocation;
+
+    // When the buffer in this slot was last queued and acquired, or 0 once
+    // the matching acquire or release has been recorded. These feed
+    // BufferQueueCore::mLatencyTracker.
+    nsecs_t mQueueTime;
+    nsecs_t mAcquireTime;
 };
 
 } // namespace android
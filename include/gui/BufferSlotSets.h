@@ -0,0 +1,166 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_GUI_BUFFERSLOTSETS_H
+#define ANDROID_GUI_BUFFERSLOTSETS_H
+
+#include <gui/BufferQueueDefs.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace android {
+
+static_assert(BufferQueueDefs::NUM_BUFFER_SLOTS <= 64,
+        "slot sets are stored in a 64-bit mask");
+
+// An ordered set of slot indices, stored as a bitmask. It mirrors the parts
+// of std::set<int> that BufferQueue uses: iteration is in ascending order,
+// and every operation other than iteration is constant time and never
+// allocates.
+class SlotSet {
+public:
+    class const_iterator {
+    public:
+        explicit const_iterator(uint64_t bits) : mBits(bits) {}
+        int operator*() const { return __builtin_ctzll(mBits); }
+        const_iterator& operator++() { mBits &= mBits - 1; return *this; }
+        bool operator==(const const_iterator& o) const { return mBits == o.mBits; }
+        bool operator!=(const const_iterator& o) const { return mBits != o.mBits; }
+    private:
+        // The slots not yet visited; iterating works on a snapshot, so the
+        // set may be modified while it is walked.
+        uint64_t mBits;
+    };
+    typedef const_iterator iterator;
+
+    SlotSet() : mBits(0) {}
+
+    bool empty() const { return mBits == 0; }
+    size_t size() const { return static_cast<size_t>(__builtin_popcountll(mBits)); }
+    size_t count(int slot) const { return (mBits >> slot) & 1; }
+
+    void insert(int slot) { mBits |= bit(slot); }
+    void erase(int slot) { mBits &= ~bit(slot); }
+    void erase(const_iterator it) { erase(*it); }
+    void clear() { mBits = 0; }
+
+    const_iterator begin() const { return const_iterator(mBits); }
+    const_iterator end() const { return const_iterator(0); }
+
+private:
+    static uint64_t bit(int slot) { return uint64_t(1) << slot; }
+
+    uint64_t mBits;
+};
+
+// An ordered list of distinct slot indices, linked through fixed arrays. It
+// mirrors the parts of std::list<int> that BufferQueue uses, but removing a
+// slot by value is constant time and nothing is ever allocated. Adding a
+// slot that is already present moves it instead of duplicating it.
+class SlotList {
+public:
+    class const_iterator {
+    public:
+        const_iterator(const SlotList* list, int slot) : mList(list), mSlot(slot) {}
+        int operator*() const { return mSlot; }
+        const_iterator& operator++() { mSlot = mList->mNext[mSlot]; return *this; }
+        bool operator==(const const_iterator& o) const { return mSlot == o.mSlot; }
+        bool operator!=(const const_iterator& o) const { return mSlot != o.mSlot; }
+    private:
+        const SlotList* mList;
+        int mSlot;
+    };
+    typedef const_iterator iterator;
+
+    SlotList() : mHead(INVALID), mTail(INVALID), mMembers() {}
+
+    bool empty() const { return mHead == INVALID; }
+    size_t size() const { return mMembers.size(); }
+    size_t count(int slot) const { return mMembers.count(slot); }
+
+    int front() const { return mHead; }
+    int back() const { return mTail; }
+
+    void push_front(int slot) {
+        remove(slot);
+        mPrev[slot] = INVALID;
+        mNext[slot] = static_cast<int8_t>(mHead);
+        if (mHead != INVALID) {
+            mPrev[mHead] = static_cast<int8_t>(slot);
+        } else {
+            mTail = slot;
+        }
+        mHead = slot;
+        mMembers.insert(slot);
+    }
+
+    void push_back(int slot) {
+        remove(slot);
+        mNext[slot] = INVALID;
+        mPrev[slot] = static_cast<int8_t>(mTail);
+        if (mTail != INVALID) {
+            mNext[mTail] = static_cast<int8_t>(slot);
+        } else {
+            mHead = slot;
+        }
+        mTail = slot;
+        mMembers.insert(slot);
+    }
+
+    void pop_front() { remove(mHead); }
+    void pop_back() { remove(mTail); }
+
+    void remove(int slot) {
+        if (slot == INVALID || !mMembers.count(slot)) {
+            return;
+        }
+        if (mPrev[slot] != INVALID) {
+            mNext[mPrev[slot]] = mNext[slot];
+        } else {
+            mHead = mNext[slot];
+        }
+        if (mNext[slot] != INVALID) {
+            mPrev[mNext[slot]] = mPrev[slot];
+        } else {
+            mTail = mPrev[slot];
+        }
+        mMembers.erase(slot);
+    }
+
+    void clear() {
+        mHead = mTail = INVALID;
+        mMembers.clear();
+    }
+
+    const_iterator begin() const { return const_iterator(this, mHead); }
+    const_iterator end() const { return const_iterator(this, INVALID); }
+    const_iterator cbegin() const { return begin(); }
+    const_iterator cend() const { return end(); }
+
+private:
+    enum { INVALID = -1 };
+
+    int mHead;
+    int mTail;
+    int8_t mNext[BufferQueueDefs::NUM_BUFFER_SLOTS];
+    int8_t mPrev[BufferQueueDefs::NUM_BUFFER_SLOTS];
+    SlotSet mMembers;
+};
+
+} // namespace android
+
+#endif
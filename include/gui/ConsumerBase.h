@@ -92,10 +92,25 @@ public:
     // See IGraphicBufferConsumer::discardFreeBuffers
     status_t discardFreeBuffers();
 
+    // See IGraphicBufferConsumer::trimFreeBuffers
+    status_t trimFreeBuffers(int maxAllocatedBuffers);
+
+    // See IGraphicBufferConsumer::setFrameDropPolicy
+    status_t setFrameDropPolicy(int maxQueuedFrames,
+            nsecs_t expectedPresentOffset);
+
+    // See IGraphicBufferConsumer::dumpLatency
+    void dumpLatency(String8& result, const char* prefix) const;
+
 private:
     ConsumerBase(const ConsumerBase&);
     void operator=(const ConsumerBase&);
 
+    // Frees the slots the queue has released buffers from without telling
+    // the consumer listener, after discardFreeBuffers or trimFreeBuffers.
+    // This method must be called with mMutex locked.
+    void freeReleasedBuffersLocked();
+
 protected:
     // ConsumerBase constructs a new ConsumerBase object to consume image
     // buffers from the given IGraphicBufferConsumer.
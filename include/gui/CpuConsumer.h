@@ -110,6 +110,19 @@ class CpuConsumer : public ConsumerBase
     // by calling unlockBuffer before more buffers can be acquired.
     status_t lockNextBuffer(LockedBuffer *nativeBuffer);
 
+    // Gets up to count of the next graphics buffers from the producer and
+    // locks them for CPU use, filling out nativeBuffers in queue order.
+    // Returns how many buffers were locked, BAD_VALUE if no new buffer is
+    // available, and NOT_ENOUGH_DATA if the maximum number of buffers is
+    // already locked. A buffer that fails to lock goes back to the queue.
+    //
+    // The buffers are acquired together and then locked without holding the
+    // consumer's lock, so that waiting for their acquire fences doesn't hold
+    // up the producer queueing more. If prefetch is set, the first rows of
+    // each plane are prefetched into the CPU caches once a buffer is locked.
+    ssize_t lockNextBuffers(LockedBuffer *nativeBuffers, size_t count,
+            bool prefetch = false);
+
     // Returns a locked buffer to the queue, allowing it to be reused. Since
     // only a fixed number of buffers may be locked at a time, old buffers must
     // be released by calling unlockBuffer to ensure new buffers can be acquired by
@@ -121,6 +134,8 @@ class CpuConsumer : public ConsumerBase
     size_t mMaxLockedBuffers;
 
     status_t releaseAcquiredBufferLocked(size_t lockedIdx);
+    // Releases an acquired buffer that failed to lock.
+    void releaseUnlockedBufferLocked(size_t lockedIdx);
 
     virtual void freeBufferLocked(int slotIndex);
 
@@ -140,6 +155,12 @@ class CpuConsumer : public ConsumerBase
     };
     Vector<AcquiredBuffer> mAcquiredBuffers;
 
+    // Slots whose buffer failed to lock as flexible YUV. lockYCbCr can map
+    // and unmap the whole buffer before failing, so it's only tried once per
+    // buffer instead of on every frame. Cleared when the slot gets a new
+    // buffer or is freed.
+    bool mFlexYuvUnsupported[BufferQueue::NUM_BUFFER_SLOTS];
+
     // Count of currently locked buffers
     size_t mCurrentLockedBuffers;
 
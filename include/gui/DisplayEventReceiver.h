@@ -34,6 +34,7 @@ namespace android {
 
 class BitTube;
 class IDisplayEventConnection;
+class VsyncSnapshot;
 
 // ----------------------------------------------------------------------------
 
@@ -126,9 +127,22 @@ public:
      */
     status_t requestNextVsync();
 
+    /*
+     * getLatestVsync() copies the last vsync event SurfaceFlinger sent out
+     * into vsync, from memory shared with SurfaceFlinger, so that a caller
+     * that is already awake can look at the current vsync without reading
+     * the queue. The vsync events are still written to the queue. Returns
+     * WOULD_BLOCK if there was no vsync yet, or NO_INIT if SurfaceFlinger
+     * doesn't share one.
+     */
+    status_t getLatestVsync(Event* vsync);
+
 private:
     sp<IDisplayEventConnection> mEventConnection;
     sp<BitTube> mDataChannel;
+    // mapped on the first getLatestVsync()
+    sp<VsyncSnapshot> mVsyncSnapshot;
+    bool mVsyncSnapshotQueried;
 };
 
 // ----------------------------------------------------------------------------
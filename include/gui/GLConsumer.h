@@ -98,6 +98,16 @@ public:
     // This calls doGLFenceWait to ensure proper synchronization.
     status_t updateTexImage();
 
+    // updateTexImageNoWait does the same as updateTexImage, except that it
+    // doesn't wait for the new buffer to be ready. Instead, the fence that
+    // signals when it is ready (see getCurrentFence) is returned in
+    // outAcquireFence, so that an app updating many textures can wait for all
+    // of them at once. The caller must either wait for the fence on the CPU
+    // or call doGLFenceWait before OpenGL ES reads the texture.
+    //
+    // outAcquireFence is set to Fence::NO_FENCE if an error occurs.
+    status_t updateTexImageNoWait(sp<Fence>* outAcquireFence);
+
     // releaseTexImage releases the texture acquired in updateTexImage().
     // This is intended to be used in single buffer mode.
     //
@@ -189,7 +199,9 @@ public:
 
     // doGLFenceWait inserts a wait command into the OpenGL ES command stream
     // to ensure that it is safe for future OpenGL ES commands to access the
-    // current texture buffer.
+    // current texture buffer. Nothing needs to be done if the fence has
+    // already signaled, e.g. because the caller of updateTexImageNoWait has
+    // waited for it already.
     status_t doGLFenceWait() const;
 
     // set the name of the GLConsumer that will be used to identify it in
@@ -281,8 +293,8 @@ protected:
 
     // Binds mTexName and the current buffer to mTexTarget.  Uses
     // mCurrentTexture if it's set, mCurrentTextureImage if not.  If the
-    // bind succeeds, this calls doGLFenceWait.
-    status_t bindTextureImageLocked();
+    // bind succeeds and waitForFence is true, this calls doGLFenceWait.
+    status_t bindTextureImageLocked(bool waitForFence = true);
 
     // Gets the current EGLDisplay and EGLContext values, and compares them
     // to mEglDisplay and mEglContext.  If the fields have been previously
@@ -293,6 +305,9 @@ protected:
     status_t checkAndUpdateEglStateLocked(bool contextCheck = false);
 
 private:
+    // Implements updateTexImage and updateTexImageNoWait.
+    status_t updateTexImageLocked(bool waitForFence);
+
     // EglImage is a utility class for tracking and creating EGLImageKHRs. There
     // is primarily just one image per slot, but there is also special cases:
     //  - For releaseTexImage, we use a debug image (mReleasedTexImage)
@@ -313,7 +328,7 @@ private:
         // texture in the specified texture target.
         void bindToTextureTarget(uint32_t texTarget);
 
-        const sp<GraphicBuffer>& graphicBuffer() { return mGraphicBuffer; }
+        const sp<GraphicBuffer>& graphicBuffer() const { return mGraphicBuffer; }
         const native_handle* graphicBufferHandle() {
             return mGraphicBuffer == NULL ? NULL : mGraphicBuffer->handle;
         }
@@ -345,6 +360,17 @@ private:
         Rect mCropRect;
     };
 
+    // findEglImageLocked returns the EglImage that is already around for
+    // graphicBuffer, in any slot or as the current texture image, or NULL if
+    // there is none. Buffers that come back after being detached and attached
+    // again can keep their EGLImage this way, even in another slot. Images
+    // are not kept beyond their slots, so they never keep a freed buffer
+    // alive.
+    //
+    // This method must be called with mMutex locked.
+    sp<EglImage> findEglImageLocked(const sp<GraphicBuffer>& graphicBuffer)
+            const;
+
     // freeBufferLocked frees up the given buffer slot. If the slot has been
     // initialized this will release the reference to the GraphicBuffer in that
     // slot and destroy the EGLImage in that slot.  Otherwise it has no effect.
@@ -369,6 +395,13 @@ private:
     // before the outstanding accesses have completed.
     status_t syncForReleaseLocked(EGLDisplay dpy);
 
+    // createReleaseFenceLocked returns a native fence that signals once the
+    // OpenGL ES commands issued so far have completed, or NULL on error. It
+    // is used by syncForReleaseLocked when native fence sync is available;
+    // subclasses that release several buffers with no OpenGL ES commands in
+    // between may hand out one fence for all of them.
+    virtual sp<Fence> createReleaseFenceLocked(EGLDisplay dpy);
+
     // returns a graphic buffer used when the texture image has been released
     static sp<GraphicBuffer> getDebugTexImageBuffer();
 
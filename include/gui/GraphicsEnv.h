@@ -35,10 +35,19 @@ public:
     void setDriverPath(const std::string path);
     android_namespace_t* getDriverNamespace();
 
+    // Load the system graphics drivers now rather than on the first EGL call.
+    // Meant for the zygote, so that the drivers' code and relocated data are
+    // shared by the applications it forks instead of being loaded again by
+    // each of them. The drivers must not open devices or start threads when
+    // loaded for this to be safe. Once the drivers are loaded, a driver path
+    // set afterwards has no effect.
+    bool preloadDrivers();
+
 private:
     GraphicsEnv() = default;
     std::string mDriverPath;
     android_namespace_t* mDriverNamespace = nullptr;
+    bool mDriversPreloaded = false;
 };
 
 } // namespace android
@@ -30,6 +30,7 @@
 namespace android {
 // ----------------------------------------------------------------------------
 
+class BitTube;
 class BufferItem;
 
 // ConsumerListener is the interface through which the BufferQueue notifies
@@ -85,6 +86,12 @@ public:
     // This queries the consumer for the timestamps
     virtual bool getFrameTimestamps(uint64_t /*frameNumber*/,
             FrameTimestamps* /*outTimestamps*/) const { return false; }
+
+    // See IGraphicBufferProducer::createFrameEventChannel
+    // This is not forwarded to consumers in other processes
+    virtual status_t createFrameEventChannel(sp<BitTube>* /*outChannel*/) {
+        return INVALID_OPERATION;
+    }
 };
 
 
@@ -24,6 +24,7 @@
 #include <utils/RefBase.h>
 
 #include <binder/IInterface.h>
+#include <binder/IMemory.h>
 
 namespace android {
 // ----------------------------------------------------------------------------
@@ -54,6 +55,12 @@ public:
      * if the vsync rate is > 0.
      */
     virtual void requestNextVsync() = 0;    // asynchronous
+
+    /*
+     * getVsyncMemory() returns the memory of the VsyncSnapshot the last
+     * vsync event is published in, or NULL if there is none.
+     */
+    virtual sp<IMemory> getVsyncMemory() const = 0;
 };
 
 // ----------------------------------------------------------------------------
@@ -230,6 +230,35 @@ public:
     // * INVALID_OPERATION - attempting to call this after a producer connected.
     virtual status_t setMaxAcquiredBufferCount(int maxAcquiredBuffers) = 0;
 
+    // setFrameDropPolicy tells queueBuffer which droppable frames (those
+    // queued in async mode or while dequeueBuffer cannot block) to drop before
+    // they ever get acquired:
+    //
+    // * maxQueuedFrames is the number of droppable frames that may wait at the
+    //   back of the queue. Queueing another one drops the oldest of them. The
+    //   default of 1 replaces a droppable frame with the next one; larger
+    //   values keep the last maxQueuedFrames frames, and allocate that many
+    //   extra buffers so the producer still never waits for the consumer.
+    // * expectedPresentOffset is how long after it is queued the consumer
+    //   expects a frame to be presented, or -1 (the default) to disable
+    //   timestamp based drops. Once a frame is queued whose desired present
+    //   time comes before then, all of the droppable frames queued ahead of it
+    //   are dropped, since acquireBuffer would drop them anyway. Frames with
+    //   auto-generated timestamps never cause drops.
+    //
+    // Frames already in the queue are not affected until the next one is
+    // queued.
+    //
+    // Return of a value other than NO_ERROR means an error has occurred:
+    // * NO_INIT - the buffer queue has been abandoned
+    // * BAD_VALUE - one of the below conditions occurred:
+    //             * maxQueuedFrames was less than 1, or expectedPresentOffset
+    //               was less than -1.
+    //             * the extra buffers would exceed the maxBufferCount, or
+    //               failure to adjust the number of available slots.
+    virtual status_t setFrameDropPolicy(int maxQueuedFrames,
+            nsecs_t expectedPresentOffset) = 0;
+
     // setConsumerName sets the name used in logging
     virtual void setConsumerName(const String8& name) = 0;
 
@@ -277,9 +306,24 @@ public:
     // possible without discarding data.
     virtual status_t discardFreeBuffers() = 0;
 
+    // trimFreeBuffers releases free buffers held by the queue until no more
+    // than maxAllocatedBuffers buffers, counting the ones currently dequeued,
+    // queued or acquired, remain allocated. Unlike changing the maximum buffer
+    // count this never makes the producer wait: it only costs an allocation
+    // in dequeueBuffer if the producer needs the released buffers again.
+    //
+    // Return of a value other than NO_ERROR means an error has occurred:
+    // * BAD_VALUE - maxAllocatedBuffers is negative
+    virtual status_t trimFreeBuffers(int maxAllocatedBuffers) = 0;
+
     // dump state into a string
     virtual void dumpState(String8& result, const char* prefix) const = 0;
 
+    // dumpLatency appends the BufferQueue's dequeue, queue-to-acquire and
+    // acquire-to-release latency histograms to result, one line per stage,
+    // each line starting with prefix.
+    virtual void dumpLatency(String8& result, const char* prefix) const = 0;
+
 public:
     DECLARE_META_INTERFACE(GraphicBufferConsumer);
 };
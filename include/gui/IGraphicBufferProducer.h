@@ -35,6 +35,7 @@
 namespace android {
 // ----------------------------------------------------------------------------
 
+class BitTube;
 class IProducerListener;
 class NativeHandle;
 class Surface;
@@ -389,6 +390,28 @@ public:
     virtual status_t queueBuffer(int slot, const QueueBufferInput& input,
             QueueBufferOutput* output) = 0;
 
+    // queueAndDequeueBuffer queues the buffer in slot exactly as queueBuffer
+    // does and then, in the same call, tries to dequeue the next buffer with
+    // the given parameters (see dequeueBuffer), so that a remote producer
+    // pays one round trip per frame instead of two or three.
+    //
+    // The second half never blocks. If no buffer can be dequeued right away,
+    // or the dequeue fails for any other reason, *outSlot is set to -1 and
+    // the producer should call dequeueBuffer as usual. Otherwise *outSlot,
+    // *outFence and *outDequeueResult are what dequeueBuffer would have
+    // returned, and if BUFFER_NEEDS_REALLOCATION is set in *outDequeueResult,
+    // *outBuffer holds the buffer that requestBuffer would have returned.
+    //
+    // The default implementation only queues; it never prefetches.
+    //
+    // The return value is that of queueBuffer. If it is not NO_ERROR,
+    // nothing was dequeued.
+    virtual status_t queueAndDequeueBuffer(int slot,
+            const QueueBufferInput& input, QueueBufferOutput* output,
+            uint32_t w, uint32_t h, PixelFormat format, uint32_t usage,
+            int* outSlot, sp<Fence>* outFence, sp<GraphicBuffer>* outBuffer,
+            status_t* outDequeueResult);
+
     // cancelBuffer indicates that the client does not wish to fill in the
     // buffer associated with slot and transfers ownership of the slot back to
     // the server.
@@ -588,6 +611,19 @@ public:
     virtual bool getFrameTimestamps(uint64_t /*frameNumber*/,
             FrameTimestamps* /*outTimestamps*/) const { return false; }
 
+    // Creates a channel on which the consumer sends the FrameTimestamps of
+    // each frame queued from now on, read with BitTube::recvObjects. A frame
+    // is sent once all of its times are known, or with the missing times
+    // left at 0 once the consumer stops tracking it, so a producer can pace
+    // itself from the channel's fd instead of polling getFrameTimestamps.
+    // Events that do not fit in the channel are dropped.
+    //
+    // A new channel replaces the previous one. Returns INVALID_OPERATION if
+    // the consumer does not track frame timestamps.
+    virtual status_t createFrameEventChannel(sp<BitTube>* /*outChannel*/) {
+        return INVALID_OPERATION;
+    }
+
     // Returns a unique id for this BufferQueue
     virtual status_t getUniqueId(uint64_t* outId) const = 0;
 };
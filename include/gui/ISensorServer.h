@@ -24,6 +24,9 @@
 #include <utils/RefBase.h>
 
 #include <binder/IInterface.h>
+#include <binder/IMemory.h>
+
+#include <gui/SensorListMemory.h>
 
 namespace android {
 // ----------------------------------------------------------------------------
@@ -40,9 +43,21 @@ public:
     virtual Vector<Sensor> getSensorList(const String16& opPackageName) = 0;
     virtual Vector<Sensor> getDynamicSensorList(const String16& opPackageName) = 0;
 
+    // Returns the memory of the SensorListMemory shared with every client, and in entries the
+    // sensors of getSensorList() which are in it. Returns NULL if the service does not share one,
+    // in which case getSensorList() has to be used.
+    virtual sp<IMemory> getSensorListMemory(const String16& opPackageName,
+            Vector<SensorListMemory::Entry>* entries) = 0;
+
     virtual sp<ISensorEventConnection> createSensorEventConnection(const String8& packageName,
              int mode, const String16& opPackageName) = 0;
     virtual int32_t isDataInjectionEnabled() = 0;
+
+    // Creates a connection which writes the events of its sensors to the SensorDirectChannel
+    // backed by the given ashmem fd instead of to its BitTube. Wake-up sensors cannot be enabled
+    // on such a connection.
+    virtual sp<ISensorEventConnection> createSensorDirectConnection(const String8& packageName,
+             const String16& opPackageName, int fd) = 0;
 };
 
 // ----------------------------------------------------------------------------
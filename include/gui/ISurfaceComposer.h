@@ -37,11 +37,14 @@ namespace android {
 
 class ComposerState;
 class DisplayState;
+class Fence;
+class GraphicBuffer;
 struct DisplayInfo;
 struct DisplayStatInfo;
 class HdrCapabilities;
 class IDisplayEventConnection;
 class IMemoryHeap;
+class ITransactionCompletedListener;
 class Rect;
 
 /*
@@ -105,6 +108,20 @@ public:
     virtual void setTransactionState(const Vector<ComposerState>& state,
             const Vector<DisplayState>& displays, uint32_t flags) = 0;
 
+    /* queues a transaction without waiting for it. It is applied in the
+     * first frame expected to be presented at or after desiredPresentTime
+     * (0 for the next frame), coalesced with the caller's other transactions
+     * due for the same frame; eSynchronous is ignored. listener, if any, is
+     * told with transactionId once that frame has been composed.
+     * Requires ACCESS_SURFACE_FLINGER permission
+     */
+    virtual status_t setTransactionStateAsync(
+            const Vector<ComposerState>& state,
+            const Vector<DisplayState>& displays, uint32_t flags,
+            nsecs_t desiredPresentTime,
+            const sp<ITransactionCompletedListener>& listener,
+            uint64_t transactionId) = 0;
+
     /* signal that we're done booting.
      * Requires ACCESS_SURFACE_FLINGER permission
      */
@@ -157,6 +174,29 @@ public:
             Rotation rotation = eRotateNone,
             bool isCpuConsumer = false) = 0;
 
+    /* Capture the specified screen into a buffer the caller allocated with
+     * GRALLOC_USAGE_HW_RENDER, at the buffer's size. Returns as soon as the
+     * rendering has been submitted; outFence signals once the pixels are in
+     * the buffer. requires READ_FRAME_BUFFER permission
+     * This function will fail if there is a secure window on screen.
+     */
+    virtual status_t captureScreenToBuffer(const sp<IBinder>& display,
+            const sp<GraphicBuffer>& buffer, Rect sourceCrop,
+            uint32_t minLayerZ, uint32_t maxLayerZ,
+            bool useIdentityTransform, Rotation rotation,
+            sp<Fence>* outFence) = 0;
+
+    /* Capture a single layer, identified by the handle of its surface, into
+     * a buffer as captureScreenToBuffer() does. sourceCrop is in layer stack
+     * space and defaults to the layer's bounds; only the layer is drawn, on
+     * a transparent background, scaled to the buffer's size.
+     * requires READ_FRAME_BUFFER permission
+     * This function will fail if the layer is secure.
+     */
+    virtual status_t captureLayerToBuffer(const sp<IBinder>& layerHandle,
+            const sp<GraphicBuffer>& buffer, Rect sourceCrop,
+            sp<Fence>* outFence) = 0;
+
     /* Clears the frame statistics for animations.
      *
      * Requires the ACCESS_SURFACE_FLINGER permission.
@@ -206,6 +246,9 @@ public:
         GET_DISPLAY_COLOR_MODES,
         GET_ACTIVE_COLOR_MODE,
         SET_ACTIVE_COLOR_MODE,
+        SET_TRANSACTION_STATE_ASYNC,
+        CAPTURE_SCREEN_TO_BUFFER,
+        CAPTURE_LAYER_TO_BUFFER,
     };
 
     virtual status_t onTransact(uint32_t code, const Parcel& data,
@@ -0,0 +1,58 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_GUI_ITRANSACTIONCOMPLETEDLISTENER_H
+#define ANDROID_GUI_ITRANSACTIONCOMPLETEDLISTENER_H
+
+#include <stdint.h>
+
+#include <binder/IInterface.h>
+
+#include <utils/RefBase.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+class Fence;
+
+// ITransactionCompletedListener is told by SurfaceFlinger when a transaction
+// sent with ISurfaceComposer::setTransactionStateAsync() has been applied and
+// the frame it went into has been composed.
+
+class ITransactionCompletedListener : public IInterface
+{
+public:
+    DECLARE_META_INTERFACE(TransactionCompletedListener)
+
+    // latchTime is when the transaction was applied and presentFence signals
+    // once the frame with its changes is on screen (it may be NO_FENCE when
+    // the display doesn't provide one). Transactions that were coalesced are
+    // reported one by one, in order. Asynchronous.
+    virtual void onTransactionCompleted(uint64_t transactionId,
+            nsecs_t latchTime, const sp<Fence>& presentFence) = 0;
+};
+
+class BnTransactionCompletedListener :
+        public BnInterface<ITransactionCompletedListener>
+{
+public:
+    virtual status_t onTransact(uint32_t code, const Parcel& data,
+            Parcel* reply, uint32_t flags = 0);
+};
+
+} // namespace android
+
+#endif
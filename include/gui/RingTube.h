@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_GUI_RING_TUBE_H
+#define ANDROID_GUI_RING_TUBE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/Errors.h>
+#include <utils/RefBase.h>
+#include <cutils/log.h>
+
+
+namespace android {
+// ----------------------------------------------------------------------------
+class Parcel;
+
+/*
+ * A channel for small fixed-size objects with the same interface as BitTube,
+ * built on a ring of bytes in shared memory and an eventfd instead of a
+ * socket. Objects are copied in and out of the ring without a system call.
+ * The eventfd is only written when the receiver found the ring empty and may
+ * be waiting on getFd(), so a receiver that keeps up costs no system calls.
+ *
+ * There must be one sender and one receiver, and every object sent through
+ * a tube must have the same size. The receiver has to call recvObjects()
+ * until it returns 0 before it waits on getFd() again: that call is what
+ * asks the sender for a wakeup. Unlike BitTube, objects that don't fit in
+ * the receiving buffer stay in the ring for the next recvObjects(), and a
+ * tube can't tell that the other side went away: the sender has to learn
+ * that some other way, e.g. from a binder death notification.
+ */
+class RingTube : public RefBase
+{
+public:
+
+    // creates a RingTube with a default (4KB) ring
+    RingTube();
+
+    // creates a RingTube with a ring of the specified size
+    explicit RingTube(size_t bufsize);
+
+    explicit RingTube(const Parcel& data);
+    virtual ~RingTube();
+
+    // check state after construction
+    status_t initCheck() const;
+
+    // get the file-descriptor to poll for objects; it is readable whenever
+    // there are objects to receive
+    int getFd() const;
+
+    // get the file-descriptor the sender signals the receiver with
+    int getSendFd() const;
+
+    // send objects (sized blobs). All objects are guaranteed to be written or the call fails.
+    template <typename T>
+    static ssize_t sendObjects(const sp<RingTube>& tube,
+            T const* events, size_t count) {
+        return sendObjects(tube, events, count, sizeof(T));
+    }
+
+    // receive objects (sized blobs), up to count of them.
+    template <typename T>
+    static ssize_t recvObjects(const sp<RingTube>& tube,
+            T* events, size_t count) {
+        return recvObjects(tube, events, count, sizeof(T));
+    }
+
+    // parcels the receiving side of this RingTube; the sender keeps its own
+    status_t writeToParcel(Parcel* reply) const;
+
+private:
+    struct Header;
+
+    void init(size_t bufsize);
+    // maps the header and ring of memoryFd, returns the ring's capacity or
+    // a negative error
+    ssize_t map(int memoryFd);
+
+    // The write is guaranteed to copy the whole message or fail.
+    ssize_t write(void const* vaddr, size_t size);
+
+    // Reads as many whole objects as fit in size.
+    ssize_t read(void* vaddr, size_t size, size_t objSize);
+
+    // Copies out of the ring what fits in size, returns the number of bytes.
+    ssize_t consume(void* vaddr, size_t size, size_t objSize);
+
+    int mEventFd;
+    int mMemoryFd;
+    void* mBase;
+    size_t mMappedSize;
+    Header* mHeader;
+    uint8_t* mRing;
+    size_t mCapacity;
+
+    static ssize_t sendObjects(const sp<RingTube>& tube,
+            void const* events, size_t count, size_t objSize);
+
+    static ssize_t recvObjects(const sp<RingTube>& tube,
+            void* events, size_t count, size_t objSize);
+};
+
+// ----------------------------------------------------------------------------
+}; // namespace android
+
+#endif // ANDROID_GUI_RING_TUBE_H
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_GUI_SENSOR_DIRECT_CHANNEL_H
+#define ANDROID_GUI_SENSOR_DIRECT_CHANNEL_H
+
+#include <atomic>
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/RefBase.h>
+
+#include <android/sensor.h>
+
+// ----------------------------------------------------------------------------
+namespace android {
+// ----------------------------------------------------------------------------
+
+/*
+ * A ring of sensor events in shared memory, written by SensorService and read by a single client
+ * without any system call, lock or acknowledgement. The client creates the channel and passes it
+ * to SensorManager::createDirectConnection(); events of the sensors enabled on that connection
+ * are then copied straight into the ring.
+ *
+ * The writer never waits for the reader. When the reader falls more than a ring behind, the
+ * oldest events are overwritten and read() reports how many were lost. Every slot carries the
+ * sequence number of the event it holds, which the reader checks before and after copying the
+ * event so that it never returns an event that was being overwritten.
+ */
+class SensorDirectChannel : public RefBase
+{
+public:
+    // Creates a channel with room for eventCount events.
+    static sp<SensorDirectChannel> create(size_t eventCount);
+
+    // Maps a channel received from a client for writing. Takes ownership of fd.
+    static sp<SensorDirectChannel> createFromFd(int fd);
+
+    virtual ~SensorDirectChannel();
+
+    int getFd() const { return mFd; }
+    size_t getCapacity() const { return mCapacity; }
+
+    // Appends events to the ring, overwriting the oldest ones if it is full.
+    void write(ASensorEvent const* events, size_t count);
+
+    // Copies up to count of the events written since the last read, oldest first. Returns the
+    // number of events copied. If outDroppedCount is not NULL, it is set to the number of events
+    // which were overwritten before they could be read.
+    ssize_t read(ASensorEvent* events, size_t count, size_t* outDroppedCount = NULL);
+
+private:
+    struct Header {
+        // The number of events written so far, published after the event itself.
+        std::atomic<uint64_t> writeCount;
+        uint64_t reserved;
+    };
+
+    struct Slot {
+        // One more than the number of the event in the slot, zero while it is being written.
+        std::atomic<uint64_t> sequence;
+        ASensorEvent event;
+    };
+
+    SensorDirectChannel(int fd, void* base, size_t size, size_t capacity);
+
+    static size_t getCapacityForSize(size_t size);
+
+    const int mFd;
+    void* const mBase;
+    const size_t mSize;
+    const size_t mCapacity;
+    Header* const mHeader;
+    Slot* const mSlots;
+
+    // The number of the next event to write or read.
+    uint64_t mNextEvent;
+};
+
+// ----------------------------------------------------------------------------
+}; // namespace android
+
+#endif // ANDROID_GUI_SENSOR_DIRECT_CHANNEL_H
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_GUI_SENSOR_LIST_MEMORY_H
+#define ANDROID_GUI_SENSOR_LIST_MEMORY_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <binder/IMemory.h>
+#include <utils/Errors.h>
+#include <utils/RefBase.h>
+#include <utils/Vector.h>
+
+// ----------------------------------------------------------------------------
+namespace android {
+// ----------------------------------------------------------------------------
+
+class Sensor;
+
+/*
+ * The static sensors of the device, flattened once by SensorService into memory that it shares
+ * read-only with every client. A client then only needs to be told which of them its package may
+ * see, and their IDs, to rebuild its sensor list without the sensors being parceled for it.
+ *
+ * The memory also holds a generation number which SensorService bumps whenever a dynamic sensor
+ * connects or disconnects, so that clients can keep their dynamic sensor list until it changes.
+ */
+class SensorListMemory : public RefBase
+{
+public:
+    // A sensor a client may see: its index in the shared list and the ID the client sees it with.
+    struct Entry {
+        uint32_t index;
+        int32_t id;
+    };
+
+    // Service side: flattens sensors into newly allocated shared memory.
+    static sp<SensorListMemory> create(const Vector<Sensor>& sensors);
+
+    // Client side: checks the memory handed out by SensorService, or returns NULL if it isn't a
+    // sensor list.
+    static sp<SensorListMemory> fromMemory(const sp<IMemory>& memory);
+
+    sp<IMemory> getMemory() const { return mMemory; }
+
+    size_t getCount() const { return mCount; }
+
+    // Unflattens the sensor at index into sensor.
+    status_t getSensor(size_t index, Sensor* sensor) const;
+
+    // Service side: tells clients that a dynamic sensor connected or disconnected.
+    void dynamicSensorsChanged();
+
+    uint32_t getDynamicSensorsGeneration() const;
+
+private:
+    struct Header;
+    struct Offset;
+
+    SensorListMemory(const sp<IMemory>& memory, size_t count);
+
+    sp<IMemory> mMemory;
+    Header* mHeader;
+    size_t mCount;
+};
+
+// ----------------------------------------------------------------------------
+}; // namespace android
+
+#endif // ANDROID_GUI_SENSOR_LIST_MEMORY_H
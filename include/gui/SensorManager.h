@@ -42,9 +42,12 @@ struct ASensorManager { };
 namespace android {
 // ----------------------------------------------------------------------------
 
+class ISensorEventConnection;
 class ISensorServer;
 class Sensor;
+class SensorDirectChannel;
 class SensorEventQueue;
+class SensorListMemory;
 // ----------------------------------------------------------------------------
 
 class SensorManager :
@@ -58,6 +61,9 @@ public:
     ssize_t getDynamicSensorList(Vector<Sensor>& list);
     Sensor const* getDefaultSensor(int type);
     sp<SensorEventQueue> createEventQueue(String8 packageName = String8(""), int mode = 0);
+    // Returns a connection whose enabled sensors report into channel instead of an event queue.
+    sp<ISensorEventConnection> createDirectConnection(const sp<SensorDirectChannel>& channel,
+            String8 packageName = String8(""));
     bool isDataInjectionEnabled();
 
 private:
@@ -66,6 +72,8 @@ private:
 
     SensorManager(const String16& opPackageName);
     status_t assertStateLocked();
+    // Fills mSensors from the sensor list SensorService shares, returns false if it doesn't.
+    bool readSharedSensorListLocked();
 
 private:
     static Mutex sLock;
@@ -75,6 +83,12 @@ private:
     sp<ISensorServer> mSensorServer;
     Sensor const** mSensorList;
     Vector<Sensor> mSensors;
+    // The sensor list shared by SensorService, NULL if it is fetched over binder instead.
+    sp<SensorListMemory> mSharedSensorList;
+    // The last dynamic sensor list, valid while the shared list's generation stays the same.
+    Vector<Sensor> mDynamicSensors;
+    bool mDynamicSensorsValid;
+    uint32_t mDynamicSensorsGeneration;
     sp<IBinder::DeathRecipient> mDeathObserver;
     const String16 mOpPackageName;
 };
@@ -17,9 +17,12 @@
 #ifndef ANDROID_GUI_STREAMSPLITTER_H
 #define ANDROID_GUI_STREAMSPLITTER_H
 
+#include <gui/BufferQueueDefs.h>
 #include <gui/IConsumerListener.h>
 #include <gui/IProducerListener.h>
 
+#include <ui/FenceSet.h>
+
 #include <utils/Condition.h>
 #include <utils/KeyedVector.h>
 #include <utils/Mutex.h>
@@ -37,6 +40,11 @@ class IGraphicBufferProducer;
 // BufferQueue, where each buffer queued to the input is available to be
 // acquired by each of the outputs, and is able to be dequeued by the input
 // again only once all of the outputs have released it.
+//
+// Buffers are never detached from the input: each one stays acquired in its
+// input slot while the outputs hold it and is released back to that same slot,
+// so the input producer can keep dequeueing its buffers without having to
+// request them again.
 class StreamSplitter : public BnConsumerListener {
 public:
     // createSplitter creates a new splitter, outSplitter, using inputQueue as
@@ -69,18 +77,19 @@ public:
 private:
     // From IConsumerListener
     //
-    // During this callback, we store some tracking information, detach the
-    // buffer from the input, and attach it to each of the outputs. This call
+    // During this callback, we acquire the buffer from the input, store some
+    // tracking information, and attach it to each of the outputs. This call
     // can block if there are too many outstanding buffers. If it blocks, it
     // will resume when onBufferReleasedByOutput releases a buffer back to the
     // input.
     virtual void onFrameAvailable(const BufferItem& item);
 
     // From IConsumerListener
-    // We don't care about released buffers because we detach each buffer as
-    // soon as we acquire it. See the comment for onBufferReleased below for
-    // some clarifying notes about the name.
-    virtual void onBuffersReleased() {}
+    // The input only hands us a buffer the first time its slot is acquired, so
+    // we remember the buffer of every slot, and forget it here when the slot
+    // is freed. See the comment for onBufferReleased below for some clarifying
+    // notes about the name.
+    virtual void onBuffersReleased();
 
     // From IConsumerListener
     // We don't care about sideband streams, since we won't be splitting them
@@ -92,7 +101,8 @@ private:
     //
     // During this callback, we detach the buffer from the output queue that
     // generated the callback, update our state tracking to see if this is the
-    // last output releasing the buffer, and if so, release it to the input.
+    // last output releasing the buffer, and if so, release it to its input
+    // slot.
     // If we release the buffer to the input, we allow a blocked
     // onFrameAvailable call to proceed.
     void onBufferReleasedByOutput(const sp<IGraphicBufferProducer>& from);
@@ -128,10 +138,13 @@ private:
 
     class BufferTracker : public LightRefBase<BufferTracker> {
     public:
-        BufferTracker(const sp<GraphicBuffer>& buffer);
+        BufferTracker(const sp<GraphicBuffer>& buffer, int inputSlot,
+                uint64_t frameNumber);
 
         const sp<GraphicBuffer>& getBuffer() const { return mBuffer; }
-        const sp<Fence>& getMergedFence() const { return mMergedFence; }
+        int getInputSlot() const { return mInputSlot; }
+        uint64_t getFrameNumber() const { return mFrameNumber; }
+        sp<Fence> getMergedFence() { return mReleaseFences.get(); }
 
         void mergeFence(const sp<Fence>& with);
 
@@ -149,7 +162,9 @@ private:
         BufferTracker& operator=(const BufferTracker& other);
 
         sp<GraphicBuffer> mBuffer; // One instance that holds this native handle
-        sp<Fence> mMergedFence;
+        int mInputSlot; // Where the buffer stays acquired in the input
+        uint64_t mFrameNumber; // Frame number it was acquired with
+        FenceSet mReleaseFences; // Merged once all outputs released it
         size_t mReleaseCount;
     };
 
@@ -159,6 +174,8 @@ private:
     // Must be accessed through RefBase
     virtual ~StreamSplitter();
 
+    // Every outstanding buffer stays acquired from the input, so this must not
+    // exceed the input's maximum acquired buffer count plus one.
     static const int MAX_OUTSTANDING_BUFFERS = 2;
 
     // mIsAbandoned is set to true when an output dies. Once the StreamSplitter
@@ -173,6 +190,9 @@ private:
     sp<IGraphicBufferConsumer> mInput;
     Vector<sp<IGraphicBufferProducer> > mOutputs;
 
+    // The buffer in each input slot, as last returned by acquireBuffer
+    sp<GraphicBuffer> mInputBuffers[BufferQueueDefs::NUM_BUFFER_SLOTS];
+
     // Map of GraphicBuffer IDs (GraphicBuffer::getId()) to buffer tracking
     // objects (which are mostly for counting how many outputs have released the
     // buffer, but also contain merged release fences).
@@ -122,6 +122,14 @@ public:
     // See IGraphicBufferProducer::setDequeueTimeout
     status_t setDequeueTimeout(nsecs_t timeout);
 
+    /* Makes queueBuffer also dequeue the next buffer in the same transaction
+     * when one is available without blocking (see
+     * IGraphicBufferProducer::queueAndDequeueBuffer), so that the following
+     * dequeueBuffer can return it without calling the producer at all. The
+     * prefetched buffer counts as dequeued until it is handed out. Disabled
+     * by default, and ignored in shared buffer mode. */
+    void setBufferPrefetch(bool enabled);
+
     /*
      * Wait for frame number to increase past lastFrame for at most
      * timeoutNs. Useful for one thread to wait for another unknown
@@ -129,6 +137,17 @@ public:
      */
     bool waitForNextFrame(uint64_t lastFrame, nsecs_t timeout);
 
+    /* Returns what changed in the last age - 1 frames queued by this Surface,
+     * i.e. what a buffer of that age (see NATIVE_WINDOW_BUFFER_AGE) has to
+     * repaint on top of the new frame's own damage. Region::INVALID_REGION
+     * means everything, and is what an age of 0 gets.
+     *
+     * The damage is in the coordinates it was given in: those of
+     * setSurfaceDamage (i.e. GL and Vulkan ones) or the buffer coordinates of
+     * lock's dirty bounds.
+     */
+    Region getAccumulatedDamage(uint32_t age) const;
+
     // See IGraphicBufferProducer::getLastQueuedBuffer
     // See GLConsumer::getTransformMatrix for outTransformMatrix format
     status_t getLastQueuedBuffer(sp<GraphicBuffer>* outBuffer,
@@ -140,6 +159,9 @@ public:
             nsecs_t* outGlCompositionDoneTime, nsecs_t* outDisplayRetireTime,
             nsecs_t* outReleaseTime);
 
+    // See IGraphicBufferProducer::createFrameEventChannel
+    status_t createFrameEventChannel(sp<BitTube>* outChannel);
+
     status_t getUniqueId(uint64_t* outId) const;
 
 protected:
@@ -240,10 +262,22 @@ protected:
 private:
     void freeAllBuffers();
     int getSlotFromBufferLocked(android_native_buffer_t* buffer) const;
+    // Returns a buffer dequeued by queueAndDequeueBuffer to the producer.
+    void cancelPrefetchedBufferLocked();
+    // Returns the age of the buffer with the given id, as
+    // NATIVE_WINDOW_BUFFER_AGE defines it, from mQueuedFrames.
+    uint32_t getBufferAgeLocked(uint64_t bufferId) const;
+    Region getAccumulatedDamageLocked(uint32_t age) const;
 
     struct BufferSlot {
         sp<GraphicBuffer> buffer;
-        Region dirtyRegion;
+    };
+
+    // A frame queued by this Surface. The damage is Region::INVALID_REGION
+    // when it's unknown, i.e. the whole buffer.
+    struct QueuedFrame {
+        uint64_t bufferId;
+        Region damage;
     };
 
     // mSurfaceTexture is the interface to the surface texture server. All
@@ -356,6 +390,17 @@ private:
     // (the change since the previous frame) passed in by the producer.
     Region mDirtyRegion;
 
+    // The last frames queued since connecting, oldest first, at most
+    // NUM_BUFFER_SLOTS of them. Everything that changed since a buffer was
+    // last queued is the damage of the frames that follow it, which gives
+    // both the buffer age and the region a producer has to repaint without
+    // asking the IGraphicBufferProducer.
+    Vector<QueuedFrame> mQueuedFrames;
+
+    // The id of the last buffer returned by dequeueBuffer, whose age
+    // NATIVE_WINDOW_BUFFER_AGE returns.
+    uint64_t mLastDequeuedBufferId;
+
     // Stores the current generation number. See setGenerationNumber and
     // IGraphicBufferProducer::setGenerationNumber for more information.
     uint32_t mGenerationNumber;
@@ -379,6 +424,21 @@ private:
 
     Condition mQueueBufferCondition;
 
+    // The buffer prefetched by the last queueBuffer, if any, and the request
+    // it was dequeued for. See setBufferPrefetch.
+    struct PrefetchedBuffer {
+        int slot = BufferItem::INVALID_BUFFER_SLOT;
+        sp<Fence> fence;
+        sp<GraphicBuffer> buffer;
+        status_t result = NO_ERROR;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        PixelFormat format = 0;
+        uint32_t usage = 0;
+    };
+    bool mPrefetchEnabled = false;
+    PrefetchedBuffer mPrefetched;
+
     uint64_t mNextFrameNumber;
 };
 
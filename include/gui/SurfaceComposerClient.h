@@ -26,6 +26,7 @@
 #include <utils/RefBase.h>
 #include <utils/Singleton.h>
 #include <utils/SortedVector.h>
+#include <utils/Timers.h>
 #include <utils/threads.h>
 
 #include <ui/FrameStats.h>
@@ -39,9 +40,12 @@ namespace android {
 // ---------------------------------------------------------------------------
 
 class DisplayInfo;
+class Fence;
+class GraphicBuffer;
 class Composer;
 class HdrCapabilities;
 class ISurfaceComposerClient;
+class ITransactionCompletedListener;
 class IGraphicBufferProducer;
 class Region;
 
@@ -131,6 +135,15 @@ public:
     //! Close a composer transaction on all active SurfaceComposerClients.
     static void closeGlobalTransaction(bool synchronous = false);
 
+    //! Close a composer transaction without waiting for SurfaceFlinger.
+    //! The changes are applied in the first frame expected to be presented
+    //! at or after desiredPresentTime (0 for the next frame), together with
+    //! this process's other transactions due for it, and listener, if any,
+    //! is told once that frame has been composed. Returns the id given to
+    //! the listener, or 0 if the transaction is still open or was rejected.
+    static uint64_t closeGlobalTransactionAsync(nsecs_t desiredPresentTime = 0,
+            const sp<ITransactionCompletedListener>& listener = NULL);
+
     //! Flag the currently open transaction as an animation transaction.
     static void setAnimationTransaction();
 
@@ -217,6 +230,24 @@ public:
             uint32_t minLayerZ, uint32_t maxLayerZ,
             bool useIdentityTransform);
 
+    // renders into a buffer allocated with GRALLOC_USAGE_HW_RENDER, at its
+    // size, without waiting for the GPU; the pixels are there once outFence
+    // signals
+    static status_t capture(
+            const sp<IBinder>& display,
+            const sp<GraphicBuffer>& buffer, Rect sourceCrop,
+            uint32_t minLayerZ, uint32_t maxLayerZ,
+            bool useIdentityTransform, uint32_t rotation,
+            sp<Fence>* outFence);
+
+    // renders just the layer behind layerHandle (see
+    // SurfaceControl::getHandle()), scaled into the buffer; an empty
+    // sourceCrop takes the whole layer
+    static status_t captureLayer(
+            const sp<IBinder>& layerHandle,
+            const sp<GraphicBuffer>& buffer, Rect sourceCrop,
+            sp<Fence>* outFence);
+
 private:
     mutable sp<CpuConsumer> mCpuConsumer;
     mutable sp<IGraphicBufferProducer> mProducer;
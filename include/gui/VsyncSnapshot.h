@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_GUI_VSYNC_SNAPSHOT_H
+#define ANDROID_GUI_VSYNC_SNAPSHOT_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <binder/IMemory.h>
+#include <utils/Errors.h>
+#include <utils/RefBase.h>
+
+#include <gui/DisplayEventReceiver.h>
+
+// ----------------------------------------------------------------------------
+namespace android {
+// ----------------------------------------------------------------------------
+
+/*
+ * The last vsync event an EventThread delivered, in memory it shares read-only with the
+ * DisplayEventReceivers of its connections. A receiver that is already awake can look at the
+ * current vsync without reading, or draining, its BitTube.
+ *
+ * The EventThread is the only writer. It publishes the event before writing it to the
+ * connections, with a sequence number that is odd while the event is being written, and readers
+ * retry until they copied a stable one.
+ */
+class VsyncSnapshot : public RefBase
+{
+public:
+    // EventThread side: allocates the shared memory, with nothing published.
+    static sp<VsyncSnapshot> create();
+
+    // Receiver side: maps the memory handed out by the connection, or returns NULL if it isn't
+    // a vsync snapshot.
+    static sp<VsyncSnapshot> fromMemory(const sp<IMemory>& memory);
+
+    sp<IMemory> getMemory() const { return mMemory; }
+
+    void publish(const DisplayEventReceiver::Event& vsync);
+
+    // Copies the last vsync event into vsync. Returns WOULD_BLOCK if none was published yet, or
+    // if the writer seems stuck in the middle of an update.
+    status_t read(DisplayEventReceiver::Event* vsync) const;
+
+private:
+    struct Shared;
+
+    explicit VsyncSnapshot(const sp<IMemory>& memory);
+
+    sp<IMemory> mMemory;
+    Shared* mShared;
+};
+
+// ----------------------------------------------------------------------------
+}; // namespace android
+
+#endif // ANDROID_GUI_VSYNC_SNAPSHOT_H
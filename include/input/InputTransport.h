@@ -48,6 +48,8 @@ struct InputMessage {
         TYPE_KEY = 1,
         TYPE_MOTION = 2,
         TYPE_FINISHED = 3,
+        // Tells the consumer that there are events in the shared memory ring.
+        TYPE_WAKE = 4,
     };
 
     struct Header {
@@ -133,6 +135,11 @@ struct InputMessage {
  *
  * Each endpoint has its own InputChannel object that specifies its file descriptor.
  *
+ * Optionally, the server endpoint can send its key and motion messages to the client
+ * through a ring in shared memory instead, which holds many more messages than the
+ * socket buffer. The socket then only carries wakeups for the client when the ring
+ * stops being empty, and the finished signals back to the server.
+ *
  * The input channel is closed when all references to it are released.
  */
 class InputChannel : public RefBase {
@@ -142,6 +149,12 @@ protected:
 public:
     InputChannel(const String8& name, int fd);
 
+    /* Creates the client endpoint of a channel whose events come through the shared
+     * memory ring in ringFd, as returned by getRingFd() on a client channel.
+     * Takes ownership of both file descriptors.
+     */
+    InputChannel(const String8& name, int fd, int ringFd);
+
     /* Creates a pair of input channels.
      *
      * Returns OK on success.
@@ -149,9 +162,22 @@ public:
     static status_t openInputChannelPair(const String8& name,
             sp<InputChannel>& outServerChannel, sp<InputChannel>& outClientChannel);
 
+    /* Creates a pair of input channels where the server sends its events through a
+     * shared memory ring of about ringSize bytes.
+     *
+     * Returns OK on success.
+     */
+    static status_t openInputChannelPair(const String8& name, size_t ringSize,
+            sp<InputChannel>& outServerChannel, sp<InputChannel>& outClientChannel);
+
     inline String8 getName() const { return mName; }
     inline int getFd() const { return mFd; }
 
+    /* Returns the fd of the shared memory ring, or -1 if the channel has none. It has to be
+     * passed along with getFd() when the client endpoint is sent to another process.
+     */
+    inline int getRingFd() const { return mRingFd; }
+
     /* Sends a message to the other endpoint.
      *
      * If the channel is full then the message is guaranteed not to have been sent at all.
@@ -165,6 +191,16 @@ public:
      */
     status_t sendMessage(const InputMessage* msg);
 
+    /* Sends several messages to the other endpoint, with as few system calls as possible.
+     *
+     * Messages are sent in order, and the number that were sent is returned in outCount
+     * even if sending the rest failed.
+     *
+     * Returns OK if all of the messages were sent.
+     * Otherwise returns the error sendMessage() would have for the first unsent message.
+     */
+    status_t sendMessages(const InputMessage* msgs, size_t count, size_t* outCount);
+
     /* Receives a message sent by the other endpoint.
      *
      * If there is no message present, try again after poll() indicates that the fd
@@ -177,12 +213,42 @@ public:
      */
     status_t receiveMessage(InputMessage* msg);
 
+    /* Receives as many of the messages sent by the other endpoint as there are present,
+     * up to capacity, in one system call.
+     *
+     * Returns OK on success, with the number of messages received in outCount.
+     * Otherwise returns what receiveMessage() would.
+     */
+    status_t receiveMessages(InputMessage* msgs, size_t capacity, size_t* outCount);
+
     /* Returns a new object that has a duplicate of this channel's fd. */
     sp<InputChannel> dup() const;
 
 private:
+    struct RingHeader;
+
     String8 mName;
     int mFd;
+
+    // The shared memory ring, if any, and which end of it this channel is.
+    int mRingFd;
+    RingHeader* mRing;
+    size_t mRingMapSize;
+    uint32_t mRingCapacity;
+    bool mRingWriter;
+
+    void mapRing(int ringFd, bool writer);
+
+    status_t writeRingMessage(const InputMessage* msg);
+    status_t readRingMessage(InputMessage* msg);
+    status_t receiveRingMessages(InputMessage* msgs, size_t capacity, size_t* outCount);
+    status_t receiveWakeups();
+
+    // Motion messages are sent with only the axes that each pointer has.
+    static size_t getPackedMotionMessageSize(const InputMessage* msg);
+    static size_t packMotionMessage(const InputMessage* msg, uint8_t* buffer);
+    static bool unpackMessage(const uint8_t* data, size_t size, InputMessage* msg);
+    static bool unpackMessage(InputMessage* msg, size_t size);
 };
 
 /*
@@ -330,6 +396,9 @@ public:
      * Alternately, the caller can call hasDeferredEvent() to determine whether there is
      * a deferred event waiting and then ensure that its event loop wakes up at least
      * one more time to consume the deferred event.
+     *
+     * Messages that were read from the input channel in a batch but not consumed yet
+     * count as deferred events too.
      */
     bool hasDeferredEvent() const;
 
@@ -340,16 +409,48 @@ public:
      */
     bool hasPendingBatch() const;
 
+    /* Ways of resampling touches to the frame time. */
+    enum ResampleStrategy {
+        // Interpolates to the next sample, or extrapolates from the last two.
+        RESAMPLE_LINEAR,
+        // Like RESAMPLE_LINEAR, but extrapolates from a quadratic least squares fit of
+        // the last few samples, which keeps up better with curved strokes when predicting
+        // further ahead.
+        RESAMPLE_LSQ2,
+    };
+
+    /* Sets how touches are resampled for this consumer, such as for a drawing window
+     * that trades some prediction error for latency.
+     *
+     * Touches are sampled latency before the frame time, and predicted at most
+     * maxPrediction past the last sample.  The defaults are RESAMPLE_LINEAR, 5ms and 8ms.
+     * Has no effect when resampling is disabled.
+     */
+    void setResampleStrategy(ResampleStrategy strategy, nsecs_t latency,
+            nsecs_t maxPrediction);
+
 private:
     // True if touch resampling is enabled.
     const bool mResampleTouch;
 
+    // How to resample touches when enabled, see setResampleStrategy().
+    ResampleStrategy mResampleStrategy;
+    nsecs_t mResampleLatency;
+    nsecs_t mResampleMaxPrediction;
+
     // The input channel.
     sp<InputChannel> mChannel;
 
     // The current input message.
     InputMessage mMsg;
 
+    // Messages read from the channel in one go that have yet to be handled. A few frames
+    // worth of moves can be waiting, such as when a 240Hz touch screen feeds a 60Hz display.
+    enum { RECEIVE_BATCH_SIZE = 4 };
+    InputMessage mReceivedMsgs[RECEIVE_BATCH_SIZE];
+    size_t mReceivedCount;
+    size_t mReceivedIndex;
+
     // True if mMsg contains a valid input message that was deferred from the previous
     // call to consume and that still needs to be handled.
     bool mMsgDeferred;
@@ -383,11 +484,14 @@ private:
         }
     };
     struct TouchState {
+        // Enough samples to fit a quadratic with some smoothing.
+        enum { MAX_HISTORY = 5 };
+
         int32_t deviceId;
         int32_t source;
         size_t historyCurrent;
         size_t historySize;
-        History history[2];
+        History history[MAX_HISTORY];
         History lastResample;
 
         void initialize(int32_t deviceId, int32_t source) {
@@ -400,15 +504,16 @@ private:
         }
 
         void addHistory(const InputMessage* msg) {
-            historyCurrent ^= 1;
-            if (historySize < 2) {
+            historyCurrent = (historyCurrent + 1) % MAX_HISTORY;
+            if (historySize < MAX_HISTORY) {
                 historySize += 1;
             }
             history[historyCurrent].initializeFrom(msg);
         }
 
+        // Index 0 is the most recent sample.
         const History* getHistory(size_t index) const {
-            return &history[(historyCurrent + index) & 1];
+            return &history[(historyCurrent + MAX_HISTORY - index) % MAX_HISTORY];
         }
     };
     Vector<TouchState> mTouchStates;
@@ -423,6 +528,9 @@ private:
     };
     Vector<SeqChain> mSeqChains;
 
+    // Finished signals for the messages of a batch, kept to save reallocating them.
+    Vector<InputMessage> mFinishedMsgs;
+
     status_t consumeBatch(InputEventFactoryInterface* factory,
             nsecs_t frameTime, uint32_t* outSeq, InputEvent** outEvent);
     status_t consumeSamples(InputEventFactoryInterface* factory,
@@ -432,11 +540,14 @@ private:
     void rewriteMessage(const TouchState& state, InputMessage* msg);
     void resampleTouchState(nsecs_t frameTime, MotionEvent* event,
             const InputMessage *next);
+    static void predictQuadratic(const TouchState& touchState, uint32_t id,
+            nsecs_t sampleTime, float* inOutX, float* inOutY);
 
     ssize_t findBatch(int32_t deviceId, int32_t source) const;
     ssize_t findTouchState(int32_t deviceId, int32_t source) const;
 
-    status_t sendUnchainedFinishedSignal(uint32_t seq, bool handled);
+    status_t receiveMessage(InputMessage* msg);
+    static void initializeFinishedMessage(InputMessage* msg, uint32_t seq, bool handled);
 
     static void initializeKeyEvent(KeyEvent* event, const InputMessage* msg);
     static void initializeMotionEvent(MotionEvent* event, const InputMessage* msg);
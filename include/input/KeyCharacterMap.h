@@ -146,10 +146,6 @@ protected:
 private:
     struct Behavior {
         Behavior();
-        Behavior(const Behavior& other);
-
-        /* The next behavior in the list, or NULL if none. */
-        Behavior* next;
 
         /* The meta key modifiers for this behavior. */
         int32_t metaState;
@@ -164,10 +160,9 @@ private:
         int32_t replacementKeyCode;
     };
 
-    struct Key {
-        Key();
-        Key(const Key& other);
-        ~Key();
+    /* A key as the parser, combine() and readFromParcel() build it. */
+    struct KeyDefinition {
+        KeyDefinition();
 
         /* The single character label printed on the key, or 0 if none. */
         char16_t label;
@@ -175,11 +170,34 @@ private:
         /* The number or symbol character generated by the key, or 0 if none. */
         char16_t number;
 
-        /* The list of key behaviors sorted from most specific to least specific
+        /* The key behaviors sorted from most specific to least specific
          * meta key binding. */
-        Behavior* firstBehavior;
+        Vector<Behavior> behaviors;
+    };
+
+    typedef KeyedVector<int32_t, KeyDefinition> KeyDefinitions;
+
+    /* A key in the lookup tables built from the key definitions. */
+    struct Key {
+        int32_t keyCode;
+        char16_t label;
+        char16_t number;
+
+        /* The behaviors of the key are the numBehaviors ones of mBehaviors
+         * starting at firstBehavior, in the order of KeyDefinition::behaviors. */
+        uint32_t firstBehavior;
+        uint32_t numBehaviors;
     };
 
+    /* The key chosen to type a character, and the meta state it needs. */
+    struct CharacterKey {
+        int32_t keyCode;
+        int32_t metaState;
+    };
+
+    /* Key codes below this are looked up in mKeyIndices. */
+    enum { MAX_INDEXED_KEY_CODE = 1024 };
+
     class Parser {
         enum State {
             STATE_TOP = 0,
@@ -205,6 +223,7 @@ private:
         Format mFormat;
         State mState;
         int32_t mKeyCode;
+        KeyDefinitions mKeys;
 
     public:
         Parser(KeyCharacterMap* map, Tokenizer* tokenizer, Format format);
@@ -217,14 +236,24 @@ private:
         status_t parseMapKey();
         status_t parseKey();
         status_t parseKeyProperty();
-        status_t finishKey(Key* key);
+        status_t finishKey(KeyDefinition& key);
         status_t parseModifier(const String8& token, int32_t* outMetaState);
         status_t parseCharacterLiteral(char16_t* outCharacter);
     };
 
     static sp<KeyCharacterMap> sEmpty;
 
-    KeyedVector<int32_t, Key*> mKeys;
+    /* The keys sorted by key code, and their behaviors. */
+    Vector<Key> mKeys;
+    Vector<Behavior> mBehaviors;
+
+    /* 1 + the index in mKeys of the key with a key code, or 0 if there is
+     * none; only as long as the largest key code below MAX_INDEXED_KEY_CODE. */
+    Vector<uint16_t> mKeyIndices;
+
+    /* The keys getEvents() types each character with. */
+    KeyedVector<char16_t, CharacterKey> mCharacterKeys;
+
     int mType;
 
     KeyedVector<int32_t, int32_t> mKeysByScanCode;
@@ -233,6 +262,9 @@ private:
     KeyCharacterMap();
     KeyCharacterMap(const KeyCharacterMap& other);
 
+    void setKeys(const KeyDefinitions& keys);
+    void getKeyDefinitions(KeyDefinitions* outKeys) const;
+
     bool getKey(int32_t keyCode, const Key** outKey) const;
     bool getKeyBehavior(int32_t keyCode, int32_t metaState,
             const Key** outKey, const Behavior** outBehavior) const;
@@ -90,16 +90,37 @@ public:
      * scaled / accelerated delta based on the current velocity. */
     void move(nsecs_t eventTime, float* deltaX, float* deltaY);
 
+    /* Translates a burst of raw movement deltas, oldest first, in place.
+     * Either array may be NULL.  The velocity is estimated once for the
+     * whole burst, after its newest sample, rather than once per sample. */
+    void move(const nsecs_t* eventTimes, float* deltaX, float* deltaY, size_t count);
+
 private:
     // If no movements are received within this amount of time,
     // we assume the movement has stopped and reset the movement counters.
     static const nsecs_t STOP_TIME = 500 * 1000000; // 500 ms
 
+    // The velocity estimate is reused for the movements within this amount
+    // of time of it, so that high rate devices don't pay for an estimate
+    // with every sample.
+    static const nsecs_t ESTIMATE_INTERVAL = 4 * 1000000; // 4 ms
+
+    // Adds a raw movement to the velocity tracker.
+    void addMovement(nsecs_t eventTime, float deltaX, float deltaY);
+
+    // Gets the scale to apply to the movements up to the last one added.
+    float getScale();
+
     VelocityControlParameters mParameters;
 
     nsecs_t mLastMovementTime;
     VelocityTracker::Position mRawPosition;
     VelocityTracker mVelocityTracker;
+
+    // The time of the movement the cached scale was estimated at, or
+    // LLONG_MIN if there is none.
+    nsecs_t mLastEstimateTime;
+    float mScale;
 };
 
 } // namespace android
@@ -191,6 +191,63 @@ private:
 };
 
 
+/*
+ * Velocity tracker algorithm with the same unweighted least-squares fit as
+ * LeastSquaresVelocityTrackerStrategy, but keeping running sums of the samples of each
+ * pointer so that getting an estimate does not go over the history again.
+ */
+class IncrementalLeastSquaresVelocityTrackerStrategy : public VelocityTrackerStrategy {
+public:
+    // Degree must be 1 or 2.
+    IncrementalLeastSquaresVelocityTrackerStrategy(uint32_t degree);
+    virtual ~IncrementalLeastSquaresVelocityTrackerStrategy();
+
+    virtual void clear();
+    virtual void clearPointers(BitSet32 idBits);
+    virtual void addMovement(nsecs_t eventTime, BitSet32 idBits,
+            const VelocityTracker::Position* positions);
+    virtual bool getEstimator(uint32_t id, VelocityTracker::Estimator* outEstimator) const;
+
+private:
+    // Same sample horizon and history as LeastSquaresVelocityTrackerStrategy.
+    static const nsecs_t HORIZON = 100 * 1000000; // 100 ms
+    static const uint32_t HISTORY_SIZE = 20;
+
+    static const uint32_t MAX_DEGREE = 2;
+
+    struct Sample {
+        nsecs_t eventTime;
+        VelocityTracker::Position position;
+    };
+
+    // The samples of a pointer within the horizon, and the sums of the normal equations
+    // over them with time in seconds since timeBase.  Doubles since samples are also
+    // subtracted from the sums again; the sums are recomputed when timeBase gets old.
+    struct State {
+        uint32_t first;
+        uint32_t count;
+        nsecs_t timeBase;
+        Sample samples[HISTORY_SIZE];
+        double t[2 * MAX_DEGREE + 1]; // sum of t^k
+        double xt[MAX_DEGREE + 1]; // sum of x t^k
+        double yt[MAX_DEGREE + 1]; // sum of y t^k
+        double xx, yy;
+    };
+
+    const uint32_t mDegree;
+    BitSet32 mPointerIdBits;
+    State mPointerState[MAX_POINTER_ID + 1];
+
+    void initState(State& state, nsecs_t eventTime) const;
+    void addSample(State& state, nsecs_t eventTime,
+            const VelocityTracker::Position& position) const;
+    static void resetSums(State& state, nsecs_t timeBase);
+    static void accumulate(State& state, const Sample& sample, double sign);
+    static bool solve(const State& state, uint32_t degree,
+            VelocityTracker::Estimator* outEstimator);
+};
+
+
 /*
  * Velocity tracker algorithm that uses an IIR filter.
  */
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_PRIVATE_BINDER_TRANSACTION_BUFFERS_H
+#define ANDROID_PRIVATE_BINDER_TRANSACTION_BUFFERS_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+// The size of the mapping ProcessState opens the driver with; every
+// transaction buffer this process receives is carved out of it.
+#define BINDER_VM_SIZE ((1*1024*1024) - (4096 *2))
+
+namespace android {
+
+class String8;
+
+// Accounting of the transaction buffers the driver handed to this process
+// that haven't been given back with BC_FREE_BUFFER yet.  Incoming
+// transactions and replies share the mapping, so a service holding on to
+// parcels it received starves its own later transactions and replies.
+//
+// A warning is logged when the outstanding bytes go past three quarters of
+// the mapping; it is logged again only after they have dropped below half.
+// The totals cost a few atomic operations per buffer. Which call sites
+// hold the buffers, for the warning and dump(), is only kept track of when
+// debug.binder.buffer_sites is set when the process starts, as that takes
+// a process-wide lock for every buffer.
+class TransactionBuffers
+{
+public:
+    // A buffer that came with an incoming transaction, or with the reply to
+    // a transaction this process made on 'handle'.
+    static void             received(const uint8_t* data, size_t size,
+                                     bool incoming, int32_t handle, uint32_t code);
+    // The buffer at 'data', of the size it was received with, is being
+    // freed.
+    static void             freed(const uint8_t* data, size_t size);
+
+    static size_t           outstandingBytes();
+
+    // The totals, and the outstanding buffers grouped by call site, largest
+    // first, if those are kept track of.
+    static void             dump(String8& result);
+};
+
+}; // namespace android
+
+#endif // ANDROID_PRIVATE_BINDER_TRANSACTION_BUFFERS_H
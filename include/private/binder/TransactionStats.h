@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_PRIVATE_BINDER_TRANSACTION_STATS_H
+#define ANDROID_PRIVATE_BINDER_TRANSACTION_STATS_H
+
+#include <atomic>
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/String16.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+class String8;
+
+// Latency histograms for the binder transactions made and served by one
+// thread, keyed by interface descriptor, transaction code and direction.
+//
+// Only the owning thread ever writes to a table, so recording takes no
+// locks; the counters are atomics so that dump() can read every thread's
+// table while it is being updated.
+class TransactionStats
+{
+public:
+    static bool             isEnabled() {
+        return sEnabled.load(std::memory_order_relaxed);
+    }
+    static void             setEnabled(bool enabled);
+
+    // Allocates and registers a table for the calling thread.
+    static TransactionStats* create();
+    // Folds a thread's table into the process totals and frees it.
+    static void             retire(TransactionStats* stats);
+
+    // 'data' is the transaction payload; the descriptor is taken from its
+    // interface token when it has one.
+    void                    record(bool incoming, uint32_t code,
+                                   const uint8_t* data, size_t dataSize,
+                                   size_t objectCount,
+                                   nsecs_t wallTime, nsecs_t cpuTime);
+
+    // Finds the interface descriptor in a payload that starts with an
+    // interface token; the string points into 'data'.
+    static bool             peekDescriptor(const uint8_t* data, size_t dataSize,
+                                           const char16_t** outStr, size_t* outLen);
+
+    // Process-wide totals, merged across all threads.
+    static void             dump(String8& result);
+    // Emits the count and p50/p99 wall time of each key as atrace counters.
+    static void             trace(uint64_t tag);
+
+    // Latency buckets are powers of two in microseconds.
+    static const size_t     NUM_BUCKETS = 24;
+    static const size_t     NUM_ENTRIES = 64;
+
+    struct Entry {
+        std::atomic<uint64_t>   key;        // 0 when the slot is unused
+        String16                descriptor; // immutable once key is set
+        uint32_t                code;
+        bool                    incoming;
+        std::atomic<uint64_t>   count;
+        std::atomic<uint64_t>   wallTime;
+        std::atomic<uint64_t>   cpuTime;
+        std::atomic<uint64_t>   bytes;
+        std::atomic<uint64_t>   objects;
+        std::atomic<uint64_t>   buckets[NUM_BUCKETS];
+    };
+
+private:
+                            TransactionStats();
+                            ~TransactionStats();
+                            TransactionStats(const TransactionStats&);
+    TransactionStats&       operator=(const TransactionStats&);
+
+    Entry*                  findOrInsert(uint64_t key, bool incoming, uint32_t code,
+                                         const char16_t* descriptor, size_t len);
+    // Calls visit() on every slot of every table; caller holds the stats
+    // lock.  Returns the number of live thread tables.
+    static size_t           collectLocked(void (*visit)(const Entry& e, void* cookie),
+                                          void* cookie, uint64_t* outOverflow);
+
+    static std::atomic<bool> sEnabled;
+
+    Entry                   mEntries[NUM_ENTRIES];
+    // Transactions dropped because every slot was already taken.
+    std::atomic<uint64_t>   mOverflow;
+};
+
+}; // namespace android
+
+#endif // ANDROID_PRIVATE_BINDER_TRANSACTION_STATS_H
@@ -78,6 +78,10 @@ struct layer_state_t {
     status_t    write(Parcel& output) const;
     status_t    read(const Parcel& input);
 
+    // Folds in the changes of a later state of the same surface, as if the
+    // two had been applied one after the other.
+    void        merge(const layer_state_t& other);
+
             struct matrix22_t {
                 float   dsdx;
                 float   dtdx;
@@ -148,6 +152,8 @@ struct DisplayState {
     uint32_t width, height;
     status_t write(Parcel& output) const;
     status_t read(const Parcel& input);
+    // as layer_state_t::merge()
+    void merge(const DisplayState& other);
 };
 
 }; // namespace android
@@ -28,6 +28,7 @@
 #include <utils/Timers.h>
 
 #include <experimental/optional>
+#include <vector>
 
 struct ANativeWindowBuffer;
 
@@ -87,6 +88,16 @@ public:
     static sp<Fence> merge(const String8& name, const sp<Fence>& f1,
             const sp<Fence>& f2);
 
+    // merge combines any number of Fence objects into one which becomes
+    // signaled when all of them are signaled. Unlike the two-fence merge,
+    // fences which already signaled are left out rather than merged, so the
+    // result is NO_FENCE when all of them signaled and the only pending fence
+    // itself when there is a single one. It must not be used to get the
+    // signal time of the fences then. Merging N pending fences takes N - 1
+    // sync_merge calls, but only the fd of the result is left open.
+    static sp<Fence> merge(const char* name,
+            const std::vector<sp<Fence>>& fences);
+
     // Return a duplicate of the fence file descriptor. The caller is
     // responsible for closing the returned file descriptor. On error, -1 will
     // be returned and errno will indicate the problem.
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_FENCE_SET_H
+#define ANDROID_FENCE_SET_H
+
+#include <ui/Fence.h>
+#include <utils/String8.h>
+
+#include <vector>
+
+namespace android {
+
+// ===========================================================================
+// FenceSet
+// ===========================================================================
+
+// A FenceSet collects fences which all have to be signaled, e.g. the release
+// fences of a buffer sent to several consumers, without merging them one by
+// one as they come. The fences are only merged when get() is called, which
+// is when a single fence is needed to send it over binder or to the HWC, and
+// the fences which signaled by then are left out of the merge.
+//
+// A FenceSet is not thread-safe.
+class FenceSet {
+public:
+    // The name is the one given to the merged fence.
+    explicit FenceSet(const char* name);
+
+    // Adds a fence to the set. Invalid fences, such as NO_FENCE, are ignored.
+    void add(const sp<Fence>& fence);
+
+    // Returns whether the set holds no fence, which is also the case once
+    // get() found all of them signaled.
+    bool isEmpty() const { return mFences.empty(); }
+
+    // Returns a fence that becomes signaled when all of the fences in the set
+    // are signaled. This is NO_FENCE when all of them already are, see
+    // Fence::merge. The result is kept until another fence is added.
+    sp<Fence> get();
+
+    // Waits for up to timeout milliseconds for all of the fences to signal,
+    // without merging them. Returns NO_ERROR if they did, -ETIME if the
+    // timeout expired or the error of the failing wait.
+    status_t wait(int timeout);
+
+    // Removes all of the fences.
+    void clear();
+
+private:
+    // Above this many fences, the signaled ones are dropped on add() so that
+    // a set which is never merged doesn't keep their fds open.
+    static constexpr size_t MAX_UNMERGED_FENCES = 16;
+
+    void dropSignaledFences();
+
+    String8 mName;
+    std::vector<sp<Fence>> mFences;
+};
+
+}; // namespace android
+
+#endif // ANDROID_FENCE_SET_H
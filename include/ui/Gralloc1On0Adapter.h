@@ -22,6 +22,7 @@
 
 #include <hardware/gralloc1.h>
 
+#include <atomic>
 #include <mutex>
 #include <string>
 #include <unordered_map>
@@ -480,12 +481,44 @@ private:
             gralloc1_buffer_descriptor_t descriptorId);
     std::shared_ptr<Buffer> getBuffer(buffer_handle_t bufferHandle);
 
+    // Descriptors and buffers are spread over shards, each with its own lock,
+    // so that threads locking different buffers don't wait for each other.
+    // A buffer's reference count is only changed under its shard's lock.
+    static constexpr size_t NUM_SHARDS = 8;
+
+    struct DescriptorShard {
+        std::mutex mutex;
+        std::unordered_map<gralloc1_buffer_descriptor_t,
+                std::shared_ptr<Descriptor>> descriptors;
+    };
+    struct BufferShard {
+        std::mutex mutex;
+        std::unordered_map<buffer_handle_t, std::shared_ptr<Buffer>> buffers;
+    };
+
+    DescriptorShard& getDescriptorShard(
+            gralloc1_buffer_descriptor_t descriptorId) {
+        return mDescriptorShards[descriptorId % NUM_SHARDS];
+    }
+    BufferShard& getBufferShard(buffer_handle_t bufferHandle) {
+        // handles are heap pointers, their low bits are always the same
+        auto bits = reinterpret_cast<uintptr_t>(bufferHandle);
+        return mBufferShards[(bits >> 4) % NUM_SHARDS];
+    }
+
+    // The last few buffers getBuffer() found on this thread, and the value
+    // of sBufferGeneration they were found with
+    struct BufferCache;
+    static thread_local BufferCache sBufferCache;
+
+    // Makes every thread's last getBuffer() result stale, called whenever a
+    // buffer is removed since its handle may be reused for another one
+    static void invalidateBufferCaches();
+
     static std::atomic<gralloc1_buffer_descriptor_t> sNextBufferDescriptorId;
-    std::mutex mDescriptorMutex;
-    std::unordered_map<gralloc1_buffer_descriptor_t,
-            std::shared_ptr<Descriptor>> mDescriptors;
-    std::mutex mBufferMutex;
-    std::unordered_map<buffer_handle_t, std::shared_ptr<Buffer>> mBuffers;
+    static std::atomic<uint64_t> sBufferGeneration;
+    DescriptorShard mDescriptorShards[NUM_SHARDS];
+    BufferShard mBufferShards[NUM_SHARDS];
 };
 
 } // namespace android
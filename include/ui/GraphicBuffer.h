@@ -164,6 +164,14 @@ private:
 
     void free_handle();
 
+    // Looks for a live buffer this process already imported that has the
+    // given id and the very same handle, so that it can be shared instead of
+    // importing the handle again.
+    static sp<GraphicBuffer> findImported(uint64_t id, int const* fds,
+            size_t numFds, int const* ints, size_t numInts);
+    void addImported();
+    void removeImported();
+
     GraphicBufferMapper& mBufferMapper;
     ssize_t mInitCheck;
 
@@ -177,6 +185,9 @@ private:
     // match the BufferQueue's internal generation number (set through
     // IGBP::setGenerationNumber), attempts to attach the buffer will fail.
     uint32_t mGenerationNumber;
+
+    // Whether findImported() can return this buffer
+    bool mImported;
 };
 
 }; // namespace android
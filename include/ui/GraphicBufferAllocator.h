@@ -19,6 +19,7 @@
 #define ANDROID_BUFFER_ALLOCATOR_H
 
 #include <stdint.h>
+#include <sys/types.h>
 
 #include <cutils/native_handle.h>
 
@@ -26,6 +27,8 @@
 #include <utils/KeyedVector.h>
 #include <utils/threads.h>
 #include <utils/Singleton.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
 
 #include <ui/Gralloc1.h>
 #include <ui/PixelFormat.h>
@@ -65,6 +68,31 @@ public:
 
     status_t free(buffer_handle_t handle);
 
+    // Buffers freed by this process can be kept in a recycle pool and handed
+    // back by allocate() for an identical request (size, format and usage)
+    // from the same uid, which skips gralloc entirely. Keying on the uid the
+    // buffer was allocated for keeps one client's old buffer contents from
+    // reaching another, and protected buffers are never pooled. A recycled
+    // buffer takes the new graphicBufferId, though gralloc keeps reporting
+    // the backing store it was first allocated with. Pooled
+    // buffers left unclaimed for a few seconds are released by the next
+    // allocate() or free(), and the oldest go first once the pool would
+    // exceed its limit. A limit of 0 disables recycling; the default comes
+    // from ro.ui.buffer_pool_kb and is 0 when that is unset.
+    void setPoolLimit(size_t bytes);
+    // Releases pooled buffers until at most maxBytes remain, e.g. when the
+    // process is asked to trim its memory.
+    void trimPool(size_t maxBytes = 0);
+
+    // The buffers allocated for a process: the binder caller of allocate(),
+    // or this process when it allocates for itself. Buffers of unknown size
+    // are counted but add nothing to size.
+    struct process_usage_t {
+        size_t count;
+        size_t size;
+    };
+    void getProcessUsage(KeyedVector<pid_t, process_usage_t>* outUsage) const;
+
     void dump(String8& res) const;
     static void dumpToSystemLog();
 
@@ -77,10 +105,34 @@ private:
         uint32_t usage;
         size_t size;
         std::string requestorName;
+        uint64_t graphicBufferId;
+        pid_t pid;
+        uid_t uid;
     };
 
+    static void getProcessUsageLocked(KeyedVector<pid_t, process_usage_t>* outUsage);
+
+    struct pool_rec_t {
+        buffer_handle_t handle;
+        alloc_rec_t rec;
+        nsecs_t freedAt;
+    };
+
+    // Takes pooled buffers out of the pool, oldest first, until it holds at
+    // most maxBytes and none older than the maximum age. Their handles are
+    // appended to outRelease, to be released once sLock has been dropped.
+    static void trimPoolLocked(size_t maxBytes,
+            Vector<buffer_handle_t>* outRelease);
+    void release(const Vector<buffer_handle_t>& handles);
+
     static Mutex sLock;
     static KeyedVector<buffer_handle_t, alloc_rec_t> sAllocList;
+    // Ordered from the least to the most recently freed
+    static Vector<pool_rec_t> sPool;
+    static size_t sPoolBytes;
+    static size_t sPoolLimit;
+    static uint64_t sPoolHits;
+    static uint64_t sPoolMisses;
 
     friend class Singleton<GraphicBufferAllocator>;
     GraphicBufferAllocator();
@@ -38,17 +38,21 @@ public:
 
                         Region();
                         Region(const Region& rhs);
+                        Region(Region&& rhs);
     explicit            Region(const Rect& rhs);
                         ~Region();
 
     static  Region      createTJunctionFreeRegion(const Region& r);
 
         Region& operator = (const Region& rhs);
+        Region& operator = (Region&& rhs);
 
     inline  bool        isEmpty() const     { return getBounds().isEmpty(); }
-    inline  bool        isRect() const      { return mStorage.size() == 1; }
+    inline  bool        isRect() const      { return mStorage.isEmpty(); }
 
-    inline  Rect        getBounds() const   { return mStorage[mStorage.size() - 1]; }
+    inline  Rect        getBounds() const {
+        return mStorage.isEmpty() ? mRect : mStorage[mStorage.size() - 1];
+    }
     inline  Rect        bounds() const      { return getBounds(); }
 
             bool        contains(const Point& point) const;
@@ -154,6 +158,10 @@ private:
     const Region operation(const Region& rhs, int op) const;
     const Region operation(const Region& rhs, int dx, int dy, int op) const;
 
+    static bool trivial_operation(int op, Region& dst,
+            const Region& lhs, const Region* rhs, const Rect& rhsBounds,
+            bool rhsIsRect, int dx, int dy);
+
     static void boolean_operation(int op, Region& dst,
             const Region& lhs, const Region& rhs, int dx, int dy);
     static void boolean_operation(int op, Region& dst,
@@ -170,10 +178,16 @@ private:
     static bool validate(const Region& reg,
             const char* name, bool silent = false);
 
-    // mStorage is a (manually) sorted array of Rects describing the region
-    // with an extra Rect as the last element which is set to the
-    // bounds of the region. However, if the region is
-    // a simple Rect then mStorage contains only that rect.
+    // makes the region the single rect r, dropping any rect list
+    void setRect(const Rect& r);
+
+    // A region that is a simple Rect, which is by far the most common kind,
+    // is held in mRect and leaves mStorage empty, so that it can be built,
+    // copied and moved without touching the heap.
+    // Otherwise mStorage is a (manually) sorted array of Rects describing
+    // the region with an extra Rect as the last element which is set to the
+    // bounds of the region, and mRect is unused.
+    Rect mRect;
     Vector<Rect> mStorage;
 };
 
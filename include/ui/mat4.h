@@ -23,6 +23,14 @@
 #include <ui/vec4.h>
 #include <utils/String8.h>
 
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define UI_MAT4_NEON
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#define UI_MAT4_SSE
+#endif
+
 #define TMAT_IMPLEMENTATION
 #include <ui/TMatHelpers.h>
 
@@ -77,8 +85,8 @@ private:
 
 public:
     // array access
-    inline col_type const& operator [] (size_t i) const { return mValue[i]; }
-    inline col_type&       operator [] (size_t i)       { return mValue[i]; }
+    constexpr col_type const& operator [] (size_t i) const { return mValue[i]; }
+    inline    col_type&       operator [] (size_t i)       { return mValue[i]; }
 
     T const* asArray() const { return &mValue[0][0]; }
 
@@ -88,29 +96,34 @@ public:
 
     /*
      *  constructors
+     *
+     *  all of them but the NO_INIT and C array ones are constexpr, so that
+     *  constant matrices (e.g.: static constexpr mat4 kFlipY(vec4(1,-1,1,1));)
+     *  don't need to be computed at runtime.
      */
 
     // leaves object uninitialized. use with caution.
     explicit tmat44(no_init) { }
 
     // initialize to identity
-    tmat44();
+    constexpr tmat44();
 
     // initialize to Identity*scalar.
     template<typename U>
-    explicit tmat44(U v);
+    explicit constexpr tmat44(U v);
 
     // sets the diagonal to the passed vector
     template <typename U>
-    explicit tmat44(const tvec4<U>& rhs);
+    explicit constexpr tmat44(const tvec4<U>& rhs);
 
     // construct from another matrix of the same size
     template <typename U>
-    explicit tmat44(const tmat44<U>& rhs);
+    explicit constexpr tmat44(const tmat44<U>& rhs);
 
     // construct from 4 column vectors
     template <typename A, typename B, typename C, typename D>
-    tmat44(const tvec4<A>& v0, const tvec4<B>& v1, const tvec4<C>& v2, const tvec4<D>& v3);
+    constexpr tmat44(const tvec4<A>& v0, const tvec4<B>& v1,
+            const tvec4<C>& v2, const tvec4<D>& v3);
 
     // construct from 16 scalars
     template <
@@ -118,10 +131,10 @@ public:
         typename E, typename F, typename G, typename H,
         typename I, typename J, typename K, typename L,
         typename M, typename N, typename O, typename P>
-    tmat44( A m00, B m01, C m02, D m03,
-            E m10, F m11, G m12, H m13,
-            I m20, J m21, K m22, L m23,
-            M m30, N m31, O m32, P m33);
+    constexpr tmat44( A m00, B m01, C m02, D m03,
+                      E m10, F m11, G m12, H m13,
+                      I m20, J m21, K m22, L m23,
+                      M m30, N m31, O m32, P m33);
 
     // construct from a C array
     template <typename U>
@@ -158,29 +171,29 @@ public:
  */
 
 template <typename T>
-tmat44<T>::tmat44() {
-    mValue[0] = col_type(1,0,0,0);
-    mValue[1] = col_type(0,1,0,0);
-    mValue[2] = col_type(0,0,1,0);
-    mValue[3] = col_type(0,0,0,1);
+constexpr tmat44<T>::tmat44()
+    : mValue{ col_type(1,0,0,0),
+              col_type(0,1,0,0),
+              col_type(0,0,1,0),
+              col_type(0,0,0,1) } {
 }
 
 template <typename T>
 template <typename U>
-tmat44<T>::tmat44(U v) {
-    mValue[0] = col_type(v,0,0,0);
-    mValue[1] = col_type(0,v,0,0);
-    mValue[2] = col_type(0,0,v,0);
-    mValue[3] = col_type(0,0,0,v);
+constexpr tmat44<T>::tmat44(U v)
+    : mValue{ col_type(v,0,0,0),
+              col_type(0,v,0,0),
+              col_type(0,0,v,0),
+              col_type(0,0,0,v) } {
 }
 
 template<typename T>
 template<typename U>
-tmat44<T>::tmat44(const tvec4<U>& v) {
-    mValue[0] = col_type(v.x,0,0,0);
-    mValue[1] = col_type(0,v.y,0,0);
-    mValue[2] = col_type(0,0,v.z,0);
-    mValue[3] = col_type(0,0,0,v.w);
+constexpr tmat44<T>::tmat44(const tvec4<U>& v)
+    : mValue{ col_type(v.x,0,0,0),
+              col_type(0,v.y,0,0),
+              col_type(0,0,v.z,0),
+              col_type(0,0,0,v.w) } {
 }
 
 // construct from 16 scalars
@@ -190,30 +203,33 @@ template <
     typename E, typename F, typename G, typename H,
     typename I, typename J, typename K, typename L,
     typename M, typename N, typename O, typename P>
-tmat44<T>::tmat44(  A m00, B m01, C m02, D m03,
-                    E m10, F m11, G m12, H m13,
-                    I m20, J m21, K m22, L m23,
-                    M m30, N m31, O m32, P m33) {
-    mValue[0] = col_type(m00, m01, m02, m03);
-    mValue[1] = col_type(m10, m11, m12, m13);
-    mValue[2] = col_type(m20, m21, m22, m23);
-    mValue[3] = col_type(m30, m31, m32, m33);
+constexpr tmat44<T>::tmat44(    A m00, B m01, C m02, D m03,
+                                E m10, F m11, G m12, H m13,
+                                I m20, J m21, K m22, L m23,
+                                M m30, N m31, O m32, P m33)
+    : mValue{ col_type(m00, m01, m02, m03),
+              col_type(m10, m11, m12, m13),
+              col_type(m20, m21, m22, m23),
+              col_type(m30, m31, m32, m33) } {
 }
 
 template <typename T>
 template <typename U>
-tmat44<T>::tmat44(const tmat44<U>& rhs) {
-    for (size_t r=0 ; r<row_size() ; r++)
-        mValue[r] = rhs[r];
+constexpr tmat44<T>::tmat44(const tmat44<U>& rhs)
+    : mValue{ col_type(rhs[0]),
+              col_type(rhs[1]),
+              col_type(rhs[2]),
+              col_type(rhs[3]) } {
 }
 
 template <typename T>
 template <typename A, typename B, typename C, typename D>
-tmat44<T>::tmat44(const tvec4<A>& v0, const tvec4<B>& v1, const tvec4<C>& v2, const tvec4<D>& v3) {
-    mValue[0] = v0;
-    mValue[1] = v1;
-    mValue[2] = v2;
-    mValue[3] = v3;
+constexpr tmat44<T>::tmat44(const tvec4<A>& v0, const tvec4<B>& v1,
+        const tvec4<C>& v2, const tvec4<D>& v3)
+    : mValue{ col_type(v0),
+              col_type(v1),
+              col_type(v2),
+              col_type(v3) } {
 }
 
 template <typename T>
@@ -373,6 +389,124 @@ tmat44<T> PURE operator *(U rv, const tmat44<T>& lv) {
     return result;
 }
 
+// ----------------------------------------------------------------------------------------
+// 4x4 float kernels
+// ----------------------------------------------------------------------------------------
+
+/*
+ * mat4 is what SurfaceFlinger uses for all its projections and color transforms,
+ * so the generic loops of TMatHelpers.h are specialized here for tmat44<float>:
+ * products and transpose use NEON or SSE when available, and the inverse is
+ * computed from the cofactors instead of with a Gauss-Jordan elimination.
+ *
+ * matrices are only guaranteed to be aligned on a float, so all loads and
+ * stores are unaligned.
+ */
+
+// matrix * vector. matrix::multiply() is built on this one, so it also handles
+// matrix * matrix.
+inline tvec4<float> PURE operator *(const tmat44<float>& lv, const tvec4<float>& rv) {
+#if defined(UI_MAT4_NEON)
+    float32x4_t r = vmulq_n_f32(vld1q_f32(&lv[0][0]), rv.x);
+    r = vmlaq_n_f32(r, vld1q_f32(&lv[1][0]), rv.y);
+    r = vmlaq_n_f32(r, vld1q_f32(&lv[2][0]), rv.z);
+    r = vmlaq_n_f32(r, vld1q_f32(&lv[3][0]), rv.w);
+    tvec4<float> result(tvec4<float>::NO_INIT);
+    vst1q_f32(&result[0], r);
+    return result;
+#elif defined(UI_MAT4_SSE)
+    __m128 r = _mm_mul_ps(_mm_loadu_ps(&lv[0][0]), _mm_set1_ps(rv.x));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(&lv[1][0]), _mm_set1_ps(rv.y)));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(&lv[2][0]), _mm_set1_ps(rv.z)));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(&lv[3][0]), _mm_set1_ps(rv.w)));
+    tvec4<float> result(tvec4<float>::NO_INIT);
+    _mm_storeu_ps(&result[0], r);
+    return result;
+#else
+    return lv[0]*rv.x + lv[1]*rv.y + lv[2]*rv.z + lv[3]*rv.w;
+#endif
+}
+
+namespace matrix {
+
+template<>
+inline tmat44<float> PURE transpose<tmat44<float> >(const tmat44<float>& m) {
+    tmat44<float> result(tmat44<float>::NO_INIT);
+#if defined(UI_MAT4_NEON)
+    // vld4q de-interleaves the 16 floats, which is exactly a transpose
+    float32x4x4_t t = vld4q_f32(&m[0][0]);
+    vst1q_f32(&result[0][0], t.val[0]);
+    vst1q_f32(&result[1][0], t.val[1]);
+    vst1q_f32(&result[2][0], t.val[2]);
+    vst1q_f32(&result[3][0], t.val[3]);
+#elif defined(UI_MAT4_SSE)
+    __m128 c0 = _mm_loadu_ps(&m[0][0]);
+    __m128 c1 = _mm_loadu_ps(&m[1][0]);
+    __m128 c2 = _mm_loadu_ps(&m[2][0]);
+    __m128 c3 = _mm_loadu_ps(&m[3][0]);
+    __m128 t0 = _mm_unpacklo_ps(c0, c1);    // 00 10 01 11
+    __m128 t1 = _mm_unpacklo_ps(c2, c3);    // 20 30 21 31
+    __m128 t2 = _mm_unpackhi_ps(c0, c1);    // 02 12 03 13
+    __m128 t3 = _mm_unpackhi_ps(c2, c3);    // 22 32 23 33
+    _mm_storeu_ps(&result[0][0], _mm_movelh_ps(t0, t1));
+    _mm_storeu_ps(&result[1][0], _mm_movehl_ps(t1, t0));
+    _mm_storeu_ps(&result[2][0], _mm_movelh_ps(t2, t3));
+    _mm_storeu_ps(&result[3][0], _mm_movehl_ps(t3, t2));
+#else
+    result[0] = tvec4<float>(m[0][0], m[1][0], m[2][0], m[3][0]);
+    result[1] = tvec4<float>(m[0][1], m[1][1], m[2][1], m[3][1]);
+    result[2] = tvec4<float>(m[0][2], m[1][2], m[2][2], m[3][2]);
+    result[3] = tvec4<float>(m[0][3], m[1][3], m[2][3], m[3][3]);
+#endif
+    return result;
+}
+
+// Laplace expansion of the determinant using the 2x2 sub-determinants of the
+// first two and last two columns. A singular matrix yields inf/nan entries, as
+// it does with the generic version.
+template<>
+inline tmat44<float> PURE inverse<tmat44<float> >(const tmat44<float>& m) {
+    const float s0 = m[0][0] * m[1][1] - m[1][0] * m[0][1];
+    const float s1 = m[0][0] * m[1][2] - m[1][0] * m[0][2];
+    const float s2 = m[0][0] * m[1][3] - m[1][0] * m[0][3];
+    const float s3 = m[0][1] * m[1][2] - m[1][1] * m[0][2];
+    const float s4 = m[0][1] * m[1][3] - m[1][1] * m[0][3];
+    const float s5 = m[0][2] * m[1][3] - m[1][2] * m[0][3];
+
+    const float c5 = m[2][2] * m[3][3] - m[3][2] * m[2][3];
+    const float c4 = m[2][1] * m[3][3] - m[3][1] * m[2][3];
+    const float c3 = m[2][1] * m[3][2] - m[3][1] * m[2][2];
+    const float c2 = m[2][0] * m[3][3] - m[3][0] * m[2][3];
+    const float c1 = m[2][0] * m[3][2] - m[3][0] * m[2][2];
+    const float c0 = m[2][0] * m[3][1] - m[3][0] * m[2][1];
+
+    const float det = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+    const float t = 1 / det;
+
+    return tmat44<float>(
+        ( m[1][1] * c5 - m[1][2] * c4 + m[1][3] * c3) * t,
+        (-m[0][1] * c5 + m[0][2] * c4 - m[0][3] * c3) * t,
+        ( m[3][1] * s5 - m[3][2] * s4 + m[3][3] * s3) * t,
+        (-m[2][1] * s5 + m[2][2] * s4 - m[2][3] * s3) * t,
+
+        (-m[1][0] * c5 + m[1][2] * c2 - m[1][3] * c1) * t,
+        ( m[0][0] * c5 - m[0][2] * c2 + m[0][3] * c1) * t,
+        (-m[3][0] * s5 + m[3][2] * s2 - m[3][3] * s1) * t,
+        ( m[2][0] * s5 - m[2][2] * s2 + m[2][3] * s1) * t,
+
+        ( m[1][0] * c4 - m[1][1] * c2 + m[1][3] * c0) * t,
+        (-m[0][0] * c4 + m[0][1] * c2 - m[0][3] * c0) * t,
+        ( m[3][0] * s4 - m[3][1] * s2 + m[3][3] * s0) * t,
+        (-m[2][0] * s4 + m[2][1] * s2 - m[2][3] * s0) * t,
+
+        (-m[1][0] * c3 + m[1][1] * c1 - m[1][2] * c0) * t,
+        ( m[0][0] * c3 - m[0][1] * c1 + m[0][2] * c0) * t,
+        (-m[3][0] * s3 + m[3][1] * s1 - m[3][2] * s0) * t,
+        ( m[2][0] * s3 - m[2][1] * s1 + m[2][2] * s0) * t);
+}
+
+}; // namespace matrix
+
 // ----------------------------------------------------------------------------------------
 
 /* FIXME: this should go into TMatSquareFunctions<> but for some reason
@@ -391,5 +525,7 @@ typedef tmat44<float> mat4;
 }; // namespace android
 
 #undef PURE
+#undef UI_MAT4_NEON
+#undef UI_MAT4_SSE
 
 #endif /* UI_MAT4_H */
@@ -63,17 +63,17 @@ public:
     explicit tvec2(no_init) { }
 
     // default constructor
-    tvec2() : x(0), y(0) { }
+    constexpr tvec2() : x(0), y(0) { }
 
     // handles implicit conversion to a tvec4. must not be explicit.
     template<typename A>
-    tvec2(A v) : x(v), y(v) { }
+    constexpr tvec2(A v) : x(v), y(v) { }
 
     template<typename A, typename B>
-    tvec2(A x, B y) : x(x), y(y) { }
+    constexpr tvec2(A x, B y) : x(x), y(y) { }
 
     template<typename A>
-    explicit tvec2(const tvec2<A>& v) : x(v.x), y(v.y) { }
+    explicit constexpr tvec2(const tvec2<A>& v) : x(v.x), y(v.y) { }
 
     template<typename A>
     tvec2(const Impersonator< tvec2<A> >& v)
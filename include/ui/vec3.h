@@ -64,20 +64,20 @@ public:
     explicit tvec3(no_init) { }
 
     // default constructor
-    tvec3() : x(0), y(0), z(0) { }
+    constexpr tvec3() : x(0), y(0), z(0) { }
 
     // handles implicit conversion to a tvec4. must not be explicit.
     template<typename A>
-    tvec3(A v) : x(v), y(v), z(v) { }
+    constexpr tvec3(A v) : x(v), y(v), z(v) { }
 
     template<typename A, typename B, typename C>
-    tvec3(A x, B y, C z) : x(x), y(y), z(z) { }
+    constexpr tvec3(A x, B y, C z) : x(x), y(y), z(z) { }
 
     template<typename A, typename B>
-    tvec3(const tvec2<A>& v, B z) : x(v.x), y(v.y), z(z) { }
+    constexpr tvec3(const tvec2<A>& v, B z) : x(v.x), y(v.y), z(z) { }
 
     template<typename A>
-    explicit tvec3(const tvec3<A>& v) : x(v.x), y(v.y), z(v.z) { }
+    explicit constexpr tvec3(const tvec3<A>& v) : x(v.x), y(v.y), z(v.z) { }
 
     template<typename A>
     tvec3(const Impersonator< tvec3<A> >& v)
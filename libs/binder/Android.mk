@@ -41,6 +41,8 @@ sources := \
     Static.cpp \
     Status.cpp \
     TextOutput.cpp \
+    TransactionBuffers.cpp \
+    TransactionStats.cpp \
 
 ifeq ($(BOARD_NEEDS_MEMORYHEAPION),true)
 sources += \
@@ -20,12 +20,216 @@
 
 #include <utils/SystemClock.h>
 
+#include <map>
+#include <set>
+#include <thread>
+
 namespace android {
 
 static String16 _appops("appops");
 static pthread_mutex_t gTokenMutex = PTHREAD_MUTEX_INITIALIZER;
 static sp<IBinder> gToken;
 
+namespace {
+
+struct OpKey {
+    int32_t op;
+    int32_t uid;
+    String16 package;
+
+    bool operator<(const OpKey& k) const {
+        if (op != k.op) return op < k.op;
+        if (uid != k.uid) return uid < k.uid;
+        return package < k.package;
+    }
+};
+
+// The modes checkOp() and noteOp() got from the app ops service, kept for
+// as long as the service reports the changes to them. A mode is only kept
+// once the service watches its op and package for us, and not when a
+// change was reported while it was being fetched.
+class ModeCache : public BnAppOpsCallback, public IBinder::DeathRecipient {
+public:
+    ModeCache() : mGeneration(0) {}
+
+    bool get(const OpKey& key, int32_t* mode) {
+        Mutex::Autolock _l(mLock);
+        auto it = mModes.find(key);
+        if (it == mModes.end()) {
+            return false;
+        }
+        *mode = it->second;
+        return true;
+    }
+
+    // Makes sure service reports the changes to the op of key. Returns
+    // false when it won't, and otherwise the generation to put() with.
+    bool watch(const sp<IAppOpsService>& service, const OpKey& key,
+            uint32_t* outGeneration) {
+        const sp<IBinder> binder(IInterface::asBinder(service));
+        const std::pair<int32_t, String16> opPackage(key.op, key.package);
+        uint32_t generation;
+        {
+            Mutex::Autolock _l(mLock);
+            if (binder != mService) {
+                if (mService != NULL && mService->remoteBinder() != NULL) {
+                    mService->unlinkToDeath(this);
+                }
+                forgetLocked();
+                mWatched.clear();
+                // a service in this process can't die without us
+                mService = binder->remoteBinder() == NULL ||
+                        binder->linkToDeath(this) == NO_ERROR ? binder : NULL;
+            }
+            if (mService == NULL) {
+                return false;
+            }
+            generation = mGeneration;
+            if (mWatched.count(opPackage)) {
+                *outGeneration = generation;
+                return true;
+            }
+            if (mWatched.size() >= MAX_WATCHES) {
+                return false;
+            }
+        }
+
+        // not under the lock, the service may be calling opChanged()
+        service->startWatchingMode(key.op, key.package, this);
+
+        Mutex::Autolock _l(mLock);
+        if (mService != binder) {
+            return false;
+        }
+        mWatched.insert(opPackage);
+        *outGeneration = generation;
+        return true;
+    }
+
+    void put(const OpKey& key, int32_t mode, uint32_t generation) {
+        Mutex::Autolock _l(mLock);
+        if (generation == mGeneration) {
+            mModes[key] = mode;
+        }
+    }
+
+    virtual void opChanged(int32_t op, const String16& packageName) {
+        // without a package the change is to the op as a whole, such as a
+        // user restriction or a uid's mode
+        const bool allPackages = packageName.size() == 0;
+        Mutex::Autolock _l(mLock);
+        mGeneration++;
+        for (auto it = mModes.begin(); it != mModes.end(); ) {
+            if (it->first.op == op &&
+                    (allPackages || it->first.package == packageName)) {
+                it = mModes.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    virtual void binderDied(const wp<IBinder>& /*who*/) {
+        // the watches died with the service
+        Mutex::Autolock _l(mLock);
+        forgetLocked();
+        mWatched.clear();
+        mService = NULL;
+    }
+
+private:
+    // every watch is a callback the service keeps for the life of the
+    // process, past this many ops are not cached
+    enum { MAX_WATCHES = 256 };
+
+    void forgetLocked() {
+        mModes.clear();
+        mGeneration++;
+    }
+
+    Mutex mLock;
+    // the service watching for us, and whose death we listen for
+    sp<IBinder> mService;
+    std::set<std::pair<int32_t, String16>> mWatched;
+    std::map<OpKey, int32_t> mModes;
+    uint32_t mGeneration;
+};
+
+// Notes the ops of noteOpAsync() from a thread of its own, a batch every
+// BATCH_DELAY, with an op noted more than once in a batch noted once.
+class OpNoter {
+public:
+    OpNoter() : mStarted(false) {}
+
+    void note(const sp<IAppOpsService>& service, const OpKey& key) {
+        Mutex::Autolock _l(mLock);
+        mService = service;
+        mPending.insert(key);
+        if (!mStarted) {
+            mStarted = true;
+            std::thread(&OpNoter::threadMain, this).detach();
+        }
+        mCondition.signal();
+    }
+
+private:
+    static const nsecs_t BATCH_DELAY = 100000000; // 100ms
+
+    void threadMain() {
+        Mutex::Autolock _l(mLock);
+        for (;;) {
+            while (mPending.empty()) {
+                mCondition.wait(mLock);
+            }
+            mLock.unlock();
+            usleep(ns2us(BATCH_DELAY));
+            mLock.lock();
+
+            std::set<OpKey> batch;
+            batch.swap(mPending);
+            sp<IAppOpsService> service(mService);
+            mLock.unlock();
+            for (const OpKey& key : batch) {
+                service->noteOperation(key.op, key.uid, key.package);
+            }
+            mLock.lock();
+        }
+    }
+
+    Mutex mLock;
+    Condition mCondition;
+    bool mStarted;
+    sp<IAppOpsService> mService;
+    std::set<OpKey> mPending;
+};
+
+} // namespace
+
+static pthread_mutex_t gCacheMutex = PTHREAD_MUTEX_INITIALIZER;
+static sp<ModeCache> gModeCache;
+// never freed, its thread runs until the process exits
+static OpNoter* gOpNoter;
+
+static sp<ModeCache> getModeCache() {
+    pthread_mutex_lock(&gCacheMutex);
+    if (gModeCache == NULL) {
+        gModeCache = new ModeCache();
+    }
+    sp<ModeCache> cache(gModeCache);
+    pthread_mutex_unlock(&gCacheMutex);
+    return cache;
+}
+
+static OpNoter* getOpNoter() {
+    pthread_mutex_lock(&gCacheMutex);
+    if (gOpNoter == NULL) {
+        gOpNoter = new OpNoter();
+    }
+    OpNoter* noter = gOpNoter;
+    pthread_mutex_unlock(&gCacheMutex);
+    return noter;
+}
+
 static const sp<IBinder>& getToken(const sp<IAppOpsService>& service) {
     pthread_mutex_lock(&gTokenMutex);
     if (gToken == NULL || gToken->pingBinder() != NO_ERROR) {
@@ -39,6 +243,11 @@ AppOpsManager::AppOpsManager()
 {
 }
 
+AppOpsManager::AppOpsManager(const sp<IAppOpsService>& service)
+    : mService(service)
+{
+}
+
 sp<IAppOpsService> AppOpsManager::getService()
 {
     int64_t startTime = 0;
@@ -67,13 +276,52 @@ sp<IAppOpsService> AppOpsManager::getService()
 
 int32_t AppOpsManager::checkOp(int32_t op, int32_t uid, const String16& callingPackage)
 {
+    const OpKey key = { op, uid, callingPackage };
+    sp<ModeCache> cache(getModeCache());
+    int32_t mode;
+    if (cache->get(key, &mode)) {
+        return mode;
+    }
     sp<IAppOpsService> service = getService();
-    return service != NULL ? service->checkOperation(op, uid, callingPackage) : MODE_IGNORED;
+    if (service == NULL) {
+        return MODE_IGNORED;
+    }
+    uint32_t generation;
+    const bool watched = cache->watch(service, key, &generation);
+    mode = service->checkOperation(op, uid, callingPackage);
+    if (watched) {
+        cache->put(key, mode, generation);
+    }
+    return mode;
 }
 
 int32_t AppOpsManager::noteOp(int32_t op, int32_t uid, const String16& callingPackage) {
     sp<IAppOpsService> service = getService();
-    return service != NULL ? service->noteOperation(op, uid, callingPackage) : MODE_IGNORED;
+    if (service == NULL) {
+        return MODE_IGNORED;
+    }
+    const OpKey key = { op, uid, callingPackage };
+    sp<ModeCache> cache(getModeCache());
+    uint32_t generation;
+    const bool watched = cache->watch(service, key, &generation);
+    const int32_t mode = service->noteOperation(op, uid, callingPackage);
+    if (watched) {
+        cache->put(key, mode, generation);
+    }
+    return mode;
+}
+
+int32_t AppOpsManager::noteOpAsync(int32_t op, int32_t uid, const String16& callingPackage) {
+    const OpKey key = { op, uid, callingPackage };
+    int32_t mode;
+    if (!getModeCache()->get(key, &mode)) {
+        return noteOp(op, uid, callingPackage);
+    }
+    sp<IAppOpsService> service = getService();
+    if (service != NULL) {
+        getOpNoter()->note(service, key);
+    }
+    return mode;
 }
 
 int32_t AppOpsManager::startOp(int32_t op, int32_t uid, const String16& callingPackage) {
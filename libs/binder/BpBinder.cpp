@@ -21,7 +21,9 @@
 
 #include <binder/IPCThreadState.h>
 #include <binder/IResultReceiver.h>
+#include <utils/Condition.h>
 #include <utils/Log.h>
+#include <utils/Thread.h>
 
 #include <stdio.h>
 
@@ -87,6 +89,72 @@ void BpBinder::ObjectManager::kill()
 
 // ---------------------------------------------------------------------------
 
+// Delivers obituaries for recipients linked with DEATH_FLAG_ASYNC, so the
+// binder thread that received BR_DEAD_BINDER can go straight back to the
+// driver.  One batch holds every async recipient of one dead proxy.
+class ObituaryWorker : public Thread
+{
+public:
+    struct Batch {
+        wp<IBinder> who;
+        Vector<wp<IBinder::DeathRecipient> > recipients;
+    };
+
+    static void post(const Batch& batch)
+    {
+        sp<ObituaryWorker> worker;
+        {
+            AutoMutex _l(sLock);
+            if (sWorker == NULL) {
+                sWorker = new ObituaryWorker();
+                sWorker->run("binder:obituaries");
+            }
+            worker = sWorker;
+        }
+        AutoMutex _l(worker->mLock);
+        worker->mQueue.add(batch);
+        worker->mCondition.signal();
+    }
+
+private:
+    ObituaryWorker() : Thread(false) { }
+
+    virtual bool threadLoop()
+    {
+        Vector<Batch> batches;
+        {
+            AutoMutex _l(mLock);
+            while (mQueue.isEmpty()) {
+                mCondition.wait(mLock);
+            }
+            batches = mQueue;
+            mQueue.clear();
+        }
+        for (size_t i = 0; i < batches.size(); i++) {
+            const Batch& batch = batches[i];
+            for (size_t j = 0; j < batch.recipients.size(); j++) {
+                sp<IBinder::DeathRecipient> recipient = batch.recipients[j].promote();
+                if (recipient != NULL) {
+                    recipient->binderDied(batch.who);
+                }
+            }
+        }
+        return true;
+    }
+
+    Mutex mLock;
+    Condition mCondition;
+    Vector<Batch> mQueue;
+
+    static Mutex sLock;
+    static sp<ObituaryWorker> sWorker;
+};
+
+Mutex ObituaryWorker::sLock;
+sp<ObituaryWorker> ObituaryWorker::sWorker;
+
+// ---------------------------------------------------------------------------
+
 BpBinder::BpBinder(int32_t handle)
     : mHandle(handle)
     , mAlive(1)
@@ -252,9 +320,9 @@ void BpBinder::sendObituary()
     Vector<Obituary>* obits = mObituaries;
     if(obits != NULL) {
         ALOGV("Clearing sent death notification: %p handle %d\n", this, mHandle);
-        IPCThreadState* self = IPCThreadState::self();
-        self->clearDeathNotification(mHandle, this);
-        self->flushCommands();
+        // No flush: this goes out with the BC_DEAD_BINDER_DONE that the
+        // caller queues next, instead of costing an ioctl per proxy.
+        IPCThreadState::self()->clearDeathNotification(mHandle, this);
         mObituaries = NULL;
     }
     mObitsSent = 1;
@@ -264,9 +332,19 @@ void BpBinder::sendObituary()
         this, obits ? obits->size() : 0U);
 
     if (obits != NULL) {
+        ObituaryWorker::Batch async;
         const size_t N = obits->size();
         for (size_t i=0; i<N; i++) {
-            reportOneDeath(obits->itemAt(i));
+            const Obituary& obit = obits->itemAt(i);
+            if (obit.flags & DEATH_FLAG_ASYNC) {
+                async.recipients.add(obit.recipient);
+            } else {
+                reportOneDeath(obit);
+            }
+        }
+        if (!async.recipients.isEmpty()) {
+            async.who = this;
+            ObituaryWorker::post(async);
         }
 
         delete obits;
@@ -32,6 +32,10 @@
 
 namespace android {
 
+// Buffers are kept at up to this size between lines, so that long runs of
+// output don't reallocate for every line.
+static const size_t kMaxRetainedBufferSize = 4096;
+
 struct BufferedTextOutput::BufferState : public RefBase
 {
     BufferState(int32_t _seq)
@@ -64,14 +68,24 @@ struct BufferedTextOutput::BufferState : public RefBase
     void restart() {
         bufferPos = 0;
         atFront = true;
-        if (bufferSize > 256) {
-            void* b = realloc(buffer, 256);
+        if (bufferSize > kMaxRetainedBufferSize) {
+            void* b = realloc(buffer, kMaxRetainedBufferSize);
             if (b) {
                 buffer = (char*)b;
-                bufferSize = 256;
+                bufferSize = kMaxRetainedBufferSize;
             }
         }
     }
+
+    // Drops the first 'len' bytes, which have been written.
+    void consume(size_t len) {
+        if (len == bufferPos) {
+            restart();
+            return;
+        }
+        memmove(buffer, buffer+len, bufferPos-len);
+        bufferPos -= len;
+    }
     
     const int32_t seq;
     char* buffer;
@@ -87,6 +101,31 @@ struct BufferedTextOutput::ThreadState
     Vector<sp<BufferedTextOutput::BufferState> > states;
 };
 
+// The state of the calling thread; only the state shared by all threads,
+// when there is no per-thread one, needs the lock.
+class BufferedTextOutput::BufferLock
+{
+public:
+    explicit BufferLock(BufferedTextOutput* out)
+        : mOut(out)
+        , mState(out->getBuffer()) {
+        if (mState == NULL) {
+            mOut->mLock.lock();
+            mState = mOut->mGlobalState;
+        }
+    }
+    ~BufferLock() {
+        if (mState == mOut->mGlobalState) {
+            mOut->mLock.unlock();
+        }
+    }
+    BufferState* operator->() const { return mState; }
+
+private:
+    BufferedTextOutput* const mOut;
+    BufferState* mState;
+};
+
 static mutex_t          gMutex;
 
 static thread_store_t   tls;
@@ -159,13 +198,16 @@ status_t BufferedTextOutput::print(const char* txt, size_t len)
 {
     //printf("BufferedTextOutput: printing %d\n", len);
     
-    AutoMutex _l(mLock);
-    BufferState* b = getBuffer();
+    BufferLock b(this);
     
     const char* const end = txt+len;
     
     status_t err;
 
+    // The complete lines this call adds to the buffer are written out all
+    // at once, when it returns or along with the fast path.
+    size_t complete = 0;
+
     while (txt < end) {
         // Find the next line.
         const char* first = txt;
@@ -188,15 +230,24 @@ status_t BufferedTextOutput::print(const char* txt, size_t len)
                 // them out without going through the buffer.
                 
                 // Slurp up all of the lines.
-                const char* lastLine = txt+1;
+                const char* lastLine = txt;
                 while (txt < end) {
                     if (*txt++ == '\n') lastLine = txt;
                 }
-                struct iovec vec;
-                vec.iov_base = (void*)first;
-                vec.iov_len = lastLine-first;
+                struct iovec vec[2];
+                size_t N = 0;
+                if (complete > 0) {
+                    vec[N].iov_base = b->buffer;
+                    vec[N].iov_len = complete;
+                    N++;
+                }
+                vec[N].iov_base = (void*)first;
+                vec[N].iov_len = lastLine-first;
+                N++;
                 //printf("Writing %d bytes of data!\n", vec.iov_len);
-                writeLines(vec, 1);
+                writeLines(vec[0], N);
+                b->consume(complete);
+                complete = 0;
                 txt = lastLine;
                 continue;
             }
@@ -206,18 +257,18 @@ status_t BufferedTextOutput::print(const char* txt, size_t len)
         err = b->append(first, txt-first);
         if (err != NO_ERROR) return err;
         b->atFront = *(txt-1) == '\n';
-        
-        // If we have finished a line and are not bundling, write
-        // it out.
-        //printf("Buffer is now %d bytes\n", b->bufferPos);
-        if (b->atFront && !b->bundle) {
-            struct iovec vec;
-            vec.iov_base = b->buffer;
-            vec.iov_len = b->bufferPos;
-            //printf("Writing %d bytes of data!\n", vec.iov_len);
-            writeLines(vec, 1);
-            b->restart();
-        }
+        if (b->atFront) complete = b->bufferPos;
+    }
+    
+    // If we have finished lines and are not bundling, write them out.
+    //printf("Buffer is now %d bytes\n", b->bufferPos);
+    if (complete > 0 && !b->bundle) {
+        struct iovec vec;
+        vec.iov_base = b->buffer;
+        vec.iov_len = complete;
+        //printf("Writing %d bytes of data!\n", vec.iov_len);
+        writeLines(vec, 1);
+        b->consume(complete);
     }
     
     return NO_ERROR;
@@ -225,23 +276,20 @@ status_t BufferedTextOutput::print(const char* txt, size_t len)
 
 void BufferedTextOutput::moveIndent(int delta)
 {
-    AutoMutex _l(mLock);
-    BufferState* b = getBuffer();
+    BufferLock b(this);
     b->indent += delta;
     if (b->indent < 0) b->indent = 0;
 }
 
 void BufferedTextOutput::pushBundle()
 {
-    AutoMutex _l(mLock);
-    BufferState* b = getBuffer();
+    BufferLock b(this);
     b->bundle++;
 }
 
 void BufferedTextOutput::popBundle()
 {
-    AutoMutex _l(mLock);
-    BufferState* b = getBuffer();
+    BufferLock b(this);
     b->bundle--;
     LOG_FATAL_IF(b->bundle < 0,
         "TextOutput::popBundle() called more times than pushBundle()");
@@ -270,13 +318,13 @@ BufferedTextOutput::BufferState* BufferedTextOutput::getBuffer() const
             BufferState* bs = ts->states[mIndex].get();
             if (bs != NULL && bs->seq == mSeq) return bs;
             
-            ts->states.editItemAt(mIndex) = new BufferState(mIndex);
+            ts->states.editItemAt(mIndex) = new BufferState(mSeq);
             bs = ts->states[mIndex].get();
             if (bs != NULL) return bs;
         }
     }
     
-    return mGlobalState;
+    return NULL;
 }
 
 }; // namespace android
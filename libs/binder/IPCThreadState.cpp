@@ -29,9 +29,14 @@
 
 #include <private/binder/binder_module.h>
 #include <private/binder/Static.h>
+#include <private/binder/TransactionBuffers.h>
+#include <private/binder/TransactionStats.h>
+
+#include <atomic>
 
 #include <errno.h>
 #include <inttypes.h>
+#include <poll.h>
 #include <pthread.h>
 #include <sched.h>
 #include <signal.h>
@@ -280,6 +285,25 @@ static pthread_key_t gTLS = 0;
 static bool gShutdown = false;
 static bool gDisableBackgroundScheduling = false;
 
+// Upper bound on queued one-way transactions before we submit on our own.
+static const size_t kMaxOneWayBatch = 32;
+
+static std::atomic<uint64_t> gDriverIoctlCount(0);
+static std::atomic<uint64_t> gDriverTransactionCount(0);
+
+// What a transaction buffer takes of the mapping; the driver keeps the data
+// and the offsets array each pointer aligned.
+static size_t bufferBytes(size_t dataSize, size_t offsetsSize)
+{
+    const size_t align = sizeof(void*) - 1;
+    return ((dataSize + align) & ~align) + ((offsetsSize + align) & ~align);
+}
+
+static size_t bufferBytes(const binder_transaction_data& tr)
+{
+    return bufferBytes(tr.data_size, tr.offsets_size);
+}
+
 IPCThreadState* IPCThreadState::self()
 {
     if (gHaveTLS) {
@@ -402,6 +426,51 @@ void IPCThreadState::clearCaller()
     mCallingUid = getuid();
 }
 
+void IPCThreadState::getDriverStats(uint64_t* outIoctls, uint64_t* outTransactions)
+{
+    if (outIoctls) *outIoctls = gDriverIoctlCount.load(std::memory_order_relaxed);
+    if (outTransactions) {
+        *outTransactions = gDriverTransactionCount.load(std::memory_order_relaxed);
+    }
+}
+
+void IPCThreadState::setTransactionStatsEnabled(bool enabled)
+{
+    TransactionStats::setEnabled(enabled);
+}
+
+void IPCThreadState::dumpTransactionStats(String8& result)
+{
+    TransactionStats::dump(result);
+}
+
+size_t IPCThreadState::getOutstandingBufferBytes()
+{
+    return TransactionBuffers::outstandingBytes();
+}
+
+void IPCThreadState::dumpOutstandingBuffers(String8& result)
+{
+    TransactionBuffers::dump(result);
+}
+
+void IPCThreadState::traceTransactionStats(uint64_t tag)
+{
+    TransactionStats::trace(tag);
+}
+
+void IPCThreadState::recordTransaction(bool incoming, uint32_t code, const Parcel& data,
+        nsecs_t wallStart, nsecs_t cpuStart)
+{
+    if (mTransactionStats == NULL) {
+        mTransactionStats = TransactionStats::create();
+    }
+    mTransactionStats->record(incoming, code, data.data(), data.dataSize(),
+            data.objectsCount(),
+            systemTime(SYSTEM_TIME_MONOTONIC) - wallStart,
+            systemTime(SYSTEM_TIME_THREAD) - cpuStart);
+}
+
 void IPCThreadState::flushCommands()
 {
     if (mProcess->mDriverFD <= 0)
@@ -456,6 +525,22 @@ status_t IPCThreadState::getAndExecuteCommand()
                       mProcess->mMaxThreads, starvationTimeMs);
             }
             mProcess->mStarvationStartTimeMs = 0;
+            mProcess->mStarvationCount++;
+            mProcess->mTotalStarvationMs += starvationTimeMs;
+            if (starvationTimeMs > mProcess->mMaxStarvationMs) {
+                mProcess->mMaxStarvationMs = starvationTimeMs;
+            }
+            if (mProcess->mMaxThreads < mProcess->mAdaptiveMaxThreads &&
+                    starvationTimeMs >= mProcess->mGrowAfterMs) {
+                // Sustained queueing: let the driver spawn one more looper.
+                mProcess->mMaxThreads++;
+                if (mProcess->updateDriverMaxThreadsLocked() != NO_ERROR) {
+                    mProcess->mMaxThreads--;
+                } else {
+                    LOG_THREADPOOL("binder thread pool grown to %zu threads\n",
+                            mProcess->mMaxThreads);
+                }
+            }
         }
         pthread_cond_broadcast(&mProcess->mThreadCountDecrement);
         pthread_mutex_unlock(&mProcess->mThreadCountLock);
@@ -494,9 +579,20 @@ void IPCThreadState::joinThreadPool(bool isMain)
 
     mOut.writeInt32(isMain ? BC_ENTER_LOOPER : BC_REGISTER_LOOPER);
 
+    pthread_mutex_lock(&mProcess->mThreadCountLock);
+    mProcess->mPoolThreadCount++;
+    pthread_mutex_unlock(&mProcess->mThreadCountLock);
+
     status_t result;
     do {
         processPendingDerefs();
+
+        // Under the adaptive policy, spawned loopers go away when idle.
+        if (!isMain && idleTimedOut()) {
+            result = TIMED_OUT;
+            break;
+        }
+
         // now get the next command to be processed, waiting if necessary
         result = getAndExecuteCommand();
 
@@ -516,10 +612,52 @@ void IPCThreadState::joinThreadPool(bool isMain)
     LOG_THREADPOOL("**** THREAD %p (PID %d) IS LEAVING THE THREAD POOL err=%p\n",
         (void*)pthread_self(), getpid(), (void*)result);
     
+    pthread_mutex_lock(&mProcess->mThreadCountLock);
+    mProcess->mPoolThreadCount--;
+    pthread_mutex_unlock(&mProcess->mThreadCountLock);
+
     mOut.writeInt32(BC_EXIT_LOOPER);
     talkWithDriver(false);
 }
 
+bool IPCThreadState::idleTimedOut()
+{
+    pthread_mutex_lock(&mProcess->mThreadCountLock);
+    const int64_t timeoutMs = mProcess->mIdleTimeoutMs;
+    pthread_mutex_unlock(&mProcess->mThreadCountLock);
+
+    if (timeoutMs <= 0 || mIn.dataPosition() < mIn.dataSize()) {
+        return false;
+    }
+
+    // Get our pending commands (including loop registration) to the driver
+    // before waiting on it.
+    if (mOut.dataSize() > 0) {
+        talkWithDriver(false);
+    }
+
+    struct pollfd pfd;
+    pfd.fd = mProcess->mDriverFD;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    const int timeout = timeoutMs > INT32_MAX ? INT32_MAX : (int)timeoutMs;
+    if (TEMP_FAILURE_RETRY(poll(&pfd, 1, timeout)) != 0) {
+        return false;
+    }
+
+    pthread_mutex_lock(&mProcess->mThreadCountLock);
+    mProcess->mRetiredThreadCount++;
+    if (mProcess->updateDriverMaxThreadsLocked() != NO_ERROR) {
+        mProcess->mRetiredThreadCount--;
+        pthread_mutex_unlock(&mProcess->mThreadCountLock);
+        return false;
+    }
+    pthread_mutex_unlock(&mProcess->mThreadCountLock);
+    LOG_THREADPOOL("**** THREAD %p (PID %d) RETIRING AFTER %" PRId64 " ms IDLE\n",
+        (void*)pthread_self(), getpid(), timeoutMs);
+    return true;
+}
+
 int IPCThreadState::setupPolling(int* fd)
 {
     if (mProcess->mDriverFD <= 0) {
@@ -562,6 +700,10 @@ status_t IPCThreadState::transact(int32_t handle,
 
     flags |= TF_ACCEPT_FDS;
 
+    const bool recordStats = TransactionStats::isEnabled();
+    const nsecs_t wallStart = recordStats ? systemTime(SYSTEM_TIME_MONOTONIC) : 0;
+    const nsecs_t cpuStart = recordStats ? systemTime(SYSTEM_TIME_THREAD) : 0;
+
     IF_LOG_TRANSACTIONS() {
         TextOutput::Bundle _b(alog);
         alog << "BC_TRANSACTION thr " << (void*)pthread_self() << " / hand "
@@ -570,6 +712,14 @@ status_t IPCThreadState::transact(int32_t handle,
     }
 
     if (err == NO_ERROR) {
+        if ((flags & TF_ONE_WAY) != 0 && mOneWayBatchDepth > 0) {
+            LOG_ONEWAY(">>>> QUEUE from pid %d uid %d ONE WAY", getpid(), getuid());
+            return (mLastError = queueOneWayTransaction(handle, code, data, flags));
+        }
+        if (!mOneWayBatch.isEmpty()) {
+            // Anything already queued must reach the driver ahead of us.
+            flushOneWayBatch();
+        }
         LOG_ONEWAY(">>>> SEND from pid %d uid %d %s", getpid(), getuid(),
             (flags & TF_ONE_WAY) == 0 ? "READ REPLY" : "ONE WAY");
         err = writeTransactionData(BC_TRANSACTION, flags, handle, code, data, NULL);
@@ -588,12 +738,20 @@ status_t IPCThreadState::transact(int32_t handle,
             ALOGI(">>>>>> CALLING transaction %d", code);
         }
         #endif
+        // Saved for the accounting of the reply buffer; the transactions
+        // served while waiting make their own.
+        const int32_t origReplyHandle = mReplyHandle;
+        const uint32_t origReplyCode = mReplyCode;
+        mReplyHandle = handle;
+        mReplyCode = code;
         if (reply) {
             err = waitForResponse(reply);
         } else {
             Parcel fakeReply;
             err = waitForResponse(&fakeReply);
         }
+        mReplyHandle = origReplyHandle;
+        mReplyCode = origReplyCode;
         #if 0
         if (code == 4) { // relayout
             ALOGI("<<<<<< RETURNING transaction 4");
@@ -613,9 +771,71 @@ status_t IPCThreadState::transact(int32_t handle,
         err = waitForResponse(NULL, NULL);
     }
 
+    if (recordStats) {
+        recordTransaction(false, code, data, wallStart, cpuStart);
+    }
+
     return err;
 }
 
+void IPCThreadState::beginOneWayBatch()
+{
+    mOneWayBatchDepth++;
+}
+
+status_t IPCThreadState::endOneWayBatch()
+{
+    ALOG_ASSERT(mOneWayBatchDepth > 0, "endOneWayBatch() without beginOneWayBatch()");
+    if (mOneWayBatchDepth <= 0 || --mOneWayBatchDepth > 0) {
+        return NO_ERROR;
+    }
+    return flushOneWayBatch();
+}
+
+status_t IPCThreadState::queueOneWayTransaction(int32_t handle, uint32_t code,
+                                                const Parcel& data, uint32_t flags)
+{
+    // The caller's parcel is usually gone by the time the batch is
+    // submitted, so the driver gets a private copy (objects included).
+    Parcel* copy = new Parcel;
+    status_t err = copy->appendFrom(&data, 0, data.ipcDataSize());
+    if (err == NO_ERROR) {
+        err = writeTransactionData(BC_TRANSACTION, flags, handle, code, *copy, NULL);
+    }
+    if (err != NO_ERROR) {
+        delete copy;
+        return err;
+    }
+
+    mOneWayBatch.push(copy);
+    if (mOneWayBatch.size() >= kMaxOneWayBatch) {
+        return flushOneWayBatch();
+    }
+    return NO_ERROR;
+}
+
+status_t IPCThreadState::flushOneWayBatch()
+{
+    // Take the queue first so nothing we run below sees it half-done.
+    Vector<Parcel*> batch(mOneWayBatch);
+    mOneWayBatch.clear();
+
+    // All the queued commands go out on the first talkWithDriver(); the
+    // driver then answers each transaction with its own completion.
+    status_t result = NO_ERROR;
+    for (size_t i = 0; i < batch.size(); i++) {
+        const status_t err = waitForResponse(NULL, NULL);
+        if (err != NO_ERROR && result == NO_ERROR) {
+            result = err;
+        }
+    }
+
+    for (size_t i = 0; i < batch.size(); i++) {
+        delete batch[i];
+    }
+    return result;
+}
+
 void IPCThreadState::incStrongHandle(int32_t handle)
 {
     LOG_REMOTEREFS("IPCThreadState::incStrongHandle(%d)\n", handle);
@@ -695,7 +915,11 @@ status_t IPCThreadState::clearDeathNotification(int32_t handle, BpBinder* proxy)
 IPCThreadState::IPCThreadState()
     : mProcess(ProcessState::self()),
       mStrictModePolicy(0),
-      mLastTransactionBinderFlags(0)
+      mLastTransactionBinderFlags(0),
+      mOneWayBatchDepth(0),
+      mTransactionStats(NULL),
+      mReplyHandle(0),
+      mReplyCode(0)
 {
     pthread_setspecific(gTLS, this);
     clearCaller();
@@ -705,12 +929,19 @@ IPCThreadState::IPCThreadState()
 
 IPCThreadState::~IPCThreadState()
 {
+    for (size_t i = 0; i < mOneWayBatch.size(); i++) {
+        delete mOneWayBatch[i];
+    }
+    TransactionStats::retire(mTransactionStats);
 }
 
 status_t IPCThreadState::sendReply(const Parcel& reply, uint32_t flags)
 {
     status_t err;
     status_t statusBuffer;
+    if (!mOneWayBatch.isEmpty()) {
+        flushOneWayBatch();
+    }
     err = writeTransactionData(BC_REPLY, flags, -1, 0, reply, &statusBuffer);
     if (err < NO_ERROR) return err;
 
@@ -764,6 +995,10 @@ status_t IPCThreadState::waitForResponse(Parcel *reply, status_t *acquireResult)
                 ALOG_ASSERT(err == NO_ERROR, "Not enough command data for brREPLY");
                 if (err != NO_ERROR) goto finish;
 
+                // freeBuffer() accounts for every buffer it frees
+                TransactionBuffers::received(
+                    reinterpret_cast<const uint8_t*>(tr.data.ptr.buffer),
+                    bufferBytes(tr), false, mReplyHandle, mReplyCode);
                 if (reply) {
                     if ((tr.flags & TF_STATUS_CODE) == 0) {
                         reply->ipcSetDataReference(
@@ -861,6 +1096,7 @@ status_t IPCThreadState::talkWithDriver(bool doReceive)
             alog << "About to read/write, write size = " << mOut.dataSize() << endl;
         }
 #if defined(__ANDROID__)
+        gDriverIoctlCount.fetch_add(1, std::memory_order_relaxed);
         if (ioctl(mProcess->mDriverFD, BINDER_WRITE_READ, &bwr) >= 0)
             err = NO_ERROR;
         else
@@ -941,6 +1177,9 @@ status_t IPCThreadState::writeTransactionData(int32_t cmd, uint32_t binderFlags,
 
     mOut.writeInt32(cmd);
     mOut.write(&tr, sizeof(tr));
+    if (cmd == BC_TRANSACTION) {
+        gDriverTransactionCount.fetch_add(1, std::memory_order_relaxed);
+    }
 
     return NO_ERROR;
 }
@@ -1039,6 +1278,9 @@ status_t IPCThreadState::executeCommand(int32_t cmd)
                 "Not enough command data for brTRANSACTION");
             if (result != NO_ERROR) break;
 
+            TransactionBuffers::received(
+                reinterpret_cast<const uint8_t*>(tr.data.ptr.buffer),
+                bufferBytes(tr), true, 0, tr.code);
             Parcel buffer;
             buffer.ipcSetDataReference(
                 reinterpret_cast<const uint8_t*>(tr.data.ptr.buffer),
@@ -1070,6 +1312,10 @@ status_t IPCThreadState::executeCommand(int32_t cmd)
                     << ", offsets addr="
                     << reinterpret_cast<const size_t*>(tr.data.ptr.offsets) << endl;
             }
+            const bool recordStats = TransactionStats::isEnabled();
+            const nsecs_t wallStart = recordStats ? systemTime(SYSTEM_TIME_MONOTONIC) : 0;
+            const nsecs_t cpuStart = recordStats ? systemTime(SYSTEM_TIME_THREAD) : 0;
+
             if (tr.target.ptr) {
                 // We only have a weak reference on the target object, so we must first try to
                 // safely acquire a strong reference before doing anything else with it.
@@ -1086,6 +1332,10 @@ status_t IPCThreadState::executeCommand(int32_t cmd)
                 error = the_context_object->transact(tr.code, buffer, &reply, tr.flags);
             }
 
+            if (recordStats) {
+                recordTransaction(true, tr.code, buffer, wallStart, cpuStart);
+            }
+
             //ALOGI("<<<< TRANSACT from pid %d restore pid %d uid %d\n",
             //     mCallingPid, origPid, origUid);
 
@@ -1153,6 +1403,7 @@ void IPCThreadState::threadDestructor(void *st)
 {
         IPCThreadState* const self = static_cast<IPCThreadState*>(st);
         if (self) {
+                self->flushOneWayBatch();
                 self->flushCommands();
 #if defined(__ANDROID__)
         if (self->mProcess->mDriverFD > 0) {
@@ -1165,9 +1416,9 @@ void IPCThreadState::threadDestructor(void *st)
 
 
 void IPCThreadState::freeBuffer(Parcel* parcel, const uint8_t* data,
-                                size_t /*dataSize*/,
+                                size_t dataSize,
                                 const binder_size_t* /*objects*/,
-                                size_t /*objectsSize*/, void* /*cookie*/)
+                                size_t objectsSize, void* /*cookie*/)
 {
     //ALOGI("Freeing parcel %p", &parcel);
     IF_LOG_COMMANDS() {
@@ -1175,6 +1426,8 @@ void IPCThreadState::freeBuffer(Parcel* parcel, const uint8_t* data,
     }
     ALOG_ASSERT(data != NULL, "Called with NULL data");
     if (parcel != NULL) parcel->closeFileDescriptors();
+    TransactionBuffers::freed(data,
+            bufferBytes(dataSize, objectsSize * sizeof(binder_size_t)));
     IPCThreadState* state = self();
     state->mOut.writeInt32(BC_FREE_BUFFER);
     state->mOut.writePointer((uintptr_t)data);
@@ -19,10 +19,14 @@
 #include <binder/IServiceManager.h>
 
 #include <utils/Log.h>
+#include <binder/Binder.h>
 #include <binder/IPCThreadState.h>
 #include <binder/Parcel.h>
+#include <utils/Condition.h>
+#include <utils/KeyedVector.h>
 #include <utils/String8.h>
 #include <utils/SystemClock.h>
+#include <utils/Timers.h>
 
 #include <private/binder/Static.h>
 
@@ -128,35 +132,234 @@ bool checkPermission(const String16& permission, pid_t pid, uid_t uid)
 
 // ----------------------------------------------------------------------
 
+// Services this process has already looked up.  Entries are weak so the
+// cache never keeps a service alive on its own; remote entries are also
+// dropped as soon as their death notification arrives.  A name can also be
+// registered again while the service it named lives on, so an entry is
+// only trusted for a while after the service manager last handed it out,
+// and is dropped when the service manager reports the name registered to a
+// waiting thread.
+class ServiceCache : public IBinder::DeathRecipient
+{
+public:
+    sp<IBinder> get(const String16& name)
+    {
+        AutoMutex _l(mLock);
+        ssize_t index = mServices.indexOfKey(name);
+        if (index < 0) {
+            return NULL;
+        }
+        const Entry& entry = mServices.valueAt(index);
+        sp<IBinder> binder = entry.binder.promote();
+        if (binder == NULL || !binder->isBinderAlive()) {
+            mServices.removeItemsAt(index);
+            return NULL;
+        }
+        // kept, so that put() of the same binder just renews it
+        if (systemTime(SYSTEM_TIME_MONOTONIC) - entry.checked > kValidity) {
+            return NULL;
+        }
+        return binder;
+    }
+
+    void put(const String16& name, const sp<IBinder>& binder)
+    {
+        AutoMutex _l(mLock);
+        const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        ssize_t index = mServices.indexOfKey(name);
+        sp<IBinder> previous;
+        if (index >= 0) {
+            previous = mServices.valueAt(index).binder.promote();
+            if (previous == binder) {
+                mServices.editValueAt(index).checked = now;
+                return;
+            }
+        }
+        // One death recipient per binder, however many names it is cached
+        // under; binderDied() drops all of them.
+        if (binder->remoteBinder() != NULL && !isCachedLocked(binder) &&
+                binder->linkToDeath(this) != NO_ERROR) {
+            return;
+        }
+        Entry entry;
+        entry.binder = binder;
+        entry.checked = now;
+        mServices.replaceValueFor(name, entry);
+        if (previous != NULL) {
+            unlinkIfUnusedLocked(previous);
+        }
+    }
+
+    void remove(const String16& name)
+    {
+        AutoMutex _l(mLock);
+        ssize_t index = mServices.indexOfKey(name);
+        if (index < 0) {
+            return;
+        }
+        sp<IBinder> previous = mServices.valueAt(index).binder.promote();
+        mServices.removeItemsAt(index);
+        if (previous != NULL) {
+            unlinkIfUnusedLocked(previous);
+        }
+    }
+
+    virtual void binderDied(const wp<IBinder>& who)
+    {
+        AutoMutex _l(mLock);
+        for (size_t i = mServices.size(); i > 0; i--) {
+            if (mServices.valueAt(i - 1).binder == who) {
+                mServices.removeItemsAt(i - 1);
+            }
+        }
+    }
+
+private:
+    // How long an entry is used without asking the service manager again
+    static const nsecs_t kValidity = 1000000000; // 1s
+
+    struct Entry {
+        wp<IBinder> binder;
+        nsecs_t checked;
+    };
+
+    bool isCachedLocked(const sp<IBinder>& binder) const
+    {
+        for (size_t i = 0; i < mServices.size(); i++) {
+            // an entry left by a dead binder may point at a new one reusing
+            // its address, so a matching pointer has to be promoted too.
+            const wp<IBinder>& entry = mServices.valueAt(i).binder;
+            if (entry.unsafe_get() == binder.get() && entry.promote() == binder) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Called once binder is no longer cached under one of its names.
+    void unlinkIfUnusedLocked(const sp<IBinder>& binder)
+    {
+        if (binder->remoteBinder() != NULL && !isCachedLocked(binder)) {
+            binder->unlinkToDeath(this);
+        }
+    }
+
+    Mutex mLock;
+    KeyedVector<String16, Entry> mServices;
+};
+
+// Callback handed to the service manager by waitForService().  There is
+// one per process, so the service manager holds at most one registration
+// per name for us; every waiting thread wakes on each notification and
+// re-checks its own service.  The registration is taken back once the last
+// thread waiting for the name gives up.
+class ServiceWaiter : public BBinder
+{
+public:
+    explicit ServiceWaiter(const sp<ServiceCache>& cache)
+        : mCache(cache), mGeneration(0) { }
+
+    uint32_t generation()
+    {
+        AutoMutex _l(mLock);
+        return mGeneration;
+    }
+
+    // Waits for a notification newer than 'generation'.
+    void wait(uint32_t generation, nsecs_t timeout)
+    {
+        AutoMutex _l(mLock);
+        if (mGeneration == generation) {
+            mCondition.waitRelative(mLock, timeout);
+        }
+    }
+
+    void startWaiting(const String16& name)
+    {
+        AutoMutex _l(mLock);
+        ssize_t index = mWaiting.indexOfKey(name);
+        if (index < 0) {
+            mWaiting.add(name, 1);
+        } else {
+            mWaiting.editValueAt(index)++;
+        }
+    }
+
+    // Returns whether no other thread is waiting for name.
+    bool stopWaiting(const String16& name)
+    {
+        AutoMutex _l(mLock);
+        ssize_t index = mWaiting.indexOfKey(name);
+        if (index < 0) {
+            return true;
+        }
+        if (--mWaiting.editValueAt(index) > 0) {
+            return false;
+        }
+        mWaiting.removeItemsAt(index);
+        return true;
+    }
+
+protected:
+    virtual status_t onTransact(uint32_t code, const Parcel& data,
+            Parcel* reply, uint32_t flags)
+    {
+        if (code != FIRST_CALL_TRANSACTION) {
+            return BBinder::onTransact(code, data, reply, flags);
+        }
+        // whatever was cached under the name may have been replaced
+        const String16 name(data.readString16());
+        if (name.size() > 0) {
+            mCache->remove(name);
+        }
+        AutoMutex _l(mLock);
+        mGeneration++;
+        mCondition.broadcast();
+        return NO_ERROR;
+    }
+
+private:
+    const sp<ServiceCache> mCache;
+    Mutex mLock;
+    Condition mCondition;
+    uint32_t mGeneration;
+    KeyedVector<String16, size_t> mWaiting;
+};
+
 class BpServiceManager : public BpInterface<IServiceManager>
 {
 public:
     BpServiceManager(const sp<IBinder>& impl)
-        : BpInterface<IServiceManager>(impl)
+        : BpInterface<IServiceManager>(impl),
+          mCache(new ServiceCache()),
+          mWaiter(new ServiceWaiter(mCache))
     {
     }
 
     virtual sp<IBinder> getService(const String16& name) const
     {
-        unsigned n;
-        for (n = 0; n < 5; n++){
-            if (n > 0) {
-                ALOGI("Waiting for service %s...", String8(name).string());
-                sleep(1);
-            }
-            sp<IBinder> svc = checkService(name);
-            if (svc != NULL) return svc;
-        }
-        return NULL;
+        return awaitService(name, 4000);
     }
 
     virtual sp<IBinder> checkService( const String16& name) const
     {
+        sp<IBinder> svc = mCache->get(name);
+        if (svc != NULL) return svc;
+
         Parcel data, reply;
         data.writeInterfaceToken(IServiceManager::getInterfaceDescriptor());
         data.writeString16(name);
         remote()->transact(CHECK_SERVICE_TRANSACTION, data, &reply);
-        return reply.readStrongBinder();
+        svc = reply.readStrongBinder();
+        if (svc != NULL) {
+            mCache->put(name, svc);
+        }
+        return svc;
+    }
+
+    virtual sp<IBinder> waitForService(const String16& name) const
+    {
+        return awaitService(name, -1);
     }
 
     virtual status_t addService(const String16& name, const sp<IBinder>& service,
@@ -187,6 +390,65 @@ public:
         }
         return res;
     }
+
+private:
+    // Blocks for up to timeoutMs (forever if negative).  The service
+    // manager wakes us when the service is added; the periodic re-check
+    // covers callers without a binder thread to receive that callback,
+    // and older service managers that don't support it.
+    sp<IBinder> awaitService(const String16& name, int timeoutMs) const
+    {
+        sp<IBinder> svc = checkService(name);
+        if (svc != NULL) return svc;
+
+        mWaiter->startWaiting(name);
+        bool registered = false;
+        {
+            Parcel data, reply;
+            data.writeInterfaceToken(IServiceManager::getInterfaceDescriptor());
+            data.writeString16(name);
+            data.writeStrongBinder(mWaiter);
+            registered = remote()->transact(WAIT_FOR_SERVICE_TRANSACTION, data, &reply)
+                    == NO_ERROR && reply.readExceptionCode() == NO_ERROR;
+        }
+
+        const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        const nsecs_t timeout = ms2ns(timeoutMs);
+        nsecs_t delay = ms2ns(10);
+        bool logged = false;
+        for (;;) {
+            const uint32_t generation = mWaiter->generation();
+            svc = checkService(name);
+            if (svc != NULL) break;
+
+            const nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+            if (timeoutMs >= 0 && elapsed >= timeout) break;
+            if (!logged && elapsed >= s2ns(1)) {
+                ALOGI("Waiting for service %s...", String8(name).string());
+                logged = true;
+            }
+
+            nsecs_t wait = registered ? s2ns(1) : delay;
+            if (!registered && delay < s2ns(1)) delay *= 2;
+            if (timeoutMs >= 0 && wait > timeout - elapsed) wait = timeout - elapsed;
+            mWaiter->wait(generation, wait);
+        }
+
+        // the service manager forgets the registration itself once the
+        // service is added, but not when we give up on it
+        if (mWaiter->stopWaiting(name) && registered && svc == NULL) {
+            Parcel data, reply;
+            data.writeInterfaceToken(IServiceManager::getInterfaceDescriptor());
+            data.writeString16(name);
+            data.writeStrongBinder(mWaiter);
+            remote()->transact(STOP_WAITING_FOR_SERVICE_TRANSACTION, data, &reply,
+                    IBinder::FLAG_ONEWAY);
+        }
+        return svc;
+    }
+
+    const sp<ServiceCache> mCache;
+    const sp<ServiceWaiter> mWaiter;
 };
 
 IMPLEMENT_META_INTERFACE(ServiceManager, "android.os.IServiceManager");
@@ -38,6 +38,8 @@
 #include <sys/mman.h>
 #include <sys/file.h>
 
+#include <unordered_map>
+
 namespace android {
 // ----------------------------------------------------------------------------
 
@@ -120,13 +122,19 @@ private:
 
 // ----------------------------------------------------------------------------
 
+// Despite the name (kept for MemoryDealer's forward declaration), this is a
+// segregated-fit allocator: free chunks sit in power-of-two size bins with a
+// bitmap of non-empty bins, and allocated chunks are indexed by offset, so
+// both allocate() and deallocate() run in constant time instead of walking
+// every chunk in the heap.
+
 class SimpleBestFitAllocator
 {
     enum {
         PAGE_ALIGNED = 0x00000001
     };
 public:
-    SimpleBestFitAllocator(size_t size);
+    SimpleBestFitAllocator(size_t size, MemoryDealer::Policy policy);
     ~SimpleBestFitAllocator();
 
     size_t      allocate(size_t size, uint32_t flags = 0);
@@ -141,24 +149,43 @@ private:
 
     struct chunk_t {
         chunk_t(size_t start, size_t size)
-        : start(start), size(size), free(1), prev(0), next(0) {
+        : start(start), size(size), free(1), prev(0), next(0),
+          freePrev(0), freeNext(0) {
         }
         size_t              start;
         size_t              size : 28;
         int                 free : 4;
+        // neighbours in address order
         mutable chunk_t*    prev;
         mutable chunk_t*    next;
+        // neighbours in the free bin, while free
+        chunk_t*            freePrev;
+        chunk_t*            freeNext;
     };
 
+    // One bin per power of two that fits in chunk_t::size.
+    enum { kNumBins = 28 };
+
     ssize_t  alloc(size_t size, uint32_t flags);
     chunk_t* dealloc(size_t start);
+    chunk_t* findFree(size_t size) const;
+    chunk_t* findBestFree(size_t size) const;
+    chunk_t* findFreeAligned(size_t size, size_t* outExtra) const;
+    void     insertFree(chunk_t* chunk);
+    void     removeFree(chunk_t* chunk);
     void     dump_l(const char* what) const;
     void     dump_l(String8& res, const char* what) const;
 
+    static int binFor(size_t size) { return 31 - __builtin_clz((uint32_t)size); }
+
     static const int    kMemoryAlign;
     mutable Mutex       mLock;
     LinkedList<chunk_t> mList;
+    chunk_t*            mFreeBins[kNumBins];
+    uint32_t            mFreeBinMap;
+    std::unordered_map<size_t, chunk_t*> mAllocated;
     size_t              mHeapSize;
+    const MemoryDealer::Policy mPolicy;
 };
 
 // ----------------------------------------------------------------------------
@@ -229,10 +256,17 @@ Allocation::~Allocation()
 
 MemoryDealer::MemoryDealer(size_t size, const char* name, uint32_t flags)
     : mHeap(new MemoryHeapBase(size, flags, name)),
-    mAllocator(new SimpleBestFitAllocator(size))
+    mAllocator(new SimpleBestFitAllocator(size, POLICY_GOOD_FIT))
 {    
 }
 
+MemoryDealer::MemoryDealer(size_t size, const char* name, uint32_t flags,
+        Policy policy)
+    : mHeap(new MemoryHeapBase(size, flags, name)),
+    mAllocator(new SimpleBestFitAllocator(size, policy))
+{
+}
+
 MemoryDealer::~MemoryDealer()
 {
     delete mAllocator;
@@ -277,13 +311,19 @@ size_t MemoryDealer::getAllocationAlignment()
 // align all the memory blocks on a cache-line boundary
 const int SimpleBestFitAllocator::kMemoryAlign = 32;
 
-SimpleBestFitAllocator::SimpleBestFitAllocator(size_t size)
+SimpleBestFitAllocator::SimpleBestFitAllocator(size_t size,
+        MemoryDealer::Policy policy)
+    : mFreeBinMap(0), mPolicy(policy)
 {
     size_t pagesize = getpagesize();
     mHeapSize = ((size + pagesize-1) & ~(pagesize-1));
+    memset(mFreeBins, 0, sizeof(mFreeBins));
 
     chunk_t* node = new chunk_t(0, mHeapSize / kMemoryAlign);
     mList.insertHead(node);
+    if (node->size) {
+        insertFree(node);
+    }
 }
 
 SimpleBestFitAllocator::~SimpleBestFitAllocator()
@@ -315,102 +355,186 @@ status_t SimpleBestFitAllocator::deallocate(size_t offset)
     return NAME_NOT_FOUND;
 }
 
-ssize_t SimpleBestFitAllocator::alloc(size_t size, uint32_t flags)
+void SimpleBestFitAllocator::insertFree(chunk_t* chunk)
 {
-    if (size == 0) {
-        return 0;
+    const int bin = binFor(chunk->size);
+    chunk->freePrev = 0;
+    chunk->freeNext = mFreeBins[bin];
+    if (mFreeBins[bin]) {
+        mFreeBins[bin]->freePrev = chunk;
     }
-    size = (size + kMemoryAlign-1) / kMemoryAlign;
-    chunk_t* free_chunk = 0;
-    chunk_t* cur = mList.head();
+    mFreeBins[bin] = chunk;
+    mFreeBinMap |= 1u << bin;
+}
 
-    size_t pagesize = getpagesize();
-    while (cur) {
-        int extra = 0;
-        if (flags & PAGE_ALIGNED)
-            extra = ( -cur->start & ((pagesize/kMemoryAlign)-1) ) ;
-
-        // best fit
-        if (cur->free && (cur->size >= (size+extra))) {
-            if ((!free_chunk) || (cur->size < free_chunk->size)) {
-                free_chunk = cur;
-            }
-            if (cur->size == size) {
-                break;
-            }
+void SimpleBestFitAllocator::removeFree(chunk_t* chunk)
+{
+    const int bin = binFor(chunk->size);
+    if (chunk->freePrev) {
+        chunk->freePrev->freeNext = chunk->freeNext;
+    } else {
+        mFreeBins[bin] = chunk->freeNext;
+    }
+    if (chunk->freeNext) {
+        chunk->freeNext->freePrev = chunk->freePrev;
+    }
+    chunk->freePrev = chunk->freeNext = 0;
+    if (!mFreeBins[bin]) {
+        mFreeBinMap &= ~(1u << bin);
+    }
+}
+
+SimpleBestFitAllocator::chunk_t* SimpleBestFitAllocator::findFree(size_t size) const
+{
+    const int bin = binFor(size);
+
+    // The head of our own bin is the likeliest close fit.
+    chunk_t* cur = mFreeBins[bin];
+    if (cur && cur->size >= size) {
+        return cur;
+    }
+
+    // Every chunk in a larger bin is big enough; take the smallest such bin.
+    const uint32_t larger = (bin + 1 < kNumBins) ? mFreeBinMap & ~((2u << bin) - 1) : 0;
+    if (larger) {
+        return mFreeBins[__builtin_ctz(larger)];
+    }
+
+    // Last resort: something further down our own bin may still fit.
+    for (; cur; cur = cur->freeNext) {
+        if (cur->size >= size) {
+            return cur;
         }
-        cur = cur->next;
     }
+    return 0;
+}
 
-    if (free_chunk) {
-        const size_t free_size = free_chunk->size;
-        free_chunk->free = 0;
-        free_chunk->size = size;
-        if (free_size > size) {
-            int extra = 0;
-            if (flags & PAGE_ALIGNED)
-                extra = ( -free_chunk->start & ((pagesize/kMemoryAlign)-1) ) ;
-            if (extra) {
-                chunk_t* split = new chunk_t(free_chunk->start, extra);
-                free_chunk->start += extra;
-                mList.insertBefore(free_chunk, split);
+SimpleBestFitAllocator::chunk_t* SimpleBestFitAllocator::findBestFree(size_t size) const
+{
+    // Chunks in a bin are smaller than those of the bins above, so the best
+    // fit is the smallest one that fits in the lowest bin holding any.
+    uint32_t bins = mFreeBinMap & ~((1u << binFor(size)) - 1);
+    while (bins) {
+        const int bin = __builtin_ctz(bins);
+        chunk_t* best = 0;
+        for (chunk_t* cur = mFreeBins[bin]; cur; cur = cur->freeNext) {
+            if (cur->size >= size && (!best || cur->size < best->size)) {
+                best = cur;
+                if (cur->size == size) {
+                    break;
+                }
             }
+        }
+        if (best) {
+            return best;
+        }
+        bins &= ~(1u << bin);
+    }
+    return 0;
+}
 
-            ALOGE_IF((flags&PAGE_ALIGNED) && 
-                    ((free_chunk->start*kMemoryAlign)&(pagesize-1)),
-                    "PAGE_ALIGNED requested, but page is not aligned!!!");
-
-            const ssize_t tail_free = free_size - (size+extra);
-            if (tail_free > 0) {
-                chunk_t* split = new chunk_t(
-                        free_chunk->start + free_chunk->size, tail_free);
-                mList.insertAfter(free_chunk, split);
+SimpleBestFitAllocator::chunk_t* SimpleBestFitAllocator::findFreeAligned(size_t size,
+        size_t* outExtra) const
+{
+    // Alignment requests are rare; a walk over the free chunks is fine.
+    const size_t pagesize = getpagesize();
+    chunk_t* best = 0;
+    for (int bin = binFor(size); bin < kNumBins; bin++) {
+        for (chunk_t* cur = mFreeBins[bin]; cur; cur = cur->freeNext) {
+            const size_t extra = ( -cur->start & ((pagesize/kMemoryAlign)-1) );
+            if (cur->size >= size + extra && (!best || cur->size < best->size)) {
+                best = cur;
+                *outExtra = extra;
             }
         }
-        return (free_chunk->start)*kMemoryAlign;
+        if (best) break;
     }
-    return NO_MEMORY;
+    return best;
 }
 
-SimpleBestFitAllocator::chunk_t* SimpleBestFitAllocator::dealloc(size_t start)
+ssize_t SimpleBestFitAllocator::alloc(size_t size, uint32_t flags)
 {
-    start = start / kMemoryAlign;
-    chunk_t* cur = mList.head();
-    while (cur) {
-        if (cur->start == start) {
-            LOG_FATAL_IF(cur->free,
-                "block at offset 0x%08lX of size 0x%08lX already freed",
-                cur->start*kMemoryAlign, cur->size*kMemoryAlign);
-
-            // merge freed blocks together
-            chunk_t* freed = cur;
-            cur->free = 1;
-            do {
-                chunk_t* const p = cur->prev;
-                chunk_t* const n = cur->next;
-                if (p && (p->free || !cur->size)) {
-                    freed = p;
-                    p->size += cur->size;
-                    mList.remove(cur);
-                    delete cur;
-                }
-                cur = n;
-            } while (cur && cur->free);
+    if (size == 0) {
+        return 0;
+    }
+    size = (size + kMemoryAlign-1) / kMemoryAlign;
+    if (size >= (1u << kNumBins)) {
+        return NO_MEMORY;
+    }
 
-            #ifndef NDEBUG
-                if (!freed->free) {
-                    dump_l("dealloc (!freed->free)");
-                }
-            #endif
-            LOG_FATAL_IF(!freed->free,
-                "freed block at offset 0x%08lX of size 0x%08lX is not free!",
-                freed->start * kMemoryAlign, freed->size * kMemoryAlign);
+    size_t extra = 0;
+    chunk_t* free_chunk;
+    if (flags & PAGE_ALIGNED) {
+        free_chunk = findFreeAligned(size, &extra);
+    } else if (mPolicy == MemoryDealer::POLICY_BEST_FIT) {
+        free_chunk = findBestFree(size);
+    } else {
+        free_chunk = findFree(size);
+    }
+    if (!free_chunk) {
+        return NO_MEMORY;
+    }
 
-            return freed;
-        }
-        cur = cur->next;
+    removeFree(free_chunk);
+    if (extra) {
+        // Leave the unaligned head behind as its own free chunk.
+        chunk_t* split = new chunk_t(free_chunk->start, extra);
+        free_chunk->start += extra;
+        free_chunk->size = free_chunk->size - extra;
+        mList.insertBefore(free_chunk, split);
+        insertFree(split);
     }
-    return 0;
+
+    ALOGE_IF((flags&PAGE_ALIGNED) &&
+            ((free_chunk->start*kMemoryAlign)&(getpagesize()-1)),
+            "PAGE_ALIGNED requested, but page is not aligned!!!");
+
+    const size_t tail_free = free_chunk->size - size;
+    free_chunk->free = 0;
+    free_chunk->size = size;
+    if (tail_free > 0) {
+        chunk_t* split = new chunk_t(free_chunk->start + size, tail_free);
+        mList.insertAfter(free_chunk, split);
+        insertFree(split);
+    }
+
+    mAllocated[free_chunk->start] = free_chunk;
+    return (free_chunk->start)*kMemoryAlign;
+}
+
+SimpleBestFitAllocator::chunk_t* SimpleBestFitAllocator::dealloc(size_t start)
+{
+    start = start / kMemoryAlign;
+    auto it = mAllocated.find(start);
+    if (it == mAllocated.end()) {
+        return 0;
+    }
+    chunk_t* cur = it->second;
+    mAllocated.erase(it);
+
+    LOG_FATAL_IF(cur->free,
+        "block at offset 0x%08lX of size 0x%08lX already freed",
+        cur->start*kMemoryAlign, cur->size*kMemoryAlign);
+
+    // merge freed blocks together
+    cur->free = 1;
+    chunk_t* const n = cur->next;
+    if (n && n->free) {
+        removeFree(n);
+        cur->size += n->size;
+        mList.remove(n);
+        delete n;
+    }
+    chunk_t* const p = cur->prev;
+    if (p && p->free) {
+        removeFree(p);
+        p->size += cur->size;
+        mList.remove(cur);
+        delete cur;
+        cur = p;
+    }
+    insertFree(cur);
+    return cur;
 }
 
 void SimpleBestFitAllocator::dump(const char* what) const
@@ -437,13 +561,17 @@ void SimpleBestFitAllocator::dump_l(String8& result,
         const char* what) const
 {
     size_t size = 0;
+    size_t freeSize = 0;
+    size_t freeChunks = 0;
+    size_t largestFree = 0;
     int32_t i = 0;
     chunk_t const* cur = mList.head();
     
     const size_t SIZE = 256;
     char buffer[SIZE];
-    snprintf(buffer, SIZE, "  %s (%p, size=%u)\n",
-            what, this, (unsigned int)mHeapSize);
+    snprintf(buffer, SIZE, "  %s (%p, size=%u, %s fit)\n",
+            what, this, (unsigned int)mHeapSize,
+            mPolicy == MemoryDealer::POLICY_BEST_FIT ? "best" : "good");
     
     result.append(buffer);
             
@@ -461,8 +589,15 @@ void SimpleBestFitAllocator::dump_l(String8& result,
         
         result.append(buffer);
 
-        if (!cur->free)
+        if (!cur->free) {
             size += cur->size*kMemoryAlign;
+        } else {
+            freeSize += cur->size*kMemoryAlign;
+            freeChunks++;
+            if (cur->size*kMemoryAlign > largestFree) {
+                largestFree = cur->size*kMemoryAlign;
+            }
+        }
 
         i++;
         cur = cur->next;
@@ -470,6 +605,17 @@ void SimpleBestFitAllocator::dump_l(String8& result,
     snprintf(buffer, SIZE,
             "  size allocated: %u (%u KB)\n", int(size), int(size/1024));
     result.append(buffer);
+
+    // The share of the free memory an allocation of the largest free chunk
+    // can't reach: 0 when it is all in one piece.
+    const unsigned int fragmentation = freeSize ?
+            (unsigned int)(100 - largestFree * 100 / freeSize) : 0;
+    snprintf(buffer, SIZE,
+            "  free: %u (%u KB) in %u chunks, largest %u (%u KB),"
+            " fragmentation %u%%\n",
+            int(freeSize), int(freeSize/1024), int(freeChunks),
+            int(largestFree), int(largestFree/1024), fragmentation);
+    result.append(buffer);
 }
 
 
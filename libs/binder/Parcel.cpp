@@ -89,6 +89,8 @@ static pthread_mutex_t gParcelGlobalAllocSizeLock = PTHREAD_MUTEX_INITIALIZER;
 static size_t gParcelGlobalAllocSize = 0;
 static size_t gParcelGlobalAllocCount = 0;
 
+static size_t gParcelGlobalPooledSize = 0;
+
 static size_t gMaxFds = 0;
 
 // Maximum size of a blob to transfer in-place.
@@ -126,6 +128,126 @@ static dev_t ashmem_rdev()
     return rdev;
 }
 
+// ---------------------------------------------------------------------------
+// Per-thread cache of Parcel data buffers.
+//
+// Most transactions are built in a short-lived Parcel on the stack, so
+// every call mallocs and frees a buffer of roughly the same size.  Fresh
+// buffers are rounded up to a small set of size classes, and buffers of
+// exactly a class size are parked here on free for the next Parcel created
+// on the same thread.
+
+static const size_t kParcelPoolSizeClasses[] = { 256, 1024, 4096, 16384 };
+static const size_t kParcelPoolNumClasses =
+        sizeof(kParcelPoolSizeClasses) / sizeof(kParcelPoolSizeClasses[0]);
+static const size_t kParcelPoolBuffersPerClass = 4;
+
+struct ParcelBufferPool {
+    void* buffers[kParcelPoolNumClasses][kParcelPoolBuffersPerClass];
+    size_t count[kParcelPoolNumClasses];
+};
+
+static pthread_once_t gParcelPoolKeyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t gParcelPoolKey;
+static bool gParcelPoolKeyValid = false;
+
+static void destroyParcelBufferPool(void* p)
+{
+    ParcelBufferPool* pool = static_cast<ParcelBufferPool*>(p);
+    size_t released = 0;
+    for (size_t c = 0; c < kParcelPoolNumClasses; c++) {
+        for (size_t i = 0; i < pool->count[c]; i++) {
+            free(pool->buffers[c][i]);
+        }
+        released += pool->count[c] * kParcelPoolSizeClasses[c];
+    }
+    delete pool;
+
+    pthread_mutex_lock(&gParcelGlobalAllocSizeLock);
+    gParcelGlobalPooledSize -= released;
+    pthread_mutex_unlock(&gParcelGlobalAllocSizeLock);
+}
+
+static void createParcelBufferPoolKey()
+{
+    gParcelPoolKeyValid =
+            pthread_key_create(&gParcelPoolKey, destroyParcelBufferPool) == 0;
+    if (!gParcelPoolKeyValid) {
+        ALOGW("Unable to create Parcel buffer pool key; pooling disabled");
+    }
+}
+
+static ParcelBufferPool* parcelBufferPool(bool create)
+{
+    pthread_once(&gParcelPoolKeyOnce, createParcelBufferPoolKey);
+    if (!gParcelPoolKeyValid) return NULL;
+
+    ParcelBufferPool* pool =
+            static_cast<ParcelBufferPool*>(pthread_getspecific(gParcelPoolKey));
+    if (!pool && create) {
+        pool = new ParcelBufferPool();
+        memset(pool, 0, sizeof(*pool));
+        if (pthread_setspecific(gParcelPoolKey, pool) != 0) {
+            delete pool;
+            pool = NULL;
+        }
+    }
+    return pool;
+}
+
+static bool parcelPoolClass(size_t size, size_t* outClass)
+{
+    for (size_t c = 0; c < kParcelPoolNumClasses; c++) {
+        if (size <= kParcelPoolSizeClasses[c]) {
+            *outClass = c;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Returns a buffer of at least 'desired' bytes and stores its real size in
+// outCapacity, which is always a full size class for pool-sized requests.
+static void* parcelPoolAlloc(size_t desired, size_t* outCapacity)
+{
+    size_t c;
+    if (!parcelPoolClass(desired, &c)) {
+        *outCapacity = desired;
+        return malloc(desired);
+    }
+
+    const size_t size = kParcelPoolSizeClasses[c];
+    ParcelBufferPool* pool = parcelBufferPool(true);
+    if (pool && pool->count[c] > 0) {
+        pthread_mutex_lock(&gParcelGlobalAllocSizeLock);
+        gParcelGlobalPooledSize -= size;
+        pthread_mutex_unlock(&gParcelGlobalAllocSizeLock);
+        *outCapacity = size;
+        return pool->buffers[c][--pool->count[c]];
+    }
+
+    *outCapacity = size;
+    return malloc(size);
+}
+
+static void parcelPoolFree(void* data, size_t capacity)
+{
+    size_t c;
+    if (parcelPoolClass(capacity, &c) && kParcelPoolSizeClasses[c] == capacity) {
+        // Don't create a pool just to park a buffer; this may run from a
+        // thread-exit destructor after our own pool is gone.
+        ParcelBufferPool* pool = parcelBufferPool(false);
+        if (pool && pool->count[c] < kParcelPoolBuffersPerClass) {
+            pool->buffers[c][pool->count[c]++] = data;
+            pthread_mutex_lock(&gParcelGlobalAllocSizeLock);
+            gParcelGlobalPooledSize += capacity;
+            pthread_mutex_unlock(&gParcelGlobalAllocSizeLock);
+            return;
+        }
+    }
+    free(data);
+}
+
 void acquire_object(const sp<ProcessState>& proc,
     const flat_binder_object& obj, const void* who, size_t* outAshmemSize)
 {
@@ -403,6 +525,13 @@ size_t Parcel::getGlobalAllocCount() {
     return count;
 }
 
+size_t Parcel::getGlobalPooledSize() {
+    pthread_mutex_lock(&gParcelGlobalAllocSizeLock);
+    size_t size = gParcelGlobalPooledSize;
+    pthread_mutex_unlock(&gParcelGlobalAllocSizeLock);
+    return size;
+}
+
 const uint8_t* Parcel::data() const
 {
     return mData;
@@ -473,6 +602,33 @@ status_t Parcel::setDataCapacity(size_t size)
     return NO_ERROR;
 }
 
+status_t Parcel::reserveData(size_t len)
+{
+    if (len > INT32_MAX) {
+        // don't accept size_t values which may have come from an
+        // inadvertent conversion from a negative int.
+        return BAD_VALUE;
+    }
+
+    const size_t end = mDataPos + len;
+    if (end < mDataPos) {
+        // integer overflow
+        return BAD_VALUE;
+    }
+
+    if (end <= mDataCapacity) return NO_ERROR;
+
+    // Same 3/2 headroom as growData(), but sized from the write position so
+    // that the whole reservation is satisfied by a single realloc().
+    const size_t base = (mDataPos > mDataSize) ? mDataPos : mDataSize;
+    if (base + len < base || base + len > INT32_MAX) {
+        return BAD_VALUE;
+    }
+    size_t newSize = ((base + len) * 3) / 2;
+    if (newSize > INT32_MAX) newSize = base + len;
+    return continueWrite(newSize);
+}
+
 status_t Parcel::setData(const uint8_t* buffer, size_t len)
 {
     if (len > INT32_MAX) {
@@ -648,12 +804,17 @@ bool Parcel::enforceInterface(const String16& interface,
     } else {
       threadState->setStrictModePolicy(strictPolicy);
     }
-    const String16 str(readString16());
-    if (str == interface) {
+    // Compare against the token where it lies instead of building a
+    // String16 for it; this runs at the top of every incoming transaction.
+    size_t len = 0;
+    const char16_t* str = readString16Inplace(&len);
+    if (str != NULL && len == interface.size() &&
+            memcmp(str, interface.string(), len * sizeof(char16_t)) == 0) {
         return true;
     } else {
         ALOGW("**** enforceInterface() expected '%s' but read '%s'",
-                String8(interface).string(), String8(str).string());
+                String8(interface).string(),
+                str != NULL ? String8(str, len).string() : "");
         return false;
     }
 }
@@ -792,12 +953,17 @@ status_t Parcel::writeUtf8AsUtf16(const std::string& str) {
         return BAD_VALUE;
     }
 
-    status_t err = writeInt32(utf16Len);
+    // Allocate enough bytes to hold our converted string and its terminating NULL.
+    status_t err = reserveData(sizeof(int32_t) + pad_size((utf16Len + 1) * sizeof(char16_t)));
+    if (err) {
+        return err;
+    }
+
+    err = writeInt32(utf16Len);
     if (err) {
         return err;
     }
 
-    // Allocate enough bytes to hold our converted string and its terminating NULL.
     void* dst = writeInplace((utf16Len + 1) * sizeof(char16_t));
     if (!dst) {
         return NO_MEMORY;
@@ -826,6 +992,12 @@ status_t writeByteVectorInternal(Parcel* parcel, const std::vector<T>& val)
         return status;
     }
 
+    // Size the buffer for the length prefix and payload in one step.
+    status = parcel->reserveData(sizeof(int32_t) + val.size() + 3);
+    if (status != OK) {
+        return status;
+    }
+
     status = parcel->writeInt32(val.size());
     if (status != OK) {
         return status;
@@ -934,6 +1106,19 @@ status_t Parcel::writeCharVector(const std::unique_ptr<std::vector<char16_t>>& v
 
 status_t Parcel::writeString16Vector(const std::vector<String16>& val)
 {
+    // The flattened size is known exactly, so reserve it all before writing
+    // the first element rather than growing once per string.
+    size_t total = sizeof(int32_t);
+    for (const auto& str : val) {
+        total += sizeof(int32_t) + PAD_SIZE_UNSAFE((str.size() + 1) * sizeof(char16_t));
+        if (total > INT32_MAX) {
+            return BAD_VALUE;
+        }
+    }
+    status_t err = reserveData(total);
+    if (err != NO_ERROR) {
+        return err;
+    }
     return writeTypedVector(val, &Parcel::writeString16);
 }
 
@@ -972,7 +1157,11 @@ status_t Parcel::writeInt32Array(size_t len, const int32_t *val) {
     if (!val) {
         return writeInt32(-1);
     }
-    status_t ret = writeInt32(static_cast<uint32_t>(len));
+    status_t ret = reserveData(sizeof(int32_t) + pad_size(len * sizeof(*val)));
+    if (ret != NO_ERROR) {
+        return ret;
+    }
+    ret = writeInt32(static_cast<uint32_t>(len));
     if (ret == NO_ERROR) {
         ret = write(val, len * sizeof(*val));
     }
@@ -988,7 +1177,11 @@ status_t Parcel::writeByteArray(size_t len, const uint8_t *val) {
     if (!val) {
         return writeInt32(-1);
     }
-    status_t ret = writeInt32(static_cast<uint32_t>(len));
+    status_t ret = reserveData(sizeof(int32_t) + pad_size(len * sizeof(*val)));
+    if (ret != NO_ERROR) {
+        return ret;
+    }
+    ret = writeInt32(static_cast<uint32_t>(len));
     if (ret == NO_ERROR) {
         ret = write(val, len * sizeof(*val));
     }
@@ -1086,7 +1279,10 @@ status_t Parcel::writeString16(const char16_t* str, size_t len)
 {
     if (str == NULL) return writeInt32(-1);
 
-    status_t err = writeInt32(len);
+    status_t err = reserveData(sizeof(int32_t) + pad_size((len + 1) * sizeof(char16_t)));
+    if (err != NO_ERROR) return err;
+
+    err = writeInt32(len);
     if (err == NO_ERROR) {
         len *= sizeof(char16_t);
         uint8_t* data = (uint8_t*)writeInplace(len+sizeof(char16_t));
@@ -1196,11 +1392,34 @@ status_t Parcel::writeUniqueFileDescriptor(const ScopedFd& fd) {
 }
 
 status_t Parcel::writeUniqueFileDescriptorVector(const std::vector<ScopedFd>& val) {
+    if (val.size() > std::numeric_limits<int32_t>::max()) {
+        return BAD_VALUE;
+    }
+    // fail before writing part of the vector
+    if (!val.empty() && !mAllowFds) {
+        return FDS_NOT_ALLOWED;
+    }
+
+    // One growth of the data and of the object index for the whole vector,
+    // instead of one every few descriptors.
+    status_t status = reserveData(sizeof(int32_t) + val.size() * sizeof(flat_binder_object));
+    if (status != OK) {
+        return status;
+    }
+    status = growObjects(val.size());
+    if (status != OK) {
+        return status;
+    }
+
     return writeTypedVector(val, &Parcel::writeUniqueFileDescriptor);
 }
 
 status_t Parcel::writeUniqueFileDescriptorVector(const std::unique_ptr<std::vector<ScopedFd>>& val) {
-    return writeNullableTypedVector(val, &Parcel::writeUniqueFileDescriptor);
+    if (val.get() == nullptr) {
+        return writeInt32(-1);
+    }
+
+    return writeUniqueFileDescriptorVector(*val);
 }
 
 status_t Parcel::writeBlob(size_t len, bool mutableCopy, WritableBlob* outBlob)
@@ -1267,6 +1486,33 @@ status_t Parcel::writeDupImmutableBlobFileDescriptor(int fd)
     return writeDupFileDescriptor(fd);
 }
 
+status_t Parcel::writeByteVectorBlob(const uint8_t* data, size_t len)
+{
+    if (len > INT32_MAX) {
+        // don't accept size_t values which may have come from an
+        // inadvertent conversion from a negative int.
+        return BAD_VALUE;
+    }
+
+    status_t status = writeInt32(static_cast<int32_t>(len));
+    if (status) return status;
+
+    WritableBlob blob;
+    status = writeBlob(len, false /*mutableCopy*/, &blob);
+    if (status) return status;
+
+    if (len > 0) {
+        memcpy(blob.data(), data, len);
+    }
+    blob.release();
+    return NO_ERROR;
+}
+
+status_t Parcel::writeByteVectorBlob(const std::vector<uint8_t>& val)
+{
+    return writeByteVectorBlob(val.data(), val.size());
+}
+
 status_t Parcel::write(const FlattenableHelperInterface& val)
 {
     status_t err;
@@ -1349,26 +1595,51 @@ restart_write:
         if (err != NO_ERROR) return err;
     }
     if (!enoughObjects) {
-        size_t newSize = ((mObjectsSize+2)*3)/2;
-        if (newSize*sizeof(binder_size_t) < mObjectsSize) return NO_MEMORY;   // overflow
-        binder_size_t* objects = (binder_size_t*)realloc(mObjects, newSize*sizeof(binder_size_t));
-        if (objects == NULL) return NO_MEMORY;
-        mObjects = objects;
-        mObjectsCapacity = newSize;
+        const status_t err = growObjects(1);
+        if (err != NO_ERROR) return err;
     }
 
     goto restart_write;
 }
 
+status_t Parcel::growObjects(size_t count)
+{
+    if (count <= mObjectsCapacity - mObjectsSize) return NO_ERROR;
+
+    const size_t maxObjects = SIZE_MAX / sizeof(binder_size_t);
+    if (count > maxObjects - mObjectsSize) return NO_MEMORY;   // overflow
+    size_t newSize = ((mObjectsSize+2)*3)/2;
+    if (newSize < mObjectsSize + count) newSize = mObjectsSize + count;
+    if (newSize > maxObjects) newSize = mObjectsSize + count;
+    binder_size_t* objects = (binder_size_t*)realloc(mObjects, newSize*sizeof(binder_size_t));
+    if (objects == NULL) return NO_MEMORY;
+    mObjects = objects;
+    mObjectsCapacity = newSize;
+    return NO_ERROR;
+}
+
 status_t Parcel::writeNoException()
 {
     binder::Status status;
     return status.writeToParcel(this);
 }
 
-void Parcel::remove(size_t /*start*/, size_t /*amt*/)
+void Parcel::remove(size_t start, size_t amt)
 {
-    LOG_ALWAYS_FATAL("Parcel::remove() not yet implemented!");
+    // Only raw data can be removed; shifting objects would invalidate the
+    // offsets we hand to the driver.  This is what IPCThreadState needs when
+    // the driver consumes only part of the pending commands in mOut.
+    LOG_ALWAYS_FATAL_IF(mObjectsSize > 0, "Parcel::remove() with objects not implemented!");
+    LOG_ALWAYS_FATAL_IF(start > mDataSize || amt > mDataSize - start,
+            "Parcel::remove(%zu, %zu) out of range (size %zu)", start, amt, mDataSize);
+
+    memmove(mData + start, mData + start + amt, mDataSize - start - amt);
+    mDataSize -= amt;
+    if (mDataPos > start + amt) {
+        mDataPos -= amt;
+    } else if (mDataPos > start) {
+        mDataPos = start;
+    }
 }
 
 status_t Parcel::read(void* outData, size_t len) const
@@ -2021,10 +2292,43 @@ status_t Parcel::readUniqueFileDescriptor(ScopedFd* val) const
 
 
 status_t Parcel::readUniqueFileDescriptorVector(std::unique_ptr<std::vector<ScopedFd>>* val) const {
-    return readNullableTypedVector(val, &Parcel::readUniqueFileDescriptor);
+    const size_t start = dataPosition();
+    int32_t size;
+    status_t status = readInt32(&size);
+    val->reset();
+
+    if (status != OK || size < 0) {
+        return status;
+    }
+
+    setDataPosition(start);
+    val->reset(new std::vector<ScopedFd>());
+
+    status = readUniqueFileDescriptorVector(val->get());
+
+    if (status != OK) {
+        val->reset();
+    }
+
+    return status;
 }
 
 status_t Parcel::readUniqueFileDescriptorVector(std::vector<ScopedFd>* val) const {
+    // Each descriptor is a whole object, don't size the vector from a count
+    // the rest of the parcel can't hold.
+    const size_t start = dataPosition();
+    int32_t size;
+    status_t status = readInt32(&size);
+
+    if (status != OK) {
+        return status;
+    }
+
+    if (size > 0 && size_t(size) > dataAvail() / sizeof(flat_binder_object)) {
+        return BAD_VALUE;
+    }
+
+    setDataPosition(start);
     return readTypedVector(val, &Parcel::readUniqueFileDescriptor);
 }
 
@@ -2056,6 +2360,28 @@ status_t Parcel::readBlob(size_t len, ReadableBlob* outBlob) const
     return NO_ERROR;
 }
 
+status_t Parcel::readByteVectorBlob(ReadableBlob* outBlob) const
+{
+    int32_t len;
+    status_t status = readInt32(&len);
+    if (status) return status;
+    if (len < 0) return BAD_VALUE;
+
+    return readBlob(static_cast<size_t>(len), outBlob);
+}
+
+status_t Parcel::readByteVectorBlob(std::vector<uint8_t>* val) const
+{
+    ReadableBlob blob;
+    status_t status = readByteVectorBlob(&blob);
+    if (status) return status;
+
+    const uint8_t* data = static_cast<const uint8_t*>(blob.data());
+    val->assign(data, data + blob.size());
+    blob.release();
+    return NO_ERROR;
+}
+
 status_t Parcel::read(FlattenableHelperInterface& val) const
 {
     // size
@@ -2229,6 +2555,91 @@ void Parcel::ipcSetDataReference(const uint8_t* data, size_t dataSize,
     scanForFds();
 }
 
+status_t Parcel::releaseTransactionBuffer()
+{
+    if (!mOwner) {
+        return NO_ERROR;
+    }
+    if (mDataSize == 0) {
+        freeData();
+        return NO_ERROR;
+    }
+
+    uint8_t* data = (uint8_t*)malloc(mDataSize);
+    if (!data) {
+        return NO_MEMORY;
+    }
+    binder_size_t* objects = NULL;
+    if (mObjectsSize) {
+        objects = (binder_size_t*)calloc(mObjectsSize, sizeof(binder_size_t));
+        if (!objects) {
+            free(data);
+            return NO_MEMORY;
+        }
+        memcpy(objects, mObjects, mObjectsSize*sizeof(binder_size_t));
+    }
+    memcpy(data, mData, mDataSize);
+
+    // The descriptors are closed along with the buffer, the copy owns
+    // duplicates of them.
+    for (size_t i = 0; i < mObjectsSize; i++) {
+        flat_binder_object* flat = reinterpret_cast<flat_binder_object*>(data+objects[i]);
+        if (flat->type != BINDER_TYPE_FD) {
+            continue;
+        }
+        const int fd = fcntl(flat->handle, F_DUPFD_CLOEXEC, 0);
+        if (fd < 0) {
+            const status_t err = -errno;
+            ALOGE("releaseTransactionBuffer: dup of fd %d failed: %s",
+                    flat->handle, strerror(errno));
+            while (i > 0) {
+                i--;
+                flat = reinterpret_cast<flat_binder_object*>(data+objects[i]);
+                if (flat->type == BINDER_TYPE_FD) {
+                    close(flat->handle);
+                }
+            }
+            free(objects);
+            free(data);
+            return err;
+        }
+        flat->handle = fd;
+        flat->cookie = 1;
+    }
+
+    // Unlike the buffer, the copy holds references on its objects.
+    const sp<ProcessState> proc(ProcessState::self());
+    for (size_t i = 0; i < mObjectsSize; i++) {
+        const flat_binder_object* flat
+            = reinterpret_cast<const flat_binder_object*>(data+objects[i]);
+#ifndef DISABLE_ASHMEM_TRACKING
+        acquire_object(proc, *flat, this, &mOpenAshmemSize);
+#else
+        acquire_object(proc, *flat, this);
+#endif
+    }
+
+    mOwner(this, mData, mDataSize, mObjects, mObjectsSize, mOwnerCookie);
+    mOwner = NULL;
+
+    LOG_ALLOC("Parcel %p: released transaction buffer, copied %zu bytes", this, mDataSize);
+    pthread_mutex_lock(&gParcelGlobalAllocSizeLock);
+    gParcelGlobalAllocSize += mDataSize;
+    gParcelGlobalAllocCount++;
+    pthread_mutex_unlock(&gParcelGlobalAllocSizeLock);
+
+    mData = data;
+    mDataCapacity = mDataSize;
+    mObjects = objects;
+    mObjectsCapacity = mObjectsSize;
+    mNextObjectHint = 0;
+
+    // The owner only queued BC_FREE_BUFFER, send it now rather than with
+    // this thread's next transaction.
+    IPCThreadState::self()->flushCommands();
+    return NO_ERROR;
+}
+
 void Parcel::print(TextOutput& to, uint32_t /*flags*/) const
 {
     to << "Parcel(";
@@ -2318,7 +2729,7 @@ void Parcel::freeDataNoInit()
               gParcelGlobalAllocCount--;
             }
             pthread_mutex_unlock(&gParcelGlobalAllocSizeLock);
-            free(mData);
+            parcelPoolFree(mData, mDataCapacity);
         }
         if (mObjects) free(mObjects);
     }
@@ -2522,7 +2933,8 @@ status_t Parcel::continueWrite(size_t desired)
 
     } else {
         // This is the first data.  Easy!
-        uint8_t* data = (uint8_t*)malloc(desired);
+        size_t capacity;
+        uint8_t* data = (uint8_t*)parcelPoolAlloc(desired, &capacity);
         if (!data) {
             mError = NO_MEMORY;
             return NO_MEMORY;
@@ -2533,9 +2945,9 @@ status_t Parcel::continueWrite(size_t desired)
             ALOGE("continueWrite: %zu/%p/%zu/%zu", mDataCapacity, mObjects, mObjectsCapacity, desired);
         }
 
-        LOG_ALLOC("Parcel %p: allocating with %zu capacity", this, desired);
+        LOG_ALLOC("Parcel %p: allocating with %zu capacity", this, capacity);
         pthread_mutex_lock(&gParcelGlobalAllocSizeLock);
-        gParcelGlobalAllocSize += desired;
+        gParcelGlobalAllocSize += capacity;
         gParcelGlobalAllocCount++;
         pthread_mutex_unlock(&gParcelGlobalAllocSizeLock);
 
@@ -2543,7 +2955,7 @@ status_t Parcel::continueWrite(size_t desired)
         mDataSize = mDataPos = 0;
         ALOGV("continueWrite Setting data size of %p to %zu", this, mDataSize);
         ALOGV("continueWrite Setting data pos of %p to %zu", this, mDataPos);
-        mDataCapacity = desired;
+        mDataCapacity = capacity;
     }
 
     return NO_ERROR;
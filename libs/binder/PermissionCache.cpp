@@ -31,18 +31,42 @@ ANDROID_SINGLETON_STATIC_INSTANCE(PermissionCache) ;
 
 // ----------------------------------------------------------------------------
 
+// How long a result is trusted for; permission changes are not reported to
+// the cache, so this bounds how long a stale result can be handed out.
+static const nsecs_t kExpiry = s2ns(60);
+
 PermissionCache::PermissionCache() {
 }
 
+size_t PermissionCache::KeyHash::operator () (const Key& k) const {
+    // FNV-1a, over the uid and the name
+    uint32_t hash = 2166136261u;
+    hash = (hash ^ uint32_t(k.uid)) * 16777619u;
+    const char16_t* name = k.name.string();
+    for (size_t i = 0; i < k.name.size(); i++) {
+        hash = (hash ^ name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+PermissionCache::Shard& PermissionCache::shardFor(const Key& key) {
+    return mShards[KeyHash()(key) % NUM_SHARDS];
+}
+
+const PermissionCache::Shard& PermissionCache::shardFor(const Key& key) const {
+    return mShards[KeyHash()(key) % NUM_SHARDS];
+}
+
 status_t PermissionCache::check(bool* granted,
         const String16& permission, uid_t uid) const {
-    Mutex::Autolock _l(mLock);
-    Entry e;
-    e.name = permission;
-    e.uid  = uid;
-    ssize_t index = mCache.indexOf(e);
-    if (index >= 0) {
-        *granted = mCache.itemAt(index).granted;
+    Key k;
+    k.name = permission;
+    k.uid  = uid;
+    const Shard& shard(shardFor(k));
+    Mutex::Autolock _l(shard.lock);
+    auto it = shard.entries.find(k);
+    if (it != shard.entries.end() && it->second.expires > systemTime()) {
+        *granted = it->second.granted;
         return NO_ERROR;
     }
     return NAME_NOT_FOUND;
@@ -50,28 +74,42 @@ status_t PermissionCache::check(bool* granted,
 
 void PermissionCache::cache(const String16& permission,
         uid_t uid, bool granted) {
-    Mutex::Autolock _l(mLock);
-    Entry e;
-    ssize_t index = mPermissionNamesPool.indexOf(permission);
-    if (index > 0) {
-        e.name = mPermissionNamesPool.itemAt(index);
-    } else {
-        mPermissionNamesPool.add(permission);
-        e.name = permission;
-    }
     // note, we don't need to store the pid, which is not actually used in
     // permission checks
-    e.uid  = uid;
+    Key k;
+    k.name = permission;
+    k.uid  = uid;
+    Entry e;
     e.granted = granted;
-    index = mCache.indexOf(e);
-    if (index < 0) {
-        mCache.add(e);
-    }
+    e.expires = systemTime() + kExpiry;
+    Shard& shard(shardFor(k));
+    Mutex::Autolock _l(shard.lock);
+    shard.entries[k] = e;
 }
 
 void PermissionCache::purge() {
-    Mutex::Autolock _l(mLock);
-    mCache.clear();
+    for (Shard& shard : mShards) {
+        Mutex::Autolock _l(shard.lock);
+        shard.entries.clear();
+    }
+}
+
+void PermissionCache::invalidate(uid_t uid) {
+    PermissionCache& pc(PermissionCache::getInstance());
+    for (Shard& shard : pc.mShards) {
+        Mutex::Autolock _l(shard.lock);
+        for (auto it = shard.entries.begin(); it != shard.entries.end(); ) {
+            if (it->first.uid == uid) {
+                it = shard.entries.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+}
+
+void PermissionCache::invalidate() {
+    PermissionCache::getInstance().purge();
 }
 
 bool PermissionCache::checkCallingPermission(const String16& permission) {
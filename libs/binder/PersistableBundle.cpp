@@ -85,12 +85,51 @@ namespace os {
          }                                                               \
     }
 
+PersistableBundle::PersistableBundle(const PersistableBundle& bundle) {
+    copyFrom(bundle);
+}
+
+PersistableBundle& PersistableBundle::operator=(const PersistableBundle& bundle) {
+    if (this != &bundle) {
+        copyFrom(bundle);
+    }
+    return *this;
+}
+
+void PersistableBundle::copyFrom(const PersistableBundle& bundle) {
+    // Copying a bundle that isn't decoded yet doesn't decode it.
+    std::lock_guard<std::mutex> lock(bundle.mParcelledDataLock);
+    mParcelledData = bundle.mParcelledData;
+    mBoolMap = bundle.mBoolMap;
+    mIntMap = bundle.mIntMap;
+    mLongMap = bundle.mLongMap;
+    mDoubleMap = bundle.mDoubleMap;
+    mStringMap = bundle.mStringMap;
+    mBoolVectorMap = bundle.mBoolVectorMap;
+    mIntVectorMap = bundle.mIntVectorMap;
+    mLongVectorMap = bundle.mLongVectorMap;
+    mDoubleVectorMap = bundle.mDoubleVectorMap;
+    mStringVectorMap = bundle.mStringVectorMap;
+    mPersistableBundleMap = bundle.mPersistableBundleMap;
+}
+
 status_t PersistableBundle::writeToParcel(Parcel* parcel) const {
     /*
      * Keep implementation in sync with writeToParcelInner() in
      * frameworks/base/core/java/android/os/BaseBundle.java.
      */
 
+    {
+        // A bundle that wasn't decoded is written back as it was read.
+        std::lock_guard<std::mutex> lock(mParcelledDataLock);
+        if (!mParcelledData.empty()) {
+            RETURN_IF_FAILED(parcel->writeInt32(static_cast<int32_t>(mParcelledData.size())));
+            RETURN_IF_FAILED(parcel->writeInt32(BUNDLE_MAGIC));
+            RETURN_IF_FAILED(parcel->write(mParcelledData.data(), mParcelledData.size()));
+            return NO_ERROR;
+        }
+    }
+
     // Special case for empty bundles.
     if (empty()) {
         RETURN_IF_FAILED(parcel->writeInt32(0));
@@ -128,7 +167,57 @@ status_t PersistableBundle::readFromParcel(const Parcel* parcel) {
         return UNEXPECTED_NULL;
     }
 
-    return readFromParcelInner(parcel, static_cast<size_t>(length));
+    *this = PersistableBundle();
+    if (length == 0) {
+        // Empty PersistableBundle or end of data.
+        return NO_ERROR;
+    }
+
+    int32_t magic;
+    RETURN_IF_FAILED(parcel->readInt32(&magic));
+    if (magic != BUNDLE_MAGIC) {
+        ALOGE("Bad magic number for PersistableBundle: 0x%08x", magic);
+        return BAD_VALUE;
+    }
+
+    // Kept as is until first accessed, see unparcel().
+    const uint8_t* data = static_cast<const uint8_t*>(parcel->readInplace(length));
+    if (data == nullptr) {
+        ALOGE("PersistableBundle length (%d) past the end of the parcel", length);
+        return BAD_VALUE;
+    }
+    mParcelledData.assign(data, data + length);
+    return NO_ERROR;
+}
+
+void PersistableBundle::unparcel() const {
+    std::lock_guard<std::mutex> lock(mParcelledDataLock);
+    if (mParcelledData.empty()) {
+        return;
+    }
+
+    Parcel parcel;
+    status_t err = parcel.setData(mParcelledData.data(), mParcelledData.size());
+    if (err == NO_ERROR) {
+        parcel.setDataPosition(0);
+        err = readFromParcelInner(&parcel);
+    }
+    if (err != NO_ERROR) {
+        // Don't hand out what was decoded of a bad bundle.
+        ALOGE("Failed to decode PersistableBundle: %d", err);
+        mBoolMap.clear();
+        mIntMap.clear();
+        mLongMap.clear();
+        mDoubleMap.clear();
+        mStringMap.clear();
+        mBoolVectorMap.clear();
+        mIntVectorMap.clear();
+        mLongVectorMap.clear();
+        mDoubleVectorMap.clear();
+        mStringVectorMap.clear();
+        mPersistableBundleMap.clear();
+    }
+    std::vector<uint8_t>().swap(mParcelledData);
 }
 
 bool PersistableBundle::empty() const {
@@ -136,6 +225,7 @@ bool PersistableBundle::empty() const {
 }
 
 size_t PersistableBundle::size() const {
+    unparcel();
     return (mBoolMap.size() +
             mIntMap.size() +
             mLongMap.size() +
@@ -150,6 +240,7 @@ size_t PersistableBundle::size() const {
 }
 
 size_t PersistableBundle::erase(const String16& key) {
+    unparcel();
     RETURN_IF_ENTRY_ERASED(mBoolMap, key);
     RETURN_IF_ENTRY_ERASED(mIntMap, key);
     RETURN_IF_ENTRY_ERASED(mLongMap, key);
@@ -219,46 +310,57 @@ void PersistableBundle::putPersistableBundle(const String16& key, const Persista
 }
 
 bool PersistableBundle::getBoolean(const String16& key, bool* out) const {
+    unparcel();
     return getValue(key, out, mBoolMap);
 }
 
 bool PersistableBundle::getInt(const String16& key, int32_t* out) const {
+    unparcel();
     return getValue(key, out, mIntMap);
 }
 
 bool PersistableBundle::getLong(const String16& key, int64_t* out) const {
+    unparcel();
     return getValue(key, out, mLongMap);
 }
 
 bool PersistableBundle::getDouble(const String16& key, double* out) const {
+    unparcel();
     return getValue(key, out, mDoubleMap);
 }
 
 bool PersistableBundle::getString(const String16& key, String16* out) const {
+    unparcel();
     return getValue(key, out, mStringMap);
 }
 
 bool PersistableBundle::getBooleanVector(const String16& key, std::vector<bool>* out) const {
+    unparcel();
     return getValue(key, out, mBoolVectorMap);
 }
 
 bool PersistableBundle::getIntVector(const String16& key, std::vector<int32_t>* out) const {
+    unparcel();
     return getValue(key, out, mIntVectorMap);
 }
 
 bool PersistableBundle::getLongVector(const String16& key, std::vector<int64_t>* out) const {
+    unparcel();
     return getValue(key, out, mLongVectorMap);
 }
 
 bool PersistableBundle::getDoubleVector(const String16& key, std::vector<double>* out) const {
+    unparcel();
     return getValue(key, out, mDoubleVectorMap);
 }
 
 bool PersistableBundle::getStringVector(const String16& key, std::vector<String16>* out) const {
+    unparcel();
     return getValue(key, out, mStringVectorMap);
 }
 
 bool PersistableBundle::getPersistableBundle(const String16& key, PersistableBundle* out) const {
+    unparcel();
     return getValue(key, out, mPersistableBundleMap);
 }
 
@@ -335,24 +437,7 @@ status_t PersistableBundle::writeToParcelInner(Parcel* parcel) const {
     return NO_ERROR;
 }
 
-status_t PersistableBundle::readFromParcelInner(const Parcel* parcel, size_t length) {
-    /*
-     * Note: we don't actually use length for anything other than an empty PersistableBundle
-     * check, since we do not actually need to copy in an entire Parcel, unlike in the Java
-     * implementation.
-     */
-    if (length == 0) {
-        // Empty PersistableBundle or end of data.
-        return NO_ERROR;
-    }
-
-    int32_t magic;
-    RETURN_IF_FAILED(parcel->readInt32(&magic));
-    if (magic != BUNDLE_MAGIC) {
-        ALOGE("Bad magic number for PersistableBundle: 0x%08x", magic);
-        return BAD_VALUE;
-    }
-
+status_t PersistableBundle::readFromParcelInner(const Parcel* parcel) const {
     /*
      * To keep this implementation in sync with unparcel() in
      * frameworks/base/core/java/android/os/BaseBundle.java, the number of
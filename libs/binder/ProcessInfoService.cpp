@@ -22,33 +22,51 @@
 
 namespace android {
 
-ProcessInfoService::ProcessInfoService() {
+ProcessInfoService::ProcessInfoService()
+    : mDeathRecipient(new ServiceDeathRecipient()) {
+    Mutex::Autolock _l(mProcessInfoLock);
     updateBinderLocked();
 }
 
+void ProcessInfoService::ServiceDeathRecipient::binderDied(const wp<IBinder>& who) {
+    ProcessInfoService& self(ProcessInfoService::getInstance());
+    Mutex::Autolock _l(self.mProcessInfoLock);
+    if (self.mProcessInfoService != NULL &&
+            IInterface::asBinder(self.mProcessInfoService) == who.promote()) {
+        self.mProcessInfoService = NULL;
+    }
+}
+
 status_t ProcessInfoService::getProcessStatesImpl(size_t length, /*in*/ int32_t* pids,
-        /*out*/ int32_t* states) {
+        /*out*/ int32_t* states, /*out*/ int32_t* scores) {
     status_t err = NO_ERROR;
-    sp<IProcessInfoService> pis;
-    mProcessInfoLock.lock();
-    pis = mProcessInfoService;
-    mProcessInfoLock.unlock();
+    useconds_t delay = BINDER_RETRY_DELAY_US;
 
     for (int i = 0; i < BINDER_ATTEMPT_LIMIT; i++) {
-
-        if (pis != NULL) {
-            err = pis->getProcessStatesFromPids(length, /*in*/ pids, /*out*/ states);
-            if (err == NO_ERROR) return NO_ERROR; // success
-            if (IInterface::asBinder(pis)->isBinderAlive()) return err;
-        }
-        sleep(1);
-
+        sp<IProcessInfoService> pis;
         mProcessInfoLock.lock();
-        if (pis == mProcessInfoService) {
+        if (mProcessInfoService == NULL) {
             updateBinderLocked();
         }
         pis = mProcessInfoService;
         mProcessInfoLock.unlock();
+
+        if (pis == NULL) {
+            // Not registered (again) yet, give it some time.
+            usleep(delay);
+            delay *= 2;
+            continue;
+        }
+
+        err = scores != NULL
+                ? pis->getProcessStatesAndOomScoresFromPids(length, /*in*/ pids,
+                        /*out*/ states, /*out*/ scores)
+                : pis->getProcessStatesFromPids(length, /*in*/ pids, /*out*/ states);
+        if (err == NO_ERROR) return NO_ERROR; // success
+        if (IInterface::asBinder(pis)->isBinderAlive()) return err;
+
+        // It died with the call, look up its replacement right away.
+        dropBinder(pis);
     }
 
     ALOGW("%s: Could not retrieve process states from ProcessInfoService after %d retries.",
@@ -62,6 +80,18 @@ void ProcessInfoService::updateBinderLocked() {
     if (sm != NULL) {
         const String16 name("processinfo");
         mProcessInfoService = interface_cast<IProcessInfoService>(sm->checkService(name));
+        if (mProcessInfoService != NULL &&
+                IInterface::asBinder(mProcessInfoService)->linkToDeath(mDeathRecipient)
+                        == DEAD_OBJECT) {
+            mProcessInfoService = NULL;
+        }
+    }
+}
+
+void ProcessInfoService::dropBinder(const sp<IProcessInfoService>& pis) {
+    Mutex::Autolock _l(mProcessInfoLock);
+    if (pis == mProcessInfoService) {
+        mProcessInfoService = NULL;
     }
 }
 
@@ -17,6 +17,7 @@
 #define LOG_TAG "ProcessState"
 
 #include <cutils/process_name.h>
+#include <cutils/properties.h>
 
 #include <binder/ProcessState.h>
 
@@ -31,6 +32,7 @@
 
 #include <private/binder/binder_module.h>
 #include <private/binder/Static.h>
+#include <private/binder/TransactionBuffers.h>
 
 #include <errno.h>
 #include <fcntl.h>
@@ -42,7 +44,6 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
-#define BINDER_VM_SIZE ((1*1024*1024) - (4096 *2))
 #define DEFAULT_MAX_BINDER_THREADS 15
 
 // -------------------------------------------------------------------------
@@ -163,26 +164,36 @@ bool ProcessState::becomeContextManager(context_check_func checkFunc, void* user
     return mManagesContexts;
 }
 
-ProcessState::handle_entry* ProcessState::lookupHandleLocked(int32_t handle)
+ProcessState::handle_shard& ProcessState::shardForHandle(int32_t handle)
 {
-    const size_t N=mHandleToObject.size();
-    if (N <= (size_t)handle) {
+    return mHandleShards[(uint32_t)handle % HANDLE_SHARD_COUNT];
+}
+
+ProcessState::handle_entry* ProcessState::lookupHandleLocked(handle_shard& shard,
+        int32_t handle)
+{
+    if (handle < 0) return NULL;
+
+    const size_t index = (size_t)handle / HANDLE_SHARD_COUNT;
+    const size_t N=shard.entries.size();
+    if (N <= index) {
         handle_entry e;
         e.binder = NULL;
         e.refs = NULL;
-        status_t err = mHandleToObject.insertAt(e, N, handle+1-N);
+        status_t err = shard.entries.insertAt(e, N, index+1-N);
         if (err < NO_ERROR) return NULL;
     }
-    return &mHandleToObject.editItemAt(handle);
+    return &shard.entries.editItemAt(index);
 }
 
 sp<IBinder> ProcessState::getStrongProxyForHandle(int32_t handle)
 {
     sp<IBinder> result;
 
-    AutoMutex _l(mLock);
+    handle_shard& shard = shardForHandle(handle);
+    AutoMutex _l(shard.lock);
 
-    handle_entry* e = lookupHandleLocked(handle);
+    handle_entry* e = lookupHandleLocked(shard, handle);
 
     if (e != NULL) {
         // We need to create a new BpBinder if there isn't currently one, OR we
@@ -237,15 +248,16 @@ wp<IBinder> ProcessState::getWeakProxyForHandle(int32_t handle)
 {
     wp<IBinder> result;
 
-    AutoMutex _l(mLock);
+    handle_shard& shard = shardForHandle(handle);
+    AutoMutex _l(shard.lock);
 
-    handle_entry* e = lookupHandleLocked(handle);
+    handle_entry* e = lookupHandleLocked(shard, handle);
 
     if (e != NULL) {        
         // We need to create a new BpBinder if there isn't currently one, OR we
         // are unable to acquire a weak reference on this current one.  The
         // attemptIncWeak() is safe because we know the BpBinder destructor will always
-        // call expungeHandle(), which acquires the same lock we are holding now.
+        // call expungeHandle(), which acquires the same shard lock we are holding now.
         // We need to do this because there is a race condition between someone
         // releasing a reference on this BpBinder, and a new reference on its handle
         // arriving from the driver.
@@ -266,9 +278,10 @@ wp<IBinder> ProcessState::getWeakProxyForHandle(int32_t handle)
 
 void ProcessState::expungeHandle(int32_t handle, IBinder* binder)
 {
-    AutoMutex _l(mLock);
-    
-    handle_entry* e = lookupHandleLocked(handle);
+    handle_shard& shard = shardForHandle(handle);
+    AutoMutex _l(shard.lock);
+
+    handle_entry* e = lookupHandleLocked(shard, handle);
 
     // This handle may have already been replaced with a new BpBinder
     // (if someone failed the AttemptIncWeak() above); we don't want
@@ -295,16 +308,52 @@ void ProcessState::spawnPooledThread(bool isMain)
 }
 
 status_t ProcessState::setThreadPoolMaxThreadCount(size_t maxThreads) {
-    status_t result = NO_ERROR;
-    if (ioctl(mDriverFD, BINDER_SET_MAX_THREADS, &maxThreads) != -1) {
-        mMaxThreads = maxThreads;
-    } else {
-        result = -errno;
-        ALOGE("Binder ioctl to set max threads failed: %s", strerror(-result));
+    pthread_mutex_lock(&mThreadCountLock);
+    const size_t oldMaxThreads = mMaxThreads;
+    mMaxThreads = maxThreads;
+    status_t result = updateDriverMaxThreadsLocked();
+    if (result != NO_ERROR) {
+        mMaxThreads = oldMaxThreads;
     }
+    pthread_mutex_unlock(&mThreadCountLock);
     return result;
 }
 
+status_t ProcessState::updateDriverMaxThreadsLocked() {
+    size_t driverMaxThreads = mMaxThreads + mRetiredThreadCount;
+    if (ioctl(mDriverFD, BINDER_SET_MAX_THREADS, &driverMaxThreads) == -1) {
+        status_t result = -errno;
+        ALOGE("Binder ioctl to set max threads failed: %s", strerror(-result));
+        return result;
+    }
+    return NO_ERROR;
+}
+
+status_t ProcessState::setThreadPoolAdaptive(size_t maxThreads, int64_t growAfterMs,
+        int64_t idleTimeoutMs) {
+    if (growAfterMs < 0 || idleTimeoutMs < 0) {
+        return BAD_VALUE;
+    }
+    pthread_mutex_lock(&mThreadCountLock);
+    mAdaptiveMaxThreads = maxThreads;
+    mGrowAfterMs = growAfterMs;
+    mIdleTimeoutMs = idleTimeoutMs;
+    pthread_mutex_unlock(&mThreadCountLock);
+    return NO_ERROR;
+}
+
+void ProcessState::getThreadPoolStats(ThreadPoolStats* outStats) {
+    pthread_mutex_lock(&mThreadCountLock);
+    outStats->threads = mPoolThreadCount;
+    outStats->executingThreads = mExecutingThreadsCount;
+    outStats->maxThreads = mMaxThreads;
+    outStats->starvationCount = mStarvationCount;
+    outStats->totalStarvationMs = mTotalStarvationMs;
+    outStats->maxStarvationMs = mMaxStarvationMs;
+    outStats->retiredThreads = mRetiredThreadCount;
+    pthread_mutex_unlock(&mThreadCountLock);
+}
+
 void ProcessState::giveThreadPoolName() {
     androidSetThreadName( makeBinderThreadName().string() );
 }
@@ -344,6 +393,14 @@ ProcessState::ProcessState()
     , mExecutingThreadsCount(0)
     , mMaxThreads(DEFAULT_MAX_BINDER_THREADS)
     , mStarvationStartTimeMs(0)
+    , mAdaptiveMaxThreads(0)
+    , mGrowAfterMs(0)
+    , mIdleTimeoutMs(0)
+    , mPoolThreadCount(0)
+    , mRetiredThreadCount(0)
+    , mStarvationCount(0)
+    , mTotalStarvationMs(0)
+    , mMaxStarvationMs(0)
     , mManagesContexts(false)
     , mBinderContextCheckFunc(NULL)
     , mBinderContextUserData(NULL)
@@ -362,6 +419,10 @@ ProcessState::ProcessState()
     }
 
     LOG_ALWAYS_FATAL_IF(mDriverFD < 0, "Binder driver could not be opened.  Terminating.");
+
+    if (property_get_bool("debug.binder.stats", false)) {
+        IPCThreadState::setTransactionStatsEnabled(true);
+    }
 }
 
 ProcessState::~ProcessState()
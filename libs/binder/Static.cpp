@@ -39,8 +39,10 @@ protected:
     virtual status_t writeLines(const struct iovec& vec, size_t N)
     {
         //android_writevLog(&vec, N);       <-- this is now a no-op
-        if (N != 1) ALOGI("WARNING: writeLines N=%zu\n", N);
-        ALOGI("%.*s", (int)vec.iov_len, (const char*) vec.iov_base);
+        const struct iovec* vecs = &vec;
+        for (size_t i = 0; i < N; i++) {
+            ALOGI("%.*s", (int)vecs[i].iov_len, (const char*) vecs[i].iov_base);
+        }
         return NO_ERROR;
     }
 };
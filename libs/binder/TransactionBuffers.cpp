@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "TransactionBuffers"
+
+#include <private/binder/TransactionBuffers.h>
+#include <private/binder/TransactionStats.h>
+
+#include <cutils/properties.h>
+
+#include <utils/KeyedVector.h>
+#include <utils/Log.h>
+#include <utils/Mutex.h>
+#include <utils/String16.h>
+#include <utils/String8.h>
+#include <utils/Vector.h>
+
+#include <atomic>
+#include <stdlib.h>
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+// Outstanding bytes at which the warning is logged, and below which it is
+// armed again.
+static const size_t kWarnBytes = BINDER_VM_SIZE / 4 * 3;
+static const size_t kRearmBytes = BINDER_VM_SIZE / 2;
+
+// Call sites listed in the warning.
+static const size_t kMaxWarnedSites = 5;
+
+struct BufferRecord {
+    size_t size;
+    bool incoming;
+    int32_t handle;
+    uint32_t code;
+};
+
+struct CallSite {
+    String8 name;
+    size_t buffers;
+    size_t bytes;
+};
+
+// Every binder thread of the process goes through here, so the totals
+// are atomics rather than anything behind a lock.
+static std::atomic<size_t> gOutstandingBytes(0);
+static std::atomic<size_t> gOutstandingBuffers(0);
+static std::atomic<size_t> gPeakBytes(0);
+static std::atomic<bool> gWarned(false);
+
+// The buffers themselves are only kept track of, keyed by the start of the
+// buffer in the mapping, when debug.binder.buffer_sites is set at startup.
+static Mutex gBuffersLock;
+static KeyedVector<const uint8_t*, BufferRecord> gBuffers;
+
+static bool trackSites()
+{
+    static const bool track = [] {
+        char value[PROPERTY_VALUE_MAX];
+        property_get("debug.binder.buffer_sites", value, "0");
+        return atoi(value) != 0;
+    }();
+    return track;
+}
+
+// The buffers are still mapped while they are outstanding, so the
+// descriptor of an incoming transaction is looked up only when needed.
+static String8 callSiteName(const uint8_t* data, const BufferRecord& r)
+{
+    if (!r.incoming) {
+        return String8::format("reply handle=%d code=%u", r.handle, r.code);
+    }
+    const char16_t* str;
+    size_t len;
+    if (TransactionStats::peekDescriptor(data, r.size, &str, &len)) {
+        return String8::format("in %s code=%u", String8(str, len).string(), r.code);
+    }
+    return String8::format("in <unknown> code=%u", r.code);
+}
+
+static void collectCallSitesLocked(Vector<CallSite>* sites)
+{
+    for (size_t i = 0; i < gBuffers.size(); i++) {
+        const BufferRecord& r = gBuffers.valueAt(i);
+        const String8 name(callSiteName(gBuffers.keyAt(i), r));
+        size_t j = 0;
+        while (j < sites->size() && sites->itemAt(j).name != name) {
+            j++;
+        }
+        if (j == sites->size()) {
+            CallSite site;
+            site.name = name;
+            site.buffers = 0;
+            site.bytes = 0;
+            sites->add(site);
+        }
+        CallSite& site = sites->editItemAt(j);
+        site.buffers++;
+        site.bytes += r.size;
+    }
+    // A handful of call sites at most, a selection sort will do.
+    for (size_t i = 0; i < sites->size(); i++) {
+        size_t largest = i;
+        for (size_t j = i + 1; j < sites->size(); j++) {
+            if (sites->itemAt(j).bytes > sites->itemAt(largest).bytes) {
+                largest = j;
+            }
+        }
+        if (largest != i) {
+            const CallSite tmp(sites->itemAt(i));
+            sites->editItemAt(i) = sites->itemAt(largest);
+            sites->editItemAt(largest) = tmp;
+        }
+    }
+}
+
+static void warn(size_t outstanding)
+{
+    ALOGW("%zu of %d bytes of binder transaction buffers outstanding in %zu buffers;"
+            " parcels received from the driver are being held on to",
+            outstanding, BINDER_VM_SIZE, gOutstandingBuffers.load());
+    if (!trackSites()) {
+        return;
+    }
+    Vector<CallSite> sites;
+    {
+        AutoMutex _l(gBuffersLock);
+        collectCallSitesLocked(&sites);
+    }
+    for (size_t i = 0; i < sites.size() && i < kMaxWarnedSites; i++) {
+        const CallSite& s = sites[i];
+        ALOGW("  %s: %zu buffers, %zu bytes", s.name.string(), s.buffers, s.bytes);
+    }
+}
+
+// ---------------------------------------------------------------------------
+
+void TransactionBuffers::received(const uint8_t* data, size_t size,
+        bool incoming, int32_t handle, uint32_t code)
+{
+    const size_t outstanding =
+            gOutstandingBytes.fetch_add(size, std::memory_order_relaxed) + size;
+    gOutstandingBuffers.fetch_add(1, std::memory_order_relaxed);
+    size_t peak = gPeakBytes.load(std::memory_order_relaxed);
+    while (outstanding > peak && !gPeakBytes.compare_exchange_weak(peak,
+            outstanding, std::memory_order_relaxed)) {
+    }
+
+    if (trackSites()) {
+        BufferRecord r;
+        r.size = size;
+        r.incoming = incoming;
+        r.handle = handle;
+        r.code = code;
+        AutoMutex _l(gBuffersLock);
+        gBuffers.add(data, r);
+    }
+
+    if (outstanding >= kWarnBytes && !gWarned.load(std::memory_order_relaxed) &&
+            !gWarned.exchange(true)) {
+        warn(outstanding);
+    }
+}
+
+void TransactionBuffers::freed(const uint8_t* data, size_t size)
+{
+    if (trackSites()) {
+        AutoMutex _l(gBuffersLock);
+        const ssize_t i = gBuffers.indexOfKey(data);
+        if (i >= 0) {
+            gBuffers.removeItemsAt(i);
+        }
+    }
+
+    const size_t outstanding =
+            gOutstandingBytes.fetch_sub(size, std::memory_order_relaxed) - size;
+    gOutstandingBuffers.fetch_sub(1, std::memory_order_relaxed);
+    if (outstanding < kRearmBytes && gWarned.load(std::memory_order_relaxed)) {
+        gWarned.store(false);
+    }
+}
+
+size_t TransactionBuffers::outstandingBytes()
+{
+    return gOutstandingBytes.load();
+}
+
+void TransactionBuffers::dump(String8& result)
+{
+    result.appendFormat("Binder transaction buffers: %zu outstanding, %zu of %d bytes"
+            " (peak %zu):\n", gOutstandingBuffers.load(), gOutstandingBytes.load(),
+            BINDER_VM_SIZE, gPeakBytes.load());
+    if (!trackSites()) {
+        result.append("  call sites not tracked, set debug.binder.buffer_sites\n");
+        return;
+    }
+    Vector<CallSite> sites;
+    {
+        AutoMutex _l(gBuffersLock);
+        collectCallSitesLocked(&sites);
+    }
+    for (size_t i = 0; i < sites.size(); i++) {
+        const CallSite& s = sites[i];
+        result.appendFormat("  %s: %zu buffers, %zu bytes\n",
+                s.name.string(), s.buffers, s.bytes);
+    }
+}
+
+}; // namespace android
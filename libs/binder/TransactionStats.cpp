@@ -0,0 +1,371 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "TransactionStats"
+
+#include <private/binder/TransactionStats.h>
+
+#include <cutils/trace.h>
+#include <utils/KeyedVector.h>
+#include <utils/Log.h>
+#include <utils/Mutex.h>
+#include <utils/String8.h>
+#include <utils/Vector.h>
+
+#include <inttypes.h>
+#include <string.h>
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+std::atomic<bool> TransactionStats::sEnabled(false);
+
+// Registered per-thread tables, and the totals of threads that have exited.
+static Mutex gStatsLock;
+static Vector<TransactionStats*> gStatsTables;
+static TransactionStats* gRetiredStats = NULL;
+
+// Longest interface descriptor we bother to look at.
+static const size_t kMaxDescriptorLength = 256;
+
+// Finds the interface descriptor in a payload that starts with the header
+// written by Parcel::writeInterfaceToken(): the strict mode policy followed
+// by the descriptor as a String16.
+bool TransactionStats::peekDescriptor(const uint8_t* data, size_t dataSize,
+        const char16_t** outStr, size_t* outLen)
+{
+    if (data == NULL || dataSize < 2 * sizeof(int32_t)) {
+        return false;
+    }
+    int32_t len;
+    memcpy(&len, data + sizeof(int32_t), sizeof(len));
+    if (len <= 0 || (size_t)len > kMaxDescriptorLength) {
+        return false;
+    }
+    const size_t bytes = ((size_t)len + 1) * sizeof(char16_t);
+    if (bytes > dataSize - 2 * sizeof(int32_t)) {
+        return false;
+    }
+    const char16_t* str = reinterpret_cast<const char16_t*>(data + 2 * sizeof(int32_t));
+    if (str[len] != 0) {
+        return false;
+    }
+    *outStr = str;
+    *outLen = len;
+    return true;
+}
+
+static uint64_t makeKey(bool incoming, uint32_t code, const char16_t* str, size_t len)
+{
+    // FNV-1a over the descriptor, then the code and direction.
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ str[i]) * 1099511628211ULL;
+    }
+    hash = (hash ^ code) * 1099511628211ULL;
+    hash = (hash ^ (incoming ? 1 : 2)) * 1099511628211ULL;
+    return hash ? hash : 1;
+}
+
+static size_t bucketFor(nsecs_t wallTime)
+{
+    const uint64_t us = wallTime > 0 ? (uint64_t)wallTime / 1000 : 0;
+    if (us < 2) {
+        return 0;
+    }
+    const size_t bucket = 63 - __builtin_clzll(us);
+    return bucket < TransactionStats::NUM_BUCKETS ? bucket
+            : TransactionStats::NUM_BUCKETS - 1;
+}
+
+// ---------------------------------------------------------------------------
+
+TransactionStats::TransactionStats()
+    : mOverflow(0)
+{
+    for (size_t i = 0; i < NUM_ENTRIES; i++) {
+        Entry& e = mEntries[i];
+        e.key.store(0, std::memory_order_relaxed);
+        e.code = 0;
+        e.incoming = false;
+        e.count.store(0, std::memory_order_relaxed);
+        e.wallTime.store(0, std::memory_order_relaxed);
+        e.cpuTime.store(0, std::memory_order_relaxed);
+        e.bytes.store(0, std::memory_order_relaxed);
+        e.objects.store(0, std::memory_order_relaxed);
+        for (size_t b = 0; b < NUM_BUCKETS; b++) {
+            e.buckets[b].store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+TransactionStats::~TransactionStats()
+{
+}
+
+void TransactionStats::setEnabled(bool enabled)
+{
+    sEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+TransactionStats* TransactionStats::create()
+{
+    TransactionStats* stats = new TransactionStats();
+    Mutex::Autolock _l(gStatsLock);
+    gStatsTables.push(stats);
+    return stats;
+}
+
+void TransactionStats::retire(TransactionStats* stats)
+{
+    if (stats == NULL) {
+        return;
+    }
+
+    Mutex::Autolock _l(gStatsLock);
+    for (size_t i = 0; i < gStatsTables.size(); i++) {
+        if (gStatsTables[i] == stats) {
+            gStatsTables.removeAt(i);
+            break;
+        }
+    }
+
+    // The retired table is only ever touched under gStatsLock.
+    if (gRetiredStats == NULL) {
+        gRetiredStats = new TransactionStats();
+    }
+    for (size_t i = 0; i < NUM_ENTRIES; i++) {
+        const Entry& from = stats->mEntries[i];
+        const uint64_t key = from.key.load(std::memory_order_acquire);
+        if (key == 0) {
+            continue;
+        }
+        Entry* to = gRetiredStats->findOrInsert(key, from.incoming, from.code,
+                from.descriptor.string(), from.descriptor.size());
+        if (to == NULL) {
+            gRetiredStats->mOverflow += from.count.load(std::memory_order_relaxed);
+            continue;
+        }
+        to->count += from.count.load(std::memory_order_relaxed);
+        to->wallTime += from.wallTime.load(std::memory_order_relaxed);
+        to->cpuTime += from.cpuTime.load(std::memory_order_relaxed);
+        to->bytes += from.bytes.load(std::memory_order_relaxed);
+        to->objects += from.objects.load(std::memory_order_relaxed);
+        for (size_t b = 0; b < NUM_BUCKETS; b++) {
+            to->buckets[b] += from.buckets[b].load(std::memory_order_relaxed);
+        }
+    }
+    gRetiredStats->mOverflow += stats->mOverflow.load(std::memory_order_relaxed);
+    delete stats;
+}
+
+TransactionStats::Entry* TransactionStats::findOrInsert(uint64_t key, bool incoming,
+        uint32_t code, const char16_t* descriptor, size_t len)
+{
+    for (size_t probe = 0; probe < NUM_ENTRIES; probe++) {
+        Entry& e = mEntries[(key + probe) % NUM_ENTRIES];
+        const uint64_t k = e.key.load(std::memory_order_relaxed);
+        if (k == key) {
+            return &e;
+        }
+        if (k == 0) {
+            // Fill in the identity before publishing the key; readers
+            // acquire the key and may then look at the rest.
+            e.descriptor.setTo(descriptor, len);
+            e.code = code;
+            e.incoming = incoming;
+            e.key.store(key, std::memory_order_release);
+            return &e;
+        }
+    }
+    return NULL;
+}
+
+void TransactionStats::record(bool incoming, uint32_t code,
+        const uint8_t* data, size_t dataSize, size_t objectCount,
+        nsecs_t wallTime, nsecs_t cpuTime)
+{
+    static const char16_t kUnknown[] = { 0 };
+    const char16_t* descriptor = kUnknown;
+    size_t len = 0;
+    peekDescriptor(data, dataSize, &descriptor, &len);
+
+    Entry* e = findOrInsert(makeKey(incoming, code, descriptor, len),
+            incoming, code, descriptor, len);
+    if (e == NULL) {
+        mOverflow.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    e->count.fetch_add(1, std::memory_order_relaxed);
+    e->wallTime.fetch_add(wallTime > 0 ? wallTime : 0, std::memory_order_relaxed);
+    e->cpuTime.fetch_add(cpuTime > 0 ? cpuTime : 0, std::memory_order_relaxed);
+    e->bytes.fetch_add(dataSize, std::memory_order_relaxed);
+    e->objects.fetch_add(objectCount, std::memory_order_relaxed);
+    e->buckets[bucketFor(wallTime)].fetch_add(1, std::memory_order_relaxed);
+}
+
+// ---------------------------------------------------------------------------
+
+namespace {
+
+struct Summary {
+    String16 descriptor;
+    uint32_t code;
+    bool incoming;
+    uint64_t count;
+    uint64_t wallTime;
+    uint64_t cpuTime;
+    uint64_t bytes;
+    uint64_t objects;
+    uint64_t buckets[TransactionStats::NUM_BUCKETS];
+};
+
+// Upper bound, in microseconds, of the bucket holding the given fraction.
+uint64_t percentileUs(const Summary& s, double fraction)
+{
+    const uint64_t target = (uint64_t)(s.count * fraction);
+    uint64_t seen = 0;
+    for (size_t b = 0; b < TransactionStats::NUM_BUCKETS; b++) {
+        seen += s.buckets[b];
+        if (seen > target) {
+            return 2ULL << b;
+        }
+    }
+    return 2ULL << (TransactionStats::NUM_BUCKETS - 1);
+}
+
+void accumulate(KeyedVector<uint64_t, Summary>& totals, const TransactionStats::Entry& e)
+{
+    const uint64_t key = e.key.load(std::memory_order_acquire);
+    if (key == 0) {
+        return;
+    }
+    ssize_t index = totals.indexOfKey(key);
+    if (index < 0) {
+        Summary s;
+        s.descriptor = e.descriptor;
+        s.code = e.code;
+        s.incoming = e.incoming;
+        s.count = s.wallTime = s.cpuTime = s.bytes = s.objects = 0;
+        memset(s.buckets, 0, sizeof(s.buckets));
+        index = totals.add(key, s);
+    }
+    Summary& s = totals.editValueAt(index);
+    s.count += e.count.load(std::memory_order_relaxed);
+    s.wallTime += e.wallTime.load(std::memory_order_relaxed);
+    s.cpuTime += e.cpuTime.load(std::memory_order_relaxed);
+    s.bytes += e.bytes.load(std::memory_order_relaxed);
+    s.objects += e.objects.load(std::memory_order_relaxed);
+    for (size_t b = 0; b < TransactionStats::NUM_BUCKETS; b++) {
+        s.buckets[b] += e.buckets[b].load(std::memory_order_relaxed);
+    }
+}
+
+void accumulateVisitor(const TransactionStats::Entry& e, void* cookie)
+{
+    accumulate(*static_cast<KeyedVector<uint64_t, Summary>*>(cookie), e);
+}
+
+} // namespace
+
+size_t TransactionStats::collectLocked(void (*visit)(const Entry& e, void* cookie),
+        void* cookie, uint64_t* outOverflow)
+{
+    *outOverflow = 0;
+    for (size_t t = 0; t < gStatsTables.size(); t++) {
+        const TransactionStats* stats = gStatsTables[t];
+        for (size_t i = 0; i < NUM_ENTRIES; i++) {
+            visit(stats->mEntries[i], cookie);
+        }
+        *outOverflow += stats->mOverflow.load(std::memory_order_relaxed);
+    }
+    if (gRetiredStats != NULL) {
+        for (size_t i = 0; i < NUM_ENTRIES; i++) {
+            visit(gRetiredStats->mEntries[i], cookie);
+        }
+        *outOverflow += gRetiredStats->mOverflow.load(std::memory_order_relaxed);
+    }
+    return gStatsTables.size();
+}
+
+void TransactionStats::dump(String8& result)
+{
+    KeyedVector<uint64_t, Summary> totals;
+    uint64_t overflow;
+    size_t threads;
+    {
+        Mutex::Autolock _l(gStatsLock);
+        threads = collectLocked(accumulateVisitor, &totals, &overflow);
+    }
+
+    result.appendFormat("Binder transaction stats (%s, %zu threads):\n",
+            isEnabled() ? "enabled" : "disabled", threads);
+    for (size_t i = 0; i < totals.size(); i++) {
+        const Summary& s = totals.valueAt(i);
+        if (s.count == 0) {
+            continue;
+        }
+        result.appendFormat("  %s %s code=%u count=%" PRIu64
+                " wall avg=%" PRIu64 "us p50<%" PRIu64 "us p99<%" PRIu64
+                "us p999<%" PRIu64 "us cpu avg=%" PRIu64 "us"
+                " bytes avg=%" PRIu64 " objects avg=%" PRIu64 "\n",
+                s.incoming ? "in " : "out",
+                s.descriptor.size() ? String8(s.descriptor).string() : "<unknown>",
+                s.code, s.count,
+                s.wallTime / s.count / 1000,
+                percentileUs(s, 0.5), percentileUs(s, 0.99), percentileUs(s, 0.999),
+                s.cpuTime / s.count / 1000,
+                s.bytes / s.count, s.objects / s.count);
+    }
+    if (overflow) {
+        result.appendFormat("  (%" PRIu64 " transactions not tracked: table full)\n",
+                overflow);
+    }
+}
+
+void TransactionStats::trace(uint64_t tag)
+{
+    if (!atrace_is_tag_enabled(tag)) {
+        return;
+    }
+
+    KeyedVector<uint64_t, Summary> totals;
+    uint64_t overflow;
+    {
+        Mutex::Autolock _l(gStatsLock);
+        collectLocked(accumulateVisitor, &totals, &overflow);
+    }
+
+    for (size_t i = 0; i < totals.size(); i++) {
+        const Summary& s = totals.valueAt(i);
+        if (s.count == 0) {
+            continue;
+        }
+        String8 prefix = String8::format("binder:%s:%s#%u",
+                s.incoming ? "in" : "out",
+                s.descriptor.size() ? String8(s.descriptor).string() : "unknown",
+                s.code);
+        atrace_int64(tag, String8::format("%s:count", prefix.string()).string(), s.count);
+        atrace_int64(tag, String8::format("%s:p50_us", prefix.string()).string(),
+                percentileUs(s, 0.5));
+        atrace_int64(tag, String8::format("%s:p99_us", prefix.string()).string(),
+                percentileUs(s, 0.99));
+    }
+}
+
+}; // namespace android
@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <binder/AppOpsManager.h>
+#include <binder/IAppOpsService.h>
+
+#include <utils/Mutex.h>
+
+using namespace android;
+
+namespace {
+
+const int32_t kOp = AppOpsManager::OP_CAMERA;
+const int32_t kUid = 10001;
+
+// Counts the checks that reach it, and keeps the callback it's asked to
+// report changes to, so the tests can report them.
+class FakeAppOpsService : public BnAppOpsService {
+public:
+    FakeAppOpsService() : mChecks(0) {}
+
+    virtual int32_t checkOperation(int32_t, int32_t, const String16&) {
+        Mutex::Autolock _l(mLock);
+        mChecks++;
+        return AppOpsManager::MODE_ALLOWED;
+    }
+    virtual int32_t noteOperation(int32_t, int32_t, const String16&) {
+        return AppOpsManager::MODE_ALLOWED;
+    }
+    virtual int32_t startOperation(const sp<IBinder>&, int32_t, int32_t,
+            const String16&) {
+        return AppOpsManager::MODE_ALLOWED;
+    }
+    virtual void finishOperation(const sp<IBinder>&, int32_t, int32_t,
+            const String16&) {
+    }
+    virtual void startWatchingMode(int32_t, const String16&,
+            const sp<IAppOpsCallback>& callback) {
+        Mutex::Autolock _l(mLock);
+        mCallback = callback;
+    }
+    virtual void stopWatchingMode(const sp<IAppOpsCallback>&) {
+    }
+    virtual sp<IBinder> getToken(const sp<IBinder>& clientToken) {
+        return clientToken;
+    }
+    virtual int32_t permissionToOpCode(const String16&) {
+        return -1;
+    }
+
+    int checks() {
+        Mutex::Autolock _l(mLock);
+        return mChecks;
+    }
+
+    sp<IAppOpsCallback> callback() {
+        Mutex::Autolock _l(mLock);
+        return mCallback;
+    }
+
+private:
+    Mutex mLock;
+    int mChecks;
+    sp<IAppOpsCallback> mCallback;
+};
+
+class AppOpsManagerTest : public ::testing::Test {
+protected:
+    AppOpsManagerTest()
+        : mService(new FakeAppOpsService()),
+          mAppOps(mService),
+          mPackage(String16("com.example.one")),
+          mOtherPackage(String16("com.example.two")) {
+    }
+
+    sp<FakeAppOpsService> mService;
+    AppOpsManager mAppOps;
+    String16 mPackage;
+    String16 mOtherPackage;
+};
+
+TEST_F(AppOpsManagerTest, RepeatedCheckIsCached) {
+    mAppOps.checkOp(kOp, kUid, mPackage);
+    mAppOps.checkOp(kOp, kUid, mPackage);
+    EXPECT_EQ(1, mService->checks());
+    ASSERT_TRUE(mService->callback() != NULL);
+}
+
+TEST_F(AppOpsManagerTest, PackageChangeKeepsOtherPackages) {
+    mAppOps.checkOp(kOp, kUid, mPackage);
+    mAppOps.checkOp(kOp, kUid, mOtherPackage);
+    ASSERT_EQ(2, mService->checks());
+    ASSERT_TRUE(mService->callback() != NULL);
+
+    mService->callback()->opChanged(kOp, mPackage);
+
+    mAppOps.checkOp(kOp, kUid, mPackage);
+    EXPECT_EQ(3, mService->checks());
+    mAppOps.checkOp(kOp, kUid, mOtherPackage);
+    EXPECT_EQ(3, mService->checks());
+}
+
+TEST_F(AppOpsManagerTest, NullPackageChangeDropsEveryPackage) {
+    mAppOps.checkOp(kOp, kUid, mPackage);
+    mAppOps.checkOp(kOp, kUid, mOtherPackage);
+    mAppOps.checkOp(AppOpsManager::OP_RECORD_AUDIO, kUid, mPackage);
+    ASSERT_EQ(3, mService->checks());
+    ASSERT_TRUE(mService->callback() != NULL);
+
+    // user restrictions and uid modes are reported without a package
+    mService->callback()->opChanged(kOp, String16());
+
+    mAppOps.checkOp(kOp, kUid, mPackage);
+    mAppOps.checkOp(kOp, kUid, mOtherPackage);
+    EXPECT_EQ(5, mService->checks());
+    mAppOps.checkOp(AppOpsManager::OP_RECORD_AUDIO, kUid, mPackage);
+    EXPECT_EQ(5, mService->checks());
+}
+
+} // namespace
@@ -20,6 +20,9 @@
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/stat.h>
+
+#include <vector>
 
 #include <gtest/gtest.h>
 
@@ -348,6 +351,27 @@ TEST_F(BinderLibTest, GetId) {
     EXPECT_EQ(0, id);
 }
 
+TEST_F(BinderLibTest, ReleaseTransactionBuffer) {
+    status_t ret;
+    int32_t id;
+    Parcel data, reply;
+    const size_t outstanding = IPCThreadState::getOutstandingBufferBytes();
+    ret = m_server->transact(BINDER_LIB_TEST_GET_ID_TRANSACTION, data, &reply);
+    EXPECT_EQ(NO_ERROR, ret);
+    EXPECT_GT(IPCThreadState::getOutstandingBufferBytes(), outstanding);
+
+    ret = reply.releaseTransactionBuffer();
+    EXPECT_EQ(NO_ERROR, ret);
+    EXPECT_EQ(outstanding, IPCThreadState::getOutstandingBufferBytes());
+    ret = reply.readInt32(&id);
+    EXPECT_EQ(NO_ERROR, ret);
+    EXPECT_EQ(0, id);
+
+    // a parcel of its own already
+    ret = reply.releaseTransactionBuffer();
+    EXPECT_EQ(NO_ERROR, ret);
+}
+
 TEST_F(BinderLibTest, PtrSize) {
     status_t ret;
     int32_t ptrsize;
@@ -483,6 +507,36 @@ TEST_F(BinderLibTest, CallBack)
     EXPECT_EQ(NO_ERROR, ret);
 }
 
+TEST_F(BinderLibTest, OneWayBatch)
+{
+    status_t ret;
+    const int callBackCount = 4;
+    sp<BinderLibTestCallBack> callBack[callBackCount];
+    uint64_t transactionsBefore, transactionsAfter;
+    IPCThreadState* ipc = IPCThreadState::self();
+
+    IPCThreadState::getDriverStats(NULL, &transactionsBefore);
+    ipc->beginOneWayBatch();
+    for (int i = 0; i < callBackCount; i++) {
+        Parcel data, reply;
+        callBack[i] = new BinderLibTestCallBack();
+        data.writeStrongBinder(callBack[i]);
+        ret = m_server->transact(BINDER_LIB_TEST_NOP_CALL_BACK, data, &reply, TF_ONE_WAY);
+        EXPECT_EQ(NO_ERROR, ret);
+    }
+    ret = ipc->endOneWayBatch();
+    EXPECT_EQ(NO_ERROR, ret);
+    IPCThreadState::getDriverStats(NULL, &transactionsAfter);
+    EXPECT_EQ(transactionsBefore + callBackCount, transactionsAfter);
+
+    for (int i = 0; i < callBackCount; i++) {
+        ret = callBack[i]->waitEvent(5);
+        EXPECT_EQ(NO_ERROR, ret);
+        ret = callBack[i]->getResult();
+        EXPECT_EQ(NO_ERROR, ret);
+    }
+}
+
 TEST_F(BinderLibTest, AddServer)
 {
     sp<IBinder> server = addServer();
@@ -644,6 +698,55 @@ TEST_F(BinderLibTest, PassFile) {
     close(pipefd[0]);
 }
 
+TEST_F(BinderLibTest, FileDescriptorVector) {
+    int ret;
+    int pipefd[2];
+
+    ret = pipe2(pipefd, O_NONBLOCK);
+    ASSERT_EQ(0, ret);
+
+    std::vector<ScopedFd> fds;
+    for (int i = 0; i < 32; i++) {
+        fds.emplace_back(dup(pipefd[i % 2]));
+    }
+
+    Parcel data;
+    ret = data.writeUniqueFileDescriptorVector(fds);
+    EXPECT_EQ(NO_ERROR, ret);
+    EXPECT_TRUE(data.hasFileDescriptors());
+    EXPECT_EQ(fds.size(), data.objectsCount());
+
+    data.setDataPosition(0);
+    std::vector<ScopedFd> received;
+    ret = data.readUniqueFileDescriptorVector(&received);
+    EXPECT_EQ(NO_ERROR, ret);
+    ASSERT_EQ(fds.size(), received.size());
+    for (size_t i = 0; i < fds.size(); i++) {
+        struct stat sent, got;
+        ASSERT_EQ(0, fstat(fds[i].get(), &sent));
+        ASSERT_EQ(0, fstat(received[i].get(), &got));
+        EXPECT_EQ(sent.st_ino, got.st_ino);
+        EXPECT_NE(fds[i].get(), received[i].get());
+    }
+
+    // a count the parcel can't hold is rejected before allocating for it
+    Parcel bogus;
+    bogus.writeInt32(0x40000000);
+    bogus.setDataPosition(0);
+    ret = bogus.readUniqueFileDescriptorVector(&received);
+    EXPECT_EQ(BAD_VALUE, ret);
+
+    // nothing of the vector is written when fds aren't allowed
+    Parcel noFds;
+    noFds.pushAllowFds(false);
+    ret = noFds.writeUniqueFileDescriptorVector(fds);
+    EXPECT_EQ(FDS_NOT_ALLOWED, ret);
+    EXPECT_EQ(0u, noFds.dataSize());
+
+    close(pipefd[0]);
+    close(pipefd[1]);
+}
+
 TEST_F(BinderLibTest, PromoteLocal) {
     sp<IBinder> strong = new BBinder();
     wp<IBinder> weak = strong;
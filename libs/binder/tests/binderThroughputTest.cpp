@@ -3,6 +3,7 @@
 #include <binder/IPCThreadState.h>
 #include <binder/IServiceManager.h>
 #include <string>
+#include <cstdint>
 #include <cstring>
 #include <cstdlib>
 #include <cstdio>
@@ -11,6 +12,8 @@
 #include <vector>
 #include <tuple>
 
+#include <fcntl.h>
+#include <sched.h>
 #include <unistd.h>
 #include <sys/wait.h>
 
@@ -84,8 +87,15 @@ public:
         ASSERT_TRUE(error >= 0);
     }
     template <typename T> void recv(T& v) {
-        int error = read(m_readFd, &v, sizeof(T));
-        ASSERT_TRUE(error >= 0);
+        // Results are larger than PIPE_BUF, so they may arrive in pieces.
+        uint8_t* dst = reinterpret_cast<uint8_t*>(&v);
+        size_t remaining = sizeof(T);
+        while (remaining > 0) {
+            int error = read(m_readFd, dst, remaining);
+            ASSERT_TRUE(error > 0);
+            dst += error;
+            remaining -= error;
+        }
     }
     static tuple<Pipe, Pipe> createPipePair() {
         int a[2];
@@ -100,13 +110,15 @@ public:
     }
 };
 
-static const uint32_t num_buckets = 128;
-static const uint64_t max_time_bucket = 50ull * 1000000;
-static const uint64_t time_per_bucket = max_time_bucket / num_buckets;
+// Latency histogram with 1us buckets up to 10ms, so that the p999 of a
+// fast path is still resolvable; anything slower lands in the last bucket.
+static const uint32_t num_buckets = 10000;
+static const uint64_t time_per_bucket = 1000;
+static const uint64_t max_time_bucket = num_buckets * time_per_bucket;
 static constexpr float time_per_bucket_ms = time_per_bucket / 1.0E6;
 
 struct ProcResults {
-    uint64_t m_best = max_time_bucket;
+    uint64_t m_best = UINT64_MAX;
     uint64_t m_worst = 0;
     uint32_t m_buckets[num_buckets] = {0};
     uint64_t m_transactions = 0;
@@ -130,31 +142,63 @@ struct ProcResults {
         ret.m_total_time = a.m_total_time + b.m_total_time;
         return ret;
     }
-    void dump() {
-        double best = (double)m_best / 1.0E6;
-        double worst = (double)m_worst / 1.0E6;
-        double average = (double)m_total_time / m_transactions / 1.0E6;
-        cout << "average:" << average << "ms worst:" << worst << "ms best:" << best << "ms" << endl;
-
+    // Midpoint, in ms, of the bucket holding the given fraction of samples.
+    float percentile(float fraction) const {
         uint64_t cur_total = 0;
         for (int i = 0; i < num_buckets; i++) {
-            float cur_time = time_per_bucket_ms * i + 0.5f * time_per_bucket_ms;
-            if ((cur_total < 0.5f * m_transactions) && (cur_total + m_buckets[i] >= 0.5f * m_transactions)) {
-                cout << "50%: " << cur_time << " ";
-            }
-            if ((cur_total < 0.9f * m_transactions) && (cur_total + m_buckets[i] >= 0.9f * m_transactions)) {
-                cout << "90%: " << cur_time << " ";
-            }
-            if ((cur_total < 0.95f * m_transactions) && (cur_total + m_buckets[i] >= 0.95f * m_transactions)) {
-                cout << "95%: " << cur_time << " ";
-            }
-            if ((cur_total < 0.99f * m_transactions) && (cur_total + m_buckets[i] >= 0.99f * m_transactions)) {
-                cout << "99%: " << cur_time << " ";
-            }
             cur_total += m_buckets[i];
+            if (cur_total >= fraction * m_transactions) {
+                return time_per_bucket_ms * i + 0.5f * time_per_bucket_ms;
+            }
         }
-        cout << endl;
+        return time_per_bucket_ms * num_buckets;
+    }
+    void dump() const {
+        double best = (double)m_best / 1.0E6;
+        double worst = (double)m_worst / 1.0E6;
+        double average = (double)m_total_time / m_transactions / 1.0E6;
+        cout << "average:" << average << "ms worst:" << worst << "ms best:" << best << "ms" << endl;
+        cout << "50%: " << percentile(0.5f) << " "
+             << "90%: " << percentile(0.9f) << " "
+             << "95%: " << percentile(0.95f) << " "
+             << "99%: " << percentile(0.99f) << " "
+             << "99.9%: " << percentile(0.999f) << endl;
+    }
+    // One line of JSON, for tracking regressions across builds.
+    void dumpJson(const string& name, double iterations_per_sec) const {
+        cout << "{\"name\":\"" << name << "\""
+             << ",\"transactions\":" << m_transactions
+             << ",\"iterations_per_sec\":" << iterations_per_sec
+             << ",\"avg_ms\":" << (double)m_total_time / m_transactions / 1.0E6
+             << ",\"best_ms\":" << (double)m_best / 1.0E6
+             << ",\"worst_ms\":" << (double)m_worst / 1.0E6
+             << ",\"p50_ms\":" << percentile(0.5f)
+             << ",\"p90_ms\":" << percentile(0.9f)
+             << ",\"p99_ms\":" << percentile(0.99f)
+             << ",\"p999_ms\":" << percentile(0.999f)
+             << "}" << endl;
+    }
+};
 
+// What each transaction carries and how it is sent.
+struct Workload {
+    int payload_size = 0;
+    int fd_count = 0;
+    int binder_count = 0;
+    bool one_way = false;
+    // All workers call worker 0 instead of a random peer.
+    bool single_target = false;
+    // Run clients at SCHED_FIFO to exercise priority inheritance.
+    bool realtime = false;
+
+    string name() const {
+        string n = "size=" + to_string(payload_size) +
+                ",fds=" + to_string(fd_count) +
+                ",binders=" + to_string(binder_count);
+        if (one_way) n += ",oneway";
+        if (single_target) n += ",single_target";
+        if (realtime) n += ",rt";
+        return n;
     }
 };
 
@@ -170,6 +214,7 @@ void worker_fx(
     int num,
     int worker_count,
     int iterations,
+    const Workload& workload,
     Pipe p)
 {
     // Create BinderWorkerService and for go.
@@ -189,8 +234,35 @@ void worker_fx(
     for (int i = 0; i < worker_count; i++) {
         if (num == i)
             continue;
+        if (workload.single_target && i != 0)
+            continue;
         workers.push_back(serviceMgr->getService(generateServiceName(i)));
     }
+    if (workers.empty()) {
+        // Worker 0 only serves in single-target mode.
+        p.signal();
+        p.wait();
+        p.send(ProcResults());
+        p.wait();
+        exit(EXIT_SUCCESS);
+    }
+
+    if (workload.realtime) {
+        struct sched_param param = {};
+        param.sched_priority = 1;
+        if (sched_setscheduler(0, SCHED_FIFO, &param) != 0) {
+            cout << "worker " << num << " could not switch to SCHED_FIFO" << endl;
+        }
+    }
+
+    vector<uint8_t> payload(workload.payload_size, 0x5a);
+    int fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    ASSERT_TRUE(fd >= 0);
+    vector<sp<IBinder> > binders;
+    for (int i = 0; i < workload.binder_count; i++) {
+        binders.push_back(new BBinder);
+    }
+    const uint32_t flags = workload.one_way ? IBinder::FLAG_ONEWAY : 0;
 
     // Run the benchmark.
     ProcResults results;
@@ -199,7 +271,16 @@ void worker_fx(
         int target = rand() % workers.size();
         Parcel data, reply;
         start = chrono::high_resolution_clock::now();
-        status_t ret = workers[target]->transact(BINDER_NOP, data, &reply);
+        if (!payload.empty()) {
+            data.write(payload.data(), payload.size());
+        }
+        for (int j = 0; j < workload.fd_count; j++) {
+            data.writeFileDescriptor(fd);
+        }
+        for (auto& binder : binders) {
+            data.writeStrongBinder(binder);
+        }
+        status_t ret = workers[target]->transact(BINDER_NOP, data, &reply, flags);
         end = chrono::high_resolution_clock::now();
 
         uint64_t cur_time = uint64_t(chrono::duration_cast<chrono::nanoseconds>(end - start).count());
@@ -210,6 +291,8 @@ void worker_fx(
            exit(EXIT_FAILURE);
         }
     }
+    close(fd);
+
     // Signal completion to master and wait.
     p.signal();
     p.wait();
@@ -221,7 +304,7 @@ void worker_fx(
     exit(EXIT_SUCCESS);
 }
 
-Pipe make_worker(int num, int iterations, int worker_count)
+Pipe make_worker(int num, int iterations, int worker_count, const Workload& workload)
 {
     auto pipe_pair = Pipe::createPipePair();
     pid_t pid = fork();
@@ -230,7 +313,7 @@ Pipe make_worker(int num, int iterations, int worker_count)
         return move(get<0>(pipe_pair));
     } else {
         /* child */
-        worker_fx(num, worker_count, iterations, move(get<1>(pipe_pair)));
+        worker_fx(num, worker_count, iterations, workload, move(get<1>(pipe_pair)));
         /* never get here */
         return move(get<0>(pipe_pair));
     }
@@ -251,45 +334,56 @@ void signal_all(vector<Pipe>& v)
     }
 }
 
-int main(int argc, char *argv[])
+// Splits "a,b,c" into integers.
+static vector<int> parse_list(const char* arg)
 {
-    int workers = 2;
-    int iterations = 10000;
-    (void)argc;
-    (void)argv;
-    vector<Pipe> pipes;
-
-    // Parse arguments.
-    for (int i = 1; i < argc; i++) {
-        if (string(argv[i]) == "-w") {
-            workers = atoi(argv[i+1]);
-            i++;
-            continue;
-        }
-        if (string(argv[i]) == "-i") {
-            iterations = atoi(argv[i+1]);
-            i++;
-            continue;
-        }
+    vector<int> values;
+    string str(arg);
+    size_t pos = 0;
+    while (pos <= str.size()) {
+        size_t comma = str.find(',', pos);
+        if (comma == string::npos) comma = str.size();
+        values.push_back(atoi(str.substr(pos, comma - pos).c_str()));
+        pos = comma + 1;
     }
+    return values;
+}
+
+static void usage(const char* argv0)
+{
+    cout << "usage: " << argv0 << " [-w workers] [-i iterations] [-s size[,size...]]\n"
+         << "    [-f fds] [-b binders] [-o] [-t] [-rt] [-j]\n"
+         << "  -s  payload sizes in bytes; one run per size\n"
+         << "  -f  file descriptors per transaction\n"
+         << "  -b  binder objects per transaction\n"
+         << "  -o  one-way transactions\n"
+         << "  -t  every worker calls worker 0 (contention)\n"
+         << "  -rt run clients at SCHED_FIFO to exercise priority inheritance\n"
+         << "  -j  print each run's results as one line of JSON" << endl;
+}
+
+static void run(int workers, int iterations, const Workload& workload, bool json)
+{
+    vector<Pipe> pipes;
 
     // Create all the workers and wait for them to spawn.
     for (int i = 0; i < workers; i++) {
-        pipes.push_back(make_worker(i, iterations, workers));
+        pipes.push_back(make_worker(i, iterations, workers, workload));
     }
     wait_all(pipes);
 
 
     // Run the workers and wait for completion.
     chrono::time_point<chrono::high_resolution_clock> start, end;
-    cout << "waiting for workers to complete" << endl;
+    cout << "waiting for workers to complete (" << workload.name() << ")" << endl;
     start = chrono::high_resolution_clock::now();
     signal_all(pipes);
     wait_all(pipes);
     end = chrono::high_resolution_clock::now();
 
     // Calculate overall throughput.
-    double iterations_per_sec = double(iterations * workers) / (chrono::duration_cast<chrono::nanoseconds>(end - start).count() / 1.0E9);
+    const int clients = workload.single_target ? workers - 1 : workers;
+    double iterations_per_sec = double(iterations * clients) / (chrono::duration_cast<chrono::nanoseconds>(end - start).count() / 1.0E9);
     cout << "iterations per sec: " << iterations_per_sec << endl;
 
     // Collect all results from the workers.
@@ -302,6 +396,9 @@ int main(int argc, char *argv[])
         tot_results = ProcResults::combine(tot_results, tmp_results);
     }
     tot_results.dump();
+    if (json) {
+        tot_results.dumpJson(workload.name(), iterations_per_sec);
+    }
 
     // Kill all the workers.
     cout << "killing workers" << endl;
@@ -313,5 +410,51 @@ int main(int argc, char *argv[])
             cout << "nonzero child status" << status << endl;
         }
     }
+}
+
+int main(int argc, char *argv[])
+{
+    int workers = 2;
+    int iterations = 10000;
+    vector<int> sizes = { 0 };
+    Workload workload;
+    bool json = false;
+
+    // Parse arguments.
+    for (int i = 1; i < argc; i++) {
+        string arg(argv[i]);
+        const bool has_value = i + 1 < argc;
+        if (arg == "-w" && has_value) {
+            workers = atoi(argv[++i]);
+        } else if (arg == "-i" && has_value) {
+            iterations = atoi(argv[++i]);
+        } else if (arg == "-s" && has_value) {
+            sizes = parse_list(argv[++i]);
+        } else if (arg == "-f" && has_value) {
+            workload.fd_count = atoi(argv[++i]);
+        } else if (arg == "-b" && has_value) {
+            workload.binder_count = atoi(argv[++i]);
+        } else if (arg == "-o") {
+            workload.one_way = true;
+        } else if (arg == "-t") {
+            workload.single_target = true;
+        } else if (arg == "-rt") {
+            workload.realtime = true;
+        } else if (arg == "-j") {
+            json = true;
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (workers < 2) {
+        cout << "need at least two workers" << endl;
+        return EXIT_FAILURE;
+    }
+
+    for (int size : sizes) {
+        workload.payload_size = size;
+        run(workers, iterations, workload, json);
+    }
     return 0;
 }
@@ -17,55 +17,188 @@
 
 #include <dirent.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 
 #include <diskusage/dirsize.h>
 
+/* Directory entries are read this many bytes at a time, several times
+   what readdir() asks the kernel for, so that large directories take
+   few syscalls. */
+#define DENTS_BUFFER_SIZE (32 * 1024)
+
+/* Subdirectories waiting for a thread in calculate_dir_size_parallel().
+   Each holds an open fd; once this many are waiting, the thread that
+   found the next one sizes it itself. */
+#define MAX_QUEUED_DIRS 64
+
+#define MAX_THREADS 8
+
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+struct walk_state {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int queue[MAX_QUEUED_DIRS];
+    int queued;
+    /* threads sizing a directory, which may queue more */
+    int busy;
+    int64_t size;
+};
+
 int64_t stat_size(struct stat *s)
 {
     return s->st_blocks * 512;
 }
 
-int64_t calculate_dir_size(int dfd)
+static int queue_dir(struct walk_state *state, int dfd)
+{
+    int queued = 0;
+
+    pthread_mutex_lock(&state->lock);
+    if (state->queued < MAX_QUEUED_DIRS) {
+        state->queue[state->queued++] = dfd;
+        pthread_cond_signal(&state->cond);
+        queued = 1;
+    }
+    pthread_mutex_unlock(&state->lock);
+    return queued;
+}
+
+/* Returns the size of everything below dfd, and closes it. With a state,
+   subdirectories are handed to the other threads while there is room in
+   its queue. */
+static int64_t walk_dir(int dfd, struct walk_state *state)
 {
     int64_t size = 0;
     struct stat s;
-    DIR *d;
-    struct dirent *de;
+    char *buf;
+    long len;
 
-    d = fdopendir(dfd);
-    if (d == NULL) {
+    buf = malloc(DENTS_BUFFER_SIZE);
+    if (buf == NULL) {
         close(dfd);
         return 0;
     }
 
-    while ((de = readdir(d))) {
-        const char *name = de->d_name;
-        if (de->d_type == DT_DIR) {
-            int subfd;
-
-            /* always skip "." and ".." */
-            if (name[0] == '.') {
-                if (name[1] == 0)
-                    continue;
-                if ((name[1] == '.') && (name[2] == 0))
-                    continue;
-            }
+    while ((len = syscall(__NR_getdents64, dfd, buf, DENTS_BUFFER_SIZE)) > 0) {
+        long pos;
+        for (pos = 0; pos < len; ) {
+            struct linux_dirent64 *de = (struct linux_dirent64 *) (buf + pos);
+            const char *name = de->d_name;
+            pos += de->d_reclen;
 
-            if (fstatat(dfd, name, &s, AT_SYMLINK_NOFOLLOW) == 0) {
-                size += stat_size(&s);
-            }
-            subfd = openat(dfd, name, O_RDONLY | O_DIRECTORY);
-            if (subfd >= 0) {
-                size += calculate_dir_size(subfd);
-            }
-        } else {
-            if (fstatat(dfd, name, &s, AT_SYMLINK_NOFOLLOW) == 0) {
-                size += stat_size(&s);
+            if (de->d_type == DT_DIR) {
+                int subfd;
+
+                /* always skip "." and ".." */
+                if (name[0] == '.') {
+                    if (name[1] == 0)
+                        continue;
+                    if ((name[1] == '.') && (name[2] == 0))
+                        continue;
+                }
+
+                if (fstatat(dfd, name, &s, AT_SYMLINK_NOFOLLOW) == 0) {
+                    size += stat_size(&s);
+                }
+                subfd = openat(dfd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                if (subfd >= 0 && (state == NULL || !queue_dir(state, subfd))) {
+                    size += walk_dir(subfd, state);
+                }
+            } else {
+                if (fstatat(dfd, name, &s, AT_SYMLINK_NOFOLLOW) == 0) {
+                    size += stat_size(&s);
+                }
             }
         }
     }
-    closedir(d);
+    free(buf);
+    close(dfd);
     return size;
 }
+
+int64_t calculate_dir_size(int dfd)
+{
+    return walk_dir(dfd, NULL);
+}
+
+static void *walk_thread(void *arg)
+{
+    struct walk_state *state = arg;
+
+    pthread_mutex_lock(&state->lock);
+    for (;;) {
+        int64_t size;
+        int dfd;
+
+        while (state->queued == 0 && state->busy > 0) {
+            pthread_cond_wait(&state->cond, &state->lock);
+        }
+        if (state->queued == 0) {
+            /* nothing left to size, and nobody who could queue more */
+            pthread_cond_broadcast(&state->cond);
+            break;
+        }
+        dfd = state->queue[--state->queued];
+        state->busy++;
+        pthread_mutex_unlock(&state->lock);
+
+        size = walk_dir(dfd, state);
+
+        pthread_mutex_lock(&state->lock);
+        state->size += size;
+        state->busy--;
+    }
+    pthread_mutex_unlock(&state->lock);
+    return NULL;
+}
+
+int64_t calculate_dir_size_parallel(int dfd, int threads)
+{
+    struct walk_state state;
+    pthread_t workers[MAX_THREADS];
+    int started = 0;
+    int i;
+
+    if (threads <= 0) {
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (threads > MAX_THREADS) {
+        threads = MAX_THREADS;
+    }
+    if (threads <= 1) {
+        return calculate_dir_size(dfd);
+    }
+
+    pthread_mutex_init(&state.lock, NULL);
+    pthread_cond_init(&state.cond, NULL);
+    state.queue[0] = dfd;
+    state.queued = 1;
+    state.busy = 0;
+    state.size = 0;
+
+    /* the calling thread is one of them */
+    for (i = 1; i < threads; i++) {
+        if (pthread_create(&workers[started], NULL, walk_thread, &state) == 0) {
+            started++;
+        }
+    }
+    walk_thread(&state);
+    for (i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    pthread_cond_destroy(&state.cond);
+    pthread_mutex_destroy(&state.lock);
+    return state.size;
+}
@@ -44,6 +44,8 @@ LOCAL_SRC_FILES := \
 	BitTube.cpp \
 	BufferItem.cpp \
 	BufferItemConsumer.cpp \
+	BufferItemFifo.cpp \
+	BufferLatencyTracker.cpp \
 	BufferQueue.cpp \
 	BufferQueueConsumer.cpp \
 	BufferQueueCore.cpp \
@@ -64,16 +66,21 @@ LOCAL_SRC_FILES := \
 	ISensorServer.cpp \
 	ISurfaceComposer.cpp \
 	ISurfaceComposerClient.cpp \
+	ITransactionCompletedListener.cpp \
 	LayerState.cpp \
 	OccupancyTracker.cpp \
+	RingTube.cpp \
 	Sensor.cpp \
+	SensorDirectChannel.cpp \
 	SensorEventQueue.cpp \
+	SensorListMemory.cpp \
 	SensorManager.cpp \
 	StreamSplitter.cpp \
 	Surface.cpp \
 	SurfaceControl.cpp \
 	SurfaceComposerClient.cpp \
 	SyncFeatures.cpp \
+	VsyncSnapshot.cpp \
 
 LOCAL_SHARED_LIBRARIES := \
  	libnativeloader \
@@ -0,0 +1,90 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gui/BufferItemFifo.h>
+
+#include <ui/Fence.h>
+#include <ui/GraphicBuffer.h>
+
+namespace android {
+
+// Enough for any synchronous queue in practice; deeper queues grow it.
+static const size_t INITIAL_CAPACITY = 8;
+
+BufferItemFifo::BufferItemFifo() :
+    mItems(new BufferItem[INITIAL_CAPACITY]),
+    mCapacity(INITIAL_CAPACITY),
+    mHead(0),
+    mSize(0) {}
+
+BufferItemFifo::~BufferItemFifo() {
+    delete[] mItems;
+}
+
+void BufferItemFifo::push_back(const BufferItem& item) {
+    if (mSize == mCapacity) {
+        grow();
+    }
+    mItems[wrap(mSize)] = item;
+    ++mSize;
+}
+
+void BufferItemFifo::pop_front() {
+    if (mSize == 0) {
+        return;
+    }
+    mItems[mHead] = BufferItem();
+    mHead = (mHead + 1) & (mCapacity - 1);
+    --mSize;
+}
+
+BufferItemFifo::iterator BufferItemFifo::erase(iterator it) {
+    size_t index = it.index();
+    if (index >= mSize) {
+        return end();
+    }
+    if (index == 0) {
+        pop_front();
+        return begin();
+    }
+    for (size_t i = index; i + 1 < mSize; ++i) {
+        (*this)[i] = (*this)[i + 1];
+    }
+    (*this)[mSize - 1] = BufferItem();
+    --mSize;
+    return iterator(this, index);
+}
+
+void BufferItemFifo::clear() {
+    while (mSize > 0) {
+        pop_front();
+    }
+    mHead = 0;
+}
+
+void BufferItemFifo::grow() {
+    size_t capacity = mCapacity * 2;
+    BufferItem* items = new BufferItem[capacity];
+    for (size_t i = 0; i < mSize; ++i) {
+        items[i] = (*this)[i];
+    }
+    delete[] mItems;
+    mItems = items;
+    mCapacity = capacity;
+    mHead = 0;
+}
+
+} // namespace android
@@ -0,0 +1,87 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gui/BufferLatencyTracker.h>
+
+#include <utils/String8.h>
+
+#include <inttypes.h>
+#include <string.h>
+
+namespace android {
+
+static const char* const STAGE_NAMES[] = {
+    "dequeue-block",
+    "queue-to-acquire",
+    "acquire-to-release",
+};
+
+static_assert(sizeof(STAGE_NAMES) / sizeof(STAGE_NAMES[0]) ==
+        BufferLatencyTracker::NUM_STAGES, "missing stage name");
+
+BufferLatencyTracker::BufferLatencyTracker() {
+    clear();
+}
+
+void BufferLatencyTracker::record(Stage stage, nsecs_t duration) {
+    if (duration < 0) {
+        duration = 0;
+    }
+    Histogram& histogram(mHistograms[stage]);
+    uint64_t us = static_cast<uint64_t>(ns2us(duration));
+    size_t bucket = (us == 0) ? 0 : 64 - __builtin_clzll(us);
+    if (bucket >= NUM_BUCKETS) {
+        bucket = NUM_BUCKETS - 1;
+    }
+    histogram.buckets[bucket]++;
+    histogram.count++;
+    if (duration > histogram.max) {
+        histogram.max = duration;
+    }
+}
+
+void BufferLatencyTracker::clear() {
+    memset(mHistograms, 0, sizeof(mHistograms));
+}
+
+nsecs_t BufferLatencyTracker::percentile(const Histogram& histogram,
+        uint32_t percent) {
+    uint64_t target = (histogram.count * percent + 99) / 100;
+    uint64_t seen = 0;
+    for (size_t b = 0; b < NUM_BUCKETS; b++) {
+        seen += histogram.buckets[b];
+        if (seen >= target && seen > 0) {
+            nsecs_t bound = us2ns(static_cast<nsecs_t>(1) << b);
+            return bound < histogram.max ? bound : histogram.max;
+        }
+    }
+    return histogram.max;
+}
+
+void BufferLatencyTracker::dump(String8& result, const char* prefix) const {
+    result.appendFormat("%sstage\tcount\tp50(us)\tp90(us)\tp99(us)\tmax(us)\n",
+            prefix);
+    for (size_t s = 0; s < NUM_STAGES; s++) {
+        const Histogram& histogram(mHistograms[s]);
+        result.appendFormat("%s%s\t%" PRIu64 "\t%" PRId64 "\t%" PRId64 "\t%"
+                PRId64 "\t%" PRId64 "\n", prefix, STAGE_NAMES[s],
+                histogram.count, ns2us(percentile(histogram, 50)),
+                ns2us(percentile(histogram, 90)),
+                ns2us(percentile(histogram, 99)), ns2us(histogram.max));
+    }
+}
+
+} // namespace android
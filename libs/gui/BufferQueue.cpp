@@ -70,6 +70,15 @@ bool BufferQueue::ProxyConsumerListener::getFrameTimestamps(
     return false;
 }
 
+status_t BufferQueue::ProxyConsumerListener::createFrameEventChannel(
+        sp<BitTube>* outChannel) {
+    sp<ConsumerListener> listener(mConsumerListener.promote());
+    if (listener != NULL) {
+        return listener->createFrameEventChannel(outChannel);
+    }
+    return NO_INIT;
+}
+
 void BufferQueue::createBufferQueue(sp<IGraphicBufferProducer>* outProducer,
         sp<IGraphicBufferConsumer>* outConsumer,
         const sp<IGraphicBufferAlloc>& allocator) {
@@ -243,6 +243,15 @@ status_t BufferQueueConsumer::acquireBuffer(BufferItem* outBuffer,
                 mSlots[slot].mBufferState.acquire();
             }
             mSlots[slot].mFence = Fence::NO_FENCE;
+
+            const nsecs_t now = systemTime();
+            if (mSlots[slot].mQueueTime > 0) {
+                mCore->mLatencyTracker.record(
+                        BufferLatencyTracker::QUEUE_TO_ACQUIRE,
+                        now - mSlots[slot].mQueueTime);
+                mSlots[slot].mQueueTime = 0;
+            }
+            mSlots[slot].mAcquireTime = now;
         }
 
         // If the buffer has previously been acquired by the consumer, set
@@ -254,17 +263,18 @@ status_t BufferQueueConsumer::acquireBuffer(BufferItem* outBuffer,
 
         mCore->mQueue.erase(front);
 
-        // We might have freed a slot while dropping old buffers, or the producer
-        // may be blocked waiting for the number of buffers in the queue to
-        // decrease.
-        mCore->mDequeueCondition.broadcast();
-
         ATRACE_INT(mCore->mConsumerName.string(), mCore->mQueue.size());
         mCore->mOccupancyTracker.registerOccupancyChange(mCore->mQueue.size());
 
         VALIDATE_CONSISTENCY();
     }
 
+    // We might have freed a slot while dropping old buffers, or the producer
+    // may be blocked waiting for the number of buffers in the queue to
+    // decrease. Signal after unlocking so the producer can take mMutex at
+    // once.
+    mCore->mDequeueCondition.broadcast();
+
     if (listener != NULL) {
         for (int i = 0; i < numDroppedBuffers; ++i) {
             listener->onBufferReleased();
@@ -438,6 +448,13 @@ status_t BufferQueueConsumer::releaseBuffer(int slot, uint64_t frameNumber,
         mSlots[slot].mFence = releaseFence;
         mSlots[slot].mBufferState.release();
 
+        if (mSlots[slot].mAcquireTime > 0) {
+            mCore->mLatencyTracker.record(
+                    BufferLatencyTracker::ACQUIRE_TO_RELEASE,
+                    systemTime() - mSlots[slot].mAcquireTime);
+            mSlots[slot].mAcquireTime = 0;
+        }
+
         // After leaving shared buffer mode, the shared buffer will
         // still be around. Mark it as no longer shared if this
         // operation causes it to be free.
@@ -453,10 +470,12 @@ status_t BufferQueueConsumer::releaseBuffer(int slot, uint64_t frameNumber,
         listener = mCore->mConnectedProducerListener;
         BQ_LOGV("releaseBuffer: releasing slot %d", slot);
 
-        mCore->mDequeueCondition.broadcast();
         VALIDATE_CONSISTENCY();
     } // Autolock scope
 
+    // Wake a producer blocked in dequeueBuffer without holding mMutex
+    mCore->mDequeueCondition.broadcast();
+
     // Call back without lock held
     if (listener != NULL) {
         listener->onBufferReleased();
@@ -643,7 +662,8 @@ status_t BufferQueueConsumer::setMaxAcquiredBufferCount(
         }
 
         if ((maxAcquiredBuffers + mCore->mMaxDequeuedBufferCount +
-                (mCore->mAsyncMode || mCore->mDequeueBufferCannotBlock ? 1 : 0))
+                mCore->getAsyncBufferCountLocked(mCore->mAsyncMode,
+                        mCore->mDequeueBufferCannotBlock))
                 > mCore->mMaxBufferCount) {
             BQ_LOGE("setMaxAcquiredBufferCount: %d acquired buffers would "
                     "exceed the maxBufferCount (%d) (maxDequeued %d async %d)",
@@ -673,6 +693,65 @@ status_t BufferQueueConsumer::setMaxAcquiredBufferCount(
     return NO_ERROR;
 }
 
+status_t BufferQueueConsumer::setFrameDropPolicy(int maxQueuedFrames,
+        nsecs_t expectedPresentOffset) {
+    ATRACE_CALL();
+
+    if (maxQueuedFrames < 1 || expectedPresentOffset < -1) {
+        BQ_LOGE("setFrameDropPolicy: invalid policy (maxQueuedFrames %d "
+                "expectedPresentOffset %" PRId64 ")", maxQueuedFrames,
+                expectedPresentOffset);
+        return BAD_VALUE;
+    }
+
+    sp<IConsumerListener> listener;
+    { // Autolock scope
+        Mutex::Autolock lock(mCore->mMutex);
+        mCore->waitWhileAllocatingLocked();
+
+        if (mCore->mIsAbandoned) {
+            BQ_LOGE("setFrameDropPolicy: consumer is abandoned");
+            return NO_INIT;
+        }
+
+        // Droppable frames only need buffers of their own while the producer
+        // can't wait for the consumer
+        int asyncBuffers = (mCore->mAsyncMode ||
+                mCore->mDequeueBufferCannotBlock) ? maxQueuedFrames : 0;
+        if (mCore->mMaxAcquiredBufferCount + mCore->mMaxDequeuedBufferCount +
+                asyncBuffers > mCore->mMaxBufferCount) {
+            BQ_LOGE("setFrameDropPolicy: %d queued frames would exceed the "
+                    "maxBufferCount (%d) (maxAcquired %d maxDequeued %d)",
+                    maxQueuedFrames, mCore->mMaxBufferCount,
+                    mCore->mMaxAcquiredBufferCount,
+                    mCore->mMaxDequeuedBufferCount);
+            return BAD_VALUE;
+        }
+
+        int delta = asyncBuffers - mCore->getAsyncBufferCountLocked(
+                mCore->mAsyncMode, mCore->mDequeueBufferCannotBlock);
+        if (!mCore->adjustAvailableSlotsLocked(delta)) {
+            return BAD_VALUE;
+        }
+
+        BQ_LOGV("setFrameDropPolicy: maxQueuedFrames %d expectedPresentOffset "
+                "%" PRId64, maxQueuedFrames, expectedPresentOffset);
+        mCore->mMaxQueuedDroppableFrames = maxQueuedFrames;
+        mCore->mExpectedPresentOffset = expectedPresentOffset;
+        VALIDATE_CONSISTENCY();
+        mCore->mDequeueCondition.broadcast();
+        if (delta < 0) {
+            listener = mCore->mConsumerListener;
+        }
+    }
+    // Call back without lock held
+    if (listener != NULL) {
+        listener->onBuffersReleased();
+    }
+
+    return NO_ERROR;
+}
+
 void BufferQueueConsumer::setConsumerName(const String8& name) {
     ATRACE_CALL();
     BQ_LOGV("setConsumerName: '%s'", name.string());
@@ -732,6 +811,17 @@ status_t BufferQueueConsumer::discardFreeBuffers() {
     return NO_ERROR;
 }
 
+status_t BufferQueueConsumer::trimFreeBuffers(int maxAllocatedBuffers) {
+    if (maxAllocatedBuffers < 0) {
+        BQ_LOGE("trimFreeBuffers: invalid maxAllocatedBuffers %d",
+                maxAllocatedBuffers);
+        return BAD_VALUE;
+    }
+    Mutex::Autolock lock(mCore->mMutex);
+    mCore->trimFreeBuffersLocked(maxAllocatedBuffers);
+    return NO_ERROR;
+}
+
 void BufferQueueConsumer::dumpState(String8& result, const char* prefix) const {
     const IPCThreadState* ipc = IPCThreadState::self();
     const pid_t pid = ipc->getCallingPid();
@@ -747,4 +837,20 @@ void BufferQueueConsumer::dumpState(String8& result, const char* prefix) const {
     }
 }
 
+void BufferQueueConsumer::dumpLatency(String8& result,
+        const char* prefix) const {
+    const IPCThreadState* ipc = IPCThreadState::self();
+    const pid_t pid = ipc->getCallingPid();
+    const uid_t uid = ipc->getCallingUid();
+    if ((uid != AID_SHELL)
+            && !PermissionCache::checkPermission(String16(
+            "android.permission.DUMP"), pid, uid)) {
+        result.appendFormat("Permission Denial: can't dump BufferQueueConsumer "
+                "from pid=%d, uid=%d\n", pid, uid);
+    } else {
+        Mutex::Autolock lock(mCore->mMutex);
+        mCore->mLatencyTracker.dump(result, prefix);
+    }
+}
+
 } // namespace android
@@ -76,6 +76,8 @@ BufferQueueCore::BufferQueueCore(const sp<IGraphicBufferAlloc>& allocator) :
     mMaxBufferCount(BufferQueueDefs::NUM_BUFFER_SLOTS),
     mMaxAcquiredBufferCount(1),
     mMaxDequeuedBufferCount(1),
+    mMaxQueuedDroppableFrames(1),
+    mExpectedPresentOffset(-1),
     mBufferHasBeenQueued(false),
     mFrameCounter(0),
     mTransformHint(0),
@@ -130,10 +132,12 @@ void BufferQueueCore::dumpState(String8& result, const char* prefix) const {
 
     result.appendFormat("%s-BufferQueue mMaxAcquiredBufferCount=%d, "
             "mMaxDequeuedBufferCount=%d, mDequeueBufferCannotBlock=%d "
-            "mAsyncMode=%d, default-size=[%dx%d], default-format=%d, "
-            "transform-hint=%02x, FIFO(%zu)={%s}\n", prefix,
+            "mAsyncMode=%d, mMaxQueuedDroppableFrames=%d, "
+            "mExpectedPresentOffset=%" PRId64 ", default-size=[%dx%d], "
+            "default-format=%d, transform-hint=%02x, FIFO(%zu)={%s}\n", prefix,
             mMaxAcquiredBufferCount, mMaxDequeuedBufferCount,
-            mDequeueBufferCannotBlock, mAsyncMode, mDefaultWidth,
+            mDequeueBufferCannotBlock, mAsyncMode, mMaxQueuedDroppableFrames,
+            mExpectedPresentOffset, mDefaultWidth,
             mDefaultHeight, mDefaultBufferFormat, mTransformHint, mQueue.size(),
             fifo.string());
 
@@ -165,16 +169,16 @@ void BufferQueueCore::dumpState(String8& result, const char* prefix) const {
         result.appendFormat("%s [%02d:%p] state=%-8s\n", prefix, s,
                 buffer.get(), mSlots[s].mBufferState.string());
     }
+
+    result.appendFormat("%s-Latency\n", prefix);
+    mLatencyTracker.dump(result, String8::format("%s ", prefix).string());
 }
 
 int BufferQueueCore::getMinUndequeuedBufferCountLocked() const {
     // If dequeueBuffer is allowed to error out, we don't have to add an
     // extra buffer.
-    if (mAsyncMode || mDequeueBufferCannotBlock) {
-        return mMaxAcquiredBufferCount + 1;
-    }
-
-    return mMaxAcquiredBufferCount;
+    return mMaxAcquiredBufferCount +
+            getAsyncBufferCountLocked(mAsyncMode, mDequeueBufferCannotBlock);
 }
 
 int BufferQueueCore::getMinMaxBufferCountLocked() const {
@@ -184,14 +188,20 @@ int BufferQueueCore::getMinMaxBufferCountLocked() const {
 int BufferQueueCore::getMaxBufferCountLocked(bool asyncMode,
         bool dequeueBufferCannotBlock, int maxBufferCount) const {
     int maxCount = mMaxAcquiredBufferCount + mMaxDequeuedBufferCount +
-            ((asyncMode || dequeueBufferCannotBlock) ? 1 : 0);
+            getAsyncBufferCountLocked(asyncMode, dequeueBufferCannotBlock);
     maxCount = std::min(maxBufferCount, maxCount);
     return maxCount;
 }
 
+int BufferQueueCore::getAsyncBufferCountLocked(bool asyncMode,
+        bool dequeueBufferCannotBlock) const {
+    return (asyncMode || dequeueBufferCannotBlock) ?
+            mMaxQueuedDroppableFrames : 0;
+}
+
 int BufferQueueCore::getMaxBufferCountLocked() const {
     int maxBufferCount = mMaxAcquiredBufferCount + mMaxDequeuedBufferCount +
-            ((mAsyncMode || mDequeueBufferCannotBlock) ? 1 : 0);
+            getAsyncBufferCountLocked(mAsyncMode, mDequeueBufferCannotBlock);
 
     // limit maxBufferCount by mMaxBufferCount always
     maxBufferCount = std::min(mMaxBufferCount, maxBufferCount);
@@ -256,6 +266,22 @@ void BufferQueueCore::discardFreeBuffersLocked() {
     VALIDATE_CONSISTENCY();
 }
 
+void BufferQueueCore::trimFreeBuffersLocked(int maxAllocatedBuffers) {
+    // Every active slot holds a buffer, as does every slot in mFreeBuffers
+    int allocated = static_cast<int>(mActiveBuffers.size() +
+            mFreeBuffers.size());
+    // dequeueBuffer takes from the front, so keep those
+    while (allocated > maxAllocatedBuffers && !mFreeBuffers.empty()) {
+        int slot = mFreeBuffers.back();
+        mFreeBuffers.pop_back();
+        mFreeSlots.insert(slot);
+        clearBufferSlotLocked(slot);
+        --allocated;
+    }
+
+    VALIDATE_CONSISTENCY();
+}
+
 bool BufferQueueCore::adjustAvailableSlotsLocked(int delta) {
     if (delta >= 0) {
         // If we're going to fail, do so before modifying anything
@@ -310,13 +336,9 @@ void BufferQueueCore::validateConsistencyLocked() const {
     int allocatedSlots = 0;
     for (int slot = 0; slot < BufferQueueDefs::NUM_BUFFER_SLOTS; ++slot) {
         bool isInFreeSlots = mFreeSlots.count(slot) != 0;
-        bool isInFreeBuffers =
-                std::find(mFreeBuffers.cbegin(), mFreeBuffers.cend(), slot) !=
-                mFreeBuffers.cend();
+        bool isInFreeBuffers = mFreeBuffers.count(slot) != 0;
         bool isInActiveBuffers = mActiveBuffers.count(slot) != 0;
-        bool isInUnusedSlots =
-                std::find(mUnusedSlots.cbegin(), mUnusedSlots.cend(), slot) !=
-                mUnusedSlots.cend();
+        bool isInUnusedSlots = mUnusedSlots.count(slot) != 0;
 
         if (isInFreeSlots || isInFreeBuffers || isInActiveBuffers) {
             allocatedSlots++;
@@ -186,7 +186,8 @@ status_t BufferQueueProducer::setAsyncMode(bool async) {
         }
 
         if ((mCore->mMaxAcquiredBufferCount + mCore->mMaxDequeuedBufferCount +
-                (async || mCore->mDequeueBufferCannotBlock ? 1 : 0)) >
+                mCore->getAsyncBufferCountLocked(async,
+                        mCore->mDequeueBufferCannotBlock)) >
                 mCore->mMaxBufferCount) {
             BQ_LOGE("setAsyncMode(%d): this call would cause the "
                     "maxBufferCount (%d) to be exceeded (maxAcquired %d "
@@ -239,10 +240,74 @@ int BufferQueueProducer::getFreeSlotLocked() const {
     return slot;
 }
 
+void BufferQueueProducer::freeDroppedBufferLocked(const BufferItem& dropped) {
+    if (dropped.mIsStale) {
+        return;
+    }
+
+    mSlots[dropped.mSlot].mBufferState.freeQueued();
+
+    // After leaving shared buffer mode, the shared buffer will still be
+    // around. Mark it as no longer shared if this operation causes it to be
+    // free.
+    if (!mCore->mSharedBufferMode &&
+            mSlots[dropped.mSlot].mBufferState.isFree()) {
+        mSlots[dropped.mSlot].mBufferState.mShared = false;
+    }
+    // Don't put the shared buffer on the free list.
+    if (!mSlots[dropped.mSlot].mBufferState.isShared()) {
+        mCore->mActiveBuffers.erase(dropped.mSlot);
+        mCore->mFreeBuffers.push_back(dropped.mSlot);
+    }
+}
+
+bool BufferQueueProducer::dropQueuedFramesLocked(const BufferItem& incoming) {
+    // Only the droppable frames queued since the last one that has to be
+    // acquired are candidates
+    size_t first = mCore->mQueue.size();
+    while (first > 0 && mCore->mQueue[first - 1].mIsDroppable) {
+        --first;
+    }
+    size_t droppable = mCore->mQueue.size() - first;
+    if (droppable == 0) {
+        return false;
+    }
+
+    // If the incoming frame is due by the time the consumer expects to
+    // present it, acquireBuffer would drop everything queued before it. As in
+    // acquireBuffer, auto-generated and unreasonable timestamps (more than a
+    // second before the expected present time) never cause drops.
+    bool dropAll = false;
+    if (mCore->mExpectedPresentOffset >= 0 && !incoming.mIsAutoTimestamp) {
+        const nsecs_t MAX_REASONABLE_NSEC = 1000000000LL; // 1 second
+        nsecs_t expectedPresent = systemTime(SYSTEM_TIME_MONOTONIC) +
+                mCore->mExpectedPresentOffset;
+        dropAll = incoming.mTimestamp <= expectedPresent &&
+                incoming.mTimestamp >= expectedPresent - MAX_REASONABLE_NSEC;
+    }
+
+    // Otherwise drop the oldest ones, leaving room for the incoming frame
+    const size_t maxDroppable =
+            static_cast<size_t>(mCore->mMaxQueuedDroppableFrames);
+    BufferQueueCore::Fifo::iterator current(&mCore->mQueue, first);
+    while (current != mCore->mQueue.end() &&
+            (dropAll || droppable >= maxDroppable)) {
+        BQ_LOGV("queueBuffer: dropping frame %" PRIu64 " (%zu droppable)",
+                current->mFrameNumber, droppable);
+        freeDroppedBufferLocked(*current);
+        --droppable;
+        if (current.index() + 1 == mCore->mQueue.size()) {
+            return true;
+        }
+        current = mCore->mQueue.erase(current);
+    }
+    return false;
+}
+
 status_t BufferQueueProducer::waitForFreeSlotThenRelock(FreeSlotCaller caller,
         int* found) const {
-    auto callerString = (caller == FreeSlotCaller::Dequeue) ?
-            "dequeueBuffer" : "attachBuffer";
+    auto callerString = (caller == FreeSlotCaller::Attach) ?
+            "attachBuffer" : "dequeueBuffer";
     bool tryAgain = true;
     while (tryAgain) {
         if (mCore->mIsAbandoned) {
@@ -266,6 +331,9 @@ status_t BufferQueueProducer::waitForFreeSlotThenRelock(FreeSlotCaller caller,
         // This check is only done if a buffer has already been queued
         if (mCore->mBufferHasBeenQueued &&
                 dequeuedCount >= mCore->mMaxDequeuedBufferCount) {
+            if (caller == FreeSlotCaller::Prefetch) {
+                return WOULD_BLOCK;
+            }
             BQ_LOGE("%s: attempting to exceed the max dequeued buffer count "
                     "(%d)", callerString, mCore->mMaxDequeuedBufferCount);
             return INVALID_OPERATION;
@@ -290,7 +358,7 @@ status_t BufferQueueProducer::waitForFreeSlotThenRelock(FreeSlotCaller caller,
                     BufferQueueCore::INVALID_BUFFER_SLOT) {
                 *found = mCore->mSharedBufferSlot;
             } else {
-                if (caller == FreeSlotCaller::Dequeue) {
+                if (caller != FreeSlotCaller::Attach) {
                     // If we're calling this from dequeue, prefer free buffers
                     int slot = getFreeBufferLocked();
                     if (slot != BufferQueueCore::INVALID_BUFFER_SLOT) {
@@ -326,6 +394,9 @@ status_t BufferQueueProducer::waitForFreeSlotThenRelock(FreeSlotCaller caller,
                     (acquiredCount <= mCore->mMaxAcquiredBufferCount)) {
                 return WOULD_BLOCK;
             }
+            if (caller == FreeSlotCaller::Prefetch) {
+                return WOULD_BLOCK;
+            }
             if (mDequeueTimeout >= 0) {
                 status_t result = mCore->mDequeueCondition.waitRelative(
                         mCore->mMutex, mDequeueTimeout);
@@ -345,6 +416,13 @@ status_t BufferQueueProducer::dequeueBuffer(int *outSlot,
         sp<android::Fence> *outFence, uint32_t width, uint32_t height,
         PixelFormat format, uint32_t usage) {
     ATRACE_CALL();
+    return dequeueBufferInternal(FreeSlotCaller::Dequeue, outSlot, outFence,
+            width, height, format, usage);
+}
+
+status_t BufferQueueProducer::dequeueBufferInternal(FreeSlotCaller caller,
+        int* outSlot, sp<android::Fence>* outFence, uint32_t width,
+        uint32_t height, PixelFormat format, uint32_t usage) {
     { // Autolock scope
         Mutex::Autolock lock(mCore->mMutex);
         mConsumerName = mCore->mConsumerName;
@@ -375,6 +453,7 @@ status_t BufferQueueProducer::dequeueBuffer(int *outSlot,
 
     { // Autolock scope
         Mutex::Autolock lock(mCore->mMutex);
+        const nsecs_t waitStart = systemTime();
         mCore->waitWhileAllocatingLocked();
 
         if (format == 0) {
@@ -392,8 +471,7 @@ status_t BufferQueueProducer::dequeueBuffer(int *outSlot,
 
         int found = BufferItem::INVALID_BUFFER_SLOT;
         while (found == BufferItem::INVALID_BUFFER_SLOT) {
-            status_t status = waitForFreeSlotThenRelock(FreeSlotCaller::Dequeue,
-                    &found);
+            status_t status = waitForFreeSlotThenRelock(caller, &found);
             if (status != NO_ERROR) {
                 return status;
             }
@@ -434,6 +512,11 @@ status_t BufferQueueProducer::dequeueBuffer(int *outSlot,
             return BAD_VALUE;
         }
 
+        if (caller == FreeSlotCaller::Dequeue) {
+            mCore->mLatencyTracker.record(BufferLatencyTracker::DEQUEUE_BLOCK,
+                    systemTime() - waitStart);
+        }
+
         if (mCore->mSharedBufferSlot != found) {
             mCore->mActiveBuffers.insert(found);
         }
@@ -822,6 +905,7 @@ status_t BufferQueueProducer::queueBuffer(int slot,
 
         mSlots[slot].mFence = fence;
         mSlots[slot].mBufferState.queue();
+        mSlots[slot].mQueueTime = systemTime();
 
         ++mCore->mFrameCounter;
         mSlots[slot].mFrameNumber = mCore->mFrameCounter;
@@ -864,29 +948,10 @@ status_t BufferQueueProducer::queueBuffer(int slot,
             mCore->mQueue.push_back(item);
             frameAvailableListener = mCore->mConsumerListener;
         } else {
-            // When the queue is not empty, we need to look at the last buffer
-            // in the queue to see if we need to replace it
-            const BufferItem& last = mCore->mQueue.itemAt(
-                    mCore->mQueue.size() - 1);
-            if (last.mIsDroppable) {
-
-                if (!last.mIsStale) {
-                    mSlots[last.mSlot].mBufferState.freeQueued();
-
-                    // After leaving shared buffer mode, the shared buffer will
-                    // still be around. Mark it as no longer shared if this
-                    // operation causes it to be free.
-                    if (!mCore->mSharedBufferMode &&
-                            mSlots[last.mSlot].mBufferState.isFree()) {
-                        mSlots[last.mSlot].mBufferState.mShared = false;
-                    }
-                    // Don't put the shared buffer on the free list.
-                    if (!mSlots[last.mSlot].mBufferState.isShared()) {
-                        mCore->mActiveBuffers.erase(last.mSlot);
-                        mCore->mFreeBuffers.push_back(last.mSlot);
-                    }
-                }
-
+            // When the queue is not empty, we need to look at the droppable
+            // buffers at the back of the queue to see if we need to drop or
+            // replace any of them
+            if (dropQueuedFramesLocked(item)) {
                 // Overwrite the droppable buffer with the incoming one
                 mCore->mQueue.editItemAt(mCore->mQueue.size() - 1) = item;
                 frameReplacedListener = mCore->mConsumerListener;
@@ -897,7 +962,6 @@ status_t BufferQueueProducer::queueBuffer(int slot,
         }
 
         mCore->mBufferHasBeenQueued = true;
-        mCore->mDequeueCondition.broadcast();
         mCore->mLastQueuedSlot = slot;
 
         output->inflate(mCore->mDefaultWidth, mCore->mDefaultHeight,
@@ -914,6 +978,10 @@ status_t BufferQueueProducer::queueBuffer(int slot,
         VALIDATE_CONSISTENCY();
     } // Autolock scope
 
+    // Wake blocked dequeuers only now that mMutex is free, so they don't
+    // wake up just to block on it again.
+    mCore->mDequeueCondition.broadcast();
+
     // Don't send the GraphicBuffer through the callback, and don't send
     // the slot number, since the consumer shouldn't need it
     item.mGraphicBuffer.clear();
@@ -959,6 +1027,36 @@ status_t BufferQueueProducer::queueBuffer(int slot,
     return NO_ERROR;
 }
 
+status_t BufferQueueProducer::queueAndDequeueBuffer(int slot,
+        const QueueBufferInput& input, QueueBufferOutput* output,
+        uint32_t width, uint32_t height, PixelFormat format, uint32_t usage,
+        int* outSlot, sp<Fence>* outFence, sp<GraphicBuffer>* outBuffer,
+        status_t* outDequeueResult) {
+    ATRACE_CALL();
+    *outSlot = BufferQueueCore::INVALID_BUFFER_SLOT;
+
+    status_t result = queueBuffer(slot, input, output);
+    if (result != NO_ERROR) {
+        return result;
+    }
+
+    int nextSlot = BufferQueueCore::INVALID_BUFFER_SLOT;
+    status_t dequeueResult = dequeueBufferInternal(FreeSlotCaller::Prefetch,
+            &nextSlot, outFence, width, height, format, usage);
+    if (dequeueResult < 0) {
+        BQ_LOGV("queueAndDequeueBuffer: not prefetching (%d)", dequeueResult);
+        return NO_ERROR;
+    }
+
+    if (dequeueResult & BUFFER_NEEDS_REALLOCATION) {
+        // If this fails the caller sees a null buffer and asks for it itself
+        requestBuffer(nextSlot, outBuffer);
+    }
+    *outSlot = nextSlot;
+    *outDequeueResult = dequeueResult;
+    return NO_ERROR;
+}
+
 status_t BufferQueueProducer::cancelBuffer(int slot, const sp<Fence>& fence) {
     ATRACE_CALL();
     BQ_LOGV("cancelBuffer: slot %d", slot);
@@ -1454,6 +1552,22 @@ bool BufferQueueProducer::getFrameTimestamps(uint64_t frameNumber,
     return false;
 }
 
+status_t BufferQueueProducer::createFrameEventChannel(
+        sp<BitTube>* outChannel) {
+    ATRACE_CALL();
+    BQ_LOGV("createFrameEventChannel");
+    sp<IConsumerListener> listener;
+
+    {
+        Mutex::Autolock lock(mCore->mMutex);
+        listener = mCore->mConsumerListener;
+    }
+    if (listener != NULL) {
+        return listener->createFrameEventChannel(outChannel);
+    }
+    return NO_INIT;
+}
+
 void BufferQueueProducer::binderDied(const wp<android::IBinder>& /* who */) {
     // If we're here, it means that a producer we were connected to died.
     // We're guaranteed that we are still connected to it because we remove
@@ -235,6 +235,17 @@ status_t ConsumerBase::setDefaultBufferDataSpace(
     return mConsumer->setDefaultBufferDataSpace(defaultDataSpace);
 }
 
+status_t ConsumerBase::setFrameDropPolicy(int maxQueuedFrames,
+        nsecs_t expectedPresentOffset) {
+    Mutex::Autolock _l(mMutex);
+    if (mAbandoned) {
+        CB_LOGE("setFrameDropPolicy: ConsumerBase is abandoned!");
+        return NO_INIT;
+    }
+    return mConsumer->setFrameDropPolicy(maxQueuedFrames,
+            expectedPresentOffset);
+}
+
 status_t ConsumerBase::getOccupancyHistory(bool forceFlush,
         std::vector<OccupancyTracker::Segment>* outHistory) {
     Mutex::Autolock _l(mMutex);
@@ -251,7 +262,45 @@ status_t ConsumerBase::discardFreeBuffers() {
         CB_LOGE("discardFreeBuffers: ConsumerBase is abandoned!");
         return NO_INIT;
     }
-    return mConsumer->discardFreeBuffers();
+    status_t err = mConsumer->discardFreeBuffers();
+    if (err != NO_ERROR) {
+        return err;
+    }
+    freeReleasedBuffersLocked();
+    return NO_ERROR;
+}
+
+status_t ConsumerBase::trimFreeBuffers(int maxAllocatedBuffers) {
+    Mutex::Autolock _l(mMutex);
+    if (mAbandoned) {
+        CB_LOGE("trimFreeBuffers: ConsumerBase is abandoned!");
+        return NO_INIT;
+    }
+    status_t err = mConsumer->trimFreeBuffers(maxAllocatedBuffers);
+    if (err != NO_ERROR) {
+        return err;
+    }
+    freeReleasedBuffersLocked();
+    return NO_ERROR;
+}
+
+void ConsumerBase::freeReleasedBuffersLocked() {
+    // The queue doesn't tell its listener about discarded buffers, so drop
+    // our own references to them here; otherwise they stay allocated.
+    uint64_t mask = 0;
+    mConsumer->getReleasedBuffers(&mask);
+    for (int i = 0; i < BufferQueue::NUM_BUFFER_SLOTS; i++) {
+        if (mask & (1ULL << i)) {
+            freeBufferLocked(i);
+        }
+    }
+}
+
+void ConsumerBase::dumpLatency(String8& result, const char* prefix) const {
+    Mutex::Autolock _l(mMutex);
+    if (!mAbandoned) {
+        mConsumer->dumpLatency(result, prefix);
+    }
 }
 
 void ConsumerBase::dumpState(String8& result) const {
@@ -40,6 +40,10 @@ CpuConsumer::CpuConsumer(const sp<IGraphicBufferConsumer>& bq,
     // Create tracking entries for locked buffers
     mAcquiredBuffers.insertAt(0, maxLockedBuffers);
 
+    for (size_t i = 0; i < BufferQueue::NUM_BUFFER_SLOTS; i++) {
+        mFlexYuvUnsupported[i] = false;
+    }
+
     mConsumer->setConsumerUsageBits(GRALLOC_USAGE_SW_READ_OFTEN);
     mConsumer->setMaxAcquiredBufferCount(static_cast<int32_t>(maxLockedBuffers));
 }
@@ -86,46 +90,42 @@ static bool isPossiblyYUV(PixelFormat format) {
     }
 }
 
-status_t CpuConsumer::lockNextBuffer(LockedBuffer *nativeBuffer) {
-    status_t err;
+// How much of each plane lockNextBuffers() prefetches when asked to: the
+// first rows, which the CPU reads first and would otherwise wait on.
+static const size_t PREFETCH_BYTES = 4096;
+static const size_t CACHE_LINE_BYTES = 64;
 
-    if (!nativeBuffer) return BAD_VALUE;
-    if (mCurrentLockedBuffers == mMaxLockedBuffers) {
-        CC_LOGW("Max buffers have been locked (%zd), cannot lock anymore.",
-                mMaxLockedBuffers);
-        return NOT_ENOUGH_DATA;
+static void prefetchPlane(const uint8_t* data) {
+    if (data == NULL) {
+        return;
     }
-
-    BufferItem b;
-
-    Mutex::Autolock _l(mMutex);
-
-    err = acquireBufferLocked(&b, 0);
-    if (err != OK) {
-        if (err == BufferQueue::NO_BUFFER_AVAILABLE) {
-            return BAD_VALUE;
-        } else {
-            CC_LOGE("Error acquiring buffer: %s (%d)", strerror(err), err);
-            return err;
-        }
+    for (size_t offset = 0; offset < PREFETCH_BYTES; offset += CACHE_LINE_BYTES) {
+        __builtin_prefetch(data + offset, 0 /* read */, 3 /* keep in all caches */);
     }
+}
 
-    int slot = b.mSlot;
-
+// Locks buffer for CPU reading once its acquire fence has signaled, and fills
+// out nativeBuffer from the locked planes and the BufferItem. Doesn't touch
+// any CpuConsumer state, so that it can wait on the fence without mMutex.
+static status_t lockAcquiredBuffer(const BufferItem& b, const sp<GraphicBuffer>& buffer,
+        bool tryFlexYuv, bool* outFlexYuvUnsupported,
+        CpuConsumer::LockedBuffer* nativeBuffer) {
+    status_t err;
     void *bufferPointer = NULL;
     android_ycbcr ycbcr = android_ycbcr();
 
-    PixelFormat format = mSlots[slot].mGraphicBuffer->getPixelFormat();
+    *outFlexYuvUnsupported = false;
+    PixelFormat format = buffer->getPixelFormat();
     PixelFormat flexFormat = format;
-    if (isPossiblyYUV(format)) {
+    if (isPossiblyYUV(format) && tryFlexYuv) {
         if (b.mFence.get()) {
-            err = mSlots[slot].mGraphicBuffer->lockAsyncYCbCr(
+            err = buffer->lockAsyncYCbCr(
                 GraphicBuffer::USAGE_SW_READ_OFTEN,
                 b.mCrop,
                 &ycbcr,
                 b.mFence->dup());
         } else {
-            err = mSlots[slot].mGraphicBuffer->lockYCbCr(
+            err = buffer->lockYCbCr(
                 GraphicBuffer::USAGE_SW_READ_OFTEN,
                 b.mCrop,
                 &ycbcr);
@@ -134,58 +134,46 @@ status_t CpuConsumer::lockNextBuffer(LockedBuffer *nativeBuffer) {
             bufferPointer = ycbcr.y;
             flexFormat = HAL_PIXEL_FORMAT_YCbCr_420_888;
             if (format != HAL_PIXEL_FORMAT_YCbCr_420_888) {
-                CC_LOGV("locking buffer of format %#x as flex YUV", format);
+                ALOGV("locking buffer of format %#x as flex YUV", format);
             }
         } else if (format == HAL_PIXEL_FORMAT_YCbCr_420_888) {
-            CC_LOGE("Unable to lock YCbCr buffer for CPU reading: %s (%d)",
+            ALOGE("Unable to lock YCbCr buffer for CPU reading: %s (%d)",
                     strerror(-err), err);
             return err;
+        } else {
+            *outFlexYuvUnsupported = true;
         }
     }
 
     if (bufferPointer == NULL) { // not flexible YUV
         if (b.mFence.get()) {
-            err = mSlots[slot].mGraphicBuffer->lockAsync(
+            err = buffer->lockAsync(
                 GraphicBuffer::USAGE_SW_READ_OFTEN,
                 b.mCrop,
                 &bufferPointer,
                 b.mFence->dup());
         } else {
-            err = mSlots[slot].mGraphicBuffer->lock(
+            err = buffer->lock(
                 GraphicBuffer::USAGE_SW_READ_OFTEN,
                 b.mCrop,
                 &bufferPointer);
         }
         if (err != OK) {
-            CC_LOGE("Unable to lock buffer for CPU reading: %s (%d)",
+            ALOGE("Unable to lock buffer for CPU reading: %s (%d)",
                     strerror(-err), err);
             return err;
         }
     }
 
-    size_t lockedIdx = 0;
-    for (; lockedIdx < static_cast<size_t>(mMaxLockedBuffers); lockedIdx++) {
-        if (mAcquiredBuffers[lockedIdx].mSlot ==
-                BufferQueue::INVALID_BUFFER_SLOT) {
-            break;
-        }
-    }
-    assert(lockedIdx < mMaxLockedBuffers);
-
-    AcquiredBuffer &ab = mAcquiredBuffers.editItemAt(lockedIdx);
-    ab.mSlot = slot;
-    ab.mBufferPointer = bufferPointer;
-    ab.mGraphicBuffer = mSlots[slot].mGraphicBuffer;
-
     nativeBuffer->data   =
             reinterpret_cast<uint8_t*>(bufferPointer);
-    nativeBuffer->width  = mSlots[slot].mGraphicBuffer->getWidth();
-    nativeBuffer->height = mSlots[slot].mGraphicBuffer->getHeight();
+    nativeBuffer->width  = buffer->getWidth();
+    nativeBuffer->height = buffer->getHeight();
     nativeBuffer->format = format;
     nativeBuffer->flexFormat = flexFormat;
     nativeBuffer->stride = (ycbcr.y != NULL) ?
             static_cast<uint32_t>(ycbcr.ystride) :
-            mSlots[slot].mGraphicBuffer->getStride();
+            buffer->getStride();
 
     nativeBuffer->crop        = b.mCrop;
     nativeBuffer->transform   = b.mTransform;
@@ -199,16 +187,141 @@ status_t CpuConsumer::lockNextBuffer(LockedBuffer *nativeBuffer) {
     nativeBuffer->chromaStride = static_cast<uint32_t>(ycbcr.cstride);
     nativeBuffer->chromaStep   = static_cast<uint32_t>(ycbcr.chroma_step);
 
-    mCurrentLockedBuffers++;
-
     return OK;
 }
 
+status_t CpuConsumer::lockNextBuffer(LockedBuffer *nativeBuffer) {
+    if (!nativeBuffer) return BAD_VALUE;
+    ssize_t count = lockNextBuffers(nativeBuffer, 1);
+    if (count < 0) {
+        return status_t(count);
+    }
+    return count == 1 ? OK : BAD_VALUE;
+}
+
+ssize_t CpuConsumer::lockNextBuffers(LockedBuffer *nativeBuffers, size_t count,
+        bool prefetch) {
+    if (!nativeBuffers || count == 0) return BAD_VALUE;
+
+    // Acquire the buffers and reserve their entries, then lock them without
+    // mMutex: locking waits for the acquire fences, and onFrameAvailable()
+    // needs mMutex while the producer's queueBuffer() waits on it.
+    struct Pending {
+        BufferItem item;
+        size_t lockedIdx;
+        sp<GraphicBuffer> buffer;
+        bool tryFlexYuv;
+    };
+    Vector<Pending> pending;
+    {
+        Mutex::Autolock _l(mMutex);
+        if (mCurrentLockedBuffers == mMaxLockedBuffers) {
+            CC_LOGW("Max buffers have been locked (%zd), cannot lock anymore.",
+                    mMaxLockedBuffers);
+            return NOT_ENOUGH_DATA;
+        }
+
+        size_t lockedIdx = 0;
+        while (size_t(pending.size()) < count &&
+                mCurrentLockedBuffers < mMaxLockedBuffers) {
+            Pending p;
+            status_t err = acquireBufferLocked(&p.item, 0);
+            if (err == BufferQueue::NO_BUFFER_AVAILABLE) {
+                break;
+            } else if (err != OK) {
+                CC_LOGE("Error acquiring buffer: %s (%d)", strerror(err), err);
+                if (pending.isEmpty()) {
+                    return err;
+                }
+                break;
+            }
+
+            int slot = p.item.mSlot;
+            if (p.item.mGraphicBuffer != NULL) {
+                mFlexYuvUnsupported[slot] = false;
+            }
+            p.buffer = mSlots[slot].mGraphicBuffer;
+            p.tryFlexYuv = !mFlexYuvUnsupported[slot];
+
+            for (; lockedIdx < static_cast<size_t>(mMaxLockedBuffers); lockedIdx++) {
+                if (mAcquiredBuffers[lockedIdx].mSlot ==
+                        BufferQueue::INVALID_BUFFER_SLOT) {
+                    break;
+                }
+            }
+            assert(lockedIdx < mMaxLockedBuffers);
+
+            // Reserved: the slot is set, but without a pointer unlockBuffer()
+            // can't find it yet.
+            AcquiredBuffer &ab = mAcquiredBuffers.editItemAt(lockedIdx);
+            ab.mSlot = slot;
+            ab.mBufferPointer = NULL;
+            ab.mGraphicBuffer = p.buffer;
+            p.lockedIdx = lockedIdx;
+            mCurrentLockedBuffers++;
+            pending.push_back(p);
+        }
+    }
+    if (pending.isEmpty()) {
+        return BAD_VALUE;
+    }
+
+    Vector<status_t> results;
+    Vector<bool> flexYuvUnsupported;
+    results.insertAt(OK, 0, pending.size());
+    flexYuvUnsupported.insertAt(false, 0, pending.size());
+    for (size_t i = 0; i < pending.size(); i++) {
+        bool unsupported = false;
+        results.editItemAt(i) = lockAcquiredBuffer(pending[i].item, pending[i].buffer,
+                pending[i].tryFlexYuv, &unsupported, &nativeBuffers[i]);
+        flexYuvUnsupported.editItemAt(i) = unsupported;
+    }
+    if (prefetch) {
+        for (size_t i = 0; i < pending.size(); i++) {
+            if (results[i] == OK) {
+                prefetchPlane(nativeBuffers[i].data);
+                prefetchPlane(nativeBuffers[i].dataCb);
+                prefetchPlane(nativeBuffers[i].dataCr);
+            }
+        }
+    }
+
+    Mutex::Autolock _l(mMutex);
+    // Buffers that locked are handed out in order, those that didn't go back
+    // to the queue.
+    size_t locked = 0;
+    status_t firstError = OK;
+    for (size_t i = 0; i < pending.size(); i++) {
+        const Pending& p = pending[i];
+        if (flexYuvUnsupported[i] && mSlots[p.item.mSlot].mGraphicBuffer == p.buffer) {
+            mFlexYuvUnsupported[p.item.mSlot] = true;
+        }
+        if (results[i] != OK) {
+            if (firstError == OK) {
+                firstError = results[i];
+            }
+            releaseUnlockedBufferLocked(p.lockedIdx);
+            continue;
+        }
+        mAcquiredBuffers.editItemAt(p.lockedIdx).mBufferPointer = nativeBuffers[i].data;
+        if (locked != i) {
+            nativeBuffers[locked] = nativeBuffers[i];
+        }
+        locked++;
+    }
+    return locked > 0 ? ssize_t(locked) : ssize_t(firstError);
+}
+
 status_t CpuConsumer::unlockBuffer(const LockedBuffer &nativeBuffer) {
     Mutex::Autolock _l(mMutex);
     size_t lockedIdx = 0;
 
     void *bufPtr = reinterpret_cast<void *>(nativeBuffer.data);
+    if (bufPtr == NULL) {
+        // also what the entries of buffers being locked hold
+        CC_LOGE("%s: Can't find buffer to free", __FUNCTION__);
+        return BAD_VALUE;
+    }
     for (; lockedIdx < static_cast<size_t>(mMaxLockedBuffers); lockedIdx++) {
         if (bufPtr == mAcquiredBuffers[lockedIdx].mBufferPointer) break;
     }
@@ -258,7 +371,25 @@ status_t CpuConsumer::releaseAcquiredBufferLocked(size_t lockedIdx) {
     return OK;
 }
 
+void CpuConsumer::releaseUnlockedBufferLocked(size_t lockedIdx) {
+    int buf = mAcquiredBuffers[lockedIdx].mSlot;
+    if (CC_LIKELY(mAcquiredBuffers[lockedIdx].mGraphicBuffer ==
+            mSlots[buf].mGraphicBuffer)) {
+        releaseBufferLocked(
+                buf, mAcquiredBuffers[lockedIdx].mGraphicBuffer,
+                EGL_NO_DISPLAY, EGL_NO_SYNC_KHR);
+    }
+
+    AcquiredBuffer &ab = mAcquiredBuffers.editItemAt(lockedIdx);
+    ab.mSlot = BufferQueue::INVALID_BUFFER_SLOT;
+    ab.mBufferPointer = NULL;
+    ab.mGraphicBuffer.clear();
+
+    mCurrentLockedBuffers--;
+}
+
 void CpuConsumer::freeBufferLocked(int slotIndex) {
+    mFlexYuvUnsupported[slotIndex] = false;
     ConsumerBase::freeBufferLocked(slotIndex);
 }
 
@@ -22,6 +22,7 @@
 #include <gui/DisplayEventReceiver.h>
 #include <gui/IDisplayEventConnection.h>
 #include <gui/ISurfaceComposer.h>
+#include <gui/VsyncSnapshot.h>
 
 #include <private/gui/ComposerService.h>
 
@@ -31,7 +32,8 @@ namespace android {
 
 // ---------------------------------------------------------------------------
 
-DisplayEventReceiver::DisplayEventReceiver() {
+DisplayEventReceiver::DisplayEventReceiver()
+    : mVsyncSnapshotQueried(false) {
     sp<ISurfaceComposer> sf(ComposerService::getComposerService());
     if (sf != NULL) {
         mEventConnection = sf->createDisplayEventConnection();
@@ -76,6 +78,16 @@ status_t DisplayEventReceiver::requestNextVsync() {
     return NO_INIT;
 }
 
+status_t DisplayEventReceiver::getLatestVsync(Event* vsync) {
+    if (!mVsyncSnapshotQueried && mEventConnection != NULL) {
+        mVsyncSnapshot = VsyncSnapshot::fromMemory(mEventConnection->getVsyncMemory());
+        mVsyncSnapshotQueried = true;
+    }
+    if (mVsyncSnapshot == NULL) {
+        return NO_INIT;
+    }
+    return mVsyncSnapshot->read(vsync);
+}
 
 ssize_t DisplayEventReceiver::getEvents(DisplayEventReceiver::Event* events,
         size_t count) {
@@ -149,6 +149,13 @@ static bool isEglImageCroppable(const Rect& crop) {
     return hasEglAndroidImageCrop() && (crop.left == 0 && crop.top == 0);
 }
 
+// The crop that EglImage::createImage actually applies to the image, so that
+// crops it would ignore anyway don't cause the image to be recreated.
+static Rect eglImageCrop(const Rect& crop) {
+    return crop.isValid() && isEglImageCroppable(crop) ? crop :
+            Rect::INVALID_RECT;
+}
+
 GLConsumer::GLConsumer(const sp<IGraphicBufferConsumer>& bq, uint32_t tex,
         uint32_t texTarget, bool useFenceSync, bool isControlledByApp) :
     ConsumerBase(bq, isControlledByApp),
@@ -221,7 +228,20 @@ status_t GLConsumer::updateTexImage() {
     ATRACE_CALL();
     GLC_LOGV("updateTexImage");
     Mutex::Autolock lock(mMutex);
+    return updateTexImageLocked(true);
+}
+
+status_t GLConsumer::updateTexImageNoWait(sp<Fence>* outAcquireFence) {
+    ATRACE_CALL();
+    GLC_LOGV("updateTexImageNoWait");
+    Mutex::Autolock lock(mMutex);
+
+    status_t err = updateTexImageLocked(false);
+    *outAcquireFence = err == NO_ERROR ? mCurrentFence : Fence::NO_FENCE;
+    return err;
+}
 
+status_t GLConsumer::updateTexImageLocked(bool waitForFence) {
     if (mAbandoned) {
         GLC_LOGE("updateTexImage: GLConsumer is abandoned!");
         return NO_INIT;
@@ -260,8 +280,9 @@ status_t GLConsumer::updateTexImage() {
         return err;
     }
 
-    // Bind the new buffer to the GL texture, and wait until it's ready.
-    return bindTextureImageLocked();
+    // Bind the new buffer to the GL texture, and wait until it's ready if
+    // asked to.
+    return bindTextureImageLocked(waitForFence);
 }
 
 
@@ -374,11 +395,17 @@ status_t GLConsumer::acquireBufferLocked(BufferItem *item,
     }
 
     // If item->mGraphicBuffer is not null, this buffer has not been acquired
-    // before, so any prior EglImage created is using a stale buffer. This
-    // replaces any old EglImage with a new one (using the new buffer).
+    // in this slot before, so any prior EglImage created is using a stale
+    // buffer. This replaces any old EglImage with one for the new buffer,
+    // reusing the image of the same buffer if it has merely been detached
+    // and attached again.
     if (item->mGraphicBuffer != NULL) {
         int slot = item->mSlot;
-        mEglSlots[slot].mEglImage = new EglImage(item->mGraphicBuffer);
+        sp<EglImage> image = findEglImageLocked(item->mGraphicBuffer);
+        if (image == NULL) {
+            image = new EglImage(item->mGraphicBuffer);
+        }
+        mEglSlots[slot].mEglImage = image;
     }
 
     return NO_ERROR;
@@ -495,7 +522,7 @@ status_t GLConsumer::updateAndReleaseLocked(const BufferItem& item,
     return err;
 }
 
-status_t GLConsumer::bindTextureImageLocked() {
+status_t GLConsumer::bindTextureImageLocked(bool waitForFence) {
     if (mEglDisplay == EGL_NO_DISPLAY) {
         ALOGE("bindTextureImage: invalid display");
         return INVALID_OPERATION;
@@ -544,6 +571,9 @@ status_t GLConsumer::bindTextureImageLocked() {
     }
 
     // Wait for the new buffer to be ready.
+    if (!waitForFence) {
+        return NO_ERROR;
+    }
     return doGLFenceWaitLocked();
 }
 
@@ -692,22 +722,10 @@ status_t GLConsumer::syncForReleaseLocked(EGLDisplay dpy) {
 
     if (mCurrentTexture != BufferQueue::INVALID_BUFFER_SLOT) {
         if (SyncFeatures::getInstance().useNativeFenceSync()) {
-            EGLSyncKHR sync = eglCreateSyncKHR(dpy,
-                    EGL_SYNC_NATIVE_FENCE_ANDROID, NULL);
-            if (sync == EGL_NO_SYNC_KHR) {
-                GLC_LOGE("syncForReleaseLocked: error creating EGL fence: %#x",
-                        eglGetError());
+            sp<Fence> fence(createReleaseFenceLocked(dpy));
+            if (fence == NULL) {
                 return UNKNOWN_ERROR;
             }
-            glFlush();
-            int fenceFd = eglDupNativeFenceFDANDROID(dpy, sync);
-            eglDestroySyncKHR(dpy, sync);
-            if (fenceFd == EGL_NO_NATIVE_FENCE_FD_ANDROID) {
-                GLC_LOGE("syncForReleaseLocked: error dup'ing native fence "
-                        "fd: %#x", eglGetError());
-                return UNKNOWN_ERROR;
-            }
-            sp<Fence> fence(new Fence(fenceFd));
             status_t err = addReleaseFenceLocked(mCurrentTexture,
                     mCurrentTextureImage->graphicBuffer(), fence);
             if (err != OK) {
@@ -751,6 +769,25 @@ status_t GLConsumer::syncForReleaseLocked(EGLDisplay dpy) {
     return OK;
 }
 
+sp<Fence> GLConsumer::createReleaseFenceLocked(EGLDisplay dpy) {
+    EGLSyncKHR sync = eglCreateSyncKHR(dpy,
+            EGL_SYNC_NATIVE_FENCE_ANDROID, NULL);
+    if (sync == EGL_NO_SYNC_KHR) {
+        GLC_LOGE("createReleaseFenceLocked: error creating EGL fence: %#x",
+                eglGetError());
+        return NULL;
+    }
+    glFlush();
+    int fenceFd = eglDupNativeFenceFDANDROID(dpy, sync);
+    eglDestroySyncKHR(dpy, sync);
+    if (fenceFd == EGL_NO_NATIVE_FENCE_FD_ANDROID) {
+        GLC_LOGE("createReleaseFenceLocked: error dup'ing native fence "
+                "fd: %#x", eglGetError());
+        return NULL;
+    }
+    return new Fence(fenceFd);
+}
+
 bool GLConsumer::isExternalFormat(PixelFormat format)
 {
     switch (format) {
@@ -1001,7 +1038,10 @@ status_t GLConsumer::doGLFenceWaitLocked() const {
         return INVALID_OPERATION;
     }
 
-    if (mCurrentFence->isValid()) {
+    // Skip the wait, and the EGL sync it takes, if the buffer is already
+    // ready, e.g. because the app waited for the fence itself.
+    if (mCurrentFence->isValid() &&
+            !mCurrentFence->hasSignaled().value_or(false)) {
         if (SyncFeatures::getInstance().useWaitSync()) {
             // Create an EGLSyncKHR from the current fence.
             int fenceFd = mCurrentFence->dup();
@@ -1046,6 +1086,24 @@ status_t GLConsumer::doGLFenceWaitLocked() const {
     return NO_ERROR;
 }
 
+sp<GLConsumer::EglImage> GLConsumer::findEglImageLocked(
+        const sp<GraphicBuffer>& graphicBuffer) const {
+    // Only an image of the very same GraphicBuffer will do. A buffer with the
+    // same id that was imported again from another process has its own
+    // handle, which the image would not be using.
+    for (int i = 0; i < BufferQueue::NUM_BUFFER_SLOTS; i++) {
+        const sp<EglImage>& image = mEglSlots[i].mEglImage;
+        if (image != NULL && image->graphicBuffer() == graphicBuffer) {
+            return image;
+        }
+    }
+    if (mCurrentTextureImage != NULL &&
+            mCurrentTextureImage->graphicBuffer() == graphicBuffer) {
+        return mCurrentTextureImage;
+    }
+    return NULL;
+}
+
 void GLConsumer::freeBufferLocked(int slotIndex) {
     GLC_LOGV("freeBufferLocked: slotIndex=%d", slotIndex);
     if (slotIndex == mCurrentTexture) {
@@ -1174,7 +1232,8 @@ status_t GLConsumer::EglImage::createIfNeeded(EGLDisplay eglDisplay,
     // If there's an image and it's no longer valid, destroy it.
     bool haveImage = mEglImage != EGL_NO_IMAGE_KHR;
     bool displayInvalid = mEglDisplay != eglDisplay;
-    bool cropInvalid = hasEglAndroidImageCrop() && mCropRect != cropRect;
+    bool cropInvalid = hasEglAndroidImageCrop() &&
+            eglImageCrop(mCropRect) != eglImageCrop(cropRect);
     if (haveImage && (displayInvalid || cropInvalid || forceCreation)) {
         if (!eglDestroyImageKHR(mEglDisplay, mEglImage)) {
            ALOGE("createIfNeeded: eglDestroyImageKHR failed");
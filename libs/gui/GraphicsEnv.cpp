@@ -23,6 +23,12 @@
 #include <log/log.h>
 #include <nativeloader/dlext_namespaces.h>
 
+#include <EGL/egl.h>
+
+// Exported by libEGL for preloadDrivers(), see the FIXME in GraphicsEnv.h
+// about why it isn't part of this class.
+extern "C" EGLBoolean android_preloadGraphicsDrivers();
+
 namespace android {
 
 /*static*/ GraphicsEnv& GraphicsEnv::getInstance() {
@@ -36,6 +42,10 @@ void GraphicsEnv::setDriverPath(const std::string path) {
                 mDriverPath.c_str(), path.c_str());
         return;
     }
+    if (mDriversPreloaded) {
+        ALOGW("drivers were preloaded, ignoring driver path '%s'", path.c_str());
+        return;
+    }
     ALOGV("setting driver path to '%s'", path.c_str());
     mDriverPath = path;
 }
@@ -74,6 +84,17 @@ android_namespace_t* GraphicsEnv::getDriverNamespace() {
     return mDriverNamespace;
 }
 
+bool GraphicsEnv::preloadDrivers() {
+    if (!mDriverPath.empty()) {
+        // the updated driver can only be loaded once the path is known
+        ALOGV("not preloading drivers, driver path is '%s'", mDriverPath.c_str());
+        return false;
+    }
+    mDriversPreloaded = android_preloadGraphicsDrivers() == EGL_TRUE;
+    ALOGE_IF(!mDriversPreloaded, "failed to preload graphics drivers");
+    return mDriversPreloaded;
+}
+
 } // namespace android
 
 extern "C" android_namespace_t* android_getDriverNamespace() {
@@ -33,7 +33,8 @@ namespace android {
 enum {
     GET_DATA_CHANNEL = IBinder::FIRST_CALL_TRANSACTION,
     SET_VSYNC_RATE,
-    REQUEST_NEXT_VSYNC
+    REQUEST_NEXT_VSYNC,
+    GET_VSYNC_MEMORY
 };
 
 class BpDisplayEventConnection : public BpInterface<IDisplayEventConnection>
@@ -66,6 +67,17 @@ public:
         data.writeInterfaceToken(IDisplayEventConnection::getInterfaceDescriptor());
         remote()->transact(REQUEST_NEXT_VSYNC, data, &reply, IBinder::FLAG_ONEWAY);
     }
+
+    virtual sp<IMemory> getVsyncMemory() const
+    {
+        Parcel data, reply;
+        data.writeInterfaceToken(IDisplayEventConnection::getInterfaceDescriptor());
+        status_t err = remote()->transact(GET_VSYNC_MEMORY, data, &reply);
+        if (err != NO_ERROR) {
+            return NULL;
+        }
+        return interface_cast<IMemory>(reply.readStrongBinder());
+    }
 };
 
 // Out-of-line virtual method definition to trigger vtable emission in this
@@ -96,6 +108,11 @@ status_t BnDisplayEventConnection::onTransact(
             requestNextVsync();
             return NO_ERROR;
         }
+        case GET_VSYNC_MEMORY: {
+            CHECK_INTERFACE(IDisplayEventConnection, data, reply);
+            reply->writeStrongBinder(IInterface::asBinder(getVsyncMemory()));
+            return NO_ERROR;
+        }
     }
     return BBinder::onTransact(code, data, reply, flags);
 }
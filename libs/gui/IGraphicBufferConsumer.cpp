@@ -54,6 +54,9 @@ enum {
     GET_OCCUPANCY_HISTORY,
     DISCARD_FREE_BUFFERS,
     DUMP,
+    DUMP_LATENCY,
+    SET_FRAME_DROP_POLICY,
+    TRIM_FREE_BUFFERS,
 };
 
 
@@ -310,6 +313,44 @@ public:
         remote()->transact(DUMP, data, &reply);
         reply.readString8();
     }
+
+    virtual void dumpLatency(String8& result, const char* prefix) const {
+        Parcel data, reply;
+        data.writeInterfaceToken(IGraphicBufferConsumer::getInterfaceDescriptor());
+        data.writeString8(String8(prefix ? prefix : ""));
+        if (remote()->transact(DUMP_LATENCY, data, &reply) == NO_ERROR) {
+            result.append(reply.readString8());
+        }
+    }
+
+    virtual status_t setFrameDropPolicy(int maxQueuedFrames,
+            nsecs_t expectedPresentOffset) {
+        Parcel data, reply;
+        data.writeInterfaceToken(IGraphicBufferConsumer::getInterfaceDescriptor());
+        data.writeInt32(maxQueuedFrames);
+        data.writeInt64(expectedPresentOffset);
+        status_t result = remote()->transact(SET_FRAME_DROP_POLICY, data, &reply);
+        if (result != NO_ERROR) {
+            return result;
+        }
+        return reply.readInt32();
+    }
+
+    virtual status_t trimFreeBuffers(int maxAllocatedBuffers) {
+        Parcel data, reply;
+        data.writeInterfaceToken(IGraphicBufferConsumer::getInterfaceDescriptor());
+        data.writeInt32(maxAllocatedBuffers);
+        status_t error = remote()->transact(TRIM_FREE_BUFFERS, data, &reply);
+        if (error != NO_ERROR) {
+            return error;
+        }
+        int32_t result = NO_ERROR;
+        error = reply.readInt32(&result);
+        if (error != NO_ERROR) {
+            return error;
+        }
+        return result;
+    }
 };
 
 // Out-of-line virtual method definition to trigger vtable emission in this
@@ -484,6 +525,31 @@ status_t BnGraphicBufferConsumer::onTransact(
             reply->writeString8(result);
             return NO_ERROR;
         }
+        case DUMP_LATENCY: {
+            CHECK_INTERFACE(IGraphicBufferConsumer, data, reply);
+            String8 prefix = data.readString8();
+            String8 result;
+            static_cast<IGraphicBufferConsumer*>(this)->dumpLatency(result,
+                    prefix);
+            reply->writeString8(result);
+            return NO_ERROR;
+        }
+        case SET_FRAME_DROP_POLICY: {
+            CHECK_INTERFACE(IGraphicBufferConsumer, data, reply);
+            int maxQueuedFrames = data.readInt32();
+            nsecs_t expectedPresentOffset = data.readInt64();
+            status_t result = setFrameDropPolicy(maxQueuedFrames,
+                    expectedPresentOffset);
+            reply->writeInt32(result);
+            return NO_ERROR;
+        }
+        case TRIM_FREE_BUFFERS: {
+            CHECK_INTERFACE(IGraphicBufferConsumer, data, reply);
+            int maxAllocatedBuffers = data.readInt32();
+            status_t result = trimFreeBuffers(maxAllocatedBuffers);
+            status_t error = reply->writeInt32(result);
+            return error;
+        }
     }
     return BBinder::onTransact(code, data, reply, flags);
 }
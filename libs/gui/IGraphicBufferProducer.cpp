@@ -26,6 +26,8 @@
 #include <binder/Parcel.h>
 #include <binder/IInterface.h>
 
+#include <gui/BitTube.h>
+#include <gui/BufferItem.h>
 #include <gui/BufferQueueDefs.h>
 #include <gui/IGraphicBufferProducer.h>
 #include <gui/IProducerListener.h>
@@ -56,7 +58,9 @@ enum {
     SET_DEQUEUE_TIMEOUT,
     GET_LAST_QUEUED_BUFFER,
     GET_FRAME_TIMESTAMPS,
-    GET_UNIQUE_ID
+    GET_UNIQUE_ID,
+    QUEUE_AND_DEQUEUE_BUFFER,
+    CREATE_FRAME_EVENT_CHANNEL
 };
 
 class BpGraphicBufferProducer : public BpInterface<IGraphicBufferProducer>
@@ -232,6 +236,59 @@ public:
         return result;
     }
 
+    virtual status_t queueAndDequeueBuffer(int buf,
+            const QueueBufferInput& input, QueueBufferOutput* output,
+            uint32_t width, uint32_t height, PixelFormat format,
+            uint32_t usage, int* outSlot, sp<Fence>* outFence,
+            sp<GraphicBuffer>* outBuffer, status_t* outDequeueResult) {
+        *outSlot = BufferItem::INVALID_BUFFER_SLOT;
+        Parcel data, reply;
+        data.writeInterfaceToken(IGraphicBufferProducer::getInterfaceDescriptor());
+        data.writeInt32(buf);
+        data.write(input);
+        data.writeUint32(width);
+        data.writeUint32(height);
+        data.writeInt32(static_cast<int32_t>(format));
+        data.writeUint32(usage);
+        status_t result = remote()->transact(QUEUE_AND_DEQUEUE_BUFFER, data,
+                &reply);
+        if (result != NO_ERROR) {
+            return result;
+        }
+        memcpy(output, reply.readInplace(sizeof(*output)), sizeof(*output));
+        result = reply.readInt32();
+        if (result != NO_ERROR) {
+            return result;
+        }
+
+        int slot = reply.readInt32();
+        if (slot == BufferItem::INVALID_BUFFER_SLOT) {
+            return NO_ERROR;
+        }
+        if (slot < 0 || slot >= BufferQueueDefs::NUM_BUFFER_SLOTS) {
+            ALOGE("queueAndDequeueBuffer returned invalid slot %d", slot);
+            android_errorWriteLog(0x534e4554, "36991414");
+            return UNKNOWN_ERROR;
+        }
+        *outDequeueResult = reply.readInt32();
+        *outFence = new Fence();
+        status_t err = reply.read(**outFence);
+        if (err != NO_ERROR) {
+            outFence->clear();
+            return err;
+        }
+        bool nonNull = reply.readInt32();
+        if (nonNull) {
+            *outBuffer = new GraphicBuffer();
+            if (reply.read(**outBuffer) != NO_ERROR) {
+                // The slot is still ours; the caller will requestBuffer it
+                outBuffer->clear();
+            }
+        }
+        *outSlot = slot;
+        return NO_ERROR;
+    }
+
     virtual status_t cancelBuffer(int buf, const sp<Fence>& fence) {
         Parcel data, reply;
         data.writeInterfaceToken(IGraphicBufferProducer::getInterfaceDescriptor());
@@ -485,6 +542,26 @@ public:
         }
         return actualResult;
     }
+
+    virtual status_t createFrameEventChannel(sp<BitTube>* outChannel) {
+        Parcel data, reply;
+        data.writeInterfaceToken(IGraphicBufferProducer::getInterfaceDescriptor());
+        status_t result = remote()->transact(CREATE_FRAME_EVENT_CHANNEL, data,
+                &reply);
+        if (result != NO_ERROR) {
+            ALOGE("createFrameEventChannel failed to transact: %d", result);
+            return result;
+        }
+        status_t actualResult = NO_ERROR;
+        result = reply.readInt32(&actualResult);
+        if (result != NO_ERROR) {
+            return result;
+        }
+        if (actualResult == NO_ERROR) {
+            *outChannel = new BitTube(reply);
+        }
+        return actualResult;
+    }
 };
 
 // Out-of-line virtual method definition to trigger vtable emission in this
@@ -592,6 +669,43 @@ status_t BnGraphicBufferProducer::onTransact(
             reply->writeInt32(result);
             return NO_ERROR;
         }
+        case QUEUE_AND_DEQUEUE_BUFFER: {
+            CHECK_INTERFACE(IGraphicBufferProducer, data, reply);
+            int buf = data.readInt32();
+            QueueBufferInput input(data);
+            uint32_t width = data.readUint32();
+            uint32_t height = data.readUint32();
+            PixelFormat format = static_cast<PixelFormat>(data.readInt32());
+            uint32_t usage = data.readUint32();
+            QueueBufferOutput* const output =
+                    reinterpret_cast<QueueBufferOutput *>(
+                            reply->writeInplace(sizeof(QueueBufferOutput)));
+            memset(output, 0, sizeof(QueueBufferOutput));
+            int slot = BufferItem::INVALID_BUFFER_SLOT;
+            sp<Fence> fence;
+            sp<GraphicBuffer> buffer;
+            status_t dequeueResult = NO_ERROR;
+            status_t result = queueAndDequeueBuffer(buf, input, output, width,
+                    height, format, usage, &slot, &fence, &buffer,
+                    &dequeueResult);
+            reply->writeInt32(result);
+            if (result != NO_ERROR) {
+                return NO_ERROR;
+            }
+            if (fence == NULL) {
+                slot = BufferItem::INVALID_BUFFER_SLOT;
+            }
+            reply->writeInt32(slot);
+            if (slot != BufferItem::INVALID_BUFFER_SLOT) {
+                reply->writeInt32(dequeueResult);
+                reply->write(*fence);
+                reply->writeInt32(buffer != NULL);
+                if (buffer != NULL) {
+                    reply->write(*buffer);
+                }
+            }
+            return NO_ERROR;
+        }
         case CANCEL_BUFFER: {
             CHECK_INTERFACE(IGraphicBufferProducer, data, reply);
             int buf = data.readInt32();
@@ -763,12 +877,40 @@ status_t BnGraphicBufferProducer::onTransact(
             }
             return NO_ERROR;
         }
+        case CREATE_FRAME_EVENT_CHANNEL: {
+            CHECK_INTERFACE(IGraphicBufferProducer, data, reply);
+            sp<BitTube> channel;
+            status_t actualResult = createFrameEventChannel(&channel);
+            status_t result = reply->writeInt32(actualResult);
+            if (result != NO_ERROR) {
+                return result;
+            }
+            if (actualResult == NO_ERROR) {
+                result = channel->writeToParcel(reply);
+                if (result != NO_ERROR) {
+                    ALOGE("onTransact failed to write channel: %d", result);
+                    return result;
+                }
+            }
+            return NO_ERROR;
+        }
     }
     return BBinder::onTransact(code, data, reply, flags);
 }
 
 // ----------------------------------------------------------------------------
 
+status_t IGraphicBufferProducer::queueAndDequeueBuffer(int slot,
+        const QueueBufferInput& input, QueueBufferOutput* output,
+        uint32_t /*w*/, uint32_t /*h*/, PixelFormat /*format*/,
+        uint32_t /*usage*/, int* outSlot, sp<Fence>* /*outFence*/,
+        sp<GraphicBuffer>* /*outBuffer*/, status_t* /*outDequeueResult*/) {
+    *outSlot = BufferItem::INVALID_BUFFER_SLOT;
+    return queueBuffer(slot, input, output);
+}
+
+// ----------------------------------------------------------------------------
+
 IGraphicBufferProducer::QueueBufferInput::QueueBufferInput(const Parcel& parcel) {
     parcel.read(*this);
 }
@@ -37,6 +37,8 @@ enum {
     CREATE_SENSOR_EVENT_CONNECTION,
     ENABLE_DATA_INJECTION,
     GET_DYNAMIC_SENSOR_LIST,
+    CREATE_SENSOR_DIRECT_CONNECTION,
+    GET_SENSOR_LIST_MEMORY,
 };
 
 class BpSensorServer : public BpInterface<ISensorServer>
@@ -83,6 +85,32 @@ public:
         return v;
     }
 
+    virtual sp<IMemory> getSensorListMemory(const String16& opPackageName,
+            Vector<SensorListMemory::Entry>* entries)
+    {
+        Parcel data, reply;
+        data.writeInterfaceToken(ISensorServer::getInterfaceDescriptor());
+        data.writeString16(opPackageName);
+        status_t err = remote()->transact(GET_SENSOR_LIST_MEMORY, data, &reply);
+        if (err != NO_ERROR) {
+            return NULL;
+        }
+        sp<IMemory> memory = interface_cast<IMemory>(reply.readStrongBinder());
+        uint32_t n = reply.readUint32();
+        if (memory == NULL || n > reply.dataAvail() / (2 * sizeof(int32_t))) {
+            return NULL;
+        }
+        entries->clear();
+        entries->setCapacity(n);
+        while (n--) {
+            SensorListMemory::Entry entry;
+            entry.index = reply.readUint32();
+            entry.id = reply.readInt32();
+            entries->add(entry);
+        }
+        return memory;
+    }
+
     virtual sp<ISensorEventConnection> createSensorEventConnection(const String8& packageName,
              int mode, const String16& opPackageName)
     {
@@ -101,6 +129,18 @@ public:
         remote()->transact(ENABLE_DATA_INJECTION, data, &reply);
         return reply.readInt32();
     }
+
+    virtual sp<ISensorEventConnection> createSensorDirectConnection(const String8& packageName,
+             const String16& opPackageName, int fd)
+    {
+        Parcel data, reply;
+        data.writeInterfaceToken(ISensorServer::getInterfaceDescriptor());
+        data.writeString8(packageName);
+        data.writeString16(opPackageName);
+        data.writeFileDescriptor(fd);
+        remote()->transact(CREATE_SENSOR_DIRECT_CONNECTION, data, &reply);
+        return interface_cast<ISensorEventConnection>(reply.readStrongBinder());
+    }
 };
 
 // Out-of-line virtual method definition to trigger vtable emission in this
@@ -153,6 +193,34 @@ status_t BnSensorServer::onTransact(
             }
             return NO_ERROR;
         }
+        case GET_SENSOR_LIST_MEMORY: {
+            CHECK_INTERFACE(ISensorServer, data, reply);
+            const String16& opPackageName = data.readString16();
+            Vector<SensorListMemory::Entry> entries;
+            sp<IMemory> memory(getSensorListMemory(opPackageName, &entries));
+            reply->writeStrongBinder(IInterface::asBinder(memory));
+            size_t n = memory != NULL ? entries.size() : 0;
+            reply->writeUint32(static_cast<uint32_t>(n));
+            for (size_t i = 0; i < n; i++) {
+                reply->writeUint32(entries[i].index);
+                reply->writeInt32(entries[i].id);
+            }
+            return NO_ERROR;
+        }
+        case CREATE_SENSOR_DIRECT_CONNECTION: {
+            CHECK_INTERFACE(ISensorServer, data, reply);
+            String8 packageName = data.readString8();
+            const String16& opPackageName = data.readString16();
+            // The parcel owns the fd, the service has to dup it to keep it.
+            int fd = data.readFileDescriptor();
+            if (fd < 0) {
+                return BAD_VALUE;
+            }
+            sp<ISensorEventConnection> connection(createSensorDirectConnection(packageName,
+                    opPackageName, fd));
+            reply->writeStrongBinder(IInterface::asBinder(connection));
+            return NO_ERROR;
+        }
     }
     return BBinder::onTransact(code, data, reply, flags);
 }
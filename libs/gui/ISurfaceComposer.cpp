@@ -29,6 +29,7 @@
 #include <gui/IDisplayEventConnection.h>
 #include <gui/ISurfaceComposer.h>
 #include <gui/IGraphicBufferProducer.h>
+#include <gui/ITransactionCompletedListener.h>
 
 #include <private/gui/LayerState.h>
 
@@ -36,6 +37,8 @@
 
 #include <ui/DisplayInfo.h>
 #include <ui/DisplayStatInfo.h>
+#include <ui/Fence.h>
+#include <ui/GraphicBuffer.h>
 #include <ui/HdrCapabilities.h>
 
 #include <utils/Log.h>
@@ -46,6 +49,52 @@ namespace android {
 
 class IDisplayEventConnection;
 
+// ----------------------------------------------------------------------------
+
+static void writeTransactionState(Parcel& data,
+        const Vector<ComposerState>& state,
+        const Vector<DisplayState>& displays) {
+    data.writeUint32(static_cast<uint32_t>(state.size()));
+    for (const auto& s : state) {
+        s.write(data);
+    }
+
+    data.writeUint32(static_cast<uint32_t>(displays.size()));
+    for (const auto& d : displays) {
+        d.write(data);
+    }
+}
+
+static status_t readTransactionState(const Parcel& data,
+        Vector<ComposerState>* outState, Vector<DisplayState>* outDisplays) {
+    size_t count = data.readUint32();
+    if (count > data.dataSize()) {
+        return BAD_VALUE;
+    }
+    ComposerState s;
+    outState->setCapacity(count);
+    for (size_t i = 0; i < count; i++) {
+        if (s.read(data) == BAD_VALUE) {
+            return BAD_VALUE;
+        }
+        outState->add(s);
+    }
+
+    count = data.readUint32();
+    if (count > data.dataSize()) {
+        return BAD_VALUE;
+    }
+    DisplayState d;
+    outDisplays->setCapacity(count);
+    for (size_t i = 0; i < count; i++) {
+        if (d.read(data) == BAD_VALUE) {
+            return BAD_VALUE;
+        }
+        outDisplays->add(d);
+    }
+    return NO_ERROR;
+}
+
 class BpSurfaceComposer : public BpInterface<ISurfaceComposer>
 {
 public:
@@ -79,21 +128,34 @@ public:
     {
         Parcel data, reply;
         data.writeInterfaceToken(ISurfaceComposer::getInterfaceDescriptor());
-
-        data.writeUint32(static_cast<uint32_t>(state.size()));
-        for (const auto& s : state) {
-            s.write(data);
-        }
-
-        data.writeUint32(static_cast<uint32_t>(displays.size()));
-        for (const auto& d : displays) {
-            d.write(data);
-        }
-
+        writeTransactionState(data, state, displays);
         data.writeUint32(flags);
         remote()->transact(BnSurfaceComposer::SET_TRANSACTION_STATE, data, &reply);
     }
 
+    virtual status_t setTransactionStateAsync(
+            const Vector<ComposerState>& state,
+            const Vector<DisplayState>& displays,
+            uint32_t flags, nsecs_t desiredPresentTime,
+            const sp<ITransactionCompletedListener>& listener,
+            uint64_t transactionId)
+    {
+        Parcel data, reply;
+        data.writeInterfaceToken(ISurfaceComposer::getInterfaceDescriptor());
+        writeTransactionState(data, state, displays);
+        data.writeUint32(flags);
+        data.writeInt64(desiredPresentTime);
+        data.writeStrongBinder(IInterface::asBinder(listener));
+        data.writeUint64(transactionId);
+        status_t result = remote()->transact(
+                BnSurfaceComposer::SET_TRANSACTION_STATE_ASYNC, data, &reply);
+        if (result != NO_ERROR) {
+            ALOGE("setTransactionStateAsync failed to transact: %d", result);
+            return result;
+        }
+        return reply.readInt32();
+    }
+
     virtual void bootFinished()
     {
         Parcel data, reply;
@@ -125,6 +187,71 @@ public:
         return reply.readInt32();
     }
 
+    virtual status_t captureScreenToBuffer(const sp<IBinder>& display,
+            const sp<GraphicBuffer>& buffer, Rect sourceCrop,
+            uint32_t minLayerZ, uint32_t maxLayerZ,
+            bool useIdentityTransform,
+            ISurfaceComposer::Rotation rotation,
+            sp<Fence>* outFence)
+    {
+        Parcel data, reply;
+        data.writeInterfaceToken(ISurfaceComposer::getInterfaceDescriptor());
+        data.writeStrongBinder(display);
+        data.write(*buffer);
+        data.write(sourceCrop);
+        data.writeUint32(minLayerZ);
+        data.writeUint32(maxLayerZ);
+        data.writeInt32(static_cast<int32_t>(useIdentityTransform));
+        data.writeInt32(static_cast<int32_t>(rotation));
+        status_t result = remote()->transact(
+                BnSurfaceComposer::CAPTURE_SCREEN_TO_BUFFER, data, &reply);
+        if (result != NO_ERROR) {
+            ALOGE("captureScreenToBuffer failed to transact: %d", result);
+            return result;
+        }
+        result = reply.readInt32();
+        if (result != NO_ERROR) {
+            return result;
+        }
+        sp<Fence> fence = new Fence();
+        result = reply.read(*fence);
+        if (result != NO_ERROR) {
+            ALOGE("captureScreenToBuffer failed to read fence: %d", result);
+            return result;
+        }
+        *outFence = fence;
+        return NO_ERROR;
+    }
+
+    virtual status_t captureLayerToBuffer(const sp<IBinder>& layerHandle,
+            const sp<GraphicBuffer>& buffer, Rect sourceCrop,
+            sp<Fence>* outFence)
+    {
+        Parcel data, reply;
+        data.writeInterfaceToken(ISurfaceComposer::getInterfaceDescriptor());
+        data.writeStrongBinder(layerHandle);
+        data.write(*buffer);
+        data.write(sourceCrop);
+        status_t result = remote()->transact(
+                BnSurfaceComposer::CAPTURE_LAYER_TO_BUFFER, data, &reply);
+        if (result != NO_ERROR) {
+            ALOGE("captureLayerToBuffer failed to transact: %d", result);
+            return result;
+        }
+        result = reply.readInt32();
+        if (result != NO_ERROR) {
+            return result;
+        }
+        sp<Fence> fence = new Fence();
+        result = reply.read(*fence);
+        if (result != NO_ERROR) {
+            ALOGE("captureLayerToBuffer failed to read fence: %d", result);
+            return result;
+        }
+        *outFence = fence;
+        return NO_ERROR;
+    }
+
     virtual bool authenticateSurfaceTexture(
             const sp<IGraphicBufferProducer>& bufferProducer) const
     {
@@ -413,37 +540,31 @@ status_t BnSurfaceComposer::onTransact(
         }
         case SET_TRANSACTION_STATE: {
             CHECK_INTERFACE(ISurfaceComposer, data, reply);
-
-            size_t count = data.readUint32();
-            if (count > data.dataSize()) {
-                return BAD_VALUE;
-            }
-            ComposerState s;
             Vector<ComposerState> state;
-            state.setCapacity(count);
-            for (size_t i = 0; i < count; i++) {
-                if (s.read(data) == BAD_VALUE) {
-                    return BAD_VALUE;
-                }
-                state.add(s);
-            }
-
-            count = data.readUint32();
-            if (count > data.dataSize()) {
+            Vector<DisplayState> displays;
+            if (readTransactionState(data, &state, &displays) != NO_ERROR) {
                 return BAD_VALUE;
             }
-            DisplayState d;
+            uint32_t stateFlags = data.readUint32();
+            setTransactionState(state, displays, stateFlags);
+            return NO_ERROR;
+        }
+        case SET_TRANSACTION_STATE_ASYNC: {
+            CHECK_INTERFACE(ISurfaceComposer, data, reply);
+            Vector<ComposerState> state;
             Vector<DisplayState> displays;
-            displays.setCapacity(count);
-            for (size_t i = 0; i < count; i++) {
-                if (d.read(data) == BAD_VALUE) {
-                    return BAD_VALUE;
-                }
-                displays.add(d);
+            if (readTransactionState(data, &state, &displays) != NO_ERROR) {
+                return BAD_VALUE;
             }
-
             uint32_t stateFlags = data.readUint32();
-            setTransactionState(state, displays, stateFlags);
+            nsecs_t desiredPresentTime = data.readInt64();
+            sp<ITransactionCompletedListener> listener =
+                    interface_cast<ITransactionCompletedListener>(
+                            data.readStrongBinder());
+            uint64_t transactionId = data.readUint64();
+            status_t result = setTransactionStateAsync(state, displays,
+                    stateFlags, desiredPresentTime, listener, transactionId);
+            reply->writeInt32(result);
             return NO_ERROR;
         }
         case BOOT_FINISHED: {
@@ -474,6 +595,53 @@ status_t BnSurfaceComposer::onTransact(
             reply->writeInt32(res);
             return NO_ERROR;
         }
+        case CAPTURE_SCREEN_TO_BUFFER: {
+            CHECK_INTERFACE(ISurfaceComposer, data, reply);
+            sp<IBinder> display = data.readStrongBinder();
+            sp<GraphicBuffer> buffer = new GraphicBuffer();
+            status_t result = data.read(*buffer);
+            if (result != NO_ERROR) {
+                ALOGE("captureScreenToBuffer failed to read buffer: %d", result);
+                return result;
+            }
+            Rect sourceCrop(Rect::EMPTY_RECT);
+            data.read(sourceCrop);
+            uint32_t minLayerZ = data.readUint32();
+            uint32_t maxLayerZ = data.readUint32();
+            bool useIdentityTransform = static_cast<bool>(data.readInt32());
+            int32_t rotation = data.readInt32();
+
+            sp<Fence> fence;
+            result = captureScreenToBuffer(display, buffer, sourceCrop,
+                    minLayerZ, maxLayerZ, useIdentityTransform,
+                    static_cast<ISurfaceComposer::Rotation>(rotation), &fence);
+            reply->writeInt32(result);
+            if (result == NO_ERROR) {
+                reply->write(*fence);
+            }
+            return NO_ERROR;
+        }
+        case CAPTURE_LAYER_TO_BUFFER: {
+            CHECK_INTERFACE(ISurfaceComposer, data, reply);
+            sp<IBinder> layerHandle = data.readStrongBinder();
+            sp<GraphicBuffer> buffer = new GraphicBuffer();
+            status_t result = data.read(*buffer);
+            if (result != NO_ERROR) {
+                ALOGE("captureLayerToBuffer failed to read buffer: %d", result);
+                return result;
+            }
+            Rect sourceCrop(Rect::EMPTY_RECT);
+            data.read(sourceCrop);
+
+            sp<Fence> fence;
+            result = captureLayerToBuffer(layerHandle, buffer, sourceCrop,
+                    &fence);
+            reply->writeInt32(result);
+            if (result == NO_ERROR) {
+                reply->write(*fence);
+            }
+            return NO_ERROR;
+        }
         case AUTHENTICATE_SURFACE: {
             CHECK_INTERFACE(ISurfaceComposer, data, reply);
             sp<IGraphicBufferProducer> bufferProducer =
@@ -0,0 +1,78 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <binder/Parcel.h>
+
+#include <gui/ITransactionCompletedListener.h>
+
+#include <ui/Fence.h>
+
+namespace android {
+
+enum {
+    ON_TRANSACTION_COMPLETED = IBinder::FIRST_CALL_TRANSACTION,
+};
+
+class BpTransactionCompletedListener :
+        public BpInterface<ITransactionCompletedListener>
+{
+public:
+    BpTransactionCompletedListener(const sp<IBinder>& impl)
+        : BpInterface<ITransactionCompletedListener>(impl) {}
+
+    virtual ~BpTransactionCompletedListener();
+
+    virtual void onTransactionCompleted(uint64_t transactionId,
+            nsecs_t latchTime, const sp<Fence>& presentFence) {
+        Parcel data, reply;
+        data.writeInterfaceToken(
+                ITransactionCompletedListener::getInterfaceDescriptor());
+        data.writeUint64(transactionId);
+        data.writeInt64(latchTime);
+        data.write(*presentFence);
+        remote()->transact(ON_TRANSACTION_COMPLETED, data, &reply,
+                IBinder::FLAG_ONEWAY);
+    }
+};
+
+// Out-of-line virtual method definition to trigger vtable emission in this
+// translation unit (see clang warning -Wweak-vtables)
+BpTransactionCompletedListener::~BpTransactionCompletedListener() {}
+
+IMPLEMENT_META_INTERFACE(TransactionCompletedListener,
+        "android.gui.ITransactionCompletedListener")
+
+status_t BnTransactionCompletedListener::onTransact(uint32_t code,
+        const Parcel& data, Parcel* reply, uint32_t flags) {
+    switch (code) {
+        case ON_TRANSACTION_COMPLETED: {
+            CHECK_INTERFACE(ITransactionCompletedListener, data, reply);
+            uint64_t transactionId = data.readUint64();
+            nsecs_t latchTime = data.readInt64();
+            sp<Fence> presentFence = new Fence();
+            status_t result = data.read(*presentFence);
+            if (result != NO_ERROR) {
+                ALOGE("onTransactionCompleted: failed to read fence");
+                return result;
+            }
+            onTransactionCompleted(transactionId, latchTime, presentFence);
+            return NO_ERROR;
+        }
+    }
+    return BBinder::onTransact(code, data, reply, flags);
+}
+
+} // namespace android
@@ -22,65 +22,141 @@
 
 namespace android {
 
+// Only the fields flagged in 'what' go over the wire, in the order of the
+// checks below; read() leaves the others at their defaults.
+
 status_t layer_state_t::write(Parcel& output) const
 {
     output.writeStrongBinder(surface);
     output.writeUint32(what);
-    output.writeFloat(x);
-    output.writeFloat(y);
-    output.writeUint32(z);
-    output.writeUint32(w);
-    output.writeUint32(h);
-    output.writeUint32(layerStack);
-    output.writeFloat(blur);
-    output.writeStrongBinder(blurMaskSurface);
-    output.writeUint32(blurMaskSampling);
-    output.writeFloat(blurMaskAlphaThreshold);
-    output.writeFloat(alpha);
-    output.writeUint32(flags);
-    output.writeUint32(mask);
-    *reinterpret_cast<layer_state_t::matrix22_t *>(
-            output.writeInplace(sizeof(layer_state_t::matrix22_t))) = matrix;
-    output.write(crop);
-    output.write(finalCrop);
-    output.writeStrongBinder(handle);
-    output.writeUint64(frameNumber);
-    output.writeInt32(overrideScalingMode);
-    output.writeUint32(color);
-    output.write(transparentRegion);
+    if (what & ePositionChanged) {
+        output.writeFloat(x);
+        output.writeFloat(y);
+    }
+    if (what & eLayerChanged) {
+        output.writeUint32(z);
+    }
+    if (what & eSizeChanged) {
+        output.writeUint32(w);
+        output.writeUint32(h);
+    }
+    if (what & eLayerStackChanged) {
+        output.writeUint32(layerStack);
+    }
+    if (what & eBlurChanged) {
+        output.writeFloat(blur);
+    }
+    if (what & eBlurMaskSurfaceChanged) {
+        output.writeStrongBinder(blurMaskSurface);
+    }
+    if (what & eBlurMaskSamplingChanged) {
+        output.writeUint32(blurMaskSampling);
+    }
+    if (what & eBlurMaskAlphaThresholdChanged) {
+        output.writeFloat(blurMaskAlphaThreshold);
+    }
+    if (what & eAlphaChanged) {
+        output.writeFloat(alpha);
+    }
+    if (what & eFlagsChanged) {
+        output.writeUint32(uint32_t(flags) | (uint32_t(mask) << 8));
+    }
+    if (what & eMatrixChanged) {
+        *reinterpret_cast<layer_state_t::matrix22_t *>(
+                output.writeInplace(sizeof(layer_state_t::matrix22_t))) = matrix;
+    }
+    if (what & eCropChanged) {
+        output.write(crop);
+    }
+    if (what & eFinalCropChanged) {
+        output.write(finalCrop);
+    }
+    if (what & eDeferTransaction) {
+        output.writeStrongBinder(handle);
+        output.writeUint64(frameNumber);
+    }
+    if (what & eOverrideScalingModeChanged) {
+        output.writeInt32(overrideScalingMode);
+    }
+    if (what & eColorChanged) {
+        output.writeUint32(color);
+    }
+    if (what & eTransparentRegionChanged) {
+        output.write(transparentRegion);
+    }
     return NO_ERROR;
 }
 
 status_t layer_state_t::read(const Parcel& input)
 {
+    // the same state may be read into over and over
+    *this = layer_state_t();
+
     surface = input.readStrongBinder();
     what = input.readUint32();
-    x = input.readFloat();
-    y = input.readFloat();
-    z = input.readUint32();
-    w = input.readUint32();
-    h = input.readUint32();
-    layerStack = input.readUint32();
-    blur = input.readFloat();
-    blurMaskSurface = input.readStrongBinder();
-    blurMaskSampling = input.readUint32();
-    blurMaskAlphaThreshold = input.readFloat();
-    alpha = input.readFloat();
-    flags = static_cast<uint8_t>(input.readUint32());
-    mask = static_cast<uint8_t>(input.readUint32());
-    const void* matrix_data = input.readInplace(sizeof(layer_state_t::matrix22_t));
-    if (matrix_data) {
-        matrix = *reinterpret_cast<layer_state_t::matrix22_t const *>(matrix_data);
-    } else {
-        return BAD_VALUE;
-    }
-    input.read(crop);
-    input.read(finalCrop);
-    handle = input.readStrongBinder();
-    frameNumber = input.readUint64();
-    overrideScalingMode = input.readInt32();
-    color = input.readUint32();
-    input.read(transparentRegion);
+    if (what & ePositionChanged) {
+        x = input.readFloat();
+        y = input.readFloat();
+    }
+    if (what & eLayerChanged) {
+        z = input.readUint32();
+    }
+    if (what & eSizeChanged) {
+        w = input.readUint32();
+        h = input.readUint32();
+    }
+    if (what & eLayerStackChanged) {
+        layerStack = input.readUint32();
+    }
+    if (what & eBlurChanged) {
+        blur = input.readFloat();
+    }
+    if (what & eBlurMaskSurfaceChanged) {
+        blurMaskSurface = input.readStrongBinder();
+    }
+    if (what & eBlurMaskSamplingChanged) {
+        blurMaskSampling = input.readUint32();
+    }
+    if (what & eBlurMaskAlphaThresholdChanged) {
+        blurMaskAlphaThreshold = input.readFloat();
+    }
+    if (what & eAlphaChanged) {
+        alpha = input.readFloat();
+    }
+    if (what & eFlagsChanged) {
+        const uint32_t flagsAndMask = input.readUint32();
+        flags = static_cast<uint8_t>(flagsAndMask);
+        mask = static_cast<uint8_t>(flagsAndMask >> 8);
+    }
+    if (what & eMatrixChanged) {
+        const void* matrix_data = input.readInplace(sizeof(layer_state_t::matrix22_t));
+        if (matrix_data) {
+            matrix = *reinterpret_cast<layer_state_t::matrix22_t const *>(matrix_data);
+        } else {
+            return BAD_VALUE;
+        }
+    }
+    if (what & eCropChanged) {
+        input.read(crop);
+    }
+    if (what & eFinalCropChanged) {
+        input.read(finalCrop);
+    }
+    if (what & eDeferTransaction) {
+        handle = input.readStrongBinder();
+        frameNumber = input.readUint64();
+    }
+    if (what & eOverrideScalingModeChanged) {
+        overrideScalingMode = input.readInt32();
+    }
+    if (what & eColorChanged) {
+        color = input.readUint32();
+    }
+    if (what & eTransparentRegionChanged) {
+        if (input.read(transparentRegion) != NO_ERROR) {
+            return BAD_VALUE;
+        }
+    }
     return NO_ERROR;
 }
 
@@ -89,6 +165,65 @@ status_t ComposerState::write(Parcel& output) const {
     return state.write(output);
 }
 
+void layer_state_t::merge(const layer_state_t& other) {
+    if (other.what & ePositionChanged) {
+        x = other.x;
+        y = other.y;
+    }
+    if (other.what & eLayerChanged) {
+        z = other.z;
+    }
+    if (other.what & eSizeChanged) {
+        w = other.w;
+        h = other.h;
+    }
+    if (other.what & eAlphaChanged) {
+        alpha = other.alpha;
+    }
+    if (other.what & eMatrixChanged) {
+        matrix = other.matrix;
+    }
+    if (other.what & eTransparentRegionChanged) {
+        transparentRegion = other.transparentRegion;
+    }
+    if (other.what & eFlagsChanged) {
+        flags = (flags & ~other.mask) | (other.flags & other.mask);
+        mask |= other.mask;
+    }
+    if (other.what & eLayerStackChanged) {
+        layerStack = other.layerStack;
+    }
+    if (other.what & eCropChanged) {
+        crop = other.crop;
+    }
+    if (other.what & eDeferTransaction) {
+        handle = other.handle;
+        frameNumber = other.frameNumber;
+    }
+    if (other.what & eFinalCropChanged) {
+        finalCrop = other.finalCrop;
+    }
+    if (other.what & eOverrideScalingModeChanged) {
+        overrideScalingMode = other.overrideScalingMode;
+    }
+    if (other.what & eColorChanged) {
+        color = other.color;
+    }
+    if (other.what & eBlurChanged) {
+        blur = other.blur;
+    }
+    if (other.what & eBlurMaskSurfaceChanged) {
+        blurMaskSurface = other.blurMaskSurface;
+    }
+    if (other.what & eBlurMaskSamplingChanged) {
+        blurMaskSampling = other.blurMaskSampling;
+    }
+    if (other.what & eBlurMaskAlphaThresholdChanged) {
+        blurMaskAlphaThreshold = other.blurMaskAlphaThreshold;
+    }
+    what |= other.what;
+}
+
 status_t ComposerState::read(const Parcel& input) {
     client = interface_cast<ISurfaceComposerClient>(input.readStrongBinder());
     return state.read(input);
@@ -118,6 +253,25 @@ status_t DisplayState::write(Parcel& output) const {
     return NO_ERROR;
 }
 
+void DisplayState::merge(const DisplayState& other) {
+    if (other.what & eSurfaceChanged) {
+        surface = other.surface;
+    }
+    if (other.what & eLayerStackChanged) {
+        layerStack = other.layerStack;
+    }
+    if (other.what & eDisplayProjectionChanged) {
+        orientation = other.orientation;
+        viewport = other.viewport;
+        frame = other.frame;
+    }
+    if (other.what & eDisplaySizeChanged) {
+        width = other.width;
+        height = other.height;
+    }
+    what |= other.what;
+}
+
 status_t DisplayState::read(const Parcel& input) {
     token = input.readStrongBinder();
     surface = interface_cast<IGraphicBufferProducer>(input.readStrongBinder());
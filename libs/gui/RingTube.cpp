@@ -0,0 +1,290 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+
+#include <cutils/ashmem.h>
+#include <utils/Errors.h>
+
+#include <binder/Parcel.h>
+
+#include <gui/RingTube.h>
+
+namespace android {
+// ----------------------------------------------------------------------------
+
+// The same default as BitTube's socket buffers.
+static const size_t DEFAULT_RING_SIZE = 4 * 1024;
+
+// The ring follows the header in the shared memory. The positions only ever
+// grow, the ring offset is the position modulo the capacity; the sender owns
+// writePos and the receiver readPos, each on its own cache line.
+struct RingTube::Header {
+    std::atomic<uint64_t> writePos;
+    uint8_t pad0[56];
+    std::atomic<uint64_t> readPos;
+    // set by the receiver when it found the ring empty, taken by the sender
+    // when it writes the eventfd
+    std::atomic<uint32_t> wantsWakeup;
+    uint8_t pad1[52];
+    uint32_t capacity;
+    uint32_t reserved;
+};
+
+// The header is shared between processes, so its counters must not fall back to a lock.
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "64-bit atomics must be lock free");
+
+RingTube::RingTube()
+    : mEventFd(-1), mMemoryFd(-1), mBase(MAP_FAILED), mMappedSize(0),
+      mHeader(NULL), mRing(NULL), mCapacity(0)
+{
+    init(DEFAULT_RING_SIZE);
+}
+
+RingTube::RingTube(size_t bufsize)
+    : mEventFd(-1), mMemoryFd(-1), mBase(MAP_FAILED), mMappedSize(0),
+      mHeader(NULL), mRing(NULL), mCapacity(0)
+{
+    init(bufsize);
+}
+
+RingTube::RingTube(const Parcel& data)
+    : mEventFd(-1), mMemoryFd(-1), mBase(MAP_FAILED), mMappedSize(0),
+      mHeader(NULL), mRing(NULL), mCapacity(0)
+{
+    mEventFd = dup(data.readFileDescriptor());
+    mMemoryFd = dup(data.readFileDescriptor());
+    if (mEventFd < 0 || mMemoryFd < 0) {
+        const int err = errno;
+        ALOGE("RingTube(Parcel): can't dup filedescriptor (%s)", strerror(err));
+        if (mEventFd >= 0) {
+            close(mEventFd);
+        }
+        mEventFd = -err;
+        return;
+    }
+
+    ssize_t capacity = map(mMemoryFd);
+    if (capacity < 0) {
+        ALOGE("RingTube(Parcel): bad shared memory (%s)", strerror(-capacity));
+        close(mEventFd);
+        mEventFd = int(capacity);
+        return;
+    }
+    mCapacity = size_t(capacity);
+}
+
+RingTube::~RingTube()
+{
+    if (mBase != MAP_FAILED)
+        munmap(mBase, mMappedSize);
+
+    if (mMemoryFd >= 0)
+        close(mMemoryFd);
+
+    if (mEventFd >= 0)
+        close(mEventFd);
+}
+
+void RingTube::init(size_t bufsize) {
+    if (bufsize == 0 || bufsize > UINT32_MAX - sizeof(Header)) {
+        mEventFd = -EINVAL;
+        return;
+    }
+
+    mMemoryFd = ashmem_create_region("RingTube", sizeof(Header) + bufsize);
+    if (mMemoryFd < 0) {
+        mEventFd = -errno;
+        ALOGE("RingTube: ashmem creation failed (%s)", strerror(-mEventFd));
+        return;
+    }
+    mBase = mmap(NULL, sizeof(Header) + bufsize, PROT_READ | PROT_WRITE, MAP_SHARED,
+            mMemoryFd, 0);
+    if (mBase == MAP_FAILED) {
+        mEventFd = -errno;
+        ALOGE("RingTube: mmap failed (%s)", strerror(-mEventFd));
+        return;
+    }
+    mMappedSize = sizeof(Header) + bufsize;
+    mHeader = static_cast<Header*>(mBase);
+    mRing = static_cast<uint8_t*>(mBase) + sizeof(Header);
+    mCapacity = bufsize;
+    // ashmem comes zeroed; the receiver waits for the first objects
+    mHeader->capacity = uint32_t(bufsize);
+    mHeader->wantsWakeup.store(1, std::memory_order_relaxed);
+
+    mEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (mEventFd < 0) {
+        mEventFd = -errno;
+        ALOGE("RingTube: eventfd creation failed (%s)", strerror(-mEventFd));
+    }
+}
+
+ssize_t RingTube::map(int memoryFd) {
+    const int size = ashmem_get_size_region(memoryFd);
+    if (size < int(sizeof(Header))) {
+        return -EINVAL;
+    }
+    void* base = mmap(NULL, size_t(size), PROT_READ | PROT_WRITE, MAP_SHARED, memoryFd, 0);
+    if (base == MAP_FAILED) {
+        return -errno;
+    }
+    Header* header = static_cast<Header*>(base);
+    // read once, the sender could change it under us
+    const uint32_t capacity = header->capacity;
+    if (capacity == 0 || capacity > size_t(size) - sizeof(Header)) {
+        munmap(base, size_t(size));
+        return -EINVAL;
+    }
+    mBase = base;
+    mMappedSize = size_t(size);
+    mHeader = header;
+    mRing = static_cast<uint8_t*>(base) + sizeof(Header);
+    return ssize_t(capacity);
+}
+
+status_t RingTube::initCheck() const
+{
+    if (mEventFd < 0) {
+        return status_t(mEventFd);
+    }
+    return NO_ERROR;
+}
+
+int RingTube::getFd() const
+{
+    return mEventFd;
+}
+
+int RingTube::getSendFd() const
+{
+    return mEventFd;
+}
+
+ssize_t RingTube::write(void const* vaddr, size_t size)
+{
+    if (size > mCapacity) {
+        return -EMSGSIZE;
+    }
+    const uint64_t writePos = mHeader->writePos.load(std::memory_order_relaxed);
+    const uint64_t used = writePos - mHeader->readPos.load(std::memory_order_acquire);
+    if (used > mCapacity) {
+        // the receiver scribbled over the header
+        return -EPIPE;
+    }
+    if (mCapacity - used < size) {
+        return -EAGAIN;
+    }
+
+    const size_t offset = size_t(writePos % mCapacity);
+    const size_t first = size < mCapacity - offset ? size : mCapacity - offset;
+    memcpy(mRing + offset, vaddr, first);
+    memcpy(mRing, static_cast<const uint8_t*>(vaddr) + first, size - first);
+    mHeader->writePos.store(writePos + size, std::memory_order_seq_cst);
+
+    // A receiver that found the ring empty asked for a wakeup before checking
+    // the ring one last time, so either it sees these objects or we see its
+    // request.
+    if (mHeader->wantsWakeup.load(std::memory_order_seq_cst) &&
+            mHeader->wantsWakeup.exchange(0, std::memory_order_seq_cst)) {
+        const uint64_t one = 1;
+        ssize_t len;
+        do {
+            len = ::write(mEventFd, &one, sizeof(one));
+        } while (len < 0 && errno == EINTR);
+    }
+    return ssize_t(size);
+}
+
+ssize_t RingTube::consume(void* vaddr, size_t size, size_t objSize)
+{
+    const uint64_t readPos = mHeader->readPos.load(std::memory_order_relaxed);
+    const uint64_t available =
+            mHeader->writePos.load(std::memory_order_seq_cst) - readPos;
+    if (available > mCapacity) {
+        // the sender scribbled over the header
+        return -EPIPE;
+    }
+    size_t len = available < size ? size_t(available) : size;
+    len -= len % objSize;
+    if (len == 0) {
+        return 0;
+    }
+
+    const size_t offset = size_t(readPos % mCapacity);
+    const size_t first = len < mCapacity - offset ? len : mCapacity - offset;
+    memcpy(vaddr, mRing + offset, first);
+    memcpy(static_cast<uint8_t*>(vaddr) + first, mRing, len - first);
+    mHeader->readPos.store(readPos + len, std::memory_order_release);
+    return ssize_t(len);
+}
+
+ssize_t RingTube::read(void* vaddr, size_t size, size_t objSize)
+{
+    ssize_t len = consume(vaddr, size, objSize);
+    if (len != 0) {
+        return len;
+    }
+
+    // The ring is empty: clear the eventfd, ask for a wakeup and check the
+    // ring once more for objects sent before the sender saw the request.
+    uint64_t count;
+    ssize_t err;
+    do {
+        err = ::read(mEventFd, &count, sizeof(count));
+    } while (err < 0 && errno == EINTR);
+    mHeader->wantsWakeup.store(1, std::memory_order_seq_cst);
+    return consume(vaddr, size, objSize);
+}
+
+status_t RingTube::writeToParcel(Parcel* reply) const
+{
+    if (mEventFd < 0 || mMemoryFd < 0)
+        return -EINVAL;
+
+    status_t result = reply->writeDupFileDescriptor(mEventFd);
+    if (result == NO_ERROR) {
+        result = reply->writeDupFileDescriptor(mMemoryFd);
+    }
+    return result;
+}
+
+
+ssize_t RingTube::sendObjects(const sp<RingTube>& tube,
+        void const* events, size_t count, size_t objSize)
+{
+    ssize_t size = tube->write(events, count*objSize);
+    return size < 0 ? size : size / static_cast<ssize_t>(objSize);
+}
+
+ssize_t RingTube::recvObjects(const sp<RingTube>& tube,
+        void* events, size_t count, size_t objSize)
+{
+    ssize_t size = tube->read(events, count*objSize, objSize);
+    return size < 0 ? size : size / static_cast<ssize_t>(objSize);
+}
+
+// ----------------------------------------------------------------------------
+}; // namespace android
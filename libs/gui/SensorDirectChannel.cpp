@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "Sensors"
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cutils/ashmem.h>
+#include <utils/Errors.h>
+#include <utils/Log.h>
+
+#include <gui/SensorDirectChannel.h>
+
+// ----------------------------------------------------------------------------
+namespace android {
+// ----------------------------------------------------------------------------
+
+// The ring is shared between processes, so its counters must not fall back to a lock.
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "64-bit atomics must be lock free");
+
+SensorDirectChannel::SensorDirectChannel(int fd, void* base, size_t size, size_t capacity)
+    : mFd(fd), mBase(base), mSize(size), mCapacity(capacity),
+      mHeader(static_cast<Header*>(base)),
+      mSlots(reinterpret_cast<Slot*>(static_cast<uint8_t*>(base) + sizeof(Header))),
+      mNextEvent(0)
+{
+}
+
+SensorDirectChannel::~SensorDirectChannel()
+{
+    munmap(mBase, mSize);
+    close(mFd);
+}
+
+size_t SensorDirectChannel::getCapacityForSize(size_t size)
+{
+    return size < sizeof(Header) ? 0 : (size - sizeof(Header)) / sizeof(Slot);
+}
+
+sp<SensorDirectChannel> SensorDirectChannel::create(size_t eventCount)
+{
+    if (eventCount == 0 || eventCount > (SIZE_MAX - sizeof(Header)) / sizeof(Slot)) {
+        return NULL;
+    }
+    size_t size = sizeof(Header) + eventCount * sizeof(Slot);
+    int fd = ashmem_create_region("SensorDirectChannel", size);
+    if (fd < 0) {
+        ALOGE("SensorDirectChannel: could not create ashmem region (%s)", strerror(errno));
+        return NULL;
+    }
+    // The reader never writes to the ring. Ashmem is zero filled, so every slot starts out empty.
+    void* base = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        ALOGE("SensorDirectChannel: could not map ashmem region (%s)", strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    return new SensorDirectChannel(fd, base, size, eventCount);
+}
+
+sp<SensorDirectChannel> SensorDirectChannel::createFromFd(int fd)
+{
+    // Only trust the size of the region, not anything the client may have put in it.
+    int size = ashmem_get_size_region(fd);
+    size_t capacity = size > 0 ? getCapacityForSize(size_t(size)) : 0;
+    if (capacity == 0) {
+        ALOGE("SensorDirectChannel: fd %d is not a usable ashmem region", fd);
+        close(fd);
+        return NULL;
+    }
+    void* base = mmap(NULL, size_t(size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        ALOGE("SensorDirectChannel: could not map ashmem region (%s)", strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    return new SensorDirectChannel(fd, base, size_t(size), capacity);
+}
+
+void SensorDirectChannel::write(ASensorEvent const* events, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        Slot& slot = mSlots[mNextEvent % mCapacity];
+        slot.sequence.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(&slot.event, &events[i], sizeof(ASensorEvent));
+        mNextEvent++;
+        slot.sequence.store(mNextEvent, std::memory_order_release);
+    }
+    // Publishing once per batch is enough, readers check every slot anyway.
+    mHeader->writeCount.store(mNextEvent, std::memory_order_release);
+}
+
+ssize_t SensorDirectChannel::read(ASensorEvent* events, size_t count, size_t* outDroppedCount)
+{
+    size_t dropped = 0;
+    size_t numRead = 0;
+    uint64_t writeCount = mHeader->writeCount.load(std::memory_order_acquire);
+    while (numRead < count && mNextEvent < writeCount) {
+        if (writeCount - mNextEvent > mCapacity) {
+            // The writer went around the ring since the last read.
+            uint64_t oldest = writeCount - mCapacity;
+            dropped += size_t(oldest - mNextEvent);
+            mNextEvent = oldest;
+        }
+
+        const Slot& slot = mSlots[mNextEvent % mCapacity];
+        uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+        memcpy(&events[numRead], &slot.event, sizeof(ASensorEvent));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence != mNextEvent + 1
+                || slot.sequence.load(std::memory_order_relaxed) != sequence) {
+            // The slot was overwritten while we got to it. Skip past everything the writer may
+            // be about to overwrite, including the slot it is writing right now.
+            writeCount = mHeader->writeCount.load(std::memory_order_acquire);
+            uint64_t oldest = writeCount + 1 > mCapacity ? writeCount + 1 - mCapacity : 0;
+            if (oldest <= mNextEvent) {
+                oldest = mNextEvent + 1;
+            }
+            dropped += size_t(oldest - mNextEvent);
+            mNextEvent = oldest;
+            continue;
+        }
+        mNextEvent++;
+        numRead++;
+    }
+    if (outDroppedCount) {
+        *outDroppedCount = dropped;
+    }
+    return ssize_t(numRead);
+}
+
+// ----------------------------------------------------------------------------
+}; // namespace android
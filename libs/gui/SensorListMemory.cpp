@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "Sensors"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+
+#include <binder/MemoryBase.h>
+#include <binder/MemoryHeapBase.h>
+#include <utils/Log.h>
+
+#include <gui/Sensor.h>
+#include <gui/SensorListMemory.h>
+
+// ----------------------------------------------------------------------------
+namespace android {
+// ----------------------------------------------------------------------------
+
+// Followed by count Offsets, and then the flattened sensors they point to.
+struct SensorListMemory::Header {
+    enum { MAGIC = 0x4c4e5353 }; // "SSNL"
+    uint32_t magic;
+    uint32_t count;
+    // Read by clients while the service writes it.
+    std::atomic<uint32_t> dynamicSensorsGeneration;
+    uint32_t reserved;
+};
+
+// Where a flattened sensor is, from the start of the memory.
+struct SensorListMemory::Offset {
+    uint32_t offset;
+    uint32_t size;
+};
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "32-bit atomics must be lock free");
+
+SensorListMemory::SensorListMemory(const sp<IMemory>& memory, size_t count)
+    : mMemory(memory),
+      mHeader(static_cast<Header*>(memory->pointer())),
+      mCount(count)
+{
+}
+
+sp<SensorListMemory> SensorListMemory::create(const Vector<Sensor>& sensors)
+{
+    const size_t count = sensors.size();
+    size_t size = sizeof(Header) + count * sizeof(Offset);
+    for (size_t i = 0; i < count; i++) {
+        size += FlattenableUtils::align<4>(sensors[i].getFlattenedSize());
+    }
+
+    sp<MemoryHeapBase> heap = new MemoryHeapBase(size, MemoryHeapBase::READ_ONLY,
+            "SensorListMemory");
+    if (heap->getHeapID() < 0) {
+        return NULL;
+    }
+
+    uint8_t* base = static_cast<uint8_t*>(heap->getBase());
+    Header* header = reinterpret_cast<Header*>(base);
+    Offset* offsets = reinterpret_cast<Offset*>(base + sizeof(Header));
+    header->magic = Header::MAGIC;
+    header->count = uint32_t(count);
+    header->dynamicSensorsGeneration.store(0, std::memory_order_relaxed);
+
+    size_t offset = sizeof(Header) + count * sizeof(Offset);
+    for (size_t i = 0; i < count; i++) {
+        const size_t sensorSize = sensors[i].getFlattenedSize();
+        status_t err = sensors[i].flatten(base + offset, size - offset);
+        if (err != NO_ERROR) {
+            ALOGE("Failed to flatten sensor %s: %d", sensors[i].getName().string(), err);
+            return NULL;
+        }
+        offsets[i].offset = uint32_t(offset);
+        offsets[i].size = uint32_t(sensorSize);
+        offset += FlattenableUtils::align<4>(sensorSize);
+    }
+    return new SensorListMemory(new MemoryBase(heap, 0, size), count);
+}
+
+sp<SensorListMemory> SensorListMemory::fromMemory(const sp<IMemory>& memory)
+{
+    if (memory == NULL || memory->pointer() == NULL || memory->size() < sizeof(Header)) {
+        return NULL;
+    }
+    const uint8_t* base = static_cast<const uint8_t*>(memory->pointer());
+    const size_t size = memory->size();
+    const Header* header = reinterpret_cast<const Header*>(base);
+    if (header->magic != Header::MAGIC ||
+            header->count > (size - sizeof(Header)) / sizeof(Offset)) {
+        ALOGW("Shared sensor list is malformed");
+        return NULL;
+    }
+
+    const Offset* offsets = reinterpret_cast<const Offset*>(base + sizeof(Header));
+    for (size_t i = 0; i < header->count; i++) {
+        if (offsets[i].offset > size || offsets[i].size > size - offsets[i].offset) {
+            ALOGW("Shared sensor list entry %zu is out of bounds", i);
+            return NULL;
+        }
+    }
+    return new SensorListMemory(memory, header->count);
+}
+
+status_t SensorListMemory::getSensor(size_t index, Sensor* sensor) const
+{
+    if (index >= mCount) {
+        return BAD_INDEX;
+    }
+    const uint8_t* base = reinterpret_cast<const uint8_t*>(mHeader);
+    const Offset& offset = reinterpret_cast<const Offset*>(base + sizeof(Header))[index];
+    return sensor->unflatten(base + offset.offset, offset.size);
+}
+
+void SensorListMemory::dynamicSensorsChanged()
+{
+    mHeader->dynamicSensorsGeneration.fetch_add(1, std::memory_order_release);
+}
+
+uint32_t SensorListMemory::getDynamicSensorsGeneration() const
+{
+    return mHeader->dynamicSensorsGeneration.load(std::memory_order_acquire);
+}
+
+// ----------------------------------------------------------------------------
+}; // namespace android
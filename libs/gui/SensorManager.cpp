@@ -29,8 +29,10 @@
 #include <gui/ISensorServer.h>
 #include <gui/ISensorEventConnection.h>
 #include <gui/Sensor.h>
+#include <gui/SensorDirectChannel.h>
 #include <gui/SensorManager.h>
 #include <gui/SensorEventQueue.h>
+#include <gui/SensorListMemory.h>
 
 // ----------------------------------------------------------------------------
 namespace android {
@@ -89,7 +91,8 @@ SensorManager& SensorManager::getInstanceForPackage(const String16& packageName)
 }
 
 SensorManager::SensorManager(const String16& opPackageName)
-    : mSensorList(0), mOpPackageName(opPackageName) {
+    : mSensorList(0), mDynamicSensorsValid(false), mDynamicSensorsGeneration(0),
+      mOpPackageName(opPackageName) {
     // okay we're not locked here, but it's not needed during construction
     assertStateLocked();
 }
@@ -104,6 +107,34 @@ void SensorManager::sensorManagerDied() {
     free(mSensorList);
     mSensorList = NULL;
     mSensors.clear();
+    mSharedSensorList.clear();
+    mDynamicSensors.clear();
+    mDynamicSensorsValid = false;
+}
+
+bool SensorManager::readSharedSensorListLocked() {
+    mSharedSensorList.clear();
+    Vector<SensorListMemory::Entry> entries;
+    sp<SensorListMemory> shared = SensorListMemory::fromMemory(
+            mSensorServer->getSensorListMemory(mOpPackageName, &entries));
+    if (shared == NULL) {
+        return false;
+    }
+
+    Vector<Sensor> sensors;
+    sensors.setCapacity(entries.size());
+    for (const SensorListMemory::Entry& entry : entries) {
+        Sensor sensor;
+        if (shared->getSensor(entry.index, &sensor) != NO_ERROR) {
+            ALOGW("Bad shared sensor list entry %u", entry.index);
+            return false;
+        }
+        sensor.setId(entry.id);
+        sensors.add(sensor);
+    }
+    mSensors = sensors;
+    mSharedSensorList = shared;
+    return true;
 }
 
 status_t SensorManager::assertStateLocked() {
@@ -147,7 +178,9 @@ status_t SensorManager::assertStateLocked() {
         mDeathObserver = new DeathObserver(*const_cast<SensorManager *>(this));
         IInterface::asBinder(mSensorServer)->linkToDeath(mDeathObserver);
 
-        mSensors = mSensorServer->getSensorList(mOpPackageName);
+        if (!readSharedSensorListLocked()) {
+            mSensors = mSensorServer->getSensorList(mOpPackageName);
+        }
         size_t count = mSensors.size();
         mSensorList =
                 static_cast<Sensor const**>(malloc(count * sizeof(Sensor*)));
@@ -178,7 +211,19 @@ ssize_t SensorManager::getDynamicSensorList(Vector<Sensor> & dynamicSensors) {
         return static_cast<ssize_t>(err);
     }
 
-    dynamicSensors = mSensorServer->getDynamicSensorList(mOpPackageName);
+    if (mSharedSensorList == NULL) {
+        dynamicSensors = mSensorServer->getDynamicSensorList(mOpPackageName);
+        return static_cast<ssize_t>(dynamicSensors.size());
+    }
+
+    // Read the generation first, so a change while the list is fetched fetches it again next time.
+    const uint32_t generation = mSharedSensorList->getDynamicSensorsGeneration();
+    if (!mDynamicSensorsValid || generation != mDynamicSensorsGeneration) {
+        mDynamicSensors = mSensorServer->getDynamicSensorList(mOpPackageName);
+        mDynamicSensorsGeneration = generation;
+        mDynamicSensorsValid = true;
+    }
+    dynamicSensors = mDynamicSensors;
     size_t count = dynamicSensors.size();
 
     return static_cast<ssize_t>(count);
@@ -229,6 +274,20 @@ sp<SensorEventQueue> SensorManager::createEventQueue(String8 packageName, int mo
     return queue;
 }
 
+sp<ISensorEventConnection> SensorManager::createDirectConnection(
+        const sp<SensorDirectChannel>& channel, String8 packageName) {
+    Mutex::Autolock _l(mLock);
+    if (channel == NULL || assertStateLocked() != NO_ERROR) {
+        return NULL;
+    }
+    sp<ISensorEventConnection> connection = mSensorServer->createSensorDirectConnection(
+            packageName, mOpPackageName, channel->getFd());
+    if (connection == NULL) {
+        ALOGE("createDirectConnection: connection is NULL.");
+    }
+    return connection;
+}
+
 bool SensorManager::isDataInjectionEnabled() {
     Mutex::Autolock _l(mLock);
     if (assertStateLocked() == NO_ERROR) {
@@ -123,22 +123,27 @@ void StreamSplitter::onFrameAvailable(const BufferItem& /* item */) {
     }
     ++mOutstandingBuffers;
 
-    // Acquire and detach the buffer from the input
+    // Acquire the buffer from the input. It stays acquired in its slot until
+    // all of the outputs have released it.
     BufferItem bufferItem;
     status_t status = mInput->acquireBuffer(&bufferItem, /* presentWhen */ 0);
     LOG_ALWAYS_FATAL_IF(status != NO_ERROR,
             "acquiring buffer from input failed (%d)", status);
 
-    ALOGV("acquired buffer %#" PRIx64 " from input",
-            bufferItem.mGraphicBuffer->getId());
+    // The buffer is only sent the first time this slot is acquired
+    if (bufferItem.mGraphicBuffer != NULL) {
+        mInputBuffers[bufferItem.mSlot] = bufferItem.mGraphicBuffer;
+    }
+    sp<GraphicBuffer> buffer(mInputBuffers[bufferItem.mSlot]);
+    LOG_ALWAYS_FATAL_IF(buffer == NULL,
+            "no buffer known for input slot %d", bufferItem.mSlot);
 
-    status = mInput->detachBuffer(bufferItem.mSlot);
-    LOG_ALWAYS_FATAL_IF(status != NO_ERROR,
-            "detaching buffer from input failed (%d)", status);
+    ALOGV("acquired buffer %#" PRIx64 " from input slot %d", buffer->getId(),
+            bufferItem.mSlot);
 
     // Initialize our reference count for this buffer
-    mBuffers.add(bufferItem.mGraphicBuffer->getId(),
-            new BufferTracker(bufferItem.mGraphicBuffer));
+    mBuffers.add(buffer->getId(), new BufferTracker(buffer, bufferItem.mSlot,
+            bufferItem.mFrameNumber));
 
     IGraphicBufferProducer::QueueBufferInput queueInput(
             bufferItem.mTimestamp, bufferItem.mIsAutoTimestamp,
@@ -150,13 +155,13 @@ void StreamSplitter::onFrameAvailable(const BufferItem& /* item */) {
     Vector<sp<IGraphicBufferProducer> >::iterator output = mOutputs.begin();
     for (; output != mOutputs.end(); ++output) {
         int slot;
-        status = (*output)->attachBuffer(&slot, bufferItem.mGraphicBuffer);
+        status = (*output)->attachBuffer(&slot, buffer);
         if (status == NO_INIT) {
             // If we just discovered that this output has been abandoned, note
             // that, increment the release count so that we still release this
             // buffer eventually, and move on to the next output
             onAbandonedLocked();
-            mBuffers.editValueFor(bufferItem.mGraphicBuffer->getId())->
+            mBuffers.editValueFor(buffer->getId())->
                     incrementReleaseCountLocked();
             continue;
         } else {
@@ -171,7 +176,7 @@ void StreamSplitter::onFrameAvailable(const BufferItem& /* item */) {
             // that, increment the release count so that we still release this
             // buffer eventually, and move on to the next output
             onAbandonedLocked();
-            mBuffers.editValueFor(bufferItem.mGraphicBuffer->getId())->
+            mBuffers.editValueFor(buffer->getId())->
                     incrementReleaseCountLocked();
             continue;
         } else {
@@ -179,8 +184,22 @@ void StreamSplitter::onFrameAvailable(const BufferItem& /* item */) {
                     "queueing buffer to output failed (%d)", status);
         }
 
-        ALOGV("queued buffer %#" PRIx64 " to output %p",
-                bufferItem.mGraphicBuffer->getId(), output->get());
+        ALOGV("queued buffer %#" PRIx64 " to output %p", buffer->getId(),
+                output->get());
+    }
+}
+
+void StreamSplitter::onBuffersReleased() {
+    Mutex::Autolock lock(mMutex);
+
+    uint64_t mask = 0;
+    if (mInput->getReleasedBuffers(&mask) != NO_ERROR) {
+        return;
+    }
+    for (int slot = 0; slot < BufferQueueDefs::NUM_BUFFER_SLOTS; ++slot) {
+        if (mask & (1ULL << slot)) {
+            mInputBuffers[slot].clear();
+        }
     }
 }
 
@@ -226,15 +245,14 @@ void StreamSplitter::onBufferReleasedByOutput(
         return;
     }
 
-    // Attach and release the buffer back to the input
-    int consumerSlot;
-    status = mInput->attachBuffer(&consumerSlot, tracker->getBuffer());
-    LOG_ALWAYS_FATAL_IF(status != NO_ERROR,
-            "attaching buffer to input failed (%d)", status);
-
-    status = mInput->releaseBuffer(consumerSlot, /* frameNumber */ 0,
-            EGL_NO_DISPLAY, EGL_NO_SYNC_KHR, tracker->getMergedFence());
-    LOG_ALWAYS_FATAL_IF(status != NO_ERROR,
+    // Release the buffer back to the input slot it was acquired from. If the
+    // slot has been freed in the meantime (e.g., because the input producer
+    // disconnected), the input has already forgotten about the buffer.
+    status = mInput->releaseBuffer(tracker->getInputSlot(),
+            tracker->getFrameNumber(), EGL_NO_DISPLAY, EGL_NO_SYNC_KHR,
+            tracker->getMergedFence());
+    LOG_ALWAYS_FATAL_IF(status != NO_ERROR &&
+            status != IGraphicBufferConsumer::STALE_BUFFER_SLOT,
             "releasing buffer to input failed (%d)", status);
 
     ALOGV("released buffer %#" PRIx64 " to input", buffer->getId());
@@ -273,13 +291,15 @@ void StreamSplitter::OutputListener::binderDied(const wp<IBinder>& /* who */) {
     mSplitter->onAbandonedLocked();
 }
 
-StreamSplitter::BufferTracker::BufferTracker(const sp<GraphicBuffer>& buffer)
-      : mBuffer(buffer), mMergedFence(Fence::NO_FENCE), mReleaseCount(0) {}
+StreamSplitter::BufferTracker::BufferTracker(const sp<GraphicBuffer>& buffer,
+        int inputSlot, uint64_t frameNumber)
+      : mBuffer(buffer), mInputSlot(inputSlot), mFrameNumber(frameNumber),
+        mReleaseFences("StreamSplitter"), mReleaseCount(0) {}
 
 StreamSplitter::BufferTracker::~BufferTracker() {}
 
 void StreamSplitter::BufferTracker::mergeFence(const sp<Fence>& with) {
-    mMergedFence = Fence::merge(String8("StreamSplitter"), mMergedFence, with);
+    mReleaseFences.add(with);
 }
 
 } // namespace android
@@ -83,6 +83,7 @@ Surface::Surface(
     mTransformHint = 0;
     mConsumerRunningBehind = false;
     mConnectedToCpu = false;
+    mLastDequeuedBufferId = 0;
     mProducerControlledByApp = controlledByApp;
     mSwapIntervalZero = false;
 }
@@ -129,6 +130,14 @@ status_t Surface::setDequeueTimeout(nsecs_t timeout) {
     return mGraphicBufferProducer->setDequeueTimeout(timeout);
 }
 
+void Surface::setBufferPrefetch(bool enabled) {
+    Mutex::Autolock lock(mMutex);
+    mPrefetchEnabled = enabled;
+    if (!enabled) {
+        cancelPrefetchedBufferLocked();
+    }
+}
+
 status_t Surface::getLastQueuedBuffer(sp<GraphicBuffer>* outBuffer,
         sp<Fence>* outFence, float outTransformMatrix[16]) {
     return mGraphicBufferProducer->getLastQueuedBuffer(outBuffer, outFence,
@@ -271,6 +280,7 @@ int Surface::dequeueBuffer(android_native_buffer_t** buffer, int* fenceFd) {
     uint32_t reqHeight;
     PixelFormat reqFormat;
     uint32_t reqUsage;
+    PrefetchedBuffer prefetched;
 
     {
         Mutex::Autolock lock(mMutex);
@@ -286,18 +296,39 @@ int Surface::dequeueBuffer(android_native_buffer_t** buffer, int* fenceFd) {
             sp<GraphicBuffer>& gbuf(mSlots[mSharedBufferSlot].buffer);
             if (gbuf != NULL) {
                 *buffer = gbuf.get();
+    mLastDequeuedBufferId = gbuf->getId();
                 *fenceFd = -1;
                 return OK;
             }
         }
+
+        if (mPrefetched.slot != BufferItem::INVALID_BUFFER_SLOT) {
+            if (mPrefetched.width == reqWidth &&
+                    mPrefetched.height == reqHeight &&
+                    mPrefetched.format == reqFormat &&
+                    mPrefetched.usage == reqUsage) {
+                prefetched = mPrefetched;
+                mPrefetched = PrefetchedBuffer();
+            } else {
+                cancelPrefetchedBufferLocked();
+            }
+        }
     } // Drop the lock so that we can still touch the Surface while blocking in IGBP::dequeueBuffer
 
     int buf = -1;
     sp<Fence> fence;
-    nsecs_t now = systemTime();
-    status_t result = mGraphicBufferProducer->dequeueBuffer(&buf, &fence,
-            reqWidth, reqHeight, reqFormat, reqUsage);
-    mLastDequeueDuration = systemTime() - now;
+    status_t result;
+    if (prefetched.slot != BufferItem::INVALID_BUFFER_SLOT) {
+        buf = prefetched.slot;
+        fence = prefetched.fence;
+        result = prefetched.result;
+        mLastDequeueDuration = 0;
+    } else {
+        nsecs_t now = systemTime();
+        result = mGraphicBufferProducer->dequeueBuffer(&buf, &fence,
+                reqWidth, reqHeight, reqFormat, reqUsage);
+        mLastDequeueDuration = systemTime() - now;
+    }
 
     if (result < 0) {
         ALOGV("dequeueBuffer: IGraphicBufferProducer::dequeueBuffer"
@@ -323,7 +354,10 @@ int Surface::dequeueBuffer(android_native_buffer_t** buffer, int* fenceFd) {
         freeAllBuffers();
     }
 
-    if ((result & IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION) || gbuf == 0) {
+    if ((result & IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION) &&
+            prefetched.buffer != NULL) {
+        gbuf = prefetched.buffer;
+    } else if ((result & IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION) || gbuf == 0) {
         result = mGraphicBufferProducer->requestBuffer(buf, &gbuf);
         if (result != NO_ERROR) {
             ALOGE("dequeueBuffer: IGraphicBufferProducer::requestBuffer failed: %d", result);
@@ -507,7 +541,23 @@ int Surface::queueBuffer(android_native_buffer_t* buffer, int fenceFd) {
     }
 
     nsecs_t now = systemTime();
-    status_t err = mGraphicBufferProducer->queueBuffer(i, input, &output);
+    status_t err;
+    if (mPrefetchEnabled && !mSharedBufferMode &&
+            mPrefetched.slot == BufferItem::INVALID_BUFFER_SLOT) {
+        PrefetchedBuffer& next(mPrefetched);
+        next.width = mReqWidth ? mReqWidth : mUserWidth;
+        next.height = mReqHeight ? mReqHeight : mUserHeight;
+        next.format = mReqFormat;
+        next.usage = mReqUsage;
+        err = mGraphicBufferProducer->queueAndDequeueBuffer(i, input, &output,
+                next.width, next.height, next.format, next.usage, &next.slot,
+                &next.fence, &next.buffer, &next.result);
+        if (err != OK) {
+            mPrefetched = PrefetchedBuffer();
+        }
+    } else {
+        err = mGraphicBufferProducer->queueBuffer(i, input, &output);
+    }
     mLastQueueDuration = systemTime() - now;
     if (err != OK)  {
         ALOGE("queueBuffer: error queuing buffer to SurfaceTexture, %d", err);
@@ -525,11 +575,19 @@ int Surface::queueBuffer(android_native_buffer_t* buffer, int fenceFd) {
 
     mConsumerRunningBehind = (numPendingBuffers >= 2);
 
-    if (!mConnectedToCpu) {
-        // Clear surface damage back to full-buffer
-        mDirtyRegion = Region::INVALID_REGION;
+    if (err == OK) {
+        QueuedFrame frame;
+        frame.bufferId = mSlots[i].buffer->getId();
+        frame.damage = mDirtyRegion;
+        mQueuedFrames.push_back(frame);
+        if (mQueuedFrames.size() > NUM_BUFFER_SLOTS) {
+            mQueuedFrames.removeAt(0);
+        }
     }
 
+    // Clear surface damage back to full-buffer
+    mDirtyRegion = Region::INVALID_REGION;
+
     if (mSharedBufferMode && mAutoRefresh && mSharedBufferSlot == i) {
         mSharedBufferHasBeenQueued = true;
     }
@@ -594,6 +652,14 @@ int Surface::query(int what, int* value) const {
                         static_cast<int>(durationUs);
                 return NO_ERROR;
             }
+            case NATIVE_WINDOW_BUFFER_AGE:
+                // In shared buffer mode the age is up to the producer
+                if (!mSharedBufferMode) {
+                    *value = static_cast<int>(
+                            getBufferAgeLocked(mLastDequeuedBufferId));
+                    return NO_ERROR;
+                }
+                break;
             case NATIVE_WINDOW_LAST_QUEUE_DURATION: {
                 int64_t durationUs = mLastQueueDuration / 1000;
                 *value = durationUs > std::numeric_limits<int>::max() ?
@@ -839,8 +905,9 @@ int Surface::connect(int api, const sp<IProducerListener>& listener) {
     }
     if (!err && api == NATIVE_WINDOW_API_CPU) {
         mConnectedToCpu = true;
-        // Clear the dirty region in case we're switching from a non-CPU API
-        mDirtyRegion.clear();
+        // Reset the dirty region in case we're switching from a non-CPU API.
+        // lock() sets it.
+        mDirtyRegion = Region::INVALID_REGION;
     } else if (!err) {
         // Initialize the dirty region for tracking surface damage
         mDirtyRegion = Region::INVALID_REGION;
@@ -856,6 +923,7 @@ int Surface::disconnect(int api, IGraphicBufferProducer::DisconnectMode mode) {
     Mutex::Autolock lock(mMutex);
     mSharedBufferSlot = BufferItem::INVALID_BUFFER_SLOT;
     mSharedBufferHasBeenQueued = false;
+    mPrefetched = PrefetchedBuffer();
     freeAllBuffers();
     int err = mGraphicBufferProducer->disconnect(api, mode);
     if (!err) {
@@ -969,6 +1037,7 @@ int Surface::setBufferCount(int bufferCount)
     ATRACE_CALL();
     ALOGV("Surface::setBufferCount");
     Mutex::Autolock lock(mMutex);
+    cancelPrefetchedBufferLocked();
 
     status_t err = NO_ERROR;
     if (bufferCount == 0) {
@@ -993,6 +1062,7 @@ int Surface::setMaxDequeuedBufferCount(int maxDequeuedBuffers) {
     ATRACE_CALL();
     ALOGV("Surface::setMaxDequeuedBufferCount");
     Mutex::Autolock lock(mMutex);
+    cancelPrefetchedBufferLocked();
 
     status_t err = mGraphicBufferProducer->setMaxDequeuedBufferCount(
             maxDequeuedBuffers);
@@ -1018,6 +1088,7 @@ int Surface::setSharedBufferMode(bool sharedBufferMode) {
     ATRACE_CALL();
     ALOGV("Surface::setSharedBufferMode (%d)", sharedBufferMode);
     Mutex::Autolock lock(mMutex);
+    cancelPrefetchedBufferLocked();
 
     status_t err = mGraphicBufferProducer->setSharedBufferMode(
             sharedBufferMode);
@@ -1149,6 +1220,54 @@ void Surface::freeAllBuffers() {
     for (int i = 0; i < NUM_BUFFER_SLOTS; i++) {
         mSlots[i].buffer = 0;
     }
+    mQueuedFrames.clear();
+}
+
+uint32_t Surface::getBufferAgeLocked(uint64_t bufferId) const {
+    for (size_t i = mQueuedFrames.size(); i > 0; i--) {
+        if (mQueuedFrames[i - 1].bufferId == bufferId) {
+            return static_cast<uint32_t>(mQueuedFrames.size() - i + 1);
+        }
+    }
+    return 0;
+}
+
+Region Surface::getAccumulatedDamageLocked(uint32_t age) const {
+    if (age == 0 || age - 1 > mQueuedFrames.size()) {
+        return Region::INVALID_REGION;
+    }
+    Region damage;
+    for (size_t i = mQueuedFrames.size() - (age - 1); i < mQueuedFrames.size();
+            i++) {
+        const Region& frameDamage(mQueuedFrames[i].damage);
+        if (frameDamage.bounds() == Rect::INVALID_RECT) {
+            return Region::INVALID_REGION;
+        }
+        damage.orSelf(frameDamage);
+    }
+    return damage;
+}
+
+Region Surface::getAccumulatedDamage(uint32_t age) const {
+    Mutex::Autolock lock(mMutex);
+    return getAccumulatedDamageLocked(age);
+}
+
+void Surface::cancelPrefetchedBufferLocked() {
+    if (mPrefetched.slot == BufferItem::INVALID_BUFFER_SLOT) {
+        return;
+    }
+    // Keep the slot cache in step with what the producer told us, since
+    // nobody else will see these flags.
+    if (mPrefetched.result & IGraphicBufferProducer::RELEASE_ALL_BUFFERS) {
+        freeAllBuffers();
+    }
+    if (mPrefetched.result & IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION) {
+        mSlots[mPrefetched.slot].buffer = mPrefetched.buffer;
+    }
+    mGraphicBufferProducer->cancelBuffer(mPrefetched.slot,
+            mPrefetched.fence != NULL ? mPrefetched.fence : Fence::NO_FENCE);
+    mPrefetched = PrefetchedBuffer();
 }
 
 void Surface::setSurfaceDamage(android_native_rect_t* rects, size_t numRects) {
@@ -1268,7 +1387,6 @@ status_t Surface::lock(
         }
 
         // figure out if we can copy the frontbuffer back
-        int backBufferSlot(getSlotFromBufferLocked(backBuffer.get()));
         const sp<GraphicBuffer>& frontBuffer(mPostedBuffer);
         const bool canCopyBack = (frontBuffer != 0 &&
                 backBuffer->width  == frontBuffer->width &&
@@ -1277,14 +1395,13 @@ status_t Surface::lock(
 
         if (canCopyBack) {
             Mutex::Autolock lock(mMutex);
-            Region oldDirtyRegion;
-            if(mSlots[backBufferSlot].dirtyRegion.isEmpty()) {
+            // what changed since the back buffer was last queued, or
+            // everything if it wasn't queued recently (e.g.: it was just
+            // allocated)
+            Region oldDirtyRegion(getAccumulatedDamageLocked(
+                    getBufferAgeLocked(backBuffer->getId())));
+            if (oldDirtyRegion.bounds() == Rect::INVALID_RECT) {
                 oldDirtyRegion.set(bounds);
-            } else {
-                for(int i = 0 ; i < NUM_BUFFER_SLOTS; i++ ) {
-                    if(i != backBufferSlot && !mSlots[i].dirtyRegion.isEmpty())
-                        oldDirtyRegion.orSelf(mSlots[i].dirtyRegion);
-                }
             }
             const Region copyback(oldDirtyRegion.subtract(newDirtyRegion));
             if (!copyback.isEmpty()) {
@@ -1294,16 +1411,11 @@ status_t Surface::lock(
             // if we can't copy-back anything, modify the user's dirty
             // region to make sure they redraw the whole buffer
             newDirtyRegion.set(bounds);
-            Mutex::Autolock lock(mMutex);
-            for (size_t i=0 ; i<NUM_BUFFER_SLOTS ; i++) {
-                mSlots[i].dirtyRegion.clear();
-            }
         }
 
-
         { // scope for the lock
             Mutex::Autolock lock(mMutex);
-            mSlots[backBufferSlot].dirtyRegion = newDirtyRegion;
+            mDirtyRegion = newDirtyRegion;
         }
 
         if (inOutDirtyBounds) {
@@ -1360,6 +1472,11 @@ bool Surface::waitForNextFrame(uint64_t lastFrame, nsecs_t timeout) {
     return mQueueBufferCondition.waitRelative(mMutex, timeout) == OK;
 }
 
+status_t Surface::createFrameEventChannel(sp<BitTube>* outChannel) {
+    ATRACE_CALL();
+    return mGraphicBufferProducer->createFrameEventChannel(outChannel);
+}
+
 status_t Surface::getUniqueId(uint64_t* outId) const {
     Mutex::Autolock lock(mMutex);
     return mGraphicBufferProducer->getUniqueId(outId);
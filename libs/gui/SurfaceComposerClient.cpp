@@ -20,7 +20,9 @@
 
 #define LOG_TAG "SurfaceComposerClient"
 
+#include <inttypes.h>
 #include <stdint.h>
+#include <string.h>
 #include <sys/types.h>
 
 #include <utils/Errors.h>
@@ -36,11 +38,14 @@
 #include <system/graphics.h>
 
 #include <ui/DisplayInfo.h>
+#include <ui/Fence.h>
+#include <ui/GraphicBuffer.h>
 
 #include <gui/CpuConsumer.h>
 #include <gui/IGraphicBufferProducer.h>
 #include <gui/ISurfaceComposer.h>
 #include <gui/ISurfaceComposerClient.h>
+#include <gui/ITransactionCompletedListener.h>
 #include <gui/SurfaceComposerClient.h>
 
 #include <private/gui/ComposerService.h>
@@ -124,14 +129,20 @@ class Composer : public Singleton<Composer>
     uint32_t                    mForceSynchronous;
     uint32_t                    mTransactionNestCount;
     bool                        mAnimation;
+    uint64_t                    mNextTransactionId;
 
     Composer() : Singleton<Composer>(),
         mForceSynchronous(0), mTransactionNestCount(0),
-        mAnimation(false)
+        mAnimation(false), mNextTransactionId(1)
     { }
 
     void openGlobalTransactionImpl();
     void closeGlobalTransactionImpl(bool synchronous);
+    uint64_t closeGlobalTransactionAsyncImpl(nsecs_t desiredPresentTime,
+            const sp<ITransactionCompletedListener>& listener);
+    bool takeTransactionLocked(bool synchronous,
+            Vector<ComposerState>* transaction,
+            Vector<DisplayState>* displayTransaction, uint32_t* flags);
     void setAnimationTransactionImpl();
 
     layer_state_t* getLayerStateLocked(
@@ -204,6 +215,12 @@ public:
     static void closeGlobalTransaction(bool synchronous) {
         Composer::getInstance().closeGlobalTransactionImpl(synchronous);
     }
+
+    static uint64_t closeGlobalTransactionAsync(nsecs_t desiredPresentTime,
+            const sp<ITransactionCompletedListener>& listener) {
+        return Composer::getInstance().closeGlobalTransactionAsyncImpl(
+                desiredPresentTime, listener);
+    }
 };
 
 ANDROID_SINGLETON_STATIC_INSTANCE(Composer);
@@ -230,6 +247,36 @@ void Composer::openGlobalTransactionImpl() {
     }
 }
 
+bool Composer::takeTransactionLocked(bool synchronous,
+        Vector<ComposerState>* transaction,
+        Vector<DisplayState>* displayTransaction, uint32_t* flags) {
+    mForceSynchronous |= synchronous;
+    if (!mTransactionNestCount) {
+        ALOGW("At least one call to closeGlobalTransaction() was not matched by a prior "
+                "call to openGlobalTransaction().");
+    } else if (--mTransactionNestCount) {
+        return false;
+    }
+
+    *transaction = mComposerStates;
+    mComposerStates.clear();
+
+    *displayTransaction = mDisplayStates;
+    mDisplayStates.clear();
+
+    *flags = 0;
+    if (mForceSynchronous) {
+        *flags |= ISurfaceComposer::eSynchronous;
+    }
+    if (mAnimation) {
+        *flags |= ISurfaceComposer::eAnimation;
+    }
+
+    mForceSynchronous = false;
+    mAnimation = false;
+    return true;
+}
+
 void Composer::closeGlobalTransactionImpl(bool synchronous) {
     sp<ISurfaceComposer> sm(ComposerService::getComposerService());
 
@@ -239,32 +286,42 @@ void Composer::closeGlobalTransactionImpl(bool synchronous) {
 
     { // scope for the lock
         Mutex::Autolock _l(mLock);
-        mForceSynchronous |= synchronous;
-        if (!mTransactionNestCount) {
-            ALOGW("At least one call to closeGlobalTransaction() was not matched by a prior "
-                    "call to openGlobalTransaction().");
-        } else if (--mTransactionNestCount) {
+        if (!takeTransactionLocked(synchronous, &transaction,
+                &displayTransaction, &flags)) {
             return;
         }
+    }
 
-        transaction = mComposerStates;
-        mComposerStates.clear();
+   sm->setTransactionState(transaction, displayTransaction, flags);
+}
 
-        displayTransaction = mDisplayStates;
-        mDisplayStates.clear();
+uint64_t Composer::closeGlobalTransactionAsyncImpl(nsecs_t desiredPresentTime,
+        const sp<ITransactionCompletedListener>& listener) {
+    sp<ISurfaceComposer> sm(ComposerService::getComposerService());
 
-        if (mForceSynchronous) {
-            flags |= ISurfaceComposer::eSynchronous;
-        }
-        if (mAnimation) {
-            flags |= ISurfaceComposer::eAnimation;
-        }
+    Vector<ComposerState> transaction;
+    Vector<DisplayState> displayTransaction;
+    uint32_t flags = 0;
+    uint64_t transactionId = 0;
 
-        mForceSynchronous = false;
-        mAnimation = false;
+    { // scope for the lock
+        Mutex::Autolock _l(mLock);
+        if (!takeTransactionLocked(false, &transaction,
+                &displayTransaction, &flags)) {
+            return 0;
+        }
+        transactionId = mNextTransactionId++;
     }
 
-   sm->setTransactionState(transaction, displayTransaction, flags);
+    status_t err = sm->setTransactionStateAsync(transaction,
+            displayTransaction, flags, desiredPresentTime, listener,
+            transactionId);
+    if (err != NO_ERROR) {
+        ALOGE("closeGlobalTransactionAsync: transaction %" PRIu64
+                " was rejected: %s (%d)", transactionId, strerror(-err), err);
+        return 0;
+    }
+    return transactionId;
 }
 
 void Composer::setAnimationTransactionImpl() {
@@ -717,6 +774,12 @@ void SurfaceComposerClient::closeGlobalTransaction(bool synchronous) {
     Composer::closeGlobalTransaction(synchronous);
 }
 
+uint64_t SurfaceComposerClient::closeGlobalTransactionAsync(
+        nsecs_t desiredPresentTime,
+        const sp<ITransactionCompletedListener>& listener) {
+    return Composer::closeGlobalTransactionAsync(desiredPresentTime, listener);
+}
+
 void SurfaceComposerClient::setAnimationTransaction() {
     Composer::setAnimationTransaction();
 }
@@ -927,6 +990,29 @@ status_t ScreenshotClient::capture(
             ISurfaceComposer::eRotateNone, SS_CPU_CONSUMER);
 }
 
+status_t ScreenshotClient::capture(
+        const sp<IBinder>& display,
+        const sp<GraphicBuffer>& buffer, Rect sourceCrop,
+        uint32_t minLayerZ, uint32_t maxLayerZ, bool useIdentityTransform,
+        uint32_t rotation, sp<Fence>* outFence) {
+    sp<ISurfaceComposer> s(ComposerService::getComposerService());
+    if (s == NULL) return NO_INIT;
+    if (buffer == NULL || outFence == NULL) return BAD_VALUE;
+    return s->captureScreenToBuffer(display, buffer, sourceCrop,
+            minLayerZ, maxLayerZ, useIdentityTransform,
+            static_cast<ISurfaceComposer::Rotation>(rotation), outFence);
+}
+
+status_t ScreenshotClient::captureLayer(
+        const sp<IBinder>& layerHandle,
+        const sp<GraphicBuffer>& buffer, Rect sourceCrop,
+        sp<Fence>* outFence) {
+    sp<ISurfaceComposer> s(ComposerService::getComposerService());
+    if (s == NULL) return NO_INIT;
+    if (buffer == NULL || outFence == NULL) return BAD_VALUE;
+    return s->captureLayerToBuffer(layerHandle, buffer, sourceCrop, outFence);
+}
+
 ScreenshotClient::ScreenshotClient()
     : mHaveBuffer(false) {
     memset(&mBuffer, 0, sizeof(mBuffer));
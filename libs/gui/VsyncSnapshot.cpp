@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "VsyncSnapshot"
+
+#include <sched.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#include <binder/MemoryBase.h>
+#include <binder/MemoryHeapBase.h>
+#include <utils/Log.h>
+
+#include <gui/VsyncSnapshot.h>
+
+// ----------------------------------------------------------------------------
+namespace android {
+// ----------------------------------------------------------------------------
+
+// The layout of the shared memory, the same for 32 and 64-bit processes. The event fields are
+// atomics only so that reading them while they are written is well defined; the sequence number
+// tells whether what was read is consistent.
+struct VsyncSnapshot::Shared {
+    enum { MAGIC = 0x43535956 }; // "VYSC"
+
+    uint32_t magic;
+    std::atomic<uint32_t> sequence;
+    std::atomic<int64_t> timestamp;
+    std::atomic<uint32_t> id;
+    std::atomic<uint32_t> count;
+};
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "64-bit atomics must be lock free");
+
+// An update is a handful of stores, readers that keep finding one in progress give up rather
+// than spin.
+static const int MAX_READ_ATTEMPTS = 100;
+
+VsyncSnapshot::VsyncSnapshot(const sp<IMemory>& memory)
+    : mMemory(memory),
+      mShared(static_cast<Shared*>(memory->pointer()))
+{
+}
+
+sp<VsyncSnapshot> VsyncSnapshot::create()
+{
+    sp<MemoryHeapBase> heap = new MemoryHeapBase(sizeof(Shared), MemoryHeapBase::READ_ONLY,
+            "VsyncSnapshot");
+    if (heap->getHeapID() < 0) {
+        return NULL;
+    }
+    // ashmem comes zeroed, which is sequence 0: nothing published
+    Shared* shared = static_cast<Shared*>(heap->getBase());
+    shared->magic = Shared::MAGIC;
+    return new VsyncSnapshot(new MemoryBase(heap, 0, sizeof(Shared)));
+}
+
+sp<VsyncSnapshot> VsyncSnapshot::fromMemory(const sp<IMemory>& memory)
+{
+    if (memory == NULL || memory->pointer() == NULL || memory->size() < sizeof(Shared)) {
+        return NULL;
+    }
+    const Shared* shared = static_cast<const Shared*>(memory->pointer());
+    if (shared->magic != Shared::MAGIC) {
+        ALOGW("Shared memory is not a vsync snapshot");
+        return NULL;
+    }
+    return new VsyncSnapshot(memory);
+}
+
+void VsyncSnapshot::publish(const DisplayEventReceiver::Event& vsync)
+{
+    Shared* s = mShared;
+    const uint32_t sequence = s->sequence.load(std::memory_order_relaxed);
+    s->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    s->timestamp.store(vsync.header.timestamp, std::memory_order_relaxed);
+    s->id.store(vsync.header.id, std::memory_order_relaxed);
+    s->count.store(vsync.vsync.count, std::memory_order_relaxed);
+
+    // skip 0 when wrapping around, it means nothing was published
+    s->sequence.store(sequence + 2 != 0 ? sequence + 2 : 2, std::memory_order_release);
+}
+
+status_t VsyncSnapshot::read(DisplayEventReceiver::Event* vsync) const
+{
+    const Shared* s = mShared;
+    for (int attempt = 0; attempt < MAX_READ_ATTEMPTS; attempt++) {
+        const uint32_t sequence = s->sequence.load(std::memory_order_acquire);
+        if (sequence == 0) {
+            return WOULD_BLOCK;
+        }
+        if (sequence & 1) {
+            // the EventThread is in the middle of an update
+            sched_yield();
+            continue;
+        }
+        const nsecs_t timestamp = s->timestamp.load(std::memory_order_relaxed);
+        const uint32_t id = s->id.load(std::memory_order_relaxed);
+        const uint32_t count = s->count.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (s->sequence.load(std::memory_order_relaxed) == sequence) {
+            vsync->header.type = DisplayEventReceiver::DISPLAY_EVENT_VSYNC;
+            vsync->header.id = id;
+            vsync->header.timestamp = timestamp;
+            vsync->vsync.count = count;
+            return NO_ERROR;
+        }
+    }
+    return WOULD_BLOCK;
+}
+
+// ----------------------------------------------------------------------------
+}; // namespace android
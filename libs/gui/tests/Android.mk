@@ -11,12 +11,17 @@ LOCAL_MODULE_TAGS := tests
 
 LOCAL_SRC_FILES := \
     BufferQueue_test.cpp \
+    BufferSlotSets_test.cpp \
     CpuConsumer_test.cpp \
     FillBuffer.cpp \
     GLTest.cpp \
     IGraphicBufferProducer_test.cpp \
+    LayerState_test.cpp \
     MultiTextureConsumer_test.cpp \
+    RingTube_test.cpp \
     SRGB_test.cpp \
+    SensorDirectChannel_test.cpp \
+    SensorListMemory_test.cpp \
     StreamSplitter_test.cpp \
     SurfaceTextureClient_test.cpp \
     SurfaceTextureFBO_test.cpp \
@@ -26,6 +31,7 @@ LOCAL_SRC_FILES := \
     SurfaceTextureMultiContextGL_test.cpp \
     Surface_test.cpp \
     TextureRenderer.cpp \
+    VsyncSnapshot_test.cpp \
 
 LOCAL_SHARED_LIBRARIES := \
 	libEGL \
@@ -42,6 +48,18 @@ LOCAL_SHARED_LIBRARIES := \
 # to integrate with auto-test framework.
 include $(BUILD_NATIVE_TEST)
 
+include $(CLEAR_VARS)
+LOCAL_ADDITIONAL_DEPENDENCIES := $(LOCAL_PATH)/Android.mk
+LOCAL_SRC_FILES := tube_benchmark.cpp
+LOCAL_SHARED_LIBRARIES := \
+	libbinder \
+	libcutils \
+	libgui \
+	libutils \
+
+LOCAL_MODULE := gui_tube_benchmark
+include $(BUILD_NATIVE_BENCHMARK)
+
 # Include subdirectory makefiles
 # ============================================================
 
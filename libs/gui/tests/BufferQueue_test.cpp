@@ -34,6 +34,7 @@
 
 #include <gtest/gtest.h>
 
+#include <inttypes.h>
 #include <thread>
 
 using namespace std::chrono_literals;
@@ -1067,4 +1068,235 @@ TEST_F(BufferQueueTest, TestDiscardFreeBuffers) {
     }
 }
 
+TEST_F(BufferQueueTest, TestTrimFreeBuffers) {
+    createBufferQueue();
+    sp<DummyConsumer> dc(new DummyConsumer);
+    ASSERT_EQ(OK, mConsumer->consumerConnect(dc, false));
+    IGraphicBufferProducer::QueueBufferOutput output;
+    ASSERT_EQ(OK, mProducer->connect(new DummyProducerListener,
+            NATIVE_WINDOW_API_CPU, false, &output));
+
+    ASSERT_EQ(BAD_VALUE, mConsumer->trimFreeBuffers(-1));
+
+    sp<Fence> fence = Fence::NO_FENCE;
+    sp<GraphicBuffer> buffer = nullptr;
+    IGraphicBufferProducer::QueueBufferInput input(0ull, true,
+        HAL_DATASPACE_UNKNOWN, Rect::INVALID_RECT,
+        NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, Fence::NO_FENCE);
+    BufferItem item{};
+
+    // Allocate 4 buffers and free them again
+    int slots[4] = {};
+    mProducer->setMaxDequeuedBufferCount(4);
+    for (size_t i = 0; i < 4; ++i) {
+        status_t result = mProducer->dequeueBuffer(&slots[i], &fence,
+                0, 0, 0, 0);
+        ASSERT_EQ(IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION, result);
+        ASSERT_EQ(OK, mProducer->requestBuffer(slots[i], &buffer));
+    }
+    for (size_t i = 0; i < 4; ++i) {
+        ASSERT_EQ(OK, mProducer->cancelBuffer(slots[i], Fence::NO_FENCE));
+    }
+
+    // Keep one buffer acquired; it counts against the limit
+    int slot = BufferQueue::INVALID_BUFFER_SLOT;
+    ASSERT_EQ(OK, mProducer->dequeueBuffer(&slot, &fence, 0, 0, 0, 0));
+    ASSERT_EQ(OK, mProducer->queueBuffer(slot, input, &output));
+    ASSERT_EQ(OK, mConsumer->acquireBuffer(&item, 0));
+
+    ASSERT_EQ(OK, mConsumer->trimFreeBuffers(2));
+
+    // Only one of the free buffers was kept
+    ASSERT_EQ(OK, mProducer->dequeueBuffer(&slot, &fence, 0, 0, 0, 0));
+    ASSERT_EQ(IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION,
+            mProducer->dequeueBuffer(&slot, &fence, 0, 0, 0, 0));
+
+    // Trimming never touches buffers that are in use
+    ASSERT_EQ(OK, mConsumer->trimFreeBuffers(0));
+    ASSERT_EQ(OK, mConsumer->releaseBuffer(item.mSlot, item.mFrameNumber,
+            EGL_NO_DISPLAY, EGL_NO_SYNC_KHR, Fence::NO_FENCE));
+    ASSERT_EQ(OK, mProducer->dequeueBuffer(&slot, &fence, 0, 0, 0, 0));
+}
+
+TEST_F(BufferQueueTest, TestLatencyHistograms) {
+    createBufferQueue();
+    sp<DummyConsumer> dc(new DummyConsumer);
+    ASSERT_EQ(OK, mConsumer->consumerConnect(dc, false));
+    IGraphicBufferProducer::QueueBufferOutput output;
+    ASSERT_EQ(OK, mProducer->connect(new DummyProducerListener,
+            NATIVE_WINDOW_API_CPU, false, &output));
+
+    int slot = BufferQueue::INVALID_BUFFER_SLOT;
+    sp<Fence> fence = Fence::NO_FENCE;
+    sp<GraphicBuffer> buffer = nullptr;
+    IGraphicBufferProducer::QueueBufferInput input(0ull, true,
+        HAL_DATASPACE_UNKNOWN, Rect::INVALID_RECT,
+        NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, Fence::NO_FENCE);
+    BufferItem item{};
+
+    for (int i = 0; i < 3; ++i) {
+        status_t result = mProducer->dequeueBuffer(&slot, &fence, 0, 0, 0, 0);
+        ASSERT_EQ(OK, result & ~IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION);
+        ASSERT_EQ(OK, mProducer->requestBuffer(slot, &buffer));
+        ASSERT_EQ(OK, mProducer->queueBuffer(slot, input, &output));
+        ASSERT_EQ(OK, mConsumer->acquireBuffer(&item, 0));
+        ASSERT_EQ(OK, mConsumer->releaseBuffer(item.mSlot, item.mFrameNumber,
+                EGL_NO_DISPLAY, EGL_NO_SYNC_KHR, Fence::NO_FENCE));
+    }
+
+    String8 dumpString;
+    mConsumer->dumpLatency(dumpString, "");
+    ASSERT_GT(dumpString.find("\ndequeue-block\t3\t"), 0)
+            << dumpString.string();
+    ASSERT_GT(dumpString.find("\nqueue-to-acquire\t3\t"), 0)
+            << dumpString.string();
+    ASSERT_GT(dumpString.find("\nacquire-to-release\t3\t"), 0)
+            << dumpString.string();
+}
+
+TEST_F(BufferQueueTest, SetFrameDropPolicyWithIllegalValues_ReturnsError) {
+    createBufferQueue();
+    sp<DummyConsumer> dc(new DummyConsumer);
+    ASSERT_EQ(OK, mConsumer->consumerConnect(dc, false));
+
+    ASSERT_EQ(BAD_VALUE, mConsumer->setFrameDropPolicy(0, -1));
+    ASSERT_EQ(BAD_VALUE, mConsumer->setFrameDropPolicy(-1, -1));
+    ASSERT_EQ(BAD_VALUE, mConsumer->setFrameDropPolicy(1, -2));
+    ASSERT_EQ(OK, mConsumer->setFrameDropPolicy(1, -1));
+}
+
+TEST_F(BufferQueueTest, FrameDropPolicyKeepsLastQueuedFrames) {
+    createBufferQueue();
+    sp<DummyConsumer> dc(new DummyConsumer);
+    ASSERT_EQ(OK, mConsumer->consumerConnect(dc, false));
+    ASSERT_EQ(OK, mConsumer->setFrameDropPolicy(2, -1));
+    IGraphicBufferProducer::QueueBufferOutput output;
+    ASSERT_EQ(OK, mProducer->connect(new DummyProducerListener,
+            NATIVE_WINDOW_API_CPU, false, &output));
+    ASSERT_EQ(OK, mProducer->setAsyncMode(true));
+
+    int slot = BufferQueue::INVALID_BUFFER_SLOT;
+    sp<Fence> fence = Fence::NO_FENCE;
+    sp<GraphicBuffer> buffer = nullptr;
+    IGraphicBufferProducer::QueueBufferInput input(0ull, true,
+        HAL_DATASPACE_UNKNOWN, Rect::INVALID_RECT,
+        NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, Fence::NO_FENCE);
+    BufferItem item{};
+
+    // None of these dequeues may block, even though nothing is acquired
+    for (int i = 0; i < 4; ++i) {
+        status_t result = mProducer->dequeueBuffer(&slot, &fence, 0, 0, 0, 0);
+        ASSERT_EQ(OK, result & ~IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION);
+        ASSERT_EQ(OK, mProducer->requestBuffer(slot, &buffer));
+        ASSERT_EQ(OK, mProducer->queueBuffer(slot, input, &output));
+    }
+
+    // Only the last two frames are left
+    for (uint64_t frame = 3; frame <= 4; ++frame) {
+        ASSERT_EQ(OK, mConsumer->acquireBuffer(&item, 0));
+        ASSERT_EQ(frame, item.mFrameNumber);
+        ASSERT_EQ(OK, mConsumer->releaseBuffer(item.mSlot, item.mFrameNumber,
+                EGL_NO_DISPLAY, EGL_NO_SYNC_KHR, Fence::NO_FENCE));
+    }
+    ASSERT_EQ(BufferQueue::NO_BUFFER_AVAILABLE,
+            mConsumer->acquireBuffer(&item, 0));
+}
+
+TEST_F(BufferQueueTest, FrameDropPolicyDropsLateFramesWhenQueued) {
+    createBufferQueue();
+    sp<DummyConsumer> dc(new DummyConsumer);
+    ASSERT_EQ(OK, mConsumer->consumerConnect(dc, false));
+    ASSERT_EQ(OK, mConsumer->setFrameDropPolicy(3, 0));
+    IGraphicBufferProducer::QueueBufferOutput output;
+    ASSERT_EQ(OK, mProducer->connect(new DummyProducerListener,
+            NATIVE_WINDOW_API_CPU, false, &output));
+    ASSERT_EQ(OK, mProducer->setAsyncMode(true));
+
+    int slot = BufferQueue::INVALID_BUFFER_SLOT;
+    sp<Fence> fence = Fence::NO_FENCE;
+    sp<GraphicBuffer> buffer = nullptr;
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    IGraphicBufferProducer::QueueBufferInput due(now, false,
+        HAL_DATASPACE_UNKNOWN, Rect::INVALID_RECT,
+        NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, Fence::NO_FENCE);
+    IGraphicBufferProducer::QueueBufferInput later(now + s2ns(10), false,
+        HAL_DATASPACE_UNKNOWN, Rect::INVALID_RECT,
+        NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, Fence::NO_FENCE);
+    BufferItem item{};
+
+    // Every frame that is already due makes the ones before it stale, but a
+    // frame for later doesn't
+    for (int i = 0; i < 4; ++i) {
+        status_t result = mProducer->dequeueBuffer(&slot, &fence, 0, 0, 0, 0);
+        ASSERT_EQ(OK, result & ~IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION);
+        ASSERT_EQ(OK, mProducer->requestBuffer(slot, &buffer));
+        ASSERT_EQ(OK, mProducer->queueBuffer(slot, i < 3 ? due : later,
+                &output));
+    }
+
+    for (uint64_t frame = 3; frame <= 4; ++frame) {
+        ASSERT_EQ(OK, mConsumer->acquireBuffer(&item, 0));
+        ASSERT_EQ(frame, item.mFrameNumber);
+        ASSERT_EQ(OK, mConsumer->releaseBuffer(item.mSlot, item.mFrameNumber,
+                EGL_NO_DISPLAY, EGL_NO_SYNC_KHR, Fence::NO_FENCE));
+    }
+    ASSERT_EQ(BufferQueue::NO_BUFFER_AVAILABLE,
+            mConsumer->acquireBuffer(&item, 0));
+}
+
+// Not a pass/fail benchmark: reports the cost of acquiring from a deep
+// queue, which used to shift every remaining item on each acquire.
+TEST_F(BufferQueueTest, AcquireFromDeepQueue) {
+    createBufferQueue();
+    sp<DummyConsumer> dc(new DummyConsumer);
+    ASSERT_EQ(OK, mConsumer->consumerConnect(dc, false));
+    IGraphicBufferProducer::QueueBufferOutput output;
+    ASSERT_EQ(OK, mProducer->connect(new DummyProducerListener,
+            NATIVE_WINDOW_API_CPU, false, &output));
+
+    const int depth = BufferQueue::NUM_BUFFER_SLOTS - 2;
+    ASSERT_EQ(OK, mProducer->setMaxDequeuedBufferCount(depth));
+
+    int slot = BufferQueue::INVALID_BUFFER_SLOT;
+    sp<Fence> fence = Fence::NO_FENCE;
+    sp<GraphicBuffer> buffer = nullptr;
+    IGraphicBufferProducer::QueueBufferInput input(0ull, true,
+        HAL_DATASPACE_UNKNOWN, Rect::INVALID_RECT,
+        NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, Fence::NO_FENCE);
+    BufferItem item{};
+
+    // Preallocate so the timed loop never reallocates
+    int slots[BufferQueue::NUM_BUFFER_SLOTS] = {};
+    for (int i = 0; i < depth; ++i) {
+        ASSERT_EQ(IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION,
+                mProducer->dequeueBuffer(&slots[i], &fence, 0, 0, 0, 0));
+        ASSERT_EQ(OK, mProducer->requestBuffer(slots[i], &buffer));
+    }
+    for (int i = 0; i < depth; ++i) {
+        ASSERT_EQ(OK, mProducer->cancelBuffer(slots[i], Fence::NO_FENCE));
+    }
+
+    const int rounds = 200;
+    nsecs_t acquireTime = 0;
+    uint64_t expectedFrame = 1;
+    for (int round = 0; round < rounds; ++round) {
+        for (int i = 0; i < depth; ++i) {
+            ASSERT_EQ(OK, mProducer->dequeueBuffer(&slot, &fence, 0, 0, 0, 0));
+            ASSERT_EQ(OK, mProducer->queueBuffer(slot, input, &output));
+        }
+        for (int i = 0; i < depth; ++i) {
+            nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+            ASSERT_EQ(OK, mConsumer->acquireBuffer(&item, 0));
+            acquireTime += systemTime(SYSTEM_TIME_MONOTONIC) - start;
+            ASSERT_EQ(expectedFrame++, item.mFrameNumber);
+            ASSERT_EQ(OK, mConsumer->releaseBuffer(item.mSlot,
+                    item.mFrameNumber, EGL_NO_DISPLAY, EGL_NO_SYNC_KHR,
+                    Fence::NO_FENCE));
+        }
+    }
+
+    printf("%" PRId64 " ns per acquire at depth %d\n",
+            acquireTime / (rounds * depth), depth);
+}
+
 } // namespace android
@@ -0,0 +1,101 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "BufferSlotSets_test"
+//#define LOG_NDEBUG 0
+
+#include <gui/BufferSlotSets.h>
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+namespace android {
+
+template <typename T>
+static std::vector<int> contents(const T& slots) {
+    std::vector<int> result;
+    for (int s : slots) {
+        result.push_back(s);
+    }
+    return result;
+}
+
+TEST(SlotSetTest, IteratesInAscendingOrder) {
+    SlotSet set;
+    ASSERT_TRUE(set.empty());
+    set.insert(63);
+    set.insert(0);
+    set.insert(17);
+    set.insert(17);
+    ASSERT_EQ(3u, set.size());
+    ASSERT_EQ((std::vector<int>{0, 17, 63}), contents(set));
+}
+
+TEST(SlotSetTest, EraseByValueAndIterator) {
+    SlotSet set;
+    set.insert(4);
+    set.insert(9);
+    set.insert(12);
+    set.erase(set.begin());
+    set.erase(12);
+    ASSERT_EQ(0u, set.count(4));
+    ASSERT_EQ(1u, set.count(9));
+    ASSERT_EQ((std::vector<int>{9}), contents(set));
+    set.clear();
+    ASSERT_TRUE(set.empty());
+}
+
+TEST(SlotListTest, KeepsInsertionOrder) {
+    SlotList list;
+    ASSERT_TRUE(list.empty());
+    list.push_back(3);
+    list.push_back(7);
+    list.push_front(9);
+    ASSERT_EQ((std::vector<int>{9, 3, 7}), contents(list));
+    ASSERT_EQ(9, list.front());
+    ASSERT_EQ(7, list.back());
+}
+
+TEST(SlotListTest, ReinsertMovesSlot) {
+    SlotList list;
+    list.push_back(1);
+    list.push_back(2);
+    list.push_back(1);
+    ASSERT_EQ(2u, list.size());
+    ASSERT_EQ((std::vector<int>{2, 1}), contents(list));
+}
+
+TEST(SlotListTest, RemoveAndPop) {
+    SlotList list;
+    for (int s = 0; s < BufferQueueDefs::NUM_BUFFER_SLOTS; s++) {
+        list.push_back(s);
+    }
+    list.remove(10);
+    list.remove(10);
+    ASSERT_EQ(static_cast<size_t>(BufferQueueDefs::NUM_BUFFER_SLOTS - 1), list.size());
+    ASSERT_EQ(0u, list.count(10));
+    list.pop_front();
+    list.pop_back();
+    ASSERT_EQ(1, list.front());
+    ASSERT_EQ(BufferQueueDefs::NUM_BUFFER_SLOTS - 2, list.back());
+    list.clear();
+    ASSERT_TRUE(list.empty());
+    list.push_front(5);
+    ASSERT_EQ((std::vector<int>{5}), contents(list));
+}
+
+} // namespace android
@@ -689,6 +689,59 @@ TEST_P(CpuConsumerTest, FromCpuLockMax) {
 
 }
 
+TEST_P(CpuConsumerTest, FromCpuLockBatch) {
+    status_t err;
+    CpuConsumerTestParams params = GetParam();
+
+    // Set up
+
+    ASSERT_NO_FATAL_FAILURE(configureANW(mANW, params, params.maxLockedBuffers + 1));
+
+    // Produce
+
+    uint32_t stride;
+    for (int i = 0; i < params.maxLockedBuffers + 1; i++) {
+        ALOGV("Producing frame %d", i);
+        ASSERT_NO_FATAL_FAILURE(produceOneFrame(mANW, params, 1000L + i,
+                        &stride));
+    }
+
+    // Consume, asking for more than can be locked
+
+    const size_t count = params.maxLockedBuffers + 1;
+    CpuConsumer::LockedBuffer *b = new CpuConsumer::LockedBuffer[count];
+    ssize_t locked = mCC->lockNextBuffers(b, count, true);
+    ASSERT_EQ(params.maxLockedBuffers, locked);
+    for (int i = 0; i < params.maxLockedBuffers; i++) {
+        ASSERT_TRUE(b[i].data != NULL);
+        EXPECT_EQ(params.width,  b[i].width);
+        EXPECT_EQ(params.height, b[i].height);
+        EXPECT_EQ(params.format, b[i].format);
+        EXPECT_EQ(stride, b[i].stride);
+        EXPECT_EQ(1000L + i, b[i].timestamp);
+
+        checkAnyBuffer(b[i], GetParam().format);
+    }
+
+    CpuConsumer::LockedBuffer bTooMuch;
+    EXPECT_EQ(NOT_ENOUGH_DATA, mCC->lockNextBuffers(&bTooMuch, 1));
+
+    for (int i = 0; i < params.maxLockedBuffers; i++) {
+        err = mCC->unlockBuffer(b[i]);
+        ASSERT_NO_ERROR(err, "Could not unlock buffer: ");
+    }
+
+    // The frame that didn't fit is still there, and then no more
+
+    locked = mCC->lockNextBuffers(b, count);
+    ASSERT_EQ(1, locked);
+    EXPECT_EQ(1000L + params.maxLockedBuffers, b[0].timestamp);
+    mCC->unlockBuffer(b[0]);
+    EXPECT_EQ(BAD_VALUE, mCC->lockNextBuffers(b, count));
+
+    delete[] b;
+}
+
 CpuConsumerTestParams y8TestSets[] = {
     { 512,   512, 1, HAL_PIXEL_FORMAT_Y8},
     { 512,   512, 3, HAL_PIXEL_FORMAT_Y8},
@@ -0,0 +1,167 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "LayerState_test"
+//#define LOG_NDEBUG 0
+
+#include <binder/Parcel.h>
+
+#include <private/gui/LayerState.h>
+
+#include <gtest/gtest.h>
+
+namespace android {
+
+TEST(LayerStateTest, MergeTakesTheLaterChanges) {
+    layer_state_t first;
+    first.what = layer_state_t::ePositionChanged | layer_state_t::eAlphaChanged;
+    first.x = 1;
+    first.y = 2;
+    first.alpha = 0.5f;
+
+    layer_state_t second;
+    second.what = layer_state_t::ePositionChanged | layer_state_t::eLayerChanged;
+    second.x = 3;
+    second.y = 4;
+    second.z = 7;
+
+    first.merge(second);
+    EXPECT_EQ(layer_state_t::ePositionChanged | layer_state_t::eAlphaChanged |
+            layer_state_t::eLayerChanged, first.what);
+    EXPECT_EQ(3.0f, first.x);
+    EXPECT_EQ(4.0f, first.y);
+    EXPECT_EQ(7u, first.z);
+    EXPECT_EQ(0.5f, first.alpha);
+}
+
+TEST(LayerStateTest, MergeKeepsUnchangedFields) {
+    layer_state_t first;
+    first.what = layer_state_t::eCropChanged;
+    first.crop = Rect(0, 0, 10, 10);
+
+    layer_state_t second;
+    second.what = layer_state_t::eSizeChanged;
+    second.w = 20;
+    second.h = 30;
+    second.crop = Rect(5, 5, 6, 6);
+
+    first.merge(second);
+    EXPECT_EQ(Rect(0, 0, 10, 10), first.crop);
+    EXPECT_EQ(20u, first.w);
+    EXPECT_EQ(30u, first.h);
+}
+
+TEST(LayerStateTest, MergeCombinesFlagMasks) {
+    layer_state_t first;
+    first.what = layer_state_t::eFlagsChanged;
+    first.flags = layer_state_t::eLayerHidden;
+    first.mask = layer_state_t::eLayerHidden;
+
+    layer_state_t second;
+    second.what = layer_state_t::eFlagsChanged;
+    second.flags = layer_state_t::eLayerOpaque;
+    second.mask = layer_state_t::eLayerOpaque;
+
+    first.merge(second);
+    EXPECT_EQ(layer_state_t::eLayerHidden | layer_state_t::eLayerOpaque,
+            first.flags);
+    EXPECT_EQ(layer_state_t::eLayerHidden | layer_state_t::eLayerOpaque,
+            first.mask);
+
+    layer_state_t third;
+    third.what = layer_state_t::eFlagsChanged;
+    third.flags = 0;
+    third.mask = layer_state_t::eLayerHidden;
+
+    first.merge(third);
+    EXPECT_EQ(layer_state_t::eLayerOpaque, first.flags);
+}
+
+TEST(LayerStateTest, MergeDisplayState) {
+    DisplayState first;
+    first.what = DisplayState::eLayerStackChanged;
+    first.layerStack = 1;
+
+    DisplayState second;
+    second.what = DisplayState::eDisplaySizeChanged |
+            DisplayState::eLayerStackChanged;
+    second.layerStack = 2;
+    second.width = 640;
+    second.height = 480;
+
+    first.merge(second);
+    EXPECT_EQ(DisplayState::eDisplaySizeChanged |
+            DisplayState::eLayerStackChanged, first.what);
+    EXPECT_EQ(2u, first.layerStack);
+    EXPECT_EQ(640u, first.width);
+    EXPECT_EQ(480u, first.height);
+}
+
+TEST(LayerStateTest, WritesOnlyChangedFields) {
+    layer_state_t position;
+    position.what = layer_state_t::ePositionChanged;
+    position.x = 10;
+    position.y = 20;
+    Parcel positionParcel;
+    ASSERT_EQ(NO_ERROR, position.write(positionParcel));
+
+    layer_state_t everything(position);
+    everything.what |= layer_state_t::eMatrixChanged |
+            layer_state_t::eCropChanged | layer_state_t::eFinalCropChanged |
+            layer_state_t::eTransparentRegionChanged;
+    everything.transparentRegion = Region(Rect(0, 0, 8, 8));
+    Parcel everythingParcel;
+    ASSERT_EQ(NO_ERROR, everything.write(everythingParcel));
+
+    EXPECT_LT(positionParcel.dataSize(), everythingParcel.dataSize());
+}
+
+TEST(LayerStateTest, ReadsBackChangedFields) {
+    layer_state_t state;
+    state.what = layer_state_t::ePositionChanged |
+            layer_state_t::eFlagsChanged | layer_state_t::eMatrixChanged |
+            layer_state_t::eCropChanged |
+            layer_state_t::eTransparentRegionChanged;
+    state.x = 1.5f;
+    state.y = -2.5f;
+    state.flags = layer_state_t::eLayerHidden;
+    state.mask = layer_state_t::eLayerHidden | layer_state_t::eLayerSecure;
+    state.matrix.dsdx = 2.0f;
+    state.crop = Rect(1, 2, 3, 4);
+    state.transparentRegion = Region(Rect(0, 0, 8, 8));
+    // not flagged, so not sent
+    state.alpha = 0.25f;
+
+    Parcel parcel;
+    ASSERT_EQ(NO_ERROR, state.write(parcel));
+    parcel.setDataPosition(0);
+
+    layer_state_t result;
+    result.alpha = 0.75f;
+    ASSERT_EQ(NO_ERROR, result.read(parcel));
+    EXPECT_EQ(state.what, result.what);
+    EXPECT_EQ(1.5f, result.x);
+    EXPECT_EQ(-2.5f, result.y);
+    EXPECT_EQ(state.flags, result.flags);
+    EXPECT_EQ(state.mask, result.mask);
+    EXPECT_EQ(2.0f, result.matrix.dsdx);
+    EXPECT_EQ(Rect(1, 2, 3, 4), result.crop);
+    EXPECT_EQ(Rect(0, 0, 8, 8), result.transparentRegion.getBounds());
+    EXPECT_EQ(0.0f, result.alpha);
+    EXPECT_EQ(Rect::INVALID_RECT, result.finalCrop);
+}
+
+} // namespace android
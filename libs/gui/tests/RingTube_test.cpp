@@ -0,0 +1,161 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "RingTube_test"
+//#define LOG_NDEBUG 0
+
+#include <errno.h>
+#include <poll.h>
+
+#include <thread>
+
+#include <binder/Parcel.h>
+#include <gui/RingTube.h>
+
+#include <gtest/gtest.h>
+
+namespace android {
+
+class RingTubeTest : public ::testing::Test {
+protected:
+    struct Object {
+        uint64_t value;
+        uint64_t check;
+    };
+
+    static const size_t CAPACITY = 8;
+
+    sp<RingTube> mSender;
+    sp<RingTube> mReceiver;
+
+    virtual void SetUp() {
+        mSender = new RingTube(CAPACITY * sizeof(Object));
+        ASSERT_EQ(NO_ERROR, mSender->initCheck());
+        // What a client does with the RingTube it gets over binder.
+        Parcel parcel;
+        ASSERT_EQ(NO_ERROR, mSender->writeToParcel(&parcel));
+        parcel.setDataPosition(0);
+        mReceiver = new RingTube(parcel);
+        ASSERT_EQ(NO_ERROR, mReceiver->initCheck());
+    }
+
+    static void fill(Object* objects, uint64_t first, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            objects[i].value = first + i;
+            objects[i].check = ~(first + i);
+        }
+    }
+
+    bool isReadable() {
+        struct pollfd fd = { mReceiver->getFd(), POLLIN, 0 };
+        return poll(&fd, 1, 0) == 1;
+    }
+};
+
+const size_t RingTubeTest::CAPACITY;
+
+TEST_F(RingTubeTest, ReceivesSentObjectsInOrder) {
+    Object objects[CAPACITY];
+    fill(objects, 0, 5);
+    ASSERT_EQ(5, RingTube::sendObjects(mSender, objects, 5));
+
+    Object received[CAPACITY];
+    ASSERT_EQ(5, RingTube::recvObjects(mReceiver, received, CAPACITY));
+    for (size_t i = 0; i < 5; i++) {
+        EXPECT_EQ(i, received[i].value);
+        EXPECT_EQ(~uint64_t(i), received[i].check);
+    }
+    EXPECT_EQ(0, RingTube::recvObjects(mReceiver, received, CAPACITY));
+}
+
+TEST_F(RingTubeTest, SendsAllObjectsOrFails) {
+    Object objects[CAPACITY + 1];
+    fill(objects, 0, CAPACITY + 1);
+    EXPECT_EQ(-EMSGSIZE, RingTube::sendObjects(mSender, objects, CAPACITY + 1));
+
+    ASSERT_EQ(6, RingTube::sendObjects(mSender, objects, 6));
+    EXPECT_EQ(-EAGAIN, RingTube::sendObjects(mSender, objects, 3));
+    EXPECT_EQ(2, RingTube::sendObjects(mSender, objects, 2));
+}
+
+TEST_F(RingTubeTest, KeepsObjectsThatDidNotFit) {
+    Object objects[CAPACITY];
+    fill(objects, 0, 6);
+    ASSERT_EQ(6, RingTube::sendObjects(mSender, objects, 6));
+
+    Object received[CAPACITY];
+    ASSERT_EQ(4, RingTube::recvObjects(mReceiver, received, 4));
+    // wraps around the end of the ring
+    fill(objects, 6, 5);
+    ASSERT_EQ(5, RingTube::sendObjects(mSender, objects, 5));
+    ASSERT_EQ(7, RingTube::recvObjects(mReceiver, received, CAPACITY));
+    for (size_t i = 0; i < 7; i++) {
+        EXPECT_EQ(4 + i, received[i].value);
+        EXPECT_EQ(~uint64_t(4 + i), received[i].check);
+    }
+}
+
+TEST_F(RingTubeTest, SignalsOnlyAReceiverThatDrainedTheRing) {
+    Object objects[2];
+    fill(objects, 0, 2);
+    EXPECT_FALSE(isReadable());
+
+    ASSERT_EQ(1, RingTube::sendObjects(mSender, objects, 1));
+    EXPECT_TRUE(isReadable());
+
+    Object received[CAPACITY];
+    ASSERT_EQ(1, RingTube::recvObjects(mReceiver, received, CAPACITY));
+    ASSERT_EQ(0, RingTube::recvObjects(mReceiver, received, CAPACITY));
+    EXPECT_FALSE(isReadable());
+
+    ASSERT_EQ(2, RingTube::sendObjects(mSender, objects, 2));
+    EXPECT_TRUE(isReadable());
+}
+
+TEST_F(RingTubeTest, ReceiverWaitingOnFdNeverMissesObjects) {
+    const uint64_t count = 100000;
+    std::thread sender([this, count] {
+        uint64_t next = 0;
+        while (next < count) {
+            Object objects[3];
+            const size_t n = count - next < 3 ? size_t(count - next) : 3;
+            fill(objects, next, n);
+            if (RingTube::sendObjects(mSender, objects, n) == ssize_t(n)) {
+                next += n;
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    uint64_t next = 0;
+    while (next < count) {
+        Object received[CAPACITY];
+        ssize_t n = RingTube::recvObjects(mReceiver, received, CAPACITY);
+        ASSERT_GE(n, 0);
+        if (n == 0) {
+            struct pollfd fd = { mReceiver->getFd(), POLLIN, 0 };
+            ASSERT_EQ(1, poll(&fd, 1, 5000)) << "missed a wakeup at " << next;
+        }
+        for (ssize_t i = 0; i < n; i++, next++) {
+            ASSERT_EQ(next, received[i].value);
+            ASSERT_EQ(~next, received[i].check);
+        }
+    }
+    sender.join();
+}
+
+} // namespace android
@@ -0,0 +1,103 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "SensorDirectChannel_test"
+//#define LOG_NDEBUG 0
+
+#include <string.h>
+#include <unistd.h>
+
+#include <gui/SensorDirectChannel.h>
+
+#include <gtest/gtest.h>
+
+namespace android {
+
+class SensorDirectChannelTest : public ::testing::Test {
+protected:
+    static const size_t CAPACITY = 4;
+
+    sp<SensorDirectChannel> mReader;
+    sp<SensorDirectChannel> mWriter;
+
+    virtual void SetUp() {
+        mReader = SensorDirectChannel::create(CAPACITY);
+        ASSERT_TRUE(mReader != NULL);
+        // What SensorService does with the fd it gets over binder.
+        mWriter = SensorDirectChannel::createFromFd(dup(mReader->getFd()));
+        ASSERT_TRUE(mWriter != NULL);
+        ASSERT_EQ(CAPACITY, mWriter->getCapacity());
+    }
+
+    void writeEvents(int64_t firstTimestamp, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            ASensorEvent event;
+            memset(&event, 0, sizeof(event));
+            event.sensor = 7;
+            event.type = ASENSOR_TYPE_GYROSCOPE;
+            event.timestamp = firstTimestamp + int64_t(i);
+            mWriter->write(&event, 1);
+        }
+    }
+};
+
+const size_t SensorDirectChannelTest::CAPACITY;
+
+TEST_F(SensorDirectChannelTest, ReadReturnsWrittenEventsInOrder) {
+    ASensorEvent events[CAPACITY];
+    size_t dropped = 1;
+    EXPECT_EQ(0, mReader->read(events, CAPACITY, &dropped));
+    EXPECT_EQ(0U, dropped);
+
+    writeEvents(100, 3);
+    ASSERT_EQ(2, mReader->read(events, 2, &dropped));
+    EXPECT_EQ(0U, dropped);
+    EXPECT_EQ(100, events[0].timestamp);
+    EXPECT_EQ(101, events[1].timestamp);
+    EXPECT_EQ(7, events[1].sensor);
+    EXPECT_EQ(ASENSOR_TYPE_GYROSCOPE, events[1].type);
+
+    writeEvents(103, 2);
+    ASSERT_EQ(3, mReader->read(events, CAPACITY, &dropped));
+    EXPECT_EQ(0U, dropped);
+    EXPECT_EQ(102, events[0].timestamp);
+    EXPECT_EQ(104, events[2].timestamp);
+    EXPECT_EQ(0, mReader->read(events, CAPACITY));
+}
+
+TEST_F(SensorDirectChannelTest, ReadAfterOverrunSkipsOverwrittenEvents) {
+    writeEvents(100, CAPACITY * 2 + 1);
+
+    ASensorEvent events[CAPACITY];
+    size_t dropped;
+    ASSERT_EQ(ssize_t(CAPACITY), mReader->read(events, CAPACITY, &dropped));
+    EXPECT_EQ(CAPACITY + 1, dropped);
+    for (size_t i = 0; i < CAPACITY; i++) {
+        EXPECT_EQ(int64_t(100 + CAPACITY + 1 + i), events[i].timestamp);
+    }
+    EXPECT_EQ(0, mReader->read(events, CAPACITY, &dropped));
+    EXPECT_EQ(0U, dropped);
+}
+
+TEST_F(SensorDirectChannelTest, CreateFromFdRejectsNonAshmemFds) {
+    int fds[2];
+    ASSERT_EQ(0, pipe(fds));
+    close(fds[1]);
+    // Takes ownership of the fd either way.
+    EXPECT_TRUE(SensorDirectChannel::createFromFd(fds[0]) == NULL);
+}
+
+} // namespace android
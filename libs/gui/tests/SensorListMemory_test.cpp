@@ -0,0 +1,77 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "SensorListMemory_test"
+//#define LOG_NDEBUG 0
+
+#include <binder/MemoryBase.h>
+#include <binder/MemoryHeapBase.h>
+
+#include <gui/Sensor.h>
+#include <gui/SensorListMemory.h>
+
+#include <gtest/gtest.h>
+
+namespace android {
+
+class SensorListMemoryTest : public ::testing::Test {
+protected:
+    Vector<Sensor> mSensors;
+
+    virtual void SetUp() {
+        mSensors.add(Sensor("accelerometer"));
+        mSensors.add(Sensor("gyroscope"));
+        mSensors.add(Sensor(""));
+    }
+};
+
+TEST_F(SensorListMemoryTest, ClientReadsTheSharedSensors) {
+    sp<SensorListMemory> service = SensorListMemory::create(mSensors);
+    ASSERT_TRUE(service != NULL);
+    sp<SensorListMemory> client = SensorListMemory::fromMemory(service->getMemory());
+    ASSERT_TRUE(client != NULL);
+
+    ASSERT_EQ(mSensors.size(), client->getCount());
+    for (size_t i = 0; i < mSensors.size(); i++) {
+        Sensor sensor;
+        ASSERT_EQ(NO_ERROR, client->getSensor(i, &sensor));
+        EXPECT_STREQ(mSensors[i].getName().string(), sensor.getName().string());
+    }
+
+    Sensor sensor;
+    EXPECT_EQ(BAD_INDEX, client->getSensor(mSensors.size(), &sensor));
+}
+
+TEST_F(SensorListMemoryTest, ClientSeesDynamicSensorChanges) {
+    sp<SensorListMemory> service = SensorListMemory::create(mSensors);
+    ASSERT_TRUE(service != NULL);
+    sp<SensorListMemory> client = SensorListMemory::fromMemory(service->getMemory());
+    ASSERT_TRUE(client != NULL);
+
+    const uint32_t generation = client->getDynamicSensorsGeneration();
+    service->dynamicSensorsChanged();
+    EXPECT_NE(generation, client->getDynamicSensorsGeneration());
+}
+
+TEST_F(SensorListMemoryTest, OtherMemoryIsRejected) {
+    EXPECT_TRUE(SensorListMemory::fromMemory(NULL) == NULL);
+
+    sp<MemoryHeapBase> heap = new MemoryHeapBase(4096);
+    ASSERT_GE(heap->getHeapID(), 0);
+    EXPECT_TRUE(SensorListMemory::fromMemory(new MemoryBase(heap, 0, 4096)) == NULL);
+}
+
+} // namespace android
@@ -112,10 +112,13 @@ TEST_F(StreamSplitterTest, OneInputOneOutput) {
             EGL_NO_DISPLAY, EGL_NO_SYNC_KHR, Fence::NO_FENCE));
 
     // This should succeed even with allocation disabled since it will have
-    // received the buffer back from the output BufferQueue
-    ASSERT_EQ(IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION,
-            inputProducer->dequeueBuffer(&slot, &fence, 0, 0, 0,
-                    GRALLOC_USAGE_SW_WRITE_OFTEN));
+    // received the buffer back from the output BufferQueue. The buffer
+    // should come back in the slot it was queued from, so it doesn't need to
+    // be requested again.
+    int queuedSlot = slot;
+    ASSERT_EQ(OK, inputProducer->dequeueBuffer(&slot, &fence, 0, 0, 0,
+            GRALLOC_USAGE_SW_WRITE_OFTEN));
+    ASSERT_EQ(queuedSlot, slot);
 }
 
 TEST_F(StreamSplitterTest, OneInputMultipleOutputs) {
@@ -187,10 +190,13 @@ TEST_F(StreamSplitterTest, OneInputMultipleOutputs) {
     }
 
     // This should succeed even with allocation disabled since it will have
-    // received the buffer back from the output BufferQueues
-    ASSERT_EQ(IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION,
-            inputProducer->dequeueBuffer(&slot, &fence, 0, 0, 0,
-                    GRALLOC_USAGE_SW_WRITE_OFTEN));
+    // received the buffer back from the output BufferQueues. The buffer
+    // should come back in the slot it was queued from, so it doesn't need to
+    // be requested again.
+    int queuedSlot = slot;
+    ASSERT_EQ(OK, inputProducer->dequeueBuffer(&slot, &fence, 0, 0, 0,
+            GRALLOC_USAGE_SW_WRITE_OFTEN));
+    ASSERT_EQ(queuedSlot, slot);
 }
 
 TEST_F(StreamSplitterTest, OutputAbandonment) {
@@ -22,6 +22,8 @@
 #include "DisconnectWaiter.h"
 #include "FillBuffer.h"
 
+#include <gui/IProducerListener.h>
+
 namespace android {
 
 TEST_F(SurfaceTextureGLTest, TexturingFromCpuFilledYV12BufferNpot) {
@@ -433,6 +435,114 @@ TEST_F(SurfaceTextureGLTest, TexturingFromCpuFilledRGBABufferPow2) {
 // to handle a special case where updateTexImage is called
 // in the middle of disconnect.  This ordering is enforced
 // by blocking in the disconnect callback.
+TEST_F(SurfaceTextureGLTest, TexturingWithDeferredFenceWait) {
+    const int texWidth = 64;
+    const int texHeight = 66;
+
+    ASSERT_EQ(NO_ERROR, native_window_api_connect(mANW.get(),
+            NATIVE_WINDOW_API_CPU));
+    ASSERT_EQ(NO_ERROR, native_window_set_buffers_dimensions(mANW.get(),
+            texWidth, texHeight));
+    ASSERT_EQ(NO_ERROR, native_window_set_buffers_format(mANW.get(),
+            HAL_PIXEL_FORMAT_RGBA_8888));
+    ASSERT_EQ(NO_ERROR, native_window_set_usage(mANW.get(),
+            GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN));
+
+    ASSERT_NO_FATAL_FAILURE(produceOneRGBA8Frame(mANW));
+
+    sp<Fence> fence;
+    ASSERT_EQ(NO_ERROR, mST->updateTexImageNoWait(&fence));
+    ASSERT_TRUE(fence != NULL);
+    EXPECT_EQ(mST->getCurrentFence(), fence);
+    ASSERT_EQ(NO_ERROR, fence->waitForever("TexturingWithDeferredFenceWait"));
+    ASSERT_EQ(NO_ERROR, mST->doGLFenceWait());
+
+    glClearColor(0.2, 0.2, 0.2, 0.2);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    glViewport(0, 0, texWidth, texHeight);
+    drawTexture();
+
+    EXPECT_TRUE(checkPixel( 0,  0,  35,  35,  35,  35));
+    EXPECT_TRUE(checkPixel(63,  0, 231, 231, 231, 231));
+    EXPECT_TRUE(checkPixel(63, 65, 231, 231, 231, 231));
+    EXPECT_TRUE(checkPixel( 0, 65,  35,  35,  35,  35));
+
+    // Without a new buffer, the fence of the current one is returned again
+    ASSERT_EQ(NO_ERROR, mST->updateTexImageNoWait(&fence));
+    EXPECT_EQ(mST->getCurrentFence(), fence);
+}
+
+TEST_F(SurfaceTextureGLTest, TexturingFromReattachedBuffers) {
+    const int texWidth = 4;
+    const int texHeight = 4;
+    const uint8_t colors[3][4] = {
+        { 255,   0,   0, 255 },
+        {   0, 255,   0, 255 },
+        {   0,   0, 255, 255 },
+    };
+
+    sp<IGraphicBufferProducer> producer(mSTC->getIGraphicBufferProducer());
+    IGraphicBufferProducer::QueueBufferOutput output;
+    ASSERT_EQ(NO_ERROR, producer->connect(new DummyProducerListener,
+            NATIVE_WINDOW_API_CPU, false, &output));
+
+    sp<GraphicBuffer> buffers[2];
+    for (int i = 0; i < 2; i++) {
+        buffers[i] = new GraphicBuffer(texWidth, texHeight,
+                HAL_PIXEL_FORMAT_RGBA_8888,
+                GRALLOC_USAGE_SW_WRITE_OFTEN | GRALLOC_USAGE_HW_TEXTURE);
+        ASSERT_EQ(NO_ERROR, buffers[i]->initCheck());
+    }
+
+    // The consumer sees every attached buffer as a new one, but must show
+    // the current contents of a buffer it has seen before
+    for (int i = 0; i < 6; i++) {
+        const sp<GraphicBuffer>& buffer = buffers[i % 2];
+        const uint8_t* color = colors[i % 3];
+
+        int slot;
+        ASSERT_EQ(NO_ERROR, producer->attachBuffer(&slot, buffer));
+
+        uint8_t* img = NULL;
+        ASSERT_EQ(NO_ERROR, buffer->lock(GRALLOC_USAGE_SW_WRITE_OFTEN,
+                reinterpret_cast<void**>(&img)));
+        for (int y = 0; y < texHeight; y++) {
+            for (int x = 0; x < texWidth; x++) {
+                memcpy(img + (y * buffer->getStride() + x) * 4, color, 4);
+            }
+        }
+        ASSERT_EQ(NO_ERROR, buffer->unlock());
+
+        IGraphicBufferProducer::QueueBufferInput input(0, false,
+                HAL_DATASPACE_UNKNOWN, Rect::INVALID_RECT,
+                NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, Fence::NO_FENCE);
+        ASSERT_EQ(NO_ERROR, producer->queueBuffer(slot, input, &output));
+        mFW->waitForFrame();
+        ASSERT_EQ(NO_ERROR, mST->updateTexImage());
+
+        glClearColor(0.2, 0.2, 0.2, 0.2);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        glViewport(0, 0, texWidth, texHeight);
+        drawTexture();
+
+        EXPECT_TRUE(checkPixel(1, 1, color[0], color[1], color[2], color[3]))
+                << "frame " << i;
+
+        // Take the buffer released by this update back out of the queue, so
+        // that it can be attached again
+        if (i > 0) {
+            sp<GraphicBuffer> detached;
+            sp<Fence> fence;
+            ASSERT_EQ(NO_ERROR, producer->detachNextBuffer(&detached, &fence));
+            ASSERT_EQ(buffers[(i + 1) % 2], detached);
+            ASSERT_EQ(NO_ERROR,
+                    fence->waitForever("TexturingFromReattachedBuffers"));
+        }
+    }
+}
+
 TEST_F(SurfaceTextureGLTest, DisconnectStressTest) {
 
     class ProducerThread : public Thread {
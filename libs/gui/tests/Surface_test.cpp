@@ -18,7 +18,10 @@
 
 #include <gtest/gtest.h>
 
+#include <poll.h>
+
 #include <binder/IMemory.h>
+#include <gui/BitTube.h>
 #include <gui/ISurfaceComposer.h>
 #include <gui/Surface.h>
 #include <gui/SurfaceComposerClient.h>
@@ -216,6 +219,54 @@ TEST_F(SurfaceTest, SettingGenerationNumber) {
     ASSERT_EQ(1U, graphicBuffer->getGenerationNumber());
 }
 
+TEST_F(SurfaceTest, FrameEventChannelNeedsTrackingConsumer) {
+    sp<IGraphicBufferProducer> producer;
+    sp<IGraphicBufferConsumer> consumer;
+    BufferQueue::createBufferQueue(&producer, &consumer);
+
+    sp<DummyConsumer> dummyConsumer(new DummyConsumer);
+    consumer->consumerConnect(dummyConsumer, false);
+
+    sp<Surface> surface = new Surface(producer);
+    sp<BitTube> channel;
+    ASSERT_EQ(INVALID_OPERATION, surface->createFrameEventChannel(&channel));
+    ASSERT_TRUE(channel == NULL);
+}
+
+TEST_F(SurfaceTest, FrameEventChannelSendsQueuedFrames) {
+    sp<BitTube> channel;
+    ASSERT_EQ(NO_ERROR, mSurface->createFrameEventChannel(&channel));
+    ASSERT_TRUE(channel != NULL);
+
+    sp<ANativeWindow> window(mSurface);
+    ASSERT_EQ(NO_ERROR, native_window_api_connect(window.get(),
+            NATIVE_WINDOW_API_CPU));
+
+    // Frames go out once their record in SurfaceFlinger is reused at the
+    // latest, so keep queueing until one arrives
+    FrameTimestamps timestamps;
+    ssize_t count = 0;
+    for (int i = 0; i < 32 && count <= 0; i++) {
+        int fence;
+        ANativeWindowBuffer* buffer;
+        ASSERT_EQ(NO_ERROR, window->dequeueBuffer(window.get(), &buffer,
+                &fence));
+        ASSERT_EQ(NO_ERROR, window->queueBuffer(window.get(), buffer, fence));
+
+        struct pollfd fd = { channel->getFd(), POLLIN, 0 };
+        if (poll(&fd, 1, 100) == 1) {
+            count = BitTube::recvObjects(channel, &timestamps, 1);
+        }
+    }
+    ASSERT_EQ(1, count);
+    ASSERT_GT(timestamps.frameNumber, 0u);
+    ASSERT_GT(timestamps.postedTime, 0);
+    ASSERT_GT(timestamps.refreshStartTime, 0);
+
+    ASSERT_EQ(NO_ERROR, native_window_api_disconnect(window.get(),
+            NATIVE_WINDOW_API_CPU));
+}
+
 TEST_F(SurfaceTest, GetConsumerName) {
     sp<IGraphicBufferProducer> producer;
     sp<IGraphicBufferConsumer> consumer;
@@ -258,4 +309,191 @@ TEST_F(SurfaceTest, DynamicSetBufferCount) {
     ASSERT_EQ(NO_ERROR, window->queueBuffer(window.get(), buffer, fence));
 }
 
+
+TEST_F(SurfaceTest, BufferPrefetch) {
+    sp<IGraphicBufferProducer> producer;
+    sp<IGraphicBufferConsumer> consumer;
+    BufferQueue::createBufferQueue(&producer, &consumer);
+
+    sp<DummyConsumer> dummyConsumer(new DummyConsumer);
+    consumer->consumerConnect(dummyConsumer, false);
+    consumer->setConsumerName(String8("TestConsumer"));
+
+    sp<Surface> surface = new Surface(producer);
+    sp<ANativeWindow> window(surface);
+
+    ASSERT_EQ(NO_ERROR, native_window_api_connect(window.get(),
+            NATIVE_WINDOW_API_CPU));
+    ASSERT_EQ(NO_ERROR, native_window_set_buffer_count(window.get(), 4));
+    surface->setBufferPrefetch(true);
+
+    int fence;
+    ANativeWindowBuffer* buffer;
+    BufferItem item;
+    for (int i = 0; i < 8; i++) {
+        ASSERT_EQ(NO_ERROR, window->dequeueBuffer(window.get(), &buffer,
+                &fence));
+        ASSERT_EQ(NO_ERROR, window->queueBuffer(window.get(), buffer, fence));
+        ASSERT_EQ(NO_ERROR, consumer->acquireBuffer(&item, 0));
+        ASSERT_EQ(NO_ERROR, consumer->releaseBuffer(item.mSlot,
+                item.mFrameNumber, EGL_NO_DISPLAY, EGL_NO_SYNC_KHR,
+                Fence::NO_FENCE));
+    }
+
+    // The last queue left a buffer prefetched; it must not stop the buffer
+    // count from shrinking, nor be handed out for a different request.
+    ASSERT_EQ(NO_ERROR, native_window_set_buffer_count(window.get(), 3));
+    ASSERT_EQ(NO_ERROR, window->dequeueBuffer(window.get(), &buffer, &fence));
+    ASSERT_EQ(NO_ERROR, window->queueBuffer(window.get(), buffer, fence));
+    ASSERT_EQ(NO_ERROR, native_window_set_buffers_dimensions(window.get(),
+            32, 32));
+    ASSERT_EQ(NO_ERROR, consumer->acquireBuffer(&item, 0));
+    ASSERT_EQ(NO_ERROR, consumer->releaseBuffer(item.mSlot,
+            item.mFrameNumber, EGL_NO_DISPLAY, EGL_NO_SYNC_KHR,
+            Fence::NO_FENCE));
+    ASSERT_EQ(NO_ERROR, window->dequeueBuffer(window.get(), &buffer, &fence));
+    EXPECT_EQ(32, buffer->width);
+    EXPECT_EQ(32, buffer->height);
+    ASSERT_EQ(NO_ERROR, window->cancelBuffer(window.get(), buffer, fence));
+
+    ASSERT_EQ(NO_ERROR, native_window_api_disconnect(window.get(),
+            NATIVE_WINDOW_API_CPU));
+}
+
+TEST_F(SurfaceTest, LockCopiesBackWhatChanged) {
+    sp<IGraphicBufferProducer> producer;
+    sp<IGraphicBufferConsumer> consumer;
+    BufferQueue::createBufferQueue(&producer, &consumer);
+
+    sp<DummyConsumer> dummyConsumer(new DummyConsumer);
+    consumer->consumerConnect(dummyConsumer, false);
+    consumer->setConsumerName(String8("TestConsumer"));
+
+    sp<Surface> surface = new Surface(producer);
+    sp<ANativeWindow> window(surface);
+
+    const int32_t size = 16;
+    ASSERT_EQ(NO_ERROR, native_window_set_buffers_dimensions(window.get(),
+            size, size));
+    ASSERT_EQ(NO_ERROR, native_window_set_buffers_format(window.get(),
+            HAL_PIXEL_FORMAT_RGBA_8888));
+
+    // Every frame only redraws a small square. Whichever buffer is dequeued,
+    // everything else must have been copied back from the previous frames.
+    const Rect dirty[] = {
+        Rect(size, size), Rect(0, 0, 4, 4), Rect(4, 4, 8, 8),
+        Rect(4, 4, 8, 8), Rect(8, 8, 12, 12), Rect(0, 12, 16, 16),
+        Rect(12, 0, 16, 4), Rect(0, 0, 4, 4), Rect(2, 2, 10, 10),
+        Rect(6, 6, 7, 7),
+    };
+    uint32_t expected[size * size] = {};
+    for (uint32_t frame = 0; frame < sizeof(dirty) / sizeof(dirty[0]);
+            frame++) {
+        ANativeWindow_Buffer buffer;
+        ARect bounds = { dirty[frame].left, dirty[frame].top,
+                dirty[frame].right, dirty[frame].bottom };
+        ASSERT_EQ(NO_ERROR, surface->lock(&buffer, &bounds));
+        const Rect drawn(bounds.left, bounds.top, bounds.right, bounds.bottom);
+
+        uint32_t* pixels = static_cast<uint32_t*>(buffer.bits);
+        for (int32_t y = 0; y < size; y++) {
+            for (int32_t x = 0; x < size; x++) {
+                uint32_t& pixel(pixels[y * buffer.stride + x]);
+                if (x >= drawn.left && x < drawn.right &&
+                        y >= drawn.top && y < drawn.bottom) {
+                    pixel = expected[y * size + x] = frame + 1;
+                } else {
+                    ASSERT_EQ(expected[y * size + x], pixel) << "frame "
+                            << frame << " at " << x << "," << y;
+                }
+            }
+        }
+        ASSERT_EQ(NO_ERROR, surface->unlockAndPost());
+
+        BufferItem item;
+        ASSERT_EQ(NO_ERROR, consumer->acquireBuffer(&item, 0));
+        ASSERT_EQ(NO_ERROR, consumer->releaseBuffer(item.mSlot,
+                item.mFrameNumber, EGL_NO_DISPLAY, EGL_NO_SYNC_KHR,
+                Fence::NO_FENCE));
+    }
+
+    ASSERT_EQ(NO_ERROR, native_window_api_disconnect(window.get(),
+            NATIVE_WINDOW_API_CPU));
+}
+
+TEST_F(SurfaceTest, BufferAgeAndAccumulatedDamage) {
+    sp<IGraphicBufferProducer> producer;
+    sp<IGraphicBufferConsumer> consumer;
+    BufferQueue::createBufferQueue(&producer, &consumer);
+
+    sp<DummyConsumer> dummyConsumer(new DummyConsumer);
+    consumer->consumerConnect(dummyConsumer, false);
+    consumer->setConsumerName(String8("TestConsumer"));
+
+    sp<Surface> surface = new Surface(producer);
+    sp<ANativeWindow> window(surface);
+
+    ASSERT_EQ(NO_ERROR, native_window_api_connect(window.get(),
+            NATIVE_WINDOW_API_EGL));
+    ASSERT_EQ(NO_ERROR, native_window_set_buffer_count(window.get(), 3));
+
+    // The damage of each frame, the last one is unknown.
+    std::vector<Region> damages;
+    for (int frame = 0; frame < 12; frame++) {
+        int fence;
+        ANativeWindowBuffer* buffer;
+        ASSERT_EQ(NO_ERROR, window->dequeueBuffer(window.get(), &buffer,
+                &fence));
+
+        // Surface answers on its own, it must agree with the BufferQueue.
+        int age = -1;
+        int expectedAge = -1;
+        ASSERT_EQ(NO_ERROR, window->query(window.get(),
+                NATIVE_WINDOW_BUFFER_AGE, &age));
+        ASSERT_EQ(NO_ERROR, producer->query(NATIVE_WINDOW_BUFFER_AGE,
+                &expectedAge));
+        EXPECT_EQ(expectedAge, age) << "frame " << frame;
+
+        Region expectedDamage;
+        if (age == 0) {
+            expectedDamage = Region::INVALID_REGION;
+        }
+        for (int i = frame - age + 1; age > 0 && i < frame; i++) {
+            if (damages[i].bounds() == Rect::INVALID_RECT) {
+                expectedDamage = Region::INVALID_REGION;
+                break;
+            }
+            expectedDamage.orSelf(damages[i]);
+        }
+        Region damage(surface->getAccumulatedDamage(age));
+        if (expectedDamage.bounds() == Rect::INVALID_RECT) {
+            EXPECT_EQ(Rect::INVALID_RECT, damage.bounds()) << "frame " << frame;
+        } else {
+            EXPECT_TRUE(expectedDamage.subtract(damage).isEmpty() &&
+                    damage.subtract(expectedDamage).isEmpty())
+                    << "frame " << frame;
+        }
+
+        if (frame % 5 == 4) {
+            damages.push_back(Region::INVALID_REGION);
+        } else {
+            // GL convention, the top is above the bottom
+            android_native_rect_t rect = { frame, frame + 2, frame + 1, frame };
+            ASSERT_EQ(NO_ERROR, native_window_set_surface_damage(window.get(),
+                    &rect, 1));
+            damages.push_back(Region(Rect(frame, frame, frame + 1, frame + 2)));
+        }
+        ASSERT_EQ(NO_ERROR, window->queueBuffer(window.get(), buffer, fence));
+
+        BufferItem item;
+        ASSERT_EQ(NO_ERROR, consumer->acquireBuffer(&item, 0));
+        ASSERT_EQ(NO_ERROR, consumer->releaseBuffer(item.mSlot,
+                item.mFrameNumber, EGL_NO_DISPLAY, EGL_NO_SYNC_KHR,
+                Fence::NO_FENCE));
+    }
+
+    ASSERT_EQ(NO_ERROR, native_window_api_disconnect(window.get(),
+            NATIVE_WINDOW_API_EGL));
+}
+
 }
@@ -0,0 +1,86 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "VsyncSnapshot_test"
+//#define LOG_NDEBUG 0
+
+#include <thread>
+
+#include <gui/VsyncSnapshot.h>
+
+#include <gtest/gtest.h>
+
+namespace android {
+
+class VsyncSnapshotTest : public ::testing::Test {
+protected:
+    sp<VsyncSnapshot> mWriter;
+    sp<VsyncSnapshot> mReader;
+
+    virtual void SetUp() {
+        mWriter = VsyncSnapshot::create();
+        ASSERT_TRUE(mWriter != NULL);
+        mReader = VsyncSnapshot::fromMemory(mWriter->getMemory());
+        ASSERT_TRUE(mReader != NULL);
+    }
+
+    static DisplayEventReceiver::Event makeVsync(uint32_t count) {
+        DisplayEventReceiver::Event vsync;
+        vsync.header.type = DisplayEventReceiver::DISPLAY_EVENT_VSYNC;
+        vsync.header.id = 0;
+        vsync.header.timestamp = nsecs_t(count) * 16666667;
+        vsync.vsync.count = count;
+        return vsync;
+    }
+};
+
+TEST_F(VsyncSnapshotTest, NothingPublishedWouldBlock) {
+    DisplayEventReceiver::Event vsync;
+    EXPECT_EQ(WOULD_BLOCK, mReader->read(&vsync));
+}
+
+TEST_F(VsyncSnapshotTest, ReadReturnsLastPublishedVsync) {
+    mWriter->publish(makeVsync(1));
+    mWriter->publish(makeVsync(2));
+
+    DisplayEventReceiver::Event vsync;
+    ASSERT_EQ(NO_ERROR, mReader->read(&vsync));
+    EXPECT_EQ(uint32_t(DisplayEventReceiver::DISPLAY_EVENT_VSYNC), vsync.header.type);
+    EXPECT_EQ(2u, vsync.vsync.count);
+    EXPECT_EQ(makeVsync(2).header.timestamp, vsync.header.timestamp);
+}
+
+TEST_F(VsyncSnapshotTest, ReadNeverSeesTornVsync) {
+    const uint32_t lastCount = 100000;
+    std::thread writer([this, lastCount] {
+        for (uint32_t count = 1; count <= lastCount; count++) {
+            mWriter->publish(makeVsync(count));
+        }
+    });
+
+    uint32_t count = 0;
+    while (count < lastCount) {
+        DisplayEventReceiver::Event vsync;
+        if (mReader->read(&vsync) == NO_ERROR) {
+            ASSERT_EQ(makeVsync(vsync.vsync.count).header.timestamp, vsync.header.timestamp);
+            ASSERT_GE(vsync.vsync.count, count);
+            count = vsync.vsync.count;
+        }
+    }
+    writer.join();
+}
+
+} // namespace android
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <poll.h>
+
+#include <atomic>
+#include <thread>
+
+#include <benchmark/benchmark.h>
+
+#include <gui/BitTube.h>
+#include <gui/RingTube.h>
+
+namespace android {
+
+// The size of a DisplayEventReceiver::Event, and about a quarter of an
+// ASensorEvent.
+struct Message {
+    uint64_t data[3];
+};
+
+static const size_t TUBE_SIZE = 16 * 1024;
+
+static void waitForFd(int fd) {
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    poll(&pfd, 1, -1);
+}
+
+// Batches of state.range(0) messages sent and received by one thread: the
+// cost of the channel itself, without any wakeup.
+template <typename Tube>
+static void BM_Throughput(benchmark::State& state) {
+    sp<Tube> tube = new Tube(TUBE_SIZE);
+    const size_t count = size_t(state.range(0));
+    Message messages[64] = {};
+    while (state.KeepRunning()) {
+        Tube::sendObjects(tube, messages, count);
+        benchmark::DoNotOptimize(Tube::recvObjects(tube, messages, count));
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+    state.SetBytesProcessed(state.iterations() * count * sizeof(Message));
+}
+BENCHMARK_TEMPLATE(BM_Throughput, BitTube)->Arg(1)->Arg(8)->Arg(64);
+BENCHMARK_TEMPLATE(BM_Throughput, RingTube)->Arg(1)->Arg(8)->Arg(64);
+
+// A message sent to a thread waiting on the tube's fd, and back through a
+// second tube: the round trip latency with wakeups, the way vsync and
+// sensor events reach a Looper.
+template <typename Tube>
+static void BM_RoundTrip(benchmark::State& state) {
+    sp<Tube> request = new Tube(TUBE_SIZE);
+    sp<Tube> response = new Tube(TUBE_SIZE);
+    std::atomic<bool> done(false);
+
+    std::thread echo([&] {
+        Message message;
+        while (!done.load()) {
+            ssize_t n;
+            while ((n = Tube::recvObjects(request, &message, 1)) > 0) {
+                Tube::sendObjects(response, &message, 1);
+            }
+            if (!done.load()) {
+                waitForFd(request->getFd());
+            }
+        }
+    });
+
+    Message message = {};
+    while (state.KeepRunning()) {
+        message.data[0]++;
+        Tube::sendObjects(request, &message, 1);
+        while (Tube::recvObjects(response, &message, 1) == 0) {
+            waitForFd(response->getFd());
+        }
+    }
+
+    done.store(true);
+    Tube::sendObjects(request, &message, 1);
+    echo.join();
+}
+BENCHMARK_TEMPLATE(BM_RoundTrip, BitTube);
+BENCHMARK_TEMPLATE(BM_RoundTrip, RingTube);
+
+}; // namespace android
+
+BENCHMARK_MAIN();
@@ -24,10 +24,16 @@
 #include <fcntl.h>
 #include <inttypes.h>
 #include <math.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
+#include <atomic>
+
+#include <cutils/ashmem.h>
 #include <cutils/log.h>
 #include <cutils/properties.h>
 #include <input/InputTransport.h>
@@ -44,10 +50,20 @@ static const size_t SOCKET_BUFFER_SIZE = 32 * 1024;
 // Nanoseconds per milliseconds.
 static const nsecs_t NANOS_PER_MS = 1000000;
 
-// Latency added during resampling.  A few milliseconds doesn't hurt much but
+// Default latency added during resampling.  A few milliseconds doesn't hurt much but
 // reduces the impact of mispredicted touch positions.
 static const nsecs_t RESAMPLE_LATENCY = 5 * NANOS_PER_MS;
 
+// Maximum number of messages to hand to one sendmmsg() call.
+static const size_t SEND_BATCH_SIZE = 16;
+
+// The shared memory ring is a RingHeader followed, from RING_DATA_OFFSET on, by records
+// that are each a RingRecord and a message (packed like on the socket) padded to 8 bytes.
+static const uint32_t RING_MAGIC = 0x52504e49; // "INPR"
+static const size_t RING_DATA_OFFSET = 64;
+// Record length that marks the rest of the ring as unused, when a record did not fit.
+static const uint32_t RING_PADDING = 0xffffffff;
+
 // Minimum time difference between consecutive samples before attempting to resample.
 static const nsecs_t RESAMPLE_MIN_DELTA = 2 * NANOS_PER_MS;
 
@@ -55,10 +71,18 @@ static const nsecs_t RESAMPLE_MIN_DELTA = 2 * NANOS_PER_MS;
 // by extrapolation.
 static const nsecs_t RESAMPLE_MAX_DELTA = 20 * NANOS_PER_MS;
 
-// Maximum time to predict forward from the last known state, to avoid predicting too
-// far into the future.  This time is further bounded by 50% of the last time delta.
+// Default maximum time to predict forward from the last known state, to avoid predicting
+// too far into the future.  For linear resampling this time is further bounded by 50% of
+// the last time delta.
 static const nsecs_t RESAMPLE_MAX_PREDICTION = 8 * NANOS_PER_MS;
 
+// Oldest sample to include in the quadratic fit of RESAMPLE_LSQ2, relative to the last one.
+static const nsecs_t RESAMPLE_LSQ2_HORIZON = 50 * NANOS_PER_MS;
+
+// Maximum distance of a quadratic prediction from the last sample, relative to the distance
+// of the linear one.  This keeps a stroke that turns sharply from overshooting far.
+static const float RESAMPLE_LSQ2_MAX_OVERSHOOT = 1.5f;
+
 template<typename T>
 inline static T min(const T& a, const T& b) {
     return a < b ? a : b;
@@ -79,6 +103,7 @@ bool InputMessage::isValid(size_t actualSize) const {
             return body.motion.pointerCount > 0
                     && body.motion.pointerCount <= MAX_POINTERS;
         case TYPE_FINISHED:
+        case TYPE_WAKE:
             return true;
         }
     }
@@ -100,8 +125,31 @@ size_t InputMessage::size() const {
 
 // --- InputChannel ---
 
+struct InputChannel::RingHeader {
+    uint32_t magic;
+    uint32_t capacity; // bytes of records, a multiple of 8
+    std::atomic<uint64_t> head; // bytes written, only written by the server
+    std::atomic<uint64_t> tail; // bytes read, only written by the client
+};
+
+struct RingRecord {
+    uint32_t length; // of the message, or RING_PADDING
+    uint32_t reserved;
+};
+
+static_assert(sizeof(InputChannel::RingHeader) <= RING_DATA_OFFSET,
+        "RingHeader does not fit before the records");
+
+static inline size_t getRingRecordSize(size_t length) {
+    return sizeof(RingRecord) + ((length + 7) & ~size_t(7));
+}
+
+// Large enough to always fit the largest record, wherever the last one ended.
+static const size_t MIN_RING_CAPACITY = 2 * getRingRecordSize(sizeof(InputMessage));
+
 InputChannel::InputChannel(const String8& name, int fd) :
-        mName(name), mFd(fd) {
+        mName(name), mFd(fd),
+        mRingFd(-1), mRing(NULL), mRingMapSize(0), mRingCapacity(0), mRingWriter(false) {
 #if DEBUG_CHANNEL_LIFECYCLE
     ALOGD("Input channel constructed: name='%s', fd=%d",
             mName.string(), fd);
@@ -112,15 +160,52 @@ InputChannel::InputChannel(const String8& name, int fd) :
             "non-blocking.  errno=%d", mName.string(), errno);
 }
 
+InputChannel::InputChannel(const String8& name, int fd, int ringFd) :
+        InputChannel(name, fd) {
+    mapRing(ringFd, false /*writer*/);
+}
+
 InputChannel::~InputChannel() {
 #if DEBUG_CHANNEL_LIFECYCLE
     ALOGD("Input channel destroyed: name='%s', fd=%d",
             mName.string(), mFd);
 #endif
 
+    if (mRing) {
+        munmap(mRing, mRingMapSize);
+        ::close(mRingFd);
+    }
     ::close(mFd);
 }
 
+void InputChannel::mapRing(int ringFd, bool writer) {
+    int size = ashmem_get_size_region(ringFd);
+    LOG_ALWAYS_FATAL_IF(size < int(RING_DATA_OFFSET + MIN_RING_CAPACITY),
+            "channel '%s' ~ Shared memory ring is too small, size=%d", mName.string(), size);
+    void* data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, ringFd, 0);
+    LOG_ALWAYS_FATAL_IF(data == MAP_FAILED, "channel '%s' ~ Could not map shared memory "
+            "ring.  errno=%d", mName.string(), errno);
+
+    RingHeader* ring = static_cast<RingHeader*>(data);
+    if (writer && ring->magic != RING_MAGIC) {
+        // A new ring, as ashmem regions start out zeroed.
+        ring->capacity = (size - RING_DATA_OFFSET) & ~size_t(7);
+        ring->head.store(0);
+        ring->tail.store(0);
+        ring->magic = RING_MAGIC;
+    }
+    LOG_ALWAYS_FATAL_IF(ring->magic != RING_MAGIC || ring->capacity % 8 != 0
+            || ring->capacity < MIN_RING_CAPACITY
+            || ring->capacity > size - RING_DATA_OFFSET,
+            "channel '%s' ~ Shared memory ring is not valid", mName.string());
+
+    mRingFd = ringFd;
+    mRing = ring;
+    mRingMapSize = size;
+    mRingCapacity = ring->capacity;
+    mRingWriter = writer;
+}
+
 status_t InputChannel::openInputChannelPair(const String8& name,
         sp<InputChannel>& outServerChannel, sp<InputChannel>& outClientChannel) {
     int sockets[2];
@@ -149,11 +234,138 @@ status_t InputChannel::openInputChannelPair(const String8& name,
     return OK;
 }
 
+status_t InputChannel::openInputChannelPair(const String8& name, size_t ringSize,
+        sp<InputChannel>& outServerChannel, sp<InputChannel>& outClientChannel) {
+    size_t size = RING_DATA_OFFSET + (ringSize > MIN_RING_CAPACITY
+            ? (ringSize + 7) & ~size_t(7) : MIN_RING_CAPACITY);
+    int serverRingFd = ashmem_create_region(name.string(), size);
+    if (serverRingFd < 0) {
+        status_t result = -errno;
+        ALOGE("channel '%s' ~ Could not create shared memory ring.  errno=%d",
+                name.string(), errno);
+        outServerChannel.clear();
+        outClientChannel.clear();
+        return result;
+    }
+    int clientRingFd = ::dup(serverRingFd);
+    if (clientRingFd < 0) {
+        status_t result = -errno;
+        ::close(serverRingFd);
+        outServerChannel.clear();
+        outClientChannel.clear();
+        return result;
+    }
+
+    status_t result = openInputChannelPair(name, outServerChannel, outClientChannel);
+    if (result) {
+        ::close(serverRingFd);
+        ::close(clientRingFd);
+        return result;
+    }
+    // The server sets the ring up, so it has to go first.
+    outServerChannel->mapRing(serverRingFd, true /*writer*/);
+    outClientChannel->mapRing(clientRingFd, false /*writer*/);
+    return OK;
+}
+
+// A motion message on the wire is the header and the fields of the body before the
+// pointers, then for each pointer its properties, its axis bits and the value of each axis
+// it has, which for touches is usually a third of PointerCoords.
+static const size_t MOTION_FIXED_SIZE = sizeof(InputMessage::Header)
+        + offsetof(InputMessage::Body::Motion, pointers);
+
+size_t InputChannel::getPackedMotionMessageSize(const InputMessage* msg) {
+    size_t size = MOTION_FIXED_SIZE;
+    for (uint32_t i = 0; i < msg->body.motion.pointerCount; i++) {
+        size += sizeof(PointerProperties) + sizeof(uint64_t)
+                + BitSet64::count(msg->body.motion.pointers[i].coords.bits) * sizeof(float);
+    }
+    return size;
+}
+
+size_t InputChannel::packMotionMessage(const InputMessage* msg, uint8_t* buffer) {
+    memcpy(buffer, msg, MOTION_FIXED_SIZE);
+    size_t size = MOTION_FIXED_SIZE;
+    for (uint32_t i = 0; i < msg->body.motion.pointerCount; i++) {
+        const InputMessage::Body::Motion::Pointer& pointer = msg->body.motion.pointers[i];
+        memcpy(buffer + size, &pointer.properties, sizeof(PointerProperties));
+        size += sizeof(PointerProperties);
+        memcpy(buffer + size, &pointer.coords.bits, sizeof(uint64_t));
+        size += sizeof(uint64_t);
+        size_t valuesSize = BitSet64::count(pointer.coords.bits) * sizeof(float);
+        memcpy(buffer + size, pointer.coords.values, valuesSize);
+        size += valuesSize;
+    }
+    return size;
+}
+
+bool InputChannel::unpackMessage(const uint8_t* data, size_t size, InputMessage* msg) {
+    if (size < sizeof(InputMessage::Header) || size > sizeof(InputMessage)) {
+        return false;
+    }
+    memcpy(&msg->header, data, sizeof(InputMessage::Header));
+    if (msg->header.type != InputMessage::TYPE_MOTION) {
+        memcpy(msg, data, size);
+        return msg->isValid(size);
+    }
+    if (size < MOTION_FIXED_SIZE) {
+        return false;
+    }
+    memcpy(msg, data, MOTION_FIXED_SIZE);
+    uint32_t pointerCount = msg->body.motion.pointerCount;
+    if (pointerCount < 1 || pointerCount > MAX_POINTERS) {
+        return false;
+    }
+
+    size_t offset = MOTION_FIXED_SIZE;
+    for (uint32_t i = 0; i < pointerCount; i++) {
+        InputMessage::Body::Motion::Pointer& pointer = msg->body.motion.pointers[i];
+        if (size - offset < sizeof(PointerProperties) + sizeof(uint64_t)) {
+            return false;
+        }
+        memcpy(&pointer.properties, data + offset, sizeof(PointerProperties));
+        offset += sizeof(PointerProperties);
+        memcpy(&pointer.coords.bits, data + offset, sizeof(uint64_t));
+        offset += sizeof(uint64_t);
+        uint32_t axisCount = BitSet64::count(pointer.coords.bits);
+        size_t valuesSize = axisCount * sizeof(float);
+        if (axisCount > PointerCoords::MAX_AXES || size - offset < valuesSize) {
+            return false;
+        }
+        memcpy(pointer.coords.values, data + offset, valuesSize);
+        offset += valuesSize;
+    }
+    return offset == size;
+}
+
+bool InputChannel::unpackMessage(InputMessage* msg, size_t size) {
+    if (size > sizeof(InputMessage)) {
+        return false;
+    }
+    // Expanding the pointers in place would overwrite the packed ones still to be read.
+    uint8_t packed[sizeof(InputMessage)];
+    memcpy(packed, msg, size);
+    return unpackMessage(packed, size, msg);
+}
+
 status_t InputChannel::sendMessage(const InputMessage* msg) {
-    size_t msgLength = msg->size();
+    if (mRingWriter && (msg->header.type == InputMessage::TYPE_KEY
+            || msg->header.type == InputMessage::TYPE_MOTION)) {
+        return writeRingMessage(msg);
+    }
+
+    uint8_t packed[sizeof(InputMessage)];
+    const void* data = msg;
+    size_t msgLength;
+    if (msg->header.type == InputMessage::TYPE_MOTION) {
+        msgLength = packMotionMessage(msg, packed);
+        data = packed;
+    } else {
+        msgLength = msg->size();
+    }
     ssize_t nWrite;
     do {
-        nWrite = ::send(mFd, msg, msgLength, MSG_DONTWAIT | MSG_NOSIGNAL);
+        nWrite = ::send(mFd, data, msgLength, MSG_DONTWAIT | MSG_NOSIGNAL);
     } while (nWrite == -1 && errno == EINTR);
 
     if (nWrite < 0) {
@@ -185,7 +397,76 @@ status_t InputChannel::sendMessage(const InputMessage* msg) {
     return OK;
 }
 
+status_t InputChannel::sendMessages(const InputMessage* msgs, size_t count,
+        size_t* outCount) {
+    size_t sent = 0;
+    while (sent < count) {
+        // Motion messages need packing and events for the ring go through it, so those go
+        // one at a time; the runs of finished signals and keys in between are batched.
+        if (mRingWriter || msgs[sent].header.type == InputMessage::TYPE_MOTION) {
+            status_t status = sendMessage(&msgs[sent]);
+            if (status) {
+                *outCount = sent;
+                return status;
+            }
+            sent += 1;
+            continue;
+        }
+
+        struct iovec iovs[SEND_BATCH_SIZE];
+        struct mmsghdr headers[SEND_BATCH_SIZE];
+        size_t batchSize = 0;
+        while (batchSize < SEND_BATCH_SIZE && sent + batchSize < count
+                && msgs[sent + batchSize].header.type != InputMessage::TYPE_MOTION) {
+            const InputMessage& msg = msgs[sent + batchSize];
+            iovs[batchSize].iov_base = const_cast<InputMessage*>(&msg);
+            iovs[batchSize].iov_len = msg.size();
+            memset(&headers[batchSize], 0, sizeof(struct mmsghdr));
+            headers[batchSize].msg_hdr.msg_iov = &iovs[batchSize];
+            headers[batchSize].msg_hdr.msg_iovlen = 1;
+            batchSize += 1;
+        }
+
+        int nSent;
+        do {
+            nSent = ::sendmmsg(mFd, headers, batchSize, MSG_DONTWAIT | MSG_NOSIGNAL);
+        } while (nSent == -1 && errno == EINTR);
+
+        if (nSent < 0) {
+            // Let sendMessage() sort out and report the error for the first one.
+            status_t status = sendMessage(&msgs[sent]);
+            if (status) {
+                *outCount = sent;
+                return status;
+            }
+            sent += 1;
+            continue;
+        }
+        for (int i = 0; i < nSent; i++) {
+            if (headers[i].msg_len != iovs[i].iov_len) {
+#if DEBUG_CHANNEL_MESSAGES
+                ALOGD("channel '%s' ~ error sending message type %d, send was incomplete",
+                        mName.string(), msgs[sent + i].header.type);
+#endif
+                *outCount = sent + i;
+                return DEAD_OBJECT;
+            }
+        }
+        sent += nSent;
+#if DEBUG_CHANNEL_MESSAGES
+        ALOGD("channel '%s' ~ sent %d messages in one batch", mName.string(), nSent);
+#endif
+    }
+    *outCount = sent;
+    return OK;
+}
+
 status_t InputChannel::receiveMessage(InputMessage* msg) {
+    if (mRing && !mRingWriter) {
+        size_t count;
+        return receiveRingMessages(msg, 1, &count);
+    }
+
     ssize_t nRead;
     do {
         nRead = ::recv(mFd, msg, sizeof(InputMessage), MSG_DONTWAIT);
@@ -212,7 +493,7 @@ status_t InputChannel::receiveMessage(InputMessage* msg) {
         return DEAD_OBJECT;
     }
 
-    if (!msg->isValid(nRead)) {
+    if (!unpackMessage(msg, nRead)) {
 #if DEBUG_CHANNEL_MESSAGES
         ALOGD("channel '%s' ~ received invalid message", mName.string());
 #endif
@@ -225,9 +506,245 @@ status_t InputChannel::receiveMessage(InputMessage* msg) {
     return OK;
 }
 
+status_t InputChannel::receiveMessages(InputMessage* msgs, size_t capacity,
+        size_t* outCount) {
+    *outCount = 0;
+    if (mRing && !mRingWriter) {
+        return receiveRingMessages(msgs, capacity, outCount);
+    }
+    if (capacity == 1) {
+        status_t result = receiveMessage(msgs);
+        if (!result) {
+            *outCount = 1;
+        }
+        return result;
+    }
+
+    struct iovec iovs[capacity];
+    struct mmsghdr headers[capacity];
+    for (size_t i = 0; i < capacity; i++) {
+        iovs[i].iov_base = &msgs[i];
+        iovs[i].iov_len = sizeof(InputMessage);
+        memset(&headers[i], 0, sizeof(struct mmsghdr));
+        headers[i].msg_hdr.msg_iov = &iovs[i];
+        headers[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int nRead;
+    do {
+        nRead = ::recvmmsg(mFd, headers, capacity, MSG_DONTWAIT, NULL);
+    } while (nRead == -1 && errno == EINTR);
+
+    if (nRead < 0) {
+        int error = errno;
+#if DEBUG_CHANNEL_MESSAGES
+        ALOGD("channel '%s' ~ receive messages failed, errno=%d", mName.string(), errno);
+#endif
+        if (error == EAGAIN || error == EWOULDBLOCK) {
+            return WOULD_BLOCK;
+        }
+        if (error == EPIPE || error == ENOTCONN || error == ECONNREFUSED) {
+            return DEAD_OBJECT;
+        }
+        return -error;
+    }
+
+    for (int i = 0; i < nRead; i++) {
+        if (headers[i].msg_len == 0) { // check for EOF
+#if DEBUG_CHANNEL_MESSAGES
+            ALOGD("channel '%s' ~ receive message failed because peer was closed",
+                    mName.string());
+#endif
+            return DEAD_OBJECT;
+        }
+        if (!unpackMessage(&msgs[i], headers[i].msg_len)) {
+#if DEBUG_CHANNEL_MESSAGES
+            ALOGD("channel '%s' ~ received invalid message", mName.string());
+#endif
+            return BAD_VALUE;
+        }
+    }
+    if (nRead == 0) {
+        return DEAD_OBJECT;
+    }
+
+#if DEBUG_CHANNEL_MESSAGES
+    ALOGD("channel '%s' ~ received %d messages", mName.string(), nRead);
+#endif
+    *outCount = nRead;
+    return OK;
+}
+
+status_t InputChannel::writeRingMessage(const InputMessage* msg) {
+    size_t length = msg->header.type == InputMessage::TYPE_MOTION
+            ? getPackedMotionMessageSize(msg) : msg->size();
+    size_t recordSize = getRingRecordSize(length);
+
+    // The client can scribble over the header, but offsets are taken modulo our own capacity,
+    // so that would only garble its own events.
+    uint64_t head = mRing->head.load();
+    uint64_t tail = mRing->tail.load();
+    if (tail > head || head - tail > mRingCapacity) {
+        ALOGE("channel '%s' ~ Shared memory ring has an invalid read position",
+                mName.string());
+        return DEAD_OBJECT;
+    }
+    size_t offset = head % mRingCapacity;
+    size_t contiguous = mRingCapacity - offset;
+    size_t needed = recordSize > contiguous ? contiguous + recordSize : recordSize;
+    if (needed > mRingCapacity - (head - tail)) {
+        return WOULD_BLOCK;
+    }
+
+    uint8_t* data = reinterpret_cast<uint8_t*>(mRing) + RING_DATA_OFFSET;
+    if (recordSize > contiguous) {
+        reinterpret_cast<RingRecord*>(data + offset)->length = RING_PADDING;
+        offset = 0;
+    }
+    reinterpret_cast<RingRecord*>(data + offset)->length = length;
+    uint8_t* payload = data + offset + sizeof(RingRecord);
+    if (msg->header.type == InputMessage::TYPE_MOTION) {
+        packMotionMessage(msg, payload);
+    } else {
+        memcpy(payload, msg, length);
+    }
+    mRing->head.store(head + needed);
+
+#if DEBUG_CHANNEL_MESSAGES
+    ALOGD("channel '%s' ~ wrote message of type %d to the ring", mName.string(),
+            msg->header.type);
+#endif
+
+    // If the client had read everything before this message, it may be waiting on the
+    // socket. Since the head is stored before the tail is loaded here, and the client stores
+    // its tail before loading the head, one of us always sees the other.
+    if (mRing->tail.load() != head) {
+        return OK;
+    }
+    InputMessage wake;
+    wake.header.type = InputMessage::TYPE_WAKE;
+    wake.header.padding = 0;
+    status_t status = sendMessage(&wake);
+    // A full socket has wakeups the client has yet to read.
+    return status == WOULD_BLOCK ? OK : status;
+}
+
+status_t InputChannel::readRingMessage(InputMessage* msg) {
+    uint64_t tail = mRing->tail.load();
+    uint64_t head = mRing->head.load();
+    if (head == tail) {
+        return WOULD_BLOCK;
+    }
+    if (head < tail || head - tail > mRingCapacity) {
+        return BAD_VALUE;
+    }
+
+    uint8_t* data = reinterpret_cast<uint8_t*>(mRing) + RING_DATA_OFFSET;
+    size_t offset = tail % mRingCapacity;
+    size_t skipped = 0;
+    uint32_t length = reinterpret_cast<const RingRecord*>(data + offset)->length;
+    if (length == RING_PADDING) {
+        skipped = mRingCapacity - offset;
+        offset = 0;
+        length = reinterpret_cast<const RingRecord*>(data)->length;
+    }
+    if (length > sizeof(InputMessage)) {
+        return BAD_VALUE;
+    }
+    size_t recordSize = getRingRecordSize(length);
+    if (offset + recordSize > mRingCapacity || skipped + recordSize > head - tail
+            || !unpackMessage(data + offset + sizeof(RingRecord), length, msg)) {
+        return BAD_VALUE;
+    }
+
+    mRing->tail.store(tail + skipped + recordSize);
+    return OK;
+}
+
+status_t InputChannel::receiveRingMessages(InputMessage* msgs, size_t capacity,
+        size_t* outCount) {
+    *outCount = 0;
+    bool receivedWakeups = false;
+    for (;;) {
+        size_t count = 0;
+        while (count < capacity) {
+            status_t result = readRingMessage(&msgs[count]);
+            if (result == WOULD_BLOCK) {
+                break;
+            }
+            if (result) {
+#if DEBUG_CHANNEL_MESSAGES
+                ALOGD("channel '%s' ~ read invalid message from the ring", mName.string());
+#endif
+                return result;
+            }
+            count += 1;
+        }
+        if (count) {
+            *outCount = count;
+            return OK;
+        }
+        if (receivedWakeups) {
+            return WOULD_BLOCK;
+        }
+
+        // The ring is empty, so clear out the wakeups that made the fd readable, and look
+        // again for events written in the meantime.
+        status_t result = receiveWakeups();
+        if (result) {
+            return result;
+        }
+        receivedWakeups = true;
+    }
+}
+
+status_t InputChannel::receiveWakeups() {
+    for (;;) {
+        InputMessage::Header header;
+        ssize_t nRead;
+        do {
+            nRead = ::recv(mFd, &header, sizeof(header), MSG_DONTWAIT);
+        } while (nRead == -1 && errno == EINTR);
+
+        if (nRead < 0) {
+            int error = errno;
+            if (error == EAGAIN || error == EWOULDBLOCK) {
+                return OK;
+            }
+            if (error == EPIPE || error == ENOTCONN || error == ECONNREFUSED) {
+                return DEAD_OBJECT;
+            }
+            return -error;
+        }
+        if (nRead == 0) { // check for EOF
+            return DEAD_OBJECT;
+        }
+        if (size_t(nRead) != sizeof(header) || header.type != InputMessage::TYPE_WAKE) {
+#if DEBUG_CHANNEL_MESSAGES
+            ALOGD("channel '%s' ~ received unexpected message instead of a wakeup",
+                    mName.string());
+#endif
+            return BAD_VALUE;
+        }
+    }
+}
+
 sp<InputChannel> InputChannel::dup() const {
     int fd = ::dup(getFd());
-    return fd >= 0 ? new InputChannel(getName(), fd) : NULL;
+    if (fd < 0) {
+        return NULL;
+    }
+    if (!mRing) {
+        return new InputChannel(getName(), fd);
+    }
+    int ringFd = ::dup(mRingFd);
+    if (ringFd < 0) {
+        ::close(fd);
+        return NULL;
+    }
+    sp<InputChannel> channel = new InputChannel(getName(), fd);
+    channel->mapRing(ringFd, mRingWriter);
+    return channel;
 }
 
 
@@ -375,7 +892,9 @@ status_t InputPublisher::receiveFinishedSignal(uint32_t* outSeq, bool* outHandle
 
 InputConsumer::InputConsumer(const sp<InputChannel>& channel) :
         mResampleTouch(isTouchResamplingEnabled()),
-        mChannel(channel), mMsgDeferred(false) {
+        mResampleStrategy(RESAMPLE_LINEAR), mResampleLatency(RESAMPLE_LATENCY),
+        mResampleMaxPrediction(RESAMPLE_MAX_PREDICTION),
+        mChannel(channel), mMsgDeferred(false), mReceivedCount(0), mReceivedIndex(0) {
 }
 
 InputConsumer::~InputConsumer() {
@@ -396,6 +915,13 @@ bool InputConsumer::isTouchResamplingEnabled() {
     return true;
 }
 
+void InputConsumer::setResampleStrategy(ResampleStrategy strategy, nsecs_t latency,
+        nsecs_t maxPrediction) {
+    mResampleStrategy = strategy;
+    mResampleLatency = latency;
+    mResampleMaxPrediction = maxPrediction;
+}
+
 status_t InputConsumer::consume(InputEventFactoryInterface* factory,
         bool consumeBatches, nsecs_t frameTime, uint32_t* outSeq, InputEvent** outEvent) {
 #if DEBUG_TRANSPORT_ACTIONS
@@ -415,7 +941,7 @@ status_t InputConsumer::consume(InputEventFactoryInterface* factory,
             mMsgDeferred = false;
         } else {
             // Receive a fresh message.
-            status_t result = mChannel->receiveMessage(&mMsg);
+            status_t result = receiveMessage(&mMsg);
             if (result) {
                 // Consume the next batched event unless batches are being held for later.
                 if (consumeBatches || result != WOULD_BLOCK) {
@@ -528,7 +1054,7 @@ status_t InputConsumer::consumeBatch(InputEventFactoryInterface* factory,
 
         nsecs_t sampleTime = frameTime;
         if (mResampleTouch) {
-            sampleTime -= RESAMPLE_LATENCY;
+            sampleTime -= mResampleLatency;
         }
         ssize_t split = findSampleNoLaterThan(batch, sampleTime);
         if (split < 0) {
@@ -750,7 +1276,9 @@ void InputConsumer::resampleTouchState(nsecs_t sampleTime, MotionEvent* event,
 #endif
             return;
         }
-        nsecs_t maxPredict = current->eventTime + min(delta / 2, RESAMPLE_MAX_PREDICTION);
+        // The quadratic fit follows the stroke well enough to predict past half a delta.
+        nsecs_t maxPredict = current->eventTime + (mResampleStrategy == RESAMPLE_LSQ2
+                ? mResampleMaxPrediction : min(delta / 2, mResampleMaxPrediction));
         if (sampleTime > maxPredict) {
 #if DEBUG_RESAMPLING
             ALOGD("Sample time is too far in the future, adjusting prediction "
@@ -779,11 +1307,14 @@ void InputConsumer::resampleTouchState(nsecs_t sampleTime, MotionEvent* event,
         if (other->idBits.hasBit(id)
                 && shouldResampleTool(event->getToolType(i))) {
             const PointerCoords& otherCoords = other->getPointerById(id);
+            float x = lerp(currentCoords.getX(), otherCoords.getX(), alpha);
+            float y = lerp(currentCoords.getY(), otherCoords.getY(), alpha);
+            if (!next && mResampleStrategy == RESAMPLE_LSQ2) {
+                predictQuadratic(touchState, id, sampleTime, &x, &y);
+            }
             resampledCoords.copyFrom(currentCoords);
-            resampledCoords.setAxisValue(AMOTION_EVENT_AXIS_X,
-                    lerp(currentCoords.getX(), otherCoords.getX(), alpha));
-            resampledCoords.setAxisValue(AMOTION_EVENT_AXIS_Y,
-                    lerp(currentCoords.getY(), otherCoords.getY(), alpha));
+            resampledCoords.setAxisValue(AMOTION_EVENT_AXIS_X, x);
+            resampledCoords.setAxisValue(AMOTION_EVENT_AXIS_Y, y);
 #if DEBUG_RESAMPLING
             ALOGD("[%d] - out (%0.3f, %0.3f), cur (%0.3f, %0.3f), "
                     "other (%0.3f, %0.3f), alpha %0.3f",
@@ -805,6 +1336,64 @@ void InputConsumer::resampleTouchState(nsecs_t sampleTime, MotionEvent* event,
     event->addSample(sampleTime, touchState.lastResample.pointers);
 }
 
+void InputConsumer::predictQuadratic(const TouchState& touchState, uint32_t id,
+        nsecs_t sampleTime, float* inOutX, float* inOutY) {
+    // Fit x(t) = x0 + b * t + c * t^2 to the older samples by least squares, with t in
+    // milliseconds from the last sample and x0 at it so that the prediction starts there.
+    const History* current = touchState.getHistory(0);
+    const PointerCoords& currentCoords = current->getPointerById(id);
+    float x0 = currentCoords.getX();
+    float y0 = currentCoords.getY();
+    float stt = 0, sttt = 0, stttt = 0;
+    float sxt = 0, sxtt = 0, syt = 0, sytt = 0;
+    size_t count = 0;
+    for (size_t i = 1; i < touchState.historySize; i++) {
+        const History* history = touchState.getHistory(i);
+        if (!history->idBits.hasBit(id)
+                || current->eventTime - history->eventTime > RESAMPLE_LSQ2_HORIZON) {
+            break;
+        }
+        const PointerCoords& coords = history->getPointerById(id);
+        float t = float(history->eventTime - current->eventTime) / NANOS_PER_MS;
+        float tt = t * t;
+        float dx = coords.getX() - x0;
+        float dy = coords.getY() - y0;
+        stt += tt;
+        sttt += tt * t;
+        stttt += tt * tt;
+        sxt += dx * t;
+        sxtt += dx * tt;
+        syt += dy * t;
+        sytt += dy * tt;
+        count += 1;
+    }
+    float det = stt * stttt - sttt * sttt;
+    if (count < 2 || det <= 1e-6f * stt * stttt) {
+#if DEBUG_RESAMPLING
+        ALOGD("[%d] - not enough distinct samples for a quadratic fit, using linear", id);
+#endif
+        return;
+    }
+
+    float t = float(sampleTime - current->eventTime) / NANOS_PER_MS;
+    float dx = ((sxt * stttt - sxtt * sttt) * t + (stt * sxtt - sttt * sxt) * t * t) / det;
+    float dy = ((syt * stttt - sytt * sttt) * t + (stt * sytt - sttt * syt) * t * t) / det;
+    float distance = sqrtf(dx * dx + dy * dy);
+    float maxDistance = RESAMPLE_LSQ2_MAX_OVERSHOOT
+            * sqrtf((*inOutX - x0) * (*inOutX - x0) + (*inOutY - y0) * (*inOutY - y0));
+    if (distance > maxDistance) {
+        float scale = maxDistance / distance;
+        dx *= scale;
+        dy *= scale;
+    }
+#if DEBUG_RESAMPLING
+    ALOGD("[%d] - quadratic (%0.3f, %0.3f), linear (%0.3f, %0.3f)", id,
+            x0 + dx, y0 + dy, *inOutX, *inOutY);
+#endif
+    *inOutX = x0 + dx;
+    *inOutY = y0 + dy;
+}
+
 bool InputConsumer::shouldResampleTool(int32_t toolType) {
     return toolType == AMOTION_EVENT_TOOL_TYPE_FINGER
             || toolType == AMOTION_EVENT_TOOL_TYPE_UNKNOWN;
@@ -836,40 +1425,59 @@ status_t InputConsumer::sendFinishedSignal(uint32_t seq, bool handled) {
                  mSeqChains.removeAt(i);
              }
         }
-        status_t status = OK;
-        while (!status && chainIndex > 0) {
-            chainIndex--;
-            status = sendUnchainedFinishedSignal(chainSeqs[chainIndex], handled);
+
+        // Send the finished signals for the whole batch at once, oldest first.
+        size_t msgCount = chainIndex + 1;
+        mFinishedMsgs.resize(msgCount);
+        InputMessage* msgs = mFinishedMsgs.editArray();
+        for (size_t i = 0; i < chainIndex; i++) {
+            initializeFinishedMessage(&msgs[i], chainSeqs[chainIndex - 1 - i], handled);
         }
+        initializeFinishedMessage(&msgs[chainIndex], seq, handled);
+        size_t sentCount;
+        status_t status = mChannel->sendMessages(msgs, msgCount, &sentCount);
         if (status) {
-            // An error occurred so at least one signal was not sent, reconstruct the chain.
-            do {
+            // At least one signal was not sent, reconstruct the chain for the rest.
+            for (size_t i = sentCount; i + 1 < msgCount; i++) {
                 SeqChain seqChain;
-                seqChain.seq = chainIndex != 0 ? chainSeqs[chainIndex - 1] : seq;
-                seqChain.chain = chainSeqs[chainIndex];
+                seqChain.seq = msgs[i + 1].body.finished.seq;
+                seqChain.chain = msgs[i].body.finished.seq;
                 mSeqChains.push(seqChain);
-                if (chainIndex != 0) {
-                    chainIndex--;
-                }
-            } while (chainIndex > 0);
-            return status;
+            }
         }
+        return status;
     }
 
-    // Send finished signal for the last message in the batch.
-    return sendUnchainedFinishedSignal(seq, handled);
-}
-
-status_t InputConsumer::sendUnchainedFinishedSignal(uint32_t seq, bool handled) {
+    // Send finished signal for the only message.
     InputMessage msg;
-    msg.header.type = InputMessage::TYPE_FINISHED;
-    msg.body.finished.seq = seq;
-    msg.body.finished.handled = handled;
+    initializeFinishedMessage(&msg, seq, handled);
     return mChannel->sendMessage(&msg);
 }
 
+void InputConsumer::initializeFinishedMessage(InputMessage* msg, uint32_t seq, bool handled) {
+    msg->header.type = InputMessage::TYPE_FINISHED;
+    msg->body.finished.seq = seq;
+    msg->body.finished.handled = handled;
+}
+
+status_t InputConsumer::receiveMessage(InputMessage* msg) {
+    if (mReceivedIndex == mReceivedCount) {
+        mReceivedIndex = 0;
+        mReceivedCount = 0;
+        status_t result = mChannel->receiveMessages(mReceivedMsgs, RECEIVE_BATCH_SIZE,
+                &mReceivedCount);
+        if (result) {
+            return result;
+        }
+    }
+    const InputMessage& received = mReceivedMsgs[mReceivedIndex++];
+    memcpy(msg, &received, received.size());
+    return OK;
+}
+
 bool InputConsumer::hasDeferredEvent() const {
-    return mMsgDeferred;
+    // Messages already read from the channel do not make its fd readable either.
+    return mMsgDeferred || mReceivedIndex < mReceivedCount;
 }
 
 bool InputConsumer::hasPendingBatch() const {
@@ -92,18 +92,13 @@ KeyCharacterMap::KeyCharacterMap() :
 }
 
 KeyCharacterMap::KeyCharacterMap(const KeyCharacterMap& other) :
-    RefBase(), mType(other.mType), mKeysByScanCode(other.mKeysByScanCode),
+    RefBase(), mKeys(other.mKeys), mBehaviors(other.mBehaviors),
+    mKeyIndices(other.mKeyIndices), mCharacterKeys(other.mCharacterKeys),
+    mType(other.mType), mKeysByScanCode(other.mKeysByScanCode),
     mKeysByUsageCode(other.mKeysByUsageCode) {
-    for (size_t i = 0; i < other.mKeys.size(); i++) {
-        mKeys.add(other.mKeys.keyAt(i), new Key(*other.mKeys.valueAt(i)));
-    }
 }
 
 KeyCharacterMap::~KeyCharacterMap() {
-    for (size_t i = 0; i < mKeys.size(); i++) {
-        Key* key = mKeys.editValueAt(i);
-        delete key;
-    }
 }
 
 status_t KeyCharacterMap::load(const String8& filename,
@@ -172,17 +167,14 @@ sp<KeyCharacterMap> KeyCharacterMap::combine(const sp<KeyCharacterMap>& base,
     }
 
     sp<KeyCharacterMap> map = new KeyCharacterMap(*base.get());
-    for (size_t i = 0; i < overlay->mKeys.size(); i++) {
-        int32_t keyCode = overlay->mKeys.keyAt(i);
-        Key* key = overlay->mKeys.valueAt(i);
-        ssize_t oldIndex = map->mKeys.indexOfKey(keyCode);
-        if (oldIndex >= 0) {
-            delete map->mKeys.valueAt(oldIndex);
-            map->mKeys.editValueAt(oldIndex) = new Key(*key);
-        } else {
-            map->mKeys.add(keyCode, new Key(*key));
-        }
+    KeyDefinitions keys;
+    base->getKeyDefinitions(&keys);
+    KeyDefinitions overlayKeys;
+    overlay->getKeyDefinitions(&overlayKeys);
+    for (size_t i = 0; i < overlayKeys.size(); i++) {
+        keys.replaceValueFor(overlayKeys.keyAt(i), overlayKeys.valueAt(i));
     }
+    map->setKeys(keys);
 
     for (size_t i = 0; i < overlay->mKeysByScanCode.size(); i++) {
         map->mKeysByScanCode.replaceValueFor(overlay->mKeysByScanCode.keyAt(i),
@@ -273,7 +265,9 @@ char16_t KeyCharacterMap::getMatch(int32_t keyCode, const char16_t* chars, size_
         // Try to find the most general behavior that maps to this character.
         // For example, the base key behavior will usually be last in the list.
         // However, if we find a perfect meta state match for one behavior then use that one.
-        for (const Behavior* behavior = key->firstBehavior; behavior; behavior = behavior->next) {
+        const Behavior* behaviors = mBehaviors.array() + key->firstBehavior;
+        for (size_t b = 0; b < key->numBehaviors; b++) {
+            const Behavior* behavior = &behaviors[b];
             if (behavior->character) {
                 for (size_t i = 0; i < numChars; i++) {
                     if (behavior->character == chars[i]) {
@@ -299,6 +293,9 @@ bool KeyCharacterMap::getEvents(int32_t deviceId, const char16_t* chars, size_t
         Vector<KeyEvent>& outEvents) const {
     nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
 
+    // at least a down and an up per character
+    outEvents.setCapacity(outEvents.size() + numChars * 2);
+
     for (size_t i = 0; i < numChars; i++) {
         int32_t keyCode, metaState;
         char16_t ch = chars[i];
@@ -401,11 +398,99 @@ void KeyCharacterMap::tryRemapKey(int32_t keyCode, int32_t metaState,
 #endif
 }
 
+void KeyCharacterMap::setKeys(const KeyDefinitions& keys) {
+    mKeys.clear();
+    mBehaviors.clear();
+    mKeyIndices.clear();
+    mCharacterKeys.clear();
+
+    size_t numBehaviors = 0;
+    for (size_t i = 0; i < keys.size(); i++) {
+        numBehaviors += keys.valueAt(i).behaviors.size();
+    }
+    mKeys.setCapacity(keys.size());
+    mBehaviors.setCapacity(numBehaviors);
+
+    for (size_t i = 0; i < keys.size(); i++) {
+        const int32_t keyCode = keys.keyAt(i);
+        const KeyDefinition& definition = keys.valueAt(i);
+        Key key;
+        key.keyCode = keyCode;
+        key.label = definition.label;
+        key.number = definition.number;
+        key.firstBehavior = mBehaviors.size();
+        key.numBehaviors = definition.behaviors.size();
+        mKeys.add(key);
+        mBehaviors.appendVector(definition.behaviors);
+
+        if (keyCode >= 0 && keyCode < MAX_INDEXED_KEY_CODE) {
+            if (size_t(keyCode) >= mKeyIndices.size()) {
+                mKeyIndices.insertAt(0, mKeyIndices.size(),
+                        keyCode + 1 - mKeyIndices.size());
+            }
+            mKeyIndices.editItemAt(keyCode) = uint16_t(i + 1);
+        }
+
+        // Characters are typed with the key with the lowest key code that
+        // generates them, using its most general behavior for the character.
+        for (size_t b = 0; b < definition.behaviors.size(); b++) {
+            const Behavior& behavior = definition.behaviors.itemAt(b);
+            if (!behavior.character) {
+                continue;
+            }
+            ssize_t index = mCharacterKeys.indexOfKey(behavior.character);
+            if (index < 0) {
+                CharacterKey characterKey;
+                characterKey.keyCode = keyCode;
+                characterKey.metaState = behavior.metaState;
+                mCharacterKeys.add(behavior.character, characterKey);
+            } else if (mCharacterKeys.valueAt(index).keyCode == keyCode) {
+                mCharacterKeys.editValueAt(index).metaState = behavior.metaState;
+            }
+        }
+    }
+}
+
+void KeyCharacterMap::getKeyDefinitions(KeyDefinitions* outKeys) const {
+    outKeys->clear();
+    outKeys->setCapacity(mKeys.size());
+    for (size_t i = 0; i < mKeys.size(); i++) {
+        const Key& key = mKeys.itemAt(i);
+        KeyDefinition definition;
+        definition.label = key.label;
+        definition.number = key.number;
+        definition.behaviors.appendArray(mBehaviors.array() + key.firstBehavior,
+                key.numBehaviors);
+        outKeys->add(key.keyCode, definition);
+    }
+}
+
 bool KeyCharacterMap::getKey(int32_t keyCode, const Key** outKey) const {
-    ssize_t index = mKeys.indexOfKey(keyCode);
-    if (index >= 0) {
-        *outKey = mKeys.valueAt(index);
-        return true;
+    if (keyCode >= 0 && keyCode < MAX_INDEXED_KEY_CODE) {
+        if (size_t(keyCode) < mKeyIndices.size()) {
+            uint16_t index = mKeyIndices.itemAt(keyCode);
+            if (index) {
+                *outKey = &mKeys.itemAt(index - 1);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    size_t low = 0;
+    size_t high = mKeys.size();
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        const Key& key = mKeys.itemAt(mid);
+        if (key.keyCode == keyCode) {
+            *outKey = &key;
+            return true;
+        }
+        if (key.keyCode < keyCode) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
     }
     return false;
 }
@@ -414,14 +499,13 @@ bool KeyCharacterMap::getKeyBehavior(int32_t keyCode, int32_t metaState,
         const Key** outKey, const Behavior** outBehavior) const {
     const Key* key;
     if (getKey(keyCode, &key)) {
-        const Behavior* behavior = key->firstBehavior;
-        while (behavior) {
-            if (matchesMetaState(metaState, behavior->metaState)) {
+        const Behavior* behaviors = mBehaviors.array() + key->firstBehavior;
+        for (size_t b = 0; b < key->numBehaviors; b++) {
+            if (matchesMetaState(metaState, behaviors[b].metaState)) {
                 *outKey = key;
-                *outBehavior = behavior;
+                *outBehavior = &behaviors[b];
                 return true;
             }
-            behavior = behavior->next;
         }
     }
     return false;
@@ -463,24 +547,14 @@ bool KeyCharacterMap::findKey(char16_t ch, int32_t* outKeyCode, int32_t* outMeta
         return false;
     }
 
-    for (size_t i = 0; i < mKeys.size(); i++) {
-        const Key* key = mKeys.valueAt(i);
-
-        // Try to find the most general behavior that maps to this character.
-        // For example, the base key behavior will usually be last in the list.
-        const Behavior* found = NULL;
-        for (const Behavior* behavior = key->firstBehavior; behavior; behavior = behavior->next) {
-            if (behavior->character == ch) {
-                found = behavior;
-            }
-        }
-        if (found) {
-            *outKeyCode = mKeys.keyAt(i);
-            *outMetaState = found->metaState;
-            return true;
-        }
+    ssize_t index = mCharacterKeys.indexOfKey(ch);
+    if (index < 0) {
+        return false;
     }
-    return false;
+    const CharacterKey& characterKey = mCharacterKeys.valueAt(index);
+    *outKeyCode = characterKey.keyCode;
+    *outMetaState = characterKey.metaState;
+    return true;
 }
 
 void KeyCharacterMap::addKey(Vector<KeyEvent>& outEvents,
@@ -612,6 +686,7 @@ sp<KeyCharacterMap> KeyCharacterMap::readFromParcel(Parcel* parcel) {
         return NULL;
     }
 
+    KeyDefinitions keys;
     for (size_t i = 0; i < numKeys; i++) {
         int32_t keyCode = parcel->readInt32();
         char16_t label = parcel->readInt32();
@@ -620,12 +695,10 @@ sp<KeyCharacterMap> KeyCharacterMap::readFromParcel(Parcel* parcel) {
             return NULL;
         }
 
-        Key* key = new Key();
-        key->label = label;
-        key->number = number;
-        map->mKeys.add(keyCode, key);
+        KeyDefinition key;
+        key.label = label;
+        key.number = number;
 
-        Behavior* lastBehavior = NULL;
         while (parcel->readInt32()) {
             int32_t metaState = parcel->readInt32();
             char16_t character = parcel->readInt32();
@@ -635,23 +708,20 @@ sp<KeyCharacterMap> KeyCharacterMap::readFromParcel(Parcel* parcel) {
                 return NULL;
             }
 
-            Behavior* behavior = new Behavior();
-            behavior->metaState = metaState;
-            behavior->character = character;
-            behavior->fallbackKeyCode = fallbackKeyCode;
-            behavior->replacementKeyCode = replacementKeyCode;
-            if (lastBehavior) {
-                lastBehavior->next = behavior;
-            } else {
-                key->firstBehavior = behavior;
-            }
-            lastBehavior = behavior;
+            Behavior behavior;
+            behavior.metaState = metaState;
+            behavior.character = character;
+            behavior.fallbackKeyCode = fallbackKeyCode;
+            behavior.replacementKeyCode = replacementKeyCode;
+            key.behaviors.add(behavior);
         }
 
         if (parcel->errorCheck()) {
             return NULL;
         }
+        keys.replaceValueFor(keyCode, key);
     }
+    map->setKeys(keys);
     return map;
 }
 
@@ -661,13 +731,13 @@ void KeyCharacterMap::writeToParcel(Parcel* parcel) const {
     size_t numKeys = mKeys.size();
     parcel->writeInt32(numKeys);
     for (size_t i = 0; i < numKeys; i++) {
-        int32_t keyCode = mKeys.keyAt(i);
-        const Key* key = mKeys.valueAt(i);
-        parcel->writeInt32(keyCode);
+        const Key* key = &mKeys.itemAt(i);
+        parcel->writeInt32(key->keyCode);
         parcel->writeInt32(key->label);
         parcel->writeInt32(key->number);
-        for (const Behavior* behavior = key->firstBehavior; behavior != NULL;
-                behavior = behavior->next) {
+        const Behavior* behaviors = mBehaviors.array() + key->firstBehavior;
+        for (size_t b = 0; b < key->numBehaviors; b++) {
+            const Behavior* behavior = &behaviors[b];
             parcel->writeInt32(1);
             parcel->writeInt32(behavior->metaState);
             parcel->writeInt32(behavior->character);
@@ -680,38 +750,17 @@ void KeyCharacterMap::writeToParcel(Parcel* parcel) const {
 #endif
 
 
-// --- KeyCharacterMap::Key ---
+// --- KeyCharacterMap::KeyDefinition ---
 
-KeyCharacterMap::Key::Key() :
-        label(0), number(0), firstBehavior(NULL) {
-}
-
-KeyCharacterMap::Key::Key(const Key& other) :
-        label(other.label), number(other.number),
-        firstBehavior(other.firstBehavior ? new Behavior(*other.firstBehavior) : NULL) {
-}
-
-KeyCharacterMap::Key::~Key() {
-    Behavior* behavior = firstBehavior;
-    while (behavior) {
-        Behavior* next = behavior->next;
-        delete behavior;
-        behavior = next;
-    }
+KeyCharacterMap::KeyDefinition::KeyDefinition() :
+        label(0), number(0) {
 }
 
 
 // --- KeyCharacterMap::Behavior ---
 
 KeyCharacterMap::Behavior::Behavior() :
-        next(NULL), metaState(0), character(0), fallbackKeyCode(0), replacementKeyCode(0) {
-}
-
-KeyCharacterMap::Behavior::Behavior(const Behavior& other) :
-        next(other.next ? new Behavior(*other.next) : NULL),
-        metaState(other.metaState), character(other.character),
-        fallbackKeyCode(other.fallbackKeyCode),
-        replacementKeyCode(other.replacementKeyCode) {
+        metaState(0), character(0), fallbackKeyCode(0), replacementKeyCode(0) {
 }
 
 
@@ -803,6 +852,7 @@ status_t KeyCharacterMap::Parser::parse() {
         }
     }
 
+    mMap->setKeys(mKeys);
     return NO_ERROR;
 }
 
@@ -900,7 +950,7 @@ status_t KeyCharacterMap::Parser::parseKey() {
                 keyCodeToken.string());
         return BAD_VALUE;
     }
-    if (mMap->mKeys.indexOfKey(keyCode) >= 0) {
+    if (mKeys.indexOfKey(keyCode) >= 0) {
         ALOGE("%s: Duplicate entry for key code '%s'.", mTokenizer->getLocation().string(),
                 keyCodeToken.string());
         return BAD_VALUE;
@@ -918,13 +968,13 @@ status_t KeyCharacterMap::Parser::parseKey() {
     ALOGD("Parsed beginning of key: keyCode=%d.", keyCode);
 #endif
     mKeyCode = keyCode;
-    mMap->mKeys.add(keyCode, new Key());
+    mKeys.add(keyCode, KeyDefinition());
     mState = STATE_KEY;
     return NO_ERROR;
 }
 
 status_t KeyCharacterMap::Parser::parseKeyProperty() {
-    Key* key = mMap->mKeys.valueFor(mKeyCode);
+    KeyDefinition& key = mKeys.editValueFor(mKeyCode);
     String8 token = mTokenizer->nextToken(WHITESPACE_OR_PROPERTY_DELIMITER);
     if (token == "}") {
         mState = STATE_TOP;
@@ -1066,44 +1116,43 @@ status_t KeyCharacterMap::Parser::parseKeyProperty() {
         const Property& property = properties.itemAt(i);
         switch (property.property) {
         case PROPERTY_LABEL:
-            if (key->label) {
+            if (key.label) {
                 ALOGE("%s: Duplicate label for key.",
                         mTokenizer->getLocation().string());
                 return BAD_VALUE;
             }
-            key->label = behavior.character;
+            key.label = behavior.character;
 #if DEBUG_PARSER
-            ALOGD("Parsed key label: keyCode=%d, label=%d.", mKeyCode, key->label);
+            ALOGD("Parsed key label: keyCode=%d, label=%d.", mKeyCode, key.label);
 #endif
             break;
         case PROPERTY_NUMBER:
-            if (key->number) {
+            if (key.number) {
                 ALOGE("%s: Duplicate number for key.",
                         mTokenizer->getLocation().string());
                 return BAD_VALUE;
             }
-            key->number = behavior.character;
+            key.number = behavior.character;
 #if DEBUG_PARSER
-            ALOGD("Parsed key number: keyCode=%d, number=%d.", mKeyCode, key->number);
+            ALOGD("Parsed key number: keyCode=%d, number=%d.", mKeyCode, key.number);
 #endif
             break;
         case PROPERTY_META: {
-            for (Behavior* b = key->firstBehavior; b; b = b->next) {
-                if (b->metaState == property.metaState) {
+            for (size_t b = 0; b < key.behaviors.size(); b++) {
+                if (key.behaviors.itemAt(b).metaState == property.metaState) {
                     ALOGE("%s: Duplicate key behavior for modifier.",
                             mTokenizer->getLocation().string());
                     return BAD_VALUE;
                 }
             }
-            Behavior* newBehavior = new Behavior(behavior);
-            newBehavior->metaState = property.metaState;
-            newBehavior->next = key->firstBehavior;
-            key->firstBehavior = newBehavior;
+            Behavior newBehavior(behavior);
+            newBehavior.metaState = property.metaState;
+            key.behaviors.insertAt(newBehavior, 0);
 #if DEBUG_PARSER
             ALOGD("Parsed key meta: keyCode=%d, meta=0x%x, char=%d, fallback=%d replace=%d.",
                     mKeyCode,
-                    newBehavior->metaState, newBehavior->character,
-                    newBehavior->fallbackKeyCode, newBehavior->replacementKeyCode);
+                    newBehavior.metaState, newBehavior.character,
+                    newBehavior.fallbackKeyCode, newBehavior.replacementKeyCode);
 #endif
             break;
         }
@@ -1112,13 +1161,13 @@ status_t KeyCharacterMap::Parser::parseKeyProperty() {
     return NO_ERROR;
 }
 
-status_t KeyCharacterMap::Parser::finishKey(Key* key) {
+status_t KeyCharacterMap::Parser::finishKey(KeyDefinition& key) {
     // Fill in default number property.
-    if (!key->number) {
+    if (!key.number) {
         char16_t digit = 0;
         char16_t symbol = 0;
-        for (Behavior* b = key->firstBehavior; b; b = b->next) {
-            char16_t ch = b->character;
+        for (size_t b = 0; b < key.behaviors.size(); b++) {
+            char16_t ch = key.behaviors.itemAt(b).character;
             if (ch) {
                 if (ch >= '0' && ch <= '9') {
                     digit = ch;
@@ -1129,7 +1178,7 @@ status_t KeyCharacterMap::Parser::finishKey(Key* key) {
                 }
             }
         }
-        key->number = digit ? digit : symbol;
+        key.number = digit ? digit : symbol;
     }
     return NO_ERROR;
 }
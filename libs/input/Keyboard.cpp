@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <limits.h>
+#include <sys/stat.h>
 
 #include <input/Keyboard.h>
 #include <input/InputEventLabels.h>
@@ -26,10 +27,113 @@
 #include <input/KeyCharacterMap.h>
 #include <input/InputDevice.h>
 #include <utils/Errors.h>
+#include <utils/KeyedVector.h>
 #include <utils/Log.h>
+#include <utils/Mutex.h>
 
 namespace android {
 
+// --- KeyMapCache ---
+
+/*
+ * Holds on to the maps parsed from key layout and key character map files so that
+ * devices sharing a file, or opened again on hotplug and reconfiguration, skip the
+ * parser. The maps are immutable once loaded. An entry is only reused while the file
+ * keeps the same inode, size and modification time.
+ */
+template<typename T>
+class KeyMapCache {
+public:
+    KeyMapCache() : mUseCount(0) { }
+
+    bool get(const String8& path, const struct stat& st, sp<T>* outMap) {
+        AutoMutex _l(mLock);
+        ssize_t index = mEntries.indexOfKey(path);
+        if (index < 0) {
+            return false;
+        }
+        Entry& entry = mEntries.editValueAt(index);
+        if (entry.ino != st.st_ino || entry.size != st.st_size
+                || entry.mtime.tv_sec != st.st_mtim.tv_sec
+                || entry.mtime.tv_nsec != st.st_mtim.tv_nsec) {
+            mEntries.removeItemsAt(index);
+            return false;
+        }
+        entry.lastUse = ++mUseCount;
+        *outMap = entry.map;
+        return true;
+    }
+
+    void put(const String8& path, const struct stat& st, const sp<T>& map) {
+        AutoMutex _l(mLock);
+        if (mEntries.indexOfKey(path) < 0 && mEntries.size() >= MAX_ENTRIES) {
+            size_t oldest = 0;
+            for (size_t i = 1; i < mEntries.size(); i++) {
+                if (mEntries.valueAt(i).lastUse < mEntries.valueAt(oldest).lastUse) {
+                    oldest = i;
+                }
+            }
+            mEntries.removeItemsAt(oldest);
+        }
+        Entry entry;
+        entry.ino = st.st_ino;
+        entry.size = st.st_size;
+        entry.mtime = st.st_mtim;
+        entry.lastUse = ++mUseCount;
+        entry.map = map;
+        mEntries.replaceValueFor(path, entry);
+    }
+
+private:
+    // Plenty for the handful of files shared by the attached devices.
+    enum { MAX_ENTRIES = 32 };
+
+    struct Entry {
+        ino_t ino;
+        off_t size;
+        struct timespec mtime;
+        uint64_t lastUse;
+        sp<T> map;
+    };
+
+    Mutex mLock;
+    KeyedVector<String8, Entry> mEntries;
+    uint64_t mUseCount;
+};
+
+static status_t loadCachedKeyLayoutMap(const String8& path, sp<KeyLayoutMap>* outMap) {
+    static KeyMapCache<KeyLayoutMap> cache;
+
+    struct stat st;
+    bool cacheable = !stat(path.string(), &st);
+    if (cacheable && cache.get(path, st, outMap)) {
+        return OK;
+    }
+
+    status_t status = KeyLayoutMap::load(path, outMap);
+    if (!status && cacheable) {
+        cache.put(path, st, *outMap);
+    }
+    return status;
+}
+
+static status_t loadCachedKeyCharacterMap(const String8& path, sp<KeyCharacterMap>* outMap) {
+    static KeyMapCache<KeyCharacterMap> cache;
+
+    struct stat st;
+    bool cacheable = !stat(path.string(), &st);
+    if (cacheable && cache.get(path, st, outMap)) {
+        return OK;
+    }
+
+    status_t status = KeyCharacterMap::load(path, KeyCharacterMap::FORMAT_BASE, outMap);
+    if (!status && cacheable) {
+        cache.put(path, st, *outMap);
+    }
+    return status;
+}
+
+
 // --- KeyMap ---
 
 KeyMap::KeyMap() {
@@ -111,7 +215,7 @@ status_t KeyMap::loadKeyLayout(const InputDeviceIdentifier& deviceIdentifier,
         return NAME_NOT_FOUND;
     }
 
-    status_t status = KeyLayoutMap::load(path, &keyLayoutMap);
+    status_t status = loadCachedKeyLayoutMap(path, &keyLayoutMap);
     if (status) {
         return status;
     }
@@ -128,8 +232,7 @@ status_t KeyMap::loadKeyCharacterMap(const InputDeviceIdentifier& deviceIdentifi
         return NAME_NOT_FOUND;
     }
 
-    status_t status = KeyCharacterMap::load(path,
-            KeyCharacterMap::FORMAT_BASE, &keyCharacterMap);
+    status_t status = loadCachedKeyCharacterMap(path, &keyCharacterMap);
     if (status) {
         return status;
     }
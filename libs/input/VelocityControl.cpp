@@ -32,6 +32,7 @@ namespace android {
 // --- VelocityControl ---
 
 const nsecs_t VelocityControl::STOP_TIME;
+const nsecs_t VelocityControl::ESTIMATE_INTERVAL;
 
 VelocityControl::VelocityControl() {
     reset();
@@ -47,64 +48,121 @@ void VelocityControl::reset() {
     mRawPosition.x = 0;
     mRawPosition.y = 0;
     mVelocityTracker.clear();
+    mLastEstimateTime = LLONG_MIN;
+    mScale = mParameters.scale;
 }
 
 void VelocityControl::move(nsecs_t eventTime, float* deltaX, float* deltaY) {
     if ((deltaX && *deltaX) || (deltaY && *deltaY)) {
-        if (eventTime >= mLastMovementTime + STOP_TIME) {
-#if DEBUG_ACCELERATION
-            ALOGD("VelocityControl: stopped, last movement was %0.3fms ago",
-                    (eventTime - mLastMovementTime) * 0.000001f);
-#endif
-            reset();
-        }
+        addMovement(eventTime, deltaX ? *deltaX : 0, deltaY ? *deltaY : 0);
 
-        mLastMovementTime = eventTime;
+        float scale = getScale();
         if (deltaX) {
-            mRawPosition.x += *deltaX;
+            *deltaX *= scale;
         }
         if (deltaY) {
-            mRawPosition.y += *deltaY;
+            *deltaY *= scale;
         }
-        mVelocityTracker.addMovement(eventTime, BitSet32(BitSet32::valueForBit(0)), &mRawPosition);
-
-        float vx, vy;
-        float scale = mParameters.scale;
-        if (mVelocityTracker.getVelocity(0, &vx, &vy)) {
-            float speed = hypotf(vx, vy) * scale;
-            if (speed >= mParameters.highThreshold) {
-                // Apply full acceleration above the high speed threshold.
-                scale *= mParameters.acceleration;
-            } else if (speed > mParameters.lowThreshold) {
-                // Linearly interpolate the acceleration to apply between the low and high
-                // speed thresholds.
-                scale *= 1 + (speed - mParameters.lowThreshold)
-                        / (mParameters.highThreshold - mParameters.lowThreshold)
-                        * (mParameters.acceleration - 1);
-            }
+    }
+}
 
-#if DEBUG_ACCELERATION
-            ALOGD("VelocityControl(%0.3f, %0.3f, %0.3f, %0.3f): "
-                    "vx=%0.3f, vy=%0.3f, speed=%0.3f, accel=%0.3f",
-                    mParameters.scale, mParameters.lowThreshold, mParameters.highThreshold,
-                    mParameters.acceleration,
-                    vx, vy, speed, scale / mParameters.scale);
-#endif
-        } else {
-#if DEBUG_ACCELERATION
-            ALOGD("VelocityControl(%0.3f, %0.3f, %0.3f, %0.3f): unknown velocity",
-                    mParameters.scale, mParameters.lowThreshold, mParameters.highThreshold,
-                    mParameters.acceleration);
-#endif
+void VelocityControl::move(const nsecs_t* eventTimes, float* deltaX, float* deltaY,
+        size_t count) {
+    // The samples from 'first' on belong to the current movement.
+    size_t first = 0;
+    bool moved = false;
+    for (size_t i = 0; i < count; i++) {
+        const float dx = deltaX ? deltaX[i] : 0;
+        const float dy = deltaY ? deltaY[i] : 0;
+        if (!dx && !dy) {
+            continue;
+        }
+        if (moved && eventTimes[i] >= mLastMovementTime + STOP_TIME) {
+            // The movement before the pause ends here, scale it before the
+            // tracker is reset.
+            const float scale = getScale();
+            for (; first < i; first++) {
+                if (deltaX) {
+                    deltaX[first] *= scale;
+                }
+                if (deltaY) {
+                    deltaY[first] *= scale;
+                }
+            }
         }
+        addMovement(eventTimes[i], dx, dy);
+        moved = true;
+    }
+    if (!moved) {
+        return;
+    }
 
+    const float scale = getScale();
+    for (; first < count; first++) {
         if (deltaX) {
-            *deltaX *= scale;
+            deltaX[first] *= scale;
         }
         if (deltaY) {
-            *deltaY *= scale;
+            deltaY[first] *= scale;
         }
     }
 }
 
+void VelocityControl::addMovement(nsecs_t eventTime, float deltaX, float deltaY) {
+    if (eventTime >= mLastMovementTime + STOP_TIME) {
+#if DEBUG_ACCELERATION
+        ALOGD("VelocityControl: stopped, last movement was %0.3fms ago",
+                (eventTime - mLastMovementTime) * 0.000001f);
+#endif
+        reset();
+    }
+
+    mLastMovementTime = eventTime;
+    mRawPosition.x += deltaX;
+    mRawPosition.y += deltaY;
+    mVelocityTracker.addMovement(eventTime, BitSet32(BitSet32::valueForBit(0)), &mRawPosition);
+}
+
+float VelocityControl::getScale() {
+    if (mLastEstimateTime != LLONG_MIN
+            && mLastMovementTime < mLastEstimateTime + ESTIMATE_INTERVAL) {
+        return mScale;
+    }
+
+    float vx, vy;
+    float scale = mParameters.scale;
+    if (mVelocityTracker.getVelocity(0, &vx, &vy)) {
+        float speed = hypotf(vx, vy) * scale;
+        if (speed >= mParameters.highThreshold) {
+            // Apply full acceleration above the high speed threshold.
+            scale *= mParameters.acceleration;
+        } else if (speed > mParameters.lowThreshold) {
+            // Linearly interpolate the acceleration to apply between the low and high
+            // speed thresholds.
+            scale *= 1 + (speed - mParameters.lowThreshold)
+                    / (mParameters.highThreshold - mParameters.lowThreshold)
+                    * (mParameters.acceleration - 1);
+        }
+
+#if DEBUG_ACCELERATION
+        ALOGD("VelocityControl(%0.3f, %0.3f, %0.3f, %0.3f): "
+                "vx=%0.3f, vy=%0.3f, speed=%0.3f, accel=%0.3f",
+                mParameters.scale, mParameters.lowThreshold, mParameters.highThreshold,
+                mParameters.acceleration,
+                vx, vy, speed, scale / mParameters.scale);
+#endif
+        // Only a known velocity is worth keeping; an unknown one usually
+        // becomes known with the next movement.
+        mLastEstimateTime = mLastMovementTime;
+        mScale = scale;
+    } else {
+#if DEBUG_ACCELERATION
+        ALOGD("VelocityControl(%0.3f, %0.3f, %0.3f, %0.3f): unknown velocity",
+                mParameters.scale, mParameters.lowThreshold, mParameters.highThreshold,
+                mParameters.acceleration);
+#endif
+    }
+    return scale;
+}
+
 } // namespace android
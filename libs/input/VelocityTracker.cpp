@@ -25,6 +25,7 @@
 
 #include <math.h>
 #include <limits.h>
+#include <string.h>
 
 #include <cutils/properties.h>
 #include <input/VelocityTracker.h>
@@ -162,6 +163,17 @@ VelocityTrackerStrategy* VelocityTracker::createStrategy(const char* strategy) {
         // of the velocity when the finger is released.
         return new LeastSquaresVelocityTrackerStrategy(3);
     }
+    if (!strcmp("ilsq1", strategy)) {
+        // 1st order least squares, updated incrementally.  Quality: POOR.
+        // Same fit as 'lsq1'.
+        return new IncrementalLeastSquaresVelocityTrackerStrategy(1);
+    }
+    if (!strcmp("ilsq2", strategy)) {
+        // 2nd order least squares, updated incrementally.  Quality: VERY GOOD.
+        // Same fit as 'lsq2' up to rounding, but getting an estimate takes constant time
+        // instead of going over up to 20 samples twice.
+        return new IncrementalLeastSquaresVelocityTrackerStrategy(2);
+    }
     if (!strcmp("wlsq2-delta", strategy)) {
         // 2nd order weighted least squares, delta weighting.  Quality: EXPERIMENTAL
         return new LeastSquaresVelocityTrackerStrategy(2,
@@ -693,7 +705,237 @@ float LeastSquaresVelocityTrackerStrategy::chooseWeight(uint32_t index) const {
 }
 
 
-// --- IntegratingVelocityTrackerStrategy ---
+// --- IncrementalLeastSquaresVelocityTrackerStrategy ---
+
+const nsecs_t IncrementalLeastSquaresVelocityTrackerStrategy::HORIZON;
+const uint32_t IncrementalLeastSquaresVelocityTrackerStrategy::HISTORY_SIZE;
+const uint32_t IncrementalLeastSquaresVelocityTrackerStrategy::MAX_DEGREE;
+
+IncrementalLeastSquaresVelocityTrackerStrategy::IncrementalLeastSquaresVelocityTrackerStrategy(
+        uint32_t degree) :
+        mDegree(degree) {
+}
+
+IncrementalLeastSquaresVelocityTrackerStrategy::~IncrementalLeastSquaresVelocityTrackerStrategy() {
+}
+
+void IncrementalLeastSquaresVelocityTrackerStrategy::clear() {
+    mPointerIdBits.clear();
+}
+
+void IncrementalLeastSquaresVelocityTrackerStrategy::clearPointers(BitSet32 idBits) {
+    mPointerIdBits.value &= ~idBits.value;
+}
+
+void IncrementalLeastSquaresVelocityTrackerStrategy::addMovement(nsecs_t eventTime,
+        BitSet32 idBits, const VelocityTracker::Position* positions) {
+    // Like the history of LeastSquaresVelocityTrackerStrategy, the samples of a pointer
+    // only go back to the last movement without it.
+    uint32_t index = 0;
+    for (BitSet32 iterIdBits(idBits); !iterIdBits.isEmpty();) {
+        uint32_t id = iterIdBits.clearFirstMarkedBit();
+        State& state = mPointerState[id];
+        if (!mPointerIdBits.hasBit(id)) {
+            initState(state, eventTime);
+        }
+        addSample(state, eventTime, positions[index++]);
+    }
+
+    mPointerIdBits = idBits;
+}
+
+bool IncrementalLeastSquaresVelocityTrackerStrategy::getEstimator(uint32_t id,
+        VelocityTracker::Estimator* outEstimator) const {
+    outEstimator->clear();
+
+    if (!mPointerIdBits.hasBit(id)) {
+        return false;
+    }
+
+    const State& state = mPointerState[id];
+    const Sample& newest = state.samples[(state.first + state.count - 1) % HISTORY_SIZE];
+    outEstimator->time = newest.eventTime;
+    uint32_t degree = mDegree;
+    if (degree > state.count - 1) {
+        degree = state.count - 1;
+    }
+    if (degree >= 1 && solve(state, degree, outEstimator)) {
+#if DEBUG_STRATEGY
+        ALOGD("estimate: degree=%d, xCoeff=%s, yCoeff=%s, confidence=%f",
+                int(outEstimator->degree),
+                vectorToString(outEstimator->xCoeff, degree + 1).string(),
+                vectorToString(outEstimator->yCoeff, degree + 1).string(),
+                outEstimator->confidence);
+#endif
+        return true;
+    }
+
+    // No velocity data available for this pointer, but we do have its current position.
+    outEstimator->xCoeff[0] = newest.position.x;
+    outEstimator->yCoeff[0] = newest.position.y;
+    outEstimator->degree = 0;
+    outEstimator->confidence = 1;
+    return true;
+}
+
+void IncrementalLeastSquaresVelocityTrackerStrategy::initState(State& state,
+        nsecs_t eventTime) const {
+    state.first = 0;
+    state.count = 0;
+    resetSums(state, eventTime);
+}
+
+void IncrementalLeastSquaresVelocityTrackerStrategy::resetSums(State& state,
+        nsecs_t timeBase) {
+    state.timeBase = timeBase;
+    memset(state.t, 0, sizeof(state.t));
+    memset(state.xt, 0, sizeof(state.xt));
+    memset(state.yt, 0, sizeof(state.yt));
+    state.xx = 0;
+    state.yy = 0;
+}
+
+void IncrementalLeastSquaresVelocityTrackerStrategy::addSample(State& state,
+        nsecs_t eventTime, const VelocityTracker::Position& position) const {
+    if (state.count == HISTORY_SIZE) {
+        accumulate(state, state.samples[state.first], -1);
+        state.first = (state.first + 1) % HISTORY_SIZE;
+        state.count -= 1;
+    }
+    Sample& sample = state.samples[(state.first + state.count) % HISTORY_SIZE];
+    sample.eventTime = eventTime;
+    sample.position = position;
+    state.count += 1;
+    accumulate(state, sample, 1);
+
+    while (eventTime - state.samples[state.first].eventTime > HORIZON) {
+        accumulate(state, state.samples[state.first], -1);
+        state.first = (state.first + 1) % HISTORY_SIZE;
+        state.count -= 1;
+    }
+
+    // Keep the times small so that the sums stay accurate, by starting over from the
+    // oldest sample once the time base is two horizons old.
+    if (eventTime - state.timeBase > 2 * HORIZON) {
+        resetSums(state, state.samples[state.first].eventTime);
+        for (uint32_t i = 0; i < state.count; i++) {
+            accumulate(state, state.samples[(state.first + i) % HISTORY_SIZE], 1);
+        }
+    }
+}
+
+void IncrementalLeastSquaresVelocityTrackerStrategy::accumulate(State& state,
+        const Sample& sample, double sign) {
+    double t = (sample.eventTime - state.timeBase) * 0.000000001;
+    double x = sample.position.x;
+    double y = sample.position.y;
+    double tk = sign;
+    for (uint32_t k = 0; k <= 2 * MAX_DEGREE; k++) {
+        state.t[k] += tk;
+        if (k <= MAX_DEGREE) {
+            state.xt[k] += x * tk;
+            state.yt[k] += y * tk;
+        }
+        tk *= t;
+    }
+    state.xx += sign * x * x;
+    state.yy += sign * y * y;
+}
+
+/**
+ * Solves the normal equations of the least squares fit from the running sums, which is
+ * the same fit as solveLeastSquares() with all weights being 1, and writes the
+ * polynomial out relative to the time of the newest sample.
+ *
+ * Returns false if the fit is singular, such as when samples share a time.
+ */
+bool IncrementalLeastSquaresVelocityTrackerStrategy::solve(const State& state,
+        uint32_t degree, VelocityTracker::Estimator* outEstimator) {
+    // Gaussian elimination with partial pivoting on [A | bx by] where A[i][j] = t[i + j].
+    const uint32_t n = degree + 1;
+    double a[MAX_DEGREE + 1][MAX_DEGREE + 3];
+    for (uint32_t i = 0; i < n; i++) {
+        for (uint32_t j = 0; j < n; j++) {
+            a[i][j] = state.t[i + j];
+        }
+        a[i][n] = state.xt[i];
+        a[i][n + 1] = state.yt[i];
+    }
+    for (uint32_t col = 0; col < n; col++) {
+        uint32_t pivot = col;
+        for (uint32_t row = col + 1; row < n; row++) {
+            if (fabs(a[row][col]) > fabs(a[pivot][col])) {
+                pivot = row;
+            }
+        }
+        if (fabs(a[pivot][col]) <= 1e-9 * state.t[2 * col]) {
+#if DEBUG_STRATEGY
+            ALOGD("  - no solution, pivot=%f", a[pivot][col]);
+#endif
+            return false;
+        }
+        for (uint32_t j = 0; j < n + 2; j++) {
+            double swap = a[col][j];
+            a[col][j] = a[pivot][j];
+            a[pivot][j] = swap;
+        }
+        for (uint32_t row = col + 1; row < n; row++) {
+            double factor = a[row][col] / a[col][col];
+            for (uint32_t j = col; j < n + 2; j++) {
+                a[row][j] -= factor * a[col][j];
+            }
+        }
+    }
+    double bx[MAX_DEGREE + 1], by[MAX_DEGREE + 1];
+    for (uint32_t i = n; i != 0; ) {
+        i--;
+        bx[i] = a[i][n];
+        by[i] = a[i][n + 1];
+        for (uint32_t j = i + 1; j < n; j++) {
+            bx[i] -= a[i][j] * bx[j];
+            by[i] -= a[i][j] * by[j];
+        }
+        bx[i] /= a[i][i];
+        by[i] /= a[i][i];
+    }
+
+    // The coefficient of determination from the sums, as in solveLeastSquares(), where
+    // the residual sum of squares is sum((y - B t)^2) = yy - 2 B yt + B T B.
+    float det[2];
+    const double* b[2] = { bx, by };
+    const double* bt[2] = { state.xt, state.yt };
+    const double yy[2] = { state.xx, state.yy };
+    for (uint32_t axis = 0; axis < 2; axis++) {
+        double sserr = yy[axis];
+        for (uint32_t i = 0; i < n; i++) {
+            sserr -= 2 * b[axis][i] * bt[axis][i];
+            for (uint32_t j = 0; j < n; j++) {
+                sserr += b[axis][i] * b[axis][j] * state.t[i + j];
+            }
+        }
+        double sstot = yy[axis] - bt[axis][0] * bt[axis][0] / state.t[0];
+        det[axis] = sstot > 0.000001 ? float(1 - fmax(sserr, 0) / sstot) : 1;
+    }
+
+    // Shift the polynomials from timeBase to the newest sample.
+    const Sample& newest = state.samples[(state.first + state.count - 1) % HISTORY_SIZE];
+    double tn = (newest.eventTime - state.timeBase) * 0.000000001;
+    for (uint32_t i = 0; i < n; i++) {
+        // Coefficient i of p(s + tn) is the sum over j >= i of b[j] * C(j, i) * tn^(j - i).
+        double x = 0, y = 0, binomial = 1, power = 1;
+        for (uint32_t j = i; j < n; j++) {
+            x += bx[j] * binomial * power;
+            y += by[j] * binomial * power;
+            binomial = binomial * (j + 1) / (j + 1 - i);
+            power *= tn;
+        }
+        outEstimator->xCoeff[i] = float(x);
+        outEstimator->yCoeff[i] = float(y);
+    }
+    outEstimator->degree = degree;
+    outEstimator->confidence = det[0] * det[1];
+    return true;
+}
 
 IntegratingVelocityTrackerStrategy::IntegratingVelocityTrackerStrategy(uint32_t degree) :
         mDegree(degree) {
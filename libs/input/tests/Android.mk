@@ -5,7 +5,11 @@ LOCAL_PATH:= $(call my-dir)
 test_src_files := \
     InputChannel_test.cpp \
     InputEvent_test.cpp \
-    InputPublisherAndConsumer_test.cpp
+    InputPublisherAndConsumer_test.cpp \
+    KeyCharacterMap_test.cpp \
+    Keyboard_test.cpp \
+    VelocityControl_test.cpp \
+    VelocityTracker_test.cpp
 
 shared_libraries := \
     libinput \
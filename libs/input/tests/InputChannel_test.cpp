@@ -155,5 +155,205 @@ TEST_F(InputChannelTest, SendSignal_WhenPeerClosed_ReturnsAnError) {
             << "sendMessage should have returned DEAD_OBJECT";
 }
 
+TEST_F(InputChannelTest, SendMotionMessage_WithFewAxes_ReceivesSameCoords) {
+    sp<InputChannel> serverChannel, clientChannel;
+
+    status_t result = InputChannel::openInputChannelPair(String8("channel name"),
+            serverChannel, clientChannel);
+
+    ASSERT_EQ(OK, result)
+            << "should have successfully opened a channel pair";
+
+    InputMessage serverMsg;
+    memset(&serverMsg, 0, sizeof(InputMessage));
+    serverMsg.header.type = InputMessage::TYPE_MOTION;
+    serverMsg.body.motion.seq = 7;
+    serverMsg.body.motion.action = AMOTION_EVENT_ACTION_MOVE;
+    serverMsg.body.motion.pointerCount = 2;
+    for (uint32_t i = 0; i < 2; i++) {
+        serverMsg.body.motion.pointers[i].properties.id = i + 3;
+        serverMsg.body.motion.pointers[i].coords.clear();
+        serverMsg.body.motion.pointers[i].coords.setAxisValue(AMOTION_EVENT_AXIS_X, 10.5f * i);
+        serverMsg.body.motion.pointers[i].coords.setAxisValue(AMOTION_EVENT_AXIS_Y, 20.5f * i);
+        serverMsg.body.motion.pointers[i].coords.setAxisValue(AMOTION_EVENT_AXIS_ORIENTATION,
+                0.25f);
+    }
+    EXPECT_EQ(OK, serverChannel->sendMessage(&serverMsg))
+            << "server channel should be able to send message to client channel";
+
+    InputMessage clientMsg;
+    ASSERT_EQ(OK, clientChannel->receiveMessage(&clientMsg))
+            << "client channel should be able to receive message from server channel";
+    EXPECT_EQ(7U, clientMsg.body.motion.seq);
+    EXPECT_EQ(AMOTION_EVENT_ACTION_MOVE, clientMsg.body.motion.action);
+    ASSERT_EQ(2U, clientMsg.body.motion.pointerCount);
+    for (uint32_t i = 0; i < 2; i++) {
+        EXPECT_EQ(int32_t(i + 3), clientMsg.body.motion.pointers[i].properties.id);
+        EXPECT_EQ(serverMsg.body.motion.pointers[i].coords,
+                clientMsg.body.motion.pointers[i].coords)
+                << "client channel should receive the coords of pointer " << i;
+    }
+}
+
+TEST_F(InputChannelTest, SendMessages_ReceiveMessages_TransferAllInOrder) {
+    sp<InputChannel> serverChannel, clientChannel;
+
+    status_t result = InputChannel::openInputChannelPair(String8("channel name"),
+            serverChannel, clientChannel);
+
+    ASSERT_EQ(OK, result)
+            << "should have successfully opened a channel pair";
+
+    const size_t count = 20;
+    InputMessage clientMsgs[count];
+    memset(clientMsgs, 0, sizeof(clientMsgs));
+    for (size_t i = 0; i < count; i++) {
+        clientMsgs[i].header.type = InputMessage::TYPE_FINISHED;
+        clientMsgs[i].body.finished.seq = i + 1;
+        clientMsgs[i].body.finished.handled = i % 2;
+    }
+    size_t sentCount;
+    EXPECT_EQ(OK, clientChannel->sendMessages(clientMsgs, count, &sentCount))
+            << "client channel should be able to send messages to server channel";
+    EXPECT_EQ(count, sentCount);
+
+    InputMessage serverMsgs[8];
+    size_t received = 0;
+    while (received < count) {
+        size_t receivedCount;
+        ASSERT_EQ(OK, serverChannel->receiveMessages(serverMsgs, 8, &receivedCount))
+                << "server channel should be able to receive the messages";
+        ASSERT_LE(receivedCount, 8U);
+        for (size_t i = 0; i < receivedCount; i++) {
+            EXPECT_EQ(InputMessage::TYPE_FINISHED, serverMsgs[i].header.type);
+            EXPECT_EQ(received + i + 1, serverMsgs[i].body.finished.seq);
+            EXPECT_EQ(bool((received + i) % 2), serverMsgs[i].body.finished.handled);
+        }
+        received += receivedCount;
+    }
+
+    size_t receivedCount;
+    EXPECT_EQ(WOULD_BLOCK, serverChannel->receiveMessages(serverMsgs, 8, &receivedCount))
+            << "receiveMessages should have returned WOULD_BLOCK";
+    EXPECT_EQ(0U, receivedCount);
+}
+
+TEST_F(InputChannelTest, ReceiveMessages_WhenPeerClosed_ReturnsAnError) {
+    sp<InputChannel> serverChannel, clientChannel;
+
+    status_t result = InputChannel::openInputChannelPair(String8("channel name"),
+            serverChannel, clientChannel);
+
+    ASSERT_EQ(OK, result)
+            << "should have successfully opened a channel pair";
+
+    serverChannel.clear(); // close server channel
+
+    InputMessage msgs[4];
+    size_t receivedCount;
+    EXPECT_EQ(DEAD_OBJECT, clientChannel->receiveMessages(msgs, 4, &receivedCount))
+            << "receiveMessages should have returned DEAD_OBJECT";
+}
+
+TEST_F(InputChannelTest, SendMessage_WithRing_HoldsMoreThanTheSocketAndReceivesAllInOrder) {
+    sp<InputChannel> serverChannel, clientChannel;
+
+    status_t result = InputChannel::openInputChannelPair(String8("channel name"),
+            1024 * 1024, serverChannel, clientChannel);
+
+    ASSERT_EQ(OK, result)
+            << "should have successfully opened a channel pair";
+    EXPECT_NE(-1, clientChannel->getRingFd());
+
+    InputMessage serverMsg;
+    memset(&serverMsg, 0, sizeof(InputMessage));
+    serverMsg.header.type = InputMessage::TYPE_MOTION;
+    serverMsg.body.motion.action = AMOTION_EVENT_ACTION_MOVE;
+    serverMsg.body.motion.pointerCount = 1;
+    serverMsg.body.motion.pointers[0].coords.setAxisValue(AMOTION_EVENT_AXIS_X, 1.0f);
+    serverMsg.body.motion.pointers[0].coords.setAxisValue(AMOTION_EVENT_AXIS_Y, 2.0f);
+
+    const uint32_t count = 2000;
+    for (uint32_t i = 0; i < count; i++) {
+        serverMsg.body.motion.seq = i + 1;
+        ASSERT_EQ(OK, serverChannel->sendMessage(&serverMsg))
+                << "server channel should be able to send message " << i << " to the ring";
+    }
+
+    InputMessage clientMsgs[4];
+    uint32_t received = 0;
+    while (received < count) {
+        size_t receivedCount;
+        ASSERT_EQ(OK, clientChannel->receiveMessages(clientMsgs, 4, &receivedCount))
+                << "client channel should be able to receive the messages";
+        for (size_t i = 0; i < receivedCount; i++) {
+            EXPECT_EQ(InputMessage::TYPE_MOTION, clientMsgs[i].header.type);
+            EXPECT_EQ(received + i + 1, clientMsgs[i].body.motion.seq);
+            EXPECT_EQ(serverMsg.body.motion.pointers[0].coords,
+                    clientMsgs[i].body.motion.pointers[0].coords);
+        }
+        received += receivedCount;
+    }
+
+    InputMessage clientMsg;
+    EXPECT_EQ(WOULD_BLOCK, clientChannel->receiveMessage(&clientMsg))
+            << "receiveMessage should have returned WOULD_BLOCK once the ring is empty";
+
+    clientMsg.header.type = InputMessage::TYPE_FINISHED;
+    clientMsg.body.finished.seq = count;
+    clientMsg.body.finished.handled = true;
+    EXPECT_EQ(OK, clientChannel->sendMessage(&clientMsg))
+            << "client channel should still send its finished signals over the socket";
+
+    InputMessage serverReply;
+    ASSERT_EQ(OK, serverChannel->receiveMessage(&serverReply))
+            << "server channel should be able to receive the finished signal";
+    EXPECT_EQ(InputMessage::TYPE_FINISHED, serverReply.header.type);
+    EXPECT_EQ(count, serverReply.body.finished.seq);
+}
+
+TEST_F(InputChannelTest, SendMessage_WithRing_WhenFull_ReturnsWouldBlock) {
+    sp<InputChannel> serverChannel, clientChannel;
+
+    status_t result = InputChannel::openInputChannelPair(String8("channel name"),
+            0, serverChannel, clientChannel);
+
+    ASSERT_EQ(OK, result)
+            << "should have successfully opened a channel pair";
+
+    InputMessage serverMsg;
+    memset(&serverMsg, 0, sizeof(InputMessage));
+    serverMsg.header.type = InputMessage::TYPE_KEY;
+    status_t status;
+    uint32_t sent = 0;
+    while ((status = serverChannel->sendMessage(&serverMsg)) == OK) {
+        sent += 1;
+        ASSERT_LT(sent, 10000U) << "the smallest ring should fill up";
+    }
+    EXPECT_EQ(WOULD_BLOCK, status)
+            << "sendMessage should have returned WOULD_BLOCK once the ring is full";
+
+    InputMessage clientMsg;
+    ASSERT_EQ(OK, clientChannel->receiveMessage(&clientMsg));
+    EXPECT_EQ(OK, serverChannel->sendMessage(&serverMsg))
+            << "server channel should be able to send again once there is room";
+}
+
+TEST_F(InputChannelTest, ReceiveMessage_WithRing_WhenPeerClosed_ReturnsAnError) {
+    sp<InputChannel> serverChannel, clientChannel;
+
+    status_t result = InputChannel::openInputChannelPair(String8("channel name"),
+            64 * 1024, serverChannel, clientChannel);
+
+    ASSERT_EQ(OK, result)
+            << "should have successfully opened a channel pair";
+
+    serverChannel.clear(); // close server channel
+
+    InputMessage msg;
+    EXPECT_EQ(DEAD_OBJECT, clientChannel->receiveMessage(&msg))
+            << "receiveMessage should have returned DEAD_OBJECT";
+}
+
 
 } // namespace android
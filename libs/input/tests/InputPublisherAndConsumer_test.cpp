@@ -278,6 +278,46 @@ TEST_F(InputPublisherAndConsumerTest, PublishMotionEvent_WhenPointerCountGreater
             << "publisher publishMotionEvent should return BAD_VALUE";
 }
 
+TEST_F(InputPublisherAndConsumerTest, ConsumeMotionEvent_WithQuadraticResampling_PredictsCurve) {
+    // Accelerates along x, which the quadratic fit should predict exactly.
+    const nsecs_t interval = 8 * 1000000;
+    const nsecs_t frameTime = 5 * interval;
+    mConsumer->setResampleStrategy(InputConsumer::RESAMPLE_LSQ2, 0, interval);
+
+    PointerProperties pointerProperties;
+    pointerProperties.clear();
+    pointerProperties.id = 0;
+    pointerProperties.toolType = AMOTION_EVENT_TOOL_TYPE_FINGER;
+    PointerCoords pointerCoords;
+    MotionEvent* motionEvent = NULL;
+    for (uint32_t i = 0; i < 5; i++) {
+        nsecs_t eventTime = i * interval;
+        float ms = float(eventTime / 1000000);
+        pointerCoords.clear();
+        pointerCoords.setAxisValue(AMOTION_EVENT_AXIS_X, 100 + 0.05f * ms * ms);
+        pointerCoords.setAxisValue(AMOTION_EVENT_AXIS_Y, 200);
+        status_t status = mPublisher->publishMotionEvent(i + 1, 1, AINPUT_SOURCE_TOUCHSCREEN,
+                i ? AMOTION_EVENT_ACTION_MOVE : AMOTION_EVENT_ACTION_DOWN, 0, 0, 0, 0, 0,
+                0, 0, 1, 1, 0, eventTime, 1, &pointerProperties, &pointerCoords);
+        ASSERT_EQ(OK, status)
+                << "publisher publishMotionEvent should return OK";
+
+        uint32_t consumeSeq;
+        InputEvent* event;
+        status = mConsumer->consume(&mEventFactory, true /*consumeBatches*/,
+                i < 4 ? -1 : frameTime, &consumeSeq, &event);
+        ASSERT_EQ(OK, status)
+                << "consumer consume should return OK";
+        ASSERT_EQ(AINPUT_EVENT_TYPE_MOTION, event->getType());
+        motionEvent = static_cast<MotionEvent*>(event);
+    }
+
+    EXPECT_EQ(frameTime, motionEvent->getEventTime())
+            << "the last move should have been resampled to the frame time";
+    EXPECT_NEAR(180.0f, motionEvent->getX(0), 0.5f);
+    EXPECT_NEAR(200.0f, motionEvent->getY(0), 0.5f);
+}
+
 TEST_F(InputPublisherAndConsumerTest, PublishMultipleEvents_EndToEnd) {
     ASSERT_NO_FATAL_FAILURE(PublishAndConsumeMotionEvent());
     ASSERT_NO_FATAL_FAILURE(PublishAndConsumeKeyEvent());
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android/keycodes.h>
+#include <gtest/gtest.h>
+#include <input/KeyCharacterMap.h>
+
+namespace android {
+
+static const char* BASE_MAP =
+        "type FULL\n"
+        "\n"
+        "key A {\n"
+        "    label: 'A'\n"
+        "    base: 'a'\n"
+        "    shift, capslock: 'A'\n"
+        "}\n"
+        "\n"
+        "key PERIOD {\n"
+        "    label: '.'\n"
+        "    base: '.'\n"
+        "}\n"
+        "\n"
+        "key NUMPAD_DOT {\n"
+        "    base: fallback FORWARD_DEL\n"
+        "    numlock: '.'\n"
+        "}\n"
+        "\n"
+        "key ESCAPE {\n"
+        "    base: fallback BACK\n"
+        "    alt, meta: fallback HOME\n"
+        "}\n"
+        "\n"
+        "key DEL {\n"
+        "    base: none\n"
+        "    ctrl+alt: replace FORWARD_DEL\n"
+        "}\n";
+
+static const char* OVERLAY_MAP =
+        "type OVERLAY\n"
+        "\n"
+        "key A {\n"
+        "    base: 'q'\n"
+        "}\n"
+        "\n"
+        "key COMMA {\n"
+        "    base: '.'\n"
+        "}\n";
+
+class KeyCharacterMapTest : public testing::Test {
+protected:
+    sp<KeyCharacterMap> mBase;
+    sp<KeyCharacterMap> mOverlay;
+
+    virtual void SetUp() {
+        ASSERT_EQ(OK, KeyCharacterMap::loadContents(String8("base.kcm"), BASE_MAP,
+                KeyCharacterMap::FORMAT_BASE, &mBase));
+        ASSERT_EQ(OK, KeyCharacterMap::loadContents(String8("overlay.kcm"), OVERLAY_MAP,
+                KeyCharacterMap::FORMAT_OVERLAY, &mOverlay));
+    }
+};
+
+TEST_F(KeyCharacterMapTest, GetCharacter_MatchesMetaState) {
+    EXPECT_EQ(u'A', mBase->getDisplayLabel(AKEYCODE_A));
+    EXPECT_EQ(u'a', mBase->getCharacter(AKEYCODE_A, 0));
+    EXPECT_EQ(u'A', mBase->getCharacter(AKEYCODE_A, AMETA_SHIFT_ON | AMETA_SHIFT_LEFT_ON));
+    EXPECT_EQ(u'A', mBase->getCharacter(AKEYCODE_A, AMETA_CAPS_LOCK_ON));
+    EXPECT_EQ(0, mBase->getCharacter(AKEYCODE_A, AMETA_CTRL_ON | AMETA_CTRL_LEFT_ON));
+    EXPECT_EQ(0, mBase->getCharacter(AKEYCODE_B, 0));
+    EXPECT_EQ(0, mBase->getCharacter(-1, 0));
+    EXPECT_EQ(0, mBase->getCharacter(100000, 0));
+}
+
+TEST_F(KeyCharacterMapTest, GetFallbackAction_StripsMatchedMetaState) {
+    KeyCharacterMap::FallbackAction action;
+    ASSERT_TRUE(mBase->getFallbackAction(AKEYCODE_ESCAPE, 0, &action));
+    EXPECT_EQ(AKEYCODE_BACK, action.keyCode);
+    ASSERT_TRUE(mBase->getFallbackAction(AKEYCODE_ESCAPE,
+            AMETA_ALT_ON | AMETA_ALT_LEFT_ON, &action));
+    EXPECT_EQ(AKEYCODE_HOME, action.keyCode);
+    EXPECT_EQ(AMETA_ALT_LEFT_ON, action.metaState);
+    EXPECT_FALSE(mBase->getFallbackAction(AKEYCODE_A, 0, &action));
+}
+
+TEST_F(KeyCharacterMapTest, TryRemapKey_ReplacesKeyCode) {
+    int32_t keyCode, metaState;
+    mBase->tryRemapKey(AKEYCODE_DEL,
+            AMETA_CTRL_ON | AMETA_CTRL_LEFT_ON | AMETA_ALT_ON | AMETA_ALT_LEFT_ON,
+            &keyCode, &metaState);
+    EXPECT_EQ(AKEYCODE_FORWARD_DEL, keyCode);
+    EXPECT_EQ(0, metaState);
+}
+
+TEST_F(KeyCharacterMapTest, GetEvents_UsesLowestKeyCodeAndMostGeneralBehavior) {
+    const char16_t chars[] = { u'A', u'.' };
+    Vector<KeyEvent> events;
+    ASSERT_TRUE(mBase->getEvents(1, chars, 2, events));
+    ASSERT_EQ(6U, events.size());
+    // shift is the last behavior declared for 'A'
+    EXPECT_EQ(AKEYCODE_SHIFT_LEFT, events[0].getKeyCode());
+    EXPECT_EQ(AKEYCODE_A, events[1].getKeyCode());
+    EXPECT_EQ(AKEY_EVENT_ACTION_DOWN, events[1].getAction());
+    EXPECT_EQ(AKEYCODE_A, events[2].getKeyCode());
+    EXPECT_EQ(AKEY_EVENT_ACTION_UP, events[2].getAction());
+    EXPECT_EQ(AKEYCODE_SHIFT_LEFT, events[3].getKeyCode());
+    // PERIOD comes before NUMPAD_DOT
+    EXPECT_EQ(AKEYCODE_PERIOD, events[4].getKeyCode());
+    EXPECT_EQ(0, events[4].getMetaState());
+
+    const char16_t missing = u'z';
+    EXPECT_FALSE(mBase->getEvents(1, &missing, 1, events));
+}
+
+TEST_F(KeyCharacterMapTest, Combine_ReplacesOverlaidKeys) {
+    sp<KeyCharacterMap> map = KeyCharacterMap::combine(mBase, mOverlay);
+    EXPECT_EQ(u'q', map->getCharacter(AKEYCODE_A, 0));
+    EXPECT_EQ(u'q', map->getCharacter(AKEYCODE_A, AMETA_CAPS_LOCK_ON));
+    EXPECT_EQ(0, map->getDisplayLabel(AKEYCODE_A));
+    EXPECT_EQ(u'.', map->getCharacter(AKEYCODE_PERIOD, 0));
+
+    const char16_t chars[] = { u'.', u'A' };
+    Vector<KeyEvent> events;
+    ASSERT_TRUE(map->getEvents(1, chars, 1, events));
+    ASSERT_EQ(2U, events.size());
+    EXPECT_EQ(AKEYCODE_COMMA, events[0].getKeyCode());
+    EXPECT_FALSE(map->getEvents(1, chars + 1, 1, events));
+}
+
+} // namespace android
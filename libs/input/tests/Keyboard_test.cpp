@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <android/keycodes.h>
+#include <gtest/gtest.h>
+#include <input/InputDevice.h>
+#include <input/KeyCharacterMap.h>
+#include <input/KeyLayoutMap.h>
+#include <input/Keyboard.h>
+#include <utils/PropertyMap.h>
+
+namespace android {
+
+static const char* KEY_LAYOUT = "key 30 A\n";
+static const char* KEY_LAYOUT_EDITED = "key 30 B\nkey 48 B\n";
+static const char* KEY_CHARACTER_MAP =
+        "type FULL\n"
+        "\n"
+        "key A {\n"
+        "    label: 'A'\n"
+        "    base: 'a'\n"
+        "}\n";
+
+class KeyMapTest : public testing::Test {
+protected:
+    String8 mDataDir;
+    PropertyMap mConfiguration;
+
+    virtual void SetUp() {
+        // Key maps are also looked up in $ANDROID_DATA/system/devices, which a test can
+        // point somewhere of its own.
+        const char* tmpDir = getenv("TMPDIR");
+        char dataDir[PATH_MAX];
+        snprintf(dataDir, sizeof(dataDir), "%s/KeyMapTest_XXXXXX",
+                tmpDir ? tmpDir : "/data/local/tmp");
+        ASSERT_TRUE(mkdtemp(dataDir) != NULL);
+        mDataDir.setTo(dataDir);
+        setenv("ANDROID_DATA", dataDir, 1);
+        ASSERT_EQ(0, mkdir(path("system").string(), 0700));
+        ASSERT_EQ(0, mkdir(path("system/devices").string(), 0700));
+        ASSERT_EQ(0, mkdir(path("system/devices/keylayout").string(), 0700));
+        ASSERT_EQ(0, mkdir(path("system/devices/keychars").string(), 0700));
+
+        String8 name(String8::format("KeyMapTest_%d", getpid()));
+        mConfiguration.addProperty(String8("keyboard.layout"), name);
+        mConfiguration.addProperty(String8("keyboard.characterMap"), name);
+        ASSERT_NO_FATAL_FAILURE(writeFile(
+                String8::format("system/devices/keylayout/%s.kl", name.string()), KEY_LAYOUT));
+        ASSERT_NO_FATAL_FAILURE(writeFile(
+                String8::format("system/devices/keychars/%s.kcm", name.string()),
+                KEY_CHARACTER_MAP));
+    }
+
+    virtual void TearDown() {
+        String8 command(String8::format("rm -rf %s", mDataDir.string()));
+        system(command.string());
+    }
+
+    String8 path(const char* relativePath) {
+        return String8::format("%s/%s", mDataDir.string(), relativePath);
+    }
+
+    void writeFile(const String8& relativePath, const char* contents) {
+        FILE* file = fopen(path(relativePath.string()).string(), "w");
+        ASSERT_TRUE(file != NULL);
+        fputs(contents, file);
+        fclose(file);
+    }
+};
+
+TEST_F(KeyMapTest, Load_WhenFilesUnchanged_SharesParsedMaps) {
+    InputDeviceIdentifier identifier;
+    KeyMap first, second;
+    ASSERT_EQ(OK, first.load(identifier, &mConfiguration));
+    ASSERT_EQ(OK, second.load(identifier, &mConfiguration));
+
+    EXPECT_EQ(first.keyLayoutMap.get(), second.keyLayoutMap.get());
+    EXPECT_EQ(first.keyCharacterMap.get(), second.keyCharacterMap.get());
+
+    int32_t keyCode;
+    uint32_t flags;
+    ASSERT_EQ(OK, second.keyLayoutMap->mapKey(30, 0, &keyCode, &flags));
+    EXPECT_EQ(AKEYCODE_A, keyCode);
+}
+
+TEST_F(KeyMapTest, Load_WhenKeyLayoutEdited_ParsesItAgain) {
+    InputDeviceIdentifier identifier;
+    KeyMap first;
+    ASSERT_EQ(OK, first.load(identifier, &mConfiguration));
+
+    String8 name;
+    ASSERT_TRUE(mConfiguration.tryGetProperty(String8("keyboard.layout"), name));
+    ASSERT_NO_FATAL_FAILURE(writeFile(
+            String8::format("system/devices/keylayout/%s.kl", name.string()),
+            KEY_LAYOUT_EDITED));
+
+    KeyMap second;
+    ASSERT_EQ(OK, second.load(identifier, &mConfiguration));
+    EXPECT_NE(first.keyLayoutMap.get(), second.keyLayoutMap.get());
+    EXPECT_EQ(first.keyCharacterMap.get(), second.keyCharacterMap.get());
+
+    int32_t keyCode;
+    uint32_t flags;
+    ASSERT_EQ(OK, second.keyLayoutMap->mapKey(48, 0, &keyCode, &flags));
+    EXPECT_EQ(AKEYCODE_B, keyCode);
+}
+
+} // namespace android
@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <input/VelocityControl.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+static const nsecs_t NANOS_PER_MS = 1000000;
+
+// Full acceleration above 200 units per second.
+static const VelocityControlParameters ACCELERATED(2.0f, 100.0f, 200.0f, 3.0f);
+
+class VelocityControlTest : public testing::Test {
+protected:
+    // Moves by 'delta' every intervalMs from startMs, one sample at a time.
+    static void moveSamples(VelocityControl& control, uint32_t count, nsecs_t startMs,
+            nsecs_t intervalMs, float delta, float* outDeltas) {
+        for (uint32_t i = 0; i < count; i++) {
+            float dx = delta;
+            float dy = 0;
+            control.move((startMs + i * intervalMs) * NANOS_PER_MS, &dx, &dy);
+            outDeltas[i] = dx;
+        }
+    }
+};
+
+TEST_F(VelocityControlTest, Move_WithoutAcceleration_Scales) {
+    VelocityControl control;
+    control.setParameters(VelocityControlParameters(1.5f, 0.0f, 0.0f, 1.0f));
+
+    float dx = 4.0f;
+    float dy = -2.0f;
+    control.move(10 * NANOS_PER_MS, &dx, &dy);
+    EXPECT_FLOAT_EQ(6.0f, dx);
+    EXPECT_FLOAT_EQ(-3.0f, dy);
+
+    nsecs_t times[] = { 11 * NANOS_PER_MS, 12 * NANOS_PER_MS, 13 * NANOS_PER_MS };
+    float deltaX[] = { 1.0f, 0.0f, 2.0f };
+    control.move(times, deltaX, NULL, 3);
+    EXPECT_FLOAT_EQ(1.5f, deltaX[0]);
+    EXPECT_FLOAT_EQ(0.0f, deltaX[1]);
+    EXPECT_FLOAT_EQ(3.0f, deltaX[2]);
+}
+
+TEST_F(VelocityControlTest, Move_FastMovement_Accelerates) {
+    VelocityControl control;
+    control.setParameters(ACCELERATED);
+
+    // 5 units every 8ms is 625 units per second before scaling.
+    float deltas[20];
+    moveSamples(control, 20, 0, 8, 5.0f, deltas);
+    EXPECT_FLOAT_EQ(10.0f, deltas[0]);
+    EXPECT_FLOAT_EQ(30.0f, deltas[19]);
+}
+
+TEST_F(VelocityControlTest, MoveBatch_MatchesSteadyStateOfSingleMoves) {
+    VelocityControl single;
+    VelocityControl batched;
+    single.setParameters(ACCELERATED);
+    batched.setParameters(ACCELERATED);
+
+    // A 1000 Hz mouse: warm both up, then deliver a burst of 8 samples.
+    float deltas[28];
+    moveSamples(single, 28, 0, 1, 1.0f, deltas);
+
+    float warmup[20];
+    moveSamples(batched, 20, 0, 1, 1.0f, warmup);
+    nsecs_t times[8];
+    float deltaX[8];
+    float deltaY[8];
+    for (size_t i = 0; i < 8; i++) {
+        times[i] = (20 + i) * NANOS_PER_MS;
+        deltaX[i] = 1.0f;
+        deltaY[i] = 0.0f;
+    }
+    batched.move(times, deltaX, deltaY, 8);
+
+    for (size_t i = 0; i < 8; i++) {
+        EXPECT_FLOAT_EQ(deltas[20 + i], deltaX[i]) << "sample " << i;
+        EXPECT_FLOAT_EQ(0.0f, deltaY[i]);
+    }
+}
+
+TEST_F(VelocityControlTest, MoveBatch_PauseInBurst_ResetsAcceleration) {
+    VelocityControl control;
+    control.setParameters(ACCELERATED);
+
+    float warmup[20];
+    moveSamples(control, 20, 0, 8, 5.0f, warmup);
+
+    // The movement before the pause is still fast, the one after it has no
+    // velocity yet.
+    nsecs_t times[] = { 160 * NANOS_PER_MS, 1000 * NANOS_PER_MS };
+    float deltaX[] = { 5.0f, 5.0f };
+    control.move(times, deltaX, NULL, 2);
+    EXPECT_FLOAT_EQ(30.0f, deltaX[0]);
+    EXPECT_FLOAT_EQ(10.0f, deltaX[1]);
+}
+
+TEST_F(VelocityControlTest, MoveBatch_NoMovement_LeavesDeltas) {
+    VelocityControl control;
+    control.setParameters(ACCELERATED);
+
+    nsecs_t times[] = { 0, NANOS_PER_MS };
+    float deltaX[] = { 0.0f, 0.0f };
+    float deltaY[] = { 0.0f, 0.0f };
+    control.move(times, deltaX, deltaY, 2);
+    EXPECT_FLOAT_EQ(0.0f, deltaX[0]);
+    EXPECT_FLOAT_EQ(0.0f, deltaY[1]);
+}
+
+} // namespace android
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <gtest/gtest.h>
+#include <input/VelocityTracker.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+static const nsecs_t NANOS_PER_MS = 1000000;
+
+class VelocityTrackerTest : public testing::Test {
+protected:
+    // Moves one pointer along x = 100 + 2000 t + 3000 t^2 and y = 200 - 1000 t, for t in
+    // seconds, every intervalMs, with a little deterministic jitter.
+    static void addMovements(VelocityTracker& tracker, uint32_t count, uint32_t intervalMs) {
+        BitSet32 idBits;
+        idBits.markBit(0);
+        for (uint32_t i = 0; i < count; i++) {
+            float t = i * intervalMs * 0.001f;
+            VelocityTracker::Position position;
+            position.x = 100 + 2000 * t + 3000 * t * t + (i % 3) * 0.5f;
+            position.y = 200 - 1000 * t + (i % 2) * 0.5f;
+            tracker.addMovement(i * intervalMs * NANOS_PER_MS, idBits, &position);
+        }
+    }
+};
+
+TEST_F(VelocityTrackerTest, IncrementalLeastSquares_MatchesLeastSquares) {
+    const uint32_t counts[] = { 1, 2, 3, 5, 10, 19, 20, 21, 50, 200 };
+    const uint32_t intervalsMs[] = { 4, 8, 16 };
+    for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+        for (size_t j = 0; j < sizeof(intervalsMs) / sizeof(intervalsMs[0]); j++) {
+            VelocityTracker lsq("lsq2");
+            VelocityTracker ilsq("ilsq2");
+            addMovements(lsq, counts[i], intervalsMs[j]);
+            addMovements(ilsq, counts[i], intervalsMs[j]);
+
+            VelocityTracker::Estimator expected, actual;
+            ASSERT_TRUE(lsq.getEstimator(0, &expected));
+            ASSERT_TRUE(ilsq.getEstimator(0, &actual));
+            EXPECT_EQ(expected.time, actual.time);
+            ASSERT_EQ(expected.degree, actual.degree)
+                    << counts[i] << " movements every " << intervalsMs[j] << "ms";
+            for (uint32_t k = 0; k <= expected.degree; k++) {
+                // The float QR solve of 'lsq2' rounds more than the incremental one,
+                // particularly once the positions get large.
+                EXPECT_NEAR(expected.xCoeff[k], actual.xCoeff[k],
+                        0.005f * fabsf(expected.xCoeff[k]) + 1)
+                        << "xCoeff[" << k << "] after " << counts[i] << " movements";
+                EXPECT_NEAR(expected.yCoeff[k], actual.yCoeff[k],
+                        0.005f * fabsf(expected.yCoeff[k]) + 1)
+                        << "yCoeff[" << k << "] after " << counts[i] << " movements";
+            }
+            EXPECT_NEAR(expected.confidence, actual.confidence, 0.01f);
+        }
+    }
+}
+
+TEST_F(VelocityTrackerTest, IncrementalLeastSquares_ForgetsClearedPointers) {
+    VelocityTracker tracker("ilsq2");
+    addMovements(tracker, 10, 8);
+
+    BitSet32 idBits;
+    idBits.markBit(0);
+    tracker.clearPointers(idBits);
+    VelocityTracker::Estimator estimator;
+    EXPECT_FALSE(tracker.getEstimator(0, &estimator));
+
+    VelocityTracker::Position position;
+    position.x = 10;
+    position.y = 20;
+    tracker.addMovement(200 * NANOS_PER_MS, idBits, &position);
+    ASSERT_TRUE(tracker.getEstimator(0, &estimator));
+    EXPECT_EQ(0U, estimator.degree)
+            << "a single movement should only give the position";
+    EXPECT_EQ(10, estimator.xCoeff[0]);
+    EXPECT_EQ(20, estimator.yCoeff[0]);
+}
+
+TEST_F(VelocityTrackerTest, Benchmark_GetVelocity) {
+    // A scrolling list queries the velocity about as often as it gets movements.
+    const char* strategies[] = { "lsq2", "ilsq2", "int1" };
+    const uint32_t count = 100000;
+    for (size_t i = 0; i < sizeof(strategies) / sizeof(strategies[0]); i++) {
+        VelocityTracker tracker(strategies[i]);
+        BitSet32 idBits;
+        idBits.markBit(0);
+        double sum = 0;
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (uint32_t j = 0; j < count; j++) {
+            // Start a new gesture now and then so that the positions stay realistic.
+            if (j % 1000 == 0) {
+                tracker.clear();
+            }
+            VelocityTracker::Position position;
+            position.x = (j % 1000) * 0.5f;
+            position.y = (j % 1000) * 0.25f;
+            tracker.addMovement(j * 8 * NANOS_PER_MS, idBits, &position);
+            float vx, vy;
+            tracker.getVelocity(0, &vx, &vy);
+            sum += vx;
+        }
+        nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+        printf("%s: %.0f ns per movement and velocity query\n",
+                strategies[i], double(elapsed) / count);
+        EXPECT_NEAR(62.5f, sum / count, 1.0f)
+                << strategies[i] << " should track the steady velocity";
+    }
+}
+
+} // namespace android
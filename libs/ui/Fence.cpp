@@ -103,6 +103,38 @@ sp<Fence> Fence::merge(const String8& name, const sp<Fence>& f1,
     return merge(name.string(), f1, f2);
 }
 
+sp<Fence> Fence::merge(const char* name,
+        const std::vector<sp<Fence>>& fences) {
+    ATRACE_CALL();
+    // Checking whether a fence signaled is much cheaper than merging it, and
+    // most release fences have signaled by the time they are merged.
+    std::vector<sp<Fence>> pending;
+    for (const sp<Fence>& fence : fences) {
+        if (fence != NULL && fence->isValid() &&
+                sync_wait(fence->mFenceFd, 0) != 0) {
+            pending.push_back(fence);
+        }
+    }
+    if (pending.empty()) {
+        return NO_FENCE;
+    }
+
+    sp<Fence> merged = pending[0];
+    for (size_t i = 1; i < pending.size(); i++) {
+        int result = sync_merge(name, merged->mFenceFd, pending[i]->mFenceFd);
+        if (result == -1) {
+            status_t err = -errno;
+            ALOGE("merge: sync_merge(\"%s\", %d, %d) returned an error: %s (%d)",
+                    name, merged->mFenceFd, pending[i]->mFenceFd,
+                    strerror(-err), err);
+            return NO_FENCE;
+        }
+        // The previous intermediate fence, if any, is closed here.
+        merged = new Fence(result);
+    }
+    return merged;
+}
+
 int Fence::dup() const {
     return ::dup(mFenceFd);
 }
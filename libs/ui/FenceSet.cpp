@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "FenceSet"
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+//#define LOG_NDEBUG 0
+
+#include <ui/FenceSet.h>
+#include <utils/Timers.h>
+#include <utils/Trace.h>
+
+#include <algorithm>
+
+namespace android {
+
+FenceSet::FenceSet(const char* name) :
+    mName(name) {
+}
+
+void FenceSet::add(const sp<Fence>& fence) {
+    if (fence == NULL || !fence->isValid()) {
+        return;
+    }
+    if (mFences.size() >= MAX_UNMERGED_FENCES) {
+        dropSignaledFences();
+    }
+    mFences.push_back(fence);
+}
+
+sp<Fence> FenceSet::get() {
+    ATRACE_CALL();
+    if (mFences.size() == 1) {
+        return mFences[0];
+    }
+    sp<Fence> merged = Fence::merge(mName.string(), mFences);
+    mFences.clear();
+    add(merged);
+    return merged;
+}
+
+status_t FenceSet::wait(int timeout) {
+    ATRACE_CALL();
+    nsecs_t deadline = 0;
+    if (timeout != Fence::TIMEOUT_NEVER) {
+        deadline = systemTime() + ms2ns(timeout);
+    }
+    for (const sp<Fence>& fence : mFences) {
+        int remaining = Fence::TIMEOUT_NEVER;
+        if (timeout != Fence::TIMEOUT_NEVER) {
+            remaining = toMillisecondTimeoutDelay(systemTime(), deadline);
+        }
+        status_t err = fence->wait(remaining);
+        if (err != NO_ERROR) {
+            return err;
+        }
+    }
+    return NO_ERROR;
+}
+
+void FenceSet::clear() {
+    mFences.clear();
+}
+
+void FenceSet::dropSignaledFences() {
+    mFences.erase(std::remove_if(mFences.begin(), mFences.end(),
+            [](const sp<Fence>& fence) {
+                return fence->wait(0) == NO_ERROR;
+            }), mFences.end());
+}
+
+}; // namespace android
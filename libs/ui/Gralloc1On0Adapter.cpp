@@ -53,6 +53,8 @@ Gralloc1On0Adapter::Gralloc1On0Adapter(const hw_module_t* module)
 Gralloc1On0Adapter::~Gralloc1On0Adapter()
 {
     ALOGV("Destructing");
+    // another adapter could be allocated here and see the same handles
+    invalidateBufferCaches();
     if (mDevice) {
         ALOGV("Closing gralloc0 device %p", mDevice);
         ::gralloc_close(mDevice);
@@ -197,8 +199,9 @@ gralloc1_error_t Gralloc1On0Adapter::createDescriptor(
         gralloc1_buffer_descriptor_t* outDescriptor)
 {
     auto descriptorId = sNextBufferDescriptorId++;
-    std::lock_guard<std::mutex> lock(mDescriptorMutex);
-    mDescriptors.emplace(descriptorId,
+    auto& shard = getDescriptorShard(descriptorId);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.descriptors.emplace(descriptorId,
             std::make_shared<Descriptor>(this, descriptorId));
 
     ALOGV("Created descriptor %" PRIu64, descriptorId);
@@ -212,12 +215,11 @@ gralloc1_error_t Gralloc1On0Adapter::destroyDescriptor(
 {
     ALOGV("Destroying descriptor %" PRIu64, descriptor);
 
-    std::lock_guard<std::mutex> lock(mDescriptorMutex);
-    if (mDescriptors.count(descriptor) == 0) {
+    auto& shard = getDescriptorShard(descriptor);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (shard.descriptors.erase(descriptor) == 0) {
         return GRALLOC1_ERROR_BAD_DESCRIPTOR;
     }
-
-    mDescriptors.erase(descriptor);
     return GRALLOC1_ERROR_NONE;
 }
 
@@ -262,8 +264,9 @@ gralloc1_error_t Gralloc1On0Adapter::allocate(
     auto buffer = std::make_shared<Buffer>(handle, store, *descriptor, stride,
             true);
 
-    std::lock_guard<std::mutex> lock(mBufferMutex);
-    mBuffers.emplace(handle, std::move(buffer));
+    auto& shard = getBufferShard(handle);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.buffers.emplace(handle, std::move(buffer));
 
     return GRALLOC1_ERROR_NONE;
 }
@@ -313,7 +316,7 @@ gralloc1_error_t Gralloc1On0Adapter::getphys(
 gralloc1_error_t Gralloc1On0Adapter::retain(
         const std::shared_ptr<Buffer>& buffer)
 {
-    std::lock_guard<std::mutex> lock(mBufferMutex);
+    std::lock_guard<std::mutex> lock(getBufferShard(buffer->getHandle()).mutex);
     buffer->retain();
     return GRALLOC1_ERROR_NONE;
 }
@@ -321,12 +324,13 @@ gralloc1_error_t Gralloc1On0Adapter::retain(
 gralloc1_error_t Gralloc1On0Adapter::release(
         const std::shared_ptr<Buffer>& buffer)
 {
-    std::lock_guard<std::mutex> lock(mBufferMutex);
+    buffer_handle_t handle = buffer->getHandle();
+    auto& shard = getBufferShard(handle);
+    std::lock_guard<std::mutex> lock(shard.mutex);
     if (!buffer->release()) {
         return GRALLOC1_ERROR_NONE;
     }
 
-    buffer_handle_t handle = buffer->getHandle();
     if (buffer->wasAllocated()) {
         ALOGV("Calling free(%p)", handle);
         int result = mDevice->free(mDevice, handle);
@@ -341,7 +345,8 @@ gralloc1_error_t Gralloc1On0Adapter::release(
         }
     }
 
-    mBuffers.erase(handle);
+    shard.buffers.erase(handle);
+    invalidateBufferCaches();
     return GRALLOC1_ERROR_NONE;
 }
 
@@ -352,9 +357,11 @@ gralloc1_error_t Gralloc1On0Adapter::retain(
             graphicBuffer->getNativeBuffer()->handle, graphicBuffer->getId());
 
     buffer_handle_t handle = graphicBuffer->getNativeBuffer()->handle;
-    std::lock_guard<std::mutex> lock(mBufferMutex);
-    if (mBuffers.count(handle) != 0) {
-        mBuffers[handle]->retain();
+    auto& shard = getBufferShard(handle);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto existing = shard.buffers.find(handle);
+    if (existing != shard.buffers.end()) {
+        existing->second->retain();
         return GRALLOC1_ERROR_NONE;
     }
 
@@ -376,7 +383,7 @@ gralloc1_error_t Gralloc1On0Adapter::retain(
     auto buffer = std::make_shared<Buffer>(handle,
             static_cast<gralloc1_backing_store_t>(graphicBuffer->getId()),
             descriptor, graphicBuffer->getStride(), false);
-    mBuffers.emplace(handle, std::move(buffer));
+    shard.buffers.emplace(handle, std::move(buffer));
     return GRALLOC1_ERROR_NONE;
 }
 
@@ -479,26 +486,80 @@ gralloc1_error_t Gralloc1On0Adapter::unlock(
 std::shared_ptr<Gralloc1On0Adapter::Descriptor>
 Gralloc1On0Adapter::getDescriptor(gralloc1_buffer_descriptor_t descriptorId)
 {
-    std::lock_guard<std::mutex> lock(mDescriptorMutex);
-    if (mDescriptors.count(descriptorId) == 0) {
+    auto& shard = getDescriptorShard(descriptorId);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto descriptor = shard.descriptors.find(descriptorId);
+    if (descriptor == shard.descriptors.end()) {
         return nullptr;
     }
 
-    return mDescriptors[descriptorId];
+    return descriptor->second;
 }
 
+// CPU producers lock and unlock the same few buffers over and over, which the
+// cache answers without taking a lock. Its entries are stale as soon as any
+// buffer is removed from any adapter.
+struct Gralloc1On0Adapter::BufferCache {
+    // enough for a producer's whole queue
+    static constexpr size_t NUM_ENTRIES = 4;
+
+    struct Entry {
+        const Gralloc1On0Adapter* adapter = nullptr;
+        buffer_handle_t handle = nullptr;
+        std::shared_ptr<Buffer> buffer;
+    };
+
+    uint64_t generation = 0;
+    size_t next = 0;
+    Entry entries[NUM_ENTRIES];
+};
+
 std::shared_ptr<Gralloc1On0Adapter::Buffer> Gralloc1On0Adapter::getBuffer(
         buffer_handle_t bufferHandle)
 {
-    std::lock_guard<std::mutex> lock(mBufferMutex);
-    if (mBuffers.count(bufferHandle) == 0) {
+    // Read before looking in the shard, so that a buffer removed after that
+    // leaves the cache stale.
+    const uint64_t generation =
+            sBufferGeneration.load(std::memory_order_acquire);
+    BufferCache& cache = sBufferCache;
+    if (cache.generation == generation) {
+        for (const auto& entry : cache.entries) {
+            if (entry.adapter == this && entry.handle == bufferHandle) {
+                return entry.buffer;
+            }
+        }
+    } else {
+        for (auto& entry : cache.entries) {
+            entry = BufferCache::Entry();
+        }
+        cache.generation = generation;
+    }
+
+    auto& shard = getBufferShard(bufferHandle);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    auto buffer = shard.buffers.find(bufferHandle);
+    if (buffer == shard.buffers.end()) {
         return nullptr;
     }
+    std::shared_ptr<Buffer> result = buffer->second;
+    lock.unlock();
+
+    auto& entry = cache.entries[cache.next];
+    cache.next = (cache.next + 1) % BufferCache::NUM_ENTRIES;
+    entry.adapter = this;
+    entry.handle = bufferHandle;
+    entry.buffer = result;
+    return result;
+}
 
-    return mBuffers[bufferHandle];
+void Gralloc1On0Adapter::invalidateBufferCaches()
+{
+    sBufferGeneration.fetch_add(1, std::memory_order_release);
 }
 
 std::atomic<gralloc1_buffer_descriptor_t>
         Gralloc1On0Adapter::sNextBufferDescriptorId(1);
+std::atomic<uint64_t> Gralloc1On0Adapter::sBufferGeneration(0);
+thread_local Gralloc1On0Adapter::BufferCache Gralloc1On0Adapter::sBufferCache;
 
 } // namespace android
@@ -18,10 +18,16 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <unordered_map>
 
 #include <utils/Errors.h>
 #include <utils/Log.h>
+#include <utils/Mutex.h>
 
 #include <ui/GraphicBuffer.h>
 #include <ui/GraphicBufferAllocator.h>
@@ -43,7 +49,8 @@ static uint64_t getUniqueId() {
 
 GraphicBuffer::GraphicBuffer()
     : BASE(), mOwner(ownData), mBufferMapper(GraphicBufferMapper::get()),
-      mInitCheck(NO_ERROR), mId(getUniqueId()), mGenerationNumber(0)
+      mInitCheck(NO_ERROR), mId(getUniqueId()), mGenerationNumber(0),
+      mImported(false)
 {
     width  =
     height =
@@ -56,7 +63,8 @@ GraphicBuffer::GraphicBuffer()
 GraphicBuffer::GraphicBuffer(uint32_t inWidth, uint32_t inHeight,
         PixelFormat inFormat, uint32_t inUsage, std::string requestorName)
     : BASE(), mOwner(ownData), mBufferMapper(GraphicBufferMapper::get()),
-      mInitCheck(NO_ERROR), mId(getUniqueId()), mGenerationNumber(0)
+      mInitCheck(NO_ERROR), mId(getUniqueId()), mGenerationNumber(0),
+      mImported(false)
 {
     width  =
     height =
@@ -73,7 +81,8 @@ GraphicBuffer::GraphicBuffer(uint32_t inWidth, uint32_t inHeight,
         native_handle_t* inHandle, bool keepOwnership)
     : BASE(), mOwner(keepOwnership ? ownHandle : ownNone),
       mBufferMapper(GraphicBufferMapper::get()),
-      mInitCheck(NO_ERROR), mId(getUniqueId()), mGenerationNumber(0)
+      mInitCheck(NO_ERROR), mId(getUniqueId()), mGenerationNumber(0),
+      mImported(false)
 {
     width  = static_cast<int>(inWidth);
     height = static_cast<int>(inHeight);
@@ -87,7 +96,7 @@ GraphicBuffer::GraphicBuffer(ANativeWindowBuffer* buffer, bool keepOwnership)
     : BASE(), mOwner(keepOwnership ? ownHandle : ownNone),
       mBufferMapper(GraphicBufferMapper::get()),
       mInitCheck(NO_ERROR), mWrappedBuffer(buffer), mId(getUniqueId()),
-      mGenerationNumber(0)
+      mGenerationNumber(0), mImported(false)
 {
     width  = buffer->width;
     height = buffer->height;
@@ -106,6 +115,9 @@ GraphicBuffer::~GraphicBuffer()
 
 void GraphicBuffer::free_handle()
 {
+    if (mImported) {
+        removeImported();
+    }
     if (mOwner == ownHandle) {
         mBufferMapper.unregisterBuffer(handle);
         native_handle_close(handle);
@@ -365,12 +377,30 @@ status_t GraphicBuffer::unflatten(
         free_handle();
     }
 
+    mId = static_cast<uint64_t>(buf[6]) << 32;
+    mId |= static_cast<uint32_t>(buf[7]);
+
+    mGenerationNumber = static_cast<uint32_t>(buf[8]);
+
+    sp<GraphicBuffer> imported;
     if (numFds || numInts) {
         width  = buf[1];
         height = buf[2];
         stride = buf[3];
         format = buf[4];
         usage  = buf[5];
+        imported = findImported(mId, fds, numFds, &buf[11], numInts);
+    }
+
+    if (imported != NULL) {
+        // the fds are the ones imported already, we only need one copy
+        for (size_t i = 0; i < numFds; i++) {
+            close(fds[i]);
+        }
+        handle = imported->handle;
+        mWrappedBuffer = imported->getNativeBuffer();
+        mOwner = ownNone;
+    } else if (numFds || numInts) {
         native_handle* h = native_handle_create(
                 static_cast<int>(numFds), static_cast<int>(numInts));
         if (!h) {
@@ -387,21 +417,19 @@ status_t GraphicBuffer::unflatten(
         handle = NULL;
     }
 
-    mId = static_cast<uint64_t>(buf[6]) << 32;
-    mId |= static_cast<uint32_t>(buf[7]);
-
-    mGenerationNumber = static_cast<uint32_t>(buf[8]);
-
-    mOwner = ownHandle;
-
-    if (handle != 0) {
-        status_t err = mBufferMapper.registerBuffer(this);
-        if (err != NO_ERROR) {
-            width = height = stride = format = usage = 0;
-            handle = NULL;
-            ALOGE("unflatten: registerBuffer failed: %s (%d)",
-                    strerror(-err), err);
-            return err;
+    if (imported == NULL) {
+        mOwner = ownHandle;
+
+        if (handle != 0) {
+            status_t err = mBufferMapper.registerBuffer(this);
+            if (err != NO_ERROR) {
+                width = height = stride = format = usage = 0;
+                handle = NULL;
+                ALOGE("unflatten: registerBuffer failed: %s (%d)",
+                        strerror(-err), err);
+                return err;
+            }
+            addImported();
         }
     }
 
@@ -413,6 +441,101 @@ status_t GraphicBuffer::unflatten(
     return NO_ERROR;
 }
 
+// ---------------------------------------------------------------------------
+// Buffers imported by unflatten(). A buffer that is sent to this process again,
+// e.g. by attachBuffer() or a StreamSplitter, shares the registration of the
+// one that is still alive instead of importing its handle with gralloc again.
+
+namespace {
+struct ImportedBuffers {
+    Mutex lock;
+    std::unordered_map<uint64_t, wp<GraphicBuffer> > buffers;
+};
+}
+
+static ImportedBuffers& getImportedBuffers() {
+    // never destroyed, buffers may still go away after exit() started
+    static ImportedBuffers* const importedBuffers = new ImportedBuffers();
+    return *importedBuffers;
+}
+
+// Cleared when fstat() can't tell the buffer files apart, in which case
+// received buffers are always imported.
+static std::atomic<bool> sCanCompareFiles(true);
+
+// Ids come from the sender, so they prove nothing: a buffer is only shared
+// when the fds we received are the files it was imported from. kcmp() would
+// be exact, but seccomp policies of media processes trap it, so this goes
+// by the inode. Files on the kernel's shared anonymous inode, which has no
+// file type, all have the same one; for those nothing is shared.
+static bool isSameFile(int fd1, int fd2) {
+    struct stat st1, st2;
+    if (fstat(fd1, &st1) != 0 || fstat(fd2, &st2) != 0) {
+        return false;
+    }
+    if ((st1.st_mode & S_IFMT) == 0) {
+        sCanCompareFiles.store(false, std::memory_order_relaxed);
+        return false;
+    }
+    return st1.st_dev == st2.st_dev && st1.st_ino == st2.st_ino;
+}
+
+sp<GraphicBuffer> GraphicBuffer::findImported(uint64_t id, int const* fds,
+        size_t numFds, int const* ints, size_t numInts) {
+    if (!sCanCompareFiles.load(std::memory_order_relaxed)) {
+        return NULL;
+    }
+
+    sp<GraphicBuffer> buffer;
+    {
+        ImportedBuffers& imported(getImportedBuffers());
+        Mutex::Autolock _l(imported.lock);
+        auto entry = imported.buffers.find(id);
+        if (entry == imported.buffers.end()) {
+            return NULL;
+        }
+        buffer = entry->second.promote();
+    }
+    // the last reference to a buffer that doesn't match may go away here,
+    // which takes the lock again
+
+    if (buffer == NULL ||
+            static_cast<size_t>(buffer->handle->numFds) != numFds ||
+            static_cast<size_t>(buffer->handle->numInts) != numInts ||
+            memcmp(buffer->handle->data + numFds, ints,
+                    numInts * sizeof(int)) != 0) {
+        return NULL;
+    }
+    for (size_t i = 0; i < numFds; i++) {
+        if (!isSameFile(buffer->handle->data[i], fds[i])) {
+            return NULL;
+        }
+    }
+    return buffer;
+}
+
+void GraphicBuffer::addImported() {
+    if (!sCanCompareFiles.load(std::memory_order_relaxed)) {
+        return;
+    }
+    ImportedBuffers& imported(getImportedBuffers());
+    Mutex::Autolock _l(imported.lock);
+    // replaces a buffer with the same id that didn't match, or is going away
+    imported.buffers[mId] = this;
+    mImported = true;
+}
+
+void GraphicBuffer::removeImported() {
+    ImportedBuffers& imported(getImportedBuffers());
+    Mutex::Autolock _l(imported.lock);
+    auto entry = imported.buffers.find(mId);
+    if (entry != imported.buffers.end() &&
+            entry->second.unsafe_get() == this) {
+        imported.buffers.erase(entry);
+    }
+    mImported = false;
+}
+
 // ---------------------------------------------------------------------------
 
 }; // namespace android
@@ -18,7 +18,13 @@
 #define LOG_TAG "GraphicBufferAllocator"
 #define ATRACE_TAG ATRACE_TAG_GRAPHICS
 
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include <binder/IPCThreadState.h>
+
 #include <cutils/log.h>
+#include <cutils/properties.h>
 
 #include <utils/Singleton.h>
 #include <utils/String8.h>
@@ -35,10 +41,24 @@ ANDROID_SINGLETON_STATIC_INSTANCE( GraphicBufferAllocator )
 Mutex GraphicBufferAllocator::sLock;
 KeyedVector<buffer_handle_t,
     GraphicBufferAllocator::alloc_rec_t> GraphicBufferAllocator::sAllocList;
+Vector<GraphicBufferAllocator::pool_rec_t> GraphicBufferAllocator::sPool;
+size_t GraphicBufferAllocator::sPoolBytes = 0;
+size_t GraphicBufferAllocator::sPoolLimit = 0;
+uint64_t GraphicBufferAllocator::sPoolHits = 0;
+uint64_t GraphicBufferAllocator::sPoolMisses = 0;
+
+// Pooled buffers that nobody asked for within this long are released.
+static const nsecs_t POOL_MAX_AGE = s2ns(5);
 
 GraphicBufferAllocator::GraphicBufferAllocator()
   : mLoader(std::make_unique<Gralloc1::Loader>()),
-    mDevice(mLoader->getDevice()) {}
+    mDevice(mLoader->getDevice())
+{
+    char value[PROPERTY_VALUE_MAX];
+    property_get("ro.ui.buffer_pool_kb", value, "0");
+    Mutex::Autolock _l(sLock);
+    sPoolLimit = static_cast<size_t>(atoi(value)) * 1024;
+}
 
 GraphicBufferAllocator::~GraphicBufferAllocator() {}
 
@@ -55,25 +75,78 @@ void GraphicBufferAllocator::dump(String8& result) const
     for (size_t i=0 ; i<c ; i++) {
         const alloc_rec_t& rec(list.valueAt(i));
         if (rec.size) {
-            snprintf(buffer, SIZE, "%10p: %7.2f KiB | %4u (%4u) x %4u | %8X | 0x%08x | %s\n",
+            snprintf(buffer, SIZE, "%10p: %7.2f KiB | %4u (%4u) x %4u | %8X | 0x%08x"
+                    " | %#" PRIx64 " | %s\n",
                     list.keyAt(i), rec.size/1024.0f,
                     rec.width, rec.stride, rec.height, rec.format, rec.usage,
-                    rec.requestorName.c_str());
+                    rec.graphicBufferId, rec.requestorName.c_str());
         } else {
-            snprintf(buffer, SIZE, "%10p: unknown     | %4u (%4u) x %4u | %8X | 0x%08x | %s\n",
+            snprintf(buffer, SIZE, "%10p: unknown     | %4u (%4u) x %4u | %8X | 0x%08x"
+                    " | %#" PRIx64 " | %s\n",
                     list.keyAt(i),
                     rec.width, rec.stride, rec.height, rec.format, rec.usage,
-                    rec.requestorName.c_str());
+                    rec.graphicBufferId, rec.requestorName.c_str());
         }
         result.append(buffer);
         total += rec.size;
     }
     snprintf(buffer, SIZE, "Total allocated (estimate): %.2f KB\n", total/1024.0f);
     result.append(buffer);
+
+    KeyedVector<pid_t, process_usage_t> usage;
+    getProcessUsageLocked(&usage);
+    result.append("Allocated by process:\n");
+    for (size_t i = 0; i < usage.size(); i++) {
+        snprintf(buffer, SIZE, "  pid %5d: %4zu buffers, %10.2f KiB\n", usage.keyAt(i),
+                usage.valueAt(i).count, usage.valueAt(i).size/1024.0f);
+        result.append(buffer);
+    }
+
+    if (sPoolLimit > 0 || !sPool.isEmpty()) {
+        snprintf(buffer, SIZE, "Recycle pool: %zu buffers, %.2f of %.2f KiB, "
+                "%" PRIu64 " hits, %" PRIu64 " misses\n", sPool.size(),
+                sPoolBytes/1024.0f, sPoolLimit/1024.0f, sPoolHits, sPoolMisses);
+        result.append(buffer);
+        const nsecs_t now = systemTime();
+        for (size_t i = 0; i < sPool.size(); i++) {
+            const pool_rec_t& pooled(sPool[i]);
+            const alloc_rec_t& rec(pooled.rec);
+            snprintf(buffer, SIZE, "%10p: %7.2f KiB | %4u (%4u) x %4u | %8X | 0x%08x | %s"
+                    " | uid %5d | idle %" PRId64 " ms\n",
+                    pooled.handle, rec.size/1024.0f,
+                    rec.width, rec.stride, rec.height, rec.format, rec.usage,
+                    rec.requestorName.c_str(), rec.uid, ns2ms(now - pooled.freedAt));
+            result.append(buffer);
+        }
+    }
     std::string deviceDump = mDevice->dump();
     result.append(deviceDump.c_str(), deviceDump.size());
 }
 
+void GraphicBufferAllocator::getProcessUsage(
+        KeyedVector<pid_t, process_usage_t>* outUsage) const
+{
+    Mutex::Autolock _l(sLock);
+    getProcessUsageLocked(outUsage);
+}
+
+void GraphicBufferAllocator::getProcessUsageLocked(
+        KeyedVector<pid_t, process_usage_t>* outUsage)
+{
+    outUsage->clear();
+    for (size_t i = 0; i < sAllocList.size(); i++) {
+        const alloc_rec_t& rec(sAllocList.valueAt(i));
+        ssize_t index = outUsage->indexOfKey(rec.pid);
+        if (index < 0) {
+            process_usage_t usage = { 0, 0 };
+            index = outUsage->add(rec.pid, usage);
+        }
+        process_usage_t& usage(outUsage->editValueAt(index));
+        usage.count++;
+        usage.size += rec.size;
+    }
+}
+
 void GraphicBufferAllocator::dumpToSystemLog()
 {
     String8 s;
@@ -95,6 +168,48 @@ status_t GraphicBufferAllocator::allocate(uint32_t width, uint32_t height,
     // Filter out any usage bits that should not be passed to the gralloc module
     usage &= GRALLOC_USAGE_ALLOC_MASK;
 
+    const pid_t pid = IPCThreadState::self()->getCallingPid();
+    const uid_t uid = IPCThreadState::self()->getCallingUid();
+    Vector<buffer_handle_t> expired;
+    bool recycled = false;
+    {
+        Mutex::Autolock _l(sLock);
+        if (sPoolLimit > 0) {
+            trimPoolLocked(sPoolLimit, &expired);
+            // Prefer the most recently freed match. The contents are left
+            // as they were, so only a buffer of the same uid will do.
+            for (size_t i = sPool.size(); i > 0; i--) {
+                const pool_rec_t& pooled(sPool[i - 1]);
+                const alloc_rec_t& rec(pooled.rec);
+                if (rec.width == width && rec.height == height &&
+                        rec.format == format && rec.usage == usage &&
+                        rec.uid == uid) {
+                    *handle = pooled.handle;
+                    *stride = rec.stride;
+                    alloc_rec_t reused(rec);
+                    reused.requestorName = std::move(requestorName);
+                    reused.graphicBufferId = graphicBufferId;
+                    reused.pid = pid;
+                    sAllocList.add(pooled.handle, reused);
+                    sPoolBytes -= rec.size;
+                    sPool.removeAt(i - 1);
+                    recycled = true;
+                    break;
+                }
+            }
+            if (recycled) {
+                sPoolHits++;
+            } else {
+                sPoolMisses++;
+            }
+        }
+    }
+    release(expired);
+    if (recycled) {
+        ATRACE_NAME("recycled");
+        return NO_ERROR;
+    }
+
     auto descriptor = mDevice->createDescriptor();
     auto error = descriptor->setDimensions(width, height);
     if (error != GRALLOC1_ERROR_NONE) {
@@ -143,6 +258,9 @@ status_t GraphicBufferAllocator::allocate(uint32_t width, uint32_t height,
         rec.usage = usage;
         rec.size = static_cast<size_t>(height * (*stride) * bpp);
         rec.requestorName = std::move(requestorName);
+        rec.graphicBufferId = graphicBufferId;
+        rec.pid = pid;
+        rec.uid = uid;
         list.add(*handle, rec);
     }
 
@@ -153,17 +271,81 @@ status_t GraphicBufferAllocator::free(buffer_handle_t handle)
 {
     ATRACE_CALL();
 
-    auto error = mDevice->release(handle);
-    if (error != GRALLOC1_ERROR_NONE) {
-        ALOGE("Failed to free buffer: %d", error);
+    Vector<buffer_handle_t> released;
+    {
+        Mutex::Autolock _l(sLock);
+        KeyedVector<buffer_handle_t, alloc_rec_t>& list(sAllocList);
+        ssize_t index = list.indexOfKey(handle);
+        bool pooled = false;
+        if (index >= 0) {
+            const alloc_rec_t& rec(list.valueAt(index));
+            // Protected buffers are never recycled, and one whose size is
+            // unknown can't be accounted for
+            if (sPoolLimit > 0 && rec.size > 0 && rec.size <= sPoolLimit &&
+                    !(rec.usage & GRALLOC_USAGE_PROTECTED)) {
+                trimPoolLocked(sPoolLimit - rec.size, &released);
+                pool_rec_t entry;
+                entry.handle = handle;
+                entry.rec = rec;
+                entry.freedAt = systemTime();
+                sPool.push_back(entry);
+                sPoolBytes += rec.size;
+                pooled = true;
+            }
+            list.removeItemsAt(index);
+        }
+        if (!pooled) {
+            released.push_back(handle);
+        }
     }
-
-    Mutex::Autolock _l(sLock);
-    KeyedVector<buffer_handle_t, alloc_rec_t>& list(sAllocList);
-    list.removeItem(handle);
+    release(released);
 
     return NO_ERROR;
 }
 
+void GraphicBufferAllocator::setPoolLimit(size_t bytes)
+{
+    Vector<buffer_handle_t> released;
+    {
+        Mutex::Autolock _l(sLock);
+        sPoolLimit = bytes;
+        trimPoolLocked(sPoolLimit, &released);
+    }
+    release(released);
+}
+
+void GraphicBufferAllocator::trimPool(size_t maxBytes)
+{
+    ATRACE_CALL();
+    Vector<buffer_handle_t> released;
+    {
+        Mutex::Autolock _l(sLock);
+        trimPoolLocked(maxBytes, &released);
+    }
+    release(released);
+}
+
+void GraphicBufferAllocator::trimPoolLocked(size_t maxBytes,
+        Vector<buffer_handle_t>* outRelease)
+{
+    const nsecs_t oldest = systemTime() - POOL_MAX_AGE;
+    while (!sPool.isEmpty() &&
+            (sPoolBytes > maxBytes || sPool[0].freedAt < oldest)) {
+        outRelease->push_back(sPool[0].handle);
+        sPoolBytes -= sPool[0].rec.size;
+        sPool.removeAt(0);
+    }
+}
+
+void GraphicBufferAllocator::release(const Vector<buffer_handle_t>& handles)
+{
+    for (size_t i = 0; i < handles.size(); i++) {
+        auto error = mDevice->release(handles[i]);
+        if (error != GRALLOC1_ERROR_NONE) {
+            ALOGE("Failed to free buffer: %d", error);
+        }
+    }
+}
+
 // ---------------------------------------------------------------------------
 }; // namespace android
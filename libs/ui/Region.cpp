@@ -19,6 +19,8 @@
 #include <inttypes.h>
 #include <limits.h>
 
+#include <utility>
+
 #include <utils/Log.h>
 #include <utils/String8.h>
 #include <utils/CallStack.h>
@@ -57,20 +59,31 @@ const Region Region::INVALID_REGION(Rect::INVALID_RECT);
 
 // ----------------------------------------------------------------------------
 
-Region::Region() {
-    mStorage.add(Rect(0,0));
+Region::Region()
+    : mRect(0,0)
+{
 }
 
 Region::Region(const Region& rhs)
-    : mStorage(rhs.mStorage)
+    : mRect(rhs.mRect), mStorage(rhs.mStorage)
 {
 #if VALIDATE_REGIONS
     validate(rhs, "rhs copy-ctor");
 #endif
 }
 
-Region::Region(const Rect& rhs) {
-    mStorage.add(rhs);
+Region::Region(Region&& rhs)
+    : mRect(rhs.mRect), mStorage(rhs.mStorage)
+{
+#if VALIDATE_REGIONS
+    validate(rhs, "rhs move-ctor");
+#endif
+    rhs.setRect(Rect(0,0));
+}
+
+Region::Region(const Rect& rhs)
+    : mRect(rhs)
+{
 }
 
 Region::~Region()
@@ -213,16 +226,39 @@ Region& Region::operator = (const Region& rhs)
     validate(*this, "this->operator=");
     validate(rhs, "rhs.operator=");
 #endif
+    mRect = rhs.mRect;
     mStorage = rhs.mStorage;
     return *this;
 }
 
+Region& Region::operator = (Region&& rhs)
+{
+#if VALIDATE_REGIONS
+    validate(*this, "this->operator=(&&)");
+    validate(rhs, "rhs.operator=(&&)");
+#endif
+    if (this != &rhs) {
+        mRect = rhs.mRect;
+        mStorage = rhs.mStorage;
+        rhs.setRect(Rect(0,0));
+    }
+    return *this;
+}
+
+void Region::setRect(const Rect& r)
+{
+    mRect = r;
+    if (!mStorage.isEmpty()) {
+        // release (or stop sharing) the rect list rather than clear it,
+        // which could allocate a new one
+        mStorage = Vector<Rect>();
+    }
+}
+
 Region& Region::makeBoundsSelf()
 {
-    if (mStorage.size() >= 2) {
-        const Rect bounds(getBounds());
-        mStorage.clear();
-        mStorage.add(bounds);
+    if (!mStorage.isEmpty()) {
+        setRect(getBounds());
     }
     return *this;
 }
@@ -245,29 +281,29 @@ bool Region::contains(int x, int y) const {
 
 void Region::clear()
 {
-    mStorage.clear();
-    mStorage.add(Rect(0,0));
+    setRect(Rect(0,0));
 }
 
 void Region::set(const Rect& r)
 {
-    mStorage.clear();
-    mStorage.add(r);
+    setRect(r);
 }
 
 void Region::set(int32_t w, int32_t h)
 {
-    mStorage.clear();
-    mStorage.add(Rect(w, h));
+    setRect(Rect(w, h));
 }
 
 void Region::set(uint32_t w, uint32_t h)
 {
-    mStorage.clear();
-    mStorage.add(Rect(w, h));
+    setRect(Rect(w, h));
 }
 
 bool Region::isTriviallyEqual(const Region& region) const {
+    // single rects are never shared, but comparing them is just as cheap
+    if (isRect() && region.isRect()) {
+        return mRect == region.mRect;
+    }
     return begin() == region.begin();
 }
 
@@ -276,6 +312,9 @@ bool Region::isTriviallyEqual(const Region& region) const {
 void Region::addRectUnchecked(int l, int t, int r, int b)
 {
     Rect rect(l,t,r,b);
+    if (mStorage.isEmpty()) {
+        mStorage.add(mRect);
+    }
     size_t where = mStorage.size() - 1;
     mStorage.insertAt(rect, where, 1);
 }
@@ -413,20 +452,87 @@ const Region Region::operation(const Region& rhs, int dx, int dy, int op) const
 
 // ----------------------------------------------------------------------------
 
+// A growable array of Rects whose first few entries live inline, so that
+// rasterizing a small region does not allocate.
+class RectBuffer
+{
+public:
+    RectBuffer() : mRects(mInline), mCount(0), mCapacity(INLINE_COUNT) { }
+    ~RectBuffer() {
+        if (mRects != mInline) {
+            delete [] mRects;
+        }
+    }
+
+    size_t size() const { return mCount; }
+    const Rect* array() const { return mRects; }
+    Rect* editArray() { return mRects; }
+    const Rect& operator[](size_t index) const { return mRects[index]; }
+    const Rect& top() const { return mRects[mCount - 1]; }
+
+    void clear() { mCount = 0; }
+
+    void add(const Rect& rect) {
+        if (mCount == mCapacity) {
+            grow(mCount + 1);
+        }
+        mRects[mCount++] = rect;
+    }
+
+    void append(const RectBuffer& other) {
+        if (mCount + other.mCount > mCapacity) {
+            grow(mCount + other.mCount);
+        }
+        for (size_t i = 0; i < other.mCount; i++) {
+            mRects[mCount++] = other.mRects[i];
+        }
+    }
+
+private:
+    RectBuffer(const RectBuffer&);
+    RectBuffer& operator = (const RectBuffer&);
+
+    void grow(size_t minCapacity) {
+        size_t capacity = mCapacity * 2;
+        if (capacity < minCapacity) {
+            capacity = minCapacity;
+        }
+        Rect* rects = new Rect[capacity];
+        for (size_t i = 0; i < mCount; i++) {
+            rects[i] = mRects[i];
+        }
+        if (mRects != mInline) {
+            delete [] mRects;
+        }
+        mRects = rects;
+        mCapacity = capacity;
+    }
+
+    enum { INLINE_COUNT = 8 };
+
+    Rect mInline[INLINE_COUNT];
+    Rect* mRects;
+    size_t mCount;
+    size_t mCapacity;
+};
+
 // This is our region rasterizer, which merges rects and spans together
 // to obtain an optimal region.
+//
+// The result is only written to the region when the rasterizer is
+// destroyed, since the destination may also be one of the operands.
 class Region::rasterizer : public region_operator<Rect>::region_rasterizer
 {
     Rect bounds;
-    Vector<Rect>& storage;
+    Region& region;
+    RectBuffer storage;
     Rect* head;
     Rect* tail;
-    Vector<Rect> span;
+    RectBuffer span;
     Rect* cur;
 public:
     rasterizer(Region& reg)
-        : bounds(INT_MAX, 0, INT_MIN, 0), storage(reg.mStorage), head(), tail(), cur() {
-        storage.clear();
+        : bounds(INT_MAX, 0, INT_MIN, 0), region(reg), head(), tail(), cur() {
     }
 
     virtual ~rasterizer();
@@ -448,16 +554,21 @@ Region::rasterizer::~rasterizer()
         flushSpan();
     }
     if (storage.size()) {
-        bounds.top = storage.itemAt(0).top;
+        bounds.top = storage[0].top;
         bounds.bottom = storage.top().bottom;
-        if (storage.size() == 1) {
-            storage.clear();
-        }
     } else {
         bounds.left  = 0;
         bounds.right = 0;
     }
-    storage.add(bounds);
+    if (storage.size() <= 1) {
+        region.setRect(bounds);
+    } else {
+        Vector<Rect> rects;
+        rects.setCapacity(storage.size() + 1);
+        rects.appendArray(storage.array(), storage.size());
+        rects.add(bounds);
+        region.mStorage = rects;
+    }
 }
 
 void Region::rasterizer::operator()(const Rect& rect)
@@ -501,9 +612,9 @@ void Region::rasterizer::flushSpan()
             r++;
         }
     } else {
-        bounds.left = min(span.itemAt(0).left, bounds.left);
+        bounds.left = min(span[0].left, bounds.left);
         bounds.right = max(span.top().right, bounds.right);
-        storage.appendVector(span);
+        storage.append(span);
         tail = storage.editArray() + storage.size();
         head = tail - span.size();
     }
@@ -582,6 +693,99 @@ bool Region::validate(const Region& reg, const char* name, bool silent)
     return result;
 }
 
+static inline bool rectContains(const Rect& outer, const Rect& inner) {
+    return inner.left >= outer.left && inner.top >= outer.top &&
+            inner.right <= outer.right && inner.bottom <= outer.bottom;
+}
+
+/*
+ * Handles the operations whose result follows from the bounds alone: either
+ * side empty, operands whose bounds do not overlap, and a rect containing
+ * the other operand. These make up most of the calls made while computing
+ * visible regions and would otherwise go through a full sweep.
+ *
+ * rhsBounds is already offset by (dx, dy). rhs may be NULL when the right
+ * hand side is a single rect, in which case rhsBounds is that rect. Returns
+ * false if the operation needs the general rasterizer. dst may alias rhs,
+ * so nothing is read from rhs once dst has been written.
+ */
+bool Region::trivial_operation(int op, Region& dst,
+        const Region& lhs, const Region* rhs, const Rect& rhsBounds,
+        bool rhsIsRect, int dx, int dy)
+{
+    const Rect lhsBounds(lhs.getBounds());
+    const bool lhsEmpty = lhsBounds.isEmpty();
+    const bool rhsEmpty = rhsBounds.isEmpty();
+
+    enum { RESULT_EMPTY, RESULT_LHS, RESULT_RHS, RESULT_INTERSECTION };
+    int result;
+    if (lhsEmpty || rhsEmpty) {
+        if (op == op_and || (lhsEmpty && rhsEmpty)) {
+            result = RESULT_EMPTY;
+        } else if (lhsEmpty) {
+            result = (op == op_nand) ? RESULT_EMPTY : RESULT_RHS;
+        } else {
+            result = RESULT_LHS;
+        }
+    } else if (lhsBounds.left >= rhsBounds.right ||
+            rhsBounds.left >= lhsBounds.right ||
+            lhsBounds.top >= rhsBounds.bottom ||
+            rhsBounds.top >= lhsBounds.bottom) {
+        if (op == op_and) {
+            result = RESULT_EMPTY;
+        } else if (op == op_nand) {
+            result = RESULT_LHS;
+        } else {
+            return false;
+        }
+    } else if (rhsIsRect && rectContains(rhsBounds, lhsBounds)) {
+        if (op == op_and) {
+            result = RESULT_LHS;
+        } else if (op == op_nand) {
+            result = RESULT_EMPTY;
+        } else if (op == op_or) {
+            result = RESULT_RHS;
+        } else {
+            return false;
+        }
+    } else if (lhs.isRect() && rectContains(lhsBounds, rhsBounds)) {
+        if (op == op_and) {
+            result = RESULT_RHS;
+        } else if (op == op_or) {
+            result = RESULT_LHS;
+        } else {
+            return false;
+        }
+    } else if (op == op_and && lhs.isRect() && rhsIsRect) {
+        result = RESULT_INTERSECTION;
+    } else {
+        return false;
+    }
+
+    switch (result) {
+        case RESULT_EMPTY:
+            dst.clear();
+            break;
+        case RESULT_LHS:
+            dst = lhs;
+            break;
+        case RESULT_RHS:
+            if (rhs) {
+                translate(dst, *rhs, dx, dy);
+            } else {
+                dst.set(rhsBounds);
+            }
+            break;
+        case RESULT_INTERSECTION: {
+            Rect intersection;
+            lhsBounds.intersect(rhsBounds, &intersection);
+            dst.set(intersection);
+            break;
+        }
+    }
+    return true;
+}
+
 void Region::boolean_operation(int op, Region& dst,
         const Region& lhs,
         const Region& rhs, int dx, int dy)
@@ -592,6 +796,14 @@ void Region::boolean_operation(int op, Region& dst,
     validate(dst, "boolean_operation (before): dst");
 #endif
 
+#if !VALIDATE_WITH_CORECG
+    Rect rhsBounds(rhs.getBounds());
+    rhsBounds.offsetBy(dx, dy);
+    if (trivial_operation(op, dst, lhs, &rhs, rhsBounds, rhs.isRect(), dx, dy)) {
+        return;
+    }
+#endif
+
     size_t lhs_count;
     Rect const * const lhs_rects = lhs.getArray(&lhs_count);
 
@@ -707,6 +919,12 @@ void Region::boolean_operation(int op, Region& dst,
 #if VALIDATE_WITH_CORECG || VALIDATE_REGIONS
     boolean_operation(op, dst, lhs, Region(rhs), dx, dy);
 #else
+    Rect rhsBounds(rhs);
+    rhsBounds.offsetBy(dx, dy);
+    if (trivial_operation(op, dst, lhs, NULL, rhsBounds, true, dx, dy)) {
+        return;
+    }
+
     size_t lhs_count;
     Rect const * const lhs_rects = lhs.getArray(&lhs_count);
 
@@ -739,6 +957,10 @@ void Region::translate(Region& reg, int dx, int dy)
 #if VALIDATE_REGIONS
         validate(reg, "translate (before)");
 #endif
+        if (reg.mStorage.isEmpty()) {
+            reg.mRect.offsetBy(dx, dy);
+            return;
+        }
         size_t count = reg.mStorage.size();
         Rect* rects = reg.mStorage.editArray();
         while (count) {
@@ -761,7 +983,8 @@ void Region::translate(Region& dst, const Region& reg, int dx, int dy)
 // ----------------------------------------------------------------------------
 
 size_t Region::getFlattenedSize() const {
-    return sizeof(uint32_t) + mStorage.size() * sizeof(Rect);
+    size_t count = mStorage.isEmpty() ? 1 : mStorage.size();
+    return sizeof(uint32_t) + count * sizeof(Rect);
 }
 
 status_t Region::flatten(void* buffer, size_t size) const {
@@ -771,10 +994,15 @@ status_t Region::flatten(void* buffer, size_t size) const {
     if (size < getFlattenedSize()) {
         return NO_MEMORY;
     }
+    // The wire format is the rect list including the trailing bounds, or
+    // just the rect for a simple region
+    const Rect* rects = mStorage.isEmpty() ? &mRect : mStorage.array();
+    const size_t count = mStorage.isEmpty() ? 1 : mStorage.size();
     // Cast to uint32_t since the size of a size_t can vary between 32- and
     // 64-bit processes
-    FlattenableUtils::write(buffer, size, static_cast<uint32_t>(mStorage.size()));
-    for (auto rect : mStorage) {
+    FlattenableUtils::write(buffer, size, static_cast<uint32_t>(count));
+    for (size_t i = 0; i < count; i++) {
+        const Rect& rect(rects[i]);
         status_t result = rect.flatten(buffer, size);
         if (result != NO_ERROR) {
             return result;
@@ -800,8 +1028,12 @@ status_t Region::unflatten(void const* buffer, size_t size) {
         return NO_MEMORY;
     }
 
+    if (numRects == 0) {
+        ALOGE("Region::unflatten() failed, no rects");
+        return BAD_VALUE;
+    }
+
     Region result;
-    result.mStorage.clear();
     for (size_t r = 0; r < numRects; ++r) {
         Rect rect(Rect::EMPTY_RECT);
         status_t status = rect.unflatten(buffer, size);
@@ -809,7 +1041,11 @@ status_t Region::unflatten(void const* buffer, size_t size) {
             return status;
         }
         FlattenableUtils::advance(buffer, size, sizeof(rect));
-        result.mStorage.push_back(rect);
+        if (numRects == 1) {
+            result.mRect = rect;
+        } else {
+            result.mStorage.push_back(rect);
+        }
     }
 
 #if VALIDATE_REGIONS
@@ -820,19 +1056,21 @@ status_t Region::unflatten(void const* buffer, size_t size) {
         ALOGE("Region::unflatten() failed, invalid region");
         return BAD_VALUE;
     }
-    mStorage = result.mStorage;
+    *this = std::move(result);
     return NO_ERROR;
 }
 
 // ----------------------------------------------------------------------------
 
 Region::const_iterator Region::begin() const {
-    return mStorage.array();
+    return mStorage.isEmpty() ? &mRect : mStorage.array();
 }
 
 Region::const_iterator Region::end() const {
-    size_t numRects = isRect() ? 1 : mStorage.size() - 1;
-    return mStorage.array() + numRects;
+    if (mStorage.isEmpty()) {
+        return &mRect + 1;
+    }
+    return mStorage.array() + (mStorage.size() - 1);
 }
 
 Rect const* Region::getArray(size_t* count) const {
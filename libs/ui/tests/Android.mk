@@ -18,7 +18,7 @@ LOCAL_PATH := $(call my-dir)
 
 include $(CLEAR_VARS)
 LOCAL_ADDITIONAL_DEPENDENCIES := $(LOCAL_PATH)/Android.mk
-LOCAL_SHARED_LIBRARIES := libui
+LOCAL_SHARED_LIBRARIES := libui libutils
 LOCAL_SRC_FILES := Region_test.cpp
 LOCAL_MODULE := Region_test
 include $(BUILD_NATIVE_TEST)
@@ -34,3 +34,30 @@ LOCAL_ADDITIONAL_DEPENDENCIES := $(LOCAL_PATH)/Android.mk
 LOCAL_SRC_FILES := mat_test.cpp
 LOCAL_MODULE := mat_test
 include $(BUILD_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+LOCAL_ADDITIONAL_DEPENDENCIES := $(LOCAL_PATH)/Android.mk
+LOCAL_SHARED_LIBRARIES := libui libutils
+LOCAL_SRC_FILES := FenceSet_test.cpp
+LOCAL_MODULE := FenceSet_test
+include $(BUILD_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+LOCAL_ADDITIONAL_DEPENDENCIES := $(LOCAL_PATH)/Android.mk
+LOCAL_SHARED_LIBRARIES := libui libutils
+LOCAL_SRC_FILES := GraphicBuffer_test.cpp
+LOCAL_MODULE := GraphicBuffer_test
+include $(BUILD_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+LOCAL_ADDITIONAL_DEPENDENCIES := $(LOCAL_PATH)/Android.mk
+LOCAL_SRC_FILES := mat_benchmark.cpp
+LOCAL_MODULE := mat_benchmark
+include $(BUILD_NATIVE_BENCHMARK)
+
+include $(CLEAR_VARS)
+LOCAL_ADDITIONAL_DEPENDENCIES := $(LOCAL_PATH)/Android.mk
+LOCAL_SHARED_LIBRARIES := libui libutils libcutils libhardware
+LOCAL_SRC_FILES := gralloc1on0_benchmark.cpp
+LOCAL_MODULE := gralloc1on0_benchmark
+include $(BUILD_NATIVE_BENCHMARK)
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "FenceSetTest"
+
+#include <ui/Fence.h>
+#include <ui/FenceSet.h>
+#include <gtest/gtest.h>
+
+#include <vector>
+
+namespace android {
+
+TEST(FenceSetTest, EmptySetGivesNoFence) {
+    FenceSet set("test");
+    EXPECT_TRUE(set.isEmpty());
+    EXPECT_EQ(Fence::NO_FENCE, set.get());
+    EXPECT_EQ(NO_ERROR, set.wait(0));
+}
+
+TEST(FenceSetTest, InvalidFencesAreIgnored) {
+    FenceSet set("test");
+    set.add(Fence::NO_FENCE);
+    set.add(new Fence());
+    set.add(NULL);
+    EXPECT_TRUE(set.isEmpty());
+    EXPECT_EQ(Fence::NO_FENCE, set.get());
+}
+
+TEST(FenceSetTest, ClearEmptiesTheSet) {
+    FenceSet set("test");
+    set.add(Fence::NO_FENCE);
+    set.clear();
+    EXPECT_TRUE(set.isEmpty());
+}
+
+TEST(FenceMergeTest, MergingNothingGivesNoFence) {
+    std::vector<sp<Fence>> fences;
+    EXPECT_EQ(Fence::NO_FENCE, Fence::merge("test", fences));
+
+    fences.push_back(Fence::NO_FENCE);
+    fences.push_back(new Fence());
+    EXPECT_EQ(Fence::NO_FENCE, Fence::merge("test", fences));
+}
+
+}; // namespace android
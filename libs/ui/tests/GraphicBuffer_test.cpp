@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "GraphicBufferTest"
+
+#include <ui/GraphicBuffer.h>
+#include <gtest/gtest.h>
+
+#include <string.h>
+#include <unistd.h>
+
+#include <vector>
+
+namespace android {
+
+// A GraphicBuffer as it crosses a process, with the fds dup'ed the way a
+// Parcel does it.
+struct FlattenedBuffer {
+    explicit FlattenedBuffer(const sp<GraphicBuffer>& buffer)
+      : data(buffer->getFlattenedSize()), fds(buffer->getFdCount()) {
+        void* dataPtr = data.data();
+        size_t size = data.size();
+        int* fdsPtr = fds.data();
+        size_t count = fds.size();
+        EXPECT_EQ(NO_ERROR, buffer->flatten(dataPtr, size, fdsPtr, count));
+    }
+
+    sp<GraphicBuffer> unflatten() const {
+        std::vector<int> received;
+        for (int fd : fds) {
+            received.push_back(dup(fd));
+        }
+        void const* dataPtr = data.data();
+        size_t size = data.size();
+        int const* fdsPtr = received.data();
+        size_t count = received.size();
+        sp<GraphicBuffer> buffer = new GraphicBuffer();
+        EXPECT_EQ(NO_ERROR, buffer->unflatten(dataPtr, size, fdsPtr, count));
+        return buffer;
+    }
+
+    std::vector<uint8_t> data;
+    std::vector<int> fds;
+};
+
+static sp<GraphicBuffer> allocate() {
+    sp<GraphicBuffer> buffer = new GraphicBuffer(16, 16,
+            PIXEL_FORMAT_RGBA_8888, GraphicBuffer::USAGE_SW_WRITE_OFTEN);
+    EXPECT_EQ(NO_ERROR, buffer->initCheck());
+    return buffer;
+}
+
+TEST(GraphicBufferTest, UnflattenSameBufferTwice) {
+    sp<GraphicBuffer> source = allocate();
+    FlattenedBuffer flattened(source);
+
+    sp<GraphicBuffer> first = flattened.unflatten();
+    sp<GraphicBuffer> second = flattened.unflatten();
+    EXPECT_EQ(source->getId(), first->getId());
+    EXPECT_EQ(source->getId(), second->getId());
+    EXPECT_EQ(source->getStride(), second->getStride());
+
+    // the second one may share the import of the first, and must outlive it
+    first.clear();
+    void* vaddr = NULL;
+    ASSERT_EQ(NO_ERROR, second->lock(GraphicBuffer::USAGE_SW_WRITE_OFTEN,
+            &vaddr));
+    EXPECT_TRUE(vaddr != NULL);
+    EXPECT_EQ(NO_ERROR, second->unlock());
+}
+
+TEST(GraphicBufferTest, UnflattenReplacesPreviousBuffer) {
+    sp<GraphicBuffer> source = allocate();
+    FlattenedBuffer flattened(source);
+    sp<GraphicBuffer> buffer = flattened.unflatten();
+
+    sp<GraphicBuffer> otherSource = allocate();
+    FlattenedBuffer other(otherSource);
+    void const* dataPtr = other.data.data();
+    size_t size = other.data.size();
+    std::vector<int> received;
+    for (int fd : other.fds) {
+        received.push_back(dup(fd));
+    }
+    int const* fdsPtr = received.data();
+    size_t count = received.size();
+    ASSERT_EQ(NO_ERROR, buffer->unflatten(dataPtr, size, fdsPtr, count));
+    EXPECT_EQ(otherSource->getId(), buffer->getId());
+
+    // the first import is gone, receiving it again imports it again
+    sp<GraphicBuffer> again = flattened.unflatten();
+    EXPECT_EQ(source->getId(), again->getId());
+    EXPECT_NE(buffer->handle, again->handle);
+    void* vaddr = NULL;
+    ASSERT_EQ(NO_ERROR, again->lock(GraphicBuffer::USAGE_SW_WRITE_OFTEN,
+            &vaddr));
+    EXPECT_EQ(NO_ERROR, again->unlock());
+}
+
+TEST(GraphicBufferTest, ForgedIdDoesNotShareBuffer) {
+    sp<GraphicBuffer> victim = allocate();
+    FlattenedBuffer flattenedVictim(victim);
+    sp<GraphicBuffer> imported = flattenedVictim.unflatten();
+
+    // another buffer claiming to be the one imported above
+    FlattenedBuffer forged(allocate());
+    memcpy(&forged.data[6 * sizeof(int32_t)],
+            &flattenedVictim.data[6 * sizeof(int32_t)], 2 * sizeof(int32_t));
+    sp<GraphicBuffer> received = forged.unflatten();
+    EXPECT_EQ(victim->getId(), received->getId());
+    EXPECT_NE(imported->handle, received->handle);
+}
+
+}; // namespace android
@@ -16,10 +16,14 @@
 
 #define LOG_TAG "RegionTest"
 
+#include <inttypes.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <utility>
 #include <ui/Region.h>
 #include <ui/Rect.h>
 #include <gtest/gtest.h>
+#include <utils/Timers.h>
 
 namespace android {
 
@@ -152,5 +156,141 @@ TEST_F(RegionTest, Random_TJunction) {
     }
 }
 
+static Rect randomRect(int maxCoord, int maxSize) {
+    int l = static_cast<int>(random() % maxCoord);
+    int t = static_cast<int>(random() % maxCoord);
+    return Rect(l, t, l + static_cast<int>(random() % maxSize),
+            t + static_cast<int>(random() % maxSize));
+}
+
+static Region randomRegion(int maxRects) {
+    Region r;
+    int count = static_cast<int>(random() % (maxRects + 1));
+    for (int i = 0; i < count; i++) {
+        r.orSelf(randomRect(X_MAX, X_MAX));
+    }
+    return r;
+}
+
+TEST_F(RegionTest, BooleanOperationsMatchPixels) {
+    srandom(54321);
+
+    // Few rects on a small grid, so that empty, disjoint and nested operands
+    // (which skip the rasterizer) come up as often as overlapping ones.
+    for (int iter = 0; iter < ITER_MAX * 10; iter++) {
+        Region lhs(randomRegion(3));
+        Region rhs(randomRegion(3));
+        if (random() % 4 == 0) {
+            rhs.set(randomRect(X_MAX, X_MAX));
+        }
+        int dx = static_cast<int>(random() % 3) - 1;
+        int dy = static_cast<int>(random() % 3) - 1;
+
+        const Region rhsBounds(rhs.getBounds());
+        const Region results[] = {
+            lhs.merge(rhs, dx, dy),
+            lhs.mergeExclusive(rhs, dx, dy),
+            lhs.intersect(rhs, dx, dy),
+            lhs.subtract(rhs, dx, dy),
+            lhs.intersect(rhs.getBounds()),
+            lhs.subtract(rhs.getBounds()),
+        };
+        for (int x = -1; x <= 2 * X_MAX; x++) {
+            for (int y = -1; y <= 2 * Y_MAX; y++) {
+                bool inLhs = lhs.contains(x, y);
+                bool inRhs = rhs.contains(x - dx, y - dy);
+                bool inBounds = !rhs.isEmpty() && rhsBounds.contains(x, y);
+                ASSERT_EQ(inLhs || inRhs, results[0].contains(x, y));
+                ASSERT_EQ(inLhs != inRhs, results[1].contains(x, y));
+                ASSERT_EQ(inLhs && inRhs, results[2].contains(x, y));
+                ASSERT_EQ(inLhs && !inRhs, results[3].contains(x, y));
+                ASSERT_EQ(inLhs && inBounds, results[4].contains(x, y));
+                ASSERT_EQ(inLhs && !inBounds, results[5].contains(x, y));
+            }
+        }
+        for (const Region& result : results) {
+            if (result.isEmpty()) {
+                EXPECT_EQ(Rect(0, 0), result.getBounds());
+            }
+        }
+    }
+}
+
+TEST_F(RegionTest, CopyMoveAndFlatten) {
+    Region single(Rect(10, 20, 30, 40));
+    Region multi(single);
+    multi.orSelf(Rect(50, 60, 70, 80));
+    ASSERT_TRUE(single.isRect());
+    ASSERT_FALSE(multi.isRect());
+
+    Region copy(single);
+    EXPECT_TRUE(copy.isTriviallyEqual(single));
+    copy.translateSelf(1, 1);
+    EXPECT_FALSE(copy.isTriviallyEqual(single));
+    EXPECT_EQ(Rect(10, 20, 30, 40), single.getBounds());
+
+    Region moved(std::move(copy));
+    EXPECT_EQ(Rect(11, 21, 31, 41), moved.getBounds());
+    EXPECT_TRUE(copy.isEmpty());
+
+    Region multiCopy(multi);
+    EXPECT_TRUE(multiCopy.isTriviallyEqual(multi));
+    moved = std::move(multiCopy);
+    EXPECT_TRUE((moved ^ multi).isEmpty());
+    EXPECT_TRUE(multiCopy.isEmpty());
+    moved.set(Rect(5, 5));
+    EXPECT_TRUE(moved.isRect());
+    EXPECT_EQ(2, multi.end() - multi.begin());
+
+    for (const Region* r : { &single, &multi }) {
+        size_t size = r->getFlattenedSize();
+        uint8_t buffer[64];
+        ASSERT_LE(size, sizeof(buffer));
+        ASSERT_EQ(NO_ERROR, r->flatten(buffer, size));
+        Region unflattened;
+        ASSERT_EQ(NO_ERROR, unflattened.unflatten(buffer, size));
+        EXPECT_EQ(r->isRect(), unflattened.isRect());
+        EXPECT_TRUE((unflattened ^ *r).isEmpty());
+    }
+}
+
+TEST_F(RegionTest, VisibleRegionBenchmark) {
+    // Mirrors SurfaceFlinger::computeVisibleRegions for a stack of
+    // full-screen and inset layers, front to back.
+    static const int kLayers = 8;
+    static const int kFrames = 2000;
+    const Rect screen(1080, 1920);
+    Rect bounds[kLayers];
+    for (int i = 0; i < kLayers; i++) {
+        bounds[i] = (i % 2) ? screen : Rect(0, 64 * i, 1080, 64 * i + 400);
+    }
+
+    nsecs_t start = systemTime();
+    size_t rects = 0;
+    for (int frame = 0; frame < kFrames; frame++) {
+        Region aboveOpaqueLayers;
+        Region aboveCoveredLayers;
+        Region dirty;
+        for (int i = 0; i < kLayers; i++) {
+            Region visibleRegion(bounds[i]);
+            Region coveredRegion(aboveCoveredLayers.intersect(visibleRegion));
+            aboveCoveredLayers.orSelf(visibleRegion);
+            visibleRegion.andSelf(screen);
+            visibleRegion.subtractSelf(aboveOpaqueLayers);
+            dirty.orSelf(visibleRegion.subtract(coveredRegion));
+            if (i % 3 == 0) {
+                aboveOpaqueLayers.orSelf(visibleRegion);
+            }
+            size_t count;
+            visibleRegion.getArray(&count);
+            rects += count;
+        }
+    }
+    nsecs_t elapsed = systemTime() - start;
+    EXPECT_GT(rects, 0u);
+    printf("%d layers: %" PRId64 " ns per frame\n", kLayers,
+            elapsed / kFrames);
+}
+
 }; // namespace android
 
@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <cutils/native_handle.h>
+#include <hardware/gralloc.h>
+
+#include <ui/Gralloc1On0Adapter.h>
+
+#include <string.h>
+
+namespace android {
+
+// A gralloc0 module that does no work, so that what is measured is the
+// adapter's own bookkeeping.
+
+static int fakeAlloc(alloc_device_t* /*dev*/, int /*w*/, int /*h*/,
+        int /*format*/, int /*usage*/, buffer_handle_t* handle, int* stride) {
+    *handle = native_handle_create(0, 0);
+    *stride = 0;
+    return 0;
+}
+
+static int fakeFree(alloc_device_t* /*dev*/, buffer_handle_t handle) {
+    native_handle_delete(const_cast<native_handle_t*>(handle));
+    return 0;
+}
+
+static int fakeCloseDevice(hw_device_t* /*device*/) {
+    return 0;
+}
+
+static alloc_device_t sFakeDevice;
+
+static int fakeOpen(const hw_module_t* module, const char* /*name*/,
+        hw_device_t** device) {
+    memset(&sFakeDevice, 0, sizeof(sFakeDevice));
+    sFakeDevice.common.tag = HARDWARE_DEVICE_TAG;
+    sFakeDevice.common.module = const_cast<hw_module_t*>(module);
+    sFakeDevice.common.close = fakeCloseDevice;
+    sFakeDevice.alloc = fakeAlloc;
+    sFakeDevice.free = fakeFree;
+    *device = &sFakeDevice.common;
+    return 0;
+}
+
+static int fakeRegisterBuffer(gralloc_module_t const* /*module*/,
+        buffer_handle_t /*handle*/) {
+    return 0;
+}
+
+static int fakeLock(gralloc_module_t const* /*module*/,
+        buffer_handle_t /*handle*/, int /*usage*/, int /*l*/, int /*t*/,
+        int /*w*/, int /*h*/, void** vaddr) {
+    static uint32_t pixel;
+    *vaddr = &pixel;
+    return 0;
+}
+
+static int fakeUnlock(gralloc_module_t const* /*module*/,
+        buffer_handle_t /*handle*/) {
+    return 0;
+}
+
+static hw_module_methods_t sFakeMethods = { fakeOpen };
+
+static gralloc_module_t makeFakeModule() {
+    gralloc_module_t module;
+    memset(&module, 0, sizeof(module));
+    module.common.tag = HARDWARE_MODULE_TAG;
+    module.common.module_api_version = GRALLOC_MODULE_API_VERSION_0_2;
+    module.common.id = GRALLOC_HARDWARE_MODULE_ID;
+    module.common.methods = &sFakeMethods;
+    module.registerBuffer = fakeRegisterBuffer;
+    module.unregisterBuffer = fakeRegisterBuffer;
+    module.lock = fakeLock;
+    module.unlock = fakeUnlock;
+    return module;
+}
+
+static gralloc_module_t sFakeModule = makeFakeModule();
+
+struct Gralloc1 {
+    Gralloc1() : adapter(&sFakeModule.common) {
+        auto device = adapter.getDevice();
+        auto get = [device](gralloc1_function_descriptor_t descriptor) {
+            return device->getFunction(device, descriptor);
+        };
+        createDescriptor = reinterpret_cast<GRALLOC1_PFN_CREATE_DESCRIPTOR>(
+                get(GRALLOC1_FUNCTION_CREATE_DESCRIPTOR));
+        destroyDescriptor = reinterpret_cast<GRALLOC1_PFN_DESTROY_DESCRIPTOR>(
+                get(GRALLOC1_FUNCTION_DESTROY_DESCRIPTOR));
+        allocateWithId = reinterpret_cast<GRALLOC1_PFN_ALLOCATE_WITH_ID>(
+                get(GRALLOC1_FUNCTION_ALLOCATE_WITH_ID));
+        retain = reinterpret_cast<GRALLOC1_PFN_RETAIN>(
+                get(GRALLOC1_FUNCTION_RETAIN));
+        release = reinterpret_cast<GRALLOC1_PFN_RELEASE>(
+                get(GRALLOC1_FUNCTION_RELEASE));
+        lock = reinterpret_cast<GRALLOC1_PFN_LOCK>(
+                get(GRALLOC1_FUNCTION_LOCK));
+        unlock = reinterpret_cast<GRALLOC1_PFN_UNLOCK>(
+                get(GRALLOC1_FUNCTION_UNLOCK));
+    }
+
+    buffer_handle_t allocate() {
+        auto device = adapter.getDevice();
+        gralloc1_buffer_descriptor_t descriptor = 0;
+        createDescriptor(device, &descriptor);
+        buffer_handle_t handle = nullptr;
+        allocateWithId(device, descriptor, 0, &handle);
+        destroyDescriptor(device, descriptor);
+        return handle;
+    }
+
+    Gralloc1On0Adapter adapter;
+    GRALLOC1_PFN_CREATE_DESCRIPTOR createDescriptor;
+    GRALLOC1_PFN_DESTROY_DESCRIPTOR destroyDescriptor;
+    GRALLOC1_PFN_ALLOCATE_WITH_ID allocateWithId;
+    GRALLOC1_PFN_RETAIN retain;
+    GRALLOC1_PFN_RELEASE release;
+    GRALLOC1_PFN_LOCK lock;
+    GRALLOC1_PFN_UNLOCK unlock;
+};
+
+static Gralloc1& getGralloc1() {
+    static Gralloc1* gralloc1 = new Gralloc1();
+    return *gralloc1;
+}
+
+// Each thread works on its own buffers; with several threads this shows
+// whether they wait for each other in the adapter.
+static void BM_RetainRelease(benchmark::State& state) {
+    Gralloc1& gralloc1 = getGralloc1();
+    auto device = gralloc1.adapter.getDevice();
+    buffer_handle_t handle = gralloc1.allocate();
+    while (state.KeepRunning()) {
+        gralloc1.retain(device, handle);
+        gralloc1.release(device, handle);
+    }
+    gralloc1.release(device, handle);
+}
+BENCHMARK(BM_RetainRelease)->ThreadRange(1, 4);
+
+static void BM_LockUnlock(benchmark::State& state) {
+    Gralloc1& gralloc1 = getGralloc1();
+    auto device = gralloc1.adapter.getDevice();
+    buffer_handle_t handle = gralloc1.allocate();
+    const gralloc1_rect_t region = { 0, 0, 1, 1 };
+    while (state.KeepRunning()) {
+        void* data = nullptr;
+        int32_t releaseFence = -1;
+        gralloc1.lock(device, handle, GRALLOC1_PRODUCER_USAGE_CPU_WRITE,
+                GRALLOC1_CONSUMER_USAGE_NONE, &region, &data, -1);
+        gralloc1.unlock(device, handle, &releaseFence);
+        benchmark::DoNotOptimize(data);
+    }
+    gralloc1.release(device, handle);
+}
+BENCHMARK(BM_LockUnlock)->ThreadRange(1, 4);
+
+// A producer cycling through its queue of buffers, so that consecutive
+// lookups are for different handles.
+static void BM_LockUnlockRotating(benchmark::State& state) {
+    Gralloc1& gralloc1 = getGralloc1();
+    auto device = gralloc1.adapter.getDevice();
+    constexpr size_t NUM_BUFFERS = 3;
+    buffer_handle_t handles[NUM_BUFFERS];
+    for (auto& handle : handles) {
+        handle = gralloc1.allocate();
+    }
+    const gralloc1_rect_t region = { 0, 0, 1, 1 };
+    size_t next = 0;
+    while (state.KeepRunning()) {
+        void* data = nullptr;
+        int32_t releaseFence = -1;
+        gralloc1.lock(device, handles[next], GRALLOC1_PRODUCER_USAGE_CPU_WRITE,
+                GRALLOC1_CONSUMER_USAGE_NONE, &region, &data, -1);
+        gralloc1.unlock(device, handles[next], &releaseFence);
+        benchmark::DoNotOptimize(data);
+        next = (next + 1) % NUM_BUFFERS;
+    }
+    for (auto handle : handles) {
+        gralloc1.release(device, handle);
+    }
+}
+BENCHMARK(BM_LockUnlockRotating)->ThreadRange(1, 4);
+
+}; // namespace android
+
+BENCHMARK_MAIN();
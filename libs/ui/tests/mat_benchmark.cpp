@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <ui/mat4.h>
+
+namespace android {
+
+// The same kind of matrices SurfaceFlinger works with: projections, color
+// transforms and texture transforms.
+static mat4 makeMatrix() {
+    return mat4::ortho(0, 1080, 1920, 0, 0, 1) *
+            mat4::rotate(0.25f, vec3(0, 0, 1)) *
+            mat4::scale(vec4(0.5f, -1, 1, 1));
+}
+
+static void BM_MatrixVector(benchmark::State& state) {
+    const mat4 m(makeMatrix());
+    vec4 v(1, 2, 3, 1);
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(v = m * v);
+    }
+}
+BENCHMARK(BM_MatrixVector);
+
+static void BM_MatrixMatrix(benchmark::State& state) {
+    const mat4 lhs(makeMatrix());
+    mat4 m(makeMatrix());
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(m = lhs * m);
+    }
+}
+BENCHMARK(BM_MatrixMatrix);
+
+static void BM_Transpose(benchmark::State& state) {
+    mat4 m(makeMatrix());
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(m = transpose(m));
+    }
+}
+BENCHMARK(BM_Transpose);
+
+static void BM_Inverse(benchmark::State& state) {
+    mat4 m(makeMatrix());
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(m = inverse(m));
+    }
+}
+BENCHMARK(BM_Inverse);
+
+// tmat44<double> still goes through the generic loops of TMatHelpers.h
+static void BM_InverseGeneric(benchmark::State& state) {
+    tmat44<double> m(makeMatrix());
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(m = inverse(m));
+    }
+}
+BENCHMARK(BM_InverseGeneric);
+
+}; // namespace android
+
+BENCHMARK_MAIN();
@@ -74,6 +74,27 @@ TEST_F(MatTest, Constructors) {
     mat4 m4(vec4(1), vec4(2), vec4(3), vec4(4));
 }
 
+TEST_F(MatTest, ConstexprConstructors) {
+    constexpr mat4 m0;
+    static_assert(m0[0].x == 1 && m0[1].y == 1 && m0[2].z == 1 && m0[3].w == 1, "identity");
+    static_assert(m0[0].y == 0 && m0[3].x == 0, "identity");
+
+    constexpr mat4 m1(2);
+    static_assert(m1[1].y == 2 && m1[1].x == 0, "scalar");
+
+    constexpr mat4 m2(vec4(1,2,3,4));
+    static_assert(m2[0].x == 1 && m2[3].w == 4 && m2[2].w == 0, "diagonal");
+
+    constexpr mat4 m3(vec4(1,2,3,4), vec4(5,6,7,8), vec4(9,10,11,12), vec4(13,14,15,16));
+    constexpr mat4 m4(1,2,3,4, 5,6,7,8, 9,10,11,12, 13,14,15,16);
+    static_assert(m3[1].z == 7 && m4[1].z == 7 && m4[3].x == 13, "columns");
+
+    constexpr tmat44<double> m5(m4);
+    static_assert(m5[2].y == 10, "conversion");
+
+    EXPECT_EQ(m3, m4);
+}
+
 TEST_F(MatTest, ArithmeticOps) {
     mat4 m0;
     mat4 m1(2);
@@ -136,4 +157,32 @@ TEST_F(MatTest, MiscOps) {
     EXPECT_EQ(m1, m1*identity);
 }
 
+// mat4 has its own kernels, compare them with the generic ones tmat44<double> uses.
+TEST_F(MatTest, Kernels) {
+    const mat4 m0(vec4(2,1,0,3), vec4(-1,4,2,0), vec4(0.5,0,3,1), vec4(1,-2,1,5));
+    const mat4 m1(mat4::rotate(0.5f, vec3(1,2,3)) * mat4::translate(vec4(1,2,3,1)));
+    const tmat44<double> d0(m0);
+    const tmat44<double> d1(m1);
+
+    const mat4 product(m0 * m1);
+    const tmat44<double> dproduct(d0 * d1);
+    const vec4 v(m0 * vec4(1,2,3,4));
+    const tvec4<double> dv(d0 * tvec4<double>(1,2,3,4));
+    const mat4 t(transpose(m0));
+    const mat4 i0(inverse(m0));
+    const mat4 i1(inverse(m1));
+    const tmat44<double> di0(inverse(d0));
+    const tmat44<double> di1(inverse(d1));
+
+    for (size_t c=0 ; c<4 ; c++) {
+        EXPECT_FLOAT_EQ(dv[c], v[c]);
+        for (size_t r=0 ; r<4 ; r++) {
+            EXPECT_FLOAT_EQ(dproduct[c][r], product[c][r]);
+            EXPECT_EQ(m0[r][c], t[c][r]);
+            EXPECT_NEAR(di0[c][r], i0[c][r], 1e-6);
+            EXPECT_NEAR(di1[c][r], i1[c][r], 1e-6);
+        }
+    }
+}
+
 }; // namespace android
@@ -67,6 +67,35 @@ etc1_uint32 etc1_get_encoded_data_size(etc1_uint32 width, etc1_uint32 height);
 int etc1_encode_image(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 height,
         etc1_uint32 pixelSize, etc1_uint32 stride, etc1_byte* pOut);
 
+// Encoding quality. ETC1_QUALITY_HIGH searches both sub-block orientations and
+// all modifier tables, as etc1_encode_block() and etc1_encode_image() do.
+// ETC1_QUALITY_FAST picks the orientation and only tries the modifier tables
+// close to the spread of each sub-block's colors, which is several times
+// faster for a small loss of accuracy.
+
+#define ETC1_QUALITY_FAST 0
+#define ETC1_QUALITY_HIGH 1
+
+// Encode the block rows [firstRow, firstRow + rowCount) of an image, a block row
+// being 4 pixels high. Disjoint ranges can be encoded concurrently.
+// pOut - pointer to the encoded data of the entire image.
+// Other parameters are as for etc1_encode_image().
+// returns non-zero if there is an error.
+
+int etc1_encode_image_rows(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 height,
+        etc1_uint32 pixelSize, etc1_uint32 stride, etc1_byte* pOut,
+        etc1_uint32 firstRow, etc1_uint32 rowCount, int quality);
+
+// Encode an entire image, splitting its block rows between up to threadCount
+// threads, the calling thread being one of them. Parameters are as for
+// etc1_encode_image(). Threads are not available on Windows, where the image is
+// encoded on the calling thread.
+// returns non-zero if there is an error.
+
+int etc1_encode_image_threaded(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 height,
+        etc1_uint32 pixelSize, etc1_uint32 stride, etc1_byte* pOut,
+        int quality, etc1_uint32 threadCount);
+
 // Decode an entire image.
 // pIn - pointer to encoded data.
 // pOut - pointer to the image data. Will be written such that
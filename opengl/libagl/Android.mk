@@ -8,6 +8,7 @@ include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES:= \
 	egl.cpp                     \
+	binning.cpp                 \
 	state.cpp		            \
 	texture.cpp		            \
     Tokenizer.cpp               \
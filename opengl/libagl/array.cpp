@@ -968,17 +968,28 @@ void compileElements__generic(ogles_context_t* c,
     const GLubyte* vp = c->arrays.vertex.element(
             first & vertex_cache_t::INDEX_MASK);
     const size_t stride = c->arrays.vertex.stride;
-    transform_t const* const mvp = &c->transforms.mvp;
+    vertex_t* const vertices = v;
+
+    // fetch, transform and project the whole batch in turn, which lets the
+    // transform keep the matrix in registers across vertices.
+    GLsizei n = count;
     do {
         v->flags = 0;
         v->index = first++;
         v->obj.z = 0;
         v->obj.w = 0x10000;
         c->arrays.vertex.fetch(c, v->obj.v, vp);
-        c->arrays.mvp_transform(mvp, &v->clip, &v->obj);
-        c->arrays.perspective(c, v);
         vp += stride;
         v++;
+    } while (--n);
+
+    c->arrays.mvp_transforms(&c->transforms.mvp,
+            &vertices->clip, &vertices->obj, sizeof(vertex_t), count);
+
+    v = vertices;
+    do {
+        c->arrays.perspective(c, v);
+        v++;
     } while (--count);
 }
 
@@ -1141,6 +1152,9 @@ void validate_arrays(ogles_context_t* c, GLenum mode)
     c->arrays.mvp_transform =
         c->transforms.mvp.pointv[c->arrays.vertex.size - 2];
 
+    c->arrays.mvp_transforms =
+        c->transforms.mvp.pointsv[c->arrays.vertex.size - 2];
+
     c->arrays.mv_transform =
         c->transforms.modelview.transform.pointv[c->arrays.vertex.size - 2];
 
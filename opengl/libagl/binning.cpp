@@ -0,0 +1,913 @@
+/* libs/opengles/binning.cpp
+**
+** Copyright 2016, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+#include <utils/Condition.h>
+#include <utils/Mutex.h>
+#include <utils/Vector.h>
+
+#include "context.h"
+#include "binning.h"
+#include "TextureObjectManager.h"
+
+namespace android {
+
+// ----------------------------------------------------------------------------
+
+// upper bound of the number of rasterizer threads of a context
+static const int MAX_WORKERS = 8;
+// when the property doesn't say, one thread per CPU up to this many
+static const int DEFAULT_MAX_WORKERS = 4;
+
+// tiles are bands of (1<<TILE_SHIFT) rows of the color buffer
+static const int TILE_SHIFT = 5;
+
+// calls are recorded in a ring of batches, a batch is handed to the
+// rasterizer threads when it's full or when the application flushes.
+static const uint32_t NUM_BATCHES = 4;
+static const size_t BATCH_WORDS = 16384;
+
+// each recorded call is a word holding the opcode and the number of
+// argument words, followed by the arguments. Drawing calls start with
+// the first and last row they may touch.
+enum {
+    OP_COLOR_BUFFER,
+    OP_READ_BUFFER,
+    OP_DEPTH_BUFFER,
+    OP_BIND_TEXTURE,
+    OP_BIND_TEXTURE_LOD,
+    OP_ACTIVE_TEXTURE,
+    OP_SCISSOR,
+    OP_ENABLE,
+    OP_SHADE_MODEL,
+    OP_COLOR,
+    OP_COLOR_GRAD,
+    OP_Z_GRAD,
+    OP_W_GRAD,
+    OP_FOG_GRAD,
+    OP_FOG_COLOR,
+    OP_BLEND_FUNC,
+    OP_TEX_ENVI,
+    OP_TEX_ENVXV,
+    OP_TEX_PARAMETERI,
+    OP_TEX_COORD_2I,
+    OP_TEX_COORD_GRAD_SCALE,
+    OP_TEX_GENI,
+    OP_COLOR_MASK,
+    OP_DEPTH_MASK,
+    OP_STENCIL_MASK,
+    OP_ALPHA_FUNC,
+    OP_DEPTH_FUNC,
+    OP_LOGIC_OP,
+    OP_CLEAR_COLOR,
+    OP_CLEAR_DEPTH,
+    OP_CLEAR_STENCIL,
+    OP_CLEAR,
+    OP_POINT,
+    OP_LINE,
+    OP_RECT,
+    OP_TRIANGLE,
+};
+
+static const size_t SURFACE_WORDS = (sizeof(GGLSurface) + 3) / 4;
+
+struct batch_t {
+    uint32_t*                   data;
+    size_t                      used;
+    // textures to release once the batch has been rasterized
+    Vector<EGLTextureObject*>   textures;
+};
+
+struct worker_t {
+    binning_t*      binning;
+    int             index;
+    pthread_t       thread;
+    GGLContext*     ggl;
+    // the rasterizer's own scissor test is always enabled and set to the
+    // tile being drawn, intersected with the scissor of the application.
+    bool            scissorTest;
+    GGLint          scissor[4];
+    GGLint          width;
+    GGLint          height;
+    int             tile;
+    bool            tileVisible;
+};
+
+namespace gl {
+
+struct binning_t {
+    // entry points of the context's rasterizer we replaced
+    GGLContext      procs;
+    int             numWorkers;
+    worker_t        workers[MAX_WORKERS];
+    batch_t         batches[NUM_BATCHES];
+    batch_t*        current;
+
+    Mutex           lock;
+    Condition       submittedCondition;
+    Condition       completedCondition;
+    // batches handed to the workers, and batches all workers are done with.
+    // Workers replay the batches in order, so they also complete in order.
+    uint32_t        submitted;
+    uint32_t        completed;
+    int             pending[NUM_BATCHES];
+    bool            quit;
+};
+
+}; // namespace gl
+
+// ----------------------------------------------------------------------------
+#if 0
+#pragma mark -
+#pragma mark Rasterizer threads
+#endif
+
+static bool set_tile(worker_t* w, int tile)
+{
+    if (tile == w->tile)
+        return w->tileVisible;
+    w->tile = tile;
+
+    GGLint l = 0;
+    GGLint t = tile << TILE_SHIFT;
+    GGLint r = w->width;
+    GGLint b = t + (1 << TILE_SHIFT);
+    if (w->scissorTest) {
+        l = max(l, w->scissor[0]);
+        t = max(t, w->scissor[1]);
+        r = min(r, w->scissor[0] + w->scissor[2]);
+        b = min(b, w->scissor[1] + w->scissor[3]);
+    }
+    w->tileVisible = (l < r) && (t < b);
+    if (w->tileVisible) {
+        w->ggl->scissor(w->ggl, l, t, r - l, b - t);
+    }
+    return w->tileVisible;
+}
+
+// returns the first tile of this worker overlapping rows top to bottom, and
+// the last tile, which is smaller when there are none.
+static int first_tile(const worker_t* w, GGLint top, GGLint bottom, int* last)
+{
+    top = max(top, 0);
+    bottom = min(bottom, w->height - 1);
+    if (top > bottom) {
+        *last = -1;
+        return 0;
+    }
+    const int n = w->binning->numWorkers;
+    const int first = top >> TILE_SHIFT;
+    *last = bottom >> TILE_SHIFT;
+    return first + (w->index - first % n + n) % n;
+}
+
+#define FOR_EACH_TILE(w, top, bottom)                           \
+    for (int last_, tile_ = first_tile(w, top, bottom, &last_); \
+            tile_ <= last_; tile_ += (w)->binning->numWorkers)  \
+        if (set_tile(w, tile_))
+
+static void enable_disable(worker_t* w, GGLenum name, GGLboolean en)
+{
+    if (name == GL_SCISSOR_TEST) {
+        w->scissorTest = en;
+        w->tile = -1;
+    } else {
+        w->ggl->enableDisable(w->ggl, name, en);
+    }
+}
+
+static void replay(worker_t* w, const uint32_t* p, size_t used)
+{
+    GGLContext* const ggl = w->ggl;
+    const uint32_t* const end = p + used;
+    while (p < end) {
+        const uint32_t op = p[0] & 0xFFFF;
+        const GGLint* const a = reinterpret_cast<const GGLint*>(p + 1);
+        p += 1 + (p[0] >> 16);
+
+        GGLSurface s;
+        switch (op) {
+        case OP_COLOR_BUFFER:
+            memcpy(&s, a, sizeof(s));
+            ggl->colorBuffer(ggl, &s);
+            w->width = s.width;
+            w->height = s.height;
+            w->tile = -1;
+            break;
+        case OP_READ_BUFFER:
+            memcpy(&s, a, sizeof(s));
+            ggl->readBuffer(ggl, &s);
+            break;
+        case OP_DEPTH_BUFFER:
+            memcpy(&s, a, sizeof(s));
+            ggl->depthBuffer(ggl, &s);
+            break;
+        case OP_BIND_TEXTURE:
+            memcpy(&s, a, sizeof(s));
+            ggl->bindTexture(ggl, &s);
+            break;
+        case OP_BIND_TEXTURE_LOD:
+            memcpy(&s, a + 1, sizeof(s));
+            ggl->bindTextureLod(ggl, a[0], &s);
+            break;
+        case OP_ACTIVE_TEXTURE:
+            ggl->activeTexture(ggl, a[0]);
+            break;
+        case OP_SCISSOR:
+            memcpy(w->scissor, a, sizeof(w->scissor));
+            w->tile = -1;
+            break;
+        case OP_ENABLE:
+            enable_disable(w, a[0], a[1]);
+            break;
+        case OP_SHADE_MODEL:
+            ggl->shadeModel(ggl, a[0]);
+            break;
+        case OP_COLOR:
+            ggl->color4xv(ggl, a);
+            break;
+        case OP_COLOR_GRAD:
+            ggl->colorGrad12xv(ggl, a);
+            break;
+        case OP_Z_GRAD:
+            ggl->zGrad3xv(ggl, reinterpret_cast<const GGLfixed32*>(a));
+            break;
+        case OP_W_GRAD:
+            ggl->wGrad3xv(ggl, a);
+            break;
+        case OP_FOG_GRAD:
+            ggl->fogGrad3xv(ggl, a);
+            break;
+        case OP_FOG_COLOR:
+            ggl->fogColor3xv(ggl, a);
+            break;
+        case OP_BLEND_FUNC:
+            ggl->blendFunc(ggl, a[0], a[1]);
+            break;
+        case OP_TEX_ENVI:
+            ggl->texEnvi(ggl, a[0], a[1], a[2]);
+            break;
+        case OP_TEX_ENVXV:
+            ggl->texEnvxv(ggl, a[0], a[1], a + 2);
+            break;
+        case OP_TEX_PARAMETERI:
+            ggl->texParameteri(ggl, a[0], a[1], a[2]);
+            break;
+        case OP_TEX_COORD_2I:
+            ggl->texCoord2i(ggl, a[0], a[1]);
+            break;
+        case OP_TEX_COORD_GRAD_SCALE:
+            ggl->texCoordGradScale8xv(ggl, a[0], a + 1);
+            break;
+        case OP_TEX_GENI:
+            ggl->texGeni(ggl, a[0], a[1], a[2]);
+            break;
+        case OP_COLOR_MASK:
+            ggl->colorMask(ggl, a[0], a[1], a[2], a[3]);
+            break;
+        case OP_DEPTH_MASK:
+            ggl->depthMask(ggl, a[0]);
+            break;
+        case OP_STENCIL_MASK:
+            ggl->stencilMask(ggl, a[0]);
+            break;
+        case OP_ALPHA_FUNC:
+            ggl->alphaFuncx(ggl, a[0], a[1]);
+            break;
+        case OP_DEPTH_FUNC:
+            ggl->depthFunc(ggl, a[0]);
+            break;
+        case OP_LOGIC_OP:
+            ggl->logicOp(ggl, a[0]);
+            break;
+        case OP_CLEAR_COLOR:
+            ggl->clearColorx(ggl, a[0], a[1], a[2], a[3]);
+            break;
+        case OP_CLEAR_DEPTH:
+            ggl->clearDepthx(ggl, a[0]);
+            break;
+        case OP_CLEAR_STENCIL:
+            ggl->clearStencil(ggl, a[0]);
+            break;
+        case OP_CLEAR:
+            FOR_EACH_TILE(w, a[0], a[1])
+                ggl->clear(ggl, a[2]);
+            break;
+        case OP_POINT:
+            FOR_EACH_TILE(w, a[0], a[1])
+                ggl->pointx(ggl, a + 2, a[4]);
+            break;
+        case OP_LINE:
+            FOR_EACH_TILE(w, a[0], a[1])
+                ggl->linex(ggl, a + 2, a + 4, a[6]);
+            break;
+        case OP_RECT:
+            FOR_EACH_TILE(w, a[0], a[1])
+                ggl->recti(ggl, a[2], a[3], a[4], a[5]);
+            break;
+        case OP_TRIANGLE:
+            FOR_EACH_TILE(w, a[0], a[1])
+                ggl->trianglex(ggl, a + 2, a + 4, a + 6);
+            break;
+        default:
+            LOG_ALWAYS_FATAL("unknown recorded rasterizer call %u", op);
+        }
+    }
+}
+
+static void* worker_loop(void* arg)
+{
+    worker_t* const w = static_cast<worker_t*>(arg);
+    binning_t* const b = w->binning;
+    uint32_t next = 0;
+    for (;;) {
+        const batch_t* batch;
+        { // acquire the next batch
+            Mutex::Autolock _l(b->lock);
+            while (next == b->submitted && !b->quit)
+                b->submittedCondition.wait(b->lock);
+            if (next == b->submitted)
+                break;
+            batch = &b->batches[next % NUM_BATCHES];
+        }
+
+        replay(w, batch->data, batch->used);
+
+        { // and release it
+            Mutex::Autolock _l(b->lock);
+            if (--b->pending[next % NUM_BATCHES] == 0) {
+                b->completed++;
+                b->completedCondition.broadcast();
+            }
+        }
+        next++;
+    }
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+#if 0
+#pragma mark -
+#pragma mark Recording
+#endif
+
+static void release_textures(ogles_context_t* c, batch_t* batch)
+{
+    const size_t count = batch->textures.size();
+    for (size_t i=0 ; i<count ; i++) {
+        batch->textures[i]->decStrong(c);
+    }
+    batch->textures.clear();
+}
+
+static void submit(ogles_context_t* c)
+{
+    binning_t* const b = c->binning;
+    if (!b->current->used)
+        return;
+
+    Mutex::Autolock _l(b->lock);
+    b->pending[b->submitted % NUM_BATCHES] = b->numWorkers;
+    b->submitted++;
+    b->submittedCondition.broadcast();
+
+    // wait for the next batch of the ring to be free
+    while (b->submitted - b->completed >= NUM_BATCHES)
+        b->completedCondition.wait(b->lock);
+    b->current = &b->batches[b->submitted % NUM_BATCHES];
+    b->current->used = 0;
+    release_textures(c, b->current);
+}
+
+static uint32_t* record(ogles_context_t* c, uint32_t op, size_t words)
+{
+    binning_t* const b = c->binning;
+    if (ggl_unlikely(b->current->used + 1 + words > BATCH_WORDS))
+        submit(c);
+    batch_t* const batch = b->current;
+    uint32_t* const p = batch->data + batch->used;
+    p[0] = op | (uint32_t(words) << 16);
+    batch->used += 1 + words;
+    return p + 1;
+}
+
+static inline void record_ints(void* con, uint32_t op,
+        const GGLint* v, size_t count)
+{
+    ogles_context_t* const c = static_cast<ogles_context_t*>(con);
+    memcpy(record(c, op, count), v, count * 4);
+}
+
+static inline void record_surface(void* con, uint32_t op,
+        const GGLSurface* surface)
+{
+    ogles_context_t* const c = static_cast<ogles_context_t*>(con);
+    memcpy(record(c, op, SURFACE_WORDS), surface, sizeof(GGLSurface));
+}
+
+static inline uint32_t* record_draw(void* con, uint32_t op, size_t words,
+        GGLint top, GGLint bottom)
+{
+    ogles_context_t* const c = static_cast<ogles_context_t*>(con);
+    uint32_t* const p = record(c, op, 2 + words);
+    p[0] = top;
+    p[1] = bottom;
+    return p + 2;
+}
+
+static inline GGLContext& original(void* con) {
+    return static_cast<ogles_context_t*>(con)->binning->procs;
+}
+
+static void install_draw_procs(GGLContext& procs);
+
+// State changes are applied to the context's own rasterizer too, so that
+// libagl keeps reading the current state from it. Pixelflinger points the
+// drawing entry points back at its validation functions when its state
+// changes, so put ours back.
+static inline void forwarded(void* con) {
+    install_draw_procs(static_cast<ogles_context_t*>(con)->rasterizer.procs);
+}
+
+static void bin_colorBuffer(void* con, const GGLSurface* surface) {
+    original(con).colorBuffer(con, surface);
+    forwarded(con);
+    record_surface(con, OP_COLOR_BUFFER, surface);
+}
+
+static void bin_readBuffer(void* con, const GGLSurface* surface) {
+    original(con).readBuffer(con, surface);
+    forwarded(con);
+    record_surface(con, OP_READ_BUFFER, surface);
+}
+
+static void bin_depthBuffer(void* con, const GGLSurface* surface) {
+    original(con).depthBuffer(con, surface);
+    forwarded(con);
+    record_surface(con, OP_DEPTH_BUFFER, surface);
+}
+
+static void bin_bindTexture(void* con, const GGLSurface* surface) {
+    original(con).bindTexture(con, surface);
+    forwarded(con);
+    record_surface(con, OP_BIND_TEXTURE, surface);
+}
+
+static void bin_bindTextureLod(void* con, GGLuint tmu,
+        const GGLSurface* surface) {
+    original(con).bindTextureLod(con, tmu, surface);
+    forwarded(con);
+    ogles_context_t* const c = static_cast<ogles_context_t*>(con);
+    uint32_t* p = record(c, OP_BIND_TEXTURE_LOD, 1 + SURFACE_WORDS);
+    p[0] = tmu;
+    memcpy(p + 1, surface, sizeof(GGLSurface));
+}
+
+static void bin_activeTexture(void* con, GGLuint tmu) {
+    original(con).activeTexture(con, tmu);
+    forwarded(con);
+    const GGLint v[] = { GGLint(tmu) };
+    record_ints(con, OP_ACTIVE_TEXTURE, v, 1);
+}
+
+static void bin_scissor(void* con,
+        GGLint x, GGLint y, GGLsizei width, GGLsizei height) {
+    original(con).scissor(con, x, y, width, height);
+    forwarded(con);
+    const GGLint v[] = { x, y, width, height };
+    record_ints(con, OP_SCISSOR, v, 4);
+}
+
+static void bin_enableDisable(void* con, GGLenum name, GGLboolean en) {
+    original(con).enableDisable(con, name, en);
+    forwarded(con);
+    const GGLint v[] = { GGLint(name), en };
+    record_ints(con, OP_ENABLE, v, 2);
+}
+
+static void bin_enable(void* con, GGLenum name) {
+    bin_enableDisable(con, name, 1);
+}
+
+static void bin_disable(void* con, GGLenum name) {
+    bin_enableDisable(con, name, 0);
+}
+
+static void bin_shadeModel(void* con, GGLenum mode) {
+    original(con).shadeModel(con, mode);
+    forwarded(con);
+    const GGLint v[] = { GGLint(mode) };
+    record_ints(con, OP_SHADE_MODEL, v, 1);
+}
+
+// Iterators are only used when drawing, they don't need to be forwarded.
+
+static void bin_color4xv(void* con, const GGLclampx* color) {
+    record_ints(con, OP_COLOR, color, 4);
+}
+
+static void bin_colorGrad12xv(void* con, const GGLcolor* grad) {
+    record_ints(con, OP_COLOR_GRAD, grad, 12);
+}
+
+static void bin_zGrad3xv(void* con, const GGLfixed32* grad) {
+    record_ints(con, OP_Z_GRAD, reinterpret_cast<const GGLint*>(grad), 3);
+}
+
+static void bin_wGrad3xv(void* con, const GGLfixed* grad) {
+    record_ints(con, OP_W_GRAD, grad, 3);
+}
+
+static void bin_fogGrad3xv(void* con, const GGLfixed* grad) {
+    record_ints(con, OP_FOG_GRAD, grad, 3);
+}
+
+static void bin_texCoord2i(void* con, GGLint s, GGLint t) {
+    const GGLint v[] = { s, t };
+    record_ints(con, OP_TEX_COORD_2I, v, 2);
+}
+
+static void bin_texCoordGradScale8xv(void* con, GGLint tmu,
+        const int32_t* grad8) {
+    ogles_context_t* const c = static_cast<ogles_context_t*>(con);
+    uint32_t* p = record(c, OP_TEX_COORD_GRAD_SCALE, 9);
+    p[0] = tmu;
+    memcpy(p + 1, grad8, 8 * 4);
+}
+
+static void bin_fogColor3xv(void* con, const GGLclampx* color) {
+    original(con).fogColor3xv(con, color);
+    forwarded(con);
+    record_ints(con, OP_FOG_COLOR, color, 3);
+}
+
+static void bin_blendFunc(void* con, GGLenum src, GGLenum dst) {
+    original(con).blendFunc(con, src, dst);
+    forwarded(con);
+    const GGLint v[] = { GGLint(src), GGLint(dst) };
+    record_ints(con, OP_BLEND_FUNC, v, 2);
+}
+
+static void bin_texEnvi(void* con,
+        GGLenum target, GGLenum pname, GGLint param) {
+    original(con).texEnvi(con, target, pname, param);
+    forwarded(con);
+    const GGLint v[] = { GGLint(target), GGLint(pname), param };
+    record_ints(con, OP_TEX_ENVI, v, 3);
+}
+
+static void bin_texEnvxv(void* con,
+        GGLenum target, GGLenum pname, const GGLfixed* params) {
+    original(con).texEnvxv(con, target, pname, params);
+    forwarded(con);
+    const size_t count = (pname == GL_TEXTURE_ENV_COLOR) ? 4 : 1;
+    ogles_context_t* const c = static_cast<ogles_context_t*>(con);
+    uint32_t* p = record(c, OP_TEX_ENVXV, 2 + count);
+    p[0] = target;
+    p[1] = pname;
+    memcpy(p + 2, params, count * 4);
+}
+
+static void bin_texParameteri(void* con,
+        GGLenum target, GGLenum pname, GGLint param) {
+    original(con).texParameteri(con, target, pname, param);
+    forwarded(con);
+    const GGLint v[] = { GGLint(target), GGLint(pname), param };
+    record_ints(con, OP_TEX_PARAMETERI, v, 3);
+}
+
+static void bin_texGeni(void* con,
+        GGLenum coord, GGLenum pname, GGLint param) {
+    original(con).texGeni(con, coord, pname, param);
+    forwarded(con);
+    const GGLint v[] = { GGLint(coord), GGLint(pname), param };
+    record_ints(con, OP_TEX_GENI, v, 3);
+}
+
+static void bin_colorMask(void* con, GGLboolean red, GGLboolean green,
+        GGLboolean blue, GGLboolean alpha) {
+    original(con).colorMask(con, red, green, blue, alpha);
+    forwarded(con);
+    const GGLint v[] = { red, green, blue, alpha };
+    record_ints(con, OP_COLOR_MASK, v, 4);
+}
+
+static void bin_depthMask(void* con, GGLboolean flag) {
+    original(con).depthMask(con, flag);
+    forwarded(con);
+    const GGLint v[] = { flag };
+    record_ints(con, OP_DEPTH_MASK, v, 1);
+}
+
+static void bin_stencilMask(void* con, GGLuint mask) {
+    original(con).stencilMask(con, mask);
+    forwarded(con);
+    const GGLint v[] = { GGLint(mask) };
+    record_ints(con, OP_STENCIL_MASK, v, 1);
+}
+
+static void bin_alphaFuncx(void* con, GGLenum func, GGLclampx ref) {
+    original(con).alphaFuncx(con, func, ref);
+    forwarded(con);
+    const GGLint v[] = { GGLint(func), ref };
+    record_ints(con, OP_ALPHA_FUNC, v, 2);
+}
+
+static void bin_depthFunc(void* con, GGLenum func) {
+    original(con).depthFunc(con, func);
+    forwarded(con);
+    const GGLint v[] = { GGLint(func) };
+    record_ints(con, OP_DEPTH_FUNC, v, 1);
+}
+
+static void bin_logicOp(void* con, GGLenum opcode) {
+    original(con).logicOp(con, opcode);
+    forwarded(con);
+    const GGLint v[] = { GGLint(opcode) };
+    record_ints(con, OP_LOGIC_OP, v, 1);
+}
+
+static void bin_clearColorx(void* con,
+        GGLclampx r, GGLclampx g, GGLclampx b, GGLclampx a) {
+    original(con).clearColorx(con, r, g, b, a);
+    forwarded(con);
+    const GGLint v[] = { r, g, b, a };
+    record_ints(con, OP_CLEAR_COLOR, v, 4);
+}
+
+static void bin_clearDepthx(void* con, GGLclampx depth) {
+    original(con).clearDepthx(con, depth);
+    forwarded(con);
+    const GGLint v[] = { depth };
+    record_ints(con, OP_CLEAR_DEPTH, v, 1);
+}
+
+static void bin_clearStencil(void* con, GGLint s) {
+    original(con).clearStencil(con, s);
+    forwarded(con);
+    const GGLint v[] = { s };
+    record_ints(con, OP_CLEAR_STENCIL, v, 1);
+}
+
+// Drawing calls are only recorded, along with the rows they may touch.
+// Coordinates are in TRI_FRACTION_BITS fixed point, the extents are padded
+// by a row so that rounding never misses one.
+
+static inline GGLint row_of(GGLcoord y) {
+    return y >> TRI_FRACTION_BITS;
+}
+
+static void bin_clear(void* con, GGLbitfield mask) {
+    uint32_t* p = record_draw(con, OP_CLEAR, 1, 0, 0x7FFFFFFF);
+    p[0] = mask;
+}
+
+static void bin_pointx(void* con, const GGLcoord* v, GGLcoord r) {
+    uint32_t* p = record_draw(con, OP_POINT, 3,
+            row_of(v[1] - r) - 1, row_of(v[1] + r) + 1);
+    p[0] = v[0];
+    p[1] = v[1];
+    p[2] = r;
+}
+
+static void bin_linex(void* con,
+        const GGLcoord* v0, const GGLcoord* v1, GGLcoord width) {
+    uint32_t* p = record_draw(con, OP_LINE, 5,
+            row_of(min(v0[1], v1[1]) - width) - 1,
+            row_of(max(v0[1], v1[1]) + width) + 1);
+    p[0] = v0[0];
+    p[1] = v0[1];
+    p[2] = v1[0];
+    p[3] = v1[1];
+    p[4] = width;
+}
+
+static void bin_recti(void* con, GGLint l, GGLint t, GGLint r, GGLint b) {
+    uint32_t* p = record_draw(con, OP_RECT, 4, t, b - 1);
+    p[0] = l;
+    p[1] = t;
+    p[2] = r;
+    p[3] = b;
+}
+
+static void bin_trianglex(void* con,
+        GGLcoord const* v0, GGLcoord const* v1, GGLcoord const* v2) {
+    uint32_t* p = record_draw(con, OP_TRIANGLE, 6,
+            row_of(min(v0[1], v1[1], v2[1])) - 1,
+            row_of(max(v0[1], v1[1], v2[1])) + 1);
+    p[0] = v0[0];
+    p[1] = v0[1];
+    p[2] = v1[0];
+    p[3] = v1[1];
+    p[4] = v2[0];
+    p[5] = v2[1];
+}
+
+void install_draw_procs(GGLContext& procs)
+{
+    procs.clear         = bin_clear;
+    procs.pointx        = bin_pointx;
+    procs.linex         = bin_linex;
+    procs.recti         = bin_recti;
+    procs.trianglex     = bin_trianglex;
+}
+
+static void install_procs(GGLContext& procs)
+{
+    procs.colorBuffer           = bin_colorBuffer;
+    procs.readBuffer            = bin_readBuffer;
+    procs.depthBuffer           = bin_depthBuffer;
+    procs.bindTexture           = bin_bindTexture;
+    procs.bindTextureLod        = bin_bindTextureLod;
+    procs.activeTexture         = bin_activeTexture;
+    procs.scissor               = bin_scissor;
+    procs.enable                = bin_enable;
+    procs.disable               = bin_disable;
+    procs.enableDisable         = bin_enableDisable;
+    procs.shadeModel            = bin_shadeModel;
+    procs.color4xv              = bin_color4xv;
+    procs.colorGrad12xv         = bin_colorGrad12xv;
+    procs.zGrad3xv              = bin_zGrad3xv;
+    procs.wGrad3xv              = bin_wGrad3xv;
+    procs.fogGrad3xv            = bin_fogGrad3xv;
+    procs.fogColor3xv           = bin_fogColor3xv;
+    procs.blendFunc             = bin_blendFunc;
+    procs.texEnvi               = bin_texEnvi;
+    procs.texEnvxv              = bin_texEnvxv;
+    procs.texParameteri         = bin_texParameteri;
+    procs.texCoord2i            = bin_texCoord2i;
+    procs.texCoordGradScale8xv  = bin_texCoordGradScale8xv;
+    procs.texGeni               = bin_texGeni;
+    procs.colorMask             = bin_colorMask;
+    procs.depthMask             = bin_depthMask;
+    procs.stencilMask           = bin_stencilMask;
+    procs.alphaFuncx            = bin_alphaFuncx;
+    procs.depthFunc             = bin_depthFunc;
+    procs.logicOp               = bin_logicOp;
+    procs.clearColorx           = bin_clearColorx;
+    procs.clearDepthx           = bin_clearDepthx;
+    procs.clearStencil          = bin_clearStencil;
+    install_draw_procs(procs);
+}
+
+// ----------------------------------------------------------------------------
+#if 0
+#pragma mark -
+#pragma mark Init
+#endif
+
+static int get_num_workers()
+{
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.libagl.raster_threads", value, "0");
+    int n = atoi(value);
+    if (n <= 0) {
+        const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n = cpus > 1 ? min(int(cpus), DEFAULT_MAX_WORKERS) : 0;
+    }
+    return min(n, MAX_WORKERS);
+}
+
+static void destroy_workers(binning_t* b, int count)
+{
+    {
+        Mutex::Autolock _l(b->lock);
+        b->quit = true;
+        b->submittedCondition.broadcast();
+    }
+    for (int i=0 ; i<count ; i++) {
+        pthread_join(b->workers[i].thread, 0);
+        gglUninit(b->workers[i].ggl);
+    }
+}
+
+void ogles_init_binning(ogles_context_t* c)
+{
+    const int numWorkers = get_num_workers();
+    if (numWorkers <= 0)
+        return;
+
+    binning_t* const b = new binning_t;
+    b->numWorkers = numWorkers;
+    b->submitted = 0;
+    b->completed = 0;
+    b->quit = false;
+    bool allocated = true;
+    for (uint32_t i=0 ; i<NUM_BATCHES ; i++) {
+        b->batches[i].data = (uint32_t*)malloc(BATCH_WORDS * 4);
+        b->batches[i].used = 0;
+        b->pending[i] = 0;
+        allocated = allocated && b->batches[i].data;
+    }
+    b->current = &b->batches[0];
+
+    int count = 0;
+    while (allocated && count < numWorkers) {
+        worker_t& w(b->workers[count]);
+        w.binning = b;
+        w.index = count;
+        w.ggl = 0;
+        gglInit(&w.ggl);
+        if (!w.ggl)
+            break;
+        w.ggl->enable(w.ggl, GL_SCISSOR_TEST);
+        w.scissorTest = false;
+        memset(w.scissor, 0, sizeof(w.scissor));
+        w.width = 0;
+        w.height = 0;
+        w.tile = -1;
+        w.tileVisible = false;
+        if (pthread_create(&w.thread, 0, worker_loop, &w)) {
+            gglUninit(w.ggl);
+            break;
+        }
+        count++;
+    }
+
+    if (count < numWorkers) {
+        ALOGE("couldn't start %d rasterizer threads, rasterizing inline",
+                numWorkers);
+        destroy_workers(b, count);
+        for (uint32_t i=0 ; i<NUM_BATCHES ; i++) {
+            free(b->batches[i].data);
+        }
+        delete b;
+        return;
+    }
+
+    b->procs = c->rasterizer.procs;
+    install_procs(c->rasterizer.procs);
+    c->binning = b;
+}
+
+void ogles_uninit_binning(ogles_context_t* c)
+{
+    binning_t* const b = c->binning;
+    if (!b)
+        return;
+
+    ogles_finish_binning(c);
+    destroy_workers(b, b->numWorkers);
+    for (uint32_t i=0 ; i<NUM_BATCHES ; i++) {
+        free(b->batches[i].data);
+    }
+    c->rasterizer.procs = b->procs;
+    c->binning = 0;
+    delete b;
+}
+
+void ogles_flush_binning(ogles_context_t* c)
+{
+    if (c->binning)
+        submit(c);
+}
+
+void ogles_finish_binning(ogles_context_t* c)
+{
+    binning_t* const b = c->binning;
+    if (!b)
+        return;
+
+    submit(c);
+    {
+        Mutex::Autolock _l(b->lock);
+        while (b->completed != b->submitted)
+            b->completedCondition.wait(b->lock);
+    }
+    for (uint32_t i=0 ; i<NUM_BATCHES ; i++) {
+        release_textures(c, &b->batches[i]);
+    }
+}
+
+void ogles_retain_texture(ogles_context_t* c, EGLTextureObject* texture)
+{
+    binning_t* const b = c->binning;
+    if (!b || !texture)
+        return;
+    texture->incStrong(c);
+    b->current->textures.push(texture);
+}
+
+// ----------------------------------------------------------------------------
+}; // namespace android
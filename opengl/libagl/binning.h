@@ -0,0 +1,62 @@
+/* libs/opengles/binning.h
+**
+** Copyright 2016, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#ifndef ANDROID_OPENGLES_BINNING_H
+#define ANDROID_OPENGLES_BINNING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "context.h"
+
+namespace android {
+
+class EGLTextureObject;
+
+/*
+ * On devices with more than one CPU, rasterization is moved off the calling
+ * thread. The pixelflinger entry points of the context are replaced by ones
+ * recording the calls, and rasterizer threads each replay them on a
+ * pixelflinger context of their own. The color buffer is split in tiles,
+ * bands of rows handed out to the threads round-robin; a thread only draws
+ * the primitives overlapping its tiles, with the scissor restricted to the
+ * tile. Every pixel is therefore written by a single thread, in the order
+ * the calls were made.
+ *
+ * The "debug.libagl.raster_threads" property overrides the number of
+ * rasterizer threads, 0 meaning one per CPU up to 4.
+ */
+
+void ogles_init_binning(ogles_context_t* c);
+void ogles_uninit_binning(ogles_context_t* c);
+
+// Hands the calls recorded so far to the rasterizer threads, doesn't wait.
+void ogles_flush_binning(ogles_context_t* c);
+
+// Returns once the calls recorded so far have been rasterized. This must be
+// called before the color, depth or texture buffers are accessed or released
+// other than through the rasterizer.
+void ogles_finish_binning(ogles_context_t* c);
+
+// Keeps a texture object, which recorded calls may still sample from, alive
+// until these calls have been rasterized.
+void ogles_retain_texture(ogles_context_t* c, EGLTextureObject* texture);
+
+}; // namespace android
+
+#endif // ANDROID_OPENGLES_BINNING_H
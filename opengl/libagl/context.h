@@ -51,6 +51,7 @@ struct ogles_context_t;
 struct matrixx_t;
 struct transform_t;
 struct buffer_t;
+struct binning_t;
 
 ogles_context_t* getGlContext();
 
@@ -216,6 +217,8 @@ struct array_machine_t {
 
     void (*mvp_transform)(transform_t const*, vec4_t*, vec4_t const*);
     void (*mv_transform)(transform_t const*, vec4_t*, vec4_t const*);
+    void (*mvp_transforms)(transform_t const*, vec4_t*, vec4_t const*,
+            size_t, size_t);
     void (*tex_transform[2])(transform_t const*, vec4_t*, vec4_t const*);
     void (*perspective)(ogles_context_t*c, vertex_t* v);
     void (*clipVertex)(ogles_context_t* c, vertex_t* nv,
@@ -432,6 +435,21 @@ struct transform_t {
         void (*pointv[3])(transform_t const* t, vec4_t*, vec4_t const*);
     };
 
+    // same as above for count vectors, consecutive vectors are stride bytes
+    // apart both in the source and the destination.
+    union {
+        struct {
+            void (*points2)(transform_t const* t, vec4_t*, vec4_t const*,
+                    size_t stride, size_t count);
+            void (*points3)(transform_t const* t, vec4_t*, vec4_t const*,
+                    size_t stride, size_t count);
+            void (*points4)(transform_t const* t, vec4_t*, vec4_t const*,
+                    size_t stride, size_t count);
+        };
+        void (*pointsv[3])(transform_t const* t, vec4_t*, vec4_t const*,
+                size_t stride, size_t count);
+    };
+
     void loadIdentity();
     void picker();
     void dump(const char* what);
@@ -629,6 +647,7 @@ struct ogles_context_t {
     uint32_t                transformTextures : 1;
     EGLSurfaceManager*      surfaceManager;
     EGLBufferObjectManager* bufferObjectManager;
+    binning_t*              binning;
 
     GLenum                  error;
 
@@ -46,6 +46,7 @@
 #include "state.h"
 #include "texture.h"
 #include "matrix.h"
+#include "binning.h"
 
 #undef NELEM
 #define NELEM(x) (sizeof(x)/sizeof(*(x)))
@@ -1204,8 +1205,9 @@ static int makeCurrent(ogles_context_t* gl)
         }
     } else {
         if (current) {
-            // mark the current context as not current, and flush
-            glFlush();
+            // mark the current context as not current, and finish since
+            // its surfaces are going to be disconnected
+            glFinish();
             egl_context_t::context(current)->flags &= ~egl_context_t::IS_CURRENT;
         }
         // this thread has no context attached to it
@@ -1754,6 +1756,7 @@ EGLBoolean eglMakeCurrent(  EGLDisplay dpy, EGLSurface draw,
             
             if (c->draw) {
                 egl_surface_t* s = reinterpret_cast<egl_surface_t*>(c->draw);
+                ogles_finish_binning(gl);
                 s->disconnect();
                 s->ctx = EGL_NO_CONTEXT;
                 if (s->zombie)
@@ -1868,6 +1871,7 @@ EGLBoolean eglQueryContext( EGLDisplay dpy, EGLContext ctx,
 
 EGLBoolean eglWaitGL(void)
 {
+    glFinish();
     return EGL_TRUE;
 }
 
@@ -1887,7 +1891,10 @@ EGLBoolean eglSwapBuffers(EGLDisplay dpy, EGLSurface draw)
     if (d->dpy != dpy)
         return setError(EGL_BAD_DISPLAY, EGL_FALSE);
 
-    // post the surface
+    // post the surface, once we're done drawing into it
+    if (d->ctx != EGL_NO_CONTEXT) {
+        ogles_finish_binning((ogles_context_t*)d->ctx);
+    }
     d->swapBuffers();
 
     // if it's bound to a context, update the buffer
@@ -369,6 +369,13 @@ void lightVertex(ogles_context_t* c, vertex_t* v)
         const material_t& material = c->lighting.front;
         const int twoSide = c->lighting.lightModel.twoSide;
 
+#if !OBJECT_SPACE_LIGHTING
+        // eye coordinates of the vertex, computed for the first positional
+        // light and shared by the others.
+        vec4_t o;
+        bool haveEye = false;
+#endif
+
         while (en) {
             const int i = 31 - gglClz(en);
             en &= ~(1<<i);
@@ -382,9 +389,11 @@ void lightVertex(ogles_context_t* c, vertex_t* v)
             if (ggl_unlikely(l.position.w)) {
                 // lightPos/1.0 - vertex/vertex.w == lightPos*vertex.w - vertex
 #if !OBJECT_SPACE_LIGHTING
-                vec4_t o;
-                const transform_t& mv = c->transforms.modelview.transform;
-                mv.point4(&mv, &o, &v->obj);
+                if (!haveEye) {
+                    const transform_t& mv = c->transforms.modelview.transform;
+                    mv.point4(&mv, &o, &v->obj);
+                    haveEye = true;
+                }
                 vss3(d.v, l.objPosition.v, o.w, o.v);
 #else
                 vss3(d.v, l.objPosition.v, v->obj.w, v->obj.v);
@@ -18,6 +18,12 @@
 #include <stdlib.h>
 #include <stdio.h>
 
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+
 #include "context.h"
 #include "fp.h"
 #include "state.h"
@@ -57,6 +63,15 @@ static void point3__generic(transform_t const*, vec4_t* c, vec4_t const* o);
 static void point4__generic(transform_t const*, vec4_t* c, vec4_t const* o);
 static void point3__mvui(transform_t const*, vec4_t* c, vec4_t const* o);
 static void point4__mvui(transform_t const*, vec4_t* c, vec4_t const* o);
+static void points2__generic(transform_t const*, vec4_t* c, vec4_t const* o,
+        size_t stride, size_t count);
+static void points3__generic(transform_t const*, vec4_t* c, vec4_t const* o,
+        size_t stride, size_t count);
+static void points4__generic(transform_t const*, vec4_t* c, vec4_t const* o,
+        size_t stride, size_t count);
+template<void (*point)(transform_t const*, vec4_t*, vec4_t const*)>
+static void points__loop(transform_t const*, vec4_t* c, vec4_t const* o,
+        size_t stride, size_t count);
 
 // ----------------------------------------------------------------------------
 #if 0
@@ -176,6 +191,9 @@ void transform_t::loadIdentity() {
     point2 = point2__nop;
     point3 = point3__nop;
     point4 = point4__nop;
+    points2 = points__loop<point2__nop>;
+    points3 = points__loop<point3__nop>;
+    points4 = points__loop<point4__nop>;
 }
 
 
@@ -199,7 +217,10 @@ void transform_t::picker()
     point2 = point2__generic;
     point3 = point3__generic;
     point4 = point4__generic;
-    
+    points2 = points2__generic;
+    points3 = points3__generic;
+    points4 = points4__generic;
+
     // find out if this is a 2D projection
     if (!(notZero(m[3]) | notZero(m[7]) | notZero(m[11]) | notOne(m[15]))) {
         flags |= FLAGS_2D_PROJECTION;
@@ -212,6 +233,8 @@ void mvui_transform_t::picker()
     ops = OP_ALL;
     point3 = point3__mvui;
     point4 = point4__mvui;
+    points3 = points__loop<point3__mvui>;
+    points4 = points__loop<point4__mvui>;
 }
 
 void transform_t::dump(const char* what)
@@ -783,6 +806,184 @@ void point4__mvui(transform_t const* mx, vec4_t* lhs, vec4_t const* rhs) {
     lhs->w = rw;
 }
 
+// ----------------------------------------------------------------------------
+#if 0
+#pragma mark -
+#pragma mark matrix * vertices
+#endif
+
+/*
+ * These transform a whole batch of vertices, the matrix is loaded once and
+ * stays in registers. The results are bit-exact with the point*__generic()
+ * versions above: mla2a() and mla3a() truncate the 64-bit sums before adding
+ * the translation, mla4() rounds them.
+ */
+
+static inline vec4_t* nextVector(vec4_t* v, size_t stride) {
+    return reinterpret_cast<vec4_t*>(reinterpret_cast<uint8_t*>(v) + stride);
+}
+
+static inline vec4_t const* nextVector(vec4_t const* v, size_t stride) {
+    return reinterpret_cast<vec4_t const*>(
+            reinterpret_cast<uint8_t const*>(v) + stride);
+}
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+
+template<int N>
+static inline void points__simd(transform_t const* mx,
+        vec4_t* lhs, vec4_t const* rhs, size_t stride, size_t count)
+{
+    const GLfixed* const m = mx->matrix.m;
+    const int32x2_t m0 = vld1_s32(m +  0), m2 = vld1_s32(m +  2);
+    const int32x2_t m4 = vld1_s32(m +  4), m6 = vld1_s32(m +  6);
+    const int32x2_t m8 = vld1_s32(m +  8), m10 = vld1_s32(m + 10);
+    const int32x4_t m12 = vld1q_s32(m + 12);
+    const int32x2_t m12l = vget_low_s32(m12), m14 = vget_high_s32(m12);
+    for ( ; count ; count--) {
+        // the whole source is read before lhs is written, it may be rhs
+        const int32x4_t r = vld1q_s32(rhs->v);
+        const int32x2_t rxy = vget_low_s32(r);
+        const int32x2_t rzw = vget_high_s32(r);
+        int64x2_t xy = vmull_lane_s32(m0, rxy, 0);
+        int64x2_t zw = vmull_lane_s32(m2, rxy, 0);
+        xy = vmlal_lane_s32(xy, m4, rxy, 1);
+        zw = vmlal_lane_s32(zw, m6, rxy, 1);
+        if (N >= 3) {
+            xy = vmlal_lane_s32(xy, m8,  rzw, 0);
+            zw = vmlal_lane_s32(zw, m10, rzw, 0);
+        }
+        int32x4_t t;
+        if (N == 4) {
+            xy = vmlal_lane_s32(xy, m12l, rzw, 1);
+            zw = vmlal_lane_s32(zw, m14,  rzw, 1);
+            t = vcombine_s32(vrshrn_n_s64(xy, 16), vrshrn_n_s64(zw, 16));
+        } else {
+            t = vcombine_s32(vshrn_n_s64(xy, 16), vshrn_n_s64(zw, 16));
+            t = vaddq_s32(t, m12);
+        }
+        vst1q_s32(lhs->v, t);
+        lhs = nextVector(lhs, stride);
+        rhs = nextVector(rhs, stride);
+    }
+}
+
+#elif defined(__SSE4_1__)
+
+template<int N>
+static inline void points__simd(transform_t const* mx,
+        vec4_t* lhs, vec4_t const* rhs, size_t stride, size_t count)
+{
+    // _mm_mul_epi32() multiplies the even lanes, so the x and z results are
+    // computed from the matrix columns as they are, y and w from the columns
+    // shifted down by one lane.
+    const GLfixed* const m = mx->matrix.m;
+    const __m128i c0 = _mm_loadu_si128((const __m128i*)(m +  0));
+    const __m128i c1 = _mm_loadu_si128((const __m128i*)(m +  4));
+    const __m128i c2 = _mm_loadu_si128((const __m128i*)(m +  8));
+    const __m128i c3 = _mm_loadu_si128((const __m128i*)(m + 12));
+    const __m128i c0o = _mm_srli_epi64(c0, 32);
+    const __m128i c1o = _mm_srli_epi64(c1, 32);
+    const __m128i c2o = _mm_srli_epi64(c2, 32);
+    const __m128i c3o = _mm_srli_epi64(c3, 32);
+    const __m128i half = _mm_set1_epi64x(0x8000);
+    for ( ; count ; count--) {
+        // the whole source is read before lhs is written, it may be rhs
+        const __m128i r = _mm_loadu_si128((const __m128i*)rhs->v);
+        const __m128i rx = _mm_shuffle_epi32(r, 0x00);
+        const __m128i ry = _mm_shuffle_epi32(r, 0x55);
+        __m128i xz = _mm_mul_epi32(rx, c0);
+        __m128i yw = _mm_mul_epi32(rx, c0o);
+        xz = _mm_add_epi64(xz, _mm_mul_epi32(ry, c1));
+        yw = _mm_add_epi64(yw, _mm_mul_epi32(ry, c1o));
+        if (N >= 3) {
+            const __m128i rz = _mm_shuffle_epi32(r, 0xAA);
+            xz = _mm_add_epi64(xz, _mm_mul_epi32(rz, c2));
+            yw = _mm_add_epi64(yw, _mm_mul_epi32(rz, c2o));
+        }
+        if (N == 4) {
+            const __m128i rw = _mm_shuffle_epi32(r, 0xFF);
+            xz = _mm_add_epi64(xz, _mm_add_epi64(_mm_mul_epi32(rw, c3), half));
+            yw = _mm_add_epi64(yw, _mm_add_epi64(_mm_mul_epi32(rw, c3o), half));
+        }
+        // only the low 32 bits of each sum >> 16 are kept, which a logical
+        // shift gets right.
+        __m128i t = _mm_blend_epi16(_mm_srli_epi64(xz, 16),
+                _mm_slli_epi64(yw, 16), 0xCC);
+        if (N < 4) {
+            t = _mm_add_epi32(t, c3);
+        }
+        _mm_storeu_si128((__m128i*)lhs->v, t);
+        lhs = nextVector(lhs, stride);
+        rhs = nextVector(rhs, stride);
+    }
+}
+
+#else
+
+template<int N>
+static inline void points__simd(transform_t const* mx,
+        vec4_t* lhs, vec4_t const* rhs, size_t stride, size_t count)
+{
+    // a local copy, which can't alias lhs, lets the compiler keep the
+    // matrix in registers.
+    const matrixx_t mc = mx->matrix;
+    const GLfixed* const m = mc.m;
+    for ( ; count ; count--) {
+        const GLfixed rx = rhs->x;
+        const GLfixed ry = rhs->y;
+        const GLfixed rz = rhs->z;
+        const GLfixed rw = rhs->w;
+        if (N == 2) {
+            lhs->x = mla2a(rx, m[ 0], ry, m[ 4], m[12]);
+            lhs->y = mla2a(rx, m[ 1], ry, m[ 5], m[13]);
+            lhs->z = mla2a(rx, m[ 2], ry, m[ 6], m[14]);
+            lhs->w = mla2a(rx, m[ 3], ry, m[ 7], m[15]);
+        } else if (N == 3) {
+            lhs->x = mla3a(rx, m[ 0], ry, m[ 4], rz, m[ 8], m[12]);
+            lhs->y = mla3a(rx, m[ 1], ry, m[ 5], rz, m[ 9], m[13]);
+            lhs->z = mla3a(rx, m[ 2], ry, m[ 6], rz, m[10], m[14]);
+            lhs->w = mla3a(rx, m[ 3], ry, m[ 7], rz, m[11], m[15]);
+        } else {
+            lhs->x = mla4(rx, m[ 0], ry, m[ 4], rz, m[ 8], rw, m[12]);
+            lhs->y = mla4(rx, m[ 1], ry, m[ 5], rz, m[ 9], rw, m[13]);
+            lhs->z = mla4(rx, m[ 2], ry, m[ 6], rz, m[10], rw, m[14]);
+            lhs->w = mla4(rx, m[ 3], ry, m[ 7], rz, m[11], rw, m[15]);
+        }
+        lhs = nextVector(lhs, stride);
+        rhs = nextVector(rhs, stride);
+    }
+}
+
+#endif
+
+void points2__generic(transform_t const* mx,
+        vec4_t* lhs, vec4_t const* rhs, size_t stride, size_t count) {
+    points__simd<2>(mx, lhs, rhs, stride, count);
+}
+
+void points3__generic(transform_t const* mx,
+        vec4_t* lhs, vec4_t const* rhs, size_t stride, size_t count) {
+    points__simd<3>(mx, lhs, rhs, stride, count);
+}
+
+void points4__generic(transform_t const* mx,
+        vec4_t* lhs, vec4_t const* rhs, size_t stride, size_t count) {
+    points__simd<4>(mx, lhs, rhs, stride, count);
+}
+
+template<void (*point)(transform_t const*, vec4_t*, vec4_t const*)>
+void points__loop(transform_t const* mx,
+        vec4_t* lhs, vec4_t const* rhs, size_t stride, size_t count) {
+    for ( ; count ; count--) {
+        point(mx, lhs, rhs);
+        lhs = nextVector(lhs, stride);
+        rhs = nextVector(rhs, stride);
+    }
+}
+
+// ----------------------------------------------------------------------------
+
 void point2__nop(transform_t const*, vec4_t* lhs, vec4_t const* rhs) {
     lhs->z = 0;
     lhs->w = 0x10000;
@@ -18,6 +18,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "context.h"
 #include "state.h"
 #include "texture.h"
@@ -27,6 +33,363 @@ namespace android {
 
 // ----------------------------------------------------------------------------
 
+/*
+ * Each of these writes a row of w texels of the next level, each the average
+ * of a 2x2 block of the rows src0 and src1 below it. The SIMD loops compute
+ * the same values as the scalar ones, which are the original box filters;
+ * they all truncate, but RGBA_5551 rounds.
+ */
+
+static inline void downsampleRows565(uint16_t* dst,
+        uint16_t const* src0, uint16_t const* src1, int w, int x)
+{
+    const uint32_t mask = 0x07E0F81F;
+    for ( ; x<w ; x++) {
+        uint32_t p00 = src0[2*x];
+        uint32_t p10 = src0[2*x+1];
+        uint32_t p01 = src1[2*x];
+        uint32_t p11 = src1[2*x+1];
+        p00 = (p00 | (p00 << 16)) & mask;
+        p01 = (p01 | (p01 << 16)) & mask;
+        p10 = (p10 | (p10 << 16)) & mask;
+        p11 = (p11 | (p11 << 16)) & mask;
+        uint32_t grb = ((p00 + p10 + p01 + p11) >> 2) & mask;
+        uint32_t rgb = (grb & 0xFFFF) | (grb >> 16);
+        dst[x] = rgb;
+    }
+}
+
+static inline void downsampleRows5551(uint16_t* dst,
+        uint16_t const* src0, uint16_t const* src1, int w, int x)
+{
+    for ( ; x<w ; x++) {
+        uint32_t p00 = src0[2*x];
+        uint32_t p10 = src0[2*x+1];
+        uint32_t p01 = src1[2*x];
+        uint32_t p11 = src1[2*x+1];
+        uint32_t r = ((p00>>11)+(p10>>11)+(p01>>11)+(p11>>11)+2)>>2;
+        uint32_t g = (((p00>>6)+(p10>>6)+(p01>>6)+(p11>>6)+2)>>2)&0x3F;
+        uint32_t b = ((p00&0x3E)+(p10&0x3E)+(p01&0x3E)+(p11&0x3E)+4)>>3;
+        uint32_t a = ((p00&1)+(p10&1)+(p01&1)+(p11&1)+2)>>2;
+        dst[x] = (r<<11)|(g<<6)|(b<<1)|a;
+    }
+}
+
+static inline void downsampleRows4444(uint16_t* dst,
+        uint16_t const* src0, uint16_t const* src1, int w, int x)
+{
+    for ( ; x<w ; x++) {
+        uint32_t p00 = src0[2*x];
+        uint32_t p10 = src0[2*x+1];
+        uint32_t p01 = src1[2*x];
+        uint32_t p11 = src1[2*x+1];
+        p00 = ((p00 << 12) & 0x0F0F0000) | (p00 & 0x0F0F);
+        p10 = ((p10 << 12) & 0x0F0F0000) | (p10 & 0x0F0F);
+        p01 = ((p01 << 12) & 0x0F0F0000) | (p01 & 0x0F0F);
+        p11 = ((p11 << 12) & 0x0F0F0000) | (p11 & 0x0F0F);
+        uint32_t rbga = (p00 + p10 + p01 + p11) >> 2;
+        uint32_t rgba = (rbga & 0x0F0F) | ((rbga>>12) & 0xF0F0);
+        dst[x] = rgba;
+    }
+}
+
+static inline void downsampleRows8888(uint32_t* dst,
+        uint32_t const* src0, uint32_t const* src1, int w, int x)
+{
+    for ( ; x<w ; x++) {
+        uint32_t p00 = src0[2*x];
+        uint32_t p10 = src0[2*x+1];
+        uint32_t p01 = src1[2*x];
+        uint32_t p11 = src1[2*x+1];
+        uint32_t rb00 = p00 & 0x00FF00FF;
+        uint32_t rb01 = p01 & 0x00FF00FF;
+        uint32_t rb10 = p10 & 0x00FF00FF;
+        uint32_t rb11 = p11 & 0x00FF00FF;
+        uint32_t ga00 = (p00 >> 8) & 0x00FF00FF;
+        uint32_t ga01 = (p01 >> 8) & 0x00FF00FF;
+        uint32_t ga10 = (p10 >> 8) & 0x00FF00FF;
+        uint32_t ga11 = (p11 >> 8) & 0x00FF00FF;
+        uint32_t rb = (rb00 + rb01 + rb10 + rb11)>>2;
+        uint32_t ga = (ga00 + ga01 + ga10 + ga11)>>2;
+        uint32_t rgba = (rb & 0x00FF00FF) | ((ga & 0x00FF00FF)<<8);
+        dst[x] = rgba;
+    }
+}
+
+// For the formats made of 8-bit components, each averaged on its own.
+static inline void downsampleRowsBytes(uint8_t* dst,
+        uint8_t const* src0, uint8_t const* src1, int w, int skip, int x)
+{
+    for ( ; x<w ; x++) {
+        for (int c=0 ; c<skip ; c++) {
+            uint32_t p00 = src0[c + 2*x*skip];
+            uint32_t p10 = src0[c + 2*x*skip + skip];
+            uint32_t p01 = src1[c + 2*x*skip];
+            uint32_t p11 = src1[c + 2*x*skip + skip];
+            dst[x*skip + c] = (p00 + p10 + p01 + p11) >> 2;
+        }
+    }
+}
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+
+static void downsampleRow565(uint16_t* dst,
+        uint16_t const* src0, uint16_t const* src1, int w)
+{
+    int x = 0;
+    for ( ; x+8 <= w ; x += 8) {
+        const uint16x8x2_t a = vld2q_u16(src0 + 2*x);
+        const uint16x8x2_t b = vld2q_u16(src1 + 2*x);
+        uint16x8_t r = vaddq_u16(vshrq_n_u16(a.val[0], 11), vshrq_n_u16(a.val[1], 11));
+        r = vaddq_u16(r, vaddq_u16(vshrq_n_u16(b.val[0], 11), vshrq_n_u16(b.val[1], 11)));
+        const uint16x8_t gmask = vdupq_n_u16(0x3F);
+        uint16x8_t g = vaddq_u16(vandq_u16(vshrq_n_u16(a.val[0], 5), gmask),
+                vandq_u16(vshrq_n_u16(a.val[1], 5), gmask));
+        g = vaddq_u16(g, vaddq_u16(vandq_u16(vshrq_n_u16(b.val[0], 5), gmask),
+                vandq_u16(vshrq_n_u16(b.val[1], 5), gmask)));
+        const uint16x8_t bmask = vdupq_n_u16(0x1F);
+        uint16x8_t bl = vaddq_u16(vandq_u16(a.val[0], bmask), vandq_u16(a.val[1], bmask));
+        bl = vaddq_u16(bl, vaddq_u16(vandq_u16(b.val[0], bmask), vandq_u16(b.val[1], bmask)));
+        uint16x8_t rgb = vshlq_n_u16(vshrq_n_u16(r, 2), 11);
+        rgb = vorrq_u16(rgb, vshlq_n_u16(vshrq_n_u16(g, 2), 5));
+        rgb = vorrq_u16(rgb, vshrq_n_u16(bl, 2));
+        vst1q_u16(dst + x, rgb);
+    }
+    downsampleRows565(dst, src0, src1, w, x);
+}
+
+static void downsampleRow4444(uint16_t* dst,
+        uint16_t const* src0, uint16_t const* src1, int w)
+{
+    int x = 0;
+    const uint16x8_t mask = vdupq_n_u16(0x0F0F);
+    for ( ; x+8 <= w ; x += 8) {
+        const uint16x8x2_t a = vld2q_u16(src0 + 2*x);
+        const uint16x8x2_t b = vld2q_u16(src1 + 2*x);
+        // two components of every texel in each half, with room to add four
+        uint16x8_t lo = vaddq_u16(vandq_u16(a.val[0], mask), vandq_u16(a.val[1], mask));
+        lo = vaddq_u16(lo, vaddq_u16(vandq_u16(b.val[0], mask), vandq_u16(b.val[1], mask)));
+        uint16x8_t hi = vaddq_u16(vandq_u16(vshrq_n_u16(a.val[0], 4), mask),
+                vandq_u16(vshrq_n_u16(a.val[1], 4), mask));
+        hi = vaddq_u16(hi, vaddq_u16(vandq_u16(vshrq_n_u16(b.val[0], 4), mask),
+                vandq_u16(vshrq_n_u16(b.val[1], 4), mask)));
+        const uint16x8_t rgba = vorrq_u16(vandq_u16(vshrq_n_u16(lo, 2), mask),
+                vshlq_n_u16(vandq_u16(vshrq_n_u16(hi, 2), mask), 4));
+        vst1q_u16(dst + x, rgba);
+    }
+    downsampleRows4444(dst, src0, src1, w, x);
+}
+
+static void downsampleRow8888(uint32_t* dst,
+        uint32_t const* src0, uint32_t const* src1, int w)
+{
+    int x = 0;
+    for ( ; x+8 <= w ; x += 8) {
+        const uint8x16x4_t a = vld4q_u8((uint8_t const*)(src0 + 2*x));
+        const uint8x16x4_t b = vld4q_u8((uint8_t const*)(src1 + 2*x));
+        uint8x8x4_t d;
+        for (int c=0 ; c<4 ; c++) {
+            d.val[c] = vshrn_n_u16(vaddq_u16(vpaddlq_u8(a.val[c]), vpaddlq_u8(b.val[c])), 2);
+        }
+        vst4_u8((uint8_t*)(dst + x), d);
+    }
+    downsampleRows8888(dst, src0, src1, w, x);
+}
+
+static void downsampleRowBytes(uint8_t* dst,
+        uint8_t const* src0, uint8_t const* src1, int w, int skip)
+{
+    int x = 0;
+    if (skip == 1) {
+        for ( ; x+16 <= w ; x += 16) {
+            const uint16x8_t lo = vaddq_u16(vpaddlq_u8(vld1q_u8(src0 + 2*x)),
+                    vpaddlq_u8(vld1q_u8(src1 + 2*x)));
+            const uint16x8_t hi = vaddq_u16(vpaddlq_u8(vld1q_u8(src0 + 2*x + 16)),
+                    vpaddlq_u8(vld1q_u8(src1 + 2*x + 16)));
+            vst1q_u8(dst + x, vcombine_u8(vshrn_n_u16(lo, 2), vshrn_n_u16(hi, 2)));
+        }
+    } else if (skip == 2) {
+        for ( ; x+8 <= w ; x += 8) {
+            const uint8x16x2_t a = vld2q_u8(src0 + 4*x);
+            const uint8x16x2_t b = vld2q_u8(src1 + 4*x);
+            uint8x8x2_t d;
+            for (int c=0 ; c<2 ; c++) {
+                d.val[c] = vshrn_n_u16(vaddq_u16(vpaddlq_u8(a.val[c]), vpaddlq_u8(b.val[c])), 2);
+            }
+            vst2_u8(dst + 2*x, d);
+        }
+    } else if (skip == 3) {
+        for ( ; x+8 <= w ; x += 8) {
+            const uint8x16x3_t a = vld3q_u8(src0 + 6*x);
+            const uint8x16x3_t b = vld3q_u8(src1 + 6*x);
+            uint8x8x3_t d;
+            for (int c=0 ; c<3 ; c++) {
+                d.val[c] = vshrn_n_u16(vaddq_u16(vpaddlq_u8(a.val[c]), vpaddlq_u8(b.val[c])), 2);
+            }
+            vst3_u8(dst + 3*x, d);
+        }
+    }
+    downsampleRowsBytes(dst, src0, src1, w, skip, x);
+}
+
+#elif defined(__SSE2__)
+
+// Packs the low halves of the 32-bit lanes of a and b, which SSE2 can only do
+// with signed saturation.
+static inline __m128i packLow16(__m128i a, __m128i b)
+{
+    a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+    b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+    return _mm_packs_epi32(a, b);
+}
+
+// Spreads each 16-bit texel of the 32-bit lanes of p as its own 32-bit lane,
+// in the 0x07E0F81F layout.
+static inline __m128i expand565(__m128i p)
+{
+    const __m128i mask = _mm_set1_epi32(0x07E0F81F);
+    return _mm_and_si128(_mm_or_si128(p, _mm_slli_epi32(p, 16)), mask);
+}
+
+// 4 texels of the next level from 8 in each source row
+static inline __m128i downsample4x565(uint16_t const* src0, uint16_t const* src1)
+{
+    const __m128i lowMask = _mm_set1_epi32(0xFFFF);
+    const __m128i a = _mm_loadu_si128((__m128i const*)src0);
+    const __m128i b = _mm_loadu_si128((__m128i const*)src1);
+    __m128i sum = _mm_add_epi32(expand565(_mm_and_si128(a, lowMask)),
+            expand565(_mm_srli_epi32(a, 16)));
+    sum = _mm_add_epi32(sum, expand565(_mm_and_si128(b, lowMask)));
+    sum = _mm_add_epi32(sum, expand565(_mm_srli_epi32(b, 16)));
+    const __m128i grb = _mm_and_si128(_mm_srli_epi32(sum, 2), _mm_set1_epi32(0x07E0F81F));
+    return _mm_or_si128(_mm_and_si128(grb, lowMask), _mm_srli_epi32(grb, 16));
+}
+
+static void downsampleRow565(uint16_t* dst,
+        uint16_t const* src0, uint16_t const* src1, int w)
+{
+    int x = 0;
+    for ( ; x+8 <= w ; x += 8) {
+        const __m128i lo = downsample4x565(src0 + 2*x, src1 + 2*x);
+        const __m128i hi = downsample4x565(src0 + 2*x + 8, src1 + 2*x + 8);
+        _mm_storeu_si128((__m128i*)(dst + x), packLow16(lo, hi));
+    }
+    downsampleRows565(dst, src0, src1, w, x);
+}
+
+static inline __m128i expand4444(__m128i p)
+{
+    return _mm_or_si128(_mm_and_si128(_mm_slli_epi32(p, 12), _mm_set1_epi32(0x0F0F0000)),
+            _mm_and_si128(p, _mm_set1_epi32(0x0F0F)));
+}
+
+static inline __m128i downsample4x4444(uint16_t const* src0, uint16_t const* src1)
+{
+    const __m128i lowMask = _mm_set1_epi32(0xFFFF);
+    const __m128i a = _mm_loadu_si128((__m128i const*)src0);
+    const __m128i b = _mm_loadu_si128((__m128i const*)src1);
+    __m128i sum = _mm_add_epi32(expand4444(_mm_and_si128(a, lowMask)),
+            expand4444(_mm_srli_epi32(a, 16)));
+    sum = _mm_add_epi32(sum, expand4444(_mm_and_si128(b, lowMask)));
+    sum = _mm_add_epi32(sum, expand4444(_mm_srli_epi32(b, 16)));
+    const __m128i rbga = _mm_srli_epi32(sum, 2);
+    return _mm_or_si128(_mm_and_si128(rbga, _mm_set1_epi32(0x0F0F)),
+            _mm_and_si128(_mm_srli_epi32(rbga, 12), _mm_set1_epi32(0xF0F0)));
+}
+
+static void downsampleRow4444(uint16_t* dst,
+        uint16_t const* src0, uint16_t const* src1, int w)
+{
+    int x = 0;
+    for ( ; x+8 <= w ; x += 8) {
+        const __m128i lo = downsample4x4444(src0 + 2*x, src1 + 2*x);
+        const __m128i hi = downsample4x4444(src0 + 2*x + 8, src1 + 2*x + 8);
+        _mm_storeu_si128((__m128i*)(dst + x), packLow16(lo, hi));
+    }
+    downsampleRows4444(dst, src0, src1, w, x);
+}
+
+// The 16-bit sums of the components of the texel pairs of a row, from 4 texels
+static inline __m128i sumPairs8888(__m128i p)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lo = _mm_unpacklo_epi8(p, zero);  // texels 0 1
+    const __m128i hi = _mm_unpackhi_epi8(p, zero);  // texels 2 3
+    return _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+}
+
+static void downsampleRow8888(uint32_t* dst,
+        uint32_t const* src0, uint32_t const* src1, int w)
+{
+    int x = 0;
+    for ( ; x+4 <= w ; x += 4) {
+        __m128i lo = _mm_add_epi16(
+                sumPairs8888(_mm_loadu_si128((__m128i const*)(src0 + 2*x))),
+                sumPairs8888(_mm_loadu_si128((__m128i const*)(src1 + 2*x))));
+        __m128i hi = _mm_add_epi16(
+                sumPairs8888(_mm_loadu_si128((__m128i const*)(src0 + 2*x + 4))),
+                sumPairs8888(_mm_loadu_si128((__m128i const*)(src1 + 2*x + 4))));
+        lo = _mm_srli_epi16(lo, 2);
+        hi = _mm_srli_epi16(hi, 2);
+        _mm_storeu_si128((__m128i*)(dst + x), _mm_packus_epi16(lo, hi));
+    }
+    downsampleRows8888(dst, src0, src1, w, x);
+}
+
+// The 16-bit sums of the byte pairs of 16 bytes of a row
+static inline __m128i sumPairs8(__m128i p)
+{
+    return _mm_add_epi16(_mm_and_si128(p, _mm_set1_epi16(0xFF)), _mm_srli_epi16(p, 8));
+}
+
+static void downsampleRowBytes(uint8_t* dst,
+        uint8_t const* src0, uint8_t const* src1, int w, int skip)
+{
+    int x = 0;
+    if (skip == 1) {
+        for ( ; x+16 <= w ; x += 16) {
+            __m128i lo = _mm_add_epi16(
+                    sumPairs8(_mm_loadu_si128((__m128i const*)(src0 + 2*x))),
+                    sumPairs8(_mm_loadu_si128((__m128i const*)(src1 + 2*x))));
+            __m128i hi = _mm_add_epi16(
+                    sumPairs8(_mm_loadu_si128((__m128i const*)(src0 + 2*x + 16))),
+                    sumPairs8(_mm_loadu_si128((__m128i const*)(src1 + 2*x + 16))));
+            lo = _mm_srli_epi16(lo, 2);
+            hi = _mm_srli_epi16(hi, 2);
+            _mm_storeu_si128((__m128i*)(dst + x), _mm_packus_epi16(lo, hi));
+        }
+    }
+    downsampleRowsBytes(dst, src0, src1, w, skip, x);
+}
+
+#else
+
+static void downsampleRow565(uint16_t* dst,
+        uint16_t const* src0, uint16_t const* src1, int w)
+{
+    downsampleRows565(dst, src0, src1, w, 0);
+}
+
+static void downsampleRow4444(uint16_t* dst,
+        uint16_t const* src0, uint16_t const* src1, int w)
+{
+    downsampleRows4444(dst, src0, src1, w, 0);
+}
+
+static void downsampleRow8888(uint32_t* dst,
+        uint32_t const* src0, uint32_t const* src1, int w)
+{
+    downsampleRows8888(dst, src0, src1, w, 0);
+}
+
+static void downsampleRowBytes(uint8_t* dst,
+        uint8_t const* src0, uint8_t const* src1, int w, int skip)
+{
+    downsampleRowsBytes(dst, src0, src1, w, skip, 0);
+}
+
+#endif
+
 status_t buildAPyramid(ogles_context_t* c, EGLTextureObject* tex)
 {
     int level = 0;
@@ -57,23 +420,9 @@ status_t buildAPyramid(ogles_context_t* c, EGLTextureObject* tex)
         {
             uint16_t const * src = (uint16_t const *)base->data;
             uint16_t* dst = (uint16_t*)cur.data;
-            const uint32_t mask = 0x07E0F81F;
             for (int y=0 ; y<h ; y++) {
-                size_t offset = (y*2) * bs;
-                for (int x=0 ; x<w ; x++) {
-                    uint32_t p00 = src[offset];
-                    uint32_t p10 = src[offset+1];
-                    uint32_t p01 = src[offset+bs];
-                    uint32_t p11 = src[offset+bs+1];
-                    p00 = (p00 | (p00 << 16)) & mask;
-                    p01 = (p01 | (p01 << 16)) & mask;
-                    p10 = (p10 | (p10 << 16)) & mask;
-                    p11 = (p11 | (p11 << 16)) & mask;
-                    uint32_t grb = ((p00 + p10 + p01 + p11) >> 2) & mask;
-                    uint32_t rgb = (grb & 0xFFFF) | (grb >> 16);
-                    dst[x + y*stride] = rgb;
-                    offset += 2;
-                }
+                uint16_t const * src0 = src + (y*2) * bs;
+                downsampleRow565(dst + y*stride, src0, src0 + bs, w);
             }
         }
         else if (base->format == GGL_PIXEL_FORMAT_RGBA_5551)
@@ -81,19 +430,8 @@ status_t buildAPyramid(ogles_context_t* c, EGLTextureObject* tex)
             uint16_t const * src = (uint16_t const *)base->data;
             uint16_t* dst = (uint16_t*)cur.data;
             for (int y=0 ; y<h ; y++) {
-                size_t offset = (y*2) * bs;
-                for (int x=0 ; x<w ; x++) {
-                    uint32_t p00 = src[offset];
-                    uint32_t p10 = src[offset+1];
-                    uint32_t p01 = src[offset+bs];
-                    uint32_t p11 = src[offset+bs+1];
-                    uint32_t r = ((p00>>11)+(p10>>11)+(p01>>11)+(p11>>11)+2)>>2;
-                    uint32_t g = (((p00>>6)+(p10>>6)+(p01>>6)+(p11>>6)+2)>>2)&0x3F;
-                    uint32_t b = ((p00&0x3E)+(p10&0x3E)+(p01&0x3E)+(p11&0x3E)+4)>>3;
-                    uint32_t a = ((p00&1)+(p10&1)+(p01&1)+(p11&1)+2)>>2;
-                    dst[x + y*stride] = (r<<11)|(g<<6)|(b<<1)|a;
-                    offset += 2;
-                }
+                uint16_t const * src0 = src + (y*2) * bs;
+                downsampleRows5551(dst + y*stride, src0, src0 + bs, w, 0);
             }
         }
         else if (base->format == GGL_PIXEL_FORMAT_RGBA_8888)
@@ -101,26 +439,8 @@ status_t buildAPyramid(ogles_context_t* c, EGLTextureObject* tex)
             uint32_t const * src = (uint32_t const *)base->data;
             uint32_t* dst = (uint32_t*)cur.data;
             for (int y=0 ; y<h ; y++) {
-                size_t offset = (y*2) * bs;
-                for (int x=0 ; x<w ; x++) {
-                    uint32_t p00 = src[offset];
-                    uint32_t p10 = src[offset+1];
-                    uint32_t p01 = src[offset+bs];
-                    uint32_t p11 = src[offset+bs+1];
-                    uint32_t rb00 = p00 & 0x00FF00FF;
-                    uint32_t rb01 = p01 & 0x00FF00FF;
-                    uint32_t rb10 = p10 & 0x00FF00FF;
-                    uint32_t rb11 = p11 & 0x00FF00FF;
-                    uint32_t ga00 = (p00 >> 8) & 0x00FF00FF;
-                    uint32_t ga01 = (p01 >> 8) & 0x00FF00FF;
-                    uint32_t ga10 = (p10 >> 8) & 0x00FF00FF;
-                    uint32_t ga11 = (p11 >> 8) & 0x00FF00FF;
-                    uint32_t rb = (rb00 + rb01 + rb10 + rb11)>>2;
-                    uint32_t ga = (ga00 + ga01 + ga10 + ga11)>>2;
-                    uint32_t rgba = (rb & 0x00FF00FF) | ((ga & 0x00FF00FF)<<8);
-                    dst[x + y*stride] = rgba;
-                    offset += 2;
-                }
+                uint32_t const * src0 = src + (y*2) * bs;
+                downsampleRow8888(dst + y*stride, src0, src0 + bs, w);
             }
         }
         else if ((base->format == GGL_PIXEL_FORMAT_RGB_888) ||
@@ -139,17 +459,8 @@ status_t buildAPyramid(ogles_context_t* c, EGLTextureObject* tex)
             bs *= skip;
             stride *= skip;
             for (int y=0 ; y<h ; y++) {
-                size_t offset = (y*2) * bs;
-                for (int x=0 ; x<w ; x++) {
-                    for (int c=0 ; c<skip ; c++) {
-                        uint32_t p00 = src[c+offset];
-                        uint32_t p10 = src[c+offset+skip];
-                        uint32_t p01 = src[c+offset+bs];
-                        uint32_t p11 = src[c+offset+bs+skip];
-                        dst[x + y*stride + c] = (p00 + p10 + p01 + p11) >> 2;
-                    }
-                    offset += 2*skip;
-                }
+                uint8_t const * src0 = src + (y*2) * bs;
+                downsampleRowBytes(dst + y*stride, src0, src0 + bs, w, skip);
             }
         }
         else if (base->format == GGL_PIXEL_FORMAT_RGBA_4444)
@@ -157,21 +468,8 @@ status_t buildAPyramid(ogles_context_t* c, EGLTextureObject* tex)
             uint16_t const * src = (uint16_t const *)base->data;
             uint16_t* dst = (uint16_t*)cur.data;
             for (int y=0 ; y<h ; y++) {
-                size_t offset = (y*2) * bs;
-                for (int x=0 ; x<w ; x++) {
-                    uint32_t p00 = src[offset];
-                    uint32_t p10 = src[offset+1];
-                    uint32_t p01 = src[offset+bs];
-                    uint32_t p11 = src[offset+bs+1];
-                    p00 = ((p00 << 12) & 0x0F0F0000) | (p00 & 0x0F0F);
-                    p10 = ((p10 << 12) & 0x0F0F0000) | (p10 & 0x0F0F);
-                    p01 = ((p01 << 12) & 0x0F0F0000) | (p01 & 0x0F0F);
-                    p11 = ((p11 << 12) & 0x0F0F0000) | (p11 & 0x0F0F);
-                    uint32_t rbga = (p00 + p10 + p01 + p11) >> 2;
-                    uint32_t rgba = (rbga & 0x0F0F) | ((rbga>>12) & 0xF0F0);
-                    dst[x + y*stride] = rgba;
-                    offset += 2;
-                }
+                uint16_t const * src0 = src + (y*2) * bs;
+                downsampleRow4444(dst + y*stride, src0, src0 + bs, w);
             }
         } else {
             ALOGE("Unsupported format (%d)", base->format);
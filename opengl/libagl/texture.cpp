@@ -21,6 +21,7 @@
 #include "fp.h"
 #include "state.h"
 #include "texture.h"
+#include "binning.h"
 #include "TextureObjectManager.h"
 
 #include <ETC1/etc1.h>
@@ -147,11 +148,17 @@ void ogles_lock_textures(ogles_context_t* c)
 
 void ogles_unlock_textures(ogles_context_t* c)
 {
+    bool finished = false;
     for (int i=0 ; i<GGL_TEXTURE_UNIT_COUNT ; i++) {
         if (c->rasterizer.state.texture[i].enable) {
             texture_unit_t& u(c->textures.tmu[i]);
             ANativeWindowBuffer* native_buffer = u.texture->buffer;
             if (native_buffer) {
+                // the buffer must stay mapped until we're done drawing
+                if (!finished) {
+                    ogles_finish_binning(c);
+                    finished = true;
+                }
                 c->rasterizer.procs.activeTexture(c, i);
 
                 auto& mapper = GraphicBufferMapper::get();
@@ -281,6 +288,28 @@ int copyPixels(
         return 0;
     }
 
+    if ((dst.format == src.format) &&
+        (dst.stride > 0) && (src.stride > 0) &&
+        ((x|y|xoffset|yoffset|w|h) >= 0) &&
+        (x+w <= GLint(src.width)) && (y+h <= GLint(src.height)) &&
+        (xoffset+w <= GLint(dst.width)) && (yoffset+h <= GLint(dst.height)))
+    {
+        // sub-images and rows padded by GL_UNPACK_ALIGNMENT: nothing to
+        // convert either, copy the rows rather than having pixel-flinger
+        // sample them texel by texel.
+        const GGLFormat& pixelFormat(c->rasterizer.formats[src.format]);
+        const size_t bpp = pixelFormat.size;
+        const size_t bpr = w * bpp;
+        uint8_t const* s = src.data + (y*size_t(src.stride) + x) * bpp;
+        uint8_t* d = dst.data + (yoffset*size_t(dst.stride) + xoffset) * bpp;
+        for (GLsizei i=0 ; i<h ; i++) {
+            memcpy(d, s, bpr);
+            s += src.stride * bpp;
+            d += dst.stride * bpp;
+        }
+        return 0;
+    }
+
     // use pixel-flinger to handle all the conversions
     GGLContext* ggl = getRasterizer(c);
     if (!ggl) {
@@ -304,6 +333,9 @@ sp<EGLTextureObject> getAndBindActiveTextureObject(ogles_context_t* c)
     const int active = c->textures.active;
     const GLuint name = c->textures.tmu[active].name;
 
+    // the texture (or its memory) is about to be replaced
+    ogles_finish_binning(c);
+
     // free the reference to the previously bound object
     texture_unit_t& u(c->textures.tmu[active]);
     if (u.texture)
@@ -338,10 +370,13 @@ void bindTextureTmu(
     if (tex.get() == c->textures.tmu[tmu].texture)
         return;
 
-    // free the reference to the previously bound object
+    // free the reference to the previously bound object, pending drawing
+    // may still be sampling from it.
     texture_unit_t& u(c->textures.tmu[tmu]);
-    if (u.texture)
+    if (u.texture) {
+        ogles_retain_texture(c, u.texture);
         u.texture->decStrong(c);
+    }
 
     // bind this texture to the current active texture unit
     // and add a reference to this texture object
@@ -900,6 +935,9 @@ void glDeleteTextures(GLsizei n, const GLuint *textures)
         return;
     }
 
+    // textures may be freed below
+    ogles_finish_binning(c);
+
     // If deleting a bound texture, bind this unit to 0
     for (int t=0 ; t<GGL_TEXTURE_UNIT_COUNT ; t++) {
         if (c->textures.tmu[t].name == 0)
@@ -1287,6 +1325,7 @@ void glTexSubImage2D(
     userSurface.compressedFormat = 0;
     userSurface.data = (GLubyte*)pixels;
 
+    ogles_finish_binning(c);
     int err = copyPixels(c,
             surface, xoffset, yoffset,
             userSurface, 0, 0, width, height);
@@ -1442,6 +1481,8 @@ void glCopyTexSubImage2D(
         return;
     }
 
+    ogles_finish_binning(c);
+
     // The bottom row is stored first in textures
     GGLSurface txSurface(surface);
     txSurface.stride = -txSurface.stride;
@@ -1511,6 +1552,8 @@ void glReadPixels(
         return;
     }
 
+    ogles_finish_binning(c);
+
     const GGLFormat& pixelFormat(c->rasterizer.formats[formatIdx]);
     const int32_t align = c->textures.packAlignment-1;
     const int32_t bpr = ((width * pixelFormat.size) + align) & ~align;
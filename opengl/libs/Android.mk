@@ -25,6 +25,8 @@ LOCAL_SRC_FILES:= 	       \
 	EGL/egl_cache.cpp      \
 	EGL/egl_display.cpp    \
 	EGL/egl_object.cpp     \
+	EGL/egl_object_table.cpp \
+	EGL/egl_profiler.cpp   \
 	EGL/egl.cpp 	       \
 	EGL/eglApi.cpp 	       \
 	EGL/getProcAddress.cpp.arm \
@@ -133,6 +133,7 @@ static void* do_dlopen(const char* path, int mode) {
 // ----------------------------------------------------------------------------
 
 Loader::driver_t::driver_t(void* gles)
+    : gles1(false)
 {
     dso[0] = gles;
     for (size_t i=1 ; i<NELEM(dso) ; i++)
@@ -258,12 +259,13 @@ void* Loader::open(egl_connection_t* cnx)
     dso = load_driver("GLES", cnx, EGL | GLESv1_CM | GLESv2);
     if (dso) {
         hnd = new driver_t(dso);
+        hnd->gles1 = true;
     } else {
         // Always load EGL first
         dso = load_driver("EGL", cnx, EGL);
         if (dso) {
             hnd = new driver_t(dso);
-            hnd->set( load_driver("GLESv1_CM", cnx, GLESv1_CM), GLESv1_CM );
+            // GLESv1_CM is loaded by open_gles1() if it's ever needed
             hnd->set( load_driver("GLESv2",    cnx, GLESv2),    GLESv2 );
         }
     }
@@ -283,6 +285,18 @@ void* Loader::open(egl_connection_t* cnx)
     return (void*)hnd;
 }
 
+void Loader::open_gles1(egl_connection_t* cnx)
+{
+    Mutex::Autolock _l(mGLESv1Lock);
+    driver_t* hnd = (driver_t*)cnx->dso;
+    if (hnd == NULL || hnd->gles1) {
+        return;
+    }
+    ATRACE_CALL();
+    hnd->set( load_driver("GLESv1_CM", cnx, GLESv1_CM), GLESv1_CM );
+    hnd->gles1 = true;
+}
+
 status_t Loader::close(void* driver)
 {
     driver_t* hnd = (driver_t*)driver;
@@ -552,17 +566,22 @@ void *Loader::load_driver(const char* kind,
         }
     }
 
-    if (mask & GLESv1_CM) {
-        init_api(dso, gl_names,
+    if (mask & GLESv2) {
+      init_api(dso, gl_names,
             (__eglMustCastToProperFunctionPointerType*)
-                &cnx->hooks[egl_connection_t::GLESv1_INDEX]->gl,
+                &cnx->hooks[egl_connection_t::GLESv2_INDEX]->gl,
             getProcAddress);
     }
 
-    if (mask & GLESv2) {
-      init_api(dso, gl_names,
+    if ((mask & GLESv1_CM) && (mask & GLESv2)) {
+        // both APIs come from the same library, the lookups would give the
+        // same result again.
+        cnx->hooks[egl_connection_t::GLESv1_INDEX]->gl =
+                cnx->hooks[egl_connection_t::GLESv2_INDEX]->gl;
+    } else if (mask & GLESv1_CM) {
+        init_api(dso, gl_names,
             (__eglMustCastToProperFunctionPointerType*)
-                &cnx->hooks[egl_connection_t::GLESv2_INDEX]->gl,
+                &cnx->hooks[egl_connection_t::GLESv1_INDEX]->gl,
             getProcAddress);
     }
 
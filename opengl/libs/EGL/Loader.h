@@ -22,6 +22,7 @@
 #include <errno.h>
 
 #include <utils/Errors.h>
+#include <utils/Mutex.h>
 #include <utils/Singleton.h>
 #include <utils/String8.h>
 
@@ -52,18 +53,27 @@ class Loader : public Singleton<Loader>
         ~driver_t();
         status_t set(void* hnd, int32_t api);
         void* dso[3];
+        // whether the GLESv1_CM entry points have been resolved, see
+        // open_gles1().
+        bool gles1;
     };
     
     getProcAddressType getProcAddress;
 
     void* mLibGui;
     decltype(android_getDriverNamespace)* mGetDriverNamespace;
+    Mutex mGLESv1Lock;
 
 public:
     ~Loader();
     
     void* open(egl_connection_t* cnx);
     status_t close(void* driver);
+
+    // open() skips the GLESv1_CM driver library when it is separate, few
+    // applications use GLESv1. This loads it, it must be called before a
+    // GLESv1 context is created.
+    void open_gles1(egl_connection_t* cnx);
     
 private:
     Loader();
@@ -18,6 +18,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <atomic>
+
 #include <hardware/gralloc.h>
 #include <system/window.h>
 
@@ -203,15 +205,36 @@ static EGLBoolean egl_init_drivers_locked() {
 }
 
 static pthread_mutex_t sInitDriverMutex = PTHREAD_MUTEX_INITIALIZER;
+static std::atomic<bool> sDriversInitialized(false);
 
 EGLBoolean egl_init_drivers() {
+    // Called on every eglGetProcAddress() and eglGetDisplay(), don't take
+    // the lock once the drivers are loaded.
+    if (sDriversInitialized.load(std::memory_order_acquire)) {
+        return EGL_TRUE;
+    }
     EGLBoolean res;
     pthread_mutex_lock(&sInitDriverMutex);
     res = egl_init_drivers_locked();
+    if (res == EGL_TRUE) {
+        sDriversInitialized.store(true, std::memory_order_release);
+    }
     pthread_mutex_unlock(&sInitDriverMutex);
     return res;
 }
 
+// Called by the zygote through GraphicsEnv::preloadDrivers(), so that the
+// driver libraries are loaded, relocated and resolved once and the pages are
+// shared with every application it forks. Unlike the first EGL call, this
+// also loads the GLESv1_CM library, it's free for the applications then.
+extern "C" EGLAPI EGLBoolean android_preloadGraphicsDrivers() {
+    if (egl_init_drivers() == EGL_FALSE) {
+        return EGL_FALSE;
+    }
+    Loader::getInstance().open_gles1(&gEGLImpl);
+    return EGL_TRUE;
+}
+
 static pthread_mutex_t sLogPrintMutex = PTHREAD_MUTEX_INITIALIZER;
 static nsecs_t sLogPrintTime = 0;
 #define NSECS_DURATION 1000000000
@@ -21,6 +21,9 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
+#include <atomic>
+
 #include <hardware/gralloc.h>
 #include <system/window.h>
 
@@ -37,7 +40,6 @@
 
 #include <ui/GraphicBuffer.h>
 
-#include <utils/KeyedVector.h>
 #include <utils/SortedVector.h>
 #include <utils/String8.h>
 #include <utils/Trace.h>
@@ -51,8 +53,10 @@
 
 #include "egl_display.h"
 #include "egl_object.h"
+#include "egl_profiler.h"
 #include "egl_tls.h"
 #include "egldefs.h"
+#include "Loader.h"
 
 using namespace android;
 
@@ -238,21 +242,74 @@ static const extention_map_t sExtensionMap[] = {
 
 
 
-// accesses protected by sExtensionMapMutex
-static DefaultKeyedVector<String8, __eglMustCastToProperFunctionPointerType> sGLExtentionMap;
-static int sGLExtentionSlot = 0;
-static pthread_mutex_t sExtensionMapMutex = PTHREAD_MUTEX_INITIALIZER;
+/*
+ * A table of procedure names and their addresses, which is looked up without
+ * taking a lock. Entries are never removed, and calls to add() must be
+ * serialized. N is a power of two larger than the number of entries.
+ */
+template <size_t N>
+class proc_table_t {
+public:
+    __eglMustCastToProperFunctionPointerType find(const char* name) const {
+        for (size_t i = hash(name), n = 0; n < N; i = (i + 1) & (N - 1), n++) {
+            const char* slotName = mSlots[i].name.load(std::memory_order_acquire);
+            if (!slotName) {
+                break;
+            }
+            if (!strcmp(name, slotName)) {
+                return mSlots[i].address;
+            }
+        }
+        return NULL;
+    }
 
-static void(*findProcAddress(const char* name,
-        const extention_map_t* map, size_t n))() {
-    for (uint32_t i=0 ; i<n ; i++) {
-        if (!strcmp(name, map[i].name)) {
-            return map[i].address;
+    // name must stay valid for the lifetime of the table.
+    void add(const char* name, __eglMustCastToProperFunctionPointerType address) {
+        size_t i = hash(name);
+        while (mSlots[i].name.load(std::memory_order_relaxed)) {
+            i = (i + 1) & (N - 1);
         }
+        mSlots[i].address = address;
+        mSlots[i].name.store(name, std::memory_order_release);
     }
-    return NULL;
+
+private:
+    static size_t hash(const char* name) {
+        // FNV-1a
+        uint32_t h = 2166136261u;
+        for (; *name; name++) {
+            h = (h ^ uint8_t(*name)) * 16777619u;
+        }
+        return h & (N - 1);
+    }
+
+    struct slot_t {
+        std::atomic<const char*> name;
+        __eglMustCastToProperFunctionPointerType address;
+    };
+    slot_t mSlots[N];
+};
+
+static __eglMustCastToProperFunctionPointerType findExtensionProc(
+        const char* name) {
+    static const proc_table_t<64>* const table = []() {
+        static_assert(NELEM(sExtensionMap) < 64, "sExtensionMap is too large");
+        proc_table_t<64>* t = new proc_table_t<64>();
+        for (size_t i = 0; i < NELEM(sExtensionMap); i++) {
+            t->add(sExtensionMap[i].name, sExtensionMap[i].address);
+        }
+        return t;
+    }();
+    return table->find(name);
 }
 
+// The GL extensions resolved so far and the forwarders returned for them.
+// Lookups just read sGLExtensionTable, adding extensions and accesses to
+// sGLExtentionSlot are protected by sExtensionMapMutex.
+static proc_table_t<MAX_NUMBER_OF_GL_EXTENSIONS * 2> sGLExtensionTable;
+static int sGLExtentionSlot = 0;
+static pthread_mutex_t sExtensionMapMutex = PTHREAD_MUTEX_INITIALIZER;
+
 // ----------------------------------------------------------------------------
 
 extern void setGLHooksThreadSpecific(gl_hooks_t const *value);
@@ -698,24 +755,29 @@ EGLContext eglCreateContext(EGLDisplay dpy, EGLConfig config,
             egl_context_t* const c = get_context(share_list);
             share_list = c->context;
         }
+        // figure out if it's a GLESv1 or GLESv2
+        int version = 0;
+        if (attrib_list) {
+            const EGLint* attribs = attrib_list;
+            while (*attribs != EGL_NONE) {
+                GLint attr = *attribs++;
+                GLint value = *attribs++;
+                if (attr == EGL_CONTEXT_CLIENT_VERSION) {
+                    if (value == 1) {
+                        version = egl_connection_t::GLESv1_INDEX;
+                    } else if (value == 2 || value == 3) {
+                        version = egl_connection_t::GLESv2_INDEX;
+                    }
+                }
+            };
+        }
+        if (version == egl_connection_t::GLESv1_INDEX) {
+            // the driver may expect its GLESv1_CM library to be loaded
+            Loader::getInstance().open_gles1(cnx);
+        }
         EGLContext context = cnx->egl.eglCreateContext(
                 dp->disp.dpy, config, share_list, attrib_list);
         if (context != EGL_NO_CONTEXT) {
-            // figure out if it's a GLESv1 or GLESv2
-            int version = 0;
-            if (attrib_list) {
-                while (*attrib_list != EGL_NONE) {
-                    GLint attr = *attrib_list++;
-                    GLint value = *attrib_list++;
-                    if (attr == EGL_CONTEXT_CLIENT_VERSION) {
-                        if (value == 1) {
-                            version = egl_connection_t::GLESv1_INDEX;
-                        } else if (value == 2 || value == 3) {
-                            version = egl_connection_t::GLESv2_INDEX;
-                        }
-                    }
-                };
-            }
             egl_context_t* c = new egl_context_t(dpy, context, config, cnx,
                     version);
             return c;
@@ -821,14 +883,19 @@ EGLBoolean eglMakeCurrent(  EGLDisplay dpy, EGLSurface draw,
 
     if (result == EGL_TRUE) {
         if (c) {
-            setGLHooksThreadSpecific(c->cnx->hooks[c->version]);
-            egl_tls_t::setContext(ctx);
+            if (CC_UNLIKELY(egl_profiler_t::isEnabled())) {
+                setGLHooksThreadSpecific(egl_profiler_t::getHooks(c->version));
+            } else {
+                setGLHooksThreadSpecific(c->cnx->hooks[c->version]);
+            }
+            egl_tls_t::setCurrent(ctx, c->dpy, draw, read);
             _c.acquire();
             _r.acquire();
             _d.acquire();
         } else {
             setGLHooksThreadSpecific(&gHooksNoContext);
-            egl_tls_t::setContext(EGL_NO_CONTEXT);
+            egl_tls_t::setCurrent(EGL_NO_CONTEXT, EGL_NO_DISPLAY,
+                    EGL_NO_SURFACE, EGL_NO_SURFACE);
         }
     } else {
         // this will ALOGE the error
@@ -861,7 +928,7 @@ EGLContext eglGetCurrentContext(void)
     // could be called before eglInitialize(), but we wouldn't have a context
     // then, and this function would correctly return EGL_NO_CONTEXT.
 
-    clearError();
+    egl_tls_t::clearErrorNoImpl();
 
     EGLContext ctx = getContext();
     return ctx;
@@ -872,15 +939,13 @@ EGLSurface eglGetCurrentSurface(EGLint readdraw)
     // could be called before eglInitialize(), but we wouldn't have a context
     // then, and this function would correctly return EGL_NO_SURFACE.
 
-    clearError();
+    egl_tls_t::clearErrorNoImpl();
 
     EGLContext ctx = getContext();
     if (ctx) {
-        egl_context_t const * const c = get_context(ctx);
-        if (!c) return setError(EGL_BAD_CONTEXT, EGL_NO_SURFACE);
         switch (readdraw) {
-            case EGL_READ: return c->read;
-            case EGL_DRAW: return c->draw;
+            case EGL_READ:
+            case EGL_DRAW: return egl_tls_t::getSurface(readdraw);
             default: return setError(EGL_BAD_PARAMETER, EGL_NO_SURFACE);
         }
     }
@@ -892,15 +957,10 @@ EGLDisplay eglGetCurrentDisplay(void)
     // could be called before eglInitialize(), but we wouldn't have a context
     // then, and this function would correctly return EGL_NO_DISPLAY.
 
-    clearError();
+    egl_tls_t::clearErrorNoImpl();
 
-    EGLContext ctx = getContext();
-    if (ctx) {
-        egl_context_t const * const c = get_context(ctx);
-        if (!c) return setError(EGL_BAD_CONTEXT, EGL_NO_SURFACE);
-        return c->dpy;
-    }
-    return EGL_NO_DISPLAY;
+    // the display is only set while a context is current
+    return egl_tls_t::getDisplay();
 }
 
 EGLBoolean eglWaitGL(void)
@@ -931,6 +991,7 @@ EGLint eglGetError(void)
     egl_connection_t* const cnx = &gEGLImpl;
     if (cnx->dso) {
         err = cnx->egl.eglGetError();
+        egl_tls_t::setImplErrorCleared();
     }
     if (err == EGL_SUCCESS) {
         err = egl_tls_t::getError();
@@ -938,21 +999,42 @@ EGLint eglGetError(void)
     return err;
 }
 
+// The GL entry points exported by the wrapper libraries, in the order of
+// gl_names. They are resolved on first use.
+static const size_t sGLEntryCount =
+        sizeof(gl_hooks_t::gl_t) / sizeof(__eglMustCastToProperFunctionPointerType);
+static std::atomic<__eglMustCastToProperFunctionPointerType> sGLWrappers[sGLEntryCount];
+
 static __eglMustCastToProperFunctionPointerType findBuiltinWrapper(
         const char* procname) {
     const egl_connection_t* cnx = &gEGLImpl;
     void* proc = NULL;
 
-    proc = dlsym(cnx->libEgl, procname);
-    if (proc) return (__eglMustCastToProperFunctionPointerType)proc;
+    // gl_names is generated from entries.in, which tools/genfiles sorts by
+    // name, so GL entry points are found without asking the dynamic linker
+    // about every library.
+    const char* const* end = gl_names + sGLEntryCount;
+    const char* const* it = std::lower_bound(gl_names, end, procname,
+            [](const char* a, const char* b) { return strcmp(a, b) < 0; });
+    if (it == end || strcmp(*it, procname)) {
+        proc = dlsym(cnx->libEgl, procname);
+        return (__eglMustCastToProperFunctionPointerType)proc;
+    }
+
+    std::atomic<__eglMustCastToProperFunctionPointerType>& wrapper =
+            sGLWrappers[it - gl_names];
+    __eglMustCastToProperFunctionPointerType addr =
+            wrapper.load(std::memory_order_relaxed);
+    if (addr) return addr;
 
     proc = dlsym(cnx->libGles2, procname);
-    if (proc) return (__eglMustCastToProperFunctionPointerType)proc;
-
-    proc = dlsym(cnx->libGles1, procname);
-    if (proc) return (__eglMustCastToProperFunctionPointerType)proc;
-
-    return NULL;
+    if (!proc) {
+        proc = dlsym(cnx->libGles1, procname);
+    }
+    // Racing threads store the same value.
+    addr = (__eglMustCastToProperFunctionPointerType)proc;
+    wrapper.store(addr, std::memory_order_relaxed);
+    return addr;
 }
 
 __eglMustCastToProperFunctionPointerType eglGetProcAddress(const char *procname)
@@ -973,13 +1055,16 @@ __eglMustCastToProperFunctionPointerType eglGetProcAddress(const char *procname)
     }
 
     __eglMustCastToProperFunctionPointerType addr;
-    addr = findProcAddress(procname, sExtensionMap, NELEM(sExtensionMap));
+    addr = findExtensionProc(procname);
     if (addr) return addr;
 
     addr = findBuiltinWrapper(procname);
     if (addr) return addr;
 
-    // this protects accesses to sGLExtentionMap and sGLExtentionSlot
+    addr = sGLExtensionTable.find(procname);
+    if (addr) return addr;
+
+    // this protects adding to sGLExtensionTable and sGLExtentionSlot
     pthread_mutex_lock(&sExtensionMapMutex);
 
         /*
@@ -999,8 +1084,8 @@ __eglMustCastToProperFunctionPointerType eglGetProcAddress(const char *procname)
          *
          */
 
-        const String8 name(procname);
-        addr = sGLExtentionMap.valueFor(name);
+        // another thread may have resolved it since the lookup above
+        addr = sGLExtensionTable.find(procname);
         const int slot = sGLExtentionSlot;
 
         ALOGE_IF(slot >= MAX_NUMBER_OF_GL_EXTENSIONS,
@@ -1021,8 +1106,9 @@ __eglMustCastToProperFunctionPointerType eglGetProcAddress(const char *procname)
             }
 
             if (found) {
+                egl_profiler_t::setExtension(slot, addr);
                 addr = gExtensionForwarders[slot];
-                sGLExtentionMap.add(name, addr);
+                sGLExtensionTable.add(strdup(procname), addr);
                 sGLExtentionSlot++;
             }
         }
@@ -1109,6 +1195,8 @@ EGLBoolean eglSwapBuffersWithDamageKHR(EGLDisplay dpy, EGLSurface draw,
 
     egl_surface_t const * const s = get_surface(draw);
 
+    egl_profiler_t::SwapScope profile;
+
     if (CC_UNLIKELY(dp->traceGpuCompletion)) {
         EGLSyncKHR sync = eglCreateSyncKHR(dpy, EGL_SYNC_FENCE_KHR, NULL);
         if (sync != EGL_NO_SYNC_KHR) {
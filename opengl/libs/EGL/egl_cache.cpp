@@ -27,6 +27,9 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <vector>
+
 #ifndef MAX_EGL_CACHE_ENTRY_SIZE
 #define MAX_EGL_CACHE_ENTRY_SIZE (16 * 1024);
 #endif
@@ -44,10 +47,28 @@ static const size_t maxKeySize = MAX_EGL_CACHE_KEY_SIZE;
 static const size_t maxValueSize = MAX_EGL_CACHE_ENTRY_SIZE;
 static const size_t maxTotalSize = MAX_EGL_CACHE_SIZE;
 
-// Cache file header
-static const char* cacheFileMagic = "EGL$";
+// Cache file header: the magic followed by the format version.
+static const char* cacheFileMagic = "EGL#";
+static const uint32_t cacheFileVersion = 1;
 static const size_t cacheFileHeaderSize = 8;
 
+// Each record of the cache file is the key size, the value size and the CRC of
+// the key and value, followed by the key and the value. Records are appended
+// as pairs are inserted, the last record for a key wins.
+static const size_t cacheRecordHeaderSize = 12;
+
+// The cache file is rewritten from the cache contents instead of being
+// appended to once it would grow beyond this size.
+static const size_t maxLogSize = maxTotalSize * 2;
+
+// The seed cache is mapped rather than loaded, so it can be much larger than
+// the writable cache.
+#ifndef MAX_EGL_SEED_CACHE_SIZE
+#define MAX_EGL_SEED_CACHE_SIZE (4 * 1024 * 1024)
+#endif
+
+static const size_t maxSeedSize = MAX_EGL_SEED_CACHE_SIZE;
+
 // The time in seconds to wait before saving newly inserted cache entries.
 static const unsigned int deferredSaveDelay = 4;
 
@@ -75,7 +96,17 @@ static EGLsizeiANDROID getBlob(const void* key, EGLsizeiANDROID keySize,
 //
 egl_cache_t::egl_cache_t() :
         mInitialized(false),
-        mBlobCache(NULL) {
+        mLoaded(false),
+        mPersistent(false),
+        mTotalSize(0),
+        mUseCount(0),
+        mFileSize(0),
+        mNeedsCompaction(false),
+        mSavePending(false),
+        mSeed(NULL),
+        mHits(0),
+        mSeedHits(0),
+        mMisses(0) {
 }
 
 egl_cache_t::~egl_cache_t() {
@@ -128,60 +159,70 @@ void egl_cache_t::initialize(egl_display_t *display) {
 void egl_cache_t::terminate() {
     Mutex::Autolock lock(mMutex);
     saveBlobCacheLocked();
-    mBlobCache = NULL;
+    mLoaded = false;
+    mPersistent = false;
+    clear();
 }
 
 void egl_cache_t::setBlob(const void* key, EGLsizeiANDROID keySize,
         const void* value, EGLsizeiANDROID valueSize) {
-    Mutex::Autolock lock(mMutex);
-
     if (keySize < 0 || valueSize < 0) {
         ALOGW("EGL_ANDROID_blob_cache set: negative sizes are not allowed");
         return;
     }
 
     if (mInitialized) {
-        sp<BlobCache> bc = getBlobCacheLocked();
-        bc->set(key, keySize, value, valueSize);
-
-        if (!mSavePending) {
-            class DeferredSaveThread : public Thread {
-            public:
-                DeferredSaveThread() : Thread(false) {}
-
-                virtual bool threadLoop() {
-                    sleep(deferredSaveDelay);
-                    egl_cache_t* c = egl_cache_t::get();
-                    Mutex::Autolock lock(c->mMutex);
-                    if (c->mInitialized) {
-                        c->saveBlobCacheLocked();
-                    }
-                    c->mSavePending = false;
-                    return false;
-                }
-            };
-
-            // The thread will hold a strong ref to itself until it has finished
-            // running, so there's no need to keep a ref around.
-            sp<Thread> deferredSaveThread(new DeferredSaveThread());
-            mSavePending = true;
-            deferredSaveThread->run("DeferredSaveThread");
+        ensureLoaded();
+        std::string k(static_cast<const char*>(key), keySize);
+        std::string v(static_cast<const char*>(value), valueSize);
+        if (insert(k, v) && mPersistent) {
+            appendToLog(k, v);
         }
     }
 }
 
 EGLsizeiANDROID egl_cache_t::getBlob(const void* key, EGLsizeiANDROID keySize,
         void* value, EGLsizeiANDROID valueSize) {
-    Mutex::Autolock lock(mMutex);
-
     if (keySize < 0 || valueSize < 0) {
         ALOGW("EGL_ANDROID_blob_cache set: negative sizes are not allowed");
         return 0;
     }
 
     if (mInitialized) {
-        sp<BlobCache> bc = getBlobCacheLocked();
-        return bc->get(key, keySize, value, valueSize);
+        ensureLoaded();
+        std::string k(static_cast<const char*>(key), keySize);
+        shard_t& shard = getShard(k);
+        {
+            Mutex::Autolock lock(shard.mutex);
+            auto it = shard.index.find(k);
+            if (it != shard.index.end()) {
+                std::list<entry_t>::iterator entry = it->second;
+                entry->lastUse = ++mUseCount;
+                shard.entries.splice(shard.entries.begin(), shard.entries,
+                        entry);
+                shard.oldestUse = shard.entries.back().lastUse;
+
+                size_t size = entry->value.size();
+                if (size <= size_t(valueSize)) {
+                    memcpy(value, entry->value.data(), size);
+                }
+                mHits.fetch_add(1, std::memory_order_relaxed);
+                return size;
+            }
+        }
+
+        // Pairs set at runtime take precedence over the seed cache, which
+        // never changes once loaded.
+        const seed_t* seed = mSeed.load(std::memory_order_acquire);
+        const seed_t::record_t* record = seed ? seed->find(key, keySize) : NULL;
+        if (record != NULL) {
+            if (record->valueSize <= size_t(valueSize)) {
+                memcpy(value, record->value, record->valueSize);
+            }
+            mSeedHits.fetch_add(1, std::memory_order_relaxed);
+            return record->valueSize;
+        }
+        mMisses.fetch_add(1, std::memory_order_relaxed);
     }
     return 0;
 }
@@ -191,17 +232,123 @@ void egl_cache_t::setCacheFilename(const char* filename) {
     mFilename = filename;
 }
 
-sp<BlobCache> egl_cache_t::getBlobCacheLocked() {
-    if (mBlobCache == NULL) {
-        mBlobCache = new BlobCache(maxKeySize, maxValueSize, maxTotalSize);
-        loadBlobCacheLocked();
+void egl_cache_t::setSeedCacheFilename(const char* filename) {
+    Mutex::Autolock lock(mMutex);
+    if (mSeedFilename.length() > 0) {
+        ALOGV("ignoring attempt to change seed cache file from %s to %s",
+                mSeedFilename.string(), filename);
+        return;
+    }
+    mSeedFilename = filename;
+}
+
+void egl_cache_t::getStats(stats_t* stats) const {
+    stats->hits = mHits.load(std::memory_order_relaxed);
+    stats->seedHits = mSeedHits.load(std::memory_order_relaxed);
+    stats->misses = mMisses.load(std::memory_order_relaxed);
+    const seed_t* seed = mSeed.load(std::memory_order_acquire);
+    stats->seedEntries = seed ? seed->records.size() : 0;
+}
+
+egl_cache_t::shard_t& egl_cache_t::getShard(const std::string& key) {
+    return mShards[std::hash<std::string>()(key) % NUM_SHARDS];
+}
+
+void egl_cache_t::ensureLoaded() {
+    if (!mLoaded.load(std::memory_order_acquire)) {
+        Mutex::Autolock lock(mMutex);
+        if (!mLoaded) {
+            loadBlobCacheLocked();
+            if (mSeed.load(std::memory_order_relaxed) == NULL &&
+                    mSeedFilename.length() > 0) {
+                loadSeedCacheLocked();
+            }
+            mPersistent = mFilename.length() > 0;
+            mLoaded.store(true, std::memory_order_release);
+        }
+    }
+}
+
+bool egl_cache_t::insert(const std::string& key, const std::string& value) {
+    if (!insertIntoShard(key, value)) {
+        return false;
+    }
+    evict();
+    return true;
+}
+
+bool egl_cache_t::insertIntoShard(const std::string& key,
+        const std::string& value) {
+    if (key.size() > maxKeySize || value.size() > maxValueSize ||
+            key.size() + value.size() > maxTotalSize) {
+        return false;
+    }
+
+    shard_t& shard = getShard(key);
+    Mutex::Autolock lock(shard.mutex);
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+        std::list<entry_t>::iterator entry = it->second;
+        mTotalSize -= entry->value.size();
+        mTotalSize += value.size();
+        entry->value = value;
+        entry->lastUse = ++mUseCount;
+        shard.entries.splice(shard.entries.begin(), shard.entries, entry);
+    } else {
+        entry_t entry = { key, value, ++mUseCount };
+        shard.entries.push_front(entry);
+        shard.index[key] = shard.entries.begin();
+        mTotalSize += key.size() + value.size();
+    }
+    shard.oldestUse = shard.entries.back().lastUse;
+    return true;
+}
+
+void egl_cache_t::evict() {
+    // Only one shard is locked at a time, the victim is the shard holding the
+    // least recently used entry when it was looked at.
+    while (mTotalSize > maxTotalSize) {
+        shard_t* victim = NULL;
+        uint64_t oldestUse = UINT64_MAX;
+        for (size_t i = 0; i < NUM_SHARDS; i++) {
+            uint64_t use = mShards[i].oldestUse;
+            if (use < oldestUse) {
+                oldestUse = use;
+                victim = &mShards[i];
+            }
+        }
+        if (victim == NULL) {
+            break;
+        }
+
+        Mutex::Autolock lock(victim->mutex);
+        if (victim->entries.empty()) {
+            continue;
+        }
+        const entry_t& entry = victim->entries.back();
+        mTotalSize -= entry.key.size() + entry.value.size();
+        victim->index.erase(entry.key);
+        victim->entries.pop_back();
+        victim->oldestUse = victim->entries.empty() ?
+                UINT64_MAX : victim->entries.back().lastUse;
+    }
+}
+
+void egl_cache_t::clear() {
+    for (size_t i = 0; i < NUM_SHARDS; i++) {
+        shard_t& shard = mShards[i];
+        Mutex::Autolock lock(shard.mutex);
+        for (const entry_t& entry : shard.entries) {
+            mTotalSize -= entry.key.size() + entry.value.size();
+        }
+        shard.index.clear();
+        shard.entries.clear();
+        shard.oldestUse = UINT64_MAX;
     }
-    return mBlobCache;
 }
 
-static uint32_t crc32c(const uint8_t* buf, size_t len) {
+static uint32_t crc32c(uint32_t r, const uint8_t* buf, size_t len) {
     const uint32_t polyBits = 0x82F63B78;
-    uint32_t r = 0;
     for (size_t i = 0; i < len; i++) {
         r ^= buf[i];
         for (int j = 0; j < 8; j++) {
@@ -215,139 +362,346 @@ static uint32_t crc32c(const uint8_t* buf, size_t len) {
     return r;
 }
 
-void egl_cache_t::saveBlobCacheLocked() {
-    if (mFilename.length() > 0 && mBlobCache != NULL) {
-        size_t cacheSize = mBlobCache->getFlattenedSize();
-        size_t headerSize = cacheFileHeaderSize;
-        const char* fname = mFilename.string();
-
-        // Try to create the file with no permissions so we can write it
-        // without anyone trying to read it.
-        int fd = open(fname, O_CREAT | O_EXCL | O_RDWR, 0);
-        if (fd == -1) {
-            if (errno == EEXIST) {
-                // The file exists, delete it and try again.
-                if (unlink(fname) == -1) {
-                    // No point in retrying if the unlink failed.
-                    ALOGE("error unlinking cache file %s: %s (%d)", fname,
-                            strerror(errno), errno);
-                    return;
-                }
-                // Retry now that we've unlinked the file.
-                fd = open(fname, O_CREAT | O_EXCL | O_RDWR, 0);
-            }
-            if (fd == -1) {
-                ALOGE("error creating cache file %s: %s (%d)", fname,
-                        strerror(errno), errno);
-                return;
+static uint32_t recordCrc(const uint8_t* key, size_t keySize,
+        const uint8_t* value, size_t valueSize) {
+    return crc32c(crc32c(0, key, keySize), value, valueSize);
+}
+
+static void appendRecord(std::string* log, const std::string& key,
+        const std::string& value) {
+    uint32_t header[3] = {
+        uint32_t(key.size()),
+        uint32_t(value.size()),
+        recordCrc(reinterpret_cast<const uint8_t*>(key.data()), key.size(),
+                reinterpret_cast<const uint8_t*>(value.data()), value.size()),
+    };
+    log->append(reinterpret_cast<const char*>(header), sizeof(header));
+    log->append(key);
+    log->append(value);
+}
+
+static bool writeFully(int fd, const char* buf, size_t size) {
+    while (size > 0) {
+        ssize_t n = write(fd, buf, size);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
             }
+            return false;
         }
+        buf += n;
+        size -= n;
+    }
+    return true;
+}
+
+void egl_cache_t::appendToLog(const std::string& key,
+        const std::string& value) {
+    Mutex::Autolock lock(mLogMutex);
+    appendRecord(&mPendingLog, key, value);
+
+    if (!mSavePending) {
+        class DeferredSaveThread : public Thread {
+        public:
+            DeferredSaveThread() : Thread(false) {}
+
+            virtual bool threadLoop() {
+                sleep(deferredSaveDelay);
+                egl_cache_t* c = egl_cache_t::get();
+                Mutex::Autolock lock(c->mMutex);
+                if (c->mInitialized) {
+                    c->saveBlobCacheLocked();
+                }
+                // Records may have been queued while saving, run again if so.
+                Mutex::Autolock logLock(c->mLogMutex);
+                if (!c->mPendingLog.empty()) {
+                    return true;
+                }
+                c->mSavePending = false;
+                return false;
+            }
+        };
+
+        // The thread will hold a strong ref to itself until it has finished
+        // running, so there's no need to keep a ref around.
+        sp<Thread> deferredSaveThread(new DeferredSaveThread());
+        mSavePending = true;
+        deferredSaveThread->run("DeferredSaveThread");
+    }
+}
+
+void egl_cache_t::saveBlobCacheLocked() {
+    std::string pending;
+    {
+        Mutex::Autolock lock(mLogMutex);
+        pending.swap(mPendingLog);
+    }
+
+    if (mFilename.length() == 0 || !mLoaded) {
+        return;
+    }
 
-        size_t fileSize = headerSize + cacheSize;
+    if (mNeedsCompaction || mFileSize + pending.size() > maxLogSize) {
+        // The records queued so far are dropped, the cache contents are copied
+        // after that so any pair they hold is part of the rewritten file.
+        mNeedsCompaction = !compactBlobCacheLocked();
+        return;
+    }
+    if (pending.empty()) {
+        return;
+    }
 
-        uint8_t* buf = new uint8_t [fileSize];
-        if (!buf) {
-            ALOGE("error allocating buffer for cache contents: %s (%d)",
+    const char* fname = mFilename.string();
+    int fd = open(fname, O_WRONLY | O_APPEND, 0);
+    if (fd == -1) {
+        if (errno != ENOENT) {
+            ALOGE("error opening cache file %s: %s (%d)", fname,
                     strerror(errno), errno);
-            close(fd);
-            unlink(fname);
-            return;
         }
+        mNeedsCompaction = !compactBlobCacheLocked();
+        return;
+    }
 
-        status_t err = mBlobCache->flatten(buf + headerSize, cacheSize);
-        if (err != OK) {
-            ALOGE("error writing cache contents: %s (%d)", strerror(-err),
-                    -err);
-            delete [] buf;
-            close(fd);
-            unlink(fname);
-            return;
-        }
+    if (!writeFully(fd, pending.data(), pending.size())) {
+        ALOGE("error writing cache file: %s (%d)", strerror(errno), errno);
+        close(fd);
+        // The file may end in a partial record now.
+        mNeedsCompaction = !compactBlobCacheLocked();
+        return;
+    }
+    close(fd);
+    mFileSize += pending.size();
+}
 
-        // Write the file magic and CRC
-        memcpy(buf, cacheFileMagic, 4);
-        uint32_t* crc = reinterpret_cast<uint32_t*>(buf + 4);
-        *crc = crc32c(buf + headerSize, cacheSize);
-
-        if (write(fd, buf, fileSize) == -1) {
-            ALOGE("error writing cache file: %s (%d)", strerror(errno),
-                    errno);
-            delete [] buf;
-            close(fd);
-            unlink(fname);
-            return;
+bool egl_cache_t::compactBlobCacheLocked() {
+    std::vector<entry_t> entries;
+    for (size_t i = 0; i < NUM_SHARDS; i++) {
+        shard_t& shard = mShards[i];
+        Mutex::Autolock lock(shard.mutex);
+        entries.insert(entries.end(), shard.entries.begin(),
+                shard.entries.end());
+    }
+
+    // Write the least recently used entries first, so that loading the file
+    // back preserves the order of use.
+    std::sort(entries.begin(), entries.end(),
+            [](const entry_t& a, const entry_t& b) {
+                return a.lastUse < b.lastUse;
+            });
+    std::string buf;
+    buf.append(cacheFileMagic, 4);
+    buf.append(reinterpret_cast<const char*>(&cacheFileVersion),
+            sizeof(cacheFileVersion));
+    for (const entry_t& entry : entries) {
+        appendRecord(&buf, entry.key, entry.value);
+    }
+
+    // Write the new contents to a temporary file with no permissions so no
+    // one tries to read it before it's complete, then move it into place.
+    String8 tmpName(mFilename);
+    tmpName.append(".tmp");
+    const char* tname = tmpName.string();
+    unlink(tname);
+    int fd = open(tname, O_CREAT | O_EXCL | O_WRONLY, 0);
+    if (fd == -1) {
+        ALOGE("error creating cache file %s: %s (%d)", tname,
+                strerror(errno), errno);
+        return false;
+    }
+
+    if (!writeFully(fd, buf.data(), buf.size())) {
+        ALOGE("error writing cache file: %s (%d)", strerror(errno), errno);
+        close(fd);
+        unlink(tname);
+        return false;
+    }
+
+    fchmod(fd, S_IRUSR | S_IWUSR);
+    close(fd);
+    if (rename(tname, mFilename.string()) == -1) {
+        ALOGE("error renaming cache file %s: %s (%d)", tname,
+                strerror(errno), errno);
+        unlink(tname);
+        return false;
+    }
+    mFileSize = buf.size();
+    return true;
+}
+
+// mapCacheFile maps a cache file read-only and checks its header. Returns NULL
+// if the file doesn't exist, is larger than maxSize or isn't a cache file.
+static const uint8_t* mapCacheFile(const char* fname, size_t maxSize,
+        size_t* outSize) {
+    int fd = open(fname, O_RDONLY, 0);
+    if (fd == -1) {
+        if (errno != ENOENT) {
+            ALOGE("error opening cache file %s: %s (%d)", fname,
+                    strerror(errno), errno);
         }
+        return NULL;
+    }
+
+    struct stat statBuf;
+    if (fstat(fd, &statBuf) == -1) {
+        ALOGE("error stat'ing cache file: %s (%d)", strerror(errno), errno);
+        close(fd);
+        return NULL;
+    }
 
-        delete [] buf;
-        fchmod(fd, S_IRUSR);
+    // Sanity check the size before trying to mmap it.
+    size_t fileSize = statBuf.st_size;
+    if (fileSize > maxSize || fileSize < cacheFileHeaderSize) {
+        ALOGE("cache file has a bad size: %#" PRIx64,
+              static_cast<off64_t>(statBuf.st_size));
         close(fd);
+        return NULL;
+    }
+
+    uint8_t* buf = reinterpret_cast<uint8_t*>(mmap(NULL, fileSize,
+            PROT_READ, MAP_PRIVATE, fd, 0));
+    close(fd);
+    if (buf == MAP_FAILED) {
+        ALOGE("error mmaping cache file: %s (%d)", strerror(errno),
+                errno);
+        return NULL;
     }
+
+    // Check the file magic and version
+    uint32_t version;
+    memcpy(&version, buf + 4, sizeof(version));
+    if (memcmp(buf, cacheFileMagic, 4) != 0 ||
+            version != cacheFileVersion) {
+        ALOGE("cache file has bad mojo");
+        munmap(buf, fileSize);
+        return NULL;
+    }
+
+    *outSize = fileSize;
+    return buf;
+}
+
+// forEachRecord calls f(key, keySize, value, valueSize) for the records of a
+// mapped cache file in order, stopping at the first one that is truncated or
+// fails its CRC check. Returns the offset it stopped at, which is the file
+// size if all the records are intact.
+template <typename F>
+static size_t forEachRecord(const uint8_t* buf, size_t fileSize, F f) {
+    size_t offset = cacheFileHeaderSize;
+    while (fileSize - offset >= cacheRecordHeaderSize) {
+        uint32_t header[3];
+        memcpy(header, buf + offset, cacheRecordHeaderSize);
+        size_t keySize = header[0];
+        size_t valueSize = header[1];
+        size_t remaining = fileSize - offset - cacheRecordHeaderSize;
+        if (remaining < keySize || remaining - keySize < valueSize) {
+            break;
+        }
+        const uint8_t* key = buf + offset + cacheRecordHeaderSize;
+        const uint8_t* value = key + keySize;
+        if (recordCrc(key, keySize, value, valueSize) != header[2]) {
+            break;
+        }
+        f(key, keySize, value, valueSize);
+        offset += cacheRecordHeaderSize + keySize + valueSize;
+    }
+    return offset;
 }
 
 void egl_cache_t::loadBlobCacheLocked() {
-    if (mFilename.length() > 0) {
-        size_t headerSize = cacheFileHeaderSize;
+    mFileSize = 0;
+    mNeedsCompaction = true;
 
-        int fd = open(mFilename.string(), O_RDONLY, 0);
-        if (fd == -1) {
-            if (errno != ENOENT) {
-                ALOGE("error opening cache file %s: %s (%d)", mFilename.string(),
-                        strerror(errno), errno);
-            }
+    if (mFilename.length() > 0) {
+        // A file written by appending stays below maxLogSize, except for the
+        // last save.
+        size_t fileSize;
+        const uint8_t* buf = mapCacheFile(mFilename.string(), maxLogSize * 2,
+                &fileSize);
+        if (buf == NULL) {
             return;
         }
 
-        struct stat statBuf;
-        if (fstat(fd, &statBuf) == -1) {
-            ALOGE("error stat'ing cache file: %s (%d)", strerror(errno), errno);
-            close(fd);
-            return;
+        // Replay the records in order. Whatever was read up to a corrupt
+        // record is kept, and the file gets rewritten on the next save.
+        size_t offset = forEachRecord(buf, fileSize,
+                [this](const uint8_t* key, size_t keySize,
+                        const uint8_t* value, size_t valueSize) {
+                    insert(std::string(reinterpret_cast<const char*>(key),
+                                    keySize),
+                            std::string(reinterpret_cast<const char*>(value),
+                                    valueSize));
+                });
+        bool corrupt = offset != fileSize;
+        if (corrupt) {
+            ALOGE("cache file is corrupt at offset %zu", offset);
         }
 
-        // Sanity check the size before trying to mmap it.
-        size_t fileSize = statBuf.st_size;
-        if (fileSize > maxTotalSize * 2) {
-            ALOGE("cache file is too large: %#" PRIx64,
-                  static_cast<off64_t>(statBuf.st_size));
-            close(fd);
-            return;
-        }
+        munmap(const_cast<uint8_t*>(buf), fileSize);
+        mFileSize = offset;
+        mNeedsCompaction = corrupt;
+    }
+}
 
-        uint8_t* buf = reinterpret_cast<uint8_t*>(mmap(NULL, fileSize,
-                PROT_READ, MAP_PRIVATE, fd, 0));
-        if (buf == MAP_FAILED) {
-            ALOGE("error mmaping cache file: %s (%d)", strerror(errno),
-                    errno);
-            close(fd);
-            return;
-        }
+// FNV-1a, used to index the records of the seed cache.
+static uint32_t hashKey(const uint8_t* key, size_t keySize) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < keySize; i++) {
+        h = (h ^ key[i]) * 16777619u;
+    }
+    return h;
+}
 
-        // Check the file magic and CRC
-        size_t cacheSize = fileSize - headerSize;
-        if (memcmp(buf, cacheFileMagic, 4) != 0) {
-            ALOGE("cache file has bad mojo");
-            close(fd);
-            return;
-        }
-        uint32_t* crc = reinterpret_cast<uint32_t*>(buf + 4);
-        if (crc32c(buf + headerSize, cacheSize) != *crc) {
-            ALOGE("cache file failed CRC check");
-            close(fd);
-            return;
-        }
+void egl_cache_t::loadSeedCacheLocked() {
+    const char* fname = mSeedFilename.string();
+    size_t fileSize;
+    const uint8_t* buf = mapCacheFile(fname, maxSeedSize, &fileSize);
+    if (buf == NULL) {
+        return;
+    }
 
-        status_t err = mBlobCache->unflatten(buf + headerSize, cacheSize);
-        if (err != OK) {
-            ALOGE("error reading cache contents: %s (%d)", strerror(-err),
-                    -err);
-            munmap(buf, fileSize);
-            close(fd);
-            return;
-        }
+    seed_t* seed = new seed_t();
+    size_t offset = forEachRecord(buf, fileSize,
+            [seed](const uint8_t* key, size_t keySize,
+                    const uint8_t* value, size_t valueSize) {
+                seed_t::record_t record = {
+                    hashKey(key, keySize),
+                    uint32_t(keySize),
+                    uint32_t(valueSize),
+                    key,
+                    value,
+                };
+                seed->records.push_back(record);
+            });
+    if (offset != fileSize) {
+        ALOGE("seed cache file %s is corrupt at offset %zu", fname, offset);
+    }
 
-        munmap(buf, fileSize);
-        close(fd);
+    // A stable sort keeps the records of a key in file order, the last one
+    // wins as when loading a writable cache file.
+    std::stable_sort(seed->records.begin(), seed->records.end(),
+            [](const seed_t::record_t& a, const seed_t::record_t& b) {
+                return a.hash < b.hash;
+            });
+    seed->base = buf;
+    seed->size = fileSize;
+    mSeed.store(seed, std::memory_order_release);
+}
+
+const egl_cache_t::seed_t::record_t* egl_cache_t::seed_t::find(
+        const void* key, size_t keySize) const {
+    record_t probe = {};
+    probe.hash = hashKey(static_cast<const uint8_t*>(key), keySize);
+    auto range = std::equal_range(records.begin(), records.end(), probe,
+            [](const record_t& a, const record_t& b) {
+                return a.hash < b.hash;
+            });
+    for (auto it = range.second; it != range.first; ) {
+        --it;
+        if (it->keySize == keySize && !memcmp(it->key, key, keySize)) {
+            return &*it;
+        }
     }
+    return NULL;
 }
 
 // ----------------------------------------------------------------------------
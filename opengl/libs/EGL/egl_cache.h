@@ -17,12 +17,19 @@
 #ifndef ANDROID_EGL_CACHE_H
 #define ANDROID_EGL_CACHE_H
 
+#include <stdint.h>
+
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 
-#include <utils/BlobCache.h>
+#include <utils/Mutex.h>
 #include <utils/String8.h>
-#include <utils/StrongPointer.h>
+
+#include <atomic>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 // ----------------------------------------------------------------------------
 namespace android {
@@ -65,6 +72,25 @@ public:
     // cache contents from one program invocation to another.
     void setCacheFilename(const char* filename);
 
+    // setSeedCacheFilename sets the name of a read-only cache file whose
+    // contents are returned by getBlob for keys missing from the cache, such
+    // as one shipped with the system image or collected from an earlier run
+    // of the application.  It is a cache file written by this class, which is
+    // mapped into memory when the cache is first used.  Pairs set afterwards
+    // take precedence over it.  The seed cache can only be set once.
+    void setSeedCacheFilename(const char* filename);
+
+    // getStats returns how many getBlob calls were answered from the cache,
+    // from the seed cache or not at all since the process started, and how
+    // many entries the seed cache holds.
+    struct stats_t {
+        uint64_t hits;
+        uint64_t seedHits;
+        uint64_t misses;
+        size_t seedEntries;
+    };
+    void getStats(stats_t* stats) const;
+
 private:
     // Creation and (the lack of) destruction is handled internally.
     egl_cache_t();
@@ -74,32 +100,108 @@ private:
     egl_cache_t(const egl_cache_t&); // not implemented
     void operator=(const egl_cache_t&); // not implemented
 
-    // getBlobCacheLocked returns the BlobCache object being used to store the
-    // key/value blob pairs.  If the BlobCache object has not yet been created,
-    // this will do so, loading the serialized cache contents from disk if
-    // possible.
-    sp<BlobCache> getBlobCacheLocked();
+    // An entry of the cache. lastUse is the value of mUseCount when the entry
+    // was last inserted or retrieved.
+    struct entry_t {
+        std::string key;
+        std::string value;
+        uint64_t lastUse;
+    };
+
+    // The entries are spread over NUM_SHARDS shards by the hash of their key,
+    // each with its own lock, so that lookups of different keys from
+    // different threads don't serialize on one lock.
+    struct shard_t {
+        shard_t() : oldestUse(UINT64_MAX) {}
+        Mutex mutex;
+        // Ordered from the most to the least recently used.
+        std::list<entry_t> entries;
+        std::unordered_map<std::string, std::list<entry_t>::iterator> index;
+        // lastUse of the least recently used entry, UINT64_MAX when the
+        // shard is empty. Read without the lock to pick eviction victims.
+        std::atomic<uint64_t> oldestUse;
+    };
+
+    enum { NUM_SHARDS = 4 };
+
+    shard_t& getShard(const std::string& key);
 
-    // saveBlobCache attempts to save the current contents of mBlobCache to
-    // disk.
+    // ensureLoaded loads the saved cache contents from disk the first time
+    // the cache is used after initialize or terminate.
+    void ensureLoaded();
+
+    // insert stores a key/value pair in its shard, and then evicts the least
+    // recently used entries across all shards until the cache fits within
+    // its size limit again. Returns false if the pair is too large to be
+    // cached.
+    bool insert(const std::string& key, const std::string& value);
+    bool insertIntoShard(const std::string& key, const std::string& value);
+    void evict();
+
+    // clear drops all entries from memory.
+    void clear();
+
+    // appendToLog queues a record of an inserted pair, to be appended to the
+    // cache file by the deferred save, and schedules that save if needed.
+    void appendToLog(const std::string& key, const std::string& value);
+
+    // saveBlobCacheLocked writes the records queued since the last save to
+    // disk. If the file has grown too large, or didn't load cleanly, it's
+    // rewritten from the current contents of the cache instead. Only mMutex
+    // must be held, the shards are locked one at a time while they are
+    // copied.
     void saveBlobCacheLocked();
+    bool compactBlobCacheLocked();
 
-    // loadBlobCache attempts to load the saved cache contents from disk into
-    // mBlobCache.
+    // loadBlobCacheLocked attempts to load the saved cache contents from disk
+    // into the shards.
     void loadBlobCacheLocked();
 
+    // A seed cache file mapped into memory. The records are indexed by the
+    // hash of their key, and point into the mapping.
+    struct seed_t {
+        struct record_t {
+            uint32_t hash;
+            uint32_t keySize;
+            uint32_t valueSize;
+            const uint8_t* key;
+            const uint8_t* value;
+        };
+        const uint8_t* base;
+        size_t size;
+        // Sorted by hash, in file order for equal hashes.
+        std::vector<record_t> records;
+
+        const record_t* find(const void* key, size_t keySize) const;
+    };
+
+    // loadSeedCacheLocked maps the seed cache file and publishes it in mSeed.
+    void loadSeedCacheLocked();
+
     // mInitialized indicates whether the egl_cache_t is in the initialized
     // state.  It is initialized to false at construction time, and gets set to
     // true when initialize is called.  It is set back to false when terminate
     // is called.  When in this state, the cache behaves as normal.  When not,
     // the getBlob and setBlob methods will return without performing any cache
     // operations.
-    bool mInitialized;
+    std::atomic<bool> mInitialized;
+
+    // mLoaded indicates whether the saved contents have been loaded from the
+    // cache file since the last initialize or terminate.
+    std::atomic<bool> mLoaded;
+
+    // mPersistent indicates whether inserted pairs are logged to the cache
+    // file, which is the case when the contents were loaded with a file name
+    // set.
+    std::atomic<bool> mPersistent;
 
-    // mBlobCache is the cache in which the key/value blob pairs are stored.  It
-    // is initially NULL, and will be initialized by getBlobCacheLocked the
-    // first time it's needed.
-    sp<BlobCache> mBlobCache;
+    shard_t mShards[NUM_SHARDS];
+
+    // mTotalSize is the sum of the key and value sizes of all entries.
+    std::atomic<size_t> mTotalSize;
+
+    // mUseCount orders the entries by their last use.
+    std::atomic<uint64_t> mUseCount;
 
     // mFilename is the name of the file for storing cache contents in between
     // program invocations.  It is initialized to an empty string at
@@ -108,17 +210,46 @@ private:
     // from disk.
     String8 mFilename;
 
+    // mFileSize is the size of the cache file as loaded or last written.
+    size_t mFileSize;
+
+    // mNeedsCompaction is set when the cache file couldn't be loaded or
+    // appended to, so the next save rewrites it.
+    bool mNeedsCompaction;
+
+    // mPendingLog holds the serialized records not yet appended to the cache
+    // file. It is protected by mLogMutex.
+    std::string mPendingLog;
+
     // mSavePending indicates whether or not a deferred save operation is
     // pending.  Each time a key/value pair is inserted into the cache via
     // setBlob, a deferred save is initiated if one is not already pending.
     // This will wait some amount of time and then trigger a save of the cache
-    // contents to disk.
+    // contents to disk.  It is protected by mLogMutex.
     bool mSavePending;
 
-    // mMutex is the mutex used to prevent concurrent access to the member
-    // variables. It must be locked whenever the member variables are accessed.
+    // mSeedFilename is the name of the seed cache file, or an empty string if
+    // there is none.
+    String8 mSeedFilename;
+
+    // mSeed is the mapped seed cache, NULL until it has been loaded. Once set
+    // it is never changed or freed, so getBlob reads it without a lock.
+    std::atomic<const seed_t*> mSeed;
+
+    // Counters returned by getStats.
+    std::atomic<uint64_t> mHits;
+    std::atomic<uint64_t> mSeedHits;
+    std::atomic<uint64_t> mMisses;
+
+    // mMutex serializes initialize, terminate, loading and saving, and
+    // protects mFilename, mSeedFilename, mFileSize and mNeedsCompaction.
+    // getBlob and setBlob only take it to load the cache on first use.
     mutable Mutex mMutex;
 
+    // mLogMutex protects mPendingLog and mSavePending. It may be taken while
+    // holding mMutex, but no other lock may be taken while holding it.
+    mutable Mutex mLogMutex;
+
     // sCache is the singleton egl_cache_t object.
     static egl_cache_t sCache;
 };
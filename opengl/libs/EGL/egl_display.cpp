@@ -77,22 +77,28 @@ egl_display_t* egl_display_t::get(EGLDisplay dpy) {
 void egl_display_t::addObject(egl_object_t* object) {
     Mutex::Autolock _l(lock);
     objects.add(object);
+    objectTable.add(object);
 }
 
 void egl_display_t::removeObject(egl_object_t* object) {
     Mutex::Autolock _l(lock);
     objects.remove(object);
+    objectTable.remove(object);
 }
 
 bool egl_display_t::getObject(egl_object_t* object) const {
-    Mutex::Autolock _l(lock);
-    if (objects.indexOf(object) >= 0) {
-        if (object->getDisplay() == this) {
-            object->incRef();
-            return true;
-        }
+    // the object can't go away while it's pinned, this happens before the
+    // reference the display holds on it is released.
+    std::atomic<uint32_t>* pin = objectTable.pin(object);
+    if (pin == NULL) {
+        return false;
     }
-    return false;
+    bool valid = object->getDisplay() == this;
+    if (valid) {
+        object->incRef();
+    }
+    egl_object_table_t::unpin(pin);
+    return valid;
 }
 
 EGLDisplay egl_display_t::getFromNativeDisplay(EGLNativeDisplayType disp) {
@@ -281,6 +287,7 @@ EGLBoolean egl_display_t::terminate() {
         ALOGW_IF(count, "eglTerminate() called w/ %zu objects remaining", count);
         for (size_t i=0 ; i<count ; i++) {
             egl_object_t* o = objects.itemAt(i);
+            objectTable.remove(o);
             o->destroy();
         }
 
@@ -31,6 +31,7 @@
 #include <utils/String8.h>
 
 #include "egldefs.h"
+#include "egl_object_table.h"
 #include "../hooks.h"
 
 // ----------------------------------------------------------------------------
@@ -66,6 +67,7 @@ public:
     // remove object from this display's list
     void removeObject(egl_object_t* object);
     // add reference to this object. returns true if this is a valid object.
+    // this doesn't take the display's lock.
     bool getObject(egl_object_t* object) const;
 
     // These notifications allow the display to keep track of how many window
@@ -135,6 +137,8 @@ private:
     mutable Mutex                       lock, refLock;
     mutable Condition                   refCond;
             SortedVector<egl_object_t*> objects;
+            // same as objects, for getObject() to look up without the lock.
+            egl_object_table_t          objectTable;
             String8 mVendorString;
             String8 mVersionString;
             String8 mClientApiString;
@@ -0,0 +1,230 @@
+/*
+ ** Copyright 2016, The Android Open Source Project
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **     http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#include <sched.h>
+
+#include "egl_object_table.h"
+
+// ----------------------------------------------------------------------------
+namespace android {
+// ----------------------------------------------------------------------------
+
+egl_object_table_t::table_t::table_t(size_t capacity) :
+    capacity(capacity), used(0), slots(new slot_t[capacity]), next(NULL) {
+    for (size_t i=0 ; i<capacity ; i++) {
+        slots[i].key.store(KEY_EMPTY, std::memory_order_relaxed);
+        slots[i].pins.store(0, std::memory_order_relaxed);
+    }
+}
+
+egl_object_table_t::table_t::~table_t() {
+    delete [] slots;
+}
+
+egl_object_table_t::egl_object_table_t() :
+    mTable(new table_t(INITIAL_CAPACITY)), mRetired(NULL), mEpoch(0) {
+    mLookups[0].store(0, std::memory_order_relaxed);
+    mLookups[1].store(0, std::memory_order_relaxed);
+}
+
+egl_object_table_t::~egl_object_table_t() {
+    delete mTable.load(std::memory_order_relaxed);
+    while (mRetired) {
+        table_t* next = mRetired->next;
+        delete mRetired;
+        mRetired = next;
+    }
+}
+
+size_t egl_object_table_t::hash(uintptr_t key, size_t capacity) {
+    // objects are at least 8 bytes aligned, capacity is a power of two.
+    uint64_t h = uint64_t(key >> 3) * 0x9E3779B97F4A7C15ull;
+    return size_t(h >> 32) & (capacity - 1);
+}
+
+void egl_object_table_t::insert(table_t* table, uintptr_t key) {
+    // the table is never more than half full, so this finds a slot. A removed
+    // slot is free to reuse, remove() only returned once it was unpinned.
+    for (size_t i = hash(key, table->capacity) ;; i = (i + 1) & (table->capacity - 1)) {
+        slot_t& slot = table->slots[i];
+        uintptr_t k = slot.key.load(std::memory_order_relaxed);
+        if (k == KEY_EMPTY || k == KEY_REMOVED) {
+            slot.key.store(key, std::memory_order_release);
+            if (k == KEY_EMPTY) {
+                table->used++;
+            }
+            return;
+        }
+    }
+}
+
+bool egl_object_table_t::removeFrom(table_t* table, uintptr_t key) {
+    for (size_t i = hash(key, table->capacity), n = 0 ; n < table->capacity ;
+            i = (i + 1) & (table->capacity - 1), n++) {
+        slot_t& slot = table->slots[i];
+        uintptr_t k = slot.key.load(std::memory_order_relaxed);
+        if (k == KEY_EMPTY) {
+            break;
+        }
+        if (k == key) {
+            // pin() increments the pins before checking the key again,
+            // with both sequentially consistent either it sees the key
+            // removed or we see its pin.
+            slot.key.store(KEY_REMOVED, std::memory_order_seq_cst);
+            while (slot.pins.load(std::memory_order_seq_cst)) {
+                sched_yield();
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t egl_object_table_t::enterLookup() const {
+    for (;;) {
+        uint32_t parity = mEpoch.load(std::memory_order_seq_cst) & 1;
+        mLookups[parity].fetch_add(1, std::memory_order_seq_cst);
+        // counted under the epoch waitForLookups() will wait for, or retry.
+        if ((mEpoch.load(std::memory_order_seq_cst) & 1) == parity) {
+            return parity;
+        }
+        leaveLookup(parity);
+    }
+}
+
+void egl_object_table_t::waitForLookups() {
+    // A lookup that checked its parity just before the first flip is counted
+    // under the other one, so both are drained in turn. New lookups go to the
+    // parity not waited for and load the current table.
+    for (int i=0 ; i<2 ; i++) {
+        uint32_t epoch = mEpoch.load(std::memory_order_relaxed);
+        mEpoch.store(epoch + 1, std::memory_order_seq_cst);
+        while (mLookups[epoch & 1].load(std::memory_order_seq_cst)) {
+            sched_yield();
+        }
+    }
+}
+
+void egl_object_table_t::rehash() {
+    table_t* table = mTable.load(std::memory_order_relaxed);
+    size_t live = 0;
+    for (size_t i=0 ; i<table->capacity ; i++) {
+        if (table->slots[i].key.load(std::memory_order_relaxed) > KEY_REMOVED) {
+            live++;
+        }
+    }
+    // leave room for as many objects again before the next rehash.
+    size_t capacity = INITIAL_CAPACITY;
+    while (live * 4 > capacity) {
+        capacity *= 2;
+    }
+    table_t* fresh = new table_t(capacity);
+    for (size_t i=0 ; i<table->capacity ; i++) {
+        uintptr_t k = table->slots[i].key.load(std::memory_order_relaxed);
+        if (k > KEY_REMOVED) {
+            insert(fresh, k);
+        }
+    }
+    mTable.store(fresh, std::memory_order_seq_cst);
+
+    // pins taken in the old table from now on would have to come from
+    // lookups that loaded it before, which are done now. Its objects stay
+    // for remove() to wait for the pins already held.
+    waitForLookups();
+    table->next = mRetired;
+    mRetired = table;
+    freeRetiredTables();
+}
+
+void egl_object_table_t::freeRetiredTables() {
+    table_t** link = &mRetired;
+    while (*link) {
+        table_t* table = *link;
+        bool pinned = false;
+        for (size_t i=0 ; i<table->capacity && !pinned ; i++) {
+            pinned = table->slots[i].pins.load(std::memory_order_acquire) != 0;
+        }
+        if (pinned) {
+            link = &table->next;
+        } else {
+            *link = table->next;
+            delete table;
+        }
+    }
+}
+
+void egl_object_table_t::add(egl_object_t* object) {
+    table_t* table = mTable.load(std::memory_order_relaxed);
+    insert(table, uintptr_t(object));
+    if (table->used * 2 > table->capacity) {
+        rehash();
+    }
+}
+
+void egl_object_table_t::remove(egl_object_t* object) {
+    const uintptr_t key = uintptr_t(object);
+    removeFrom(mTable.load(std::memory_order_relaxed), key);
+    if (mRetired) {
+        // lookups may have found it in a table before it was replaced.
+        for (table_t* table = mRetired ; table ; table = table->next) {
+            removeFrom(table, key);
+        }
+        freeRetiredTables();
+    }
+}
+
+std::atomic<uint32_t>* egl_object_table_t::pin(egl_object_t const* object) const {
+    const uintptr_t key = uintptr_t(object);
+    const uint32_t parity = enterLookup();
+    table_t* table = mTable.load(std::memory_order_seq_cst);
+    std::atomic<uint32_t>* pin = NULL;
+    for (size_t i = hash(key, table->capacity), n = 0 ; n < table->capacity ;
+            i = (i + 1) & (table->capacity - 1), n++) {
+        slot_t& slot = table->slots[i];
+        uintptr_t k = slot.key.load(std::memory_order_acquire);
+        if (k == KEY_EMPTY) {
+            break;
+        }
+        if (k == key) {
+            slot.pins.fetch_add(1, std::memory_order_seq_cst);
+            if (slot.key.load(std::memory_order_seq_cst) == key) {
+                pin = &slot.pins;
+            } else {
+                // removed under us.
+                unpin(&slot.pins);
+            }
+            break;
+        }
+    }
+    leaveLookup(parity);
+    return pin;
+}
+
+size_t egl_object_table_t::getCapacity() const {
+    return mTable.load(std::memory_order_relaxed)->capacity;
+}
+
+size_t egl_object_table_t::getRetiredCount() const {
+    size_t count = 0;
+    for (table_t* table = mRetired ; table ; table = table->next) {
+        count++;
+    }
+    return count;
+}
+
+// ----------------------------------------------------------------------------
+}; // namespace android
+// ----------------------------------------------------------------------------
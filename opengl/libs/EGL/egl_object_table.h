@@ -0,0 +1,128 @@
+/*
+ ** Copyright 2016, The Android Open Source Project
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **     http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#ifndef ANDROID_EGL_OBJECT_TABLE_H
+#define ANDROID_EGL_OBJECT_TABLE_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <EGL/egl.h>
+
+// ----------------------------------------------------------------------------
+namespace android {
+// ----------------------------------------------------------------------------
+
+class egl_object_t;
+
+/*
+ * The set of live objects of a display, which EGL calls validate their
+ * surface and context handles against. Looking an object up takes no lock,
+ * so threads validating handles concurrently don't serialize on the display.
+ *
+ * Objects are kept in an open addressed hash table keyed by their address.
+ * A lookup pins the slot it found the object in, and remove() waits for the
+ * slot to be unpinned before returning, which guarantees that the object
+ * stays alive for as long as it is pinned. Removed objects leave a tombstone
+ * that add() reuses; when the tombstones and live objects fill half of the
+ * table, the live objects are moved to a new table sized for them. The old
+ * table is freed once no lookup can be walking it and none of its slots is
+ * pinned.
+ */
+class EGLAPI egl_object_table_t { // marked as EGLAPI for testing purposes
+public:
+    egl_object_table_t();
+    ~egl_object_table_t();
+
+    // add() and remove() must not be called concurrently with each other, but
+    // may be called concurrently with pin().
+    void add(egl_object_t* object);
+    // Once this returns, no pin of the object is held and no new pin can be
+    // taken.
+    void remove(egl_object_t* object);
+
+    // Returns the pin of the object if it is in the set, which the caller must
+    // release with unpin() as soon as it is done with the object. Returns NULL
+    // if object is not in the set.
+    std::atomic<uint32_t>* pin(egl_object_t const* object) const;
+    static void unpin(std::atomic<uint32_t>* pin) {
+        pin->fetch_sub(1, std::memory_order_release);
+    }
+
+    // For testing: the slots of the current table, and how many replaced
+    // tables are still waiting for their pins to be released.
+    size_t getCapacity() const;
+    size_t getRetiredCount() const;
+
+private:
+    struct slot_t {
+        std::atomic<uintptr_t> key;
+        std::atomic<uint32_t> pins;
+    };
+
+    struct table_t {
+        explicit table_t(size_t capacity);
+        ~table_t();
+        const size_t capacity;
+        // Slots which are or were used, the others end lookups.
+        size_t used;
+        slot_t* const slots;
+        // The table retired before this one.
+        table_t* next;
+    };
+
+    enum {
+        KEY_EMPTY   = 0,
+        KEY_REMOVED = 1,
+    };
+    static const size_t INITIAL_CAPACITY = 64;
+
+    static size_t hash(uintptr_t key, size_t capacity);
+    // Stores key in the first empty or removed slot of its chain.
+    static void insert(table_t* table, uintptr_t key);
+    // Marks key removed in table and waits for its pins, returns whether it
+    // was there.
+    static bool removeFrom(table_t* table, uintptr_t key);
+
+    // Lookups announce themselves under the parity of the epoch they start
+    // in, see waitForLookups().
+    uint32_t enterLookup() const;
+    void leaveLookup(uint32_t parity) const {
+        mLookups[parity].fetch_sub(1, std::memory_order_release);
+    }
+    // Returns once every lookup that could have loaded a replaced table has
+    // finished.
+    void waitForLookups();
+
+    // Moves the live objects of the current table to a new one.
+    void rehash();
+    // Frees the retired tables none of whose slots is pinned anymore.
+    void freeRetiredTables();
+
+    std::atomic<table_t*> mTable;
+    // Tables replaced by rehash() which slots may still be pinned in. They
+    // keep their objects so that remove() waits for those pins too.
+    table_t* mRetired;
+    std::atomic<uint32_t> mEpoch;
+    mutable std::atomic<uint32_t> mLookups[2];
+};
+
+// ----------------------------------------------------------------------------
+}; // namespace android
+// ----------------------------------------------------------------------------
+
+#endif // ANDROID_EGL_OBJECT_TABLE_H
@@ -0,0 +1,249 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+#include "egl_profiler.h"
+
+// ----------------------------------------------------------------------------
+namespace android {
+// ----------------------------------------------------------------------------
+
+#undef GL_ENTRY
+#define GL_ENTRY(_r, _api, ...) PROFILED_##_api,
+enum {
+    #include "../entries.in"
+    NUM_PROFILED_ENTRIES
+};
+#undef GL_ENTRY
+
+// the log shows the entry points with the most time
+static const size_t MAX_DUMPED_ENTRIES = 32;
+
+// how often onSwapBuffers() looks at debug.egl.profile.dump
+static const nsecs_t DUMP_PROPERTY_PERIOD = ms2ns(1000);
+
+struct entry_stats_t {
+    std::atomic<uint64_t> calls;
+    std::atomic<uint64_t> time;
+};
+
+// written by every GL call of every thread, hence relaxed atomics
+static entry_stats_t sEntryStats[NUM_PROFILED_ENTRIES];
+
+static gl_hooks_t sProfiledHooks[2];
+
+static bool sEnabled = false;
+
+// the value of debug.egl.profile.dump at the last dump
+static char sLastDumpValue[PROPERTY_VALUE_MAX];
+
+// ----------------------------------------------------------------------------
+
+class entry_timer_t {
+public:
+    explicit entry_timer_t(int entry)
+        : mEntry(entry), mStart(systemTime(SYSTEM_TIME_MONOTONIC)) { }
+    ~entry_timer_t() {
+        const nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - mStart;
+        entry_stats_t& stats(sEntryStats[mEntry]);
+        stats.calls.fetch_add(1, std::memory_order_relaxed);
+        stats.time.fetch_add(uint64_t(elapsed), std::memory_order_relaxed);
+    }
+private:
+    const int mEntry;
+    const nsecs_t mStart;
+};
+
+// The profiled hooks are only ever current with sEnabled set, and mirror
+// gHooks: the driver's entry point is looked up at every call, so that the
+// GLESv1_CM driver can still be loaded on first use.
+inline gl_hooks_t const* getDriverHooks() {
+    return &gHooks[getGlThreadSpecific() - sProfiledHooks];
+}
+
+template<int ENTRY, typename F, F gl_hooks_t::gl_t::*M>
+struct profiled_entry_t;
+
+template<int ENTRY, typename R, typename... Args, R (*gl_hooks_t::gl_t::*M)(Args...)>
+struct profiled_entry_t<ENTRY, R (*)(Args...), M> {
+    static R call(Args... args) {
+        entry_timer_t timer(ENTRY);
+        return (getDriverHooks()->gl.*M)(args...);
+    }
+};
+
+static void initProfiledHooks(gl_hooks_t* hooks) {
+#define GL_ENTRY(_r, _api, ...)                                             \
+    hooks->gl._api = profiled_entry_t<PROFILED_##_api,                      \
+            decltype(hooks->gl._api), &gl_hooks_t::gl_t::_api>::call;
+    #include "../entries.in"
+#undef GL_ENTRY
+}
+
+static bool isProcessProfiled(const char* value) {
+    if (!strcmp(value, "1")) {
+        return true;
+    }
+    char cmdline[256];
+    FILE* file = fopen("/proc/self/cmdline", "r");
+    if (!file) {
+        return false;
+    }
+    char* name = fgets(cmdline, sizeof(cmdline), file);
+    fclose(file);
+    return name && !strcmp(value, name);
+}
+
+static void initProfiler() {
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.egl.profile", value, "");
+    if (!value[0] || !isProcessProfiled(value)) {
+        return;
+    }
+    initProfiledHooks(&sProfiledHooks[egl_connection_t::GLESv1_INDEX]);
+    initProfiledHooks(&sProfiledHooks[egl_connection_t::GLESv2_INDEX]);
+    // only the changes made while running ask for a dump
+    property_get("debug.egl.profile.dump", sLastDumpValue, "");
+    sEnabled = true;
+    ALOGI("profiling OpenGL ES calls, set debug.egl.profile.dump to log them");
+}
+
+bool egl_profiler_t::isEnabled() {
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, initProfiler);
+    return sEnabled;
+}
+
+gl_hooks_t const* egl_profiler_t::getHooks(int version) {
+    return &sProfiledHooks[version];
+}
+
+void egl_profiler_t::setExtension(int slot,
+        __eglMustCastToProperFunctionPointerType proc) {
+    // harmless when not profiling, and this way the slots resolved before
+    // the first eglMakeCurrent() are there too
+    sProfiledHooks[egl_connection_t::GLESv1_INDEX].ext.extensions[slot] = proc;
+    sProfiledHooks[egl_connection_t::GLESv2_INDEX].ext.extensions[slot] = proc;
+}
+
+// ----------------------------------------------------------------------------
+
+// The frame statistics since the last dump, protected by sFrameMutex.
+static pthread_mutex_t sFrameMutex = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t sFrames = 0;
+static uint64_t sMaxFrameCalls = 0;
+static uint64_t sMaxFrameTime = 0;
+static uint64_t sSwapTime = 0;
+static uint64_t sLastCalls = 0;
+static uint64_t sLastTime = 0;
+// the counters of every entry point at the last dump
+static uint64_t sDumpedCalls[NUM_PROFILED_ENTRIES];
+static uint64_t sDumpedTime[NUM_PROFILED_ENTRIES];
+static uint64_t sDumpedTotalCalls = 0;
+static uint64_t sDumpedTotalTime = 0;
+static nsecs_t sLastPropertyCheck = 0;
+
+static void dumpLocked() {
+    static uint64_t entryCalls[NUM_PROFILED_ENTRIES];
+    static uint64_t entryTime[NUM_PROFILED_ENTRIES];
+    static uint16_t order[NUM_PROFILED_ENTRIES];
+    size_t numCalled = 0;
+    for (size_t i = 0; i < NUM_PROFILED_ENTRIES; i++) {
+        const uint64_t c = sEntryStats[i].calls.load(std::memory_order_relaxed);
+        const uint64_t t = sEntryStats[i].time.load(std::memory_order_relaxed);
+        entryCalls[i] = c - sDumpedCalls[i];
+        entryTime[i] = t - sDumpedTime[i];
+        sDumpedCalls[i] = c;
+        sDumpedTime[i] = t;
+        if (entryCalls[i]) {
+            order[numCalled++] = uint16_t(i);
+        }
+    }
+    std::sort(order, order + numCalled,
+            [](uint16_t a, uint16_t b) { return entryTime[a] > entryTime[b]; });
+
+    const uint64_t totalCalls = sLastCalls - sDumpedTotalCalls;
+    const uint64_t totalTime = sLastTime - sDumpedTotalTime;
+    const double frames = sFrames ? double(sFrames) : 1.0;
+    ALOGD("GL profile: %" PRIu64 " frames, %.1f calls per frame (max %" PRIu64
+            "), %.3f ms in GL per frame (max %.3f), %.3f ms in eglSwapBuffers",
+            sFrames, totalCalls / frames, sMaxFrameCalls,
+            totalTime / frames / 1e6, sMaxFrameTime / 1e6,
+            sSwapTime / frames / 1e6);
+    for (size_t i = 0; i < numCalled && i < MAX_DUMPED_ENTRIES; i++) {
+        const size_t e = order[i];
+        ALOGD("  %-40s %10" PRIu64 " calls %10.1f/frame %10.3f ms %8.0f ns/call %5.1f%%",
+                gl_names[e], entryCalls[e], entryCalls[e] / frames, entryTime[e] / 1e6,
+                double(entryTime[e]) / entryCalls[e],
+                totalTime ? 100.0 * entryTime[e] / totalTime : 0.0);
+    }
+
+    sFrames = 0;
+    sMaxFrameCalls = 0;
+    sMaxFrameTime = 0;
+    sSwapTime = 0;
+    sDumpedTotalCalls = sLastCalls;
+    sDumpedTotalTime = sLastTime;
+}
+
+void egl_profiler_t::onSwapBuffers(nsecs_t swapTime) {
+    uint64_t totalCalls = 0;
+    uint64_t totalTime = 0;
+    for (size_t i = 0; i < NUM_PROFILED_ENTRIES; i++) {
+        totalCalls += sEntryStats[i].calls.load(std::memory_order_relaxed);
+        totalTime += sEntryStats[i].time.load(std::memory_order_relaxed);
+    }
+
+    pthread_mutex_lock(&sFrameMutex);
+    // with several threads swapping, a frame is the time between any two
+    // swaps; the counters only grow, but another thread may have summed
+    // them later and come first
+    const uint64_t frameCalls = totalCalls > sLastCalls ? totalCalls - sLastCalls : 0;
+    const uint64_t frameTime = totalTime > sLastTime ? totalTime - sLastTime : 0;
+    sLastCalls = std::max(sLastCalls, totalCalls);
+    sLastTime = std::max(sLastTime, totalTime);
+    sFrames++;
+    sMaxFrameCalls = std::max(sMaxFrameCalls, frameCalls);
+    sMaxFrameTime = std::max(sMaxFrameTime, frameTime);
+    sSwapTime += uint64_t(swapTime);
+
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    if (now - sLastPropertyCheck >= DUMP_PROPERTY_PERIOD) {
+        sLastPropertyCheck = now;
+        char value[PROPERTY_VALUE_MAX];
+        property_get("debug.egl.profile.dump", value, "");
+        if (strcmp(value, sLastDumpValue)) {
+            strcpy(sLastDumpValue, value);
+            dumpLocked();
+        }
+    }
+    pthread_mutex_unlock(&sFrameMutex);
+}
+
+// ----------------------------------------------------------------------------
+}; // namespace android
+// ----------------------------------------------------------------------------
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_EGL_PROFILER_H
+#define ANDROID_EGL_PROFILER_H
+
+#include <EGL/egl.h>
+
+#include <utils/Timers.h>
+
+#include "egldefs.h"
+
+// ----------------------------------------------------------------------------
+namespace android {
+// ----------------------------------------------------------------------------
+
+/*
+ * Counts the calls to each OpenGL ES entry point and the CPU time spent in
+ * them, for the processes named by the debug.egl.profile property ("1"
+ * profiles every process). The contexts of a profiled process are made
+ * current with instrumented hooks that forward to the driver's.
+ *
+ * The counters are folded into per-frame statistics at every eglSwapBuffers,
+ * and logged whenever the value of debug.egl.profile.dump changes, e.g. with
+ * "adb shell setprop debug.egl.profile.dump $RANDOM".
+ */
+class egl_profiler_t {
+public:
+    // whether this process is profiled; the property is read once
+    static bool isEnabled();
+
+    // the hooks to make current for a context of the given version, instead
+    // of cnx->hooks[version]
+    static gl_hooks_t const* getHooks(int version);
+
+    // mirrors an extension slot resolved by eglGetProcAddress() into the
+    // instrumented hooks; extensions are forwarded but not counted
+    static void setExtension(int slot, __eglMustCastToProperFunctionPointerType proc);
+
+    // ends a frame, swapTime is the time spent in the driver's eglSwapBuffers
+    static void onSwapBuffers(nsecs_t swapTime);
+
+    // times an eglSwapBuffers call of a profiled process
+    class SwapScope {
+    public:
+        SwapScope() : mStart(isEnabled() ? systemTime(SYSTEM_TIME_MONOTONIC) : 0) { }
+        ~SwapScope() {
+            if (mStart) {
+                onSwapBuffers(systemTime(SYSTEM_TIME_MONOTONIC) - mStart);
+            }
+        }
+    private:
+        const nsecs_t mStart;
+    };
+};
+
+// ----------------------------------------------------------------------------
+}; // namespace android
+// ----------------------------------------------------------------------------
+
+#endif // ANDROID_EGL_PROFILER_H
@@ -33,7 +33,8 @@ pthread_key_t egl_tls_t::sKey = TLS_KEY_NOT_INITIALIZED;
 pthread_once_t egl_tls_t::sOnceKey = PTHREAD_ONCE_INIT;
 
 egl_tls_t::egl_tls_t()
-    : error(EGL_SUCCESS), ctx(0), logCallWithNoContext(EGL_TRUE) {
+    : error(EGL_SUCCESS), ctx(0), dpy(0), draw(0), read(0),
+      logCallWithNoContext(EGL_TRUE), implErrorCleared(false) {
 }
 
 const char *egl_tls_t::egl_strerror(EGLint err) {
@@ -117,6 +118,24 @@ void egl_tls_t::clearError() {
     // This must clear the error from all the underlying EGL implementations as
     // well as the EGL wrapper layer.
     eglGetError();
+
+    // the caller is about to call into the implementation
+    if (sKey != TLS_KEY_NOT_INITIALIZED) {
+        egl_tls_t* tls = (egl_tls_t*)pthread_getspecific(sKey);
+        if (tls) {
+            tls->implErrorCleared = false;
+        }
+    }
+}
+
+void egl_tls_t::clearErrorNoImpl() {
+    validateTLSKey();
+    egl_tls_t* tls = getTLS();
+    if (tls->implErrorCleared) {
+        tls->error = EGL_SUCCESS;
+        return;
+    }
+    eglGetError();
 }
 
 EGLint egl_tls_t::getError() {
@@ -132,9 +151,24 @@ EGLint egl_tls_t::getError() {
     return error;
 }
 
-void egl_tls_t::setContext(EGLContext ctx) {
+void egl_tls_t::setImplErrorCleared() {
+    if (sKey == TLS_KEY_NOT_INITIALIZED) {
+        return;
+    }
+    egl_tls_t* tls = (egl_tls_t*)pthread_getspecific(sKey);
+    if (tls) {
+        tls->implErrorCleared = true;
+    }
+}
+
+void egl_tls_t::setCurrent(EGLContext ctx, EGLDisplay dpy,
+        EGLSurface draw, EGLSurface read) {
     validateTLSKey();
-    getTLS()->ctx = ctx;
+    egl_tls_t* tls = getTLS();
+    tls->ctx = ctx;
+    tls->dpy = dpy;
+    tls->draw = draw;
+    tls->read = read;
 }
 
 EGLContext egl_tls_t::getContext() {
@@ -146,5 +180,23 @@ EGLContext egl_tls_t::getContext() {
     return tls->ctx;
 }
 
+EGLDisplay egl_tls_t::getDisplay() {
+    if (sKey == TLS_KEY_NOT_INITIALIZED) {
+        return EGL_NO_DISPLAY;
+    }
+    egl_tls_t* tls = (egl_tls_t *)pthread_getspecific(sKey);
+    if (!tls) return EGL_NO_DISPLAY;
+    return tls->dpy;
+}
+
+EGLSurface egl_tls_t::getSurface(EGLint readdraw) {
+    if (sKey == TLS_KEY_NOT_INITIALIZED) {
+        return EGL_NO_SURFACE;
+    }
+    egl_tls_t* tls = (egl_tls_t *)pthread_getspecific(sKey);
+    if (!tls) return EGL_NO_SURFACE;
+    return readdraw == EGL_READ ? tls->read : tls->draw;
+}
+
 
 } // namespace android
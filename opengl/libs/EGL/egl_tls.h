@@ -36,7 +36,14 @@ class egl_tls_t {
 
     EGLint      error;
     EGLContext  ctx;
+    // the display and surfaces ctx was made current with
+    EGLDisplay  dpy;
+    EGLSurface  draw;
+    EGLSurface  read;
     EGLBoolean  logCallWithNoContext;
+    // true when the implementation's error is known to be EGL_SUCCESS,
+    // because it was read and nothing called into the implementation since
+    bool        implErrorCleared;
 
     egl_tls_t();
     static void validateTLSKey();
@@ -47,9 +54,16 @@ public:
     static egl_tls_t* getTLS();
     static void clearTLS();
     static void clearError();
+    // Like clearError(), for calls which don't reach the implementation. Only
+    // asks the implementation for its error if it may have changed.
+    static void clearErrorNoImpl();
     static EGLint getError();
-    static void setContext(EGLContext ctx);
+    static void setImplErrorCleared();
+    static void setCurrent(EGLContext ctx, EGLDisplay dpy,
+            EGLSurface draw, EGLSurface read);
     static EGLContext getContext();
+    static EGLDisplay getDisplay();
+    static EGLSurface getSurface(EGLint readdraw);
     static bool logNoContextCall();
     static const char *egl_strerror(EGLint err);
 
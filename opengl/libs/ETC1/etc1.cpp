@@ -16,6 +16,10 @@
 
 #include <string.h>
 
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
 /* From http://www.khronos.org/registry/gles/extensions/OES/OES_compressed_ETC1_RGB8_texture.txt
 
  The number of bits that represent a 4x4 texel block is 64 bits if
@@ -166,6 +170,14 @@ inline int convertDiff(int base, int diff) {
 static
 void decode_subblock(etc1_byte* pOut, int r, int g, int b, const int* table,
         etc1_uint32 low, bool second, bool flipped) {
+    // The four colors the pixels of the sub-block can take, clamped once
+    // instead of for every pixel.
+    etc1_byte palette[4][3];
+    for (int i = 0; i < 4; i++) {
+        palette[i][0] = clamp(r + table[i]);
+        palette[i][1] = clamp(g + table[i]);
+        palette[i][2] = clamp(b + table[i]);
+    }
     int baseX = 0;
     int baseY = 0;
     if (second) {
@@ -186,11 +198,11 @@ void decode_subblock(etc1_byte* pOut, int r, int g, int b, const int* table,
         }
         int k = y + (x * 4);
         int offset = ((low >> k) & 1) | ((low >> (k + 15)) & 2);
-        int delta = table[offset];
+        const etc1_byte* color = palette[offset];
         etc1_byte* q = pOut + 3 * (x + 4 * y);
-        *q++ = clamp(r + delta);
-        *q++ = clamp(g + delta);
-        *q++ = clamp(b + delta);
+        q[0] = color[0];
+        q[1] = color[1];
+        q[2] = color[2];
     }
 }
 
@@ -429,9 +441,77 @@ static void etc_encodeBaseColors(etc1_byte* pBaseColors,
     pBaseColors[5] = b2;
 }
 
+// Returns the modifier table whose large modifier is closest to the largest
+// deviation of the sub-block's pixels from its base color, using the same
+// weights as chooseModifier().
+static
+int etc_estimate_table(const etc1_byte* pIn, etc1_uint32 inMask, bool flipped,
+        bool second, const etc1_byte* pBaseColors) {
+    int maxDeviation = 0;
+    for (int j = 0; j < 8; j++) {
+        int x, y;
+        if (flipped) {
+            x = j & 3;
+            y = (second ? 2 : 0) + (j >> 2);
+        } else {
+            x = (second ? 2 : 0) + (j & 1);
+            y = j >> 1;
+        }
+        int i = x + 4 * y;
+        if (inMask & (1 << i)) {
+            const etc1_byte* p = pIn + i * 3;
+            int deviation = 3 * (p[0] - pBaseColors[0]) + 6 * (p[1] - pBaseColors[1])
+                    + (p[2] - pBaseColors[2]);
+            if (deviation < 0) {
+                deviation = -deviation;
+            }
+            if (deviation > maxDeviation) {
+                maxDeviation = deviation;
+            }
+        }
+    }
+    maxDeviation = (maxDeviation + 5) / 10;
+    int best = 0;
+    for (int i = 1; i < 8; i++) {
+        int error = kModifierTable[i * 4 + 1] - maxDeviation;
+        int bestError = kModifierTable[best * 4 + 1] - maxDeviation;
+        if (error * error < bestError * bestError) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+// Returns how far the valid pixels of a sub-block are from its average color,
+// weighted like chooseModifier(). The orientation with the smaller error is
+// usually the one that encodes better.
+static
+etc1_uint32 etc_flat_error(const etc1_byte* pIn, etc1_uint32 inMask,
+        const etc1_byte* pColors, bool flipped, bool second) {
+    etc1_uint32 error = 0;
+    for (int j = 0; j < 8; j++) {
+        int x, y;
+        if (flipped) {
+            x = j & 3;
+            y = (second ? 2 : 0) + (j >> 2);
+        } else {
+            x = (second ? 2 : 0) + (j & 1);
+            y = j >> 1;
+        }
+        int i = x + 4 * y;
+        if (inMask & (1 << i)) {
+            const etc1_byte* p = pIn + i * 3;
+            error += 3 * square(p[0] - pColors[0]) + 6 * square(p[1] - pColors[1])
+                    + square(p[2] - pColors[2]);
+        }
+    }
+    return error;
+}
+
 static
 void etc_encode_block_helper(const etc1_byte* pIn, etc1_uint32 inMask,
-        const etc1_byte* pColors, etc_compressed* pCompressed, bool flipped) {
+        const etc1_byte* pColors, etc_compressed* pCompressed, bool flipped,
+        int quality) {
     pCompressed->score = ~0;
     pCompressed->high = (flipped ? 1 : 0);
     pCompressed->low = 0;
@@ -442,8 +522,22 @@ void etc_encode_block_helper(const etc1_byte* pIn, etc1_uint32 inMask,
 
     int originalHigh = pCompressed->high;
 
-    const int* pModifierTable = kModifierTable;
-    for (int i = 0; i < 8; i++, pModifierTable += 4) {
+    // The high quality search tries every modifier table for each sub-block,
+    // the fast one only the table estimated from the sub-block's spread and
+    // its neighbors.
+    int firstTable[2] = { 0, 0 };
+    int lastTable[2] = { 7, 7 };
+    if (quality == ETC1_QUALITY_FAST) {
+        for (int half = 0; half < 2; half++) {
+            int table = etc_estimate_table(pIn, inMask, flipped, half != 0,
+                    pBaseColors + 3 * half);
+            firstTable[half] = table > 0 ? table - 1 : 0;
+            lastTable[half] = table < 7 ? table + 1 : 7;
+        }
+    }
+
+    const int* pModifierTable = kModifierTable + firstTable[0] * 4;
+    for (int i = firstTable[0]; i <= lastTable[0]; i++, pModifierTable += 4) {
         etc_compressed temp;
         temp.score = 0;
         temp.high = originalHigh | (i << 5);
@@ -452,16 +546,16 @@ void etc_encode_block_helper(const etc1_byte* pIn, etc1_uint32 inMask,
                 pBaseColors, pModifierTable);
         take_best(pCompressed, &temp);
     }
-    pModifierTable = kModifierTable;
+    pModifierTable = kModifierTable + firstTable[1] * 4;
     etc_compressed firstHalf = *pCompressed;
-    for (int i = 0; i < 8; i++, pModifierTable += 4) {
+    for (int i = firstTable[1]; i <= lastTable[1]; i++, pModifierTable += 4) {
         etc_compressed temp;
         temp.score = firstHalf.score;
         temp.high = firstHalf.high | (i << 2);
         temp.low = firstHalf.low;
         etc_encode_subblock_helper(pIn, inMask, &temp, flipped, true,
                 pBaseColors + 3, pModifierTable);
-        if (i == 0) {
+        if (i == firstTable[1]) {
             *pCompressed = temp;
         } else {
             take_best(pCompressed, &temp);
@@ -481,8 +575,9 @@ static void writeBigEndian(etc1_byte* pOut, etc1_uint32 d) {
 // pixel is valid or not. Invalid pixel color values are ignored when compressing.
 // Output is an ETC1 compressed version of the data.
 
-void etc1_encode_block(const etc1_byte* pIn, etc1_uint32 inMask,
-        etc1_byte* pOut) {
+static
+void etc_encode_block(const etc1_byte* pIn, etc1_uint32 inMask,
+        etc1_byte* pOut, int quality) {
     etc1_byte colors[6];
     etc1_byte flippedColors[6];
     etc_average_colors_subblock(pIn, inMask, colors, false, false);
@@ -491,13 +586,32 @@ void etc1_encode_block(const etc1_byte* pIn, etc1_uint32 inMask,
     etc_average_colors_subblock(pIn, inMask, flippedColors + 3, true, true);
 
     etc_compressed a, b;
-    etc_encode_block_helper(pIn, inMask, colors, &a, false);
-    etc_encode_block_helper(pIn, inMask, flippedColors, &b, true);
-    take_best(&a, &b);
+    if (quality == ETC1_QUALITY_FAST) {
+        // Only encode the orientation whose sub-blocks are the most uniform.
+        etc1_uint32 error = etc_flat_error(pIn, inMask, colors, false, false)
+                + etc_flat_error(pIn, inMask, colors + 3, false, true);
+        etc1_uint32 flippedError =
+                etc_flat_error(pIn, inMask, flippedColors, true, false)
+                + etc_flat_error(pIn, inMask, flippedColors + 3, true, true);
+        if (flippedError < error) {
+            etc_encode_block_helper(pIn, inMask, flippedColors, &a, true, quality);
+        } else {
+            etc_encode_block_helper(pIn, inMask, colors, &a, false, quality);
+        }
+    } else {
+        etc_encode_block_helper(pIn, inMask, colors, &a, false, quality);
+        etc_encode_block_helper(pIn, inMask, flippedColors, &b, true, quality);
+        take_best(&a, &b);
+    }
     writeBigEndian(pOut, a.high);
     writeBigEndian(pOut + 4, a.low);
 }
 
+void etc1_encode_block(const etc1_byte* pIn, etc1_uint32 inMask,
+        etc1_byte* pOut) {
+    etc_encode_block(pIn, inMask, pOut, ETC1_QUALITY_HIGH);
+}
+
 // Return the size of the encoded image data (does not include size of PKM header).
 
 etc1_uint32 etc1_get_encoded_data_size(etc1_uint32 width, etc1_uint32 height) {
@@ -511,9 +625,22 @@ etc1_uint32 etc1_get_encoded_data_size(etc1_uint32 width, etc1_uint32 height) {
 
 int etc1_encode_image(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 height,
         etc1_uint32 pixelSize, etc1_uint32 stride, etc1_byte* pOut) {
+    return etc1_encode_image_rows(pIn, width, height, pixelSize, stride, pOut,
+            0, (height + 3) / 4, ETC1_QUALITY_HIGH);
+}
+
+// Encode the block rows [firstRow, firstRow + rowCount) of an image.
+// pOut - pointer to the encoded data of the entire image.
+
+int etc1_encode_image_rows(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 height,
+        etc1_uint32 pixelSize, etc1_uint32 stride, etc1_byte* pOut,
+        etc1_uint32 firstRow, etc1_uint32 rowCount, int quality) {
     if (pixelSize < 2 || pixelSize > 3) {
         return -1;
     }
+    if (quality != ETC1_QUALITY_FAST && quality != ETC1_QUALITY_HIGH) {
+        return -1;
+    }
     static const unsigned short kYMask[] = { 0x0, 0xf, 0xff, 0xfff, 0xffff };
     static const unsigned short kXMask[] = { 0x0, 0x1111, 0x3333, 0x7777,
             0xffff };
@@ -522,8 +649,13 @@ int etc1_encode_image(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 heigh
 
     etc1_uint32 encodedWidth = (width + 3) & ~3;
     etc1_uint32 encodedHeight = (height + 3) & ~3;
+    if (firstRow > encodedHeight / 4 || rowCount > encodedHeight / 4 - firstRow) {
+        return -1;
+    }
+    pOut += (encodedWidth / 4) * firstRow * ETC1_ENCODED_BLOCK_SIZE;
 
-    for (etc1_uint32 y = 0; y < encodedHeight; y += 4) {
+    etc1_uint32 yLimit = (firstRow + rowCount) * 4;
+    for (etc1_uint32 y = firstRow * 4; y < yLimit; y += 4) {
         etc1_uint32 yEnd = height - y;
         if (yEnd > 4) {
             yEnd = 4;
@@ -550,7 +682,7 @@ int etc1_encode_image(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 heigh
                     }
                 }
             }
-            etc1_encode_block(block, mask, encoded);
+            etc_encode_block(block, mask, encoded, quality);
             memcpy(pOut, encoded, sizeof(encoded));
             pOut += sizeof(encoded);
         }
@@ -558,6 +690,80 @@ int etc1_encode_image(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 heigh
     return 0;
 }
 
+// etc1_encode_image_threaded() uses at most this many threads.
+static const etc1_uint32 kMaxEncodeThreads = 16;
+
+#ifndef _WIN32
+
+struct etc_encode_job {
+    const etc1_byte* pIn;
+    etc1_uint32 width;
+    etc1_uint32 height;
+    etc1_uint32 pixelSize;
+    etc1_uint32 stride;
+    etc1_byte* pOut;
+    etc1_uint32 firstRow;
+    etc1_uint32 rowCount;
+    int quality;
+    int result;
+};
+
+static void* etc_encode_job_run(void* arg) {
+    etc_encode_job* job = static_cast<etc_encode_job*>(arg);
+    job->result = etc1_encode_image_rows(job->pIn, job->width, job->height,
+            job->pixelSize, job->stride, job->pOut, job->firstRow,
+            job->rowCount, job->quality);
+    return NULL;
+}
+
+#endif
+
+// Encode an entire image, splitting it by block rows over threadCount threads.
+
+int etc1_encode_image_threaded(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 height,
+        etc1_uint32 pixelSize, etc1_uint32 stride, etc1_byte* pOut,
+        int quality, etc1_uint32 threadCount) {
+    etc1_uint32 rows = (height + 3) / 4;
+    if (threadCount > rows) {
+        threadCount = rows;
+    }
+    if (threadCount > kMaxEncodeThreads) {
+        threadCount = kMaxEncodeThreads;
+    }
+#ifndef _WIN32
+    if (threadCount > 1) {
+        etc_encode_job jobs[kMaxEncodeThreads];
+        pthread_t threads[kMaxEncodeThreads];
+        bool started[kMaxEncodeThreads];
+        etc1_uint32 firstRow = 0;
+        for (etc1_uint32 i = 0; i < threadCount; i++) {
+            etc1_uint32 rowCount = rows / threadCount + (i < rows % threadCount ? 1 : 0);
+            etc_encode_job job = { pIn, width, height, pixelSize, stride, pOut,
+                    firstRow, rowCount, quality, 0 };
+            jobs[i] = job;
+            firstRow += rowCount;
+            // The calling thread encodes the first part.
+            started[i] = i > 0 &&
+                    pthread_create(&threads[i], NULL, etc_encode_job_run, &jobs[i]) == 0;
+        }
+        int result = 0;
+        for (etc1_uint32 i = 0; i < threadCount; i++) {
+            if (started[i]) {
+                pthread_join(threads[i], NULL);
+            } else {
+                etc_encode_job_run(&jobs[i]);
+            }
+            if (jobs[i].result) {
+                result = jobs[i].result;
+            }
+        }
+        return result;
+    }
+#endif
+    return etc1_encode_image_rows(pIn, width, height, pixelSize, stride, pOut,
+            0, rows, quality);
+}
+
 // Decode an entire image.
 // pIn - pointer to encoded data.
 // pOut - pointer to the image data. Will be written such that the Red component of
@@ -1,6 +1,7 @@
 dirs := \
 	angeles \
 	configdump \
+	eglcalls \
 	EGLTest \
 	fillrate \
 	filter \
@@ -16,6 +17,7 @@ dirs := \
 	include \
 	lib \
 	linetex \
+	preload \
 	swapinterval \
 	textures \
 	tritex \
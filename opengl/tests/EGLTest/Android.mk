@@ -9,6 +9,7 @@ LOCAL_MODULE_TAGS := tests
 
 LOCAL_SRC_FILES := \
     egl_cache_test.cpp \
+    egl_object_table_test.cpp \
     EGL_test.cpp \
 
 LOCAL_SHARED_LIBRARIES := \
@@ -19,6 +19,9 @@
 
 #include <gtest/gtest.h>
 
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <utils/Log.h>
 
 #include "egl_cache.h"
@@ -107,4 +110,84 @@ TEST_F(EGLCacheSerializationTest, ReinitializedCacheContainsValues) {
     ASSERT_EQ('h', buf[3]);
 }
 
+
+TEST_F(EGLCacheSerializationTest, ReinitializedCacheContainsUpdatedValues) {
+    uint8_t buf[4] = { 0xee, 0xee, 0xee, 0xee };
+    mCache->setCacheFilename(mFilename);
+    mCache->initialize(egl_display_t::get(EGL_DEFAULT_DISPLAY));
+    mCache->setBlob("abcd", 4, "efgh", 4);
+    mCache->terminate();
+    mCache->initialize(egl_display_t::get(EGL_DEFAULT_DISPLAY));
+    mCache->setBlob("abcd", 4, "ijkl", 4);
+    mCache->setBlob("mnop", 4, "qrst", 4);
+    mCache->terminate();
+    mCache->initialize(egl_display_t::get(EGL_DEFAULT_DISPLAY));
+    ASSERT_EQ(4, mCache->getBlob("abcd", 4, buf, 4));
+    ASSERT_EQ('i', buf[0]);
+    ASSERT_EQ('j', buf[1]);
+    ASSERT_EQ('k', buf[2]);
+    ASSERT_EQ('l', buf[3]);
+    ASSERT_EQ(4, mCache->getBlob("mnop", 4, buf, 4));
+    ASSERT_EQ('q', buf[0]);
+}
+
+TEST_F(EGLCacheSerializationTest, TruncatedCacheFileKeepsEarlierValues) {
+    uint8_t buf[4] = { 0xee, 0xee, 0xee, 0xee };
+    mCache->setCacheFilename(mFilename);
+    mCache->initialize(egl_display_t::get(EGL_DEFAULT_DISPLAY));
+    mCache->setBlob("abcd", 4, "efgh", 4);
+    mCache->getBlob("abcd", 4, buf, 4);
+    mCache->setBlob("mnop", 4, "qrst", 4);
+    mCache->terminate();
+
+    // Cut the most recently used entry short.
+    struct stat st;
+    ASSERT_EQ(0, stat(mFilename.string(), &st));
+    ASSERT_EQ(0, truncate(mFilename.string(), st.st_size - 1));
+
+    mCache->initialize(egl_display_t::get(EGL_DEFAULT_DISPLAY));
+    ASSERT_EQ(0, mCache->getBlob("mnop", 4, buf, 4));
+    ASSERT_EQ(4, mCache->getBlob("abcd", 4, buf, 4));
+    ASSERT_EQ('e', buf[0]);
+    ASSERT_EQ('f', buf[1]);
+    ASSERT_EQ('g', buf[2]);
+    ASSERT_EQ('h', buf[3]);
+}
+
+
+TEST_F(EGLCacheSerializationTest, SeedCacheProvidesMissingValues) {
+    uint8_t buf[4] = { 0xee, 0xee, 0xee, 0xee };
+    mCache->setCacheFilename(mFilename);
+    mCache->initialize(egl_display_t::get(EGL_DEFAULT_DISPLAY));
+    mCache->setBlob("abcd", 4, "efgh", 4);
+    mCache->terminate();
+
+    // Use the file just written as the seed of an empty cache.
+    String8 seedFilename(mFilename);
+    seedFilename.append("-seed");
+    ASSERT_EQ(0, rename(mFilename.string(), seedFilename.string()));
+    mCache->setSeedCacheFilename(seedFilename);
+
+    egl_cache_t::stats_t before, after;
+    mCache->getStats(&before);
+    mCache->initialize(egl_display_t::get(EGL_DEFAULT_DISPLAY));
+    ASSERT_EQ(4, mCache->getBlob("abcd", 4, buf, 4));
+    ASSERT_EQ('e', buf[0]);
+    ASSERT_EQ('h', buf[3]);
+    ASSERT_EQ(0, mCache->getBlob("mnop", 4, buf, 4));
+    mCache->getStats(&after);
+    ASSERT_EQ(1U, after.seedEntries);
+    ASSERT_EQ(before.seedHits + 1, after.seedHits);
+    ASSERT_EQ(before.misses + 1, after.misses);
+
+    // Values set at runtime take precedence.
+    mCache->setBlob("abcd", 4, "ijkl", 4);
+    ASSERT_EQ(4, mCache->getBlob("abcd", 4, buf, 4));
+    ASSERT_EQ('i', buf[0]);
+    mCache->getStats(&after);
+    ASSERT_EQ(before.hits + 1, after.hits);
+
+    unlink(seedFilename.string());
+}
+
 }
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "EGL_test"
+//#define LOG_NDEBUG 0
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <utils/Log.h>
+
+#include "egl_object_table.h"
+
+namespace android {
+
+// The table never dereferences the objects, any distinct aligned addresses do.
+static egl_object_t* fakeObject(size_t i) {
+    return reinterpret_cast<egl_object_t*>(uintptr_t(0x10000) + i * 16);
+}
+
+class EGLObjectTableTest : public ::testing::Test {
+protected:
+    egl_object_table_t mTable;
+};
+
+TEST_F(EGLObjectTableTest, PinFindsAddedObjectsOnly) {
+    mTable.add(fakeObject(1));
+    std::atomic<uint32_t>* pin = mTable.pin(fakeObject(1));
+    ASSERT_TRUE(pin != NULL);
+    egl_object_table_t::unpin(pin);
+    ASSERT_TRUE(mTable.pin(fakeObject(2)) == NULL);
+
+    mTable.remove(fakeObject(1));
+    ASSERT_TRUE(mTable.pin(fakeObject(1)) == NULL);
+}
+
+TEST_F(EGLObjectTableTest, KeepsObjectsWhileGrowing) {
+    const size_t count = 1000;
+    for (size_t i = 0; i < count; i++) {
+        mTable.add(fakeObject(i));
+    }
+    for (size_t i = 0; i < count; i += 2) {
+        mTable.remove(fakeObject(i));
+    }
+    for (size_t i = 0; i < count; i++) {
+        std::atomic<uint32_t>* pin = mTable.pin(fakeObject(i));
+        ASSERT_EQ(i % 2 != 0, pin != NULL) << "object " << i;
+        if (pin) {
+            egl_object_table_t::unpin(pin);
+        }
+    }
+}
+
+TEST_F(EGLObjectTableTest, ChurnDoesNotGrowTable) {
+    // Creating and destroying objects forever leaves only tombstones behind,
+    // which must be reclaimed instead of growing the table.
+    for (size_t i = 0; i < 4; i++) {
+        mTable.add(fakeObject(i));
+    }
+    const size_t capacity = mTable.getCapacity();
+    for (size_t i = 4; i < 100000; i++) {
+        mTable.add(fakeObject(i));
+        mTable.remove(fakeObject(i));
+    }
+    EXPECT_EQ(capacity, mTable.getCapacity());
+    EXPECT_EQ(0U, mTable.getRetiredCount());
+    for (size_t i = 0; i < 4; i++) {
+        std::atomic<uint32_t>* pin = mTable.pin(fakeObject(i));
+        ASSERT_TRUE(pin != NULL) << "object " << i;
+        egl_object_table_t::unpin(pin);
+    }
+}
+
+TEST_F(EGLObjectTableTest, RehashKeepsPinnedObjectRemovable) {
+    mTable.add(fakeObject(0));
+    std::atomic<uint32_t>* pin = mTable.pin(fakeObject(0));
+    ASSERT_TRUE(pin != NULL);
+
+    // Grow the table while the pin is held, the old table has to stay.
+    for (size_t i = 1; i < 1000; i++) {
+        mTable.add(fakeObject(i));
+    }
+    EXPECT_NE(0U, mTable.getRetiredCount());
+
+    std::atomic<bool> removed(false);
+    std::thread remover([&]() {
+        mTable.remove(fakeObject(0));
+        removed = true;
+    });
+    usleep(10000);
+    EXPECT_FALSE(removed);
+    egl_object_table_t::unpin(pin);
+    remover.join();
+    EXPECT_TRUE(mTable.pin(fakeObject(0)) == NULL);
+
+    // Nothing is pinned anymore, the next change frees the old tables.
+    mTable.remove(fakeObject(1));
+    EXPECT_EQ(0U, mTable.getRetiredCount());
+}
+
+TEST_F(EGLObjectTableTest, RemoveWaitsForPins) {
+    // Readers keep pinning objects that a writer keeps removing and adding
+    // back. Whenever remove() returns no reader may still hold the pin.
+    const size_t count = 8;
+    std::atomic<bool> live[count];
+    for (size_t i = 0; i < count; i++) {
+        mTable.add(fakeObject(i));
+        live[i] = true;
+    }
+    std::atomic<bool> done(false);
+    std::atomic<size_t> failures(0);
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 3; r++) {
+        readers.emplace_back([&]() {
+            for (size_t n = 0; !done; n++) {
+                size_t i = n % count;
+                std::atomic<uint32_t>* pin = mTable.pin(fakeObject(i));
+                if (pin) {
+                    if (!live[i]) {
+                        failures++;
+                    }
+                    egl_object_table_t::unpin(pin);
+                }
+            }
+        });
+    }
+    for (int n = 0; n < 100000; n++) {
+        size_t i = n % count;
+        mTable.remove(fakeObject(i));
+        live[i] = false;
+        live[i] = true;
+        mTable.add(fakeObject(i));
+    }
+    done = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    EXPECT_EQ(0U, failures);
+}
+
+} // namespace android
@@ -0,0 +1,17 @@
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	eglcalls.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+	libcutils \
+	libutils \
+    libEGL \
+    libGLESv2
+
+LOCAL_MODULE:= test-opengl-eglcalls
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,127 @@
+/*
+ ** Copyright 2016, The Android Open Source Project
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **     http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+/*
+ * Measures the per-call overhead of the EGL wrapper for the calls a renderer
+ * makes all the time, with a context current on a pbuffer: the current
+ * context, surface and display queries, eglGetError(), a GL call through the
+ * TLS hooks and eglGetProcAddress() of an already resolved name.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <EGL/egl.h>
+#include <GLES2/gl2.h>
+
+#include <utils/Timers.h>
+
+using namespace android;
+
+static int sIterations = 1000000;
+
+template <typename F>
+static void measure(const char* name, F f) {
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < sIterations; i++) {
+        f();
+    }
+    nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    printf("%-32s %8.1f ns/call\n", name, double(elapsed) / sIterations);
+}
+
+int main(int argc, char** argv)
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+            case 'n':
+                sIterations = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n iterations]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (sIterations <= 0) {
+        fprintf(stderr, "bad iteration count\n");
+        return 1;
+    }
+
+    EGLint configAttribs[] = {
+            EGL_SURFACE_TYPE,       EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE,    EGL_OPENGL_ES2_BIT,
+            EGL_NONE
+    };
+    EGLint pbufferAttribs[] = {
+            EGL_WIDTH,  16,
+            EGL_HEIGHT, 16,
+            EGL_NONE
+    };
+    EGLint contextAttribs[] = {
+            EGL_CONTEXT_CLIENT_VERSION, 2,
+            EGL_NONE
+    };
+
+    EGLDisplay dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    EGLConfig config;
+    EGLint numConfigs = 0;
+    if (!eglInitialize(dpy, NULL, NULL) ||
+            !eglChooseConfig(dpy, configAttribs, &config, 1, &numConfigs) ||
+            numConfigs < 1) {
+        fprintf(stderr, "no pbuffer config: %#x\n", eglGetError());
+        return 1;
+    }
+    EGLSurface surface = eglCreatePbufferSurface(dpy, config, pbufferAttribs);
+    EGLContext context = eglCreateContext(dpy, config, EGL_NO_CONTEXT,
+            contextAttribs);
+    if (surface == EGL_NO_SURFACE || context == EGL_NO_CONTEXT ||
+            !eglMakeCurrent(dpy, surface, surface, context)) {
+        fprintf(stderr, "making a context current failed: %#x\n", eglGetError());
+        eglTerminate(dpy);
+        return 1;
+    }
+
+    // resolve it once, the lookups below are for an already known name
+    eglGetProcAddress("glDrawElements");
+
+    volatile uintptr_t sink = 0;
+    measure("eglGetCurrentContext", [&]() {
+        sink += uintptr_t(eglGetCurrentContext());
+    });
+    measure("eglGetCurrentSurface(EGL_DRAW)", [&]() {
+        sink += uintptr_t(eglGetCurrentSurface(EGL_DRAW));
+    });
+    measure("eglGetCurrentDisplay", [&]() {
+        sink += uintptr_t(eglGetCurrentDisplay());
+    });
+    measure("eglGetError", [&]() {
+        sink += eglGetError();
+    });
+    measure("glGetError", [&]() {
+        sink += glGetError();
+    });
+    measure("eglGetProcAddress", [&]() {
+        sink += uintptr_t(eglGetProcAddress("glDrawElements"));
+    });
+
+    eglMakeCurrent(dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(dpy, context);
+    eglDestroySurface(dpy, surface);
+    eglTerminate(dpy);
+    return 0;
+}
@@ -146,3 +146,39 @@ LOCAL_C_INCLUDES += \
     $(call include-path-for, opengl-tests-includes) \
 
 include $(BUILD_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+LOCAL_ADDITIONAL_DEPENDENCIES := $(LOCAL_PATH)/Android.mk
+
+LOCAL_MODULE:= hwcBench
+LOCAL_MODULE_TAGS := tests
+# HWC2.cpp and HWC2On1Adapter.cpp are built with Surface Flinger's flags
+LOCAL_CFLAGS := -DGL_GLEXT_PROTOTYPES -DEGL_EGLEXT_PROTOTYPES -Wall
+LOCAL_CFLAGS += -std=c++14
+LOCAL_CXX_STL := libc++
+LOCAL_SRC_FILES:= \
+    hwcBench.cpp \
+    ../../../services/surfaceflinger/DisplayHardware/HWC2.cpp \
+    ../../../services/surfaceflinger/DisplayHardware/HWC2On1Adapter.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+    libcutils \
+    libEGL \
+    libGLESv2 \
+    libutils \
+    liblog \
+    libui \
+    libhardware \
+
+LOCAL_STATIC_LIBRARIES := \
+    libtestUtil \
+    libglTest \
+    libhwcTest \
+
+LOCAL_C_INCLUDES += \
+    system/extras/tests/include \
+    hardware/libhardware/include \
+    frameworks/native/services/surfaceflinger \
+    $(call include-path-for, opengl-tests-includes) \
+
+include $(BUILD_NATIVE_TEST)
@@ -0,0 +1,656 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Hardware Composer Composition Benchmark
+ *
+ * Synopsis
+ *   hwcBench [options] graphicFormat ...
+ *     options:
+ *       -l layerCounts - Comma separated layer counts (default 1,2,4,8)
+ *       -c churn - Layer attributes changed every frame, one of
+ *                  none, position or all (default: each of them)
+ *       -n frames - Frames measured per case (default 120)
+ *       -v - Verbose
+ *
+ *      graphic formats:
+ *        RGBA8888 (default)
+ *        RGBX8888
+ *        RGB888
+ *        RGB565
+ *        BGRA8888
+ *        YV12
+ *
+ * Description
+ *   Measures the time the composer spends in validateDisplay and
+ *   presentDisplay, the two calls Surface Flinger makes on every frame,
+ *   going through the same HWC2 wrapper (HWC2::Device) as Surface Flinger
+ *   does.  An HWC1 composer is measured through HWC2On1Adapter, like
+ *   Surface Flinger runs it, so the numbers include the adapter.
+ *
+ *   Each case composes layers of one graphic format on the primary display,
+ *   every layer latching a new buffer every frame.  The churn says what else
+ *   changes from frame to frame:
+ *     none     - nothing, only the buffers
+ *     position - the display frames move, as when scrolling
+ *     all      - the display frames, source crops, plane alphas, blending
+ *                and z-order, as during an animation
+ *
+ *   Each frame waits for the retire fence of the previous one, so the
+ *   composer runs at the display rate the way it does under Surface Flinger.
+ *   For each case the mean, median, 90th percentile and maximum of validate
+ *   and present are reported in microseconds, together with the average
+ *   number of layers the composer left to client (GPU) composition, which
+ *   is what the other numbers have to be read against.
+ *
+ *   The framework is stopped while measuring, since only one user at a time
+ *   is allowed to use the composer, and restarted afterwards.
+ */
+
+#define LOG_TAG "hwcBenchTest"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <inttypes.h>
+#include <libgen.h>
+#include <memory>
+#include <sstream>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#include <hardware/hardware.h>
+#include <hardware/hwcomposer.h>
+
+#include <ui/Fence.h>
+#include <ui/GraphicBuffer.h>
+#include <ui/Rect.h>
+#include <ui/Region.h>
+
+#include <utils/Log.h>
+#include <utils/Timers.h>
+#include <testUtil.h>
+
+#include "DisplayHardware/FloatRect.h"
+#include "DisplayHardware/HWC2.h"
+#include "DisplayHardware/HWC2On1Adapter.h"
+
+#include "hwcTestLib.h"
+
+using namespace std;
+using namespace android;
+
+// Defaults
+const char *defaultLayerCounts = "1,2,4,8";
+const uint32_t defaultNumFrames = 120;
+const bool defaultVerbose = false;
+
+// Frames composed before measuring, so that the composer has its planes
+// assigned and its caches warm
+const uint32_t warmupFrames = 10;
+
+// Buffers per layer: one on screen, one queued and one being filled
+const size_t buffersPerLayer = 3;
+
+// Longest wait for a retire fence, a composer that takes longer is stuck
+const int retireTimeoutMs = 1000;
+
+#define MAXCMD               200
+#define NUMA(a) (sizeof(a) / sizeof(a [0])) // Num elements in an array
+#define CMD_STOP_FRAMEWORK   "stop 2>&1"
+#define CMD_START_FRAMEWORK  "start 2>&1"
+
+enum Churn {
+    CHURN_NONE,
+    CHURN_POSITION,
+    CHURN_ALL,
+};
+
+const struct churnType {
+    const char *desc;
+    Churn id;
+} churnType[] = {
+    {"none",     CHURN_NONE},
+    {"position", CHURN_POSITION},
+    {"all",      CHURN_ALL},
+};
+
+// Timings of one case, in nanoseconds
+struct caseMeas {
+    vector<nsecs_t> validate;
+    vector<nsecs_t> present;
+    uint64_t clientLayers;
+};
+
+struct benchLayer {
+    shared_ptr<HWC2::Layer> hwcLayer;
+    vector<sp<GraphicBuffer> > buffers;
+};
+
+// Function Prototypes
+static void openHwc();
+static void initDisplay();
+static void measureCase(const struct hwcTestGraphicFormat *format,
+                        uint32_t numLayers, Churn churn, caseMeas& meas);
+static void printCase(const struct hwcTestGraphicFormat *format,
+                      uint32_t numLayers, Churn churn, caseMeas& meas);
+static vector<uint32_t> parseLayerCounts(const char *str, bool& error);
+void printSyntax(const char *cmd);
+
+// Command-line option settings
+static bool verbose = defaultVerbose;
+static uint32_t numFrames = defaultNumFrames;
+
+// Globals
+static unique_ptr<HWC2On1Adapter> hwcAdapter;
+static unique_ptr<HWC2::Device> hwcDevice;
+static shared_ptr<HWC2::Display> display;
+static uint32_t displayWidth, displayHeight;
+static sp<GraphicBuffer> clientTarget;
+
+/*
+ * Main
+ *
+ * Performs the following high-level sequence of operations:
+ *
+ *   1. Command-line parsing
+ *
+ *   2. Form a list of command-line specified graphic formats.  If
+ *      no formats are specified, then RGBA8888 is measured.
+ *
+ *   3. Stop framework
+ *      Only one user at a time is allowed to use the HWC.  Surface
+ *      Flinger uses the HWC and is part of the framework.  Need to
+ *      stop the framework so that Surface Flinger will stop using
+ *      the HWC.
+ *
+ *   4. Open the composer and power on the primary display
+ *
+ *   5. For each graphic format, layer count and churn, measure and
+ *      report the validate and present times.
+ *
+ *   6. Start framework
+ */
+int
+main(int argc, char *argv[])
+{
+    int     rv, opt;
+    bool    error;
+    char    cmd[MAXCMD];
+    vector<uint32_t> layerCounts;
+    vector<Churn> churns;
+    vector<string> formats;
+
+    testSetLogCatTag(LOG_TAG);
+
+    layerCounts = parseLayerCounts(defaultLayerCounts, error);
+
+    // Parse command line arguments
+    while ((opt = getopt(argc, argv, "l:c:n:v?h")) != -1) {
+        switch (opt) {
+          case 'l': // Layer counts
+            layerCounts = parseLayerCounts(optarg, error);
+            if (error) {
+                testPrintE("Invalid command-line specified layer counts "
+                           "of: %s", optarg);
+                exit(1);
+            }
+            break;
+
+          case 'c': // Churn
+            {
+                unsigned int n1;
+                for (n1 = 0; n1 < NUMA(churnType); n1++) {
+                    if (strcmp(optarg, churnType[n1].desc) == 0) { break; }
+                }
+                if (n1 == NUMA(churnType)) {
+                    testPrintE("Unknown churn of: %s", optarg);
+                    exit(2);
+                }
+                churns.push_back(churnType[n1].id);
+            }
+            break;
+
+          case 'n': // Frames
+            {
+                char *chptr;
+                numFrames = strtoul(optarg, &chptr, 10);
+                if ((*chptr != '\0') || (numFrames == 0)) {
+                    testPrintE("Invalid command-line specified number of "
+                               "frames of: %s", optarg);
+                    exit(3);
+                }
+            }
+            break;
+
+          case 'v': // Verbose
+            verbose = true;
+            break;
+
+          case 'h': // Help
+          case '?':
+          default:
+            printSyntax(basename(argv[0]));
+            exit(((optopt == 0) || (optopt == '?')) ? 0 : 4);
+        }
+    }
+    if (churns.empty()) {
+        for (unsigned int n1 = 0; n1 < NUMA(churnType); n1++) {
+            churns.push_back(churnType[n1].id);
+        }
+    }
+
+    // Positional parameters provide the names of graphic formats that
+    // measurements are to be made on.
+    if (optind == argc) {
+        formats.push_back(hwcTestGraphicFormat[0].desc);
+    } else {
+        for (; argv[optind] != NULL; optind++) {
+            formats.push_back(argv[optind]);
+        }
+    }
+
+    // Stop framework
+    rv = snprintf(cmd, sizeof(cmd), "%s", CMD_STOP_FRAMEWORK);
+    if (rv >= (signed) sizeof(cmd) - 1) {
+        testPrintE("Command too long for: %s", CMD_STOP_FRAMEWORK);
+        exit(5);
+    }
+    testExecCmd(cmd);
+    testDelay(1.0); // TODO - needs means to query whether asynchronous stop
+                    // framework operation has completed.  For now, just wait
+                    // a long time.
+
+    openHwc();
+    initDisplay();
+
+    testPrintI("%-8s %6s %-8s %9s %9s %9s %9s %9s %9s %9s %9s %7s",
+               "format", "layers", "churn",
+               "val mean", "val p50", "val p90", "val max",
+               "pre mean", "pre p50", "pre p90", "pre max", "client");
+
+    for (vector<string>::iterator itFormat = formats.begin();
+         itFormat != formats.end(); ++itFormat) {
+        const struct hwcTestGraphicFormat *format;
+        format = hwcTestGraphicFormatLookup((*itFormat).c_str());
+        if (format == NULL) {
+            testPrintE("Unknown graphic format of: %s", (*itFormat).c_str());
+            exit(6);
+        }
+
+        for (vector<uint32_t>::iterator itLayers = layerCounts.begin();
+             itLayers != layerCounts.end(); ++itLayers) {
+            for (vector<Churn>::iterator itChurn = churns.begin();
+                 itChurn != churns.end(); ++itChurn) {
+                caseMeas meas;
+                measureCase(format, *itLayers, *itChurn, meas);
+                printCase(format, *itLayers, *itChurn, meas);
+            }
+        }
+    }
+
+    if (verbose) {
+        testPrintI("layer state calls: %" PRIu64 ", skipped as unchanged: %"
+                   PRIu64, hwcDevice->getLayerStateCalls(),
+                   hwcDevice->getLayerStateCallsSaved());
+    }
+
+    display.reset();
+    hwcDevice.reset();
+    hwcAdapter.reset();
+
+    // Start framework
+    rv = snprintf(cmd, sizeof(cmd), "%s", CMD_START_FRAMEWORK);
+    if (rv >= (signed) sizeof(cmd) - 1) {
+        testPrintE("Command too long for: %s", CMD_START_FRAMEWORK);
+        exit(7);
+    }
+    testExecCmd(cmd);
+
+    return 0;
+}
+
+// Opens the composer the way Surface Flinger does: an HWC1 device is
+// wrapped in HWC2On1Adapter.
+static void openHwc()
+{
+    int rv;
+    hw_module_t const *hwcModule;
+
+    if ((rv = hw_get_module(HWC_HARDWARE_MODULE_ID, &hwcModule)) != 0) {
+        testPrintE("hw_get_module failed, rv: %i", rv);
+        errno = -rv;
+        perror(NULL);
+        exit(20);
+    }
+    hw_device_t *device = NULL;
+    if ((rv = hwcModule->methods->open(hwcModule, HWC_HARDWARE_COMPOSER,
+                                       &device)) != 0) {
+        testPrintE("hwc open failed, rv: %i", rv);
+        errno = -rv;
+        perror(NULL);
+        exit(21);
+    }
+
+    uint32_t majorVersion = (device->version >> 24) & 0xF;
+    if (majorVersion == 2) {
+        hwcDevice = make_unique<HWC2::Device>(
+                reinterpret_cast<hwc2_device_t*>(device));
+    } else {
+        hwcAdapter = make_unique<HWC2On1Adapter>(
+                reinterpret_cast<hwc_composer_device_1_t*>(device));
+        if (hwcAdapter->getHwc1MinorVersion() < 1) {
+            testPrintE("Cannot adapt to HWC version 1.0");
+            exit(22);
+        }
+        hwcDevice = make_unique<HWC2::Device>(
+                static_cast<hwc2_device_t*>(hwcAdapter.get()));
+    }
+    if (verbose) {
+        testPrintI("composer: HWC%u%s", majorVersion,
+                   hwcAdapter ? " through HWC2On1Adapter" : "");
+    }
+}
+
+static void initDisplay()
+{
+    // The primary display is connected while registering, the device
+    // queued its hotplug until there is a callback.
+    hwcDevice->registerHotplugCallback(
+            [](shared_ptr<HWC2::Display> hotplugged,
+               HWC2::Connection connected) {
+        if (!display && connected == HWC2::Connection::Connected) {
+            display = hotplugged;
+        }
+    });
+    if (!display) {
+        testPrintE("No primary display");
+        exit(30);
+    }
+
+    auto error = display->setPowerMode(HWC2::PowerMode::On);
+    if (error != HWC2::Error::None) {
+        testPrintE("setPowerMode failed: %s", to_string(error).c_str());
+        exit(31);
+    }
+    shared_ptr<const HWC2::Display::Config> config;
+    error = display->getActiveConfig(&config);
+    if (error != HWC2::Error::None) {
+        testPrintE("getActiveConfig failed: %s", to_string(error).c_str());
+        exit(32);
+    }
+    displayWidth = config->getWidth();
+    displayHeight = config->getHeight();
+    testPrintI("display: %ux%u, vsync period: %.2f ms", displayWidth,
+               displayHeight, config->getVsyncPeriod() / 1e6);
+
+    // What the layers left to client composition would have been composed
+    // into; its content doesn't matter here.
+    clientTarget = new GraphicBuffer(displayWidth, displayHeight,
+            HAL_PIXEL_FORMAT_RGBA_8888,
+            GraphicBuffer::USAGE_HW_COMPOSER | GraphicBuffer::USAGE_HW_RENDER);
+    if (clientTarget->initCheck() != NO_ERROR) {
+        testPrintE("Client target allocation failed");
+        exit(33);
+    }
+}
+
+// Sets the attributes of a layer for the given frame.  The churn decides
+// which attributes vary with the frame number.
+static void setLayerState(benchLayer& layer, uint32_t index,
+                          uint32_t numLayers, uint32_t frame, Churn churn)
+{
+    const uint32_t w = layer.buffers[0]->getWidth();
+    const uint32_t h = layer.buffers[0]->getHeight();
+
+    // Cascade the layers over the display, moving them around it when
+    // the position churns.
+    const uint32_t step = (displayWidth - w) / (numLayers + 1);
+    uint32_t x = index * step;
+    uint32_t y = index * ((displayHeight - h) / (numLayers + 1));
+    if (churn != CHURN_NONE) {
+        x = (x + frame * 4) % (displayWidth - w);
+        y = (y + frame * 2) % (displayHeight - h);
+    }
+    Rect frameRect(x, y, x + w, y + h);
+
+    Rect crop(0, 0, w, h);
+    float alpha = 1.0f;
+    uint32_t z = index;
+    HWC2::BlendMode blend = (index == 0) ? HWC2::BlendMode::None
+                                         : HWC2::BlendMode::Premultiplied;
+    if (churn == CHURN_ALL) {
+        const uint32_t inset = frame % (min(w, h) / 4);
+        crop = Rect(inset, inset, w - inset, h - inset);
+        alpha = ((index == 0) ? 1.0f : 0.5f + (frame % 50) / 100.0f);
+        z = (index + frame) % numLayers;
+        if (index != 0 && (frame & 1)) {
+            blend = HWC2::BlendMode::Coverage;
+        }
+    }
+
+    // Like Surface Flinger, the composition type is asked for again on
+    // every frame, whatever the composer chose last time.
+    HWC2::Error error;
+    if ((error = layer.hwcLayer->setCompositionType(
+            HWC2::Composition::Device)) != HWC2::Error::None
+        || (error = layer.hwcLayer->setDisplayFrame(frameRect))
+            != HWC2::Error::None
+        || (error = layer.hwcLayer->setSourceCrop(FloatRect(crop)))
+            != HWC2::Error::None
+        || (error = layer.hwcLayer->setVisibleRegion(Region(frameRect)))
+            != HWC2::Error::None
+        || (error = layer.hwcLayer->setSurfaceDamage(Region(Rect(w, h))))
+            != HWC2::Error::None
+        || (error = layer.hwcLayer->setPlaneAlpha(alpha)) != HWC2::Error::None
+        || (error = layer.hwcLayer->setBlendMode(blend)) != HWC2::Error::None
+        || (error = layer.hwcLayer->setZOrder(z)) != HWC2::Error::None
+        || (error = layer.hwcLayer->setBuffer(
+                layer.buffers[frame % buffersPerLayer]->handle,
+                Fence::NO_FENCE)) != HWC2::Error::None) {
+        testPrintE("Setting the state of layer %u failed: %s", index,
+                   to_string(error).c_str());
+        exit(40);
+    }
+}
+
+static void measureCase(const struct hwcTestGraphicFormat *format,
+                        uint32_t numLayers, Churn churn, caseMeas& meas)
+{
+    // Every layer covers a quarter of the display
+    uint32_t w = displayWidth / 2;
+    uint32_t h = displayHeight / 2;
+    w -= w % format->wMod;
+    h -= h % format->hMod;
+
+    vector<benchLayer> layers(numLayers);
+    for (uint32_t n1 = 0; n1 < numLayers; n1++) {
+        auto error = display->createLayer(&layers[n1].hwcLayer);
+        if (error != HWC2::Error::None) {
+            testPrintE("createLayer %u failed: %s", n1,
+                       to_string(error).c_str());
+            exit(41);
+        }
+        for (size_t n2 = 0; n2 < buffersPerLayer; n2++) {
+            sp<GraphicBuffer> buffer = new GraphicBuffer(w, h, format->format,
+                    GraphicBuffer::USAGE_HW_COMPOSER
+                    | GraphicBuffer::USAGE_HW_TEXTURE
+                    | GraphicBuffer::USAGE_SW_WRITE_RARELY);
+            if (buffer->initCheck() != NO_ERROR) {
+                testPrintE("Buffer allocation failed, format: %s",
+                           format->desc);
+                exit(42);
+            }
+            hwcTestFillColor(buffer.get(),
+                             ColorFract(float(n1 + 1) / numLayers,
+                                        float(n2) / buffersPerLayer, 0.5f),
+                             0.75f);
+            layers[n1].buffers.push_back(buffer);
+        }
+    }
+
+    meas.validate.reserve(numFrames);
+    meas.present.reserve(numFrames);
+    meas.clientLayers = 0;
+
+    sp<Fence> retireFence = Fence::NO_FENCE;
+    for (uint32_t frame = 0; frame < warmupFrames + numFrames; frame++) {
+        // Don't queue frames faster than the display takes them
+        if (retireFence->wait(retireTimeoutMs) != NO_ERROR) {
+            testPrintE("Waiting for the retire fence timed out");
+            exit(43);
+        }
+
+        for (uint32_t n1 = 0; n1 < numLayers; n1++) {
+            setLayerState(layers[n1], n1, numLayers, frame, churn);
+        }
+
+        // Validate, including taking the composer's changes
+        const nsecs_t validateStart = systemTime(SYSTEM_TIME_MONOTONIC);
+        uint32_t numTypes = 0;
+        uint32_t numRequests = 0;
+        auto error = display->validate(&numTypes, &numRequests);
+        if (error != HWC2::Error::None && error != HWC2::Error::HasChanges) {
+            testPrintE("validate failed: %s", to_string(error).c_str());
+            exit(44);
+        }
+        unordered_map<shared_ptr<HWC2::Layer>, HWC2::Composition> types;
+        if (numTypes > 0) {
+            types.reserve(numTypes);
+            error = display->getChangedCompositionTypes(&types);
+            if (error != HWC2::Error::None) {
+                testPrintE("getChangedCompositionTypes failed: %s",
+                           to_string(error).c_str());
+                exit(45);
+            }
+        }
+        error = display->acceptChanges();
+        if (error != HWC2::Error::None) {
+            testPrintE("acceptChanges failed: %s", to_string(error).c_str());
+            exit(46);
+        }
+        const nsecs_t validateEnd = systemTime(SYSTEM_TIME_MONOTONIC);
+
+        uint32_t clientLayers = 0;
+        for (auto& type : types) {
+            if (type.second == HWC2::Composition::Client) {
+                clientLayers++;
+            }
+        }
+        if (clientLayers > 0) {
+            error = display->setClientTarget(clientTarget->handle,
+                    Fence::NO_FENCE, HAL_DATASPACE_UNKNOWN);
+            if (error != HWC2::Error::None) {
+                testPrintE("setClientTarget failed: %s",
+                           to_string(error).c_str());
+                exit(47);
+            }
+        }
+
+        const nsecs_t presentStart = systemTime(SYSTEM_TIME_MONOTONIC);
+        error = display->present(&retireFence);
+        const nsecs_t presentEnd = systemTime(SYSTEM_TIME_MONOTONIC);
+        if (error != HWC2::Error::None) {
+            testPrintE("present failed: %s", to_string(error).c_str());
+            exit(48);
+        }
+
+        if (frame >= warmupFrames) {
+            meas.validate.push_back(validateEnd - validateStart);
+            meas.present.push_back(presentEnd - presentStart);
+            meas.clientLayers += clientLayers;
+        }
+    }
+    retireFence->wait(retireTimeoutMs);
+
+    // Destroying the layers removes them from the display
+}
+
+static void printTimes(vector<nsecs_t>& times, ostringstream& out)
+{
+    sort(times.begin(), times.end());
+    nsecs_t sum = 0;
+    for (nsecs_t t : times) {
+        sum += t;
+    }
+    const double mean = double(sum) / times.size();
+    char str[64];
+    snprintf(str, sizeof(str), " %9.1f %9.1f %9.1f %9.1f", mean / 1e3,
+             times[times.size() / 2] / 1e3,
+             times[(times.size() * 9) / 10] / 1e3, times.back() / 1e3);
+    out << str;
+}
+
+static void printCase(const struct hwcTestGraphicFormat *format,
+                      uint32_t numLayers, Churn churn, caseMeas& meas)
+{
+    const char *churnDesc = "";
+    for (unsigned int n1 = 0; n1 < NUMA(churnType); n1++) {
+        if (churnType[n1].id == churn) { churnDesc = churnType[n1].desc; }
+    }
+
+    char str[64];
+    ostringstream out;
+    snprintf(str, sizeof(str), "%-8s %6u %-8s", format->desc, numLayers,
+             churnDesc);
+    out << str;
+    printTimes(meas.validate, out);
+    printTimes(meas.present, out);
+    snprintf(str, sizeof(str), " %7.2f",
+             double(meas.clientLayers) / numFrames);
+    out << str;
+    testPrintI("%s", out.str().c_str());
+}
+
+static vector<uint32_t> parseLayerCounts(const char *str, bool& error)
+{
+    vector<uint32_t> counts;
+    error = false;
+    istringstream in(str);
+    string count;
+    while (getline(in, count, ',')) {
+        char *chptr;
+        uint32_t num = strtoul(count.c_str(), &chptr, 10);
+        if (count.empty() || (*chptr != '\0') || (num == 0)) {
+            error = true;
+            return counts;
+        }
+        counts.push_back(num);
+    }
+    error = counts.empty();
+    return counts;
+}
+
+void printSyntax(const char *cmd)
+{
+    testPrintE("  %s [options] [graphicFormat] ...", cmd);
+    testPrintE("    options:");
+    testPrintE("      -l layerCounts - comma separated layer counts "
+               "(default %s)", defaultLayerCounts);
+    testPrintE("      -c churn - none, position or all (default: each)");
+    testPrintE("      -n frames - frames measured per case (default %u)",
+               defaultNumFrames);
+    testPrintE("      -v - Verbose");
+    testPrintE("");
+    testPrintE("    graphic formats:");
+    for (unsigned int n1 = 0; n1 < NUMA(hwcTestGraphicFormat); n1++) {
+        testPrintE("      %s", hwcTestGraphicFormat[n1].desc);
+    }
+}
@@ -0,0 +1,17 @@
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	preload.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+	libcutils \
+	libutils \
+    libEGL \
+    libgui
+
+LOCAL_MODULE:= test-opengl-preload
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
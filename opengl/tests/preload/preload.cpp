@@ -0,0 +1,157 @@
+/*
+ ** Copyright 2016, The Android Open Source Project
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **     http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+/*
+ * Measures what preloading the graphics drivers before forking saves the
+ * children, the way the zygote would with GraphicsEnv::preloadDrivers().
+ * Every child times its first eglGetDisplay() and eglInitialize(), then
+ * reports its private dirty memory, in total and in the driver's mappings.
+ * Run it once with and once without -p to compare.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <EGL/egl.h>
+
+#include <gui/GraphicsEnv.h>
+#include <utils/Timers.h>
+
+using namespace android;
+
+struct Result {
+    nsecs_t initTime;
+    size_t privateDirtyKb;
+    size_t driverPrivateDirtyKb;
+};
+
+static bool isDriverMapping(const char* path) {
+    return strstr(path, "/egl/") || strstr(path, "libEGL") || strstr(path, "libGLES");
+}
+
+static void readPrivateDirty(Result* result) {
+    FILE* smaps = fopen("/proc/self/smaps", "r");
+    if (!smaps) {
+        perror("/proc/self/smaps");
+        return;
+    }
+    char line[1024];
+    bool driver = false;
+    while (fgets(line, sizeof(line), smaps)) {
+        size_t kb;
+        if (sscanf(line, "Private_Dirty: %zu kB", &kb) == 1) {
+            result->privateDirtyKb += kb;
+            if (driver) {
+                result->driverPrivateDirtyKb += kb;
+            }
+        } else if (strchr(line, '-') && strchr(line, ' ') > strchr(line, '-')) {
+            // a mapping header: "start-end perms offset dev inode [path]"
+            const char* path = strchr(line, '/');
+            driver = path && isDriverMapping(path);
+        }
+    }
+    fclose(smaps);
+}
+
+static void runChild(int fd) {
+    Result result = {};
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    EGLDisplay dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (eglInitialize(dpy, NULL, NULL) != EGL_TRUE) {
+        fprintf(stderr, "eglInitialize failed: %#x\n", eglGetError());
+        _exit(1);
+    }
+    result.initTime = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    readPrivateDirty(&result);
+    eglTerminate(dpy);
+    if (write(fd, &result, sizeof(result)) != sizeof(result)) {
+        _exit(1);
+    }
+    _exit(0);
+}
+
+int main(int argc, char** argv)
+{
+    bool preload = false;
+    int children = 10;
+    int opt;
+    while ((opt = getopt(argc, argv, "pn:")) != -1) {
+        switch (opt) {
+            case 'p':
+                preload = true;
+                break;
+            case 'n':
+                children = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-p] [-n children]\n"
+                        "  -p  preload the drivers before forking\n"
+                        "  -n  number of children to fork (default 10)\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (preload) {
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        if (!GraphicsEnv::getInstance().preloadDrivers()) {
+            fprintf(stderr, "preloading the drivers failed\n");
+            return 1;
+        }
+        printf("preloaded drivers in %.2f ms\n",
+                (systemTime(SYSTEM_TIME_MONOTONIC) - start) / 1e6);
+    }
+
+    Result total = {};
+    int reported = 0;
+    for (int i = 0; i < children; i++) {
+        int fds[2];
+        if (pipe(fds)) {
+            perror("pipe");
+            return 1;
+        }
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(fds[0]);
+            runChild(fds[1]);
+        }
+        close(fds[1]);
+        Result result;
+        if (pid > 0 && read(fds[0], &result, sizeof(result)) == sizeof(result)) {
+            total.initTime += result.initTime;
+            total.privateDirtyKb += result.privateDirtyKb;
+            total.driverPrivateDirtyKb += result.driverPrivateDirtyKb;
+            reported++;
+        }
+        close(fds[0]);
+        if (pid > 0) {
+            waitpid(pid, NULL, 0);
+        }
+    }
+
+    if (!reported) {
+        fprintf(stderr, "no child reported\n");
+        return 1;
+    }
+    printf("%s, %d children: first EGL initialization %.2f ms, "
+            "private dirty %zu kB of which %zu kB in driver mappings (averages)\n",
+            preload ? "preloaded" : "not preloaded", reported,
+            total.initTime / 1e6 / reported,
+            total.privateDirtyKb / reported, total.driverPrivateDirtyKb / reported);
+    return 0;
+}
@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "BatteryPropertiesSnapshot"
+//#define LOG_NDEBUG 0
+#include <utils/Log.h>
+
+#include <sched.h>
+#include <string.h>
+
+#include <atomic>
+
+#include <batteryservice/BatteryPropertiesSnapshot.h>
+#include <batteryservice/IBatteryPropertiesRegistrar.h>
+#include <binder/MemoryBase.h>
+#include <binder/MemoryHeapBase.h>
+
+namespace android {
+
+// The layout of the shared memory, the same for 32 and 64-bit processes.
+struct BatteryPropertiesSnapshot::Shared {
+    enum { VERSION = 1 };
+    enum { TECHNOLOGY_SIZE = 32 };
+
+    std::atomic<uint32_t> sequence;
+    uint32_t version;
+
+    int32_t chargerAcOnline;
+    int32_t chargerUsbOnline;
+    int32_t chargerWirelessOnline;
+    int32_t maxChargingCurrent;
+    int32_t maxChargingVoltage;
+    int32_t batteryStatus;
+    int32_t batteryHealth;
+    int32_t batteryPresent;
+    int32_t batteryLevel;
+    int32_t batteryVoltage;
+    int32_t batteryTemperature;
+    int32_t batteryCurrent;
+    int32_t batteryCycleCount;
+    int32_t batteryFullCharge;
+    int32_t batteryChargeCounter;
+    char batteryTechnology[TECHNOLOGY_SIZE];
+
+    int32_t dockBatterySupported;
+    int32_t chargerDockAcOnline;
+    int32_t dockBatteryStatus;
+    int32_t dockBatteryHealth;
+    int32_t dockBatteryPresent;
+    int32_t dockBatteryLevel;
+    int32_t dockBatteryVoltage;
+    int32_t dockBatteryTemperature;
+    char dockBatteryTechnology[TECHNOLOGY_SIZE];
+};
+
+// An update takes well under a scheduling quantum, readers that keep
+// finding one in progress give up rather than spin.
+static const int MAX_READ_ATTEMPTS = 100;
+
+static void copyTechnology(char* dst, const String8& src, size_t size) {
+    strncpy(dst, src.string(), size - 1);
+    dst[size - 1] = '\0';
+}
+
+sp<BatteryPropertiesSnapshot> BatteryPropertiesSnapshot::create() {
+    sp<MemoryHeapBase> heap = new MemoryHeapBase(sizeof(Shared), MemoryHeapBase::READ_ONLY,
+            "BatteryPropertiesSnapshot");
+    if (heap->getHeapID() < 0) {
+        return NULL;
+    }
+    // ashmem comes zeroed, which is sequence 0: nothing published
+    Shared* shared = static_cast<Shared*>(heap->getBase());
+    shared->version = Shared::VERSION;
+    return new BatteryPropertiesSnapshot(new MemoryBase(heap, 0, sizeof(Shared)));
+}
+
+sp<BatteryPropertiesSnapshot> BatteryPropertiesSnapshot::fromMemory(const sp<IMemory>& memory) {
+    if (memory == NULL || memory->pointer() == NULL || memory->size() < sizeof(Shared)) {
+        return NULL;
+    }
+    const Shared* shared = static_cast<const Shared*>(memory->pointer());
+    if (shared->version != Shared::VERSION) {
+        ALOGW("Unknown shared battery properties version %u", shared->version);
+        return NULL;
+    }
+    return new BatteryPropertiesSnapshot(memory);
+}
+
+sp<BatteryPropertiesSnapshot> BatteryPropertiesSnapshot::fromRegistrar(
+        const sp<IBatteryPropertiesRegistrar>& registrar) {
+    if (registrar == NULL) {
+        return NULL;
+    }
+    return fromMemory(registrar->getPropertiesMemory());
+}
+
+BatteryPropertiesSnapshot::BatteryPropertiesSnapshot(const sp<IMemory>& memory)
+    : mMemory(memory),
+      mShared(static_cast<Shared*>(memory->pointer())) {
+}
+
+void BatteryPropertiesSnapshot::publish(const BatteryProperties& props) {
+    Shared* s = mShared;
+    const uint32_t sequence = s->sequence.load(std::memory_order_relaxed);
+    s->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    s->chargerAcOnline = props.chargerAcOnline;
+    s->chargerUsbOnline = props.chargerUsbOnline;
+    s->chargerWirelessOnline = props.chargerWirelessOnline;
+    s->maxChargingCurrent = props.maxChargingCurrent;
+    s->maxChargingVoltage = props.maxChargingVoltage;
+    s->batteryStatus = props.batteryStatus;
+    s->batteryHealth = props.batteryHealth;
+    s->batteryPresent = props.batteryPresent;
+    s->batteryLevel = props.batteryLevel;
+    s->batteryVoltage = props.batteryVoltage;
+    s->batteryTemperature = props.batteryTemperature;
+    s->batteryCurrent = props.batteryCurrent;
+    s->batteryCycleCount = props.batteryCycleCount;
+    s->batteryFullCharge = props.batteryFullCharge;
+    s->batteryChargeCounter = props.batteryChargeCounter;
+    copyTechnology(s->batteryTechnology, props.batteryTechnology, Shared::TECHNOLOGY_SIZE);
+
+    s->dockBatterySupported = props.dockBatterySupported;
+    s->chargerDockAcOnline = props.chargerDockAcOnline;
+    s->dockBatteryStatus = props.dockBatteryStatus;
+    s->dockBatteryHealth = props.dockBatteryHealth;
+    s->dockBatteryPresent = props.dockBatteryPresent;
+    s->dockBatteryLevel = props.dockBatteryLevel;
+    s->dockBatteryVoltage = props.dockBatteryVoltage;
+    s->dockBatteryTemperature = props.dockBatteryTemperature;
+    copyTechnology(s->dockBatteryTechnology, props.dockBatteryTechnology,
+            Shared::TECHNOLOGY_SIZE);
+
+    // skip 0 when wrapping around, it means nothing was published
+    s->sequence.store(sequence + 2 != 0 ? sequence + 2 : 2, std::memory_order_release);
+}
+
+uint32_t BatteryPropertiesSnapshot::read(BatteryProperties* props) const {
+    const Shared* s = mShared;
+    Shared copy;
+    uint32_t sequence;
+    for (int attempt = 0; ; attempt++) {
+        sequence = s->sequence.load(std::memory_order_acquire);
+        if (sequence == 0 || attempt == MAX_READ_ATTEMPTS) {
+            // nothing published, or a registrar that died in an update
+            return 0;
+        }
+        if (sequence & 1) {
+            // the registrar is in the middle of an update
+            sched_yield();
+            continue;
+        }
+        memcpy(reinterpret_cast<char*>(&copy) + sizeof(copy.sequence),
+                reinterpret_cast<const char*>(s) + sizeof(s->sequence),
+                sizeof(Shared) - sizeof(s->sequence));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (s->sequence.load(std::memory_order_relaxed) == sequence) {
+            break;
+        }
+    }
+
+    props->chargerAcOnline = copy.chargerAcOnline;
+    props->chargerUsbOnline = copy.chargerUsbOnline;
+    props->chargerWirelessOnline = copy.chargerWirelessOnline;
+    props->maxChargingCurrent = copy.maxChargingCurrent;
+    props->maxChargingVoltage = copy.maxChargingVoltage;
+    props->batteryStatus = copy.batteryStatus;
+    props->batteryHealth = copy.batteryHealth;
+    props->batteryPresent = copy.batteryPresent;
+    props->batteryLevel = copy.batteryLevel;
+    props->batteryVoltage = copy.batteryVoltage;
+    props->batteryTemperature = copy.batteryTemperature;
+    props->batteryCurrent = copy.batteryCurrent;
+    props->batteryCycleCount = copy.batteryCycleCount;
+    props->batteryFullCharge = copy.batteryFullCharge;
+    props->batteryChargeCounter = copy.batteryChargeCounter;
+    props->batteryTechnology = String8(copy.batteryTechnology);
+
+    props->dockBatterySupported = copy.dockBatterySupported;
+    props->chargerDockAcOnline = copy.chargerDockAcOnline;
+    props->dockBatteryStatus = copy.dockBatteryStatus;
+    props->dockBatteryHealth = copy.dockBatteryHealth;
+    props->dockBatteryPresent = copy.dockBatteryPresent;
+    props->dockBatteryLevel = copy.dockBatteryLevel;
+    props->dockBatteryVoltage = copy.dockBatteryVoltage;
+    props->dockBatteryTemperature = copy.dockBatteryTemperature;
+    props->dockBatteryTechnology = String8(copy.dockBatteryTechnology);
+    return sequence;
+}
+
+}; // namespace android
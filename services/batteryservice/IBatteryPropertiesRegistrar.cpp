@@ -76,6 +76,17 @@ public:
                 val->readFromParcel(&reply);
             return ret;
         }
+
+        sp<IMemory> getPropertiesMemory() {
+            Parcel data, reply;
+            data.writeInterfaceToken(IBatteryPropertiesRegistrar::getInterfaceDescriptor());
+            // registrars that don't keep the memory don't know the transaction
+            if (remote()->transact(GET_PROPERTIES_MEMORY, data, &reply) != NO_ERROR ||
+                    reply.readExceptionCode() != 0) {
+                return NULL;
+            }
+            return interface_cast<IMemory>(reply.readStrongBinder());
+        }
 };
 
 IMPLEMENT_META_INTERFACE(BatteryPropertiesRegistrar, "android.os.IBatteryPropertiesRegistrar");
@@ -125,6 +136,13 @@ status_t BnBatteryPropertiesRegistrar::onTransact(uint32_t code,
             val.writeToParcel(reply);
             return OK;
         }
+
+        case GET_PROPERTIES_MEMORY: {
+            CHECK_INTERFACE(IBatteryPropertiesRegistrar, data, reply);
+            reply->writeNoException();
+            reply->writeStrongBinder(IInterface::asBinder(getPropertiesMemory()));
+            return OK;
+        }
     }
     return BBinder::onTransact(code, data, reply, flags);
 };
@@ -21,8 +21,10 @@ LOCAL_SRC_FILES:= \
     InputDispatcher.cpp \
     InputListener.cpp \
     InputManager.cpp \
+    InputRecording.cpp \
     InputReader.cpp \
-    InputWindow.cpp
+    InputWindow.cpp \
+    InputWindowIndex.cpp
 
 LOCAL_SHARED_LIBRARIES := \
     libbinder \
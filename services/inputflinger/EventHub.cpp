@@ -28,6 +28,7 @@
 #include <sys/limits.h>
 #include <sys/inotify.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
 #include <sys/utsname.h>
 #include <unistd.h>
 
@@ -36,6 +37,7 @@
 // #define LOG_NDEBUG 0
 
 #include "EventHub.h"
+#include "InputRecording.h"
 
 #include <hardware_legacy/power.h>
 
@@ -148,9 +150,11 @@ EventHub::Device::Device(int fd, int32_t id, const String8& path,
         const InputDeviceIdentifier& identifier) :
         next(NULL),
         fd(fd), id(id), path(path), identifier(identifier),
-        classes(0), configuration(NULL), virtualKeyMap(NULL),
+        classes(0), configurationFileIno(0), configurationFileSize(0),
+        configuration(NULL), virtualKeyMap(NULL),
         ffEffectPlaying(false), ffEffectId(-1), controllerNumber(0),
-        timestampOverrideSec(0), timestampOverrideUsec(0) {
+        timestampOverrideSec(0), timestampOverrideUsec(0),
+        reportCount(0), totalReportLatency(0), maxReportLatency(0) {
     memset(keyBitmask, 0, sizeof(keyBitmask));
     memset(absBitmask, 0, sizeof(absBitmask));
     memset(relBitmask, 0, sizeof(relBitmask));
@@ -158,6 +162,7 @@ EventHub::Device::Device(int fd, int32_t id, const String8& path,
     memset(ledBitmask, 0, sizeof(ledBitmask));
     memset(ffBitmask, 0, sizeof(ffBitmask));
     memset(propBitmask, 0, sizeof(propBitmask));
+    memset(&configurationFileTime, 0, sizeof(configurationFileTime));
 }
 
 EventHub::Device::~Device() {
@@ -186,7 +191,8 @@ EventHub::EventHub(void) :
         mOpeningDevices(0), mClosingDevices(0),
         mNeedToSendFinishedDeviceScan(false),
         mNeedToReopenDevices(false), mNeedToScanDevices(true),
-        mPendingEventCount(0), mPendingEventIndex(0), mPendingINotify(false) {
+        mPendingEventCount(0), mPendingEventIndex(0), mPendingINotify(false),
+        mPendingEventItemsFull(false), mRecorder(NULL) {
     acquire_wake_lock(PARTIAL_WAKE_LOCK, WAKE_LOCK_ID);
 
     mEpollFd = epoll_create(EPOLL_SIZE_HINT);
@@ -228,6 +234,12 @@ EventHub::EventHub(void) :
     getLinuxRelease(&major, &minor);
     // EPOLLWAKEUP was introduced in kernel 3.5
     mUsingEpollWakeup = major > 3 || (major == 3 && minor >= 5);
+
+    char recordPath[PROPERTY_VALUE_MAX];
+    if (property_get("debug.input.record_path", recordPath, NULL) > 0
+            && !InputRecordingWriter::open(recordPath, &mRecorder)) {
+        ALOGI("Recording input events to '%s'.", recordPath);
+    }
 }
 
 EventHub::~EventHub(void) {
@@ -244,6 +256,8 @@ EventHub::~EventHub(void) {
     ::close(mWakeReadPipeFd);
     ::close(mWakeWritePipeFd);
 
+    delete mRecorder;
+
     release_wake_lock(WAKE_LOCK_ID);
 }
 
@@ -735,9 +749,9 @@ size_t EventHub::getEvents(int timeoutMillis, RawEvent* buffer, size_t bufferSiz
         if (mNeedToReopenDevices) {
             mNeedToReopenDevices = false;
 
-            ALOGI("Reopening all input devices due to a configuration change.");
+            ALOGI("Reloading all input devices due to a configuration change.");
 
-            closeAllDevicesLocked();
+            reloadAllDevicesLocked();
             mNeedToScanDevices = true;
             break; // return to the caller before we actually rescan
         }
@@ -780,6 +794,23 @@ size_t EventHub::getEvents(int timeoutMillis, RawEvent* buffer, size_t bufferSiz
             }
         }
 
+        while (!mReloadedDevices.isEmpty() && capacity) {
+            int32_t deviceId = mReloadedDevices[0];
+            mReloadedDevices.removeAt(0);
+            if (mDevices.indexOfKey(deviceId) < 0) {
+                continue; // closed since
+            }
+            ALOGV("Reporting device reloaded: id=%d\n", deviceId);
+            event->when = now;
+            event->deviceId = deviceId == mBuiltInKeyboardId ? BUILT_IN_KEYBOARD_ID : deviceId;
+            event->type = DEVICE_RELOADED;
+            event += 1;
+            mNeedToSendFinishedDeviceScan = true;
+            if (--capacity == 0) {
+                break;
+            }
+        }
+
         if (mNeedToSendFinishedDeviceScan) {
             mNeedToSendFinishedDeviceScan = false;
             event->when = now;
@@ -845,6 +876,7 @@ size_t EventHub::getEvents(int timeoutMillis, RawEvent* buffer, size_t bufferSiz
                     ALOGE("could not get event (wrong size: %d)", readSize);
                 } else {
                     int32_t deviceId = device->id == mBuiltInKeyboardId ? 0 : device->id;
+                    nsecs_t readTime = systemTime(SYSTEM_TIME_MONOTONIC);
 
                     size_t count = size_t(readSize) / sizeof(struct input_event);
                     for (size_t i = 0; i < count; i++) {
@@ -929,6 +961,16 @@ size_t EventHub::getEvents(int timeoutMillis, RawEvent* buffer, size_t bufferSiz
                                         event->when, time, now);
                             }
                         }
+                        if (iev.type == EV_SYN && iev.code == SYN_REPORT) {
+                            nsecs_t latency = readTime - event->when;
+                            if (latency >= 0) {
+                                device->reportCount += 1;
+                                device->totalReportLatency += latency;
+                                if (latency > device->maxReportLatency) {
+                                    device->maxReportLatency = latency;
+                                }
+                            }
+                        }
                         event->deviceId = deviceId;
                         event->type = iev.type;
                         event->code = iev.code;
@@ -969,8 +1011,15 @@ size_t EventHub::getEvents(int timeoutMillis, RawEvent* buffer, size_t bufferSiz
         }
 
         // Return now if we have collected any events or if we were explicitly awoken.
+        // If the last poll came back with as many FDs as it could hold though, there may
+        // be more devices ready, so drain those too without blocking while there is room.
+        // Otherwise a burst across many devices is split over several calls.
+        bool draining = false;
         if (event != buffer || awoken) {
-            break;
+            if (!mPendingEventItemsFull || capacity == 0) {
+                break;
+            }
+            draining = true;
         }
 
         // Poll for events.  Mind the wake lock dance!
@@ -986,16 +1035,24 @@ size_t EventHub::getEvents(int timeoutMillis, RawEvent* buffer, size_t bufferSiz
         // service the timeout.
         mPendingEventIndex = 0;
 
-        mLock.unlock(); // release lock before poll, must be before release_wake_lock
-        release_wake_lock(WAKE_LOCK_ID);
+        int pollResult;
+        if (draining) {
+            // The poll does not block, so there is no need to let go of the wake lock.
+            pollResult = epoll_wait(mEpollFd, mPendingEventItems, EPOLL_MAX_EVENTS, 0);
+        } else {
+            mLock.unlock(); // release lock before poll, must be before release_wake_lock
+            release_wake_lock(WAKE_LOCK_ID);
 
-        int pollResult = epoll_wait(mEpollFd, mPendingEventItems, EPOLL_MAX_EVENTS, timeoutMillis);
+            pollResult = epoll_wait(mEpollFd, mPendingEventItems, EPOLL_MAX_EVENTS,
+                    timeoutMillis);
 
-        acquire_wake_lock(PARTIAL_WAKE_LOCK, WAKE_LOCK_ID);
-        mLock.lock(); // reacquire lock after poll, must be after acquire_wake_lock
+            acquire_wake_lock(PARTIAL_WAKE_LOCK, WAKE_LOCK_ID);
+            mLock.lock(); // reacquire lock after poll, must be after acquire_wake_lock
+        }
+        mPendingEventItemsFull = pollResult == EPOLL_MAX_EVENTS;
 
         if (pollResult == 0) {
-            // Timed out.
+            // Timed out, or nothing more to drain.
             mPendingEventCount = 0;
             break;
         }
@@ -1003,6 +1060,9 @@ size_t EventHub::getEvents(int timeoutMillis, RawEvent* buffer, size_t bufferSiz
         if (pollResult < 0) {
             // An error occurred.
             mPendingEventCount = 0;
+            if (draining) {
+                break;
+            }
 
             // Sleep after errors to avoid locking up the system.
             // Hopefully the error is transient.
@@ -1016,6 +1076,10 @@ size_t EventHub::getEvents(int timeoutMillis, RawEvent* buffer, size_t bufferSiz
         }
     }
 
+    if (mRecorder) {
+        mRecorder->writeBatch(systemTime(SYSTEM_TIME_MONOTONIC), buffer, event - buffer);
+    }
+
     // All done, return the number of events we read.
     return event - buffer;
 }
@@ -1171,6 +1235,105 @@ status_t EventHub::openDeviceLocked(const char *devicePath) {
     ioctl(fd, EVIOCGBIT(EV_FF, sizeof(device->ffBitmask)), device->ffBitmask);
     ioctl(fd, EVIOCGPROP(sizeof(device->propBitmask)), device->propBitmask);
 
+    // Figure out what kind of device this is, loading the key maps that depend on it.
+    status_t keyMapStatus = classifyDeviceLocked(device);
+
+    // If the device isn't recognized as something we handle, don't monitor it.
+    if (device->classes == 0) {
+        ALOGV("Dropping device: id=%d, path='%s', name='%s'",
+                deviceId, devicePath, device->identifier.name.string());
+        delete device;
+        return -1;
+    }
+
+    // Configure the keyboard, gamepad or virtual keyboard.
+    if (device->classes & INPUT_DEVICE_CLASS_KEYBOARD) {
+        // Register the keyboard as a built-in keyboard if it is eligible.
+        if (!keyMapStatus
+                && mBuiltInKeyboardId == NO_BUILT_IN_KEYBOARD
+                && isEligibleBuiltInKeyboard(device->identifier,
+                        device->configuration, &device->keyMap)) {
+            mBuiltInKeyboardId = device->id;
+        }
+
+        // Disable kernel key repeat since we handle it ourselves
+        unsigned int repeatRate[] = {0,0};
+        if (ioctl(fd, EVIOCSREP, repeatRate)) {
+            ALOGW("Unable to disable kernel key repeat for %s: %s", devicePath, strerror(errno));
+        }
+    }
+
+    if (device->classes & (INPUT_DEVICE_CLASS_JOYSTICK | INPUT_DEVICE_CLASS_DPAD)
+            && device->classes & INPUT_DEVICE_CLASS_GAMEPAD) {
+        device->controllerNumber = getNextControllerNumberLocked(device);
+        setLedForController(device);
+    }
+
+    // Register with epoll.
+    struct epoll_event eventItem;
+    memset(&eventItem, 0, sizeof(eventItem));
+    eventItem.events = EPOLLIN;
+    if (mUsingEpollWakeup) {
+        eventItem.events |= EPOLLWAKEUP;
+    }
+    eventItem.data.u32 = deviceId;
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &eventItem)) {
+        ALOGE("Could not add device fd to epoll instance.  errno=%d", errno);
+        delete device;
+        return -1;
+    }
+
+    String8 wakeMechanism("EPOLLWAKEUP");
+    if (!mUsingEpollWakeup) {
+#ifndef EVIOCSSUSPENDBLOCK
+        // uapi headers don't include EVIOCSSUSPENDBLOCK, and future kernels
+        // will use an epoll flag instead, so as long as we want to support
+        // this feature, we need to be prepared to define the ioctl ourselves.
+#define EVIOCSSUSPENDBLOCK _IOW('E', 0x91, int)
+#endif
+        if (ioctl(fd, EVIOCSSUSPENDBLOCK, 1)) {
+            wakeMechanism = "<none>";
+        } else {
+            wakeMechanism = "EVIOCSSUSPENDBLOCK";
+        }
+    }
+
+    // Tell the kernel that we want to use the monotonic clock for reporting timestamps
+    // associated with input events.  This is important because the input system
+    // uses the timestamps extensively and assumes they were recorded using the monotonic
+    // clock.
+    //
+    // In older kernel, before Linux 3.4, there was no way to tell the kernel which
+    // clock to use to input event timestamps.  The standard kernel behavior was to
+    // record a real time timestamp, which isn't what we want.  Android kernels therefore
+    // contained a patch to the evdev_event() function in drivers/input/evdev.c to
+    // replace the call to do_gettimeofday() with ktime_get_ts() to cause the monotonic
+    // clock to be used instead of the real time clock.
+    //
+    // As of Linux 3.4, there is a new EVIOCSCLOCKID ioctl to set the desired clock.
+    // Therefore, we no longer require the Android-specific kernel patch described above
+    // as long as we make sure to set select the monotonic clock.  We do that here.
+    int clockId = CLOCK_MONOTONIC;
+    bool usingClockIoctl = !ioctl(fd, EVIOCSCLOCKID, &clockId);
+
+    ALOGI("New device: id=%d, fd=%d, path='%s', name='%s', classes=0x%x, "
+            "configuration='%s', keyLayout='%s', keyCharacterMap='%s', builtinKeyboard=%s, "
+            "wakeMechanism=%s, usingClockIoctl=%s",
+         deviceId, fd, devicePath, device->identifier.name.string(),
+         device->classes,
+         device->configurationFile.string(),
+         device->keyMap.keyLayoutFile.string(),
+         device->keyMap.keyCharacterMapFile.string(),
+         toString(mBuiltInKeyboardId == deviceId),
+         wakeMechanism.string(), toString(usingClockIoctl));
+
+    addDeviceLocked(device);
+    return 0;
+}
+
+status_t EventHub::classifyDeviceLocked(Device* device) {
+    device->classes = 0;
+
     // See if this is a keyboard.  Ignore everything in the button range except for
     // joystick and gamepad buttons which are handled like keyboards for the most part.
     bool haveKeyboardKeys = containsNonZeroByte(device->keyBitmask, 0, sizeof_bit_array(BTN_MISC))
@@ -1272,16 +1435,7 @@ status_t EventHub::openDeviceLocked(const char *devicePath) {
         keyMapStatus = loadKeyMapLocked(device);
     }
 
-    // Configure the keyboard, gamepad or virtual keyboard.
     if (device->classes & INPUT_DEVICE_CLASS_KEYBOARD) {
-        // Register the keyboard as a built-in keyboard if it is eligible.
-        if (!keyMapStatus
-                && mBuiltInKeyboardId == NO_BUILT_IN_KEYBOARD
-                && isEligibleBuiltInKeyboard(device->identifier,
-                        device->configuration, &device->keyMap)) {
-            mBuiltInKeyboardId = device->id;
-        }
-
         // 'Q' key support = cheap test of whether this is an alpha-capable kbd
         if (hasKeycodeLocked(device, AKEYCODE_Q)) {
             device->classes |= INPUT_DEVICE_CLASS_ALPHAKEY;
@@ -1303,98 +1457,20 @@ status_t EventHub::openDeviceLocked(const char *devicePath) {
                 break;
             }
         }
-
-        // Disable kernel key repeat since we handle it ourselves
-        unsigned int repeatRate[] = {0,0};
-        if (ioctl(fd, EVIOCSREP, repeatRate)) {
-            ALOGW("Unable to disable kernel key repeat for %s: %s", devicePath, strerror(errno));
-        }
     }
 
-    // If the device isn't recognized as something we handle, don't monitor it.
-    if (device->classes == 0) {
-        ALOGV("Dropping device: id=%d, path='%s', name='%s'",
-                deviceId, devicePath, device->identifier.name.string());
-        delete device;
-        return -1;
-    }
-
-    // Determine whether the device has a mic.
-    if (deviceHasMicLocked(device)) {
-        device->classes |= INPUT_DEVICE_CLASS_MIC;
-    }
-
-    // Determine whether the device is external or internal.
-    if (isExternalDeviceLocked(device)) {
-        device->classes |= INPUT_DEVICE_CLASS_EXTERNAL;
-    }
-
-    if (device->classes & (INPUT_DEVICE_CLASS_JOYSTICK | INPUT_DEVICE_CLASS_DPAD)
-            && device->classes & INPUT_DEVICE_CLASS_GAMEPAD) {
-        device->controllerNumber = getNextControllerNumberLocked(device);
-        setLedForController(device);
-    }
-
-    // Register with epoll.
-    struct epoll_event eventItem;
-    memset(&eventItem, 0, sizeof(eventItem));
-    eventItem.events = EPOLLIN;
-    if (mUsingEpollWakeup) {
-        eventItem.events |= EPOLLWAKEUP;
-    }
-    eventItem.data.u32 = deviceId;
-    if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &eventItem)) {
-        ALOGE("Could not add device fd to epoll instance.  errno=%d", errno);
-        delete device;
-        return -1;
-    }
+    if (device->classes != 0) {
+        // Determine whether the device has a mic.
+        if (deviceHasMicLocked(device)) {
+            device->classes |= INPUT_DEVICE_CLASS_MIC;
+        }
 
-    String8 wakeMechanism("EPOLLWAKEUP");
-    if (!mUsingEpollWakeup) {
-#ifndef EVIOCSSUSPENDBLOCK
-        // uapi headers don't include EVIOCSSUSPENDBLOCK, and future kernels
-        // will use an epoll flag instead, so as long as we want to support
-        // this feature, we need to be prepared to define the ioctl ourselves.
-#define EVIOCSSUSPENDBLOCK _IOW('E', 0x91, int)
-#endif
-        if (ioctl(fd, EVIOCSSUSPENDBLOCK, 1)) {
-            wakeMechanism = "<none>";
-        } else {
-            wakeMechanism = "EVIOCSSUSPENDBLOCK";
+        // Determine whether the device is external or internal.
+        if (isExternalDeviceLocked(device)) {
+            device->classes |= INPUT_DEVICE_CLASS_EXTERNAL;
         }
     }
-
-    // Tell the kernel that we want to use the monotonic clock for reporting timestamps
-    // associated with input events.  This is important because the input system
-    // uses the timestamps extensively and assumes they were recorded using the monotonic
-    // clock.
-    //
-    // In older kernel, before Linux 3.4, there was no way to tell the kernel which
-    // clock to use to input event timestamps.  The standard kernel behavior was to
-    // record a real time timestamp, which isn't what we want.  Android kernels therefore
-    // contained a patch to the evdev_event() function in drivers/input/evdev.c to
-    // replace the call to do_gettimeofday() with ktime_get_ts() to cause the monotonic
-    // clock to be used instead of the real time clock.
-    //
-    // As of Linux 3.4, there is a new EVIOCSCLOCKID ioctl to set the desired clock.
-    // Therefore, we no longer require the Android-specific kernel patch described above
-    // as long as we make sure to set select the monotonic clock.  We do that here.
-    int clockId = CLOCK_MONOTONIC;
-    bool usingClockIoctl = !ioctl(fd, EVIOCSCLOCKID, &clockId);
-
-    ALOGI("New device: id=%d, fd=%d, path='%s', name='%s', classes=0x%x, "
-            "configuration='%s', keyLayout='%s', keyCharacterMap='%s', builtinKeyboard=%s, "
-            "wakeMechanism=%s, usingClockIoctl=%s",
-         deviceId, fd, devicePath, device->identifier.name.string(),
-         device->classes,
-         device->configurationFile.string(),
-         device->keyMap.keyLayoutFile.string(),
-         device->keyMap.keyCharacterMapFile.string(),
-         toString(mBuiltInKeyboardId == deviceId),
-         wakeMechanism.string(), toString(usingClockIoctl));
-
-    addDeviceLocked(device);
-    return 0;
+    return keyMapStatus;
 }
 
 void EventHub::createVirtualKeyboardLocked() {
@@ -1416,6 +1492,54 @@ void EventHub::addDeviceLocked(Device* device) {
     mDevices.add(device->id, device);
     device->next = mOpeningDevices;
     mOpeningDevices = device;
+
+    if (mRecorder) {
+        recordDeviceAddedLocked(device);
+    }
+}
+
+void EventHub::recordDeviceAddedLocked(Device* device) {
+    InputRecord record;
+    record.clear();
+    record.type = InputRecord::TYPE_DEVICE_ADDED;
+    record.deviceId = device->id == mBuiltInKeyboardId ? BUILT_IN_KEYBOARD_ID : device->id;
+    record.classes = device->classes;
+    record.identifier = device->identifier;
+    for (int32_t property = 0; property <= INPUT_PROP_MAX; property++) {
+        if (test_bit(property, device->propBitmask)) {
+            record.properties.push(property);
+        }
+    }
+    for (int32_t scanCode = 0; scanCode <= KEY_MAX; scanCode++) {
+        if (test_bit(scanCode, device->keyBitmask)) {
+            record.scanCodes.push(scanCode);
+        }
+    }
+    for (int32_t axis = 0; axis <= REL_MAX; axis++) {
+        if (test_bit(axis, device->relBitmask)) {
+            record.relativeAxes.push(axis);
+        }
+    }
+    if (!device->isVirtual()) {
+        // Same as getAbsoluteAxisInfo(), which cannot be called with mLock held.
+        for (int32_t axis = 0; axis <= ABS_MAX; axis++) {
+            struct input_absinfo info;
+            if (test_bit(axis, device->absBitmask)
+                    && !ioctl(device->fd, EVIOCGABS(axis), &info)
+                    && info.minimum != info.maximum) {
+                InputRecord::AbsoluteAxis absoluteAxis;
+                absoluteAxis.axis = axis;
+                absoluteAxis.info.valid = true;
+                absoluteAxis.info.minValue = info.minimum;
+                absoluteAxis.info.maxValue = info.maximum;
+                absoluteAxis.info.flat = info.flat;
+                absoluteAxis.info.fuzz = info.fuzz;
+                absoluteAxis.info.resolution = info.resolution;
+                record.absoluteAxes.push(absoluteAxis);
+            }
+        }
+    }
+    mRecorder->write(record);
 }
 
 void EventHub::loadConfigurationLocked(Device* device) {
@@ -1425,6 +1549,14 @@ void EventHub::loadConfigurationLocked(Device* device) {
         ALOGD("No input device configuration file found for device '%s'.",
                 device->identifier.name.string());
     } else {
+        // Stat before loading, a later change must not look like the version loaded.
+        struct stat st;
+        if (stat(device->configurationFile.string(), &st)) {
+            memset(&st, 0, sizeof(st));
+        }
+        device->configurationFileIno = st.st_ino;
+        device->configurationFileSize = st.st_size;
+        device->configurationFileTime = st.st_mtim;
         status_t status = PropertyMap::load(device->configurationFile,
                 &device->configuration);
         if (status) {
@@ -1435,6 +1567,25 @@ void EventHub::loadConfigurationLocked(Device* device) {
     }
 }
 
+bool EventHub::isConfigurationCurrentLocked(Device* device) const {
+    String8 configurationFile = getInputDeviceConfigurationFilePathByDeviceIdentifier(
+            device->identifier, INPUT_DEVICE_CONFIGURATION_FILE_TYPE_CONFIGURATION);
+    if (configurationFile != device->configurationFile) {
+        return false;
+    }
+    if (configurationFile.isEmpty()) {
+        return true;
+    }
+    struct stat st;
+    if (stat(configurationFile.string(), &st)) {
+        return false;
+    }
+    return st.st_ino == device->configurationFileIno
+            && st.st_size == device->configurationFileSize
+            && st.st_mtim.tv_sec == device->configurationFileTime.tv_sec
+            && st.st_mtim.tv_nsec == device->configurationFileTime.tv_nsec;
+}
+
 status_t EventHub::loadVirtualKeyMapLocked(Device* device) {
     // The virtual key map is supplied by the kernel as a system board property file.
     String8 path;
@@ -1545,11 +1696,98 @@ void EventHub::closeAllDevicesLocked() {
     }
 }
 
+void EventHub::reloadAllDevicesLocked() {
+    // Closing a device removes it from mDevices.
+    Vector<Device*> devices;
+    for (size_t i = 0; i < mDevices.size(); i++) {
+        devices.push(mDevices.valueAt(i));
+    }
+
+    for (size_t i = 0; i < devices.size(); i++) {
+        Device* device = devices[i];
+        if (device->isVirtual()) {
+            continue;
+        }
+
+        bool excluded = false;
+        for (size_t j = 0; j < mExcludedDevices.size(); j++) {
+            if (device->identifier.name == mExcludedDevices.itemAt(j)) {
+                excluded = true;
+                break;
+            }
+        }
+        if (excluded) {
+            ALOGI("Closing device %s, it is now on the excluded list.",
+                    device->identifier.name.string());
+            closeDeviceLocked(device);
+            continue;
+        }
+
+        uint32_t classes = device->classes;
+        if (!reloadDeviceLocked(device)) {
+            continue;
+        }
+        if (device->classes == classes) {
+            ALOGI("Reloaded device: id=%d, path='%s', configuration='%s', keyLayout='%s', "
+                    "keyCharacterMap='%s'",
+                    device->id, device->path.string(), device->configurationFile.string(),
+                    device->keyMap.keyLayoutFile.string(),
+                    device->keyMap.keyCharacterMapFile.string());
+            mReloadedDevices.push(device->id);
+        } else {
+            // The reader picks the mappers of a device when it is added, so add it again.
+            ALOGI("Reopening device %s, its classes changed from 0x%x to 0x%x.",
+                    device->path.string(), classes, device->classes);
+            String8 path(device->path);
+            closeDeviceLocked(device);
+            openDeviceLocked(path.string());
+        }
+    }
+}
+
+bool EventHub::reloadDeviceLocked(Device* device) {
+    if (isConfigurationCurrentLocked(device)) {
+        if (!(device->classes & (INPUT_DEVICE_CLASS_KEYBOARD | INPUT_DEVICE_CLASS_JOYSTICK))) {
+            return false;
+        }
+        // The key maps are cached until their files change, so loading them again is
+        // cheap and returns the same maps if nothing changed.
+        KeyMap keyMap;
+        keyMap.load(device->identifier, device->configuration);
+        if (keyMap.keyLayoutMap == device->keyMap.keyLayoutMap
+                && keyMap.keyCharacterMap == device->keyMap.keyCharacterMap) {
+            return false;
+        }
+    }
+
+    delete device->configuration;
+    device->configuration = NULL;
+    delete device->virtualKeyMap;
+    device->virtualKeyMap = NULL;
+    device->keyMap = KeyMap();
+
+    loadConfigurationLocked(device);
+    classifyDeviceLocked(device);
+    if (device->overlayKeyMap != NULL) {
+        device->combinedKeyMap = KeyCharacterMap::combine(
+                device->keyMap.keyCharacterMap, device->overlayKeyMap);
+    }
+    return true;
+}
+
 void EventHub::closeDeviceLocked(Device* device) {
     ALOGI("Removed device: path=%s name=%s id=%d fd=%d classes=0x%x\n",
          device->path.string(), device->identifier.name.string(), device->id,
          device->fd, device->classes);
 
+    if (mRecorder) {
+        InputRecord record;
+        record.clear();
+        record.type = InputRecord::TYPE_DEVICE_REMOVED;
+        record.deviceId = device->id == mBuiltInKeyboardId ? BUILT_IN_KEYBOARD_ID : device->id;
+        mRecorder->write(record);
+    }
+
     if (device->id == mBuiltInKeyboardId) {
         ALOGW("built-in keyboard device %s (id=%d) is closing! the apps will not like this",
                 device->path.string(), mBuiltInKeyboardId);
@@ -1657,6 +1895,9 @@ status_t EventHub::scanDirLocked(const char *dirname)
             (de->d_name[1] == '.' && de->d_name[2] == '\0')))
             continue;
         strcpy(filename, de->d_name);
+        if (getDeviceByPathLocked(devname)) {
+            continue; // still open after a reload
+        }
         openDeviceLocked(devname);
     }
     closedir(dir);
@@ -1707,6 +1948,13 @@ void EventHub::dump(String8& dump) {
                     device->configurationFile.string());
             dump.appendFormat(INDENT3 "HaveKeyboardLayoutOverlay: %s\n",
                     toString(device->overlayKeyMap != NULL));
+            if (device->reportCount) {
+                dump.appendFormat(INDENT3 "ReportLatency: count=%" PRIu64 ", "
+                        "mean=%0.3fms, max=%0.3fms\n",
+                        device->reportCount,
+                        device->totalReportLatency * 0.000001 / device->reportCount,
+                        device->maxReportLatency * 0.000001);
+            }
         }
     } // release lock
 }
@@ -181,6 +181,9 @@ public:
         // Sent when all added/removed devices from the most recent scan have been reported.
         // This event is always sent at least once.
         FINISHED_DEVICE_SCAN = 0x30000000,
+        // Sent when the configuration or key maps of a device were reloaded while it stayed
+        // open. Its classes are unchanged; a device whose classes change is removed and added.
+        DEVICE_RELOADED = 0x40000000,
 
         FIRST_SYNTHETIC_EVENT = DEVICE_ADDED,
     };
@@ -256,7 +259,9 @@ public:
     virtual void vibrate(int32_t deviceId, nsecs_t duration) = 0;
     virtual void cancelVibrate(int32_t deviceId) = 0;
 
-    /* Requests the EventHub to reopen all input devices on the next call to getEvents(). */
+    /* Requests the EventHub to reload the configuration of all input devices on the next
+     * call to getEvents(). Devices stay open unless their classes change, and only those
+     * whose configuration or key maps changed are reported. */
     virtual void requestReopenDevices() = 0;
 
     /* Wakes up getEvents() if it is blocked on a read. */
@@ -269,6 +274,8 @@ public:
     virtual void monitor() = 0;
 };
 
+class InputRecordingWriter;
+
 class EventHub : public EventHubInterface
 {
 public:
@@ -351,6 +358,10 @@ private:
         uint8_t propBitmask[(INPUT_PROP_MAX + 1) / 8];
 
         String8 configurationFile;
+        // The version of configurationFile that was loaded, to tell when it changes.
+        ino_t configurationFileIno;
+        off_t configurationFileSize;
+        struct timespec configurationFileTime;
         PropertyMap* configuration;
         VirtualKeyMap* virtualKeyMap;
         KeyMap keyMap;
@@ -366,6 +377,11 @@ private:
         int32_t timestampOverrideSec;
         int32_t timestampOverrideUsec;
 
+        // Time from the event timestamp of each SYN_REPORT to when EventHub read it.
+        uint64_t reportCount;
+        nsecs_t totalReportLatency;
+        nsecs_t maxReportLatency;
+
         Device(int fd, int32_t id, const String8& path, const InputDeviceIdentifier& identifier);
         ~Device();
 
@@ -384,11 +400,14 @@ private:
     status_t openDeviceLocked(const char *devicePath);
     void createVirtualKeyboardLocked();
     void addDeviceLocked(Device* device);
+    void recordDeviceAddedLocked(Device* device);
     void assignDescriptorLocked(InputDeviceIdentifier& identifier);
 
     status_t closeDeviceByPathLocked(const char *devicePath);
     void closeDeviceLocked(Device* device);
     void closeAllDevicesLocked();
+    void reloadAllDevicesLocked();
+    bool reloadDeviceLocked(Device* device);
 
     status_t scanDirLocked(const char *dirname);
     void scanDevicesLocked();
@@ -401,8 +420,10 @@ private:
     bool hasKeycodeLocked(Device* device, int keycode) const;
 
     void loadConfigurationLocked(Device* device);
+    bool isConfigurationCurrentLocked(Device* device) const;
     status_t loadVirtualKeyMapLocked(Device* device);
     status_t loadKeyMapLocked(Device* device);
+    status_t classifyDeviceLocked(Device* device);
 
     bool isExternalDeviceLocked(Device* device);
     bool deviceHasMicLocked(Device* device);
@@ -434,6 +455,8 @@ private:
 
     Device *mOpeningDevices;
     Device *mClosingDevices;
+    // Ids of the devices reloaded in place that have yet to be reported.
+    Vector<int32_t> mReloadedDevices;
 
     bool mNeedToSendFinishedDeviceScan;
     bool mNeedToReopenDevices;
@@ -453,15 +476,21 @@ private:
     static const int EPOLL_SIZE_HINT = 8;
 
     // Maximum number of signalled FDs to handle at a time.
-    static const int EPOLL_MAX_EVENTS = 16;
+    static const int EPOLL_MAX_EVENTS = 64;
 
     // The array of pending epoll events and the index of the next event to be handled.
     struct epoll_event mPendingEventItems[EPOLL_MAX_EVENTS];
     size_t mPendingEventCount;
     size_t mPendingEventIndex;
     bool mPendingINotify;
+    // Set when the last poll filled mPendingEventItems, so more FDs may be ready.
+    bool mPendingEventItemsFull;
 
     bool mUsingEpollWakeup;
+
+    // Records what getEvents() returns when debug.input.record_path is set, or NULL.
+    // Only used by the reader thread.
+    InputRecordingWriter* mRecorder;
 };
 
 }; // namespace android
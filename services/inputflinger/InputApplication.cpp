@@ -25,11 +25,23 @@ namespace android {
 // --- InputApplicationHandle ---
 
 InputApplicationHandle::InputApplicationHandle() :
-    mInfo(NULL) {
+    mInfo(NULL), mPublishedInfo(NULL) {
 }
 
 InputApplicationHandle::~InputApplicationHandle() {
     delete mInfo;
+    delete mPublishedInfo;
+}
+
+void InputApplicationHandle::publishInfo() {
+    if (!mInfo) {
+        delete mPublishedInfo;
+        mPublishedInfo = NULL;
+    } else if (!mPublishedInfo) {
+        mPublishedInfo = new InputApplicationInfo(*mInfo);
+    } else {
+        *mPublishedInfo = *mInfo;
+    }
 }
 
 void InputApplicationHandle::releaseInfo() {
@@ -37,6 +49,10 @@ void InputApplicationHandle::releaseInfo() {
         delete mInfo;
         mInfo = NULL;
     }
+    if (mPublishedInfo) {
+        delete mPublishedInfo;
+        mPublishedInfo = NULL;
+    }
 }
 
 } // namespace android
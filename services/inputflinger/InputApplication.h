@@ -43,28 +43,37 @@ struct InputApplicationInfo {
 class InputApplicationHandle : public RefBase {
 public:
     inline const InputApplicationInfo* getInfo() const {
-        return mInfo;
+        return mPublishedInfo;
     }
 
     inline String8 getName() const {
-        return mInfo ? mInfo->name : String8("<invalid>");
+        return mPublishedInfo ? mPublishedInfo->name : String8("<invalid>");
     }
 
     inline nsecs_t getDispatchingTimeout(nsecs_t defaultValue) const {
-        return mInfo ? mInfo->dispatchingTimeout : defaultValue;
+        return mPublishedInfo ? mPublishedInfo->dispatchingTimeout : defaultValue;
     }
 
     /**
      * Requests that the state of this object be updated to reflect
      * the most current available information about the application.
      *
-     * This method should only be called from within the input dispatcher's
-     * critical section.
+     * The information is staged in mInfo and only returned by getInfo() once
+     * published, so this method is called outside of the input dispatcher's
+     * critical section, serialized by the dispatcher's window update lock.
      *
      * Returns true on success, or false if the handle is no longer valid.
      */
     virtual bool updateInfo() = 0;
 
+    /**
+     * Makes the information staged by updateInfo() visible to getInfo().
+     *
+     * This method should only be called from within the input dispatcher's
+     * critical section.
+     */
+    void publishInfo();
+
     /**
      * Releases the storage used by the associated information when it is
      * no longer needed.
@@ -75,7 +84,11 @@ protected:
     InputApplicationHandle();
     virtual ~InputApplicationHandle();
 
+    // Staged by updateInfo().
     InputApplicationInfo* mInfo;
+
+private:
+    InputApplicationInfo* mPublishedInfo;
 };
 
 } // namespace android
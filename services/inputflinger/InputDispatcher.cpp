@@ -51,8 +51,10 @@
 #include <ui/Region.h>
 
 #include <stddef.h>
+#include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <time.h>
 
@@ -88,6 +90,13 @@ const nsecs_t SLOW_EVENT_PROCESSING_WARNING_TIMEOUT = 2000 * 1000000LL; // 2sec
 // Number of recent events to keep for debugging purposes.
 const size_t RECENT_QUEUE_MAX_SIZE = 10;
 
+// Number of freed key and motion entries to keep for reuse. This covers the inbound
+// queue, the recent queue and the entries waiting on slow connections at typical rates.
+const size_t ENTRY_POOL_CAPACITY = 32;
+
+// Number of freed dispatch entries to keep for reuse, more since there is one per target.
+const size_t DISPATCH_ENTRY_POOL_CAPACITY = 64;
+
 static inline nsecs_t now() {
     return systemTime(SYSTEM_TIME_MONOTONIC);
 }
@@ -317,6 +326,7 @@ void InputDispatcher::dispatchOnceInnerLocked(nsecs_t* nextWakeupTime) {
 
         // Get ready to dispatch the event.
         resetANRTimeoutsLocked();
+        mPendingEvent->dispatchTime = currentTime;
     }
 
     // Now we have an event to dispatch.
@@ -407,6 +417,7 @@ void InputDispatcher::dispatchOnceInnerLocked(nsecs_t* nextWakeupTime) {
 
 bool InputDispatcher::enqueueInboundEventLocked(EventEntry* entry) {
     bool needWake = mInboundQueue.isEmpty();
+    entry->enqueueTime = now();
     mInboundQueue.enqueueAtTail(entry);
     traceInboundQueueLengthLocked();
 
@@ -475,27 +486,9 @@ void InputDispatcher::addRecentEventLocked(EventEntry* entry) {
 
 sp<InputWindowHandle> InputDispatcher::findTouchedWindowAtLocked(int32_t displayId,
         int32_t x, int32_t y) {
-    // Traverse windows from front to back to find touched window.
-    size_t numWindows = mWindowHandles.size();
-    for (size_t i = 0; i < numWindows; i++) {
-        sp<InputWindowHandle> windowHandle = mWindowHandles.itemAt(i);
-        const InputWindowInfo* windowInfo = windowHandle->getInfo();
-        if (windowInfo->displayId == displayId) {
-            int32_t flags = windowInfo->layoutParamsFlags;
-
-            if (windowInfo->visible) {
-                if (!(flags & InputWindowInfo::FLAG_NOT_TOUCHABLE)) {
-                    bool isTouchModal = (flags & (InputWindowInfo::FLAG_NOT_FOCUSABLE
-                            | InputWindowInfo::FLAG_NOT_TOUCH_MODAL)) == 0;
-                    if (isTouchModal || windowInfo->touchableRegionContainsPoint(x, y)) {
-                        // Found window.
-                        return windowHandle;
-                    }
-                }
-            }
-        }
-    }
-    return NULL;
+    // The index finds the frontmost window that takes the touch.
+    ssize_t index = mWindowIndex.findTouchedWindow(mWindowHandles, displayId, x, y);
+    return index >= 0 ? mWindowHandles.itemAt(index) : NULL;
 }
 
 void InputDispatcher::dropInboundEventLocked(EventEntry* entry, DropReason dropReason) {
@@ -1200,33 +1193,21 @@ int32_t InputDispatcher::findTouchedWindowTargetsLocked(nsecs_t currentTime,
         int32_t y = int32_t(entry->pointerCoords[pointerIndex].
                 getAxisValue(AMOTION_EVENT_AXIS_Y));
         sp<InputWindowHandle> newTouchedWindowHandle;
-        bool isTouchModal = false;
 
-        // Traverse windows from front to back to find touched window and outside targets.
-        size_t numWindows = mWindowHandles.size();
-        for (size_t i = 0; i < numWindows; i++) {
-            sp<InputWindowHandle> windowHandle = mWindowHandles.itemAt(i);
-            const InputWindowInfo* windowInfo = windowHandle->getInfo();
-            if (windowInfo->displayId != displayId) {
-                continue; // wrong display
-            }
-
-            int32_t flags = windowInfo->layoutParamsFlags;
-            if (windowInfo->visible) {
-                if (! (flags & InputWindowInfo::FLAG_NOT_TOUCHABLE)) {
-                    isTouchModal = (flags & (InputWindowInfo::FLAG_NOT_FOCUSABLE
-                            | InputWindowInfo::FLAG_NOT_TOUCH_MODAL)) == 0;
-                    if (isTouchModal || windowInfo->touchableRegionContainsPoint(x, y)) {
-                        newTouchedWindowHandle = windowHandle;
-                        break; // found touched window, exit window loop
-                    }
-                }
-
-                if (maskedAction == AMOTION_EVENT_ACTION_DOWN
-                        && (flags & InputWindowInfo::FLAG_WATCH_OUTSIDE_TOUCH)) {
-                    mTempTouchState.addOrUpdateWindow(
-                            windowHandle, InputTarget::FLAG_DISPATCH_AS_OUTSIDE, BitSet32(0));
+        // Find the touched window, and the outside targets in front of it.
+        ssize_t touchedIndex = mWindowIndex.findTouchedWindow(mWindowHandles,
+                displayId, x, y);
+        if (touchedIndex >= 0) {
+            newTouchedWindowHandle = mWindowHandles.itemAt(touchedIndex);
+        }
+        if (maskedAction == AMOTION_EVENT_ACTION_DOWN) {
+            const Vector<size_t>& watchers = mWindowIndex.getOutsideTouchWatchers(displayId);
+            for (size_t i = 0; i < watchers.size(); i++) {
+                if (touchedIndex >= 0 && watchers[i] >= size_t(touchedIndex)) {
+                    break; // behind the touched window
                 }
+                mTempTouchState.addOrUpdateWindow(mWindowHandles.itemAt(watchers[i]),
+                        InputTarget::FLAG_DISPATCH_AS_OUTSIDE, BitSet32(0));
             }
         }
 
@@ -1939,6 +1920,11 @@ void InputDispatcher::enqueueDispatchEntryLocked(
             delete dispatchEntry;
             return; // skip the inconsistent event
         }
+
+        if (coalesceMotionDispatchEntryLocked(connection, dispatchEntry)) {
+            delete dispatchEntry;
+            return; // folded into the move still waiting to be published
+        }
         break;
     }
     }
@@ -1953,6 +1939,55 @@ void InputDispatcher::enqueueDispatchEntryLocked(
     traceOutboundQueueLengthLocked(connection);
 }
 
+bool InputDispatcher::coalesceMotionDispatchEntryLocked(const sp<Connection>& connection,
+        DispatchEntry* dispatchEntry) {
+    // The outbound queue only holds entries the connection could not take yet, so a move
+    // queued behind another one for the same pointers would just add to the backlog.
+    // Replace the older move with the newer one instead; the samples that did get through
+    // are still batched into history by the consumer.
+    DispatchEntry* tailEntry = connection->outboundQueue.tail;
+    if (!tailEntry || tailEntry->eventEntry->type != EventEntry::TYPE_MOTION
+            || (dispatchEntry->resolvedAction != AMOTION_EVENT_ACTION_MOVE
+                    && dispatchEntry->resolvedAction != AMOTION_EVENT_ACTION_HOVER_MOVE)
+            || tailEntry->resolvedAction != dispatchEntry->resolvedAction
+            || tailEntry->resolvedFlags != dispatchEntry->resolvedFlags
+            || tailEntry->targetFlags != dispatchEntry->targetFlags
+            || tailEntry->xOffset != dispatchEntry->xOffset
+            || tailEntry->yOffset != dispatchEntry->yOffset
+            || tailEntry->scaleFactor != dispatchEntry->scaleFactor) {
+        return false;
+    }
+
+    // Injected events are accounted for one by one, so leave them alone.
+    const MotionEntry* tailMotionEntry = static_cast<const MotionEntry*>(tailEntry->eventEntry);
+    MotionEntry* motionEntry = static_cast<MotionEntry*>(dispatchEntry->eventEntry);
+    if (tailMotionEntry->isInjected() || motionEntry->isInjected()
+            || tailMotionEntry->deviceId != motionEntry->deviceId
+            || tailMotionEntry->source != motionEntry->source
+            || tailMotionEntry->displayId != motionEntry->displayId
+            || tailMotionEntry->policyFlags != motionEntry->policyFlags
+            || tailMotionEntry->metaState != motionEntry->metaState
+            || tailMotionEntry->buttonState != motionEntry->buttonState
+            || tailMotionEntry->downTime != motionEntry->downTime
+            || tailMotionEntry->pointerCount != motionEntry->pointerCount) {
+        return false;
+    }
+    for (uint32_t i = 0; i < motionEntry->pointerCount; i++) {
+        if (tailMotionEntry->pointerProperties[i] != motionEntry->pointerProperties[i]) {
+            return false;
+        }
+    }
+
+#if DEBUG_DISPATCH_CYCLE
+    ALOGD("channel '%s' ~ coalesced motion event into the one waiting in the outbound queue",
+            connection->getInputChannelName());
+#endif
+    tailEntry->eventEntry->release();
+    tailEntry->eventEntry = motionEntry;
+    motionEntry->refCount += 1;
+    return true;
+}
+
 void InputDispatcher::startDispatchCycleLocked(nsecs_t currentTime,
         const sp<Connection>& connection) {
 #if DEBUG_DISPATCH_CYCLE
@@ -2353,6 +2388,9 @@ InputDispatcher::splitMotionEvent(const MotionEntry* originalMotionEntry, BitSet
             originalMotionEntry->downTime,
             originalMotionEntry->displayId,
             splitPointerCount, splitPointerProperties, splitPointerCoords, 0, 0);
+    splitMotionEntry->readTime = originalMotionEntry->readTime;
+    splitMotionEntry->enqueueTime = originalMotionEntry->enqueueTime;
+    splitMotionEntry->dispatchTime = originalMotionEntry->dispatchTime;
 
     if (originalMotionEntry->injectionState) {
         splitMotionEntry->injectionState = originalMotionEntry->injectionState;
@@ -2461,6 +2499,7 @@ void InputDispatcher::notifyKey(const NotifyKeyArgs* args) {
                 args->deviceId, args->source, policyFlags,
                 args->action, flags, keyCode, args->scanCode,
                 metaState, repeatCount, args->downTime);
+        newEntry->readTime = args->readTime;
 
         needWake = enqueueInboundEventLocked(newEntry);
         mLock.unlock();
@@ -2540,6 +2579,7 @@ void InputDispatcher::notifyMotion(const NotifyMotionArgs* args) {
                 args->edgeFlags, args->xPrecision, args->yPrecision, args->downTime,
                 args->displayId,
                 args->pointerCount, args->pointerProperties, args->pointerCoords, 0, 0);
+        newEntry->readTime = args->readTime;
 
         needWake = enqueueInboundEventLocked(newEntry);
         mLock.unlock();
@@ -2590,81 +2630,101 @@ void InputDispatcher::notifyDeviceReset(const NotifyDeviceResetArgs* args) {
 int32_t InputDispatcher::injectInputEvent(const InputEvent* event, int32_t displayId,
         int32_t injectorPid, int32_t injectorUid, int32_t syncMode, int32_t timeoutMillis,
         uint32_t policyFlags) {
+    return injectInputEvents(&event, 1, displayId, injectorPid, injectorUid,
+            syncMode, timeoutMillis, policyFlags);
+}
+
+static bool validateInjectedEvent(const InputEvent* event) {
+    switch (event->getType()) {
+    case AINPUT_EVENT_TYPE_KEY: {
+        const KeyEvent* keyEvent = static_cast<const KeyEvent*>(event);
+        return validateKeyEvent(keyEvent->getAction());
+    }
+
+    case AINPUT_EVENT_TYPE_MOTION: {
+        const MotionEvent* motionEvent = static_cast<const MotionEvent*>(event);
+        return validateMotionEvent(motionEvent->getAction(), motionEvent->getActionButton(),
+                motionEvent->getPointerCount(), motionEvent->getPointerProperties());
+    }
+
+    default:
+        ALOGW("Cannot inject event of type %d", event->getType());
+        return false;
+    }
+}
+
+int32_t InputDispatcher::injectInputEvents(const InputEvent* const* events, size_t eventCount,
+        int32_t displayId, int32_t injectorPid, int32_t injectorUid, int32_t syncMode,
+        int32_t timeoutMillis, uint32_t policyFlags) {
 #if DEBUG_INBOUND_EVENT_DETAILS
-    ALOGD("injectInputEvent - eventType=%d, injectorPid=%d, injectorUid=%d, "
+    ALOGD("injectInputEvents - eventCount=%zu, injectorPid=%d, injectorUid=%d, "
             "syncMode=%d, timeoutMillis=%d, policyFlags=0x%08x",
-            event->getType(), injectorPid, injectorUid, syncMode, timeoutMillis, policyFlags);
+            eventCount, injectorPid, injectorUid, syncMode, timeoutMillis, policyFlags);
 #endif
 
     nsecs_t endTime = now() + milliseconds_to_nanoseconds(timeoutMillis);
 
+    // Validate the whole batch up front so that it is injected entirely or not at all.
+    for (size_t i = 0; i < eventCount; i++) {
+        if (!validateInjectedEvent(events[i])) {
+            return INPUT_EVENT_INJECTION_FAILED;
+        }
+    }
+
     policyFlags |= POLICY_FLAG_INJECTED;
     if (hasInjectionPermission(injectorPid, injectorUid)) {
         policyFlags |= POLICY_FLAG_TRUSTED;
     }
 
-    EventEntry* firstInjectedEntry;
-    EventEntry* lastInjectedEntry;
-    switch (event->getType()) {
-    case AINPUT_EVENT_TYPE_KEY: {
-        const KeyEvent* keyEvent = static_cast<const KeyEvent*>(event);
-        int32_t action = keyEvent->getAction();
-        if (! validateKeyEvent(action)) {
-            return INPUT_EVENT_INJECTION_FAILED;
-        }
-
-        int32_t flags = keyEvent->getFlags();
-        if (flags & AKEY_EVENT_FLAG_VIRTUAL_HARD_KEY) {
-            policyFlags |= POLICY_FLAG_VIRTUAL;
-        }
+    Vector<uint32_t> eventPolicyFlags;
+    eventPolicyFlags.setCapacity(eventCount);
+    for (size_t i = 0; i < eventCount; i++) {
+        uint32_t flags = policyFlags;
+        if (events[i]->getType() == AINPUT_EVENT_TYPE_KEY) {
+            const KeyEvent* keyEvent = static_cast<const KeyEvent*>(events[i]);
+            if (keyEvent->getFlags() & AKEY_EVENT_FLAG_VIRTUAL_HARD_KEY) {
+                flags |= POLICY_FLAG_VIRTUAL;
+            }
 
-        if (!(policyFlags & POLICY_FLAG_FILTERED)) {
-            mPolicy->interceptKeyBeforeQueueing(keyEvent, /*byref*/ policyFlags);
+            if (!(flags & POLICY_FLAG_FILTERED)) {
+                mPolicy->interceptKeyBeforeQueueing(keyEvent, /*byref*/ flags);
+            }
+        } else {
+            const MotionEvent* motionEvent = static_cast<const MotionEvent*>(events[i]);
+            if (!(flags & POLICY_FLAG_FILTERED)) {
+                nsecs_t eventTime = motionEvent->getEventTime();
+                mPolicy->interceptMotionBeforeQueueing(eventTime, /*byref*/ flags);
+            }
         }
-
-        mLock.lock();
-        firstInjectedEntry = new KeyEntry(keyEvent->getEventTime(),
-                keyEvent->getDeviceId(), keyEvent->getSource(),
-                policyFlags, action, flags,
-                keyEvent->getKeyCode(), keyEvent->getScanCode(), keyEvent->getMetaState(),
-                keyEvent->getRepeatCount(), keyEvent->getDownTime());
-        lastInjectedEntry = firstInjectedEntry;
-        break;
+        eventPolicyFlags.push(flags);
     }
 
-    case AINPUT_EVENT_TYPE_MOTION: {
-        const MotionEvent* motionEvent = static_cast<const MotionEvent*>(event);
-        int32_t action = motionEvent->getAction();
-        size_t pointerCount = motionEvent->getPointerCount();
-        const PointerProperties* pointerProperties = motionEvent->getPointerProperties();
-        int32_t actionButton = motionEvent->getActionButton();
-        if (! validateMotionEvent(action, actionButton, pointerCount, pointerProperties)) {
-            return INPUT_EVENT_INJECTION_FAILED;
-        }
-
-        if (!(policyFlags & POLICY_FLAG_FILTERED)) {
-            nsecs_t eventTime = motionEvent->getEventTime();
-            mPolicy->interceptMotionBeforeQueueing(eventTime, /*byref*/ policyFlags);
-        }
+    Vector<InjectionState*> injectionStates;
+    injectionStates.setCapacity(eventCount);
+    bool needWake = false;
 
-        mLock.lock();
-        const nsecs_t* sampleEventTimes = motionEvent->getSampleEventTimes();
-        const PointerCoords* samplePointerCoords = motionEvent->getSamplePointerCoords();
-        firstInjectedEntry = new MotionEntry(*sampleEventTimes,
-                motionEvent->getDeviceId(), motionEvent->getSource(), policyFlags,
-                action, actionButton, motionEvent->getFlags(),
-                motionEvent->getMetaState(), motionEvent->getButtonState(),
-                motionEvent->getEdgeFlags(),
-                motionEvent->getXPrecision(), motionEvent->getYPrecision(),
-                motionEvent->getDownTime(), displayId,
-                uint32_t(pointerCount), pointerProperties, samplePointerCoords,
-                motionEvent->getXOffset(), motionEvent->getYOffset());
-        lastInjectedEntry = firstInjectedEntry;
-        for (size_t i = motionEvent->getHistorySize(); i > 0; i--) {
-            sampleEventTimes += 1;
-            samplePointerCoords += pointerCount;
-            MotionEntry* nextInjectedEntry = new MotionEntry(*sampleEventTimes,
-                    motionEvent->getDeviceId(), motionEvent->getSource(), policyFlags,
+    mLock.lock();
+    for (size_t i = 0; i < eventCount; i++) {
+        EventEntry* firstInjectedEntry;
+        EventEntry* lastInjectedEntry;
+        if (events[i]->getType() == AINPUT_EVENT_TYPE_KEY) {
+            const KeyEvent* keyEvent = static_cast<const KeyEvent*>(events[i]);
+            firstInjectedEntry = new KeyEntry(keyEvent->getEventTime(),
+                    keyEvent->getDeviceId(), keyEvent->getSource(),
+                    eventPolicyFlags[i], keyEvent->getAction(), keyEvent->getFlags(),
+                    keyEvent->getKeyCode(), keyEvent->getScanCode(), keyEvent->getMetaState(),
+                    keyEvent->getRepeatCount(), keyEvent->getDownTime());
+            lastInjectedEntry = firstInjectedEntry;
+        } else {
+            const MotionEvent* motionEvent = static_cast<const MotionEvent*>(events[i]);
+            int32_t action = motionEvent->getAction();
+            size_t pointerCount = motionEvent->getPointerCount();
+            const PointerProperties* pointerProperties = motionEvent->getPointerProperties();
+            int32_t actionButton = motionEvent->getActionButton();
+            const nsecs_t* sampleEventTimes = motionEvent->getSampleEventTimes();
+            const PointerCoords* samplePointerCoords = motionEvent->getSamplePointerCoords();
+            firstInjectedEntry = new MotionEntry(*sampleEventTimes,
+                    motionEvent->getDeviceId(), motionEvent->getSource(), eventPolicyFlags[i],
                     action, actionButton, motionEvent->getFlags(),
                     motionEvent->getMetaState(), motionEvent->getButtonState(),
                     motionEvent->getEdgeFlags(),
@@ -2672,95 +2732,114 @@ int32_t InputDispatcher::injectInputEvent(const InputEvent* event, int32_t displ
                     motionEvent->getDownTime(), displayId,
                     uint32_t(pointerCount), pointerProperties, samplePointerCoords,
                     motionEvent->getXOffset(), motionEvent->getYOffset());
-            lastInjectedEntry->next = nextInjectedEntry;
-            lastInjectedEntry = nextInjectedEntry;
+            lastInjectedEntry = firstInjectedEntry;
+            for (size_t j = motionEvent->getHistorySize(); j > 0; j--) {
+                sampleEventTimes += 1;
+                samplePointerCoords += pointerCount;
+                MotionEntry* nextInjectedEntry = new MotionEntry(*sampleEventTimes,
+                        motionEvent->getDeviceId(), motionEvent->getSource(),
+                        eventPolicyFlags[i],
+                        action, actionButton, motionEvent->getFlags(),
+                        motionEvent->getMetaState(), motionEvent->getButtonState(),
+                        motionEvent->getEdgeFlags(),
+                        motionEvent->getXPrecision(), motionEvent->getYPrecision(),
+                        motionEvent->getDownTime(), displayId,
+                        uint32_t(pointerCount), pointerProperties, samplePointerCoords,
+                        motionEvent->getXOffset(), motionEvent->getYOffset());
+                lastInjectedEntry->next = nextInjectedEntry;
+                lastInjectedEntry = nextInjectedEntry;
+            }
         }
-        break;
-    }
-
-    default:
-        ALOGW("Cannot inject event of type %d", event->getType());
-        return INPUT_EVENT_INJECTION_FAILED;
-    }
 
-    InjectionState* injectionState = new InjectionState(injectorPid, injectorUid);
-    if (syncMode == INPUT_EVENT_INJECTION_SYNC_NONE) {
-        injectionState->injectionIsAsync = true;
-    }
+        InjectionState* injectionState = new InjectionState(injectorPid, injectorUid);
+        if (syncMode == INPUT_EVENT_INJECTION_SYNC_NONE) {
+            injectionState->injectionIsAsync = true;
+        }
 
-    injectionState->refCount += 1;
-    lastInjectedEntry->injectionState = injectionState;
+        injectionState->refCount += 1;
+        lastInjectedEntry->injectionState = injectionState;
+        injectionStates.push(injectionState);
 
-    bool needWake = false;
-    for (EventEntry* entry = firstInjectedEntry; entry != NULL; ) {
-        EventEntry* nextEntry = entry->next;
-        needWake |= enqueueInboundEventLocked(entry);
-        entry = nextEntry;
+        for (EventEntry* entry = firstInjectedEntry; entry != NULL; ) {
+            EventEntry* nextEntry = entry->next;
+            needWake |= enqueueInboundEventLocked(entry);
+            entry = nextEntry;
+        }
     }
-
     mLock.unlock();
 
     if (needWake) {
         mLooper->wake();
     }
 
-    int32_t injectionResult;
+    // Report the first failure in the batch, after waiting for all of it.
+    int32_t injectionResult = INPUT_EVENT_INJECTION_SUCCEEDED;
     { // acquire lock
         AutoMutex _l(mLock);
 
-        if (syncMode == INPUT_EVENT_INJECTION_SYNC_NONE) {
-            injectionResult = INPUT_EVENT_INJECTION_SUCCEEDED;
-        } else {
-            for (;;) {
-                injectionResult = injectionState->injectionResult;
-                if (injectionResult != INPUT_EVENT_INJECTION_PENDING) {
-                    break;
-                }
+        for (size_t i = 0; i < injectionStates.size(); i++) {
+            int32_t result = waitForInjectionResultLocked(injectionStates[i],
+                    syncMode, endTime);
+            if (injectionResult == INPUT_EVENT_INJECTION_SUCCEEDED) {
+                injectionResult = result;
+            }
+            injectionStates[i]->release();
+        }
+    } // release lock
 
-                nsecs_t remainingTimeout = endTime - now();
-                if (remainingTimeout <= 0) {
 #if DEBUG_INJECTION
-                    ALOGD("injectInputEvent - Timed out waiting for injection result "
-                            "to become available.");
+    ALOGD("injectInputEvents - Finished with result %d.  "
+            "injectorPid=%d, injectorUid=%d",
+            injectionResult, injectorPid, injectorUid);
 #endif
-                    injectionResult = INPUT_EVENT_INJECTION_TIMED_OUT;
-                    break;
-                }
 
-                mInjectionResultAvailableCondition.waitRelative(mLock, remainingTimeout);
-            }
+    return injectionResult;
+}
 
-            if (injectionResult == INPUT_EVENT_INJECTION_SUCCEEDED
-                    && syncMode == INPUT_EVENT_INJECTION_SYNC_WAIT_FOR_FINISHED) {
-                while (injectionState->pendingForegroundDispatches != 0) {
-#if DEBUG_INJECTION
-                    ALOGD("injectInputEvent - Waiting for %d pending foreground dispatches.",
-                            injectionState->pendingForegroundDispatches);
-#endif
-                    nsecs_t remainingTimeout = endTime - now();
-                    if (remainingTimeout <= 0) {
+int32_t InputDispatcher::waitForInjectionResultLocked(InjectionState* injectionState,
+        int32_t syncMode, nsecs_t endTime) {
+    if (syncMode == INPUT_EVENT_INJECTION_SYNC_NONE) {
+        return INPUT_EVENT_INJECTION_SUCCEEDED;
+    }
+
+    int32_t injectionResult;
+    for (;;) {
+        injectionResult = injectionState->injectionResult;
+        if (injectionResult != INPUT_EVENT_INJECTION_PENDING) {
+            break;
+        }
+
+        nsecs_t remainingTimeout = endTime - now();
+        if (remainingTimeout <= 0) {
 #if DEBUG_INJECTION
-                    ALOGD("injectInputEvent - Timed out waiting for pending foreground "
-                            "dispatches to finish.");
+            ALOGD("injectInputEvent - Timed out waiting for injection result "
+                    "to become available.");
 #endif
-                        injectionResult = INPUT_EVENT_INJECTION_TIMED_OUT;
-                        break;
-                    }
-
-                    mInjectionSyncFinishedCondition.waitRelative(mLock, remainingTimeout);
-                }
-            }
+            return INPUT_EVENT_INJECTION_TIMED_OUT;
         }
 
-        injectionState->release();
-    } // release lock
+        mInjectionResultAvailableCondition.waitRelative(mLock, remainingTimeout);
+    }
 
+    if (injectionResult == INPUT_EVENT_INJECTION_SUCCEEDED
+            && syncMode == INPUT_EVENT_INJECTION_SYNC_WAIT_FOR_FINISHED) {
+        while (injectionState->pendingForegroundDispatches != 0) {
 #if DEBUG_INJECTION
-    ALOGD("injectInputEvent - Finished with result %d.  "
-            "injectorPid=%d, injectorUid=%d",
-            injectionResult, injectorPid, injectorUid);
+            ALOGD("injectInputEvent - Waiting for %d pending foreground dispatches.",
+                    injectionState->pendingForegroundDispatches);
 #endif
+            nsecs_t remainingTimeout = endTime - now();
+            if (remainingTimeout <= 0) {
+#if DEBUG_INJECTION
+                ALOGD("injectInputEvent - Timed out waiting for pending foreground "
+                        "dispatches to finish.");
+#endif
+                return INPUT_EVENT_INJECTION_TIMED_OUT;
+            }
 
+            mInjectionSyncFinishedCondition.waitRelative(mLock, remainingTimeout);
+        }
+    }
     return injectionResult;
 }
 
@@ -2847,17 +2926,31 @@ void InputDispatcher::setInputWindows(const Vector<sp<InputWindowHandle> >& inpu
 #if DEBUG_FOCUS
     ALOGD("setInputWindows");
 #endif
+    // Updating the window information calls into the window manager for every window,
+    // so do it before taking the lock and only publish the staged information under it.
+    AutoMutex _wl(mWindowUpdateLock);
+
+    Vector<sp<InputWindowHandle> > windowHandles;
+    windowHandles.setCapacity(inputWindowHandles.size());
+    for (size_t i = 0; i < inputWindowHandles.size(); i++) {
+        const sp<InputWindowHandle>& windowHandle = inputWindowHandles.itemAt(i);
+        if (windowHandle->updateInfo()) {
+            windowHandles.push(windowHandle);
+        }
+    }
+
     { // acquire lock
         AutoMutex _l(mLock);
 
         Vector<sp<InputWindowHandle> > oldWindowHandles = mWindowHandles;
-        mWindowHandles = inputWindowHandles;
+        mWindowHandles = windowHandles;
 
         sp<InputWindowHandle> newFocusedWindowHandle;
         bool foundHoveredWindow = false;
         for (size_t i = 0; i < mWindowHandles.size(); i++) {
             const sp<InputWindowHandle>& windowHandle = mWindowHandles.itemAt(i);
-            if (!windowHandle->updateInfo() || windowHandle->getInputChannel() == NULL) {
+            windowHandle->publishInfo();
+            if (windowHandle->getInputChannel() == NULL) {
                 mWindowHandles.removeAt(i--);
                 continue;
             }
@@ -2873,6 +2966,8 @@ void InputDispatcher::setInputWindows(const Vector<sp<InputWindowHandle> >& inpu
             mLastHoverWindowHandle = NULL;
         }
 
+        mWindowIndex.build(mWindowHandles);
+
         if (mFocusedWindowHandle != newFocusedWindowHandle) {
             if (mFocusedWindowHandle != NULL) {
 #if DEBUG_FOCUS
@@ -2942,10 +3037,15 @@ void InputDispatcher::setFocusedApplication(
 #if DEBUG_FOCUS
     ALOGD("setFocusedApplication");
 #endif
+    AutoMutex _wl(mWindowUpdateLock);
+
+    bool updated = inputApplicationHandle != NULL && inputApplicationHandle->updateInfo();
+
     { // acquire lock
         AutoMutex _l(mLock);
 
-        if (inputApplicationHandle != NULL && inputApplicationHandle->updateInfo()) {
+        if (updated) {
+            inputApplicationHandle->publishInfo();
             if (mFocusedApplicationHandle != inputApplicationHandle) {
                 if (mFocusedApplicationHandle != NULL) {
                     resetANRTimeoutsLocked();
@@ -3281,6 +3381,7 @@ void InputDispatcher::dumpDispatchStateLocked(String8& dump) {
                     i, connection->getInputChannelName(), connection->getWindowName(),
                     connection->getStatusLabel(), toString(connection->monitor),
                     toString(connection->inputPublisherBlocked));
+            connection->latencyStats.dump(dump);
 
             if (!connection->outboundQueue.isEmpty()) {
                 dump.appendFormat(INDENT3 "OutboundQueue: length=%u\n",
@@ -3330,6 +3431,11 @@ void InputDispatcher::dumpDispatchStateLocked(String8& dump) {
             mConfig.keyRepeatDelay * 0.000001f);
     dump.appendFormat(INDENT2 "KeyRepeatTimeout: %0.1fms\n",
             mConfig.keyRepeatTimeout * 0.000001f);
+
+    dump.append(INDENT "EntryPools:\n");
+    KeyEntry::sPool.dump(dump, "KeyEntry");
+    MotionEntry::sPool.dump(dump, "MotionEntry");
+    DispatchEntry::sPool.dump(dump, "DispatchEntry");
 }
 
 status_t InputDispatcher::registerInputChannel(const sp<InputChannel>& inputChannel,
@@ -3565,6 +3671,8 @@ void InputDispatcher::doDispatchCycleFinishedLockedInterruptible(
             dispatchEntry->eventEntry->appendDescription(msg);
             ALOGI("%s", msg.string());
         }
+        connection->latencyStats.addEvent(dispatchEntry->eventEntry,
+                dispatchEntry->deliveryTime, finishTime);
 
         bool restartEvent;
         if (dispatchEntry->eventEntry->type == EventEntry::TYPE_KEY) {
@@ -3838,6 +3946,58 @@ void InputDispatcher::monitor() {
 }
 
 
+// --- InputDispatcher::EntryPool ---
+
+InputDispatcher::EntryPool::EntryPool(size_t entrySize, size_t capacity) :
+        mEntrySize(entrySize), mCapacity(capacity),
+        mFreeList(NULL), mFreeCount(0), mInUse(0), mMaxInUse(0), mHits(0), mMisses(0) {
+}
+
+void* InputDispatcher::EntryPool::allocate(size_t size) {
+    ALOG_ASSERT(size == mEntrySize, "Pooled entries have to be %zu bytes, not %zu",
+            mEntrySize, size);
+    AutoMutex _l(mLock);
+    mInUse += 1;
+    if (mInUse > mMaxInUse) {
+        mMaxInUse = mInUse;
+    }
+    if (mFreeList) {
+        FreeEntry* entry = mFreeList;
+        mFreeList = entry->next;
+        mFreeCount -= 1;
+        mHits += 1;
+        return entry;
+    }
+    mMisses += 1;
+    return ::operator new(size);
+}
+
+void InputDispatcher::EntryPool::free(void* entry) {
+    if (!entry) {
+        return;
+    }
+    AutoMutex _l(mLock);
+    mInUse -= 1;
+    if (mFreeCount < mCapacity) {
+        FreeEntry* freeEntry = static_cast<FreeEntry*>(entry);
+        freeEntry->next = mFreeList;
+        mFreeList = freeEntry;
+        mFreeCount += 1;
+        return;
+    }
+    ::operator delete(entry);
+}
+
+void InputDispatcher::EntryPool::dump(String8& dump, const char* name) const {
+    AutoMutex _l(mLock);
+    uint64_t total = mHits + mMisses;
+    dump.appendFormat(INDENT2 "%s: inUse=%zu, maxInUse=%zu, free=%zu/%zu, "
+            "hits=%" PRIu64 ", misses=%" PRIu64 " (%0.1f%% hit)\n",
+            name, mInUse, mMaxInUse, mFreeCount, mCapacity, mHits, mMisses,
+            total ? mHits * 100.0 / total : 0.0);
+}
+
+
 // --- InputDispatcher::InjectionState ---
 
 InputDispatcher::InjectionState::InjectionState(int32_t injectorPid, int32_t injectorUid) :
@@ -3864,7 +4024,8 @@ void InputDispatcher::InjectionState::release() {
 
 InputDispatcher::EventEntry::EventEntry(int32_t type, nsecs_t eventTime, uint32_t policyFlags) :
         refCount(1), type(type), eventTime(eventTime), policyFlags(policyFlags),
-        injectionState(NULL), dispatchInProgress(false) {
+        injectionState(NULL), dispatchInProgress(false),
+        readTime(0), enqueueTime(0), dispatchTime(0) {
 }
 
 InputDispatcher::EventEntry::~EventEntry() {
@@ -3921,6 +4082,9 @@ void InputDispatcher::DeviceResetEntry::appendDescription(String8& msg) const {
 
 // --- InputDispatcher::KeyEntry ---
 
+InputDispatcher::EntryPool InputDispatcher::KeyEntry::sPool(
+        sizeof(InputDispatcher::KeyEntry), ENTRY_POOL_CAPACITY);
+
 InputDispatcher::KeyEntry::KeyEntry(nsecs_t eventTime,
         int32_t deviceId, uint32_t source, uint32_t policyFlags, int32_t action,
         int32_t flags, int32_t keyCode, int32_t scanCode, int32_t metaState,
@@ -3948,6 +4112,9 @@ void InputDispatcher::KeyEntry::recycle() {
     releaseInjectionState();
 
     dispatchInProgress = false;
+    readTime = 0;
+    enqueueTime = 0;
+    dispatchTime = 0;
     syntheticRepeat = false;
     interceptKeyResult = KeyEntry::INTERCEPT_KEY_RESULT_UNKNOWN;
     interceptKeyWakeupTime = 0;
@@ -3956,6 +4123,9 @@ void InputDispatcher::KeyEntry::recycle() {
 
 // --- InputDispatcher::MotionEntry ---
 
+InputDispatcher::EntryPool InputDispatcher::MotionEntry::sPool(
+        sizeof(InputDispatcher::MotionEntry), ENTRY_POOL_CAPACITY);
+
 InputDispatcher::MotionEntry::MotionEntry(nsecs_t eventTime, int32_t deviceId,
         uint32_t source, uint32_t policyFlags, int32_t action, int32_t actionButton,
         int32_t flags, int32_t metaState, int32_t buttonState, int32_t edgeFlags,
@@ -4002,6 +4172,9 @@ void InputDispatcher::MotionEntry::appendDescription(String8& msg) const {
 
 volatile int32_t InputDispatcher::DispatchEntry::sNextSeqAtomic;
 
+InputDispatcher::EntryPool InputDispatcher::DispatchEntry::sPool(
+        sizeof(InputDispatcher::DispatchEntry), DISPATCH_ENTRY_POOL_CAPACITY);
+
 InputDispatcher::DispatchEntry::DispatchEntry(EventEntry* eventEntry,
         int32_t targetFlags, float xOffset, float yOffset, float scaleFactor) :
         seq(nextSeq()),
@@ -4379,6 +4552,81 @@ bool InputDispatcher::InputState::shouldCancelMotion(const MotionMemento& mement
 }
 
 
+// --- InputDispatcher::LatencyStats ---
+
+InputDispatcher::LatencyStats::LatencyStats() {
+    memset(mHistograms, 0, sizeof(mHistograms));
+}
+
+void InputDispatcher::LatencyStats::addEvent(const EventEntry* entry,
+        nsecs_t deliveryTime, nsecs_t finishTime) {
+    add(STAGE_READ, entry->eventTime, entry->readTime);
+    add(STAGE_MAP, entry->readTime, entry->enqueueTime);
+    add(STAGE_INBOUND, entry->enqueueTime, entry->dispatchTime);
+    add(STAGE_DELIVER, entry->dispatchTime, deliveryTime);
+    add(STAGE_CONSUME, deliveryTime, finishTime);
+    add(STAGE_TOTAL, entry->eventTime, finishTime);
+}
+
+void InputDispatcher::LatencyStats::add(Stage stage, nsecs_t start, nsecs_t end) {
+    if (!start || !end || end < start) {
+        return; // not traced, such as for synthesized events
+    }
+    nsecs_t latency = end - start;
+    size_t bucket = 0;
+    for (nsecs_t limit = 500 * 1000LL; latency >= limit && bucket < BUCKET_COUNT - 1;
+            limit *= 2) {
+        bucket += 1;
+    }
+    Histogram& histogram = mHistograms[stage];
+    histogram.buckets[bucket] += 1;
+    histogram.count += 1;
+    histogram.total += latency;
+    if (latency > histogram.max) {
+        histogram.max = latency;
+    }
+}
+
+nsecs_t InputDispatcher::LatencyStats::getPercentile(const Histogram& histogram,
+        uint32_t percent) {
+    // Reports the top of the bucket the percentile falls in, or the max for the last one.
+    uint32_t target = (uint64_t(histogram.count) * percent + 99) / 100;
+    uint32_t count = 0;
+    nsecs_t limit = 500 * 1000LL;
+    for (size_t i = 0; i < BUCKET_COUNT - 1; i++, limit *= 2) {
+        count += histogram.buckets[i];
+        if (count >= target) {
+            return limit < histogram.max ? limit : histogram.max;
+        }
+    }
+    return histogram.max;
+}
+
+void InputDispatcher::LatencyStats::dump(String8& dump) const {
+    static const char* const STAGE_LABELS[STAGE_COUNT] = {
+        "Read", "Map", "Inbound", "Deliver", "Consume", "Total",
+    };
+    if (!mHistograms[STAGE_TOTAL].count) {
+        return;
+    }
+    dump.append(INDENT3 "Latency:\n");
+    for (size_t i = 0; i < STAGE_COUNT; i++) {
+        const Histogram& histogram = mHistograms[i];
+        if (!histogram.count) {
+            continue;
+        }
+        dump.appendFormat(INDENT4 "%s: count=%u, mean=%0.2fms, p50<=%0.1fms, p90<=%0.1fms, "
+                "p99<=%0.1fms, max=%0.2fms\n",
+                STAGE_LABELS[i], histogram.count,
+                histogram.total * 0.000001 / histogram.count,
+                getPercentile(histogram, 50) * 0.000001,
+                getPercentile(histogram, 90) * 0.000001,
+                getPercentile(histogram, 99) * 0.000001,
+                histogram.max * 0.000001);
+    }
+}
+
+
 // --- InputDispatcher::Connection ---
 
 InputDispatcher::Connection::Connection(const sp<InputChannel>& inputChannel,
@@ -34,6 +34,7 @@
 #include <limits.h>
 
 #include "InputWindow.h"
+#include "InputWindowIndex.h"
 #include "InputApplication.h"
 #include "InputListener.h"
 
@@ -304,6 +305,17 @@ public:
             int32_t injectorPid, int32_t injectorUid, int32_t syncMode, int32_t timeoutMillis,
             uint32_t policyFlags) = 0;
 
+    /* Injects a sequence of input events like injectInputEvent, checking the injector's
+     * permission and validating the events once for the whole batch. Nothing is injected
+     * if any event is invalid. Synchronous modes wait for all of the events within the
+     * timeout and return the first result other than INPUT_EVENT_INJECTION_SUCCEEDED.
+     *
+     * This method may be called on any thread (usually by the input manager).
+     */
+    virtual int32_t injectInputEvents(const InputEvent* const* events, size_t eventCount,
+            int32_t displayId, int32_t injectorPid, int32_t injectorUid, int32_t syncMode,
+            int32_t timeoutMillis, uint32_t policyFlags) = 0;
+
     /* Sets the list of input windows.
      *
      * This method may be called on any thread (usually by the input manager).
@@ -387,6 +399,9 @@ public:
     virtual int32_t injectInputEvent(const InputEvent* event, int32_t displayId,
             int32_t injectorPid, int32_t injectorUid, int32_t syncMode, int32_t timeoutMillis,
             uint32_t policyFlags);
+    virtual int32_t injectInputEvents(const InputEvent* const* events, size_t eventCount,
+            int32_t displayId, int32_t injectorPid, int32_t injectorUid, int32_t syncMode,
+            int32_t timeoutMillis, uint32_t policyFlags);
 
     virtual void setInputWindows(const Vector<sp<InputWindowHandle> >& inputWindowHandles);
     virtual void setFocusedApplication(const sp<InputApplicationHandle>& inputApplicationHandle);
@@ -401,6 +416,38 @@ public:
     virtual status_t unregisterInputChannel(const sp<InputChannel>& inputChannel);
 
 private:
+    // Keeps freed entries of one size for reuse, so that the entries made for
+    // every event and every target do not each go through the heap. Up to
+    // capacity free entries are kept; the pool starts out empty and grows
+    // with the traffic. Entries can be freed outside of mLock (such as when
+    // injection fails), so the pool has its own lock. The pools live as long as
+    // the process and never give their free entries back.
+    class EntryPool {
+    public:
+        EntryPool(size_t entrySize, size_t capacity);
+
+        void* allocate(size_t size);
+        void free(void* entry);
+
+        void dump(String8& dump, const char* name) const;
+
+    private:
+        struct FreeEntry {
+            FreeEntry* next;
+        };
+
+        const size_t mEntrySize;
+        const size_t mCapacity;
+
+        mutable Mutex mLock;
+        FreeEntry* mFreeList;
+        size_t mFreeCount;
+        size_t mInUse;
+        size_t mMaxInUse;
+        uint64_t mHits;   // allocations served from the free list
+        uint64_t mMisses; // allocations that went to the heap
+    };
+
     template <typename T>
     struct Link {
         T* next;
@@ -442,6 +489,11 @@ private:
 
         bool dispatchInProgress; // initially false, set to true while dispatching
 
+        // Timeline for latency tracing; 0 where unknown. eventTime is when it happened.
+        nsecs_t readTime;     // when InputReader got the raw events
+        nsecs_t enqueueTime;  // when it was added to the inbound queue
+        nsecs_t dispatchTime; // when the dispatcher started dispatching it
+
         inline bool isInjected() const { return injectionState != NULL; }
 
         void release();
@@ -501,6 +553,10 @@ private:
         virtual void appendDescription(String8& msg) const;
         void recycle();
 
+        static void* operator new(size_t size) { return sPool.allocate(size); }
+        static void operator delete(void* entry) { sPool.free(entry); }
+        static EntryPool sPool;
+
     protected:
         virtual ~KeyEntry();
     };
@@ -533,6 +589,11 @@ private:
                 float xOffset, float yOffset);
         virtual void appendDescription(String8& msg) const;
 
+        // the pointer data is inline, so pooling the entry covers it too
+        static void* operator new(size_t size) { return sPool.allocate(size); }
+        static void operator delete(void* entry) { sPool.free(entry); }
+        static EntryPool sPool;
+
     protected:
         virtual ~MotionEntry();
     };
@@ -564,6 +625,10 @@ private:
             return targetFlags & InputTarget::FLAG_SPLIT;
         }
 
+        static void* operator new(size_t size) { return sPool.allocate(size); }
+        static void operator delete(void* entry) { sPool.free(entry); }
+        static EntryPool sPool;
+
     private:
         static volatile int32_t sNextSeqAtomic;
 
@@ -796,6 +861,42 @@ private:
                 const CancelationOptions& options);
     };
 
+    /* Histograms of where the events a connection finished spent their time. */
+    class LatencyStats {
+    public:
+        LatencyStats();
+
+        void addEvent(const EventEntry* entry, nsecs_t deliveryTime, nsecs_t finishTime);
+        void dump(String8& dump) const;
+
+    private:
+        enum Stage {
+            STAGE_READ,     // event time to InputReader read
+            STAGE_MAP,      // read to the inbound queue, through the mappers
+            STAGE_INBOUND,  // waiting in the inbound queue
+            STAGE_DELIVER,  // dispatch to publish, including waiting for the window
+            STAGE_CONSUME,  // publish to the finished signal from the application
+            STAGE_TOTAL,    // event time to the finished signal
+            STAGE_COUNT
+        };
+
+        // Bucket 0 is below 0.5ms, each next one is twice as wide, and the last one
+        // has everything from 512ms on.
+        enum { BUCKET_COUNT = 12 };
+
+        struct Histogram {
+            uint32_t buckets[BUCKET_COUNT];
+            uint32_t count;
+            nsecs_t total;
+            nsecs_t max;
+        };
+
+        Histogram mHistograms[STAGE_COUNT];
+
+        void add(Stage stage, nsecs_t start, nsecs_t end);
+        static nsecs_t getPercentile(const Histogram& histogram, uint32_t percent);
+    };
+
     /* Manages the dispatch state associated with a single input channel. */
     class Connection : public RefBase {
     protected:
@@ -829,6 +930,9 @@ private:
         // yet received a "finished" response from the application.
         Queue<DispatchEntry> waitQueue;
 
+        // Where the finished events spent their time.
+        LatencyStats latencyStats;
+
         explicit Connection(const sp<InputChannel>& inputChannel,
                 const sp<InputWindowHandle>& inputWindowHandle, bool monitor);
 
@@ -854,6 +958,10 @@ private:
 
     Mutex mLock;
 
+    // Serializes setInputWindows() and setFocusedApplication(), which update the handle
+    // information outside of mLock. Acquired before mLock.
+    Mutex mWindowUpdateLock;
+
     Condition mDispatcherIsAliveCondition;
 
     sp<Looper> mLooper;
@@ -906,6 +1014,8 @@ private:
     Condition mInjectionResultAvailableCondition;
     bool hasInjectionPermission(int32_t injectorPid, int32_t injectorUid);
     void setInjectionResultLocked(EventEntry* entry, int32_t injectionResult);
+    int32_t waitForInjectionResultLocked(InjectionState* injectionState,
+            int32_t syncMode, nsecs_t endTime);
 
     Condition mInjectionSyncFinishedCondition;
     void incrementPendingForegroundDispatchesLocked(EventEntry* entry);
@@ -954,6 +1064,8 @@ private:
     bool mInputFilterEnabled;
 
     Vector<sp<InputWindowHandle> > mWindowHandles;
+    // mWindowHandles by where they take touches, rebuilt by setInputWindows
+    InputWindowIndex mWindowIndex;
 
     sp<InputWindowHandle> getWindowHandleLocked(const sp<InputChannel>& inputChannel) const;
     bool hasWindowHandleLocked(const sp<InputWindowHandle>& windowHandle) const;
@@ -1072,6 +1184,8 @@ private:
             EventEntry* eventEntry, const InputTarget* inputTarget);
     void enqueueDispatchEntryLocked(const sp<Connection>& connection,
             EventEntry* eventEntry, const InputTarget* inputTarget, int32_t dispatchMode);
+    bool coalesceMotionDispatchEntryLocked(const sp<Connection>& connection,
+            DispatchEntry* dispatchEntry);
     void startDispatchCycleLocked(nsecs_t currentTime, const sp<Connection>& connection);
     void finishDispatchCycleLocked(nsecs_t currentTime, const sp<Connection>& connection,
             uint32_t seq, bool handled);
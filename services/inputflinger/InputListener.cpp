@@ -48,7 +48,7 @@ NotifyKeyArgs::NotifyKeyArgs(nsecs_t eventTime, int32_t deviceId, uint32_t sourc
         int32_t metaState, nsecs_t downTime) :
         eventTime(eventTime), deviceId(deviceId), source(source), policyFlags(policyFlags),
         action(action), flags(flags), keyCode(keyCode), scanCode(scanCode),
-        metaState(metaState), downTime(downTime) {
+        metaState(metaState), downTime(downTime), readTime(0) {
 }
 
 NotifyKeyArgs::NotifyKeyArgs(const NotifyKeyArgs& other) :
@@ -56,7 +56,7 @@ NotifyKeyArgs::NotifyKeyArgs(const NotifyKeyArgs& other) :
         policyFlags(other.policyFlags),
         action(other.action), flags(other.flags),
         keyCode(other.keyCode), scanCode(other.scanCode),
-        metaState(other.metaState), downTime(other.downTime) {
+        metaState(other.metaState), downTime(other.downTime), readTime(other.readTime) {
 }
 
 void NotifyKeyArgs::notify(const sp<InputListenerInterface>& listener) const {
@@ -76,7 +76,7 @@ NotifyMotionArgs::NotifyMotionArgs(nsecs_t eventTime, int32_t deviceId, uint32_t
         action(action), actionButton(actionButton),
         flags(flags), metaState(metaState), buttonState(buttonState),
         edgeFlags(edgeFlags), displayId(displayId), pointerCount(pointerCount),
-        xPrecision(xPrecision), yPrecision(yPrecision), downTime(downTime) {
+        xPrecision(xPrecision), yPrecision(yPrecision), downTime(downTime), readTime(0) {
     for (uint32_t i = 0; i < pointerCount; i++) {
         this->pointerProperties[i].copyFrom(pointerProperties[i]);
         this->pointerCoords[i].copyFrom(pointerCoords[i]);
@@ -89,7 +89,8 @@ NotifyMotionArgs::NotifyMotionArgs(const NotifyMotionArgs& other) :
         action(other.action), actionButton(other.actionButton), flags(other.flags),
         metaState(other.metaState), buttonState(other.buttonState),
         edgeFlags(other.edgeFlags), displayId(other.displayId), pointerCount(other.pointerCount),
-        xPrecision(other.xPrecision), yPrecision(other.yPrecision), downTime(other.downTime) {
+        xPrecision(other.xPrecision), yPrecision(other.yPrecision), downTime(other.downTime),
+        readTime(other.readTime) {
     for (uint32_t i = 0; i < pointerCount; i++) {
         pointerProperties[i].copyFrom(other.pointerProperties[i]);
         pointerCoords[i].copyFrom(other.pointerCoords[i]);
@@ -137,7 +138,7 @@ void NotifyDeviceResetArgs::notify(const sp<InputListenerInterface>& listener) c
 // --- QueuedInputListener ---
 
 QueuedInputListener::QueuedInputListener(const sp<InputListenerInterface>& innerListener) :
-        mInnerListener(innerListener) {
+        mInnerListener(innerListener), mReadTime(0) {
 }
 
 QueuedInputListener::~QueuedInputListener() {
@@ -149,23 +150,70 @@ QueuedInputListener::~QueuedInputListener() {
 
 void QueuedInputListener::notifyConfigurationChanged(
         const NotifyConfigurationChangedArgs* args) {
-    mArgsQueue.push(new NotifyConfigurationChangedArgs(*args));
+    enqueue(new NotifyConfigurationChangedArgs(*args), args->eventTime);
 }
 
 void QueuedInputListener::notifyKey(const NotifyKeyArgs* args) {
-    mArgsQueue.push(new NotifyKeyArgs(*args));
+    NotifyKeyArgs* queuedArgs = new NotifyKeyArgs(*args);
+    if (!queuedArgs->readTime) {
+        queuedArgs->readTime = mReadTime;
+    }
+    enqueue(queuedArgs, args->eventTime);
 }
 
 void QueuedInputListener::notifyMotion(const NotifyMotionArgs* args) {
-    mArgsQueue.push(new NotifyMotionArgs(*args));
+    NotifyMotionArgs* queuedArgs = new NotifyMotionArgs(*args);
+    if (!queuedArgs->readTime) {
+        queuedArgs->readTime = mReadTime;
+    }
+    enqueue(queuedArgs, args->eventTime);
 }
 
 void QueuedInputListener::notifySwitch(const NotifySwitchArgs* args) {
-    mArgsQueue.push(new NotifySwitchArgs(*args));
+    enqueue(new NotifySwitchArgs(*args), args->eventTime);
 }
 
 void QueuedInputListener::notifyDeviceReset(const NotifyDeviceResetArgs* args) {
-    mArgsQueue.push(new NotifyDeviceResetArgs(*args));
+    enqueue(new NotifyDeviceResetArgs(*args), args->eventTime);
+}
+
+void QueuedInputListener::setReadTime(nsecs_t readTime) {
+    mReadTime = readTime;
+}
+
+void QueuedInputListener::enqueue(NotifyArgs* args, nsecs_t eventTime) {
+    mArgsQueue.push(args);
+    mEventTimes.push(eventTime);
+}
+
+void QueuedInputListener::clearQueue() {
+    mArgsQueue.clear();
+    mEventTimes.clear();
+}
+
+void QueuedInputListener::merge(const sp<QueuedInputListener>* listeners, size_t count) {
+    Vector<size_t> positions;
+    positions.insertAt(0, 0, count);
+    for (;;) {
+        ssize_t next = -1;
+        for (size_t i = 0; i < count; i++) {
+            const QueuedInputListener* listener = listeners[i].get();
+            if (positions[i] < listener->mArgsQueue.size() && (next < 0
+                    || listener->mEventTimes[positions[i]]
+                            < listeners[next]->mEventTimes[positions[next]])) {
+                next = i;
+            }
+        }
+        if (next < 0) {
+            break;
+        }
+        const QueuedInputListener* listener = listeners[next].get();
+        enqueue(listener->mArgsQueue[positions[next]], listener->mEventTimes[positions[next]]);
+        positions.editItemAt(next) += 1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        listeners[i]->clearQueue();
+    }
 }
 
 void QueuedInputListener::flush() {
@@ -175,7 +223,7 @@ void QueuedInputListener::flush() {
         args->notify(mInnerListener);
         delete args;
     }
-    mArgsQueue.clear();
+    clearQueue();
 }
 
 
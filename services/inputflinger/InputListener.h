@@ -62,8 +62,9 @@ struct NotifyKeyArgs : public NotifyArgs {
     int32_t scanCode;
     int32_t metaState;
     nsecs_t downTime;
+    nsecs_t readTime; // when the reader got the raw events, or 0 if unknown
 
-    inline NotifyKeyArgs() { }
+    inline NotifyKeyArgs() : readTime(0) { }
 
     NotifyKeyArgs(nsecs_t eventTime, int32_t deviceId, uint32_t source, uint32_t policyFlags,
             int32_t action, int32_t flags, int32_t keyCode, int32_t scanCode,
@@ -96,8 +97,9 @@ struct NotifyMotionArgs : public NotifyArgs {
     float xPrecision;
     float yPrecision;
     nsecs_t downTime;
+    nsecs_t readTime; // when the reader got the raw events, or 0 if unknown
 
-    inline NotifyMotionArgs() { }
+    inline NotifyMotionArgs() : readTime(0) { }
 
     NotifyMotionArgs(nsecs_t eventTime, int32_t deviceId, uint32_t source, uint32_t policyFlags,
             int32_t action, int32_t actionButton, int32_t flags,
@@ -186,11 +188,25 @@ public:
     virtual void notifySwitch(const NotifySwitchArgs* args);
     virtual void notifyDeviceReset(const NotifyDeviceResetArgs* args);
 
+    // Sets the read time stamped on key and motion args queued from now on.
+    void setReadTime(nsecs_t readTime);
+    inline nsecs_t getReadTime() const { return mReadTime; }
+
+    // Moves the args queued on each of the listeners onto the end of this queue in
+    // event time order. The order within each listener is preserved and ties go to
+    // the earlier listener.
+    void merge(const sp<QueuedInputListener>* listeners, size_t count);
+
     void flush();
 
 private:
     sp<InputListenerInterface> mInnerListener;
     Vector<NotifyArgs*> mArgsQueue;
+    Vector<nsecs_t> mEventTimes; // parallel to mArgsQueue
+    nsecs_t mReadTime;
+
+    void enqueue(NotifyArgs* args, nsecs_t eventTime);
+    void clearQueue();
 };
 
 } // namespace android
@@ -195,7 +195,7 @@ static float calculateCommonVector(float a, float b) {
     }
 }
 
-static void synthesizeButtonKey(InputReaderContext* context, int32_t action,
+static void synthesizeButtonKey(InputDevice* device, int32_t action,
         nsecs_t when, int32_t deviceId, uint32_t source,
         uint32_t policyFlags, int32_t lastButtonState, int32_t currentButtonState,
         int32_t buttonState, int32_t keyCode) {
@@ -207,18 +207,18 @@ static void synthesizeButtonKey(InputReaderContext* context, int32_t action,
                     && (lastButtonState & buttonState)
                     && !(currentButtonState & buttonState))) {
         NotifyKeyArgs args(when, deviceId, source, policyFlags,
-                action, 0, keyCode, 0, context->getGlobalMetaState(), when);
-        context->getListener()->notifyKey(&args);
+                action, 0, keyCode, 0, device->getContext()->getGlobalMetaState(), when);
+        device->getListener()->notifyKey(&args);
     }
 }
 
-static void synthesizeButtonKeys(InputReaderContext* context, int32_t action,
+static void synthesizeButtonKeys(InputDevice* device, int32_t action,
         nsecs_t when, int32_t deviceId, uint32_t source,
         uint32_t policyFlags, int32_t lastButtonState, int32_t currentButtonState) {
-    synthesizeButtonKey(context, action, when, deviceId, source, policyFlags,
+    synthesizeButtonKey(device, action, when, deviceId, source, policyFlags,
             lastButtonState, currentButtonState,
             AMOTION_EVENT_BUTTON_BACK, AKEYCODE_BACK);
-    synthesizeButtonKey(context, action, when, deviceId, source, policyFlags,
+    synthesizeButtonKey(device, action, when, deviceId, source, policyFlags,
             lastButtonState, currentButtonState,
             AMOTION_EVENT_BUTTON_FORWARD, AKEYCODE_FORWARD);
 }
@@ -272,6 +272,10 @@ InputReader::InputReader(const sp<EventHubInterface>& eventHub,
 }
 
 InputReader::~InputReader() {
+    for (size_t i = 0; i < mDeviceWorkers.size(); i++) {
+        mDeviceWorkers[i]->stop();
+    }
+
     for (size_t i = 0; i < mDevices.size(); i++) {
         delete mDevices.valueAt(i);
     }
@@ -301,6 +305,10 @@ void InputReader::loopOnce() {
 
     size_t count = mEventHub->getEvents(timeoutMillis, mEventBuffer, EVENT_BUFFER_SIZE);
 
+    // Stamp the events mapped from this batch with when we got it, for latency tracing.
+    // Events synthesized on timeouts have no read time.
+    mQueuedListener->setReadTime(count ? systemTime(SYSTEM_TIME_MONOTONIC) : 0);
+
     { // acquire lock
         AutoMutex _l(mLock);
         mReaderIsAliveCondition.broadcast();
@@ -341,23 +349,65 @@ void InputReader::loopOnce() {
     mQueuedListener->flush();
 }
 
+// Returns the number of events at the start of rawEvents that belong to the same device.
+static size_t getDeviceBatchSize(const RawEvent* rawEvents, size_t count) {
+    size_t batchSize = 1;
+    while (batchSize < count) {
+        if (rawEvents[batchSize].type >= EventHubInterface::FIRST_SYNTHETIC_EVENT
+                || rawEvents[batchSize].deviceId != rawEvents->deviceId) {
+            break;
+        }
+        batchSize += 1;
+    }
+    return batchSize;
+}
+
 void InputReader::processEventsLocked(const RawEvent* rawEvents, size_t count) {
     for (const RawEvent* rawEvent = rawEvents; count;) {
         int32_t type = rawEvent->type;
         size_t batchSize = 1;
         if (type < EventHubInterface::FIRST_SYNTHETIC_EVENT) {
             int32_t deviceId = rawEvent->deviceId;
-            while (batchSize < count) {
-                if (rawEvent[batchSize].type >= EventHubInterface::FIRST_SYNTHETIC_EVENT
-                        || rawEvent[batchSize].deviceId != deviceId) {
-                    break;
-                }
-                batchSize += 1;
-            }
+            batchSize = getDeviceBatchSize(rawEvent, count);
 #if DEBUG_RAW_EVENTS
             ALOGD("BatchSize: %d Count: %d", batchSize, count);
 #endif
-            processEventsForDeviceLocked(deviceId, rawEvent, batchSize);
+
+            // Batches that follow each other for distinct devices that only touch their
+            // own state are mapped at the same time.
+            const RawEvent* batches[MAX_CONCURRENT_DEVICES];
+            size_t batchSizes[MAX_CONCURRENT_DEVICES];
+            size_t batchCount = 0;
+            size_t concurrentCount = 0;
+            while (batchCount < MAX_CONCURRENT_DEVICES && concurrentCount < count) {
+                const RawEvent* batch = rawEvent + concurrentCount;
+                if (batch->type >= EventHubInterface::FIRST_SYNTHETIC_EVENT) {
+                    break;
+                }
+                ssize_t deviceIndex = mDevices.indexOfKey(batch->deviceId);
+                if (deviceIndex < 0 || mDevices.valueAt(deviceIndex)->isIgnored()
+                        || !mDevices.valueAt(deviceIndex)->canProcessConcurrently()) {
+                    break;
+                }
+                bool seen = false;
+                for (size_t i = 0; i < batchCount; i++) {
+                    seen |= batches[i]->deviceId == batch->deviceId;
+                }
+                if (seen) {
+                    break;
+                }
+                batches[batchCount] = batch;
+                batchSizes[batchCount] = getDeviceBatchSize(batch, count - concurrentCount);
+                concurrentCount += batchSizes[batchCount];
+                batchCount += 1;
+            }
+
+            if (batchCount > 1) {
+                processEventsConcurrentlyLocked(batches, batchSizes, batchCount);
+                batchSize = concurrentCount;
+            } else {
+                processEventsForDeviceLocked(deviceId, rawEvent, batchSize);
+            }
         } else {
             switch (rawEvent->type) {
             case EventHubInterface::DEVICE_ADDED:
@@ -366,6 +416,9 @@ void InputReader::processEventsLocked(const RawEvent* rawEvents, size_t count) {
             case EventHubInterface::DEVICE_REMOVED:
                 removeDeviceLocked(rawEvent->when, rawEvent->deviceId);
                 break;
+            case EventHubInterface::DEVICE_RELOADED:
+                reloadDeviceLocked(rawEvent->when, rawEvent->deviceId);
+                break;
             case EventHubInterface::FINISHED_DEVICE_SCAN:
                 handleConfigurationChangedLocked(rawEvent->when);
                 break;
@@ -379,6 +432,51 @@ void InputReader::processEventsLocked(const RawEvent* rawEvents, size_t count) {
     }
 }
 
+void InputReader::processEventsConcurrentlyLocked(const RawEvent* const* batches,
+        const size_t* batchSizes, size_t batchCount) {
+    // Each device queues its args separately, then they are merged back in event time
+    // order so the dispatcher sees the same stream as if the devices ran one by one.
+    InputDevice* devices[MAX_CONCURRENT_DEVICES];
+    for (size_t i = 0; i < batchCount; i++) {
+        if (mDeviceListeners[i] == NULL) {
+            mDeviceListeners[i] = new QueuedInputListener(NULL);
+        }
+        mDeviceListeners[i]->setReadTime(mQueuedListener->getReadTime());
+        devices[i] = mDevices.valueFor(batches[i]->deviceId);
+        devices[i]->setListener(mDeviceListeners[i].get());
+    }
+
+    while (mDeviceWorkers.size() < batchCount - 1) {
+        sp<DeviceWorker> worker = new DeviceWorker();
+        status_t result = worker->run("InputReaderWorker",
+                PRIORITY_URGENT_DISPLAY + PRIORITY_MORE_FAVORABLE);
+        if (result) {
+            ALOGE("Could not start InputReader worker thread due to error %d.", result);
+            break;
+        }
+        mDeviceWorkers.push(worker);
+    }
+
+    // Without enough workers, the reader thread picks up the remaining devices itself.
+    size_t workerCount = mDeviceWorkers.size() < batchCount - 1
+            ? mDeviceWorkers.size() : batchCount - 1;
+    for (size_t i = 0; i < workerCount; i++) {
+        mDeviceWorkers[i]->process(devices[i + 1], batches[i + 1], batchSizes[i + 1]);
+    }
+    devices[0]->process(batches[0], batchSizes[0]);
+    for (size_t i = workerCount + 1; i < batchCount; i++) {
+        devices[i]->process(batches[i], batchSizes[i]);
+    }
+    for (size_t i = 0; i < workerCount; i++) {
+        mDeviceWorkers[i]->waitUntilIdle();
+    }
+
+    for (size_t i = 0; i < batchCount; i++) {
+        devices[i]->setListener(NULL);
+    }
+    mQueuedListener->merge(mDeviceListeners, batchCount);
+}
+
 void InputReader::addDeviceLocked(nsecs_t when, int32_t deviceId) {
     ssize_t deviceIndex = mDevices.indexOfKey(deviceId);
     if (deviceIndex >= 0) {
@@ -438,6 +536,35 @@ void InputReader::removeDeviceLocked(nsecs_t when, int32_t deviceId) {
     delete device;
 }
 
+void InputReader::reloadDeviceLocked(nsecs_t when, int32_t deviceId) {
+    ssize_t deviceIndex = mDevices.indexOfKey(deviceId);
+    if (deviceIndex < 0) {
+        ALOGW("Ignoring spurious device reloaded event for deviceId %d.", deviceId);
+        return;
+    }
+
+    // The classes of the device are unchanged, so it gets the same mappers, but they are
+    // created again rather than reconfigured: some only read the configuration and key
+    // maps when they are first configured.
+    InputDevice* oldDevice = mDevices.valueAt(deviceIndex);
+    oldDevice->reset(when);
+
+    InputDeviceIdentifier identifier = mEventHub->getDeviceIdentifier(deviceId);
+    uint32_t classes = mEventHub->getDeviceClasses(deviceId);
+    int32_t controllerNumber = mEventHub->getDeviceControllerNumber(deviceId);
+
+    InputDevice* device = createDeviceLocked(deviceId, controllerNumber, identifier, classes);
+    device->configure(when, &mConfig, 0);
+    device->reset(when);
+
+    ALOGI("Device reloaded: id=%d, name='%s', sources=0x%08x", deviceId,
+            identifier.name.string(), device->getSources());
+
+    mDevices.replaceValueAt(deviceIndex, device);
+    bumpGenerationLocked();
+    delete oldDevice;
+}
+
 InputDevice* InputReader::createDeviceLocked(int32_t deviceId, int32_t controllerNumber,
         const InputDeviceIdentifier& identifier, uint32_t classes) {
     InputDevice* device = new InputDevice(&mContext, deviceId, bumpGenerationLocked(),
@@ -871,38 +998,45 @@ InputReader::ContextImpl::ContextImpl(InputReader* reader) :
 }
 
 void InputReader::ContextImpl::updateGlobalMetaState() {
-    // lock is already held by the input loop
+    // lock is already held by the input loop, mContextLock serializes the device workers
+    AutoMutex _l(mContextLock);
     mReader->updateGlobalMetaStateLocked();
 }
 
 int32_t InputReader::ContextImpl::getGlobalMetaState() {
-    // lock is already held by the input loop
+    // lock is already held by the input loop, mContextLock serializes the device workers
+    AutoMutex _l(mContextLock);
     return mReader->getGlobalMetaStateLocked();
 }
 
 void InputReader::ContextImpl::disableVirtualKeysUntil(nsecs_t time) {
-    // lock is already held by the input loop
+    // lock is already held by the input loop, mContextLock serializes the device workers
+    AutoMutex _l(mContextLock);
     mReader->disableVirtualKeysUntilLocked(time);
 }
 
 bool InputReader::ContextImpl::shouldDropVirtualKey(nsecs_t now,
         InputDevice* device, int32_t keyCode, int32_t scanCode) {
-    // lock is already held by the input loop
+    // lock is already held by the input loop, mContextLock serializes the device workers
+    AutoMutex _l(mContextLock);
     return mReader->shouldDropVirtualKeyLocked(now, device, keyCode, scanCode);
 }
 
 void InputReader::ContextImpl::fadePointer() {
-    // lock is already held by the input loop
+    // lock is already held by the input loop, mContextLock serializes the device workers
+    AutoMutex _l(mContextLock);
     mReader->fadePointerLocked();
 }
 
 void InputReader::ContextImpl::requestTimeoutAtTime(nsecs_t when) {
-    // lock is already held by the input loop
+    // lock is already held by the input loop, mContextLock serializes the device workers
+    AutoMutex _l(mContextLock);
     mReader->requestTimeoutAtTimeLocked(when);
 }
 
 int32_t InputReader::ContextImpl::bumpGeneration() {
-    // lock is already held by the input loop
+    // lock is already held by the input loop, mContextLock serializes the device workers
+    AutoMutex _l(mContextLock);
     return mReader->bumpGenerationLocked();
 }
 
@@ -943,13 +1077,76 @@ bool InputReaderThread::threadLoop() {
 }
 
 
+// --- InputReader::DeviceWorker ---
+
+InputReader::DeviceWorker::DeviceWorker() :
+        Thread(/*canCallJava*/ false), mDevice(NULL), mRawEvents(NULL), mCount(0) {
+}
+
+InputReader::DeviceWorker::~DeviceWorker() {
+}
+
+void InputReader::DeviceWorker::process(InputDevice* device,
+        const RawEvent* rawEvents, size_t count) {
+    AutoMutex _l(mLock);
+    mDevice = device;
+    mRawEvents = rawEvents;
+    mCount = count;
+    mCondition.broadcast();
+}
+
+void InputReader::DeviceWorker::waitUntilIdle() {
+    AutoMutex _l(mLock);
+    while (mDevice) {
+        mCondition.wait(mLock);
+    }
+}
+
+void InputReader::DeviceWorker::stop() {
+    requestExit();
+    { // acquire lock
+        AutoMutex _l(mLock);
+        mCondition.broadcast();
+    } // release lock
+    join();
+}
+
+bool InputReader::DeviceWorker::threadLoop() {
+    InputDevice* device;
+    const RawEvent* rawEvents;
+    size_t count;
+    { // acquire lock
+        AutoMutex _l(mLock);
+        while (!mDevice) {
+            if (exitPending()) {
+                return false;
+            }
+            mCondition.wait(mLock);
+        }
+        device = mDevice;
+        rawEvents = mRawEvents;
+        count = mCount;
+    } // release lock
+
+    device->process(rawEvents, count);
+
+    { // acquire lock
+        AutoMutex _l(mLock);
+        mDevice = NULL;
+        mCondition.broadcast();
+    } // release lock
+    return true;
+}
+
+
 // --- InputDevice ---
 
 InputDevice::InputDevice(InputReaderContext* context, int32_t id, int32_t generation,
         int32_t controllerNumber, const InputDeviceIdentifier& identifier, uint32_t classes) :
         mContext(context), mId(id), mGeneration(generation), mControllerNumber(controllerNumber),
         mIdentifier(identifier), mClasses(classes),
-        mSources(0), mIsExternal(false), mHasMic(false), mDropUntilNextSync(false) {
+        mSources(0), mIsExternal(false), mHasMic(false), mDropUntilNextSync(false),
+        mCanProcessConcurrently(false), mListener(NULL) {
 }
 
 InputDevice::~InputDevice() {
@@ -1038,6 +1235,15 @@ void InputDevice::configure(nsecs_t when, const InputReaderConfiguration* config
             mSources |= mapper->getSources();
         }
     }
+
+    // Mappers may change their minds when reconfigured, e.g. a touch screen that gets
+    // an external stylus, so ask again each time.
+    mCanProcessConcurrently = !isIgnored();
+    for (size_t i = 0; i < mMappers.size(); i++) {
+        if (!mMappers[i]->canProcessConcurrently()) {
+            mCanProcessConcurrently = false;
+        }
+    }
 }
 
 void InputDevice::reset(nsecs_t when) {
@@ -1216,7 +1422,7 @@ void InputDevice::bumpGeneration() {
 
 void InputDevice::notifyReset(nsecs_t when) {
     NotifyDeviceResetArgs args(when, mId);
-    mContext->getListener()->notifyDeviceReset(&args);
+    getListener()->notifyDeviceReset(&args);
 }
 
 
@@ -1920,6 +2126,10 @@ void InputMapper::updateExternalStylusState(const StylusState& state) {
 void InputMapper::fadePointer() {
 }
 
+bool InputMapper::canProcessConcurrently() {
+    return false;
+}
+
 status_t InputMapper::getAbsoluteAxisInfo(int32_t axis, RawAbsoluteAxisInfo* axisInfo) {
     return getEventHub()->getAbsoluteAxisInfo(getDeviceId(), axis, axisInfo);
 }
@@ -2676,7 +2886,7 @@ void CursorInputMapper::sync(nsecs_t when) {
     }
 
     // Synthesize key down from buttons if needed.
-    synthesizeButtonKeys(getContext(), AKEY_EVENT_ACTION_DOWN, when, getDeviceId(), mSource,
+    synthesizeButtonKeys(getDevice(), AKEY_EVENT_ACTION_DOWN, when, getDeviceId(), mSource,
             policyFlags, lastButtonState, currentButtonState);
 
     // Send motion event.
@@ -2755,7 +2965,7 @@ void CursorInputMapper::sync(nsecs_t when) {
     }
 
     // Synthesize key up from buttons if needed.
-    synthesizeButtonKeys(getContext(), AKEY_EVENT_ACTION_UP, when, getDeviceId(), mSource,
+    synthesizeButtonKeys(getDevice(), AKEY_EVENT_ACTION_UP, when, getDeviceId(), mSource,
             policyFlags, lastButtonState, currentButtonState);
 
     mCursorMotionAccumulator.finishSync();
@@ -4195,7 +4405,7 @@ void TouchInputMapper::cookAndDispatch(nsecs_t when) {
     applyExternalStylusTouchState(when);
 
     // Synthesize key down from raw buttons if needed.
-    synthesizeButtonKeys(getContext(), AKEY_EVENT_ACTION_DOWN, when, getDeviceId(), mSource,
+    synthesizeButtonKeys(getDevice(), AKEY_EVENT_ACTION_DOWN, when, getDeviceId(), mSource,
             policyFlags, mLastCookedState.buttonState, mCurrentCookedState.buttonState);
 
     // Dispatch the touches either directly or by translation through a pointer on screen.
@@ -4267,7 +4477,7 @@ void TouchInputMapper::cookAndDispatch(nsecs_t when) {
     }
 
     // Synthesize key up from raw buttons if needed.
-    synthesizeButtonKeys(getContext(), AKEY_EVENT_ACTION_UP, when, getDeviceId(), mSource,
+    synthesizeButtonKeys(getDevice(), AKEY_EVENT_ACTION_UP, when, getDeviceId(), mSource,
             policyFlags, mLastCookedState.buttonState, mCurrentCookedState.buttonState);
 
     // Clear some transient state.
@@ -4374,6 +4584,12 @@ void TouchInputMapper::updateExternalStylusState(const StylusState& state) {
     }
 }
 
+bool TouchInputMapper::canProcessConcurrently() {
+    // Pointer gestures share the pointer controller with the cursors and stylus fusion
+    // waits on state dispatched from another device, so only plain touches qualify.
+    return mDeviceMode == DEVICE_MODE_DIRECT && !mExternalStylusConnected;
+}
+
 bool TouchInputMapper::consumeRawTouches(nsecs_t when, uint32_t policyFlags) {
     // Check for release of a virtual key.
     if (mCurrentVirtualKey.down) {
@@ -6303,7 +6519,7 @@ void TouchInputMapper::fadePointer() {
     }
 }
 
-nsecs_t TouchInputMapper::mLastStylusTime = 0;
+std::atomic<nsecs_t> TouchInputMapper::mLastStylusTime(0);
 
 bool TouchInputMapper::rejectPalm(nsecs_t when) {
     return (when - mLastStylusTime < mConfig.stylusPalmRejectionTime) &&
@@ -32,6 +32,7 @@
 #include <utils/String8.h>
 #include <utils/BitSet.h>
 
+#include <atomic>
 #include <stddef.h>
 #include <unistd.h>
 
@@ -144,7 +145,8 @@ struct InputReaderConfiguration {
         // The presence of an external stylus has changed.
         CHANGE_EXTERNAL_STYLUS_PRESENCE = 1 << 7,
 
-        // All devices must be reopened.
+        // The configuration files of all devices must be reloaded. Devices stay open,
+        // only those whose configuration changed are set up again.
         CHANGE_MUST_REOPEN = 1 << 31,
     };
 
@@ -488,6 +490,10 @@ protected:
     class ContextImpl : public InputReaderContext {
         InputReader* mReader;
 
+        // Held while touching reader state from a device worker, which runs while the
+        // reader thread holds mLock on behalf of all of them.
+        Mutex mContextLock;
+
     public:
         ContextImpl(InputReader* reader);
 
@@ -525,11 +531,42 @@ private:
 
     KeyedVector<int32_t, InputDevice*> mDevices;
 
+    /* Processes the events of one device on behalf of the reader thread. */
+    class DeviceWorker : public Thread {
+    public:
+        DeviceWorker();
+        virtual ~DeviceWorker();
+
+        // Starts processing the events, which must stay valid until waitUntilIdle().
+        void process(InputDevice* device, const RawEvent* rawEvents, size_t count);
+        void waitUntilIdle();
+        void stop();
+
+    private:
+        Mutex mLock;
+        Condition mCondition;
+        InputDevice* mDevice;
+        const RawEvent* mRawEvents;
+        size_t mCount;
+
+        virtual bool threadLoop();
+    };
+
+    // The most devices whose events are processed at once by one loop iteration,
+    // including the one processed by the reader thread itself.
+    enum { MAX_CONCURRENT_DEVICES = 4 };
+
+    Vector<sp<DeviceWorker> > mDeviceWorkers;
+    sp<QueuedInputListener> mDeviceListeners[MAX_CONCURRENT_DEVICES];
+
     // low-level input event decoding and device management
     void processEventsLocked(const RawEvent* rawEvents, size_t count);
+    void processEventsConcurrentlyLocked(const RawEvent* const* batches,
+            const size_t* batchSizes, size_t batchCount);
 
     void addDeviceLocked(nsecs_t when, int32_t deviceId);
     void removeDeviceLocked(nsecs_t when, int32_t deviceId);
+    void reloadDeviceLocked(nsecs_t when, int32_t deviceId);
     void processEventsForDeviceLocked(int32_t deviceId, const RawEvent* rawEvents, size_t count);
     void timeoutExpiredLocked(nsecs_t when);
 
@@ -607,6 +644,17 @@ public:
 
     inline bool isIgnored() { return mMappers.isEmpty(); }
 
+    // True when every mapper only touches per-device state while processing events,
+    // so the device can be processed alongside other such devices.
+    inline bool canProcessConcurrently() const { return mCanProcessConcurrently; }
+
+    // Redirects the args notified by the mappers, or restores the reader's listener
+    // when NULL.
+    inline void setListener(InputListenerInterface* listener) { mListener = listener; }
+    inline InputListenerInterface* getListener() {
+        return mListener ? mListener : mContext->getListener();
+    }
+
     void dump(String8& dump);
     void addMapper(InputMapper* mapper);
     void configure(nsecs_t when, const InputReaderConfiguration* config, uint32_t changes);
@@ -672,6 +720,8 @@ private:
     bool mIsExternal;
     bool mHasMic;
     bool mDropUntilNextSync;
+    bool mCanProcessConcurrently;
+    InputListenerInterface* mListener;
 
     typedef int32_t (InputMapper::*GetStateFunc)(uint32_t sourceMask, int32_t code);
     int32_t getState(uint32_t sourceMask, int32_t code, GetStateFunc getStateFunc);
@@ -1020,7 +1070,7 @@ public:
     inline const String8 getDeviceName() { return mDevice->getName(); }
     inline InputReaderContext* getContext() { return mContext; }
     inline InputReaderPolicyInterface* getPolicy() { return mContext->getPolicy(); }
-    inline InputListenerInterface* getListener() { return mContext->getListener(); }
+    inline InputListenerInterface* getListener() { return mDevice->getListener(); }
     inline EventHubInterface* getEventHub() { return mContext->getEventHub(); }
 
     virtual uint32_t getSources() = 0;
@@ -1048,6 +1098,11 @@ public:
 
     virtual void fadePointer();
 
+    // Returns true if process() only touches the state of this mapper, its device and
+    // the internally locked event hub and pointer controller, so that it may run on a
+    // worker thread. Mappers that share state through the reader context must not.
+    virtual bool canProcessConcurrently();
+
 protected:
     InputDevice* mDevice;
     InputReaderContext* mContext;
@@ -1288,6 +1343,7 @@ public:
     virtual void cancelTouch(nsecs_t when);
     virtual void timeoutExpired(nsecs_t when);
     virtual void updateExternalStylusState(const StylusState& state);
+    virtual bool canProcessConcurrently();
 
 protected:
     CursorButtonAccumulator mCursorButtonAccumulator;
@@ -1823,8 +1879,9 @@ private:
     VelocityControl mWheelXVelocityControl;
     VelocityControl mWheelYVelocityControl;
     
-    // The time the stylus event was processed by any TouchInputMapper
-    static nsecs_t mLastStylusTime;
+    // The time the stylus event was processed by any TouchInputMapper, which may be
+    // on different device workers
+    static std::atomic<nsecs_t> mLastStylusTime;
 
     void resetExternalStylus();
     void clearStylusDataPendingFlags();
@@ -0,0 +1,383 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "InputRecording"
+
+//#define LOG_NDEBUG 0
+
+#include "InputRecording.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <utils/Log.h>
+
+namespace android {
+
+static const uint32_t RECORDING_MAGIC = 0x43455249; // "IREC"
+static const uint32_t RECORDING_VERSION = 1;
+
+// Flush the write buffer once it holds this many bytes.
+static const size_t WRITE_BUFFER_SIZE = 16 * 1024;
+
+// Event ages that do not fit are clamped, only a stalled reader produces them.
+static int32_t toAgeMicros(nsecs_t readTime, nsecs_t when) {
+    nsecs_t age = ns2us(readTime - when);
+    if (age > INT32_MAX) {
+        return INT32_MAX;
+    }
+    if (age < INT32_MIN) {
+        return INT32_MIN;
+    }
+    return int32_t(age);
+}
+
+// --- InputRecord ---
+
+void InputRecord::clear() {
+    deviceId = 0;
+    classes = 0;
+    identifier = InputDeviceIdentifier();
+    properties.clear();
+    scanCodes.clear();
+    relativeAxes.clear();
+    absoluteAxes.clear();
+    readTime = 0;
+    events.clear();
+}
+
+// --- InputRecordingWriter ---
+
+InputRecordingWriter::InputRecordingWriter(int fd) :
+        mFd(fd) {
+}
+
+InputRecordingWriter::~InputRecordingWriter() {
+    flush();
+    ::close(mFd);
+}
+
+status_t InputRecordingWriter::open(const char* path, InputRecordingWriter** outWriter) {
+    *outWriter = NULL;
+
+    int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        status_t result = -errno;
+        ALOGE("Error opening input recording '%s': %s", path, strerror(errno));
+        return result;
+    }
+
+    InputRecordingWriter* writer = new InputRecordingWriter(fd);
+    writer->appendValue(RECORDING_MAGIC);
+    writer->appendValue(RECORDING_VERSION);
+    status_t result = writer->flush();
+    if (result) {
+        delete writer;
+        return result;
+    }
+    *outWriter = writer;
+    return OK;
+}
+
+status_t InputRecordingWriter::write(const InputRecord& record) {
+    switch (record.type) {
+    case InputRecord::TYPE_DEVICE_ADDED:
+        appendValue(uint8_t(record.type));
+        appendValue(record.deviceId);
+        appendValue(record.classes);
+        appendString(record.identifier.name);
+        appendString(record.identifier.location);
+        appendString(record.identifier.uniqueId);
+        appendString(record.identifier.descriptor);
+        appendValue(record.identifier.bus);
+        appendValue(record.identifier.vendor);
+        appendValue(record.identifier.product);
+        appendValue(record.identifier.version);
+        appendCodes(record.properties);
+        appendCodes(record.scanCodes);
+        appendCodes(record.relativeAxes);
+        appendValue(uint32_t(record.absoluteAxes.size()));
+        for (size_t i = 0; i < record.absoluteAxes.size(); i++) {
+            const InputRecord::AbsoluteAxis& axis = record.absoluteAxes[i];
+            appendValue(axis.axis);
+            appendValue(axis.info.minValue);
+            appendValue(axis.info.maxValue);
+            appendValue(axis.info.flat);
+            appendValue(axis.info.fuzz);
+            appendValue(axis.info.resolution);
+        }
+        // Devices come and go rarely, make sure they are on disk before their events.
+        return flush();
+
+    case InputRecord::TYPE_DEVICE_REMOVED:
+        appendValue(uint8_t(record.type));
+        appendValue(record.deviceId);
+        return flush();
+
+    case InputRecord::TYPE_BATCH:
+        return writeBatch(record.readTime, record.events.array(), record.events.size());
+    }
+    return BAD_VALUE;
+}
+
+status_t InputRecordingWriter::writeBatch(nsecs_t readTime, const RawEvent* events,
+        size_t count) {
+    size_t recorded = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (events[i].type < EventHubInterface::FIRST_SYNTHETIC_EVENT) {
+            recorded += 1;
+        }
+    }
+    if (!recorded) {
+        return OK;
+    }
+
+    appendValue(uint8_t(InputRecord::TYPE_BATCH));
+    appendValue(int64_t(readTime));
+    appendValue(uint32_t(recorded));
+    for (size_t i = 0; i < count; i++) {
+        const RawEvent& event = events[i];
+        if (event.type >= EventHubInterface::FIRST_SYNTHETIC_EVENT) {
+            continue;
+        }
+        appendValue(toAgeMicros(readTime, event.when));
+        appendValue(uint16_t(event.deviceId));
+        appendValue(uint16_t(event.type));
+        appendValue(uint16_t(event.code));
+        appendValue(event.value);
+    }
+
+    if (mBuffer.size() >= WRITE_BUFFER_SIZE) {
+        return flush();
+    }
+    return OK;
+}
+
+void InputRecordingWriter::appendBytes(const void* data, size_t size) {
+    mBuffer.appendArray(static_cast<const uint8_t*>(data), size);
+}
+
+void InputRecordingWriter::appendString(const String8& string) {
+    appendValue(uint32_t(string.length()));
+    appendBytes(string.string(), string.length());
+}
+
+void InputRecordingWriter::appendCodes(const Vector<int32_t>& codes) {
+    appendValue(uint32_t(codes.size()));
+    appendBytes(codes.array(), codes.size() * sizeof(int32_t));
+}
+
+status_t InputRecordingWriter::flush() {
+    const uint8_t* data = mBuffer.array();
+    size_t remaining = mBuffer.size();
+    while (remaining) {
+        ssize_t nWrite = ::write(mFd, data, remaining);
+        if (nWrite < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            status_t result = -errno;
+            ALOGE("Error writing input recording: %s", strerror(errno));
+            mBuffer.clear();
+            return result;
+        }
+        data += nWrite;
+        remaining -= size_t(nWrite);
+    }
+    mBuffer.clear();
+    return OK;
+}
+
+// --- InputRecordingReader ---
+
+InputRecordingReader::InputRecordingReader(uint8_t* data, size_t size) :
+        mData(data), mSize(size), mPosition(0) {
+}
+
+InputRecordingReader::~InputRecordingReader() {
+    free(mData);
+}
+
+status_t InputRecordingReader::open(const char* path, InputRecordingReader** outReader) {
+    *outReader = NULL;
+
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        status_t result = -errno;
+        ALOGE("Error opening input recording '%s': %s", path, strerror(errno));
+        return result;
+    }
+
+    status_t result = OK;
+    struct stat stat;
+    uint8_t* data = NULL;
+    size_t size = 0;
+    if (fstat(fd, &stat)) {
+        result = -errno;
+        ALOGE("Error getting size of input recording '%s': %s", path, strerror(errno));
+    } else {
+        size = size_t(stat.st_size);
+        data = static_cast<uint8_t*>(malloc(size ? size : 1));
+        size_t offset = 0;
+        while (offset < size) {
+            ssize_t nRead = ::read(fd, data + offset, size - offset);
+            if (nRead < 0 && errno == EINTR) {
+                continue;
+            }
+            if (nRead <= 0) {
+                result = nRead < 0 ? -errno : BAD_VALUE;
+                ALOGE("Error reading input recording '%s'.", path);
+                break;
+            }
+            offset += size_t(nRead);
+        }
+    }
+    ::close(fd);
+    if (result) {
+        free(data);
+        return result;
+    }
+
+    InputRecordingReader* reader = new InputRecordingReader(data, size);
+    uint32_t magic, version;
+    if (!reader->readValue(&magic) || magic != RECORDING_MAGIC
+            || !reader->readValue(&version) || version != RECORDING_VERSION) {
+        ALOGE("Input recording '%s' has an unsupported format.", path);
+        delete reader;
+        return BAD_VALUE;
+    }
+    *outReader = reader;
+    return OK;
+}
+
+status_t InputRecordingReader::read(InputRecord* outRecord) {
+    outRecord->clear();
+    if (mPosition == mSize) {
+        return NAME_NOT_FOUND;
+    }
+
+    uint8_t type;
+    if (!readValue(&type)) {
+        return BAD_VALUE;
+    }
+    switch (type) {
+    case InputRecord::TYPE_DEVICE_ADDED: {
+        outRecord->type = InputRecord::TYPE_DEVICE_ADDED;
+        uint32_t axisCount;
+        if (!readValue(&outRecord->deviceId)
+                || !readValue(&outRecord->classes)
+                || !readString(&outRecord->identifier.name)
+                || !readString(&outRecord->identifier.location)
+                || !readString(&outRecord->identifier.uniqueId)
+                || !readString(&outRecord->identifier.descriptor)
+                || !readValue(&outRecord->identifier.bus)
+                || !readValue(&outRecord->identifier.vendor)
+                || !readValue(&outRecord->identifier.product)
+                || !readValue(&outRecord->identifier.version)
+                || !readCodes(&outRecord->properties)
+                || !readCodes(&outRecord->scanCodes)
+                || !readCodes(&outRecord->relativeAxes)
+                || !readValue(&axisCount)) {
+            return BAD_VALUE;
+        }
+        for (uint32_t i = 0; i < axisCount; i++) {
+            InputRecord::AbsoluteAxis axis;
+            axis.info.valid = true;
+            if (!readValue(&axis.axis)
+                    || !readValue(&axis.info.minValue)
+                    || !readValue(&axis.info.maxValue)
+                    || !readValue(&axis.info.flat)
+                    || !readValue(&axis.info.fuzz)
+                    || !readValue(&axis.info.resolution)) {
+                return BAD_VALUE;
+            }
+            outRecord->absoluteAxes.push(axis);
+        }
+        return OK;
+    }
+
+    case InputRecord::TYPE_DEVICE_REMOVED:
+        outRecord->type = InputRecord::TYPE_DEVICE_REMOVED;
+        return readValue(&outRecord->deviceId) ? OK : BAD_VALUE;
+
+    case InputRecord::TYPE_BATCH: {
+        outRecord->type = InputRecord::TYPE_BATCH;
+        int64_t readTime;
+        uint32_t count;
+        if (!readValue(&readTime) || !readValue(&count)) {
+            return BAD_VALUE;
+        }
+        outRecord->readTime = readTime;
+        outRecord->events.setCapacity(count);
+        for (uint32_t i = 0; i < count; i++) {
+            int32_t ageMicros, value;
+            uint16_t deviceId, eventType, code;
+            if (!readValue(&ageMicros) || !readValue(&deviceId) || !readValue(&eventType)
+                    || !readValue(&code) || !readValue(&value)) {
+                return BAD_VALUE;
+            }
+            RawEvent event;
+            event.when = readTime - us2ns(ageMicros);
+            event.deviceId = int16_t(deviceId);
+            event.type = eventType;
+            event.code = code;
+            event.value = value;
+            outRecord->events.push(event);
+        }
+        return OK;
+    }
+    }
+
+    ALOGE("Input recording has an unknown record type %d.", type);
+    return BAD_VALUE;
+}
+
+bool InputRecordingReader::readBytes(void* outData, size_t size) {
+    if (mSize - mPosition < size) {
+        ALOGE("Input recording is truncated.");
+        return false;
+    }
+    memcpy(outData, mData + mPosition, size);
+    mPosition += size;
+    return true;
+}
+
+bool InputRecordingReader::readString(String8* outString) {
+    uint32_t length;
+    if (!readValue(&length) || mSize - mPosition < length) {
+        return false;
+    }
+    outString->setTo(reinterpret_cast<const char*>(mData + mPosition), length);
+    mPosition += length;
+    return true;
+}
+
+bool InputRecordingReader::readCodes(Vector<int32_t>* outCodes) {
+    uint32_t count;
+    if (!readValue(&count) || (mSize - mPosition) / sizeof(int32_t) < count) {
+        return false;
+    }
+    outCodes->insertArrayAt(reinterpret_cast<const int32_t*>(mData + mPosition), 0, count);
+    mPosition += count * sizeof(int32_t);
+    return true;
+}
+
+} // namespace android
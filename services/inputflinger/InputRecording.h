@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _UI_INPUT_RECORDING_H
+#define _UI_INPUT_RECORDING_H
+
+#include "EventHub.h"
+
+#include <input/InputDevice.h>
+#include <utils/Errors.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+/*
+ * A recording of the raw events returned by EventHub::getEvents(), with enough about
+ * each device to feed them through the InputReader again.
+ *
+ * The file is a header followed by records:
+ *   "IREC", version (u32)
+ *   DEVICE_ADDED: id, classes, identifier, input properties, scan codes, relative axes
+ *                 and absolute axes
+ *   DEVICE_REMOVED: id
+ *   BATCH: read time, then for each event its age in microseconds relative to the
+ *          read time, device id, type, code and value (14 bytes per event)
+ * Values are in host byte order. Synthetic events are not recorded as part of batches,
+ * the device records stand in for them.
+ */
+struct InputRecord {
+    enum Type {
+        TYPE_DEVICE_ADDED = 1,
+        TYPE_DEVICE_REMOVED = 2,
+        TYPE_BATCH = 3,
+    };
+
+    struct AbsoluteAxis {
+        int32_t axis;
+        RawAbsoluteAxisInfo info;
+    };
+
+    Type type;
+
+    // TYPE_DEVICE_ADDED and TYPE_DEVICE_REMOVED
+    int32_t deviceId;
+    uint32_t classes;
+    InputDeviceIdentifier identifier;
+    Vector<int32_t> properties;
+    Vector<int32_t> scanCodes;
+    Vector<int32_t> relativeAxes;
+    Vector<AbsoluteAxis> absoluteAxes;
+
+    // TYPE_BATCH
+    nsecs_t readTime;
+    Vector<RawEvent> events;
+
+    void clear();
+};
+
+/* Appends records to a recording file. */
+class InputRecordingWriter {
+public:
+    ~InputRecordingWriter();
+
+    static status_t open(const char* path, InputRecordingWriter** outWriter);
+
+    status_t write(const InputRecord& record);
+
+    // Writes a batch without copying the events into a record first.
+    status_t writeBatch(nsecs_t readTime, const RawEvent* events, size_t count);
+
+private:
+    int mFd;
+    Vector<uint8_t> mBuffer;
+
+    InputRecordingWriter(int fd);
+
+    void appendBytes(const void* data, size_t size);
+    void appendString(const String8& string);
+    void appendCodes(const Vector<int32_t>& codes);
+    template<typename T> void appendValue(T value) {
+        appendBytes(&value, sizeof(T));
+    }
+    status_t flush();
+};
+
+/* Reads back the records of a recording file. */
+class InputRecordingReader {
+public:
+    ~InputRecordingReader();
+
+    static status_t open(const char* path, InputRecordingReader** outReader);
+
+    // Reads the next record. Returns NAME_NOT_FOUND at the end of the recording and
+    // BAD_VALUE if the file is corrupt.
+    status_t read(InputRecord* outRecord);
+
+private:
+    uint8_t* mData;
+    size_t mSize;
+    size_t mPosition;
+
+    InputRecordingReader(uint8_t* data, size_t size);
+
+    bool readBytes(void* outData, size_t size);
+    bool readString(String8* outString);
+    bool readCodes(Vector<int32_t>* outCodes);
+    template<typename T> bool readValue(T* outValue) {
+        return readBytes(outValue, sizeof(T));
+    }
+};
+
+} // namespace android
+
+#endif // _UI_INPUT_RECORDING_H
@@ -63,11 +63,23 @@ bool InputWindowInfo::overlaps(const InputWindowInfo* other) const {
 // --- InputWindowHandle ---
 
 InputWindowHandle::InputWindowHandle(const sp<InputApplicationHandle>& inputApplicationHandle) :
-    inputApplicationHandle(inputApplicationHandle), mInfo(NULL) {
+    inputApplicationHandle(inputApplicationHandle), mInfo(NULL), mPublishedInfo(NULL) {
 }
 
 InputWindowHandle::~InputWindowHandle() {
     delete mInfo;
+    delete mPublishedInfo;
+}
+
+void InputWindowHandle::publishInfo() {
+    if (!mInfo) {
+        delete mPublishedInfo;
+        mPublishedInfo = NULL;
+    } else if (!mPublishedInfo) {
+        mPublishedInfo = new InputWindowInfo(*mInfo);
+    } else {
+        *mPublishedInfo = *mInfo;
+    }
 }
 
 void InputWindowHandle::releaseInfo() {
@@ -75,6 +87,10 @@ void InputWindowHandle::releaseInfo() {
         delete mInfo;
         mInfo = NULL;
     }
+    if (mPublishedInfo) {
+        delete mPublishedInfo;
+        mPublishedInfo = NULL;
+    }
 }
 
 } // namespace android
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "InputWindowIndex"
+
+#include "InputWindowIndex.h"
+
+#include <ui/Region.h>
+
+#include <algorithm>
+
+namespace android {
+
+// --- InputWindowIndex ---
+
+InputWindowIndex::InputWindowIndex() {
+}
+
+bool InputWindowIndex::isTouchModal(const InputWindowInfo* windowInfo) {
+    return (windowInfo->layoutParamsFlags & (InputWindowInfo::FLAG_NOT_FOCUSABLE
+            | InputWindowInfo::FLAG_NOT_TOUCH_MODAL)) == 0;
+}
+
+// Offsets can span more than 2^31 when regions reach far off screen.
+static inline uint32_t cellOf(int32_t v, int32_t origin, uint32_t shift) {
+    return uint32_t(int64_t(v) - origin) >> shift;
+}
+
+static bool isTouchable(const InputWindowInfo* windowInfo) {
+    return windowInfo->visible
+            && !(windowInfo->layoutParamsFlags & InputWindowInfo::FLAG_NOT_TOUCHABLE);
+}
+
+void InputWindowIndex::clear() {
+    mDisplays.clear();
+}
+
+void InputWindowIndex::build(const Vector<sp<InputWindowHandle> >& windowHandles) {
+    mDisplays.clear();
+
+    // First find the area the windows that are not modal cover on each display.
+    size_t numWindows = windowHandles.size();
+    for (size_t i = 0; i < numWindows; i++) {
+        const InputWindowInfo* windowInfo = windowHandles.itemAt(i)->getInfo();
+        ssize_t index = mDisplays.indexOfKey(windowInfo->displayId);
+        if (index < 0) {
+            DisplayWindows display;
+            display.extent = Rect::EMPTY_RECT;
+            display.cellShift = MIN_CELL_SHIFT;
+            display.columns = 0;
+            index = mDisplays.add(windowInfo->displayId, display);
+        }
+        DisplayWindows& display = mDisplays.editValueAt(index);
+        if (!windowInfo->visible) {
+            continue;
+        }
+        if (windowInfo->layoutParamsFlags & InputWindowInfo::FLAG_WATCH_OUTSIDE_TOUCH) {
+            display.outsideTouchWatchers.push(i);
+        }
+        if (!isTouchable(windowInfo) || isTouchModal(windowInfo)) {
+            continue;
+        }
+        Rect bounds = windowInfo->touchableRegion.getBounds();
+        if (bounds.isEmpty()) {
+            continue;
+        }
+        if (display.extent.isEmpty()) {
+            display.extent = bounds;
+        } else {
+            display.extent.left = std::min(display.extent.left, bounds.left);
+            display.extent.top = std::min(display.extent.top, bounds.top);
+            display.extent.right = std::max(display.extent.right, bounds.right);
+            display.extent.bottom = std::max(display.extent.bottom, bounds.bottom);
+        }
+    }
+
+    // Then size the grids so that they have at most MAX_CELLS per side.
+    for (size_t d = 0; d < mDisplays.size(); d++) {
+        DisplayWindows& display = mDisplays.editValueAt(d);
+        if (display.extent.isEmpty()) {
+            continue;
+        }
+        uint32_t width = cellOf(display.extent.right, display.extent.left, 0);
+        uint32_t height = cellOf(display.extent.bottom, display.extent.top, 0);
+        while ((width >> display.cellShift) >= MAX_CELLS
+                || (height >> display.cellShift) >= MAX_CELLS) {
+            display.cellShift++;
+        }
+        display.columns = (width >> display.cellShift) + 1;
+        uint32_t rows = (height >> display.cellShift) + 1;
+        display.cells.insertAt(Vector<size_t>(), 0, display.columns * rows);
+    }
+
+    // And bin the windows, front to back.
+    for (size_t i = 0; i < numWindows; i++) {
+        const InputWindowInfo* windowInfo = windowHandles.itemAt(i)->getInfo();
+        if (!isTouchable(windowInfo)) {
+            continue;
+        }
+        DisplayWindows& display = mDisplays.editValueFor(windowInfo->displayId);
+        if (isTouchModal(windowInfo)) {
+            display.modalWindows.push(i);
+            for (size_t c = 0; c < display.cells.size(); c++) {
+                display.cells.editItemAt(c).push(i);
+            }
+            continue;
+        }
+        Rect bounds = windowInfo->touchableRegion.getBounds();
+        if (bounds.isEmpty()) {
+            continue;
+        }
+        const Rect& extent = display.extent;
+        uint32_t left = cellOf(bounds.left, extent.left, display.cellShift);
+        uint32_t top = cellOf(bounds.top, extent.top, display.cellShift);
+        uint32_t right = cellOf(bounds.right - 1, extent.left, display.cellShift);
+        uint32_t bottom = cellOf(bounds.bottom - 1, extent.top, display.cellShift);
+        for (uint32_t y = top; y <= bottom; y++) {
+            for (uint32_t x = left; x <= right; x++) {
+                display.cells.editItemAt(y * display.columns + x).push(i);
+            }
+        }
+    }
+}
+
+ssize_t InputWindowIndex::findTouchedWindow(
+        const Vector<sp<InputWindowHandle> >& windowHandles,
+        int32_t displayId, int32_t x, int32_t y) const {
+    ssize_t index = mDisplays.indexOfKey(displayId);
+    if (index < 0) {
+        return -1;
+    }
+    const DisplayWindows& display = mDisplays.valueAt(index);
+    const Rect& extent = display.extent;
+    if (x < extent.left || x >= extent.right || y < extent.top || y >= extent.bottom) {
+        // Only the modal windows take touches out there.
+        return display.modalWindows.isEmpty() ? -1 : ssize_t(display.modalWindows[0]);
+    }
+
+    uint32_t column = cellOf(x, extent.left, display.cellShift);
+    uint32_t row = cellOf(y, extent.top, display.cellShift);
+    const Vector<size_t>& cell = display.cells[row * display.columns + column];
+    for (size_t i = 0; i < cell.size(); i++) {
+        const InputWindowInfo* windowInfo = windowHandles.itemAt(cell[i])->getInfo();
+        if (isTouchModal(windowInfo) || windowInfo->touchableRegionContainsPoint(x, y)) {
+            return cell[i];
+        }
+    }
+    return -1;
+}
+
+const Vector<size_t>& InputWindowIndex::getOutsideTouchWatchers(int32_t displayId) const {
+    ssize_t index = mDisplays.indexOfKey(displayId);
+    return index < 0 ? mNoWindows : mDisplays.valueAt(index).outsideTouchWatchers;
+}
+
+} // namespace android
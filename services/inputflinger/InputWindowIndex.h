@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _UI_INPUT_WINDOW_INDEX_H
+#define _UI_INPUT_WINDOW_INDEX_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <ui/Rect.h>
+#include <utils/KeyedVector.h>
+#include <utils/RefBase.h>
+#include <utils/Vector.h>
+
+#include "InputWindow.h"
+
+namespace android {
+
+/*
+ * Finds the window a touch lands on without walking every window.
+ *
+ * The touchable windows of each display are binned into a grid of at most
+ * MAX_CELLS x MAX_CELLS cells over the bounds of their touchable regions.
+ * Each cell lists, front to back, the windows whose touchable bounds reach
+ * into it and the touch modal windows, which take touches anywhere. A touch
+ * then only checks the regions of the windows in its cell.
+ *
+ * The index refers to windows by their position in the list it was built
+ * from, and has to be rebuilt whenever the list or the windows' info
+ * change.
+ */
+class InputWindowIndex {
+public:
+    InputWindowIndex();
+
+    // Indexes the windows, given front to back.
+    void build(const Vector<sp<InputWindowHandle> >& windowHandles);
+
+    void clear();
+
+    // Returns the position of the frontmost window that takes a touch at
+    // (x, y) on the display, which is visible, touchable, and either touch
+    // modal or has the point in its touchable region, or -1 if none does.
+    ssize_t findTouchedWindow(const Vector<sp<InputWindowHandle> >& windowHandles,
+            int32_t displayId, int32_t x, int32_t y) const;
+
+    // Returns the positions of the visible windows on the display that
+    // watch for touches outside of them, front to back.
+    const Vector<size_t>& getOutsideTouchWatchers(int32_t displayId) const;
+
+    static bool isTouchModal(const InputWindowInfo* windowInfo);
+
+private:
+    enum { MAX_CELLS = 16, MIN_CELL_SHIFT = 6 };
+
+    struct DisplayWindows {
+        // bounds of the touchable regions of the windows that are not modal
+        Rect extent;
+        uint32_t cellShift;
+        uint32_t columns;
+        Vector<Vector<size_t> > cells;
+        // touch modal windows, for touches outside of the extent
+        Vector<size_t> modalWindows;
+        Vector<size_t> outsideTouchWatchers;
+    };
+
+    KeyedVector<int32_t, DisplayWindows> mDisplays;
+    const Vector<size_t> mNoWindows;
+};
+
+} // namespace android
+
+#endif // _UI_INPUT_WINDOW_INDEX_H
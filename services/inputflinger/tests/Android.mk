@@ -5,7 +5,8 @@ include $(CLEAR_VARS)
 # Build the unit tests.
 test_src_files := \
     InputReader_test.cpp \
-    InputDispatcher_test.cpp
+    InputDispatcher_test.cpp \
+    InputWindowIndex_test.cpp
 
 shared_libraries := \
     libcutils \
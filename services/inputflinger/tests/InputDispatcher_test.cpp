@@ -39,13 +39,18 @@ static const int32_t INJECTOR_UID = 1001;
 
 class FakeInputDispatcherPolicy : public InputDispatcherPolicyInterface {
     InputDispatcherConfiguration mConfig;
+    size_t mInterceptKeyBeforeQueueingCount;
 
 protected:
     virtual ~FakeInputDispatcherPolicy() {
     }
 
 public:
-    FakeInputDispatcherPolicy() {
+    FakeInputDispatcherPolicy() : mInterceptKeyBeforeQueueingCount(0) {
+    }
+
+    size_t getInterceptKeyBeforeQueueingCount() const {
+        return mInterceptKeyBeforeQueueingCount;
     }
 
 private:
@@ -70,6 +75,7 @@ private:
     }
 
     virtual void interceptKeyBeforeQueueing(const KeyEvent*, uint32_t&) {
+        mInterceptKeyBeforeQueueingCount += 1;
     }
 
     virtual void interceptMotionBeforeQueueing(nsecs_t, uint32_t&) {
@@ -138,6 +144,38 @@ TEST_F(InputDispatcherTest, InjectInputEvent_ValidatesKeyEvents) {
             << "Should reject key events with ACTION_MULTIPLE.";
 }
 
+TEST_F(InputDispatcherTest, InjectInputEvents_WhenOneEventIsInvalid_InjectsNone) {
+    KeyEvent down, invalid;
+    down.initialize(DEVICE_ID, AINPUT_SOURCE_KEYBOARD,
+            AKEY_EVENT_ACTION_DOWN, 0,
+            AKEYCODE_A, KEY_A, AMETA_NONE, 0, ARBITRARY_TIME, ARBITRARY_TIME);
+    invalid.initialize(DEVICE_ID, AINPUT_SOURCE_KEYBOARD,
+            /*action*/ -1, 0,
+            AKEYCODE_A, KEY_A, AMETA_NONE, 0, ARBITRARY_TIME, ARBITRARY_TIME);
+    const InputEvent* events[] = { &down, &invalid };
+    ASSERT_EQ(INPUT_EVENT_INJECTION_FAILED, mDispatcher->injectInputEvents(
+            events, 2, DISPLAY_ID,
+            INJECTOR_PID, INJECTOR_UID, INPUT_EVENT_INJECTION_SYNC_NONE, 0, 0))
+            << "Should reject the batch if any of its events is invalid.";
+    ASSERT_EQ(size_t(0), mFakePolicy->getInterceptKeyBeforeQueueingCount())
+            << "Should not let the policy see any event of a rejected batch.";
+}
+
+TEST_F(InputDispatcherTest, InjectInputEvents_QueuesEveryEvent) {
+    KeyEvent down, up;
+    down.initialize(DEVICE_ID, AINPUT_SOURCE_KEYBOARD,
+            AKEY_EVENT_ACTION_DOWN, 0,
+            AKEYCODE_A, KEY_A, AMETA_NONE, 0, ARBITRARY_TIME, ARBITRARY_TIME);
+    up.initialize(DEVICE_ID, AINPUT_SOURCE_KEYBOARD,
+            AKEY_EVENT_ACTION_UP, 0,
+            AKEYCODE_A, KEY_A, AMETA_NONE, 0, ARBITRARY_TIME, ARBITRARY_TIME);
+    const InputEvent* events[] = { &down, &up };
+    ASSERT_EQ(INPUT_EVENT_INJECTION_SUCCEEDED, mDispatcher->injectInputEvents(
+            events, 2, DISPLAY_ID,
+            INJECTOR_PID, INJECTOR_UID, INPUT_EVENT_INJECTION_SYNC_NONE, 0, 0));
+    ASSERT_EQ(size_t(2), mFakePolicy->getInterceptKeyBeforeQueueingCount());
+}
+
 TEST_F(InputDispatcherTest, InjectInputEvent_ValidatesMotionEvents) {
     MotionEvent event;
     PointerProperties pointerProperties[MAX_POINTERS + 1];
@@ -15,10 +15,14 @@
  */
 
 #include "../InputReader.h"
+#include "../InputRecording.h"
 
 #include <utils/List.h>
 #include <gtest/gtest.h>
+#include <algorithm>
 #include <math.h>
+#include <stdlib.h>
+#include <unistd.h>
 
 namespace android {
 
@@ -316,6 +320,7 @@ class FakeEventHub : public EventHubInterface {
         PropertyMap configuration;
         KeyedVector<int, RawAbsoluteAxisInfo> absoluteAxes;
         KeyedVector<int, bool> relativeAxes;
+        KeyedVector<int, bool> inputProperties;
         KeyedVector<int32_t, int32_t> keyCodeStates;
         KeyedVector<int32_t, int32_t> scanCodeStates;
         KeyedVector<int32_t, int32_t> switchStates;
@@ -333,6 +338,7 @@ class FakeEventHub : public EventHubInterface {
     KeyedVector<int32_t, Device*> mDevices;
     Vector<String8> mExcludedDevices;
     List<RawEvent> mEvents;
+    size_t mMaxEventsPerRead;
 
 protected:
     virtual ~FakeEventHub() {
@@ -342,7 +348,12 @@ protected:
     }
 
 public:
-    FakeEventHub() { }
+    FakeEventHub() : mMaxEventsPerRead(1) { }
+
+    // Lets getEvents() hand out several events at once, like the real event hub.
+    void setMaxEventsPerRead(size_t maxEventsPerRead) {
+        mMaxEventsPerRead = maxEventsPerRead;
+    }
 
     void addDevice(int32_t deviceId, const String8& name, uint32_t classes) {
         Device* device = new Device(classes);
@@ -359,6 +370,10 @@ public:
         enqueueEvent(ARBITRARY_TIME, deviceId, EventHubInterface::DEVICE_REMOVED, 0, 0);
     }
 
+    void reloadDevice(int32_t deviceId) {
+        enqueueEvent(ARBITRARY_TIME, deviceId, EventHubInterface::DEVICE_RELOADED, 0, 0);
+    }
+
     void finishDeviceScan() {
         enqueueEvent(ARBITRARY_TIME, 0, EventHubInterface::FINISHED_DEVICE_SCAN, 0, 0);
     }
@@ -392,6 +407,11 @@ public:
         device->relativeAxes.add(axis, true);
     }
 
+    void addInputProperty(int32_t deviceId, int property) {
+        Device* device = getDevice(deviceId);
+        device->inputProperties.add(property, true);
+    }
+
     void setKeyCodeState(int32_t deviceId, int32_t keyCode, int32_t state) {
         Device* device = getDevice(deviceId);
         device->keyCodeStates.replaceValueFor(keyCode, state);
@@ -514,7 +534,11 @@ private:
         return false;
     }
 
-    virtual bool hasInputProperty(int32_t, int) const {
+    virtual bool hasInputProperty(int32_t deviceId, int property) const {
+        Device* device = getDevice(deviceId);
+        if (device) {
+            return device->inputProperties.indexOfKey(property) >= 0;
+        }
         return false;
     }
 
@@ -564,14 +588,13 @@ private:
         mExcludedDevices = devices;
     }
 
-    virtual size_t getEvents(int, RawEvent* buffer, size_t) {
-        if (mEvents.empty()) {
-            return 0;
+    virtual size_t getEvents(int, RawEvent* buffer, size_t bufferSize) {
+        size_t count = 0;
+        while (!mEvents.empty() && count < mMaxEventsPerRead && count < bufferSize) {
+            buffer[count++] = *mEvents.begin();
+            mEvents.erase(mEvents.begin());
         }
-
-        *buffer = *mEvents.begin();
-        mEvents.erase(mEvents.begin());
-        return 1;
+        return count;
     }
 
     virtual int32_t getScanCodeState(int32_t deviceId, int32_t scanCode) const {
@@ -807,13 +830,15 @@ class FakeInputMapper : public InputMapper {
     bool mConfigureWasCalled;
     bool mResetWasCalled;
     bool mProcessWasCalled;
+    bool mCanProcessConcurrently;
 
 public:
     FakeInputMapper(InputDevice* device, uint32_t sources) :
             InputMapper(device),
             mSources(sources), mKeyboardType(AINPUT_KEYBOARD_TYPE_NONE),
             mMetaState(0),
-            mConfigureWasCalled(false), mResetWasCalled(false), mProcessWasCalled(false) {
+            mConfigureWasCalled(false), mResetWasCalled(false), mProcessWasCalled(false),
+            mCanProcessConcurrently(false) {
     }
 
     virtual ~FakeInputMapper() { }
@@ -826,6 +851,10 @@ public:
         mMetaState = metaState;
     }
 
+    void setCanProcessConcurrently(bool canProcessConcurrently) {
+        mCanProcessConcurrently = canProcessConcurrently;
+    }
+
     void assertConfigureWasCalled() {
         ASSERT_TRUE(mConfigureWasCalled)
                 << "Expected configure() to have been called.";
@@ -887,6 +916,13 @@ private:
     virtual void process(const RawEvent* rawEvent) {
         mLastEvent = *rawEvent;
         mProcessWasCalled = true;
+
+        // Report each sync as a key so that the order of the output can be checked.
+        if (rawEvent->type == EV_SYN && rawEvent->code == SYN_REPORT) {
+            NotifyKeyArgs args(rawEvent->when, getDeviceId(), mSources, 0,
+                    AKEY_EVENT_ACTION_DOWN, 0, AKEYCODE_A, KEY_A, 0, rawEvent->when);
+            getListener()->notifyKey(&args);
+        }
     }
 
     virtual int32_t getKeyCodeState(uint32_t, int32_t keyCode) {
@@ -924,6 +960,10 @@ private:
 
     virtual void fadePointer() {
     }
+
+    virtual bool canProcessConcurrently() {
+        return mCanProcessConcurrently;
+    }
 };
 
 
@@ -1175,6 +1215,50 @@ TEST_F(InputReaderTest, LoopOnce_WhenDeviceScanFinished_SendsConfigurationChange
     ASSERT_EQ(ARBITRARY_TIME, args.eventTime);
 }
 
+TEST_F(InputReaderTest, LoopOnce_WhenDeviceReloaded_ReplacesOnlyItsMappers) {
+    FakeInputMapper* reloadingMapper = NULL;
+    FakeInputMapper* otherMapper = NULL;
+    ASSERT_NO_FATAL_FAILURE(reloadingMapper = addDeviceWithFakeInputMapper(1, 0,
+            String8("reloading"), INPUT_DEVICE_CLASS_KEYBOARD, AINPUT_SOURCE_KEYBOARD, NULL));
+    ASSERT_NO_FATAL_FAILURE(otherMapper = addDeviceWithFakeInputMapper(2, 0,
+            String8("other"), INPUT_DEVICE_CLASS_KEYBOARD, AINPUT_SOURCE_KEYBOARD, NULL));
+    NotifyDeviceResetArgs resetArgs;
+    ASSERT_NO_FATAL_FAILURE(mFakeListener->assertNotifyDeviceResetWasCalled(&resetArgs));
+    ASSERT_NO_FATAL_FAILURE(mFakeListener->assertNotifyDeviceResetWasCalled(&resetArgs));
+
+    InputDevice* device = mReader->newDevice(1, 0, String8("reloading"),
+            INPUT_DEVICE_CLASS_KEYBOARD);
+    FakeInputMapper* reloadedMapper = new FakeInputMapper(device, AINPUT_SOURCE_KEYBOARD);
+    device->addMapper(reloadedMapper);
+    mReader->setNextDevice(device);
+    mFakeEventHub->addConfigurationProperty(1, String8("keyboard.layout"), String8("reloaded"));
+    mFakeEventHub->reloadDevice(1);
+    mFakeEventHub->finishDeviceScan();
+    mReader->loopOnce();
+    mReader->loopOnce();
+    ASSERT_NO_FATAL_FAILURE(mFakeEventHub->assertQueueIsEmpty());
+
+    // the old device is reset before it goes away, then the new one once it is set up
+    ASSERT_NO_FATAL_FAILURE(mFakeListener->assertNotifyDeviceResetWasCalled(&resetArgs));
+    ASSERT_EQ(1, resetArgs.deviceId);
+    ASSERT_NO_FATAL_FAILURE(mFakeListener->assertNotifyDeviceResetWasCalled(&resetArgs));
+    ASSERT_EQ(1, resetArgs.deviceId);
+    ASSERT_NO_FATAL_FAILURE(reloadedMapper->assertConfigureWasCalled());
+    ASSERT_NO_FATAL_FAILURE(reloadedMapper->assertResetWasCalled());
+    String8 layout;
+    ASSERT_TRUE(device->getConfiguration().tryGetProperty(String8("keyboard.layout"), layout));
+    ASSERT_STREQ("reloaded", layout.string());
+
+    mFakeEventHub->enqueueEvent(0, 1, EV_KEY, KEY_A, 1);
+    mFakeEventHub->enqueueEvent(0, 2, EV_KEY, KEY_B, 1);
+    mReader->loopOnce();
+    RawEvent event;
+    ASSERT_NO_FATAL_FAILURE(reloadedMapper->assertProcessWasCalled(&event));
+    ASSERT_EQ(KEY_A, event.code);
+    ASSERT_NO_FATAL_FAILURE(otherMapper->assertProcessWasCalled(&event));
+    ASSERT_EQ(KEY_B, event.code);
+}
+
 TEST_F(InputReaderTest, LoopOnce_ForwardsRawEventsToMappers) {
     FakeInputMapper* mapper = NULL;
     ASSERT_NO_FATAL_FAILURE(mapper = addDeviceWithFakeInputMapper(1, 0, String8("fake"),
@@ -1193,6 +1277,300 @@ TEST_F(InputReaderTest, LoopOnce_ForwardsRawEventsToMappers) {
     ASSERT_EQ(1, event.value);
 }
 
+TEST_F(InputReaderTest, LoopOnce_WhenDevicesProcessConcurrently_NotifiesInEventTimeOrder) {
+    const int32_t deviceIds[] = { 1, 2, 3 };
+    FakeInputMapper* mappers[3];
+    for (size_t i = 0; i < 3; i++) {
+        InputDevice* device = mReader->newDevice(deviceIds[i], 0, String8("fake"),
+                INPUT_DEVICE_CLASS_TOUCH);
+        mappers[i] = new FakeInputMapper(device, AINPUT_SOURCE_TOUCHSCREEN);
+        mappers[i]->setCanProcessConcurrently(true);
+        device->addMapper(mappers[i]);
+        mReader->setNextDevice(device);
+        ASSERT_NO_FATAL_FAILURE(addDevice(deviceIds[i], String8("fake"),
+                INPUT_DEVICE_CLASS_TOUCH, NULL));
+    }
+
+    // The event hub hands out whole batches per device, so the syncs of different
+    // devices arrive out of time order.
+    mFakeEventHub->setMaxEventsPerRead(6);
+    const nsecs_t times[3][2] = { { 30, 60 }, { 10, 50 }, { 20, 40 } };
+    for (size_t i = 0; i < 3; i++) {
+        for (size_t j = 0; j < 2; j++) {
+            mFakeEventHub->enqueueEvent(times[i][j], deviceIds[i], EV_SYN, SYN_REPORT, 0);
+        }
+    }
+    mReader->loopOnce();
+    ASSERT_NO_FATAL_FAILURE(mFakeEventHub->assertQueueIsEmpty());
+
+    const nsecs_t expectedTimes[] = { 10, 20, 30, 40, 50, 60 };
+    const int32_t expectedDeviceIds[] = { 2, 3, 1, 3, 2, 1 };
+    for (size_t i = 0; i < 6; i++) {
+        NotifyKeyArgs args;
+        ASSERT_NO_FATAL_FAILURE(mFakeListener->assertNotifyKeyWasCalled(&args));
+        ASSERT_EQ(expectedTimes[i], args.eventTime);
+        ASSERT_EQ(expectedDeviceIds[i], args.deviceId);
+    }
+    ASSERT_NO_FATAL_FAILURE(mFakeListener->assertNotifyKeyWasNotCalled());
+    for (size_t i = 0; i < 3; i++) {
+        ASSERT_NO_FATAL_FAILURE(mappers[i]->assertProcessWasCalled());
+    }
+}
+
+
+// --- InputReplayTest ---
+
+/*
+ * Replays recordings made with debug.input.record_path through the InputReader.
+ * Set INPUT_REPLAY_FILE to replay a recording pulled from a device instead of a synthetic
+ * one, and INPUT_REPLAY_REALTIME to keep the recorded pace instead of going flat out.
+ */
+class InputReplayTest : public InputReaderTest {
+protected:
+    static const nsecs_t FRAME_INTERVAL = 8000000;
+
+    String8 mRecordingPath;
+
+    virtual void SetUp() {
+        InputReaderTest::SetUp();
+        mFakePolicy->setDisplayInfo(DISPLAY_ID, DISPLAY_WIDTH, DISPLAY_HEIGHT,
+                DISPLAY_ORIENTATION_0);
+        mReader->requestRefreshConfiguration(InputReaderConfiguration::CHANGE_DISPLAY_INFO);
+
+        const char* tmpDir = getenv("TMPDIR");
+        mRecordingPath = String8::format("%s/InputReplayTest_%d.rec",
+                tmpDir ? tmpDir : "/data/local/tmp", getpid());
+    }
+
+    virtual void TearDown() {
+        unlink(mRecordingPath.string());
+        InputReaderTest::TearDown();
+    }
+
+    static void addAxis(InputRecord& record, int32_t axis, int32_t minValue, int32_t maxValue) {
+        InputRecord::AbsoluteAxis absoluteAxis;
+        absoluteAxis.axis = axis;
+        absoluteAxis.info.clear();
+        absoluteAxis.info.valid = true;
+        absoluteAxis.info.minValue = minValue;
+        absoluteAxis.info.maxValue = maxValue;
+        record.absoluteAxes.push(absoluteAxis);
+    }
+
+    static void addEvent(InputRecord& record, nsecs_t when, int32_t type, int32_t code,
+            int32_t value) {
+        RawEvent event;
+        event.when = when;
+        event.deviceId = 1;
+        event.type = type;
+        event.code = code;
+        event.value = value;
+        record.events.push(event);
+    }
+
+    // Records two fingers swiping down a multi-touch screen, one batch per frame.
+    void writeSyntheticRecording(uint32_t frameCount) {
+        InputRecordingWriter* writer;
+        ASSERT_EQ(OK, InputRecordingWriter::open(mRecordingPath.string(), &writer));
+
+        InputRecord record;
+        record.clear();
+        record.type = InputRecord::TYPE_DEVICE_ADDED;
+        record.deviceId = 1;
+        record.classes = INPUT_DEVICE_CLASS_TOUCH | INPUT_DEVICE_CLASS_TOUCH_MT;
+        record.identifier.name = "touchscreen";
+        record.properties.push(INPUT_PROP_DIRECT);
+        addAxis(record, ABS_MT_SLOT, 0, 9);
+        addAxis(record, ABS_MT_POSITION_X, 0, DISPLAY_WIDTH - 1);
+        addAxis(record, ABS_MT_POSITION_Y, 0, DISPLAY_HEIGHT - 1);
+        addAxis(record, ABS_MT_TRACKING_ID, 0, 65535);
+        ASSERT_EQ(OK, writer->write(record));
+
+        for (uint32_t frame = 0; frame < frameCount; frame++) {
+            nsecs_t when = ARBITRARY_TIME * 1000000 + frame * FRAME_INTERVAL;
+            record.clear();
+            record.type = InputRecord::TYPE_BATCH;
+            record.readTime = when + 1000000;
+            for (int32_t slot = 0; slot < 2; slot++) {
+                addEvent(record, when, EV_ABS, ABS_MT_SLOT, slot);
+                if (frame == 0) {
+                    addEvent(record, when, EV_ABS, ABS_MT_TRACKING_ID, slot);
+                    addEvent(record, when, EV_ABS, ABS_MT_POSITION_X, 100 + slot * 200);
+                }
+                if (frame == frameCount - 1) {
+                    addEvent(record, when, EV_ABS, ABS_MT_TRACKING_ID, -1);
+                } else {
+                    addEvent(record, when, EV_ABS, ABS_MT_POSITION_Y,
+                            frame * (DISPLAY_HEIGHT - 1) / frameCount);
+                }
+            }
+            addEvent(record, when, EV_SYN, SYN_REPORT, 0);
+            ASSERT_EQ(OK, writer->write(record));
+        }
+        delete writer;
+    }
+
+    // Feeds the recording to the reader, one loopOnce() per recorded batch, and returns
+    // how long each of those took.
+    void replay(const char* path, bool realtime, Vector<nsecs_t>* outLatencies,
+            size_t* outEventCount) {
+        InputRecordingReader* reader;
+        ASSERT_EQ(OK, InputRecordingReader::open(path, &reader));
+
+        *outEventCount = 0;
+        nsecs_t firstReadTime = -1;
+        nsecs_t startTime = systemTime(SYSTEM_TIME_MONOTONIC);
+        InputRecord record;
+        status_t status;
+        while (!(status = reader->read(&record))) {
+            switch (record.type) {
+            case InputRecord::TYPE_DEVICE_ADDED:
+                mFakeEventHub->addDevice(record.deviceId, record.identifier.name,
+                        record.classes);
+                for (size_t i = 0; i < record.properties.size(); i++) {
+                    mFakeEventHub->addInputProperty(record.deviceId, record.properties[i]);
+                }
+                for (size_t i = 0; i < record.scanCodes.size(); i++) {
+                    mFakeEventHub->addKey(record.deviceId, record.scanCodes[i], 0,
+                            AKEYCODE_UNKNOWN, 0);
+                }
+                for (size_t i = 0; i < record.relativeAxes.size(); i++) {
+                    mFakeEventHub->addRelativeAxis(record.deviceId, record.relativeAxes[i]);
+                }
+                for (size_t i = 0; i < record.absoluteAxes.size(); i++) {
+                    const InputRecord::AbsoluteAxis& axis = record.absoluteAxes[i];
+                    mFakeEventHub->addAbsoluteAxis(record.deviceId, axis.axis,
+                            axis.info.minValue, axis.info.maxValue, axis.info.flat,
+                            axis.info.fuzz, axis.info.resolution);
+                }
+                mFakeEventHub->finishDeviceScan();
+                mFakeEventHub->setMaxEventsPerRead(2);
+                mReader->loopOnce();
+                break;
+
+            case InputRecord::TYPE_DEVICE_REMOVED:
+                mFakeEventHub->removeDevice(record.deviceId);
+                mFakeEventHub->setMaxEventsPerRead(1);
+                mReader->loopOnce();
+                break;
+
+            case InputRecord::TYPE_BATCH: {
+                for (size_t i = 0; i < record.events.size(); i++) {
+                    const RawEvent& event = record.events[i];
+                    mFakeEventHub->enqueueEvent(event.when, event.deviceId, event.type,
+                            event.code, event.value);
+                }
+                mFakeEventHub->setMaxEventsPerRead(record.events.size());
+                *outEventCount += record.events.size();
+
+                if (firstReadTime < 0) {
+                    firstReadTime = record.readTime;
+                }
+                if (realtime) {
+                    nsecs_t delay = (record.readTime - firstReadTime)
+                            - (systemTime(SYSTEM_TIME_MONOTONIC) - startTime);
+                    if (delay > 0) {
+                        usleep(ns2us(delay));
+                    }
+                }
+
+                nsecs_t loopStartTime = systemTime(SYSTEM_TIME_MONOTONIC);
+                mReader->loopOnce();
+                outLatencies->push(systemTime(SYSTEM_TIME_MONOTONIC) - loopStartTime);
+                break;
+            }
+            }
+        }
+        delete reader;
+        ASSERT_EQ(NAME_NOT_FOUND, status) << "The recording should be read to the end.";
+        ASSERT_NO_FATAL_FAILURE(mFakeEventHub->assertQueueIsEmpty());
+    }
+};
+
+const nsecs_t InputReplayTest::FRAME_INTERVAL;
+
+TEST_F(InputReplayTest, Recording_ReadsBackWrittenRecords) {
+    ASSERT_NO_FATAL_FAILURE(writeSyntheticRecording(3));
+
+    InputRecordingReader* reader;
+    ASSERT_EQ(OK, InputRecordingReader::open(mRecordingPath.string(), &reader));
+
+    InputRecord record;
+    ASSERT_EQ(OK, reader->read(&record));
+    ASSERT_EQ(InputRecord::TYPE_DEVICE_ADDED, record.type);
+    ASSERT_EQ(1, record.deviceId);
+    ASSERT_EQ(INPUT_DEVICE_CLASS_TOUCH | INPUT_DEVICE_CLASS_TOUCH_MT, record.classes);
+    ASSERT_STREQ("touchscreen", record.identifier.name.string());
+    ASSERT_EQ(size_t(1), record.properties.size());
+    ASSERT_EQ(INPUT_PROP_DIRECT, record.properties[0]);
+    ASSERT_EQ(size_t(4), record.absoluteAxes.size());
+    ASSERT_EQ(ABS_MT_POSITION_Y, record.absoluteAxes[2].axis);
+    ASSERT_EQ(DISPLAY_HEIGHT - 1, record.absoluteAxes[2].info.maxValue);
+
+    ASSERT_EQ(OK, reader->read(&record));
+    ASSERT_EQ(InputRecord::TYPE_BATCH, record.type);
+    ASSERT_EQ(ARBITRARY_TIME * 1000000 + 1000000, record.readTime);
+    ASSERT_EQ(size_t(9), record.events.size());
+    ASSERT_EQ(ARBITRARY_TIME * 1000000, record.events[1].when);
+    ASSERT_EQ(1, record.events[1].deviceId);
+    ASSERT_EQ(EV_ABS, record.events[1].type);
+    ASSERT_EQ(ABS_MT_TRACKING_ID, record.events[1].code);
+    ASSERT_EQ(0, record.events[1].value);
+
+    ASSERT_EQ(OK, reader->read(&record));
+    ASSERT_EQ(OK, reader->read(&record));
+    ASSERT_EQ(-1, record.events[1].value);
+    ASSERT_EQ(NAME_NOT_FOUND, reader->read(&record));
+    delete reader;
+}
+
+TEST_F(InputReplayTest, Replay_NotifiesRecordedGesture) {
+    ASSERT_NO_FATAL_FAILURE(writeSyntheticRecording(3));
+
+    Vector<nsecs_t> latencies;
+    size_t eventCount;
+    ASSERT_NO_FATAL_FAILURE(replay(mRecordingPath.string(), false, &latencies, &eventCount));
+    ASSERT_EQ(size_t(3), latencies.size());
+
+    NotifyMotionArgs args;
+    ASSERT_NO_FATAL_FAILURE(mFakeListener->assertNotifyMotionWasCalled(&args));
+    ASSERT_EQ(AMOTION_EVENT_ACTION_DOWN, args.action);
+    ASSERT_EQ(ARBITRARY_TIME * 1000000, args.eventTime);
+    ASSERT_NO_FATAL_FAILURE(mFakeListener->assertNotifyMotionWasCalled(&args));
+    ASSERT_EQ(AMOTION_EVENT_ACTION_POINTER_DOWN
+            | (1 << AMOTION_EVENT_ACTION_POINTER_INDEX_SHIFT), args.action);
+    ASSERT_EQ(size_t(2), args.pointerCount);
+}
+
+TEST_F(InputReplayTest, Benchmark_Replay) {
+    const char* path = getenv("INPUT_REPLAY_FILE");
+    if (!path) {
+        ASSERT_NO_FATAL_FAILURE(writeSyntheticRecording(10000));
+        path = mRecordingPath.string();
+    }
+    bool realtime = getenv("INPUT_REPLAY_REALTIME") != NULL;
+
+    Vector<nsecs_t> latencies;
+    size_t eventCount;
+    nsecs_t startTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    ASSERT_NO_FATAL_FAILURE(replay(path, realtime, &latencies, &eventCount));
+    nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - startTime;
+    ASSERT_FALSE(latencies.isEmpty());
+
+    nsecs_t total = 0;
+    for (size_t i = 0; i < latencies.size(); i++) {
+        total += latencies[i];
+    }
+    std::sort(latencies.editArray(), latencies.editArray() + latencies.size());
+    size_t count = latencies.size();
+    printf("%s: %zu events in %zu batches, %.0f events/s through the reader\n",
+            path, eventCount, count, eventCount * 1e9 / total);
+    printf("loopOnce per batch: p50 %.1f us, p99 %.1f us, max %.1f us; "
+            "replay took %.1f ms\n",
+            latencies[count / 2] / 1000.0, latencies[count * 99 / 100] / 1000.0,
+            latencies[count - 1] / 1000.0, elapsed / 1000000.0);
+}
+
 
 // --- InputDeviceTest ---
 
@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "../InputWindowIndex.h"
+
+#include <gtest/gtest.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+// An arbitrary display id.
+static const int32_t DISPLAY_ID = 0;
+
+
+// --- FakeWindowHandle ---
+
+class FakeWindowHandle : public InputWindowHandle {
+public:
+    FakeWindowHandle(int32_t displayId, int32_t flags) :
+            InputWindowHandle(NULL) {
+        mInfo = new InputWindowInfo();
+        mInfo->layoutParamsFlags = flags;
+        mInfo->visible = true;
+        mInfo->displayId = displayId;
+    }
+
+    FakeWindowHandle* addTouchableRegion(const Rect& rect) {
+        mInfo->addTouchableRegion(rect);
+        return this;
+    }
+
+    virtual bool updateInfo() {
+        return true;
+    }
+
+    InputWindowInfo* editInfo() {
+        return mInfo;
+    }
+};
+
+
+// --- InputWindowIndexTest ---
+
+class InputWindowIndexTest : public testing::Test {
+protected:
+    Vector<sp<InputWindowHandle> > mWindowHandles;
+    InputWindowIndex mIndex;
+
+    FakeWindowHandle* addWindow(int32_t displayId, int32_t flags) {
+        FakeWindowHandle* windowHandle = new FakeWindowHandle(displayId, flags);
+        mWindowHandles.push(windowHandle);
+        return windowHandle;
+    }
+
+    FakeWindowHandle* addWindow(const Rect& rect) {
+        return addWindow(DISPLAY_ID, InputWindowInfo::FLAG_NOT_TOUCH_MODAL)
+                ->addTouchableRegion(rect);
+    }
+
+    // What InputDispatcher did before it had the index.
+    ssize_t findTouchedWindowLinear(int32_t displayId, int32_t x, int32_t y) const {
+        for (size_t i = 0; i < mWindowHandles.size(); i++) {
+            const InputWindowInfo* windowInfo = mWindowHandles[i]->getInfo();
+            if (windowInfo->displayId == displayId && windowInfo->visible
+                    && !(windowInfo->layoutParamsFlags & InputWindowInfo::FLAG_NOT_TOUCHABLE)
+                    && (InputWindowIndex::isTouchModal(windowInfo)
+                            || windowInfo->touchableRegionContainsPoint(x, y))) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    // Publishes the fake window information like the dispatcher does, then indexes it.
+    void buildIndex() {
+        for (size_t i = 0; i < mWindowHandles.size(); i++) {
+            mWindowHandles[i]->publishInfo();
+        }
+        mIndex.build(mWindowHandles);
+    }
+
+    ssize_t find(int32_t x, int32_t y) const {
+        return mIndex.findTouchedWindow(mWindowHandles, DISPLAY_ID, x, y);
+    }
+
+    void addRandomWindows(size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            int32_t flags = InputWindowInfo::FLAG_NOT_TOUCH_MODAL;
+            switch (rand() % 16) {
+            case 0: flags = 0; break;
+            case 1: flags |= InputWindowInfo::FLAG_NOT_TOUCHABLE; break;
+            case 2: flags |= InputWindowInfo::FLAG_WATCH_OUTSIDE_TOUCH; break;
+            }
+            FakeWindowHandle* windowHandle = addWindow(rand() % 2, flags);
+            windowHandle->editInfo()->visible = rand() % 8 != 0;
+            for (int32_t r = rand() % 3; r > 0; r--) {
+                int32_t left = rand() % 2400 - 200;
+                int32_t top = rand() % 2400 - 200;
+                windowHandle->addTouchableRegion(Rect(left, top,
+                        left + 1 + rand() % 600, top + 1 + rand() % 600));
+            }
+        }
+    }
+};
+
+TEST_F(InputWindowIndexTest, FindsFrontmostWindow) {
+    addWindow(Rect(100, 100, 200, 200));
+    addWindow(Rect(0, 0, 1000, 1000));
+    buildIndex();
+
+    EXPECT_EQ(0, find(150, 150));
+    EXPECT_EQ(1, find(50, 50));
+    EXPECT_EQ(1, find(200, 200));
+    EXPECT_EQ(-1, find(1000, 1000));
+    EXPECT_EQ(-1, find(-1, 0));
+}
+
+TEST_F(InputWindowIndexTest, SkipsInvisibleAndUntouchableWindows) {
+    addWindow(Rect(0, 0, 100, 100))->editInfo()->visible = false;
+    addWindow(DISPLAY_ID, InputWindowInfo::FLAG_NOT_TOUCH_MODAL
+            | InputWindowInfo::FLAG_NOT_TOUCHABLE)->addTouchableRegion(Rect(0, 0, 100, 100));
+    addWindow(Rect(0, 0, 200, 200));
+    buildIndex();
+
+    EXPECT_EQ(2, find(50, 50));
+}
+
+TEST_F(InputWindowIndexTest, ModalWindowTakesTouchesEverywhere) {
+    addWindow(Rect(0, 0, 100, 100));
+    addWindow(DISPLAY_ID, 0)->addTouchableRegion(Rect(500, 500, 600, 600));
+    addWindow(Rect(0, 0, 1000, 1000));
+    buildIndex();
+
+    EXPECT_EQ(0, find(50, 50));
+    EXPECT_EQ(1, find(150, 150));
+    EXPECT_EQ(1, find(5000, -5000));
+}
+
+TEST_F(InputWindowIndexTest, KeepsDisplaysApart) {
+    addWindow(1, InputWindowInfo::FLAG_NOT_TOUCH_MODAL)->addTouchableRegion(
+            Rect(0, 0, 100, 100));
+    addWindow(Rect(0, 0, 100, 100));
+    buildIndex();
+
+    EXPECT_EQ(1, find(50, 50));
+    EXPECT_EQ(0, mIndex.findTouchedWindow(mWindowHandles, 1, 50, 50));
+    EXPECT_EQ(-1, mIndex.findTouchedWindow(mWindowHandles, 2, 50, 50));
+}
+
+TEST_F(InputWindowIndexTest, ListsOutsideTouchWatchersFrontToBack) {
+    addWindow(DISPLAY_ID, InputWindowInfo::FLAG_NOT_TOUCH_MODAL
+            | InputWindowInfo::FLAG_WATCH_OUTSIDE_TOUCH);
+    addWindow(Rect(0, 0, 100, 100));
+    addWindow(DISPLAY_ID, InputWindowInfo::FLAG_NOT_TOUCH_MODAL
+            | InputWindowInfo::FLAG_WATCH_OUTSIDE_TOUCH)->editInfo()->visible = false;
+    addWindow(DISPLAY_ID, InputWindowInfo::FLAG_NOT_TOUCH_MODAL
+            | InputWindowInfo::FLAG_WATCH_OUTSIDE_TOUCH
+            | InputWindowInfo::FLAG_NOT_TOUCHABLE);
+    buildIndex();
+
+    const Vector<size_t>& watchers = mIndex.getOutsideTouchWatchers(DISPLAY_ID);
+    ASSERT_EQ(2U, watchers.size());
+    EXPECT_EQ(0U, watchers[0]);
+    EXPECT_EQ(3U, watchers[1]);
+    EXPECT_EQ(0U, mIndex.getOutsideTouchWatchers(1).size());
+}
+
+TEST_F(InputWindowIndexTest, HandlesRegionsFarOffScreen) {
+    addWindow(Rect(-2000000000, -2000000000, 2000000000, 2000000000));
+    addWindow(Rect(0, 0, 100, 100));
+    buildIndex();
+
+    EXPECT_EQ(0, find(50, 50));
+    EXPECT_EQ(0, find(-1999999999, 1999999999));
+    EXPECT_EQ(-1, find(2000000000, 0));
+}
+
+TEST_F(InputWindowIndexTest, MatchesLinearSearch) {
+    srand(1);
+    for (int32_t run = 0; run < 50; run++) {
+        mWindowHandles.clear();
+        addRandomWindows(1 + rand() % 100);
+        buildIndex();
+        for (int32_t i = 0; i < 1000; i++) {
+            int32_t displayId = rand() % 3;
+            int32_t x = rand() % 3200 - 400;
+            int32_t y = rand() % 3200 - 400;
+            ASSERT_EQ(findTouchedWindowLinear(displayId, x, y),
+                    mIndex.findTouchedWindow(mWindowHandles, displayId, x, y))
+                    << "run " << run << " at " << x << ", " << y;
+        }
+    }
+}
+
+TEST_F(InputWindowIndexTest, Benchmark) {
+    srand(2);
+    addRandomWindows(200);
+    buildIndex();
+
+    const int32_t count = 100000;
+    ssize_t linearSum = 0, indexSum = 0;
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int32_t i = 0; i < count; i++) {
+        linearSum += findTouchedWindowLinear(DISPLAY_ID, i % 2000, (i * 7) % 2000);
+    }
+    nsecs_t middle = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int32_t i = 0; i < count; i++) {
+        indexSum += find(i % 2000, (i * 7) % 2000);
+    }
+    nsecs_t end = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    EXPECT_EQ(linearSum, indexSum);
+    printf("200 windows: linear scan %" PRId64 " ns, index %" PRId64 " ns per touch\n",
+            (middle - start) / count, (end - middle) / count);
+}
+
+} // namespace android
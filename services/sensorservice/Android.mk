@@ -12,6 +12,7 @@ LOCAL_SRC_FILES:= \
     RotationVectorSensor.cpp \
     SensorDevice.cpp \
     SensorEventConnection.cpp \
+    SensorEventIndex.cpp \
     SensorFusion.cpp \
     SensorInterface.cpp \
     SensorList.cpp \
@@ -143,6 +143,16 @@ static mat<TYPE, 3, 3> crossMatrix(const vec<TYPE, 3>& p, OTHER_TYPE diag) {
     return r;
 }
 
+// Same as m*crossMatrix(p, 0), without the multiplications by the zeros of the cross matrix.
+template <typename TYPE>
+static mat<TYPE, 3, 3> mulCrossMatrix(const mat<TYPE, 3, 3>& m, const vec<TYPE, 3>& p) {
+    mat<TYPE, 3, 3> r;
+    r[0] = m[1]*p.z - m[2]*p.y;
+    r[1] = m[2]*p.x - m[0]*p.z;
+    r[2] = m[0]*p.y - m[1]*p.x;
+    return r;
+}
+
 
 template<typename TYPE, size_t SIZE>
 class Covariance {
@@ -487,7 +497,23 @@ void Fusion::predict(const vec3_t& w, float dT) {
     if (x0.w < 0)
         x0 = -x0;
 
-    P = Phi*P*transpose(Phi) + GQGt;
+    // P = Phi*P*transpose(Phi) + GQGt, without the products by the zero and identity blocks
+    // of Phi that the generic block multiplication would do. With P01 = transpose(P10):
+    //
+    // P00 = Phi00*P00*Phi00' + Phi10*P11*Phi10' + Phi00*P10*Phi10' + (Phi00*P10*Phi10')'
+    // P10 = Phi00*P10 + Phi10*P11
+    // P11 = P11
+    //
+    // Building P00 from symmetric terms keeps it exactly symmetric, which checkState() wants.
+    const mat33_t& Phi00 = Phi[0][0];
+    const mat33_t& Phi10 = Phi[1][0];
+    const mat33_t Phi00P10(Phi00*P[1][0]);
+    const mat33_t Phi00P10Phi10t(Phi00P10*transpose(Phi10));
+    P[0][0] = scaleCovariance(Phi00, P[0][0]) + scaleCovariance(Phi10, P[1][1])
+            + (Phi00P10Phi10t + transpose(Phi00P10Phi10t)) + GQGt[0][0];
+    P[1][0] = Phi00P10 + Phi10*P[1][1] + GQGt[1][0];
+    P[0][1] = transpose(P[1][0]);
+    P[1][1] += GQGt[1][1];
 
     checkState();
 }
@@ -508,7 +534,8 @@ void Fusion::update(const vec3_t& z, const vec3_t& Bi, float sigma) {
     const mat33_t R(sigma*sigma);
     const mat33_t S(scaleCovariance(L, P[0][0]) + R);
     const mat33_t Si(invert(S));
-    const mat33_t LtSi(transpose(L)*Si);
+    // L is skew-symmetric and Si symmetric, so transpose(L)*Si = transpose(Si*L).
+    const mat33_t LtSi(transpose(mulCrossMatrix(Si, Bb)));
     K[0] = P[0][0] * LtSi;
     K[1] = transpose(P[1][0])*LtSi;
 
@@ -519,8 +546,8 @@ void Fusion::update(const vec3_t& z, const vec3_t& Bi, float sigma) {
     // | K1 |                 | K1*L  0 |   | P01  P11 |   | K1*L*P00  K1*L*P10 |
     // Note: the Joseph form is numerically more stable and given by:
     //     P = (I-KH) * P * (I-KH)' + K*R*R'
-    const mat33_t K0L(K[0] * L);
-    const mat33_t K1L(K[1] * L);
+    const mat33_t K0L(mulCrossMatrix(K[0], Bb));
+    const mat33_t K1L(mulCrossMatrix(K[1], Bb));
     P[0][0] -= K0L*P[0][0];
     P[1][1] -= K1L*P[1][0];
     P[1][0] -= K0L*P[1][0];
@@ -21,6 +21,8 @@
 
 #include <inttypes.h>
 
+#include <vector>
+
 namespace android {
 namespace SensorServiceUtil {
 
@@ -29,15 +31,15 @@ namespace {
     constexpr size_t LOG_SIZE_LARGE = 50;  // larger samples for debugging
 }// unnamed namespace
 
-RecentEventLogger::RecentEventLogger(int sensorType) :
+RecentEventLogger::RecentEventLogger(int sensorType, bool logHistory) :
         mSensorType(sensorType), mEventSize(eventSizeBySensorType(mSensorType)),
-        mRecentEvents(logSizeBySensorType(sensorType)), mMaskData(false) {
+        mLogHistory(logHistory),
+        mRecentEvents(logHistory ? logSizeBySensorType(sensorType) : 1), mMaskData(false) {
     // blank
 }
 
 void RecentEventLogger::addEvent(const sensors_event_t& event) {
-    std::lock_guard<std::mutex> lk(mLock);
-    mRecentEvents.emplace(event);
+    mRecentEvents.add(SensorEventLog(event, mLogHistory));
 }
 
 bool RecentEventLogger::isEmpty() const {
@@ -45,15 +47,21 @@ bool RecentEventLogger::isEmpty() const {
 }
 
 std::string RecentEventLogger::dump() const {
-    std::lock_guard<std::mutex> lk(mLock);
+    if (!mLogHistory) {
+        return std::string("event history disabled\n");
+    }
+
+    // Copy the events first, the sensor service thread keeps adding to them meanwhile.
+    std::vector<SensorEventLog> events(mRecentEvents.size());
+    events.resize(mRecentEvents.copyRecent(events.data(), events.size()));
 
     //TODO: replace String8 with std::string completely in this function
     String8 buffer;
 
-    buffer.appendFormat("last %zu events\n", mRecentEvents.size());
+    buffer.appendFormat("last %zu events\n", events.size());
     int j = 0;
-    for (int i = mRecentEvents.size() - 1; i >= 0; --i) {
-        const auto& ev = mRecentEvents[i];
+    for (int i = events.size() - 1; i >= 0; --i) {
+        const auto& ev = events[i];
         struct tm * timeinfo = localtime(&(ev.mWallTime.tv_sec));
         buffer.appendFormat("\t%2d (ts=%.9f, wall=%02d:%02d:%02d.%03d) ",
                 ++j, ev.mEvent.timestamp/1e9, timeinfo->tm_hour, timeinfo->tm_min, timeinfo->tm_sec,
@@ -85,11 +93,9 @@ void RecentEventLogger::setFormat(std::string format) {
 }
 
 bool RecentEventLogger::populateLastEvent(sensors_event_t *event) const {
-    std::lock_guard<std::mutex> lk(mLock);
-
-    if (mRecentEvents.size()) {
-        // Index 0 contains the latest event emplace()'ed
-        *event = mRecentEvents[0].mEvent;
+    SensorEventLog ev;
+    if (mRecentEvents.front(&ev)) {
+        *event = ev.mEvent;
         return true;
     } else {
         return false;
@@ -103,8 +109,12 @@ size_t RecentEventLogger::logSizeBySensorType(int sensorType) {
             sensorType == SENSOR_TYPE_ACCELEROMETER) ? LOG_SIZE_LARGE : LOG_SIZE;
 }
 
-RecentEventLogger::SensorEventLog::SensorEventLog(const sensors_event_t& e) : mEvent(e) {
-    clock_gettime(CLOCK_REALTIME, &mWallTime);
+RecentEventLogger::SensorEventLog::SensorEventLog(const sensors_event_t& e, bool wallTime) :
+        mWallTime(), mEvent(e) {
+    // Only dump() shows the wall time.
+    if (wallTime) {
+        clock_gettime(CLOCK_REALTIME, &mWallTime);
+    }
 }
 
 } // namespace SensorServiceUtil
@@ -23,8 +23,6 @@
 #include <hardware/sensors.h>
 #include <utils/String8.h>
 
-#include <mutex>
-
 namespace android {
 namespace SensorServiceUtil {
 
@@ -33,9 +31,13 @@ namespace SensorServiceUtil {
 // generated from the sensor are stored in this buffer.  The buffer is NOT cleared when the sensor
 // unregisters and as a result very old data in the dumpsys output can be seen, which is an intended
 // behavior.
+//
+// Events are added by the sensor service thread only, dumpsys and the delivery of the last value
+// of on-change sensors read them without locking it out. With history off only the last event is
+// kept, for that delivery, and dump() shows no events.
 class RecentEventLogger : public Dumpable {
 public:
-    RecentEventLogger(int sensorType);
+    RecentEventLogger(int sensorType, bool logHistory = true);
     void addEvent(const sensors_event_t& event);
     bool populateLastEvent(sensors_event_t *event) const;
     bool isEmpty() const;
@@ -47,16 +49,17 @@ public:
 
 protected:
     struct SensorEventLog {
-        SensorEventLog(const sensors_event_t& e);
+        SensorEventLog() = default;
+        SensorEventLog(const sensors_event_t& e, bool wallTime);
         timespec mWallTime;
         sensors_event_t mEvent;
     };
 
     const int mSensorType;
     const size_t mEventSize;
+    const bool mLogHistory;
 
-    mutable std::mutex mLock;
-    RingBuffer<SensorEventLog> mRecentEvents;
+    SingleWriterRingBuffer<SensorEventLog> mRecentEvents;
 
     bool mMaskData;
 
@@ -20,7 +20,10 @@
 #include <utils/Log.h>
 #include <cutils/compiler.h>
 
+#include <atomic>
 #include <iterator>
+#include <memory>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
@@ -354,6 +357,118 @@ void RingBuffer<T>::clear() {
     mFrontIdx = 0;
 }
 
+/**
+ * A fixed length ring buffer with a single writer that readers can copy from concurrently,
+ * without locking and without ever blocking the writer.
+ *
+ * Every slot carries a sequence number derived from the position of the element it holds, which
+ * is odd while the element is being replaced.  A reader that finds a sequence number other than
+ * the one it expects knows the writer has lapped it and stops.  T must be trivially copyable
+ * since readers may copy an element that is being overwritten and then discard the copy.
+ */
+template <class T>
+class SingleWriterRingBuffer final {
+    static_assert(std::is_trivially_copyable<T>::value, "T must be trivially copyable");
+public:
+
+    /**
+     * Construct a SingleWriterRingBuffer that holds up to the given number of elements.
+     */
+    SingleWriterRingBuffer(size_t length);
+
+    /**
+     * Adds item to the front of this ring buffer, replacing the oldest element if it is full.
+     * Must only be called from one thread at a time.
+     */
+    void add(const T& item);
+
+    /**
+     * Copies up to count of the most recent elements to out, most recent first, and returns how
+     * many were copied.  Returns fewer elements than are in the buffer if the writer overtakes
+     * the copy.  May be called from any thread.
+     */
+    size_t copyRecent(T* out, size_t count) const;
+
+    /**
+     * Copies the most recent element to out.  Returns false if the buffer is empty.
+     */
+    bool front(T* out) const;
+
+    /**
+     * Return the current number of elements of this ring buffer.
+     */
+    size_t size() const;
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> mSequence;
+        T mItem;
+    };
+
+    const size_t mLength;
+    std::unique_ptr<Slot[]> mSlots;
+    // Total number of elements ever added.
+    std::atomic<uint64_t> mAdded;
+}; // class SingleWriterRingBuffer
+
+template <class T>
+SingleWriterRingBuffer<T>::SingleWriterRingBuffer(size_t length) :
+        mLength{length}, mSlots{new Slot[length]}, mAdded{0} {
+    for (size_t i = 0; i < mLength; ++i) {
+        mSlots[i].mSequence.store(0, std::memory_order_relaxed);
+    }
+}
+
+template <class T>
+void SingleWriterRingBuffer<T>::add(const T& item) {
+    uint64_t pos = mAdded.load(std::memory_order_relaxed);
+    Slot& slot = mSlots[pos % mLength];
+
+    slot.mSequence.store(2 * pos + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.mItem = item;
+    slot.mSequence.store(2 * pos + 2, std::memory_order_release);
+    mAdded.store(pos + 1, std::memory_order_release);
+}
+
+template <class T>
+size_t SingleWriterRingBuffer<T>::copyRecent(T* out, size_t count) const {
+    uint64_t added = mAdded.load(std::memory_order_acquire);
+    size_t n = 0;
+    while (n < count && n < added && n < mLength) {
+        uint64_t pos = added - 1 - n;
+        const Slot& slot = mSlots[pos % mLength];
+
+        uint64_t sequence = slot.mSequence.load(std::memory_order_acquire);
+        out[n] = slot.mItem;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence != 2 * pos + 2 ||
+                slot.mSequence.load(std::memory_order_relaxed) != sequence) {
+            // The writer has wrapped around to this slot, so all older elements are gone too.
+            break;
+        }
+        ++n;
+    }
+    return n;
+}
+
+template <class T>
+bool SingleWriterRingBuffer<T>::front(T* out) const {
+    // The newest element can only be lost to a writer that has just added a newer one, try again.
+    while (mAdded.load(std::memory_order_acquire) != 0) {
+        if (copyRecent(out, 1) == 1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <class T>
+size_t SingleWriterRingBuffer<T>::size() const {
+    uint64_t added = mAdded.load(std::memory_order_acquire);
+    return added < mLength ? added : mLength;
+}
+
 }  // namespace SensorServiceUtil
 }; // namespace android
 
@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <inttypes.h>
 #include <sys/socket.h>
 #include <utils/threads.h>
 
@@ -60,20 +61,31 @@ void SensorService::SensorEventConnection::resetWakeLockRefCount() {
     mWakeLockRefCount = 0;
 }
 
+void SensorService::SensorEventConnection::setDirectChannel(
+        const sp<SensorDirectChannel>& channel) {
+    Mutex::Autolock _l(mConnectionLock);
+    mDirectChannel = channel;
+}
+
 void SensorService::SensorEventConnection::dump(String8& result) {
     Mutex::Autolock _l(mConnectionLock);
     result.appendFormat("\tOperating Mode: %s\n",mDataInjectionMode ? "DATA_INJECTION" : "NORMAL");
+    if (mDirectChannel != NULL) {
+        result.appendFormat("\t direct channel of %zu events\n", mDirectChannel->getCapacity());
+    }
     result.appendFormat("\t %s | WakeLockRefCount %d | uid %d | cache size %d | "
             "max cache size %d\n", mPackageName.string(), mWakeLockRefCount, mUid, mCacheSize,
             mMaxCacheSize);
     for (size_t i = 0; i < mSensorInfo.size(); ++i) {
         const FlushInfo& flushInfo = mSensorInfo.valueAt(i);
-        result.appendFormat("\t %s 0x%08x | status: %s | pending flush events %d \n",
+        result.appendFormat("\t %s 0x%08x | status: %s | pending flush events %d | "
+                            "sampling period %" PRId64 "us\n",
                             mService->getSensorName(mSensorInfo.keyAt(i)).string(),
                             mSensorInfo.keyAt(i),
                             flushInfo.mFirstFlushPending ? "First flush pending" :
                                                            "active",
-                            flushInfo.mPendingFlushEventsToSend);
+                            flushInfo.mPendingFlushEventsToSend,
+                            ns2us(flushInfo.mSamplingPeriodNs));
     }
 #if DEBUG_CONNECTIONS
     result.appendFormat("\t events recvd: %d | sent %d | cache %d | dropped %d |"
@@ -95,6 +107,12 @@ bool SensorService::SensorEventConnection::addSensor(int32_t handle) {
         mSensorInfo.indexOfKey(handle) >= 0) {
         return false;
     }
+    // A direct channel has no way to acknowledge events, wake-up sensors need that.
+    if (mDirectChannel != NULL && si->getSensor().isWakeUpSensor()) {
+        ALOGE("%s cannot use wake-up sensor %s through a direct channel",
+                mPackageName.string(), si->getSensor().getName().string());
+        return false;
+    }
     mSensorInfo.add(handle, FlushInfo());
     return true;
 }
@@ -129,6 +147,16 @@ bool SensorService::SensorEventConnection::hasOneShotSensors() const {
     return false;
 }
 
+void SensorService::SensorEventConnection::setSamplingPeriod(int32_t handle,
+                                nsecs_t samplingPeriodNs) {
+    Mutex::Autolock _l(mConnectionLock);
+    ssize_t index = mSensorInfo.indexOfKey(handle);
+    if (index >= 0) {
+        FlushInfo& flushInfo = mSensorInfo.editValueAt(index);
+        flushInfo.mSamplingPeriodNs = samplingPeriodNs;
+    }
+}
+
 String8 SensorService::SensorEventConnection::getPackageName() const {
     return mPackageName;
 }
@@ -206,73 +234,94 @@ void SensorService::SensorEventConnection::incrementPendingFlushCount(int32_t ha
 status_t SensorService::SensorEventConnection::sendEvents(
         sensors_event_t const* buffer, size_t numEvents,
         sensors_event_t* scratch,
-        wp<const SensorEventConnection> const * mapFlushEventsToConnections) {
+        wp<const SensorEventConnection> const * mapFlushEventsToConnections,
+        const SensorEventIndex* index) {
     // filter out events not for this connection
     int count = 0;
     Mutex::Autolock _l(mConnectionLock);
     if (scratch) {
-        size_t i=0;
-        while (i<numEvents) {
-            int32_t sensor_handle = buffer[i].sensor;
-            if (buffer[i].type == SENSOR_TYPE_META_DATA) {
-                ALOGD_IF(DEBUG_CONNECTIONS, "flush complete event sensor==%d ",
-                        buffer[i].meta_data.sensor);
-                // Setting sensor_handle to the correct sensor to ensure the sensor events per
-                // connection are filtered correctly.  buffer[i].sensor is zero for meta_data
-                // events.
-                sensor_handle = buffer[i].meta_data.sensor;
+        // Only visit the events of the sensors this connection registered for. Each sensor's
+        // events are in buffer order, merging them keeps the events sorted by timestamp.
+        mPendingSensorEvents.clear();
+        for (size_t i = 0; i < mSensorInfo.size(); ++i) {
+            PendingSensorEvents pending;
+            pending.positions = index->getPositions(mSensorInfo.keyAt(i), &pending.count);
+            if (pending.count) {
+                pending.sensorInfoIndex = i;
+                mPendingSensorEvents.push(pending);
             }
-
-            ssize_t index = mSensorInfo.indexOfKey(sensor_handle);
-            // Check if this connection has registered for this sensor. If not continue to the
-            // next sensor_event.
-            if (index < 0) {
-                ++i;
-                continue;
+        }
+        while (!mPendingSensorEvents.isEmpty()) {
+            size_t next = 0;
+            for (size_t j = 1; j < mPendingSensorEvents.size(); ++j) {
+                if (mPendingSensorEvents[j].positions[0] <
+                        mPendingSensorEvents[next].positions[0]) {
+                    next = j;
+                }
             }
-
-            FlushInfo& flushInfo = mSensorInfo.editValueAt(index);
-            // Check if there is a pending flush_complete event for this sensor on this connection.
-            if (buffer[i].type == SENSOR_TYPE_META_DATA && flushInfo.mFirstFlushPending == true &&
-                    mapFlushEventsToConnections[i] == this) {
-                flushInfo.mFirstFlushPending = false;
-                ALOGD_IF(DEBUG_CONNECTIONS, "First flush event for sensor==%d ",
-                        buffer[i].meta_data.sensor);
-                ++i;
-                continue;
+            PendingSensorEvents& pending = mPendingSensorEvents.editItemAt(next);
+            const size_t i = pending.positions[0];
+            FlushInfo& flushInfo = mSensorInfo.editValueAt(pending.sensorInfoIndex);
+            pending.positions++;
+            if (--pending.count == 0) {
+                mPendingSensorEvents.removeAt(next);
             }
 
-            // If there is a pending flush complete event for this sensor on this connection,
-            // ignore the event and proceed to the next.
+            const bool isFlushForThisConnection = buffer[i].type == SENSOR_TYPE_META_DATA &&
+                    mapFlushEventsToConnections[i] == this;
             if (flushInfo.mFirstFlushPending) {
-                ++i;
+                // Events of the sensor are only sent on this connection after the flush that came
+                // with the activation completed, that flush complete event itself is dropped.
+                if (isFlushForThisConnection) {
+                    flushInfo.mFirstFlushPending = false;
+                    ALOGD_IF(DEBUG_CONNECTIONS, "First flush event for sensor==%d ",
+                            buffer[i].meta_data.sensor);
+                }
                 continue;
             }
-
-            do {
-                // Keep copying events into the scratch buffer as long as they are regular
-                // sensor_events are from the same sensor_handle OR they are flush_complete_events
-                // from the same sensor_handle AND the current connection is mapped to the
-                // corresponding flush_complete_event.
-                if (buffer[i].type == SENSOR_TYPE_META_DATA) {
-                    if (mapFlushEventsToConnections[i] == this) {
-                        scratch[count++] = buffer[i];
-                    }
-                    ++i;
+            if (flushInfo.mSamplingPeriodNs && buffer[i].type != SENSOR_TYPE_META_DATA) {
+                // The HAL runs at the fastest rate asked for by any connection, only keep the
+                // events this connection asked for. The timestamps are what count, so batched
+                // events are decimated the same way. Allow for some jitter so that events which
+                // come at the requested rate are never dropped, and resynchronize if the
+                // timestamps go back in time.
+                const int64_t period = flushInfo.mSamplingPeriodNs;
+                const int64_t timestamp = buffer[i].timestamp;
+                if (timestamp < flushInfo.mNextTimestamp - period / SAMPLING_PERIOD_JITTER_RATIO &&
+                        timestamp >= flushInfo.mNextTimestamp - 2 * period) {
+                    continue;
+                }
+                // Keep to the requested schedule rather than to the events which happen to be
+                // sent, unless the sensor fell behind it.
+                flushInfo.mNextTimestamp = (timestamp < flushInfo.mNextTimestamp + period &&
+                                timestamp >= flushInfo.mNextTimestamp - period) ?
+                        flushInfo.mNextTimestamp + period : timestamp + period;
+            }
+            // Flush complete events are only sent to the connection which called flush.
+            if (buffer[i].type != SENSOR_TYPE_META_DATA || isFlushForThisConnection) {
+                ALOGD_IF(DEBUG_CONNECTIONS && isFlushForThisConnection,
+                        "flush complete event sensor==%d ", buffer[i].meta_data.sensor);
+                if (mDirectChannel != NULL) {
+                    // Copy straight into the shared ring, there is nothing to batch up.
+                    mDirectChannel->write(reinterpret_cast<ASensorEvent const*>(&buffer[i]), 1);
                 } else {
-                    // Regular sensor event, just copy it to the scratch buffer.
-                    scratch[count++] = buffer[i++];
+                    scratch[count++] = buffer[i];
                 }
-            } while ((i<numEvents) && ((buffer[i].sensor == sensor_handle &&
-                                        buffer[i].type != SENSOR_TYPE_META_DATA) ||
-                                       (buffer[i].type == SENSOR_TYPE_META_DATA  &&
-                                        buffer[i].meta_data.sensor == sensor_handle)));
+            }
         }
     } else {
         scratch = const_cast<sensors_event_t *>(buffer);
         count = numEvents;
     }
 
+    if (mDirectChannel != NULL) {
+        sendPendingFlushEventsLocked();
+        if (count) {
+            mDirectChannel->write(reinterpret_cast<ASensorEvent const*>(scratch), count);
+        }
+        return status_t(NO_ERROR);
+    }
+
     sendPendingFlushEventsLocked();
     // Early return if there are no events for this connection.
     if (count == 0) {
@@ -393,6 +442,14 @@ void SensorService::SensorEventConnection::sendPendingFlushEventsLocked() {
         }
 
         FlushInfo& flushInfo = mSensorInfo.editValueAt(i);
+        if (mDirectChannel != NULL) {
+            flushCompleteEvent.meta_data.sensor = handle;
+            while (flushInfo.mPendingFlushEventsToSend > 0) {
+                mDirectChannel->write(&flushCompleteEvent, 1);
+                flushInfo.mPendingFlushEventsToSend--;
+            }
+            continue;
+        }
         while (flushInfo.mPendingFlushEventsToSend > 0) {
             flushCompleteEvent.meta_data.sensor = handle;
             bool wakeUpSensor = si->getSensor().isWakeUpSensor();
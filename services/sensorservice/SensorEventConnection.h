@@ -34,6 +34,7 @@
 #include <gui/Sensor.h>
 #include <gui/BitTube.h>
 #include <gui/ISensorServer.h>
+#include <gui/SensorDirectChannel.h>
 #include <gui/ISensorEventConnection.h>
 
 #include "SensorService.h"
@@ -51,14 +52,21 @@ public:
     SensorEventConnection(const sp<SensorService>& service, uid_t uid, String8 packageName,
                           bool isDataInjectionMode, const String16& opPackageName);
 
+    // Writes the events in the buffer which are meant for this connection to its channel. If
+    // scratch is set, the events are filtered into it using index, which must have been built from
+    // the same buffer. Otherwise all the events are sent.
     status_t sendEvents(sensors_event_t const* buffer, size_t count, sensors_event_t* scratch,
-                        wp<const SensorEventConnection> const * mapFlushEventsToConnections = NULL);
+                        wp<const SensorEventConnection> const * mapFlushEventsToConnections = NULL,
+                        const SensorEventIndex* index = NULL);
     bool hasSensor(int32_t handle) const;
     bool hasAnySensor() const;
     bool hasOneShotSensors() const;
     bool addSensor(int32_t handle);
     bool removeSensor(int32_t handle);
     void setFirstFlushPending(int32_t handle, bool value);
+    // Sets the sampling period the connection asked for, events of the sensor which come faster
+    // because another connection asked for a higher rate are dropped. 0 delivers every event.
+    void setSamplingPeriod(int32_t handle, nsecs_t samplingPeriodNs);
     void dump(String8& result);
     bool needsWakeLock();
     void resetWakeLockRefCount();
@@ -66,6 +74,10 @@ public:
 
     uid_t getUid() const { return mUid; }
 
+    // Makes the connection write its events to channel instead of to its BitTube. Must be called
+    // before any sensor is added.
+    void setDirectChannel(const sp<SensorDirectChannel>& channel);
+
 private:
     virtual ~SensorEventConnection();
     virtual void onFirstRef();
@@ -148,11 +160,30 @@ private:
         // the events for the sensor are sent on that *connection*.
         bool mFirstFlushPending;
 
-        FlushInfo() : mPendingFlushEventsToSend(0), mFirstFlushPending(false) {}
+        // The sampling period requested on this connection, 0 if the events are not decimated,
+        // and the timestamp at which the next event is due.
+        nsecs_t mSamplingPeriodNs;
+        int64_t mNextTimestamp;
+
+        FlushInfo() : mPendingFlushEventsToSend(0), mFirstFlushPending(false),
+                mSamplingPeriodNs(0), mNextTimestamp(0) {}
     };
     // protected by SensorService::mLock. Key for this vector is the sensor handle.
     KeyedVector<int, FlushInfo> mSensorInfo;
 
+    // The events of the buffer passed to sendEvents() which are yet to be filtered, per registered
+    // sensor. Only used within sendEvents(), kept here so that it does not allocate every time.
+    struct PendingSensorEvents {
+        const size_t* positions;
+        size_t count;
+        size_t sensorInfoIndex;
+    };
+    Vector<PendingSensorEvents> mPendingSensorEvents;
+
+    // Set for connections created with createSensorDirectConnection(). Such connections never
+    // cache events, the channel overwrites the oldest ones instead.
+    sp<SensorDirectChannel> mDirectChannel;
+
     sensors_event_t *mEventCache;
     int mCacheSize, mMaxCacheSize;
     String8 mPackageName;
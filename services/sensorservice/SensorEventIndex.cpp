@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SensorEventIndex.h"
+
+#include <algorithm>
+
+namespace android {
+namespace SensorServiceUtil {
+
+void SensorEventIndex::build(sensors_event_t const* buffer, size_t count) {
+    mHandles.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        // buffer[i].sensor is zero for flush complete events.
+        mHandles[i] = buffer[i].type == SENSOR_TYPE_META_DATA ?
+                buffer[i].meta_data.sensor : buffer[i].sensor;
+    }
+
+    // Only a handful of sensors are active at a time, so a sorted vector of them is enough.
+    mEntries.clear();
+    for (size_t i = 0; i < count; i++) {
+        Entry key = { mHandles[i], 0, 0 };
+        auto it = std::lower_bound(mEntries.begin(), mEntries.end(), key);
+        if (it == mEntries.end() || it->handle != key.handle) {
+            it = mEntries.insert(it, key);
+        }
+        it->count++;
+    }
+
+    size_t start = 0;
+    for (Entry& entry : mEntries) {
+        entry.start = start;
+        start += entry.count;
+        entry.count = 0;
+    }
+
+    // Filling the runs in buffer order keeps the positions of each sensor sorted.
+    mPositions.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        Entry key = { mHandles[i], 0, 0 };
+        Entry& entry = *std::lower_bound(mEntries.begin(), mEntries.end(), key);
+        mPositions[entry.start + entry.count++] = i;
+    }
+}
+
+const size_t* SensorEventIndex::getPositions(int handle, size_t* outCount) const {
+    Entry key = { handle, 0, 0 };
+    auto it = std::lower_bound(mEntries.begin(), mEntries.end(), key);
+    if (it == mEntries.end() || it->handle != handle) {
+        *outCount = 0;
+        return NULL;
+    }
+    *outCount = it->count;
+    return &mPositions[it->start];
+}
+
+} // namespace SensorServiceUtil
+} // namespace android
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSOR_SERVICE_UTIL_SENSOR_EVENT_INDEX_H
+#define ANDROID_SENSOR_SERVICE_UTIL_SENSOR_EVENT_INDEX_H
+
+#include <hardware/sensors.h>
+
+#include <cstddef>
+#include <vector>
+
+namespace android {
+namespace SensorServiceUtil {
+
+// Groups the positions of the events in a buffer by sensor handle, so that each connection only
+// has to look at the events of the sensors it registered for instead of at the whole buffer. Flush
+// complete events are grouped with the sensor that was flushed. The storage is kept across calls
+// to build() to avoid allocating on every poll.
+class SensorEventIndex {
+public:
+    void build(sensors_event_t const* buffer, size_t count);
+
+    // Returns the positions in the buffer of the events of the given sensor in increasing order,
+    // or NULL if the buffer has none.
+    const size_t* getPositions(int handle, size_t* outCount) const;
+
+private:
+    struct Entry {
+        int handle;
+        size_t start;
+        size_t count;
+
+        bool operator<(const Entry& other) const { return handle < other.handle; }
+    };
+
+    // Sorted by handle. Each entry owns a run of mPositions.
+    std::vector<Entry> mEntries;
+    std::vector<size_t> mPositions;
+    std::vector<int> mHandles;
+};
+
+} // namespace SensorServiceUtil
+} // namespace android;
+
+#endif // ANDROID_SENSOR_SERVICE_UTIL_SENSOR_EVENT_INDEX_H
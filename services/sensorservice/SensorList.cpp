@@ -32,7 +32,10 @@ bool SensorList::add(
     if (handle == si->getSensor().getHandle() &&
         mUsedHandle.insert(handle).second) {
         // will succeed as the mUsedHandle does not have this handle
-        mHandleMap.emplace(handle, Entry(si, isForDebug, isVirtual));
+        auto entry = mHandleMap.emplace(handle, Entry(si, isForDebug, isVirtual)).first;
+        // std::map does not move its elements, so the index can point into it
+        mHandleIndex.emplace(handle, &entry->second);
+        mSensorListsValid = false;
         return true;
     }
     // handle exist already or handle mismatch
@@ -43,7 +46,9 @@ bool SensorList::remove(int handle) {
     std::lock_guard<std::mutex> lk(mLock);
     auto entry = mHandleMap.find(handle);
     if (entry != mHandleMap.end()) {
+        mHandleIndex.erase(handle);
         mHandleMap.erase(entry);
+        mSensorListsValid = false;
         return true;
     }
     return false;
@@ -66,30 +71,34 @@ bool SensorList::isNewHandle(int handle) const {
     return mUsedHandle.find(handle) == mUsedHandle.end();
 }
 
+void SensorList::updateSensorListsLocked() const {
+    if (mSensorListsValid) {
+        return;
+    }
+    mUserSensors.clear();
+    mUserDebugSensors.clear();
+    for (auto&& i : mHandleMap) {
+        const Entry& e = i.second;
+        if (!e.si->getSensor().isDynamicSensor()) {
+            mUserDebugSensors.add(e.si->getSensor());
+            if (!e.isForDebug) {
+                mUserSensors.add(e.si->getSensor());
+            }
+        }
+    }
+    mSensorListsValid = true;
+}
+
 const Vector<Sensor> SensorList::getUserSensors() const {
-    // lock in forEachEntry
-    Vector<Sensor> sensors;
-    forEachEntry(
-            [&sensors] (const Entry& e) -> bool {
-                if (!e.isForDebug && !e.si->getSensor().isDynamicSensor()) {
-                    sensors.add(e.si->getSensor());
-                }
-                return true;
-            });
-    return sensors;
+    std::lock_guard<std::mutex> lk(mLock);
+    updateSensorListsLocked();
+    return mUserSensors;
 }
 
 const Vector<Sensor> SensorList::getUserDebugSensors() const {
-    // lock in forEachEntry
-    Vector<Sensor> sensors;
-    forEachEntry(
-            [&sensors] (const Entry& e) -> bool {
-                if (!e.si->getSensor().isDynamicSensor()) {
-                    sensors.add(e.si->getSensor());
-                }
-                return true;
-            });
-    return sensors;
+    std::lock_guard<std::mutex> lk(mLock);
+    updateSensorListsLocked();
+    return mUserDebugSensors;
 }
 
 const Vector<Sensor> SensorList::getDynamicSensors() const {
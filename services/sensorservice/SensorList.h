@@ -26,6 +26,7 @@
 
 #include <map>
 #include <mutex>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
@@ -99,9 +100,22 @@ private:
     template <typename T, typename TF>
     T getOne(int handle, const TF& accessor, T def = T()) const;
 
+    // Builds the cached user and user debug sensor lists if a sensor was added or removed since
+    // they were last built. Called with mLock held.
+    void updateSensorListsLocked() const;
+
     mutable std::mutex mLock;
+    // in handle order, for iteration
     std::map<int, Entry> mHandleMap;
+    // the entries of mHandleMap by handle, for lookups on the enable and flush paths
+    std::unordered_map<int, const Entry*> mHandleIndex;
     std::unordered_set<int> mUsedHandle;
+
+    // getUserSensors() and getUserDebugSensors(), rebuilt when mSensorListsValid is false.
+    // Vector copies share their storage, so handing these out does not copy the sensors.
+    mutable bool mSensorListsValid = false;
+    mutable Vector<Sensor> mUserSensors;
+    mutable Vector<Sensor> mUserDebugSensors;
 };
 
 template <typename TF>
@@ -124,9 +138,9 @@ void SensorList::forEachEntry(const TF& f) const {
 template <typename T, typename TF>
 T SensorList::getOne(int handle, const TF& accessor, T def) const {
     std::lock_guard<std::mutex> lk(mLock);
-    auto i = mHandleMap.find(handle);
-    if (i != mHandleMap.end()) {
-        return accessor(i->second);
+    auto i = mHandleIndex.find(handle);
+    if (i != mHandleIndex.end()) {
+        return accessor(*i->second);
     } else {
         return def;
     }
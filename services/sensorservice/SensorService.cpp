@@ -21,6 +21,7 @@
 #include <binder/IServiceManager.h>
 #include <binder/PermissionCache.h>
 
+#include <gui/SensorDirectChannel.h>
 #include <gui/SensorEventQueue.h>
 
 #include <hardware/sensors.h>
@@ -54,6 +55,8 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <utility>
+
 namespace android {
 // ---------------------------------------------------------------------------
 
@@ -80,6 +83,10 @@ static const String16 sDump("android.permission.DUMP");
 SensorService::SensorService()
     : mInitCheck(NO_INIT), mSocketBufferSize(SOCKET_BUFFER_SIZE_NON_BATCHED),
       mWakeLockAcquired(false) {
+    // Keeping the history of recent events for dumpsys costs a copy and a clock read per event,
+    // user builds only keep the last event of each sensor unless asked to.
+    mLogRecentEventHistory = property_get_bool("debug.sensors.recent_events",
+            property_get_bool("ro.debuggable", false));
 }
 
 bool SensorService::initializeHmacKey() {
@@ -269,6 +276,17 @@ void SensorService::onFirstRef() {
                 mLastNSensorRegistrations.push();
             }
 
+            // Every static sensor is registered by now, only dynamic ones come and go later.
+            const Vector<Sensor> sharedSensors = mSensors.getUserDebugSensors();
+            mSensorListMemory = SensorListMemory::create(sharedSensors);
+            if (mSensorListMemory != NULL) {
+                for (size_t i = 0; i < sharedSensors.size(); i++) {
+                    mSensorListMemoryIndices.emplace(sharedSensors[i].getHandle(), uint32_t(i));
+                }
+            } else {
+                ALOGW("Couldn't share the sensor list, clients will fetch it over binder");
+            }
+
             mInitCheck = NO_ERROR;
             mAckReceiver = new SensorEventAckReceiver(this);
             mAckReceiver->run("SensorEventAckReceiver", PRIORITY_URGENT_DISPLAY);
@@ -284,7 +302,7 @@ const Sensor& SensorService::registerSensor(SensorInterface* s, bool isDebug, bo
     int handle = s->getSensor().getHandle();
     int type = s->getSensor().getType();
     if (mSensors.add(handle, s, isDebug, isVirtual)){
-        mRecentEvent.emplace(handle, new RecentEventLogger(type));
+        mRecentEvent.emplace(handle, new RecentEventLogger(type, mLogRecentEventHistory));
         return s->getSensor();
     } else {
         return mSensors.getNonSensor();
@@ -292,11 +310,18 @@ const Sensor& SensorService::registerSensor(SensorInterface* s, bool isDebug, bo
 }
 
 const Sensor& SensorService::registerDynamicSensorLocked(SensorInterface* s, bool isDebug) {
-    return registerSensor(s, isDebug);
+    const Sensor& sensor = registerSensor(s, isDebug);
+    if (mSensorListMemory != NULL) {
+        mSensorListMemory->dynamicSensorsChanged();
+    }
+    return sensor;
 }
 
 bool SensorService::unregisterDynamicSensorLocked(int handle) {
     bool ret = mSensors.remove(handle);
+    if (ret && mSensorListMemory != NULL) {
+        mSensorListMemory->dynamicSensorsChanged();
+    }
 
     const auto i = mRecentEvent.find(handle);
     if (i != mRecentEvent.end()) {
@@ -393,9 +418,12 @@ status_t SensorService::dump(int fd, const Vector<String16>& args) {
             SensorFusion::getInstance().dump(result);
 
             result.append("Recent Sensor events:\n");
+            if (!mLogRecentEventHistory) {
+                result.append("disabled (debug.sensors.recent_events)\n");
+            }
             for (auto&& i : mRecentEvent) {
                 sp<SensorInterface> s = mSensors.getInterface(i.first);
-                if (!i.second->isEmpty()) {
+                if (mLogRecentEventHistory && !i.second->isEmpty()) {
                     if (privileged || s->getSensor().getRequiredPermission().isEmpty()) {
                         i.second->setFormat("normal");
                     } else {
@@ -420,6 +448,11 @@ status_t SensorService::dump(int fd, const Vector<String16>& args) {
                                 mSocketBufferSize/sizeof(sensors_event_t));
             result.appendFormat("WakeLock Status: %s \n", mWakeLockAcquired ? "acquired" :
                     "not held");
+            result.appendFormat("Event processing: %" PRIu64 " batches, %" PRIu64 " events, "
+                    "%.1f us average and %.1f us max per batch\n",
+                    mBatchStats.batches, mBatchStats.events,
+                    mBatchStats.batches ? mBatchStats.totalTime / 1e3 / mBatchStats.batches : 0.0,
+                    mBatchStats.maxTime / 1e3);
             result.appendFormat("Mode :");
             switch(mCurrentOperatingMode) {
                case NORMAL:
@@ -515,11 +548,7 @@ bool SensorService::threadLoop() {
             ALOGE("sensor poll failed (%s)", strerror(-count));
             break;
         }
-
-        // Reset sensors_event_t.flags to zero for all events in the buffer.
-        for (int i = 0; i < count; i++) {
-             mSensorEventBuffer[i].flags = 0;
-        }
+        const nsecs_t batchStartTime = systemTime(SYSTEM_TIME_MONOTONIC);
 
         // Make a copy of the connection vector as some connections may be removed during the course
         // of this loop (especially when one-shot sensor events are present in the sensor_event
@@ -538,10 +567,9 @@ bool SensorService::threadLoop() {
         // releasing the wakelock.
         bool bufferHasWakeUpEvent = false;
         for (int i = 0; i < count; i++) {
-            if (isWakeUpSensorEvent(mSensorEventBuffer[i])) {
-                bufferHasWakeUpEvent = true;
-                break;
-            }
+            // Reset sensors_event_t.flags to zero for all events in the buffer.
+            mSensorEventBuffer[i].flags = 0;
+            bufferHasWakeUpEvent |= isWakeUpSensorEvent(mSensorEventBuffer[i]);
         }
 
         if (bufferHasWakeUpEvent && !mWakeLockAcquired) {
@@ -560,12 +588,24 @@ bool SensorService::threadLoop() {
                         fusion.process(event[i]);
                     }
                 }
-                for (size_t i=0 ; i<size_t(count) && k<minBufferSize ; i++) {
+                // A virtual sensor event has the timestamp of the event it was computed from, so
+                // it goes right after it. Every sensor's events stay in timestamp order that way
+                // without sorting the buffer, and the other events stay in the order the HAL
+                // returned them in.
+                sensors_event_t* const merged = mSensorEventScratch;
+                size_t n = 0;
+                bool full = false;
+                for (size_t i=0 ; i<size_t(count) ; i++) {
+                    merged[n++] = event[i];
                     for (int handle : mActiveVirtualSensors) {
+                        if (full) {
+                            break;
+                        }
                         if (count + k >= minBufferSize) {
                             ALOGE("buffer too small to hold all events: "
                                     "count=%zd, k=%zu, size=%zu",
                                     count, k, minBufferSize);
+                            full = true;
                             break;
                         }
                         sensors_event_t out;
@@ -576,33 +616,29 @@ bool SensorService::threadLoop() {
                         }
 
                         if (si->process(&out, event[i])) {
-                            mSensorEventBuffer[count + k] = out;
+                            // record the last synthesized value
+                            recordLastValueLocked(&out, 1);
+                            merged[n++] = out;
                             k++;
                         }
                     }
                 }
                 if (k) {
-                    // record the last synthesized values
-                    recordLastValueLocked(&mSensorEventBuffer[count], k);
                     count += k;
-                    // sort the buffer by time-stamps
-                    sortEventBuffer(mSensorEventBuffer, count);
+                    std::swap(mSensorEventBuffer, mSensorEventScratch);
                 }
             }
         }
 
-        // handle backward compatibility for RotationVector sensor
-        if (halVersion < SENSORS_DEVICE_API_VERSION_1_0) {
-            for (int i = 0; i < count; i++) {
-                if (mSensorEventBuffer[i].type == SENSOR_TYPE_ROTATION_VECTOR) {
-                    // All the 4 components of the quaternion should be available
-                    // No heading accuracy. Set it to -1
-                    mSensorEventBuffer[i].data[4] = -1;
-                }
+        for (int i = 0; i < count; ++i) {
+            // handle backward compatibility for RotationVector sensor
+            if (halVersion < SENSORS_DEVICE_API_VERSION_1_0 &&
+                    mSensorEventBuffer[i].type == SENSOR_TYPE_ROTATION_VECTOR) {
+                // All the 4 components of the quaternion should be available
+                // No heading accuracy. Set it to -1
+                mSensorEventBuffer[i].data[4] = -1;
             }
-        }
 
-        for (int i = 0; i < count; ++i) {
             // Map flush_complete_events in the buffer to SensorEventConnections which called flush
             // on the hardware sensor. mapFlushEventsToConnections[i] will be the
             // SensorEventConnection mapped to the corresponding flush_complete_event in
@@ -666,12 +702,13 @@ bool SensorService::threadLoop() {
 
         // Send our events to clients. Check the state of wake lock for each client and release the
         // lock if none of the clients need it.
+        mSensorEventIndex.build(mSensorEventBuffer, count);
         bool needsWakeLock = false;
         size_t numConnections = activeConnections.size();
         for (size_t i=0 ; i < numConnections; ++i) {
             if (activeConnections[i] != 0) {
                 activeConnections[i]->sendEvents(mSensorEventBuffer, count, mSensorEventScratch,
-                        mMapFlushEventsToConnections);
+                        mMapFlushEventsToConnections, &mSensorEventIndex);
                 needsWakeLock |= activeConnections[i]->needsWakeLock();
                 // If the connection has one-shot sensors, it may be cleaned up after first trigger.
                 // Early check for one-shot sensors.
@@ -685,6 +722,8 @@ bool SensorService::threadLoop() {
         if (mWakeLockAcquired && !needsWakeLock) {
             setWakeLockAcquiredLocked(false);
         }
+
+        mBatchStats.add(count, systemTime(SYSTEM_TIME_MONOTONIC) - batchStartTime);
     } while (!Thread::exitPending());
 
     ALOGW("Exiting SensorService::threadLoop => aborting...");
@@ -761,17 +800,6 @@ void SensorService::recordLastValueLocked(
     }
 }
 
-void SensorService::sortEventBuffer(sensors_event_t* buffer, size_t count) {
-    struct compar {
-        static int cmp(void const* lhs, void const* rhs) {
-            sensors_event_t const* l = static_cast<sensors_event_t const*>(lhs);
-            sensors_event_t const* r = static_cast<sensors_event_t const*>(rhs);
-            return l->timestamp - r->timestamp;
-        }
-    };
-    qsort(buffer, count, sizeof(sensors_event_t), compar::cmp);
-}
-
 String8 SensorService::getSensorName(int handle) const {
     return mSensors.getName(handle);
 }
@@ -809,6 +837,27 @@ int32_t SensorService::getIdFromUuid(const Sensor::uuid_t &uuid) const {
         return 0;
     }
 
+    const UuidIdKey key = { uuid, IPCThreadState::self()->getCallingUid() };
+    {
+        Mutex::Autolock _l(mUuidIdLock);
+        auto i = mUuidIds.find(key);
+        if (i != mUuidIds.end()) {
+            return i->second;
+        }
+    }
+
+    int32_t id = hashUuidForApp(uuid, key.appUserId);
+    if (id != 0) {
+        Mutex::Autolock _l(mUuidIdLock);
+        if (mUuidIds.size() >= MAX_CACHED_UUID_IDS) {
+            mUuidIds.clear();
+        }
+        mUuidIds.emplace(key, id);
+    }
+    return id;
+}
+
+int32_t SensorService::hashUuidForApp(const Sensor::uuid_t &uuid, uid_t appUserId) {
     // We want each app author/publisher to get a different ID, so that the
     // same dynamic sensor cannot be tracked across apps by multiple
     // authors/publishers.  So we use both our UUID and our User ID.
@@ -818,7 +867,6 @@ int32_t SensorService::getIdFromUuid(const Sensor::uuid_t &uuid) const {
     // We refrain from using "uid" except as needed by API to try to
     // keep this distinction clear.
 
-    auto appUserId = IPCThreadState::self()->getCallingUid();
     uint8_t uuidAndApp[sizeof(uuid) + sizeof(appUserId)];
     memcpy(uuidAndApp, &uuid, sizeof(uuid));
     memcpy(uuidAndApp + sizeof(uuid), &appUserId, sizeof(appUserId));
@@ -849,7 +897,7 @@ int32_t SensorService::getIdFromUuid(const Sensor::uuid_t &uuid) const {
     // as we can be with our current 'id' length.
     memcpy(&id, hash, sizeof(id));
 
-    // Note at the beginning of the function that we return the values of
+    // Note at the beginning of getIdFromUuid() that we return the values of
     // 0 and -1 to represent special cases.  As a result, we can't return
     // those as dynamic sensor IDs.  If we happened to hash to one of those
     // values, we change 'id' so we report as a dynamic sensor, and not as
@@ -910,6 +958,28 @@ Vector<Sensor> SensorService::getDynamicSensorList(const String16& opPackageName
     return accessibleSensorList;
 }
 
+sp<IMemory> SensorService::getSensorListMemory(const String16& opPackageName,
+        Vector<SensorListMemory::Entry>* entries) {
+    if (mSensorListMemory == NULL) {
+        return NULL;
+    }
+    const Vector<Sensor> accessibleSensorList = getSensorList(opPackageName);
+    entries->clear();
+    entries->setCapacity(accessibleSensorList.size());
+    for (const Sensor& sensor : accessibleSensorList) {
+        const auto i = mSensorListMemoryIndices.find(sensor.getHandle());
+        if (i == mSensorListMemoryIndices.end()) {
+            // Not a static sensor, let the client fetch the list instead.
+            return NULL;
+        }
+        SensorListMemory::Entry entry;
+        entry.index = i->second;
+        entry.id = sensor.getId();
+        entries->add(entry);
+    }
+    return mSensorListMemory->getMemory();
+}
+
 sp<ISensorEventConnection> SensorService::createSensorEventConnection(const String8& packageName,
         int requestedMode, const String16& opPackageName) {
     // Only 2 modes supported for a SensorEventConnection ... NORMAL and DATA_INJECTION.
@@ -939,6 +1009,19 @@ sp<ISensorEventConnection> SensorService::createSensorEventConnection(const Stri
     return result;
 }
 
+sp<ISensorEventConnection> SensorService::createSensorDirectConnection(
+        const String8& packageName, const String16& opPackageName, int fd) {
+    sp<SensorDirectChannel> channel = SensorDirectChannel::createFromFd(dup(fd));
+    if (channel == NULL) {
+        return NULL;
+    }
+    uid_t uid = IPCThreadState::self()->getCallingUid();
+    sp<SensorEventConnection> result(new SensorEventConnection(this, uid, packageName,
+            false /*isDataInjectionMode*/, opPackageName));
+    result->setDirectChannel(channel);
+    return result;
+}
+
 int SensorService::isDataInjectionEnabled() {
     Mutex::Autolock _l(mLock);
     return (mCurrentOperatingMode == DATA_INJECTION);
@@ -1086,6 +1169,9 @@ status_t SensorService::enable(const sp<SensorEventConnection>& connection,
 
     status_t err = sensor->batch(connection.get(), handle, 0, samplingPeriodNs,
                                  maxBatchReportLatencyNs);
+    if (err == NO_ERROR) {
+        connection->setSamplingPeriod(handle, decimatedSamplingPeriod(sensor, samplingPeriodNs));
+    }
 
     // Call flush() before calling activate() on the sensor. Wait for a first
     // flush complete event before sending events on this connection. Ignore
@@ -1210,7 +1296,21 @@ status_t SensorService::setEventRate(const sp<SensorEventConnection>& connection
         ns = minDelayNs;
     }
 
-    return sensor->setDelay(connection.get(), handle, ns);
+    status_t err = sensor->setDelay(connection.get(), handle, ns);
+    if (err == NO_ERROR) {
+        connection->setSamplingPeriod(handle, decimatedSamplingPeriod(sensor, ns));
+    }
+    return err;
+}
+
+nsecs_t SensorService::decimatedSamplingPeriod(const sp<SensorInterface>& sensor,
+        nsecs_t samplingPeriodNs) {
+    // Only continuous sensors have a rate, the events of the others are all meaningful.
+    if (sensor->getSensor().getReportingMode() != AREPORTING_MODE_CONTINUOUS ||
+            samplingPeriodNs <= sensor->getSensor().getMinDelayNs()) {
+        return 0;
+    }
+    return samplingPeriodNs;
 }
 
 status_t SensorService::flushSensor(const sp<SensorEventConnection>& connection,
@@ -1279,7 +1379,7 @@ bool SensorService::canAccessSensor(const Sensor& sensor, const char* operation,
     const int32_t opCode = sensor.getRequiredAppOp();
     if (opCode >= 0) {
         AppOpsManager appOps;
-        if (appOps.noteOp(opCode, IPCThreadState::self()->getCallingUid(), opPackageName)
+        if (appOps.noteOpAsync(opCode, IPCThreadState::self()->getCallingUid(), opPackageName)
                         != AppOpsManager::MODE_ALLOWED) {
             ALOGE("%s a sensor (%s) without enabled required app op: %d",
                     operation, sensor.getName().string(), opCode);
@@ -19,6 +19,7 @@
 
 #include "SensorList.h"
 #include "RecentEventLogger.h"
+#include "SensorEventIndex.h"
 
 #include <binder/BinderService.h>
 #include <cutils/compiler.h>
@@ -55,6 +56,9 @@
 
 #define SENSOR_REGISTRATIONS_BUF_SIZE 200
 
+// Events decimated to a connection's sampling period may come up to 1/8th of the period early.
+#define SAMPLING_PERIOD_JITTER_RATIO 8
+
 namespace android {
 // ---------------------------------------------------------------------------
 class SensorInterface;
@@ -150,10 +154,14 @@ private:
     // ISensorServer interface
     virtual Vector<Sensor> getSensorList(const String16& opPackageName);
     virtual Vector<Sensor> getDynamicSensorList(const String16& opPackageName);
+    virtual sp<IMemory> getSensorListMemory(const String16& opPackageName,
+            Vector<SensorListMemory::Entry>* entries);
     virtual sp<ISensorEventConnection> createSensorEventConnection(
             const String8& packageName,
             int requestedMode, const String16& opPackageName);
     virtual int isDataInjectionEnabled();
+    virtual sp<ISensorEventConnection> createSensorDirectConnection(const String8& packageName,
+            const String16& opPackageName, int fd);
     virtual status_t dump(int fd, const Vector<String16>& args);
 
     String8 getSensorName(int handle) const;
@@ -161,7 +169,6 @@ private:
     sp<SensorInterface> getSensorInterfaceFromHandle(int handle) const;
     bool isWakeUpSensor(int type) const;
     void recordLastValueLocked(sensors_event_t const* buffer, size_t count);
-    static void sortEventBuffer(sensors_event_t* buffer, size_t count);
     const Sensor& registerSensor(SensorInterface* sensor,
                                  bool isDebug = false, bool isVirtual = false);
     const Sensor& registerVirtualSensor(SensorInterface* sensor, bool isDebug = false);
@@ -173,6 +180,10 @@ private:
             sensors_event_t const* buffer, const int count);
     static bool canAccessSensor(const Sensor& sensor, const char* operation,
             const String16& opPackageName);
+    // The sampling period to decimate the events of sensor to on a connection which asked for
+    // samplingPeriodNs, 0 if all its events are to be delivered.
+    static nsecs_t decimatedSamplingPeriod(const sp<SensorInterface>& sensor,
+            nsecs_t samplingPeriodNs);
     // SensorService acquires a partial wakelock for delivering events from wake up sensors. This
     // method checks whether all the events from these wake up sensors have been delivered to the
     // corresponding applications, if yes the wakelock is released.
@@ -210,8 +221,10 @@ private:
 
     // Transforms the UUIDs for all the sensors into proper IDs.
     void makeUuidsIntoIdsForSensorList(Vector<Sensor> &sensorList) const;
-    // Gets the appropriate ID from the given UUID.
+    // Gets the appropriate ID from the given UUID, for the calling app.
     int32_t getIdFromUuid(const Sensor::uuid_t &uuid) const;
+    // Hashes a dynamic sensor UUID and an app's user ID into the ID that app sees.
+    static int32_t hashUuidForApp(const Sensor::uuid_t &uuid, uid_t appUserId);
     // Either read from storage or create a new one.
     static bool initializeHmacKey();
 
@@ -224,6 +237,32 @@ private:
     SensorList mSensors;
     status_t mInitCheck;
 
+    // The static sensors, including the debug ones, shared with every client, and their indices
+    // in it by handle. Set up once all static sensors are registered.
+    sp<SensorListMemory> mSensorListMemory;
+    std::unordered_map<int, uint32_t> mSensorListMemoryIndices;
+
+    // The IDs getIdFromUuid() has hashed, by dynamic sensor UUID and app user ID. Apps list the
+    // sensors every time they start, and the HMAC only needs to run once per UUID and app.
+    struct UuidIdKey {
+        Sensor::uuid_t uuid;
+        uid_t appUserId;
+        bool operator==(const UuidIdKey& other) const {
+            return uuid.i64[0] == other.uuid.i64[0] && uuid.i64[1] == other.uuid.i64[1] &&
+                    appUserId == other.appUserId;
+        }
+    };
+    struct UuidIdKeyHash {
+        size_t operator()(const UuidIdKey& key) const {
+            return std::hash<int64_t>()(key.uuid.i64[0] ^ (key.uuid.i64[1] * 31)) ^
+                    std::hash<uid_t>()(key.appUserId);
+        }
+    };
+    // Dropped when it grows past this, rather than keeping IDs for every app that ever ran.
+    static const size_t MAX_CACHED_UUID_IDS = 512;
+    mutable Mutex mUuidIdLock;
+    mutable std::unordered_map<UuidIdKey, int32_t, UuidIdKeyHash> mUuidIds;
+
     // Socket buffersize used to initialize BitTube. This size depends on whether batching is
     // supported or not.
     uint32_t mSocketBufferSize;
@@ -238,7 +277,30 @@ private:
     bool mWakeLockAcquired;
     sensors_event_t *mSensorEventBuffer, *mSensorEventScratch;
     wp<const SensorEventConnection> * mMapFlushEventsToConnections;
+    // The events of mSensorEventBuffer by sensor handle, rebuilt for every poll.
+    SensorEventIndex mSensorEventIndex;
+    // How long threadLoop() takes with the events of each poll, from the return of the poll to
+    // the events being written to the connections.
+    struct BatchStats {
+        uint64_t batches;
+        uint64_t events;
+        nsecs_t totalTime;
+        nsecs_t maxTime;
+
+        BatchStats() : batches(0), events(0), totalTime(0), maxTime(0) {}
+        void add(size_t count, nsecs_t time) {
+            batches++;
+            events += count;
+            totalTime += time;
+            if (time > maxTime) {
+                maxTime = time;
+            }
+        }
+    };
+    BatchStats mBatchStats;
     std::unordered_map<int, RecentEventLogger*> mRecentEvent;
+    // Whether mRecentEvent keeps a history of events for dumpsys or only the last one.
+    bool mLogRecentEventHistory;
     Mode mCurrentOperatingMode;
 
     // This packagaName is set when SensorService is in RESTRICTED or DATA_INJECTION mode. Only
@@ -6,20 +6,30 @@ LOCAL_CLANG := true
 LOCAL_ADDITIONAL_DEPENDENCIES := $(LOCAL_PATH)/Android.mk
 LOCAL_SRC_FILES := \
     Client.cpp \
+    DamageHistory.cpp \
     DisplayDevice.cpp \
     DispSync.cpp \
     EventControlThread.cpp \
     EventThread.cpp \
+    FenceMonitor.cpp \
     FenceTracker.cpp \
+    FrameHistory.cpp \
+    FrameStageMonitor.cpp \
     FrameTracker.cpp \
     GpuService.cpp \
     Layer.cpp \
     LayerDim.cpp \
     LayerBlur.cpp \
+    LayerCapture.cpp \
+    LayerSpatialIndex.cpp \
     MessageQueue.cpp \
     MonitoredProducer.cpp \
+    PhaseOffsetController.cpp \
+    RefreshRateScheduler.cpp \
     SurfaceFlingerConsumer.cpp \
     Transform.cpp \
+    VisibleRegionCache.cpp \
+    WorkerPool.cpp \
     DisplayHardware/FramebufferSurface.cpp \
     DisplayHardware/HWC2.cpp \
     DisplayHardware/HWC2On1Adapter.cpp \
@@ -28,6 +38,7 @@ LOCAL_SRC_FILES := \
     Effects/Daltonizer.cpp \
     EventLog/EventLogTags.logtags \
     EventLog/EventLog.cpp \
+    EventLog/FrameStatsFile.cpp \
     RenderEngine/Description.cpp \
     RenderEngine/Mesh.cpp \
     RenderEngine/Program.cpp \
@@ -35,7 +35,8 @@ const String16 sAccessSurfaceFlinger("android.permission.ACCESS_SURFACE_FLINGER"
 // ---------------------------------------------------------------------------
 
 Client::Client(const sp<SurfaceFlinger>& flinger)
-    : mFlinger(flinger)
+    : mFlinger(flinger),
+      mPid(IPCThreadState::self()->getCallingPid())
 {
 }
 
@@ -50,6 +50,9 @@ public:
 
     sp<Layer> getLayerUser(const sp<IBinder>& handle) const;
 
+    // the process that opened the connection
+    pid_t getPid() const { return mPid; }
+
 private:
     // ISurfaceComposerClient interface
     virtual status_t createSurface(
@@ -71,6 +74,7 @@ private:
 
     // constant
     sp<SurfaceFlinger> mFlinger;
+    const pid_t mPid;
 
     // protected by mLock
     DefaultKeyedVector< wp<IBinder>, wp<Layer> > mLayers;
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+
+#include <utility>
+
+#include "DamageHistory.h"
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+static uint64_t getArea(const Region& region) {
+    uint64_t area = 0;
+    size_t count;
+    const Rect* rects = region.getArray(&count);
+    for (size_t i = 0; i < count; i++) {
+        area += uint64_t(rects[i].getWidth()) * rects[i].getHeight();
+    }
+    return area;
+}
+
+DamageHistory::DamageHistory()
+    : mValidBuffers(0), mComposedReusable(false), mCompositions(0), mPartialCompositions(0),
+      mPixelsTotal(0), mPixelsRepainted(0)
+{
+}
+
+void DamageHistory::addDamage(const Region& dirty) {
+    mPending.orSelf(dirty);
+}
+
+bool DamageHistory::getRepaintRegion(int age, Region* repaint) const {
+    if (age < 1 || size_t(age) > mValidBuffers) {
+        return false;
+    }
+    *repaint = mPending;
+    for (int i = 0; i < age - 1; i++) {
+        repaint->orSelf(mHistory[i]);
+    }
+    return true;
+}
+
+Region DamageHistory::getSwapDamage(const Rect& bounds) const {
+    if (mValidBuffers == 0) {
+        return Region(bounds);
+    }
+    return mPending;
+}
+
+void DamageHistory::onSwap() {
+    if (mComposedReusable) {
+        for (size_t i = MAX_AGE - 2; i > 0; i--) {
+            mHistory[i] = std::move(mHistory[i - 1]);
+        }
+        mHistory[0] = std::move(mPending);
+        if (mValidBuffers < MAX_AGE) {
+            mValidBuffers++;
+        }
+    } else {
+        mValidBuffers = 0;
+    }
+    mPending.clear();
+    mComposedReusable = false;
+}
+
+void DamageHistory::reset() {
+    mValidBuffers = 0;
+    mPending.clear();
+    mComposedReusable = false;
+}
+
+void DamageHistory::recordComposition(const Region& repainted,
+        const Rect& bounds, bool reusable) {
+    mComposedReusable = reusable;
+    const uint64_t total = uint64_t(bounds.getWidth()) * bounds.getHeight();
+    const uint64_t area = getArea(repainted.intersect(bounds));
+    mCompositions++;
+    if (area < total) {
+        mPartialCompositions++;
+    }
+    mPixelsTotal += total;
+    mPixelsRepainted += area;
+}
+
+void DamageHistory::dump(String8& result) const {
+    const double saved = mPixelsTotal ?
+            100.0 * (mPixelsTotal - mPixelsRepainted) / mPixelsTotal : 0.0;
+    result.appendFormat("GLES compositions=%" PRIu64 ", partial=%" PRIu64
+            ", pixels saved=%.1f%%, reusable buffers=%zu\n",
+            mCompositions, mPartialCompositions, saved, mValidBuffers);
+}
+
+// ---------------------------------------------------------------------------
+
+}; // namespace android
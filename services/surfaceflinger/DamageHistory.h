@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_DAMAGEHISTORY_H
+#define ANDROID_DAMAGEHISTORY_H
+
+#include <stdint.h>
+
+#include <ui/Rect.h>
+#include <ui/Region.h>
+#include <utils/String8.h>
+
+namespace android {
+
+/*
+ * Tracks what changed on a display between the client target buffers it
+ * swapped, so that with EGL_EXT_buffer_age a GLES composition only has to
+ * redraw what the buffer it is given has missed.
+ *
+ * Every frame adds its dirty region, whether or not it is composed into a
+ * client target. A swapped buffer can be reused only if it holds the whole
+ * screen, i.e. it was composed entirely with GLES; a buffer with holes for
+ * HWC layers resets the history.
+ */
+class DamageHistory {
+public:
+    DamageHistory();
+
+    // Adds what changed on screen this frame.
+    void addDamage(const Region& dirty);
+
+    // Sets repaint to what a buffer of the given age has to redraw to be up
+    // to date. Returns false if that is not known and the whole buffer has
+    // to be drawn.
+    bool getRepaintRegion(int age, Region* repaint) const;
+
+    // Returns what changed since the last buffer was swapped, for
+    // eglSwapBuffersWithDamageKHR; that is all of bounds when unknown.
+    Region getSwapDamage(const Rect& bounds) const;
+
+    // Records a swapped buffer; it can be reused if the last composition
+    // recorded for it was done entirely with GLES.
+    void onSwap();
+
+    // Forgets every buffer, e.g. when the display changes size.
+    void reset();
+
+    // Records a GLES composition into the next buffer to be swapped, which
+    // drew repainted out of bounds. reusable is false if it left holes for
+    // HWC layers.
+    void recordComposition(const Region& repainted, const Rect& bounds,
+            bool reusable);
+
+    void dump(String8& result) const;
+
+private:
+    // Android surfaces have at most a few buffers, older ones are not
+    // worth tracking
+    enum { MAX_AGE = 4 };
+
+    // mHistory[i] is what changed between the buffers of age i + 2 and
+    // i + 1 (counting the pending damage as age 0)
+    Region mHistory[MAX_AGE - 1];
+    // number of buffers, from age 1 up, that are known to hold a whole
+    // frame
+    size_t mValidBuffers;
+    // what changed since the last buffer was swapped
+    Region mPending;
+    // whether the buffer being composed can be reused
+    bool mComposedReusable;
+
+    uint64_t mCompositions;
+    uint64_t mPartialCompositions;
+    uint64_t mPixelsTotal;
+    uint64_t mPixelsRepainted;
+};
+
+}; // namespace android
+
+#endif // ANDROID_DAMAGEHISTORY_H
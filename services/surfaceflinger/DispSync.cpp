@@ -653,6 +653,11 @@ void DispSync::resetErrorLocked() {
     }
 }
 
+bool DispSync::isModelMarginal() const {
+    Mutex::Autolock lock(mMutex);
+    return mError > kErrorThreshold / 4;
+}
+
 nsecs_t DispSync::computeNextRefresh(int periodOffset) const {
     Mutex::Autolock lock(mMutex);
     nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
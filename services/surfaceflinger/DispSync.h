@@ -101,6 +101,10 @@ public:
     // The getPeriod method returns the current vsync period.
     nsecs_t getPeriod();
 
+    // isModelMarginal returns whether the error measured against the last
+    // present fences is close to the point where a resync is needed.
+    bool isModelMarginal() const;
+
     // setRefreshSkipCount specifies an additional number of refresh
     // cycles to skip.  For example, on a 60Hz display, a skip count of 1
     // will result in events happening at 30Hz.  Default is zero.  The idea
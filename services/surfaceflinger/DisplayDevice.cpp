@@ -69,6 +69,7 @@ inline void eglSetSwapRectangleANDROID (EGLDisplay, EGLSurface, EGLint, EGLint,
  */
 
 uint32_t DisplayDevice::sPrimaryDisplayOrientation = 0;
+uint64_t DisplayDevice::sNextProjectionId = 1;
 
 DisplayDevice::DisplayDevice(
         const sp<SurfaceFlinger>& flinger,
@@ -96,6 +97,8 @@ DisplayDevice::DisplayDevice(
       mFormat(),
 #endif
       mFlags(),
+      mUseBufferAge(false),
+      mUseSwapWithDamage(false),
       mPageFlipCount(),
       mIsSecure(isSecure),
       mLayerStack(NO_LAYER_STACK),
@@ -145,6 +148,18 @@ DisplayDevice::DisplayDevice(
     mViewport.makeInvalid();
     mFrame.makeInvalid();
 
+    // Virtual display buffers go to a consumer that may hand them back
+    // changed, so only physical displays redraw just what is missing.
+    property_get("debug.sf.buffer_age", property, "1");
+    if (atoi(property) && mType < DisplayDevice::DISPLAY_VIRTUAL) {
+        const char* const extensions = eglQueryString(display, EGL_EXTENSIONS);
+        if (extensions && strstr(extensions, "EGL_EXT_buffer_age")) {
+            mUseBufferAge = true;
+            mUseSwapWithDamage =
+                    strstr(extensions, "EGL_KHR_swap_buffers_with_damage");
+        }
+    }
+
     // virtual displays are always considered enabled
     mPowerMode = (mType >= DisplayDevice::DISPLAY_VIRTUAL) ?
                   HWC_POWER_MODE_NORMAL : HWC_POWER_MODE_OFF;
@@ -316,7 +331,15 @@ void DisplayDevice::swapBuffers(HWComposer& hwc) const {
             (hwc.hasGlesComposition(mHwcDisplayId) &&
              (hwc.supportsFramebufferTarget() || mType >= DISPLAY_VIRTUAL))) {
 #endif
-        EGLBoolean success = eglSwapBuffers(mDisplay, mSurface);
+        EGLBoolean success;
+        if (mUseSwapWithDamage) {
+            success = swapBuffersWithDamage();
+        } else {
+            success = eglSwapBuffers(mDisplay, mSurface);
+        }
+        if (mUseBufferAge) {
+            damageHistory.onSwap();
+        }
         if (!success) {
             EGLint error = eglGetError();
             if (error == EGL_CONTEXT_LOST ||
@@ -337,6 +360,27 @@ void DisplayDevice::swapBuffers(HWComposer& hwc) const {
     }
 }
 
+EGLBoolean DisplayDevice::swapBuffersWithDamage() const {
+    const Region damage(damageHistory.getSwapDamage(getBounds()));
+    size_t count;
+    const Rect* rects = damage.getArray(&count);
+    if (count == 0) {
+        // an empty list would mean the whole surface
+        return eglSwapBuffers(mDisplay, mSurface);
+    }
+    // EGL wants x, y, width, height with a bottom-left origin
+    Vector<EGLint> eglRects;
+    eglRects.resize(count * 4);
+    EGLint* r = eglRects.editArray();
+    for (size_t i = 0; i < count; i++) {
+        r[i * 4 + 0] = rects[i].left;
+        r[i * 4 + 1] = mDisplayHeight - rects[i].bottom;
+        r[i * 4 + 2] = rects[i].getWidth();
+        r[i * 4 + 3] = rects[i].getHeight();
+    }
+    return eglSwapBuffersWithDamageKHR(mDisplay, mSurface, r, EGLint(count));
+}
+
 #ifdef USE_HWC2
 void DisplayDevice::onSwapBuffersCompleted() const {
     mDisplaySurface->onFrameCommitted();
@@ -354,6 +398,14 @@ uint32_t DisplayDevice::getFlags() const
     return mFlags;
 }
 
+int DisplayDevice::getBufferAge() const {
+    EGLint age = 0;
+    if (!eglQuerySurface(mDisplay, mSurface, EGL_BUFFER_AGE_EXT, &age)) {
+        return 0;
+    }
+    return age;
+}
+
 EGLBoolean DisplayDevice::makeCurrent(EGLDisplay dpy, EGLContext ctx) const {
     EGLBoolean result = EGL_TRUE;
     EGLSurface sur = eglGetCurrentSurface(EGL_DRAW);
@@ -500,6 +552,7 @@ status_t DisplayDevice::orientationToTransfrom(
 
 void DisplayDevice::setDisplaySize(const int newWidth, const int newHeight) {
     dirtyRegion.set(getBounds());
+    damageHistory.reset();
 
     if (mSurface != EGL_NO_SURFACE) {
         eglDestroySurface(mDisplay, mSurface);
@@ -577,6 +630,7 @@ void DisplayDevice::setProjection(int orientation,
     // Apply the logical translation, scale to physical size, apply the
     // physical translation and finally rotate to the physical orientation.
     mGlobalTransform = R * TP * S * TL;
+    mProjectionId = sNextProjectionId++;
 
     const uint8_t type = mGlobalTransform.getType();
     mNeedsFiltering = (!mGlobalTransform.preserveRects() ||
@@ -634,6 +688,14 @@ void DisplayDevice::dump(String8& result) const {
         tr[0][1], tr[1][1], tr[2][1],
         tr[0][2], tr[1][2], tr[2][2]);
 
+    result.append("   visible region cache: ");
+    visibleRegionCache.dump(result);
+    if (mUseBufferAge) {
+        result.appendFormat("   buffer age%s: ",
+                mUseSwapWithDamage ? " (swap with damage)" : "");
+        damageHistory.dump(result);
+    }
+
     String8 surfaceDump;
     mDisplaySurface->dumpAsString(surfaceDump);
     result.append(surfaceDump);
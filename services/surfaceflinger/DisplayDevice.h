@@ -17,7 +17,10 @@
 #ifndef ANDROID_DISPLAY_DEVICE_H
 #define ANDROID_DISPLAY_DEVICE_H
 
+#include "DamageHistory.h"
+#include "LayerSpatialIndex.h"
 #include "Transform.h"
+#include "VisibleRegionCache.h"
 
 #include <stdlib.h>
 
@@ -65,6 +68,20 @@ public:
     // region in screen space
     Region undefinedRegion;
     bool lastCompositionHadVisibleLayers;
+    // what the last visible region pass found for this display's layers
+    VisibleRegionCache visibleRegionCache;
+    // the bounds of the layers that pass has been through so far
+    LayerSpatialIndex aboveLayersIndex;
+    // screen space damage per client target buffer, used with buffer age
+    mutable DamageHistory damageHistory;
+#ifdef USE_HWC2
+    // the HWC still shows exactly the last frame it was given, with no
+    // validate or present failing since
+    bool hwcFrameCurrent = false;
+    // nothing changed since that frame, so this one is neither validated
+    // nor presented
+    bool skipHwcFrame = false;
+#endif
 
     enum DisplayType {
         DISPLAY_ID_INVALID = -1,
@@ -117,6 +134,13 @@ public:
 #endif
     uint32_t    getFlags() const;
 
+    // whether GLES composition only redraws what the client target buffer
+    // is missing (EGL_EXT_buffer_age)
+    bool        usesBufferAge() const { return mUseBufferAge; }
+    // the age of the current back buffer, 0 if unknown; the display must be
+    // current
+    int         getBufferAge() const;
+
     EGLSurface  getEGLSurface() const;
 
     void                    setVisibleLayersSortedByZ(const Vector< sp<Layer> >& layers);
@@ -131,6 +155,9 @@ public:
     uint32_t                getOrientationTransform() const;
     static uint32_t         getPrimaryDisplayOrientationTransform();
     const Transform&        getTransform() const { return mGlobalTransform; }
+    // changes whenever setProjection() is called, and is never the same
+    // for two displays, so it can identify getTransform()'s value
+    uint64_t                getProjectionId() const { return mProjectionId; }
     const Rect              getViewport() const { return mViewport; }
     const Rect              getFrame() const { return mFrame; }
     const Rect&             getScissor() const { return mScissor; }
@@ -228,6 +255,9 @@ private:
     PixelFormat     mFormat;
 #endif
     uint32_t        mFlags;
+    // EGL_EXT_buffer_age and EGL_KHR_swap_buffers_with_damage in use
+    bool            mUseBufferAge;
+    bool            mUseSwapWithDamage;
     mutable uint32_t mPageFlipCount;
     String8         mDisplayName;
     bool            mIsSecure;
@@ -246,6 +276,8 @@ private:
     status_t orientationToTransfrom(int orientation,
             int w, int h, Transform* tr);
 
+    EGLBoolean swapBuffersWithDamage() const;
+
     uint32_t mLayerStack;
     int mOrientation;
     static uint32_t sPrimaryDisplayOrientation;
@@ -256,6 +288,8 @@ private:
     // pre-computed scissor to apply to the display
     Rect mScissor;
     Transform mGlobalTransform;
+    uint64_t mProjectionId;
+    static uint64_t sNextProjectionId;
     bool mNeedsFiltering;
     // Current power mode
     int mPowerMode;
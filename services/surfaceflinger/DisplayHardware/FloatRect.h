@@ -37,6 +37,14 @@ public:
 
     inline float getWidth() const { return right - left; }
     inline float getHeight() const { return bottom - top; }
+
+    inline bool operator==(const FloatRect& rhs) const {
+        return left == rhs.left && top == rhs.top && right == rhs.right &&
+                bottom == rhs.bottom;
+    }
+    inline bool operator!=(const FloatRect& rhs) const {
+        return !operator==(rhs);
+    }
 };
 
 }; // namespace android
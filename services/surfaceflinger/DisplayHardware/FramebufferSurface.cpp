@@ -25,6 +25,7 @@
 #include <errno.h>
 
 #include <cutils/log.h>
+#include <cutils/properties.h>
 
 #include <utils/String8.h>
 
@@ -45,6 +46,11 @@
 #define NUM_FRAMEBUFFER_SURFACE_BUFFERS (2)
 #endif
 
+// Whether framebuffer HALs post on their own thread unless the
+// ro.sf.async_fb_post property says otherwise: only deeper buffering has a
+// buffer to compose into while another one is being posted.
+#define ASYNC_FB_POST_DEFAULT (NUM_FRAMEBUFFER_SURFACE_BUFFERS > 2)
+
 // ----------------------------------------------------------------------------
 namespace android {
 // ----------------------------------------------------------------------------
@@ -62,14 +68,10 @@ FramebufferSurface::FramebufferSurface(HWComposer& hwc, int disp,
     mCurrentBufferSlot(-1),
     mCurrentBuffer(),
     mCurrentFence(Fence::NO_FENCE),
-#ifdef USE_HWC2
     mHwc(hwc),
     mHasPendingRelease(false),
     mPreviousBufferSlot(BufferQueue::INVALID_BUFFER_SLOT),
     mPreviousBuffer()
-#else
-    mHwc(hwc)
-#endif
 {
 #ifdef USE_HWC2
     ALOGV("Creating for display %d", disp);
@@ -89,6 +91,24 @@ FramebufferSurface::FramebufferSurface(HWComposer& hwc, int disp,
     mConsumer->setDefaultBufferSize(mHwc.getWidth(disp), mHwc.getHeight(disp));
 #endif
     mConsumer->setMaxAcquiredBufferCount(NUM_FRAMEBUFFER_SURFACE_BUFFERS - 1);
+
+#ifndef USE_HWC2
+    // With a framebuffer target, HWC needs the buffer before the frame is
+    // committed; only the framebuffer HAL's post() can happen later.
+    if (!mHwc.supportsFramebufferTarget() &&
+            property_get_int32("ro.sf.async_fb_post", ASYNC_FB_POST_DEFAULT)) {
+        mPostThread = new PostThread(this);
+        mPostThread->run("FramebufferPost", PRIORITY_URGENT_DISPLAY);
+    }
+#endif
+}
+
+FramebufferSurface::~FramebufferSurface() {
+#ifndef USE_HWC2
+    if (mPostThread != NULL) {
+        mPostThread->stop();
+    }
+#endif
 }
 
 status_t FramebufferSurface::beginFrame(bool /*mustRecompose*/) {
@@ -152,21 +172,31 @@ status_t FramebufferSurface::nextBuffer(sp<GraphicBuffer>& outBuffer, sp<Fence>&
     if (mCurrentBufferSlot != BufferQueue::INVALID_BUFFER_SLOT &&
         item.mSlot != mCurrentBufferSlot) {
 #ifdef USE_HWC2
-        mHasPendingRelease = true;
-        mPreviousBufferSlot = mCurrentBufferSlot;
-        mPreviousBuffer = mCurrentBuffer;
+        const bool deferRelease = true;
 #else
-        // Release the previous buffer.
-        err = releaseBufferLocked(mCurrentBufferSlot, mCurrentBuffer,
-                EGL_NO_DISPLAY, EGL_NO_SYNC_KHR);
-        if (err < NO_ERROR) {
-            ALOGE("error releasing buffer: %s (%d)", strerror(-err), err);
-            return err;
-        }
+        // the previous buffer is on screen until the new one is posted
+        const bool deferRelease = mPostThread != NULL;
 #endif
+        if (deferRelease) {
+            mHasPendingRelease = true;
+            mPreviousBufferSlot = mCurrentBufferSlot;
+            mPreviousBuffer = mCurrentBuffer;
+        } else {
+            // Release the previous buffer.
+            err = releaseBufferLocked(mCurrentBufferSlot, mCurrentBuffer,
+                    EGL_NO_DISPLAY, EGL_NO_SYNC_KHR);
+            if (err < NO_ERROR) {
+                ALOGE("error releasing buffer: %s (%d)", strerror(-err), err);
+                return err;
+            }
+        }
     }
     mCurrentBufferSlot = item.mSlot;
     mCurrentBuffer = mSlots[mCurrentBufferSlot].mGraphicBuffer;
+#ifndef USE_HWC2
+    // onFrameAvailable() tracks it on the composition thread instead
+    if (mPostThread == NULL)
+#endif
     mCurrentFence = item.mFence;
 
     outFence = item.mFence;
@@ -179,7 +209,15 @@ status_t FramebufferSurface::nextBuffer(sp<GraphicBuffer>& outBuffer, sp<Fence>&
 
 #ifndef USE_HWC2
 // Overrides ConsumerBase::onFrameAvailable(), does not call base class impl.
-void FramebufferSurface::onFrameAvailable(const BufferItem& /* item */) {
+void FramebufferSurface::onFrameAvailable(const BufferItem& item) {
+    if (mPostThread != NULL) {
+        // This is called from queueBuffer() on the composition thread, which
+        // is the one asking for getClientTargetAcquireFence().
+        mCurrentFence = item.mFence;
+        mPostThread->queueFrame();
+        return;
+    }
+
     sp<GraphicBuffer> buf;
     sp<Fence> acquireFence;
     status_t err = nextBuffer(buf, acquireFence);
@@ -193,6 +231,65 @@ void FramebufferSurface::onFrameAvailable(const BufferItem& /* item */) {
         ALOGE("error posting framebuffer: %d", err);
     }
 }
+
+void FramebufferSurface::postNextBuffer() {
+    sp<GraphicBuffer> buf;
+    sp<Fence> acquireFence;
+    status_t err = nextBuffer(buf, acquireFence);
+    if (err != NO_ERROR) {
+        ALOGE("error latching next FramebufferSurface buffer: %s (%d)",
+                strerror(-err), err);
+        return;
+    }
+    err = mHwc.fbPost(mDisplayType, acquireFence, buf);
+    if (err != NO_ERROR) {
+        ALOGE("error posting framebuffer: %d", err);
+    }
+
+    Mutex::Autolock lock(mMutex);
+    if (mHasPendingRelease) {
+        err = releaseBufferLocked(mPreviousBufferSlot, mPreviousBuffer,
+                EGL_NO_DISPLAY, EGL_NO_SYNC_KHR);
+        ALOGE_IF(err != NO_ERROR, "postNextBuffer: error releasing buffer: "
+                "%s (%d)", strerror(-err), err);
+        mPreviousBuffer.clear();
+        mHasPendingRelease = false;
+    }
+}
+
+FramebufferSurface::PostThread::PostThread(FramebufferSurface* surface)
+    : mSurface(surface), mQueuedFrames(0), mStopped(false) {
+}
+
+void FramebufferSurface::PostThread::queueFrame() {
+    Mutex::Autolock lock(mLock);
+    mQueuedFrames++;
+    mCondition.signal();
+}
+
+void FramebufferSurface::PostThread::stop() {
+    {
+        Mutex::Autolock lock(mLock);
+        mStopped = true;
+        mCondition.signal();
+    }
+    requestExitAndWait();
+}
+
+bool FramebufferSurface::PostThread::threadLoop() {
+    {
+        Mutex::Autolock lock(mLock);
+        while (mQueuedFrames == 0 && !mStopped) {
+            mCondition.wait(mLock);
+        }
+        if (mStopped) {
+            return false;
+        }
+        mQueuedFrames--;
+    }
+    mSurface->postNextBuffer();
+    return true;
+}
 #endif
 
 void FramebufferSurface::freeBufferLocked(int slotIndex) {
@@ -222,9 +319,11 @@ void FramebufferSurface::onFrameCommitted() {
     }
 #else
     sp<Fence> fence = mHwc.getAndResetReleaseFence(mDisplayType);
+    // the PostThread may be latching a new buffer
+    Mutex::Autolock lock(mMutex);
     if (fence->isValid() &&
             mCurrentBufferSlot != BufferQueue::INVALID_BUFFER_SLOT) {
-        status_t err = addReleaseFence(mCurrentBufferSlot,
+        status_t err = addReleaseFenceLocked(mCurrentBufferSlot,
                 mCurrentBuffer, fence);
         ALOGE_IF(err, "setReleaseFenceFd: failed to add the fence: %s (%d)",
                 strerror(-err), err);
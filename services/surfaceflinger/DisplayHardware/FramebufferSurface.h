@@ -22,6 +22,10 @@
 
 #include <gui/ConsumerBase.h>
 
+#include <utils/Condition.h>
+#include <utils/Mutex.h>
+#include <utils/Thread.h>
+
 #include "DisplaySurface.h"
 
 // ---------------------------------------------------------------------------
@@ -55,7 +59,7 @@ public:
     virtual const sp<Fence>& getClientTargetAcquireFence() const override;
 
 private:
-    virtual ~FramebufferSurface() { }; // this class cannot be overloaded
+    virtual ~FramebufferSurface(); // this class cannot be overloaded
 
 #ifndef USE_HWC2
     virtual void onFrameAvailable(const BufferItem& item);
@@ -74,6 +78,34 @@ private:
     status_t nextBuffer(sp<GraphicBuffer>& outBuffer, sp<Fence>& outFence);
 #endif
 
+#ifndef USE_HWC2
+    // Posts the framebuffer targets off the composition thread, so that a
+    // framebuffer HAL waiting for the vsync in post() doesn't hold back the
+    // composition of the next frame.
+    class PostThread : public Thread {
+    public:
+        explicit PostThread(FramebufferSurface* surface);
+        void queueFrame();
+        void stop();
+    private:
+        virtual bool threadLoop();
+
+        // the surface stops the thread before it goes away
+        FramebufferSurface* const mSurface;
+        Mutex mLock;
+        Condition mCondition;
+        size_t mQueuedFrames;
+        bool mStopped;
+    };
+
+    // Latches and posts the next buffer on the PostThread, and then releases
+    // the buffer it took off the screen.
+    void postNextBuffer();
+
+    // Set when posting happens on mPostThread.
+    sp<PostThread> mPostThread;
+#endif
+
     // mDisplayType must match one of the HWC display types
     int mDisplayType;
 
@@ -92,12 +124,11 @@ private:
     // Hardware composer, owned by SurfaceFlinger.
     HWComposer& mHwc;
 
-#ifdef USE_HWC2
-    // Previous buffer to release after getting an updated retire fence
+    // Previous buffer to release after getting an updated retire fence, or
+    // once the current buffer has been posted by mPostThread
     bool mHasPendingRelease;
     int mPreviousBufferSlot;
     sp<GraphicBuffer> mPreviousBuffer;
-#endif
 };
 
 // ---------------------------------------------------------------------------
@@ -135,7 +135,9 @@ Device::Device(hwc2_device_t* device)
     mRefresh(),
     mPendingRefreshes(),
     mVsync(),
-    mPendingVsyncs()
+    mPendingVsyncs(),
+    mLayerStateCalls(0),
+    mLayerStateCallsSaved(0)
 {
     loadCapabilities();
     loadFunctionPointers();
@@ -954,7 +956,19 @@ Layer::Layer(const std::shared_ptr<Display>& display, hwc2_layer_t id)
   : mDisplay(display),
     mDisplayId(display->getId()),
     mDevice(display->getDevice()),
-    mId(id)
+    mId(id),
+    mSentState(0),
+    mBlendMode(BlendMode::Invalid),
+    mColor(),
+    mDataspace(HAL_DATASPACE_UNKNOWN),
+    mDisplayFrame(),
+    mPlaneAlpha(0.0f),
+    mSidebandStream(nullptr),
+    mSourceCrop(),
+    mSurfaceDamage(),
+    mTransform(Transform::None),
+    mVisibleRegion(),
+    mZOrder(0)
 {
     ALOGV("Created layer %" PRIu64 " on display %" PRIu64, id,
             display->getId());
@@ -968,6 +982,56 @@ Layer::~Layer()
     }
 }
 
+bool Layer::isStateSent(uint32_t state, bool sameValue)
+{
+    if ((mSentState & state) && sameValue) {
+        ++mDevice.mLayerStateCallsSaved;
+        return true;
+    }
+    return false;
+}
+
+Error Layer::onStateSent(uint32_t state, int32_t intError)
+{
+    ++mDevice.mLayerStateCalls;
+    auto error = static_cast<Error>(intError);
+    if (error == Error::None) {
+        mSentState |= state;
+    } else {
+        mSentState &= ~state;
+    }
+    return error;
+}
+
+static bool sameRects(const std::vector<hwc_rect_t>& hwcRects,
+        const Rect* rects, size_t rectCount)
+{
+    if (hwcRects.size() != rectCount) {
+        return false;
+    }
+    for (size_t rect = 0; rect < rectCount; ++rect) {
+        const hwc_rect_t& hwcRect = hwcRects[rect];
+        if (hwcRect.left != rects[rect].left ||
+                hwcRect.top != rects[rect].top ||
+                hwcRect.right != rects[rect].right ||
+                hwcRect.bottom != rects[rect].bottom) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void setRects(std::vector<hwc_rect_t>* hwcRects, const Rect* rects,
+        size_t rectCount)
+{
+    // keeps the capacity, so that sending a region does not allocate
+    hwcRects->clear();
+    for (size_t rect = 0; rect < rectCount; ++rect) {
+        hwcRects->push_back({rects[rect].left, rects[rect].top,
+                rects[rect].right, rects[rect].bottom});
+    }
+}
+
 Error Layer::setCursorPosition(int32_t x, int32_t y)
 {
     int32_t intError = mDevice.mSetCursorPosition(mDevice.mHwcDevice,
@@ -988,44 +1052,49 @@ Error Layer::setSurfaceDamage(const Region& damage)
 {
     // We encode default full-screen damage as INVALID_RECT upstream, but as 0
     // rects for HWC
-    int32_t intError = 0;
-    if (damage.isRect() && damage.getBounds() == Rect::INVALID_RECT) {
-        intError = mDevice.mSetLayerSurfaceDamage(mDevice.mHwcDevice,
-                mDisplayId, mId, {0, nullptr});
-    } else {
-        size_t rectCount = 0;
-        auto rectArray = damage.getArray(&rectCount);
-
-        std::vector<hwc_rect_t> hwcRects;
-        for (size_t rect = 0; rect < rectCount; ++rect) {
-            hwcRects.push_back({rectArray[rect].left, rectArray[rect].top,
-                    rectArray[rect].right, rectArray[rect].bottom});
-        }
-
-        hwc_region_t hwcRegion = {};
-        hwcRegion.numRects = rectCount;
-        hwcRegion.rects = hwcRects.data();
-
-        intError = mDevice.mSetLayerSurfaceDamage(mDevice.mHwcDevice,
-                mDisplayId, mId, hwcRegion);
+    size_t rectCount = 0;
+    const Rect* rectArray = nullptr;
+    if (!(damage.isRect() && damage.getBounds() == Rect::INVALID_RECT)) {
+        rectArray = damage.getArray(&rectCount);
     }
+    if (isStateSent(STATE_SURFACE_DAMAGE,
+            sameRects(mSurfaceDamage, rectArray, rectCount))) {
+        return Error::None;
+    }
+    setRects(&mSurfaceDamage, rectArray, rectCount);
 
-    return static_cast<Error>(intError);
+    hwc_region_t hwcRegion = {};
+    hwcRegion.numRects = mSurfaceDamage.size();
+    hwcRegion.rects = mSurfaceDamage.empty() ? nullptr : mSurfaceDamage.data();
+
+    int32_t intError = mDevice.mSetLayerSurfaceDamage(mDevice.mHwcDevice,
+            mDisplayId, mId, hwcRegion);
+    return onStateSent(STATE_SURFACE_DAMAGE, intError);
 }
 
 Error Layer::setBlendMode(BlendMode mode)
 {
+    if (isStateSent(STATE_BLEND_MODE, mode == mBlendMode)) {
+        return Error::None;
+    }
+    mBlendMode = mode;
     auto intMode = static_cast<int32_t>(mode);
     int32_t intError = mDevice.mSetLayerBlendMode(mDevice.mHwcDevice,
             mDisplayId, mId, intMode);
-    return static_cast<Error>(intError);
+    return onStateSent(STATE_BLEND_MODE, intError);
 }
 
 Error Layer::setColor(hwc_color_t color)
 {
+    if (isStateSent(STATE_COLOR, color.r == mColor.r &&
+            color.g == mColor.g && color.b == mColor.b &&
+            color.a == mColor.a)) {
+        return Error::None;
+    }
+    mColor = color;
     int32_t intError = mDevice.mSetLayerColor(mDevice.mHwcDevice, mDisplayId,
             mId, color);
-    return static_cast<Error>(intError);
+    return onStateSent(STATE_COLOR, intError);
 }
 
 Error Layer::setCompositionType(Composition type)
@@ -1038,25 +1107,40 @@ Error Layer::setCompositionType(Composition type)
 
 Error Layer::setDataspace(android_dataspace_t dataspace)
 {
+    if (isStateSent(STATE_DATASPACE, dataspace == mDataspace)) {
+        return Error::None;
+    }
+    mDataspace = dataspace;
     auto intDataspace = static_cast<int32_t>(dataspace);
     int32_t intError = mDevice.mSetLayerDataspace(mDevice.mHwcDevice,
             mDisplayId, mId, intDataspace);
-    return static_cast<Error>(intError);
+    return onStateSent(STATE_DATASPACE, intError);
 }
 
 Error Layer::setDisplayFrame(const Rect& frame)
 {
+    if (isStateSent(STATE_DISPLAY_FRAME, frame.left == mDisplayFrame.left &&
+            frame.top == mDisplayFrame.top &&
+            frame.right == mDisplayFrame.right &&
+            frame.bottom == mDisplayFrame.bottom)) {
+        return Error::None;
+    }
     hwc_rect_t hwcRect{frame.left, frame.top, frame.right, frame.bottom};
+    mDisplayFrame = hwcRect;
     int32_t intError = mDevice.mSetLayerDisplayFrame(mDevice.mHwcDevice,
             mDisplayId, mId, hwcRect);
-    return static_cast<Error>(intError);
+    return onStateSent(STATE_DISPLAY_FRAME, intError);
 }
 
 Error Layer::setPlaneAlpha(float alpha)
 {
+    if (isStateSent(STATE_PLANE_ALPHA, alpha == mPlaneAlpha)) {
+        return Error::None;
+    }
+    mPlaneAlpha = alpha;
     int32_t intError = mDevice.mSetLayerPlaneAlpha(mDevice.mHwcDevice,
             mDisplayId, mId, alpha);
-    return static_cast<Error>(intError);
+    return onStateSent(STATE_PLANE_ALPHA, intError);
 }
 
 Error Layer::setSidebandStream(const native_handle_t* stream)
@@ -1066,52 +1150,69 @@ Error Layer::setSidebandStream(const native_handle_t* stream)
                 "device supports sideband streams");
         return Error::Unsupported;
     }
+    if (isStateSent(STATE_SIDEBAND_STREAM, stream == mSidebandStream)) {
+        return Error::None;
+    }
+    mSidebandStream = stream;
     int32_t intError = mDevice.mSetLayerSidebandStream(mDevice.mHwcDevice,
             mDisplayId, mId, stream);
-    return static_cast<Error>(intError);
+    return onStateSent(STATE_SIDEBAND_STREAM, intError);
 }
 
 Error Layer::setSourceCrop(const FloatRect& crop)
 {
+    if (isStateSent(STATE_SOURCE_CROP, crop.left == mSourceCrop.left &&
+            crop.top == mSourceCrop.top && crop.right == mSourceCrop.right &&
+            crop.bottom == mSourceCrop.bottom)) {
+        return Error::None;
+    }
     hwc_frect_t hwcRect{crop.left, crop.top, crop.right, crop.bottom};
+    mSourceCrop = hwcRect;
     int32_t intError = mDevice.mSetLayerSourceCrop(mDevice.mHwcDevice,
             mDisplayId, mId, hwcRect);
-    return static_cast<Error>(intError);
+    return onStateSent(STATE_SOURCE_CROP, intError);
 }
 
 Error Layer::setTransform(Transform transform)
 {
+    if (isStateSent(STATE_TRANSFORM, transform == mTransform)) {
+        return Error::None;
+    }
+    mTransform = transform;
     auto intTransform = static_cast<int32_t>(transform);
     int32_t intError = mDevice.mSetLayerTransform(mDevice.mHwcDevice,
             mDisplayId, mId, intTransform);
-    return static_cast<Error>(intError);
+    return onStateSent(STATE_TRANSFORM, intError);
 }
 
 Error Layer::setVisibleRegion(const Region& region)
 {
     size_t rectCount = 0;
     auto rectArray = region.getArray(&rectCount);
-
-    std::vector<hwc_rect_t> hwcRects;
-    for (size_t rect = 0; rect < rectCount; ++rect) {
-        hwcRects.push_back({rectArray[rect].left, rectArray[rect].top,
-                rectArray[rect].right, rectArray[rect].bottom});
+    if (isStateSent(STATE_VISIBLE_REGION,
+            sameRects(mVisibleRegion, rectArray, rectCount))) {
+        return Error::None;
     }
+    setRects(&mVisibleRegion, rectArray, rectCount);
 
     hwc_region_t hwcRegion = {};
-    hwcRegion.numRects = rectCount;
-    hwcRegion.rects = hwcRects.data();
+    hwcRegion.numRects = mVisibleRegion.size();
+    hwcRegion.rects = mVisibleRegion.data();
 
     int32_t intError = mDevice.mSetLayerVisibleRegion(mDevice.mHwcDevice,
             mDisplayId, mId, hwcRegion);
-    return static_cast<Error>(intError);
+    return onStateSent(STATE_VISIBLE_REGION, intError);
 }
 
 Error Layer::setZOrder(uint32_t z)
 {
+    if (isStateSent(STATE_Z_ORDER, z == mZOrder)) {
+        return Error::None;
+    }
+    mZOrder = z;
     int32_t intError = mDevice.mSetLayerZOrder(mDevice.mHwcDevice, mDisplayId,
             mId, z);
-    return static_cast<Error>(intError);
+    return onStateSent(STATE_Z_ORDER, intError);
 }
 
 } // namespace HWC2
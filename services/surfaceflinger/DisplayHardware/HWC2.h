@@ -95,6 +95,11 @@ public:
 
     bool hasCapability(HWC2::Capability capability) const;
 
+    // Layer state setter calls made into the HAL, and those left out
+    // because the layer already had the value
+    uint64_t getLayerStateCalls() const { return mLayerStateCalls; }
+    uint64_t getLayerStateCallsSaved() const { return mLayerStateCallsSaved; }
+
 private:
     // Initialization methods
 
@@ -192,6 +197,10 @@ private:
     std::vector<std::shared_ptr<Display>> mPendingRefreshes;
     VsyncCallback mVsync;
     std::vector<std::pair<std::shared_ptr<Display>, nsecs_t>> mPendingVsyncs;
+
+    // updated by Layer, on the main thread
+    uint64_t mLayerStateCalls;
+    uint64_t mLayerStateCallsSaved;
 };
 
 class Display : public std::enable_shared_from_this<Display>
@@ -388,10 +397,46 @@ public:
     [[clang::warn_unused_result]] Error setZOrder(uint32_t z);
 
 private:
+    // The HAL keeps each piece of layer state until it is set again, so the
+    // setters below remember what they last sent and skip sending the same
+    // value twice. A failed call forgets the value so that it is retried.
+    enum : uint32_t {
+        STATE_BLEND_MODE = 1 << 0,
+        STATE_COLOR = 1 << 1,
+        STATE_DATASPACE = 1 << 2,
+        STATE_DISPLAY_FRAME = 1 << 3,
+        STATE_PLANE_ALPHA = 1 << 4,
+        STATE_SIDEBAND_STREAM = 1 << 5,
+        STATE_SOURCE_CROP = 1 << 6,
+        STATE_SURFACE_DAMAGE = 1 << 7,
+        STATE_TRANSFORM = 1 << 8,
+        STATE_VISIBLE_REGION = 1 << 9,
+        STATE_Z_ORDER = 1 << 10,
+    };
+
+    // Returns true, and counts the call saved, if state was last sent with
+    // the value the caller has.
+    bool isStateSent(uint32_t state, bool sameValue);
+    Error onStateSent(uint32_t state, int32_t intError);
+
     std::weak_ptr<Display> mDisplay;
     hwc2_display_t mDisplayId;
     Device& mDevice;
     hwc2_layer_t mId;
+
+    uint32_t mSentState;
+    BlendMode mBlendMode;
+    hwc_color_t mColor;
+    android_dataspace_t mDataspace;
+    hwc_rect_t mDisplayFrame;
+    float mPlaneAlpha;
+    const native_handle_t* mSidebandStream;
+    hwc_frect_t mSourceCrop;
+    // no rects stands for the whole layer
+    std::vector<hwc_rect_t> mSurfaceDamage;
+    Transform mTransform;
+    std::vector<hwc_rect_t> mVisibleRegion;
+    uint32_t mZOrder;
 };
 
 } // namespace HWC2
@@ -27,6 +27,7 @@
 #include <utils/Trace.h>
 
 #include <cstdlib>
+#include <cstring>
 #include <chrono>
 #include <inttypes.h>
 #include <sstream>
@@ -590,7 +591,8 @@ Error HWC2On1Adapter::Display::acceptChanges()
 
     mChanges->clearTypeChanges();
 
-    mHwc1RequestedContents = std::move(mHwc1ReceivedContents);
+    // Keep what HWC1 decided, and reuse the old request for the next copy
+    std::swap(mHwc1RequestedContents, mHwc1ReceivedContents);
 
     return Error::None;
 }
@@ -1299,38 +1301,58 @@ bool HWC2On1Adapter::Display::prepare()
     return true;
 }
 
-static void cloneHWCRegion(hwc_region_t& region)
+// Copies src into dst, reusing storage (which has room for capacity rects)
+// unless it is too small
+static void copyHWCRegion(const hwc_region_t& src, hwc_region_t& dst,
+        hwc_rect_t* storage, size_t capacity)
 {
-    auto size = sizeof(hwc_rect_t) * region.numRects;
-    auto newRects = static_cast<hwc_rect_t*>(std::malloc(size));
-    std::copy_n(region.rects, region.numRects, newRects);
-    region.rects = newRects;
+    if (storage == nullptr || src.numRects > capacity) {
+        auto size = sizeof(hwc_rect_t) * std::max<size_t>(src.numRects, 1);
+        storage = static_cast<hwc_rect_t*>(std::realloc(storage, size));
+    }
+    std::copy_n(src.rects, src.numRects, storage);
+    dst.rects = storage;
+    dst.numRects = src.numRects;
 }
 
-HWC2On1Adapter::Display::HWC1Contents
-        HWC2On1Adapter::Display::cloneRequestedContents() const
+hwc_display_contents_1_t* HWC2On1Adapter::Display::copyRequestedContents()
 {
     std::unique_lock<std::recursive_mutex> lock(mStateMutex);
 
-    size_t size = sizeof(hwc_display_contents_1_t) +
-            sizeof(hwc_layer_1_t) * (mHwc1RequestedContents->numHwLayers);
-    auto contents = static_cast<hwc_display_contents_1_t*>(std::malloc(size));
-    std::memcpy(contents, mHwc1RequestedContents.get(), size);
-    for (size_t layerId = 0; layerId < contents->numHwLayers; ++layerId) {
+    // HWC1 writes its decisions into the contents it is given, so it gets a
+    // copy. The copy is kept from frame to frame, and only reallocated when
+    // the layer count changes.
+    size_t numLayers = mHwc1RequestedContents->numHwLayers;
+    if (!mHwc1ReceivedContents ||
+            mHwc1ReceivedContents->numHwLayers != numLayers) {
+        size_t size = sizeof(hwc_display_contents_1_t) +
+                sizeof(hwc_layer_1_t) * numLayers;
+        mHwc1ReceivedContents.reset(static_cast<hwc_display_contents_1_t*>(
+                std::calloc(size, 1)));
+    }
+
+    auto contents = mHwc1ReceivedContents.get();
+    std::memcpy(contents, mHwc1RequestedContents.get(),
+            sizeof(hwc_display_contents_1_t));
+    for (size_t layerId = 0; layerId < numLayers; ++layerId) {
         auto& layer = contents->hwLayers[layerId];
-        // Deep copy the regions to avoid double-frees
-        cloneHWCRegion(layer.visibleRegionScreen);
-        cloneHWCRegion(layer.surfaceDamage);
+        const auto& requestedLayer =
+                mHwc1RequestedContents->hwLayers[layerId];
+        // Each copy owns its visible region, which the deleter frees; the
+        // surface damage is never filled in, so it can be shared
+        auto rects = const_cast<hwc_rect_t*>(layer.visibleRegionScreen.rects);
+        auto capacity = layer.visibleRegionScreen.numRects;
+        layer = requestedLayer;
+        copyHWCRegion(requestedLayer.visibleRegionScreen,
+                layer.visibleRegionScreen, rects, capacity);
     }
-    return HWC1Contents(contents);
+    return contents;
 }
 
-void HWC2On1Adapter::Display::setReceivedContents(HWC1Contents contents)
+void HWC2On1Adapter::Display::setReceivedContents()
 {
     std::unique_lock<std::recursive_mutex> lock(mStateMutex);
 
-    mHwc1ReceivedContents = std::move(contents);
-
     mChanges.reset(new Changes);
 
     size_t numLayers = mHwc1ReceivedContents->numHwLayers;
@@ -1955,8 +1977,13 @@ void HWC2On1Adapter::Display::prepareFramebufferTarget()
     }
     hwc1Target.displayFrame = {0, 0, width, height};
     hwc1Target.planeAlpha = 255;
+    // The contents persist, so reuse the rect from the last frame
+    auto rects = const_cast<hwc_rect_t*>(hwc1Target.visibleRegionScreen.rects);
+    if (rects == nullptr || hwc1Target.visibleRegionScreen.numRects < 1) {
+        rects = static_cast<hwc_rect_t*>(
+                std::realloc(rects, sizeof(hwc_rect_t)));
+    }
     hwc1Target.visibleRegionScreen.numRects = 1;
-    auto rects = static_cast<hwc_rect_t*>(std::malloc(sizeof(hwc_rect_t)));
     rects[0].left = 0;
     rects[0].top = 0;
     rects[0].right = width;
@@ -2424,24 +2451,22 @@ bool HWC2On1Adapter::prepareAllDisplays()
         return false;
     }
 
-    // Always push the primary display
-    std::vector<HWC2On1Adapter::Display::HWC1Contents> requestedContents;
+    // Always push the primary display. The contents are each display's
+    // persistent copy, so this allocates nothing once running.
+    mHwc1Contents.clear();
     auto primaryDisplayId = mHwc1DisplayMap[HWC_DISPLAY_PRIMARY];
     auto& primaryDisplay = mDisplays[primaryDisplayId];
-    auto primaryDisplayContents = primaryDisplay->cloneRequestedContents();
-    requestedContents.push_back(std::move(primaryDisplayContents));
+    mHwc1Contents.push_back(primaryDisplay->copyRequestedContents());
 
     // Push the external display, if present
     if (mHwc1DisplayMap.count(HWC_DISPLAY_EXTERNAL) != 0) {
         auto externalDisplayId = mHwc1DisplayMap[HWC_DISPLAY_EXTERNAL];
         auto& externalDisplay = mDisplays[externalDisplayId];
-        auto externalDisplayContents =
-                externalDisplay->cloneRequestedContents();
-        requestedContents.push_back(std::move(externalDisplayContents));
+        mHwc1Contents.push_back(externalDisplay->copyRequestedContents());
     } else {
         // Even if an external display isn't present, we still need to send
         // at least two displays down to HWC1
-        requestedContents.push_back(nullptr);
+        mHwc1Contents.push_back(nullptr);
     }
 
     // Push the hardware virtual display, if supported and present
@@ -2449,22 +2474,19 @@ bool HWC2On1Adapter::prepareAllDisplays()
         if (mHwc1DisplayMap.count(HWC_DISPLAY_VIRTUAL) != 0) {
             auto virtualDisplayId = mHwc1DisplayMap[HWC_DISPLAY_VIRTUAL];
             auto& virtualDisplay = mDisplays[virtualDisplayId];
-            auto virtualDisplayContents =
-                    virtualDisplay->cloneRequestedContents();
-            requestedContents.push_back(std::move(virtualDisplayContents));
+            mHwc1Contents.push_back(virtualDisplay->copyRequestedContents());
         } else {
-            requestedContents.push_back(nullptr);
+            mHwc1Contents.push_back(nullptr);
         }
     }
 
-    mHwc1Contents.clear();
-    for (auto& displayContents : requestedContents) {
-        mHwc1Contents.push_back(displayContents.get());
+    for (size_t c = 0; c < mHwc1Contents.size(); ++c) {
+        auto& displayContents = mHwc1Contents[c];
         if (!displayContents) {
             continue;
         }
 
-        ALOGV("Display %zd layers:", mHwc1Contents.size() - 1);
+        ALOGV("Display %zd layers:", c);
         for (size_t l = 0; l < displayContents->numHwLayers; ++l) {
             auto& layer = displayContents->hwLayers[l];
             ALOGV("  %zd: %d", l, layer.compositionType);
@@ -2497,7 +2519,7 @@ bool HWC2On1Adapter::prepareAllDisplays()
 
         auto displayId = mHwc1DisplayMap[hwc1Id];
         auto& display = mDisplays[displayId];
-        display->setReceivedContents(std::move(requestedContents[hwc1Id]));
+        display->setReceivedContents();
     }
 
     return true;
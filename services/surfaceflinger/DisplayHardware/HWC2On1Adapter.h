@@ -231,8 +231,11 @@ private:
             void populateConfigs(uint32_t width, uint32_t height);
 
             bool prepare();
-            HWC1Contents cloneRequestedContents() const;
-            void setReceivedContents(HWC1Contents contents);
+            // Returns the contents to hand HWC1, which stay owned by the
+            // display; setReceivedContents() then reads back what HWC1 did
+            // with them.
+            hwc_display_contents_1* copyRequestedContents();
+            void setReceivedContents();
             bool hasChanges() const;
             HWC2::Error set(hwc_display_contents_1& hwcContents);
             void addRetireFence(int fenceFd);
@@ -738,10 +738,16 @@ status_t HWComposer::setColorTransform(int32_t displayId,
     }
 
     auto& displayData = mDisplayData[displayId];
+    if (transform == displayData.colorTransform) {
+        return displayData.colorTransformRejected ? UNKNOWN_ERROR : NO_ERROR;
+    }
+
     bool isIdentity = transform == mat4();
     auto error = displayData.hwcDisplay->setColorTransform(transform,
             isIdentity ? HAL_COLOR_TRANSFORM_IDENTITY :
             HAL_COLOR_TRANSFORM_ARBITRARY_MATRIX);
+    displayData.colorTransform = transform;
+    displayData.colorTransformRejected = error != HWC2::Error::None;
     if (error != HWC2::Error::None) {
         ALOGE("setColorTransform: Failed to set transform on display %d: "
                 "%s (%d)", displayId, to_string(error).c_str(),
@@ -861,6 +867,9 @@ void HWComposer::dump(String8& result) const {
     // all the state going into the layers. This is probably better done in
     // Layer itself, but it's going to take a bit of work to get there.
     result.append(mHwcDevice->dump().c_str());
+    result.appendFormat("  layer state calls: %" PRIu64 ", saved: %" PRIu64
+            "\n", mHwcDevice->getLayerStateCalls(),
+            mHwcDevice->getLayerStateCallsSaved());
 }
 
 // ---------------------------------------------------------------------------
@@ -869,6 +878,8 @@ HWComposer::DisplayData::DisplayData()
   : hasClientComposition(false),
     hasDeviceComposition(false),
     hwcDisplay(),
+    colorTransform(),
+    colorTransformRejected(false),
     lastRetireFence(Fence::NO_FENCE),
     outbufHandle(nullptr),
     outbufAcquireFence(Fence::NO_FENCE),
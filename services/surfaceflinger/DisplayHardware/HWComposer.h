@@ -106,7 +106,10 @@ public:
     // set active config
     status_t setActiveConfig(int32_t displayId, size_t configId);
 
-    // Sets a color transform to be applied to the result of composition
+    // Sets a color transform to be applied to the result of composition.
+    // The HAL is only called when the transform differs from the one the
+    // display already has; a transform the HAL rejected keeps failing until
+    // another one is set.
     status_t setColorTransform(int32_t displayId, const mat4& transform);
 
     // reset state when an external, non-virtual display is disconnected
@@ -188,6 +191,8 @@ private:
         bool hasDeviceComposition;
         std::shared_ptr<HWC2::Display> hwcDisplay;
         HWC2::DisplayRequest displayRequests;
+        mat4 colorTransform;
+        bool colorTransformRejected;
         sp<Fence> lastRetireFence;  // signals when the last set op retires
         std::unordered_map<std::shared_ptr<HWC2::Layer>, sp<Fence>>
                 releaseFences;
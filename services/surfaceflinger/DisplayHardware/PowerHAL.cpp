@@ -29,19 +29,59 @@
 namespace android {
 // ---------------------------------------------------------------------------
 
-status_t PowerHAL::vsyncHint(bool enabled) {
-    Mutex::Autolock _l(mlock);
+PowerHAL::PowerHAL()
+    : mLastLookup(0),
+      mBoostEnd(0) {
+}
+
+sp<IPowerManager> PowerHAL::getPowerManagerLocked() {
     if (mPowerManager == NULL) {
+        const nsecs_t now = systemTime();
+        if (mLastLookup != 0 && now - mLastLookup < LOOKUP_INTERVAL) {
+            return NULL;
+        }
+        mLastLookup = now;
         const String16 serviceName("power");
         sp<IBinder> bs = defaultServiceManager()->checkService(serviceName);
         if (bs == NULL) {
-            return NAME_NOT_FOUND;
+            return NULL;
         }
         mPowerManager = interface_cast<IPowerManager>(bs);
     }
-    status_t status = mPowerManager->powerHint(POWER_HINT_VSYNC, enabled ? 1 : 0);
+    return mPowerManager;
+}
+
+status_t PowerHAL::powerHintLocked(int hintId, int data) {
+    sp<IPowerManager> powerManager(getPowerManagerLocked());
+    if (powerManager == NULL) {
+        return NAME_NOT_FOUND;
+    }
+    status_t status = powerManager->powerHint(hintId, data);
     if(status == DEAD_OBJECT) {
         mPowerManager = NULL;
+        mLastLookup = 0;
+    }
+    return status;
+}
+
+status_t PowerHAL::vsyncHint(bool enabled) {
+    Mutex::Autolock _l(mlock);
+    return powerHintLocked(POWER_HINT_VSYNC, enabled ? 1 : 0);
+}
+
+status_t PowerHAL::workloadHint(nsecs_t expected, nsecs_t period, nsecs_t boostDuration) {
+    // boost once the frames take three quarters of the period
+    if (boostDuration <= 0 || expected * 4 < period * 3) {
+        return NO_ERROR;
+    }
+    Mutex::Autolock _l(mlock);
+    const nsecs_t now = systemTime();
+    if (now < mBoostEnd) {
+        return NO_ERROR;
+    }
+    status_t status = powerHintLocked(POWER_HINT_INTERACTION, int(ns2ms(boostDuration)));
+    if (status == NO_ERROR) {
+        mBoostEnd = now + boostDuration;
     }
     return status;
 }
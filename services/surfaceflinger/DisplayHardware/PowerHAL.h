@@ -20,6 +20,7 @@
 #include <stdint.h>
 #include <sys/types.h>
 #include <utils/Mutex.h>
+#include <utils/Timers.h>
 
 #include <powermanager/IPowerManager.h>
 #include <hardware/power.h>
@@ -30,10 +31,28 @@ namespace android {
 class PowerHAL
 {
 public:
+    PowerHAL();
+
     status_t vsyncHint(bool enabled);
 
+    // Tells the power HAL that the coming frames are expected to take
+    // expected out of every period. Once that gets close to the period, the
+    // CPUs are boosted for boostDuration, with an interaction hint that is
+    // sent again only once the previous boost ran out.
+    status_t workloadHint(nsecs_t expected, nsecs_t period, nsecs_t boostDuration);
+
 private:
+    // Looks the power manager up, at most once per LOOKUP_INTERVAL while it
+    // isn't there, so that hints sent early during boot don't each block
+    // on the service manager.
+    sp<IPowerManager> getPowerManagerLocked();
+    status_t powerHintLocked(int hintId, int data);
+
+    static const nsecs_t LOOKUP_INTERVAL = 1000000000; // 1s
+
     sp<IPowerManager> mPowerManager;
+    nsecs_t mLastLookup;
+    nsecs_t mBoostEnd;
     Mutex mlock;
 };
 
@@ -15,6 +15,8 @@
  */
 
 // #define LOG_NDEBUG 0
+#include <inttypes.h>
+
 #include "VirtualDisplaySurface.h"
 #include "HWComposer.h"
 
@@ -38,6 +40,21 @@ static const bool sForceHwcCopy = false;
 #define VDS_LOGV(msg, ...) ALOGV("[%s] " msg, \
         mDisplayName.string(), ##__VA_ARGS__)
 
+// Formats that GLES renders natively, so that forcing an HWC copy just to
+// convert them gains nothing.
+static bool isRgbFormat(int format) {
+    switch (format) {
+        case HAL_PIXEL_FORMAT_RGBA_8888:
+        case HAL_PIXEL_FORMAT_RGBX_8888:
+        case HAL_PIXEL_FORMAT_RGB_888:
+        case HAL_PIXEL_FORMAT_RGB_565:
+        case HAL_PIXEL_FORMAT_BGRA_8888:
+            return true;
+        default:
+            return false;
+    }
+}
+
 static const char* dbgCompositionTypeStr(DisplaySurface::CompositionType type) {
     switch (type) {
         case DisplaySurface::COMPOSITION_UNKNOWN: return "UNKNOWN";
@@ -59,6 +76,7 @@ VirtualDisplaySurface::VirtualDisplaySurface(HWComposer& hwc, int32_t dispId,
     mDisplayName(name),
     mSource{},
     mDefaultOutputFormat(HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED),
+    mForceHwcCopy(sForceHwcCopy),
     mOutputFormat(HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED),
     mOutputUsage(GRALLOC_USAGE_HW_COMPOSER),
     mProducerSlotSource(0),
@@ -73,7 +91,8 @@ VirtualDisplaySurface::VirtualDisplaySurface(HWComposer& hwc, int32_t dispId,
     mOutputProducerSlot(BufferQueue::INVALID_BUFFER_SLOT),
     mDbgState(DBG_STATE_IDLE),
     mDbgLastCompositionType(COMPOSITION_UNKNOWN),
-    mMustRecompose(false)
+    mMustRecompose(false),
+    mStats()
 {
     mSource[SOURCE_SINK] = sink;
     mSource[SOURCE_SCRATCH] = bqProducer;
@@ -101,6 +120,14 @@ VirtualDisplaySurface::VirtualDisplaySurface(HWComposer& hwc, int32_t dispId,
     }
     mOutputFormat = mDefaultOutputFormat;
 
+    // The forced HWC copy only pays off when HWC converts the GLES output to
+    // something the sink prefers, like YUV for a video encoder. A sink that
+    // reads RGB itself takes the GLES buffer as it is.
+    if (mForceHwcCopy && !(sinkUsage & GRALLOC_USAGE_HW_VIDEO_ENCODER) &&
+            isRgbFormat(mDefaultOutputFormat)) {
+        mForceHwcCopy = false;
+    }
+
     ConsumerBase::mName = String8::format("VDS: %s", mDisplayName.string());
     mConsumer->setConsumerName(ConsumerBase::mName);
     mConsumer->setConsumerUsageBits(GRALLOC_USAGE_HW_COMPOSER);
@@ -144,8 +171,15 @@ status_t VirtualDisplaySurface::prepareFrame(CompositionType compositionType) {
         // directly to the consumer.
         //
         // On the other hand, when the consumer prefers RGB or can consume RGB
-        // inexpensively, this forces an unnecessary copy.
-        mCompositionType = COMPOSITION_MIXED;
+        // inexpensively, this forces an unnecessary copy, so it is skipped
+        // for sinks that take RGB themselves (see the constructor).
+        Mutex::Autolock lock(mMutex);
+        if (mForceHwcCopy) {
+            mCompositionType = COMPOSITION_MIXED;
+            mStats.forcedHwcCopies++;
+        } else {
+            mStats.skippedHwcCopies++;
+        }
     }
 
     if (mCompositionType != mDbgLastCompositionType) {
@@ -282,6 +316,12 @@ void VirtualDisplaySurface::onFrameCommitted() {
                     &qbo);
             if (result == NO_ERROR) {
                 updateQueueBufferOutput(qbo);
+                Mutex::Autolock lock(mMutex);
+                switch (mCompositionType) {
+                    case COMPOSITION_GLES: mStats.glesFrames++; break;
+                    case COMPOSITION_HWC:  mStats.hwcFrames++; break;
+                    default:               mStats.mixedFrames++; break;
+                }
             }
         } else {
             // If the surface hadn't actually been updated, then we only went
@@ -293,13 +333,34 @@ void VirtualDisplaySurface::onFrameCommitted() {
 #else
             mSource[SOURCE_SINK]->cancelBuffer(sslot, outFence);
 #endif
+            Mutex::Autolock lock(mMutex);
+            mStats.cancelledFrames++;
         }
     }
 
     resetPerFrameState();
 }
 
-void VirtualDisplaySurface::dumpAsString(String8& /* result */) const {
+void VirtualDisplaySurface::dumpAsString(String8& result) const {
+    if (mDisplayId < 0) {
+        return;
+    }
+    Mutex::Autolock lock(mMutex);
+    // HWC and GLES frames go to the sink without an intermediate copy; MIXED
+    // frames are composed through a scratch buffer first.
+    const uint64_t queued = mStats.hwcFrames + mStats.glesFrames +
+            mStats.mixedFrames;
+    result.appendFormat("   VDS: %" PRIu64 " frames queued to the sink, "
+            "%" PRIu64 " direct (%" PRIu64 " HWC, %" PRIu64 " GLES), "
+            "%" PRIu64 " through scratch, %" PRIu64 " cancelled\n",
+            queued, mStats.hwcFrames + mStats.glesFrames, mStats.hwcFrames,
+            mStats.glesFrames, mStats.mixedFrames, mStats.cancelledFrames);
+    if (sForceHwcCopy) {
+        result.appendFormat("   VDS: forced HWC copy %s, %" PRIu64
+                " forced, %" PRIu64 " skipped for an RGB sink\n",
+                mForceHwcCopy ? "on" : "off", mStats.forcedHwcCopies,
+                mStats.skippedHwcCopies);
+    }
 }
 
 void VirtualDisplaySurface::resizeBuffers(const uint32_t w, const uint32_t h) {
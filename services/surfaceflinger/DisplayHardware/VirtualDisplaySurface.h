@@ -161,6 +161,8 @@ private:
     const String8 mDisplayName;
     sp<IGraphicBufferProducer> mSource[2]; // indexed by SOURCE_*
     uint32_t mDefaultOutputFormat;
+    // Whether GLES-only frames go through an HWC copy; see prepareFrame().
+    bool mForceHwcCopy;
 
     //
     // Inter-frame state
@@ -252,6 +254,17 @@ private:
     static const char* dbgSourceStr(Source s);
 
     bool mMustRecompose;
+
+    // How frames reached the sink, for dumpsys. Guarded by mMutex.
+    struct Stats {
+        uint64_t hwcFrames;
+        uint64_t glesFrames;
+        uint64_t mixedFrames;
+        uint64_t cancelledFrames;
+        uint64_t forcedHwcCopies;
+        uint64_t skippedHwcCopies;
+    };
+    Stats mStats;
 };
 
 // ---------------------------------------------------------------------------
@@ -14,6 +14,10 @@
  * limitations under the License.
  */
 
+#include <inttypes.h>
+
+#include <utils/String8.h>
+
 #include "EventControlThread.h"
 #include "SurfaceFlinger.h"
 
@@ -21,47 +25,77 @@ namespace android {
 
 EventControlThread::EventControlThread(const sp<SurfaceFlinger>& flinger):
         mFlinger(flinger),
-        mVsyncEnabled(false) {
+        mVsyncEnabled(false),
+        mDisableTime(0),
+        mHardwareVsyncEnabled(false),
+        mEnableCount(0),
+        mDisableCount(0),
+        mAvoidedDisableCount(0) {
 }
 
-void EventControlThread::setVsyncEnabled(bool enabled) {
+void EventControlThread::setVsyncEnabled(bool enabled, nsecs_t disableDelay) {
     Mutex::Autolock lock(mMutex);
+    if (enabled && !mVsyncEnabled && mHardwareVsyncEnabled) {
+        mAvoidedDisableCount++;
+    }
     mVsyncEnabled = enabled;
+    mDisableTime = systemTime(SYSTEM_TIME_MONOTONIC) + disableDelay;
     mCond.signal();
 }
 
-bool EventControlThread::threadLoop() {
-    Mutex::Autolock lock(mMutex);
-
-    bool vsyncEnabled = mVsyncEnabled;
-
+void EventControlThread::setHardwareVsyncLocked(bool enabled) {
 #ifdef USE_HWC2
-    mFlinger->setVsyncEnabled(HWC_DISPLAY_PRIMARY, mVsyncEnabled);
+    mFlinger->setVsyncEnabled(HWC_DISPLAY_PRIMARY, enabled);
 #else
     mFlinger->eventControl(HWC_DISPLAY_PRIMARY, SurfaceFlinger::EVENT_VSYNC,
-            mVsyncEnabled);
+            enabled);
 #endif
+    mHardwareVsyncEnabled = enabled;
+}
+
+bool EventControlThread::threadLoop() {
+    Mutex::Autolock lock(mMutex);
+
+    setHardwareVsyncLocked(mVsyncEnabled);
 
     while (true) {
-        status_t err = mCond.wait(mMutex);
+        status_t err;
+        if (mHardwareVsyncEnabled != mVsyncEnabled) {
+            const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+            if (mVsyncEnabled || now >= mDisableTime) {
+                setHardwareVsyncLocked(mVsyncEnabled);
+                if (mVsyncEnabled) {
+                    mEnableCount++;
+                } else {
+                    mDisableCount++;
+                }
+                continue;
+            }
+            // keep it on in case it's wanted again soon
+            err = mCond.waitRelative(mMutex, mDisableTime - now);
+            if (err == TIMED_OUT) {
+                continue;
+            }
+        } else {
+            err = mCond.wait(mMutex);
+        }
         if (err != NO_ERROR) {
             ALOGE("error waiting for new events: %s (%d)",
                 strerror(-err), err);
             return false;
         }
-
-        if (vsyncEnabled != mVsyncEnabled) {
-#ifdef USE_HWC2
-            mFlinger->setVsyncEnabled(HWC_DISPLAY_PRIMARY, mVsyncEnabled);
-#else
-            mFlinger->eventControl(HWC_DISPLAY_PRIMARY,
-                    SurfaceFlinger::EVENT_VSYNC, mVsyncEnabled);
-#endif
-            vsyncEnabled = mVsyncEnabled;
-        }
     }
 
     return false;
 }
 
+void EventControlThread::dump(String8& result) const {
+    Mutex::Autolock lock(mMutex);
+    result.appendFormat("hardware vsync %s (requested %s): %" PRIu64
+            " enables, %" PRIu64 " disables, %" PRIu64 " disables avoided\n",
+            mHardwareVsyncEnabled ? "on" : "off",
+            mVsyncEnabled ? "on" : "off",
+            mEnableCount, mDisableCount, mAvoidedDisableCount);
+}
+
 } // namespace android
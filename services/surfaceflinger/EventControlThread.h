@@ -21,9 +21,11 @@
 
 #include <utils/Mutex.h>
 #include <utils/Thread.h>
+#include <utils/Timers.h>
 
 namespace android {
 
+class String8;
 class SurfaceFlinger;
 
 class EventControlThread: public Thread {
@@ -32,14 +34,31 @@ public:
     EventControlThread(const sp<SurfaceFlinger>& flinger);
     virtual ~EventControlThread() {}
 
-    void setVsyncEnabled(bool enabled);
+    // Asks for hardware vsync to be turned on or off. A request to turn it
+    // off only takes effect after disableDelay, so that turning it back on
+    // before then costs no calls into the HAL.
+    void setVsyncEnabled(bool enabled, nsecs_t disableDelay = 0);
     virtual bool threadLoop();
 
+    void dump(String8& result) const;
+
 private:
+    void setHardwareVsyncLocked(bool enabled);
+
     sp<SurfaceFlinger> mFlinger;
     bool mVsyncEnabled;
+    // when a pending request to turn hardware vsync off takes effect
+    nsecs_t mDisableTime;
+    // what the HAL was last told
+    bool mHardwareVsyncEnabled;
+
+    // transitions made in the HAL, and requests to turn it off that were
+    // taken back before they took effect
+    uint64_t mEnableCount;
+    uint64_t mDisableCount;
+    uint64_t mAvoidedDisableCount;
 
-    Mutex mMutex;
+    mutable Mutex mMutex;
     Condition mCond;
 };
 
@@ -0,0 +1,193 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "FrameStatsFile"
+
+// This is needed for stdint.h to define INT64_MAX in C++
+#define __STDC_LIMIT_MACROS
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <cutils/log.h>
+
+#include "FrameStatsFile.h"
+
+// ---------------------------------------------------------------------------
+namespace android {
+// ---------------------------------------------------------------------------
+
+const nsecs_t FrameStatsFile::ROLLOVER_PERIOD = seconds_to_nanoseconds(3600);
+const int32_t FrameStatsFile::UNKNOWN;
+
+static_assert(sizeof(FrameStatsFile::Header) == FrameStatsFile::HEADER_SIZE,
+        "the header is a page");
+static_assert(sizeof(FrameStatsFile::Record) == 24, "records are packed");
+
+static bool isKnown(nsecs_t time) {
+    return time > 0 && time < INT64_MAX;
+}
+
+// us from time to end, clamped beyond half an hour
+static int32_t packOffset(nsecs_t time, nsecs_t end) {
+    if (!isKnown(time)) {
+        return FrameStatsFile::UNKNOWN;
+    }
+    const nsecs_t us = ns2us(end - time);
+    return int32_t(std::min<nsecs_t>(std::max<nsecs_t>(us, INT32_MIN + 1),
+            INT32_MAX));
+}
+
+FrameStatsFile::FrameStatsFile(const String8& dir, size_t capacity)
+    : mDir(dir),
+      mCapacity(std::max<size_t>(std::min<size_t>(capacity, MAX_CAPACITY), 1)),
+      mHeader(NULL),
+      mRecords(NULL),
+      mMapSize(0),
+      mLastPresentTime(0),
+      mNumFrames(0),
+      mNumFiles(0),
+      mFailed(false)
+{
+}
+
+FrameStatsFile::~FrameStatsFile() {
+    closeFile();
+}
+
+void FrameStatsFile::closeFile() {
+    if (mHeader) {
+        munmap(mHeader, mMapSize);
+        mHeader = NULL;
+        mRecords = NULL;
+        mMapSize = 0;
+    }
+}
+
+bool FrameStatsFile::startFile(nsecs_t now, nsecs_t displayPeriod) {
+    const String8 current = String8::format("%s/frame_stats.0", mDir.string());
+    if (mHeader) {
+        closeFile();
+        const String8 previous = String8::format("%s/frame_stats.1", mDir.string());
+        if (rename(current.string(), previous.string()) < 0) {
+            ALOGW("couldn't roll %s over: %s", current.string(), strerror(errno));
+        }
+    }
+
+    const int fd = open(current.string(),
+            O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+    if (fd < 0) {
+        ALOGE("couldn't create %s: %s", current.string(), strerror(errno));
+        return false;
+    }
+    const size_t size = HEADER_SIZE + mCapacity * sizeof(Record);
+    void* map = MAP_FAILED;
+    if (ftruncate(fd, off_t(size)) == 0) {
+        map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (map == MAP_FAILED) {
+        ALOGE("couldn't map %zu bytes of %s: %s", size, current.string(),
+                strerror(errno));
+        close(fd);
+        unlink(current.string());
+        return false;
+    }
+    // the mapping keeps the file
+    close(fd);
+
+    mHeader = static_cast<Header*>(map);
+    mRecords = reinterpret_cast<Record*>(static_cast<uint8_t*>(map) + HEADER_SIZE);
+    mMapSize = size;
+
+    // the file is zero-filled
+    mHeader->magic = MAGIC;
+    mHeader->version = VERSION;
+    mHeader->headerSize = HEADER_SIZE;
+    mHeader->recordSize = sizeof(Record);
+    mHeader->capacity = uint32_t(mCapacity);
+    mHeader->indexStride = INDEX_STRIDE;
+    mHeader->startMonotonic = now;
+    mHeader->startRealtime = systemTime(SYSTEM_TIME_REALTIME);
+    mHeader->displayPeriod = displayPeriod;
+    mNumFiles++;
+    return true;
+}
+
+void FrameStatsFile::addFrame(nsecs_t desiredPresentTime, nsecs_t frameReadyTime,
+        nsecs_t actualPresentTime, nsecs_t displayPeriod) {
+    if (mFailed) {
+        return;
+    }
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    if (!mHeader || mHeader->count == mCapacity ||
+            now - mHeader->startMonotonic >= ROLLOVER_PERIOD) {
+        if (!startFile(now, displayPeriod)) {
+            mFailed = true;
+            return;
+        }
+    }
+
+    Record record;
+    record.flags = 0;
+    record.interval = 0;
+    if (isKnown(actualPresentTime)) {
+        record.time = actualPresentTime;
+        record.desiredOffset = packOffset(desiredPresentTime, actualPresentTime);
+        record.readyOffset = packOffset(frameReadyTime, actualPresentTime);
+        if (mLastPresentTime != 0) {
+            const nsecs_t interval = actualPresentTime - mLastPresentTime;
+            record.interval = uint32_t(std::min<nsecs_t>(
+                    std::max<nsecs_t>(ns2us(interval), 0), UINT32_MAX));
+            if (displayPeriod > 0 && interval * 2 > displayPeriod * 3) {
+                record.flags |= FLAG_JANK;
+            }
+        }
+        mLastPresentTime = actualPresentTime;
+    } else {
+        record.time = isKnown(desiredPresentTime) ? desiredPresentTime : now;
+        record.desiredOffset = 0;
+        record.readyOffset = packOffset(frameReadyTime, record.time);
+        record.flags |= FLAG_DROPPED;
+    }
+
+    const uint32_t count = mHeader->count;
+    mRecords[count] = record;
+    if (count % INDEX_STRIDE == 0) {
+        mHeader->index[count / INDEX_STRIDE] = record.time;
+    }
+    // a reader sees the record before the count that covers it
+    __atomic_store_n(&mHeader->count, count + 1, __ATOMIC_RELEASE);
+    mNumFrames++;
+}
+
+void FrameStatsFile::dump(String8& result) const {
+    result.appendFormat("Frame stats file: %s/frame_stats.0, %" PRIu64
+            " frames in %" PRIu64 " files, %u of %zu in the current one%s\n",
+            mDir.string(), mNumFrames, mNumFiles,
+            mHeader ? mHeader->count : 0, mCapacity,
+            mFailed ? " (stopped on error)" : "");
+}
+
+// ---------------------------------------------------------------------------
+}; // namespace android
+// ---------------------------------------------------------------------------
@@ -0,0 +1,141 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SF_FRAMESTATSFILE_H
+#define ANDROID_SF_FRAMESTATSFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <utils/RefBase.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+// ---------------------------------------------------------------------------
+namespace android {
+// ---------------------------------------------------------------------------
+
+/*
+ * A binary record of every finished frame, appended to a memory-mapped file
+ * for monitoring jank over days instead of the minutes dumpsys covers. A
+ * frame costs a 24 byte store and no system call, where EventLog formats and
+ * writes an event.
+ *
+ * Frames go to <dir>/frame_stats.0 until it is full or ROLLOVER_PERIOD has
+ * passed; it is then renamed to frame_stats.1, replacing the previous one,
+ * and a new file is started. Each file is a page holding the Header and the
+ * index, followed by Header::capacity Records:
+ *
+ * - Header::count, stored last, is how many Records are valid, so the file
+ *   can be copied while it is being written.
+ * - index[i] is the time of Record i * INDEX_STRIDE; a reader looking for a
+ *   time searches the index, then the few Records after the entry found.
+ *
+ * Everything is in host byte order. Not thread-safe; FrameTracker calls it
+ * with its lock held.
+ */
+class FrameStatsFile : public RefBase {
+public:
+    enum { MAGIC = 0x53465346 }; // "FSFS"
+    enum { VERSION = 1 };
+
+    enum { HEADER_SIZE = 4096 };
+    enum { INDEX_STRIDE = 256 };
+    enum { MAX_INDEX_ENTRIES = (HEADER_SIZE - 64) / sizeof(int64_t) };
+    enum { MAX_CAPACITY = MAX_INDEX_ENTRIES * INDEX_STRIDE };
+
+    static const nsecs_t ROLLOVER_PERIOD;
+
+    // marks an offset that was never known
+    static const int32_t UNKNOWN = INT32_MIN;
+
+    enum {
+        // the frame was never presented, Record::time is its desired
+        // present time
+        FLAG_DROPPED = 1 << 0,
+        // more than one and a half refresh periods since the previous
+        // presented frame
+        FLAG_JANK = 1 << 1,
+    };
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t headerSize;
+        uint32_t recordSize;
+        uint32_t capacity;
+        uint32_t indexStride;
+        uint32_t count;
+        uint32_t reserved;
+        // CLOCK_MONOTONIC and CLOCK_REALTIME when the file was started, to
+        // place the Records in wall time
+        int64_t startMonotonic;
+        int64_t startRealtime;
+        // the refresh period of the first frame
+        int64_t displayPeriod;
+        int64_t reserved2;
+        int64_t index[MAX_INDEX_ENTRIES];
+    };
+
+    struct Record {
+        // the present time, CLOCK_MONOTONIC
+        int64_t time;
+        // us from the desired present and frame ready times to time
+        int32_t desiredOffset;
+        int32_t readyOffset;
+        // us since the previous presented frame, 0 if unknown
+        uint32_t interval;
+        uint32_t flags;
+    };
+
+    // Records up to capacity frames per file in dir, which must exist.
+    FrameStatsFile(const String8& dir, size_t capacity);
+    virtual ~FrameStatsFile();
+
+    // Adds a finished frame; INT64_MAX or 0 stand for a time never known.
+    void addFrame(nsecs_t desiredPresentTime, nsecs_t frameReadyTime,
+            nsecs_t actualPresentTime, nsecs_t displayPeriod);
+
+    // Appends where the frames go and how many were written.
+    void dump(String8& result) const;
+
+private:
+    FrameStatsFile(const FrameStatsFile&);
+    FrameStatsFile& operator=(const FrameStatsFile&);
+
+    // Maps a new frame_stats.0, rolling the current one over first.
+    bool startFile(nsecs_t now, nsecs_t displayPeriod);
+    void closeFile();
+
+    const String8 mDir;
+    const size_t mCapacity;
+
+    Header* mHeader;
+    Record* mRecords;
+    size_t mMapSize;
+
+    nsecs_t mLastPresentTime;
+    uint64_t mNumFrames;
+    uint64_t mNumFiles;
+    // set after a file couldn't be created, to not retry every frame
+    bool mFailed;
+};
+
+// ---------------------------------------------------------------------------
+}; // namespace android
+// ---------------------------------------------------------------------------
+
+#endif // ANDROID_SF_FRAMESTATSFILE_H
@@ -47,11 +47,13 @@ static void vsyncOffCallback(union sigval val) {
 
 EventThread::EventThread(const sp<VSyncSource>& src, SurfaceFlinger& flinger)
     : mVSyncSource(src),
+      mVsyncSnapshot(VsyncSnapshot::create()),
       mFlinger(flinger),
       mUseSoftwareVSync(false),
       mVsyncEnabled(false),
       mDebugVsyncEnabled(false),
-      mVsyncHintSent(false) {
+      mVsyncHintSent(false),
+      mLastVsyncRequest(0) {
 
     for (int32_t i=0 ; i<DisplayDevice::NUM_BUILTIN_DISPLAY_TYPES ; i++) {
         mVSyncEvent[i].header.type = DisplayEventReceiver::DISPLAY_EVENT_VSYNC;
@@ -69,26 +71,40 @@ EventThread::EventThread(const sp<VSyncSource>& src, SurfaceFlinger& flinger)
 
 void EventThread::sendVsyncHintOff() {
     Mutex::Autolock _l(mLock);
+    const nsecs_t idle = systemTime() - mLastVsyncRequest;
+    if (idle < vsyncHintOffDelay) {
+        // vsync was asked for since the timer was set
+        armVsyncHintTimerLocked(vsyncHintOffDelay - idle);
+        return;
+    }
     mPowerHAL.vsyncHint(false);
     mVsyncHintSent = false;
 }
 
+void EventThread::armVsyncHintTimerLocked(nsecs_t delay) {
+    struct itimerspec ts;
+    ts.it_value.tv_sec = delay / 1000000000;
+    ts.it_value.tv_nsec = delay % 1000000000;
+    ts.it_interval.tv_sec = 0;
+    ts.it_interval.tv_nsec = 0;
+    timer_settime(mTimerId, 0, &ts, NULL);
+}
+
 void EventThread::setPhaseOffset(nsecs_t phaseOffset) {
     Mutex::Autolock _l(mLock);
     mVSyncSource->setPhaseOffset(phaseOffset);
 }
 
 void EventThread::sendVsyncHintOnLocked() {
-    struct itimerspec ts;
+    // Only the first request arms the timer; when it fires it checks for
+    // later requests, so that vsyncs asked for back to back don't each
+    // reset it.
+    mLastVsyncRequest = systemTime();
     if(!mVsyncHintSent) {
         mPowerHAL.vsyncHint(true);
         mVsyncHintSent = true;
+        armVsyncHintTimerLocked(vsyncHintOffDelay);
     }
-    ts.it_value.tv_sec = 0;
-    ts.it_value.tv_nsec = vsyncHintOffDelay;
-    ts.it_interval.tv_sec = 0;
-    ts.it_interval.tv_nsec = 0;
-    timer_settime(mTimerId, 0, &ts, NULL);
 }
 
 void EventThread::onFirstRef() {
@@ -103,24 +119,62 @@ sp<EventThread::Connection> EventThread::createEventConnection() const {
 status_t EventThread::registerDisplayEventConnection(
         const sp<EventThread::Connection>& connection) {
     Mutex::Autolock _l(mLock);
+    // Idle connections are not visited on vsync, so this is where the ones
+    // that died get cleaned up
+    for (size_t i = 0; i < mDisplayEventConnections.size(); ) {
+        if (mDisplayEventConnections[i].promote() == NULL) {
+            mDisplayEventConnections.removeAt(i);
+        } else {
+            i++;
+        }
+    }
     mDisplayEventConnections.add(connection);
     mCondition.broadcast();
     return NO_ERROR;
 }
 
 void EventThread::removeDisplayEventConnection(
-        const wp<EventThread::Connection>& connection) {
+        const sp<EventThread::Connection>& connection) {
     Mutex::Autolock _l(mLock);
+    setConnectionCountLocked(connection, -1);
     mDisplayEventConnections.remove(connection);
 }
 
+void EventThread::setConnectionCountLocked(
+        const sp<EventThread::Connection>& connection, int32_t count) {
+    if (connection->count == 0) {
+        mOneShotConnections.remove(connection);
+    } else if (connection->count > 0) {
+        ssize_t index = mContinuousConnections.indexOfKey(connection->count);
+        if (index >= 0) {
+            mContinuousConnections.editValueAt(index).remove(connection);
+            if (mContinuousConnections.valueAt(index).isEmpty()) {
+                mContinuousConnections.removeItemsAt(index);
+            }
+        }
+    }
+
+    connection->count = count;
+
+    if (count == 0) {
+        mOneShotConnections.add(connection);
+    } else if (count > 0) {
+        ssize_t index = mContinuousConnections.indexOfKey(count);
+        if (index < 0) {
+            index = mContinuousConnections.add(count,
+                    SortedVector< wp<Connection> >());
+        }
+        mContinuousConnections.editValueAt(index).add(connection);
+    }
+}
+
 void EventThread::setVsyncRate(uint32_t count,
         const sp<EventThread::Connection>& connection) {
     if (int32_t(count) >= 0) { // server must protect against bad params
         Mutex::Autolock _l(mLock);
         const int32_t new_count = (count == 0) ? -1 : count;
         if (connection->count != new_count) {
-            connection->count = new_count;
+            setConnectionCountLocked(connection, new_count);
             mCondition.broadcast();
         }
     }
@@ -133,7 +187,7 @@ void EventThread::requestNextVsync(
     mFlinger.resyncWithRateLimit();
 
     if (connection->count < 0) {
-        connection->count = 0;
+        setConnectionCountLocked(connection, 0);
         mCondition.broadcast();
     }
 }
@@ -182,24 +236,40 @@ void EventThread::onHotplugReceived(int type, bool connected) {
 }
 
 bool EventThread::threadLoop() {
-    DisplayEventReceiver::Event event;
+    Vector<DisplayEventReceiver::Event> pendingEvents;
+    DisplayEventReceiver::Event vsyncEvent;
+    size_t vsyncConnections = 0;
     Vector< sp<EventThread::Connection> > signalConnections;
-    signalConnections = waitForEvent(&event);
+    signalConnections = waitForEvent(&pendingEvents, &vsyncEvent,
+            &vsyncConnections);
+
+    // Each connection gets all its events in a single write, the pending
+    // ones first
+    Vector<DisplayEventReceiver::Event> events(pendingEvents);
+    events.push(vsyncEvent);
+
+    // Published before the events are written, so that a receiver woken up
+    // by them finds this vsync in the snapshot.
+    if (vsyncConnections > 0 && mVsyncSnapshot != NULL) {
+        mVsyncSnapshot->publish(vsyncEvent);
+    }
 
     // dispatch events to listeners...
     const size_t count = signalConnections.size();
     for (size_t i=0 ; i<count ; i++) {
         const sp<Connection>& conn(signalConnections[i]);
+        const size_t eventCount = pendingEvents.size() +
+                (i < vsyncConnections ? 1 : 0);
         // now see if we still need to report this event
-        status_t err = conn->postEvent(event);
+        status_t err = conn->postEvents(events.array(), eventCount);
         if (err == -EAGAIN || err == -EWOULDBLOCK) {
             // The destination doesn't accept events anymore, it's probably
             // full. For now, we just drop the events on the floor.
             // FIXME: Note that some events cannot be dropped and would have
             // to be re-sent later.
             // Right-now we don't have the ability to do this.
-            ALOGW("EventThread: dropping event (%08x) for connection %p",
-                    event.header.type, conn.get());
+            ALOGW("EventThread: dropping %zu events (%08x) for connection %p",
+                    eventCount, events[0].header.type, conn.get());
         } else if (err < 0) {
             // handle any other error on the pipe as fatal. the only
             // reasonable thing to do is to clean-up this connection.
@@ -211,78 +281,100 @@ bool EventThread::threadLoop() {
 }
 
 // This will return when (1) a vsync event has been received, and (2) there was
-// at least one connection interested in receiving it when we started waiting.
+// at least one connection interested in receiving it when we started waiting,
+// or when there were other events for the connections.
 Vector< sp<EventThread::Connection> > EventThread::waitForEvent(
-        DisplayEventReceiver::Event* event)
+        Vector<DisplayEventReceiver::Event>* outPendingEvents,
+        DisplayEventReceiver::Event* outVsyncEvent,
+        size_t* outVsyncConnections)
 {
     Mutex::Autolock _l(mLock);
     Vector< sp<EventThread::Connection> > signalConnections;
 
     do {
-        bool eventPending = false;
-        bool waitForVSync = false;
-
         size_t vsyncCount = 0;
         nsecs_t timestamp = 0;
         for (int32_t i=0 ; i<DisplayDevice::NUM_BUILTIN_DISPLAY_TYPES ; i++) {
             timestamp = mVSyncEvent[i].header.timestamp;
             if (timestamp) {
                 // we have a vsync event to dispatch
-                *event = mVSyncEvent[i];
+                *outVsyncEvent = mVSyncEvent[i];
                 mVSyncEvent[i].header.timestamp = 0;
                 vsyncCount = mVSyncEvent[i].vsync.count;
                 break;
             }
         }
 
-        if (!timestamp) {
-            // no vsync event, see if there are some other event
-            eventPending = !mPendingEvents.isEmpty();
-            if (eventPending) {
-                // we have some other event to dispatch
-                *event = mPendingEvents[0];
-                mPendingEvents.removeAt(0);
+        // any other events go out along with the vsync
+        const bool eventPending = !mPendingEvents.isEmpty();
+        *outPendingEvents = mPendingEvents;
+        mPendingEvents.clear();
+
+        // we need vsync events if at least one connection is waiting for it
+        const bool waitForVSync = !mOneShotConnections.isEmpty() ||
+                !mContinuousConnections.isEmpty();
+
+        if (timestamp) {
+            // we consume the event only if it's time
+            // (ie: we received a vsync event)
+            for (size_t i=0 ; i<mOneShotConnections.size() ; i++) {
+                sp<Connection> connection(mOneShotConnections[i].promote());
+                if (connection != NULL) {
+                    // fired this time around
+                    connection->count = -1;
+                    signalConnections.add(connection);
+                }
             }
-        }
-
-        // find out connections waiting for events
-        size_t count = mDisplayEventConnections.size();
-        for (size_t i=0 ; i<count ; i++) {
-            sp<Connection> connection(mDisplayEventConnections[i].promote());
-            if (connection != NULL) {
-                bool added = false;
-                if (connection->count >= 0) {
-                    // we need vsync events because at least
-                    // one connection is waiting for it
-                    waitForVSync = true;
-                    if (timestamp) {
-                        // we consume the event only if it's time
-                        // (ie: we received a vsync event)
-                        if (connection->count == 0) {
-                            // fired this time around
-                            connection->count = -1;
-                            signalConnections.add(connection);
-                            added = true;
-                        } else if (connection->count == 1 ||
-                                (vsyncCount % connection->count) == 0) {
-                            // continuous event, and time to report it
-                            signalConnections.add(connection);
-                            added = true;
-                        }
+            mOneShotConnections.clear();
+
+            for (size_t i=0 ; i<mContinuousConnections.size() ; ) {
+                const int32_t rate = mContinuousConnections.keyAt(i);
+                if (rate != 1 && (vsyncCount % rate) != 0) {
+                    // not time to report it to any of these
+                    i++;
+                    continue;
+                }
+                SortedVector< wp<Connection> >& connections(
+                        mContinuousConnections.editValueAt(i));
+                for (size_t j=0 ; j<connections.size() ; ) {
+                    sp<Connection> connection(connections[j].promote());
+                    if (connection != NULL) {
+                        signalConnections.add(connection);
+                        j++;
+                    } else {
+                        // the connection has died, so clean-up!
+                        connections.removeAt(j);
                     }
                 }
-
-                if (eventPending && !timestamp && !added) {
-                    // we don't have a vsync event to process
-                    // (timestamp==0), but we have some pending
-                    // messages.
-                    signalConnections.add(connection);
+                if (connections.isEmpty()) {
+                    mContinuousConnections.removeItemsAt(i);
+                } else {
+                    i++;
+                }
+            }
+        }
+        *outVsyncConnections = signalConnections.size();
+
+        if (eventPending) {
+            // everybody gets the other events; hotplugs are rare enough for
+            // the lookup not to matter
+            SortedVector<Connection*> vsyncConnections;
+            for (size_t i=0 ; i<signalConnections.size() ; i++) {
+                vsyncConnections.add(signalConnections[i].get());
+            }
+            size_t count = mDisplayEventConnections.size();
+            for (size_t i=0 ; i<count ; i++) {
+                sp<Connection> connection(mDisplayEventConnections[i].promote());
+                if (connection != NULL) {
+                    if (vsyncConnections.indexOf(connection.get()) < 0) {
+                        signalConnections.add(connection);
+                    }
+                } else {
+                    // we couldn't promote this reference, the connection has
+                    // died, so clean-up!
+                    mDisplayEventConnections.removeAt(i);
+                    --i; --count;
                 }
-            } else {
-                // we couldn't promote this reference, the connection has
-                // died, so clean-up!
-                mDisplayEventConnections.removeAt(i);
-                --i; --count;
             }
         }
 
@@ -301,8 +393,9 @@ Vector< sp<EventThread::Connection> > EventThread::waitForEvent(
             enableVSyncLocked();
         }
 
-        // note: !timestamp implies signalConnections.isEmpty(), because we
-        // don't populate signalConnections if there's no vsync pending
+        // note: !timestamp implies signalConnections only holds connections
+        // for the pending events, because vsync connections are only added
+        // when there is a vsync
         if (!timestamp && !eventPending) {
             // wait for something to happen
             if (waitForVSync) {
@@ -339,7 +432,7 @@ Vector< sp<EventThread::Connection> > EventThread::waitForEvent(
         }
     } while (signalConnections.isEmpty());
 
-    // here we're guaranteed to have a timestamp and some connections to signal
+    // here we're guaranteed to have some connections to signal
     // (The connections might have dropped out of mDisplayEventConnections
     // while we were asleep, but we'll still have strong references to them.)
     return signalConnections;
@@ -375,6 +468,13 @@ void EventThread::dump(String8& result) const {
     result.appendFormat("  numListeners=%zu,\n  events-delivered: %u\n",
             mDisplayEventConnections.size(),
             mVSyncEvent[DisplayDevice::DISPLAY_PRIMARY].vsync.count);
+    result.appendFormat("  waiting for vsync: one-shot=%zu",
+            mOneShotConnections.size());
+    for (size_t i=0 ; i<mContinuousConnections.size() ; i++) {
+        result.appendFormat(", rate %d=%zu", mContinuousConnections.keyAt(i),
+                mContinuousConnections.valueAt(i).size());
+    }
+    result.append("\n");
     for (size_t i=0 ; i<mDisplayEventConnections.size() ; i++) {
         sp<Connection> connection =
                 mDisplayEventConnections.itemAt(i).promote();
@@ -413,9 +513,22 @@ void EventThread::Connection::requestNextVsync() {
     mEventThread->requestNextVsync(this);
 }
 
+sp<IMemory> EventThread::Connection::getVsyncMemory() const {
+    const sp<VsyncSnapshot>& snapshot(mEventThread->mVsyncSnapshot);
+    if (snapshot == NULL) {
+        return NULL;
+    }
+    return snapshot->getMemory();
+}
+
 status_t EventThread::Connection::postEvent(
         const DisplayEventReceiver::Event& event) {
-    ssize_t size = DisplayEventReceiver::sendEvents(mChannel, &event, 1);
+    return postEvents(&event, 1);
+}
+
+status_t EventThread::Connection::postEvents(
+        const DisplayEventReceiver::Event* events, size_t count) {
+    ssize_t size = DisplayEventReceiver::sendEvents(mChannel, events, count);
     return size < 0 ? status_t(size) : status_t(NO_ERROR);
 }
 
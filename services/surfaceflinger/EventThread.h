@@ -22,9 +22,11 @@
 
 #include <gui/DisplayEventReceiver.h>
 #include <gui/IDisplayEventConnection.h>
+#include <gui/VsyncSnapshot.h>
 
 #include <utils/Errors.h>
 #include <utils/threads.h>
+#include <utils/KeyedVector.h>
 #include <utils/SortedVector.h>
 
 #include "DisplayDevice.h"
@@ -59,6 +61,9 @@ class EventThread : public Thread, private VSyncSource::Callback {
     public:
         Connection(const sp<EventThread>& eventThread);
         status_t postEvent(const DisplayEventReceiver::Event& event);
+        // writes all the events in one go
+        status_t postEvents(const DisplayEventReceiver::Event* events,
+                size_t count);
 
         // count >= 1 : continuous event. count is the vsync rate
         // count == 0 : one-shot event that has not fired
@@ -71,6 +76,7 @@ class EventThread : public Thread, private VSyncSource::Callback {
         virtual sp<BitTube> getDataChannel() const;
         virtual void setVsyncRate(uint32_t count);
         virtual void requestNextVsync();    // asynchronous
+        virtual sp<IMemory> getVsyncMemory() const;
         sp<EventThread> const mEventThread;
         sp<BitTube> const mChannel;
     };
@@ -94,8 +100,13 @@ public:
     // called when receiving a hotplug event
     void onHotplugReceived(int type, bool connected);
 
+    // Waits until there are events for some connection, and returns those
+    // connections. The pending events go to all of them, the vsync event
+    // only to the first outVsyncConnections.
     Vector< sp<EventThread::Connection> > waitForEvent(
-            DisplayEventReceiver::Event* event);
+            Vector<DisplayEventReceiver::Event>* outPendingEvents,
+            DisplayEventReceiver::Event* outVsyncEvent,
+            size_t* outVsyncConnections);
 
     void dump(String8& result) const;
     void sendVsyncHintOff();
@@ -108,13 +119,21 @@ private:
 
     virtual void onVSyncEvent(nsecs_t timestamp);
 
-    void removeDisplayEventConnection(const wp<Connection>& connection);
+    void removeDisplayEventConnection(const sp<Connection>& connection);
+    // sets connection->count, moving the connection to the list that goes
+    // with it
+    void setConnectionCountLocked(const sp<Connection>& connection,
+            int32_t count);
     void enableVSyncLocked();
     void disableVSyncLocked();
     void sendVsyncHintOnLocked();
+    void armVsyncHintTimerLocked(nsecs_t delay);
 
     // constants
     sp<VSyncSource> mVSyncSource;
+    // The last vsync threadLoop() delivered, shared with every connection;
+    // NULL if the memory couldn't be allocated. Written by threadLoop() only.
+    sp<VsyncSnapshot> mVsyncSnapshot;
     PowerHAL mPowerHAL;
     SurfaceFlinger& mFlinger;
 
@@ -123,6 +142,11 @@ private:
 
     // protected by mLock
     SortedVector< wp<Connection> > mDisplayEventConnections;
+    // The connections that want vsync events, so that each vsync only has
+    // to visit those it is due for: one-shot requests, and continuous ones
+    // keyed by their rate.
+    SortedVector< wp<Connection> > mOneShotConnections;
+    KeyedVector< int32_t, SortedVector< wp<Connection> > > mContinuousConnections;
     Vector< DisplayEventReceiver::Event > mPendingEvents;
     DisplayEventReceiver::Event mVSyncEvent[DisplayDevice::NUM_BUILTIN_DISPLAY_TYPES];
     bool mUseSoftwareVSync;
@@ -132,6 +156,7 @@ private:
     bool mDebugVsyncEnabled;
 
     bool mVsyncHintSent;
+    nsecs_t mLastVsyncRequest;
     timer_t mTimerId;
 };
 
@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <log/log.h>
+#include <utils/Trace.h>
+
+#include "FenceMonitor.h"
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+FenceMonitor::SignalTime::SignalTime(const sp<Fence>& fence)
+    : mTime(INT64_MAX), mFence(fence)
+{
+}
+
+nsecs_t FenceMonitor::SignalTime::get() const {
+    nsecs_t time = mTime.load(std::memory_order_acquire);
+    if (time == INT64_MAX && mFence != NULL) {
+        time = mFence->getSignalTime();
+        if (time != INT64_MAX) {
+            mTime.store(time, std::memory_order_release);
+            mFence.clear();
+        }
+    }
+    return time;
+}
+
+// ---------------------------------------------------------------------------
+
+FenceMonitor::FenceMonitor()
+    : Thread(false),
+      mEventFd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+{
+    ALOGE_IF(mEventFd < 0, "could not create the fence monitor eventfd: %s",
+            strerror(errno));
+}
+
+FenceMonitor::~FenceMonitor() {
+    for (const Watched& watched : mWatched) {
+        close(watched.fd);
+    }
+    if (mEventFd >= 0) {
+        close(mEventFd);
+    }
+}
+
+sp<FenceMonitor::SignalTime> FenceMonitor::watch(
+        const sp<FenceMonitor>& monitor, const sp<Fence>& fence) {
+    if (fence == NULL || !fence->isValid()) {
+        sp<SignalTime> time = new SignalTime(NULL);
+        time->mTime.store(-1, std::memory_order_release);
+        return time;
+    }
+    if (monitor == NULL || monitor->mEventFd < 0) {
+        return new SignalTime(fence);
+    }
+    sp<SignalTime> time = new SignalTime(NULL);
+    monitor->add(fence, time);
+    return time;
+}
+
+void FenceMonitor::add(const sp<Fence>& fence, const sp<SignalTime>& time) {
+    Mutex::Autolock lock(mLock);
+    // the fd is duplicated on the monitor thread, off the caller's path
+    Watched watched = { fence, time, -1 };
+    mAdded.add(watched);
+    if (mAdded.size() == 1) {
+        wake();
+    }
+}
+
+void FenceMonitor::wake() {
+    uint64_t one = 1;
+    if (write(mEventFd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        ALOGE("could not wake the fence monitor: %s", strerror(errno));
+    }
+}
+
+void FenceMonitor::requestExit() {
+    Thread::requestExit();
+    if (mEventFd >= 0) {
+        wake();
+    }
+}
+
+status_t FenceMonitor::readyToRun() {
+    return mEventFd < 0 ? NO_INIT : NO_ERROR;
+}
+
+bool FenceMonitor::threadLoop() {
+    {
+        Mutex::Autolock lock(mLock);
+        for (size_t i = 0; i < mAdded.size(); i++) {
+            Watched watched = mAdded[i];
+            watched.fd = watched.fence->dup();
+            if (watched.fd < 0) {
+                ALOGE("could not duplicate a fence fd: %s", strerror(errno));
+                watched.time->mTime.store(-1, std::memory_order_release);
+                continue;
+            }
+            mWatched.push_back(watched);
+        }
+        mAdded.clear();
+    }
+
+    mPollFds.resize(mWatched.size() + 1);
+    mPollFds[0].fd = mEventFd;
+    mPollFds[0].events = POLLIN;
+    mPollFds[0].revents = 0;
+    for (size_t i = 0; i < mWatched.size(); i++) {
+        mPollFds[i + 1].fd = mWatched[i].fd;
+        mPollFds[i + 1].events = POLLIN;
+        mPollFds[i + 1].revents = 0;
+    }
+
+    int ready = poll(mPollFds.data(), mPollFds.size(), -1);
+    if (ready < 0) {
+        if (errno != EINTR) {
+            ALOGE("fence monitor poll failed: %s", strerror(errno));
+        }
+        return true;
+    }
+
+    if (mPollFds[0].revents & POLLIN) {
+        uint64_t count;
+        read(mEventFd, &count, sizeof(count));
+    }
+
+    ATRACE_NAME("FenceMonitor");
+    // walk backwards so that erasing keeps the poll fds lined up
+    for (size_t i = mWatched.size(); i > 0; i--) {
+        if (mPollFds[i].revents == 0) {
+            continue;
+        }
+        Watched& watched = mWatched[i - 1];
+        nsecs_t time = watched.fence->getSignalTime();
+        if (time == INT64_MAX && !(mPollFds[i].revents & (POLLERR | POLLNVAL))) {
+            continue;
+        }
+        watched.time->mTime.store(time == INT64_MAX ? -1 : time,
+                std::memory_order_release);
+        close(watched.fd);
+        mWatched.erase(mWatched.begin() + (i - 1));
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+
+}; // namespace android
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SF_FENCEMONITOR_H
+#define ANDROID_SF_FENCEMONITOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ui/Fence.h>
+#include <utils/Mutex.h>
+#include <utils/RefBase.h>
+#include <utils/Thread.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+#include <atomic>
+#include <vector>
+
+struct pollfd;
+
+namespace android {
+
+/*
+ * A thread that waits on fences with a single poll() over all of them, and
+ * records the time each one signaled.
+ *
+ * watch() hands back a SignalTime that the thread fills in. Reading it is
+ * an atomic load, so the frame trackers can look at their fences as often
+ * as they like without a sync ioctl per fence and per look. The times are
+ * the ones the kernel recorded, so they are exact however late the thread
+ * gets to run.
+ */
+class FenceMonitor : public Thread {
+public:
+    class SignalTime : public LightRefBase<SignalTime> {
+    public:
+        // The time the fence signaled, INT64_MAX while it is pending, or -1
+        // if it was invalid or could not be read.
+        nsecs_t get() const;
+
+    private:
+        friend class FenceMonitor;
+        friend class LightRefBase<SignalTime>;
+        explicit SignalTime(const sp<Fence>& fence);
+        ~SignalTime() {}
+
+        mutable std::atomic<nsecs_t> mTime;
+        // only set when nothing monitors the fence, in which case get()
+        // asks it directly and must be called under the owner's lock
+        mutable sp<Fence> mFence;
+    };
+
+    FenceMonitor();
+    virtual ~FenceMonitor();
+
+    // Starts waiting on fence. With a null monitor the returned time polls
+    // the fence itself, as the trackers did before there was a monitor.
+    static sp<SignalTime> watch(const sp<FenceMonitor>& monitor,
+            const sp<Fence>& fence);
+
+    virtual void requestExit();
+
+private:
+    struct Watched {
+        sp<Fence> fence;
+        sp<SignalTime> time;
+        int fd;
+    };
+
+    virtual status_t readyToRun();
+    virtual bool threadLoop();
+
+    void add(const sp<Fence>& fence, const sp<SignalTime>& time);
+    void wake();
+
+    // wakes the thread up when fences are added or on exit
+    int mEventFd;
+
+    Mutex mLock;
+    Vector<Watched> mAdded;
+
+    // owned by the thread
+    std::vector<Watched> mWatched;
+    std::vector<struct pollfd> mPollFds;
+};
+
+}; // namespace android
+
+#endif // ANDROID_SF_FENCEMONITOR_H
@@ -45,7 +45,7 @@ void FenceTracker::dump(String8* outString) {
         if (frame.glesCompositionDoneTime) {
             outString->appendFormat("- GLES done\t%" PRId64 "\n",
                     frame.glesCompositionDoneTime);
-        } else if (frame.glesCompositionDoneFence != Fence::NO_FENCE) {
+        } else if (frame.glesCompositionDoneFence != NULL) {
             outString->append("- GLES done\tNot signaled\n");
         }
         if (frame.retireTime) {
@@ -85,40 +85,48 @@ static inline bool isValidTimestamp(nsecs_t time) {
 void FenceTracker::checkFencesForCompletion() {
     ATRACE_CALL();
     for (auto& frame : mFrames) {
-        if (frame.retireFence != Fence::NO_FENCE) {
-            nsecs_t time = frame.retireFence->getSignalTime();
+        if (frame.retireFence != NULL) {
+            nsecs_t time = frame.retireFence->get();
             if (isValidTimestamp(time)) {
                 frame.retireTime = time;
-                frame.retireFence = Fence::NO_FENCE;
+                frame.retireFence = NULL;
             }
         }
-        if (frame.glesCompositionDoneFence != Fence::NO_FENCE) {
-            nsecs_t time = frame.glesCompositionDoneFence->getSignalTime();
+        if (frame.glesCompositionDoneFence != NULL) {
+            nsecs_t time = frame.glesCompositionDoneFence->get();
             if (isValidTimestamp(time)) {
                 frame.glesCompositionDoneTime = time;
-                frame.glesCompositionDoneFence = Fence::NO_FENCE;
+                frame.glesCompositionDoneFence = NULL;
             }
         }
         for (auto& kv : frame.layers) {
             LayerRecord& layer = kv.second;
-            if (layer.acquireFence != Fence::NO_FENCE) {
-                nsecs_t time = layer.acquireFence->getSignalTime();
+            if (layer.acquireFence != NULL) {
+                nsecs_t time = layer.acquireFence->get();
                 if (isValidTimestamp(time)) {
                     layer.acquireTime = time;
-                    layer.acquireFence = Fence::NO_FENCE;
+                    layer.acquireFence = NULL;
                 }
             }
-            if (layer.releaseFence != Fence::NO_FENCE) {
-                nsecs_t time = layer.releaseFence->getSignalTime();
+            if (layer.releaseFence != NULL) {
+                nsecs_t time = layer.releaseFence->get();
                 if (isValidTimestamp(time)) {
                     layer.releaseTime = time;
-                    layer.releaseFence = Fence::NO_FENCE;
+                    layer.releaseFence = NULL;
                 }
             }
         }
     }
 }
 
+sp<FenceMonitor::SignalTime> FenceTracker::watch(
+        const sp<Fence>& fence) const {
+    if (fence == Fence::NO_FENCE) {
+        return NULL;
+    }
+    return FenceMonitor::watch(mFenceMonitor, fence);
+}
+
 void FenceTracker::addFrame(nsecs_t refreshStartTime, sp<Fence> retireFence,
         const Vector<sp<Layer>>& layers, sp<Fence> glDoneFence) {
     ATRACE_CALL();
@@ -126,6 +134,11 @@ void FenceTracker::addFrame(nsecs_t refreshStartTime, sp<Fence> retireFence,
     FrameRecord& frame = mFrames[mOffset];
     FrameRecord& prevFrame = mFrames[(mOffset + MAX_FRAME_HISTORY - 1) %
                                      MAX_FRAME_HISTORY];
+    if (!mChannels.empty()) {
+        // the oldest record goes out with whatever is known by now
+        checkFencesForCompletion();
+        sendFrameEventsLocked(frame, true);
+    }
     frame.layers.clear();
 
     bool wasGlesCompositionDone = false;
@@ -146,45 +159,89 @@ void FenceTracker::addFrame(nsecs_t refreshStartTime, sp<Fence> retireFence,
             frame.layers.emplace(std::piecewise_construct,
                     std::forward_as_tuple(layerId),
                     std::forward_as_tuple(name, frameNumber, glesComposition,
-                    postedTime, 0, 0, acquireFence, prevReleaseFence));
+                    postedTime, 0, 0, watch(acquireFence),
+                    watch(prevReleaseFence)));
             wasGlesCompositionDone = true;
         } else {
             frame.layers.emplace(std::piecewise_construct,
                     std::forward_as_tuple(layerId),
                     std::forward_as_tuple(name, frameNumber, glesComposition,
-                    postedTime, 0, 0, acquireFence, Fence::NO_FENCE));
+                    postedTime, 0, 0, watch(acquireFence),
+                    sp<FenceMonitor::SignalTime>()));
             auto prevLayer = prevFrame.layers.find(layerId);
             if (prevLayer != prevFrame.layers.end()) {
-                prevLayer->second.releaseFence = prevReleaseFence;
+                prevLayer->second.releaseFence = watch(prevReleaseFence);
             }
         }
 #else
         frame.layers.emplace(std::piecewise_construct,
                 std::forward_as_tuple(layerId),
                 std::forward_as_tuple(name, frameNumber, glesComposition,
-                postedTime, 0, 0, acquireFence,
-                glesComposition ? Fence::NO_FENCE : prevReleaseFence));
+                postedTime, 0, 0, watch(acquireFence),
+                glesComposition ? sp<FenceMonitor::SignalTime>() :
+                        watch(prevReleaseFence)));
         if (glesComposition) {
             wasGlesCompositionDone = true;
         }
 #endif
-        frame.layers.emplace(std::piecewise_construct,
-                std::forward_as_tuple(layerId),
-                std::forward_as_tuple(name, frameNumber, glesComposition,
-                postedTime, 0, 0, acquireFence, prevReleaseFence));
     }
 
     frame.frameId = mFrameCounter;
     frame.refreshStartTime = refreshStartTime;
     frame.retireTime = 0;
     frame.glesCompositionDoneTime = 0;
-    prevFrame.retireFence = retireFence;
-    frame.retireFence = Fence::NO_FENCE;
-    frame.glesCompositionDoneFence = wasGlesCompositionDone ? glDoneFence :
-            Fence::NO_FENCE;
+    prevFrame.retireFence = watch(retireFence);
+    frame.retireFence = NULL;
+    frame.glesCompositionDoneFence = wasGlesCompositionDone ?
+            watch(glDoneFence) : sp<FenceMonitor::SignalTime>();
 
     mOffset = (mOffset + 1) % MAX_FRAME_HISTORY;
     mFrameCounter++;
+
+    for (size_t i = 0; i < MAX_FRAME_HISTORY && !mChannels.empty(); i++) {
+        sendFrameEventsLocked(mFrames[i], false);
+    }
+}
+
+void FenceTracker::sendFrameEventsLocked(FrameRecord& frame, bool evicting) {
+    // a frame's retire fence arrives with the next frame, and so does the
+    // release fence of a layer that HWC composed
+    bool frameDone = frame.retireTime != 0 &&
+            frame.glesCompositionDoneFence == NULL;
+    for (auto& kv : frame.layers) {
+        LayerRecord& layer = kv.second;
+        if (layer.sent) {
+            continue;
+        }
+        auto channel = mChannels.find(kv.first);
+        if (channel == mChannels.end()) {
+            continue;
+        }
+        bool layerDone = layer.acquireFence == NULL && layer.releaseTime != 0;
+        if (!evicting && !(frameDone && layerDone)) {
+            continue;
+        }
+
+        FrameTimestamps timestamps;
+        fillTimestamps(frame, layer, &timestamps);
+        layer.sent = true;
+        ssize_t size = BitTube::sendObjects(channel->second, &timestamps, 1);
+        if (size < 0 && size != -EAGAIN) {
+            // the receiving end was closed
+            mChannels.erase(channel);
+        }
+    }
+}
+
+void FenceTracker::fillTimestamps(const FrameRecord& frame,
+        const LayerRecord& layer, FrameTimestamps* outTimestamps) {
+    outTimestamps->frameNumber = layer.frameNumber;
+    outTimestamps->postedTime = layer.postedTime;
+    outTimestamps->acquireTime = layer.acquireTime;
+    outTimestamps->refreshStartTime = frame.refreshStartTime;
+    outTimestamps->glCompositionDoneTime = frame.glesCompositionDoneTime;
+    outTimestamps->displayRetireTime = frame.retireTime;
+    outTimestamps->releaseTime = layer.releaseTime;
 }
 
 bool FenceTracker::getFrameTimestamps(const Layer& layer,
@@ -204,16 +261,41 @@ bool FenceTracker::getFrameTimestamps(const Layer& layer,
         return false;
     }
 
-    const FrameRecord& frameRecord = mFrames[i];
-    const LayerRecord& layerRecord = mFrames[i].layers[layerId];
-    outTimestamps->frameNumber = frameNumber;
-    outTimestamps->postedTime = layerRecord.postedTime;
-    outTimestamps->acquireTime = layerRecord.acquireTime;
-    outTimestamps->refreshStartTime = frameRecord.refreshStartTime;
-    outTimestamps->glCompositionDoneTime = frameRecord.glesCompositionDoneTime;
-    outTimestamps->displayRetireTime = frameRecord.retireTime;
-    outTimestamps->releaseTime = layerRecord.releaseTime;
+    fillTimestamps(mFrames[i], mFrames[i].layers[layerId], outTimestamps);
     return true;
 }
 
+void FenceTracker::setFenceMonitor(const sp<FenceMonitor>& monitor) {
+    Mutex::Autolock lock(mMutex);
+    mFenceMonitor = monitor;
+}
+
+status_t FenceTracker::createFrameEventChannel(const Layer& layer,
+        sp<BitTube>* outChannel) {
+    sp<BitTube> channel = new BitTube();
+    status_t err = channel->initCheck();
+    if (err != NO_ERROR) {
+        ALOGE("could not create a frame event channel: %d", err);
+        return err;
+    }
+
+    Mutex::Autolock lock(mMutex);
+    // frames already tracked have been queued before the channel existed
+    int32_t layerId = layer.getSequence();
+    for (auto& frame : mFrames) {
+        auto record = frame.layers.find(layerId);
+        if (record != frame.layers.end()) {
+            record->second.sent = true;
+        }
+    }
+    mChannels[layerId] = channel;
+    *outChannel = channel;
+    return NO_ERROR;
+}
+
+void FenceTracker::removeFrameEventChannel(const Layer& layer) {
+    Mutex::Autolock lock(mMutex);
+    mChannels.erase(layer.getSequence());
+}
+
 } // namespace android
@@ -17,6 +17,7 @@
 #ifndef ANDROID_FENCETRACKER_H
 #define ANDROID_FENCETRACKER_H
 
+#include <gui/BitTube.h>
 #include <ui/Fence.h>
 #include <utils/Mutex.h>
 #include <utils/RefBase.h>
@@ -26,6 +27,8 @@
 
 #include <unordered_map>
 
+#include "FenceMonitor.h"
+
 namespace android {
 
 class Layer;
@@ -33,6 +36,10 @@ struct FrameTimestamps;
 /*
  * Keeps a circular buffer of fence/timestamp data for the last N frames in
  * SurfaceFlinger. Gets timestamps for fences after they have signaled.
+ *
+ * Layers can also have a frame event channel, on which each of their frames
+ * is sent as soon as all its times are known, or as it is when its record
+ * is about to be reused.
  */
 class FenceTracker {
 public:
@@ -42,6 +49,12 @@ public:
              const Vector<sp<Layer>>& layers, sp<Fence> glDoneFence);
      bool getFrameTimestamps(const Layer& layer, uint64_t frameNumber,
              FrameTimestamps* outTimestamps);
+     // Hands the fences of the frames added from now on to the monitor.
+     void setFenceMonitor(const sp<FenceMonitor>& monitor);
+     // See IGraphicBufferProducer::createFrameEventChannel
+     status_t createFrameEventChannel(const Layer& layer,
+             sp<BitTube>* outChannel);
+     void removeFrameEventChannel(const Layer& layer);
 
 protected:
      static constexpr size_t MAX_FRAME_HISTORY = 8;
@@ -53,21 +66,24 @@ protected:
          nsecs_t postedTime; // time when buffer was queued
          nsecs_t acquireTime; // timestamp from the acquire fence
          nsecs_t releaseTime; // timestamp from the release fence
-         sp<Fence> acquireFence; // acquire fence
-         sp<Fence> releaseFence; // release fence
+         sp<FenceMonitor::SignalTime> acquireFence; // acquire fence
+         sp<FenceMonitor::SignalTime> releaseFence; // release fence
+         bool sent; // has it gone out on the layer's frame event channel?
 
          LayerRecord(const String8& name, uint64_t frameNumber,
                  bool isGlesComposition, nsecs_t postedTime,
                  nsecs_t acquireTime, nsecs_t releaseTime,
-                 sp<Fence> acquireFence, sp<Fence> releaseFence) :
+                 sp<FenceMonitor::SignalTime> acquireFence,
+                 sp<FenceMonitor::SignalTime> releaseFence) :
                  name(name), frameNumber(frameNumber),
                  isGlesComposition(isGlesComposition), postedTime(postedTime),
                  acquireTime(acquireTime), releaseTime(releaseTime),
-                 acquireFence(acquireFence), releaseFence(releaseFence) {};
+                 acquireFence(acquireFence), releaseFence(releaseFence),
+                 sent(false) {};
          LayerRecord() : name("uninitialized"), frameNumber(0),
                  isGlesComposition(false), postedTime(0), acquireTime(0),
-                 releaseTime(0), acquireFence(Fence::NO_FENCE),
-                 releaseFence(Fence::NO_FENCE) {};
+                 releaseTime(0), acquireFence(), releaseFence(),
+                 sent(false) {};
      };
 
      struct FrameRecord {
@@ -82,22 +98,31 @@ protected:
          // timestamp from the GLES composition completion fence
          nsecs_t glesCompositionDoneTime;
          // primary display retire fence for this frame
-         sp<Fence> retireFence;
+         sp<FenceMonitor::SignalTime> retireFence;
          // if GLES composition was done, the fence for its completion
-         sp<Fence> glesCompositionDoneFence;
+         sp<FenceMonitor::SignalTime> glesCompositionDoneFence;
 
          FrameRecord() : frameId(0), layers(), refreshStartTime(0),
                  retireTime(0), glesCompositionDoneTime(0),
-                 retireFence(Fence::NO_FENCE),
-                 glesCompositionDoneFence(Fence::NO_FENCE) {}
+                 retireFence(), glesCompositionDoneFence() {}
      };
 
      uint64_t mFrameCounter;
      uint32_t mOffset;
      FrameRecord mFrames[MAX_FRAME_HISTORY];
      Mutex mMutex;
+     sp<FenceMonitor> mFenceMonitor;
+     // frame event channels, by layer sequence
+     std::unordered_map<int32_t, sp<BitTube>> mChannels;
 
      void checkFencesForCompletion();
+     // NULL for NO_FENCE, which is how the records mark a missing fence
+     sp<FenceMonitor::SignalTime> watch(const sp<Fence>& fence) const;
+     // Sends the layers of the frame that have a channel, if all their times
+     // are known or the record is going away.
+     void sendFrameEventsLocked(FrameRecord& frame, bool evicting);
+     static void fillTimestamps(const FrameRecord& frame,
+             const LayerRecord& layer, FrameTimestamps* outTimestamps);
 };
 
 }
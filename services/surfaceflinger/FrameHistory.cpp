@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// This is needed for stdint.h to define INT64_MAX in C++
+#define __STDC_LIMIT_MACROS
+
+#include <inttypes.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "FrameHistory.h"
+
+namespace android {
+
+const int32_t FrameHistory::UNKNOWN;
+
+static bool isKnown(nsecs_t time) {
+    return time > 0 && time < INT64_MAX;
+}
+
+FrameHistory::FrameHistory()
+    : mCapacity(0), mNext(0), mAnchor(0), mDisplayPeriod(0)
+{
+    clear();
+}
+
+void FrameHistory::setCapacity(size_t capacity) {
+    if (capacity == mCapacity) {
+        return;
+    }
+    mCapacity = capacity;
+    // the offsets only make sense in order, so start over
+    std::vector<PackedFrame>().swap(mFrames);
+    mFrames.reserve(capacity);
+    mNext = 0;
+    clear();
+}
+
+int32_t FrameHistory::packOffset(nsecs_t time, nsecs_t anchor) {
+    if (!isKnown(time) || anchor == 0) {
+        return UNKNOWN;
+    }
+    // offsets beyond half an hour are clamped
+    const nsecs_t us = ns2us(time - anchor);
+    return int32_t(std::min<nsecs_t>(std::max<nsecs_t>(us, INT32_MIN + 1),
+            INT32_MAX));
+}
+
+void FrameHistory::addFrame(nsecs_t desiredPresentTime,
+        nsecs_t frameReadyTime, nsecs_t actualPresentTime,
+        nsecs_t displayPeriod) {
+    if (mCapacity == 0) {
+        return;
+    }
+    mDisplayPeriod = displayPeriod;
+
+    PackedFrame frame;
+    if (isKnown(actualPresentTime)) {
+        frame.presentDelta = packOffset(actualPresentTime, mAnchor);
+        if (mAnchor != 0) {
+            const nsecs_t interval = actualPresentTime - mAnchor;
+            const size_t bucket = std::min<size_t>(
+                    size_t(std::max<nsecs_t>(interval, 0) >> BUCKET_SHIFT),
+                    NUM_BUCKETS - 1);
+            mIntervals[bucket]++;
+            mNumIntervals++;
+            if (displayPeriod > 0 && interval > displayPeriod * 3 / 2) {
+                mNumJankyIntervals++;
+            }
+            mMaxInterval = std::max(mMaxInterval, interval);
+        }
+        mAnchor = actualPresentTime;
+    } else {
+        frame.presentDelta = UNKNOWN;
+        mNumDroppedFrames++;
+    }
+    frame.desiredOffset = packOffset(desiredPresentTime, mAnchor);
+    frame.readyOffset = packOffset(frameReadyTime, mAnchor);
+    mNumFrames++;
+
+    if (mFrames.size() < mCapacity) {
+        mFrames.push_back(frame);
+    } else {
+        mFrames[mNext] = frame;
+        mNext = (mNext + 1) % mCapacity;
+    }
+}
+
+void FrameHistory::clear() {
+    mFrames.clear();
+    mNext = 0;
+    mAnchor = 0;
+    memset(mIntervals, 0, sizeof(mIntervals));
+    mNumFrames = 0;
+    mNumIntervals = 0;
+    mNumJankyIntervals = 0;
+    mNumDroppedFrames = 0;
+    mMaxInterval = 0;
+}
+
+nsecs_t FrameHistory::getPercentile(uint32_t percent) const {
+    const uint64_t target = (mNumIntervals * percent + 99) / 100;
+    uint64_t count = 0;
+    for (size_t i = 0; i < NUM_BUCKETS; i++) {
+        count += mIntervals[i];
+        if (count >= target) {
+            // report the top of the bucket, or the longest interval for the
+            // catch-all one
+            return i == NUM_BUCKETS - 1 ? mMaxInterval :
+                    nsecs_t(i + 1) << BUCKET_SHIFT;
+        }
+    }
+    return mMaxInterval;
+}
+
+void FrameHistory::dump(String8& result) const {
+    if (mCapacity == 0) {
+        result.append("frame history disabled\n");
+        return;
+    }
+    result.appendFormat("frames %" PRIu64 " (%zu of %zu kept), dropped %"
+            PRIu64 ", intervals longer than 1.5 refreshes %" PRIu64 "\n",
+            mNumFrames, mFrames.size(), mCapacity, mNumDroppedFrames,
+            mNumJankyIntervals);
+    if (mNumIntervals == 0) {
+        return;
+    }
+    result.appendFormat("present interval p50 %.1f ms, p90 %.1f ms, "
+            "p95 %.1f ms, p99 %.1f ms, max %.1f ms\n",
+            getPercentile(50) / 1e6, getPercentile(90) / 1e6,
+            getPercentile(95) / 1e6, getPercentile(99) / 1e6,
+            mMaxInterval / 1e6);
+}
+
+void FrameHistory::exportTo(const String8& name, String8& result) const {
+    Header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.frameSize = sizeof(PackedFrame);
+    header.nameLength = name.length();
+    header.count = mFrames.size();
+    header.displayPeriod = mDisplayPeriod;
+    header.lastPresentTime = mAnchor;
+    result.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    result.append(name.string(), name.length());
+
+    // oldest first; mNext is only non-zero once the history has wrapped
+    const char* frames = reinterpret_cast<const char*>(mFrames.data());
+    const size_t split = mNext * sizeof(PackedFrame);
+    const size_t size = mFrames.size() * sizeof(PackedFrame);
+    if (size > 0) {
+        result.append(frames + split, size - split);
+        if (split > 0) {
+            result.append(frames, split);
+        }
+    }
+}
+
+}; // namespace android
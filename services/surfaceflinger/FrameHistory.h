@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_FRAMEHISTORY_H
+#define ANDROID_FRAMEHISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+#include <vector>
+
+namespace android {
+
+/*
+ * A long, compact timeline of finished frames, with online statistics on
+ * the intervals between them.
+ *
+ * Each frame is packed into 12 bytes of microsecond offsets against a
+ * running anchor, the present time of the last frame that was presented,
+ * so that thousands of frames fit where FrameTracker keeps 128. Frames are
+ * added in order and the oldest are dropped once the capacity is reached.
+ * The statistics cover every frame added since the last clear(), not just
+ * the ones kept.
+ *
+ * Not thread-safe; FrameTracker calls it with its lock held.
+ */
+class FrameHistory {
+public:
+    // Binary export, in host byte order: a Header, the name (not NUL
+    // terminated), and then Header::count PackedFrames, oldest first.
+    // The anchor of the newest frame is Header::lastPresentTime; going
+    // backwards, a frame's anchor is the next frame's anchor less the next
+    // frame's presentDelta (if known).
+    enum { MAGIC = 0x48465346 }; // "SFFH"
+    enum { VERSION = 1 };
+
+    // marks an offset that was never known
+    static const int32_t UNKNOWN = INT32_MIN;
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t frameSize;
+        uint32_t nameLength;
+        uint32_t count;
+        uint32_t reserved;
+        int64_t displayPeriod;
+        int64_t lastPresentTime;
+    };
+
+    struct PackedFrame {
+        // us from the previous anchor to the present time, which then
+        // becomes the anchor, or UNKNOWN if the frame was never presented
+        int32_t presentDelta;
+        // us from the anchor to the desired present and frame ready times
+        int32_t desiredOffset;
+        int32_t readyOffset;
+    };
+
+    FrameHistory();
+
+    // Keeps the last capacity frames. 0 frees the history and stops
+    // collecting statistics.
+    void setCapacity(size_t capacity);
+    size_t getCapacity() const { return mCapacity; }
+
+    // Adds a finished frame; INT64_MAX or 0 stand for a time never known.
+    void addFrame(nsecs_t desiredPresentTime, nsecs_t frameReadyTime,
+            nsecs_t actualPresentTime, nsecs_t displayPeriod);
+
+    void clear();
+
+    // Appends the interval percentiles and jank counts.
+    void dump(String8& result) const;
+
+    // Appends the binary export described above.
+    void exportTo(const String8& name, String8& result) const;
+
+private:
+    enum {
+        // present intervals are binned in half milliseconds
+        BUCKET_SHIFT = 19,
+        NUM_BUCKETS = 256
+    };
+
+    static int32_t packOffset(nsecs_t time, nsecs_t anchor);
+    // the interval below which the given fraction of intervals fall
+    nsecs_t getPercentile(uint32_t percent) const;
+
+    size_t mCapacity;
+    std::vector<PackedFrame> mFrames;
+    // where the next frame goes once the history has wrapped
+    size_t mNext;
+    nsecs_t mAnchor;
+    nsecs_t mDisplayPeriod;
+
+    uint32_t mIntervals[NUM_BUCKETS];
+    uint64_t mNumFrames;
+    uint64_t mNumIntervals;
+    // intervals of more than one and a half refresh periods
+    uint64_t mNumJankyIntervals;
+    uint64_t mNumDroppedFrames;
+    nsecs_t mMaxInterval;
+};
+
+}; // namespace android
+
+#endif // ANDROID_FRAMEHISTORY_H
@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// This is needed for stdint.h to define UINT32_MAX in C++
+#define __STDC_LIMIT_MACROS
+
+#include <inttypes.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "FrameStageMonitor.h"
+
+namespace android {
+
+FrameStageMonitor::Composition::Composition()
+    : layers(0), clientLayers(0), deviceLayers(0), otherLayers(0)
+{
+}
+
+FrameStageMonitor::FrameStageMonitor()
+    : mFrameOpen(false),
+      mLapStart(0),
+      mFrameTime(0),
+      mNext(0),
+      mNumFrames(0),
+      mNumSlowFrames(0),
+      mNextSlowFrame(0)
+{
+    memset(mStageTimes, 0, sizeof(mStageTimes));
+    memset(mHistogram, 0, sizeof(mHistogram));
+    mWindow.reserve(WINDOW);
+    mSlowFrames.reserve(MAX_SLOW_FRAMES);
+}
+
+const char* FrameStageMonitor::getStageName(size_t stage) {
+    static const char* const names[NUM_STAGES + 1] = {
+        "transaction",
+        "page flip",
+        "preComposition",
+        "rebuildLayerStacks",
+        "setUpHWComposer",
+        "doComposition",
+        "postFramebuffer",
+        "postComposition",
+        "whole frame",
+    };
+    return names[stage];
+}
+
+size_t FrameStageMonitor::getBucket(uint32_t us) {
+    return std::min<size_t>(us / BUCKET_US, NUM_BUCKETS - 1);
+}
+
+void FrameStageMonitor::begin() {
+    mLapStart = systemTime(SYSTEM_TIME_MONOTONIC);
+    if (!mFrameOpen) {
+        mFrameOpen = true;
+        mFrameTime = 0;
+        memset(mStageTimes, 0, sizeof(mStageTimes));
+    }
+}
+
+void FrameStageMonitor::mark(Stage stage) {
+    if (!mFrameOpen) {
+        return;
+    }
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    const nsecs_t elapsed = now - mLapStart;
+    mLapStart = now;
+    mStageTimes[stage] += elapsed;
+    mFrameTime += elapsed;
+}
+
+void FrameStageMonitor::endFrame(nsecs_t deadline,
+        const Composition& composition) {
+    if (!mFrameOpen) {
+        return;
+    }
+    mFrameOpen = false;
+
+    // stages beyond an hour are clamped
+    FrameTimes times;
+    for (size_t i = 0; i < NUM_STAGES; i++) {
+        times.us[i] = uint32_t(std::min<nsecs_t>(ns2us(mStageTimes[i]),
+                UINT32_MAX));
+    }
+    times.us[NUM_STAGES] = uint32_t(std::min<nsecs_t>(ns2us(mFrameTime),
+            UINT32_MAX));
+
+    Mutex::Autolock lock(mLock);
+    if (mWindow.size() < WINDOW) {
+        mWindow.push_back(times);
+    } else {
+        FrameTimes& oldest(mWindow[mNext]);
+        for (size_t i = 0; i <= NUM_STAGES; i++) {
+            mHistogram[i][getBucket(oldest.us[i])]--;
+        }
+        oldest = times;
+        mNext = (mNext + 1) % WINDOW;
+    }
+    for (size_t i = 0; i <= NUM_STAGES; i++) {
+        mHistogram[i][getBucket(times.us[i])]++;
+    }
+    mNumFrames++;
+
+    if (deadline > 0 && mFrameTime > deadline) {
+        SlowFrame slowFrame;
+        slowFrame.endTime = systemTime(SYSTEM_TIME_MONOTONIC);
+        slowFrame.deadline = deadline;
+        slowFrame.times = times;
+        slowFrame.composition = composition;
+        if (mSlowFrames.size() < MAX_SLOW_FRAMES) {
+            mSlowFrames.push_back(slowFrame);
+        } else {
+            mSlowFrames[mNextSlowFrame] = slowFrame;
+            mNextSlowFrame = (mNextSlowFrame + 1) % MAX_SLOW_FRAMES;
+        }
+        mNumSlowFrames++;
+    }
+}
+
+uint32_t FrameStageMonitor::getMax(size_t stage) const {
+    uint32_t max = 0;
+    for (const auto& times : mWindow) {
+        max = std::max(max, times.us[stage]);
+    }
+    return max;
+}
+
+uint32_t FrameStageMonitor::getPercentile(size_t stage,
+        uint32_t percent) const {
+    const size_t target = (mWindow.size() * percent + 99) / 100;
+    const uint32_t max = getMax(stage);
+    size_t count = 0;
+    for (size_t i = 0; i < NUM_BUCKETS - 1; i++) {
+        count += mHistogram[stage][i];
+        if (count >= target) {
+            // report the top of the bucket, or the longest time if that's
+            // shorter
+            return std::min(max, uint32_t(i + 1) * BUCKET_US);
+        }
+    }
+    // the catch-all bucket
+    return max;
+}
+
+void FrameStageMonitor::dumpSummary(String8& result) const {
+    Mutex::Autolock lock(mLock);
+    result.appendFormat("  frame stages: %" PRIu64 " frames, %" PRIu64
+            " over their deadline (dumpsys SurfaceFlinger --frame-stages)\n",
+            mNumFrames, mNumSlowFrames);
+}
+
+void FrameStageMonitor::dump(String8& result) const {
+    Mutex::Autolock lock(mLock);
+    result.appendFormat("Main thread stages of the last %zu frames "
+            "(%" PRIu64 " frames, %" PRIu64 " over their deadline):\n",
+            mWindow.size(), mNumFrames, mNumSlowFrames);
+    if (mWindow.empty()) {
+        return;
+    }
+    result.append("  stage                  p50 ms   p90 ms   p99 ms   max ms\n");
+    for (size_t i = 0; i <= NUM_STAGES; i++) {
+        result.appendFormat("  %-20s %8.2f %8.2f %8.2f %8.2f\n",
+                getStageName(i), getPercentile(i, 50) / 1e3,
+                getPercentile(i, 90) / 1e3, getPercentile(i, 99) / 1e3,
+                getMax(i) / 1e3);
+    }
+
+    if (mSlowFrames.empty()) {
+        return;
+    }
+    result.append("Slow frames, newest first:\n");
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    // mNextSlowFrame is only non-zero once the snapshots have wrapped, and
+    // then points at the oldest one
+    for (size_t n = 0; n < mSlowFrames.size(); n++) {
+        const size_t index = (mNextSlowFrame + mSlowFrames.size() - 1 - n) %
+                mSlowFrames.size();
+        const SlowFrame& frame(mSlowFrames[index]);
+        result.appendFormat("  %.3f s ago: %.2f ms of %.2f ms, "
+                "%u layers (%u client, %u device, %u other)\n",
+                (now - frame.endTime) / 1e9,
+                frame.times.us[NUM_STAGES] / 1e3, frame.deadline / 1e6,
+                frame.composition.layers, frame.composition.clientLayers,
+                frame.composition.deviceLayers,
+                frame.composition.otherLayers);
+        result.append("   ");
+        for (size_t i = 0; i < NUM_STAGES; i++) {
+            result.appendFormat(" %s %.2f", getStageName(i),
+                    frame.times.us[i] / 1e3);
+        }
+        result.append("\n");
+    }
+}
+
+}; // namespace android
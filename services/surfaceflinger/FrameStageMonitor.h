@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SF_FRAMESTAGEMONITOR_H
+#define ANDROID_SF_FRAMESTAGEMONITOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <utils/Mutex.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+#include <vector>
+
+namespace android {
+
+/*
+ * Times the stages the main thread goes through for each frame, so that a
+ * missed vsync can be blamed on one of them.
+ *
+ * The main thread calls begin() when it starts handling a message and
+ * mark() after each stage, which charges the time since the previous
+ * begin() or mark() to that stage. A frame runs from the first begin()
+ * after endFrame() up to the next endFrame(), which may span an
+ * INVALIDATE and the REFRESH it asked for; the time spent waiting between
+ * the two isn't charged to anything.
+ *
+ * The last WINDOW frames are kept in a sliding histogram per stage. Each
+ * frame that took longer than its deadline also leaves a snapshot of its
+ * stage times and of how it was composed, the last MAX_SLOW_FRAMES of
+ * which are kept for dumpsys.
+ *
+ * begin(), mark() and endFrame() must be called from the main thread only;
+ * dump() may be called from any thread.
+ */
+class FrameStageMonitor {
+public:
+    enum Stage {
+        TRANSACTION,
+        PAGE_FLIP,
+        PRE_COMPOSITION,
+        REBUILD_LAYER_STACKS,
+        SET_UP_HWC,
+        COMPOSITION,
+        POST_FRAMEBUFFER,
+        POST_COMPOSITION,
+        NUM_STAGES
+    };
+
+    // How the visible layers of all displays were composed
+    struct Composition {
+        Composition();
+
+        uint32_t layers;
+        uint32_t clientLayers;
+        uint32_t deviceLayers;
+        // solid color, cursor and sideband layers
+        uint32_t otherLayers;
+    };
+
+    FrameStageMonitor();
+
+    void begin();
+    void mark(Stage stage);
+
+    // The time charged to the stages of the current frame so far
+    nsecs_t getFrameTime() const { return mFrameTime; }
+
+    // Ends the current frame. composition is only looked at when the frame
+    // took longer than deadline.
+    void endFrame(nsecs_t deadline, const Composition& composition);
+
+    // Appends a line with the frame and slow frame counts.
+    void dumpSummary(String8& result) const;
+
+    // Appends the stage percentiles and the slow frame snapshots.
+    void dump(String8& result) const;
+
+private:
+    enum {
+        WINDOW = 1024,
+        // stage times are binned in quarter milliseconds, up to 32 ms
+        BUCKET_US = 250,
+        NUM_BUCKETS = 128,
+        MAX_SLOW_FRAMES = 16
+    };
+
+    // the stages in us, followed by the whole frame
+    struct FrameTimes {
+        uint32_t us[NUM_STAGES + 1];
+    };
+
+    struct SlowFrame {
+        nsecs_t endTime;
+        nsecs_t deadline;
+        FrameTimes times;
+        Composition composition;
+    };
+
+    static const char* getStageName(size_t stage);
+    static size_t getBucket(uint32_t us);
+    // the time below which the given fraction of the frames in the window
+    // fall for the given stage
+    uint32_t getPercentile(size_t stage, uint32_t percent) const;
+    uint32_t getMax(size_t stage) const;
+
+    // owned by the main thread
+    bool mFrameOpen;
+    nsecs_t mLapStart;
+    nsecs_t mFrameTime;
+    nsecs_t mStageTimes[NUM_STAGES];
+
+    mutable Mutex mLock;
+    std::vector<FrameTimes> mWindow;
+    // where the next frame goes once the window is full
+    size_t mNext;
+    uint32_t mHistogram[NUM_STAGES + 1][NUM_BUCKETS];
+    uint64_t mNumFrames;
+    uint64_t mNumSlowFrames;
+    std::vector<SlowFrame> mSlowFrames;
+    size_t mNextSlowFrame;
+};
+
+}; // namespace android
+
+#endif // ANDROID_SF_FRAMESTAGEMONITOR_H
@@ -34,7 +34,8 @@ namespace android {
 FrameTracker::FrameTracker() :
         mOffset(0),
         mNumFences(0),
-        mDisplayPeriod(0) {
+        mDisplayPeriod(0),
+        mNumUnrecorded(0) {
     resetFrameCountersLocked();
 }
 
@@ -50,7 +51,8 @@ void FrameTracker::setFrameReadyTime(nsecs_t readyTime) {
 
 void FrameTracker::setFrameReadyFence(const sp<Fence>& readyFence) {
     Mutex::Autolock lock(mMutex);
-    mFrameRecords[mOffset].frameReadyFence = readyFence;
+    mFrameRecords[mOffset].frameReadyFence =
+            FenceMonitor::watch(mFenceMonitor, readyFence);
     mNumFences++;
 }
 
@@ -61,7 +63,8 @@ void FrameTracker::setActualPresentTime(nsecs_t presentTime) {
 
 void FrameTracker::setActualPresentFence(const sp<Fence>& readyFence) {
     Mutex::Autolock lock(mMutex);
-    mFrameRecords[mOffset].actualPresentFence = readyFence;
+    mFrameRecords[mOffset].actualPresentFence =
+            FenceMonitor::watch(mFenceMonitor, readyFence);
     mNumFences++;
 }
 
@@ -75,9 +78,19 @@ void FrameTracker::advanceFrame() {
 
     // Update the statistic to include the frame we just finished.
     updateStatsLocked(mOffset);
+    if (mHistory.getCapacity() > 0 || mStatsFile != NULL) {
+        mNumUnrecorded++;
+    }
 
     // Advance to the next frame.
     mOffset = (mOffset+1) % NUM_FRAME_RECORDS;
+
+    // The frame record about to be reused may still be waiting for a fence;
+    // it goes into the history as it is.
+    if (mNumUnrecorded == NUM_FRAME_RECORDS) {
+        recordFrameLocked(mOffset);
+        mNumUnrecorded--;
+    }
     mFrameRecords[mOffset].desiredPresentTime = INT64_MAX;
     mFrameRecords[mOffset].frameReadyTime = INT64_MAX;
     mFrameRecords[mOffset].actualPresentTime = INT64_MAX;
@@ -99,6 +112,8 @@ void FrameTracker::advanceFrame() {
     // Clean up the signaled fences to keep the number of open fence FDs in
     // this process reasonable.
     processFencesLocked();
+
+    recordHistoryLocked();
 }
 
 void FrameTracker::clearStats() {
@@ -111,6 +126,9 @@ void FrameTracker::clearStats() {
         mFrameRecords[i].actualPresentFence.clear();
     }
     mNumFences = 0;
+    // The long frame history is kept: it has its own statistics, and the
+    // frames it is missing are gone.
+    mNumUnrecorded = 0;
     mFrameRecords[mOffset].desiredPresentTime = INT64_MAX;
     mFrameRecords[mOffset].frameReadyTime = INT64_MAX;
     mFrameRecords[mOffset].actualPresentTime = INT64_MAX;
@@ -156,9 +174,10 @@ void FrameTracker::processFencesLocked() const {
         size_t idx = (mOffset+NUM_FRAME_RECORDS-i) % NUM_FRAME_RECORDS;
         bool updated = false;
 
-        const sp<Fence>& rfence = records[idx].frameReadyFence;
+        const sp<FenceMonitor::SignalTime>& rfence =
+                records[idx].frameReadyFence;
         if (rfence != NULL) {
-            records[idx].frameReadyTime = rfence->getSignalTime();
+            records[idx].frameReadyTime = rfence->get();
             if (records[idx].frameReadyTime < INT64_MAX) {
                 records[idx].frameReadyFence = NULL;
                 numFences--;
@@ -166,9 +185,10 @@ void FrameTracker::processFencesLocked() const {
             }
         }
 
-        const sp<Fence>& pfence = records[idx].actualPresentFence;
+        const sp<FenceMonitor::SignalTime>& pfence =
+                records[idx].actualPresentFence;
         if (pfence != NULL) {
-            records[idx].actualPresentTime = pfence->getSignalTime();
+            records[idx].actualPresentTime = pfence->get();
             if (records[idx].actualPresentTime < INT64_MAX) {
                 records[idx].actualPresentFence = NULL;
                 numFences--;
@@ -248,4 +268,72 @@ void FrameTracker::dumpStats(String8& result) const {
     result.append("\n");
 }
 
+void FrameTracker::setHistoryCapacity(size_t capacity) {
+    Mutex::Autolock lock(mMutex);
+    mHistory.setCapacity(capacity);
+    if (mStatsFile == NULL) {
+        mNumUnrecorded = 0;
+    }
+}
+
+void FrameTracker::dumpHistory(String8& result) const {
+    Mutex::Autolock lock(mMutex);
+    mHistory.dump(result);
+    if (mStatsFile != NULL) {
+        mStatsFile->dump(result);
+    }
+}
+
+void FrameTracker::exportHistory(const String8& name, String8& result) const {
+    Mutex::Autolock lock(mMutex);
+    mHistory.exportTo(name, result);
+}
+
+void FrameTracker::setFenceMonitor(const sp<FenceMonitor>& monitor) {
+    Mutex::Autolock lock(mMutex);
+    mFenceMonitor = monitor;
+}
+
+void FrameTracker::setStatsFile(const sp<FrameStatsFile>& file) {
+    Mutex::Autolock lock(mMutex);
+    mStatsFile = file;
+    if (mStatsFile == NULL && mHistory.getCapacity() == 0) {
+        mNumUnrecorded = 0;
+    }
+}
+
+void FrameTracker::recordHistoryLocked() {
+    while (mNumUnrecorded > 0) {
+        const size_t idx = (mOffset + NUM_FRAME_RECORDS - mNumUnrecorded) %
+                NUM_FRAME_RECORDS;
+        if (mFrameRecords[idx].frameReadyFence != NULL ||
+                mFrameRecords[idx].actualPresentFence != NULL) {
+            // later frames have to wait for this one to keep the order
+            return;
+        }
+        recordFrameLocked(idx);
+        mNumUnrecorded--;
+    }
+}
+
+void FrameTracker::recordFrameLocked(size_t idx) {
+    const FrameRecord& record = mFrameRecords[idx];
+    nsecs_t frameReadyTime = record.frameReadyTime;
+    nsecs_t actualPresentTime = record.actualPresentTime;
+    // an outstanding fence leaves its time at INT64_MAX, unknown to the
+    // history
+    if (record.frameReadyFence != NULL) {
+        frameReadyTime = record.frameReadyFence->get();
+    }
+    if (record.actualPresentFence != NULL) {
+        actualPresentTime = record.actualPresentFence->get();
+    }
+    mHistory.addFrame(record.desiredPresentTime, frameReadyTime,
+            actualPresentTime, mDisplayPeriod);
+    if (mStatsFile != NULL) {
+        mStatsFile->addFrame(record.desiredPresentTime, frameReadyTime,
+                actualPresentTime, mDisplayPeriod);
+    }
+}
+
 } // namespace android
@@ -23,10 +23,13 @@
 #include <utils/Timers.h>
 #include <utils/RefBase.h>
 
+#include "FenceMonitor.h"
+#include "FrameHistory.h"
+#include "EventLog/FrameStatsFile.h"
+
 namespace android {
 
 class String8;
-class Fence;
 
 // FrameTracker tracks information about the most recently rendered frames. It
 // uses a circular buffer of frame records, and is *NOT* thread-safe -
@@ -91,6 +94,26 @@ public:
     // dumpStats dump appends the current frame display time history to the result string.
     void dumpStats(String8& result) const;
 
+    // setHistoryCapacity sets how many frames the long frame history keeps
+    // once they leave the frame records; 0 turns it off.
+    void setHistoryCapacity(size_t capacity);
+
+    // dumpHistory appends the long frame history's statistics, and the state
+    // of the stats file, to the result string.
+    void dumpHistory(String8& result) const;
+
+    // exportHistory appends the long frame history to the result string in
+    // the binary format described in FrameHistory.h.
+    void exportHistory(const String8& name, String8& result) const;
+
+    // setFenceMonitor hands the fences set from now on to the given monitor,
+    // so that looking at them does not have to query each fence.
+    void setFenceMonitor(const sp<FenceMonitor>& monitor);
+
+    // setStatsFile appends every finished frame to the given file as well as
+    // to the long frame history, in the same order; NULL stops it.
+    void setStatsFile(const sp<FrameStatsFile>& file);
+
 private:
     struct FrameRecord {
         FrameRecord() :
@@ -100,8 +123,8 @@ private:
         nsecs_t desiredPresentTime;
         nsecs_t frameReadyTime;
         nsecs_t actualPresentTime;
-        sp<Fence> frameReadyFence;
-        sp<Fence> actualPresentFence;
+        sp<FenceMonitor::SignalTime> frameReadyFence;
+        sp<FenceMonitor::SignalTime> actualPresentFence;
     };
 
     // processFences iterates over all the frame records that have a fence set
@@ -128,6 +151,14 @@ private:
     // valid and has all arrived (i.e. there are no oustanding fences).
     bool isFrameValidLocked(size_t idx) const;
 
+    // recordHistoryLocked adds the finished frames that have no outstanding
+    // fences left to the long frame history, oldest first.
+    void recordHistoryLocked();
+
+    // recordFrameLocked adds the given frame to the long frame history,
+    // whether or not its fences have signaled.
+    void recordFrameLocked(size_t idx);
+
     // mFrameRecords is the circular buffer storing the tracked data for each
     // frame.
     FrameRecord mFrameRecords[NUM_FRAME_RECORDS];
@@ -155,6 +186,21 @@ private:
     // this FrameTracker is gathering information.
     nsecs_t mDisplayPeriod;
 
+    // mHistory keeps frames for much longer than mFrameRecords, packed.
+    // Frames are added in order as soon as all their times are known, and
+    // at the latest when their frame record is reused.
+    FrameHistory mHistory;
+
+    // mNumUnrecorded is the number of finished frames, ending just before
+    // mOffset, that are not in mHistory and mStatsFile yet.
+    size_t mNumUnrecorded;
+
+    // mFenceMonitor waits on the fences, if set.
+    sp<FenceMonitor> mFenceMonitor;
+
+    // mStatsFile gets the same frames as mHistory, if set.
+    sp<FrameStatsFile> mStatsFile;
+
     // mMutex is used to protect access to all member variables.
     mutable Mutex mMutex;
 };
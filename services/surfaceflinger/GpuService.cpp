@@ -16,7 +16,15 @@
 
 #include "GpuService.h"
 
+#include <algorithm>
+
+#include <unistd.h>
+
+#include <binder/IPCThreadState.h>
 #include <binder/Parcel.h>
+#include <binder/PermissionCache.h>
+#include <private/android_filesystem_config.h>
+#include <ui/GraphicBufferAllocator.h>
 #include <utils/String8.h>
 #include <vkjson.h>
 
@@ -28,6 +36,29 @@ class BpGpuService : public BpInterface<IGpuService>
 {
 public:
     BpGpuService(const sp<IBinder>& impl) : BpInterface<IGpuService>(impl) {}
+
+    virtual status_t getProcessMemory(std::vector<ProcessMemory>* outMemory) {
+        Parcel data, reply;
+        data.writeInterfaceToken(IGpuService::getInterfaceDescriptor());
+        status_t err = remote()->transact(GET_PROCESS_MEMORY, data, &reply);
+        if (err != NO_ERROR) {
+            return err;
+        }
+        err = reply.readInt32();
+        if (err != NO_ERROR) {
+            return err;
+        }
+        const int32_t count = reply.readInt32();
+        outMemory->clear();
+        for (int32_t i = 0; i < count && reply.dataAvail() > 0; i++) {
+            ProcessMemory memory;
+            memory.pid = reply.readInt32();
+            memory.buffers = reply.readUint32();
+            memory.bytes = reply.readUint64();
+            outMemory->push_back(memory);
+        }
+        return NO_ERROR;
+    }
 };
 
 IMPLEMENT_META_INTERFACE(GpuService, "android.ui.IGpuService");
@@ -48,6 +79,22 @@ status_t BnGpuService::onTransact(uint32_t code, const Parcel& data,
         return shellCommand(in, out, err, args);
     }
 
+    case GET_PROCESS_MEMORY: {
+        CHECK_INTERFACE(IGpuService, data, reply);
+        std::vector<ProcessMemory> memory;
+        status_t err = getProcessMemory(&memory);
+        reply->writeInt32(err);
+        if (err == NO_ERROR) {
+            reply->writeInt32(static_cast<int32_t>(memory.size()));
+            for (const auto& process : memory) {
+                reply->writeInt32(process.pid);
+                reply->writeUint32(process.buffers);
+                reply->writeUint64(process.bytes);
+            }
+        }
+        return NO_ERROR;
+    }
+
     default:
         return BBinder::onTransact(code, data, reply, flags);
     }
@@ -58,12 +105,57 @@ status_t BnGpuService::onTransact(uint32_t code, const Parcel& data,
 namespace {
     status_t cmd_help(int out);
     status_t cmd_vkjson(int out, int err);
+    status_t cmd_memory(GpuService& service, int out);
+    void dumpProcessMemory(const std::vector<IGpuService::ProcessMemory>& memory,
+            String8& result);
 }
 
+static const String16 sDump("android.permission.DUMP");
+
 const char* const GpuService::SERVICE_NAME = "gpu";
 
 GpuService::GpuService() {}
 
+status_t GpuService::getProcessMemory(std::vector<ProcessMemory>* outMemory) {
+    IPCThreadState* ipc = IPCThreadState::self();
+    const int pid = ipc->getCallingPid();
+    const int uid = ipc->getCallingUid();
+    if (uid != AID_SHELL && !PermissionCache::checkPermission(sDump, pid, uid)) {
+        ALOGE("Permission Denial: can't get GPU memory pid=%d, uid=%d", pid, uid);
+        return PERMISSION_DENIED;
+    }
+
+    KeyedVector<pid_t, GraphicBufferAllocator::process_usage_t> usage;
+    GraphicBufferAllocator::get().getProcessUsage(&usage);
+    outMemory->clear();
+    for (size_t i = 0; i < usage.size(); i++) {
+        ProcessMemory memory;
+        memory.pid = usage.keyAt(i);
+        memory.buffers = static_cast<uint32_t>(usage.valueAt(i).count);
+        memory.bytes = usage.valueAt(i).size;
+        outMemory->push_back(memory);
+    }
+    std::sort(outMemory->begin(), outMemory->end(),
+            [](const ProcessMemory& a, const ProcessMemory& b) {
+                return a.bytes > b.bytes;
+            });
+    return NO_ERROR;
+}
+
+status_t GpuService::dump(int fd, const Vector<String16>& /*args*/) {
+    String8 result;
+    std::vector<ProcessMemory> memory;
+    if (getProcessMemory(&memory) != NO_ERROR) {
+        result.appendFormat("Permission Denial: can't dump GpuService from pid=%d, uid=%d\n",
+                IPCThreadState::self()->getCallingPid(),
+                IPCThreadState::self()->getCallingUid());
+    } else {
+        dumpProcessMemory(memory, result);
+    }
+    write(fd, result.string(), result.size());
+    return NO_ERROR;
+}
+
 status_t GpuService::shellCommand(int /*in*/, int out, int err,
         Vector<String16>& args)
 {
@@ -73,6 +165,8 @@ status_t GpuService::shellCommand(int /*in*/, int out, int err,
 
     if (args[0] == String16("vkjson"))
         return cmd_vkjson(out, err);
+    else if (args[0] == String16("memory"))
+        return cmd_memory(*this, out);
     else if (args[0] == String16("help"))
         return cmd_help(out);
 
@@ -92,7 +186,8 @@ status_t cmd_help(int out) {
     }
     fprintf(outs,
         "GPU Service commands:\n"
-        "  vkjson   dump Vulkan device capabilities as JSON\n");
+        "  vkjson   dump Vulkan device capabilities as JSON\n"
+        "  memory   list graphics buffer memory by process\n");
     fclose(outs);
     return NO_ERROR;
 }
@@ -170,6 +265,30 @@ status_t cmd_vkjson(int out, int err) {
     return result >= 0 ? NO_ERROR : UNKNOWN_ERROR;
 }
 
+void dumpProcessMemory(const std::vector<IGpuService::ProcessMemory>& memory,
+        String8& result) {
+    uint64_t total = 0;
+    result.append("Graphics buffers by process:\n");
+    for (const auto& process : memory) {
+        result.appendFormat("  pid %5d: %4u buffers, %10.2f KiB\n", process.pid,
+                process.buffers, process.bytes / 1024.0);
+        total += process.bytes;
+    }
+    result.appendFormat("Total: %.2f KiB\n", total / 1024.0);
+}
+
+status_t cmd_memory(GpuService& service, int out) {
+    std::vector<IGpuService::ProcessMemory> memory;
+    status_t err = service.getProcessMemory(&memory);
+    if (err != NO_ERROR) {
+        return err;
+    }
+    String8 result;
+    dumpProcessMemory(memory, result);
+    write(out, result.string(), result.size());
+    return NO_ERROR;
+}
+
 } // anonymous namespace
 
 } // namespace android
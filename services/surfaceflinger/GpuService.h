@@ -17,6 +17,8 @@
 #ifndef ANDROID_GPUSERVICE_H
 #define ANDROID_GPUSERVICE_H
 
+#include <vector>
+
 #include <binder/IInterface.h>
 #include <cutils/compiler.h>
 
@@ -29,6 +31,21 @@ namespace android {
 class IGpuService : public IInterface {
 public:
     DECLARE_META_INTERFACE(GpuService);
+
+    // The graphics buffers allocated through SurfaceFlinger for a process
+    struct ProcessMemory {
+        int32_t pid;
+        uint32_t buffers;
+        uint64_t bytes;
+    };
+
+    // Lists the processes graphics buffers are allocated for, largest
+    // first. Needs android.permission.DUMP.
+    virtual status_t getProcessMemory(std::vector<ProcessMemory>* outMemory) = 0;
+
+    enum {
+        GET_PROCESS_MEMORY = IBinder::FIRST_CALL_TRANSACTION,
+    };
 };
 
 class BnGpuService: public BnInterface<IGpuService> {
@@ -47,6 +64,10 @@ public:
 
     GpuService() ANDROID_API;
 
+    virtual status_t getProcessMemory(std::vector<ProcessMemory>* outMemory) override;
+
+    virtual status_t dump(int fd, const Vector<String16>& args) override;
+
 protected:
     virtual status_t shellCommand(int in, int out, int err,
         Vector<String16>& args) override;
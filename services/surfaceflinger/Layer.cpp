@@ -24,10 +24,13 @@
 #define ATRACE_TAG ATRACE_TAG_GRAPHICS
 
 #include <stdlib.h>
+#include <inttypes.h>
 #include <stdint.h>
 #include <sys/types.h>
 #include <math.h>
 
+#include <algorithm>
+
 #include <cutils/compiler.h>
 #include <cutils/native_handle.h>
 #include <cutils/properties.h>
@@ -36,6 +39,7 @@
 #include <utils/Log.h>
 #include <utils/NativeHandle.h>
 #include <utils/StopWatch.h>
+#include <utils/String16.h>
 #include <utils/Trace.h>
 
 #include <ui/GraphicBuffer.h>
@@ -56,6 +60,7 @@
 #include "RenderEngine/RenderEngine.h"
 
 #include <mutex>
+#include <thread>
 
 #define DEBUG_RESIZE    0
 #ifdef QTI_BSP
@@ -63,11 +68,19 @@
 #endif
 
 #define MAX_POSITION 32767
+
+// How long an auto-refresh shared buffer layer may go without a full latch.
+// Auto refresh can be turned off without queueing a buffer, and a full latch
+// is the only way to find out.
+#define SHARED_BUFFER_RELATCH_INTERVAL ms2ns(250)
+
 namespace android {
 
 // ---------------------------------------------------------------------------
 
 int32_t Layer::sSequence = 1;
+std::atomic<uint64_t> Layer::sDisplayTransformsComputed(0);
+std::atomic<uint64_t> Layer::sDisplayTransformsReused(0);
 
 Layer::Layer(SurfaceFlinger* flinger, const sp<Client>& client,
         const String8& name, uint32_t w, uint32_t h, uint32_t flags)
@@ -106,11 +119,19 @@ Layer::Layer(SurfaceFlinger* flinger, const sp<Client>& client,
         mLastFrameNumberReceived(0),
         mUpdateTexImageFailed(false),
         mAutoRefresh(false),
+        mSharedBufferFastPath(false),
+        mLastSharedBufferLatch(0),
+        mSharedBufferRefreshes(0),
         mFreezePositionUpdates(false),
-        mTransformHint(0)
+        mTransformHint(0),
+        mFramesOffScreen(0),
+        mBuffersTrimmed(false),
+        mSegmentsWithoutThirdBuffer(0),
+        mDoubleBuffered(false)
 {
 #ifdef USE_HWC2
     ALOGV("Creating Layer %s", name.string());
+    mPerFrameDataGeneration = 1;
 #endif
 
     mCurrentCrop.makeInvalid();
@@ -160,6 +181,8 @@ Layer::Layer(SurfaceFlinger* flinger, const sp<Client>& client,
             flinger->getHwComposer().getRefreshPeriod(HWC_DISPLAY_PRIMARY);
 #endif
     mFrameTracker.setDisplayRefreshPeriod(displayPeriod);
+    mFrameTracker.setHistoryCapacity(flinger->mLayerFrameHistorySize);
+    mFrameTracker.setFenceMonitor(flinger->mFenceMonitor);
 }
 
 void Layer::onFirstRef() {
@@ -243,6 +266,8 @@ void Layer::onFrameAvailable(const BufferItem& item) {
 
         mQueueItems.push_back(item);
         android_atomic_inc(&mQueuedFrames);
+        mContentCadence.addFrame(item.mTimestamp, item.mIsAutoTimestamp,
+                systemTime());
 
         // Wake up any pending callbacks
         mLastFrameNumberReceived = item.mFrameNumber;
@@ -270,6 +295,8 @@ void Layer::onFrameReplaced(const BufferItem& item) {
             return;
         }
         mQueueItems.editItemAt(mQueueItems.size() - 1) = item;
+        mContentCadence.addFrame(item.mTimestamp, item.mIsAutoTimestamp,
+                systemTime());
 
         // Wake up any pending callbacks
         mLastFrameNumberReceived = item.mFrameNumber;
@@ -277,6 +304,17 @@ void Layer::onFrameReplaced(const BufferItem& item) {
     }
 }
 
+nsecs_t Layer::getContentFramePeriod(nsecs_t now,
+        bool* outIsAutoTimestamp) const {
+    if (hasUnlatchedContent()) {
+        // the rate of what is drawn is unknown
+        *outIsAutoTimestamp = true;
+        return -1;
+    }
+    Mutex::Autolock lock(mQueueItemLock);
+    return mContentCadence.getFramePeriod(now, outIsAutoTimestamp);
+}
+
 void Layer::onSidebandStreamChanged() {
     if (android_atomic_release_cas(false, true, &mSidebandStreamChanged) == 0) {
         // mSidebandStreamChanged was false
@@ -289,6 +327,7 @@ void Layer::onSidebandStreamChanged() {
 // it's removed from the drawing state list)
 void Layer::onRemoved() {
     mSurfaceFlingerConsumer->abandon();
+    mFlinger->removeFrameEventChannel(*this);
 }
 
 // ---------------------------------------------------------------------------
@@ -333,14 +372,30 @@ status_t Layer::setBuffers( uint32_t w, uint32_t h,
  * LayerCleaner ensures that mFlinger->onLayerDestroyed() is called for
  * this layer when the handle is destroyed.
  */
+static const String16 sHandleDescriptor("android.surfaceflinger.Layer.Handle");
+
 class Layer::Handle : public BBinder, public LayerCleaner {
     public:
         Handle(const sp<SurfaceFlinger>& flinger, const sp<Layer>& layer)
             : LayerCleaner(flinger, layer), owner(layer) {}
 
+        // tells our handles apart from any other local binder, see
+        // fromHandle()
+        virtual const String16& getInterfaceDescriptor() const {
+            return sHandleDescriptor;
+        }
+
         wp<Layer> owner;
 };
 
+sp<Layer> Layer::fromHandle(const sp<IBinder>& handle) {
+    if (handle == NULL || handle->localBinder() == NULL ||
+            handle->getInterfaceDescriptor() != sHandleDescriptor) {
+        return NULL;
+    }
+    return static_cast<Handle*>(handle.get())->owner.promote();
+}
+
 sp<IBinder> Layer::getHandle() {
     Mutex::Autolock _l(mLock);
 
@@ -506,6 +561,22 @@ FloatRect Layer::computeCrop(const sp<const DisplayDevice>& hw) const {
     return crop;
 }
 
+#ifdef USE_HWC2
+static bool sameRegion(const Region& lhs, const Region& rhs) {
+    // regions are kept in a canonical form, so equal regions have equal
+    // rectangle lists
+    if (lhs.isTriviallyEqual(rhs)) {
+        return true;
+    }
+    size_t lhsCount = 0;
+    size_t rhsCount = 0;
+    const Rect* lhsRects = lhs.getArray(&lhsCount);
+    const Rect* rhsRects = rhs.getArray(&rhsCount);
+    return lhsCount == rhsCount &&
+            std::equal(lhsRects, lhsRects + lhsCount, rhsRects);
+}
+#endif
+
 #ifdef USE_HWC2
 void Layer::setGeometry(const sp<const DisplayDevice>& displayDevice)
 #else
@@ -517,6 +588,14 @@ void Layer::setGeometry(
 #ifdef USE_HWC2
     const auto hwcId = displayDevice->getHwcDisplayId();
     auto& hwcInfo = mHwcLayers[hwcId];
+    // The HWC keeps a sideband layer's plane showing the stream without any
+    // help from us, so when a geometry pass (which any other layer changing
+    // triggers) leaves its geometry as it was, nothing is sent again and its
+    // per-frame data stays as it is too.
+    const bool skipUnchanged = mSidebandStream != NULL &&
+            hwcInfo.sidebandGeometrySent;
+    const bool wasForcedClient = hwcInfo.forceClientComposition;
+    bool changed = !skipUnchanged;
 #else
     layer.setDefaultState();
 #endif
@@ -525,9 +604,10 @@ void Layer::setGeometry(
 #ifdef USE_HWC2
     hwcInfo.forceClientComposition = false;
 
-    if (isSecure() && !displayDevice->isSecure()) {
-        hwcInfo.forceClientComposition = true;
-    }
+    // The HWC blacks out secure layers on displays that aren't secure (see
+    // setPerFrameData), rather than have them drawn black with GLES.
+    const bool wasBlackedOut = hwcInfo.blackOut;
+    hwcInfo.blackOut = isSecure() && !displayDevice->isSecure();
 
     auto& hwcLayer = hwcInfo.layer;
 #else
@@ -544,10 +624,15 @@ void Layer::setGeometry(
     if (!isOpaque(s) || s.alpha != 1.0f) {
         auto blendMode = mPremultipliedAlpha ?
                 HWC2::BlendMode::Premultiplied : HWC2::BlendMode::Coverage;
-        auto error = hwcLayer->setBlendMode(blendMode);
-        ALOGE_IF(error != HWC2::Error::None, "[%s] Failed to set blend mode %s:"
-                " %s (%d)", mName.string(), to_string(blendMode).c_str(),
-                to_string(error).c_str(), static_cast<int32_t>(error));
+        if (!skipUnchanged || blendMode != hwcInfo.blendMode) {
+            auto error = hwcLayer->setBlendMode(blendMode);
+            ALOGE_IF(error != HWC2::Error::None, "[%s] Failed to set blend "
+                    "mode %s: %s (%d)", mName.string(),
+                    to_string(blendMode).c_str(), to_string(error).c_str(),
+                    static_cast<int32_t>(error));
+            hwcInfo.blendMode = blendMode;
+            changed = true;
+        }
     }
 #else
 #if defined(QTI_BSP) && !defined(QCOM_BSP_LEGACY)
@@ -605,36 +690,51 @@ void Layer::setGeometry(
     }
     const Transform& tr(displayDevice->getTransform());
     Rect transformedFrame = tr.transform(frame);
-    auto error = hwcLayer->setDisplayFrame(transformedFrame);
-    if (error != HWC2::Error::None) {
-        ALOGE("[%s] Failed to set display frame [%d, %d, %d, %d]: %s (%d)",
-                mName.string(), transformedFrame.left, transformedFrame.top,
-                transformedFrame.right, transformedFrame.bottom,
-                to_string(error).c_str(), static_cast<int32_t>(error));
-    } else {
-        hwcInfo.displayFrame = transformedFrame;
+    if (!skipUnchanged || transformedFrame != hwcInfo.displayFrame) {
+        auto error = hwcLayer->setDisplayFrame(transformedFrame);
+        if (error != HWC2::Error::None) {
+            ALOGE("[%s] Failed to set display frame [%d, %d, %d, %d]: %s (%d)",
+                    mName.string(), transformedFrame.left,
+                    transformedFrame.top, transformedFrame.right,
+                    transformedFrame.bottom, to_string(error).c_str(),
+                    static_cast<int32_t>(error));
+        } else {
+            hwcInfo.displayFrame = transformedFrame;
+        }
+        changed = true;
     }
 
     FloatRect sourceCrop = computeCrop(displayDevice);
-    error = hwcLayer->setSourceCrop(sourceCrop);
-    if (error != HWC2::Error::None) {
-        ALOGE("[%s] Failed to set source crop [%.3f, %.3f, %.3f, %.3f]: "
-                "%s (%d)", mName.string(), sourceCrop.left, sourceCrop.top,
-                sourceCrop.right, sourceCrop.bottom, to_string(error).c_str(),
-                static_cast<int32_t>(error));
-    } else {
-        hwcInfo.sourceCrop = sourceCrop;
+    if (!skipUnchanged || sourceCrop != hwcInfo.sourceCrop) {
+        auto error = hwcLayer->setSourceCrop(sourceCrop);
+        if (error != HWC2::Error::None) {
+            ALOGE("[%s] Failed to set source crop [%.3f, %.3f, %.3f, %.3f]: "
+                    "%s (%d)", mName.string(), sourceCrop.left, sourceCrop.top,
+                    sourceCrop.right, sourceCrop.bottom,
+                    to_string(error).c_str(), static_cast<int32_t>(error));
+        } else {
+            hwcInfo.sourceCrop = sourceCrop;
+        }
+        changed = true;
     }
 
-    error = hwcLayer->setPlaneAlpha(s.alpha);
-    ALOGE_IF(error != HWC2::Error::None, "[%s] Failed to set plane alpha %.3f: "
-            "%s (%d)", mName.string(), s.alpha, to_string(error).c_str(),
-            static_cast<int32_t>(error));
+    if (!skipUnchanged || s.alpha != hwcInfo.planeAlpha) {
+        auto error = hwcLayer->setPlaneAlpha(s.alpha);
+        ALOGE_IF(error != HWC2::Error::None, "[%s] Failed to set plane alpha "
+                "%.3f: %s (%d)", mName.string(), s.alpha,
+                to_string(error).c_str(), static_cast<int32_t>(error));
+        hwcInfo.planeAlpha = s.alpha;
+        changed = true;
+    }
 
-    error = hwcLayer->setZOrder(s.z);
-    ALOGE_IF(error != HWC2::Error::None, "[%s] Failed to set Z %u: %s (%d)",
-            mName.string(), s.z, to_string(error).c_str(),
-            static_cast<int32_t>(error));
+    if (!skipUnchanged || s.z != hwcInfo.z) {
+        auto error = hwcLayer->setZOrder(s.z);
+        ALOGE_IF(error != HWC2::Error::None, "[%s] Failed to set Z %u: %s "
+                "(%d)", mName.string(), s.z, to_string(error).c_str(),
+                static_cast<int32_t>(error));
+        hwcInfo.z = s.z;
+        changed = true;
+    }
 #else
     if (!frame.intersect(hw->getViewport(), &frame)) {
         frame.clear();
@@ -655,7 +755,11 @@ void Layer::setGeometry(
      */
 
     const Transform bufferOrientation(mCurrentTransform);
-    Transform transform(tr * s.active.transform * bufferOrientation);
+#ifdef USE_HWC2
+    Transform transform(getDisplayTransform(displayDevice) * bufferOrientation);
+#else
+    Transform transform(getDisplayTransform(hw) * bufferOrientation);
+#endif
 
     if (mSurfaceFlingerConsumer->getTransformToDisplayInverse()) {
         /*
@@ -681,11 +785,30 @@ void Layer::setGeometry(
         hwcInfo.forceClientComposition = true;
     } else {
         auto transform = static_cast<HWC2::Transform>(orientation);
-        auto error = hwcLayer->setTransform(transform);
-        ALOGE_IF(error != HWC2::Error::None, "[%s] Failed to set transform %s: "
-                "%s (%d)", mName.string(), to_string(transform).c_str(),
-                to_string(error).c_str(), static_cast<int32_t>(error));
+        if (!skipUnchanged || transform != hwcInfo.transform) {
+            auto error = hwcLayer->setTransform(transform);
+            ALOGE_IF(error != HWC2::Error::None, "[%s] Failed to set "
+                    "transform %s: %s (%d)", mName.string(),
+                    to_string(transform).c_str(), to_string(error).c_str(),
+                    static_cast<int32_t>(error));
+            hwcInfo.transform = transform;
+            changed = true;
+        }
+    }
+
+    // setPerFrameData() also depends on the display, through the visible
+    // region it sends
+    changed = changed || hwcInfo.forceClientComposition != wasForcedClient ||
+            hwcInfo.blackOut != wasBlackedOut;
+    if (!changed) {
+        const Region visible(tr.transform(
+                visibleRegion.intersect(displayDevice->getViewport())));
+        changed = !sameRegion(visible, hwcInfo.visibleRegion);
     }
+    if (changed) {
+        mPerFrameDataGeneration++;
+    }
+    hwcInfo.sidebandGeometrySent = mSidebandStream != NULL;
 #else
     if (orientation & Transform::ROT_INVALID) {
         // we can only handle simple transformation
@@ -704,23 +827,36 @@ void Layer::forceClientComposition(int32_t hwcId) {
     }
 
     mHwcLayers[hwcId].forceClientComposition = true;
+    mPerFrameDataGeneration++;
 }
 #endif
 
 #ifdef USE_HWC2
 void Layer::setPerFrameData(const sp<const DisplayDevice>& displayDevice) {
+    auto hwcId = displayDevice->getHwcDisplayId();
+    auto& hwcInfo = mHwcLayers[hwcId];
+    // Nothing has changed since the last frame, unless validate moved the
+    // layer to another composition type that it should be asked back from.
+    if (hwcInfo.perFrameDataGeneration == mPerFrameDataGeneration &&
+            hwcInfo.compositionType == hwcInfo.requestedCompositionType) {
+        return;
+    }
+    hwcInfo.perFrameDataGeneration = mPerFrameDataGeneration;
+
     // Apply this display's projection's viewport to the visible region
     // before giving it to the HWC HAL.
     const Transform& tr = displayDevice->getTransform();
     const auto& viewport = displayDevice->getViewport();
     Region visible = tr.transform(visibleRegion.intersect(viewport));
-    auto hwcId = displayDevice->getHwcDisplayId();
-    auto& hwcLayer = mHwcLayers[hwcId].layer;
+    auto& hwcLayer = hwcInfo.layer;
     auto error = hwcLayer->setVisibleRegion(visible);
     if (error != HWC2::Error::None) {
         ALOGE("[%s] Failed to set visible region: %s (%d)", mName.string(),
                 to_string(error).c_str(), static_cast<int32_t>(error));
         visible.dump(LOG_TAG);
+        hwcInfo.visibleRegion.clear();
+    } else {
+        hwcInfo.visibleRegion = visible;
     }
 
     error = hwcLayer->setSurfaceDamage(surfaceDamageRegion);
@@ -743,6 +879,22 @@ void Layer::setPerFrameData(const sp<const DisplayDevice>& displayDevice) {
         return;
     }
 
+    // Secure layers on displays that aren't secure, e.g. virtual displays
+    // that are being recorded. Showing them as solid black lets the rest of
+    // the frame stay on overlays, and their buffer never reaches the HWC.
+    // Should the HWC turn this into client composition after all,
+    // drawWithOpenGL() blacks the layer out the same way.
+    if (hwcInfo.blackOut && !hwcInfo.forceClientComposition) {
+        ALOGV("[%s] Requesting black SolidColor composition", mName.string());
+        setCompositionType(hwcId, HWC2::Composition::SolidColor);
+        error = hwcLayer->setColor({0, 0, 0, 255});
+        if (error != HWC2::Error::None) {
+            ALOGE("[%s] Failed to set color: %s (%d)", mName.string(),
+                    to_string(error).c_str(), static_cast<int32_t>(error));
+        }
+        return;
+    }
+
     // Client layers
     if (mHwcLayers[hwcId].forceClientComposition ||
             (mActiveBuffer != nullptr && mActiveBuffer->handle == nullptr)) {
@@ -822,6 +974,19 @@ void Layer::setPerFrameData(const sp<const DisplayDevice>& hw,
 #endif
 
 #ifdef USE_HWC2
+bool Layer::canMoveCursorAsync() const {
+    if (!mPotentialCursor || mFreezePositionUpdates || mHwcLayers.empty() ||
+            isOpaque(mDrawingState)) {
+        return false;
+    }
+    for (const auto& entry : mHwcLayers) {
+        if (entry.second.compositionType != HWC2::Composition::Cursor) {
+            return false;
+        }
+    }
+    return true;
+}
+
 void Layer::updateCursorPosition(const sp<const DisplayDevice>& displayDevice) {
     auto hwcId = displayDevice->getHwcDisplayId();
     if (mHwcLayers.count(hwcId) == 0 ||
@@ -1136,6 +1301,9 @@ void Layer::setCompositionType(int32_t hwcId, HWC2::Composition type,
     auto& hwcLayer = hwcInfo.layer;
     ALOGV("setCompositionType(%" PRIx64 ", %s, %d)", hwcLayer->getId(),
             to_string(type).c_str(), static_cast<int>(callIntoHwc));
+    if (callIntoHwc) {
+        hwcInfo.requestedCompositionType = type;
+    }
     if (hwcInfo.compositionType != type) {
         ALOGV("    actually setting");
         hwcInfo.compositionType = type;
@@ -1299,7 +1467,7 @@ void Layer::computeGeometry(const sp<const DisplayDevice>& hw, Mesh& mesh,
         bool useIdentityTransform) const
 {
     const Layer::State& s(getDrawingState());
-    const Transform tr(hw->getTransform());
+    const Transform& tr(hw->getTransform());
     const uint32_t hw_h = hw->getHeight();
     Rect win(s.active.w, s.active.h);
     if (!s.crop.isEmpty()) {
@@ -1321,7 +1489,7 @@ void Layer::computeGeometry(const sp<const DisplayDevice>& hw, Mesh& mesh,
         win = reduce(win, s.activeTransparentRegion);
 
         const Transform bufferOrientation(mCurrentTransform);
-        Transform transform(tr * s.active.transform * bufferOrientation);
+        Transform transform(getDisplayTransform(hw) * bufferOrientation);
         if (mSurfaceFlingerConsumer->getTransformToDisplayInverse()) {
             uint32_t invTransform =  DisplayDevice::getPrimaryDisplayOrientationTransform();
             if (invTransform & NATIVE_WINDOW_TRANSFORM_ROT_90) {
@@ -1352,40 +1520,40 @@ void Layer::computeGeometry(const sp<const DisplayDevice>& hw, Mesh& mesh,
     vec2 rb = vec2(win.right, win.bottom);
     vec2 rt = vec2(win.right, win.top);
 
-    if (!useIdentityTransform) {
+    bool layerTransform = !useIdentityTransform;
 #ifdef QTI_BSP
-        if((hw_w * hw_h) > NUM_PIXEL_LOW_RES_PANEL) {
-            if (orientation | mCurrentTransform | mTransformHint) {
-                lt = s.active.transform.transform(lt);
-                lb = s.active.transform.transform(lb);
-                rb = s.active.transform.transform(rb);
-                rt = s.active.transform.transform(rt);
-            }
-        } else {
+    if ((hw_w * hw_h) > NUM_PIXEL_LOW_RES_PANEL) {
+        layerTransform = layerTransform &&
+                (orientation | mCurrentTransform | mTransformHint);
+    }
+#endif
+
+    Mesh::VertexArray<vec2> position(mesh.getPositionArray<vec2>());
+    if (layerTransform && s.finalCrop.isEmpty()) {
+        // nothing to clip to in between, so go straight to the display
+        const Transform& layerToDisplay(getDisplayTransform(hw));
+        position[0] = layerToDisplay.transform(lt);
+        position[1] = layerToDisplay.transform(lb);
+        position[2] = layerToDisplay.transform(rb);
+        position[3] = layerToDisplay.transform(rt);
+    } else {
+        if (layerTransform) {
             lt = s.active.transform.transform(lt);
             lb = s.active.transform.transform(lb);
             rb = s.active.transform.transform(rb);
             rt = s.active.transform.transform(rt);
         }
-#else
-        lt = s.active.transform.transform(lt);
-        lb = s.active.transform.transform(lb);
-        rb = s.active.transform.transform(rb);
-        rt = s.active.transform.transform(rt);
-#endif
-    }
-    if (!s.finalCrop.isEmpty()) {
-        boundPoint(&lt, s.finalCrop);
-        boundPoint(&lb, s.finalCrop);
-        boundPoint(&rb, s.finalCrop);
-        boundPoint(&rt, s.finalCrop);
+        if (!s.finalCrop.isEmpty()) {
+            boundPoint(&lt, s.finalCrop);
+            boundPoint(&lb, s.finalCrop);
+            boundPoint(&rb, s.finalCrop);
+            boundPoint(&rt, s.finalCrop);
+        }
+        position[0] = tr.transform(lt);
+        position[1] = tr.transform(lb);
+        position[2] = tr.transform(rb);
+        position[3] = tr.transform(rt);
     }
-
-    Mesh::VertexArray<vec2> position(mesh.getPositionArray<vec2>());
-    position[0] = tr.transform(lt);
-    position[1] = tr.transform(lb);
-    position[2] = tr.transform(rb);
-    position[3] = tr.transform(rt);
     for (size_t i=0 ; i<4 ; i++) {
         position[i].y = hw_h - position[i].y;
     }
@@ -1431,6 +1599,11 @@ bool Layer::needsFiltering(const sp<const DisplayDevice>& hw) const {
 
 void Layer::setVisibleRegion(const Region& visibleRegion) {
     // always called from main thread
+#ifdef USE_HWC2
+    if (!sameRegion(this->visibleRegion, visibleRegion)) {
+        mPerFrameDataGeneration++;
+    }
+#endif
     this->visibleRegion = visibleRegion;
 }
 
@@ -1565,12 +1738,28 @@ void Layer::notifyAvailableFrames() {
 uint32_t Layer::doTransaction(uint32_t flags) {
     ATRACE_CALL();
 
+    if (!mCurrentState.modified && mPendingStates.empty()) {
+        return 0;
+    }
+
+    // Unless this transaction waits on a frame of another layer, or follows
+    // one that does, it would only go through mPendingStates to come out
+    // unchanged, so the current state is committed as it is. That saves
+    // the State copies in and out of mPendingStates and the one into c.
+    if (mCurrentState.handle == nullptr && mPendingStates.empty()) {
+        mCurrentState.modified = false;
+        return commitState(flags, mCurrentState);
+    }
+
     pushPendingState();
     Layer::State c = getCurrentState();
     if (!applyPendingStates(&c)) {
         return 0;
     }
+    return commitState(flags, c);
+}
 
+uint32_t Layer::commitState(uint32_t flags, State& c) {
     const Layer::State& s(getDrawingState());
 
     const bool sizeChanged = (c.requested.w != s.requested.w) ||
@@ -1681,12 +1870,37 @@ uint32_t Layer::doTransaction(uint32_t flags) {
 
 void Layer::commitTransaction(const State& stateToCommit) {
     mDrawingState = stateToCommit;
+    mDisplayTransforms.clear();
+}
+
+const Transform& Layer::getDisplayTransform(
+        const sp<const DisplayDevice>& hw) const {
+    // projection ids are never reused, not even by another display
+    const uint64_t projectionId = hw->getProjectionId();
+    for (const auto& cached : mDisplayTransforms) {
+        if (cached.projectionId == projectionId) {
+            sDisplayTransformsReused++;
+            return cached.transform;
+        }
+    }
+    sDisplayTransformsComputed++;
+    if (mDisplayTransforms.size() >= MAX_DISPLAY_TRANSFORMS) {
+        // most likely for a projection that was replaced since
+        mDisplayTransforms.erase(mDisplayTransforms.begin());
+    }
+    mDisplayTransforms.push_back({projectionId,
+            hw->getTransform() * getDrawingState().active.transform});
+    return mDisplayTransforms.back().transform;
 }
 
 uint32_t Layer::getTransactionFlags(uint32_t flags) {
     return android_atomic_and(~flags, &mTransactionFlags) & flags;
 }
 
+uint32_t Layer::peekTransactionFlags() const {
+    return android_atomic_acquire_load(&mTransactionFlags);
+}
+
 uint32_t Layer::setTransactionFlags(uint32_t flags) {
     return android_atomic_or(flags, &mTransactionFlags);
 }
@@ -1850,7 +2064,11 @@ void Layer::deferTransactionUntil(const sp<IBinder>& handle,
 }
 
 void Layer::useSurfaceDamage() {
-    if (mFlinger->mForceFullDamage) {
+#ifdef USE_HWC2
+    // a new buffer has been latched
+    mPerFrameDataGeneration++;
+#endif
+    if (mFlinger->mForceFullDamage || mSharedBufferFastPath) {
         surfaceDamageRegion = Region::INVALID_REGION;
     } else {
         surfaceDamageRegion = mSurfaceFlingerConsumer->getSurfaceDamage();
@@ -1858,6 +2076,12 @@ void Layer::useSurfaceDamage() {
 }
 
 void Layer::useEmptyDamage() {
+#ifdef USE_HWC2
+    // the region may also be INVALID_REGION, which is empty as well
+    if (!sameRegion(surfaceDamageRegion, Region())) {
+        mPerFrameDataGeneration++;
+    }
+#endif
     surfaceDamageRegion.clear();
 }
 
@@ -1953,6 +2177,9 @@ Region Layer::latchBuffer(bool& recomputeVisibleRegions)
     if (android_atomic_acquire_cas(true, false, &mSidebandStreamChanged) == 0) {
         // mSidebandStreamChanged was true
         mSidebandStream = mSurfaceFlingerConsumer->getSidebandStream();
+#ifdef USE_HWC2
+        mPerFrameDataGeneration++;
+#endif
         if (mSidebandStream != NULL) {
             setTransactionFlags(eTransactionNeeded);
             mFlinger->setTransactionFlags(eTraversalNeeded);
@@ -1975,6 +2202,22 @@ Region Layer::latchBuffer(bool& recomputeVisibleRegions)
             return outDirtyRegion;
         }
 
+        // With auto refresh in shared buffer mode the producer draws straight
+        // into the buffer we are already showing, and acquiring it again would
+        // only return, and re-release, the same slot. Until something is
+        // queued, just redraw the layer; its damage is unknown.
+        const nsecs_t now = systemTime();
+        if (mAutoRefresh && mQueuedFrames == 0 && mActiveBuffer != NULL &&
+                now - mLastSharedBufferLatch < SHARED_BUFFER_RELATCH_INTERVAL) {
+            mSharedBufferFastPath = true;
+            mSharedBufferRefreshes++;
+            mFlinger->signalLayerUpdate();
+            const State& s(getDrawingState());
+            return s.active.transform.transform(
+                    Region(Rect(s.active.w, s.active.h)));
+        }
+        mSharedBufferFastPath = false;
+
         // If the head buffer's acquire fence hasn't signaled yet, return and
         // try again later
         if (!headFenceHasSignaled()) {
@@ -1986,6 +2229,7 @@ Region Layer::latchBuffer(bool& recomputeVisibleRegions)
         const State& s(getDrawingState());
         const bool oldOpacity = isOpaque(s);
         sp<GraphicBuffer> oldActiveBuffer = mActiveBuffer;
+        const uint64_t oldFrameNumber = mCurrentFrameNumber;
 
         struct Reject : public SurfaceFlingerConsumer::BufferRejecter {
             Layer::State& front;
@@ -1995,6 +2239,7 @@ Region Layer::latchBuffer(bool& recomputeVisibleRegions)
             const char* name;
             int32_t overrideScalingMode;
             bool& freezePositionUpdates;
+            bool activeChanged;
 
             Reject(Layer::State& front, Layer::State& current,
                     bool& recomputeVisibleRegions, bool stickySet,
@@ -2006,7 +2251,8 @@ Region Layer::latchBuffer(bool& recomputeVisibleRegions)
                   stickyTransformSet(stickySet),
                   name(name),
                   overrideScalingMode(overrideScalingMode),
-                  freezePositionUpdates(freezePositionUpdates) {
+                  freezePositionUpdates(freezePositionUpdates),
+                  activeChanged(false) {
             }
 
             virtual bool reject(const sp<GraphicBuffer>& buf,
@@ -2037,6 +2283,7 @@ Region Layer::latchBuffer(bool& recomputeVisibleRegions)
                         // current and drawing states. Drawing state is only accessed
                         // in this thread, no need to have it locked
                         front.active = front.requested;
+                        activeChanged = true;
 
                         // We also need to update the current state so that
                         // we don't end-up overwriting the drawing state with
@@ -2155,7 +2402,10 @@ Region Layer::latchBuffer(bool& recomputeVisibleRegions)
         bool queuedBuffer = false;
         status_t updateResult = mSurfaceFlingerConsumer->updateTexImage(&r,
                 mFlinger->mPrimaryDispSync, &mAutoRefresh, &queuedBuffer,
-                mLastFrameNumberReceived);
+                mLastFrameNumberReceived, &mFlinger->mLatchReleaseFence);
+        if (r.activeChanged) {
+            mDisplayTransforms.clear();
+        }
         if (updateResult == BufferQueue::PRESENT_LATER) {
             // Producer doesn't want buffer to be displayed yet.  Signal a
             // layer update so we check again at the next opportunity.
@@ -2212,6 +2462,10 @@ Region Layer::latchBuffer(bool& recomputeVisibleRegions)
         }
 
 
+        if (mAutoRefresh) {
+            mLastSharedBufferLatch = now;
+        }
+
         // Decrement the queued-frames count.  Signal another event if we
         // have more frames pending.
         if ((queuedBuffer && android_atomic_dec(&mQueuedFrames) > 1)
@@ -2291,8 +2545,20 @@ Region Layer::latchBuffer(bool& recomputeVisibleRegions)
             }
         }
 
-        // FIXME: postedRegion should be dirty & bounds
+        // Redraw only the surface damage when it maps directly onto the
+        // layer. Damage is relative to the previously queued frame, so this
+        // is only safe if that is the frame we were showing.
         Region dirtyRegion(Rect(s.active.w, s.active.h));
+        const Region& damage(mSurfaceFlingerConsumer->getSurfaceDamage());
+        if (queuedBuffer && !recomputeVisibleRegions &&
+                !mFlinger->mForceFullDamage &&
+                mCurrentFrameNumber == oldFrameNumber + 1 &&
+                damage.bounds() != Rect::INVALID_RECT &&
+                mCurrentTransform == 0 && mCurrentCrop.isEmpty() &&
+                uint32_t(mActiveBuffer->width) == s.active.w &&
+                uint32_t(mActiveBuffer->height) == s.active.h) {
+            dirtyRegion.andSelf(damage);
+        }
 
         // transform the dirty region to window-manager space
         outDirtyRegion = (s.active.transform.transform(dirtyRegion));
@@ -2384,6 +2650,14 @@ void Layer::dump(String8& result, Colorizer& colorizer) const
             " queued-frames=%d, mRefreshPending=%d\n",
             mFormat, w0, h0, s0,f0,
             mQueuedFrames, mRefreshPending);
+    size_t numBuffers = 0;
+    const size_t bufferBytes = getRetainedBufferBytes(&numBuffers);
+    result.appendFormat("      retained buffers=%zu (%.1f KiB)\n", numBuffers,
+            bufferBytes / 1024.0f);
+    if (mSharedBufferRefreshes > 0) {
+        result.appendFormat("      shared-buffer refreshes without latch=%"
+                PRIu64 "\n", mSharedBufferRefreshes);
+    }
 
     if (mSurfaceFlingerConsumer != 0) {
         mSurfaceFlingerConsumer->dumpState(result, "            ");
@@ -2442,6 +2716,18 @@ void Layer::dumpFrameStats(String8& result) const {
     mFrameTracker.dumpStats(result);
 }
 
+void Layer::dumpFrameHistory(String8& result) const {
+    mFrameTracker.dumpHistory(result);
+}
+
+void Layer::exportFrameHistory(String8& result) const {
+    mFrameTracker.exportHistory(mName, result);
+}
+
+void Layer::dumpBufferLatency(String8& result) const {
+    mSurfaceFlingerConsumer->dumpLatency(result, "");
+}
+
 void Layer::clearFrameStats() {
     mFrameTracker.clearStats();
 }
@@ -2485,10 +2771,114 @@ std::vector<OccupancyTracker::Segment> Layer::getOccupancyHistory(
     return history;
 }
 
+size_t Layer::getRetainedBufferBytes(size_t* outNumBuffers) const {
+    if (mSurfaceFlingerConsumer == NULL) {
+        if (outNumBuffers) {
+            *outNumBuffers = 0;
+        }
+        return 0;
+    }
+    return mSurfaceFlingerConsumer->getRetainedBufferBytes(outNumBuffers);
+}
+
+size_t Layer::discardFreeBuffers() {
+    const size_t before = getRetainedBufferBytes();
+    status_t result = mSurfaceFlingerConsumer->discardFreeBuffers();
+    if (result != NO_ERROR) {
+        ALOGW("[%s] Failed to discard free buffers (%d)", mName.string(),
+                result);
+        return 0;
+    }
+    const size_t after = getRetainedBufferBytes();
+    if (after < before) {
+        mBuffersTrimmed = true;
+        return before - after;
+    }
+    return 0;
+}
+
+void Layer::updateBufferTrimming(bool onScreen, uint32_t trimAfterFrames) {
+    if (onScreen) {
+        mFramesOffScreen = 0;
+        if (mBuffersTrimmed) {
+            mBuffersTrimmed = false;
+            // a double buffered layer gets its two back on the first frames
+            if (!mDoubleBuffered) {
+                allocateBuffersAsync();
+            }
+        }
+        return;
+    }
+    // the count stops once past the limit, so this trims only once
+    if (trimAfterFrames == 0 || mFramesOffScreen > trimAfterFrames) {
+        return;
+    }
+    if (++mFramesOffScreen > trimAfterFrames) {
+        const size_t freed = discardFreeBuffers();
+        ALOGV("[%s] off screen for %u frames, freed %zu KiB", mName.string(),
+                trimAfterFrames, freed / 1024);
+    }
+}
+
+void Layer::updateBufferCount(
+        const std::vector<OccupancyTracker::Segment>& history,
+        uint32_t doubleBufferAfterSegments) {
+    if (doubleBufferAfterSegments == 0 || history.empty()) {
+        return;
+    }
+    bool grow = false;
+    // the history is newest first
+    for (auto it = history.rbegin(); it != history.rend(); ++it) {
+        if (it->usedThirdBuffer) {
+            mSegmentsWithoutThirdBuffer = 0;
+            grow = grow || mDoubleBuffered;
+            mDoubleBuffered = false;
+        } else if (mSegmentsWithoutThirdBuffer < doubleBufferAfterSegments) {
+            mSegmentsWithoutThirdBuffer++;
+        }
+    }
+
+    if (mSegmentsWithoutThirdBuffer >= doubleBufferAfterSegments) {
+        // Trim every time, the producer may have allocated a buffer since
+        // (e.g. for a single frame it ran ahead, which is too short to
+        // count as a segment of its own).
+        const size_t before = getRetainedBufferBytes();
+        status_t result = mSurfaceFlingerConsumer->trimFreeBuffers(2);
+        if (result != NO_ERROR) {
+            ALOGW("[%s] Failed to trim free buffers (%d)", mName.string(),
+                    result);
+            return;
+        }
+        const size_t after = getRetainedBufferBytes();
+        ALOGV_IF(!mDoubleBuffered, "[%s] double buffered after %u segments, "
+                "freed %zu KiB", mName.string(), doubleBufferAfterSegments,
+                before > after ? (before - after) / 1024 : 0);
+        mDoubleBuffered = true;
+    } else if (grow) {
+        ALOGV("[%s] needed a third buffer, allocating the queue again",
+                mName.string());
+        allocateBuffersAsync();
+    }
+}
+
+void Layer::allocateBuffersAsync() {
+    // The producer would allocate them one by one as it needs them, in its
+    // dequeueBuffer() calls; get them all ready up front instead, away from
+    // the main thread.
+    sp<IGraphicBufferProducer> producer(mProducer);
+    std::thread([producer]() {
+        producer->allocateBuffers(0, 0, 0, 0);
+    }).detach();
+}
+
 bool Layer::getTransformToDisplayInverse() const {
     return mSurfaceFlingerConsumer->getTransformToDisplayInverse();
 }
 
+sp<Client> Layer::getClient() const {
+    return mClientRef.promote();
+}
+
 // ---------------------------------------------------------------------------
 
 Layer::LayerCleaner::LayerCleaner(const sp<SurfaceFlinger>& flinger,
@@ -36,11 +36,14 @@
 
 #include <private/gui/LayerState.h>
 
+#include <atomic>
 #include <list>
+#include <vector>
 
 #include "FrameTracker.h"
 #include "Client.h"
 #include "MonitoredProducer.h"
+#include "RefreshRateScheduler.h"
 #include "SurfaceFlinger.h"
 #include "SurfaceFlingerConsumer.h"
 #include "Transform.h"
@@ -186,15 +189,31 @@ public:
     void useEmptyDamage();
 
     uint32_t getTransactionFlags(uint32_t flags);
+    uint32_t peekTransactionFlags() const;
     uint32_t setTransactionFlags(uint32_t flags);
 
     virtual void computeGeometry(const sp<const DisplayDevice>& hw, Mesh& mesh,
             bool useIdentityTransform) const;
     Rect computeBounds(const Region& activeTransparentRegion) const;
     Rect computeBounds() const;
+    // The display's transform combined with the layer's, which is only
+    // computed again after a transaction or a projection change.
+    const Transform& getDisplayTransform(
+            const sp<const DisplayDevice>& hw) const;
+    // how often getDisplayTransform() had to compute the transform, and how
+    // often it could reuse one, over all layers
+    static uint64_t getDisplayTransformsComputed() {
+        return sDisplayTransformsComputed;
+    }
+    static uint64_t getDisplayTransformsReused() {
+        return sDisplayTransformsReused;
+    }
 
     class Handle;
     sp<IBinder> getHandle();
+    // The layer behind a handle from getHandle(), which may have come from
+    // a client; NULL for anything else or a layer that is gone.
+    static sp<Layer> fromHandle(const sp<IBinder>& handle);
     sp<IGraphicBufferProducer> getProducer() const;
     const String8& getName() const;
 
@@ -266,6 +285,11 @@ public:
     bool getClearClientTarget(int32_t hwcId) const;
 
     void updateCursorPosition(const sp<const DisplayDevice>& hw);
+    // Whether a position change can go to HWC through
+    // updateCursorPosition() alone: the layer is on the cursor plane of
+    // every display it is on, and being translucent it could not have
+    // hidden anything which now needs to be drawn. Main thread only.
+    bool canMoveCursorAsync() const;
 #else
     void setGeometry(const sp<const DisplayDevice>& hw,
             HWComposer::HWCLayerInterface& layer);
@@ -395,6 +419,25 @@ public:
     bool hasQueuedFrame() const { return mQueuedFrames > 0 ||
             mSidebandStreamChanged || mAutoRefresh; }
 
+    /*
+     * Returns the frame number of the buffer last latched.
+     */
+    uint64_t getCurrentFrameNumber() const { return mCurrentFrameNumber; }
+
+    /*
+     * Returns true if what this layer draws can change without a new
+     * frame being latched (auto refresh, sideband streams).
+     */
+    bool hasUnlatchedContent() const {
+        return mAutoRefresh || mSidebandStream != NULL;
+    }
+
+    /*
+     * Returns how often new frames have been queued lately; see
+     * ContentCadence::getFramePeriod().
+     */
+    nsecs_t getContentFramePeriod(nsecs_t now, bool* outIsAutoTimestamp) const;
+
 #ifdef USE_HWC2
     // -----------------------------------------------------------------------
 
@@ -420,6 +463,8 @@ public:
     void setHwcLayer(int32_t hwcId, std::shared_ptr<HWC2::Layer>&& layer) {
         if (layer) {
             mHwcLayers[hwcId].layer = layer;
+            mHwcLayers[hwcId].perFrameDataGeneration = 0;
+            mHwcLayers[hwcId].sidebandGeometrySent = false;
         } else {
             mHwcLayers.erase(hwcId);
         }
@@ -447,6 +492,9 @@ public:
     void miniDump(String8& result, int32_t hwcId) const;
 #endif
     void dumpFrameStats(String8& result) const;
+    void dumpFrameHistory(String8& result) const;
+    void exportFrameHistory(String8& result) const;
+    void dumpBufferLatency(String8& result) const;
     void clearFrameStats();
     void logFrameStats();
     void getFrameStats(FrameStats* outStats) const;
@@ -457,13 +505,39 @@ public:
 
     std::vector<OccupancyTracker::Segment> getOccupancyHistory(bool forceFlush);
 
+    // Estimated bytes of the buffers this layer's queue keeps allocated.
+    virtual size_t getRetainedBufferBytes(size_t* outNumBuffers = NULL) const;
+    // Frees the buffers neither the producer nor the layer is using, which
+    // only costs a reallocation if the producer needs them again, and
+    // returns the bytes released.
+    size_t discardFreeBuffers();
+    // Discards the free buffers once the layer has been off every display
+    // for more than trimAfterFrames compositions, and has the queue
+    // allocate them again when it comes back. Main thread only.
+    void updateBufferTrimming(bool onScreen, uint32_t trimAfterFrames);
+    // Feeds the occupancy history back into the queue: once
+    // doubleBufferAfterSegments bursts of frames in a row never needed a
+    // third buffer, the free buffers beyond two are discarded, and the queue
+    // is allocated again as soon as a burst does need one. Takes the history
+    // just returned by getOccupancyHistory. Main thread only.
+    void updateBufferCount(
+            const std::vector<OccupancyTracker::Segment>& history,
+            uint32_t doubleBufferAfterSegments);
+
     bool getFrameTimestamps(uint64_t frameNumber,
             FrameTimestamps* outTimestamps) const {
         return mFlinger->getFrameTimestamps(*this, frameNumber, outTimestamps);
     }
 
+    status_t createFrameEventChannel(sp<BitTube>* outChannel) const {
+        return mFlinger->createFrameEventChannel(*this, outChannel);
+    }
+
     bool getTransformToDisplayInverse() const;
 
+    // NULL once the client connection is gone
+    sp<Client> getClient() const;
+
 protected:
     // constant
     sp<SurfaceFlinger> mFlinger;
@@ -491,6 +565,9 @@ private:
     virtual void onFrameReplaced(const BufferItem& item) override;
     virtual void onSidebandStreamChanged() override;
 
+    // The rest of doTransaction() once the state to commit is known, which
+    // may be mCurrentState itself
+    uint32_t commitState(uint32_t flags, State& c);
     void commitTransaction(const State& stateToCommit);
 
     // needsLinearFiltering - true if this surface's state requires filtering
@@ -513,6 +590,9 @@ private:
     // Loads the corresponding system property once per process
     static bool latchUnsignaledBuffers();
 
+    // Has the producer allocate all of its buffers on another thread.
+    void allocateBuffersAsync();
+
     // -----------------------------------------------------------------------
 
     class SyncPoint
@@ -627,16 +707,43 @@ private:
           : layer(),
             forceClientComposition(false),
             compositionType(HWC2::Composition::Invalid),
-            clearClientTarget(false) {}
+            requestedCompositionType(HWC2::Composition::Invalid),
+            clearClientTarget(false),
+            perFrameDataGeneration(0),
+            blendMode(HWC2::BlendMode::Invalid),
+            planeAlpha(0.0f),
+            z(0),
+            transform(HWC2::Transform::None),
+            sidebandGeometrySent(false),
+            blackOut(false) {}
 
         std::shared_ptr<HWC2::Layer> layer;
         bool forceClientComposition;
         HWC2::Composition compositionType;
+        // what setPerFrameData() last asked for, which validate may have
+        // changed compositionType from
+        HWC2::Composition requestedCompositionType;
         bool clearClientTarget;
         Rect displayFrame;
         FloatRect sourceCrop;
+        // mPerFrameDataGeneration as of the last per-frame data sent
+        uint64_t perFrameDataGeneration;
+        // the rest of what was last sent, which setGeometry() only sends
+        // again if it changed while sidebandGeometrySent is set
+        HWC2::BlendMode blendMode;
+        float planeAlpha;
+        uint32_t z;
+        HWC2::Transform transform;
+        Region visibleRegion;
+        bool sidebandGeometrySent;
+        // a secure layer on a display that isn't secure, shown as black
+        bool blackOut;
     };
     std::unordered_map<int32_t, HWCInfo> mHwcLayers;
+    // Bumped whenever anything setPerFrameData() sends may have changed;
+    // the HWC keeps layer state between frames, so until then there is
+    // nothing to send.
+    uint64_t mPerFrameDataGeneration;
 #else
     bool mIsGlesComposition;
 #endif
@@ -658,11 +765,41 @@ private:
     Condition mQueueItemCondition;
     Vector<BufferItem> mQueueItems;
     std::atomic<uint64_t> mLastFrameNumberReceived;
+    // when the queued frames are meant to be shown; protected by
+    // mQueueItemLock
+    ContentCadence mContentCadence;
     bool mUpdateTexImageFailed; // This is only modified from the main thread
 
     bool mAutoRefresh;
+    // Set while latchBuffer is refreshing an auto-refresh shared buffer
+    // without acquiring it; see latchBuffer.
+    bool mSharedBufferFastPath;
+    nsecs_t mLastSharedBufferLatch;
+    uint64_t mSharedBufferRefreshes;
     bool mFreezePositionUpdates;
     uint32_t mTransformHint;
+
+    // compositions the layer has been off every display for, and whether
+    // its free buffers were discarded since it was last shown; main thread
+    // only
+    uint32_t mFramesOffScreen;
+    bool mBuffersTrimmed;
+    // occupancy segments in a row that didn't use a third buffer (stops
+    // counting at the limit), and whether the queue was trimmed to two
+    // buffers because of them; main thread only
+    uint32_t mSegmentsWithoutThirdBuffer;
+    bool mDoubleBuffered;
+
+    // getDisplayTransform() results by DisplayDevice::getProjectionId(),
+    // dropped whenever the drawing state's geometry changes
+    struct DisplayTransform {
+        uint64_t projectionId;
+        Transform transform;
+    };
+    static constexpr size_t MAX_DISPLAY_TRANSFORMS = 4;
+    mutable std::vector<DisplayTransform> mDisplayTransforms;
+    static std::atomic<uint64_t> sDisplayTransformsComputed;
+    static std::atomic<uint64_t> sDisplayTransformsReused;
 };
 
 // ---------------------------------------------------------------------------
@@ -27,6 +27,8 @@
 #include <time.h>
 #include <dlfcn.h>
 
+#include <cutils/properties.h>
+
 #include <utils/Errors.h>
 #include <utils/Log.h>
 #include <utils/Trace.h>
@@ -91,11 +93,60 @@ static void setupMesh(Mesh& mesh, int width, int height, int viewportHeight) {
     texCoords[3] = vec2(1.0f, 1.0f);
 }
 
+LayerBlur::BlurKey::BlurKey()
+    : display(NULL), layerStack(0), width(0), height(0), panelMountFlip(0),
+      level(0), downscale(1)
+{
+}
+
+static bool sameTransform(const Transform& lhs, const Transform& rhs) {
+    for (size_t i = 0; i < 3; i++) {
+        for (size_t j = 0; j < 3; j++) {
+            if (lhs[i][j] != rhs[i][j]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool LayerBlur::BlurKey::matches(const BlurKey& other) const {
+    if (display != other.display || layerStack != other.layerStack ||
+            width != other.width || height != other.height ||
+            panelMountFlip != other.panelMountFlip ||
+            level != other.level || downscale != other.downscale ||
+            !sameTransform(transform, other.transform) ||
+            sources.size() != other.sources.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < sources.size(); i++) {
+        const Source& a(sources[i]);
+        const Source& b(other.sources[i]);
+        if (a.sequence != b.sequence || a.stateSequence != b.stateSequence ||
+                a.frameNumber != b.frameNumber) {
+            return false;
+        }
+    }
+    return true;
+}
+
 LayerBlur::LayerBlur(SurfaceFlinger* flinger, const sp<Client>& client,
         const String8& name, uint32_t w, uint32_t h, uint32_t flags)
     : Layer(flinger, client, name, w, h, flags), mBlurMaskSampling(1),
-    mBlurMaskAlphaThreshold(0.0f) ,mLastFrameSequence(0)
+    mBlurMaskAlphaThreshold(0.0f) ,mLastFrameSequence(0),
+    mBlurKeyValid(false), mDownscale(1)
 {
+    // The capture is blurred anyway, so it loses little by being taken at a
+    // lower resolution, and both the capture and the blur get cheaper.
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.sf.blur_downscale", value, "1");
+    mDownscale = atoi(value);
+    if (mDownscale < 1) {
+        mDownscale = 1;
+    } else if (mDownscale > 8) {
+        mDownscale = 8;
+    }
+
     GLuint texnames[3];
     mFlinger->getRenderEngine().genTextures(3, texnames);
     mTextureCapture.init(Texture::TEXTURE_2D, texnames[0]);
@@ -148,13 +199,26 @@ void LayerBlur::onDraw(const sp<const DisplayDevice>& hw, const Region& /*clip*/
     size_t savedViewportHeight = engine.getViewportHeight();
 
 
-    if (mLastFrameSequence != mFlinger->mActiveFrameSequence ||
-            mTextureBlur.getWidth() == 0 || mTextureBlur.getHeight() == 0) {
-        // full drawing needed.
+    // The layers below may not have changed since the last blur; the key
+    // tells, but it is not even needed when drawn again within a frame.
+    bool reuseBlur = mTextureBlur.getWidth() != 0 &&
+            mTextureBlur.getHeight() != 0 &&
+            mLastFrameSequence == mFlinger->mActiveFrameSequence;
+    BlurKey key;
+    const bool keyValid = !reuseBlur && computeBlurKey(hw, &key);
+    if (keyValid && mBlurKeyValid && mTextureBlur.getWidth() != 0 &&
+            mTextureBlur.getHeight() != 0 && key.matches(mBlurKey)) {
+        ATRACE_NAME("Blur.reuse");
+        reuseBlur = true;
+    }
 
+    if (!reuseBlur) {
+        // full drawing needed.
+        mBlurKeyValid = false;
 
         // capture
-        if (!captureScreen(hw, mFboCapture, mTextureCapture, hwWidth, hwHeight)) {
+        if (!captureScreen(hw, mFboCapture, mTextureCapture,
+                hwWidth / mDownscale, hwHeight / mDownscale)) {
             return;
         }
 
@@ -173,6 +237,8 @@ void LayerBlur::onDraw(const sp<const DisplayDevice>& hw, const Region& /*clip*/
 
         // mTextureBlur now has "Blurred image"
         mTextureBlur.setDimensions(outTexWidth, outTexHeight);
+        mBlurKey = key;
+        mBlurKeyValid = keyValid;
 
     } else {
         // We can just re-use mTextureBlur.
@@ -211,6 +277,43 @@ void LayerBlur::onDraw(const sp<const DisplayDevice>& hw, const Region& /*clip*/
 }
 
 
+bool LayerBlur::computeBlurKey(const sp<const DisplayDevice>& hw,
+        BlurKey* key) const {
+    const Layer::State& s(getDrawingState());
+    if (s.z == 0) {
+        // captureScreen() wraps around and draws every layer
+        return false;
+    }
+    key->display = hw.get();
+    key->layerStack = hw->getLayerStack();
+    key->width = hw->getWidth();
+    key->height = hw->getHeight();
+    key->panelMountFlip = hw->getPanelMountFlip();
+    key->transform = hw->getTransform();
+    key->level = s.blur;
+    key->downscale = mDownscale;
+
+    // the same layers captureScreen() draws, see renderScreenImplLocked()
+    const LayerVector& layers(mFlinger->mDrawingState.layersSortedByZ);
+    for (size_t i = 0; i < layers.size(); i++) {
+        const sp<Layer>& layer(layers[i]);
+        const Layer::State& state(layer->getDrawingState());
+        if (state.layerStack != key->layerStack || state.z >= s.z ||
+                !layer->isVisible()) {
+            continue;
+        }
+        if (layer->isBlurLayer() || layer->hasUnlatchedContent()) {
+            return false;
+        }
+        BlurKey::Source source;
+        source.sequence = layer->getSequence();
+        source.stateSequence = state.sequence;
+        source.frameNumber = layer->getCurrentFrameNumber();
+        key->sources.add(source);
+    }
+    return true;
+}
+
 bool LayerBlur::captureScreen(const sp<const DisplayDevice>& hw, FBO& fbo, Texture& texture, int width, int height) {
     ATRACE_CALL();
     ensureFbo(fbo, width, height, texture.getTextureName());
@@ -231,7 +334,7 @@ bool LayerBlur::captureScreen(const sp<const DisplayDevice>& hw, FBO& fbo, Textu
     rotation = (Transform::orientation_flags)(rotation ^ hw->getPanelMountFlip());
     mFlinger->renderScreenImplLocked(
                 hw,
-                Rect(0,0,width,height),
+                Rect(0,0,hw->getWidth(),hw->getHeight()),
                 width, height,
                 0, getDrawingState().z-1,
                 false,
@@ -302,8 +405,8 @@ void LayerBlur::doDrawFinal(const sp<const DisplayDevice>& hw,
     RenderEngine& engine(mFlinger->getRenderEngine());
     const Layer::State& s(getDrawingState());
 
-    Transform trToDraw(useIdentityTransform ? hw->getTransform() : hw->getTransform() * s.active.transform);
-    Transform trToMapTexture(hw->getTransform() * s.active.transform);
+    const Transform& trToMapTexture(getDisplayTransform(hw));
+    const Transform& trToDraw(useIdentityTransform ? hw->getTransform() : trToMapTexture);
 
     Rect frameToDraw(trToDraw.transform(Rect(s.active.w, s.active.h)));
     Rect frameToMapTexture(trToMapTexture.transform(Rect(s.active.w, s.active.h)));
@@ -359,6 +462,23 @@ bool LayerBlur::setBlurMaskLayer(sp<Layer>& maskLayer) {
 }
 
 
+size_t LayerBlur::getRetainedBufferBytes(size_t* outNumBuffers) const {
+    size_t numBuffers = 0;
+    size_t bytes = Layer::getRetainedBufferBytes(&numBuffers);
+    // both are RGBA textures of the FBO size, see initFbo()
+    const FBO* fbos[] = { &mFboCapture, &mFboMasking };
+    for (const FBO* fbo : fbos) {
+        if (fbo->fbo != 0) {
+            bytes += size_t(fbo->width) * fbo->height * 4;
+            numBuffers++;
+        }
+    }
+    if (outNumBuffers) {
+        *outNumBuffers = numBuffers;
+    }
+    return bytes;
+}
+
 void LayerBlur::initFbo(FBO& fbobj, int width, int height, int textureName) {
     GLuint fbo=0;
 
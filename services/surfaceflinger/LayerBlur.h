@@ -48,6 +48,8 @@ public:
     virtual bool isSecure() const         { return false; }
     virtual bool isFixedSize() const      { return true; }
     virtual bool isVisible() const;
+    // adds the capture and mask scratch textures
+    virtual size_t getRetainedBufferBytes(size_t* outNumBuffers = NULL) const;
 
     virtual bool isBlurLayer() const      { return true; }
     virtual bool setBlurMaskLayer(sp<Layer>& maskLayer);
@@ -104,6 +106,36 @@ private:
     void ensureFbo(FBO& fbo, int width, int height, int textureName);
 
 
+    // What mTextureBlur was made from. While the display and every layer
+    // below the blur are unchanged, the blurred texture is reused.
+    struct BlurKey {
+        struct Source {
+            int32_t sequence;
+            int32_t stateSequence;
+            uint64_t frameNumber;
+        };
+        BlurKey();
+        bool matches(const BlurKey& other) const;
+
+        const DisplayDevice* display;
+        uint32_t layerStack;
+        int width;
+        int height;
+        uint32_t panelMountFlip;
+        Transform transform;
+        int32_t level;
+        int32_t downscale;
+        Vector<Source> sources;
+    };
+    // Returns false if the layers below can't be keyed, e.g. because one
+    // of them changes without latching frames.
+    bool computeBlurKey(const sp<const DisplayDevice>& hw, BlurKey* key) const;
+
+    BlurKey mBlurKey;
+    bool mBlurKeyValid;
+    // the screen is captured at 1/mDownscale of the display size
+    int32_t mDownscale;
+
     FBO mFboCapture;
     Texture mTextureCapture;
 
@@ -0,0 +1,194 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <string.h>
+
+#include "Layer.h"
+#include "LayerCapture.h"
+
+namespace android {
+
+static void packRect(const Rect& rect, int32_t* out) {
+    out[0] = rect.left;
+    out[1] = rect.top;
+    out[2] = rect.right;
+    out[3] = rect.bottom;
+}
+
+LayerCapture::LayerCapture()
+    : mEnabled(false), mCapacity(0), mNext(0), mNumFrames(0)
+{
+}
+
+void LayerCapture::setCapacity(size_t capacity) {
+    Mutex::Autolock lock(mLock);
+    if (capacity == mCapacity) {
+        return;
+    }
+    mCapacity = capacity;
+    // the ring order is lost, so start over
+    std::vector<Frame>().swap(mFrames);
+    mFrames.reserve(capacity);
+    mNext = 0;
+    mEnabled = capacity > 0;
+}
+
+void LayerCapture::beginFrame(nsecs_t time) {
+    mBuilding.record.time = time;
+    mBuilding.record.numDisplays = 0;
+    mBuilding.record.numLayers = 0;
+    mBuilding.displays.clear();
+    mBuilding.layers.clear();
+}
+
+void LayerCapture::addDisplay(uint32_t layerStack, int32_t width,
+        int32_t height, uint32_t flags) {
+    if (mBuilding.displays.size() >= MAX_DISPLAYS) {
+        return;
+    }
+    DisplayRecord display;
+    display.layerStack = layerStack;
+    display.width = width;
+    display.height = height;
+    display.flags = flags;
+    mBuilding.displays.push_back(display);
+}
+
+void LayerCapture::addLayer(const Layer& layer) {
+    const Layer::State& s(layer.getDrawingState());
+    LayerRecord record;
+    // no padding goes out uninitialized
+    memset(&record, 0, sizeof(record));
+
+    const sp<GraphicBuffer>& buffer(layer.getActiveBuffer());
+    record.bufferId = buffer != nullptr ? buffer->getId() : 0;
+    record.frameNumber = layer.getCurrentFrameNumber();
+    const Transform& tr(s.active.transform);
+    for (size_t i = 0; i < 3; i++) {
+        for (size_t j = 0; j < 3; j++) {
+            record.transform[i * 3 + j] = tr[i][j];
+        }
+    }
+    record.z = s.z;
+    record.layerStack = s.layerStack;
+#ifdef USE_HWC2
+    record.alpha = s.alpha;
+#else
+    record.alpha = s.alpha / 255.0f;
+#endif
+    record.width = s.active.w;
+    record.height = s.active.h;
+    packRect(s.crop, record.crop);
+    packRect(s.finalCrop, record.finalCrop);
+
+    // the same inputs as computeVisibleRegions()
+    const bool visible = layer.isVisible();
+    const bool translucent = !layer.isOpaque(s);
+    Rect bounds(Rect::EMPTY_RECT);
+    if (visible) {
+        record.flags |= LAYER_VISIBLE;
+        bounds = tr.transform(layer.computeBounds());
+    }
+    if (translucent) {
+        record.flags |= LAYER_TRANSLUCENT;
+    }
+    if (record.alpha == 1.0f && !translucent &&
+            (tr.getOrientation() & Transform::ROT_INVALID) == 0) {
+        record.flags |= LAYER_OPAQUE;
+    }
+    if (layer.isSecure()) {
+        record.flags |= LAYER_SECURE;
+    }
+    packRect(bounds, record.bounds);
+
+    const Region& visibleRegion(layer.visibleRegion);
+    packRect(visibleRegion.getBounds(), record.visibleBounds);
+    record.visibleRects = uint32_t(visibleRegion.end() - visibleRegion.begin());
+
+    mBuilding.layers.push_back(record);
+}
+
+void LayerCapture::setComposition(size_t layer, size_t display,
+        uint8_t composition) {
+    if (layer < mBuilding.layers.size() && display < MAX_DISPLAYS) {
+        mBuilding.layers[layer].composition[display] = composition;
+    }
+}
+
+void LayerCapture::endFrame() {
+    mBuilding.record.numDisplays = uint32_t(mBuilding.displays.size());
+    mBuilding.record.numLayers = uint32_t(mBuilding.layers.size());
+
+    Mutex::Autolock lock(mLock);
+    if (mCapacity == 0) {
+        return;
+    }
+    if (mFrames.size() < mCapacity) {
+        mFrames.push_back(Frame());
+        std::swap(mFrames.back(), mBuilding);
+    } else {
+        // the frame that drops out is reused for the next one
+        std::swap(mFrames[mNext], mBuilding);
+        mNext = (mNext + 1) % mCapacity;
+    }
+    mNumFrames++;
+}
+
+void LayerCapture::dump(String8& result) const {
+    Mutex::Autolock lock(mLock);
+    if (mCapacity == 0) {
+        result.append("  layer capture disabled\n");
+        return;
+    }
+    size_t numLayers = 0;
+    for (const auto& frame : mFrames) {
+        numLayers += frame.layers.size();
+    }
+    result.appendFormat("  layer capture: %zu of %zu frames kept (%zu "
+            "layers), %" PRIu64 " captured\n", mFrames.size(), mCapacity,
+            numLayers, mNumFrames);
+}
+
+void LayerCapture::exportTo(String8& result) const {
+    Mutex::Autolock lock(mLock);
+    Header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.frameSize = sizeof(FrameRecord);
+    header.displaySize = sizeof(DisplayRecord);
+    header.layerSize = sizeof(LayerRecord);
+    header.count = uint32_t(mFrames.size());
+    result.append(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    // oldest first; mNext is only non-zero once the ring has wrapped
+    for (size_t n = 0; n < mFrames.size(); n++) {
+        const Frame& frame(mFrames[(mNext + n) % mFrames.size()]);
+        result.append(reinterpret_cast<const char*>(&frame.record),
+                sizeof(frame.record));
+        if (!frame.displays.empty()) {
+            result.append(reinterpret_cast<const char*>(frame.displays.data()),
+                    frame.displays.size() * sizeof(DisplayRecord));
+        }
+        if (!frame.layers.empty()) {
+            result.append(reinterpret_cast<const char*>(frame.layers.data()),
+                    frame.layers.size() * sizeof(LayerRecord));
+        }
+    }
+}
+
+}; // namespace android
@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SF_LAYERCAPTURE_H
+#define ANDROID_SF_LAYERCAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <utils/Mutex.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+#include <atomic>
+#include <vector>
+
+namespace android {
+
+class Layer;
+
+/*
+ * A ring buffer of the layer state of the last frames, in a binary form
+ * that the layerreplay tool (tests/layerreplay) can read back to run the
+ * visible region pass over real scenes offline.
+ *
+ * Each frame holds the displays and every layer of the drawing state in Z
+ * order, with the inputs computeVisibleRegions() worked from, the visible
+ * region it came up with, and how each display composed the layer. Frames
+ * are built into a scratch frame that is swapped into the ring, so that
+ * once the ring is full capturing allocates nothing.
+ *
+ * Frames are built on the main thread only; setCapacity(), dump() and
+ * exportTo() may be called from any thread.
+ */
+class LayerCapture {
+public:
+    // Binary export, in host byte order: a Header, and then Header::count
+    // frames, oldest first. Each frame is a FrameRecord followed by its
+    // DisplayRecords and its LayerRecords, bottom-most layer first.
+    enum { MAGIC = 0x434c4653 }; // "SFLC"
+    enum { VERSION = 1 };
+    enum { MAX_DISPLAYS = 4 };
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t frameSize;
+        uint32_t displaySize;
+        uint32_t layerSize;
+        uint32_t count;
+    };
+
+    struct FrameRecord {
+        nsecs_t time;
+        uint32_t numDisplays;
+        uint32_t numLayers;
+    };
+
+    enum {
+        DISPLAY_ON = 0x1,
+        DISPLAY_SECURE = 0x2
+    };
+
+    struct DisplayRecord {
+        uint32_t layerStack;
+        int32_t width;
+        int32_t height;
+        uint32_t flags;
+    };
+
+    enum {
+        LAYER_VISIBLE = 0x1,
+        LAYER_TRANSLUCENT = 0x2,
+        // the layer's footprint is opaque: fully opaque alpha, not
+        // translucent, and a transform that keeps rectangles
+        LAYER_OPAQUE = 0x4,
+        LAYER_SECURE = 0x8
+    };
+
+    // how a display composed a layer, in LayerRecord::composition
+    enum {
+        COMPOSITION_NONE = 0, // not visible on the display
+        COMPOSITION_CLIENT,
+        COMPOSITION_DEVICE,
+        COMPOSITION_SOLID_COLOR,
+        COMPOSITION_CURSOR,
+        COMPOSITION_SIDEBAND,
+        COMPOSITION_OTHER
+    };
+
+    struct LayerRecord {
+        uint64_t bufferId;
+        uint64_t frameNumber;
+        // the active transform, column by column
+        float transform[9];
+        uint32_t z;
+        uint32_t layerStack;
+        float alpha;
+        uint32_t flags;
+        uint32_t width;
+        uint32_t height;
+        // rects are left, top, right, bottom
+        int32_t crop[4];
+        int32_t finalCrop[4];
+        // the transformed bounds computeVisibleRegions() starts from
+        int32_t bounds[4];
+        // and the bounds and rect count of the visible region it found
+        int32_t visibleBounds[4];
+        uint32_t visibleRects;
+        // per display, in the order of the frame's DisplayRecords
+        uint8_t composition[MAX_DISPLAYS];
+    };
+
+    LayerCapture();
+
+    // Keeps the last capacity frames; 0 frees them and stops capturing.
+    void setCapacity(size_t capacity);
+    bool isEnabled() const { return mEnabled; }
+
+    // Builds a frame; endFrame() adds it to the ring.
+    void beginFrame(nsecs_t time);
+    void addDisplay(uint32_t layerStack, int32_t width, int32_t height,
+            uint32_t flags);
+    void addLayer(const Layer& layer);
+    // the display and layer indices are the order they were added in
+    void setComposition(size_t layer, size_t display, uint8_t composition);
+    void endFrame();
+
+    // Appends a line with the number of frames kept.
+    void dump(String8& result) const;
+
+    // Appends the binary export described above.
+    void exportTo(String8& result) const;
+
+private:
+    struct Frame {
+        FrameRecord record;
+        std::vector<DisplayRecord> displays;
+        std::vector<LayerRecord> layers;
+    };
+
+    // owned by the main thread
+    Frame mBuilding;
+
+    // whether mCapacity is non-zero, read without the lock
+    std::atomic<bool> mEnabled;
+
+    mutable Mutex mLock;
+    size_t mCapacity;
+    std::vector<Frame> mFrames;
+    // where the next frame goes once the ring is full
+    size_t mNext;
+    uint64_t mNumFrames;
+};
+
+}; // namespace android
+
+#endif // ANDROID_SF_LAYERCAPTURE_H
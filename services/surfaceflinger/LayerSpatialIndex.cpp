@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+
+#include "LayerSpatialIndex.h"
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+LayerSpatialIndex::LayerSpatialIndex()
+    : mExtent(Rect::EMPTY_RECT)
+{
+}
+
+void LayerSpatialIndex::clear() {
+    mBounds.clear();
+    mOversized.clear();
+    mExtent = Rect::EMPTY_RECT;
+    for (auto& cell : mCells) {
+        cell.second.clear();
+    }
+}
+
+void LayerSpatialIndex::insert(const Rect& bounds) {
+    if (bounds.isEmpty()) {
+        return;
+    }
+    const size_t index = mBounds.add(bounds);
+
+    const int32_t left = cellOf(bounds.left);
+    const int32_t top = cellOf(bounds.top);
+    const int32_t right = cellOf(bounds.right - 1);
+    const int32_t bottom = cellOf(bounds.bottom - 1);
+    if (int64_t(right - left + 1) * (bottom - top + 1) > MAX_CELLS) {
+        mOversized.add(index);
+        return;
+    }
+    for (int32_t cy = top; cy <= bottom; cy++) {
+        for (int32_t cx = left; cx <= right; cx++) {
+            mCells[keyOf(cx, cy)].push_back(index);
+        }
+    }
+    if (mExtent.isEmpty()) {
+        mExtent = bounds;
+    } else {
+        mExtent.left = std::min(mExtent.left, bounds.left);
+        mExtent.top = std::min(mExtent.top, bounds.top);
+        mExtent.right = std::max(mExtent.right, bounds.right);
+        mExtent.bottom = std::max(mExtent.bottom, bounds.bottom);
+    }
+}
+
+bool LayerSpatialIndex::intersects(const Rect& r) const {
+    if (r.isEmpty()) {
+        return false;
+    }
+    for (size_t i = 0; i < mOversized.size(); i++) {
+        if (overlaps(mBounds[mOversized[i]], r)) {
+            return true;
+        }
+    }
+    Rect area;
+    if (!r.intersect(mExtent, &area)) {
+        return false;
+    }
+    const int32_t left = cellOf(area.left);
+    const int32_t top = cellOf(area.top);
+    const int32_t right = cellOf(area.right - 1);
+    const int32_t bottom = cellOf(area.bottom - 1);
+    for (int32_t cy = top; cy <= bottom; cy++) {
+        for (int32_t cx = left; cx <= right; cx++) {
+            auto cell = mCells.find(keyOf(cx, cy));
+            if (cell == mCells.end()) {
+                continue;
+            }
+            for (size_t index : cell->second) {
+                if (overlaps(mBounds[index], area)) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+// ---------------------------------------------------------------------------
+
+}; // namespace android
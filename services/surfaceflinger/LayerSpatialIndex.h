@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_LAYERSPATIALINDEX_H
+#define ANDROID_LAYERSPATIALINDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ui/Rect.h>
+#include <utils/Vector.h>
+
+#include <unordered_map>
+#include <vector>
+
+namespace android {
+
+/*
+ * A set of layer bounds that answers "does anything overlap this rect"
+ * without looking at every layer.
+ *
+ * Bounds are binned into a sparse grid of CELL_SIZE squares. Layers that
+ * would take up more than MAX_CELLS cells (the wallpaper, full-screen
+ * apps) are few and are kept in a separate list that is always scanned,
+ * so that inserting them stays cheap. Cells are kept across clear() so
+ * that rebuilding the index every pass does not allocate.
+ */
+class LayerSpatialIndex {
+public:
+    LayerSpatialIndex();
+
+    void clear();
+
+    // Adds the bounds of a layer; empty bounds are ignored.
+    void insert(const Rect& bounds);
+
+    // Returns true if any inserted bounds overlap r.
+    bool intersects(const Rect& r) const;
+
+    size_t size() const { return mBounds.size(); }
+
+private:
+    enum {
+        CELL_SHIFT = 8,
+        CELL_SIZE = 1 << CELL_SHIFT,
+        MAX_CELLS = 16
+    };
+
+    static int32_t cellOf(int32_t coord) { return coord >> CELL_SHIFT; }
+    static uint64_t keyOf(int32_t cx, int32_t cy) {
+        return (uint64_t(uint32_t(cx)) << 32) | uint32_t(cy);
+    }
+
+    static bool overlaps(const Rect& a, const Rect& b) {
+        return a.left < b.right && b.left < a.right &&
+                a.top < b.bottom && b.top < a.bottom;
+    }
+
+    Vector<Rect> mBounds;
+    Vector<size_t> mOversized;
+    // the union of the bounds in mCells, which limits the cells a query
+    // has to visit
+    Rect mExtent;
+    std::unordered_map<uint64_t, std::vector<size_t>> mCells;
+};
+
+}; // namespace android
+
+#endif // ANDROID_LAYERSPATIALINDEX_H
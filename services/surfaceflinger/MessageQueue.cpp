@@ -49,22 +49,30 @@ void MessageBase::handleMessage(const Message&) {
 
 // ---------------------------------------------------------------------------
 
+// Composition messages are sent for time 0, which puts them ahead of every
+// other message the Looper has queued.
+
 void MessageQueue::Handler::dispatchRefresh() {
     if ((android_atomic_or(eventMaskRefresh, &mEventMask) & eventMaskRefresh) == 0) {
-        mQueue.mLooper->sendMessage(this, Message(MessageQueue::REFRESH));
+        mQueue.mLooper->sendMessageAtTime(0, this, Message(MessageQueue::REFRESH));
     }
 }
 
 void MessageQueue::Handler::dispatchInvalidate() {
     if ((android_atomic_or(eventMaskInvalidate, &mEventMask) & eventMaskInvalidate) == 0) {
-        mQueue.mLooper->sendMessage(this, Message(MessageQueue::INVALIDATE));
+        mQueue.mLooper->sendMessageAtTime(0, this, Message(MessageQueue::INVALIDATE));
     }
 }
 
+bool MessageQueue::Handler::isRefreshPending() const {
+    return (android_atomic_acquire_load(&mEventMask) & eventMaskRefresh) != 0;
+}
+
 void MessageQueue::Handler::handleMessage(const Message& message) {
     switch (message.what) {
         case INVALIDATE:
             android_atomic_and(~eventMaskInvalidate, &mEventMask);
+            mQueue.beginFrame();
             mQueue.mFlinger->onMessageReceived(message.what);
             break;
         case REFRESH:
@@ -72,11 +80,17 @@ void MessageQueue::Handler::handleMessage(const Message& message) {
             mQueue.mFlinger->onMessageReceived(message.what);
             break;
     }
+    // the frame is done unless it goes on with a REFRESH
+    if (!isRefreshPending()) {
+        mQueue.endFrame();
+    }
 }
 
 // ---------------------------------------------------------------------------
 
 MessageQueue::MessageQueue()
+    : mFramePending(false),
+      mInFrame(false)
 {
 }
 
@@ -102,7 +116,7 @@ void MessageQueue::setEventThread(const sp<EventThread>& eventThread)
 void MessageQueue::waitMessage() {
     do {
         IPCThreadState::self()->flushCommands();
-        int32_t ret = mLooper->pollOnce(-1);
+        int32_t ret = mLooper->pollOnce(releaseExpiredIdleMessages());
         switch (ret) {
             case Looper::POLL_WAKE:
             case Looper::POLL_CALLBACK:
@@ -111,7 +125,7 @@ void MessageQueue::waitMessage() {
                 ALOGE("Looper::POLL_ERROR");
                 continue;
             case Looper::POLL_TIMEOUT:
-                // timeout (should not happen)
+                // an idle message is due
                 continue;
             default:
                 // should not happen
@@ -122,19 +136,70 @@ void MessageQueue::waitMessage() {
 }
 
 status_t MessageQueue::postMessage(
-        const sp<MessageBase>& messageHandler, nsecs_t relTime)
+        const sp<MessageBase>& messageHandler, nsecs_t relTime, uint32_t flags)
 {
     const Message dummyMessage;
     if (relTime > 0) {
         mLooper->sendMessageDelayed(relTime, messageHandler, dummyMessage);
-    } else {
-        mLooper->sendMessage(messageHandler, dummyMessage);
+        return NO_ERROR;
+    }
+    if (flags & FLAG_IDLE) {
+        Mutex::Autolock _l(mIdleLock);
+        if (mFramePending || mInFrame) {
+            IdleMessage idle;
+            idle.message = messageHandler;
+            idle.deadline = systemTime(SYSTEM_TIME_MONOTONIC) + MAX_IDLE_DELAY;
+            mIdleMessages.add(idle);
+            if (mIdleMessages.size() == 1) {
+                // the main thread has to wait for the deadline
+                mLooper->wake();
+            }
+            return NO_ERROR;
+        }
     }
+    mLooper->sendMessage(messageHandler, dummyMessage);
     return NO_ERROR;
 }
 
+void MessageQueue::beginFrame() {
+    Mutex::Autolock _l(mIdleLock);
+    mFramePending = false;
+    mInFrame = true;
+}
+
+void MessageQueue::endFrame() {
+    Mutex::Autolock _l(mIdleLock);
+    mInFrame = false;
+    const Message dummyMessage;
+    for (size_t i = 0; i < mIdleMessages.size(); i++) {
+        mLooper->sendMessage(mIdleMessages[i].message, dummyMessage);
+    }
+    mIdleMessages.clear();
+}
+
+int MessageQueue::releaseExpiredIdleMessages() {
+    Mutex::Autolock _l(mIdleLock);
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    const Message dummyMessage;
+    size_t expired = 0;
+    while (expired < mIdleMessages.size() &&
+            mIdleMessages[expired].deadline <= now) {
+        mLooper->sendMessage(mIdleMessages[expired].message, dummyMessage);
+        expired++;
+    }
+    mIdleMessages.removeItemsAt(0, expired);
+    if (mIdleMessages.isEmpty()) {
+        return -1;
+    }
+    return toMillisecondTimeoutDelay(now, mIdleMessages[0].deadline);
+}
+
 
 void MessageQueue::invalidate() {
+    {
+        Mutex::Autolock _l(mIdleLock);
+        mFramePending = true;
+    }
     mEvents->requestNextVsync();
 }
 
@@ -24,6 +24,7 @@
 #include <utils/threads.h>
 #include <utils/Timers.h>
 #include <utils/Looper.h>
+#include <utils/Vector.h>
 
 #include <gui/DisplayEventReceiver.h>
 
@@ -73,6 +74,14 @@ class MessageQueue {
         virtual void handleMessage(const Message& message);
         void dispatchRefresh();
         void dispatchInvalidate();
+    private:
+        bool isRefreshPending() const;
+    };
+
+    // A message waiting for the frame to be done
+    struct IdleMessage {
+        sp<MessageBase> message;
+        nsecs_t deadline;
     };
 
     friend class Handler;
@@ -84,23 +93,50 @@ class MessageQueue {
     sp<BitTube> mEventTube;
     sp<Handler> mHandler;
 
+    // protected by mIdleLock
+    Mutex mIdleLock;
+    // a vsync was asked for and its INVALIDATE not handled yet
+    bool mFramePending;
+    // an INVALIDATE or REFRESH is being handled, or the REFRESH it asked
+    // for is queued
+    bool mInFrame;
+    // in the order they were posted, which is also the order of deadlines
+    Vector<IdleMessage> mIdleMessages;
+
 
     static int cb_eventReceiver(int fd, int events, void* data);
     int eventReceiver(int fd, int events);
 
+    void beginFrame();
+    void endFrame();
+    // posts the idle messages past their deadline, returns the timeout until
+    // the next deadline in milliseconds for Looper::pollOnce()
+    int releaseExpiredIdleMessages();
+
 public:
     enum {
         INVALIDATE  = 0,
         REFRESH     = 1,
     };
 
+    // flags for postMessage()
+    enum {
+        // Maintenance work: if a frame is being composed or waited for,
+        // the message runs once the frame is done, or after MAX_IDLE_DELAY
+        // if the frame takes longer than that. Delayed messages ignore it.
+        FLAG_IDLE   = 0x1,
+    };
+
+    static const nsecs_t MAX_IDLE_DELAY = 100000000; // 100ms
+
     MessageQueue();
     ~MessageQueue();
     void init(const sp<SurfaceFlinger>& flinger);
     void setEventThread(const sp<EventThread>& events);
 
     void waitMessage();
-    status_t postMessage(const sp<MessageBase>& message, nsecs_t reltime=0);
+    status_t postMessage(const sp<MessageBase>& message, nsecs_t reltime=0,
+            uint32_t flags=0);
 
     // sends INVALIDATE message at next VSYNC
     void invalidate();
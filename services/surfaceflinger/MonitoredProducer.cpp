@@ -49,7 +49,8 @@ MonitoredProducer::~MonitoredProducer() {
         wp<IBinder> mProducer;
     };
 
-    mFlinger->postMessageAsync(new MessageCleanUpList(mFlinger, asBinder(this)));
+    mFlinger->postMessageAsync(new MessageCleanUpList(mFlinger, asBinder(this)),
+            0, MessageQueue::FLAG_IDLE);
 }
 
 status_t MonitoredProducer::requestBuffer(int slot, sp<GraphicBuffer>* buf) {
@@ -89,6 +90,15 @@ status_t MonitoredProducer::queueBuffer(int slot, const QueueBufferInput& input,
     return mProducer->queueBuffer(slot, input, output);
 }
 
+status_t MonitoredProducer::queueAndDequeueBuffer(int slot,
+        const QueueBufferInput& input, QueueBufferOutput* output, uint32_t w,
+        uint32_t h, PixelFormat format, uint32_t usage, int* outSlot,
+        sp<Fence>* outFence, sp<GraphicBuffer>* outBuffer,
+        status_t* outDequeueResult) {
+    return mProducer->queueAndDequeueBuffer(slot, input, output, w, h, format,
+            usage, outSlot, outFence, outBuffer, outDequeueResult);
+}
+
 status_t MonitoredProducer::cancelBuffer(int slot, const sp<Fence>& fence) {
     return mProducer->cancelBuffer(slot, fence);
 }
@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include <inttypes.h>
+
+#include <ui/Fence.h>
+
+#include <utils/String8.h>
+#include <utils/Trace.h>
+
+#include "PhaseOffsetController.h"
+
+namespace android {
+
+PhaseOffsetController::PhaseOffsetController(nsecs_t appOffset,
+        nsecs_t sfOffset) :
+    mDefaultAppOffset(appOffset),
+    mDefaultSfOffset(sfOffset),
+    mAppOffset(appOffset),
+    mSfOffset(sfOffset),
+    mEstimate(0),
+    mFrames(0),
+    mFramesSinceChange(0),
+    mHoldFrames(0),
+    mPendingWakeupTime(0),
+    mPendingCpuDoneTime(0),
+    mChanges(0),
+    mMissedFrames(0)
+{
+}
+
+nsecs_t PhaseOffsetController::normalize(nsecs_t offset, nsecs_t period) {
+    // same as DispSyncSource::setPhaseOffset()
+    offset %= period;
+    if (offset < 0) {
+        offset += period;
+    }
+    return offset;
+}
+
+void PhaseOffsetController::addFrame(nsecs_t wakeupTime, nsecs_t cpuDoneTime,
+        const sp<Fence>& gpuDoneFence, nsecs_t period) {
+    if (mPendingGpuDoneFence != NULL || mPendingCpuDoneTime != 0) {
+        nsecs_t doneTime = mPendingCpuDoneTime;
+        if (mPendingGpuDoneFence != NULL && mPendingGpuDoneFence->isValid()) {
+            nsecs_t gpuDoneTime = mPendingGpuDoneFence->getSignalTime();
+            if (gpuDoneTime == INT64_MAX || gpuDoneTime < 0) {
+                // still not done a frame later, which is at least as bad as
+                // being done now
+                gpuDoneTime = systemTime();
+            }
+            if (gpuDoneTime > doneTime) {
+                doneTime = gpuDoneTime;
+            }
+        }
+        addDuration(doneTime - mPendingWakeupTime, period);
+    }
+    mPendingWakeupTime = wakeupTime;
+    mPendingCpuDoneTime = cpuDoneTime;
+    mPendingGpuDoneFence = gpuDoneFence;
+}
+
+void PhaseOffsetController::addDuration(nsecs_t duration, nsecs_t period) {
+    if (duration < 0) {
+        return;
+    }
+    if (duration > mEstimate) {
+        mEstimate = duration;
+    } else {
+        mEstimate -= (mEstimate - duration) / RELEASE;
+    }
+    ATRACE_INT64("CompositionEstimate", mEstimate);
+    mFrames++;
+    mFramesSinceChange++;
+    if (mHoldFrames > 0) {
+        mHoldFrames--;
+    }
+
+    // composition that ran into the next vsync missed it
+    if (duration > period - normalize(mSfOffset, period)) {
+        onFrameMissed();
+    }
+}
+
+void PhaseOffsetController::reset() {
+    mEstimate = 0;
+    mFrames = 0;
+    mPendingWakeupTime = 0;
+    mPendingCpuDoneTime = 0;
+    mPendingGpuDoneFence.clear();
+}
+
+void PhaseOffsetController::onFrameMissed() {
+    mMissedFrames++;
+    mHoldFrames = FRAMES_AFTER_MISS;
+}
+
+bool PhaseOffsetController::updateOffsets(nsecs_t period,
+        nsecs_t* outAppOffset, nsecs_t* outSfOffset) {
+    if (period <= 0 || mFrames < MIN_FRAMES) {
+        return false;
+    }
+
+    const nsecs_t defaultSfOffset = normalize(mDefaultSfOffset, period);
+    nsecs_t target = defaultSfOffset;
+    if (mHoldFrames == 0) {
+        target = period - mEstimate - MARGIN;
+        if (target > period - MIN_BUDGET) {
+            target = period - MIN_BUDGET;
+        }
+        if (target < defaultSfOffset) {
+            target = defaultSfOffset;
+        }
+    }
+
+    const nsecs_t current = normalize(mSfOffset, period);
+    if (target == current) {
+        return false;
+    }
+    // Waking up earlier is what keeps frames from being missed, so it is
+    // done at once; waking up later has to be worth the listener churn.
+    if (target > current && (target - current < HYSTERESIS ||
+            mFramesSinceChange < FRAMES_BETWEEN_CHANGES)) {
+        return false;
+    }
+
+    // the app keeps the lead it was configured with over SurfaceFlinger
+    mSfOffset = target;
+    mAppOffset = mDefaultAppOffset + (target - defaultSfOffset);
+    mFramesSinceChange = 0;
+    mChanges++;
+
+    *outAppOffset = mAppOffset;
+    *outSfOffset = mSfOffset;
+    return true;
+}
+
+void PhaseOffsetController::dump(String8& result) const {
+    result.appendFormat("adaptive phase offsets: app %" PRId64 " ns, "
+            "sf %" PRId64 " ns, composition estimate %" PRId64 " ns, "
+            "%" PRIu64 " changes, %" PRIu64 " missed frames%s\n",
+            mAppOffset, mSfOffset, mEstimate, mChanges, mMissedFrames,
+            mHoldFrames > 0 ? " (holding)" : "");
+}
+
+} // namespace android
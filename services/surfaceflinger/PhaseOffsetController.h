@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_PHASEOFFSETCONTROLLER_H
+#define ANDROID_PHASEOFFSETCONTROLLER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <utils/RefBase.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+class Fence;
+class String8;
+
+// PhaseOffsetController moves the SurfaceFlinger and app vsync phase offsets
+// to follow how long composition actually takes. SurfaceFlinger has to be
+// done by the next hardware vsync, so when composition is cheap it can wake
+// up later, and the app with it, which takes that much off the latency from
+// the app's frame to the display. As soon as composition gets slower, or a
+// frame is missed, the offsets move back towards the configured ones, which
+// are never improved upon in the other direction.
+//
+// Composition times are tracked with a fast-attack, slow-release estimate:
+// a slower frame raises it at once, faster frames lower it a little at a
+// time. Like FrameTracker, this is *NOT* thread-safe.
+class PhaseOffsetController {
+public:
+    PhaseOffsetController(nsecs_t appOffset, nsecs_t sfOffset);
+
+    // addFrame reports a composition that started when SurfaceFlinger woke
+    // up at wakeupTime and was done on the CPU at cpuDoneTime. If any of it
+    // was done by the GPU, gpuDoneFence signals when that finished; it may
+    // still be pending and is looked at when the next frame is added.
+    void addFrame(nsecs_t wakeupTime, nsecs_t cpuDoneTime,
+            const sp<Fence>& gpuDoneFence, nsecs_t period);
+
+    // reset forgets the frames added so far, for when composition stopped
+    // for a while; the offsets are kept.
+    void reset();
+
+    // onFrameMissed reports that a frame did not make it to the display in
+    // time.
+    void onFrameMissed();
+
+    // updateOffsets returns true and sets the new offsets if they should be
+    // changed.
+    bool updateOffsets(nsecs_t period, nsecs_t* outAppOffset,
+            nsecs_t* outSfOffset);
+
+    nsecs_t getAppOffset() const { return mAppOffset; }
+    nsecs_t getSfOffset() const { return mSfOffset; }
+
+    void dump(String8& result) const;
+
+private:
+    // margin kept between the composition estimate and the next vsync
+    static const nsecs_t MARGIN = 1500000;
+    // the least time SurfaceFlinger is ever left before the next vsync
+    static const nsecs_t MIN_BUDGET = 4000000;
+    // offsets are only moved later once the target is this far away...
+    static const nsecs_t HYSTERESIS = 500000;
+    // ...and this many frames have gone by since the last change
+    enum { FRAMES_BETWEEN_CHANGES = 60 };
+    // frames composed before the estimate is trusted
+    enum { MIN_FRAMES = 30 };
+    // frames the configured offsets are kept after a missed frame
+    enum { FRAMES_AFTER_MISS = 600 };
+    // the estimate falls by 1/RELEASE of the difference per faster frame
+    enum { RELEASE = 16 };
+
+    static nsecs_t normalize(nsecs_t offset, nsecs_t period);
+
+    void addDuration(nsecs_t duration, nsecs_t period);
+
+    const nsecs_t mDefaultAppOffset;
+    const nsecs_t mDefaultSfOffset;
+    nsecs_t mAppOffset;
+    nsecs_t mSfOffset;
+
+    nsecs_t mEstimate;
+    size_t mFrames;
+    size_t mFramesSinceChange;
+    size_t mHoldFrames;
+
+    // the last frame, until its GPU work is known to be done
+    nsecs_t mPendingWakeupTime;
+    nsecs_t mPendingCpuDoneTime;
+    sp<Fence> mPendingGpuDoneFence;
+
+    uint64_t mChanges;
+    uint64_t mMissedFrames;
+};
+
+}
+
+#endif // ANDROID_PHASEOFFSETCONTROLLER_H
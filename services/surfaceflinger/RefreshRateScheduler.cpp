@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+
+#include <algorithm>
+
+#include <utils/String8.h>
+
+#include "RefreshRateScheduler.h"
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+ContentCadence::ContentCadence() :
+    mTimestamps(),
+    mNext(0),
+    mCount(0),
+    mLastQueueTime(0),
+    mIsAutoTimestamp(true)
+{
+}
+
+void ContentCadence::addFrame(nsecs_t timestamp, bool isAutoTimestamp,
+        nsecs_t now) {
+    // a long pause or timestamps going backwards start a new cadence
+    if (now - mLastQueueTime > IDLE_TIMEOUT || (mCount > 0 &&
+            timestamp <= mTimestamps[(mNext + NUM_FRAMES - 1) % NUM_FRAMES])) {
+        mCount = 0;
+    }
+    mTimestamps[mNext] = timestamp;
+    mNext = (mNext + 1) % NUM_FRAMES;
+    if (mCount < NUM_FRAMES) {
+        mCount++;
+    }
+    mLastQueueTime = now;
+    mIsAutoTimestamp = isAutoTimestamp;
+}
+
+nsecs_t ContentCadence::getFramePeriod(nsecs_t now,
+        bool* outIsAutoTimestamp) const {
+    *outIsAutoTimestamp = mIsAutoTimestamp;
+    if (mCount == 0 || now - mLastQueueTime > IDLE_TIMEOUT) {
+        return 0;
+    }
+    if (mCount < MIN_FRAMES) {
+        return -1;
+    }
+
+    nsecs_t intervals[NUM_FRAMES - 1];
+    const size_t count = mCount - 1;
+    const size_t first = (mNext + NUM_FRAMES - mCount) % NUM_FRAMES;
+    for (size_t i = 0; i < count; i++) {
+        intervals[i] = mTimestamps[(first + i + 1) % NUM_FRAMES] -
+                mTimestamps[(first + i) % NUM_FRAMES];
+    }
+    std::nth_element(intervals, intervals + count / 2, intervals + count);
+    return intervals[count / 2];
+}
+
+// ---------------------------------------------------------------------------
+
+RefreshRateScheduler::RefreshRateScheduler() :
+    mPreferredConfig(-1),
+    mNeedsPreferred(false),
+    mCandidateConfig(-1),
+    mCandidateSince(0),
+    mLastReason(REASON_PREFERRED),
+    mNextDecision(0),
+    mSwitches(0)
+{
+}
+
+const char* RefreshRateScheduler::reasonName(Reason reason) {
+    switch (reason) {
+        case REASON_PREFERRED: return "preferred";
+        case REASON_IDLE: return "idle";
+        case REASON_CONTENT: return "content";
+        case REASON_NO_MATCH: return "no match";
+    }
+    return "?";
+}
+
+bool RefreshRateScheduler::fits(nsecs_t refreshPeriod, nsecs_t framePeriod) {
+    // each frame has to stay up for a whole number of refreshes, give or
+    // take a tenth of one
+    const nsecs_t refreshes = (framePeriod + refreshPeriod / 2) / refreshPeriod;
+    if (refreshes < 1) {
+        return false;
+    }
+    const nsecs_t error = framePeriod - refreshes * refreshPeriod;
+    return error < refreshPeriod / 10 && -error < refreshPeriod / 10;
+}
+
+void RefreshRateScheduler::beginDecision() {
+    mNeedsPreferred = false;
+    mFramePeriods.clear();
+}
+
+void RefreshRateScheduler::addLayer(nsecs_t framePeriod,
+        bool isAutoTimestamp) {
+    if (framePeriod == 0) {
+        // static
+        return;
+    }
+    if (framePeriod < 0 || isAutoTimestamp) {
+        mNeedsPreferred = true;
+        return;
+    }
+    mFramePeriods.push_back(framePeriod);
+}
+
+int32_t RefreshRateScheduler::chooseConfig(nsecs_t now,
+        const std::vector<nsecs_t>& periods, int32_t currentConfig) {
+    if (mPreferredConfig < 0 ||
+            mPreferredConfig >= static_cast<int32_t>(periods.size()) ||
+            currentConfig < 0 ||
+            currentConfig >= static_cast<int32_t>(periods.size())) {
+        return -1;
+    }
+
+    int32_t target = mPreferredConfig;
+    Reason reason = REASON_PREFERRED;
+    if (!mNeedsPreferred) {
+        reason = mFramePeriods.empty() ? REASON_IDLE : REASON_NO_MATCH;
+        // the slowest config that fits every layer
+        nsecs_t targetPeriod = 0;
+        for (size_t i = 0; i < periods.size(); i++) {
+            if (periods[i] <= targetPeriod) {
+                continue;
+            }
+            bool allFit = true;
+            for (size_t j = 0; j < mFramePeriods.size() && allFit; j++) {
+                allFit = fits(periods[i], mFramePeriods[j]);
+            }
+            if (allFit) {
+                target = static_cast<int32_t>(i);
+                targetPeriod = periods[i];
+                if (!mFramePeriods.empty()) {
+                    reason = REASON_CONTENT;
+                }
+            }
+        }
+    }
+    mLastReason = reason;
+
+    if (target == currentConfig) {
+        mCandidateConfig = -1;
+        return -1;
+    }
+
+    // only make the display slower once that has been asked for a while
+    if (periods[currentConfig] != 0 &&
+            periods[target] > periods[currentConfig]) {
+        if (target != mCandidateConfig) {
+            mCandidateConfig = target;
+            mCandidateSince = now;
+            return -1;
+        }
+        if (now - mCandidateSince < HOLD_TIME) {
+            return -1;
+        }
+    }
+    mCandidateConfig = -1;
+
+    Decision& decision(mDecisions[mNextDecision]);
+    decision.when = now;
+    decision.from = currentConfig;
+    decision.to = target;
+    decision.reason = reason;
+    decision.framePeriod = mFramePeriods.empty() ? 0 :
+            *std::min_element(mFramePeriods.begin(), mFramePeriods.end());
+    mNextDecision = (mNextDecision + 1) % NUM_DECISIONS;
+    mSwitches++;
+    return target;
+}
+
+void RefreshRateScheduler::dump(String8& result) const {
+    result.appendFormat("refresh rate scheduler: preferred config %d, "
+            "%" PRIu64 " switches, last reason %s%s\n", mPreferredConfig,
+            mSwitches, reasonName(mLastReason),
+            hasPendingChange() ? ", slowing down" : "");
+    for (size_t i = 0; i < NUM_DECISIONS; i++) {
+        const Decision& decision(
+                mDecisions[(mNextDecision + i) % NUM_DECISIONS]);
+        if (decision.when == 0) {
+            continue;
+        }
+        result.appendFormat("  %" PRId64 ": config %d -> %d (%s",
+                decision.when, decision.from, decision.to,
+                reasonName(decision.reason));
+        if (decision.framePeriod > 0) {
+            result.appendFormat(", content %.2f fps",
+                    1e9 / decision.framePeriod);
+        }
+        result.append(")\n");
+    }
+}
+
+// ---------------------------------------------------------------------------
+
+}; // namespace android
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_REFRESHRATESCHEDULER_H
+#define ANDROID_REFRESHRATESCHEDULER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <utils/Timers.h>
+
+#include <vector>
+
+namespace android {
+
+class String8;
+
+// ContentCadence keeps the timestamps of the last few buffers queued to a
+// layer, to tell how often its content changes. It is *NOT* thread-safe;
+// Layer guards it with its queue item lock.
+class ContentCadence {
+public:
+    // a layer that queued nothing for this long is static
+    static const nsecs_t IDLE_TIMEOUT = 1000000000;
+
+    ContentCadence();
+
+    void addFrame(nsecs_t timestamp, bool isAutoTimestamp, nsecs_t now);
+
+    // getFramePeriod returns the median interval between the recent
+    // frames, 0 if the layer is static, or -1 if there are too few frames
+    // to tell. outIsAutoTimestamp is set if the producer left the
+    // timestamps to BufferQueue, which then only say when the frames were
+    // queued rather than when they are meant to be shown.
+    nsecs_t getFramePeriod(nsecs_t now, bool* outIsAutoTimestamp) const;
+
+private:
+    enum { NUM_FRAMES = 8 };
+    enum { MIN_FRAMES = 3 };
+
+    nsecs_t mTimestamps[NUM_FRAMES];
+    size_t mNext;
+    size_t mCount;
+    nsecs_t mLastQueueTime;
+    bool mIsAutoTimestamp;
+};
+
+// RefreshRateScheduler picks the slowest display config that still shows
+// every visible layer at its own rate. Video, whose buffers carry
+// presentation timestamps, only needs a refresh rate that is a multiple of
+// its frame rate; static layers need nothing; anything else, such as UI
+// that renders as fast as it is let, needs the config the framework chose.
+// Faster configs are switched to at once; slower ones only once they have
+// been asked for for HOLD_TIME in a row.
+class RefreshRateScheduler {
+public:
+    // how long a slower config has to be asked for before switching to it
+    static const nsecs_t HOLD_TIME = 1000000000;
+
+    RefreshRateScheduler();
+
+    // setPreferredConfig records the config the framework chose, which is
+    // used whenever content needs it and is never made any faster.
+    void setPreferredConfig(int32_t config) { mPreferredConfig = config; }
+    int32_t getPreferredConfig() const { return mPreferredConfig; }
+
+    // beginDecision starts gathering the layers for a decision.
+    void beginDecision();
+    // addLayer takes the result of ContentCadence::getFramePeriod() for
+    // one visible layer.
+    void addLayer(nsecs_t framePeriod, bool isAutoTimestamp);
+    // chooseConfig returns the config to switch to, or -1 to stay with
+    // currentConfig. periods holds the vsync period of every config, or 0
+    // for those that may not be used.
+    int32_t chooseConfig(nsecs_t now, const std::vector<nsecs_t>& periods,
+            int32_t currentConfig);
+
+    // hasPendingChange returns true while a slower config is being held
+    // back, so that there is a reason to check again.
+    bool hasPendingChange() const { return mCandidateConfig >= 0; }
+
+    void dump(String8& result) const;
+
+private:
+    enum Reason {
+        REASON_PREFERRED,
+        REASON_IDLE,
+        REASON_CONTENT,
+        REASON_NO_MATCH,
+    };
+
+    static const char* reasonName(Reason reason);
+
+    // whether a refresh period shows content of the given frame period
+    // without judder
+    static bool fits(nsecs_t refreshPeriod, nsecs_t framePeriod);
+
+    enum { NUM_DECISIONS = 16 };
+    struct Decision {
+        Decision() : when(0), from(-1), to(-1), reason(REASON_PREFERRED),
+                framePeriod(0) {}
+        nsecs_t when;
+        int32_t from;
+        int32_t to;
+        Reason reason;
+        nsecs_t framePeriod;
+    };
+
+    int32_t mPreferredConfig;
+
+    // the layers gathered for the current decision
+    bool mNeedsPreferred;
+    std::vector<nsecs_t> mFramePeriods;
+
+    int32_t mCandidateConfig;
+    nsecs_t mCandidateSince;
+
+    Reason mLastReason;
+    Decision mDecisions[NUM_DECISIONS];
+    size_t mNextDecision;
+    uint64_t mSwitches;
+};
+
+}
+
+#endif // ANDROID_REFRESHRATESCHEDULER_H
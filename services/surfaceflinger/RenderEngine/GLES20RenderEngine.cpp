@@ -44,7 +44,8 @@ namespace android {
 // ---------------------------------------------------------------------------
 
 GLES20RenderEngine::GLES20RenderEngine() :
-        mVpWidth(0), mVpHeight(0), mProjectionRotation(Transform::ROT_0) {
+        mVpWidth(0), mVpHeight(0), mProjectionRotation(Transform::ROT_0),
+        mBlendState(BLEND_UNKNOWN), mBlendSrcFactor(GL_ONE) {
 
     glGetIntegerv(GL_MAX_TEXTURE_SIZE, &mMaxTextureSize);
     glGetIntegerv(GL_MAX_VIEWPORT_DIMS, mMaxViewportDims);
@@ -68,6 +69,13 @@ GLES20RenderEngine::GLES20RenderEngine() :
 GLES20RenderEngine::~GLES20RenderEngine() {
 }
 
+void GLES20RenderEngine::setupSharedContext() {
+    // what the constructor and the first Program set up in the main context
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glEnableVertexAttribArray(Program::position);
+}
+
 
 size_t GLES20RenderEngine::getMaxTextureSize() const {
     return mMaxTextureSize;
@@ -128,6 +136,25 @@ void GLES20RenderEngine::setViewportAndProjection(
     mProjectionSourceCrop = sourceCrop;
     mProjectionYSwap = yswap;
     mProjectionRotation = rotation;
+    mBlendState = BLEND_UNKNOWN;
+}
+
+void GLES20RenderEngine::setBlending(bool enabled, GLenum srcFactor) {
+    if (!enabled) {
+        if (mBlendState != BLEND_DISABLED) {
+            glDisable(GL_BLEND);
+            mBlendState = BLEND_DISABLED;
+        }
+        return;
+    }
+    if (mBlendState != BLEND_ENABLED) {
+        glEnable(GL_BLEND);
+        mBlendState = BLEND_ENABLED;
+    } else if (mBlendSrcFactor == srcFactor) {
+        return;
+    }
+    glBlendFunc(srcFactor, GL_ONE_MINUS_SRC_ALPHA);
+    mBlendSrcFactor = srcFactor;
 }
 
 #ifdef USE_HWC2
@@ -149,10 +176,9 @@ void GLES20RenderEngine::setupLayerBlending(
 
     if (alpha < 0xFF || !opaque) {
 #endif
-        glEnable(GL_BLEND);
-        glBlendFunc(premultipliedAlpha ? GL_ONE : GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        setBlending(true, premultipliedAlpha ? GL_ONE : GL_SRC_ALPHA);
     } else {
-        glDisable(GL_BLEND);
+        setBlending(false, GL_ONE);
     }
 }
 
@@ -176,10 +202,9 @@ void GLES20RenderEngine::setupDimLayerBlending(int alpha) {
 #else
     if (alpha == 0xFF) {
 #endif
-        glDisable(GL_BLEND);
+        setBlending(false, GL_ONE);
     } else {
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+        setBlending(true, GL_ONE);
     }
 }
 
@@ -209,10 +234,9 @@ void GLES20RenderEngine::setupDimLayerBlendingWithColor(uint32_t color, int alph
 #else
     if (alpha == 0xFF) {
 #endif
-        glDisable(GL_BLEND);
+        setBlending(false, GL_ONE);
     } else {
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+        setBlending(true, GL_ONE);
     }
 }
 
@@ -249,7 +273,7 @@ void GLES20RenderEngine::disableTexturing() {
 }
 
 void GLES20RenderEngine::disableBlending() {
-    glDisable(GL_BLEND);
+    setBlending(false, GL_ONE);
 }
 
 
@@ -300,7 +324,7 @@ void GLES20RenderEngine::setupFillWithColor(float r, float g, float b, float a)
     mState.setOpaque(false);
     mState.setColor(r, g, b, a);
     mState.disableTexture();
-    glDisable(GL_BLEND);
+    setBlending(false, GL_ONE);
 }
 
 void GLES20RenderEngine::drawMesh(const Mesh& mesh) {
@@ -57,10 +57,20 @@ class GLES20RenderEngine : public RenderEngine {
     Description mState;
     Vector<Group> mGroupStack;
 
+    // The blending state last set, so that consecutive layers that blend
+    // the same way don't toggle it. It is forgotten whenever the viewport
+    // is set up, since other GL users (the blur library, for one) run in
+    // between and always set it up again before drawing through us.
+    enum { BLEND_UNKNOWN, BLEND_DISABLED, BLEND_ENABLED };
+    int mBlendState;
+    GLenum mBlendSrcFactor;
+    void setBlending(bool enabled, GLenum srcFactor);
+
     virtual void bindImageAsFramebuffer(EGLImageKHR image,
             uint32_t* texName, uint32_t* fbName, uint32_t* status,
             bool useReadPixels, int reqWidth, int reqHeight);
     virtual void unbindFramebuffer(uint32_t texName, uint32_t fbName, bool useReadPixels);
+    virtual void setupSharedContext();
 
 public:
     GLES20RenderEngine();
@@ -96,6 +106,7 @@ protected:
 
     virtual size_t getMaxTextureSize() const;
     virtual size_t getMaxViewportDims() const;
+    virtual bool supportsSharedContexts() const { return true; }
     virtual bool getProjectionYSwap() { return mProjectionYSwap; }
     virtual size_t getViewportWidth() const { return mVpWidth; }
     virtual size_t getViewportHeight() const { return mVpHeight; }
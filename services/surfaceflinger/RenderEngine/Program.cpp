@@ -15,9 +15,13 @@
  */
 
 #include <stdint.h>
+#include <string.h>
 
 #include <log/log.h>
 
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+
 #include "Program.h"
 #include "ProgramCache.h"
 #include "Description.h"
@@ -26,7 +30,7 @@
 namespace android {
 
 Program::Program(const ProgramCache::Key& /*needs*/, const char* vertex, const char* fragment)
-        : mInitialized(false) {
+        : mInitialized(false), mUniformsSet(false) {
     GLuint vertexId = buildShader(vertex, GL_VERTEX_SHADER);
     GLuint fragmentId = buildShader(fragment, GL_FRAGMENT_SHADER);
     GLuint programId = glCreateProgram();
@@ -53,28 +57,55 @@ Program::Program(const ProgramCache::Key& /*needs*/, const char* vertex, const c
         glDeleteShader(fragmentId);
         glDeleteProgram(programId);
     } else {
-        mProgram = programId;
         mVertexShader = vertexId;
         mFragmentShader = fragmentId;
-        mInitialized = true;
-
-        mColorMatrixLoc = glGetUniformLocation(programId, "colorMatrix");
-        mProjectionMatrixLoc = glGetUniformLocation(programId, "projection");
-        mTextureMatrixLoc = glGetUniformLocation(programId, "texture");
-        mSamplerLoc = glGetUniformLocation(programId, "sampler");
-        mColorLoc = glGetUniformLocation(programId, "color");
-        mAlphaPlaneLoc = glGetUniformLocation(programId, "alphaPlane");
-        mSamplerMaskLoc = glGetUniformLocation(programId, "samplerMask");
-        mMaskAlphaThresholdLoc = glGetUniformLocation(programId, "maskAlphaThreshold");
-
-        // set-up the default values for our uniforms
-        glUseProgram(programId);
-        const GLfloat m[16] = {1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1 };
-        glUniformMatrix4fv(mProjectionMatrixLoc, 1, GL_FALSE, m);
-        glEnableVertexAttribArray(0);
+        initialize(programId);
     }
 }
 
+Program::Program(const ProgramCache::Key& /*needs*/, GLenum binaryFormat,
+        const void* binary, GLsizei length)
+        : mInitialized(false), mVertexShader(0), mFragmentShader(0),
+          mUniformsSet(false) {
+    GLuint programId = glCreateProgram();
+    glProgramBinaryOES(programId, binaryFormat, binary, length);
+
+    // the driver refuses binaries it did not produce, or that an update has
+    // made stale; this is reported as a link failure
+    GLint status;
+    glGetProgramiv(programId, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+        ALOGW("Program binary rejected by the driver (format 0x%x, %d bytes)",
+                binaryFormat, length);
+        glDeleteProgram(programId);
+        // clear any error so that it is not blamed on a later call
+        while (glGetError() != GL_NO_ERROR) {
+        }
+    } else {
+        initialize(programId);
+    }
+}
+
+void Program::initialize(GLuint programId) {
+    mProgram = programId;
+    mInitialized = true;
+
+    mColorMatrixLoc = glGetUniformLocation(programId, "colorMatrix");
+    mProjectionMatrixLoc = glGetUniformLocation(programId, "projection");
+    mTextureMatrixLoc = glGetUniformLocation(programId, "texture");
+    mSamplerLoc = glGetUniformLocation(programId, "sampler");
+    mColorLoc = glGetUniformLocation(programId, "color");
+    mAlphaPlaneLoc = glGetUniformLocation(programId, "alphaPlane");
+    mSamplerMaskLoc = glGetUniformLocation(programId, "samplerMask");
+    mMaskAlphaThresholdLoc = glGetUniformLocation(programId, "maskAlphaThreshold");
+
+    // set-up the default values for our uniforms
+    glUseProgram(programId);
+    const GLfloat m[16] = {1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1 };
+    glUniformMatrix4fv(mProjectionMatrixLoc, 1, GL_FALSE, m);
+    glEnableVertexAttribArray(0);
+}
+
 Program::~Program() {
 }
 
@@ -82,6 +113,27 @@ bool Program::isValid() const {
     return mInitialized;
 }
 
+bool Program::getBinary(GLenum* binaryFormat, Vector<uint8_t>* binary) const {
+    if (!mInitialized) {
+        return false;
+    }
+    GLint length = 0;
+    glGetProgramiv(mProgram, GL_PROGRAM_BINARY_LENGTH_OES, &length);
+    if (length <= 0) {
+        return false;
+    }
+    binary->resize(length);
+    GLsizei written = 0;
+    glGetProgramBinaryOES(mProgram, length, &written, binaryFormat,
+            binary->editArray());
+    if (written <= 0 || written > length) {
+        binary->clear();
+        return false;
+    }
+    binary->resize(written);
+    return true;
+}
+
 void Program::use() {
     glUseProgram(mProgram);
 }
@@ -125,32 +177,57 @@ String8& Program::dumpShader(String8& result, GLenum /*type*/) {
     return result;
 }
 
+// Uploads a matrix unless it holds the value last uploaded to the location.
+// Uniforms are program state, and only this class sets ours.
+static void uniformMatrix4(GLint location, const mat4& value, mat4* lastValue,
+        bool force) {
+    if (force || memcmp(value.asArray(), lastValue->asArray(), sizeof(mat4))) {
+        glUniformMatrix4fv(location, 1, GL_FALSE, value.asArray());
+        *lastValue = value;
+    }
+}
+
 void Program::setUniforms(const Description& desc) {
 
-    // TODO: we should have a mechanism here to not always reset uniforms that
-    // didn't change for this program.
+    // Layers drawn one after the other mostly share the projection, the
+    // color matrix and often the rest, so only what changed is uploaded.
+    if (!mUniformsSet) {
+        // the samplers are constant
+        if (mSamplerLoc >= 0) {
+            glUniform1i(mSamplerLoc, 0);
+        }
+        if (mSamplerMaskLoc >= 0) {
+            glUniform1i(mSamplerMaskLoc, 1);
+        }
+    }
 
     if (mSamplerLoc >= 0) {
-        glUniform1i(mSamplerLoc, 0);
-        glUniformMatrix4fv(mTextureMatrixLoc, 1, GL_FALSE, desc.mTexture.getMatrix().asArray());
+        uniformMatrix4(mTextureMatrixLoc, desc.mTexture.getMatrix(),
+                &mTextureMatrix, !mUniformsSet);
     }
-    if (mAlphaPlaneLoc >= 0) {
+    if (mAlphaPlaneLoc >= 0 &&
+            (!mUniformsSet || desc.mPlaneAlpha != mAlphaPlane)) {
         glUniform1f(mAlphaPlaneLoc, desc.mPlaneAlpha);
+        mAlphaPlane = desc.mPlaneAlpha;
     }
-    if (mColorLoc >= 0) {
+    if (mColorLoc >= 0 &&
+            (!mUniformsSet || memcmp(desc.mColor, mColor, sizeof(mColor)))) {
         glUniform4fv(mColorLoc, 1, desc.mColor);
+        memcpy(mColor, desc.mColor, sizeof(mColor));
     }
     if (mColorMatrixLoc >= 0) {
-        glUniformMatrix4fv(mColorMatrixLoc, 1, GL_FALSE, desc.mColorMatrix.asArray());
+        uniformMatrix4(mColorMatrixLoc, desc.mColorMatrix, &mColorMatrix,
+                !mUniformsSet);
     }
     // these uniforms are always present
-    glUniformMatrix4fv(mProjectionMatrixLoc, 1, GL_FALSE, desc.mProjectionMatrix.asArray());
-    if (mSamplerMaskLoc >= 0) {
-        glUniform1i(mSamplerMaskLoc, 1);
-    }
-    if (mMaskAlphaThresholdLoc >= 0) {
+    uniformMatrix4(mProjectionMatrixLoc, desc.mProjectionMatrix,
+            &mProjectionMatrix, !mUniformsSet);
+    if (mMaskAlphaThresholdLoc >= 0 && (!mUniformsSet ||
+            desc.mMaskAlphaThreshold != mMaskAlphaThreshold)) {
         glUniform1f(mMaskAlphaThresholdLoc, desc.mMaskAlphaThreshold);
+        mMaskAlphaThreshold = desc.mMaskAlphaThreshold;
     }
+    mUniformsSet = true;
 }
 
 } /* namespace android */
@@ -21,6 +21,8 @@
 
 #include <GLES2/gl2.h>
 
+#include <utils/Vector.h>
+
 #include "Description.h"
 #include "ProgramCache.h"
 
@@ -37,11 +39,18 @@ public:
     enum { position=0, texCoords=1 };
 
     Program(const ProgramCache::Key& needs, const char* vertex, const char* fragment);
+    /* Creates the program from a binary returned by getBinary(); the result
+     * is not valid if the driver no longer accepts the binary */
+    Program(const ProgramCache::Key& needs, GLenum binaryFormat,
+            const void* binary, GLsizei length);
     ~Program();
 
     /* whether this object is usable */
     bool isValid() const;
 
+    /* Retrieves the linked program in the driver's binary format */
+    bool getBinary(GLenum* binaryFormat, Vector<uint8_t>* binary) const;
+
     /* Binds this program to the GLES context */
     void use();
 
@@ -56,6 +65,7 @@ public:
 
 
 private:
+    void initialize(GLuint programId);
     GLuint buildShader(const char* source, GLenum type);
     String8& dumpShader(String8& result, GLenum type);
 
@@ -87,6 +97,15 @@ private:
 
     GLint mSamplerMaskLoc;
     GLint mMaskAlphaThresholdLoc;
+
+    // the uniform values last uploaded, valid once mUniformsSet is true
+    bool mUniformsSet;
+    mat4 mTextureMatrix;
+    mat4 mColorMatrix;
+    mat4 mProjectionMatrix;
+    GLclampf mColor[4];
+    GLclampf mAlphaPlane;
+    GLclampf mMaskAlphaThreshold;
 };
 
 
@@ -16,11 +16,22 @@
 
 //#define LOG_NDEBUG 0
 
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
 
+#include <cutils/properties.h>
+#include <utils/Mutex.h>
 #include <utils/String8.h>
 
+#include <thread>
+
 #include "ProgramCache.h"
 #include "Program.h"
 #include "Description.h"
@@ -79,15 +90,101 @@ Formatter& dedent(Formatter& f) {
 
 ANDROID_SINGLETON_STATIC_INSTANCE(ProgramCache)
 
-ProgramCache::ProgramCache() {
-    // Until surfaceflinger has a dependable blob cache on the filesystem,
-    // generate shaders on initialization so as to avoid jank.
+const char* const ProgramCache::BINARY_CACHE_PATH =
+        "/data/misc/surfaceflinger/programs";
+
+// "SFPB"
+static const uint32_t BINARY_CACHE_MAGIC = 0x42504653;
+static const uint32_t BINARY_CACHE_VERSION = 1;
+// no program binary is anywhere near this big
+static const uint32_t BINARY_CACHE_MAX_SIZE = 8 * 1024 * 1024;
+
+static String8 getGLString(GLenum name) {
+    const GLubyte* s = glGetString(name);
+    return String8(s ? reinterpret_cast<const char*>(s) : "");
+}
+
+ProgramCache::ProgramCache()
+    : mBinariesSupported(false), mBinariesDirty(false), mLastProgram(NULL) {
+    memset(mTable, 0, sizeof(mTable));
+
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.sf.program_binaries", value, "1");
+    if (atoi(value)) {
+        String8 extensions(getGLString(GL_EXTENSIONS));
+        GLint formats = 0;
+        if (strstr(extensions.string(), "GL_OES_get_program_binary")) {
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS_OES, &formats);
+        }
+        mBinariesSupported = formats > 0;
+    }
+    if (mBinariesSupported) {
+        // Binaries only load on the driver build that produced them.
+        mDriverId = getGLString(GL_VENDOR);
+        mDriverId.append("\n");
+        mDriverId.append(getGLString(GL_RENDERER));
+        mDriverId.append("\n");
+        mDriverId.append(getGLString(GL_VERSION));
+        loadBinaries();
+    }
+
+    // Generate whatever the binary cache did not have on initialization so
+    // as to avoid jank.
     primeCache();
+
+    if (mBinariesDirty) {
+        saveBinaries();
+    }
 }
 
 ProgramCache::~ProgramCache() {
 }
 
+ssize_t ProgramCache::tableIndex(const Key& key) {
+    static_assert(TABLE_LOW_MASK < 0x40 &&
+            (TABLE_HIGH_MASK >> TABLE_HIGH_SHIFT) == 0xc0,
+            "key bits don't fit in the program table");
+    if (key.mKey & ~(TABLE_LOW_MASK | TABLE_HIGH_MASK)) {
+        return -1;
+    }
+    return (key.mKey & TABLE_LOW_MASK) |
+            ((key.mKey & TABLE_HIGH_MASK) >> TABLE_HIGH_SHIFT);
+}
+
+ProgramCache::Key ProgramCache::tableKey(size_t index) {
+    Key key;
+    key.mKey = (index & TABLE_LOW_MASK) |
+            ((index << TABLE_HIGH_SHIFT) & TABLE_HIGH_MASK);
+    return key;
+}
+
+Program* ProgramCache::getProgram(const Key& key) const {
+    ssize_t index = tableIndex(key);
+    return index >= 0 ? mTable[index] : mOverflow.valueFor(key);
+}
+
+void ProgramCache::addProgram(const Key& key, Program* program) {
+    ssize_t index = tableIndex(key);
+    if (index >= 0) {
+        mTable[index] = program;
+    } else {
+        mOverflow.add(key, program);
+    }
+}
+
+Vector<ProgramCache::Key> ProgramCache::getKeys() const {
+    Vector<Key> keys;
+    for (size_t i = 0; i < TABLE_SIZE; i++) {
+        if (mTable[i] != NULL) {
+            keys.add(tableKey(i));
+        }
+    }
+    for (size_t i = 0; i < mOverflow.size(); i++) {
+        keys.add(mOverflow.keyAt(i));
+    }
+    return keys;
+}
+
 void ProgramCache::primeCache() {
     uint32_t shaderCount = 0;
     uint32_t keyMask = Key::BLEND_MASK | Key::OPACITY_MASK |
@@ -105,10 +202,10 @@ void ProgramCache::primeCache() {
             tex != Key::TEXTURE_2D) {
             continue;
         }
-        Program* program = mCache.valueFor(shaderKey);
+        Program* program = getProgram(shaderKey);
         if (program == NULL) {
             program = generateProgram(shaderKey);
-            mCache.add(shaderKey, program);
+            addProgram(shaderKey, program);
             shaderCount++;
         }
     }
@@ -122,10 +219,10 @@ void ProgramCache::primeCache() {
     for (size_t i=0; i<sizeof(blurringKeys)/sizeof(blurringKeys[0]); ++i) {
         Key shaderKey;
         shaderKey.set(blurringKeys[i], blurringKeys[i]);
-        Program* program = mCache.valueFor(shaderKey);
+        Program* program = getProgram(shaderKey);
         if (program == NULL) {
             program = generateProgram(shaderKey);
-            mCache.add(shaderKey, program);
+            addProgram(shaderKey, program);
             shaderCount++;
         }
     }
@@ -133,6 +230,160 @@ void ProgramCache::primeCache() {
     nsecs_t timeAfter = systemTime();
     float compileTimeMs = static_cast<float>(timeAfter - timeBefore) / 1.0E6;
     ALOGD("SF. shader cache generated - %u shaders in %f ms\n", shaderCount, compileTimeMs);
+    if (shaderCount) {
+        mBinariesDirty = true;
+    }
+}
+
+static bool readU32(FILE* file, uint32_t* value) {
+    return fread(value, sizeof(*value), 1, file) == 1;
+}
+
+static bool writeU32(FILE* file, uint32_t value) {
+    return fwrite(&value, sizeof(value), 1, file) == 1;
+}
+
+size_t ProgramCache::loadBinaries() {
+    FILE* file = fopen(BINARY_CACHE_PATH, "rb");
+    if (file == NULL) {
+        if (errno != ENOENT) {
+            ALOGW("can't open %s (%s)", BINARY_CACHE_PATH, strerror(errno));
+        }
+        return 0;
+    }
+
+    nsecs_t timeBefore = systemTime();
+    size_t loaded = 0;
+    size_t rejected = 0;
+    uint32_t magic = 0, version = 0, idLength = 0, count = 0;
+    bool valid = readU32(file, &magic) && magic == BINARY_CACHE_MAGIC &&
+            readU32(file, &version) && version == BINARY_CACHE_VERSION &&
+            readU32(file, &idLength) && idLength == mDriverId.size();
+    if (valid) {
+        Vector<char> id;
+        id.resize(idLength);
+        valid = fread(id.editArray(), 1, idLength, file) == idLength &&
+                memcmp(id.array(), mDriverId.string(), idLength) == 0 &&
+                readU32(file, &count);
+    }
+
+    Vector<uint8_t> binary;
+    for (uint32_t i = 0; valid && i < count; i++) {
+        uint32_t keyValue = 0, format = 0, length = 0;
+        valid = readU32(file, &keyValue) && readU32(file, &format) &&
+                readU32(file, &length) && length > 0 &&
+                length <= BINARY_CACHE_MAX_SIZE;
+        if (!valid) {
+            break;
+        }
+        binary.resize(length);
+        valid = fread(binary.editArray(), 1, length, file) == length;
+        if (!valid) {
+            break;
+        }
+        Key key;
+        key.mKey = keyValue;
+        if (getProgram(key) != NULL) {
+            continue;
+        }
+        Program* program = new Program(key, format, binary.array(), length);
+        if (program->isValid()) {
+            addProgram(key, program);
+            loaded++;
+        } else {
+            delete program;
+            rejected++;
+        }
+    }
+    fclose(file);
+
+    if (!valid || rejected) {
+        // the file is stale or damaged; write a fresh one once the missing
+        // programs have been compiled
+        mBinariesDirty = true;
+    }
+    float loadTimeMs = static_cast<float>(systemTime() - timeBefore) / 1.0E6;
+    ALOGD("SF. program binaries loaded - %zu programs in %f ms (%zu rejected%s)",
+            loaded, loadTimeMs, rejected, valid ? "" : ", file invalid");
+    return loaded;
+}
+
+bool ProgramCache::hasUnsavedBinaries() const {
+    return mBinariesDirty;
+}
+
+void ProgramCache::saveBinariesIfDirty() {
+    if (mBinariesDirty) {
+        saveBinaries();
+    }
+}
+
+void ProgramCache::saveBinaries() {
+    mBinariesDirty = false;
+    if (!mBinariesSupported) {
+        return;
+    }
+
+    // the binaries can only be read with the context current, so collect
+    // them here and leave the file to a thread of its own
+    std::shared_ptr<BinaryFile> contents(std::make_shared<BinaryFile>());
+    contents->driverId = mDriverId;
+    const Vector<Key> cachedKeys(getKeys());
+    for (size_t i = 0; i < cachedKeys.size(); i++) {
+        GLenum format = 0;
+        Vector<uint8_t> binary;
+        if (getProgram(cachedKeys[i])->getBinary(&format, &binary)) {
+            contents->keys.add(cachedKeys[i]);
+            contents->formats.add(format);
+            contents->binaries.add(binary);
+        }
+    }
+    std::thread(writeBinaries, contents).detach();
+}
+
+void ProgramCache::writeBinaries(std::shared_ptr<BinaryFile> contents) {
+    // the temporary file is shared, so one write at a time
+    static Mutex sWriteLock;
+    Mutex::Autolock _l(sWriteLock);
+
+    String8 tmpPath(BINARY_CACHE_PATH);
+    tmpPath.append(".tmp");
+    int fd = open(tmpPath.string(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+            0600);
+    FILE* file = fd >= 0 ? fdopen(fd, "wb") : NULL;
+    if (file == NULL) {
+        ALOGW("can't create %s (%s)", tmpPath.string(), strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return;
+    }
+
+    const String8& driverId(contents->driverId);
+    const Vector<Key>& keys(contents->keys);
+    bool ok = writeU32(file, BINARY_CACHE_MAGIC) &&
+            writeU32(file, BINARY_CACHE_VERSION) &&
+            writeU32(file, uint32_t(driverId.size())) &&
+            fwrite(driverId.string(), 1, driverId.size(), file) ==
+                    driverId.size() &&
+            writeU32(file, uint32_t(keys.size()));
+    for (size_t i = 0; ok && i < keys.size(); i++) {
+        const Vector<uint8_t>& binary(contents->binaries[i]);
+        ok = writeU32(file, keys[i].mKey) &&
+                writeU32(file, contents->formats[i]) &&
+                writeU32(file, uint32_t(binary.size())) &&
+                fwrite(binary.array(), 1, binary.size(), file) == binary.size();
+    }
+    ok = fflush(file) == 0 && ok;
+    ok = fsync(fileno(file)) == 0 && ok;
+    ok = fclose(file) == 0 && ok;
+
+    if (!ok || rename(tmpPath.string(), BINARY_CACHE_PATH) != 0) {
+        ALOGW("can't write %s (%s)", BINARY_CACHE_PATH, strerror(errno));
+        unlink(tmpPath.string());
+        return;
+    }
+    ALOGD("SF. program binaries saved - %zu programs", keys.size());
 }
 
 ProgramCache::Key ProgramCache::computeKey(const Description& description) {
@@ -266,15 +517,27 @@ void ProgramCache::useProgram(const Description& description) {
     Key needs(computeKey(description));
 
      // look-up the program in the cache
-    Program* program = mCache.valueFor(needs);
+    Program* program = mLastProgram;
+    if (program == NULL || needs.mKey != mLastKey.mKey) {
+        program = getProgram(needs);
+    }
     if (program == NULL) {
         // we didn't find our program, so generate one...
         nsecs_t time = -systemTime();
         program = generateProgram(needs);
-        mCache.add(needs, program);
+        addProgram(needs, program);
         time += systemTime();
+
+        // written out by SurfaceFlinger between frames, see
+        // saveBinariesIfDirty()
+        if (mBinariesSupported && program->isValid()) {
+            mBinariesDirty = true;
+        }
     }
 
+    mLastKey = needs;
+    mLastProgram = program;
+
     // here we have a suitable program for this description
     if (program->isValid()) {
         program->use();
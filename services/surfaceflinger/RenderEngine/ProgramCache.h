@@ -21,7 +21,11 @@
 
 #include <utils/Singleton.h>
 #include <utils/KeyedVector.h>
+#include <utils/String8.h>
 #include <utils/TypeHelpers.h>
+#include <utils/Vector.h>
+
+#include <memory>
 
 #include "Description.h"
 
@@ -118,10 +122,20 @@ public:
     ProgramCache();
     ~ProgramCache();
 
+    // file the linked programs are kept in across restarts
+    static const char* const BINARY_CACHE_PATH;
+
     // useProgram lookup a suitable program in the cache or generates one
     // if none can be found.
     void useProgram(const Description& description);
 
+    // Whether programs were generated since the file was last written
+    bool hasUnsavedBinaries() const;
+    // Writes the file out if hasUnsavedBinaries(). The binaries are read
+    // here, with the context current, and written and synced on a thread of
+    // their own, so that a compile doesn't also cost frames a file write.
+    void saveBinariesIfDirty();
+
 private:
     // Generate shaders to populate the cache
     void primeCache();
@@ -134,9 +148,56 @@ private:
     // generates the fragment shader from the Key
     static String8 generateFragmentShader(const Key& needs);
 
-    // Key/Value map used for caching Programs. Currently the cache
+    // Adds the programs saved by an earlier run with the same driver to the
+    // cache. Returns the number of programs loaded.
+    size_t loadBinaries();
+    // Saves every program in the cache, replacing the file atomically
+    void saveBinaries();
+
+    struct BinaryFile {
+        String8 driverId;
+        Vector<Key> keys;
+        Vector<GLenum> formats;
+        Vector< Vector<uint8_t> > binaries;
+    };
+    static void writeBinaries(std::shared_ptr<BinaryFile> contents);
+
+    // whether the driver can hand out program binaries
+    bool mBinariesSupported;
+    // whether the cache holds programs that the file is missing
+    bool mBinariesDirty;
+    // identifies the driver that produced the binaries
+    String8 mDriverId;
+
+    // Programs are stored in a table indexed by the key bits that are in
+    // use, so that looking one up is a single array access. Keys with any
+    // other bit set go to mOverflow.
+    enum {
+        TABLE_LOW_MASK      =       Key::BLEND_MASK | Key::OPACITY_MASK |
+                                    Key::PLANE_ALPHA_MASK | Key::TEXTURE_MASK |
+                                    Key::COLOR_MATRIX_MASK,
+        // the texture masking bits are moved down next to the low bits
+        TABLE_HIGH_MASK     =       Key::TEXTURE_MASKING_MASK,
+        TABLE_HIGH_SHIFT    =       17,
+        TABLE_SIZE          =       0x100,
+    };
+    // returns the table slot of the key, or -1 if it has to overflow
+    static ssize_t tableIndex(const Key& key);
+    static Key tableKey(size_t index);
+
+    Program* getProgram(const Key& key) const;
+    void addProgram(const Key& key, Program* program);
+    // returns every cached key; used when saving, not per draw
+    Vector<Key> getKeys() const;
+
+    Program* mTable[TABLE_SIZE];
+    // Key/Value map for keys the table can't hold. Currently the cache
     // is never shrunk.
-    DefaultKeyedVector<Key, Program*> mCache;
+    DefaultKeyedVector<Key, Program*> mOverflow;
+
+    // consecutive layers tend to use the same program
+    Key mLastKey;
+    Program* mLastProgram;
 };
 
 
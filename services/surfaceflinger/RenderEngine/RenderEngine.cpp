@@ -131,7 +131,7 @@ RenderEngine* RenderEngine::create(EGLDisplay display, int hwcFormat) {
         engine = new GLES20RenderEngine();
         break;
     }
-    engine->setEGLHandles(config, ctxt);
+    engine->setEGLHandles(config, ctxt, dummyConfig, contextClientVersion);
 
     ALOGI("OpenGL ES informations:");
     ALOGI("vendor    : %s", extensions.getVendor());
@@ -147,15 +147,83 @@ RenderEngine* RenderEngine::create(EGLDisplay display, int hwcFormat) {
     return engine;
 }
 
-RenderEngine::RenderEngine() : mEGLConfig(NULL), mEGLContext(EGL_NO_CONTEXT) {
+RenderEngine::RenderEngine() : mEGLConfig(NULL), mEGLContext(EGL_NO_CONTEXT),
+        mPbufferConfig(NULL), mContextClientVersion(0) {
 }
 
 RenderEngine::~RenderEngine() {
+    for (size_t i = 0; i < mSharedContexts.size(); i++) {
+        const SharedContext& shared(mSharedContexts[i]);
+        eglDestroySurface(shared.display, shared.surface);
+        eglDestroyContext(shared.display, shared.context);
+    }
 }
 
-void RenderEngine::setEGLHandles(EGLConfig config, EGLContext ctxt) {
+void RenderEngine::setEGLHandles(EGLConfig config, EGLContext ctxt,
+        EGLConfig pbufferConfig, EGLint contextClientVersion) {
     mEGLConfig = config;
     mEGLContext = ctxt;
+    mPbufferConfig = pbufferConfig;
+    mContextClientVersion = contextClientVersion;
+}
+
+EGLContext RenderEngine::createSharedContext(EGLDisplay display,
+        ContextPriority priority) {
+    if (!supportsSharedContexts()) {
+        return EGL_NO_CONTEXT;
+    }
+
+    EGLint contextAttributes[] = {
+            EGL_CONTEXT_CLIENT_VERSION, mContextClientVersion,
+            EGL_NONE, EGL_NONE,
+            EGL_NONE
+    };
+#ifdef EGL_IMG_context_priority
+    if (findExtension(eglQueryStringImplementationANDROID(display,
+            EGL_EXTENSIONS), "EGL_IMG_context_priority")) {
+        contextAttributes[2] = EGL_CONTEXT_PRIORITY_LEVEL_IMG;
+        switch (priority) {
+        case CONTEXT_PRIORITY_HIGH:
+            contextAttributes[3] = EGL_CONTEXT_PRIORITY_HIGH_IMG;
+            break;
+        case CONTEXT_PRIORITY_MEDIUM:
+            contextAttributes[3] = EGL_CONTEXT_PRIORITY_MEDIUM_IMG;
+            break;
+        case CONTEXT_PRIORITY_LOW:
+            contextAttributes[3] = EGL_CONTEXT_PRIORITY_LOW_IMG;
+            break;
+        }
+    }
+#else
+    (void)priority;
+#endif
+    EGLContext context = eglCreateContext(display, mEGLConfig, mEGLContext,
+            contextAttributes);
+    if (context == EGL_NO_CONTEXT) {
+        ALOGE("createSharedContext: eglCreateContext failed (%#x)",
+                eglGetError());
+        return EGL_NO_CONTEXT;
+    }
+
+    // not every implementation has EGL_KHR_surfaceless_context
+    EGLint attribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE, EGL_NONE };
+    EGLSurface surface = eglCreatePbufferSurface(display, mPbufferConfig,
+            attribs);
+    if (surface == EGL_NO_SURFACE) {
+        ALOGE("createSharedContext: eglCreatePbufferSurface failed (%#x)",
+                eglGetError());
+        eglDestroyContext(display, context);
+        return EGL_NO_CONTEXT;
+    }
+
+    mSharedContexts.add({display, context, surface});
+
+    BindSharedContext bind(*this, context);
+    if (!bind.isBound()) {
+        return EGL_NO_CONTEXT;
+    }
+    setupSharedContext();
+    return context;
 }
 
 EGLContext RenderEngine::getEGLConfig() const {
@@ -256,10 +324,44 @@ void RenderEngine::dump(String8& result) {
             extensions.getRenderer(),
             extensions.getVersion());
     result.appendFormat("%s\n", extensions.getExtension());
+    result.appendFormat("shared contexts: %zu\n", mSharedContexts.size());
 }
 
 // ---------------------------------------------------------------------------
 
+RenderEngine::BindSharedContext::BindSharedContext(RenderEngine& engine,
+        EGLContext context)
+    : mDisplay(EGL_NO_DISPLAY), mPreviousContext(EGL_NO_CONTEXT),
+      mPreviousDraw(EGL_NO_SURFACE), mPreviousRead(EGL_NO_SURFACE),
+      mBound(false) {
+    if (context == EGL_NO_CONTEXT) {
+        return;
+    }
+    for (size_t i = 0; i < engine.mSharedContexts.size(); i++) {
+        const SharedContext& shared(engine.mSharedContexts[i]);
+        if (shared.context != context) {
+            continue;
+        }
+        mPreviousContext = eglGetCurrentContext();
+        mPreviousDraw = eglGetCurrentSurface(EGL_DRAW);
+        mPreviousRead = eglGetCurrentSurface(EGL_READ);
+        mBound = eglMakeCurrent(shared.display, shared.surface,
+                shared.surface, shared.context);
+        ALOGE_IF(!mBound, "BindSharedContext: eglMakeCurrent failed (%#x)",
+                eglGetError());
+        mDisplay = shared.display;
+        return;
+    }
+    ALOGE("BindSharedContext: %p is not a shared context", context);
+}
+
+RenderEngine::BindSharedContext::~BindSharedContext() {
+    if (mBound) {
+        eglMakeCurrent(mDisplay, mPreviousDraw, mPreviousRead,
+                mPreviousContext);
+    }
+}
+
 RenderEngine::BindImageAsFramebuffer::BindImageAsFramebuffer(
         RenderEngine& engine, EGLImageKHR image, bool useReadPixels,
         int reqWidth, int reqHeight) : mEngine(engine), mUseReadPixels(useReadPixels)
@@ -444,6 +546,14 @@ void RenderEngine::primeCache() const {
     ProgramCache::getInstance();
 }
 
+bool RenderEngine::hasUnsavedPrograms() const {
+    return ProgramCache::getInstance().hasUnsavedBinaries();
+}
+
+void RenderEngine::saveProgramsIfDirty() const {
+    ProgramCache::getInstance().saveBinariesIfDirty();
+}
+
 // ---------------------------------------------------------------------------
 }; // namespace android
 // ---------------------------------------------------------------------------
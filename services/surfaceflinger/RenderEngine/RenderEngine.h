@@ -24,6 +24,7 @@
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 #include <ui/mat4.h>
+#include <utils/Vector.h>
 #include <Transform.h>
 
 #define EGL_NO_CONFIG ((EGLConfig)0)
@@ -49,13 +50,28 @@ class RenderEngine {
 
     EGLConfig mEGLConfig;
     EGLContext mEGLContext;
-    void setEGLHandles(EGLConfig config, EGLContext ctxt);
+    // config for the pbuffers shared contexts are made current with, which
+    // mEGLConfig may not be (see EGL_ANDROIDX_no_config_context)
+    EGLConfig mPbufferConfig;
+    EGLint mContextClientVersion;
+    void setEGLHandles(EGLConfig config, EGLContext ctxt,
+            EGLConfig pbufferConfig, EGLint contextClientVersion);
+
+    struct SharedContext {
+        EGLDisplay display;
+        EGLContext context;
+        EGLSurface surface;
+    };
+    Vector<SharedContext> mSharedContexts;
 
     virtual void bindImageAsFramebuffer(EGLImageKHR image, uint32_t* texName,
             uint32_t* fbName, uint32_t* status, bool useReadPixels, int reqWidth,
             int reqHeight) = 0;
     virtual void unbindFramebuffer(uint32_t texName, uint32_t fbName,
             bool useReadPixels) = 0;
+    // Sets up the GL state the engine relies on in a new shared context,
+    // which is current when this is called.
+    virtual void setupSharedContext() {}
 
 protected:
     RenderEngine();
@@ -66,7 +82,49 @@ public:
 
     static EGLConfig chooseEglConfig(EGLDisplay display, int format);
 
+    enum ContextPriority {
+        CONTEXT_PRIORITY_HIGH,
+        CONTEXT_PRIORITY_MEDIUM,
+        CONTEXT_PRIORITY_LOW,
+    };
+
+    // Creates another context sharing the textures, buffers and programs of
+    // the main one, so that work for another output can be submitted from
+    // it, at its own GPU priority where EGL_IMG_context_priority allows,
+    // without disturbing the main context's state. The engine keeps
+    // ownership. Returns EGL_NO_CONTEXT if the engine's GL version doesn't
+    // allow it or EGL fails.
+    //
+    // Layers can't be drawn in one: their GLConsumers are bound to the main
+    // context and refuse to update their texture, or to wait for the
+    // buffer's acquire fence, in any other.
+    EGLContext createSharedContext(EGLDisplay display,
+            ContextPriority priority);
+
+    // The engine only sets up GL's defaults again for every draw in GLES 2.0
+    // and later, so only then can it draw in more than one context.
+    virtual bool supportsSharedContexts() const { return false; }
+
+    // Makes a context from createSharedContext() current on this thread for
+    // the duration of the scope, and whatever was current before again
+    // afterwards. Does nothing for EGL_NO_CONTEXT, or if the context can't
+    // be made current.
+    class BindSharedContext {
+        EGLDisplay mDisplay;
+        EGLContext mPreviousContext;
+        EGLSurface mPreviousDraw;
+        EGLSurface mPreviousRead;
+        bool mBound;
+    public:
+        BindSharedContext(RenderEngine& engine, EGLContext context);
+        ~BindSharedContext();
+        bool isBound() const { return mBound; }
+    };
+
     void primeCache() const;
+    // see ProgramCache::saveBinariesIfDirty()
+    bool hasUnsavedPrograms() const;
+    void saveProgramsIfDirty() const;
 
     // dump the extension strings. always call the base class.
     virtual void dump(String8& result);
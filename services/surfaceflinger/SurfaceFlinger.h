@@ -42,6 +42,7 @@
 
 #include <gui/ISurfaceComposer.h>
 #include <gui/ISurfaceComposerClient.h>
+#include <gui/ITransactionCompletedListener.h>
 #include <gui/OccupancyTracker.h>
 
 #include <hardware/hwcomposer_defs.h>
@@ -54,16 +55,24 @@
 #include "DisplayDevice.h"
 #include "DispSync.h"
 #include "FenceTracker.h"
+#include "FrameStageMonitor.h"
 #include "FrameTracker.h"
+#include "LayerCapture.h"
+#include "LayerSpatialIndex.h"
 #include "MessageQueue.h"
+#include "PhaseOffsetController.h"
+#include "RefreshRateScheduler.h"
+#include "WorkerPool.h"
 
 #include "DisplayHardware/HWComposer.h"
+#include "DisplayHardware/PowerHAL.h"
 #include "Effects/Daltonizer.h"
 
 #include "FrameRateHelper.h"
 
 #include <map>
 #include <string>
+#include <vector>
 
 namespace android {
 
@@ -86,7 +95,10 @@ enum {
     eTransactionNeeded        = 0x01,
     eTraversalNeeded          = 0x02,
     eDisplayTransactionNeeded = 0x04,
-    eTransactionMask          = 0x07
+    eTransactionMask          = 0x07,
+    // only cursor layers HWC composes on its cursor plane have moved, see
+    // handleCursorMoves()
+    eCursorMoveNeeded         = 0x08
 };
 
 class SurfaceFlinger : public BnSurfaceComposer,
@@ -219,6 +231,12 @@ private:
     virtual sp<IBinder> getBuiltInDisplay(int32_t id);
     virtual void setTransactionState(const Vector<ComposerState>& state,
             const Vector<DisplayState>& displays, uint32_t flags);
+    virtual status_t setTransactionStateAsync(
+            const Vector<ComposerState>& state,
+            const Vector<DisplayState>& displays, uint32_t flags,
+            nsecs_t desiredPresentTime,
+            const sp<ITransactionCompletedListener>& listener,
+            uint64_t transactionId);
     virtual void bootFinished();
     virtual bool authenticateSurfaceTexture(
         const sp<IGraphicBufferProducer>& bufferProducer) const;
@@ -229,6 +247,14 @@ private:
             uint32_t minLayerZ, uint32_t maxLayerZ,
             bool useIdentityTransform, ISurfaceComposer::Rotation rotation,
             bool isCpuConsumer);
+    virtual status_t captureScreenToBuffer(const sp<IBinder>& display,
+            const sp<GraphicBuffer>& buffer, Rect sourceCrop,
+            uint32_t minLayerZ, uint32_t maxLayerZ,
+            bool useIdentityTransform, ISurfaceComposer::Rotation rotation,
+            sp<Fence>* outFence);
+    virtual status_t captureLayerToBuffer(const sp<IBinder>& layerHandle,
+            const sp<GraphicBuffer>& buffer, Rect sourceCrop,
+            sp<Fence>* outFence);
     virtual status_t getDisplayStats(const sp<IBinder>& display,
             DisplayStatInfo* stats);
     virtual status_t getDisplayConfigs(const sp<IBinder>& display,
@@ -323,15 +349,39 @@ private:
     // Returns whether the transaction actually modified any state
     bool handleMessageTransaction();
 
+    // Applies the setTransactionStateAsync() transactions due for the frame
+    // being prepared.
+    void applyQueuedTransactions();
+    // Applies the queued transactions due for the frame being prepared, or
+    // all of pid's if it isn't negative, and returns the transaction flags
+    // they raised.
+    uint32_t applyQueuedTransactionsLocked(pid_t pid);
+    // Tells the listeners of the transactions that went into the frame just
+    // composed.
+    void notifyTransactionsCompleted(const sp<Fence>& presentFence);
+
     // Returns whether a new buffer has been latched (see handlePageFlip())
     bool handleMessageInvalidate();
 
     void handleMessageRefresh();
+    // Ends the frame of mFrameStages, with a snapshot of the composition
+    // if it missed the vsync period, and hints the power HAL about the
+    // coming frames
+    void endFrameStages();
+    // Adds the layer state of the frame just composed to mLayerCapture
+    void captureLayers();
 
     void handleTransaction(uint32_t transactionFlags);
     void handleTransactionLocked(uint32_t transactionFlags);
 
     void updateCursorAsync();
+#ifdef USE_HWC2
+    // Commits the positions of the cursor layers moved by eCursorMoveNeeded
+    // transactions and hands them to HWC directly, without composing a
+    // frame; the next composition picks up the new geometry. Returns false,
+    // changing nothing, if some layer needs a composition after all.
+    bool handleCursorMoves();
+#endif
 
     /* handlePageFlip - latch a new buffer if available and compute the dirty
      * region. Returns whether a new buffer has been latched, i.e., whether it
@@ -348,6 +398,9 @@ private:
     void commitTransaction();
     uint32_t setClientStateLocked(const sp<Client>& client, const layer_state_t& s);
     uint32_t setDisplayStateLocked(const DisplayState& s);
+    // Applies the display and then the layer changes of one transaction.
+    uint32_t applyTransactionStateLocked(const Vector<ComposerState>& state,
+            const Vector<DisplayState>& displays);
 
     /* ------------------------------------------------------------------------
      * Layer management
@@ -393,11 +446,19 @@ private:
 
     void startBootAnim();
 
+    // Appends a step of init() that ran from start until now, and returns
+    // now so the next step can start from it.
+    nsecs_t recordInitStage(const char* name, nsecs_t start);
+    void dumpInitStagesLocked(String8& result) const;
+
+    // Draws the layers in [minLayerZ, maxLayerZ] that show within
+    // sourceCrop, or only onlyLayer if it is set.
     void renderScreenImplLocked(
             const sp<const DisplayDevice>& hw,
             Rect sourceCrop, uint32_t reqWidth, uint32_t reqHeight,
             uint32_t minLayerZ, uint32_t maxLayerZ,
-            bool yswap, bool useIdentityTransform, Transform::orientation_flags rotation);
+            bool yswap, bool useIdentityTransform, Transform::orientation_flags rotation,
+            const sp<const Layer>& onlyLayer = NULL);
 
     status_t captureScreenImplLocked(
             const sp<const DisplayDevice>& hw,
@@ -407,6 +468,36 @@ private:
             bool useIdentityTransform, Transform::orientation_flags rotation,
             bool isLocalScreenshot, bool useReadPixels);
 
+    // Renders into buffer at its size and returns a fence for the GPU work
+    // in outSyncFd (-1 if the work has been waited for instead).
+    status_t captureScreenToBufferImplLocked(
+            const sp<const DisplayDevice>& hw,
+            const sp<GraphicBuffer>& buffer, Rect sourceCrop,
+            uint32_t minLayerZ, uint32_t maxLayerZ,
+            bool useIdentityTransform, Transform::orientation_flags rotation,
+            bool isLocalScreenshot, int* outSyncFd);
+
+    // Renders one layer, on its own, in layer stack space.
+    status_t captureLayerToBufferImplLocked(const sp<IBinder>& layerHandle,
+            const sp<GraphicBuffer>& buffer, Rect sourceCrop,
+            bool isLocalScreenshot, int* outSyncFd);
+
+    // The part of the two above past their checks: renders into buffer at
+    // its size and flushes.
+    status_t renderScreenToBufferLocked(const sp<const DisplayDevice>& hw,
+            const sp<GraphicBuffer>& buffer, Rect sourceCrop,
+            uint32_t minLayerZ, uint32_t maxLayerZ,
+            bool useIdentityTransform, Transform::orientation_flags rotation,
+            const sp<const Layer>& onlyLayer, int* outSyncFd);
+
+    bool secureLayerIsVisibleLocked(const sp<const DisplayDevice>& hw,
+            uint32_t minLayerZ, uint32_t maxLayerZ) const;
+
+    // Flushes the rendering of a screenshot and returns a native fence fd
+    // that signals when it is done, or -1 once it has been waited for when
+    // native fences aren't available.
+    int flushScreenshotLocked();
+
     /* ------------------------------------------------------------------------
      * EGL
      */
@@ -462,11 +553,42 @@ private:
     void invalidateHwcGeometry();
     void computeVisibleRegions(size_t dpy,
             const LayerVector& currentLayers, uint32_t layerStack,
-            Region& dirtyRegion, Region& opaqueRegion);
+            Region& dirtyRegion, Region& opaqueRegion,
+            VisibleRegionCache& cache, LayerSpatialIndex& aboveLayersIndex);
+    // Redoes a cached computeVisibleRegions() pass from scratch and logs
+    // any layer whose regions came out different.
+    void checkVisibleRegions(size_t dpy,
+            const LayerVector& currentLayers, uint32_t layerStack,
+            Region& dirtyRegion, Region& opaqueRegion,
+            VisibleRegionCache& cache, LayerSpatialIndex& aboveLayersIndex);
 
     void preComposition();
     void postComposition(nsecs_t refreshStartTime);
+    // Writes out the program binaries compiled since they were last saved,
+    // once the frame being composed is done.
+    void scheduleProgramSave();
+    void updatePhaseOffsets(const sp<Fence>& glesCompositionDoneFence);
+#ifdef USE_HWC2
+    // Lets the refresh rate scheduler pick the primary display config.
+    void updateRefreshRate();
+    // Checks the refresh rate again after a while, in case nothing gets
+    // composed to do it before then.
+    void scheduleRefreshRateCheck();
+#endif
     void rebuildLayerStacks();
+#ifdef USE_HWC2
+    // What rebuildLayerStacks() works out for one display. Working it out
+    // touches the layers of that display's layer stack only, so displays
+    // with different layer stacks can be done on different threads.
+    struct VisibleLayers {
+        Region opaqueRegion;
+        Region dirtyRegion;
+        Vector<sp<Layer>> layersSortedByZ;
+        // layers that are on the layer stack but no longer visible
+        Vector<sp<Layer>> hiddenLayers;
+    };
+    void computeVisibleLayers(size_t dpy, VisibleLayers& result);
+#endif
     void setUpHWComposer();
     void doComposition();
     void doDebugFlashRegions();
@@ -499,6 +621,10 @@ private:
     void listLayersLocked(const Vector<String16>& args, size_t& index, String8& result) const;
     void dumpStatsLocked(const Vector<String16>& args, size_t& index, String8& result) const;
     void clearStatsLocked(const Vector<String16>& args, size_t& index, String8& result);
+    void dumpBufferLatencyLocked(const Vector<String16>& args, size_t& index,
+            String8& result) const;
+    void dumpFrameHistoryLocked(const Vector<String16>& args, size_t& index,
+            String8& result, bool exportBinary) const;
     void dumpAllLocked(const Vector<String16>& args, size_t& index, String8& result) const;
     bool startDdmConnection();
     static void appendSfConfigString(String8& result);
@@ -515,8 +641,19 @@ private:
             std::vector<OccupancyTracker::Segment>&& history);
     void dumpBufferingStats(String8& result) const;
 
+    // Trims the buffers of layers no display has shown for a while, and
+    // enforces the layer buffer budget; see below.
+    void trimLayerBuffers();
+    // Discards the free buffers of layers no display shows, largest first,
+    // while all layers together retain more than the budget.
+    void enforceLayerBufferBudget(const SortedVector<const Layer*>& onScreen);
+    void dumpLayerBufferMemoryLocked(String8& result) const;
+
     bool getFrameTimestamps(const Layer& layer, uint64_t frameNumber,
             FrameTimestamps* outTimestamps);
+    status_t createFrameEventChannel(const Layer& layer,
+            sp<BitTube>* outChannel);
+    void removeFrameEventChannel(const Layer& layer);
 
     /* ------------------------------------------------------------------------
      * Attributes
@@ -530,6 +667,29 @@ private:
     bool mTransactionPending;
     bool mAnimTransactionPending;
     Vector< sp<Layer> > mLayersPendingRemoval;
+
+    // An asynchronous transaction waiting for its frame, with the listeners
+    // of the transactions coalesced into it.
+    struct TransactionCallback {
+        sp<ITransactionCompletedListener> listener;
+        uint64_t transactionId;
+        nsecs_t latchTime;
+    };
+    struct QueuedTransaction {
+        pid_t pid;
+        Vector<ComposerState> state;
+        Vector<DisplayState> displays;
+        uint32_t flags;
+        nsecs_t desiredPresentTime;
+        std::vector<TransactionCallback> callbacks;
+    };
+    std::vector<QueuedTransaction> mQueuedTransactions;
+    // callbacks of the transactions applied since the last INVALIDATE
+    std::vector<TransactionCallback> mAppliedTransactions;
+    uint64_t mAsyncTransactions = 0;
+    uint64_t mAsyncTransactionsCoalesced = 0;
+    // cursor moves handled without a composition
+    uint64_t mCursorMovesWithoutComposition = 0;
     SortedVector< wp<IBinder> > mGraphicBufferProducerList;
 
     // protected by mStateLock (but we could use another lock)
@@ -542,10 +702,23 @@ private:
     HWComposer* mHwc;
     RenderEngine* mRenderEngine;
     nsecs_t mBootTime;
+    // the steps of init() and how long they took; written by init() before
+    // the service is published
+    struct InitStage {
+        const char* name;
+        nsecs_t duration;
+        // ran on another thread, beside the stages before it
+        bool parallel;
+    };
+    std::vector<InitStage> mInitStages;
+    // when init() started the boot animation, 0 until then
+    nsecs_t mBootAnimStartTime = 0;
     bool mGpuToCpuSupported;
     sp<EventThread> mEventThread;
     sp<EventThread> mSFEventThread;
     sp<EventControlThread> mEventControlThread;
+    // waits on the fences the frame trackers look at
+    sp<FenceMonitor> mFenceMonitor;
     EGLContext mEGLContext;
     EGLDisplay mEGLDisplay;
     sp<IBinder> mBuiltinDisplays[DisplayDevice::NUM_BUILTIN_DISPLAY_TYPES];
@@ -560,6 +733,12 @@ private:
     bool mGeometryInvalid;
 #endif
     bool mAnimCompositionPending;
+    // callbacks of the transactions going into the frame being composed
+    std::vector<TransactionCallback> mComposingTransactions;
+    // Release fence for the buffers replaced by handlePageFlip(). No GL
+    // commands are issued while the layers are latched, so one fence covers
+    // them all and saves a flush per layer.
+    sp<Fence> mLatchReleaseFence;
 #ifdef USE_HWC2
     std::vector<sp<Layer>> mLayersWithQueuedFrames;
     sp<Fence> mPreviousPresentFence = Fence::NO_FENCE;
@@ -580,13 +759,66 @@ private:
     volatile nsecs_t mDebugInTransaction;
     nsecs_t mLastTransactionTime;
     bool mBootFinished;
+    // main thread only
+    bool mProgramSavePending = false;
     bool mForceFullDamage;
     FenceTracker mFenceTracker;
+    FrameStageMonitor mFrameStages;
+    // the last frames of layer state, kept when debug.sf.layer_capture_frames
+    // or dumpsys SurfaceFlinger --layer-capture asks for them
+    LayerCapture mLayerCapture;
+    // boosts the CPUs when the main thread's frames get close to the vsync
+    // period, for debug.sf.workload_boost_ms; 0 never boosts
+    PowerHAL mPowerHAL;
+    nsecs_t mWorkloadBoostDuration = 0;
+    // moving average of the main thread's time per frame
+    nsecs_t mExpectedFrameTime = 0;
+    // frames each layer's long frame history keeps, where the window
+    // animation one is set by debug.sf.frame_history
+    size_t mLayerFrameHistorySize = 0;
+    // bytes of buffers all layers may retain before the ones in the
+    // background are trimmed, from debug.sf.layer_buffer_budget_kb; 0 is
+    // no budget
+    size_t mLayerBufferBudget = 0;
+    // compositions a layer stays off screen before its free buffers are
+    // discarded, from debug.sf.trim_invisible_frames; 0 never trims
+    uint32_t mTrimInvisibleFrames = 0;
+    // bursts of frames in a row a layer has to get by without a third
+    // buffer before its queue is trimmed to two, from
+    // debug.sf.double_buffer_after_segments; 0 never trims
+    uint32_t mDoubleBufferAfterSegments = 0;
+    nsecs_t mLastBufferBudgetCheck = 0;
+    uint64_t mBufferBudgetTrims = 0;
+    uint64_t mBufferBudgetBytesFreed = 0;
 #ifdef USE_HWC2
     bool mPropagateBackpressure = true;
 #endif
     bool mUseHwcVirtualDisplays = true;
 
+    // Restart computeVisibleRegions() below the unchanged top of each
+    // display's layer stack; checking compares every such pass against a
+    // full one.
+    bool mUseVisibleRegionCache = true;
+    bool mCheckVisibleRegions = false;
+#ifdef USE_HWC2
+    // threads rebuildLayerStacks() spreads the layer stacks over, counting
+    // the main thread
+    size_t mLayerStackThreads = 2;
+    WorkerPool mWorkerPool;
+
+    // Runs the primary display at the slowest config its content needs
+    // when debug.sf.refresh_rate_scheduler is set; main thread only.
+    bool mUseRefreshRateScheduler = false;
+    RefreshRateScheduler mRefreshRateScheduler;
+    nsecs_t mLastRefreshRateCheck = 0;
+    bool mRefreshRateCheckPending = false;
+
+    // Leaves the HWC alone for refreshes that change nothing on a display
+    // unless debug.sf.skip_static_frames is 0; main thread only.
+    bool mSkipStaticFrames = true;
+    uint64_t mStaticFramesSkipped = 0;
+#endif
+
     // these are thread safe
     mutable MessageQueue mEventQueue;
     FrameTracker mAnimFrameTracker;
@@ -616,6 +848,13 @@ private:
     mat4 mPreviousColorMatrix;
     mat4 mColorMatrix;
     bool mHasColorMatrix;
+#ifdef USE_HWC2
+    // mColorMatrix times the daltonizer's, which the displays are composed
+    // with. The binder thread changing either sets mColorTransformChanged,
+    // and the main thread recomputes it once in setUpHWComposer().
+    mat4 mColorTransform;
+    volatile int32_t mColorTransformChanged = 1;
+#endif
 
     mat4 mSecondaryColorMatrix;
     bool mHasSecondaryColorMatrix;
@@ -659,6 +898,13 @@ private:
      * In case of display mirroring, this variable should be increased on every display.
      */
     uint32_t mActiveFrameSequence;
+
+    // Moves the app and sf phase offsets with the measured composition time
+    // when debug.sf.adaptive_phase_offset is set; main thread only.
+    PhaseOffsetController mPhaseOffsetController;
+    bool mUseAdaptivePhaseOffsets;
+    // when SurfaceFlinger last woke up to handle a frame
+    nsecs_t mLastInvalidateTime;
 };
 
 }; // namespace android
@@ -24,6 +24,9 @@
 
 #include <gui/BufferItem.h>
 
+#include <ui/GraphicBuffer.h>
+#include <ui/PixelFormat.h>
+
 #include <utils/Errors.h>
 #include <utils/NativeHandle.h>
 #include <utils/Trace.h>
@@ -34,7 +37,7 @@ namespace android {
 
 status_t SurfaceFlingerConsumer::updateTexImage(BufferRejecter* rejecter,
         const DispSync& dispSync, bool* autoRefresh, bool* queuedBuffer,
-        uint64_t maxFrameNumber)
+        uint64_t maxFrameNumber, sp<Fence>* sharedReleaseFence)
 {
     ATRACE_CALL();
     ALOGV("updateTexImage");
@@ -88,11 +91,13 @@ status_t SurfaceFlingerConsumer::updateTexImage(BufferRejecter* rejecter,
     }
 
     // Release the previous buffer.
+    mSharedReleaseFence = sharedReleaseFence;
 #ifdef USE_HWC2
     err = updateAndReleaseLocked(item, &mPendingRelease);
 #else
     err = updateAndReleaseLocked(item);
 #endif
+    mSharedReleaseFence = nullptr;
     if (err != NO_ERROR) {
         return err;
     }
@@ -110,6 +115,18 @@ status_t SurfaceFlingerConsumer::updateTexImage(BufferRejecter* rejecter,
     return err;
 }
 
+sp<Fence> SurfaceFlingerConsumer::createReleaseFenceLocked(EGLDisplay dpy) {
+    if (mSharedReleaseFence == nullptr) {
+        return GLConsumer::createReleaseFenceLocked(dpy);
+    }
+    // Nothing has been drawn since the shared fence was created, so it
+    // covers all the reads of this buffer too
+    if (*mSharedReleaseFence == NULL) {
+        *mSharedReleaseFence = GLConsumer::createReleaseFenceLocked(dpy);
+    }
+    return *mSharedReleaseFence;
+}
+
 status_t SurfaceFlingerConsumer::bindTextureImage()
 {
     Mutex::Autolock lock(mMutex);
@@ -141,6 +158,30 @@ sp<NativeHandle> SurfaceFlingerConsumer::getSidebandStream() const {
     return mConsumer->getSidebandStream();
 }
 
+size_t SurfaceFlingerConsumer::getRetainedBufferBytes(
+        size_t* outNumBuffers) const {
+    Mutex::Autolock lock(mMutex);
+    size_t bytes = 0;
+    size_t count = 0;
+    for (int i = 0; i < BufferQueue::NUM_BUFFER_SLOTS; i++) {
+        const sp<GraphicBuffer>& buffer(mSlots[i].mGraphicBuffer);
+        if (buffer == NULL) {
+            continue;
+        }
+        // the same estimate GraphicBufferAllocator::dump() makes, except
+        // that formats without a fixed pixel size count as 4:2:0 YUV
+        const size_t pixels = size_t(buffer->getStride()) *
+                buffer->getHeight();
+        const uint32_t bpp = bytesPerPixel(buffer->getPixelFormat());
+        bytes += bpp > 0 ? pixels * bpp : pixels * 3 / 2;
+        count++;
+    }
+    if (outNumBuffers) {
+        *outNumBuffers = count;
+    }
+    return bytes;
+}
+
 // We need to determine the time when a buffer acquired now will be
 // displayed.  This can be calculated:
 //   time when previous buffer's actual-present fence was signaled
@@ -259,6 +300,12 @@ bool SurfaceFlingerConsumer::getFrameTimestamps(uint64_t frameNumber,
     return l.get() ? l->getFrameTimestamps(frameNumber, outTimestamps) : false;
 }
 
+status_t SurfaceFlingerConsumer::createFrameEventChannel(
+        sp<BitTube>* outChannel) {
+    sp<const Layer> l = mLayer.promote();
+    return l.get() ? l->createFrameEventChannel(outChannel) : NO_INIT;
+}
+
 // ---------------------------------------------------------------------------
 }; // namespace android
 
@@ -40,7 +40,8 @@ public:
             uint32_t tex, const Layer* layer)
         : GLConsumer(consumer, tex, GLConsumer::TEXTURE_EXTERNAL, false, false),
           mTransformToDisplayInverse(false), mSurfaceDamage(),
-          mPrevReleaseFence(Fence::NO_FENCE), mLayer(layer)
+          mPrevReleaseFence(Fence::NO_FENCE), mSharedReleaseFence(nullptr),
+          mLayer(layer)
     {}
 
     class BufferRejecter {
@@ -59,9 +60,13 @@ public:
     // reject the newly acquired buffer.  Unlike the GLConsumer version,
     // this does not guarantee that the buffer has been bound to the GL
     // texture.
+    // If sharedReleaseFence is given, the previous buffer is released with
+    // the fence it holds, which is first created if it is NULL; the caller
+    // must not issue GL commands while it keeps the fence around.
     status_t updateTexImage(BufferRejecter* rejecter, const DispSync& dispSync,
             bool* autoRefresh, bool* queuedBuffer,
-            uint64_t maxFrameNumber = 0);
+            uint64_t maxFrameNumber = 0,
+            sp<Fence>* sharedReleaseFence = nullptr);
 
     // See GLConsumer::bindTextureImageLocked().
     status_t bindTextureImage();
@@ -77,6 +82,10 @@ public:
 
     sp<NativeHandle> getSidebandStream() const;
 
+    // Estimated bytes of the buffers this consumer holds slot references
+    // to, which keep them allocated whatever state the queue has them in.
+    size_t getRetainedBufferBytes(size_t* outNumBuffers) const;
+
     nsecs_t computeExpectedPresent(const DispSync& dispSync);
 
     virtual void setReleaseFence(const sp<Fence>& fence) override;
@@ -87,6 +96,10 @@ public:
 
     virtual bool getFrameTimestamps(uint64_t frameNumber,
             FrameTimestamps* outTimestamps) const override;
+    virtual status_t createFrameEventChannel(sp<BitTube>* outChannel) override;
+
+protected:
+    virtual sp<Fence> createReleaseFenceLocked(EGLDisplay dpy) override;
 
 private:
     virtual void onSidebandStreamChanged();
@@ -110,6 +123,10 @@ private:
     // The release fence of the already displayed buffer (previous frame).
     sp<Fence> mPrevReleaseFence;
 
+    // The release fence shared with the other layers latched in this
+    // updateTexImage() pass, if any
+    sp<Fence>* mSharedReleaseFence;
+
     // The layer for this SurfaceFlingerConsumer
     wp<const Layer> mLayer;
 };
@@ -22,12 +22,15 @@
 
 #include <stdint.h>
 #include <sys/types.h>
+#include <unistd.h>
 #include <errno.h>
 #include <math.h>
 #include <dlfcn.h>
 #include <inttypes.h>
 #include <stdatomic.h>
 
+#include <algorithm>
+
 #include <EGL/egl.h>
 
 #include <cutils/iosched_policy.h>
@@ -75,6 +78,7 @@
 #include "DisplayDevice.h"
 #include "DispSync.h"
 #include "EventControlThread.h"
+#include "FenceMonitor.h"
 #include "EventThread.h"
 #include "Layer.h"
 #include "LayerDim.h"
@@ -173,7 +177,10 @@ SurfaceFlinger::SurfaceFlinger()
         mFrameBuckets(),
         mTotalTime(0),
         mLastSwapTime(0),
-        mActiveFrameSequence(0)
+        mActiveFrameSequence(0),
+        mPhaseOffsetController(vsyncPhaseOffsetNs, sfVsyncPhaseOffsetNs),
+        mUseAdaptivePhaseOffsets(false),
+        mLastInvalidateTime(0)
 {
     ALOGI("SurfaceFlinger is starting");
 
@@ -201,6 +208,41 @@ SurfaceFlinger::SurfaceFlinger()
     mUseHwcVirtualDisplays = !atoi(value);
     ALOGI_IF(!mUseHwcVirtualDisplays, "Disabling HWC virtual displays");
 
+    property_get("debug.sf.visible_region_cache", value, "1");
+    mUseVisibleRegionCache = atoi(value);
+    property_get("debug.sf.check_visible_regions", value, "0");
+    mCheckVisibleRegions = mUseVisibleRegionCache && atoi(value);
+    ALOGI_IF(mCheckVisibleRegions, "Checking cached visible regions");
+
+    property_get("debug.sf.adaptive_phase_offset", value, "0");
+    mUseAdaptivePhaseOffsets = atoi(value);
+    ALOGI_IF(mUseAdaptivePhaseOffsets, "Enabling adaptive phase offsets");
+
+    property_get("debug.sf.frame_history", value, "1800");
+    mAnimFrameTracker.setHistoryCapacity(std::max(atoi(value), 0));
+    property_get("debug.sf.frame_stats_dir", value, "");
+    if (value[0]) {
+        const String8 dir(value);
+        property_get("debug.sf.frame_stats_frames", value, "65536");
+        mAnimFrameTracker.setStatsFile(
+                new FrameStatsFile(dir, std::max(atoi(value), 1)));
+        ALOGI("Writing frame stats to %s", dir.string());
+    }
+    property_get("debug.sf.layer_frame_history", value, "0");
+    mLayerFrameHistorySize = std::max(atoi(value), 0);
+    property_get("debug.sf.layer_capture_frames", value, "0");
+    mLayerCapture.setCapacity(std::max(atoi(value), 0));
+
+    property_get("debug.sf.workload_boost_ms", value, "0");
+    mWorkloadBoostDuration = ms2ns(std::max(atoi(value), 0));
+
+    property_get("debug.sf.layer_buffer_budget_kb", value, "0");
+    mLayerBufferBudget = size_t(std::max(atoi(value), 0)) * 1024;
+    property_get("debug.sf.trim_invisible_frames", value, "600");
+    mTrimInvisibleFrames = std::max(atoi(value), 0);
+    property_get("debug.sf.double_buffer_after_segments", value, "5");
+    mDoubleBufferAfterSegments = std::max(atoi(value), 0);
+
     // we store the value as orientation:
     // 90 -> 1, 180 -> 2, 270 -> 3
     mHardwareRotation = property_get_int32("ro.sf.hwrotation", 0) / 90;
@@ -346,7 +388,31 @@ void SurfaceFlinger::deleteTextureAsync(uint32_t texture) {
             return true;
         }
     };
-    postMessageAsync(new MessageDestroyGLTexture(getRenderEngine(), texture));
+    postMessageAsync(new MessageDestroyGLTexture(getRenderEngine(), texture),
+            0, MessageQueue::FLAG_IDLE);
+}
+
+void SurfaceFlinger::scheduleProgramSave() {
+    class MessageSavePrograms : public MessageBase {
+        SurfaceFlinger& mFlinger;
+    public:
+        explicit MessageSavePrograms(SurfaceFlinger& flinger)
+            : mFlinger(flinger) {
+        }
+        virtual bool handler() {
+            mFlinger.mProgramSavePending = false;
+            mFlinger.getRenderEngine().saveProgramsIfDirty();
+            return true;
+        }
+    };
+
+    if (mProgramSavePending) {
+        return;
+    }
+    if (postMessageAsync(new MessageSavePrograms(*this), 0,
+            MessageQueue::FLAG_IDLE) == NO_ERROR) {
+        mProgramSavePending = true;
+    }
 }
 
 class DispSyncSource : public VSyncSource, private DispSync::Callback {
@@ -468,12 +534,16 @@ private:
 void SurfaceFlinger::init() {
     ALOGI(  "SurfaceFlinger's main thread ready to run. "
             "Initializing graphics H/W...");
+    ATRACE_CALL();
+    const nsecs_t initStart = systemTime();
+    nsecs_t stageStart = initStart;
 
     Mutex::Autolock _l(mStateLock);
 
     // initialize EGL for the default display
     mEGLDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
     eglInitialize(mEGLDisplay, NULL, NULL);
+    stageStart = recordInitStage("EGL initialization", stageStart);
 
     // start the EventThread
     if (vsyncPhaseOffsetNs != sfVsyncPhaseOffsetNs) {
@@ -504,11 +574,13 @@ void SurfaceFlinger::init() {
            ALOGE("Couldn't set SCHED_FIFO for SFEventThread");
        }
     }
+    stageStart = recordInitStage("EventThreads", stageStart);
 
     // Initialize the H/W composer object.  There may or may not be an
     // actual hardware composer underneath.
     mHwc = DisplayUtils::getInstance()->getHWCInstance(this,
         *static_cast<HWComposer::EventHandler *>(this));
+    stageStart = recordInitStage("HWComposer load", stageStart);
 
     // get a RenderEngine for the given display / config (can't fail)
     mRenderEngine = RenderEngine::create(mEGLDisplay, mHwc->getVisualID());
@@ -519,6 +591,8 @@ void SurfaceFlinger::init() {
     LOG_ALWAYS_FATAL_IF(mEGLContext == EGL_NO_CONTEXT,
             "couldn't create EGLContext");
 
+    stageStart = recordInitStage("RenderEngine", stageStart);
+
     // initialize our non-virtual displays
     for (size_t i=0 ; i<DisplayDevice::NUM_BUILTIN_DISPLAY_TYPES ; i++) {
         DisplayDevice::DisplayType type((DisplayDevice::DisplayType)i);
@@ -559,10 +633,17 @@ void SurfaceFlinger::init() {
             mDisplays.add(token, hw);
         }
     }
+    stageStart = recordInitStage("builtin displays", stageStart);
 
     // make the GLContext current so that we can create textures when creating Layers
     // (which may happens before we render something)
     getDefaultDisplayDevice()->makeCurrent(mEGLDisplay, mEGLContext);
+    stageStart = recordInitStage("make current", stageStart);
+
+    mFenceMonitor = new FenceMonitor();
+    mFenceMonitor->run("FenceMonitor", PRIORITY_NORMAL);
+    mFenceTracker.setFenceMonitor(mFenceMonitor);
+    mAnimFrameTracker.setFenceMonitor(mFenceMonitor);
 
     mEventControlThread = new EventControlThread(this);
     mEventControlThread->run("EventControl", PRIORITY_URGENT_DISPLAY);
@@ -578,13 +659,46 @@ void SurfaceFlinger::init() {
 
     // set initial conditions (e.g. unblank default device)
     initializeDisplays();
+    stageStart = recordInitStage("display power on", stageStart);
 
     mRenderEngine->primeCache();
+    stageStart = recordInitStage("shader cache", stageStart);
 
     // start boot animation
     startBootAnim();
+    mBootAnimStartTime = systemTime();
+
+    ALOGI("Initialized in %.1f ms, boot animation started %.1f ms after "
+            "SurfaceFlinger was created", ns2us(stageStart - initStart) / 1000.0,
+            ns2us(mBootAnimStartTime - mBootTime) / 1000.0);
+}
+
+nsecs_t SurfaceFlinger::recordInitStage(const char* name, nsecs_t start) {
+    const nsecs_t now = systemTime();
+    mInitStages.push_back({name, now - start, false});
+    return now;
+}
+
+void SurfaceFlinger::dumpInitStagesLocked(String8& result) const {
+    nsecs_t total = 0;
+    for (const InitStage& stage : mInitStages) {
+        result.appendFormat("    %-22s %8.2f ms%s\n", stage.name,
+                ns2us(stage.duration) / 1000.0,
+                stage.parallel ? " (in parallel)" : "");
+        if (!stage.parallel) {
+            total += stage.duration;
+        }
+    }
+    result.appendFormat("    init() took %.2f ms", ns2us(total) / 1000.0);
+    if (mBootAnimStartTime != 0) {
+        result.appendFormat(", boot animation started %.2f ms after "
+                "SurfaceFlinger was created",
+                ns2us(mBootAnimStartTime - mBootTime) / 1000.0);
+    }
+    result.append("\n");
 }
 
+
 int32_t SurfaceFlinger::allocateHwcDisplayId(DisplayDevice::DisplayType type) {
     return (uint32_t(type) < DisplayDevice::NUM_BUILTIN_DISPLAY_TYPES) ?
             type : mHwc->allocateDisplayId();
@@ -928,13 +1042,13 @@ void SurfaceFlinger::signalRefresh() {
 }
 
 status_t SurfaceFlinger::postMessageAsync(const sp<MessageBase>& msg,
-        nsecs_t reltime, uint32_t /* flags */) {
-    return mEventQueue.postMessage(msg, reltime);
+        nsecs_t reltime, uint32_t flags) {
+    return mEventQueue.postMessage(msg, reltime, flags);
 }
 
 status_t SurfaceFlinger::postMessageSync(const sp<MessageBase>& msg,
-        nsecs_t reltime, uint32_t /* flags */) {
-    status_t res = mEventQueue.postMessage(msg, reltime);
+        nsecs_t reltime, uint32_t flags) {
+    status_t res = mEventQueue.postMessage(msg, reltime, flags);
     if (res == NO_ERROR) {
         msg->wait();
     }
@@ -983,10 +1097,18 @@ void SurfaceFlinger::resyncToHardwareVsync(bool makeAvailable) {
 }
 
 void SurfaceFlinger::disableHardwareVsync(bool makeUnavailable) {
+    // A model that only just fit the hardware vsyncs is likely to need them
+    // again soon; interactions that keep resyncing shouldn't turn them on and
+    // off every time.
+    static constexpr nsecs_t kMarginalModelDisableDelay = ms2ns(200);
+
     Mutex::Autolock _l(mHWVsyncLock);
     if (mPrimaryHWVsyncEnabled) {
         //eventControl(HWC_DISPLAY_PRIMARY, SurfaceFlinger::EVENT_VSYNC, false);
-        mEventControlThread->setVsyncEnabled(false);
+        const bool linger = !makeUnavailable &&
+                mPrimaryDispSync.isModelMarginal();
+        mEventControlThread->setVsyncEnabled(false,
+                linger ? kMarginalModelDisableDelay : 0);
         mPrimaryDispSync.endResync();
         mPrimaryHWVsyncEnabled = false;
     }
@@ -1052,14 +1174,20 @@ void SurfaceFlinger::onMessageReceived(int32_t what) {
     ATRACE_CALL();
     switch (what) {
         case MessageQueue::INVALIDATE: {
+            mLastInvalidateTime = systemTime();
+            mFrameStages.begin();
             bool refreshNeeded = handleMessageTransaction();
+            mFrameStages.mark(FrameStageMonitor::TRANSACTION);
             refreshNeeded |= handleMessageInvalidate();
+            mFrameStages.mark(FrameStageMonitor::PAGE_FLIP);
             refreshNeeded |= mRepaintEverything;
             if (refreshNeeded) {
                 // Signal a refresh if a transaction modified the window state,
                 // a new buffer was latched, or if HWC has requested a full
                 // repaint
                 signalRefresh();
+            } else {
+                endFrameStages();
             }
             break;
         }
@@ -1071,6 +1199,7 @@ void SurfaceFlinger::onMessageReceived(int32_t what) {
 }
 
 bool SurfaceFlinger::handleMessageTransaction() {
+    applyQueuedTransactions();
     uint32_t transactionFlags = peekTransactionFlags(eTransactionMask);
     if (transactionFlags) {
         handleTransaction(transactionFlags);
@@ -1088,13 +1217,126 @@ void SurfaceFlinger::handleMessageRefresh() {
     ATRACE_CALL();
 
     nsecs_t refreshStartTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    mFrameStages.begin();
 
     preComposition();
+    mFrameStages.mark(FrameStageMonitor::PRE_COMPOSITION);
     rebuildLayerStacks();
+    mFrameStages.mark(FrameStageMonitor::REBUILD_LAYER_STACKS);
     setUpHWComposer();
     doDebugFlashRegions();
+    mFrameStages.mark(FrameStageMonitor::SET_UP_HWC);
     doComposition();
     postComposition(refreshStartTime);
+    captureLayers();
+    mFrameStages.mark(FrameStageMonitor::POST_COMPOSITION);
+    endFrameStages();
+}
+
+void SurfaceFlinger::captureLayers() {
+    if (CC_LIKELY(!mLayerCapture.isEnabled())) {
+        return;
+    }
+    ATRACE_CALL();
+
+    mLayerCapture.beginFrame(systemTime(SYSTEM_TIME_MONOTONIC));
+    const size_t numDisplays = std::min(mDisplays.size(),
+            size_t(LayerCapture::MAX_DISPLAYS));
+    for (size_t dpy = 0; dpy < numDisplays; dpy++) {
+        sp<const DisplayDevice> hw(mDisplays[dpy]);
+        const uint32_t flags =
+                (hw->isDisplayOn() ? LayerCapture::DISPLAY_ON : 0) |
+                (hw->isSecure() ? LayerCapture::DISPLAY_SECURE : 0);
+        mLayerCapture.addDisplay(hw->getLayerStack(), hw->getWidth(),
+                hw->getHeight(), flags);
+    }
+
+    const LayerVector& layers(mDrawingState.layersSortedByZ);
+    for (size_t i = 0; i < layers.size(); i++) {
+        mLayerCapture.addLayer(*layers[i]);
+    }
+
+    HWComposer& hwc(getHwComposer());
+    for (size_t dpy = 0; dpy < numDisplays; dpy++) {
+        sp<const DisplayDevice> hw(mDisplays[dpy]);
+        const int32_t id = hw->getHwcDisplayId();
+        const Vector< sp<Layer> >& visibleLayers(hw->getVisibleLayersSortedByZ());
+        HWComposer::LayerListIterator cur = hwc.begin(id);
+        const HWComposer::LayerListIterator end = hwc.end(id);
+        // without a h/w composer list everything is drawn with GLES
+        const bool useHwc = cur != end;
+        for (size_t i = 0; i < visibleLayers.size(); i++) {
+            uint8_t composition = LayerCapture::COMPOSITION_CLIENT;
+            if (useHwc) {
+                if (cur == end) {
+                    break;
+                }
+                switch (cur->getCompositionType()) {
+                    case HWC_FRAMEBUFFER:
+                        break;
+                    case HWC_OVERLAY:
+                        composition = LayerCapture::COMPOSITION_DEVICE;
+                        break;
+                    case HWC_CURSOR_OVERLAY:
+                        composition = LayerCapture::COMPOSITION_CURSOR;
+                        break;
+                    case HWC_SIDEBAND:
+                        composition = LayerCapture::COMPOSITION_SIDEBAND;
+                        break;
+                    default:
+                        composition = LayerCapture::COMPOSITION_OTHER;
+                        break;
+                }
+                ++cur;
+            }
+            const ssize_t index = layers.indexOf(visibleLayers[i]);
+            if (index >= 0) {
+                mLayerCapture.setComposition(size_t(index), dpy, composition);
+            }
+        }
+    }
+    mLayerCapture.endFrame();
+}
+
+void SurfaceFlinger::endFrameStages() {
+    const nsecs_t deadline = mPrimaryDispSync.getPeriod();
+    FrameStageMonitor::Composition composition;
+    if (mFrameStages.getFrameTime() > deadline) {
+        HWComposer& hwc(getHwComposer());
+        for (size_t dpy = 0; dpy < mDisplays.size(); dpy++) {
+            sp<const DisplayDevice> hw(mDisplays[dpy]);
+            const int32_t id = hw->getHwcDisplayId();
+            const size_t count = hw->getVisibleLayersSortedByZ().size();
+            composition.layers += count;
+            HWComposer::LayerListIterator cur = hwc.begin(id);
+            const HWComposer::LayerListIterator end = hwc.end(id);
+            if (cur == end) {
+                // not using h/w composer
+                composition.clientLayers += count;
+                continue;
+            }
+            for (size_t i = 0; i < count && cur != end; ++i, ++cur) {
+                switch (cur->getCompositionType()) {
+                    case HWC_FRAMEBUFFER:
+                        composition.clientLayers++;
+                        break;
+                    case HWC_OVERLAY:
+                        composition.deviceLayers++;
+                        break;
+                    default:
+                        composition.otherLayers++;
+                        break;
+                }
+            }
+        }
+    }
+    const nsecs_t frameTime = mFrameStages.getFrameTime();
+    mFrameStages.endFrame(deadline, composition);
+
+    // weigh the last frame by a quarter, so that one slow frame alone
+    // doesn't boost but a few in a row do, before they miss the period
+    mExpectedFrameTime = (3 * mExpectedFrameTime + frameTime) / 4;
+    mPowerHAL.workloadHint(mExpectedFrameTime, deadline, mWorkloadBoostDuration);
 }
 
 void SurfaceFlinger::doDebugFlashRegions()
@@ -1159,8 +1401,10 @@ void SurfaceFlinger::postComposition(nsecs_t refreshStartTime)
     for (size_t i=0 ; i<count ; i++) {
         bool frameLatched = layers[i]->onPostComposition();
         if (frameLatched) {
+            auto history = layers[i]->getOccupancyHistory(false);
+            layers[i]->updateBufferCount(history, mDoubleBufferAfterSegments);
             recordBufferingStats(layers[i]->getName().string(),
-                    layers[i]->getOccupancyHistory(false));
+                    std::move(history));
         }
     }
 
@@ -1199,12 +1443,24 @@ void SurfaceFlinger::postComposition(nsecs_t refreshStartTime)
         mAnimFrameTracker.advanceFrame();
     }
 
+    notifyTransactionsCompleted(presentFence);
+    trimLayerBuffers();
+
     dumpDrawCycle(false);
 
     if (hw->getPowerMode() == HWC_POWER_MODE_OFF) {
         return;
     }
 
+    if (mUseAdaptivePhaseOffsets) {
+        updatePhaseOffsets(hw->getClientTargetAcquireFence());
+    }
+
+    // compiled programs are saved after the frame, once boot has finished
+    if (mBootFinished && getRenderEngine().hasUnsavedPrograms()) {
+        scheduleProgramSave();
+    }
+
     nsecs_t currentTime = systemTime();
     if (mHasPoweredOff) {
         mHasPoweredOff = false;
@@ -1222,6 +1478,27 @@ void SurfaceFlinger::postComposition(nsecs_t refreshStartTime)
     mLastSwapTime = currentTime;
 }
 
+void SurfaceFlinger::updatePhaseOffsets(
+        const sp<Fence>& glesCompositionDoneFence) {
+    const nsecs_t period = mPrimaryDispSync.getPeriod();
+    mPhaseOffsetController.addFrame(mLastInvalidateTime, systemTime(),
+            glesCompositionDoneFence, period);
+
+    nsecs_t appOffset;
+    nsecs_t sfOffset;
+    if (mPhaseOffsetController.updateOffsets(period, &appOffset, &sfOffset)) {
+        ATRACE_INT64("AppPhaseOffset", appOffset);
+        ATRACE_INT64("SfPhaseOffset", sfOffset);
+        if (mSFEventThread != NULL) {
+            mEventThread->setPhaseOffset(appOffset);
+            mSFEventThread->setPhaseOffset(sfOffset);
+        } else {
+            // app and sf share a vsync source, and their offsets are equal
+            mEventThread->setPhaseOffset(sfOffset);
+        }
+    }
+}
+
 void SurfaceFlinger::rebuildLayerStacks() {
     updateExtendedMode();
     // rebuild the visible layer list per screen
@@ -1240,7 +1517,13 @@ void SurfaceFlinger::rebuildLayerStacks() {
             const Rect bounds(hw->getBounds());
             if (hw->isDisplayOn()) {
                 computeVisibleRegions(hw->getHwcDisplayId(), layers,
-                        hw->getLayerStack(), dirtyRegion, opaqueRegion);
+                        hw->getLayerStack(), dirtyRegion, opaqueRegion,
+                        hw->visibleRegionCache, hw->aboveLayersIndex);
+                if (CC_UNLIKELY(mCheckVisibleRegions)) {
+                    checkVisibleRegions(hw->getHwcDisplayId(), layers,
+                            hw->getLayerStack(), dirtyRegion, opaqueRegion,
+                            hw->visibleRegionCache, hw->aboveLayersIndex);
+                }
 
                 const size_t count = layers.size();
                 for (size_t i=0 ; i<count ; i++) {
@@ -1398,7 +1681,9 @@ void SurfaceFlinger::doComposition() {
         // inform the h/w that we're done compositing
         hw->compositionComplete();
     }
+    mFrameStages.mark(FrameStageMonitor::COMPOSITION);
     postFramebuffer();
+    mFrameStages.mark(FrameStageMonitor::POST_FRAMEBUFFER);
 }
 
 void SurfaceFlinger::postFramebuffer()
@@ -1832,7 +2117,8 @@ void SurfaceFlinger::commitTransaction()
 
 void SurfaceFlinger::computeVisibleRegions(size_t dpy,
         const LayerVector& currentLayers, uint32_t layerStack,
-        Region& outDirtyRegion, Region& outOpaqueRegion)
+        Region& outDirtyRegion, Region& outOpaqueRegion,
+        VisibleRegionCache& cache, LayerSpatialIndex& aboveLayersIndex)
 {
     ATRACE_CALL();
 
@@ -1841,10 +2127,15 @@ void SurfaceFlinger::computeVisibleRegions(size_t dpy,
     Region dirty;
 
     outDirtyRegion.clear();
+    aboveLayersIndex.clear();
     bool bIgnoreLayers = false;
     int indexLOI = -1;
     getIndexLOI(dpy, currentLayers, bIgnoreLayers, indexLOI);
 
+    // layers of interest change which layers are considered, which the
+    // cache doesn't know about
+    cache.begin(layerStack, mUseVisibleRegionCache && !bIgnoreLayers);
+
     size_t i = currentLayers.size();
     while (i--) {
         const sp<Layer>& layer = currentLayers[i];
@@ -1857,6 +2148,14 @@ void SurfaceFlinger::computeVisibleRegions(size_t dpy,
                               layerStack, i))
             continue;
 
+        // if neither this layer nor any above it changed since the last
+        // pass, its regions are still correct
+        const VisibleRegionCache::Inputs inputs(layer);
+        if (cache.reuse(layer, inputs, aboveOpaqueLayers, aboveCoveredLayers)) {
+            aboveLayersIndex.insert(inputs.bounds);
+            continue;
+        }
+
         /*
          * opaqueRegion: area of a surface that is fully opaque.
          */
@@ -1889,8 +2188,8 @@ void SurfaceFlinger::computeVisibleRegions(size_t dpy,
 
         // handle hidden surfaces by setting the visible region to empty
         if (CC_LIKELY(layer->isVisible())) {
-            const bool translucent = !layer->isOpaque(s);
-            Rect bounds(s.active.transform.transform(layer->computeBounds()));
+            const bool translucent = inputs.translucent;
+            Rect bounds(inputs.bounds);
             visibleRegion.set(bounds);
             if (!visibleRegion.isEmpty()) {
                 // Remove the transparent area from the visible region
@@ -1916,14 +2215,25 @@ void SurfaceFlinger::computeVisibleRegions(size_t dpy,
             }
         }
 
+        // Layers above can only cover or occlude this one if one of them
+        // overlaps it, which the index answers without going through the
+        // accumulated regions
+        const bool overlapped =
+                aboveLayersIndex.intersects(visibleRegion.getBounds());
+        aboveLayersIndex.insert(visibleRegion.getBounds());
+
         // Clip the covered region to the visible region
-        coveredRegion = aboveCoveredLayers.intersect(visibleRegion);
+        if (overlapped) {
+            coveredRegion = aboveCoveredLayers.intersect(visibleRegion);
+        }
 
         // Update aboveCoveredLayers for next (lower) layer
         aboveCoveredLayers.orSelf(visibleRegion);
 
         // subtract the opaque region covered by the layers above us
-        visibleRegion.subtractSelf(aboveOpaqueLayers);
+        if (overlapped) {
+            visibleRegion.subtractSelf(aboveOpaqueLayers);
+        }
 
         // compute this layer's dirty region
         if (layer->contentDirty) {
@@ -1964,11 +2274,64 @@ void SurfaceFlinger::computeVisibleRegions(size_t dpy,
         layer->setCoveredRegion(coveredRegion);
         layer->setVisibleNonTransparentRegion(
                 visibleRegion.subtract(transparentRegion));
+
+        cache.record(layer, inputs, aboveOpaqueLayers, aboveCoveredLayers);
     }
 
+    cache.end(aboveOpaqueLayers);
     outOpaqueRegion = aboveOpaqueLayers;
 }
 
+void SurfaceFlinger::checkVisibleRegions(size_t dpy,
+        const LayerVector& currentLayers, uint32_t layerStack,
+        Region& outDirtyRegion, Region& outOpaqueRegion,
+        VisibleRegionCache& cache, LayerSpatialIndex& aboveLayersIndex)
+{
+    ATRACE_CALL();
+
+    // Keep what the cached pass produced, then redo it from scratch
+    const size_t count = currentLayers.size();
+    Vector<Region> cached;
+    cached.setCapacity(count * 3);
+    for (size_t i=0 ; i<count ; i++) {
+        const sp<Layer>& layer(currentLayers[i]);
+        cached.add(layer->visibleRegion);
+        cached.add(layer->coveredRegion);
+        cached.add(layer->visibleNonTransparentRegion);
+    }
+
+    cache.invalidate();
+    Region dirtyRegion;
+    Region opaqueRegion;
+    computeVisibleRegions(dpy, currentLayers, layerStack,
+            dirtyRegion, opaqueRegion, cache, aboveLayersIndex);
+
+    bool mismatch = false;
+    for (size_t i=0 ; i<count ; i++) {
+        const sp<Layer>& layer(currentLayers[i]);
+        if (layer->getDrawingState().layerStack != layerStack)
+            continue;
+        if (!(cached[i*3] ^ layer->visibleRegion).isEmpty() ||
+                !(cached[i*3 + 1] ^ layer->coveredRegion).isEmpty() ||
+                !(cached[i*3 + 2] ^ layer->visibleNonTransparentRegion).isEmpty()) {
+            ALOGE("cached visible regions of layer %s are wrong",
+                    layer->getName().string());
+            mismatch = true;
+        }
+    }
+    if (!(outOpaqueRegion ^ opaqueRegion).isEmpty()) {
+        ALOGE("cached opaque region of layer stack %u is wrong", layerStack);
+        mismatch = true;
+    }
+
+    if (mismatch) {
+        // the full pass left the right regions in the layers; make sure
+        // whatever they cover gets redrawn too
+        outDirtyRegion.orSelf(dirtyRegion);
+        outOpaqueRegion = opaqueRegion;
+    }
+}
+
 void SurfaceFlinger::invalidateLayerStack(uint32_t layerStack,
         const Region& dirty) {
     for (size_t dpy=0 ; dpy<mDisplays.size() ; dpy++) {
@@ -2010,6 +2373,7 @@ bool SurfaceFlinger::handlePageFlip()
             layer->useEmptyDamage();
         }
     }
+    mLatchReleaseFence.clear();
     for (size_t i = 0, count = layersWithQueuedFrames.size() ; i<count ; i++) {
         Layer* layer = layersWithQueuedFrames[i];
         const Region dirty(layer->latchBuffer(visibleRegions));
@@ -2017,6 +2381,7 @@ bool SurfaceFlinger::handlePageFlip()
         const Layer::State& s(layer->getDrawingState());
         invalidateLayerStack(s.layerStack, dirty);
     }
+    mLatchReleaseFence.clear();
 
     mVisibleRegionsDirty |= visibleRegions;
 
@@ -2067,6 +2432,11 @@ void SurfaceFlinger::doDisplayComposition(const sp<const DisplayDevice>& hw,
             // This is needed because PARTIAL_UPDATES only takes one
             // rectangle instead of a region (see DisplayDevice::flip())
             dirtyRegion.set(hw->swapRegion.bounds());
+        } else if (hw->usesBufferAge()) {
+            // doComposeSurfaces() adds whatever the buffer it is given has
+            // missed since it was last on screen
+            hw->damageHistory.addDamage(dirtyRegion);
+            hw->swapRegion = dirtyRegion;
         } else {
             // we need to redraw everything (the whole screen)
             dirtyRegion.set(hw->bounds());
@@ -2098,14 +2468,23 @@ void SurfaceFlinger::doDisplayComposition(const sp<const DisplayDevice>& hw,
     hw->swapBuffers(getHwComposer());
 }
 
-bool SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& hw, const Region& dirty)
+bool SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& hw, const Region& inDirty)
 {
+    Region dirty(inDirty);
     RenderEngine& engine(getRenderEngine());
     const int32_t id = hw->getHwcDisplayId();
     HWComposer& hwc(getHwComposer());
     HWComposer::LayerListIterator cur = hwc.begin(id);
     const HWComposer::LayerListIterator end = hwc.end(id);
 
+    // whether the client target will hold the whole frame, so that later
+    // frames can draw just what changed into it
+    bool clientTargetReusable = false;
+    // set when only part of the client target is drawn; the layers draw
+    // their whole mesh whatever their clip, so the GL scissor has to keep
+    // them, translucent ones especially, off the pixels kept from before
+    bool partialRepaint = false;
+    Rect repaintBounds;
     bool hasGlesComposition = hwc.hasGlesComposition(id);
     if (hasGlesComposition) {
         if (!hw->makeCurrent(mEGLDisplay, mEGLContext)) {
@@ -2128,7 +2507,28 @@ bool SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& hw, const
             // GPUs doing a "clean slate" clear might be more efficient.
             // We'll revisit later if needed.
             engine.clearWithColor(0, 0, 0, 0);
+            if (hw->usesBufferAge()) {
+                // everything has to be drawn again on the cleared buffer
+                dirty.set(hw->bounds());
+            }
         } else {
+            if (hw->usesBufferAge()) {
+                // only what this buffer has missed needs to be drawn
+                clientTargetReusable = true;
+                Region repaint;
+                if (hw->damageHistory.getRepaintRegion(
+                        hw->getBufferAge(), &repaint)) {
+                    if (!repaint.getBounds().intersect(hw->bounds(),
+                            &repaintBounds)) {
+                        repaintBounds.clear();
+                    }
+                    dirty.set(repaintBounds);
+                    partialRepaint = true;
+                } else {
+                    dirty.set(hw->bounds());
+                }
+            }
+
             // we start with the whole screen area
             const Region bounds(hw->getBounds());
 
@@ -2167,6 +2567,17 @@ bool SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& hw, const
                         scissor.getWidth(), scissor.getHeight());
             }
         }
+
+        if (partialRepaint) {
+            Rect scissor(repaintBounds);
+            if (hw->getDisplayType() != DisplayDevice::DISPLAY_PRIMARY &&
+                    !repaintBounds.intersect(hw->getScissor(), &scissor)) {
+                scissor.clear();
+            }
+            const uint32_t height = hw->getHeight();
+            engine.setScissor(scissor.left, height - scissor.bottom,
+                    scissor.getWidth(), scissor.getHeight());
+        }
     }
 
     /*
@@ -2222,6 +2633,11 @@ bool SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& hw, const
         }
     }
 
+    if (hasGlesComposition && hw->usesBufferAge()) {
+        hw->damageHistory.recordComposition(dirty, hw->bounds(),
+                clientTargetReusable);
+    }
+
     // disable scissor at the end of the frame
     engine.disableScissor();
     return true;
@@ -2315,6 +2731,49 @@ void SurfaceFlinger::setTransactionState(
         }
     }
 
+    // the caller's queued asynchronous transactions must not be overtaken
+    transactionFlags |= applyQueuedTransactionsLocked(
+            IPCThreadState::self()->getCallingPid());
+    transactionFlags |= applyTransactionStateLocked(state, displays);
+
+    // If a synchronous transaction is explicitly requested without any changes,
+    // force a transaction anyway. This can be used as a flush mechanism for
+    // previous async transactions.
+    if (transactionFlags == 0 && (flags & eSynchronous)) {
+        transactionFlags = eTransactionNeeded;
+    }
+
+    if (transactionFlags) {
+        // this triggers the transaction
+        setTransactionFlags(transactionFlags);
+
+        // if this is a synchronous transaction, wait for it to take effect
+        // before returning.
+        if (flags & eSynchronous) {
+            mTransactionPending = true;
+        }
+        if (flags & eAnimation) {
+            mAnimTransactionPending = true;
+        }
+        while (mTransactionPending) {
+            status_t err = mTransactionCV.waitRelative(mStateLock, s2ns(5));
+            if (CC_UNLIKELY(err != NO_ERROR)) {
+                // just in case something goes wrong in SF, return to the
+                // called after a few seconds.
+                ALOGW_IF(err == TIMED_OUT, "setTransactionState timed out!");
+                mTransactionPending = false;
+                break;
+            }
+        }
+    }
+}
+
+uint32_t SurfaceFlinger::applyTransactionStateLocked(
+        const Vector<ComposerState>& state,
+        const Vector<DisplayState>& displays)
+{
+    uint32_t transactionFlags = 0;
+
     size_t count = displays.size();
     for (size_t i=0 ; i<count ; i++) {
         const DisplayState& s(displays[i]);
@@ -2342,36 +2801,192 @@ void SurfaceFlinger::setTransactionState(
         }
     }
 
-    // If a synchronous transaction is explicitly requested without any changes,
-    // force a transaction anyway. This can be used as a flush mechanism for
-    // previous async transactions.
-    if (transactionFlags == 0 && (flags & eSynchronous)) {
-        transactionFlags = eTransactionNeeded;
+    return transactionFlags;
+}
+
+static bool sameLayer(const ComposerState& lhs, const ComposerState& rhs) {
+    return IInterface::asBinder(lhs.client) == IInterface::asBinder(rhs.client) &&
+            lhs.state.surface == rhs.state.surface;
+}
+
+static bool canCoalesce(const Vector<ComposerState>& state) {
+    // transactions deferred until a frame, or applied with a resize, hold
+    // back whatever they are merged with
+    for (const auto& s : state) {
+        if (s.state.what & (layer_state_t::eDeferTransaction |
+                layer_state_t::eGeometryAppliesWithResize)) {
+            return false;
+        }
     }
+    return true;
+}
 
-    if (transactionFlags) {
-        // this triggers the transaction
-        setTransactionFlags(transactionFlags);
+status_t SurfaceFlinger::setTransactionStateAsync(
+        const Vector<ComposerState>& state,
+        const Vector<DisplayState>& displays,
+        uint32_t flags, nsecs_t desiredPresentTime,
+        const sp<ITransactionCompletedListener>& listener,
+        uint64_t transactionId)
+{
+    ATRACE_CALL();
+    const pid_t pid = IPCThreadState::self()->getCallingPid();
 
-        // if this is a synchronous transaction, wait for it to take effect
-        // before returning.
-        if (flags & eSynchronous) {
-            mTransactionPending = true;
+    delayDPTransactionIfNeeded(displays);
+    Mutex::Autolock _l(mStateLock);
+    mAsyncTransactions++;
+
+    TransactionCallback callback;
+    callback.listener = listener;
+    callback.transactionId = transactionId;
+    callback.latchTime = 0;
+
+    // fold the transaction into the caller's newest queued one when both
+    // are due for the same frame; the order of the caller's transactions
+    // is kept either way
+    for (auto it = mQueuedTransactions.rbegin();
+            it != mQueuedTransactions.rend(); ++it) {
+        if (it->pid != pid) {
+            continue;
         }
-        if (flags & eAnimation) {
-            mAnimTransactionPending = true;
+        if (it->desiredPresentTime != desiredPresentTime ||
+                !canCoalesce(it->state) || !canCoalesce(state)) {
+            break;
         }
-        while (mTransactionPending) {
-            status_t err = mTransactionCV.waitRelative(mStateLock, s2ns(5));
-            if (CC_UNLIKELY(err != NO_ERROR)) {
-                // just in case something goes wrong in SF, return to the
-                // called after a few seconds.
-                ALOGW_IF(err == TIMED_OUT, "setTransactionState timed out!");
-                mTransactionPending = false;
-                break;
+        for (const auto& s : state) {
+            bool merged = false;
+            for (size_t i = 0; i < it->state.size(); i++) {
+                if (sameLayer(it->state[i], s)) {
+                    it->state.editItemAt(i).state.merge(s.state);
+                    merged = true;
+                    break;
+                }
+            }
+            if (!merged) {
+                it->state.add(s);
+            }
+        }
+        for (const auto& d : displays) {
+            bool merged = false;
+            for (size_t i = 0; i < it->displays.size(); i++) {
+                if (it->displays[i].token == d.token) {
+                    it->displays.editItemAt(i).merge(d);
+                    merged = true;
+                    break;
+                }
             }
+            if (!merged) {
+                it->displays.add(d);
+            }
+        }
+        it->flags |= flags & eAnimation;
+        if (listener != NULL) {
+            it->callbacks.push_back(callback);
+        }
+        mAsyncTransactionsCoalesced++;
+        return NO_ERROR;
+    }
+
+    QueuedTransaction transaction;
+    transaction.pid = pid;
+    transaction.state = state;
+    transaction.displays = displays;
+    transaction.flags = flags & eAnimation;
+    transaction.desiredPresentTime = desiredPresentTime;
+    if (listener != NULL) {
+        transaction.callbacks.push_back(callback);
+    }
+    mQueuedTransactions.push_back(transaction);
+
+    // the transaction is applied when the next vsync invalidates
+    signalTransaction();
+    return NO_ERROR;
+}
+
+uint32_t SurfaceFlinger::applyQueuedTransactionsLocked(pid_t pid)
+{
+    if (mQueuedTransactions.empty()) {
+        return 0;
+    }
+    ATRACE_CALL();
+
+    // the frame being prepared is shown at the next refresh; a transaction
+    // is due when it would otherwise be shown at least half a period late
+    // the refresh after. Targets more than a second out are taken to be
+    // bogus.
+    const nsecs_t now = systemTime();
+    const nsecs_t nextRefresh = mPrimaryDispSync.computeNextRefresh(0);
+    const nsecs_t halfPeriod = mPrimaryDispSync.getPeriod() / 2;
+
+    uint32_t transactionFlags = 0;
+    bool applied = false;
+    std::vector<pid_t> waitingPids;
+    for (auto it = mQueuedTransactions.begin();
+            it != mQueuedTransactions.end();) {
+        bool due;
+        if (pid >= 0) {
+            due = it->pid == pid;
+        } else {
+            due = it->desiredPresentTime < nextRefresh + halfPeriod ||
+                    it->desiredPresentTime > now + s2ns(1);
+            due = due && std::find(waitingPids.begin(), waitingPids.end(),
+                    it->pid) == waitingPids.end();
+        }
+        if (!due) {
+            waitingPids.push_back(it->pid);
+            ++it;
+            continue;
+        }
+        transactionFlags |= applyTransactionStateLocked(it->state,
+                it->displays);
+        if (it->flags & eAnimation) {
+            mAnimTransactionPending = true;
+        }
+        for (auto& callback : it->callbacks) {
+            callback.latchTime = now;
+            mAppliedTransactions.push_back(callback);
         }
+        it = mQueuedTransactions.erase(it);
+        applied = true;
+    }
+
+    if (pid < 0 && !waitingPids.empty()) {
+        // look again at the next vsync
+        signalTransaction();
+    }
+    if (transactionFlags == 0 && applied) {
+        // compose a frame anyway, so that the listeners hear back
+        transactionFlags = eTransactionNeeded;
+    }
+    return transactionFlags;
+}
+
+void SurfaceFlinger::applyQueuedTransactions()
+{
+    Mutex::Autolock _l(mStateLock);
+    uint32_t transactionFlags = applyQueuedTransactionsLocked(-1);
+    if (transactionFlags) {
+        // handleMessageTransaction() picks these up right away, so there is
+        // no need to wake the server up again
+        android_atomic_or(transactionFlags, &mTransactionFlags);
+    }
+    // whatever has been applied by now goes out with this frame
+    mComposingTransactions.insert(mComposingTransactions.end(),
+            mAppliedTransactions.begin(), mAppliedTransactions.end());
+    mAppliedTransactions.clear();
+}
+
+void SurfaceFlinger::notifyTransactionsCompleted(
+        const sp<Fence>& presentFence)
+{
+    if (mComposingTransactions.empty()) {
+        return;
+    }
+    ATRACE_CALL();
+    for (const auto& callback : mComposingTransactions) {
+        callback.listener->onTransactionCompleted(callback.transactionId,
+                callback.latchTime, presentFence);
     }
+    mComposingTransactions.clear();
 }
 
 uint32_t SurfaceFlinger::setDisplayStateLocked(const DisplayState& s)
@@ -2728,6 +3343,7 @@ void SurfaceFlinger::setPowerModeInternal(const sp<DisplayDevice>& hw,
 
         mVisibleRegionsDirty = true;
         mHasPoweredOff = true;
+        mPhaseOffsetController.reset();
         repaintEverything();
 
         struct sched_param param = {0};
@@ -2828,14 +3444,35 @@ status_t SurfaceFlinger::dump(int fd, const Vector<String16>& args)
             }
 
             if ((index < numArgs) &&
-                    (args[index] == String16("--latency-clear"))) {
+                    (args[index] == String16("--buffer-latency"))) {
                 index++;
-                clearStatsLocked(args, index, result);
+                dumpBufferLatencyLocked(args, index, result);
                 dumpAll = false;
             }
 
             if ((index < numArgs) &&
-                    (args[index] == String16("--dispsync"))) {
+                    (args[index] == String16("--frame-history"))) {
+                index++;
+                dumpFrameHistoryLocked(args, index, result, false);
+                dumpAll = false;
+            }
+
+            if ((index < numArgs) &&
+                    (args[index] == String16("--frame-history-export"))) {
+                index++;
+                dumpFrameHistoryLocked(args, index, result, true);
+                dumpAll = false;
+            }
+
+            if ((index < numArgs) &&
+                    (args[index] == String16("--latency-clear"))) {
+                index++;
+                clearStatsLocked(args, index, result);
+                dumpAll = false;
+            }
+
+            if ((index < numArgs) &&
+                    (args[index] == String16("--dispsync"))) {
                 index++;
                 mPrimaryDispSync.dump(result);
                 dumpAll = false;
@@ -2854,6 +3491,33 @@ status_t SurfaceFlinger::dump(int fd, const Vector<String16>& args)
                 mFenceTracker.dump(&result);
                 dumpAll = false;
             }
+
+            if ((index < numArgs) &&
+                    (args[index] == String16("--layer-capture"))) {
+                // followed by the number of frames to keep, 0 to stop
+                index++;
+                if (index < numArgs) {
+                    mLayerCapture.setCapacity(std::max(
+                            atoi(String8(args[index]).string()), 0));
+                    index++;
+                }
+                mLayerCapture.dump(result);
+                dumpAll = false;
+            }
+
+            if ((index < numArgs) &&
+                    (args[index] == String16("--layer-capture-export"))) {
+                index++;
+                mLayerCapture.exportTo(result);
+                dumpAll = false;
+            }
+
+            if ((index < numArgs) &&
+                    (args[index] == String16("--frame-stages"))) {
+                index++;
+                mFrameStages.dump(result);
+                dumpAll = false;
+            }
         }
 
         if (dumpAll) {
@@ -2906,6 +3570,60 @@ void SurfaceFlinger::dumpStatsLocked(const Vector<String16>& args, size_t& index
     }
 }
 
+void SurfaceFlinger::dumpBufferLatencyLocked(const Vector<String16>& args,
+        size_t& index, String8& result) const
+{
+    String8 name;
+    if (index < args.size()) {
+        name = String8(args[index]);
+        index++;
+    }
+
+    const LayerVector& currentLayers = mCurrentState.layersSortedByZ;
+    const size_t count = currentLayers.size();
+    for (size_t i=0 ; i<count ; i++) {
+        const sp<Layer>& layer(currentLayers[i]);
+        if (name.isEmpty() || (name == layer->getName())) {
+            result.appendFormat("%s\n", layer->getName().string());
+            layer->dumpBufferLatency(result);
+        }
+    }
+}
+
+void SurfaceFlinger::dumpFrameHistoryLocked(const Vector<String16>& args,
+        size_t& index, String8& result, bool exportBinary) const
+{
+    String8 name;
+    if (index < args.size()) {
+        name = String8(args[index]);
+        index++;
+    }
+
+    // Without a name this is the window animation history. Layers only keep
+    // one when debug.sf.layer_frame_history is set.
+    if (name.isEmpty()) {
+        if (exportBinary) {
+            mAnimFrameTracker.exportHistory(String8("<win-anim>"), result);
+        } else {
+            mAnimFrameTracker.dumpHistory(result);
+        }
+        return;
+    }
+
+    const LayerVector& currentLayers = mCurrentState.layersSortedByZ;
+    const size_t count = currentLayers.size();
+    for (size_t i=0 ; i<count ; i++) {
+        const sp<Layer>& layer(currentLayers[i]);
+        if (name == layer->getName()) {
+            if (exportBinary) {
+                layer->exportFrameHistory(result);
+            } else {
+                layer->dumpFrameHistory(result);
+            }
+        }
+    }
+}
+
 void SurfaceFlinger::clearStatsLocked(const Vector<String16>& args, size_t& index,
         String8& /* result */)
 {
@@ -3026,6 +3744,112 @@ void SurfaceFlinger::dumpBufferingStats(String8& result) const {
     result.append("\n");
 }
 
+void SurfaceFlinger::trimLayerBuffers() {
+    if (mTrimInvisibleFrames == 0 && mLayerBufferBudget == 0) {
+        return;
+    }
+    SortedVector<const Layer*> onScreen;
+    for (size_t dpy = 0; dpy < mDisplays.size(); dpy++) {
+        const Vector< sp<Layer> >& visible(
+                mDisplays[dpy]->getVisibleLayersSortedByZ());
+        for (size_t i = 0; i < visible.size(); i++) {
+            onScreen.add(visible[i].get());
+        }
+    }
+
+    const LayerVector& layers(mDrawingState.layersSortedByZ);
+    for (size_t i = 0; i < layers.size(); i++) {
+        layers[i]->updateBufferTrimming(
+                onScreen.indexOf(layers[i].get()) >= 0, mTrimInvisibleFrames);
+    }
+
+    enforceLayerBufferBudget(onScreen);
+}
+
+void SurfaceFlinger::enforceLayerBufferBudget(
+        const SortedVector<const Layer*>& onScreen) {
+    if (mLayerBufferBudget == 0) {
+        return;
+    }
+    // counting takes every layer's queue lock, so don't do it every frame
+    const nsecs_t now = systemTime();
+    if (now - mLastBufferBudgetCheck < ms2ns(500)) {
+        return;
+    }
+    mLastBufferBudgetCheck = now;
+
+    const LayerVector& layers(mDrawingState.layersSortedByZ);
+    std::vector<std::pair<size_t, sp<Layer>>> background;
+    size_t total = 0;
+    for (size_t i = 0; i < layers.size(); i++) {
+        const size_t bytes = layers[i]->getRetainedBufferBytes();
+        total += bytes;
+        if (bytes > 0 && onScreen.indexOf(layers[i].get()) < 0) {
+            background.push_back(std::make_pair(bytes, layers[i]));
+        }
+    }
+    if (total <= mLayerBufferBudget) {
+        return;
+    }
+
+    std::sort(background.begin(), background.end(),
+            [](const std::pair<size_t, sp<Layer>>& a,
+               const std::pair<size_t, sp<Layer>>& b) {
+        return a.first > b.first;
+    });
+    size_t freed = 0;
+    for (size_t i = 0; i < background.size() && total > mLayerBufferBudget;
+            i++) {
+        const size_t released = background[i].second->discardFreeBuffers();
+        total -= std::min(released, total);
+        freed += released;
+    }
+    mBufferBudgetTrims++;
+    mBufferBudgetBytesFreed += freed;
+    ALOGV("layer buffers over budget, freed %zu KiB, %zu KiB retained",
+            freed / 1024, total / 1024);
+}
+
+void SurfaceFlinger::dumpLayerBufferMemoryLocked(String8& result) const {
+    struct Usage {
+        pid_t pid;
+        size_t layers;
+        size_t buffers;
+        size_t bytes;
+    };
+    std::map<const Client*, Usage> perClient;
+    size_t totalBuffers = 0;
+    size_t totalBytes = 0;
+    const LayerVector& layers(mCurrentState.layersSortedByZ);
+    for (size_t i = 0; i < layers.size(); i++) {
+        size_t buffers = 0;
+        const size_t bytes = layers[i]->getRetainedBufferBytes(&buffers);
+        totalBuffers += buffers;
+        totalBytes += bytes;
+        sp<Client> client(layers[i]->getClient());
+        Usage& usage = perClient[client.get()];
+        usage.pid = client != NULL ? client->getPid() : -1;
+        usage.layers++;
+        usage.buffers += buffers;
+        usage.bytes += bytes;
+    }
+
+    result.appendFormat("Layer buffer memory: %.1f KiB in %zu buffers",
+            totalBytes / 1024.0f, totalBuffers);
+    if (mLayerBufferBudget > 0) {
+        result.appendFormat(", budget %zu KiB, %" PRIu64 " trims freed "
+                "%.1f KiB", mLayerBufferBudget / 1024, mBufferBudgetTrims,
+                mBufferBudgetBytesFreed / 1024.0f);
+    }
+    result.append("\n");
+    for (const auto& entry : perClient) {
+        const Usage& usage = entry.second;
+        result.appendFormat("  pid %5d: %.1f KiB in %zu buffers, %zu layers\n",
+                usage.pid, usage.bytes / 1024.0f, usage.buffers, usage.layers);
+    }
+    result.append("\n");
+}
+
 void SurfaceFlinger::dumpAllLocked(const Vector<String16>& args, size_t& index,
         String8& result) const
 {
@@ -3071,6 +3895,15 @@ void SurfaceFlinger::dumpAllLocked(const Vector<String16>& args, size_t& index,
         vsyncPhaseOffsetNs, sfVsyncPhaseOffsetNs, PRESENT_TIME_OFFSET_FROM_VSYNC_NS,
         mHwc->getRefreshPeriod(HWC_DISPLAY_PRIMARY));
     result.append("\n");
+    mEventControlThread->dump(result);
+    if (mUseAdaptivePhaseOffsets) {
+        mPhaseOffsetController.dump(result);
+    }
+
+    colorizer.bold(result);
+    result.append("Boot stages:\n");
+    colorizer.reset(result);
+    dumpInitStagesLocked(result);
 
     // Dump static screen stats
     result.append("\n");
@@ -3078,6 +3911,10 @@ void SurfaceFlinger::dumpAllLocked(const Vector<String16>& args, size_t& index,
     result.append("\n");
 
     dumpBufferingStats(result);
+    dumpLayerBufferMemoryLocked(result);
+    result.appendFormat("Layer display transforms: %" PRIu64 " computed, "
+            "%" PRIu64 " reused\n\n", Layer::getDisplayTransformsComputed(),
+            Layer::getDisplayTransformsReused());
 
     /*
      * Dump the visible layer list
@@ -3150,6 +3987,12 @@ void SurfaceFlinger::dumpAllLocked(const Vector<String16>& args, size_t& index,
     result.appendFormat("  transaction time: %f us\n",
             inTransactionDuration/1000.0);
 
+    result.appendFormat("  async transactions: %" PRIu64 " (%" PRIu64
+            " coalesced), %zu queued\n", mAsyncTransactions,
+            mAsyncTransactionsCoalesced, mQueuedTransactions.size());
+    mFrameStages.dumpSummary(result);
+    mLayerCapture.dump(result);
+
     /*
      * VSYNC state
      */
@@ -3218,6 +4061,7 @@ status_t SurfaceFlinger::onTransact(
         case CREATE_CONNECTION:
         case CREATE_DISPLAY:
         case SET_TRANSACTION_STATE:
+        case SET_TRANSACTION_STATE_ASYNC:
         case BOOT_FINISHED:
         case CLEAR_ANIMATION_FRAME_STATS:
         case GET_ANIMATION_FRAME_STATS:
@@ -3237,6 +4081,8 @@ status_t SurfaceFlinger::onTransact(
             break;
         }
         case CAPTURE_SCREEN:
+        case CAPTURE_SCREEN_TO_BUFFER:
+        case CAPTURE_LAYER_TO_BUFFER:
         {
             // codes that require permission check
             IPCThreadState* ipc = IPCThreadState::self();
@@ -3372,12 +4218,16 @@ status_t SurfaceFlinger::onTransact(
             }
             case 1018: { // Modify Choreographer's phase offset
                 n = data.readInt32();
+                // an offset set by hand is not second-guessed
+                mUseAdaptivePhaseOffsets = false;
                 if (mEventThread != NULL)
                     mEventThread->setPhaseOffset(static_cast<nsecs_t>(n));
                 return NO_ERROR;
             }
             case 1019: { // Modify SurfaceFlinger's phase offset
                 n = data.readInt32();
+                // an offset set by hand is not second-guessed
+                mUseAdaptivePhaseOffsets = false;
                 if (mSFEventThread != NULL)
                     mSFEventThread->setPhaseOffset(static_cast<nsecs_t>(n));
                 return NO_ERROR;
@@ -3535,6 +4385,24 @@ public:
 };
 
 
+// Converts to surfaceflinger's internal rotation type.
+static Transform::orientation_flags toRotationFlags(
+        ISurfaceComposer::Rotation rotation) {
+    switch (rotation) {
+        case ISurfaceComposer::eRotateNone:
+            return Transform::ROT_0;
+        case ISurfaceComposer::eRotate90:
+            return Transform::ROT_90;
+        case ISurfaceComposer::eRotate180:
+            return Transform::ROT_180;
+        case ISurfaceComposer::eRotate270:
+            return Transform::ROT_270;
+        default:
+            ALOGE("Invalid rotation passed to captureScreen(): %d\n", rotation);
+            return Transform::ROT_0;
+    }
+}
+
 status_t SurfaceFlinger::captureScreen(const sp<IBinder>& display,
         const sp<IGraphicBufferProducer>& producer,
         Rect sourceCrop, uint32_t reqWidth, uint32_t reqHeight,
@@ -3553,26 +4421,7 @@ status_t SurfaceFlinger::captureScreen(const sp<IBinder>& display,
     // ourselves).
     bool isLocalScreenshot = IInterface::asBinder(producer)->localBinder();
 
-    // Convert to surfaceflinger's internal rotation type.
-    Transform::orientation_flags rotationFlags;
-    switch (rotation) {
-        case ISurfaceComposer::eRotateNone:
-            rotationFlags = Transform::ROT_0;
-            break;
-        case ISurfaceComposer::eRotate90:
-            rotationFlags = Transform::ROT_90;
-            break;
-        case ISurfaceComposer::eRotate180:
-            rotationFlags = Transform::ROT_180;
-            break;
-        case ISurfaceComposer::eRotate270:
-            rotationFlags = Transform::ROT_270;
-            break;
-        default:
-            rotationFlags = Transform::ROT_0;
-            ALOGE("Invalid rotation passed to captureScreen(): %d\n", rotation);
-            break;
-    }
+    Transform::orientation_flags rotationFlags = toRotationFlags(rotation);
 
     class MessageCaptureScreen : public MessageBase {
         SurfaceFlinger* flinger;
@@ -3632,7 +4481,8 @@ status_t SurfaceFlinger::captureScreen(const sp<IBinder>& display,
             sourceCrop, reqWidth, reqHeight, minLayerZ, maxLayerZ,
             useIdentityTransform, rotationFlags, isLocalScreenshot, useReadPixels);
 
-    status_t res = postMessageAsync(msg);
+    // the screenshot waits for the frame in flight rather than delay it
+    status_t res = postMessageAsync(msg, 0, MessageQueue::FLAG_IDLE);
     if (res == NO_ERROR) {
         res = wrapper->waitForResponse();
     }
@@ -3644,7 +4494,8 @@ void SurfaceFlinger::renderScreenImplLocked(
         const sp<const DisplayDevice>& hw,
         Rect sourceCrop, uint32_t reqWidth, uint32_t reqHeight,
         uint32_t minLayerZ, uint32_t maxLayerZ,
-        bool yswap, bool useIdentityTransform, Transform::orientation_flags rotation)
+        bool yswap, bool useIdentityTransform, Transform::orientation_flags rotation,
+        const sp<const Layer>& onlyLayer)
 {
     ATRACE_CALL();
     RenderEngine& engine(getRenderEngine());
@@ -3652,8 +4503,6 @@ void SurfaceFlinger::renderScreenImplLocked(
     // get screen geometry
     const int32_t hw_w = hw->getWidth();
     const int32_t hw_h = hw->getHeight();
-    const bool filtering = static_cast<int32_t>(reqWidth) != hw_w ||
-                           static_cast<int32_t>(reqHeight) != hw_h;
 
     // if a default or invalid sourceCrop is passed in, set reasonable values
     if (sourceCrop.width() == 0 || sourceCrop.height() == 0 ||
@@ -3662,6 +4511,19 @@ void SurfaceFlinger::renderScreenImplLocked(
         sourceCrop.setRightBottom(Point(hw_w, hw_h));
     }
 
+    // only scaling the crop to the requested size needs filtering, so that
+    // a 1:1 capture of part of the screen stays sharp
+    const bool swapped = rotation & Transform::ROT_90;
+    const int32_t crop_w = swapped ? sourceCrop.height() : sourceCrop.width();
+    const int32_t crop_h = swapped ? sourceCrop.width() : sourceCrop.height();
+    const bool filtering = static_cast<int32_t>(reqWidth) != crop_w ||
+                           static_cast<int32_t>(reqHeight) != crop_h;
+
+    // layers entirely outside the crop aren't drawn at all
+    const Rect cullRect(sourceCrop);
+    const Transform displayTransform(useIdentityTransform ?
+            Transform() : hw->getTransform());
+
     // ensure that sourceCrop is inside screen
     if (sourceCrop.left < 0) {
         ALOGE("Invalid crop rect: l = %d (< 0)", sourceCrop.left);
@@ -3695,17 +4557,25 @@ void SurfaceFlinger::renderScreenImplLocked(
         reqWidth, reqHeight, sourceCrop, hw_h, yswap, rotation);
     engine.disableTexturing();
 
-    // redraw the screen entirely...
-    engine.clearWithColor(0, 0, 0, 1);
+    // redraw the screen entirely... a single layer goes on a transparent
+    // background
+    engine.clearWithColor(0, 0, 0, onlyLayer != NULL ? 0 : 1);
 
     const LayerVector& layers( mDrawingState.layersSortedByZ );
     const size_t count = layers.size();
     for (size_t i=0 ; i<count ; ++i) {
         const sp<Layer>& layer(layers[i]);
         const Layer::State& state(layer->getDrawingState());
+        if (onlyLayer != NULL && layer != onlyLayer) {
+            continue;
+        }
         if (state.layerStack == hw->getLayerStack()) {
             if (state.z >= minLayerZ && state.z <= maxLayerZ) {
-                if (canDrawLayerinScreenShot(hw,layer)) {
+                const Rect bounds(displayTransform.transform(
+                        state.active.transform.transform(layer->computeBounds())));
+                Rect drawn;
+                if (canDrawLayerinScreenShot(hw,layer) &&
+                        bounds.intersect(cullRect, &drawn)) {
                     if (filtering) layer->setFiltering(true);
                     layer->draw(hw, useIdentityTransform);
                     if (filtering) layer->setFiltering(false);
@@ -3749,20 +4619,8 @@ status_t SurfaceFlinger::captureScreenImplLocked(
     reqWidth  = (!reqWidth)  ? hw_w : reqWidth;
     reqHeight = (!reqHeight) ? hw_h : reqHeight;
 
-    bool secureLayerIsVisible = false;
-    const LayerVector& layers(mDrawingState.layersSortedByZ);
-    const size_t count = layers.size();
-    for (size_t i = 0 ; i < count ; ++i) {
-        const sp<Layer>& layer(layers[i]);
-        const Layer::State& state(layer->getDrawingState());
-        if (state.layerStack == hw->getLayerStack() && state.z >= minLayerZ &&
-                state.z <= maxLayerZ && layer->isVisible() &&
-                layer->isSecure()) {
-            secureLayerIsVisible = true;
-        }
-    }
-
-    if (!isLocalScreenshot && secureLayerIsVisible) {
+    if (!isLocalScreenshot &&
+            secureLayerIsVisibleLocked(hw, minLayerZ, maxLayerZ)) {
         ALOGW("FB is protected: PERMISSION_DENIED");
         return PERMISSION_DENIED;
     }
@@ -3808,43 +4666,8 @@ status_t SurfaceFlinger::captureScreenImplLocked(
                             hw, sourceCrop, reqWidth, reqHeight, minLayerZ, maxLayerZ, true,
                             useIdentityTransform, rotation);
 
-                        // Attempt to create a sync khr object that can produce a sync point. If that
-                        // isn't available, create a non-dupable sync object in the fallback path and
-                        // wait on it directly.
-                        EGLSyncKHR sync;
-                        if (!DEBUG_SCREENSHOTS) {
-                           sync = eglCreateSyncKHR(mEGLDisplay, EGL_SYNC_NATIVE_FENCE_ANDROID, NULL);
-                           // native fence fd will not be populated until flush() is done.
-                           getRenderEngine().flush();
-                        } else {
-                            sync = EGL_NO_SYNC_KHR;
-                        }
-                        if (sync != EGL_NO_SYNC_KHR) {
-                            // get the sync fd
-                            syncFd = eglDupNativeFenceFDANDROID(mEGLDisplay, sync);
-                            if (syncFd == EGL_NO_NATIVE_FENCE_FD_ANDROID) {
-                                ALOGW("captureScreen: failed to dup sync khr object");
-                                syncFd = -1;
-                            }
-                            eglDestroySyncKHR(mEGLDisplay, sync);
-                        } else {
-                            // fallback path
-                            sync = eglCreateSyncKHR(mEGLDisplay, EGL_SYNC_FENCE_KHR, NULL);
-                            if (sync != EGL_NO_SYNC_KHR) {
-                                EGLint result = eglClientWaitSyncKHR(mEGLDisplay, sync,
-                                    EGL_SYNC_FLUSH_COMMANDS_BIT_KHR, 2000000000 /*2 sec*/);
-                                EGLint eglErr = eglGetError();
-                                if (result == EGL_TIMEOUT_EXPIRED_KHR) {
-                                    ALOGW("captureScreen: fence wait timed out");
-                                } else {
-                                    ALOGW_IF(eglErr != EGL_SUCCESS,
-                                            "captureScreen: error waiting on EGL fence: %#x", eglErr);
-                                }
-                                eglDestroySyncKHR(mEGLDisplay, sync);
-                            } else {
-                                ALOGW("captureScreen: error creating EGL fence: %#x", eglGetError());
-                            }
-                        }
+                        syncFd = flushScreenshotLocked();
+
                         if (useReadPixels) {
                             sp<GraphicBuffer> buf = static_cast<GraphicBuffer*>(buffer);
                             void* vaddr;
@@ -3892,6 +4715,335 @@ bool SurfaceFlinger::getFrameTimestamps(const Layer& layer,
     return mFenceTracker.getFrameTimestamps(layer, frameNumber, outTimestamps);
 }
 
+status_t SurfaceFlinger::createFrameEventChannel(const Layer& layer,
+        sp<BitTube>* outChannel) {
+    return mFenceTracker.createFrameEventChannel(layer, outChannel);
+}
+
+void SurfaceFlinger::removeFrameEventChannel(const Layer& layer) {
+    mFenceTracker.removeFrameEventChannel(layer);
+}
+
+int SurfaceFlinger::flushScreenshotLocked()
+{
+    int syncFd = -1;
+
+    // Attempt to create a sync khr object that can produce a sync point. If that
+    // isn't available, create a non-dupable sync object in the fallback path and
+    // wait on it directly.
+    EGLSyncKHR sync;
+    if (!DEBUG_SCREENSHOTS) {
+        sync = eglCreateSyncKHR(mEGLDisplay, EGL_SYNC_NATIVE_FENCE_ANDROID, NULL);
+        // native fence fd will not be populated until flush() is done.
+        getRenderEngine().flush();
+    } else {
+        sync = EGL_NO_SYNC_KHR;
+    }
+    if (sync != EGL_NO_SYNC_KHR) {
+        // get the sync fd
+        syncFd = eglDupNativeFenceFDANDROID(mEGLDisplay, sync);
+        if (syncFd == EGL_NO_NATIVE_FENCE_FD_ANDROID) {
+            ALOGW("captureScreen: failed to dup sync khr object");
+            syncFd = -1;
+        }
+        eglDestroySyncKHR(mEGLDisplay, sync);
+    } else {
+        // fallback path
+        sync = eglCreateSyncKHR(mEGLDisplay, EGL_SYNC_FENCE_KHR, NULL);
+        if (sync != EGL_NO_SYNC_KHR) {
+            EGLint result = eglClientWaitSyncKHR(mEGLDisplay, sync,
+                EGL_SYNC_FLUSH_COMMANDS_BIT_KHR, 2000000000 /*2 sec*/);
+            EGLint eglErr = eglGetError();
+            if (result == EGL_TIMEOUT_EXPIRED_KHR) {
+                ALOGW("captureScreen: fence wait timed out");
+            } else {
+                ALOGW_IF(eglErr != EGL_SUCCESS,
+                        "captureScreen: error waiting on EGL fence: %#x", eglErr);
+            }
+            eglDestroySyncKHR(mEGLDisplay, sync);
+        } else {
+            ALOGW("captureScreen: error creating EGL fence: %#x", eglGetError());
+        }
+    }
+    return syncFd;
+}
+
+status_t SurfaceFlinger::captureScreenToBuffer(const sp<IBinder>& display,
+        const sp<GraphicBuffer>& buffer, Rect sourceCrop,
+        uint32_t minLayerZ, uint32_t maxLayerZ,
+        bool useIdentityTransform, ISurfaceComposer::Rotation rotation,
+        sp<Fence>* outFence) {
+
+    if (CC_UNLIKELY(display == 0 || buffer == 0 || outFence == NULL))
+        return BAD_VALUE;
+
+    // the buffer says nothing about where it came from, so only our own
+    // screenshots may show secure windows
+    bool isLocalScreenshot = IPCThreadState::self()->getCallingPid() == getpid();
+
+    class MessageCaptureScreenToBuffer : public MessageBase {
+        SurfaceFlinger* flinger;
+        sp<IBinder> display;
+        sp<GraphicBuffer> buffer;
+        Rect sourceCrop;
+        uint32_t minLayerZ, maxLayerZ;
+        bool useIdentityTransform;
+        Transform::orientation_flags rotation;
+        bool isLocalScreenshot;
+        status_t result;
+        int syncFd;
+    public:
+        MessageCaptureScreenToBuffer(SurfaceFlinger* flinger,
+                const sp<IBinder>& display, const sp<GraphicBuffer>& buffer,
+                Rect sourceCrop, uint32_t minLayerZ, uint32_t maxLayerZ,
+                bool useIdentityTransform,
+                Transform::orientation_flags rotation,
+                bool isLocalScreenshot)
+            : flinger(flinger), display(display), buffer(buffer),
+              sourceCrop(sourceCrop), minLayerZ(minLayerZ),
+              maxLayerZ(maxLayerZ),
+              useIdentityTransform(useIdentityTransform),
+              rotation(rotation), isLocalScreenshot(isLocalScreenshot),
+              result(PERMISSION_DENIED), syncFd(-1)
+        {
+        }
+        status_t getResult() const {
+            return result;
+        }
+        int getSyncFd() const {
+            return syncFd;
+        }
+        virtual bool handler() {
+            Mutex::Autolock _l(flinger->mStateLock);
+            sp<const DisplayDevice> hw(flinger->getDisplayDevice(display));
+            result = flinger->captureScreenToBufferImplLocked(hw, buffer,
+                    sourceCrop, minLayerZ, maxLayerZ, useIdentityTransform,
+                    rotation, isLocalScreenshot, &syncFd);
+            return true;
+        }
+    };
+
+    // nothing on the main thread waits for the client here, so unlike
+    // captureScreen() no GraphicProducerWrapper is needed
+    sp<MessageCaptureScreenToBuffer> msg = new MessageCaptureScreenToBuffer(
+            this, display, buffer, sourceCrop, minLayerZ, maxLayerZ,
+            useIdentityTransform, toRotationFlags(rotation),
+            isLocalScreenshot);
+    status_t res = postMessageSync(msg, 0, MessageQueue::FLAG_IDLE);
+    if (res == NO_ERROR) {
+        res = msg->getResult();
+    }
+    if (res == NO_ERROR) {
+        *outFence = msg->getSyncFd() >= 0 ?
+                new Fence(msg->getSyncFd()) : Fence::NO_FENCE;
+    }
+    return res;
+}
+
+status_t SurfaceFlinger::captureScreenToBufferImplLocked(
+        const sp<const DisplayDevice>& hw,
+        const sp<GraphicBuffer>& buffer, Rect sourceCrop,
+        uint32_t minLayerZ, uint32_t maxLayerZ,
+        bool useIdentityTransform, Transform::orientation_flags rotation,
+        bool isLocalScreenshot, int* outSyncFd)
+{
+    ATRACE_CALL();
+
+    if (hw == NULL) {
+        return NAME_NOT_FOUND;
+    }
+
+    if (!(buffer->getUsage() & GRALLOC_USAGE_HW_RENDER)) {
+        ALOGE("captureScreenToBuffer: buffer can't be rendered to");
+        return BAD_VALUE;
+    }
+
+    // get screen geometry
+    uint32_t hw_w = hw->getWidth();
+    uint32_t hw_h = hw->getHeight();
+
+    if (rotation & Transform::ROT_90) {
+        std::swap(hw_w, hw_h);
+    }
+
+    const uint32_t reqWidth = buffer->getWidth();
+    const uint32_t reqHeight = buffer->getHeight();
+    if ((reqWidth > hw_w) || (reqHeight > hw_h) ||
+            reqWidth == 0 || reqHeight == 0) {
+        ALOGE("size mismatch (%d, %d) > (%d, %d)",
+                reqWidth, reqHeight, hw_w, hw_h);
+        return BAD_VALUE;
+    }
+
+    ++mActiveFrameSequence;
+
+    if (!isLocalScreenshot &&
+            secureLayerIsVisibleLocked(hw, minLayerZ, maxLayerZ)) {
+        ALOGW("FB is protected: PERMISSION_DENIED");
+        return PERMISSION_DENIED;
+    }
+
+    return renderScreenToBufferLocked(hw, buffer, sourceCrop,
+            minLayerZ, maxLayerZ, useIdentityTransform, rotation, NULL,
+            outSyncFd);
+}
+
+status_t SurfaceFlinger::captureLayerToBuffer(const sp<IBinder>& layerHandle,
+        const sp<GraphicBuffer>& buffer, Rect sourceCrop,
+        sp<Fence>* outFence) {
+
+    if (CC_UNLIKELY(layerHandle == 0 || buffer == 0 || outFence == NULL))
+        return BAD_VALUE;
+
+    bool isLocalScreenshot = IPCThreadState::self()->getCallingPid() == getpid();
+
+    class MessageCaptureLayerToBuffer : public MessageBase {
+        SurfaceFlinger* flinger;
+        sp<IBinder> layerHandle;
+        sp<GraphicBuffer> buffer;
+        Rect sourceCrop;
+        bool isLocalScreenshot;
+        status_t result;
+        int syncFd;
+    public:
+        MessageCaptureLayerToBuffer(SurfaceFlinger* flinger,
+                const sp<IBinder>& layerHandle,
+                const sp<GraphicBuffer>& buffer, Rect sourceCrop,
+                bool isLocalScreenshot)
+            : flinger(flinger), layerHandle(layerHandle), buffer(buffer),
+              sourceCrop(sourceCrop), isLocalScreenshot(isLocalScreenshot),
+              result(PERMISSION_DENIED), syncFd(-1)
+        {
+        }
+        status_t getResult() const {
+            return result;
+        }
+        int getSyncFd() const {
+            return syncFd;
+        }
+        virtual bool handler() {
+            Mutex::Autolock _l(flinger->mStateLock);
+            result = flinger->captureLayerToBufferImplLocked(layerHandle,
+                    buffer, sourceCrop, isLocalScreenshot, &syncFd);
+            return true;
+        }
+    };
+
+    sp<MessageCaptureLayerToBuffer> msg = new MessageCaptureLayerToBuffer(
+            this, layerHandle, buffer, sourceCrop, isLocalScreenshot);
+    status_t res = postMessageSync(msg, 0, MessageQueue::FLAG_IDLE);
+    if (res == NO_ERROR) {
+        res = msg->getResult();
+    }
+    if (res == NO_ERROR) {
+        *outFence = msg->getSyncFd() >= 0 ?
+                new Fence(msg->getSyncFd()) : Fence::NO_FENCE;
+    }
+    return res;
+}
+
+status_t SurfaceFlinger::captureLayerToBufferImplLocked(
+        const sp<IBinder>& layerHandle, const sp<GraphicBuffer>& buffer,
+        Rect sourceCrop, bool isLocalScreenshot, int* outSyncFd)
+{
+    ATRACE_CALL();
+
+    sp<Layer> layer(Layer::fromHandle(layerHandle));
+    if (layer == NULL || mDrawingState.layersSortedByZ.indexOf(layer) < 0) {
+        return NAME_NOT_FOUND;
+    }
+    const Layer::State& state(layer->getDrawingState());
+
+    // draw with the first display showing the layer's stack, through its
+    // layer stack space rather than the display's projection
+    sp<const DisplayDevice> hw;
+    for (size_t dpy = 0; dpy < mDisplays.size(); dpy++) {
+        if (mDisplays[dpy]->getLayerStack() == state.layerStack) {
+            hw = mDisplays[dpy];
+            break;
+        }
+    }
+    if (hw == NULL) {
+        return NAME_NOT_FOUND;
+    }
+
+    if (!isLocalScreenshot && layer->isSecure()) {
+        ALOGW("layer is secure: PERMISSION_DENIED");
+        return PERMISSION_DENIED;
+    }
+
+    if (!(buffer->getUsage() & GRALLOC_USAGE_HW_RENDER) ||
+            buffer->getWidth() == 0 || buffer->getHeight() == 0) {
+        ALOGE("captureLayerToBuffer: buffer can't be rendered to");
+        return BAD_VALUE;
+    }
+
+    if (sourceCrop.isEmpty()) {
+        sourceCrop = state.active.transform.transform(layer->computeBounds());
+        if (sourceCrop.isEmpty()) {
+            return BAD_VALUE;
+        }
+    }
+
+    ++mActiveFrameSequence;
+
+    return renderScreenToBufferLocked(hw, buffer, sourceCrop,
+            state.z, state.z, true, Transform::ROT_0, layer, outSyncFd);
+}
+
+status_t SurfaceFlinger::renderScreenToBufferLocked(
+        const sp<const DisplayDevice>& hw,
+        const sp<GraphicBuffer>& buffer, Rect sourceCrop,
+        uint32_t minLayerZ, uint32_t maxLayerZ,
+        bool useIdentityTransform, Transform::orientation_flags rotation,
+        const sp<const Layer>& onlyLayer, int* outSyncFd)
+{
+    const uint32_t reqWidth = buffer->getWidth();
+    const uint32_t reqHeight = buffer->getHeight();
+
+    EGLImageKHR image = eglCreateImageKHR(mEGLDisplay, EGL_NO_CONTEXT,
+            EGL_NATIVE_BUFFER_ANDROID, buffer->getNativeBuffer(), NULL);
+    if (image == EGL_NO_IMAGE_KHR) {
+        return BAD_VALUE;
+    }
+
+    status_t result = NO_ERROR;
+    {
+        RenderEngine::BindImageAsFramebuffer imageBond(getRenderEngine(),
+                image, false, reqWidth, reqHeight);
+        if (imageBond.getStatus() == NO_ERROR) {
+            renderScreenImplLocked(
+                hw, sourceCrop, reqWidth, reqHeight, minLayerZ, maxLayerZ,
+                true, useIdentityTransform, rotation, onlyLayer);
+            // the client waits for the GPU, not us
+            *outSyncFd = flushScreenshotLocked();
+        } else {
+            ALOGE("got GL_FRAMEBUFFER_COMPLETE_OES error while taking screenshot");
+            result = INVALID_OPERATION;
+        }
+    }
+    eglDestroyImageKHR(mEGLDisplay, image);
+    return result;
+}
+
+bool SurfaceFlinger::secureLayerIsVisibleLocked(
+        const sp<const DisplayDevice>& hw,
+        uint32_t minLayerZ, uint32_t maxLayerZ) const
+{
+    const LayerVector& layers(mDrawingState.layersSortedByZ);
+    const size_t count = layers.size();
+    for (size_t i = 0 ; i < count ; ++i) {
+        const sp<Layer>& layer(layers[i]);
+        const Layer::State& state(layer->getDrawingState());
+        if (state.layerStack == hw->getLayerStack() && state.z >= minLayerZ &&
+                state.z <= maxLayerZ && layer->isVisible() &&
+                layer->isSecure()) {
+            return true;
+        }
+    }
+    return false;
+}
+
 void SurfaceFlinger::checkScreenshot(size_t w, size_t s, size_t h, void const* vaddr,
         const sp<const DisplayDevice>& hw, uint32_t minLayerZ, uint32_t maxLayerZ) {
     if (DEBUG_SCREENSHOTS) {
@@ -196,9 +196,77 @@ Rect Transform::makeBounds(int w, int h) const
     return transform( Rect(w, h) );
 }
 
+// Past this magnitude floats don't hold every integer, and the float path
+// would round differently
+static const int32_t MAX_INTEGRAL = 1 << 24;
+
+static inline bool isUnit(float f) {
+    return f == 0.0f || f == 1.0f || f == -1.0f;
+}
+
+bool Transform::transformIntegral(const Rect& bounds, Rect* outBounds) const
+{
+    const mat33& M(mMatrix);
+    const float a = M[0][0];
+    const float b = M[1][0];
+    const float c = M[0][1];
+    const float d = M[1][1];
+    const float x = M[2][0];
+    const float y = M[2][1];
+
+    // either a and d or b and c are zero, and the others are +/-1
+    if (!isUnit(a) || !isUnit(b) || !isUnit(c) || !isUnit(d) ||
+            (a == 0.0f) != (d == 0.0f) || (b == 0.0f) != (c == 0.0f) ||
+            (a == 0.0f) == (b == 0.0f)) {
+        return false;
+    }
+    if (!(fabsf(x) < MAX_INTEGRAL && fabsf(y) < MAX_INTEGRAL)) {
+        return false;
+    }
+    const int32_t ix = int32_t(x);
+    const int32_t iy = int32_t(y);
+    if (float(ix) != x || float(iy) != y) {
+        return false;
+    }
+    if (bounds.left <= -MAX_INTEGRAL || bounds.left >= MAX_INTEGRAL ||
+            bounds.top <= -MAX_INTEGRAL || bounds.top >= MAX_INTEGRAL ||
+            bounds.right <= -MAX_INTEGRAL || bounds.right >= MAX_INTEGRAL ||
+            bounds.bottom <= -MAX_INTEGRAL || bounds.bottom >= MAX_INTEGRAL) {
+        return false;
+    }
+
+    int32_t x0, x1, y0, y1;
+    if (b == 0.0f) {
+        // x' = a*x + tx, y' = d*y + ty
+        const int32_t sa = int32_t(a);
+        const int32_t sd = int32_t(d);
+        x0 = sa * bounds.left;
+        x1 = sa * bounds.right;
+        y0 = sd * bounds.top;
+        y1 = sd * bounds.bottom;
+    } else {
+        // x' = b*y + tx, y' = c*x + ty
+        const int32_t sb = int32_t(b);
+        const int32_t sc = int32_t(c);
+        x0 = sb * bounds.top;
+        x1 = sb * bounds.bottom;
+        y0 = sc * bounds.left;
+        y1 = sc * bounds.right;
+    }
+    outBounds->left   = min(x0, x1) + ix;
+    outBounds->top    = min(y0, y1) + iy;
+    outBounds->right  = max(x0, x1) + ix;
+    outBounds->bottom = max(y0, y1) + iy;
+    return true;
+}
+
 Rect Transform::transform(const Rect& bounds, bool roundOutwards) const
 {
     Rect r;
+    if (CC_LIKELY(transformIntegral(bounds, &r))) {
+        return r;
+    }
+
     vec2 lt( bounds.left,  bounds.top    );
     vec2 rt( bounds.right, bounds.top    );
     vec2 lb( bounds.left,  bounds.bottom );
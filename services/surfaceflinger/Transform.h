@@ -102,6 +102,10 @@ private:
     uint32_t type() const;
     static bool absIsOne(float f);
     static bool isZero(float f);
+    // transforms bounds with integer math if this is a rotation by a
+    // multiple of 90 degrees, a flip and/or an integral translation, which
+    // map integer rects to integer rects exactly
+    bool transformIntegral(const Rect& bounds, Rect* outBounds) const;
 
     mat33               mMatrix;
     mutable uint32_t    mType;
@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+
+#include "Layer.h"
+#include "VisibleRegionCache.h"
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+VisibleRegionCache::Inputs::Inputs()
+    : layer(NULL), sequence(0), visible(false), translucent(false),
+      opaqueAlpha(false)
+{
+}
+
+VisibleRegionCache::Inputs::Inputs(const sp<Layer>& layer)
+    : layer(layer.get()),
+      sequence(layer->getSequence()),
+      visible(layer->isVisible()),
+      bounds(Rect::EMPTY_RECT)
+{
+    const Layer::State& s(layer->getDrawingState());
+    translucent = !layer->isOpaque(s);
+#ifdef USE_HWC2
+    opaqueAlpha = s.alpha == 1.0f;
+#else
+    opaqueAlpha = s.alpha == 255;
+#endif
+    transform = s.active.transform;
+    if (visible) {
+        bounds = s.active.transform.transform(layer->computeBounds());
+    }
+    transparentRegion = s.activeTransparentRegion;
+}
+
+static bool sameTransform(const Transform& lhs, const Transform& rhs) {
+    for (size_t i = 0; i < 3; i++) {
+        for (size_t j = 0; j < 3; j++) {
+            if (lhs[i][j] != rhs[i][j]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool VisibleRegionCache::Inputs::matches(const Inputs& other) const {
+    // the transparent region is a hint, so a conservative test is enough
+    return layer == other.layer && sequence == other.sequence &&
+            visible == other.visible &&
+            translucent == other.translucent &&
+            opaqueAlpha == other.opaqueAlpha &&
+            bounds == other.bounds &&
+            sameTransform(transform, other.transform) &&
+            transparentRegion.isTriviallyEqual(other.transparentRegion);
+}
+
+// ---------------------------------------------------------------------------
+
+VisibleRegionCache::VisibleRegionCache()
+    : mLayerStack(0), mValid(false), mDiverged(false), mPosition(0),
+      mPasses(0), mLayersReused(0), mLayersComputed(0)
+{
+}
+
+void VisibleRegionCache::begin(uint32_t layerStack, bool enabled) {
+    if (!enabled || !mValid || layerStack != mLayerStack) {
+        mEntries.clear();
+    }
+    mLayerStack = layerStack;
+    mValid = enabled;
+    mDiverged = false;
+    mPosition = 0;
+    mPasses++;
+}
+
+bool VisibleRegionCache::reuse(const sp<Layer>& layer, const Inputs& inputs,
+        Region& aboveOpaqueLayers, Region& aboveCoveredLayers) {
+    if (!mDiverged) {
+        if (mPosition < mEntries.size() && !layer->contentDirty &&
+                mEntries[mPosition].inputs.matches(inputs)) {
+            // Set the results again rather than trusting the layer to still
+            // hold them: another display may have been through it since.
+            const Entry& entry(mEntries[mPosition]);
+            layer->setVisibleRegion(entry.visibleRegion);
+            layer->setCoveredRegion(entry.coveredRegion);
+            layer->setVisibleNonTransparentRegion(
+                    entry.visibleNonTransparentRegion);
+            mPosition++;
+            mLayersReused++;
+            return true;
+        }
+        mDiverged = true;
+        restore(aboveOpaqueLayers, aboveCoveredLayers);
+        truncate();
+    }
+    mLayersComputed++;
+    return false;
+}
+
+void VisibleRegionCache::record(const sp<Layer>& layer, const Inputs& inputs,
+        const Region& aboveOpaqueLayers, const Region& aboveCoveredLayers) {
+    if (!mValid) {
+        return;
+    }
+    Entry entry(inputs);
+    entry.visibleRegion = layer->visibleRegion;
+    entry.coveredRegion = layer->coveredRegion;
+    entry.visibleNonTransparentRegion = layer->visibleNonTransparentRegion;
+    entry.aboveOpaqueLayers = aboveOpaqueLayers;
+    entry.aboveCoveredLayers = aboveCoveredLayers;
+    mEntries.add(entry);
+    mPosition++;
+}
+
+void VisibleRegionCache::end(Region& aboveOpaqueLayers) {
+    if (!mDiverged) {
+        // Every layer matched; any layers left in the cache were at the
+        // bottom of the stack and have gone.
+        Region aboveCoveredLayers;
+        restore(aboveOpaqueLayers, aboveCoveredLayers);
+        truncate();
+    }
+}
+
+void VisibleRegionCache::truncate() {
+    if (mEntries.size() > mPosition) {
+        mEntries.removeItemsAt(mPosition, mEntries.size() - mPosition);
+    }
+}
+
+void VisibleRegionCache::restore(Region& aboveOpaqueLayers,
+        Region& aboveCoveredLayers) const {
+    if (mPosition > 0) {
+        const Entry& entry(mEntries[mPosition - 1]);
+        aboveOpaqueLayers = entry.aboveOpaqueLayers;
+        aboveCoveredLayers = entry.aboveCoveredLayers;
+    }
+}
+
+void VisibleRegionCache::invalidate() {
+    mEntries.clear();
+    mValid = false;
+}
+
+void VisibleRegionCache::dump(String8& result) const {
+    result.appendFormat("layerStack=%u, cached layers=%zu, passes=%" PRIu64
+            ", layers reused=%" PRIu64 ", computed=%" PRIu64 "\n",
+            mLayerStack, mEntries.size(), mPasses, mLayersReused,
+            mLayersComputed);
+}
+
+// ---------------------------------------------------------------------------
+
+}; // namespace android
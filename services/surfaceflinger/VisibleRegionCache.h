@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_VISIBLEREGIONCACHE_H
+#define ANDROID_VISIBLEREGIONCACHE_H
+
+#include <stdint.h>
+
+#include <ui/Rect.h>
+#include <ui/Region.h>
+#include <utils/RefBase.h>
+#include <utils/String8.h>
+#include <utils/Vector.h>
+
+#include "Transform.h"
+
+namespace android {
+
+class Layer;
+
+/*
+ * Remembers what SurfaceFlinger::computeVisibleRegions() found for each
+ * layer of one display's layer stack, so that the next pass can skip every
+ * layer above the topmost one whose visibility inputs changed.
+ *
+ * A layer's visible and covered regions only depend on its own state and
+ * on the layers above it. The pass walks the stack top to bottom, calling
+ * reuse() for every layer; while the layers match the previous pass their
+ * results are restored from the cache. At the first mismatch the running
+ * opaque and covered accumulators are restored and the pass continues as
+ * usual, handing each result to record().
+ */
+class VisibleRegionCache {
+public:
+    // Everything about a layer that its visible region depends on.
+    struct Inputs {
+        Inputs();
+        explicit Inputs(const sp<Layer>& layer);
+
+        bool matches(const Inputs& other) const;
+
+        const Layer* layer;
+        int32_t sequence;
+        bool visible;
+        bool translucent;
+        bool opaqueAlpha;
+        Transform transform;
+        Rect bounds;
+        Region transparentRegion;
+    };
+
+    VisibleRegionCache();
+
+    // Starts a pass over layerStack. A disabled cache is emptied and
+    // reuses nothing.
+    void begin(uint32_t layerStack, bool enabled);
+
+    // Returns true if the layer's regions, and the accumulators below it,
+    // were restored from the previous pass. Otherwise aboveOpaqueLayers and
+    // aboveCoveredLayers are set to what the layers above this one add up
+    // to, and the caller must compute the layer and then call record().
+    bool reuse(const sp<Layer>& layer, const Inputs& inputs,
+            Region& aboveOpaqueLayers, Region& aboveCoveredLayers);
+
+    void record(const sp<Layer>& layer, const Inputs& inputs,
+            const Region& aboveOpaqueLayers, const Region& aboveCoveredLayers);
+
+    // Ends the pass; if every layer was reused, restores the opaque
+    // accumulator so that it covers the whole stack.
+    void end(Region& aboveOpaqueLayers);
+
+    void invalidate();
+
+    void dump(String8& result) const;
+
+private:
+    struct Entry {
+        Entry() { }
+        explicit Entry(const Inputs& inputs) : inputs(inputs) { }
+
+        Inputs inputs;
+        // the layer's results
+        Region visibleRegion;
+        Region coveredRegion;
+        Region visibleNonTransparentRegion;
+        // the accumulators once this layer has been added
+        Region aboveOpaqueLayers;
+        Region aboveCoveredLayers;
+    };
+
+    void restore(Region& aboveOpaqueLayers, Region& aboveCoveredLayers) const;
+    // drops the entries from the current position down
+    void truncate();
+
+    uint32_t mLayerStack;
+    bool mValid;
+    bool mDiverged;
+    size_t mPosition;
+    Vector<Entry> mEntries;
+
+    uint64_t mPasses;
+    uint64_t mLayersReused;
+    uint64_t mLayersComputed;
+};
+
+}; // namespace android
+
+#endif // ANDROID_VISIBLEREGIONCACHE_H
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include <utils/Log.h>
+#include <utils/String8.h>
+
+#include "WorkerPool.h"
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+WorkerPool::Worker::Worker(WorkerPool& pool)
+    : Thread(false), mPool(pool), mGeneration(0)
+{
+}
+
+bool WorkerPool::Worker::threadLoop() {
+    {
+        Mutex::Autolock _l(mPool.mLock);
+        while (!mPool.mExiting && mGeneration == mPool.mGeneration) {
+            mPool.mWorkAvailable.wait(mPool.mLock);
+        }
+        if (mPool.mExiting) {
+            return false;
+        }
+        mGeneration = mPool.mGeneration;
+    }
+
+    mPool.drain();
+
+    Mutex::Autolock _l(mPool.mLock);
+    if (--mPool.mActive == 0) {
+        mPool.mWorkDone.signal();
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+
+WorkerPool::WorkerPool()
+    : mTask(NULL), mCount(0), mNext(0), mActive(0), mGeneration(0),
+      mExiting(false)
+{
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        Mutex::Autolock _l(mLock);
+        mExiting = true;
+        mWorkAvailable.broadcast();
+    }
+    for (size_t i = 0; i < mWorkers.size(); i++) {
+        mWorkers[i]->requestExitAndWait();
+    }
+}
+
+void WorkerPool::start(size_t threads, const char* name) {
+    for (size_t i = mWorkers.size() + 1; i < threads; i++) {
+        sp<Worker> worker(new Worker(*this));
+        // the work is on the display's critical path, like the main thread
+        status_t err = worker->run(String8::format("%s:%zu", name, i).string(),
+                PRIORITY_URGENT_DISPLAY);
+        if (err != NO_ERROR) {
+            ALOGE("failed to start worker thread %zu: %s (%d)", i,
+                    strerror(-err), err);
+            break;
+        }
+        mWorkers.add(worker);
+    }
+}
+
+void WorkerPool::run(size_t count, const Task& task) {
+    if (mWorkers.isEmpty() || count < 2) {
+        for (size_t i = 0; i < count; i++) {
+            task(i);
+        }
+        return;
+    }
+
+    {
+        Mutex::Autolock _l(mLock);
+        mTask = &task;
+        mCount = count;
+        mNext = 0;
+        mActive = mWorkers.size();
+        mGeneration++;
+        mWorkAvailable.broadcast();
+    }
+
+    drain();
+
+    Mutex::Autolock _l(mLock);
+    while (mActive > 0) {
+        mWorkDone.wait(mLock);
+    }
+    mTask = NULL;
+}
+
+void WorkerPool::drain() {
+    while (true) {
+        size_t i;
+        {
+            Mutex::Autolock _l(mLock);
+            if (mNext >= mCount) {
+                return;
+            }
+            i = mNext++;
+        }
+        (*mTask)(i);
+    }
+}
+
+// ---------------------------------------------------------------------------
+
+}; // namespace android
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SF_WORKERPOOL_H
+#define ANDROID_SF_WORKERPOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <utils/Condition.h>
+#include <utils/Mutex.h>
+#include <utils/Thread.h>
+#include <utils/Vector.h>
+
+#include <functional>
+
+namespace android {
+
+/*
+ * A few threads that run the independent parts of a composition pass
+ * alongside the main thread.
+ *
+ * run() hands out task indices to whichever thread is free, including the
+ * calling one, and returns once every task has returned. The threads are
+ * started once and sleep between calls, so a pass costs a wakeup rather
+ * than a thread creation.
+ */
+class WorkerPool {
+public:
+    typedef std::function<void(size_t)> Task;
+
+    WorkerPool();
+    ~WorkerPool();
+
+    // Starts threads - 1 worker threads; the caller of run() is the last.
+    void start(size_t threads, const char* name);
+
+    size_t getThreadCount() const { return mWorkers.size() + 1; }
+
+    // Calls task(i) for every i < count, in no particular order.
+    void run(size_t count, const Task& task);
+
+private:
+    class Worker : public Thread {
+    public:
+        explicit Worker(WorkerPool& pool);
+    private:
+        virtual bool threadLoop();
+        WorkerPool& mPool;
+        uint32_t mGeneration;
+    };
+
+    // runs tasks until there are none left
+    void drain();
+
+    Mutex mLock;
+    Condition mWorkAvailable;
+    Condition mWorkDone;
+    Vector<sp<Worker>> mWorkers;
+
+    const Task* mTask;
+    size_t mCount;
+    size_t mNext;
+    // workers that have yet to finish the current run
+    size_t mActive;
+    // bumped for every run, so that workers can tell a new one from a
+    // spurious wakeup
+    uint32_t mGeneration;
+    bool mExiting;
+};
+
+}; // namespace android
+
+#endif // ANDROID_SF_WORKERPOOL_H
@@ -16,6 +16,7 @@ LOCAL_SHARED_LIBRARIES := \
 	libbinder \
 	libcutils \
 	libgui \
+	libsync \
 	libui \
 	libutils \
 
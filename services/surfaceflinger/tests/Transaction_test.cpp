@@ -28,8 +28,21 @@
 
 #include <utils/String8.h>
 #include <ui/DisplayInfo.h>
+#include <ui/GraphicBuffer.h>
+
+#include <sync/sync.h>
 
 #include <math.h>
+#include <stdio.h>
+#include <thread>
+#include <unistd.h>
+
+// libsync has these, but doesn't export the sw_sync.h declaring them.
+extern "C" {
+int sw_sync_timeline_create(void);
+int sw_sync_timeline_inc(int fd, unsigned count);
+int sw_sync_fence_create(int fd, const char* name, unsigned value);
+}
 
 namespace android {
 
@@ -518,4 +531,87 @@ TEST_F(LayerUpdateTest, DeferredTransactionTest) {
     }
 }
 
+// Queues a buffer filled with a single color whose acquire fence only
+// signals once the returned timeline is incremented, or returns -1 if
+// sw_sync isn't available.
+static int queuePendingRGBA8(const sp<SurfaceControl>& sc,
+        uint8_t r, uint8_t g, uint8_t b) {
+    int timeline = sw_sync_timeline_create();
+    if (timeline < 0) {
+        return -1;
+    }
+    sp<Surface> s = sc->getSurface();
+    ANativeWindow* window = s.get();
+    ANativeWindowBuffer* anb;
+    int fenceFd = -1;
+    native_window_set_usage(window, GRALLOC_USAGE_SW_WRITE_OFTEN);
+    if (window->dequeueBuffer(window, &anb, &fenceFd) != NO_ERROR) {
+        close(timeline);
+        return -1;
+    }
+    if (fenceFd >= 0) {
+        sync_wait(fenceFd, -1);
+        close(fenceFd);
+    }
+    sp<GraphicBuffer> buffer(new GraphicBuffer(anb, false));
+    uint8_t* img = NULL;
+    buffer->lock(GRALLOC_USAGE_SW_WRITE_OFTEN, reinterpret_cast<void**>(&img));
+    for (uint32_t y = 0; y < buffer->getHeight(); y++) {
+        for (uint32_t x = 0; x < buffer->getWidth(); x++) {
+            uint8_t* pixel = img + (4 * (y * buffer->getStride() + x));
+            pixel[0] = r;
+            pixel[1] = g;
+            pixel[2] = b;
+            pixel[3] = 255;
+        }
+    }
+    buffer->unlock();
+    window->queueBuffer(window, anb, sw_sync_fence_create(timeline, "pending", 1));
+    return timeline;
+}
+
+TEST_F(LayerUpdateTest, CaptureWithPendingAcquireFence) {
+    sp<ScreenCapture> sc;
+    {
+        SCOPED_TRACE("before update");
+        ScreenCapture::captureScreen(&sc);
+        sc->checkPixel( 96,  96, 195,  63,  63);
+    }
+
+    // the previous buffer is shown until the new one's fence signals
+    const int timeline = queuePendingRGBA8(mFGSurfaceControl, 63, 195, 63);
+    if (timeline < 0) {
+        printf("[ SKIPPED  ] sw_sync isn't available\n");
+        return;
+    }
+    waitForPostedBuffers();
+    {
+        SCOPED_TRACE("fence pending");
+        ScreenCapture::captureScreen(&sc);
+        sc->checkPixel( 32,  32,  63,  63, 195);
+        sc->checkPixel( 96,  96, 195,  63,  63);
+    }
+
+    // signal while screenshots are being taken
+    std::thread signaler([timeline]() {
+        usleep(20000);
+        sw_sync_timeline_inc(timeline, 1);
+    });
+    for (int i = 0; i < 5; i++) {
+        ScreenCapture::captureScreen(&sc);
+        sc->checkPixel( 32,  32,  63,  63, 195);
+    }
+    signaler.join();
+    close(timeline);
+
+    waitForPostedBuffers();
+    {
+        SCOPED_TRACE("fence signaled");
+        ScreenCapture::captureScreen(&sc);
+        sc->checkPixel( 32,  32,  63,  63, 195);
+        sc->checkPixel( 96,  96,  63, 195,  63);
+        sc->checkPixel(160, 160,  63,  63, 195);
+    }
+}
+
 }
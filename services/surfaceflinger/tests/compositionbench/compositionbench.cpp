@@ -0,0 +1,371 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Animates a tree of layers with one transaction per vsync, the way the
+// window manager does, and reports what it cost SurfaceFlinger:
+//
+//   - transaction to present latency, from closing each transaction to
+//     the present fence of the frame it went into
+//   - SurfaceFlinger CPU time (user and system) per presented frame
+//   - missed frames, presents further apart than 1.5 refresh periods
+//
+// The last line sums it up as key=value pairs for scripts to compare.
+
+#include <dirent.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <math.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+#include <android/native_window.h>
+
+#include <binder/IPCThreadState.h>
+#include <binder/ProcessState.h>
+
+#include <gui/DisplayEventReceiver.h>
+#include <gui/ISurfaceComposer.h>
+#include <gui/ISurfaceComposerClient.h>
+#include <gui/ITransactionCompletedListener.h>
+#include <gui/Surface.h>
+#include <gui/SurfaceComposerClient.h>
+#include <gui/SurfaceControl.h>
+
+#include <ui/DisplayInfo.h>
+#include <ui/Fence.h>
+
+#include <utils/Mutex.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+using namespace android;
+
+struct Options {
+    Options() : layers(10), frames(600), size(256), translucent(false),
+            postBuffers(false) {}
+
+    int layers;
+    int frames;
+    int size;
+    bool translucent;
+    // queue a new buffer to every layer each frame, on top of moving it
+    bool postBuffers;
+};
+
+class CompletedListener : public BnTransactionCompletedListener {
+public:
+    struct Completion {
+        nsecs_t sentTime;
+        nsecs_t latchTime;
+        sp<Fence> presentFence;
+    };
+
+    void sent(uint64_t transactionId, nsecs_t time) {
+        Mutex::Autolock lock(mLock);
+        mCompletions[transactionId].sentTime = time;
+    }
+
+    virtual void onTransactionCompleted(uint64_t transactionId,
+            nsecs_t latchTime, const sp<Fence>& presentFence) {
+        Mutex::Autolock lock(mLock);
+        Completion& completion(mCompletions[transactionId]);
+        completion.latchTime = latchTime;
+        completion.presentFence = presentFence;
+    }
+
+    std::vector<Completion> getCompletions() {
+        Mutex::Autolock lock(mLock);
+        std::vector<Completion> completions;
+        for (const auto& entry : mCompletions) {
+            completions.push_back(entry.second);
+        }
+        return completions;
+    }
+
+private:
+    Mutex mLock;
+    std::unordered_map<uint64_t, Completion> mCompletions;
+};
+
+static bool fillSurface(const sp<SurfaceControl>& sc, uint8_t r, uint8_t g,
+        uint8_t b, uint8_t a) {
+    ANativeWindow_Buffer outBuffer;
+    sp<Surface> s = sc->getSurface();
+    if (s == NULL || s->lock(&outBuffer, NULL) != NO_ERROR) {
+        return false;
+    }
+    uint8_t* img = reinterpret_cast<uint8_t*>(outBuffer.bits);
+    for (int y = 0; y < outBuffer.height; y++) {
+        for (int x = 0; x < outBuffer.width; x++) {
+            uint8_t* pixel = img + (4 * (y * outBuffer.stride + x));
+            pixel[0] = r;
+            pixel[1] = g;
+            pixel[2] = b;
+            pixel[3] = a;
+        }
+    }
+    return s->unlockAndPost() == NO_ERROR;
+}
+
+static pid_t findSurfaceFlinger() {
+    DIR* dir = opendir("/proc");
+    if (dir == NULL) {
+        return -1;
+    }
+    pid_t pid = -1;
+    struct dirent* de;
+    while (pid < 0 && (de = readdir(dir)) != NULL) {
+        const pid_t candidate = atoi(de->d_name);
+        if (candidate <= 0) {
+            continue;
+        }
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%d/comm", candidate);
+        FILE* file = fopen(path, "r");
+        if (file == NULL) {
+            continue;
+        }
+        char comm[32] = {};
+        if (fgets(comm, sizeof(comm), file) != NULL &&
+                strcmp(comm, "surfaceflinger\n") == 0) {
+            pid = candidate;
+        }
+        fclose(file);
+    }
+    closedir(dir);
+    return pid;
+}
+
+// user plus system time of pid, or -1
+static nsecs_t getCpuTime(pid_t pid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+    char stat[1024];
+    const size_t length = fread(stat, 1, sizeof(stat) - 1, file);
+    fclose(file);
+    stat[length] = '\0';
+
+    // the fields after the comm, which may contain spaces, start with the
+    // state (field 3); utime and stime are fields 14 and 15
+    const char* fields = strrchr(stat, ')');
+    unsigned long utime = 0;
+    unsigned long stime = 0;
+    if (fields == NULL || sscanf(fields + 2, "%*c %*d %*d %*d %*d %*d %*u "
+            "%*u %*u %*u %*u %lu %lu", &utime, &stime) != 2) {
+        return -1;
+    }
+    return nsecs_t(utime + stime) * (1000000000LL / sysconf(_SC_CLK_TCK));
+}
+
+static nsecs_t percentile(const std::vector<nsecs_t>& sorted,
+        uint32_t percent) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    return sorted[std::min(sorted.size() - 1,
+            (sorted.size() * percent) / 100)];
+}
+
+static void usage(const char* name) {
+    fprintf(stderr, "usage: %s [-l layers] [-f frames] [-s size] [-t] [-b]\n"
+            "  -l  number of layers to animate (10)\n"
+            "  -f  number of frames to run for (600)\n"
+            "  -s  width and height of each layer in pixels (256)\n"
+            "  -t  make the layers translucent\n"
+            "  -b  also post a buffer to every layer each frame\n", name);
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    int opt;
+    while ((opt = getopt(argc, argv, "l:f:s:tbh")) != -1) {
+        switch (opt) {
+            case 'l': options.layers = std::max(atoi(optarg), 1); break;
+            case 'f': options.frames = std::max(atoi(optarg), 1); break;
+            case 's': options.size = std::max(atoi(optarg), 1); break;
+            case 't': options.translucent = true; break;
+            case 'b': options.postBuffers = true; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+
+    // the completion callbacks arrive on the binder thread pool
+    ProcessState::self()->startThreadPool();
+
+    sp<SurfaceComposerClient> client = new SurfaceComposerClient;
+    if (client->initCheck() != NO_ERROR) {
+        fprintf(stderr, "can't connect to SurfaceFlinger\n");
+        return 1;
+    }
+    sp<IBinder> display(SurfaceComposerClient::getBuiltInDisplay(
+            ISurfaceComposer::eDisplayIdMain));
+    DisplayInfo info;
+    if (SurfaceComposerClient::getDisplayInfo(display, &info) != NO_ERROR) {
+        fprintf(stderr, "can't get the main display's info\n");
+        return 1;
+    }
+    const nsecs_t refreshPeriod = nsecs_t(1e9 / info.fps);
+
+    std::vector<sp<SurfaceControl>> layers;
+    const uint8_t alpha = options.translucent ? 128 : 255;
+    for (int i = 0; i < options.layers; i++) {
+        sp<SurfaceControl> sc = client->createSurface(
+                String8::format("Composition Bench %d", i), options.size,
+                options.size, PIXEL_FORMAT_RGBA_8888,
+                options.translucent ? 0 : ISurfaceComposerClient::eOpaque);
+        if (sc == NULL || !sc->isValid() ||
+                !fillSurface(sc, uint8_t(i * 37), uint8_t(255 - i * 23), 128,
+                        alpha)) {
+            fprintf(stderr, "can't create layer %d\n", i);
+            return 1;
+        }
+        layers.push_back(sc);
+    }
+
+    SurfaceComposerClient::openGlobalTransaction();
+    for (size_t i = 0; i < layers.size(); i++) {
+        layers[i]->setLayer(uint32_t(INT_MAX - 1000) + uint32_t(i));
+        layers[i]->show();
+    }
+    SurfaceComposerClient::closeGlobalTransaction(true);
+
+    const pid_t sfPid = findSurfaceFlinger();
+    sp<CompletedListener> listener = new CompletedListener;
+    DisplayEventReceiver receiver;
+    receiver.setVsyncRate(1);
+    struct pollfd pfd = { receiver.getFd(), POLLIN, 0 };
+
+    const nsecs_t cpuStart = sfPid >= 0 ? getCpuTime(sfPid) : -1;
+    const int rangeX = std::max(int(info.w) - options.size, 1);
+    const int rangeY = std::max(int(info.h) - options.size, 1);
+    int frame = 0;
+    while (frame < options.frames) {
+        if (poll(&pfd, 1, 1000) <= 0) {
+            fprintf(stderr, "no vsync for a second\n");
+            return 1;
+        }
+        DisplayEventReceiver::Event events[8];
+        bool vsync = false;
+        ssize_t n;
+        while ((n = receiver.getEvents(events, 8)) > 0) {
+            for (ssize_t i = 0; i < n; i++) {
+                vsync = vsync || events[i].header.type ==
+                        DisplayEventReceiver::DISPLAY_EVENT_VSYNC;
+            }
+        }
+        if (!vsync) {
+            continue;
+        }
+
+        // every layer goes around its own ellipse
+        SurfaceComposerClient::openGlobalTransaction();
+        for (size_t i = 0; i < layers.size(); i++) {
+            const float phase = (frame + i * 13) * 0.05f;
+            layers[i]->setPosition(
+                    rangeX * (0.5f + 0.5f * cosf(phase)),
+                    rangeY * (0.5f + 0.5f * sinf(phase * 0.7f)));
+        }
+        SurfaceComposerClient::setAnimationTransaction();
+        const nsecs_t sentTime = systemTime();
+        const uint64_t id =
+                SurfaceComposerClient::closeGlobalTransactionAsync(0, listener);
+        if (id != 0) {
+            listener->sent(id, sentTime);
+        }
+
+        if (options.postBuffers) {
+            for (size_t i = 0; i < layers.size(); i++) {
+                fillSurface(layers[i], uint8_t(frame * 3 + i), 64, 192, alpha);
+            }
+        }
+        frame++;
+    }
+
+    // let the last frames be presented before looking at their fences
+    usleep(useconds_t(ns2us(refreshPeriod * 4)));
+    const nsecs_t cpuEnd = sfPid >= 0 ? getCpuTime(sfPid) : -1;
+
+    std::vector<nsecs_t> latencies;
+    std::vector<nsecs_t> presentTimes;
+    size_t unknown = 0;
+    for (const auto& completion : listener->getCompletions()) {
+        const sp<Fence>& fence(completion.presentFence);
+        if (completion.sentTime == 0 || fence == NULL || !fence->isValid()) {
+            unknown++;
+            continue;
+        }
+        fence->wait(1000);
+        const nsecs_t presentTime = fence->getSignalTime();
+        if (presentTime <= 0 || presentTime == INT64_MAX) {
+            unknown++;
+            continue;
+        }
+        latencies.push_back(presentTime - completion.sentTime);
+        presentTimes.push_back(presentTime);
+    }
+    std::sort(latencies.begin(), latencies.end());
+    std::sort(presentTimes.begin(), presentTimes.end());
+    // transactions coalesced into the same frame share its present time
+    presentTimes.erase(std::unique(presentTimes.begin(), presentTimes.end()),
+            presentTimes.end());
+
+    size_t missed = 0;
+    for (size_t i = 1; i < presentTimes.size(); i++) {
+        if (presentTimes[i] - presentTimes[i - 1] > refreshPeriod * 3 / 2) {
+            missed++;
+        }
+    }
+    const size_t presented = presentTimes.size();
+    const double cpuPerFrame = (cpuStart >= 0 && cpuEnd >= 0 && presented) ?
+            double(cpuEnd - cpuStart) / presented / 1e6 : -1.0;
+
+    printf("%d layers of %dx%d (%s%s), %d frames at %.1f Hz\n",
+            options.layers, options.size, options.size,
+            options.translucent ? "translucent" : "opaque",
+            options.postBuffers ? ", new buffers every frame" : "",
+            options.frames, info.fps);
+    printf("transaction to present: p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, "
+            "max %.2f ms (%zu unknown)\n",
+            percentile(latencies, 50) / 1e6, percentile(latencies, 90) / 1e6,
+            percentile(latencies, 99) / 1e6,
+            latencies.empty() ? 0.0 : latencies.back() / 1e6, unknown);
+    if (cpuPerFrame >= 0) {
+        printf("SurfaceFlinger CPU: %.2f ms per frame\n", cpuPerFrame);
+    } else {
+        printf("SurfaceFlinger CPU: unknown\n");
+    }
+    printf("frames presented %zu, missed %zu\n", presented, missed);
+    printf("latency_p50_ms=%.3f latency_p99_ms=%.3f sf_cpu_ms_per_frame=%.3f "
+            "frames=%zu missed_frames=%zu\n",
+            percentile(latencies, 50) / 1e6, percentile(latencies, 99) / 1e6,
+            cpuPerFrame, presented, missed);
+
+    client->dispose();
+    return 0;
+}
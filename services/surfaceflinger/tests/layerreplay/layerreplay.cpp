@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Replays the visible region pass of SurfaceFlinger::computeVisibleRegions()
+// over the frames of a layer capture, taken with
+//
+//   adb shell dumpsys SurfaceFlinger --layer-capture 600
+//   adb exec-out dumpsys SurfaceFlinger --layer-capture-export > capture.bin
+//
+// and reports how long the pass takes per frame, and any layer whose
+// visible region comes out different from the one SurfaceFlinger found.
+// Changes to the pass can be tried out here against real scenes first.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <ui/Rect.h>
+#include <ui/Region.h>
+#include <utils/Timers.h>
+
+#include "LayerCapture.h"
+#include "LayerSpatialIndex.h"
+
+using namespace android;
+
+struct Frame {
+    LayerCapture::FrameRecord record;
+    std::vector<LayerCapture::DisplayRecord> displays;
+    std::vector<LayerCapture::LayerRecord> layers;
+};
+
+static Rect unpackRect(const int32_t* r) {
+    return Rect(r[0], r[1], r[2], r[3]);
+}
+
+static bool read(FILE* file, void* data, size_t size) {
+    return fread(data, 1, size, file) == size;
+}
+
+static bool readCapture(const char* path, std::vector<Frame>* frames) {
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr) {
+        fprintf(stderr, "can't open %s\n", path);
+        return false;
+    }
+
+    LayerCapture::Header header;
+    bool ok = read(file, &header, sizeof(header));
+    if (!ok || header.magic != LayerCapture::MAGIC ||
+            header.version != LayerCapture::VERSION ||
+            header.frameSize != sizeof(LayerCapture::FrameRecord) ||
+            header.displaySize != sizeof(LayerCapture::DisplayRecord) ||
+            header.layerSize != sizeof(LayerCapture::LayerRecord)) {
+        fprintf(stderr, "%s is not a layer capture of this version\n", path);
+        fclose(file);
+        return false;
+    }
+
+    frames->resize(header.count);
+    for (auto& frame : *frames) {
+        ok = read(file, &frame.record, sizeof(frame.record)) &&
+                frame.record.numDisplays <= LayerCapture::MAX_DISPLAYS;
+        if (!ok) {
+            break;
+        }
+        frame.displays.resize(frame.record.numDisplays);
+        frame.layers.resize(frame.record.numLayers);
+        ok = read(file, frame.displays.data(),
+                frame.displays.size() * sizeof(LayerCapture::DisplayRecord)) &&
+                read(file, frame.layers.data(),
+                frame.layers.size() * sizeof(LayerCapture::LayerRecord));
+        if (!ok) {
+            break;
+        }
+    }
+    fclose(file);
+    if (!ok) {
+        fprintf(stderr, "%s is truncated\n", path);
+    }
+    return ok;
+}
+
+// The visible region pass, from the top-most layer down, without the
+// dirty region and transparent region bookkeeping.
+static void computeVisibleRegions(const Frame& frame, uint32_t layerStack,
+        LayerSpatialIndex& aboveLayersIndex, std::vector<Region>& visible) {
+    Region aboveOpaqueLayers;
+    Region aboveCoveredLayers;
+    aboveLayersIndex.clear();
+
+    size_t i = frame.layers.size();
+    while (i--) {
+        const LayerCapture::LayerRecord& layer(frame.layers[i]);
+        if (layer.layerStack != layerStack) {
+            continue;
+        }
+
+        Region opaqueRegion;
+        Region visibleRegion;
+        Region coveredRegion;
+        if (layer.flags & LayerCapture::LAYER_VISIBLE) {
+            visibleRegion.set(unpackRect(layer.bounds));
+            if (!visibleRegion.isEmpty() &&
+                    (layer.flags & LayerCapture::LAYER_OPAQUE)) {
+                opaqueRegion = visibleRegion;
+            }
+        }
+
+        const bool overlapped =
+                aboveLayersIndex.intersects(visibleRegion.getBounds());
+        aboveLayersIndex.insert(visibleRegion.getBounds());
+        if (overlapped) {
+            coveredRegion = aboveCoveredLayers.intersect(visibleRegion);
+        }
+        aboveCoveredLayers.orSelf(visibleRegion);
+        if (overlapped) {
+            visibleRegion.subtractSelf(aboveOpaqueLayers);
+        }
+        aboveOpaqueLayers.orSelf(opaqueRegion);
+
+        visible[i] = visibleRegion;
+    }
+}
+
+// the layer stacks of the displays that are on, once each
+static std::vector<uint32_t> getLayerStacks(const Frame& frame) {
+    std::vector<uint32_t> layerStacks;
+    for (const auto& display : frame.displays) {
+        if ((display.flags & LayerCapture::DISPLAY_ON) &&
+                std::find(layerStacks.begin(), layerStacks.end(),
+                        display.layerStack) == layerStacks.end()) {
+            layerStacks.push_back(display.layerStack);
+        }
+    }
+    return layerStacks;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <capture> [iterations]\n", argv[0]);
+        return 1;
+    }
+    const int iterations = argc > 2 ? std::max(atoi(argv[2]), 1) : 100;
+
+    std::vector<Frame> frames;
+    if (!readCapture(argv[1], &frames)) {
+        return 1;
+    }
+    if (frames.empty()) {
+        printf("no frames captured\n");
+        return 0;
+    }
+
+    LayerSpatialIndex index;
+    std::vector<Region> visible;
+    std::vector<nsecs_t> frameTimes;
+    size_t numLayers = 0;
+    size_t mismatches = 0;
+    size_t compositions[LayerCapture::COMPOSITION_OTHER + 1] = {};
+
+    for (size_t f = 0; f < frames.size(); f++) {
+        const Frame& frame(frames[f]);
+        const std::vector<uint32_t> layerStacks(getLayerStacks(frame));
+        numLayers += frame.layers.size();
+        visible.assign(frame.layers.size(), Region());
+
+        const nsecs_t start = systemTime();
+        for (int i = 0; i < iterations; i++) {
+            for (uint32_t layerStack : layerStacks) {
+                computeVisibleRegions(frame, layerStack, index, visible);
+            }
+        }
+        frameTimes.push_back((systemTime() - start) / iterations);
+
+        for (size_t i = 0; i < frame.layers.size(); i++) {
+            const LayerCapture::LayerRecord& layer(frame.layers[i]);
+            for (size_t d = 0; d < frame.displays.size(); d++) {
+                compositions[std::min<size_t>(layer.composition[d],
+                        LayerCapture::COMPOSITION_OTHER)]++;
+            }
+            // layers on no display that is on keep stale regions
+            if (std::find(layerStacks.begin(), layerStacks.end(),
+                    layer.layerStack) == layerStacks.end()) {
+                continue;
+            }
+            const Region& region(visible[i]);
+            const uint32_t rects = uint32_t(region.end() - region.begin());
+            if (region.getBounds() != unpackRect(layer.visibleBounds) ||
+                    rects != layer.visibleRects) {
+                if (mismatches < 10) {
+                    const Rect b(region.getBounds());
+                    printf("frame %zu layer %zu (z %u): visible [%d %d %d %d] "
+                            "%u rects, captured [%d %d %d %d] %u rects\n",
+                            f, i, layer.z, b.left, b.top, b.right, b.bottom,
+                            rects, layer.visibleBounds[0],
+                            layer.visibleBounds[1], layer.visibleBounds[2],
+                            layer.visibleBounds[3], layer.visibleRects);
+                }
+                mismatches++;
+            }
+        }
+    }
+
+    std::vector<nsecs_t> sorted(frameTimes);
+    std::sort(sorted.begin(), sorted.end());
+    nsecs_t total = 0;
+    for (nsecs_t t : frameTimes) {
+        total += t;
+    }
+    printf("%zu frames, %.1f layers per frame, %d iterations each\n",
+            frames.size(), double(numLayers) / frames.size(), iterations);
+    printf("visible regions per frame: mean %.2f us, p50 %.2f us, "
+            "p99 %.2f us, max %.2f us\n",
+            total / 1e3 / frameTimes.size(),
+            sorted[sorted.size() / 2] / 1e3,
+            sorted[(sorted.size() * 99) / 100] / 1e3,
+            sorted.back() / 1e3);
+    printf("composition: %zu client, %zu device, %zu solid color, "
+            "%zu cursor, %zu sideband, %zu other\n",
+            compositions[LayerCapture::COMPOSITION_CLIENT],
+            compositions[LayerCapture::COMPOSITION_DEVICE],
+            compositions[LayerCapture::COMPOSITION_SOLID_COLOR],
+            compositions[LayerCapture::COMPOSITION_CURSOR],
+            compositions[LayerCapture::COMPOSITION_SIDEBAND],
+            compositions[LayerCapture::COMPOSITION_OTHER]);
+    printf("%zu layers with a different visible region\n", mismatches);
+    return mismatches == 0 ? 0 : 2;
+}
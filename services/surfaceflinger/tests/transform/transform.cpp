@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Times Transform::transform() on rects and regions for the kinds of
+// transforms layers usually have, and checks the results against the
+// plain float math.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <ui/Rect.h>
+#include <ui/Region.h>
+#include <utils/Timers.h>
+
+#include "Transform.h"
+
+using namespace android;
+
+static const int ITERATIONS = 1000000;
+
+// Transform::transform(const Rect&) as it is without the integer path
+static Rect floatTransform(const Transform& t, const Rect& b) {
+    vec2 lt = t.transform(vec2(b.left, b.top));
+    vec2 rt = t.transform(vec2(b.right, b.top));
+    vec2 lb = t.transform(vec2(b.left, b.bottom));
+    vec2 rb = t.transform(vec2(b.right, b.bottom));
+    Rect r;
+    r.left   = floorf(fminf(fminf(lt[0], rt[0]), fminf(lb[0], rb[0])) + 0.5f);
+    r.top    = floorf(fminf(fminf(lt[1], rt[1]), fminf(lb[1], rb[1])) + 0.5f);
+    r.right  = floorf(fmaxf(fmaxf(lt[0], rt[0]), fmaxf(lb[0], rb[0])) + 0.5f);
+    r.bottom = floorf(fmaxf(fmaxf(lt[1], rt[1]), fmaxf(lb[1], rb[1])) + 0.5f);
+    return r;
+}
+
+static Rect randomRect() {
+    int32_t l = rand() % 4000 - 2000;
+    int32_t t = rand() % 4000 - 2000;
+    return Rect(l, t, l + rand() % 2000, t + rand() % 2000);
+}
+
+static void run(const char* name, const Transform& tr) {
+    Rect rects[256];
+    Region region;
+    for (size_t i = 0; i < 256; i++) {
+        rects[i] = randomRect();
+        if (i < 16) {
+            region.orSelf(Rect(i * 64, 0, i * 64 + 32, 32 + i * 8));
+        }
+    }
+
+    int mismatches = 0;
+    for (size_t i = 0; i < 256; i++) {
+        Rect a = tr.transform(rects[i]);
+        Rect b = floatTransform(tr, rects[i]);
+        if (a != b) {
+            mismatches++;
+        }
+    }
+
+    // keeps the loops from being optimized away
+    volatile int32_t sink = 0;
+    nsecs_t start = systemTime();
+    for (int i = 0; i < ITERATIONS; i++) {
+        sink += tr.transform(rects[i & 255]).left;
+    }
+    nsecs_t rectTime = systemTime() - start;
+
+    start = systemTime();
+    for (int i = 0; i < ITERATIONS; i++) {
+        sink += floatTransform(tr, rects[i & 255]).left;
+    }
+    nsecs_t floatTime = systemTime() - start;
+
+    start = systemTime();
+    for (int i = 0; i < ITERATIONS / 100; i++) {
+        sink += tr.transform(region).bounds().left;
+    }
+    nsecs_t regionTime = systemTime() - start;
+
+    printf("%-20s rect %6.1f ns (float %6.1f ns), 16-rect region %8.1f ns,"
+            " %d mismatches\n", name,
+            double(rectTime) / ITERATIONS, double(floatTime) / ITERATIONS,
+            double(regionTime) / (ITERATIONS / 100), mismatches);
+}
+
+int main(int /*argc*/, char** /*argv*/)
+{
+    Transform identity;
+    run("identity", identity);
+
+    Transform translate;
+    translate.set(100, -50);
+    run("translate", translate);
+
+    Transform rot90(Transform::ROT_90);
+    Transform rotTranslate;
+    rotTranslate.set(1080, 0);
+    run("rot90 + translate", rotTranslate * rot90);
+
+    Transform rot180;
+    rot180.set(Transform::ROT_180, 1080, 1920);
+    run("rot180", rot180);
+
+    Transform flip;
+    flip.set(Transform::FLIP_H, 1080, 1920);
+    run("flip h", flip);
+
+    Transform fractional;
+    fractional.set(10.5f, 3.25f);
+    run("fractional translate", fractional);
+
+    Transform scale;
+    scale.set(1.5f, 0, 0, 1.5f);
+    run("scale", scale);
+
+    return 0;
+}
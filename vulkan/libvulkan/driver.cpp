@@ -467,6 +467,10 @@ void CreateInfoWrapper::FilterExtension(const char* name) {
         }
     } else {
         switch (ext_bit) {
+            case ProcHook::GOOGLE_display_timing:
+                hook_extensions_.set(ext_bit);
+                // return now as these extensions do not require HAL support
+                return;
             case ProcHook::KHR_swapchain:
                 // map VK_KHR_swapchain to VK_ANDROID_native_buffer
                 name = VK_ANDROID_NATIVE_BUFFER_EXTENSION_NAME;
@@ -731,17 +735,38 @@ VkResult EnumerateDeviceExtensionProperties(
     VkExtensionProperties* pProperties) {
     const InstanceData& data = GetData(physicalDevice);
 
+    if (pLayerName) {
+        return data.driver.EnumerateDeviceExtensionProperties(
+            physicalDevice, pLayerName, pPropertyCount, pProperties);
+    }
+
+    // extensions we implement on top of VK_ANDROID_native_buffer are
+    // appended to the HAL's, so the HAL's are queried in full first
+    uint32_t hal_count;
     VkResult result = data.driver.EnumerateDeviceExtensionProperties(
-        physicalDevice, pLayerName, pPropertyCount, pProperties);
-    if (result != VK_SUCCESS && result != VK_INCOMPLETE)
+        physicalDevice, nullptr, &hal_count, nullptr);
+    if (result != VK_SUCCESS)
         return result;
 
-    if (!pProperties)
+    const uint32_t max_count = hal_count + 1;
+    VkExtensionProperties* props =
+        reinterpret_cast<VkExtensionProperties*>(data.allocator.pfnAllocation(
+            data.allocator.pUserData, sizeof(VkExtensionProperties) * max_count,
+            alignof(VkExtensionProperties), VK_SYSTEM_ALLOCATION_SCOPE_COMMAND));
+    if (!props)
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+
+    result = data.driver.EnumerateDeviceExtensionProperties(
+        physicalDevice, nullptr, &hal_count, props);
+    if (result != VK_SUCCESS && result != VK_INCOMPLETE) {
+        data.allocator.pfnFree(data.allocator.pUserData, props);
         return result;
+    }
 
     // map VK_ANDROID_native_buffer to VK_KHR_swapchain
-    for (uint32_t i = 0; i < *pPropertyCount; i++) {
-        auto& prop = pProperties[i];
+    uint32_t count = hal_count;
+    for (uint32_t i = 0; i < hal_count; i++) {
+        auto& prop = props[i];
 
         if (strcmp(prop.extensionName,
                    VK_ANDROID_NATIVE_BUFFER_EXTENSION_NAME) != 0)
@@ -750,8 +775,27 @@ VkResult EnumerateDeviceExtensionProperties(
         memcpy(prop.extensionName, VK_KHR_SWAPCHAIN_EXTENSION_NAME,
                sizeof(VK_KHR_SWAPCHAIN_EXTENSION_NAME));
         prop.specVersion = VK_KHR_SWAPCHAIN_SPEC_VERSION;
+
+        auto& timing = props[count++];
+        memset(&timing, 0, sizeof(timing));
+        memcpy(timing.extensionName, VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME,
+               sizeof(VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME));
+        timing.specVersion = VK_GOOGLE_DISPLAY_TIMING_SPEC_VERSION;
+    }
+
+    if (!pProperties) {
+        *pPropertyCount = count;
+    } else {
+        if (*pPropertyCount < count) {
+            count = *pPropertyCount;
+            result = VK_INCOMPLETE;
+        }
+        std::copy(props, props + count, pProperties);
+        *pPropertyCount = count;
     }
 
+    data.allocator.pfnFree(data.allocator.pUserData, props);
+
     return result;
 }
 
@@ -35,6 +35,7 @@ struct ProcHook {
     enum Extension {
         ANDROID_native_buffer,
         EXT_debug_report,
+        GOOGLE_display_timing,
         KHR_android_surface,
         KHR_surface,
         KHR_swapchain,
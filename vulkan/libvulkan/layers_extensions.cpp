@@ -17,6 +17,7 @@
 #include "layers_extensions.h"
 
 #include <alloca.h>
+#include <deque>
 #include <dirent.h>
 #include <dlfcn.h>
 #include <mutex>
@@ -69,12 +70,13 @@ const char kSystemLayerLibraryDir[] = "/data/local/debug/vulkan";
 class LayerLibrary {
    public:
     LayerLibrary(const std::string& path)
-        : path_(path), dlhandle_(nullptr), refcount_(0) {}
+        : path_(path), dlhandle_(nullptr), refcount_(0), enumerated_(false) {}
 
     LayerLibrary(LayerLibrary&& other)
         : path_(std::move(other.path_)),
           dlhandle_(other.dlhandle_),
-          refcount_(other.refcount_) {
+          refcount_(other.refcount_),
+          enumerated_(other.enumerated_) {
         other.dlhandle_ = nullptr;
         other.refcount_ = 0;
     }
@@ -87,7 +89,16 @@ class LayerLibrary {
     void Close();
 
     bool EnumerateLayers(size_t library_idx,
-                         std::vector<Layer>& instance_layers) const;
+                         std::deque<Layer>& instance_layers) const;
+
+    // Whether the library name follows the libVkLayer_<suffix>.so convention
+    // for a layer named VK_LAYER_..._<suffix>. Only a hint of where to look
+    // first, a library may provide any layer.
+    bool IsNamedAfter(const char* layer_name) const;
+
+    // protected by g_layers_mutex, see EnumerateLibrary
+    bool IsEnumerated() const { return enumerated_; }
+    void SetEnumerated() { enumerated_ = true; }
 
     void* GetGPA(const Layer& layer,
                  const char* gpa_name,
@@ -99,6 +110,7 @@ class LayerLibrary {
     std::mutex mutex_;
     void* dlhandle_;
     size_t refcount_;
+    bool enumerated_;
 };
 
 bool LayerLibrary::Open() {
@@ -141,7 +153,7 @@ void LayerLibrary::Close() {
 }
 
 bool LayerLibrary::EnumerateLayers(size_t library_idx,
-                                   std::vector<Layer>& instance_layers) const {
+                                   std::deque<Layer>& instance_layers) const {
     PFN_vkEnumerateInstanceLayerProperties enumerate_instance_layers =
         reinterpret_cast<PFN_vkEnumerateInstanceLayerProperties>(
             dlsym(dlhandle_, "vkEnumerateInstanceLayerProperties"));
@@ -208,7 +220,6 @@ bool LayerLibrary::EnumerateLayers(size_t library_idx,
 
     // append layers to instance_layers
     size_t prev_num_instance_layers = instance_layers.size();
-    instance_layers.reserve(prev_num_instance_layers + num_instance_layers);
     for (size_t i = 0; i < num_instance_layers; i++) {
         const VkLayerProperties& props = properties[i];
 
@@ -282,6 +293,22 @@ bool LayerLibrary::EnumerateLayers(size_t library_idx,
     return true;
 }
 
+bool LayerLibrary::IsNamedAfter(const char* layer_name) const {
+    const char kPrefix[] = "libVkLayer_";
+    const char kSuffix[] = ".so";
+    size_t slash = path_.rfind('/');
+    size_t start = (slash == std::string::npos) ? 0 : slash + 1;
+    if (path_.compare(start, sizeof(kPrefix) - 1, kPrefix) != 0)
+        return false;
+    start += sizeof(kPrefix) - 1;
+    if (path_.size() < start + sizeof(kSuffix) - 1)
+        return false;
+    size_t len = path_.size() - start - (sizeof(kSuffix) - 1);
+    size_t name_len = strlen(layer_name);
+    return len > 0 && len < name_len && layer_name[name_len - len - 1] == '_' &&
+           path_.compare(start, len, layer_name + name_len - len) == 0;
+}
+
 void* LayerLibrary::GetGPA(const Layer& layer,
                            const char* gpa_name,
                            size_t gpa_name_len) const {
@@ -301,22 +328,50 @@ void* LayerLibrary::GetGPA(const Layer& layer,
 
 // ----------------------------------------------------------------------------
 
+// Discovery only lists the layer libraries. A library is loaded to enumerate
+// its layers the first time a layer is looked for that no library enumerated
+// so far provides, or when all layers are listed, so that applications not
+// enabling any layer never load them. g_layer_libraries doesn't change once
+// discovery is done. g_instance_layers only grows, and never moves its
+// elements, so Layer references stay valid without holding g_layers_mutex.
 std::vector<LayerLibrary> g_layer_libraries;
-std::vector<Layer> g_instance_layers;
+std::deque<Layer> g_instance_layers;
+std::mutex g_layers_mutex;
+size_t g_num_enumerated_libraries;
 
 void AddLayerLibrary(const std::string& path) {
-    LayerLibrary library(path);
-    if (!library.Open())
-        return;
+    g_layer_libraries.emplace_back(path);
+}
 
-    if (!library.EnumerateLayers(g_layer_libraries.size(), g_instance_layers)) {
-        library.Close();
+// Must be called with g_layers_mutex held.
+void EnumerateLibrary(size_t library_idx) {
+    LayerLibrary& library = g_layer_libraries[library_idx];
+    if (library.IsEnumerated())
         return;
-    }
+    library.SetEnumerated();
+    g_num_enumerated_libraries++;
 
+    if (!library.Open())
+        return;
+    library.EnumerateLayers(library_idx, g_instance_layers);
     library.Close();
+}
+
+// Must be called with g_layers_mutex held.
+void EnumerateAllLibraries() {
+    for (size_t i = 0; g_num_enumerated_libraries < g_layer_libraries.size();
+         i++)
+        EnumerateLibrary(i);
+}
 
-    g_layer_libraries.emplace_back(std::move(library));
+// Must be called with g_layers_mutex held.
+const Layer* FindEnumeratedLayer(const char* name, size_t first) {
+    auto layer =
+        std::find_if(g_instance_layers.cbegin() + first,
+                     g_instance_layers.cend(), [=](const Layer& entry) {
+                         return strcmp(entry.properties.layerName, name) == 0;
+                     });
+    return (layer != g_instance_layers.cend()) ? &*layer : nullptr;
 }
 
 template <typename Functor>
@@ -432,20 +487,37 @@ void DiscoverLayers() {
 }
 
 uint32_t GetLayerCount() {
+    std::lock_guard<std::mutex> lock(g_layers_mutex);
+    EnumerateAllLibraries();
     return static_cast<uint32_t>(g_instance_layers.size());
 }
 
 const Layer& GetLayer(uint32_t index) {
+    std::lock_guard<std::mutex> lock(g_layers_mutex);
     return g_instance_layers[index];
 }
 
 const Layer* FindLayer(const char* name) {
-    auto layer =
-        std::find_if(g_instance_layers.cbegin(), g_instance_layers.cend(),
-                     [=](const Layer& entry) {
-                         return strcmp(entry.properties.layerName, name) == 0;
-                     });
-    return (layer != g_instance_layers.cend()) ? &*layer : nullptr;
+    std::lock_guard<std::mutex> lock(g_layers_mutex);
+    const Layer* layer = FindEnumeratedLayer(name, 0);
+    if (layer)
+        return layer;
+
+    // Libraries named after the layer are tried first, then the others in
+    // the order they were found in.
+    for (int named_after = 1; named_after >= 0; named_after--) {
+        for (size_t i = 0; i < g_layer_libraries.size(); i++) {
+            const LayerLibrary& library = g_layer_libraries[i];
+            if (library.IsEnumerated() ||
+                library.IsNamedAfter(name) != static_cast<bool>(named_after))
+                continue;
+            size_t first = g_instance_layers.size();
+            EnumerateLibrary(i);
+            if ((layer = FindEnumeratedLayer(name, first)) != nullptr)
+                return layer;
+        }
+    }
+    return nullptr;
 }
 
 const VkLayerProperties& GetLayerProperties(const Layer& layer) {
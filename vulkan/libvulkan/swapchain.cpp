@@ -15,10 +15,19 @@
  */
 
 #include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+#include <pthread.h>
 
 #include <gui/BufferQueue.h>
+#include <gui/ISurfaceComposer.h>
+#include <gui/SurfaceComposerClient.h>
 #include <log/log.h>
 #include <sync/sync.h>
+#include <ui/DisplayInfo.h>
 #include <utils/StrongPointer.h>
 
 #include "driver.h"
@@ -120,12 +129,95 @@ Surface* SurfaceFromHandle(VkSurfaceKHR handle) {
     return reinterpret_cast<Surface*>(handle);
 }
 
+// Dequeues buffers from a window on a thread of its own, which lets
+// vkAcquireNextImageKHR honor finite timeouts instead of blocking in
+// dequeueBuffer, and lets the next image be dequeued while the application is
+// still rendering the current one.
+//
+// A dequeue blocks for as long as all buffers are in use, so a swapchain going
+// away doesn't wait for the thread: it detaches from it, and the thread
+// cancels whatever it dequeues afterwards before exiting. The state is shared
+// between the two for that reason.
+struct Acquirer {
+    explicit Acquirer(const android::sp<ANativeWindow>& window_)
+        : window(window_) {}
+
+    const android::sp<ANativeWindow> window;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    // A dequeue has been asked for and its result not been taken yet.
+    bool pending = false;
+    // The result of the last dequeue is available.
+    bool ready = false;
+    bool detached = false;
+    int err = 0;
+    ANativeWindowBuffer* buffer = nullptr;
+    int fence = -1;
+};
+
 struct Swapchain {
-    Swapchain(Surface& surface_, uint32_t num_images_)
-        : surface(surface_), num_images(num_images_) {}
+    Swapchain(Surface& surface_,
+              const VkSwapchainCreateInfoKHR& create_info_,
+              uint32_t num_images_,
+              int gralloc_usage_)
+        : surface(surface_),
+          num_images(num_images_),
+          mailbox(create_info_.presentMode == VK_PRESENT_MODE_MAILBOX_KHR),
+          min_image_count(create_info_.minImageCount),
+          format(create_info_.imageFormat),
+          extent(create_info_.imageExtent),
+          usage(create_info_.imageUsage),
+          sharing_mode(create_info_.imageSharingMode),
+          gralloc_usage(gralloc_usage_) {
+        std::fill(std::begin(buffer_map), std::end(buffer_map), BufferSlot());
+    }
+
+    // VK_GOOGLE_display_timing state, see QueuePresentKHR.
+    struct Timing {
+        uint32_t present_id;
+        uint64_t desired_present_time;
+        // Index of the present among those queued to the window.
+        uint64_t serial;
+        nsecs_t actual_present_time;
+        nsecs_t ready_time;
+    };
+    // The window only keeps the timestamps of its last few frames, and
+    // presents older than that are forgotten whether or not the application
+    // asked for their timing.
+    static const size_t kMaxTimings = 8;
+    Timing timings[kMaxTimings];
+    size_t num_timings = 0;
+    uint64_t frames_queued = 0;
+    // The window was given a desired present time for the last frame.
+    bool timestamp_set = false;
+    nsecs_t refresh_duration = 0;
 
     Surface& surface;
     uint32_t num_images;
+    bool mailbox;
+
+    // What the images were created for, see CanReuseImages.
+    uint32_t min_image_count;
+    VkFormat format;
+    VkExtent2D extent;
+    VkImageUsageFlags usage;
+    VkSharingMode sharing_mode;
+    int gralloc_usage;
+
+    // Created on first use, see Acquirer.
+    std::shared_ptr<Acquirer> acquirer;
+
+    // Open addressed map from the buffers the window hands out to the index
+    // of their image. Twice as many slots as images keeps the probes short.
+    struct BufferSlot {
+        BufferSlot() : buffer(nullptr), index(0) {}
+        const ANativeWindowBuffer* buffer;
+        uint32_t index;
+    };
+    static const size_t kBufferMapSize =
+        2 * android::BufferQueue::NUM_BUFFER_SLOTS;
+    BufferSlot buffer_map[kBufferMapSize];
 
     struct Image {
         Image() : image(VK_NULL_HANDLE), dequeue_fence(-1), dequeued(false) {}
@@ -148,6 +240,216 @@ Swapchain* SwapchainFromHandle(VkSwapchainKHR handle) {
     return reinterpret_cast<Swapchain*>(handle);
 }
 
+size_t BufferMapStart(const ANativeWindowBuffer* buffer) {
+    static_assert((Swapchain::kBufferMapSize &
+                   (Swapchain::kBufferMapSize - 1)) == 0,
+                  "buffer map size must be a power of 2");
+    // Buffers are heap allocated, the low bits carry next to no information.
+    uint64_t key = reinterpret_cast<uintptr_t>(buffer);
+    key *= 0x9E3779B97F4A7C15ull;
+    return static_cast<size_t>(key >> 32) & (Swapchain::kBufferMapSize - 1);
+}
+
+void MapBufferToImage(Swapchain& swapchain,
+                      const ANativeWindowBuffer* buffer,
+                      uint32_t index) {
+    size_t i = BufferMapStart(buffer);
+    while (swapchain.buffer_map[i].buffer &&
+           swapchain.buffer_map[i].buffer != buffer)
+        i = (i + 1) & (Swapchain::kBufferMapSize - 1);
+    swapchain.buffer_map[i].buffer = buffer;
+    swapchain.buffer_map[i].index = index;
+}
+
+// Returns num_images if the buffer doesn't belong to the swapchain.
+uint32_t ImageFromBuffer(const Swapchain& swapchain,
+                         const ANativeWindowBuffer* buffer) {
+    for (size_t i = BufferMapStart(buffer); swapchain.buffer_map[i].buffer;
+         i = (i + 1) & (Swapchain::kBufferMapSize - 1)) {
+        if (swapchain.buffer_map[i].buffer == buffer)
+            return swapchain.buffer_map[i].index;
+    }
+    return swapchain.num_images;
+}
+
+nsecs_t RefreshDuration(Swapchain& swapchain) {
+    if (!swapchain.refresh_duration) {
+        // Swapchains are only ever shown on the main display.
+        android::DisplayInfo info;
+        android::sp<android::IBinder> display =
+            android::SurfaceComposerClient::getBuiltInDisplay(
+                android::ISurfaceComposer::eDisplayIdMain);
+        if (display != nullptr &&
+            android::SurfaceComposerClient::getDisplayInfo(display, &info) ==
+                android::NO_ERROR &&
+            info.fps > 0) {
+            swapchain.refresh_duration =
+                static_cast<nsecs_t>(1000000000.0 / info.fps);
+        } else {
+            ALOGW("failed to get the display refresh rate, assuming 60Hz");
+            swapchain.refresh_duration = 16666667;
+        }
+    }
+    return swapchain.refresh_duration;
+}
+
+bool IsValidTimestamp(nsecs_t time) {
+    return time > 0 && time < INT64_MAX;
+}
+
+// Fetches the timestamps of the presents which haven't been displayed yet,
+// and drops those the window doesn't know about anymore.
+void UpdateTimings(Swapchain& swapchain) {
+    ANativeWindow* window = swapchain.surface.window.get();
+    size_t kept = 0;
+    for (size_t i = 0; i < swapchain.num_timings; i++) {
+        Swapchain::Timing& timing = swapchain.timings[i];
+        if (!timing.actual_present_time) {
+            uint64_t frames_ago = swapchain.frames_queued - 1 - timing.serial;
+            if (frames_ago >= Swapchain::kMaxTimings)
+                continue;
+            nsecs_t posted = 0, acquire = 0, retire = 0;
+            int err = native_window_get_frame_timestamps(
+                window, static_cast<uint32_t>(frames_ago), &posted, &acquire,
+                nullptr, nullptr, &retire, nullptr);
+            if (err == 0 && IsValidTimestamp(retire)) {
+                if (!IsValidTimestamp(posted))
+                    posted = 0;
+                if (!IsValidTimestamp(acquire))
+                    acquire = 0;
+                timing.actual_present_time = retire;
+                timing.ready_time = std::max(posted, acquire);
+            }
+        }
+        swapchain.timings[kept++] = timing;
+    }
+    swapchain.num_timings = kept;
+}
+
+void* RunAcquirer(void* arg) {
+    std::shared_ptr<Acquirer>* acquirer_ptr =
+        static_cast<std::shared_ptr<Acquirer>*>(arg);
+    std::shared_ptr<Acquirer> acquirer = std::move(*acquirer_ptr);
+    delete acquirer_ptr;
+    ANativeWindow* window = acquirer->window.get();
+
+    std::unique_lock<std::mutex> lock(acquirer->mutex);
+    for (;;) {
+        acquirer->cond.wait(lock, [&acquirer] {
+            return acquirer->detached ||
+                   (acquirer->pending && !acquirer->ready);
+        });
+        if (acquirer->detached)
+            break;
+
+        lock.unlock();
+        ANativeWindowBuffer* buffer = nullptr;
+        int fence = -1;
+        int err = window->dequeueBuffer(window, &buffer, &fence);
+        lock.lock();
+
+        if (acquirer->detached) {
+            if (err == 0)
+                window->cancelBuffer(window, buffer, fence);
+            break;
+        }
+        acquirer->ready = true;
+        acquirer->err = err;
+        acquirer->buffer = err == 0 ? buffer : nullptr;
+        acquirer->fence = err == 0 ? fence : -1;
+        acquirer->cond.notify_all();
+    }
+    return nullptr;
+}
+
+// Returns false if the thread couldn't be started, acquiring then falls back
+// to dequeueing synchronously.
+bool StartAcquirer(Swapchain& swapchain) {
+    std::shared_ptr<Acquirer> acquirer =
+        std::make_shared<Acquirer>(swapchain.surface.window);
+    std::shared_ptr<Acquirer>* arg = new std::shared_ptr<Acquirer>(acquirer);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_t thread;
+    int err = pthread_create(&thread, &attr, RunAcquirer, arg);
+    pthread_attr_destroy(&attr);
+    if (err != 0) {
+        ALOGW("failed to start the swapchain acquire thread: %s (%d)",
+              strerror(err), err);
+        delete arg;
+        return false;
+    }
+    pthread_setname_np(thread, "vkacquire");
+    swapchain.acquirer = std::move(acquirer);
+    return true;
+}
+
+// Asks the thread to dequeue the next buffer, unless it already is.
+void RequestAcquire(Acquirer& acquirer) {
+    std::lock_guard<std::mutex> lock(acquirer.mutex);
+    if (!acquirer.pending) {
+        acquirer.pending = true;
+        acquirer.cond.notify_all();
+    }
+}
+
+// Detaches the swapchain from its thread, cancelling the buffer dequeued ahead
+// of the application if there is one.
+void StopAcquirer(Swapchain& swapchain) {
+    std::shared_ptr<Acquirer> acquirer = std::move(swapchain.acquirer);
+    if (!acquirer)
+        return;
+    ANativeWindowBuffer* buffer = nullptr;
+    int fence = -1;
+    {
+        std::lock_guard<std::mutex> lock(acquirer->mutex);
+        acquirer->detached = true;
+        if (acquirer->ready) {
+            buffer = acquirer->buffer;
+            fence = acquirer->fence;
+        }
+        acquirer->cond.notify_all();
+    }
+    if (buffer) {
+        ANativeWindow* window = acquirer->window.get();
+        window->cancelBuffer(window, buffer, fence);
+    }
+}
+
+// Waits for the thread to dequeue a buffer, kicking it off if needed. Returns
+// VK_NOT_READY or VK_TIMEOUT when the timeout expires first, the dequeue then
+// carries on and its buffer goes to the next call.
+VkResult AcquireFromThread(Acquirer& acquirer,
+                           uint64_t timeout,
+                           int* err,
+                           ANativeWindowBuffer** buffer,
+                           int* fence) {
+    std::unique_lock<std::mutex> lock(acquirer.mutex);
+    if (!acquirer.pending) {
+        acquirer.pending = true;
+        acquirer.cond.notify_all();
+    }
+    auto is_ready = [&acquirer] { return acquirer.ready; };
+    // Timeouts this long would overflow the clock, they are infinite in
+    // practice.
+    if (timeout >= uint64_t(std::chrono::nanoseconds::max().count()) / 2) {
+        acquirer.cond.wait(lock, is_ready);
+    } else if (!acquirer.cond.wait_for(
+                   lock, std::chrono::nanoseconds(timeout), is_ready)) {
+        return timeout ? VK_TIMEOUT : VK_NOT_READY;
+    }
+    *err = acquirer.err;
+    *buffer = acquirer.buffer;
+    *fence = acquirer.fence;
+    acquirer.ready = false;
+    acquirer.pending = false;
+    acquirer.buffer = nullptr;
+    acquirer.fence = -1;
+    return VK_SUCCESS;
+}
+
 void ReleaseSwapchainImage(VkDevice device,
                            ANativeWindow* window,
                            int release_fence,
@@ -197,9 +499,41 @@ void ReleaseSwapchainImage(VkDevice device,
     image.buffer.clear();
 }
 
+// Whether a swapchain replacing old_swapchain can take over its buffers and
+// images instead of allocating new ones. Recreating a swapchain otherwise
+// costs a window reconnection, which frees all buffers, then new gralloc
+// buffers and VkImages. Swapchains are mostly recreated for a new transform
+// after a rotation, which doesn't affect the buffers.
+bool CanReuseImages(Swapchain& old_swapchain,
+                    const VkSwapchainCreateInfoKHR& create_info,
+                    int gralloc_usage) {
+    if (old_swapchain.surface.swapchain_handle !=
+            HandleFromSwapchain(&old_swapchain) ||
+        old_swapchain.min_image_count != create_info.minImageCount ||
+        old_swapchain.mailbox !=
+            (create_info.presentMode == VK_PRESENT_MODE_MAILBOX_KHR) ||
+        old_swapchain.format != create_info.imageFormat ||
+        old_swapchain.extent.width != create_info.imageExtent.width ||
+        old_swapchain.extent.height != create_info.imageExtent.height ||
+        old_swapchain.usage != create_info.imageUsage ||
+        old_swapchain.gralloc_usage != gralloc_usage ||
+        old_swapchain.sharing_mode != VK_SHARING_MODE_EXCLUSIVE ||
+        create_info.imageSharingMode != VK_SHARING_MODE_EXCLUSIVE)
+        return false;
+    // Images the application still holds stay with the old swapchain, which
+    // they may still be presented to.
+    for (uint32_t i = 0; i < old_swapchain.num_images; i++) {
+        const Swapchain::Image& img = old_swapchain.images[i];
+        if (img.dequeued || !img.image)
+            return false;
+    }
+    return true;
+}
+
 void OrphanSwapchain(VkDevice device, Swapchain* swapchain) {
     if (swapchain->surface.swapchain_handle != HandleFromSwapchain(swapchain))
         return;
+    StopAcquirer(*swapchain);
     for (uint32_t i = 0; i < swapchain->num_images; i++) {
         if (!swapchain->images[i].dequeued)
             ReleaseSwapchainImage(device, nullptr, -1, swapchain->images[i]);
@@ -207,6 +541,178 @@ void OrphanSwapchain(VkDevice device, Swapchain* swapchain) {
     swapchain->surface.swapchain_handle = VK_NULL_HANDLE;
 }
 
+// Sets the native window up for a new swapchain. Any buffers the window had
+// are freed and it's left with num_images undequeued buffers.
+VkResult ConfigureNativeWindow(Surface& surface,
+                               const VkSwapchainCreateInfoKHR* create_info,
+                               int gralloc_usage,
+                               uint32_t* out_num_images) {
+    int err;
+
+    // -- Reset the native window --
+    // The native window might have been used previously, and had its properties
+    // changed from defaults. That will affect the answer we get for queries
+    // like MIN_UNDEQUED_BUFFERS. Reset to a known/default state before we
+    // attempt such queries.
+
+    // The native window only allows dequeueing all buffers before any have
+    // been queued, since after that point at least one is assumed to be in
+    // non-FREE state at any given time. Disconnecting and re-connecting
+    // orphans the previous buffers, getting us back to the state where we can
+    // dequeue all buffers.
+    err = native_window_api_disconnect(surface.window.get(),
+                                       NATIVE_WINDOW_API_EGL);
+    ALOGW_IF(err != 0, "native_window_api_disconnect failed: %s (%d)",
+             strerror(-err), err);
+    err =
+        native_window_api_connect(surface.window.get(), NATIVE_WINDOW_API_EGL);
+    ALOGW_IF(err != 0, "native_window_api_connect failed: %s (%d)",
+             strerror(-err), err);
+
+    err = native_window_set_buffer_count(surface.window.get(), 0);
+    if (err != 0) {
+        ALOGE("native_window_set_buffer_count(0) failed: %s (%d)",
+              strerror(-err), err);
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    err = surface.window->setSwapInterval(surface.window.get(), 1);
+    if (err != 0) {
+        // TODO(jessehall): Improve error reporting. Can we enumerate possible
+        // errors and translate them to valid Vulkan result codes?
+        ALOGE("native_window->setSwapInterval(1) failed: %s (%d)",
+              strerror(-err), err);
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    // -- Configure the native window --
+
+    int native_format = HAL_PIXEL_FORMAT_RGBA_8888;
+    switch (create_info->imageFormat) {
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+            native_format = HAL_PIXEL_FORMAT_RGBA_8888;
+            break;
+        case VK_FORMAT_R5G6B5_UNORM_PACK16:
+            native_format = HAL_PIXEL_FORMAT_RGB_565;
+            break;
+        default:
+            ALOGV("unsupported swapchain format %d", create_info->imageFormat);
+            break;
+    }
+    err = native_window_set_buffers_format(surface.window.get(), native_format);
+    if (err != 0) {
+        // TODO(jessehall): Improve error reporting. Can we enumerate possible
+        // errors and translate them to valid Vulkan result codes?
+        ALOGE("native_window_set_buffers_format(%d) failed: %s (%d)",
+              native_format, strerror(-err), err);
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+    err = native_window_set_buffers_data_space(surface.window.get(),
+                                               HAL_DATASPACE_SRGB_LINEAR);
+    if (err != 0) {
+        // TODO(jessehall): Improve error reporting. Can we enumerate possible
+        // errors and translate them to valid Vulkan result codes?
+        ALOGE("native_window_set_buffers_data_space(%d) failed: %s (%d)",
+              HAL_DATASPACE_SRGB_LINEAR, strerror(-err), err);
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    err = native_window_set_buffers_dimensions(
+        surface.window.get(), static_cast<int>(create_info->imageExtent.width),
+        static_cast<int>(create_info->imageExtent.height));
+    if (err != 0) {
+        // TODO(jessehall): Improve error reporting. Can we enumerate possible
+        // errors and translate them to valid Vulkan result codes?
+        ALOGE("native_window_set_buffers_dimensions(%d,%d) failed: %s (%d)",
+              create_info->imageExtent.width, create_info->imageExtent.height,
+              strerror(-err), err);
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    // VkSwapchainCreateInfo::preTransform indicates the transformation the app
+    // applied during rendering. native_window_set_transform() expects the
+    // inverse: the transform the app is requesting that the compositor perform
+    // during composition. With native windows, pre-transform works by rendering
+    // with the same transform the compositor is applying (as in Vulkan), but
+    // then requesting the inverse transform, so that when the compositor does
+    // it's job the two transforms cancel each other out and the compositor ends
+    // up applying an identity transform to the app's buffer.
+    err = native_window_set_buffers_transform(
+        surface.window.get(),
+        InvertTransformToNative(create_info->preTransform));
+    if (err != 0) {
+        // TODO(jessehall): Improve error reporting. Can we enumerate possible
+        // errors and translate them to valid Vulkan result codes?
+        ALOGE("native_window_set_buffers_transform(%d) failed: %s (%d)",
+              InvertTransformToNative(create_info->preTransform),
+              strerror(-err), err);
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    err = native_window_set_scaling_mode(
+        surface.window.get(), NATIVE_WINDOW_SCALING_MODE_SCALE_TO_WINDOW);
+    if (err != 0) {
+        // TODO(jessehall): Improve error reporting. Can we enumerate possible
+        // errors and translate them to valid Vulkan result codes?
+        ALOGE("native_window_set_scaling_mode(SCALE_TO_WINDOW) failed: %s (%d)",
+              strerror(-err), err);
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    int query_value;
+    err = surface.window->query(surface.window.get(),
+                                NATIVE_WINDOW_MIN_UNDEQUEUED_BUFFERS,
+                                &query_value);
+    if (err != 0 || query_value < 0) {
+        // TODO(jessehall): Improve error reporting. Can we enumerate possible
+        // errors and translate them to valid Vulkan result codes?
+        ALOGE("window->query failed: %s (%d) value=%d", strerror(-err), err,
+              query_value);
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+    uint32_t min_undequeued_buffers = static_cast<uint32_t>(query_value);
+    // The MIN_UNDEQUEUED_BUFFERS query doesn't know whether we'll be using
+    // async mode or not, and assumes not. But in async mode, the BufferQueue
+    // requires an extra undequeued buffer.
+    // See BufferQueueCore::getMinUndequeuedBufferCountLocked().
+    if (create_info->presentMode == VK_PRESENT_MODE_MAILBOX_KHR)
+        min_undequeued_buffers += 1;
+
+    uint32_t num_images =
+        (create_info->minImageCount - 1) + min_undequeued_buffers;
+    *out_num_images = num_images;
+    err = native_window_set_buffer_count(surface.window.get(), num_images);
+    if (err != 0) {
+        // TODO(jessehall): Improve error reporting. Can we enumerate possible
+        // errors and translate them to valid Vulkan result codes?
+        ALOGE("native_window_set_buffer_count(%d) failed: %s (%d)", num_images,
+              strerror(-err), err);
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    err = native_window_set_usage(surface.window.get(), gralloc_usage);
+    if (err != 0) {
+        // TODO(jessehall): Improve error reporting. Can we enumerate possible
+        // errors and translate them to valid Vulkan result codes?
+        ALOGE("native_window_set_usage failed: %s (%d)", strerror(-err), err);
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    int swap_interval =
+        create_info->presentMode == VK_PRESENT_MODE_MAILBOX_KHR ? 0 : 1;
+    err = surface.window->setSwapInterval(surface.window.get(), swap_interval);
+    if (err != 0) {
+        // TODO(jessehall): Improve error reporting. Can we enumerate possible
+        // errors and translate them to valid Vulkan result codes?
+        ALOGE("native_window->setSwapInterval(%d) failed: %s (%d)",
+              swap_interval, strerror(-err), err);
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    return VK_SUCCESS;
+}
+
 }  // anonymous namespace
 
 VKAPI_ATTR
@@ -372,6 +878,11 @@ VkResult GetPhysicalDeviceSurfacePresentModesKHR(VkPhysicalDevice /*pdev*/,
                                                  VkSurfaceKHR /*surface*/,
                                                  uint32_t* count,
                                                  VkPresentModeKHR* modes) {
+    // MAILBOX puts the BufferQueue in async mode, where a queued buffer not
+    // yet latched by the consumer is replaced by the next one. It gets an
+    // extra buffer for that, and the next image is dequeued in the background
+    // as soon as one is presented, see Acquirer. FIFO is the default,
+    // synchronous mode.
     const VkPresentModeKHR kModes[] = {
         VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_KHR,
     };
@@ -394,6 +905,7 @@ VkResult CreateSwapchainKHR(VkDevice device,
                             VkSwapchainKHR* swapchain_handle) {
     int err;
     VkResult result = VK_SUCCESS;
+    auto start_time = std::chrono::steady_clock::now();
 
     ALOGV("vkCreateSwapchainKHR: surface=0x%" PRIx64
           " minImageCount=%u imageFormat=%u imageColorSpace=%u"
@@ -434,151 +946,9 @@ VkResult CreateSwapchainKHR(VkDevice device,
               reinterpret_cast<uint64_t>(create_info->oldSwapchain));
         return VK_ERROR_NATIVE_WINDOW_IN_USE_KHR;
     }
-    if (create_info->oldSwapchain != VK_NULL_HANDLE)
-        OrphanSwapchain(device, SwapchainFromHandle(create_info->oldSwapchain));
-
-    // -- Reset the native window --
-    // The native window might have been used previously, and had its properties
-    // changed from defaults. That will affect the answer we get for queries
-    // like MIN_UNDEQUED_BUFFERS. Reset to a known/default state before we
-    // attempt such queries.
-
-    // The native window only allows dequeueing all buffers before any have
-    // been queued, since after that point at least one is assumed to be in
-    // non-FREE state at any given time. Disconnecting and re-connecting
-    // orphans the previous buffers, getting us back to the state where we can
-    // dequeue all buffers.
-    err = native_window_api_disconnect(surface.window.get(),
-                                       NATIVE_WINDOW_API_EGL);
-    ALOGW_IF(err != 0, "native_window_api_disconnect failed: %s (%d)",
-             strerror(-err), err);
-    err =
-        native_window_api_connect(surface.window.get(), NATIVE_WINDOW_API_EGL);
-    ALOGW_IF(err != 0, "native_window_api_connect failed: %s (%d)",
-             strerror(-err), err);
-
-    err = native_window_set_buffer_count(surface.window.get(), 0);
-    if (err != 0) {
-        ALOGE("native_window_set_buffer_count(0) failed: %s (%d)",
-              strerror(-err), err);
-        return VK_ERROR_INITIALIZATION_FAILED;
-    }
-
-    err = surface.window->setSwapInterval(surface.window.get(), 1);
-    if (err != 0) {
-        // TODO(jessehall): Improve error reporting. Can we enumerate possible
-        // errors and translate them to valid Vulkan result codes?
-        ALOGE("native_window->setSwapInterval(1) failed: %s (%d)",
-              strerror(-err), err);
-        return VK_ERROR_INITIALIZATION_FAILED;
-    }
-
-    // -- Configure the native window --
 
     const auto& dispatch = GetData(device).driver;
-
-    int native_format = HAL_PIXEL_FORMAT_RGBA_8888;
-    switch (create_info->imageFormat) {
-        case VK_FORMAT_R8G8B8A8_UNORM:
-        case VK_FORMAT_R8G8B8A8_SRGB:
-            native_format = HAL_PIXEL_FORMAT_RGBA_8888;
-            break;
-        case VK_FORMAT_R5G6B5_UNORM_PACK16:
-            native_format = HAL_PIXEL_FORMAT_RGB_565;
-            break;
-        default:
-            ALOGV("unsupported swapchain format %d", create_info->imageFormat);
-            break;
-    }
-    err = native_window_set_buffers_format(surface.window.get(), native_format);
-    if (err != 0) {
-        // TODO(jessehall): Improve error reporting. Can we enumerate possible
-        // errors and translate them to valid Vulkan result codes?
-        ALOGE("native_window_set_buffers_format(%d) failed: %s (%d)",
-              native_format, strerror(-err), err);
-        return VK_ERROR_INITIALIZATION_FAILED;
-    }
-    err = native_window_set_buffers_data_space(surface.window.get(),
-                                               HAL_DATASPACE_SRGB_LINEAR);
-    if (err != 0) {
-        // TODO(jessehall): Improve error reporting. Can we enumerate possible
-        // errors and translate them to valid Vulkan result codes?
-        ALOGE("native_window_set_buffers_data_space(%d) failed: %s (%d)",
-              HAL_DATASPACE_SRGB_LINEAR, strerror(-err), err);
-        return VK_ERROR_INITIALIZATION_FAILED;
-    }
-
-    err = native_window_set_buffers_dimensions(
-        surface.window.get(), static_cast<int>(create_info->imageExtent.width),
-        static_cast<int>(create_info->imageExtent.height));
-    if (err != 0) {
-        // TODO(jessehall): Improve error reporting. Can we enumerate possible
-        // errors and translate them to valid Vulkan result codes?
-        ALOGE("native_window_set_buffers_dimensions(%d,%d) failed: %s (%d)",
-              create_info->imageExtent.width, create_info->imageExtent.height,
-              strerror(-err), err);
-        return VK_ERROR_INITIALIZATION_FAILED;
-    }
-
-    // VkSwapchainCreateInfo::preTransform indicates the transformation the app
-    // applied during rendering. native_window_set_transform() expects the
-    // inverse: the transform the app is requesting that the compositor perform
-    // during composition. With native windows, pre-transform works by rendering
-    // with the same transform the compositor is applying (as in Vulkan), but
-    // then requesting the inverse transform, so that when the compositor does
-    // it's job the two transforms cancel each other out and the compositor ends
-    // up applying an identity transform to the app's buffer.
-    err = native_window_set_buffers_transform(
-        surface.window.get(),
-        InvertTransformToNative(create_info->preTransform));
-    if (err != 0) {
-        // TODO(jessehall): Improve error reporting. Can we enumerate possible
-        // errors and translate them to valid Vulkan result codes?
-        ALOGE("native_window_set_buffers_transform(%d) failed: %s (%d)",
-              InvertTransformToNative(create_info->preTransform),
-              strerror(-err), err);
-        return VK_ERROR_INITIALIZATION_FAILED;
-    }
-
-    err = native_window_set_scaling_mode(
-        surface.window.get(), NATIVE_WINDOW_SCALING_MODE_SCALE_TO_WINDOW);
-    if (err != 0) {
-        // TODO(jessehall): Improve error reporting. Can we enumerate possible
-        // errors and translate them to valid Vulkan result codes?
-        ALOGE("native_window_set_scaling_mode(SCALE_TO_WINDOW) failed: %s (%d)",
-              strerror(-err), err);
-        return VK_ERROR_INITIALIZATION_FAILED;
-    }
-
-    int query_value;
-    err = surface.window->query(surface.window.get(),
-                                NATIVE_WINDOW_MIN_UNDEQUEUED_BUFFERS,
-                                &query_value);
-    if (err != 0 || query_value < 0) {
-        // TODO(jessehall): Improve error reporting. Can we enumerate possible
-        // errors and translate them to valid Vulkan result codes?
-        ALOGE("window->query failed: %s (%d) value=%d", strerror(-err), err,
-              query_value);
-        return VK_ERROR_INITIALIZATION_FAILED;
-    }
-    uint32_t min_undequeued_buffers = static_cast<uint32_t>(query_value);
-    // The MIN_UNDEQUEUED_BUFFERS query doesn't know whether we'll be using
-    // async mode or not, and assumes not. But in async mode, the BufferQueue
-    // requires an extra undequeued buffer.
-    // See BufferQueueCore::getMinUndequeuedBufferCountLocked().
-    if (create_info->presentMode == VK_PRESENT_MODE_MAILBOX_KHR)
-        min_undequeued_buffers += 1;
-
-    uint32_t num_images =
-        (create_info->minImageCount - 1) + min_undequeued_buffers;
-    err = native_window_set_buffer_count(surface.window.get(), num_images);
-    if (err != 0) {
-        // TODO(jessehall): Improve error reporting. Can we enumerate possible
-        // errors and translate them to valid Vulkan result codes?
-        ALOGE("native_window_set_buffer_count(%d) failed: %s (%d)", num_images,
-              strerror(-err), err);
-        return VK_ERROR_INITIALIZATION_FAILED;
-    }
+    Swapchain* old_swapchain = SwapchainFromHandle(create_info->oldSwapchain);
 
     int gralloc_usage = 0;
     // TODO(jessehall): Remove conditional once all drivers have been updated
@@ -588,28 +958,39 @@ VkResult CreateSwapchainKHR(VkDevice device,
             &gralloc_usage);
         if (result != VK_SUCCESS) {
             ALOGE("vkGetSwapchainGrallocUsageANDROID failed: %d", result);
+            if (old_swapchain)
+                OrphanSwapchain(device, old_swapchain);
             return VK_ERROR_INITIALIZATION_FAILED;
         }
     } else {
         gralloc_usage = GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_TEXTURE;
     }
-    err = native_window_set_usage(surface.window.get(), gralloc_usage);
-    if (err != 0) {
-        // TODO(jessehall): Improve error reporting. Can we enumerate possible
-        // errors and translate them to valid Vulkan result codes?
-        ALOGE("native_window_set_usage failed: %s (%d)", strerror(-err), err);
-        return VK_ERROR_INITIALIZATION_FAILED;
-    }
 
-    int swap_interval =
-        create_info->presentMode == VK_PRESENT_MODE_MAILBOX_KHR ? 0 : 1;
-    err = surface.window->setSwapInterval(surface.window.get(), swap_interval);
-    if (err != 0) {
-        // TODO(jessehall): Improve error reporting. Can we enumerate possible
-        // errors and translate them to valid Vulkan result codes?
-        ALOGE("native_window->setSwapInterval(%d) failed: %s (%d)",
-              swap_interval, strerror(-err), err);
-        return VK_ERROR_INITIALIZATION_FAILED;
+    bool reuse_images =
+        old_swapchain &&
+        CanReuseImages(*old_swapchain, *create_info, gralloc_usage);
+    uint32_t num_images;
+    if (reuse_images) {
+        // The window is already set up for these buffers, only the transform
+        // can differ.
+        num_images = old_swapchain->num_images;
+        err = native_window_set_buffers_transform(
+            surface.window.get(),
+            InvertTransformToNative(create_info->preTransform));
+        if (err != 0) {
+            ALOGE("native_window_set_buffers_transform(%d) failed: %s (%d)",
+                  InvertTransformToNative(create_info->preTransform),
+                  strerror(-err), err);
+            OrphanSwapchain(device, old_swapchain);
+            return VK_ERROR_INITIALIZATION_FAILED;
+        }
+    } else {
+        if (old_swapchain)
+            OrphanSwapchain(device, old_swapchain);
+        result = ConfigureNativeWindow(surface, create_info, gralloc_usage,
+                                       &num_images);
+        if (result != VK_SUCCESS)
+            return result;
     }
 
     // -- Allocate our Swapchain object --
@@ -618,9 +999,40 @@ VkResult CreateSwapchainKHR(VkDevice device,
     void* mem = allocator->pfnAllocation(allocator->pUserData,
                                          sizeof(Swapchain), alignof(Swapchain),
                                          VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
-    if (!mem)
+    if (!mem) {
+        if (reuse_images)
+            OrphanSwapchain(device, old_swapchain);
         return VK_ERROR_OUT_OF_HOST_MEMORY;
-    Swapchain* swapchain = new (mem) Swapchain(surface, num_images);
+    }
+    Swapchain* swapchain =
+        new (mem) Swapchain(surface, *create_info, num_images, gralloc_usage);
+
+    if (reuse_images) {
+        // Stop the old swapchain's acquirer before taking its images over, a
+        // buffer it dequeued is cancelled. Images left in the old swapchain
+        // are empty, orphaning it then releases nothing.
+        StopAcquirer(*old_swapchain);
+        for (uint32_t i = 0; i < num_images; i++) {
+            Swapchain::Image& img = swapchain->images[i];
+            Swapchain::Image& old_img = old_swapchain->images[i];
+            img.image = old_img.image;
+            img.buffer = std::move(old_img.buffer);
+            old_img.image = VK_NULL_HANDLE;
+            old_img.buffer.clear();
+            MapBufferToImage(*swapchain, img.buffer.get(), i);
+        }
+        OrphanSwapchain(device, old_swapchain);
+
+        surface.swapchain_handle = HandleFromSwapchain(swapchain);
+        *swapchain_handle = surface.swapchain_handle;
+        ALOGD("swapchain of %u images created in %lld us, reusing images",
+              num_images,
+              static_cast<long long>(
+                  std::chrono::duration_cast<std::chrono::microseconds>(
+                      std::chrono::steady_clock::now() - start_time)
+                      .count()));
+        return VK_SUCCESS;
+    }
 
     // -- Dequeue all buffers and create a VkImage for each --
     // Any failures during or after this must cancel the dequeued buffers.
@@ -664,6 +1076,7 @@ VkResult CreateSwapchainKHR(VkDevice device,
         }
         img.buffer = buffer;
         img.dequeued = true;
+        MapBufferToImage(*swapchain, buffer, i);
 
         image_create.extent =
             VkExtent3D{static_cast<uint32_t>(img.buffer->width),
@@ -710,6 +1123,11 @@ VkResult CreateSwapchainKHR(VkDevice device,
 
     surface.swapchain_handle = HandleFromSwapchain(swapchain);
     *swapchain_handle = surface.swapchain_handle;
+    ALOGD("swapchain of %u images created in %lld us", num_images,
+          static_cast<long long>(
+              std::chrono::duration_cast<std::chrono::microseconds>(
+                  std::chrono::steady_clock::now() - start_time)
+                  .count()));
     return VK_SUCCESS;
 }
 
@@ -724,6 +1142,7 @@ void DestroySwapchainKHR(VkDevice device,
     bool active = swapchain->surface.swapchain_handle == swapchain_handle;
     ANativeWindow* window = active ? swapchain->surface.window.get() : nullptr;
 
+    StopAcquirer(*swapchain);
     for (uint32_t i = 0; i < swapchain->num_images; i++)
         ReleaseSwapchainImage(device, window, -1, swapchain->images[i]);
     if (active)
@@ -773,13 +1192,24 @@ VkResult AcquireNextImageKHR(VkDevice device,
     if (swapchain.surface.swapchain_handle != swapchain_handle)
         return VK_ERROR_OUT_OF_DATE_KHR;
 
-    ALOGW_IF(
-        timeout != UINT64_MAX,
-        "vkAcquireNextImageKHR: non-infinite timeouts not yet implemented");
+    // Mailbox swapchains and applications which don't want to block get their
+    // buffers from the acquire thread. Others dequeue synchronously, which
+    // costs no thread.
+    if (!swapchain.acquirer && (swapchain.mailbox || timeout != UINT64_MAX)) {
+        if (!StartAcquirer(swapchain) && timeout != UINT64_MAX)
+            ALOGW("vkAcquireNextImageKHR: timeout ignored");
+    }
 
     ANativeWindowBuffer* buffer;
     int fence_fd;
-    err = window->dequeueBuffer(window, &buffer, &fence_fd);
+    if (swapchain.acquirer) {
+        result = AcquireFromThread(*swapchain.acquirer, timeout, &err, &buffer,
+                                   &fence_fd);
+        if (result != VK_SUCCESS)
+            return result;
+    } else {
+        err = window->dequeueBuffer(window, &buffer, &fence_fd);
+    }
     if (err != 0) {
         // TODO(jessehall): Improve error reporting. Can we enumerate possible
         // errors and translate them to valid Vulkan result codes?
@@ -787,19 +1217,14 @@ VkResult AcquireNextImageKHR(VkDevice device,
         return VK_ERROR_INITIALIZATION_FAILED;
     }
 
-    uint32_t idx;
-    for (idx = 0; idx < swapchain.num_images; idx++) {
-        if (swapchain.images[idx].buffer.get() == buffer) {
-            swapchain.images[idx].dequeued = true;
-            swapchain.images[idx].dequeue_fence = fence_fd;
-            break;
-        }
-    }
+    uint32_t idx = ImageFromBuffer(swapchain, buffer);
     if (idx == swapchain.num_images) {
         ALOGE("dequeueBuffer returned unrecognized buffer");
         window->cancelBuffer(window, buffer, fence_fd);
         return VK_ERROR_OUT_OF_DATE_KHR;
     }
+    swapchain.images[idx].dequeued = true;
+    swapchain.images[idx].dequeue_fence = fence_fd;
 
     int fence_clone = -1;
     if (fence_fd != -1) {
@@ -856,7 +1281,27 @@ VkResult QueuePresentKHR(VkQueue queue, const VkPresentInfoKHR* present_info) {
     ALOGV_IF(present_info->sType != VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
              "vkQueuePresentKHR: invalid VkPresentInfoKHR structure type %d",
              present_info->sType);
-    ALOGV_IF(present_info->pNext, "VkPresentInfo::pNext != NULL");
+
+    const VkPresentTimesInfoGOOGLE* present_times = nullptr;
+    const bool display_timing =
+        GetData(queue).hook_extensions[ProcHook::GOOGLE_display_timing];
+    for (const VkPresentTimesInfoGOOGLE* next =
+             reinterpret_cast<const VkPresentTimesInfoGOOGLE*>(
+                 present_info->pNext);
+         next; next = reinterpret_cast<const VkPresentTimesInfoGOOGLE*>(
+                   next->pNext)) {
+        if (display_timing &&
+            next->sType == VK_STRUCTURE_TYPE_PRESENT_TIMES_INFO_GOOGLE) {
+            present_times = next;
+        } else {
+            ALOGV("vkQueuePresentKHR: ignored pNext structure type %d",
+                  next->sType);
+        }
+    }
+    ALOGV_IF(present_times &&
+                 present_times->swapchainCount != present_info->swapchainCount,
+             "vkQueuePresentKHR: VkPresentTimesInfoGOOGLE::swapchainCount "
+             "doesn't match VkPresentInfoKHR::swapchainCount");
 
     VkDevice device = GetData(queue).driver_device;
     const auto& dispatch = GetData(queue).driver;
@@ -883,7 +1328,24 @@ VkResult QueuePresentKHR(VkQueue queue, const VkPresentInfoKHR* present_info) {
         if (swapchain.surface.swapchain_handle ==
             present_info->pSwapchains[sc]) {
             ANativeWindow* window = swapchain.surface.window.get();
+            const VkPresentTimeGOOGLE* present_time =
+                (present_times && present_times->pTimes &&
+                 sc < present_times->swapchainCount)
+                    ? &present_times->pTimes[sc]
+                    : nullptr;
             if (swapchain_result == VK_SUCCESS) {
+                // The desired present time becomes the buffer's timestamp,
+                // which SurfaceFlinger doesn't latch the buffer before.
+                if (present_time && present_time->desiredPresentTime) {
+                    native_window_set_buffers_timestamp(
+                        window,
+                        static_cast<int64_t>(present_time->desiredPresentTime));
+                    swapchain.timestamp_set = true;
+                } else if (swapchain.timestamp_set) {
+                    native_window_set_buffers_timestamp(
+                        window, NATIVE_WINDOW_TIMESTAMP_AUTO);
+                    swapchain.timestamp_set = false;
+                }
                 err = window->queueBuffer(window, img.buffer.get(), fence);
                 // queueBuffer always closes fence, even on error
                 if (err != 0) {
@@ -898,6 +1360,29 @@ VkResult QueuePresentKHR(VkQueue queue, const VkPresentInfoKHR* present_info) {
                     img.dequeue_fence = -1;
                 }
                 img.dequeued = false;
+                if (err == 0 && display_timing) {
+                    if (present_time) {
+                        if (swapchain.num_timings == Swapchain::kMaxTimings) {
+                            std::move(std::begin(swapchain.timings) + 1,
+                                      std::end(swapchain.timings),
+                                      std::begin(swapchain.timings));
+                            swapchain.num_timings--;
+                        }
+                        Swapchain::Timing& timing =
+                            swapchain.timings[swapchain.num_timings++];
+                        timing.present_id = present_time->presentID;
+                        timing.desired_present_time =
+                            present_time->desiredPresentTime;
+                        timing.serial = swapchain.frames_queued;
+                        timing.actual_present_time = 0;
+                        timing.ready_time = 0;
+                    }
+                    swapchain.frames_queued++;
+                }
+                // Start dequeueing the next image while the application
+                // prepares its next frame.
+                if (swapchain.acquirer)
+                    RequestAcquire(*swapchain.acquirer);
             }
             if (swapchain_result != VK_SUCCESS) {
                 ReleaseSwapchainImage(device, window, fence, img);
@@ -918,5 +1403,70 @@ VkResult QueuePresentKHR(VkQueue queue, const VkPresentInfoKHR* present_info) {
     return final_result;
 }
 
+VKAPI_ATTR
+VkResult GetRefreshCycleDurationGOOGLE(
+    VkDevice,
+    VkSwapchainKHR swapchain_handle,
+    VkRefreshCycleDurationGOOGLE* properties) {
+    Swapchain& swapchain = *SwapchainFromHandle(swapchain_handle);
+    properties->refreshDuration =
+        static_cast<uint64_t>(RefreshDuration(swapchain));
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR
+VkResult GetPastPresentationTimingGOOGLE(
+    VkDevice,
+    VkSwapchainKHR swapchain_handle,
+    uint32_t* count,
+    VkPastPresentationTimingGOOGLE* timings) {
+    Swapchain& swapchain = *SwapchainFromHandle(swapchain_handle);
+    if (swapchain.surface.swapchain_handle != swapchain_handle)
+        return VK_ERROR_OUT_OF_DATE_KHR;
+
+    UpdateTimings(swapchain);
+
+    uint32_t num_ready = 0;
+    for (size_t i = 0; i < swapchain.num_timings; i++) {
+        if (swapchain.timings[i].actual_present_time)
+            num_ready++;
+    }
+    if (!timings) {
+        *count = num_ready;
+        return VK_SUCCESS;
+    }
+
+    // Reported presents are forgotten, the others are kept in order.
+    const nsecs_t refresh = RefreshDuration(swapchain);
+    uint32_t num_reported = 0;
+    size_t kept = 0;
+    for (size_t i = 0; i < swapchain.num_timings; i++) {
+        const Swapchain::Timing& timing = swapchain.timings[i];
+        if (!timing.actual_present_time || num_reported == *count) {
+            swapchain.timings[kept++] = timing;
+            continue;
+        }
+        // The image could have been shown at the first refresh after it
+        // was ready.
+        nsecs_t actual = timing.actual_present_time;
+        nsecs_t earliest = actual;
+        if (timing.ready_time && timing.ready_time < actual) {
+            earliest =
+                actual - ((actual - timing.ready_time) / refresh) * refresh;
+        }
+        VkPastPresentationTimingGOOGLE& out = timings[num_reported++];
+        out.presentID = timing.present_id;
+        out.desiredPresentTime = timing.desired_present_time;
+        out.actualPresentTime = static_cast<uint64_t>(actual);
+        out.earliestPresentTime = static_cast<uint64_t>(earliest);
+        out.presentMargin = static_cast<uint64_t>(
+            timing.ready_time ? earliest - timing.ready_time : 0);
+    }
+    swapchain.num_timings = kept;
+    *count = num_reported;
+
+    return num_reported < num_ready ? VK_INCOMPLETE : VK_SUCCESS;
+}
+
 }  // namespace driver
 }  // namespace vulkan
@@ -0,0 +1,211 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures what calling a Vulkan command costs depending on how the
+// application got hold of it. Commands exported by libvulkan and those
+// returned by vkGetInstanceProcAddr go through the loader's trampolines,
+// which look up the dispatch table of the object. Commands returned by
+// vkGetDeviceProcAddr are the first layer's, or the driver's when there is no
+// layer, unless the loader has to intercept them.
+//
+// Run it with and without layers enabled (debug.vulkan.layers) to see what
+// the layers add.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <vulkan/vulkan.h>
+
+#define LOG_TAG "vkdispatch"
+#include <log/log.h>
+
+namespace {
+
+const uint32_t kDefaultIterations = 1000000;
+
+[[noreturn]] void die(const char* proc, VkResult result) {
+    fprintf(stderr, "%s failed: %d\n", proc, result);
+    exit(1);
+}
+
+uint64_t Now() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull +
+           static_cast<uint64_t>(ts.tv_nsec);
+}
+
+template <typename Functor>
+void Measure(const char* name, uint32_t iterations, Functor functor) {
+    // warm up caches and lazily bound symbols
+    for (uint32_t i = 0; i < iterations / 16; i++)
+        functor();
+    uint64_t start = Now();
+    for (uint32_t i = 0; i < iterations; i++)
+        functor();
+    uint64_t elapsed = Now() - start;
+    printf("%-48s %8.2f ns/call\n", name,
+           static_cast<double>(elapsed) / static_cast<double>(iterations));
+}
+
+}  // namespace
+
+int main(int argc, char const* argv[]) {
+    uint32_t iterations = kDefaultIterations;
+    if (argc > 1)
+        iterations = static_cast<uint32_t>(strtoul(argv[1], nullptr, 0));
+    if (!iterations) {
+        fputs("usage: vkdispatch [iterations]\n", stderr);
+        return 1;
+    }
+
+    VkResult result;
+
+    const VkInstanceCreateInfo instance_info = {
+        .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+    };
+    VkInstance instance;
+    result = vkCreateInstance(&instance_info, nullptr, &instance);
+    if (result != VK_SUCCESS)
+        die("vkCreateInstance", result);
+
+    uint32_t num_gpus = 1;
+    VkPhysicalDevice gpu;
+    result = vkEnumeratePhysicalDevices(instance, &num_gpus, &gpu);
+    if (result != VK_SUCCESS && result != VK_INCOMPLETE)
+        die("vkEnumeratePhysicalDevices", result);
+    if (!num_gpus) {
+        fputs("no physical device\n", stderr);
+        return 1;
+    }
+
+    float queue_priorities[] = {0.0};
+    const VkDeviceQueueCreateInfo queue_info = {
+        .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+        .queueFamilyIndex = 0,
+        .queueCount = 1,
+        .pQueuePriorities = queue_priorities,
+    };
+    const VkDeviceCreateInfo device_info = {
+        .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+        .queueCreateInfoCount = 1,
+        .pQueueCreateInfos = &queue_info,
+    };
+    VkDevice device;
+    result = vkCreateDevice(gpu, &device_info, nullptr, &device);
+    if (result != VK_SUCCESS)
+        die("vkCreateDevice", result);
+
+    const VkCommandPoolCreateInfo pool_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+        .queueFamilyIndex = 0,
+    };
+    VkCommandPool pool;
+    result = vkCreateCommandPool(device, &pool_info, nullptr, &pool);
+    if (result != VK_SUCCESS)
+        die("vkCreateCommandPool", result);
+
+    const VkCommandBufferAllocateInfo cmdbuf_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = pool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1,
+    };
+    VkCommandBuffer cmdbuf;
+    result = vkAllocateCommandBuffers(device, &cmdbuf_info, &cmdbuf);
+    if (result != VK_SUCCESS)
+        die("vkAllocateCommandBuffers", result);
+
+    const VkFenceCreateInfo fence_info = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+        .flags = VK_FENCE_CREATE_SIGNALED_BIT,
+    };
+    VkFence fence;
+    result = vkCreateFence(device, &fence_info, nullptr, &fence);
+    if (result != VK_SUCCESS)
+        die("vkCreateFence", result);
+
+    const VkCommandBufferBeginInfo begin_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+    };
+    result = vkBeginCommandBuffer(cmdbuf, &begin_info);
+    if (result != VK_SUCCESS)
+        die("vkBeginCommandBuffer", result);
+
+    auto ipa_set_line_width = reinterpret_cast<PFN_vkCmdSetLineWidth>(
+        vkGetInstanceProcAddr(instance, "vkCmdSetLineWidth"));
+    auto dpa_set_line_width = reinterpret_cast<PFN_vkCmdSetLineWidth>(
+        vkGetDeviceProcAddr(device, "vkCmdSetLineWidth"));
+    auto ipa_get_fence_status = reinterpret_cast<PFN_vkGetFenceStatus>(
+        vkGetInstanceProcAddr(instance, "vkGetFenceStatus"));
+    auto dpa_get_fence_status = reinterpret_cast<PFN_vkGetFenceStatus>(
+        vkGetDeviceProcAddr(device, "vkGetFenceStatus"));
+    auto dpa_get_queue = reinterpret_cast<PFN_vkGetDeviceQueue>(
+        vkGetDeviceProcAddr(device, "vkGetDeviceQueue"));
+
+    printf("vkCmdSetLineWidth from vkGetDeviceProcAddr is %s\n",
+           (dpa_set_line_width == vkCmdSetLineWidth) ? "the trampoline"
+                                                     : "direct");
+
+    // Nothing is ever recorded for real, so the command buffer is reset now
+    // and then to keep drivers from growing it without bounds.
+    uint32_t recorded = 0;
+    auto reset_now_and_then = [&]() {
+        if (++recorded % 4096 == 0) {
+            vkEndCommandBuffer(cmdbuf);
+            vkResetCommandBuffer(cmdbuf, 0);
+            vkBeginCommandBuffer(cmdbuf, &begin_info);
+        }
+    };
+
+    Measure("vkCmdSetLineWidth exported", iterations, [&]() {
+        vkCmdSetLineWidth(cmdbuf, 1.0f);
+        reset_now_and_then();
+    });
+    Measure("vkCmdSetLineWidth vkGetInstanceProcAddr", iterations, [&]() {
+        ipa_set_line_width(cmdbuf, 1.0f);
+        reset_now_and_then();
+    });
+    Measure("vkCmdSetLineWidth vkGetDeviceProcAddr", iterations, [&]() {
+        dpa_set_line_width(cmdbuf, 1.0f);
+        reset_now_and_then();
+    });
+
+    Measure("vkGetFenceStatus exported", iterations,
+            [&]() { vkGetFenceStatus(device, fence); });
+    Measure("vkGetFenceStatus vkGetInstanceProcAddr", iterations,
+            [&]() { ipa_get_fence_status(device, fence); });
+    Measure("vkGetFenceStatus vkGetDeviceProcAddr", iterations,
+            [&]() { dpa_get_fence_status(device, fence); });
+
+    // intercepted by the loader, which sets up the dispatch of the queue
+    VkQueue queue;
+    Measure("vkGetDeviceQueue exported", iterations,
+            [&]() { vkGetDeviceQueue(device, 0, 0, &queue); });
+    Measure("vkGetDeviceQueue vkGetDeviceProcAddr", iterations,
+            [&]() { dpa_get_queue(device, 0, 0, &queue); });
+
+    vkEndCommandBuffer(cmdbuf);
+    vkFreeCommandBuffers(device, pool, 1, &cmdbuf);
+    vkDestroyCommandPool(device, pool, nullptr);
+    vkDestroyFence(device, fence, nullptr);
+    vkDestroyDevice(device, nullptr);
+    vkDestroyInstance(instance, nullptr);
+
+    return 0;
+}
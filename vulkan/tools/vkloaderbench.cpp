@@ -0,0 +1,320 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Times the loader paths an application goes through most: instance and
+// device creation, command dispatch, swapchain creation and the
+// acquire/present loop. Presents go to an in-process BufferQueue whose
+// consumer releases each buffer as soon as it's queued, so nothing waits on
+// the display.
+//
+// Meant to run against the null driver (vulkan.default), where the time
+// measured is nearly all the loader's, to catch regressions in libvulkan.
+// With a real driver the numbers include the driver's own overhead.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <vulkan/vulkan.h>
+
+#include <gui/BufferItem.h>
+#include <gui/BufferQueue.h>
+#include <gui/IConsumerListener.h>
+#include <gui/Surface.h>
+#include <ui/Fence.h>
+
+using namespace android;
+
+namespace {
+
+const uint32_t kDefaultIterations = 100000;
+
+// Creating objects costs way more than calling commands, they get this many
+// times fewer iterations.
+const uint32_t kCreateDivisor = 100;
+
+struct DiscardingListener : public BnConsumerListener {
+    virtual void onFrameAvailable(const BufferItem& /* item */) {}
+    virtual void onBuffersReleased() {}
+    virtual void onSidebandStreamChanged() {}
+};
+
+[[noreturn]] void die(const char* proc, VkResult result) {
+    fprintf(stderr, "%s failed: %d\n", proc, result);
+    exit(1);
+}
+
+uint64_t Now() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull +
+           static_cast<uint64_t>(ts.tv_nsec);
+}
+
+template <typename Functor>
+void Measure(const char* name, uint32_t iterations, Functor functor) {
+    if (!iterations)
+        iterations = 1;
+    // warm up caches and lazily bound symbols
+    functor();
+    uint64_t start = Now();
+    for (uint32_t i = 0; i < iterations; i++)
+        functor();
+    uint64_t elapsed = Now() - start;
+    printf("%-40s %12.2f ns/call\n", name,
+           static_cast<double>(elapsed) / static_cast<double>(iterations));
+}
+
+const char* const kInstanceExtensions[] = {
+    VK_KHR_SURFACE_EXTENSION_NAME, VK_KHR_ANDROID_SURFACE_EXTENSION_NAME,
+};
+const char* const kDeviceExtensions[] = {
+    VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+};
+
+const VkInstanceCreateInfo kInstanceInfo = {
+    .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+    .enabledExtensionCount = 2,
+    .ppEnabledExtensionNames = kInstanceExtensions,
+};
+
+const float kQueuePriorities[] = {0.0f};
+const VkDeviceQueueCreateInfo kQueueInfo = {
+    .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+    .queueFamilyIndex = 0,
+    .queueCount = 1,
+    .pQueuePriorities = kQueuePriorities,
+};
+const VkDeviceCreateInfo kDeviceInfo = {
+    .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+    .queueCreateInfoCount = 1,
+    .pQueueCreateInfos = &kQueueInfo,
+    .enabledExtensionCount = 1,
+    .ppEnabledExtensionNames = kDeviceExtensions,
+};
+
+}  // namespace
+
+int main(int argc, char const* argv[]) {
+    uint32_t iterations = kDefaultIterations;
+    if (argc > 1)
+        iterations = static_cast<uint32_t>(strtoul(argv[1], nullptr, 0));
+    if (!iterations) {
+        fputs("usage: vkloaderbench [iterations]\n", stderr);
+        return 1;
+    }
+    const uint32_t create_iterations = iterations / kCreateDivisor;
+
+    VkResult result;
+
+    // -- Instance and device --
+
+    Measure("vkCreateInstance+vkDestroyInstance", create_iterations, [&]() {
+        VkInstance instance;
+        VkResult r = vkCreateInstance(&kInstanceInfo, nullptr, &instance);
+        if (r != VK_SUCCESS)
+            die("vkCreateInstance", r);
+        vkDestroyInstance(instance, nullptr);
+    });
+
+    VkInstance instance;
+    result = vkCreateInstance(&kInstanceInfo, nullptr, &instance);
+    if (result != VK_SUCCESS)
+        die("vkCreateInstance", result);
+
+    uint32_t num_gpus = 1;
+    VkPhysicalDevice gpu;
+    result = vkEnumeratePhysicalDevices(instance, &num_gpus, &gpu);
+    if (result != VK_SUCCESS && result != VK_INCOMPLETE)
+        die("vkEnumeratePhysicalDevices", result);
+    if (!num_gpus) {
+        fputs("no physical device\n", stderr);
+        return 1;
+    }
+
+    Measure("vkEnumeratePhysicalDevices", iterations, [&]() {
+        uint32_t count = 1;
+        VkPhysicalDevice dev;
+        vkEnumeratePhysicalDevices(instance, &count, &dev);
+    });
+
+    Measure("vkCreateDevice+vkDestroyDevice", create_iterations, [&]() {
+        VkDevice device;
+        VkResult r = vkCreateDevice(gpu, &kDeviceInfo, nullptr, &device);
+        if (r != VK_SUCCESS)
+            die("vkCreateDevice", r);
+        vkDestroyDevice(device, nullptr);
+    });
+
+    VkDevice device;
+    result = vkCreateDevice(gpu, &kDeviceInfo, nullptr, &device);
+    if (result != VK_SUCCESS)
+        die("vkCreateDevice", result);
+    VkQueue queue;
+    vkGetDeviceQueue(device, 0, 0, &queue);
+
+    // -- Command dispatch --
+
+    const VkCommandPoolCreateInfo pool_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+        .queueFamilyIndex = 0,
+    };
+    VkCommandPool pool;
+    result = vkCreateCommandPool(device, &pool_info, nullptr, &pool);
+    if (result != VK_SUCCESS)
+        die("vkCreateCommandPool", result);
+
+    const VkCommandBufferAllocateInfo cmdbuf_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = pool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1,
+    };
+    VkCommandBuffer cmdbuf;
+    result = vkAllocateCommandBuffers(device, &cmdbuf_info, &cmdbuf);
+    if (result != VK_SUCCESS)
+        die("vkAllocateCommandBuffers", result);
+
+    const VkCommandBufferBeginInfo begin_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+    };
+    vkBeginCommandBuffer(cmdbuf, &begin_info);
+    Measure("vkCmdSetLineWidth", iterations,
+            [&]() { vkCmdSetLineWidth(cmdbuf, 1.0f); });
+    vkEndCommandBuffer(cmdbuf);
+
+    Measure("vkAllocateCommandBuffers+vkFree...", iterations, [&]() {
+        VkCommandBuffer cb;
+        VkResult r = vkAllocateCommandBuffers(device, &cmdbuf_info, &cb);
+        if (r != VK_SUCCESS)
+            die("vkAllocateCommandBuffers", r);
+        vkFreeCommandBuffers(device, pool, 1, &cb);
+    });
+
+    const VkSubmitInfo submit_info = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &cmdbuf,
+    };
+    Measure("vkQueueSubmit", iterations,
+            [&]() { vkQueueSubmit(queue, 1, &submit_info, VK_NULL_HANDLE); });
+
+    // -- Swapchain --
+
+    sp<IGraphicBufferProducer> producer;
+    sp<IGraphicBufferConsumer> consumer;
+    BufferQueue::createBufferQueue(&producer, &consumer);
+    consumer->consumerConnect(new DiscardingListener, false);
+    consumer->setDefaultBufferSize(256, 256);
+    sp<Surface> window = new Surface(producer, true);
+
+    const VkAndroidSurfaceCreateInfoKHR surface_info = {
+        .sType = VK_STRUCTURE_TYPE_ANDROID_SURFACE_CREATE_INFO_KHR,
+        .window = window.get(),
+    };
+    VkSurfaceKHR surface;
+    result = vkCreateAndroidSurfaceKHR(instance, &surface_info, nullptr,
+                                       &surface);
+    if (result != VK_SUCCESS)
+        die("vkCreateAndroidSurfaceKHR", result);
+
+    VkSwapchainCreateInfoKHR swapchain_info = {
+        .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
+        .surface = surface,
+        .minImageCount = 2,
+        .imageFormat = VK_FORMAT_R8G8B8A8_UNORM,
+        .imageColorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR,
+        .imageExtent = {256, 256},
+        .imageArrayLayers = 1,
+        .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+        .imageSharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR,
+        .compositeAlpha = VK_COMPOSITE_ALPHA_INHERIT_BIT_KHR,
+        .presentMode = VK_PRESENT_MODE_FIFO_KHR,
+        .clipped = VK_TRUE,
+    };
+
+    Measure("vkCreateSwapchainKHR+vkDestroy...", create_iterations, [&]() {
+        VkSwapchainKHR sc;
+        VkResult r = vkCreateSwapchainKHR(device, &swapchain_info, nullptr,
+                                          &sc);
+        if (r != VK_SUCCESS)
+            die("vkCreateSwapchainKHR", r);
+        vkDestroySwapchainKHR(device, sc, nullptr);
+    });
+
+    VkSwapchainKHR swapchain;
+    result =
+        vkCreateSwapchainKHR(device, &swapchain_info, nullptr, &swapchain);
+    if (result != VK_SUCCESS)
+        die("vkCreateSwapchainKHR", result);
+
+    // what recreating the swapchain after a rotation costs
+    Measure("vkCreateSwapchainKHR(oldSwapchain)", create_iterations, [&]() {
+        swapchain_info.oldSwapchain = swapchain;
+        VkSwapchainKHR sc;
+        VkResult r = vkCreateSwapchainKHR(device, &swapchain_info, nullptr,
+                                          &sc);
+        if (r != VK_SUCCESS)
+            die("vkCreateSwapchainKHR", r);
+        vkDestroySwapchainKHR(device, swapchain, nullptr);
+        swapchain = sc;
+    });
+
+    const VkFenceCreateInfo fence_info = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+    };
+    VkFence fence;
+    result = vkCreateFence(device, &fence_info, nullptr, &fence);
+    if (result != VK_SUCCESS)
+        die("vkCreateFence", result);
+
+    Measure("vkAcquireNextImageKHR+vkQueuePresentKHR", iterations, [&]() {
+        uint32_t index;
+        VkResult r = vkAcquireNextImageKHR(device, swapchain, UINT64_MAX,
+                                           VK_NULL_HANDLE, fence, &index);
+        if (r != VK_SUCCESS)
+            die("vkAcquireNextImageKHR", r);
+        const VkPresentInfoKHR present_info = {
+            .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+            .swapchainCount = 1,
+            .pSwapchains = &swapchain,
+            .pImageIndices = &index,
+        };
+        r = vkQueuePresentKHR(queue, &present_info);
+        if (r != VK_SUCCESS)
+            die("vkQueuePresentKHR", r);
+
+        BufferItem item;
+        if (consumer->acquireBuffer(&item, 0) == NO_ERROR) {
+            consumer->releaseBuffer(item.mSlot, item.mFrameNumber,
+                                    EGL_NO_DISPLAY, EGL_NO_SYNC_KHR,
+                                    Fence::NO_FENCE);
+        }
+    });
+
+    vkDestroyFence(device, fence, nullptr);
+    vkDestroySwapchainKHR(device, swapchain, nullptr);
+    vkDestroySurfaceKHR(instance, surface, nullptr);
+    vkFreeCommandBuffers(device, pool, 1, &cmdbuf);
+    vkDestroyCommandPool(device, pool, nullptr);
+    vkDestroyDevice(device, nullptr);
+    vkDestroyInstance(instance, nullptr);
+
+    return 0;
+}